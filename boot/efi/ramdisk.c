@@ -6,6 +6,7 @@
 #include <tilck/common/page_size.h>
 #include <tilck/common/assert.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/crd.h>
 #include <tilck/common/utils.h>
 
 #include "defs.h"
@@ -15,8 +16,9 @@ struct load_ramdisk_ctx {
 
    EFI_BLOCK_IO_PROTOCOL *blockio;
 
-   UINT32 total_fat_size;
+   UINT32 total_fat_size;           /* Or the header size, if is_crd */
    UINT32 rounded_tot_fat_sz;       /* Rounded up at PAGE_SIZE */
+   bool is_crd;                     /* Compressed ramdisk (see crd.h) */
 
    UINT32 tot_used_bytes;
    UINT32 rounded_tot_used_bytes;   /* Rounded up at PAGE_SIZE */
@@ -43,8 +45,19 @@ LoadRamdisk_GetTotFatSize(struct load_ramdisk_ctx *ctx)
    status = ReadAlignedBlock(ctx->blockio, initrd_off, PAGE_SIZE, fat_hdr);
    HANDLE_EFI_ERROR("ReadAlignedBlock");
 
-   fat_sec_sz = fat_get_sector_size(fat_hdr);
-   ctx->total_fat_size = (fat_get_first_data_sector(fat_hdr) + 1) * fat_sec_sz;
+   if (crd_is_image(fat_hdr)) {
+
+      /* Compressed: we just need its header to know how big the image is */
+      ctx->is_crd = true;
+      ctx->total_fat_size = round_up_at(crd_hdr_size(fat_hdr), SECTOR_SIZE);
+
+   } else {
+
+      fat_sec_sz = fat_get_sector_size(fat_hdr);
+      ctx->total_fat_size =
+         (fat_get_first_data_sector(fat_hdr) + 1) * fat_sec_sz;
+   }
+
    ctx->rounded_tot_fat_sz = round_up_at(ctx->total_fat_size, PAGE_SIZE);
 
    status = BS->FreePages(paddr, 1);
@@ -76,7 +89,11 @@ LoadRamdisk_GetTotUsedBytes(struct load_ramdisk_ctx *ctx)
                              fat_hdr);
    HANDLE_EFI_ERROR("ReadAlignedBlock");
 
-   ctx->tot_used_bytes = fat_calculate_used_bytes(fat_hdr);
+   if (ctx->is_crd)
+      ctx->tot_used_bytes = crd_image_size(fat_hdr);
+   else
+      ctx->tot_used_bytes = fat_calculate_used_bytes(fat_hdr);
+
    ctx->rounded_tot_used_bytes = round_up_at(ctx->tot_used_bytes, PAGE_SIZE);
 
    /*
@@ -99,6 +116,9 @@ LoadRamdisk_CompactClusters(struct load_ramdisk_ctx *ctx)
    void *fat_hdr = ctx->fat_hdr;
    UINT32 ff_clu_off;
 
+   if (ctx->is_crd)
+      return status; /* The clusters have been compacted by crdmake */
+
    ff_clu_off = fat_get_first_free_cluster_off(fat_hdr);
 
    if (ff_clu_off < ctx->tot_used_bytes) {
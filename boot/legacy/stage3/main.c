@@ -123,6 +123,8 @@ void bootloader_main(void)
    if (!success)
       panic("read_write_params failed");
 
+   detect_ext_reads(current_device);
+
    /* Load the BOOTPART from which we'll load the kernel */
    success =
       load_fat_ramdisk(LOADING_BOOTPART_STR,
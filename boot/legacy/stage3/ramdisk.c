@@ -4,6 +4,8 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/crd.h>
+#include <tilck/common/utils.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/color_defs.h>
 
@@ -35,7 +37,7 @@ static void
 read_sectors_with_progress(const char *prefix_str,
                            u32 paddr, u32 first_sector, u32 count)
 {
-   const u32 chunk_sectors = 1024;
+   const u32 chunk_sectors = 4096;
    const u32 chunks_count = count / chunk_sectors;
    const u32 rem = count - chunks_count * chunk_sectors;
 
@@ -63,6 +65,9 @@ rd_compact_clusters(void *ramdisk, u32 rd_size)
 {
    u32 ff_clu_off;         /* offset of ramdisk's first free cluster */
 
+   if (crd_is_image(ramdisk))
+      return rd_size;      /* compressed: compacted by crdmake already */
+
    ff_clu_off = fat_get_first_free_cluster_off(ramdisk);
 
    if (ff_clu_off < rd_size) {
@@ -168,9 +173,11 @@ load_fat_ramdisk(const char *load_str,
    u32 rd_sectors;         /* rd_size in 512-bytes sectors (rounded-up) */
    u32 rd_size;            /* ramdisk size (used bytes in the fat partition) */
    u32 rd_metadata_sz;     /* size of ramdisk's metadata, including the FATs */
+   u32 crd_hdr_sz;         /* size of the header of a compressed ramdisk */
    ulong rd_paddr;         /* ramdisk physical address */
    ulong free_mem;
    ulong size_to_alloc;
+   u32 start_ticks;
 
    printk("%s", load_str);
    free_mem = get_usable_mem(&g_meminfo, min_paddr, SECTOR_SIZE);
@@ -181,6 +188,23 @@ load_fat_ramdisk(const char *load_str,
    // Read FAT's header
    read_sectors(free_mem, first_sec, 1 /* read just 1 sector */);
 
+   if (crd_is_image((void *)free_mem)) {
+
+      /*
+       * Compressed ramdisk: the kernel will decompress it on demand, we just
+       * need to load it as it is. Read its whole header for the image size.
+       */
+      crd_hdr_sz = round_up_at(crd_hdr_size((void *)free_mem), SECTOR_SIZE);
+      free_mem = get_usable_mem(&g_meminfo, min_paddr, crd_hdr_sz);
+
+      if (!free_mem || overlap_with_kernel_file(free_mem, crd_hdr_sz))
+         goto oom;
+
+      read_sectors(free_mem, first_sec, crd_hdr_sz / SECTOR_SIZE);
+      rd_size = crd_image_size((void *)free_mem);
+      goto load;
+   }
+
    // Do some sanity checks against data corruption
    if (!check_fat_header((void *)free_mem))
       goto corrupted;
@@ -200,6 +224,7 @@ load_fat_ramdisk(const char *load_str,
    // Finally we're able to determine how big is the fatpart (pure data)
    rd_size = fat_calculate_used_bytes((void *)free_mem);
 
+load:
    /* Calculate rd_size in sectors, rounding up at SECTOR_SIZE */
    rd_sectors = (rd_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
 
@@ -215,13 +240,15 @@ load_fat_ramdisk(const char *load_str,
       goto oom;
 
    rd_paddr = free_mem;
+   start_ticks = bios_get_ticks();
    read_sectors_with_progress(load_str,
                               rd_paddr,
                               first_sec,
                               rd_sectors);
 
    bt_movecur(bt_get_curr_row(), 0);
-   printk("%s", load_str);
+   printk("%s(%u ms) ",
+          load_str, bios_ticks_to_ms(bios_get_ticks() - start_ticks));
    write_ok_msg();
 
    /* Return ramdisk's paddr and size using the OUT parameters */
@@ -120,6 +120,30 @@ extern u32 curr_sec;
 
 u16 saved_cx;
 u16 saved_dx;
+u8 use_ext_reads;
+
+/*
+ * Checks if the BIOS supports the int 0x13 extensions for `drive`: if so,
+ * read_sectors() will use the LBA-based extended reads, which transfer many
+ * more sectors per call than the CHS reads, limited to one track.
+ */
+bool detect_ext_reads(u8 drive)
+{
+   u32 eax, ebx, ecx, edx, esi, edi, flags;
+
+   eax = 0x41 << 8; /* AH = check extensions present */
+   ebx = 0x55AA;
+   edx = drive;     /* DL = drive number */
+
+   realmode_call(&realmode_int_13h, &eax, &ebx, &ecx, &edx, &esi, &edi, &flags);
+
+   /* CX bit 0: the extended disk access functions (0x42 included) */
+   use_ext_reads = !(flags & EFLAGS_CF) &&
+                   (ebx & 0xffff) == 0xAA55 &&
+                   (ecx & 1);
+
+   return use_ext_reads;
+}
 
 void dump_chs(void)
 {
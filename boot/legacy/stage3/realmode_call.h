@@ -48,3 +48,19 @@ bool read_drive_params(u8 drive,
                        u32 *cylinder_count);
 
 void read_sectors(u32 dest_paddr, u32 lba_sector, u32 sector_count);
+bool detect_ext_reads(u8 drive);
+
+/*
+ * The BIOS timer ticks (~18.2 Hz) since midnight, from the BIOS data area.
+ * Note: the counter advances only while we're in (un)real mode, with the
+ * interrupts enabled: that's fine for measuring the disk reads.
+ */
+static ALWAYS_INLINE u32 bios_get_ticks(void)
+{
+   return *(volatile u32 *)0x46C;
+}
+
+static ALWAYS_INLINE u32 bios_ticks_to_ms(u32 ticks)
+{
+   return ticks * 10000 / 182;
+}
@@ -39,9 +39,20 @@ void get_cpu_features(void)
       goto ext_features;
 
    /* CPUID[7] supported */
-   if (f->ecx1.avx) {
-      cpuid(7, &a, &b, &c, &d);
+   cpuid(7, &a, &b, &c, &d);
+   f->erms = !!(b & (1 << 9));
+   f->fsgsbase = !!(b & (1 << 0));
+
+   if (f->ecx1.avx)
       f->avx2 = !!(b & (1 << 5)) && !!(b & (1 << 3)) && !!(b & (1 << 8));
+
+   if (f->max_basic_cpuid_cmd < 0xd)
+      goto ext_features;
+
+   /* CPUID[0xd] supported: sub-leaf 1 describes the XSAVE extensions */
+   if (f->ecx1.xsave) {
+      cpuid_count(0xd, 1, &a, &b, &c, &d);
+      f->xsaveopt = !!(a & (1 << 0));
    }
 
 ext_features:
@@ -179,6 +190,15 @@ void dump_x86_features(void)
    if (x86_cpu_features.avx2)
       w += (u32)snprintk(buf + w, sizeof(buf) - w, "avx2 ");
 
+   if (x86_cpu_features.xsaveopt)
+      w += (u32)snprintk(buf + w, sizeof(buf) - w, "xsaveopt ");
+
+   if (x86_cpu_features.erms)
+      w += (u32)snprintk(buf + w, sizeof(buf) - w, "erms ");
+
+   if (x86_cpu_features.fsgsbase)
+      w += (u32)snprintk(buf + w, sizeof(buf) - w, "fsgsbase ");
+
    if (w)
       printk("%s\n", buf);
 }
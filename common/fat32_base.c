@@ -21,10 +21,7 @@
  */
 
 
-#define FAT_ENTRY_LAST                       ((char)0)
-#define FAT_ENTRY_AVAILABLE                  ((char)0xE5)
-
-static u8 shortname_checksum(u8 *shortname)
+u8 fat_shortname_checksum(u8 *shortname)
 {
    u8 sum = 0;
 
@@ -229,7 +226,7 @@ static const char *
 finalize_long_name(struct fat_walk_long_name_ctx *ctx,
                    struct fat_entry *e)
 {
-   const s16 e_checksum = shortname_checksum((u8 *)e->DIR_Name);
+   const s16 e_checksum = fat_shortname_checksum((u8 *)e->DIR_Name);
 
    if (ctx->lname_chksum == e_checksum) {
       ctx->lname_buf[ctx->lname_sz] = 0;
@@ -241,14 +238,21 @@ finalize_long_name(struct fat_walk_long_name_ctx *ctx,
 }
 
 int
-fat_walk(struct fat_walk_static_params *p, u32 cluster)
+fat_walk_resume(struct fat_walk_static_params *p, struct fat_walk_pos *pos)
 {
    struct fat_walk_long_name_ctx *const ctx = p->ctx;
    const u32 entries_per_cluster = fat_get_dir_entries_per_cluster(p->h);
    struct fat_entry *dentries = NULL;
+   struct fat_walk_pos start = *pos;   /* first slot of the current entry */
+   bool in_lname = false;
+   u32 cluster = pos->cluster;
+   u32 first = pos->index;
 
    ASSERT(p->ft == fat16_type || p->ft == fat32_type);
 
+   if (pos->eof)
+      return 0;
+
    if (cluster == 0)
       dentries = fat_get_rootdir(p->h, p->ft, &cluster);
 
@@ -274,24 +278,39 @@ fat_walk(struct fat_walk_static_params *p, u32 cluster)
 
       ASSERT(dentries != NULL);
 
-      for (u32 i = 0; i < entries_per_cluster; i++) {
+      for (u32 i = first; i < entries_per_cluster; i++) {
 
-         if (ctx && is_long_name_entry(&dentries[i])) {
-            fat_handle_long_dir_entry(ctx, (void *)&dentries[i]);
+         if (!in_lname)
+            start = (struct fat_walk_pos) { .cluster = cluster, .index = i };
+
+         // the entry was used, but now is free (long name slots included)
+         if (dentries[i].DIR_Name[0] == FAT_ENTRY_AVAILABLE) {
+            in_lname = false;
             continue;
          }
 
-         // the first "file" is the volume ID. Skip it.
-         if (dentries[i].volume_id)
+         if (is_long_name_entry(&dentries[i])) {
+
+            /* The long name slots belong to the following entry */
+            in_lname = true;
+
+            if (ctx)
+               fat_handle_long_dir_entry(ctx, (void *)&dentries[i]);
+
             continue;
+         }
 
-         // the entry was used, but now is free
-         if (dentries[i].DIR_Name[0] == FAT_ENTRY_AVAILABLE)
+         in_lname = false;
+
+         // the first "file" is the volume ID. Skip it.
+         if (dentries[i].volume_id)
             continue;
 
          // that means all the rest of the entries are free.
-         if (dentries[i].DIR_Name[0] == FAT_ENTRY_LAST)
+         if (dentries[i].DIR_Name[0] == FAT_ENTRY_LAST) {
+            pos->eof = true;
             return 0;
+         }
 
          const char *long_name_ptr = NULL;
 
@@ -307,10 +326,13 @@ fat_walk(struct fat_walk_static_params *p, u32 cluster)
 
          if (ret) {
             /* the callback returns a value != 0 to request a walk STOP. */
+            *pos = start;
             return 0;
          }
       }
 
+      first = 0;
+
       /*
        * In case fat_walk has been called on the root dir on a FAT16,
        * cluster is 0 (invalid) and there is no next cluster in the chain. This
@@ -335,9 +357,17 @@ fat_walk(struct fat_walk_static_params *p, u32 cluster)
       cluster = val;
    }
 
+   pos->eof = true;
    return 0;
 }
 
+int
+fat_walk(struct fat_walk_static_params *p, u32 cluster)
+{
+   struct fat_walk_pos pos = { .cluster = cluster };
+   return fat_walk_resume(p, &pos);
+}
+
 u32 fat_get_cluster_count(struct fat_hdr *hdr)
 {
    const u32 FATSz = fat_get_FATSz(hdr);
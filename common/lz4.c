@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/lz4.h>
+
+/*
+ * A LZ4 block is a sequence of: a token byte (high nibble: literals length,
+ * low nibble: match length - LZ4_MIN_MATCH), the literals, a 16-bit LE
+ * offset and the match. A nibble equal to 15 means that the length continues
+ * in the next bytes, until a byte != 255. The last sequence has only literals.
+ */
+
+static int lz4_read_len(const u8 **ipp, const u8 *iend, u32 *len)
+{
+   u8 b;
+
+   do {
+
+      if (*ipp == iend)
+         return -1;
+
+      b = *(*ipp)++;
+      *len += b;
+
+   } while (b == 255);
+
+   return 0;
+}
+
+int lz4_decompress_block(const void *src, u32 src_len, void *dst, u32 dst_len)
+{
+   const u8 *ip = src;
+   const u8 *const iend = ip + src_len;
+   u8 *op = dst;
+   u8 *const oend = op + dst_len;
+   const u8 *match;
+   u32 len, off;
+   u8 token;
+
+   while (ip < iend) {
+
+      token = *ip++;
+      len = token >> 4;
+
+      if (len == 15 && lz4_read_len(&ip, iend, &len))
+         return -1;
+
+      if (len > (u32)(iend - ip) || len > (u32)(oend - op))
+         return -1;
+
+      memcpy(op, ip, len);
+      op += len;
+      ip += len;
+
+      if (ip == iend)
+         break; /* the last sequence: no match */
+
+      if (iend - ip < 2)
+         return -1;
+
+      off = (u32)ip[0] | ((u32)ip[1] << 8);
+      ip += 2;
+
+      if (!off || off > (u32)(op - (u8 *)dst))
+         return -1;
+
+      len = token & 15;
+
+      if (len == 15 && lz4_read_len(&ip, iend, &len))
+         return -1;
+
+      len += LZ4_MIN_MATCH;
+
+      if (len > (u32)(oend - op))
+         return -1;
+
+      /* The match can overlap with the output: copy byte by byte */
+      for (match = op - off; len > 0; len--)
+         *op++ = *match++;
+   }
+
+   return (int)(op - (u8 *)dst);
+}
+
+/* LZ4 rules: the last match must start at least 12 bytes before the end */
+#define LZ4_MF_LIMIT                          12
+
+/* LZ4 rules: the last 5 bytes are always literals */
+#define LZ4_LAST_LITERALS                      5
+
+static inline u32 lz4_read_u32(const u8 *p)
+{
+   u32 v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static inline u32 lz4_hash4(const u8 *p, u32 hash_bits)
+{
+   return (lz4_read_u32(p) * 2654435761u) >> (32 - hash_bits);
+}
+
+static u8 *lz4_emit_len(u8 *op, u32 len)
+{
+   for (; len >= 255; len -= 255)
+      *op++ = 255;
+
+   *op++ = (u8)len;
+   return op;
+}
+
+/*
+ * Emits a sequence: `lit_len` literals from `lit` and, if `match_len` != 0,
+ * a match. Returns NULL if it does not fit in [op, oend).
+ */
+static u8 *
+lz4_emit_seq(u8 *op,
+             u8 *oend,
+             const u8 *lit,
+             u32 lit_len,
+             u32 off,
+             u32 match_len)
+{
+   const u32 ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+   u8 *token = op;
+
+   /* Worst case: token, lengths, literals and the offset */
+   if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + ml/255 + 1)
+      return NULL;
+
+   op++;
+   *token = (u8)(MIN(lit_len, 15u) << 4);
+
+   if (lit_len >= 15)
+      op = lz4_emit_len(op, lit_len - 15);
+
+   memcpy(op, lit, lit_len);
+   op += lit_len;
+
+   if (!match_len)
+      return op;
+
+   *op++ = (u8)(off & 0xff);
+   *op++ = (u8)(off >> 8);
+   *token |= (u8)MIN(ml, 15u);
+
+   if (ml >= 15)
+      op = lz4_emit_len(op, ml - 15);
+
+   return op;
+}
+
+u32
+lz4_compress_block(const void *src,
+                   u32 len,
+                   void *dst,
+                   u32 cap,
+                   u32 *hash_table,
+                   u32 hash_bits)
+{
+   const u8 *const base = src;
+   const u8 *ip = base;
+   const u8 *anchor = base;
+   const u8 *const iend = base + len;
+   const u8 *const mflimit = len > LZ4_MF_LIMIT ? iend - LZ4_MF_LIMIT : base;
+   const u8 *const mlimit = iend - MIN(len, (u32)LZ4_LAST_LITERALS);
+   u8 *op = dst;
+   u8 *const oend = op + cap;
+
+   memset(hash_table, 0, sizeof(u32) << hash_bits);
+
+   while (ip < mflimit) {
+
+      const u32 h = lz4_hash4(ip, hash_bits);
+      const u8 *ref = hash_table[h] ? base + hash_table[h] - 1 : NULL;
+      u32 mlen = LZ4_MIN_MATCH;
+
+      hash_table[h] = (u32)(ip - base) + 1;
+
+      if (!ref ||
+          ip - ref > LZ4_MAX_OFFSET ||
+          lz4_read_u32(ref) != lz4_read_u32(ip))
+      {
+         ip++;
+         continue;
+      }
+
+      while (ip + mlen < mlimit && ref[mlen] == ip[mlen])
+         mlen++;
+
+      op = lz4_emit_seq(op,
+                        oend,
+                        anchor,
+                        (u32)(ip - anchor),
+                        (u32)(ip - ref),
+                        mlen);
+      if (!op)
+         return 0;
+
+      ip += mlen;
+      anchor = ip;
+   }
+
+   op = lz4_emit_seq(op, oend, anchor, (u32)(iend - anchor), 0, 0);
+
+   if (!op || op == oend)
+      return 0;
+
+   return (u32)(op - (u8 *)dst);
+}
@@ -89,6 +89,7 @@
  * variables.
  */
 #define USER_ARGS_PAGE_COUNT                                    1
+#define USER_ARGS_MAX_PAGES                                    32
 #define MAX_TTYS                                                9
 #define MAX_PATH                                              256
 #define MAX_PID                                              8191
@@ -30,4 +30,5 @@
  */
 
 #define BUSYBOX         "/initrd/bin/busybox"
+#define INIT_SERVICES_FILE "/initrd/etc/services"
 #define TTYS0_MINOR     64
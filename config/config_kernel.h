@@ -45,7 +45,42 @@
 #define MAX_MOUNTPOINTS                            16
 #define MAX_NESTED_INTERRUPTS                      32
 
+/* Pipe buffers: the default size can be changed with -pipe_size */
+#define PIPE_DEFAULT_SIZE                   (64 * KB)
+#define PIPE_MAX_SIZE                     (1024 * KB)
+
+/* Wake-up preemption granularity: can be changed with -sched_wakeup_gran */
+#define SCHED_WAKEUP_GRAN_US                     1000
+#define SCHED_WAKEUP_GRAN_MAX_US              1000000
+
+/* Contended kmutex_lock(): max yields to a runnable owner, see -kmutex_spin */
+#define KMUTEX_SPIN_YIELDS                          2
+#define KMUTEX_SPIN_MAX_YIELDS                     64
+
+/* Pre-zeroed pages kept by the idle task: can be changed with -zero_pool */
+#define ZERO_POOL_PAGES                            64
+#define ZERO_POOL_MAX_PAGES                      4096
+
+/* Tracing ring buffer size: can be changed with -trace_buf_kb */
+#define TRACE_BUF_KB                              128
+#define TRACE_BUF_MIN_KB                           16
+#define TRACE_BUF_MAX_KB                         4096
+
+/* Leak sampling: 1 kmalloc() every N is tracked, see -kmalloc_sample */
+#define KMALLOC_SAMPLE_RATE                         0
+#define KMALLOC_SAMPLE_MAX_RATE               1000000
+#define KMALLOC_SAMPLE_OLD_SEC                     60
+
 #define WTH_MAX_THREADS                            64
 #define WTH_MAX_PRIO_QUEUE_SIZE                    32
+#define WTH_LOW_PRIO_QUEUE_SIZE                    32
 #define WTH_KB_QUEUE_SIZE                          32
 #define WTH_SERIAL_QUEUE_SIZE                      32
+#define WTH_VBLK_QUEUE_SIZE                        32
+#define WTH_VNET_QUEUE_SIZE                        32
+
+/* Max pdirs of dead processes waiting to be destroyed by the worker thread */
+#define PDIR_REAPER_MAX_BACKLOG                    16
+
+/* The worker thread queues grow, when almost full, up to this size */
+#define WTH_MAX_QUEUE_SIZE                       1024
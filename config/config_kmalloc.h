@@ -12,6 +12,7 @@
 
 /* --------- Boolean config variables --------- */
 
+#cmakedefine01 KMALLOC_CALLSITE_STATS
 #cmakedefine01 KMALLOC_FREE_MEM_POISONING
 #cmakedefine01 KMALLOC_HEAVY_STATS
 #cmakedefine01 KMALLOC_SUPPORT_DEBUG_LOG
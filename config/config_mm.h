@@ -16,6 +16,8 @@
 
 #cmakedefine01 FORK_NO_COW
 #cmakedefine01 MMAP_NO_COW
+#cmakedefine01 ZRAM_SWAP
+#cmakedefine01 KSM_MERGE
 
 
 /*
@@ -44,5 +46,11 @@
 #define USER_MMAP_MIN_SZ            (16 * MB)
 #define USER_MMAP_MAX_SZ          (1024 * MB)
 
+/* Where the ELF interpreter of the dynamic executables gets loaded */
+#define USER_INTERP_VADDR (USER_MMAP_BEGIN + USER_MMAP_MAX_SZ) /* +2 GB */
+
+/* Pages allocated together on a write to anonymous memory: power of 2 */
+#define ANON_FAULT_AROUND_PAGES           16
+
 #define USERMODE_STACK_MAX \
    ((USERMODE_VADDR_END - 1) & ALIGNED_MASK(USERMODE_STACK_ALIGN))
@@ -28,6 +28,7 @@
  */
 #define MEASURE_BOGOMIPS_TICKS        (TIMER_HZ / 10)
 #define BOGOMIPS_CONST                          10000
+#define TSC_CALIB_TICKS               (TIMER_HZ / 10)
 
 
 #if !KRN_MINIMAL_TIME_SLICE
@@ -28,6 +28,22 @@
 
 #define USERAPP_MAX_ARGS_COUNT                                 32
 
+/*
+ * RLIMIT_NOFILE: the default soft limit and the hard one. Note: the first
+ * MAX_HANDLES file descriptors are embedded in struct process, while the others
+ * are allocated on demand.
+ */
+#define NOFILE_DEFAULT_LIMIT                                 1024
+#define NOFILE_MAX_LIMIT                                     4096
+
+
+/*
+ * Queued signals (siginfo): the size of the global pool, pre-allocated at
+ * build time, and the max number of entries queued to a single task (the
+ * equivalent of RLIMIT_SIGPENDING).
+ */
+#define SIGQUEUE_POOL_SIZE                                    128
+#define SIGQUEUE_MAX_PER_TASK                                  32
 
 /*
  * execve recursion limit with #!/path/to/executable scripts
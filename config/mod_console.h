@@ -39,6 +39,8 @@
  * promoting a hard-coded constant to a configurable CMake variable.
  */
 
+/* TTY input buffer: the default size can be changed with -tty_inbuf */
 #define TTY_INPUT_BS                                              1024
+#define TTY_INPUT_MAX_BS                                     (64 * KB)
 #define FAILSAFE_COLS                                              80u
 #define FAILSAFE_ROWS                                              25u
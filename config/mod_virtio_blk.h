@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * This is a TEMPLATE. The actual config header file is generated by CMake
+ * and put in <BUILD_DIR>/tilck_gen_headers/.
+ */
+
+#pragma once
+
+#cmakedefine01    MOD_virtio_blk
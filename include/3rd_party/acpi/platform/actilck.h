@@ -11,6 +11,8 @@
 #define ACPI_USE_SYSTEM_CLIBRARY
 #define ACPI_USE_NATIVE_MATH64
 #define ACPI_USE_NATIVE_DIVIDE
-#define ACPI_USE_LOCAL_CACHE
+/* ACPICA's object caches are backed by Tilck's ones, see osl_malloc.c */
+struct kmalloc_cache;
+#define ACPI_CACHE_T                struct kmalloc_cache
 
 #define ACPI_MACHINE_WIDTH          NBITS
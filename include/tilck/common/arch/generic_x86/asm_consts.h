@@ -26,6 +26,16 @@
 #define MSR_IA32_SYSENTER_ESP           0x175
 #define MSR_IA32_SYSENTER_EIP           0x176
 
+#define MSR_EFER                        0xc0000080
+#define MSR_STAR                        0xc0000081
+#define MSR_LSTAR                       0xc0000082
+#define MSR_SFMASK                      0xc0000084
+#define MSR_FS_BASE                     0xc0000100
+#define MSR_GS_BASE                     0xc0000101
+
+#define EFER_SCE                        (1u << 0)
+
+#define MSR_IA32_APIC_BASE              0x01b
 #define MSR_IA32_MTRRCAP                0x0fe
 #define MSR_IA32_MTRR_DEF_TYPE          0x2ff
 
@@ -67,6 +77,7 @@
 #define CR4_PGE             (1u << 7)
 #define CR4_OSFXSR          (1u << 9)
 #define CR4_OSXMMEXCPT      (1u << 10)
+#define CR4_FSGSBASE        (1u << 16)
 #define CR4_OSXSAVE         (1u << 18)
 
 #define XCR0_X87            (1u << 0)
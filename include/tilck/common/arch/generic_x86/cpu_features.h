@@ -92,6 +92,9 @@ struct x86_cpu_features {
    } ecx1;
 
    bool avx2;
+   bool xsaveopt;
+   bool erms;        /* Enhanced REP MOVSB/STOSB */
+   bool fsgsbase;    /* RD/WR{FS,GS}BASE instructions */
    bool invariant_TSC;
    u8 phys_addr_bits;
    u8 virt_addr_bits;
@@ -103,6 +106,7 @@ struct x86_cpu_features {
    bool can_use_sse4_1;
    bool can_use_avx;
    bool can_use_avx2;
+   bool can_use_fsgsbase;
 
 };
 
@@ -7,6 +7,7 @@
 #endif
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/irqs_off_trace.h>
 #include <tilck/common/arch/generic_x86/asm_consts.h>
 
 /*
@@ -184,16 +185,54 @@ static ALWAYS_INLINE void halt(void)
    asmVolatile("hlt");
 }
 
+/*
+ * Enable the interrupts and halt, atomically: STI delays the interrupts by one
+ * instruction, so an IRQ cannot sneak in between the two and get us stuck in
+ * HLT until the next one.
+ */
+static ALWAYS_INLINE void enable_interrupts_and_halt(void)
+{
+#ifndef UNIT_TEST_ENVIRONMENT
+   asmVolatile("sti\n\thlt");
+#endif
+}
+
+/* Arms the address monitoring hardware on the cache line containing `addr` */
+static ALWAYS_INLINE void monitor(const void *addr, u32 ext, u32 hints)
+{
+   asmVolatile("monitor" : : "a" (addr), "c" (ext), "d" (hints));
+}
+
+/*
+ * Enable the interrupts and MWAIT, atomically (see above). Bit 0 of `ext`
+ * makes the interrupts break the MWAIT even when they're masked, but it's not
+ * needed here as STI comes first.
+ */
+static ALWAYS_INLINE void enable_interrupts_and_mwait(u32 hints, u32 ext)
+{
+#ifndef UNIT_TEST_ENVIRONMENT
+   asmVolatile("sti\n\tmwait" : : "a" (hints), "c" (ext));
+#endif
+}
+
+/*
+ * NOTE: the "A" constraint means EDX:EAX only on i386: on x86_64 it's just
+ * RAX. Therefore, split the value explicitly.
+ */
 static ALWAYS_INLINE void wrmsr(u32 msr_id, u64 msr_value)
 {
-   asmVolatile( "wrmsr" : : "c" (msr_id), "A" (msr_value) );
+   asmVolatile( "wrmsr"
+                :
+                : "c" (msr_id),
+                  "a" ((u32)msr_value),
+                  "d" ((u32)(msr_value >> 32)) );
 }
 
 static ALWAYS_INLINE u64 rdmsr(u32 msr_id)
 {
-   u64 msr_value;
-   asmVolatile( "rdmsr" : "=A" (msr_value) : "c" (msr_id) );
-   return msr_value;
+   u32 lo, hi;
+   asmVolatile( "rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr_id) );
+   return ((u64)hi << 32) | lo;
 }
 
 static ALWAYS_INLINE ulong get_eflags(void)
@@ -240,12 +279,14 @@ static ALWAYS_INLINE void disable_interrupts(ulong *const var)
 
    if (*var & EFLAGS_IF) {
       disable_interrupts_forced();
+      irqs_off_trace_start();
    }
 }
 
 static ALWAYS_INLINE void enable_interrupts(const ulong *const var)
 {
    if (*var & EFLAGS_IF) {
+      irqs_off_trace_end();
       enable_interrupts_forced();
    }
 }
@@ -266,14 +307,20 @@ static ALWAYS_INLINE void write_back_and_invl_cache(void)
    asmVolatile("wbinvd");
 }
 
-static ALWAYS_INLINE void cpuid(u32 code, u32 *a, u32 *b, u32 *c, u32 *d)
+static ALWAYS_INLINE void
+cpuid_count(u32 code, u32 subleaf, u32 *a, u32 *b, u32 *c, u32 *d)
 {
     asm("cpuid"
         : "=a"(*a), "=b" (*b), "=c" (*c), "=d"(*d)
-        : "a"(code), "b" (0), "c" (0), "d" (0)
+        : "a"(code), "b" (0), "c" (subleaf), "d" (0)
         : "memory");
 }
 
+static ALWAYS_INLINE void cpuid(u32 code, u32 *a, u32 *b, u32 *c, u32 *d)
+{
+   cpuid_count(code, 0, a, b, c, d);
+}
+
 static ALWAYS_INLINE ulong read_cr0(void)
 {
    ulong res;
@@ -331,6 +378,17 @@ static ALWAYS_INLINE void write_cr4(ulong val)
                : /* no clobber */);
 }
 
+/*
+ * Invalidates the whole TLB, including the global pages. Reloading CR3 is not
+ * enough for them: toggling CR4.PGE is needed. Interrupts must be disabled.
+ */
+static ALWAYS_INLINE void invalidate_all_pages_hw(void)
+{
+   const ulong cr4 = read_cr4();
+   write_cr4(cr4 & ~CR4_PGE);
+   write_cr4(cr4);
+}
+
 static ALWAYS_INLINE void hw_fpu_enable(void)
 {
    write_cr0(read_cr0() & ~CR0_TS);
@@ -11,6 +11,12 @@
 #define SR_MPP        0x00001800UL /* Previously Machine */
 #define SR_SUM        0x00040000UL /* Supervisor User Memory Access */
 
+#define SR_VS         0x00000600UL /* Vector Status */
+#define SR_VS_OFF     0x00000000UL
+#define SR_VS_INITIAL 0x00000200UL
+#define SR_VS_CLEAN   0x00000400UL
+#define SR_VS_DIRTY   0x00000600UL
+
 #define SR_FS         0x00006000UL /* Floating-point Status */
 #define SR_FS_OFF     0x00000000UL
 #define SR_FS_INITIAL 0x00002000UL
@@ -101,8 +107,15 @@
 #define CSR_SCAUSE     0x142
 #define CSR_STVAL      0x143
 #define CSR_SIP        0x144
+#define CSR_STIMECMP   0x14d    /* Sstc */
+#define CSR_STIMECMPH  0x15d    /* Sstc, RV32 only */
 #define CSR_SATP       0x180
 
+/* xTVEC modes */
+#define TVEC_MODE_DIRECT     0x0
+#define TVEC_MODE_VECTORED   0x1
+#define TVEC_MODE_MASK       0x3
+
 /* IE/IP (Supervisor/Machine Interrupt Enable/Pending) flags */
 #define IE_SIE    (0x1UL << IRQ_S_SOFT)
 #define IE_TIE    (0x1UL << IRQ_S_TIMER)
@@ -7,6 +7,7 @@
 #endif
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/irqs_off_trace.h>
 #include <tilck/common/arch/riscv/asm_consts.h>
 #include <tilck/common/page_size.h>
 
@@ -110,12 +111,14 @@ static ALWAYS_INLINE void disable_interrupts(ulong *var)
 
    if (*var & SR_SIE) {
       csr_clear(CSR_SSTATUS, SR_SIE);
+      irqs_off_trace_start();
    }
 }
 
 static ALWAYS_INLINE void enable_interrupts(ulong *var)
 {
    if (*var & SR_SIE) {
+      irqs_off_trace_end();
       csr_set(CSR_SSTATUS, SR_SIE);
    }
 }
@@ -140,6 +143,16 @@ static ALWAYS_INLINE void hw_fpu_disable(void)
    csr_clear(CSR_SSTATUS, SR_FS);
 }
 
+static ALWAYS_INLINE void hw_vector_enable(void)
+{
+   csr_set(CSR_SSTATUS, SR_VS_CLEAN);
+}
+
+static ALWAYS_INLINE void hw_vector_disable(void)
+{
+   csr_clear(CSR_SSTATUS, SR_VS);
+}
+
 static ALWAYS_INLINE bool hw_is_fpu_enabled(void)
 {
    return !!(csr_read(CSR_SSTATUS) & SR_FS);
@@ -164,6 +177,14 @@ static ALWAYS_INLINE void invalidate_page_hw(ulong vaddr)
    asmVolatile("sfence.vma %0" : : "r" (vaddr) : "memory");
 }
 
+/*
+ * Invalidates the whole TLB: all the addresses, in all the address spaces.
+ */
+static ALWAYS_INLINE void invalidate_all_pages_hw(void)
+{
+   asmVolatile("sfence.vma" : : : "memory");
+}
+
 static ALWAYS_INLINE void flush_icache_all(void)
 {
    asmVolatile("fence.i" : : : "memory");
@@ -174,6 +195,16 @@ static ALWAYS_INLINE void halt(void)
    asmVolatile("wfi" : : : "memory");
 }
 
+/*
+ * WFI wakes up on pending interrupts even when they're disabled: halt first,
+ * and then enable the interrupts to get the pending IRQ handled.
+ */
+static ALWAYS_INLINE void enable_interrupts_and_halt(void)
+{
+   asmVolatile("wfi" : : : "memory");
+   csr_set(CSR_SSTATUS, SR_SIE);
+}
+
 static ALWAYS_INLINE bool in_hypervisor(void)
 {
    // TODO: implement in_hypervisor() for RISCV
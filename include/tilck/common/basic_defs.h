@@ -159,6 +159,24 @@
    #define FASTCALL
 #endif
 
+/*
+ * Boot-only code and data: their pages are freed after the first user process
+ * starts (see free_init_mem()). In the unit tests and in the loadable modules,
+ * which never free anything like that, they're just regular code and data.
+ */
+#if defined(__TILCK_KERNEL__)                  &&  \
+    !defined(UNIT_TEST_ENVIRONMENT)            &&  \
+    !defined(KERNEL_LOADABLE_MODULE)
+
+   #define INIT_TEXT                 ATTR_SECTION(".init.text")
+   #define INIT_DATA                 ATTR_SECTION(".init.data")
+   #define INIT_RODATA               ATTR_SECTION(".init.rodata")
+#else
+   #define INIT_TEXT
+   #define INIT_DATA
+   #define INIT_RODATA
+#endif
+
 typedef int8_t s8;
 typedef int16_t s16;
 typedef int32_t s32;
@@ -12,13 +12,18 @@
 /*          name              ,alias, type,    default            */
 DEFINE_KOPT(ttys              ,     , long,    TTY_COUNT)
 DEFINE_KOPT(selftest          ,     , wordstr, NULL)
+DEFINE_KOPT(mods              ,     , wordstr, NULL)
 
 DEFINE_KOPT(sched_alive_thread, sat , bool,    false)
 DEFINE_KOPT(sercon            ,     , bool,    !MOD_console)
 DEFINE_KOPT(noacpi            ,     , bool,    false)
+DEFINE_KOPT(noapic            ,     , bool,    false)
+DEFINE_KOPT(smp               ,     , bool,    false)
 DEFINE_KOPT(fb_no_opt         ,     , bool,    false)
 DEFINE_KOPT(fb_no_wc          ,     , bool,    false)
 DEFINE_KOPT(no_fpu_memcpy     ,     , bool,    false)
+DEFINE_KOPT(no_tickless       ,     , bool,    false)
+DEFINE_KOPT(no_tsc            ,     , bool,    false)
 DEFINE_KOPT(panic_kb          , pk  , bool,    false)
 DEFINE_KOPT(panic_nobt        , nobt, bool,    !PANIC_SHOW_STACKTRACE)
 DEFINE_KOPT(panic_regs        , pr  , bool,    PANIC_SHOW_REGS)
@@ -26,3 +31,11 @@ DEFINE_KOPT(panic_mmap        , pm  , bool,    false)
 DEFINE_KOPT(big_scroll_buf    , bb  , bool,    TERM_BIG_SCROLL_BUF)
 DEFINE_KOPT(ps2_log           , plg , bool,    PS2_VERBOSE_DEBUG_LOG)
 DEFINE_KOPT(ps2_selftest      , pse , bool,    PS2_DO_SELFTEST)
+DEFINE_KOPT(pipe_size         ,     , ulong,   PIPE_DEFAULT_SIZE)
+DEFINE_KOPT(tty_inbuf         ,     , ulong,   TTY_INPUT_BS)
+DEFINE_KOPT(sched_wakeup_gran , swg , ulong,   SCHED_WAKEUP_GRAN_US)
+DEFINE_KOPT(zero_pool         , zp  , ulong,   ZERO_POOL_PAGES)
+DEFINE_KOPT(kmutex_spin       , kms , ulong,   KMUTEX_SPIN_YIELDS)
+DEFINE_KOPT(trace_buf_kb      , tbk , ulong,   TRACE_BUF_KB)
+DEFINE_KOPT(kmalloc_sample    , kls , ulong,   KMALLOC_SAMPLE_RATE)
+DEFINE_KOPT(initrd_rw_kb      , irw , ulong,   0)
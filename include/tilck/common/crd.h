@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Compressed ramdisk (CRD) format: a FAT ramdisk image split in blocks of
+ * (1 << block_shift) bytes, each one compressed independently with LZ4 (block
+ * format, no frames). Because of the index, any block can be decompressed
+ * without touching the others: that allows the kernel to decompress the file
+ * data on demand, while the bootloaders just load the image as it is.
+ *
+ * Layout:
+ *
+ *    struct crd_hdr | u32 offsets[blocks + 1] | block 0 | block 1 | ...
+ *
+ * Block `i` is stored at [offsets[i], offsets[i + 1]), offsets being relative
+ * to the beginning of the image. A block whose stored size is equal to its
+ * uncompressed size is stored as it is (incompressible data).
+ */
+
+#define CRD_MAGIC                0x44524354   /* "TCRD" */
+#define CRD_MIN_BLOCK_SHIFT              12   /* 4 KB */
+#define CRD_MAX_BLOCK_SHIFT              20   /* 1 MB */
+
+struct crd_hdr {
+
+   u32 magic;
+   u32 block_shift;
+   u32 blocks;
+   u32 size;               /* size of the uncompressed FAT image */
+   u32 offsets[];
+};
+
+static inline bool crd_is_image(const void *p)
+{
+   return ((const struct crd_hdr *)p)->magic == CRD_MAGIC;
+}
+
+static inline u32 crd_hdr_size(const struct crd_hdr *h)
+{
+   return (u32)sizeof(struct crd_hdr) + 4 * (h->blocks + 1);
+}
+
+/* Size of the whole (compressed) image */
+static inline u32 crd_image_size(const struct crd_hdr *h)
+{
+   return h->offsets[h->blocks];
+}
+
+/* Uncompressed size of the block `i`: the last one might be partial */
+static inline u32 crd_block_size(const struct crd_hdr *h, u32 i)
+{
+   const u32 bs = 1u << h->block_shift;
+   return MIN(bs, h->size - (i << h->block_shift));
+}
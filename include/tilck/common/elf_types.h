@@ -15,7 +15,11 @@
    typedef Elf32_Phdr Elf_Phdr;
    typedef Elf32_Shdr Elf_Shdr;
    typedef Elf32_Sym Elf_Sym;
+   typedef Elf32_Rel Elf_Rel;
+   typedef Elf32_Rela Elf_Rela;
 
+   #define ELF_R_SYM(val)           ELF32_R_SYM (val)
+   #define ELF_R_TYPE(val)          ELF32_R_TYPE (val)
    #define ELF_ST_BIND(val)         ELF32_ST_BIND (val)
    #define ELF_ST_TYPE(val)         ELF32_ST_TYPE (val)
    #define ELF_ST_INFO(bind, type)  ELF32_ST_INFO ((bind), (type))
@@ -29,7 +33,11 @@
    typedef Elf64_Phdr Elf_Phdr;
    typedef Elf64_Shdr Elf_Shdr;
    typedef Elf64_Sym Elf_Sym;
+   typedef Elf64_Rel Elf_Rel;
+   typedef Elf64_Rela Elf_Rela;
 
+   #define ELF_R_SYM(val)           ELF64_R_SYM (val)
+   #define ELF_R_TYPE(val)          ELF64_R_TYPE (val)
    #define ELF_ST_BIND(val)         ELF64_ST_BIND (val)
    #define ELF_ST_TYPE(val)         ELF64_ST_TYPE (val)
    #define ELF_ST_INFO(bind, type)  ELF64_ST_INFO ((bind), (type))
@@ -68,6 +68,10 @@ struct fat32_header2 {
 #define FAT_ENTRY_NTRES_BASE_LOW_CASE  0x08
 #define FAT_ENTRY_NTRES_EXT_LOW_CASE   0x10
 
+/* Special values of DIR_Name[0] */
+#define FAT_ENTRY_LAST                       ((char)0)
+#define FAT_ENTRY_AVAILABLE                  ((char)0xE5)
+
 /* In case an extact comparison using DIR_Name is needed */
 #define FAT_DIR_DOT      ".          "
 #define FAT_DIR_DOT_DOT  "..         "
@@ -114,6 +118,31 @@ struct fat_long_entry {
 } PACKED;
 
 
+#define FAT_LONG_ENTRY_LAST                  0x40  /* flag in LDIR_Ord */
+#define FAT_LONG_ENTRY_CHARS                 13    /* UCS-2 chars per entry */
+#define FAT_ATTR_LONG_NAME                   0x0F
+
+/*
+ * The FSInfo sector of the FAT32 volumes (sector BPB_FSInfo), caching the
+ * number of free clusters and a hint for the next free one. Both are just
+ * hints: 0xFFFFFFFF means unknown.
+ */
+
+#define FAT_FSI_LEAD_SIG                     0x41615252
+#define FAT_FSI_STRUC_SIG                    0x61417272
+
+struct fat_fsinfo {
+
+   u32 FSI_LeadSig;
+   u8 FSI_Reserved1[480];
+   u32 FSI_StrucSig;
+   u32 FSI_Free_Count;
+   u32 FSI_Nxt_Free;
+   u8 FSI_Reserved2[12];
+   u32 FSI_TrailSig;
+
+} PACKED;
+
 static inline bool is_long_name_entry(struct fat_entry *e)
 {
    return e->readonly && e->hidden && e->system && e->volume_id;
@@ -129,6 +158,7 @@ fat_get_rootdir(struct fat_hdr *hdr,
                 u32 *cluster /*out*/);
 
 void fat_get_short_name(struct fat_entry *entry, char *destbuf);
+u8 fat_shortname_checksum(u8 *shortname);
 
 u32 fat_get_sector_for_cluster(struct fat_hdr *hdr, u32 N);
 
@@ -261,12 +291,31 @@ struct fat_walk_static_params {
    void *arg;
 };
 
+/*
+ * Position in a directory walk: the first slot (long name slots included) of
+ * the next entry to visit. `cluster` is 0 only for the root directory, before
+ * the first walk (or always, on FAT16).
+ */
+struct fat_walk_pos {
+
+   u32 cluster;
+   u32 index;        /* slot index inside `cluster` */
+   bool eof;         /* the whole directory has been walked */
+};
+
 /*
  * Walk the FAT directory having dir entries in the specified cluster.
  * For the root directory, just set cluster = 0.
  */
 int fat_walk(struct fat_walk_static_params *p, u32 cluster);
 
+/*
+ * Like fat_walk(), but start from `*pos` and update it. When the callback
+ * requests a stop, `*pos` is left pointing to the entry passed to it, which
+ * will be visited again by the next call.
+ */
+int fat_walk_resume(struct fat_walk_static_params *p, struct fat_walk_pos *pos);
+
 struct fat_entry *
 fat_search_entry(struct fat_hdr *hdr,
                  enum fat_type ft,
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Hooks for the irqs-off side of the latency tracer (see kernel/lat_tracer.c),
+ * called by disable_interrupts() and enable_interrupts() only when they
+ * actually change the interrupts state. Compiled-in only in the kernel, with
+ * LATENCY_TRACER enabled.
+ */
+
+#if defined(__TILCK_KERNEL__)             &&  \
+    !defined(UNIT_TEST_ENVIRONMENT)       &&  \
+    !defined(__MOD_ACPICA__)
+
+   #include <tilck_gen_headers/config_debug.h>
+   #define IRQS_OFF_TRACE_HOOKS        LATENCY_TRACER
+#else
+   #define IRQS_OFF_TRACE_HOOKS        0
+#endif
+
+#if IRQS_OFF_TRACE_HOOKS
+
+   void irqs_off_trace_start(void);
+   void irqs_off_trace_end(void);
+
+#else
+
+   static ALWAYS_INLINE void irqs_off_trace_start(void) { }
+   static ALWAYS_INLINE void irqs_off_trace_end(void) { }
+
+#endif
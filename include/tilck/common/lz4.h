@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+
+#define LZ4_MIN_MATCH                     4
+#define LZ4_MAX_OFFSET                65535
+
+/*
+ * Decompresses a LZ4 block (the raw block format, not the frame one) of
+ * `src_len` bytes into `dst`, which can hold up to `dst_len` bytes. Returns
+ * the number of decompressed bytes or -1 if the block is malformed or it
+ * does not fit in `dst`.
+ */
+int lz4_decompress_block(const void *src, u32 src_len, void *dst, u32 dst_len);
+
+/*
+ * Compresses `len` bytes from `src` to a LZ4 block in `dst`, which can hold
+ * `cap` bytes. The compressor is a simple greedy one, using `hash_table` (an
+ * array of 1 << `hash_bits` entries, provided by the caller) to find matches.
+ * Returns the size of the block or 0, if it would not be smaller than `cap`.
+ */
+u32
+lz4_compress_block(const void *src,
+                   u32 len,
+                   void *dst,
+                   u32 cap,
+                   u32 *hash_table,
+                   u32 hash_bits);
@@ -20,9 +20,11 @@ enum tilck_cmd {
    TILCK_CMD_CALL_FUNC_0         = 10,
    TILCK_CMD_GET_VAR_LONG        = 11,
    TILCK_CMD_BUSY_WAIT           = 12,
+   TILCK_CMD_SPAWN               = 13,
+   TILCK_CMD_LOAD_MODULE         = 14,
 
    /* Number of elements in the enum */
-   TILCK_CMD_COUNT               = 13,
+   TILCK_CMD_COUNT               = 15,
 };
 
 #if defined(__x86_64__)
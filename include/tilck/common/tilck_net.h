@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Tilck's userspace interface for the raw packet devices (e.g. /dev/vnet0).
+ * There's no network stack in the kernel: each device just moves Ethernet
+ * frames between the NIC and user space, where a stack can do TCP/UDP.
+ *
+ * read() and write() transfer one frame each, copying it. The fast path is
+ * mmap(): the device maps a control page (struct tilck_net_ring) followed by
+ * `rx_count` RX slots and `tx_count` TX slots, each `slot_size` bytes long.
+ * The NIC writes and reads the frames directly in the slots, without copies.
+ *
+ * Both rings are single-producer, single-consumer, with free-running u32
+ * indexes: slot N is at (N % count). The counts are powers of 2.
+ *
+ *    RX: the kernel fills the slots [rx_tail, rx_head) and stores `rx_head`
+ *        (release). The reader consumes them and stores `rx_tail` (release).
+ *
+ *    TX: the writer fills the slots [tx_head, tx_tail + tx_count), sets
+ *        their `len`, stores `tx_head` (release) and calls the ioctl
+ *        TILCK_IOCTL_NET_SYNC to submit all of them at once. The kernel
+ *        advances `tx_tail` when the NIC is done with them.
+ *
+ * The RX slots consumed by the reader are given back to the NIC on the next
+ * interrupt, poll(), read() or TILCK_IOCTL_NET_SYNC. Mixing read()/write()
+ * and the mmap-ed rings on the same device is not supported.
+ */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+
+#define TILCK_IOCTL_NET_SYNC                 1
+#define TILCK_IOCTL_NET_GET_MAC              2   /* argument: u8[6] */
+
+#define TILCK_NET_RING_MAGIC        0x474e524e   /* NRNG */
+#define TILCK_NET_RING_VERSION               1
+
+#define TILCK_NET_SLOT_SIZE               2048
+#define TILCK_NET_FRAME_OFF                 16
+#define TILCK_NET_MAX_FRAME     (TILCK_NET_SLOT_SIZE - TILCK_NET_FRAME_OFF)
+
+/* At the beginning of each slot: the frame follows, at TILCK_NET_FRAME_OFF */
+struct tilck_net_slot {
+
+   u32 len;                      /* length of the frame */
+   u16 __reserved;
+   u8 dev_hdr[10];               /* owned by the driver: don't touch */
+};
+
+struct tilck_net_ring {
+
+   u32 magic;
+   u32 version;
+   u32 slot_size;
+   u32 rx_offset;                /* offset of the RX slots from the mapping */
+   u32 rx_count;
+   u32 tx_offset;                /* offset of the TX slots from the mapping */
+   u32 tx_count;
+   u8 mac[6];
+   u16 __reserved;
+
+   ATOMIC(u32) rx_head;          /* written by the kernel */
+   ATOMIC(u32) rx_tail;          /* written by the reader */
+   ATOMIC(u32) tx_head;          /* written by the writer */
+   ATOMIC(u32) tx_tail;          /* written by the kernel */
+};
@@ -16,6 +16,7 @@
 #define TILCK_IOCTL_SOUND_CONTINUE           5
 #define TILCK_IOCTL_SOUND_GET_INFO           6
 #define TILCK_IOCTL_SOUND_WAIT_COMPLETION    7
+#define TILCK_IOCTL_SOUND_GET_STATS          8
 
 /* Used with TILCK_IOCTL_SOUND_GET_INFO */
 struct tilck_sound_card_info {
@@ -33,4 +34,21 @@ struct tilck_sound_params {
    u8 bits;          /* 8 or 16 */
    u8 channels;      /* 1 or 2 */
    u8 sign;          /* 0 = unsigned, 1 = signed */
+   u8 period_kb;     /* 0 = driver's default, otherwise a power of 2 */
+};
+
+/*
+ * Used with TILCK_IOCTL_SOUND_GET_STATS. The driver plays a ring of periods:
+ * write() queues complete periods, waiting only when the ring is full. An
+ * underrun happens when the card reaches a period not queued yet: playback
+ * pauses until there's enough data again.
+ */
+struct tilck_sound_stats {
+
+   u32 period_size;  /* in bytes */
+   u32 periods;      /* periods in the ring */
+   u32 queued;       /* periods queued right now */
+   u32 high_water;   /* max periods ever queued, since the setup */
+   u32 underruns;
+   u32 played;       /* periods played, since the setup */
 };
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Tilck's userspace interface for the binary snapshots of the sysfs (/syst)
+ * objects. Each directory having numeric properties (integers and booleans)
+ * contains also a read-only file named TILCK_SYSFS_SNAPSHOT_NAME: reading it
+ * returns all the numeric properties at once, as a struct tilck_sysfs_snap,
+ * without formatting them as text.
+ *
+ * The values are in the same order the numeric properties appear in the
+ * directory listing (readdir). Use pread() at offset 0 to get a fresh
+ * snapshot with a single syscall, keeping the file open. A buffer too small
+ * for all the values makes the read fail with -EINVAL.
+ */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+#define TILCK_SYSFS_SNAPSHOT_NAME           ".snapshot"
+#define TILCK_SYSFS_SNAPSHOT_MAGIC          0x50414e53   /* SNAP */
+
+struct tilck_sysfs_snap {
+
+   u32 magic;
+   u32 count;                    /* number of values */
+   u64 values[];                 /* signed properties are sign-extended */
+};
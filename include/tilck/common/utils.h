@@ -118,7 +118,7 @@ CONSTEXPR static inline u32
 get_first_zero_bit_index_l(ulong num)
 {
    u32 i;
-   ASSERT(num != ~0U);
+   ASSERT(num != ~0UL);
 
    for (i = 0; i < NBITS; i++)
       if ((num & (1UL << i)) == 0)
@@ -4,9 +4,18 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/kernel/list.h>
 
+/*
+ * IRQs 0-15 come from the 8259 PIC, while 16-30 are the MSI vectors, delivered
+ * by the local APIC. IRQ 31 is the LAPIC's spurious vector.
+ */
+#define X86_IRQS_COUNT                   32
+#define X86_MSI_FIRST_IRQ                16
+#define X86_MSI_IRQS_COUNT               15
+#define X86_LAPIC_SPUR_IRQ               31
+
 extern const char *x86_exception_names[32];
-extern struct list irq_handlers_lists[16];
-extern void (*irq_entry_points[16])(void);
+extern struct list irq_handlers_lists[X86_IRQS_COUNT];
+extern void (*irq_entry_points[X86_IRQS_COUNT])(void);
 extern soft_int_handler_t fault_handlers[32];
 
 static ALWAYS_INLINE int int_to_irq(int int_num)
@@ -28,3 +37,19 @@ static ALWAYS_INLINE bool is_fault(int int_num)
 {
    return IN_RANGE(int_num, 0, 32);
 }
+
+/* The message a PCI device has to write in order to trigger an MSI vector */
+struct msi_msg {
+
+   u64 addr;
+   u32 data;
+};
+
+/*
+ * Allocates `count` (a power of 2) contiguous MSI vectors, aligned to `count`
+ * as multi-message MSI requires. Returns the first IRQ number, to be used
+ * with irq_install_handler(), or a negative errno value. The message in `msg`
+ * triggers the first vector: the device adds the vector index to `data`.
+ */
+int irq_alloc_msi(u32 count, struct msi_msg *msg);
+void irq_free_msi(int irq, u32 count);
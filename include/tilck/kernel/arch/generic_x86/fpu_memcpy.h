@@ -338,4 +338,13 @@ fpu_cpy_single_256_nt_read(void *dest, const void *src)
 }
 
 
+/*
+ * General purpose copies, for the kernel's bulk data paths (ramfs, pipes,
+ * COW). They pick the best strategy at runtime, depending on the size, the
+ * alignment, the CPU features and the context: they can be called anywhere,
+ * even in IRQ handlers and with preemption disabled.
+ */
+void fast_memcpy(void *dest, const void *src, size_t n);
+void fast_copy_page(void *dest, const void *src);
+
 void init_fpu_memcpy(void);
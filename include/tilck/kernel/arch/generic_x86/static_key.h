@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * The site of a disabled key is a 5-byte NOP (nopl 0x0(%eax,%eax,1)), as
+ * long as a `jmp rel32`, the instruction replacing it when the key is
+ * enabled. See static_key.h.
+ */
+
+#define STATIC_KEY_INSN_SIZE                   5
+#define STATIC_KEY_NOP5             0x0f, 0x1f, 0x44, 0x00, 0x00
+#define STATIC_KEY_JMP_REL32                0xe9
+
+#ifdef __x86_64__
+   #define ASM_STATIC_KEY_PTR    ".balign 8\n.quad"
+#else
+   #define ASM_STATIC_KEY_PTR    ".balign 4\n.long"
+#endif
+
+static ALWAYS_INLINE bool arch_static_branch(struct static_key *key)
+{
+   asm goto("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n"
+            ".pushsection .static_keys, \"a\"\n"
+            ASM_STATIC_KEY_PTR " 1b, %l[l_yes], %c0\n"
+            ".popsection\n"
+            : /* no outputs */
+            : "i" (key)
+            : /* no clobbers */
+            : l_yes);
+
+   return false;
+
+l_yes:
+   return true;
+}
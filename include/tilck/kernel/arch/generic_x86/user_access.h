@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * Single-value user-access primitives: see get_user() and put_user() in
+ * user.h. In case of a fault, the fault handler jumps to the fixup code
+ * (label 3), found through the exception table (see extable.h).
+ */
+
+#ifdef __x86_64__
+   #define ASM_EXTABLE_ALIGN_PTR    ".balign 8\n.quad"
+#else
+   #define ASM_EXTABLE_ALIGN_PTR    ".balign 4\n.long"
+#endif
+
+#define ASM_EXTABLE(insn, fixup)                                           \
+   ".pushsection .ex_table, \"a\"\n"                                       \
+   ASM_EXTABLE_ALIGN_PTR " " #insn ", " #fixup "\n"                        \
+   ".popsection\n"
+
+#define DEFINE_ARCH_GET_USER(n, insn, reg)                                 \
+   static ALWAYS_INLINE int                                                \
+   arch_get_user_##n(ulong *val, const void *uptr)                         \
+   {                                                                       \
+      int err = 0;                                                         \
+      ulong v;                                                             \
+                                                                           \
+      asmVolatile("1: " insn " %2, " reg "\n"                              \
+                  "2:\n"                                                   \
+                  ".pushsection .text.fixup, \"ax\"\n"                     \
+                  "3: movl %3, %0\n"                                       \
+                  "   xorl %k1, %k1\n"                                     \
+                  "   jmp 2b\n"                                            \
+                  ".popsection\n"                                          \
+                  ASM_EXTABLE(1b, 3b)                                      \
+                  : "+r" (err), "=r" (v)                                   \
+                  : "m" (*(const char *)uptr), "i" (-EFAULT));             \
+                                                                           \
+      *val = v;                                                            \
+      return err;                                                          \
+   }
+
+#define DEFINE_ARCH_PUT_USER(n, insn, reg)                                 \
+   static ALWAYS_INLINE int                                                \
+   arch_put_user_##n(ulong val, void *uptr)                                \
+   {                                                                       \
+      int err = 0;                                                         \
+                                                                           \
+      asmVolatile("1: " insn " " reg ", %1\n"                              \
+                  "2:\n"                                                   \
+                  ".pushsection .text.fixup, \"ax\"\n"                     \
+                  "3: movl %3, %0\n"                                       \
+                  "   jmp 2b\n"                                            \
+                  ".popsection\n"                                          \
+                  ASM_EXTABLE(1b, 3b)                                      \
+                  : "+r" (err), "=m" (*(char *)uptr)                       \
+                  : "q" (val), "i" (-EFAULT));                             \
+                                                                           \
+      return err;                                                          \
+   }
+
+DEFINE_ARCH_GET_USER(1, "movzbl", "%k1")
+DEFINE_ARCH_GET_USER(2, "movzwl", "%k1")
+DEFINE_ARCH_GET_USER(4, "movl", "%k1")
+
+DEFINE_ARCH_PUT_USER(1, "movb", "%b2")
+DEFINE_ARCH_PUT_USER(2, "movw", "%w2")
+DEFINE_ARCH_PUT_USER(4, "movl", "%k2")
+
+#ifdef __x86_64__
+
+   DEFINE_ARCH_GET_USER(long, "movq", "%q1")
+   DEFINE_ARCH_PUT_USER(long, "movq", "%q2")
+
+#else
+
+   #define arch_get_user_long    arch_get_user_4
+   #define arch_put_user_long    arch_put_user_4
+
+#endif
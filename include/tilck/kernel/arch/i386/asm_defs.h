@@ -29,6 +29,9 @@
 #define X86_USER_CODE_SEL    0x1b
 #define X86_USER_DATA_SEL    0x23
 
+/* Where the APs start: in the reserved first 64 KB. See ap_trampoline.S */
+#define AP_TRAMPOLINE_PADDR  0x8000
+
 /* Some useful asm macros */
 #ifdef ASM_FILE
 
@@ -8,6 +8,7 @@
 
 extern const char *riscv_exception_names[32];
 extern struct list irq_handlers_lists[MAX_IRQ_NUM];
+extern struct irq_handler_node *irq_direct_handlers[MAX_IRQ_NUM];
 extern soft_int_handler_t fault_handlers[32];
 
 static ALWAYS_INLINE int int_to_irq(int int_num)
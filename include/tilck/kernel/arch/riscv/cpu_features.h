@@ -44,6 +44,8 @@ struct riscv_cpu_features {
 
    } isa_exts;
 
+   u32 cboz_block_size; /* Zicboz: bytes zeroed by a single cbo.zero */
+
    /* Vendor defined page attribute bits */
    ulong page_mtmask;
    ulong page_cb; /* Cacheble & bufferable */
@@ -3,6 +3,7 @@
 #pragma once
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/kernel/arch/riscv/cpu_features.h>
 
 #ifdef __FPU_MEMCPY_C__
    #define EXTERN extern
@@ -12,48 +13,86 @@
 
 
 void memcpy256_failsafe(void *dest, const void *src, u32 n);
+void memset256_failsafe(void *dest, u32 val32, u32 n);
+void memcpy256_rvv(void *dest, const void *src, u32 n);
+void memset256_rvv(void *dest, u32 val32, u32 n);
 FASTCALL void memcpy_single_256_failsafe(void *dest, const void *src);
 
+static ALWAYS_INLINE bool fpu_memcpy_can_use_rvv(void)
+{
+   return riscv_cpu_features.isa_exts.v;
+}
+
 /* Non-temporal hint for the destination */
 /* 'n' is the number of 32-byte (256-bit) data packets to copy */
 EXTERN inline void fpu_memcpy256_nt(void *dest, const void *src, u32 n)
 {
-
-   memcpy256_failsafe(dest, src, n);
+   if (fpu_memcpy_can_use_rvv())
+      memcpy256_rvv(dest, src, n);
+   else
+      memcpy256_failsafe(dest, src, n);
 }
 
 /* 'n' is the number of 32-byte (256-bit) data packets to copy */
 EXTERN inline void fpu_memcpy256(void *dest, const void *src, u32 n)
 {
-
-   memcpy256_failsafe(dest, src, n);
+   if (fpu_memcpy_can_use_rvv())
+      memcpy256_rvv(dest, src, n);
+   else
+      memcpy256_failsafe(dest, src, n);
 }
 
 /* Non-temporal hint for the source */
 /* 'n' is the number of 32-byte (256-bit) data packets to copy */
 EXTERN inline void fpu_memcpy256_nt_read(void *dest, const void *src, u32 n)
 {
-
-   memcpy256_failsafe(dest, src, n);
+   if (fpu_memcpy_can_use_rvv())
+      memcpy256_rvv(dest, src, n);
+   else
+      memcpy256_failsafe(dest, src, n);
 }
 
+/* 'n' is the number of 32-byte (256-bit) blocks to fill with `val32` */
 EXTERN inline void fpu_memset256(void *dest, u32 val32, u32 n)
 {
-   memset(dest, (int)val32, n << 5);
+   /* For zeroing, cbo.zero (used by the failsafe func) is the fastest way */
+   if (fpu_memcpy_can_use_rvv() &&
+       (val32 || !riscv_cpu_features.isa_exts.zicboz))
+   {
+      memset256_rvv(dest, val32, n);
+      return;
+   }
+
+   memset256_failsafe(dest, val32, n);
 }
 
 EXTERN ALWAYS_INLINE FASTCALL void
 fpu_cpy_single_256_nt(void *dest, const void *src)
 {
-   memcpy_single_256_failsafe(dest, src);
+   if (fpu_memcpy_can_use_rvv())
+      memcpy256_rvv(dest, src, 1);
+   else
+      memcpy_single_256_failsafe(dest, src);
 }
 
 EXTERN ALWAYS_INLINE FASTCALL void
 fpu_cpy_single_256_nt_read(void *dest, const void *src)
 {
-   memcpy_single_256_failsafe(dest, src);
+   if (fpu_memcpy_can_use_rvv())
+      memcpy256_rvv(dest, src, 1);
+   else
+      memcpy_single_256_failsafe(dest, src);
 }
 
 
+/*
+ * General purpose copies, for the kernel's bulk data paths (ramfs, pipes,
+ * COW). They pick the best strategy at runtime, depending on the size, the
+ * alignment, the CPU features and the context: they can be called anywhere,
+ * even in IRQ handlers and with preemption disabled.
+ */
+void fast_memcpy(void *dest, const void *src, size_t n);
+void fast_copy_page(void *dest, const void *src);
+
 void init_fpu_memcpy(void);
 
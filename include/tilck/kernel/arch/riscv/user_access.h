@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * Single-value user-access primitives: see get_user() and put_user() in
+ * user.h. In case of a fault, the fault handler jumps to the fixup code
+ * (label 3), found through the exception table (see extable.h). The fixup
+ * code stays inline, jumped over on the success path, because a `j` from a
+ * separate section might be out of range.
+ */
+
+#define ASM_EXTABLE(insn, fixup)                                           \
+   ".pushsection .ex_table, \"a\"\n"                                       \
+   ".balign 8\n"                                                           \
+   ".dword " #insn ", " #fixup "\n"                                        \
+   ".popsection\n"
+
+#define DEFINE_ARCH_GET_USER(n, insn)                                      \
+   static ALWAYS_INLINE int                                                \
+   arch_get_user_##n(ulong *val, const void *uptr)                         \
+   {                                                                       \
+      int err = 0;                                                         \
+      ulong v;                                                             \
+                                                                           \
+      asmVolatile("1: " insn " %1, %2\n"                                   \
+                  "   j 2f\n"                                              \
+                  "3: li %0, %3\n"                                         \
+                  "   li %1, 0\n"                                          \
+                  "2:\n"                                                   \
+                  ASM_EXTABLE(1b, 3b)                                      \
+                  : "+r" (err), "=r" (v)                                   \
+                  : "m" (*(const char *)uptr), "i" (-EFAULT));             \
+                                                                           \
+      *val = v;                                                            \
+      return err;                                                          \
+   }
+
+#define DEFINE_ARCH_PUT_USER(n, insn)                                      \
+   static ALWAYS_INLINE int                                                \
+   arch_put_user_##n(ulong val, void *uptr)                                \
+   {                                                                       \
+      int err = 0;                                                         \
+                                                                           \
+      asmVolatile("1: " insn " %2, %1\n"                                   \
+                  "   j 2f\n"                                              \
+                  "3: li %0, %3\n"                                         \
+                  "2:\n"                                                   \
+                  ASM_EXTABLE(1b, 3b)                                      \
+                  : "+r" (err), "=m" (*(char *)uptr)                       \
+                  : "r" (val), "i" (-EFAULT));                             \
+                                                                           \
+      return err;                                                          \
+   }
+
+DEFINE_ARCH_GET_USER(1, "lbu")
+DEFINE_ARCH_GET_USER(2, "lhu")
+DEFINE_ARCH_GET_USER(4, "lwu")
+DEFINE_ARCH_GET_USER(long, "ld")
+
+DEFINE_ARCH_PUT_USER(1, "sb")
+DEFINE_ARCH_PUT_USER(2, "sh")
+DEFINE_ARCH_PUT_USER(4, "sw")
+DEFINE_ARCH_PUT_USER(long, "sd")
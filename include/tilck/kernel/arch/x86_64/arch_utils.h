@@ -10,15 +10,21 @@
 #include <tilck/kernel/arch/x86_64/asm_defs.h>
 
 struct x86_64_regs {
-   /* STUB struct */
+   u64 kernel_resume_rip;
+   u64 custom_flags;        /* custom Tilck flags */
+   u64 r15, r14, r13, r12, r11, r10, r9, r8;
+   u64 rdi, rsi, rbp, rdx, rcx, rbx, rax;
    s32 int_num;
+   u32 int_num_hi;      /* unused: int_num is pushed as a qword */
    u32 err_code;
-   u64 rsp, rbp, rax, rip;
-   u64 rflags;
-   u64 userrsp;
-   u32 custom_flags;
+   u32 err_code_hi;     /* unused: err_code is pushed as a qword */
+   u64 rip, cs, rflags, rsp, ss;  /* the IRET frame */
 };
 
+STATIC_ASSERT(SIZEOF_REGS == sizeof(regs_t));
+STATIC_ASSERT(REGS_RIP_OFF == OFFSET_OF(regs_t, rip));
+STATIC_ASSERT(REGS_RSP_OFF == OFFSET_OF(regs_t, rsp));
+
 struct x86_64_arch_proc_members {
    /* STUB struct */
    ulong some_var; /* avoid error: empty struct has size 0 in C, 1 in C++ */
@@ -27,12 +33,13 @@ struct x86_64_arch_proc_members {
 struct x86_64_arch_task_members {
    u16 fpu_regs_size;
    void *fpu_regs;
+   ulong fs_base;           /* user FS base (TLS), see arch_prctl() */
+   ulong gs_base;           /* user GS base */
 };
 
 static ALWAYS_INLINE int regs_intnum(regs_t *r)
 {
-   NOT_IMPLEMENTED();
-   return 0;
+   return r->int_num;
 }
 
 static ALWAYS_INLINE void set_return_register(regs_t *r, ulong value)
@@ -75,12 +82,17 @@ static ALWAYS_INLINE void regs_set_ip(regs_t *r, ulong value)
    r->rip = value;
 }
 
+/*
+ * NOTE: unlike i386, in long mode the CPU always pushes SS:RSP, therefore
+ * `rsp` is both the user stack pointer and the stack pointer at the time of
+ * the interrupt.
+ */
 static ALWAYS_INLINE ulong regs_get_usersp(regs_t *r)
 {
-   return r->userrsp;
+   return r->rsp;
 }
 
 static ALWAYS_INLINE void regs_set_usersp(regs_t *r, ulong value)
 {
-   r->userrsp = value;
+   r->rsp = value;
 }
@@ -14,9 +14,21 @@
    #error Unsupported value of KERNEL_STACK_PAGES
 #endif
 
+#define SIZEOF_REGS            192
+#define REGS_RIP_OFF           152
+#define REGS_RSP_OFF           176
 
+#define REGS_FL_SYSCALL         1
 #define REGS_FL_FPU_ENABLED     8
 
+/*
+ * NOTE: the order of the user segments is imposed by SYSRET, which loads
+ * SS = STAR[63:48] + 8 and CS = STAR[63:48] + 16: user data comes first.
+ */
+#define X86_KERNEL_CODE_SEL  0x08
+#define X86_KERNEL_DATA_SEL  0x10
+#define X86_USER_DATA_SEL    0x1b
+#define X86_USER_CODE_SEL    0x23
 
 /* Some useful asm macros */
 #ifdef ASM_FILE
@@ -26,4 +38,68 @@
 #define FUNC(x) .type x, @function; x
 #define END_FUNC(x) .size x, .-(x)
 
+.macro asm_disable_cr0_ts
+   mov rax, CR0
+   and rax, ~8
+   mov CR0, rax
+.endm
+
+.macro push_custom_flags additional_flags
+   mov rax, CR0
+   and rax, 8       // CR0_TS
+   xor rax, 8       // flip the bit:
+                    // we use FPU_ENABLED while TS=1 means FPU disabled
+
+   or rax, \additional_flags
+   push rax         // custom_flags
+
+   asm_disable_cr0_ts
+.endm
+
+.macro pop_custom_flags
+   pop rax       // custom_flags
+   and rax, 8    // REGS_FL_FPU_ENABLED
+   xor rax, 8    // flip the bit
+   mov rbx, CR0
+   and rbx, ~8
+   or rbx, rax
+   mov CR0, rbx
+.endm
+
+.macro save_base_regs
+   push rax
+   push rbx
+   push rcx
+   push rdx
+   push rbp
+   push rsi
+   push rdi
+   push r8
+   push r9
+   push r10
+   push r11
+   push r12
+   push r13
+   push r14
+   push r15
+.endm
+
+.macro resume_base_regs
+   pop r15
+   pop r14
+   pop r13
+   pop r12
+   pop r11
+   pop r10
+   pop r9
+   pop r8
+   pop rdi
+   pop rsi
+   pop rbp
+   pop rdx
+   pop rcx
+   pop rbx
+   pop rax
+.endm
+
 #endif
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Micro-benchmark harness for the in-kernel performance tests (see the `bench`
+ * self test). Each benchmark runs `func` first `warmup` times, without
+ * measuring, then `iters` times, measuring each run with RDTSC() (the TSC on
+ * x86, the `cycle` CSR on riscv). Since a run may perform more than one
+ * operation (to amortize the cost of reading the counter), the results are
+ * divided by `ops`.
+ *
+ * The results are printed on a single line, as a JSON object, in order to be
+ * easily parsed from the serial log by scripts tracking regressions:
+ *
+ *    {"bench": "kmalloc_64", "unit": "cycles", "iters": 1000, "ops": 16,
+ *     "min": 71, "median": 74, "avg": 80, "max": 1290}
+ *
+ * The devshell's `bench` command prints the results of the user space
+ * benchmarks in the same format.
+ */
+
+#define BENCH_MAX_ITERS                    4096
+
+struct bench {
+
+   const char *name;
+   u32 warmup;
+   u32 iters;                       /* must be <= BENCH_MAX_ITERS */
+   u32 ops;                         /* operations per run, 0 means 1 */
+   void (*func)(void *arg);
+   void *arg;
+};
+
+struct bench_result {
+
+   u64 min;                         /* all the values are cycles per op */
+   u64 median;
+   u64 avg;
+   u64 max;
+};
+
+/* Runs the benchmark and prints its results. Returns 0 or -ENOMEM. */
+int bench_run(const struct bench *b, struct bench_result *res);
+
+/* Prints the results of a benchmark measured in a custom way */
+void
+bench_report(const char *name,
+             u32 iters,
+             u32 ops,
+             const struct bench_result *res);
@@ -4,11 +4,13 @@
 #include <tilck/common/basic_defs.h>
 
 #define MAX_TREE_HEIGHT       32
+#define BINTREE_MAX_SIZE      ((1u << 24) - 1)
 
 struct bintree_node {
    void *left_obj;   // pointer to the left container obj
    void *right_obj;  // pointer to the right container obj
-   u16 height;
+   u32 height : 8;
+   u32 size : 24;    // number of objects in the subtree, this one included
 };
 
 static inline void bintree_node_init(struct bintree_node *node)
@@ -17,9 +19,30 @@ static inline void bintree_node_init(struct bintree_node *node)
       .left_obj = NULL,
       .right_obj = NULL,
       .height = 0,
+      .size = 1,
    };
 }
 
+/*
+ * A tree with cached pointers to its first and last objects, for the users
+ * that need them often (e.g. the scheduler's runqueue). Initialize with zeros.
+ */
+struct bintree_cached {
+   void *root;
+   void *first;
+   void *last;
+};
+
+/*
+ * Explicit-stack iterator: each call to bintree_iter_next() costs O(1),
+ * amortized. Unlike bintree_walk_ctx, it can start from any value.
+ */
+struct bintree_iter {
+   void *stack[MAX_TREE_HEIGHT];
+   int stack_size;
+   long bintree_offset;
+};
+
 #include <tilck/common/norec.h>
 
 struct bintree_walk_ctx {
@@ -98,6 +121,68 @@ bintree_get_first_obj_internal(void *root_obj, long bintree_offset);
 void *
 bintree_get_last_obj_internal(void *root_obj, long bintree_offset);
 
+/*
+ * bintree_find_ge_internal() returns the smallest obj* such that
+ * objval_cmpfun(obj, value_ptr) >= 0, or NULL.
+ */
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset);
+
+/*
+ * bintree_find_gt_internal() returns the smallest obj* such that
+ * objval_cmpfun(obj, value_ptr) > 0, or NULL.
+ */
+void *
+bintree_find_gt_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset);
+
+/* Order statistics, in O(log N) thanks to the subtree sizes */
+
+ulong
+bintree_get_count_internal(void *root_obj, long bintree_offset);
+
+void *
+bintree_get_nth_obj_internal(void *root_obj, ulong n, long bintree_offset);
+
+/* Returns the number of objects such that objval_cmpfun(obj, value_ptr) < 0 */
+ulong
+bintree_get_rank_internal(void *root_obj,
+                          const void *value_ptr,
+                          cmpfun_ptr objval_cmpfun,
+                          long bintree_offset);
+
+void
+bintree_iter_start_internal(struct bintree_iter *it,
+                            void *root_obj,
+                            long bintree_offset);
+
+void
+bintree_iter_start_ge_internal(struct bintree_iter *it,
+                               void *root_obj,
+                               const void *value_ptr,
+                               cmpfun_ptr objval_cmpfun,
+                               long bintree_offset);
+
+void *
+bintree_iter_next(struct bintree_iter *it);
+
+bool
+bintree_cached_insert_internal(struct bintree_cached *t,
+                               void *obj,
+                               cmpfun_ptr cmp,
+                               long bintree_offset);
+
+void *
+bintree_cached_remove_internal(struct bintree_cached *t,
+                               void *value_ptr,
+                               cmpfun_ptr objval_cmpfun,
+                               long bintree_offset);
+
 bool
 bintree_insert_ptr_internal(void **root_obj_ref,
                             void *obj,
@@ -151,6 +236,17 @@ bintree_remove_ptr_internal(void **root_obj_ref,
                              OFFSET_OF(struct_type, elem_name),               \
                              OFFSET_OF(struct_type, field_name))
 
+/*
+ * Like bintree_find(), but returns the first object >= `value`. Searching
+ * for values not exactly matching any object makes sense here: for example,
+ * with a compare function treating each object as a range, this finds either
+ * the range containing `value` or the first one after it.
+ */
+#define bintree_find_ge(root_obj, value, objval_cmpfun, struct_type, elem_name)\
+   bintree_find_ge_internal((void*)(root_obj),                                \
+                            (value), (objval_cmpfun),                         \
+                            OFFSET_OF(struct_type, elem_name))
+
 #define bintree_remove(rootref, value, objval_cmpfun, struct_type, elem_name) \
    bintree_remove_internal((void**)(rootref),                                 \
                            (value), (objval_cmpfun),                          \
@@ -187,3 +283,41 @@ bintree_remove_ptr_internal(void **root_obj_ref,
                                          (void*)(obj),                       \
                                          OFFSET_OF(struct_type, elem_name),  \
                                          rev)
+
+/* Like bintree_find_ge(), but returns the first object > `value` */
+#define bintree_find_gt(root_obj, value, objval_cmpfun, struct_type, elem_name)\
+   bintree_find_gt_internal((void*)(root_obj),                                \
+                            (value), (objval_cmpfun),                         \
+                            OFFSET_OF(struct_type, elem_name))
+
+#define bintree_get_count(root_obj, struct_type, elem_name)                   \
+   bintree_get_count_internal((void *)(root_obj),                             \
+                              OFFSET_OF(struct_type, elem_name))
+
+/* Returns the n-th object in order, starting from 0, or NULL */
+#define bintree_get_nth_obj(root_obj, n, struct_type, elem_name)              \
+   bintree_get_nth_obj_internal((void *)(root_obj), (n),                      \
+                                OFFSET_OF(struct_type, elem_name))
+
+#define bintree_get_rank(root_obj, value, objval_cmpfun, struct_type, elem)   \
+   bintree_get_rank_internal((void *)(root_obj),                              \
+                             (value), (objval_cmpfun),                        \
+                             OFFSET_OF(struct_type, elem))
+
+#define bintree_iter_start(it, root_obj, struct_type, elem_name)              \
+   bintree_iter_start_internal((it), (void *)(root_obj),                      \
+                               OFFSET_OF(struct_type, elem_name))
+
+/* Start iterating from the first object >= `value` (range iteration) */
+#define bintree_iter_start_ge(it, root_obj, value, cmpf, struct_type, elem)   \
+   bintree_iter_start_ge_internal((it), (void *)(root_obj),                   \
+                                  (value), (cmpf),                            \
+                                  OFFSET_OF(struct_type, elem))
+
+#define bintree_cached_insert(t, obj, cmpfun, struct_type, elem_name)         \
+   bintree_cached_insert_internal((t), (void *)(obj), (cmpfun),               \
+                                  OFFSET_OF(struct_type, elem_name))
+
+#define bintree_cached_remove(t, value, objval_cmpfun, struct_type, elem)     \
+   bintree_cached_remove_internal((t), (value), (objval_cmpfun),              \
+                                  OFFSET_OF(struct_type, elem))
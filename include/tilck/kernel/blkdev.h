@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/sync.h>
+
+#define BLK_SECTOR_SIZE                       512
+#define BLK_SECTOR_SHIFT                        9
+
+#define BLK_MAX_DEVICES                        16
+#define BLK_MAX_REQ_BIOS                       16   /* bios merged in a req */
+#define BLK_MAX_REQ_SECTORS                   256   /* 128 KB per request */
+
+struct blk_device;
+
+/*
+ * A block I/O: a contiguous range of sectors to read or write from/to a
+ * virtually contiguous buffer. Drivers map it for DMA with dma_map_buf(),
+ * therefore it doesn't need to be in the linear mapping.
+ */
+struct blk_bio {
+
+   struct list_node node;        /* in the request's `bios` list */
+   u64 sector;
+   u32 sectors;
+   bool write;
+   volatile bool done;
+   char *buf;
+   int rc;
+};
+
+/*
+ * A block request: one or more bios for adjacent sectors, merged together so
+ * that the driver can perform all of them with a single I/O operation (e.g.
+ * a virtio-blk request with one data descriptor per bio).
+ */
+struct blk_request {
+
+   struct list_node node;        /* in the device's queue */
+   struct list bios;             /* sorted by sector */
+   u64 sector;
+   u32 sectors;
+   u32 bios_count;
+   bool write;
+};
+
+struct blk_ops {
+
+   /*
+    * Starts the I/O for `req` and returns immediately: the driver must call
+    * blk_end_request() when it's completed, from a task context (e.g. the
+    * bottom half of its IRQ handler). Called with the device lock held.
+    */
+   int (*submit)(struct blk_device *dev, struct blk_request *req);
+};
+
+struct blk_stats {
+
+   u64 bios;
+   u64 requests;
+   u64 merges;
+};
+
+struct blk_device {
+
+   const char *name;             /* e.g. "vda": statically allocated */
+   u64 sectors;
+   bool read_only;
+   const struct blk_ops *ops;
+   void *priv;
+
+   /* Generic fields, set by register_blk_device() */
+   u16 minor;
+   int plug_count;
+   u64 head;                     /* elevator's position */
+
+   struct kmutex lock;
+   struct kcond done_cond;       /* signaled when requests complete */
+   struct list queue;            /* pending requests, sorted by sector */
+   struct blk_request *active;   /* the request in flight, if any */
+   struct blk_stats stats;
+};
+
+int register_blk_device(struct blk_device *dev);
+struct blk_device *get_blk_device(const char *name);
+
+void blk_submit_bio(struct blk_device *dev, struct blk_bio *bio);
+int blk_wait_bio(struct blk_device *dev, struct blk_bio *bio);
+void blk_end_request(struct blk_device *dev, struct blk_request *req, int rc);
+
+void blk_plug(struct blk_device *dev);
+void blk_unplug(struct blk_device *dev);
+
+int blk_read(struct blk_device *dev, u64 sector, u32 count, void *buf);
+int blk_write(struct blk_device *dev, u64 sector, u32 count, void *buf);
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Boot timeline: a fixed array of timestamped steps, filled from the very
+ * beginning of kmain() until init's first fork. The timestamps are TSC values
+ * (rdtime on riscv), because they are available long before the timer.
+ */
+
+#define BOOT_TRACE_MAX_EVENTS                    64
+
+struct boot_trace_event {
+
+   const char *name;       /* static string */
+   const char *arg;        /* static string or NULL */
+   u64 start;              /* TSC */
+   u64 end;                /* TSC, 0 while the step is running */
+   u64 sys_time;           /* get_sys_time() at start: 0 before the timer */
+};
+
+int boot_trace_begin(const char *name, const char *arg);
+void boot_trace_end(int id);
+
+static inline void boot_trace_point(const char *name, const char *arg)
+{
+   boot_trace_end(boot_trace_begin(name, arg));
+}
+
+int boot_trace_get_count(void);
+const struct boot_trace_event *boot_trace_get_event(int i);
+u64 boot_trace_tsc_to_us(u64 tsc);
@@ -9,6 +9,14 @@ extern const ulong init_st_begin;
 extern const ulong init_st_end;
 
 void dump_stacktrace(void *ebp, pdir_t *pdir);
+
+/*
+ * Walks up to `count` frames of a kernel stack starting from the frame pointer
+ * `fp`, without ever leaving the KERNEL_STACK_SIZE bytes starting at `stack`.
+ * Safe to call in IRQ context, even when `fp` is garbage.
+ */
+size_t
+stackwalk_kernel_stack(void **frames, size_t count, void *fp, void *stack);
 void dump_regs(regs_t *r);
 
 int debug_qemu_turn_off_machine(void);
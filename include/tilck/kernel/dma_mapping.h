@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * DMA mapping API, for the device drivers. On the architectures we support,
+ * DMA is cache-coherent: mapping a buffer just means finding out the physical
+ * ranges the device has to access. The only constraint is the device's DMA
+ * mask: the highest physical address it can reach. A buffer (or a part of it)
+ * beyond the mask or split in too many physical ranges gets copied through a
+ * bounce buffer. Only the devices with a mask below the regular memory (e.g.
+ * ISA DMA) end up using the tiny DMA heap (see KMALLOC_FL_DMA).
+ */
+
+#define DMA_MASK_ISA                          (16 * MB - 1)
+#define DMA_MASK_32                           ((u64)0xffffffff)
+#define DMA_MASK_ALL                          ((u64)-1)
+
+enum dma_dir {
+
+   DMA_TO_DEVICE,
+   DMA_FROM_DEVICE,
+   DMA_BIDIRECTIONAL,
+};
+
+/* A physically contiguous range: an entry of a scatter-gather list */
+struct dma_sg {
+
+   u64 paddr;
+   u32 len;
+};
+
+struct dma_map {
+
+   void *buf;
+   size_t len;
+   enum dma_dir dir;
+   void *bounce;              /* NULL if the device accesses `buf` directly */
+   size_t bounce_size;
+   u32 sg_count;              /* entries used in the scatter-gather list */
+};
+
+/*
+ * Allocates `size` bytes (rounded up to pages) of zeroed memory, physically
+ * contiguous and below `mask`. The physical address is stored in `paddr`.
+ */
+void *dma_alloc_coherent(size_t size, u64 mask, ulong *paddr);
+void dma_free_coherent(void *vaddr, size_t size);
+
+/*
+ * Maps `buf` for a DMA transfer of `len` bytes, filling the scatter-gather
+ * list `sg` (at most `max_sg` entries). The buffer can be anywhere in the
+ * kernel's address space: in the linear mapping or in vmalloc / ramfs pages.
+ * Adjacent physical pages are merged in a single entry. Returns 0 or -ENOMEM
+ * if a bounce buffer was needed, but it couldn't be allocated.
+ */
+int
+dma_map_buf(void *buf,
+            size_t len,
+            enum dma_dir dir,
+            u64 mask,
+            struct dma_sg *sg,
+            u32 max_sg,
+            struct dma_map *m);
+
+/* Completes the transfer: copies back and frees the bounce buffer, if any */
+void dma_unmap_buf(struct dma_map *m);
@@ -9,15 +9,23 @@
 
 struct locked_file; /* forward declaration */
 
+struct exec_args; /* forward declaration */
+
 struct elf_program_info {
 
+   struct exec_args *args; // IN: argv and env, mapped on top of the stack
    pdir_t *pdir;           // The pdir used for the program
-   void *entry;            // The address of program's entry point
+   void *entry;            // Where to start (interpreter's entry, if any)
+   void *prog_entry;       // The address of program's entry point
    void *stack;            // The initial value of the stack pointer
    void *brk;              // The first invalid vaddr (program break)
+   void *phdrs;            // Program's headers in memory (can be NULL)
+   u32 phnum;              // The number of program's headers
+   void *interp_base;      // Where the interpreter is loaded (can be NULL)
    struct locked_file *lf; // ELF's file lock (can be NULL)
+   struct locked_file *interp_lf; // Interpreter's file lock (can be NULL)
    bool wrong_arch;        // The ELF is compiled for the wrong arch
-   bool dyn_exec;          // The ELF is a dynamic executable (not supported)
+   bool dyn_exec;          // Dynamic executable, the interpreter failed to load
 };
 
 /*
@@ -28,7 +36,14 @@ struct elf_program_info {
  * `header_buf`: IN arg, the address of a buffer where to store the first
  * `ELF_RAW_HEADER_SIZE` bytes of the file at `filepath`.
  *
- * 'pinfo': OUT arg, essential info about the loaded program.
+ * 'pinfo': OUT arg, essential info about the loaded program. Except for
+ * `pinfo->args` (IN): on success, the pages of its strings belong to the
+ * new pdir, mapped at the top of the stack (see struct exec_args).
+ *
+ * Dynamic executables (with a PT_INTERP segment) are supported by loading
+ * their interpreter (e.g. musl's ld.so, an ET_DYN ELF) at USER_INTERP_VADDR:
+ * in that case, `entry` is interpreter's entry point, while `prog_entry` is
+ * program's one, passed to the interpreter with AT_ENTRY.
  */
 int load_elf_program(const char *filepath,
                      char *header_buf,
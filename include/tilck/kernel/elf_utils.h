@@ -14,6 +14,7 @@ struct elf_symbol_info {
 };
 
 void call_kernel_global_ctors(void);
+void init_ksyms_index(void);
 ulong find_addr_of_symbol(const char *searched_sym);
 const char *find_sym_at_addr(ulong vaddr, long *off, u32 *sym_size);
 const char *find_sym_at_addr_safe(ulong vaddr, long *off, u32 *sym_size);
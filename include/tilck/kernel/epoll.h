@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+#include <tilck/kernel/sync.h>
+
+struct epoll;
+
+struct epoll *create_epoll(void);
+void destroy_epoll(struct epoll *ep);
+fs_handle epoll_create_handle(struct epoll *ep);
+
+/*
+ * Called by kcond_signal_*() for WOBJ_EPOLL wait objects: those are the
+ * persistent registrations of an epoll item in a file's r/w/e kcond. Returns
+ * true if there was a task in epoll_wait() to wake up.
+ */
+bool epoll_on_cond_signal(struct wait_obj *wo);
+
+/* Called by vfs_close(): drops all the epoll registrations of `h` */
+void epoll_on_handle_close(fs_handle h);
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/* Same values as Linux's <sys/eventfd.h> */
+#define EFD_SEMAPHORE                   00000001
+#define EFD_CLOEXEC                     O_CLOEXEC
+#define EFD_NONBLOCK                    O_NONBLOCK
+
+struct eventfd;
+
+struct eventfd *create_eventfd(u64 initval, int flags);
+void destroy_eventfd(struct eventfd *efd);
+fs_handle eventfd_create_handle(struct eventfd *efd, int flags);
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/hal_types.h>
+
+/*
+ * The exception table maps the address of each kernel instruction allowed to
+ * fault while accessing user memory to the address of the code handling that
+ * fault (fixup). The entries are emitted by the user-access primitives (see
+ * get_user(), put_user() and asm_copy_user()) in the `.ex_table` section and
+ * the linker script collects them between `ex_table` and `ex_table_end`.
+ *
+ * Compared to fault_resumable_call(), that costs nothing on the success path:
+ * no registers to save, nor fault masks to set.
+ */
+struct extable_entry {
+
+   ulong insn;    /* address of the faulting instruction */
+   ulong fixup;   /* where to continue after the fault */
+};
+
+extern const struct extable_entry ex_table[];
+extern const struct extable_entry ex_table_end[];
+
+/*
+ * Called by the fault handler: if the fault happened at an instruction in the
+ * exception table, make `r` resume at its fixup code and return true.
+ */
+bool extable_fixup(regs_t *r);
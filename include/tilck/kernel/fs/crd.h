@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/crd.h>
+#include <tilck/kernel/sync.h>
+
+/*
+ * A compressed ramdisk (see <tilck/common/crd.h>), decompressed on demand.
+ *
+ * The uncompressed image has a virtual address range reserved in the hi vmem,
+ * `image`, but only the blocks needed to walk the FS (the FATs and the
+ * directories) get decompressed and mapped there, by crd_map(). The file data
+ * is read with crd_read() instead, which decompresses the blocks not mapped in
+ * a scratch buffer: in the end, the data of the files is stored only in their
+ * page cache and only after it has been read.
+ */
+
+#define CRD_NO_BLOCK                 ((u32)-1)
+
+struct crd {
+
+   const struct crd_hdr *hdr;    /* the compressed image */
+   char *image;                  /* the uncompressed image, partially mapped */
+   size_t image_vsize;           /* size of the range reserved for `image` */
+   char **blocks;                /* the mapped blocks or NULL */
+
+   struct kmutex lock;           /* protects the scratch buffer */
+   char *scratch;
+   u32 scratch_block;            /* the block in `scratch` or CRD_NO_BLOCK */
+};
+
+int crd_init(struct crd *c, void *rd, size_t rd_size);
+void crd_destroy(struct crd *c);
+
+int crd_map(struct crd *c, u32 off, u32 len);
+int crd_read(struct crd *c, u32 off, char *buf, u32 len);
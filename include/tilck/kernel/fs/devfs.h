@@ -4,6 +4,7 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/sys_types.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/hashtable.h>
 
 typedef int (*func_create_per_handle_extra)(int minor, void *extra);
 typedef int (*func_on_dup_per_handle_extra)(int minor, void *extra);
@@ -26,6 +27,7 @@ struct devfs_file {
    enum vfs_entry_type type;     /* Must be FIRST, because of devfs_dir */
 
    struct list_node dir_node;
+   struct htable_node hnode;
    struct devfs_file_info nfo;
 
    u16 dev_major;
@@ -64,6 +66,7 @@ typedef int
 struct driver_info {
 
    u16 major;
+   u16 next_minor;               /* see devfs_alloc_minor() */
    const char *name;
    func_create_device_file create_dev_file;
 };
@@ -74,6 +77,8 @@ void init_devfs(void);
 int register_driver(struct driver_info *info, int major);
 
 int create_dev_file(const char *filename, u16 major, u16 minor, void **devfile);
+int devfs_alloc_minor(u16 major);
+int devfs_create_mp_dir(const char *name);
 struct mnt_fs *get_devfs(void);
 struct driver_info *get_driver_info(u16 major);
 
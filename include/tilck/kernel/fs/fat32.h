@@ -6,8 +6,79 @@
 #include <tilck/common/fat32_base.h>
 
 #include <tilck/kernel/sync.h>
+#include <tilck/kernel/rwlock.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/fs/vfs_base.h>
+#include <tilck/kernel/fs/pagecache.h>
+
+struct crd;
+
+#define FAT_INVALID_CLUSTER                ((u32)-1)
+
+/*
+ * A run of contiguous clusters in a file's cluster chain: the clusters of the
+ * file with index in [fclu, fclu + len) are [clu, clu + len) on the volume.
+ */
+struct fat_extent {
+   u32 fclu;
+   u32 clu;
+   u32 len;
+};
+
+/*
+ * Per-file extent map, built lazily from the cluster chain the first time a
+ * random access (pread, seek) is needed. On read-only volumes the maps never
+ * change and live until the umount. When the volume cannot be accessed
+ * directly (see `use_pagecache`), the map also holds the page cache of the
+ * file, which gets filled through the extents.
+ *
+ * On r/w volumes, every open file has its map, which acts as the in-memory
+ * inode of the file: it's updated as the cluster chain changes and it holds
+ * the lock of the file's data. See fat32_rw.c.
+ */
+struct fat_extent_map {
+
+   struct bintree_node node;
+   struct fat_entry *e;            /* key: FAT has no inodes, see below */
+   struct fat_fs_device_data *d;
+   u32 count;
+   u32 slots;                      /* allocated elements in `extents` */
+   struct fat_extent *extents;     /* sorted by `fclu` */
+   struct page_cache pc;
+
+   /* r/w volumes only */
+   bool stale;                     /* out of memory: walk the chain instead */
+   bool mtime_dirty;               /* `mtime` not written back yet */
+   int ref_count;                  /* open handles */
+   s64 mtime;                      /* timestamp of the last write */
+   struct rwlock_wp rwlock;        /* protects the data and the size */
+};
+
+/*
+ * State of the r/w volumes. The data is written in place in the ramdisk, but
+ * the FAT is updated only in its first copy: the dirty sectors of the FAT are
+ * copied to the others (and the FSInfo sector updated) by fat_flush(), which
+ * writes back also the modification times of the files.
+ */
+struct fat_rw_data {
+
+   struct rwlock_wp fs_rwlock;     /* the fs-lock */
+   struct kmutex lock;             /* FAT, allocator and dirty state */
+   struct list_node wb_node;       /* in the writeback thread's list */
+   struct fat_fs_device_data *d;
+
+   u32 max_cluster;                /* first cluster beyond the ramdisk */
+   u32 next_free;                  /* next-fit allocation cursor */
+   u32 free_count;                 /* free clusters below `max_cluster` */
+   u32 free_beyond;                /* free clusters beyond the ramdisk */
+
+   ulong *dirty_fat;               /* bitmap: one bit per sector of FAT 0 */
+   u32 dirty_fat_words;
+   u32 dirty_fat_sectors;
+   bool dirty_files;               /* some map has `mtime_dirty` set */
+};
 
 struct fat_fs_device_data {
 
@@ -17,6 +88,16 @@ struct fat_fs_device_data {
    u32 root_cluster;
    bool mmap_support;
 
+   /*
+    * True when the clusters are not page-aligned in memory, so they cannot be
+    * mapped directly in user space, as `mmap_support` requires: files are then
+    * read and mapped through their page cache.
+    */
+   bool use_pagecache;
+
+   /* Set for compressed ramdisks (see fat32_crd.c): implies `use_pagecache` */
+   struct crd *crd;
+
    /*
     * A pointer to root directory's entries. Notice that this isn't a random
     * choice: the first entry in the root directory the is "Volume ID" entry,
@@ -28,6 +109,12 @@ struct fat_fs_device_data {
     * regular fat_entry.
     */
    struct fat_entry *root_dir_entries;
+
+   /* Tree of struct fat_extent_map, keyed by fat_entry */
+   struct fat_extent_map *extent_maps_root;
+
+   /* Set only for the r/w volumes */
+   struct fat_rw_data *rw;
 };
 
 struct fatfs_handle {
@@ -38,10 +125,69 @@ struct fatfs_handle {
    /* fs-specific members */
    struct fat_entry *e;
    u32 curr_cluster;
+   struct pc_readahead ra;
+   struct fat_walk_pos dir_walk_pos;  /* directories: getdents() cursor */
+   struct fat_extent_map *map;        /* files on r/w volumes */
 };
 
 STATIC_ASSERT(sizeof(struct fatfs_handle) <= MAX_FS_HANDLE_SIZE);
 
+/*
+ * Returns the first cluster of the directory `e`, handling the special case
+ * where `e` is NOT a dir entry but a pointer to the entries in the root
+ * directory. On FAT16, that's 0.
+ */
+static inline u32
+fat_get_dir_first_cluster(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   return e == d->root_dir_entries ? d->root_cluster : fat_get_first_cluster(e);
+}
+
+u32 fat_get_file_cluster(struct fat_fs_device_data *d,
+                          struct fat_entry *e,
+                          u32 fclu);
+void fat_destroy_extent_maps(struct fat_fs_device_data *d);
+
+struct fat_extent_map *
+fat_retain_file(struct fat_fs_device_data *d, struct fat_entry *e);
+
+int fat_file_ref(struct fat_fs_device_data *d, struct fat_entry *e, int delta);
+void fat_forget_file(struct fat_fs_device_data *d, struct fat_entry *e);
+void fat_extent_map_append(struct fat_extent_map *map, u32 fclu, u32 clu);
+void fat_extent_map_truncate(struct fat_extent_map *map, u32 nclu);
+
+struct page_cache *
+fat_get_page_cache(struct fat_fs_device_data *d, struct fat_entry *e);
+
+int fat_crd_init(struct fat_fs_device_data *d, void *rd, size_t rd_size);
+int fat_crd_map_dirs(struct fat_fs_device_data *d);
+void fat_crd_destroy(struct fat_fs_device_data *d);
+
+int
+fat_crd_read(struct fat_fs_device_data *d,
+             u32 clu, u32 off, char *buf, u32 len);
+
+int fat_rw_init(struct mnt_fs *fs, size_t rd_size);
+void fat_rw_destroy(struct mnt_fs *fs);
+void fat_flush(struct fat_fs_device_data *d);
+
+ssize_t
+fat_rw_write(struct fatfs_handle *h, char *buf, size_t len, offt *pos);
+
+int fat_rw_truncate(struct mnt_fs *fs, struct fat_entry *e, offt len);
+int fat_rw_unlink(struct vfs_path *p);
+
+int
+fat_rw_create(struct mnt_fs *fs,
+              struct fat_entry *dir,
+              const char *name,
+              struct fat_entry **out);
+
+/*
+ * Mounts the FAT ramdisk at `vaddr`. With VFS_FS_RW, the memory must be
+ * writable and the free clusters of the volume are usable only as long as
+ * they're inside [vaddr, vaddr + rd_size).
+ */
 struct mnt_fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags);
 void fat_umount_ramdisk(struct mnt_fs *fs);
 
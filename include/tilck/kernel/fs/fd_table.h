@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_userlim.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+#define FD_TABLE_INLINE_WORDS          ((MAX_HANDLES + NBITS - 1) / NBITS)
+
+/*
+ * The table of the file descriptors of a process.
+ *
+ * The first MAX_HANDLES slots are embedded in the table itself, which is
+ * enough for the vast majority of the processes. When more are needed, the
+ * table is moved on the heap, doubling its size each time, up to the soft
+ * RLIMIT_NOFILE limit (`nofile_cur`). The `open_fds` bitmap allows finding
+ * the lowest free fd and iterating over the open ones without scanning the
+ * whole table.
+ *
+ * The table is allocated on the heap as well, by fd_table_clone(): that keeps
+ * `struct process` small enough for `struct task_and_process` to fit in a
+ * single 1 KB kmalloc chunk on 32-bit systems.
+ *
+ * Locking: protected by the owner process' `fslock`.
+ */
+struct fd_table {
+
+   fs_handle *handles;                /* `size` slots */
+   ulong *open_fds;                   /* bitmap: one bit per slot */
+   u32 size;
+
+   u32 nofile_cur;                    /* RLIMIT_NOFILE: soft limit */
+   u32 nofile_max;                    /* RLIMIT_NOFILE: hard limit */
+
+   fs_handle inline_handles[MAX_HANDLES];
+   ulong inline_open_fds[FD_TABLE_INLINE_WORDS];
+};
+
+void fd_table_init(struct fd_table *t);
+int fd_table_copy(struct fd_table *dst, struct fd_table *src);
+void fd_table_destroy(struct fd_table *t);
+
+struct fd_table *fd_table_clone(struct fd_table *src);
+void fd_table_free(struct fd_table *t);
+
+int fd_table_get_free_fd(struct fd_table *t, int ge);
+int fd_table_reserve(struct fd_table *t, int fd);
+void fd_table_set(struct fd_table *t, int fd, fs_handle h);
+int fd_table_next_open(struct fd_table *t, int fd);
+
+static ALWAYS_INLINE fs_handle
+fd_table_get(struct fd_table *t, int fd)
+{
+   return IN_RANGE(fd, 0, (int)t->size) ? t->handles[fd] : NULL;
+}
+
+/* Iterate over the open fds, in increasing order */
+#define fd_table_for_each(t, fd)                                 \
+   for (fd = fd_table_next_open((t), 0);                         \
+        fd >= 0;                                                 \
+        fd = fd_table_next_open((t), fd + 1))
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/fs/vfs.h>
+
+/*
+ * Generic per-inode page cache.
+ *
+ * File systems whose blocks cannot be mapped directly in memory (unlike the
+ * ramfs blocks or the clusters of a page-aligned FAT ramdisk) read their files
+ * through a page cache: each page of the file is read once, with the FS's
+ * fill_page() callback, and then shared by all the readers. mmap() maps the
+ * cached pages: MAP_SHARED mappings and the read-only ELF segments of all the
+ * processes share the same physical pages, while the private mappings copy
+ * them on the first write.
+ *
+ * NOTE: the cache is read-only, as the only FS using it (fat) is.
+ */
+
+#define PC_RA_MIN_PAGES                          4
+#define PC_RA_MAX_PAGES                         32
+
+struct page_cache;
+
+/*
+ * Fills the page with index `index` of the file: `buf` is PAGE_SIZE bytes long
+ * and the part of it past EOF must be zeroed.
+ */
+typedef int (*func_pc_fill_page)(struct page_cache *pc, ulong index, char *buf);
+
+struct pc_page {
+
+   struct bintree_node node;
+   ulong index;                       /* page index in the file: the key */
+   char *vaddr;                       /* the page, in the linear mapping */
+};
+
+struct page_cache {
+
+   struct pc_page *pages_root;
+   func_pc_fill_page fill_page;
+   offt fsize;
+   size_t nr_pages;
+};
+
+/*
+ * Per-handle readahead state. Sequential streams double the readahead window,
+ * from PC_RA_MIN_PAGES up to PC_RA_MAX_PAGES, every time they consume half of
+ * the pages read ahead. Any random access resets the window.
+ */
+struct pc_readahead {
+
+   ulong next;                        /* index expected if sequential */
+   ulong end;                         /* first page not read ahead yet */
+   u32 win;                           /* current window size, in pages */
+};
+
+void pc_init(struct page_cache *pc, func_pc_fill_page fill_page, offt fsize);
+void pc_destroy(struct page_cache *pc);
+char *pc_get_page(struct page_cache *pc, ulong index);
+
+void
+pc_update_readahead(struct page_cache *pc,
+                    struct pc_readahead *ra,
+                    ulong index);
+
+ssize_t
+pc_read(struct page_cache *pc,
+        struct pc_readahead *ra,
+        char *buf,
+        size_t len,
+        offt *pos);
+
+ssize_t
+pc_splice_read(struct page_cache *pc,
+               struct pc_readahead *ra,
+               size_t len,
+               offt *pos,
+               func_splice_actor actor,
+               void *arg);
+
+int
+pc_mmap(struct page_cache *pc,
+        struct user_mapping *um,
+        pdir_t *pdir,
+        u32 pg_flags);
@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs.h>
+
+struct mnt_fs *ramfs_create(void);
+
+int
+ramfs_create_anon_file(struct mnt_fs *fs, mode_t mode, int fl, fs_handle *out);
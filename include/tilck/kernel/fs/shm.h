@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+#define MEMFD_NAME_MAX_LEN                   249
+
+void init_shm(void);
+int shm_create_memfd(int fl, fs_handle *out);
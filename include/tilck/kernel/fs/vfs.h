@@ -39,6 +39,8 @@ typedef int     (*func_symlink)   (const char *, struct vfs_path *);
 typedef int     (*func_readlink)  (struct vfs_path *, char *);
 typedef int     (*func_chmod)     (struct mnt_fs *, vfs_inode_ptr_t, mode_t);
 typedef void    (*func_fslock_t)  (struct mnt_fs *);
+typedef int     (*func_dirlock)   (struct vfs_path *);
+typedef void    (*func_dirunlock) (struct vfs_path *);
 typedef int     (*func_rr_inode)  (struct mnt_fs *, vfs_inode_ptr_t);
 
 typedef int     (*func_futimens)  (struct mnt_fs *,
@@ -101,8 +103,32 @@ typedef ssize_t        (*func_writev)       (fs_handle,
                                              int);
 
 typedef int            (*func_fsync)        (fs_handle);
+typedef int            (*func_fallocate)    (fs_handle, int, offt, offt);
+
+/*
+ * Splice support: a func_splice_read() feeds the file contents directly to the
+ * `actor`, without copying them in an intermediate buffer. The actor returns
+ * the number of bytes it consumed (possibly less than `len`) or an error.
+ */
+typedef ssize_t        (*func_splice_actor) (void *, char *, size_t);
+typedef ssize_t        (*func_splice_read)  (fs_handle,
+                                             size_t,
+                                             offt *,
+                                             func_splice_actor,
+                                             void *);
 typedef void           (*func_syncfs)       (struct mnt_fs *);
 
+/*
+ * Copies data between two files of the same file system, ideally by sharing
+ * their blocks. It can copy less than asked (even nothing): the VFS copies the
+ * rest. See vfs_copy_file_range().
+ */
+typedef ssize_t        (*func_copy_range)   (fs_handle,
+                                             offt *,
+                                             fs_handle,
+                                             offt *,
+                                             size_t);
+
 /*
  * Operations affecting the file system structure (directories, files, etc.).
  *
@@ -117,6 +143,24 @@ typedef void           (*func_syncfs)       (struct mnt_fs *);
  * approach not only offers a great simplification, but it actually increases
  * the overall throughput of the system (fine-grain per-directory locking is
  * pretty expensive).
+ *
+ * Per-directory locks (optional)
+ * --------------------------------
+ *
+ * With preemption, a task holding the exclusive fs-lock blocks all the path
+ * lookups on the same FS. Therefore, the file systems can implement also the
+ * dir_exlock() and dir_exunlock() funcs: in that case, open() and the ops
+ * creating new entries (open with O_CREAT, mkdir, symlink) run holding just a
+ * shared fs-lock. The ops creating entries also lock exclusively the directory
+ * containing the last component of the path, using dir_exlock(). Because the
+ * path has been resolved before that, dir_exlock() has to check whether the
+ * last component is still the same: if it isn't, it returns -EAGAIN and the
+ * VFS repeats the whole operation holding the exclusive fs-lock.
+ *
+ * All the other ops removing or moving entries (unlink, rmdir, rename, link)
+ * still hold the exclusive fs-lock. Because of that, no entry or inode can
+ * disappear while holding a shared fs-lock. The FS is responsible for locking
+ * each directory (at least) in shared mode while looking up its entries.
  */
 struct fs_ops {
 
@@ -148,6 +192,10 @@ struct fs_ops {
    func_fslock_t fs_shlock;
    func_fslock_t fs_shunlock;
 
+   /* per-directory lock funcs, both optional: see the comment above */
+   func_dirlock dir_exlock;
+   func_dirunlock dir_exunlock;
+
    /* per-file lock funcs */
    func_exlock_noblk exlock_noblk;     /* if NULL -> -ENOLOCK  */
    func_exlock_noblk exunlock;         /* if NULL -> 0         */
@@ -164,9 +212,12 @@ struct file_ops {
    func_munmap munmap;                 /* if NULL -> -ENODEV */
    func_fsync sync;                    /* if NULL -> -EROFS or 0 */
    func_fsync datasync;                /* if NULL -> -EROFS or 0 */
+   func_fallocate fallocate;           /* if NULL -> -EOPNOTSUPP */
+   func_copy_range copy_range;         /* if NULL, emulated with splice */
 
    func_readv readv;                   /* if NULL, emulated in non-atomic way */
    func_writev writev;                 /* if NULL, emulated in non-atomic way */
+   func_splice_read splice_read;       /* if NULL, emulated using read() */
 
    func_handle_fault handle_fault;     /* if NULL -> false     */
 
@@ -189,6 +240,8 @@ struct file_ops {
 
 int vfs_stat64(const char *path, struct k_stat64 *statbuf, bool res_last_sl);
 int vfs_open(const char *path, fs_handle *out, int flags, mode_t mode);
+int vfs_openat(fs_handle dirh, const char *path, fs_handle *out,
+               int flags, mode_t mode);
 int vfs_unlink(const char *path);
 int vfs_mkdir(const char *path, mode_t mode);
 int vfs_rmdir(const char *path);
@@ -209,6 +262,7 @@ int vfs_fchmod(fs_handle h, mode_t mode);
 int vfs_futimens(fs_handle h, const struct k_timespec64 times[2]);
 int vfs_fsync(fs_handle h);
 int vfs_fdatasync(fs_handle h);
+int vfs_fallocate(fs_handle h, int mode, offt off, offt len);
 offt vfs_seek(fs_handle h, offt off, int whence);
 
 int vfs_read_ready(fs_handle h);
@@ -224,6 +278,13 @@ ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt);
 ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt);
 ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off);
 ssize_t vfs_pwrite(fs_handle h, void *buf, size_t buf_size, offt off);
+ssize_t vfs_read_user(fs_handle h, void *u_buf, size_t len);
+ssize_t vfs_pread_user(fs_handle h, void *u_buf, size_t len, offt off);
+
+ssize_t vfs_splice(fs_handle in, offt *in_pos,
+                   fs_handle out, offt *out_pos, size_t len);
+ssize_t vfs_copy_file_range(fs_handle in, offt *in_pos,
+                            fs_handle out, offt *out_pos, size_t len);
 
 int vfs_exlock_noblock(struct mnt_fs *fs, vfs_inode_ptr_t i);
 int vfs_exunlock(struct mnt_fs *fs, vfs_inode_ptr_t i);
@@ -270,6 +331,27 @@ vfs_get_root_entry(struct mnt_fs *fs, struct fs_path *fs_path)
    vfs_get_entry(fs, NULL, NULL, 0, fs_path);
 }
 
+/*
+ * Dentry cache, used for the file systems having the VFS_FS_DCACHE flag.
+ * Such file systems MUST call vfs_dcache_invalidate() every time an entry is
+ * added to or removed from a directory (name != NULL) and when a directory
+ * inode is destroyed (name == NULL).
+ */
+
+struct vfs_dcache_stats {
+   ulong hits;
+   ulong neg_hits;
+   ulong misses;
+   ulong invalidations;
+   ulong evictions;
+   ulong entries;
+};
+
+extern struct vfs_dcache_stats vfs_dcache_stats;
+
+void vfs_dcache_invalidate(vfs_inode_ptr_t idir, const char *name, size_t len);
+void vfs_dcache_invalidate_fs(struct mnt_fs *fs);
+
 /* Whole-struct mnt_fs locks */
 void vfs_fs_exlock(struct mnt_fs *fs);
 void vfs_fs_exunlock(struct mnt_fs *fs);
@@ -313,6 +395,18 @@ vfs_resolve(const char *path,
             bool exlock,
             bool res_last_sl);
 
+/*
+ * Like vfs_resolve(), but the relative paths start from the directory `dir`
+ * instead of the current working directory (if `dir` is not NULL). The caller
+ * must guarantee that `dir` stays valid during the call.
+ */
+int
+vfs_resolve_at(const struct vfs_path *dir,
+               const char *path,
+               struct vfs_path *rp,
+               bool exlock,
+               bool res_last_sl);
+
 int mp_init(struct mnt_fs *root_fs);
 int mp_add(struct mnt_fs *fs, const char *target_path);
 int mp_remove(const char *target_path);
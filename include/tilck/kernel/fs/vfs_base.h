@@ -12,6 +12,7 @@ struct process;
 struct user_mapping;
 struct fs_ops;
 struct locked_file;
+struct mountpoint;
 
 /*
  * Opaque type for file handles.
@@ -69,7 +70,7 @@ struct vfs_path {
 };
 
 #define VFS_FS_RW             (1 << 0)  /* struct mnt_fs mounted in RW mode */
-#define VFS_FS_RQ_DE_SKIP     (1 << 1)  /* FS requires vfs dents skip */
+#define VFS_FS_DCACHE         (1 << 2)  /* FS uses the VFS dentry cache */
 
 /* This struct is Tilck's analogue of Linux's "superblock" */
 struct mnt_fs {
@@ -82,6 +83,15 @@ struct mnt_fs {
    u32 flags;
    void *device_data;
    const struct fs_ops *fsops;
+
+   /*
+    * Mountpoint info, used by vfs_resolve() to skip the mount table for most
+    * of the path components: `hosted_mps` is the number of file systems
+    * mounted on directories of this FS, while `mp` is where this FS is
+    * mounted (NULL for the root FS).
+    */
+   u32 hosted_mps;
+   struct mountpoint *mp;
 };
 
 
@@ -117,6 +127,12 @@ struct fs_handle_base {
 #define VFS_SPFL_MMAP_SUPPORTED                (1 << 1)
 #define VFS_SPFL_NO_LF                         (1 << 2)
 
+/*
+ * read() and pread() can copy directly in the user buffer, through the file's
+ * splice_read() function: see vfs_read_user().
+ */
+#define VFS_SPFL_USER_SPLICE_READ              (1 << 3)
+
 /*
  * vfs_mmap()'s flags
  *
@@ -131,13 +147,20 @@ struct fs_handle_base {
  * VFS_MM_DONT_MMAP flag play a role. At the same way, in other exceptional
  * situations we might not want the FS to register the mapping, but to do it
  * anyway.
+ *
+ * VFS_MM_PRIVATE asks the FS to map the file's pages copy-on-write, so that
+ * writes never reach the file. It's used by the ELF loader for the writable
+ * segments and requires VFS_MM_DONT_REGISTER: the private copies are owned by
+ * the page directory and get released by pdir_destroy().
  */
 #define VFS_MM_DONT_MMAP            (1 << 0)
 #define VFS_MM_DONT_REGISTER        (1 << 1)
+#define VFS_MM_PRIVATE              (1 << 2)
 
 int vfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags);
 int vfs_munmap(struct user_mapping *um, void *vaddr, size_t len);
 bool vfs_handle_fault(struct user_mapping *um, void *va, bool p, bool rw);
+int vfs_mm_drop_pages(struct user_mapping *um, void *va, size_t len);
 int vfs_dup(fs_handle h, fs_handle *dup_h);
 void vfs_close(fs_handle h);
 fs_handle get_fs_handle(int fd);
@@ -137,6 +137,11 @@
       /* STUB function: do nothing */
    }
 
+   static ALWAYS_INLINE void enable_interrupts_and_halt(void)
+   {
+      /* STUB function: do nothing */
+   }
+
    static ALWAYS_INLINE void init_fpu_memcpy(void)
    {
       /* STUB function: do nothing */
@@ -191,7 +196,20 @@ int get_int_num(regs_t *context);
 void on_first_pdir_update(void);
 extern void (*hw_read_clock)(struct datetime *out);
 void hw_read_clock_cmos(struct datetime *out);
+
+/*
+ * Sleeps until the HW clock changes the second and saves in `sys_time` the
+ * value of get_sys_time() at that moment. Returns -ENODEV if the HW clock
+ * cannot notify that, or -ETIMEDOUT.
+ */
+int hw_clock_wait_edge(u64 *sys_time);
 u32 hw_timer_setup(u32 hz);
+u32 hw_timer_stop_tick(u32 max_ticks, u32 *phase);
+u64 hw_timer_restart_tick(bool *expired);
+bool hw_idle_supported(int method);
+void hw_idle_enter(int method, ulong arg);
+bool hw_tsc_is_stable(void);
+u64 hw_tsc_get_hz(void);
 
 bool allocate_fpu_regs(arch_task_members_t *arch_fields);
 void copy_main_tss_on_regs(regs_t *ctx);
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Intrusive hash table, with separate chaining. The objects embed a struct
+ * htable_node and the caller computes the hashes (see the functions below),
+ * while the table only compares them: the keys are compared by the `match`
+ * callback passed to htable_find().
+ *
+ * The table doubles its buckets when the average chain length exceeds
+ * HTABLE_MAX_LOAD. In order to avoid latency spikes, the nodes are NOT moved
+ * all at once: each insertion and removal moves the nodes of the next
+ * HTABLE_REHASH_STEP buckets of the old array, while the lookups just check
+ * in which array each bucket is at the moment. If the allocation of the new
+ * buckets fails, the table simply keeps the old ones: the operations never
+ * fail. The table never shrinks.
+ *
+ * A zeroed struct htable is a valid empty table, using a single bucket stored
+ * in the struct itself: because of that, the struct must not be copied.
+ *
+ * NOTE: there's no locking here: that's up to the caller.
+ */
+
+#define HTABLE_MAX_LOAD                       2
+#define HTABLE_REHASH_STEP                    4
+
+struct htable_node {
+   struct htable_node *next;
+   struct htable_node **pprev;   /* the pointer pointing to this node */
+   u32 hash;
+};
+
+struct htable {
+
+   struct htable_node **buckets;       /* NULL: use `single` */
+   struct htable_node **old_buckets;   /* NULL when not rehashing */
+   struct htable_node *single;         /* the bucket before the first grow */
+   u32 bits;                           /* buckets: 2^bits */
+   u32 old_bits;
+   u32 rehash_pos;                     /* next old bucket to move */
+   u32 count;
+};
+
+/* Returns true if the object containing `n` has the key `key` */
+typedef bool (*htable_match_func)(struct htable_node *n, const void *key);
+
+static inline void htable_node_init(struct htable_node *n)
+{
+   n->next = NULL;
+   n->pprev = NULL;
+   n->hash = 0;
+}
+
+static inline bool htable_node_is_in_table(struct htable_node *n)
+{
+   return n->pprev != NULL;
+}
+
+static inline u32 htable_get_count(struct htable *ht)
+{
+   return ht->count;
+}
+
+void htable_init(struct htable *ht);
+void htable_destroy(struct htable *ht);
+void htable_add(struct htable *ht, struct htable_node *n, u32 hash);
+void htable_del(struct htable *ht, struct htable_node *n);
+
+struct htable_node *
+htable_find(struct htable *ht, u32 hash, htable_match_func m, const void *key);
+
+#define htable_find_obj(ht, hash, m, key, struct_type, elem_name)          \
+   ({                                                                      \
+      struct htable_node *__n = htable_find((ht), (hash), (m), (key));     \
+      __n ? CONTAINER_OF(__n, struct_type, elem_name) : NULL;              \
+   })
+
+/* FNV-1a: `s` might be not NUL-terminated */
+static inline u32 hash_str(const char *s, size_t len)
+{
+   u32 h = 2166136261u;
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)s[i];
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+/*
+ * The finalizer of MurmurHash3: unlike the multiplicative hashing, all the
+ * bits of the result depend on all the bits of `v`, so it's fine to use just
+ * the lowest ones as bucket index.
+ */
+static inline u32 hash_u32(u32 v)
+{
+   v ^= v >> 16;
+   v *= 0x85ebca6bu;
+   v ^= v >> 13;
+   v *= 0xc2b2ae35u;
+   v ^= v >> 16;
+   return v;
+}
+
+static inline u32 hash_u64(u64 v)
+{
+   return hash_u32((u32)v ^ hash_u32((u32)(v >> 32)));
+}
+
+static inline u32 hash_ulong(ulong v)
+{
+   return NBITS == 64 ? hash_u64(v) : hash_u32((u32)v);
+}
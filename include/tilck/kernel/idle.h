@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * CPU idle states (C-states) and the idle governor. State 0 is always the
+ * plain halt (HLT on x86, WFI on riscv), while the deeper ones are registered
+ * by the firmware drivers (e.g. from ACPI's _CST). Each time the CPU idles,
+ * the governor picks the deepest state whose target residency fits in the
+ * time until the next timer event: entering a deep state costs more than it
+ * saves, if the CPU has to wake up again too soon.
+ *
+ * NOTE: the states are kept sorted by exit latency.
+ */
+
+#define MAX_IDLE_STATES                          8
+#define IDLE_STATE_NAME_LEN                      8
+
+/* Target residency = exit latency * this, as ACPI provides just the latter */
+#define IDLE_RESIDENCY_FACTOR                    2
+
+enum idle_method {
+
+   IDLE_M_HALT    = 0,  /* HLT or WFI */
+   IDLE_M_MWAIT   = 1,  /* MWAIT with `arg` as hint (x86) */
+   IDLE_M_IO_PORT = 2,  /* read from the I/O port `arg` (ACPI P_LVLx) */
+};
+
+struct idle_state {
+
+   char name[IDLE_STATE_NAME_LEN];
+   enum idle_method method;
+   ulong arg;
+   u32 exit_latency_us;
+   u32 target_residency_us;
+
+   /* Stats */
+   u64 usage;                    /* times the state has been entered */
+   u64 time_ns;                  /* total residency */
+};
+
+/*
+ * Registers a new idle state or replaces the one having the same name (the
+ * stats are kept). Returns -EINVAL if the method is not supported by the
+ * hardware and -ENOSPC if there are already MAX_IDLE_STATES states.
+ */
+int idle_register_state(const char *name,
+                        enum idle_method method,
+                        ulong arg,
+                        u32 exit_latency_us);
+
+/* Copies at most `max` states in `arr` and returns their number */
+int idle_get_states(struct idle_state *arr, int max);
+
+/*
+ * Called by the idle task with the interrupts disabled. Enters the best idle
+ * state for `predicted_ns` and returns, with the interrupts enabled, after
+ * the first IRQ.
+ */
+void idle_enter(u64 predicted_ns);
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * The boot-only code and data, marked with INIT_TEXT, INIT_RODATA and INIT_DATA
+ * (see basic_defs.h), live between `init_begin` and `init_end`: the linker
+ * script aligns both of them at KMALLOC_MIN_HEAP_SIZE.
+ */
+extern char init_begin[];
+extern char init_end[];
+
+static inline bool in_init_mem(ulong va)
+{
+   return IN_RANGE(va, (ulong)init_begin, (ulong)init_end);
+}
+
+/*
+ * Gives the pages of the init sections to kmalloc. Called once, after the
+ * first user process has started: nothing marked as INIT_TEXT can be used after
+ * that.
+ */
+void free_init_mem(void);
@@ -8,6 +8,7 @@
 #include <tilck/kernel/hal_types.h>
 
 void set_fault_handler(int fault, void *ptr);
+regs_t *get_irq_regs(void);
 
 static ALWAYS_INLINE bool in_irq(void)
 {
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+#define IO_URING_MAX_ENTRIES                     256
+
+struct io_ring;
+struct io_uring_params;
+
+/*
+ * Creates a new ring for `entries` SQEs, according to the flags in `p`.
+ * On success, fills the rest of `p` (the offsets in the shared memory) and
+ * returns 0. Otherwise, returns a negative errno.
+ */
+int create_io_ring(u32 entries, struct io_uring_params *p, struct io_ring **r);
+void destroy_io_ring(struct io_ring *r);
+fs_handle io_ring_create_handle(struct io_ring *r);
@@ -29,3 +29,38 @@ void irq_uninstall_handler(u8 irq, struct irq_handler_node *n);
 void irq_set_mask(int irq);
 void irq_clear_mask(int irq);
 bool irq_is_masked(int irq);
+
+/*
+ * Per-IRQ statistics, collected by irq_entry() with the TSC for the first
+ * IRQ_STATS_MAX_IRQS IRQs. The handling time includes the nested IRQs, while
+ * the masked time is reported by the arch code only for the lines it actually
+ * masks while running the handlers (e.g. the PIC/IOAPIC lines on x86).
+ *
+ * The histogram is log2-scaled in microseconds: hist[N] counts the IRQs
+ * handled in less than 2^N us, the last bucket all the slower ones.
+ */
+
+#define IRQ_STATS_MAX_IRQS             64
+#define IRQ_STATS_HIST_BUCKETS         12
+
+struct irq_stats {
+
+   u32 count;
+   u32 max_rate;              /* max IRQs counted in a 1-second window */
+   u32 max_depth;             /* max IRQ nesting depth, this IRQ included */
+   u64 max_cycles;
+   u64 tot_cycles;
+   u64 masked_max_cycles;
+   u64 masked_tot_cycles;
+   u32 hist[IRQ_STATS_HIST_BUCKETS];
+
+   /* Current rate window */
+   u32 win_count;
+   u64 win_start;             /* ticks */
+};
+
+/* Copies the stats of `irq`. Returns false if the IRQ is not tracked */
+bool irq_get_stats(int irq, struct irq_stats *s);
+
+/* Called by the arch code, in IRQ context, with the interrupts disabled */
+void irq_account_masked_time(int irq, u64 cycles);
@@ -41,6 +41,9 @@ struct kb_dev {
    void (*register_handler)(struct keypress_handler_elem *e);
    bool (*scancode_to_ansi_seq)(u32 key, u8 modifiers, char *seq);
    u8 (*translate_to_mediumraw)(struct key_event ke);
+
+   /* TSC of the IRQ which delivered the key being processed, 0 if unknown */
+   u64 event_tsc;
 };
 
 void register_keyboard_device(struct kb_dev *kbdev);
@@ -18,7 +18,8 @@
 #define KMALLOC_FL_DMA                      (0b00100000000000000000000000000000)
 #define KMALLOC_FL_RESV_FLAGS_MASK          (0b00010000000000000000000000000000)
 #define KMALLOC_FL_DONT_ACCOUNT             (0b00001000000000000000000000000000)
-#define KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK  (0b00000111111111111111111111111111)
+#define KMALLOC_FL_LONG_LIVED               (0b00000100000000000000000000000000)
+#define KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK  (0b00000011111111111111111111111111)
 
 #define KFREE_FL_MULTI_STEP                 (0b10000000000000000000000000000000)
 #define KFREE_FL_NO_ACTUAL_FREE             (0b01000000000000000000000000000000)
@@ -41,6 +42,9 @@ early_init_kmalloc(void);
 void
 init_kmalloc(void);
 
+void
+kmalloc_add_heaps(ulong vaddr, ulong limit);
+
 void *
 general_kmalloc(size_t *size, u32 flags);
 
@@ -79,6 +83,9 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t sz);
 void *
 per_heap_kmalloc(struct kmalloc_heap *h, size_t *size, u32 flags);
 
+bool
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags);
+
 void
 per_heap_kfree(struct kmalloc_heap *h, void *ptr, size_t *size, u32 flags);
 
@@ -99,6 +106,114 @@ kmalloc_accelerator_get_elem(struct kmalloc_acc *a);
 void
 kmalloc_destroy_accelerator(struct kmalloc_acc *a);
 
+/*
+ * Object caches: a magazine of free objects of a given size in front of a
+ * kmalloc accelerator (the "slab"). Freed objects go back to the magazine and
+ * will be returned as they were by the next allocation: when a constructor is
+ * provided, it is called only on the objects newly carved out of a slab, like
+ * in the classic slab allocator. Not meant to be used in IRQ context.
+ *
+ * Pool caches (see KMALLOC_POOL_INIT) never return objects to the heap: the
+ * freed objects not fitting in the magazine are kept in an intrusive free list
+ * and `prealloc` objects are carved out of the slab upfront, on init. Because
+ * the free list's link overwrites the first word of the objects, pool caches
+ * cannot have a constructor.
+ */
+
+#define KMALLOC_CACHE_MAG_SIZE               16
+#define KMALLOC_CACHE_SLAB_SIZE              (4 * KB)
+
+typedef void (*kmalloc_cache_ctor)(void *obj);
+
+struct kmalloc_cache {
+
+   struct kmalloc_cache *next;      /* next registered cache */
+   const char *name;
+   kmalloc_cache_ctor ctor;         /* optional */
+   u32 obj_size;                    /* rounded-up to a power of 2 on init */
+   u32 prealloc;                    /* pool caches only */
+   bool pool;
+   bool initialized;
+
+   struct kmalloc_acc acc;          /* slab used to refill the magazine */
+   u32 mag_count;                   /* number of objects in `mag` */
+   void *mag[KMALLOC_CACHE_MAG_SIZE];
+   void *free_list;                 /* pool caches only */
+   u32 free_count;
+
+   /* Stats */
+   u32 allocs;
+   u32 hits;                        /* allocations served by the magazine */
+   u32 frees;
+   u32 spills;                      /* frees returned to the heap */
+};
+
+#define KMALLOC_CACHE_INIT(name_str, size, ctor_func)                        \
+   {                                                                         \
+      .name = (name_str),                                                    \
+      .ctor = (ctor_func),                                                   \
+      .obj_size = (size),                                                    \
+   }
+
+#define KMALLOC_POOL_INIT(name_str, size, prealloc_cnt)                      \
+   {                                                                         \
+      .name = (name_str),                                                    \
+      .obj_size = (size),                                                    \
+      .prealloc = (prealloc_cnt),                                            \
+      .pool = true,                                                          \
+   }
+
+void *
+kmalloc_cache_alloc(struct kmalloc_cache *c);
+
+void
+kmalloc_cache_free(struct kmalloc_cache *c, void *obj);
+
+/* Returns all the cached objects to the heap */
+void
+kmalloc_cache_shrink(struct kmalloc_cache *c);
+
+/*
+ * Shrinks the cache and unregisters it: for caches which are not static.
+ * All of its objects must have been freed already.
+ */
+void
+kmalloc_cache_destroy(struct kmalloc_cache *c);
+
+/*
+ * Shrinkers: callbacks of the subsystems holding memory they could give back,
+ * like caches. They are called by kmalloc() when an allocation is about to
+ * fail and by a worker thread when the free memory in the heaps drops below
+ * the low watermark (1/KMALLOC_LOW_WATERMARK_DIV of the total). The `shrink`
+ * callback should free at least `bytes` bytes, if possible, and return the
+ * number of bytes it actually freed (or queued to be freed soon). It's called
+ * with preemption disabled and, therefore, it must not sleep. It must not
+ * allocate memory either.
+ */
+
+#define KMALLOC_LOW_WATERMARK_DIV            16
+
+struct shrinker {
+
+   struct shrinker *next;           /* next registered shrinker */
+   const char *name;
+   size_t (*shrink)(struct shrinker *s, size_t bytes);
+
+   /* Stats */
+   u32 calls;
+   size_t freed;
+};
+
+void
+register_shrinker(struct shrinker *s);
+
+void
+unregister_shrinker(struct shrinker *s);
+
+/* Runs the shrinkers until `bytes` are freed. Returns the bytes freed */
+size_t
+kmalloc_shrink(size_t bytes);
+
 static inline void *
 kmalloc(size_t size)
 {
@@ -111,6 +226,22 @@ kfree2(void *ptr, size_t size)
    general_kfree(ptr, &size, 0);
 }
 
+/*
+ * For the long-lived or pinned blocks (page tables, kernel stacks, file data
+ * etc.): they're allocated preferably in the long-lived heaps, the smallest
+ * main heaps, which the other blocks use only as a last resort. That way, they
+ * don't get scattered across the big heaps, preventing their free memory from
+ * coalescing into big blocks. Free them with kfree2() as usual.
+ */
+static inline void *
+kmalloc_long_lived(size_t size)
+{
+   return general_kmalloc(&size, KMALLOC_FL_LONG_LIVED);
+}
+
+void *
+kzmalloc_long_lived(size_t size);
+
 void *
 kzmalloc(size_t size);
 
@@ -12,6 +12,34 @@ struct debug_kmalloc_heap_info {
    size_t min_block_size;
    size_t alloc_block_size;
    int region;
+   bool long_lived;     /* see kmalloc_long_lived() */
+};
+
+struct debug_kmalloc_cache_info {
+
+   const char *name;
+   u32 obj_size;
+   u32 cached;          /* objects in the magazine and in the free list */
+   u32 allocs;
+   u32 hits;
+   u32 frees;
+   u32 spills;
+};
+
+struct debug_kmalloc_callsite_info {
+
+   ulong caller;        /* return address of the kmalloc() call */
+   u32 count;
+   u64 bytes;
+   size_t live_bytes;
+};
+
+struct debug_kmalloc_sample_info {
+
+   ulong ptr;           /* 0 for an empty slot */
+   ulong caller;        /* return address of the kmalloc() call */
+   u64 ticks;           /* time of the allocation, in ticks */
+   u32 size;
 };
 
 struct kmalloc_small_heaps_stats {
@@ -37,6 +65,9 @@ struct debug_kmalloc_stats {
 bool
 debug_kmalloc_get_heap_info(int heap_num, struct debug_kmalloc_heap_info *i);
 
+size_t
+debug_kmalloc_get_heap_largest_free(int heap_num);
+
 void
 debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
                                    struct debug_kmalloc_heap_info *i);
@@ -44,6 +75,9 @@ debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
 void
 debug_kmalloc_get_stats(struct debug_kmalloc_stats *stats);
 
+bool
+debug_kmalloc_get_cache_info(int n, struct debug_kmalloc_cache_info *i);
+
 void
 debug_kmalloc_chunks_stats_start_read(struct debug_kmalloc_chunks_ctx *ctx);
 
@@ -52,6 +86,20 @@ debug_kmalloc_chunks_stats_next(struct debug_kmalloc_chunks_ctx *ctx,
                                 size_t *size,
                                 size_t *count);
 
+/* Call-site stats (KMALLOC_CALLSITE_STATS): the sites are in no order */
+
+bool
+debug_kmalloc_get_callsite_info(int n, struct debug_kmalloc_callsite_info *i);
+
+u32
+debug_kmalloc_get_untracked_callsites_allocs(void);
+
+bool
+debug_kmalloc_get_sample(int n, struct debug_kmalloc_sample_info *i);
+
+void
+debug_kmalloc_get_samples_stats(u32 *used, u32 *dropped);
+
 
 /* Leak-detector and kmalloc logging */
 
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/paging.h>
+
+/*
+ * Kernel same-page merging (KSM_MERGE). When the free memory is low, a
+ * dedicated worker thread hashes the anonymous user pages not written since
+ * the previous scan (see their dirty bit) and merges the identical ones into
+ * a single frame, mapped read-only and copy-on-write everywhere: the first
+ * write to a merged page just breaks the sharing, in handle_potential_cow().
+ * Zero-filled pages are merged into the zero page.
+ */
+
+struct ksm_stats {
+
+   u64 scans;                 /* scan passes */
+   u64 hashed;                /* pages hashed by all the passes */
+   u64 merged;                /* pages merged into an identical one */
+   u64 zero_merged;           /* zero-filled pages merged into the zero page */
+};
+
+void init_ksm(void);
+void ksm_get_stats(struct ksm_stats *s);
+
+/*
+ * Scan interface, used by the arch code. The table maps the hash of a page
+ * to the last page table entry seen with that hash, during the current pass.
+ * Everything runs with preemption disabled.
+ */
+struct ksm_entry {
+
+   u32 hash;
+   void *pte;
+   pdir_t *pdir;              /* NULL if the entry is empty */
+   ulong va;
+};
+
+struct ksm_scan_ctx {
+
+   size_t max;                /* max pages to hash in this pass */
+   size_t hashed;
+   size_t merged;
+   size_t zero_merged;
+
+   ulong va;                  /* in: where to start, out: where we stopped */
+   bool stopped;              /* reached `max` before the end of the pdir */
+};
+
+u32 ksm_hash_page(const void *page, bool *zero);
+struct ksm_entry *ksm_get_entry(u32 hash);
+
+/*
+ * Arch interface. pdir_merge_same_pages() walks the private page tables of
+ * `pdir` starting from `ctx->va`, merging the candidate pages as described
+ * above, until `ctx->max` pages have been hashed.
+ */
+void pdir_merge_same_pages(pdir_t *pdir, struct ksm_scan_ctx *ctx);
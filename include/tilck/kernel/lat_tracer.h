@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_debug.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/irqs_off_trace.h>
+
+/*
+ * Latency tracer (LATENCY_TRACER): keeps the LAT_TRACE_MAX_ENTRIES longest
+ * intervals with the preemption disabled (the 0 -> 1 and 1 -> 0 transitions
+ * of __disable_preempt) and with the interrupts disabled (the outermost
+ * disable_interrupts() / enable_interrupts() pairs), with the stack at both
+ * their ends. Durations are in TSC cycles (rdtime on riscv).
+ *
+ * The IRQs and the context switches run with the preemption disabled, so
+ * they count as preemption-off time. The irqs-off intervals opened by the
+ * CPU itself (IRQs, faults) are not tracked: see the per-IRQ stats for that.
+ */
+
+enum lat_trace_kind {
+   LAT_TRACE_PREEMPT_OFF,
+   LAT_TRACE_IRQS_OFF,
+   LAT_TRACE_KINDS,
+};
+
+#define LAT_TRACE_MAX_ENTRIES                  8
+#define LAT_TRACE_MAX_FRAMES                   6
+
+struct lat_trace_stack {
+   u32 nframes;
+   void *frames[LAT_TRACE_MAX_FRAMES];    /* frames[0] is the call site */
+};
+
+struct lat_trace_entry {
+   u64 cycles;
+   int tid;                               /* task at the beginning */
+   struct lat_trace_stack start;
+   struct lat_trace_stack end;
+};
+
+#if LATENCY_TRACER
+
+   void preempt_off_trace_start(void);
+   void preempt_off_trace_end(void);
+
+   /*
+    * Copies the entries of the given kind in `arr`, sorted from the longest
+    * one, and returns how many have been copied.
+    */
+   int lat_trace_get_entries(enum lat_trace_kind kind,
+                             struct lat_trace_entry *arr,
+                             int max_elems);
+
+   void lat_trace_reset(void);
+
+#else
+
+   static ALWAYS_INLINE void preempt_off_trace_start(void) { }
+   static ALWAYS_INLINE void preempt_off_trace_end(void) { }
+
+#endif
+
+#if IRQS_OFF_TRACE_HOOKS
+
+   /* Drops the pending irqs-off interval, if any: called on IRQ entry */
+   void irqs_off_trace_cancel(void);
+
+#else
+
+   static ALWAYS_INLINE void irqs_off_trace_cancel(void) { }
+
+#endif
+
+extern const char *const lat_trace_kind_names[LAT_TRACE_KINDS];
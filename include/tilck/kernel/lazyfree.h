@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/paging.h>
+
+/*
+ * Lazily freed anonymous memory (madvise(MADV_FREE)). The private anonymous
+ * pages get write-protected, like the COW ones, and their frames tagged as
+ * PF_TYPE_LAZYFREE: the first write to such a page just makes it writable
+ * again, in handle_potential_cow(), clearing the tag. When the free memory is
+ * low, a worker thread drops the pages still tagged, mapping the zero page in
+ * their place: their content was garbage for the process anyway.
+ */
+
+struct lazyfree_stats {
+
+   u64 marked;                /* pages tagged by MADV_FREE */
+   u64 dropped;               /* tagged pages dropped under memory pressure */
+   u64 scans;                 /* passes over all the processes */
+};
+
+void init_lazyfree(void);
+void lazyfree_get_stats(struct lazyfree_stats *s);
+
+/*
+ * Tags the pages in the user range [va, va + count * PAGE_SIZE) of `pdir`.
+ * Expects the preemption to be disabled. Returns the number of pages tagged.
+ */
+size_t lazyfree_mark_pages(pdir_t *pdir, ulong va, size_t count);
+
+/*
+ * Arch interface. pdir_mark_lazyfree_pages() does the job described above,
+ * skipping the pages which are not private to `pdir` (e.g. shared after
+ * fork()). pdir_drop_lazyfree_pages() walks the private page tables of `pdir`
+ * dropping the tagged pages still read-only, up to `max` pages. Both return
+ * the number of pages processed.
+ */
+size_t pdir_mark_lazyfree_pages(pdir_t *pdir, ulong va, size_t count);
+size_t pdir_drop_lazyfree_pages(pdir_t *pdir, size_t max);
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_debug.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+
+struct task;
+
+/*
+ * Lock classes: contention stats shared by all the locks of the same kind
+ * (e.g. all the ramfs inode rwlocks). A class gets registered the first time
+ * one of its locks is used. The hooks are compiled-in only when LOCK_STATS is
+ * enabled: otherwise, the locks don't even have a class pointer.
+ *
+ * Wait times are in TSC cycles (rdtime on riscv).
+ */
+
+struct lock_class {
+
+   struct list_node node;
+   const char *name;       /* static string */
+   bool registered;
+
+   u64 acquisitions;       /* successful lock operations */
+   u64 contentions;        /* lock operations that had to sleep */
+   u64 total_wait;
+   u64 max_wait;
+   int holder_tid;         /* tid of the last task acquiring a lock */
+   int blocker_tid;        /* tid holding the lock at the last contention */
+};
+
+#define DEFINE_LOCK_CLASS(var, n)                                         \
+   struct lock_class var = { .name = (n) }
+
+#if LOCK_STATS
+
+   u64 lock_stats_contended(struct lock_class *lc, struct task *owner);
+   void lock_stats_acquired(struct lock_class *lc, u64 wait_start);
+
+   /*
+    * Copies a snapshot of up to `max_elems` classes in `arr`, sorted by the
+    * number of contentions, and returns how many have been copied.
+    */
+   int lock_stats_get_classes(struct lock_class *arr, int max_elems);
+   void lock_stats_reset(void);
+
+   /* printk() the most contended classes: used by the deadlock detection */
+   void lock_stats_dump(void);
+
+#endif
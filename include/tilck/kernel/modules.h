@@ -5,19 +5,53 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/kernel/list.h>
 
+/* The init of the module can run concurrently with the following ones */
+#define MODULE_FL_ASYNC                               (1 << 0)
+
 struct module {
 
    const char *name;
    int priority;
    void (*init)(void);
+
+   /*
+    * Optional NULL-terminated list with the names of the modules that must be
+    * initialized before this one (see MOD_DEPS()). They must have a lower
+    * priority. The modules not built-in are ignored.
+    */
+   const char *const *deps;
+   u32 flags;
+
+   /* Set by init_modules() */
+   bool initialized;
+   u64 init_start;                     /* system time, in ns */
+   u64 init_time;                      /* duration of init(), in ns */
 };
 
+#define MOD_DEPS(...)         ((const char *const[]) { __VA_ARGS__, NULL })
+
+/* Where the loadable modules (<name>.ko) are, in the initrd */
+#define MODULES_DIR                                   "/initrd/modules"
+#define MODULE_NAME_MAX_LEN                           31
+
 void init_modules(void);
 void register_module(struct module *m);
+int get_modules_count(void);
+struct module *get_module(int i);
+
+/*
+ * Loads MODULES_DIR/<name>.ko. At boot, that's done by init_modules() for the
+ * modules listed in -mods: then, they're initialized in order of priority
+ * with the built-in ones. After boot, the modules are initialized right away.
+ */
+int load_module(const char *name);
+
+/* The ELF loader: links the relocatable object `path` and runs its ctors */
+int kmod_load(const char *path);
 
 #define REGISTER_MODULE(m)                             \
    __attribute__((constructor))                        \
-   static void __register_module(void)                 \
+   static void INIT_TEXT __register_module(void)       \
    {                                                   \
       register_module(m);                              \
    }
@@ -34,5 +68,7 @@ void register_module(struct module *m);
 #define MOD_fbdev_prio                       300
 #define MOD_serial_prio                      400
 #define MOD_sb16_prio                        410
+#define MOD_virtio_blk_prio                  420
+#define MOD_virtio_net_prio                  430
 #define MOD_systests_prio                    990
 #define MOD_dp_prio                         1000 /* last */
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * MPMC_RINGBUF: a bounded lock-free ring buffer supporting any number of
+ * producers and consumers, in any context (IRQ handlers included).
+ *
+ * Unlike safe_ringbuf, there is no constraint about who can interrupt whom:
+ * every slot has a sequence number telling whether it's free for the producer
+ * of the current lap or ready for the consumer of the current lap. Producers
+ * and consumers first reserve a range of slots by moving the enqueue (dequeue)
+ * position with a CAS, then copy the elements and, finally, publish each slot
+ * by updating its sequence number. The max number of elements must be a
+ * power of 2.
+ *
+ * The only caveat: a producer which reserved a slot and got interrupted before
+ * publishing it makes the slot look not-ready yet: a consumer interrupting it
+ * will just see fewer elements (possibly none). The same applies, for the
+ * free slots, to an interrupted consumer and a producer interrupting it.
+ *
+ * The caller provides the memory, mpmc_ringbuf_buf_size() bytes: the slots'
+ * sequence numbers are stored at its beginning, followed by the elements.
+ */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+
+struct mpmc_ringbuf {
+
+   ATOMIC(u32) enqueue_pos;
+   ATOMIC(u32) dequeue_pos;
+   u32 max_elems;
+   u32 elem_size;
+   ATOMIC(u32) *seqs;
+   u8 *buf;
+};
+
+static inline size_t mpmc_ringbuf_buf_size(u32 max_elems, u32 e_size)
+{
+   return (size_t)max_elems * (sizeof(u32) + e_size);
+}
+
+void
+mpmc_ringbuf_init(struct mpmc_ringbuf *rb, u32 max_elems, u32 e_size, void *b);
+
+void mpmc_ringbuf_destroy(struct mpmc_ringbuf *rb);
+
+bool mpmc_ringbuf_is_empty(struct mpmc_ringbuf *rb);
+bool mpmc_ringbuf_is_full(struct mpmc_ringbuf *rb);
+
+/*
+ * Returns the number of elements currently in the ring buffer, including the
+ * ones reserved but not yet published by an interrupted producer.
+ */
+u32 mpmc_ringbuf_get_elems(struct mpmc_ringbuf *rb);
+
+/*
+ * Writes a single element. `was_empty` (optional) is set to true when the
+ * ring buffer was empty before the write.
+ */
+bool mpmc_ringbuf_write_elem(struct mpmc_ringbuf *rb, void *e, bool *was_empty);
+bool mpmc_ringbuf_read_elem(struct mpmc_ringbuf *rb, void *elem_ptr /* out */);
+
+/*
+ * Batch versions: write (read) up to `n` contiguous elements at once, with a
+ * single CAS. Return the number of elements written (read).
+ */
+u32
+mpmc_ringbuf_write_elems(struct mpmc_ringbuf *rb,
+                         void *elems,
+                         u32 n,
+                         bool *was_empty);
+
+u32
+mpmc_ringbuf_read_elems(struct mpmc_ringbuf *rb, void *elems /* out */, u32 n);
+
+/*
+ * Moves the elements of `rb` to the new buffer `buf`, able to contain
+ * `max_elems` (a power of 2), and returns the old buffer. Must be called with
+ * interrupts disabled, when no producer nor consumer is in progress.
+ */
+void *
+mpmc_ringbuf_resize(struct mpmc_ringbuf *rb, u32 max_elems, void *buf);
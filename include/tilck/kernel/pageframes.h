@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/page_size.h>
+#include <tilck/kernel/paging.h>
+
+/*
+ * Page frame types. Anonymous memory (user pages privately owned by a
+ * process) is not explicitly tagged: it's simply a PF_TYPE_OTHER frame with
+ * mapcount > 0. Unmapped PF_TYPE_OTHER frames are either free or used by the
+ * kernel heap.
+ */
+enum pf_type {
+
+   PF_TYPE_OTHER     = 0,
+   PF_TYPE_RESERVED  = 1,   /* not usable RAM, according to system_mmap */
+   PF_TYPE_KERNEL    = 2,   /* kernel image, ramdisks, low memory etc. */
+   PF_TYPE_ZERO      = 3,   /* the zero page */
+   PF_TYPE_FILE      = 4,   /* retained by a filesystem (ramfs, fat ramdisk) */
+   PF_TYPE_USHARED   = 5,   /* kernel memory shared with user space */
+   PF_TYPE_PGTABLE   = 6,   /* page table shared by 2+ pdirs after fork */
+   PF_TYPE_LAZYFREE  = 7,   /* anonymous, MADV_FREE-ed: see lazyfree.h */
+
+   PF_TYPES_COUNT
+};
+
+/*
+ * Page frame descriptor, one for each page in the linear mapping.
+ *
+ * `refcount` counts all the references to the frame: one for each page table
+ * entry pointing to it (`mapcount`) plus the ones taken by the owners of the
+ * frame with retain_pageframes_mapped_at(). COW relies on it: a COW page with
+ * refcount == 1 is not shared anymore and doesn't need to be copied.
+ *
+ * For PF_TYPE_PGTABLE frames, `refcount` is instead the number of page
+ * directories sharing the page table, while `mapcount` is always 0.
+ */
+struct pageframe {
+
+   u32 refcount;
+   u32 mapcount : 28;
+   u32 type : 4;
+};
+
+STATIC_ASSERT(sizeof(struct pageframe) == 8);
+STATIC_ASSERT(PF_TYPES_COUNT <= 16);
+
+struct pageframe_stats {
+
+   size_t total;                         /* frames in the linear mapping */
+   size_t by_type[PF_TYPES_COUNT];
+   size_t anon;                          /* PF_TYPE_OTHER, mapped */
+   size_t mapped;                        /* any type, mapcount > 0 */
+   size_t shared;                        /* any type, mapcount > 1 */
+   size_t saved;                         /* frames not copied, thanks to the
+                                            sharing: sum(mapcount - 1) */
+};
+
+extern struct pageframe *pageframes;
+extern ulong pageframes_base_paddr;
+extern size_t pageframes_count;
+
+void init_pageframes(ulong base_paddr, ulong mem_lim);
+void get_pageframe_stats(struct pageframe_stats *s);
+const char *pf_type_str(enum pf_type t);
+
+/* Sets the type of all the frames in [begin, end), e.g. after freeing them */
+void pageframes_set_type(u64 begin, u64 end, enum pf_type type);
+
+void pf_retain(ulong paddr, enum pf_type type);
+void pf_release(ulong paddr);
+
+void
+retain_pageframes_mapped_at(pdir_t *pdir,
+                            void *vaddr,
+                            size_t len,
+                            enum pf_type type);
+
+void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
+
+static ALWAYS_INLINE struct pageframe *pf_get(ulong paddr)
+{
+   /* NOTE: paddr < pageframes_base_paddr wraps around, failing the check */
+   const ulong idx = (paddr - pageframes_base_paddr) >> PAGE_SHIFT;
+   return LIKELY(idx < pageframes_count) ? &pageframes[idx] : NULL;
+}
+
+/*
+ * pf_ref_count_inc() and pf_ref_count_dec() are meant to be used by the paging
+ * code, for each page table entry pointing to `paddr` which is added or
+ * removed: they update both the refcount and the mapcount. Frames outside of
+ * the linear mapping (e.g. MMIO) are not tracked: for them, both return 0.
+ */
+static ALWAYS_INLINE u32 pf_ref_count_inc(ulong paddr)
+{
+   struct pageframe *pf = pf_get(paddr);
+
+   if (UNLIKELY(!pf))
+      return 0;
+
+   pf->mapcount++;
+   return ++pf->refcount;
+}
+
+static ALWAYS_INLINE u32 pf_ref_count_dec(ulong paddr)
+{
+   struct pageframe *pf = pf_get(paddr);
+
+   if (UNLIKELY(!pf))
+      return 0;
+
+   ASSERT(pf->refcount > 0);
+   ASSERT(pf->mapcount > 0);
+   pf->mapcount--;
+
+   if (!--pf->refcount && pf->type == PF_TYPE_LAZYFREE)
+      pf->type = PF_TYPE_OTHER;  /* Unmapped: it's going to be freed */
+
+   return pf->refcount;
+}
+
+static ALWAYS_INLINE u32 pf_ref_count_get(ulong paddr)
+{
+   struct pageframe *pf = pf_get(paddr);
+   return LIKELY(pf != NULL) ? pf->refcount : 0;
+}
@@ -25,8 +25,18 @@
 #define PAGING_FL_DO_ALLOC                                (1 << 4)
 #define PAGING_FL_ZERO_PG                                 (1 << 5)
 
+/*
+ * Private writable page, mapped read-only and copied on the first write, like
+ * after fork(). Its page frame must be retained by its owner (e.g. ramfs),
+ * otherwise the first write would just make the original page writable.
+ */
+#define PAGING_FL_COW                                     (1 << 6)
+
 /* Combo values */
 #define PAGING_FL_RWUS               (PAGING_FL_RW | PAGING_FL_US)
+#define PAGING_FL_COW_INCOMPAT       (PAGING_FL_SHARED           | \
+                                      PAGING_FL_DO_ALLOC         | \
+                                      PAGING_FL_BIG_PAGES_ALLOWED)
 
 /*
  * These MACROs convert addresses to/from the linear mapping at BASE_VA to the
@@ -121,10 +131,59 @@ int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref);
 pdir_t *pdir_clone(pdir_t *pdir);
 pdir_t *pdir_deep_clone(pdir_t *pdir);
 void pdir_destroy(pdir_t *pdir);
+
+/*
+ * Like pdir_destroy(), with a preemption point after each page table: expects
+ * the preemption to be disabled exactly once. Only for the pdirs that nothing
+ * else can reach anymore.
+ */
+void pdir_destroy_preemptible(pdir_t *pdir);
+
+/*
+ * Counts the pages mapped in the user part of `pdir` and, among them, the
+ * resident ones: the pages mapped to the zero page (untouched anonymous memory
+ * with COW semantics) are not resident.
+ */
+void pdir_count_user_pages(pdir_t *pdir, size_t *mapped, size_t *resident);
+
+/* Counts the page tables used for the user part of `pdir` (shared included) */
+size_t pdir_count_page_tables(pdir_t *pdir);
+
+/*
+ * Range invalidations of more than this number of pages flush the whole TLB
+ * instead of invalidating one page at a time. See invalidate_pages().
+ */
+#define TLB_FLUSH_ALL_THRESHOLD                        32
+
 void invalidate_page(ulong vaddr);
+void invalidate_pages(pdir_t *pdir, void *vaddr, size_t page_count);
 void set_page_rw(pdir_t *pdir, void *vaddr, bool rw);
-void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
-void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
+void set_pages_rw(pdir_t *pdir, void *vaddr, size_t page_count, bool rw);
+
+void swap_pages(pdir_t *pdir, void *vaddr1, void *vaddr2);
+
+/*
+ * Big pages for user space: get_user_big_page_size() returns their size, or 0
+ * if the arch doesn't support them. User big pages are split in regular pages
+ * on demand (partial unmaps, fork etc.), therefore the ref-count of each
+ * pageframe is kept.
+ */
+#if defined(__i386__) && !defined(UNIT_TEST_ENVIRONMENT)
+
+   #define ARCH_HAS_USER_BIG_PAGES               1
+
+   size_t get_user_big_page_size(void);
+
+   NODISCARD int
+   map_user_big_page(pdir_t *pdir, void *vaddr, ulong paddr, bool rw);
+
+#else
+
+   static ALWAYS_INLINE size_t get_user_big_page_size(void) {
+      return 0;
+   }
+
+#endif
 
 static ALWAYS_INLINE pdir_t *get_kernel_pdir(void)
 {
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
+
+struct process;
+
+/*
+ * Sessions and process groups, as explicit objects: each user process belongs
+ * to a group and each group belongs to a session. That way, sending a signal
+ * to a group, checking whether a group exists etc. touch only the members,
+ * instead of visiting all the tasks in the system.
+ *
+ * The objects are created on demand by setsid() and setpgid() and destroyed
+ * when their last member is freed (after it has been reaped). Meanwhile,
+ * their IDs cannot be reused as PIDs (see create_new_pid()).
+ *
+ * NOTE: the kernel process doesn't belong to any group (pi->pgrp == NULL).
+ * All the functions below must be called with preemption disabled.
+ */
+
+struct session {
+
+   struct bintree_node node;        /* node in the sessions tree */
+   long sid;                        /* long: bintree_*_ptr() key */
+   struct list groups;              /* list of struct pgroup */
+};
+
+struct pgroup {
+
+   struct bintree_node node;        /* node in the groups tree */
+   long pgid;                       /* long: bintree_*_ptr() key */
+   struct session *session;
+   struct list_node session_node;   /* node in session->groups */
+   struct list members;             /* list of struct process */
+   int count;                       /* number of members */
+};
+
+struct pgroup *pgroup_get(int pgid);
+struct session *session_get(int sid);
+
+/*
+ * Moves `pi` to the group `pgid` in the session `sid`, creating them if they
+ * don't exist. If the group exists, it must belong to `sid`. Updates also
+ * pi->pgid and pi->sid. Returns 0 or -ENOMEM.
+ */
+int pgroup_join(struct process *pi, int pgid, int sid);
+
+/* Makes `pi` a member of `g`, the group of its parent. Cannot fail. */
+void pgroup_add_member(struct pgroup *g, struct process *pi);
+
+/* Removes `pi` from its group, destroying the group/session if empty */
+void pgroup_remove_member(struct process *pi);
@@ -1,11 +1,46 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #pragma once
-#define PIPE_BUF_SIZE   4096
+
+/* Same values as Linux's <fcntl.h>, which defines them only for _GNU_SOURCE */
+#ifndef F_SETPIPE_SZ
+   #define F_SETPIPE_SZ                         1031
+   #define F_GETPIPE_SZ                         1032
+#endif
+
+/* Same value as Linux: the max size of an atomic write (or of a packet) */
+#ifndef PIPE_BUF
+   #define PIPE_BUF                             4096
+#endif
 
 struct pipe;
 
+/* System-wide pipe counters, exposed by sysfs in /vfs/pipes */
+struct pipe_stats {
+
+   ulong bytes_read;
+   ulong bytes_written;
+   ulong reads;
+   ulong writes;
+   ulong read_waits;            /* times a reader had to wait for data */
+   ulong write_waits;           /* times a writer had to wait for space */
+   ulong resizes;
+};
+
+extern struct pipe_stats pipe_stats;
+
 struct pipe *create_pipe(void);
 void destroy_pipe(struct pipe *p);
 fs_handle pipe_create_read_handle(struct pipe *p);
 fs_handle pipe_create_write_handle(struct pipe *p);
+bool is_pipe_handle(fs_handle h);
+int pipe_get_size(fs_handle h);
+int pipe_set_size(fs_handle h, ulong size);
+int pipe_set_packet_mode(fs_handle h, bool enabled);
+
+ssize_t
+pipe_to_pipe(fs_handle in_h, fs_handle out_h, size_t len,
+             bool nonblock, bool consume);
+
+ssize_t
+pipe_vmsplice(fs_handle h, const struct iovec *iov, int iovcnt, bool nonblock);
@@ -17,6 +17,7 @@
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fs/fd_table.h>
 #include <tilck/kernel/sys_types.h>
 
 struct kernel_alloc {
@@ -31,6 +32,13 @@ struct mappings_info {
    struct kmalloc_heap *mmap_heap;
    size_t mmap_heap_size;
    struct list mappings;
+
+   /*
+    * The same mappings, in a tree ordered by vaddr (they never overlap),
+    * for the lookups by address. `last_um` is the last one found there.
+    */
+   struct user_mapping *mappings_tree;
+   struct user_mapping *last_um;
 };
 
 struct process {
@@ -41,13 +49,18 @@ struct process {
    int pgid;                         /* process group ID (same as in Linux)   */
    int sid;                          /* process session ID (as in Linux)      */
    int parent_pid;
+   struct pgroup *pgrp;              /* see pgroup.h                          */
+   struct list_node pgrp_node;       /* node in pgrp->members                 */
    pdir_t *pdir;
 
    void *brk;
    void *initial_brk;
    struct mappings_info *mi;
+   ulong as_limit_cur;               /* RLIMIT_AS: soft limit, in bytes      */
+   ulong as_limit_max;               /* RLIMIT_AS: hard limit, in bytes      */
 
    struct list children;
+   struct list wstatus_queue;        /* children with state changes to report */
 
    void *proc_tty;
    bool did_call_execve;
@@ -55,17 +68,18 @@ struct process {
    bool vforked;                 /* after vfork(), before execve() */
    bool inherited_mmap_heap;
    bool did_set_tty_medium_raw;
+   u16 umask;                    /* only the 0777 bits, see sys_umask() */
 
    int *set_child_tid;                    /* NOTE: this is an user pointer */
 
-   struct kmutex fslock;                  /* protects `handles` and `cwd` */
-   mode_t umask;
+   struct kmutex fslock;                  /* protects `fds` and `cwd` */
 
    struct vfs_path cwd;                   /* CWD as a struct vfs_path */
    char *debug_cmdline;                   /* debug field used by debugpanel */
 
    struct locked_file *elf;
-   fs_handle handles[MAX_HANDLES];        /* just a small fixed-size array */
+   struct locked_file *elf_interp;        /* dynamic linker (can be NULL) */
+   struct fd_table *fds;                  /* the open file descriptors */
 
    /*
     * The purpose of having this opaque `arch_fields` member here is to avoid
@@ -130,11 +144,14 @@ void unblock_parent_of_vforked_child(struct process *pi);
 void vforked_child_transfer_dispose_mi(struct process *pi);
 
 int first_execve(const char *abs_path, const char *const *argv);
+int spawn_dup_handles(struct process *pi);
+
+int tilck_sys_spawn(const char *user_path,
+                    const char *const *user_argv,
+                    const char *const *user_env);
 
 int setup_process(struct elf_program_info *pinfo,
                   struct task *task_to_use,
-                  const char *const *argv,
-                  const char *const *env,
                   struct task **ti_ref,
                   regs_t *user_regs);
 
@@ -143,21 +160,33 @@ void finalize_usermode_task_setup(struct task *ti, regs_t *user_regs);
 struct task *
 allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir);
 
+struct task *
+allocate_new_spawned_process(struct task *parent, int pid, pdir_t *new_pdir);
+
 struct task *
 allocate_new_thread(struct process *pi, int tid, bool alloc_bufs);
 
 void free_task(struct task *ti);
+
+/*
+ * Returns true if `vaddr` is in the unmapped guard page below the kernel stack
+ * of the current task (only with KERNEL_STACK_ISOLATION): a kernel page fault
+ * there means a stack overflow.
+ */
+bool is_kernel_stack_guard_page(ulong vaddr);
 void free_mem_for_zombie_task(struct task *ti);
 bool arch_specific_new_task_setup(struct task *ti, struct task *parent);
 void arch_specific_free_task(struct task *ti);
 void arch_specific_new_proc_setup(struct process *pi, struct process *parent);
 void arch_specific_free_proc(struct process *pi);
 void wake_up_tasks_waiting_on(struct task *ti, enum wakeup_reason r);
+void wstatus_queue_move(struct task *ti, struct process *new_parent_pi);
 void init_process_lists(struct process *pi);
 
 void process_set_cwd2_nolock(struct vfs_path *tp);
 void process_set_cwd2_nolock_raw(struct process *pi, struct vfs_path *tp);
 void terminate_process(int exit_code, int term_sig);
+void init_pdir_reaper(void);
 void close_cloexec_handles(struct process *pi);
 int setup_sig_handler(struct task *ti,
                       enum sig_state sig_state,
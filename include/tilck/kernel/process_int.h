@@ -22,6 +22,8 @@ void switch_to_initial_kernel_stack(void);
 int save_regs_on_user_stack(regs_t *r);
 void restore_regs_from_user_stack(regs_t *r);
 void free_common_task_allocs(struct task *ti);
+bool task_lease_bufs(struct task *ti);
+void task_release_bufs(struct task *ti);
 void process_free_mappings_info(struct process *pi);
 void task_info_reset_kernel_stack(struct task *ti);
 int setup_first_process(pdir_t *pdir, struct task **ti_ref);
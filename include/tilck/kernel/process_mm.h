@@ -5,11 +5,15 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
+
+struct locked_file; /* forward declaration */
 
 struct user_mapping {
 
    struct list_node pi_node;
    struct list_node inode_node;
+   struct bintree_node pi_tree_node;   /* node in mi->mappings_tree */
    struct process *pi;
 
    fs_handle h;
@@ -23,6 +27,11 @@ struct user_mapping {
 
    int prot;
 
+   /*
+    * Private file mappings (h == NULL) mapping directly file's pages hold a
+    * lock on the file, like the ELF loader does for programs' segments.
+    */
+   struct locked_file *lf;
 };
 
 struct user_mapping *
@@ -35,6 +44,7 @@ struct user_mapping *process_get_user_mapping(void *vaddr);
 void remove_all_file_mappings(struct process *pi);
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi);
+void process_get_mem_usage(struct process *pi, size_t *vsz, size_t *rss);
 
 
 /* Internal functions */
@@ -17,6 +17,9 @@ struct rwlock_rp {
    struct task *ex_owner;
 #endif
 
+#if LOCK_STATS
+   struct lock_class *lc;
+#endif
 };
 
 void rwlock_rp_init(struct rwlock_rp *r);
@@ -26,6 +29,14 @@ void rwlock_rp_shunlock(struct rwlock_rp *r);
 void rwlock_rp_exlock(struct rwlock_rp *r);
 void rwlock_rp_exunlock(struct rwlock_rp *r);
 
+static inline void
+rwlock_rp_set_lock_class(struct rwlock_rp *r, struct lock_class *lc)
+{
+#if LOCK_STATS
+   r->lc = lc;
+#endif
+}
+
 #if DEBUG_CHECKS
 
    static inline bool rwlock_rp_is_shlocked(struct rwlock_rp *r)
@@ -40,17 +51,30 @@ void rwlock_rp_exunlock(struct rwlock_rp *r);
 
 #endif
 
-/* Writer-preferring rwlock */
+/*
+ * Writer-preferring rwlock. The readers count and the `writer` flag share the
+ * atomic `state`: while there's no writer, shlock and shunlock are just one
+ * atomic operation each and never touch the mutex. The writers always take
+ * the slow path, with the mutex and the condition. Once a writer has set
+ * RWLOCK_WP_WRITER, the new readers wait as well: that's what prevents the
+ * writers from starving.
+ */
+
+#define RWLOCK_WP_WRITER              (1u << 31)
+#define RWLOCK_WP_READERS             (RWLOCK_WP_WRITER - 1)
 
 struct rwlock_wp {
 
    struct task *ex_owner;
    struct kmutex m;
    struct kcond c;
-   int r;     /* readers count */
-   bool w;    /* writer waiting */
-   bool rec;  /* is exlock operation recursive */
-   u16 rc;    /* recursive locking count */
+   ATOMIC(u32) state;   /* readers count | RWLOCK_WP_WRITER (writer waiting) */
+   bool rec;            /* is exlock operation recursive */
+   u16 rc;              /* recursive locking count */
+
+#if LOCK_STATS
+   struct lock_class *lc;
+#endif
 };
 
 void rwlock_wp_init(struct rwlock_wp *rw, bool recursive);
@@ -60,11 +84,19 @@ void rwlock_wp_shunlock(struct rwlock_wp *rw);
 void rwlock_wp_exlock(struct rwlock_wp *rw);
 void rwlock_wp_exunlock(struct rwlock_wp *rw);
 
+static inline void
+rwlock_wp_set_lock_class(struct rwlock_wp *rw, struct lock_class *lc)
+{
+#if LOCK_STATS
+   rw->lc = lc;
+#endif
+}
+
 #if DEBUG_CHECKS
 
    static inline bool rwlock_wp_is_shlocked(struct rwlock_wp *rw)
    {
-      return rw->r > 0;
+      return atomic_load_explicit(&rw->state, mo_relaxed) & RWLOCK_WP_READERS;
    }
 
    static inline bool rwlock_wp_holding_exlock(struct rwlock_wp *rw)
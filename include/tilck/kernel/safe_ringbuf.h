@@ -94,6 +94,17 @@ safe_ringbuf_init(struct safe_ringbuf *rb, u16 max_elems, u16 e_size, void *b);
 void
 safe_ringbuf_destory(struct safe_ringbuf *rb);
 
+/* Returns the number of elements currently in the ring buffer */
+u16 safe_ringbuf_get_elems(struct safe_ringbuf *rb);
+
+/*
+ * Moves the elements of `rb` to the new buffer `buf`, able to contain
+ * `max_elems`, and returns the old buffer. Must be called with interrupts
+ * disabled, by the consumer.
+ */
+void *
+safe_ringbuf_resize(struct safe_ringbuf *rb, u16 max_elems, void *buf);
+
 /* Generic read/write funcs */
 
 bool
@@ -7,9 +7,11 @@
 #include <tilck/kernel/hal_types.h>
 #include <tilck/kernel/list.h>
 #include <tilck/kernel/bintree.h>
+#include <tilck/kernel/hashtable.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/signal.h>
+#include <tilck/kernel/lat_tracer.h>
 
 #include <tilck_gen_headers/config_sched.h>
 
@@ -41,11 +43,91 @@ struct sched_ticks {
    u32 timeslice;       /* ticks counter for the current time slice */
    u64 total;           /* total life-time ticks */
    u64 total_kernel;    /* total life-time ticks spent in kernel */
-   u64 vruntime;        /* a brutal approx. of Linux's vruntime */
+   u64 vruntime;        /* weighted runtime, see sched_account_ticks() */
+};
+
+#define MIN_NICE                                -20
+#define MAX_NICE                                 19
+#define NICE_0_WEIGHT                          1024
+
+/*
+ * Scheduling policies, with the same values as Linux's SCHED_* constants.
+ * Realtime (FIFO and RR) tasks have a priority in [1, MAX_RT_PRIO - 1] and
+ * always run before the tasks of the fair class (SCHED_NORMAL), which
+ * have an RT priority of 0.
+ */
+enum sched_policy {
+   sched_policy_normal  = 0,
+   sched_policy_fifo    = 1,
+   sched_policy_rr      = 2,
+};
+
+#define MAX_RT_PRIO                             100
+
+/*
+ * Finer-grained scheduler stats, in TSC cycles (rdtime on riscv). The wait
+ * time is the wake-to-run latency: the time spent RUNNABLE before actually
+ * being switched in, no matter if the task has been woken up or preempted.
+ */
+struct sched_stats {
+
+   u64 runnable_since;  /* TSC at the last transition to RUNNABLE */
+   u64 wait_total;      /* total time spent waiting in the runqueue */
+   u64 wait_max;        /* longest single wait */
+   u32 wait_count;      /* number of waits accounted in wait_total */
+   u32 nvcsw;           /* voluntary switches: the task stopped running */
+   u32 nivcsw;          /* involuntary switches: the task was preempted */
+};
+
+/*
+ * Precise CPU time of a task, in TSC cycles (rdtime on riscv), accounted at
+ * every kernel entry/exit and context switch. Unlike `struct sched_ticks`,
+ * it doesn't charge a whole tick to the task running when the timer fires.
+ */
+struct sched_cputime {
+
+   u64 last;            /* TSC at the last accounting */
+   u64 user;            /* time spent in user mode */
+   u64 system;          /* time spent in kernel mode, IRQs included */
+};
+
+#define SCHED_RQ_HIST_SIZE                        8
+
+/*
+ * System-wide version of `struct sched_stats` (idle task excluded) plus the
+ * runqueue length over time. The runqueue length is the number of RUNNABLE
+ * tasks, excluding the idle task and the worker threads.
+ */
+struct sched_global_stats {
+
+   u64 start;                          /* TSC at the last reset */
+   u64 wait_total;
+   u64 wait_max;
+   u64 wait_count;
+   u64 nvcsw;
+   u64 nivcsw;
+
+   u64 rq_len_time;                    /* integral of rq_len over time */
+   u64 rq_time[SCHED_RQ_HIST_SIZE];    /* time spent with rq_len == i */
+   u64 rq_last_change;                 /* TSC at the last rq_len change */
+   int rq_len;                         /* current runqueue length */
+   int rq_max;                         /* max runqueue length */
 };
 
 STATIC_ASSERT(sizeof(enum sig_state) == 1);
 
+/*
+ * The fields are ordered by how often they're accessed. At the beginning there
+ * is what the scheduler touches at every context switch and while walking the
+ * runqueues, then the cold bookkeeping. With 64-byte cache lines, the hot
+ * block (from `policy` to `timer_ready_node`) spans two lines on i386 and
+ * three on x86_64, while everything up to `runnable_node` fits in the first
+ * two on both (see the STATIC_ASSERT in sched.c). The runnable tree walk reads
+ * only `ticks.vruntime` and `runnable_node`, which share a single line.
+ *
+ * NOTE: the offsets of `fault_resume_regs` and `faults_resume_mask` are used
+ * in assembly (see asm_defs.h): don't move the fields before them.
+ */
 struct task {
 
    union {
@@ -74,19 +156,49 @@ struct task {
    regs_t *state_regs;
    regs_t *fault_resume_regs;
    u32 faults_resume_mask;
+
+   /* --------------------- Scheduler hot fields --------------------- */
+
+   u8 policy;                         /* enum sched_policy */
+   u8 rt_prio;                        /* static RT priority, 0 if not RT */
+   u8 eff_rt_prio;                    /* rt_prio, maybe boosted by PI */
+   bool rt_yield;                     /* RT task called sched_yield() */
+   bool wake_boost;                   /* being woken up by a boosting kcond */
+
+   /* The task was sleeping on a timer and has just been woken up */
+   bool timer_ready;
+
+   /*
+    * Summary of (sa_pending & ~sa_mask) != 0, kept in sync by signal.c every
+    * time one of the two changes. It makes pending_signals() a single load.
+    */
+   bool sig_deliverable;
+
+   int nice;                          /* in [MIN_NICE, MAX_NICE] */
+   struct sched_ticks ticks;          /* scheduler counters */
+   struct bintree_node runnable_node; /* node in the vruntime-ordered tree */
+   struct list_node rt_node;          /* node in the RT runqueues */
+   struct list_node timer_ready_node; /* node in the timer_ready_tasks_list */
+   struct sched_cputime cputime;      /* precise user/system CPU time */
+   struct sched_stats sched_stats;    /* latency and context switch stats */
+   u64 wakeup_deadline;               /* in ticks, 0 means no timer */
+   struct list_node wakeup_timer_node; /* node in a timing wheel's slot */
    void *worker_thread;                      /* only for worker threads */
+   void *kernel_stack;
+
+   /* ------------------------- Cold fields -------------------------- */
 
    struct bintree_node tree_by_tid_node;
-   struct list_node runnable_node;
-   struct list_node wakeup_timer_node;
+   struct htable_node tid_hnode;      /* node in the tid -> task hash table */
    struct list_node siblings_node;    /* nodes in parent's pi's children list */
+   struct list_node wstatus_node;     /* node in parent's pi's wstatus_queue */
 
    struct list tasks_waiting_list;    /* tasks waiting this task to end */
 
    s32 wstatus;                       /* waitpid's wstatus  */
-   struct sched_ticks ticks;          /* scheduler counters */
+   u16 held_kmutexes;                 /* kmutexes currently owned */
+   u16 sigqueue_len;                  /* number of entries in `sigqueue` */
 
-   void *kernel_stack;
    void *args_copybuf;
 
    union {
@@ -95,7 +207,6 @@ struct task {
    };
 
    struct wait_obj wobj;
-   u32 ticks_before_wake_up;
 
    /* List of callbacks to call on exit */
    struct list on_exit;
@@ -103,15 +214,15 @@ struct task {
    /* Temp kernel allocations for user requests */
    struct kernel_alloc *kallocs_tree_root;
 
+   /* Cached waiter for poll() and select(), see allocate_mobj_waiter() */
+   struct multi_obj_waiter *mobj_waiter;
+
    /* This task is stopped because of its vfork-ed child */
    bool vfork_stopped;
 
    /* Trace the syscalls of this task (requires debugpanel) */
    bool traced;
 
-   /* The task was sleeping on a timer and has just been woken up */
-   bool timer_ready;
-
    /* The current sa_mask has been altered by sigsuspend() */
    bool in_sigsuspend;
 
@@ -133,6 +244,9 @@ struct task {
    /* Old blocked signals mask, saved by sys_rt_sigsuspend() */
    ulong sa_old_mask[K_SIGACTION_MASK_WORDS];
 
+   /* Queued siginfo of the pending signals, in FIFO order (see signal.c) */
+   struct list sigqueue;
+
    /* See the comment above struct process' pi_arch */
    char ti_arch[ARCH_TASK_MEMBERS_SIZE] ALIGNED_AT(ARCH_TASK_MEMBERS_ALIGN);
 };
@@ -141,7 +255,6 @@ extern struct task *kernel_process;
 extern struct process *kernel_process_pi;
 extern struct task *idle_task;
 
-extern struct list runnable_tasks_list;
 extern const char *const task_state_str[5];
 
 #define KTH_ALLOC_BUFS                       (1 << 0)
@@ -180,13 +293,19 @@ static ALWAYS_INLINE bool need_reschedule(void)
 static ALWAYS_INLINE void disable_preemption(void)
 {
    extern ATOMIC(int) __disable_preempt; /* see docs/atomics.md */
-   atomic_fetch_add_explicit(&__disable_preempt, 1, mo_relaxed);
+   int oldval = atomic_fetch_add_explicit(&__disable_preempt, 1, mo_relaxed);
+
+   if (LATENCY_TRACER && !oldval)
+      preempt_off_trace_start();
 }
 
 static ALWAYS_INLINE void enable_preemption_nosched(void)
 {
    extern ATOMIC(int) __disable_preempt; /* see docs/atomics.md */
-   atomic_fetch_sub_explicit(&__disable_preempt, 1, mo_relaxed);
+   int oldval = atomic_fetch_sub_explicit(&__disable_preempt, 1, mo_relaxed);
+
+   if (LATENCY_TRACER && oldval == 1)
+      preempt_off_trace_end();
 }
 
 void enable_preemption(void);
@@ -282,6 +401,38 @@ static ALWAYS_INLINE bool schedule_preempt_disabled(void)
    return save_regs_and_schedule(true);
 }
 
+bool __cond_resched(bool preempt_disabled);
+
+/*
+ * Explicit preemption points, for the long loops in the kernel: if a
+ * reschedule is pending, yield right away instead of waiting for the next
+ * timer IRQ or for the end of the whole operation. Return true if a context
+ * switch occurred.
+ *
+ * cond_resched() does nothing unless the preemption is enabled, so it's safe
+ * to use in code that might be called with the preemption disabled.
+ *
+ * cond_resched_preempt_disabled() expects the preemption to be disabled
+ * exactly once: it enables it for the yield and disables it again before
+ * returning. Therefore, the caller must not leave half-updated anything
+ * other tasks might look at.
+ */
+static ALWAYS_INLINE bool cond_resched(void)
+{
+   if (LIKELY(!need_reschedule()))
+      return false;
+
+   return __cond_resched(false);
+}
+
+static ALWAYS_INLINE bool cond_resched_preempt_disabled(void)
+{
+   if (LIKELY(!need_reschedule()))
+      return false;
+
+   return __cond_resched(true);
+}
+
 
 static ALWAYS_INLINE struct task *get_curr_task(void)
 {
@@ -390,6 +541,18 @@ int get_curr_tid(void);
 int get_curr_pid(void);
 void save_current_task_state(regs_t *, bool);
 void sched_account_ticks(void);
+void sched_get_global_stats(struct sched_global_stats *s);
+void sched_account_cputime(bool user);
+
+struct k_timespec64;
+void task_get_cputime(struct task *ti,
+                      struct k_timespec64 *utime,
+                      struct k_timespec64 *stime);
+u32 sched_nice_to_weight(int nice);
+void sched_set_nice(struct task *ti, int nice);
+void sched_set_policy(struct task *ti, enum sched_policy policy, int rt_prio);
+void sched_set_eff_rt_prio(struct task *ti, int prio);
+void sched_reset_global_stats(void);
 int create_new_pid(void);
 int create_new_kernel_tid(void);
 void task_info_reset_kernel_stack(struct task *ti);
@@ -420,6 +583,8 @@ NODISCARD int kthread_create2(kthread_func_ptr func,
 int iterate_over_tasks(bintree_visit_cb func, void *arg);
 int sched_count_proc_in_group(int pgid);
 int sched_get_session_of_group(int pgid);
+void sched_reserve_pgsid(int id);
+void sched_release_pgsid(int id);
 
 struct process *task_get_pi_opaque(struct task *ti);
 void process_set_tty(struct process *pi, void *t);
@@ -33,7 +33,7 @@ struct self_test {
    };                                                           \
                                                                 \
    __attribute__((constructor))                                 \
-   static void __register_se_##__name(void) {                   \
+   static void INIT_TEXT __register_se_##__name(void) {         \
       se_register(&se_##__name##_inst);                         \
    }
 
@@ -24,6 +24,8 @@ enum sig_state {
 int send_signal_to_group(int pgid, int sig);
 int send_signal_to_session(int sid, int sig);
 int send_signal2(int pid, int tid, int signum, int flags);
+int send_signal_info(int pid, int tid, int signum, int flags,
+                     const siginfo_t *info);
 bool process_signals(void *curr, enum sig_state new_sig_state, void *regs);
 void drop_all_pending_signals(void *curr);
 void reset_all_custom_signal_handlers(void *curr);
@@ -34,3 +36,21 @@ static inline int send_signal(int tid, int signum, int flags)
 }
 
 #define K_SIGACTION_MASK_WORDS                              (_NSIG / NBITS)
+
+/*
+ * The first real-time signal, as seen by the kernel. NOTE: libc's SIGRTMIN is
+ * greater than that, because libc reserves a few RT signals for itself.
+ */
+#define K_SIGRTMIN                                                      32
+
+/*
+ * Dequeues the first pending signal of the task `ti` belonging to the set
+ * `set` (K_SIGACTION_MASK_WORDS words), no matter if it's blocked or not.
+ * Returns its number and fills `info`, or returns 0 if there's none. Used by
+ * rt_sigtimedwait() and signalfd. Preemption must be disabled.
+ */
+int dequeue_signal(void *ti, const ulong *set, siginfo_t *info);
+bool is_any_pending_sig_in_set(void *ti, const ulong *set);
+
+/* Wakes up the signalfd readers: called when any signal becomes pending */
+void signalfd_notify(void);
@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+#include <tilck/kernel/signal.h>
+
+struct signalfd;
+
+struct signalfd *create_signalfd(const ulong *mask);
+void destroy_signalfd(struct signalfd *sfd);
+fs_handle signalfd_create_handle(struct signalfd *sfd, int flags);
+bool is_signalfd_handle(fs_handle h);
+void signalfd_set_mask(fs_handle h, const ulong *mask);
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+#define MAX_CPUS                                   8
+
+/*
+ * Per-CPU area. The boot CPU is always CPU 0; the others (the APs) are
+ * started by init_smp(), in the order the firmware lists them.
+ *
+ * NOTE: the APs just sit in an idle loop with the interrupts disabled: all
+ * the tasks still run on the boot CPU. Scheduling on the APs requires per-CPU
+ * runqueues, spinlocks instead of disable_preemption() and IPIs for the
+ * reschedule and the TLB shootdown, none of which exist yet.
+ */
+struct percpu {
+
+   u32 cpu;                /* logical id: index in percpu_areas */
+   u32 hw_id;              /* LAPIC id on x86 */
+   void *idle_stack;       /* NULL for the boot CPU */
+   volatile bool online;
+};
+
+extern struct percpu percpu_areas[MAX_CPUS];
+extern u32 cpus_online;
+
+#if defined(__i386__) && !defined(UNIT_TEST_ENVIRONMENT)
+
+   #define ARCH_HAS_SMP_BOOT                       1
+
+   void init_smp(void);
+
+#else
+
+   static ALWAYS_INLINE void init_smp(void)
+   {
+      /* STUB function: only the boot CPU is used */
+   }
+
+#endif
@@ -9,5 +9,24 @@ insertion_sort_ptr(void *arr, u32 elem_count, cmpfun_ptr cmp);
 void
 insertion_sort_generic(void *a, ulong elem_sz, u32 elem_count, cmpfun_ptr cmp);
 
+void
+intro_sort_ptr(void *arr, u32 elem_count, cmpfun_ptr cmp);
+
+void
+intro_sort_generic(void *a, ulong elem_sz, u32 elem_count, cmpfun_ptr cmp);
+
+/* Returns the key a radix sort orders the elements by (ascending) */
+typedef ulong (*sortkey_ptr)(const void *elem);
+
+void
+radix_sort_ptr(void *arr, void *tmp, u32 elem_count, sortkey_ptr key);
+
+void
+radix_sort_generic(void *a,
+                   void *tmp,
+                   ulong elem_sz,
+                   u32 elem_count,
+                   sortkey_ptr key);
+
 void
 array_reverse_ptr(void *a, u32 elem_count);
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Static keys (jump labels): boolean flags checked on hot paths, but changed
+ * very rarely. Each static_branch_unlikely() site is compiled as a NOP, plus
+ * an entry in the `.static_keys` section (collected by the linker script
+ * between `static_keys` and `static_keys_end`, like the exception table).
+ * When the key gets enabled, static_key_set() patches all of its sites into
+ * jumps to the code handling the unlikely case. Therefore, a disabled key
+ * costs just a NOP: no memory load, nor conditional branch.
+ *
+ * On the archs without an implementation, in the unit tests and in the
+ * loadable modules (the kernel patches only its own table), the branch is a
+ * regular check of `key->enabled`. The same happens in the builds without
+ * optimizations (Debug), where the key's address passed through the inline
+ * functions is not a compile-time constant, as the "i" asm constraint needs.
+ */
+
+struct static_key {
+   bool enabled;
+};
+
+struct static_key_entry {
+
+   ulong code;       /* address of the NOP to patch */
+   ulong target;     /* where to jump, when the key is enabled */
+   ulong key;        /* the struct static_key */
+};
+
+extern const struct static_key_entry static_keys[];
+extern const struct static_key_entry static_keys_end[];
+
+#define DEFINE_STATIC_KEY(name)     struct static_key name = { .enabled = 0 }
+
+#if (defined(__i386__) || defined(__x86_64__)) &&                          \
+    !defined(UNIT_TEST_ENVIRONMENT) && !defined(KERNEL_LOADABLE_MODULE) && \
+    defined(__OPTIMIZE__)
+
+   #define ARCH_HAS_STATIC_KEYS                  1
+   #include <tilck/kernel/arch/generic_x86/static_key.h>
+
+   #define static_branch_unlikely(key)    arch_static_branch(key)
+
+#else
+
+   #define static_branch_unlikely(key)    UNLIKELY((key)->enabled)
+
+#endif
+
+static ALWAYS_INLINE bool static_key_enabled(struct static_key *key)
+{
+   return key->enabled;
+}
+
+/*
+ * Enables or disables `key`, patching all of its sites. It's meant for the
+ * slow paths (e.g. turning tracing on): the cost is a scan of the whole table.
+ */
+void static_key_set(struct static_key *key, bool enabled);
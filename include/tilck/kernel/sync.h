@@ -5,6 +5,7 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/atomics.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/lock_stats.h>
 
 struct task;
 
@@ -15,6 +16,8 @@ enum wo_type {
    WOBJ_KCOND,
    WOBJ_TASK,
    WOBJ_SEM,
+   WOBJ_FUTEX,
+   WOBJ_EPOLL,      /* persistent registration of an epoll item */
 
    /* Special "meta-object" types */
 
@@ -40,6 +43,7 @@ struct wait_obj {
 
    u32 extra;                        /* extra info about the waiting reason  */
    enum wo_type type;                /* type of the object we're waiting for */
+   bool exclusive;                   /* see kcond_signal_one()               */
    struct list_node wait_list_node;  /* node in waited object's waiting list */
 };
 
@@ -67,6 +71,8 @@ struct mwobj_elem {
 struct multi_obj_waiter {
 
    int count;                    /* number of `struct mwobj_elem` elements */
+   int cap;                      /* number of allocated elements */
+   bool in_use;                  /* only for the per-task cached waiter */
    struct mwobj_elem elems[];    /* variable-size array */
 };
 
@@ -97,8 +103,14 @@ void prepare_to_wait_on(enum wo_type type,
 
 void *wake_up(struct task *ti);
 
+/*
+ * allocate_mobj_waiter() reuses the waiter cached in the current task when
+ * it's large enough and not already in use: free_mobj_waiter() just gives it
+ * back. The cache is dropped by free_task_mobj_waiter() when the task dies.
+ */
 struct multi_obj_waiter *allocate_mobj_waiter(int elems);
 void free_mobj_waiter(struct multi_obj_waiter *w);
+void free_task_mobj_waiter(struct task *ti);
 void mobj_waiter_reset(struct mwobj_elem *e);
 void mobj_waiter_reset2(struct multi_obj_waiter *w, int index);
 void mobj_waiter_set(struct multi_obj_waiter *w,
@@ -151,6 +163,10 @@ struct kmutex {
    u32 num_waiters;
    u32 max_num_waiters;
 #endif
+
+#if LOCK_STATS
+   struct lock_class *lc;
+#endif
 };
 
 #define STATIC_KMUTEX_INIT(m, fl)                 \
@@ -179,10 +195,30 @@ bool kmutex_trylock(struct kmutex *m);
 void kmutex_unlock(struct kmutex *m);
 void kmutex_destroy(struct kmutex *m);
 
+/* Global counters of the contended kmutex_lock() calls, see kmutex_spin() */
+struct kmutex_spin_stats {
+
+   u64 yields;             /* yields done waiting for a runnable owner */
+   u64 spin_acquired;      /* acquired after yielding, without sleeping */
+   u64 spin_failed;        /* slept after yielding, anyway */
+   u64 slept;              /* slept in total (spin_failed included) */
+};
+
+void kmutex_get_spin_stats(struct kmutex_spin_stats *s);
+
 #if DEBUG_CHECKS
 bool kmutex_is_curr_task_holding_lock(struct kmutex *m);
 #endif
 
+/* NOTE: kmutex_init() resets the class: set it after the init */
+static inline void
+kmutex_set_lock_class(struct kmutex *m, struct lock_class *lc)
+{
+#if LOCK_STATS
+   m->lc = lc;
+#endif
+}
+
 /*
  * A basic implementation of condition variables similar to the pthread ones.
  */
@@ -190,6 +226,11 @@ bool kmutex_is_curr_task_holding_lock(struct kmutex *m);
 struct kcond {
 
    struct list wait_list;
+   bool wake_boost;             /* boost the woken tasks (see sched.c) */
+
+#if LOCK_STATS
+   struct lock_class *lc;
+#endif
 };
 
 #define STATIC_KCOND_INIT(s)                     \
@@ -201,7 +242,37 @@ struct kcond {
 
 void kcond_init(struct kcond *c);
 void kcond_destory(struct kcond *c);
+/*
+ * Waiters are either exclusive or not. Tasks in kcond_wait() are exclusive,
+ * while poll/select registrations and epoll items (unless EPOLLEXCLUSIVE) are
+ * not. kcond_signal_one() notifies all the non-exclusive waiters, but wakes up
+ * only the first exclusive one that is still sleeping, skipping the waiters
+ * that already woke up because of a timeout: this way, a single event doesn't
+ * cause a thundering herd and it doesn't get lost either.
+ */
 void kcond_signal_one(struct kcond *c);
 void kcond_signal_all(struct kcond *c);
 bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks);
 bool kcond_is_anyone_waiting(struct kcond *c);
+
+/*
+ * For conditions, an acquisition is a kcond_wait() call and its wait time is
+ * the time spent sleeping, until signaled or timed out.
+ */
+static inline void
+kcond_set_lock_class(struct kcond *c, struct lock_class *lc)
+{
+#if LOCK_STATS
+   c->lc = lc;
+#endif
+}
+
+/*
+ * Latency-sensitive conditions (e.g. the tty input) can ask the scheduler to
+ * favor the tasks they wake up: see sched_place_woken_task().
+ */
+static inline void
+kcond_set_wake_boost(struct kcond *c, bool enabled)
+{
+   c->wake_boost = enabled;
+}
@@ -111,6 +111,26 @@ struct k_rusage {
    STATIC_ASSERT(sizeof(struct k_rusage) == 136);
 #endif
 
+/*
+ * The rlimit struct used by the kernel's setrlimit() and getrlimit(), with
+ * pointer-size fields. It does NOT match libc's struct rlimit on all systems.
+ */
+struct k_rlimit {
+
+   ulong rlim_cur;
+   ulong rlim_max;
+};
+
+/* The rlimit struct used by prlimit64() */
+struct k_rlimit64 {
+
+   u64 rlim_cur;
+   u64 rlim_max;
+};
+
+#define K_RLIM_INFINITY                       (~0UL)
+#define K_RLIM64_INFINITY                    (~0ULL)
+
 /*
  * Classic (old) timespec. Suffers from the Y2038 bug on ALL systems.
  */
@@ -129,6 +149,46 @@ struct k_timespec64 {
    long tv_nsec;
 };
 
+/*
+ * Linux's struct itimerspec, as used by timerfd_settime() and
+ * timerfd_gettime(), in the classic and in the modern version.
+ */
+struct k_itimerspec32 {
+
+   struct k_timespec32 it_interval;
+   struct k_timespec32 it_value;
+};
+
+struct k_itimerspec64 {
+
+   struct k_timespec64 it_interval;
+   struct k_timespec64 it_value;
+};
+
+/*
+ * Linux's struct sched_attr, as used by sched_setattr() and sched_getattr().
+ * Only the first version (SCHED_ATTR_SIZE_VER0) of the struct is supported.
+ */
+struct k_sched_attr {
+
+   u32 size;
+   u32 sched_policy;
+   u64 sched_flags;
+   s32 sched_nice;
+   u32 sched_priority;
+   u64 sched_runtime;
+   u64 sched_deadline;
+   u64 sched_period;
+};
+
+#define K_SCHED_ATTR_SIZE_VER0                  48
+STATIC_ASSERT(sizeof(struct k_sched_attr) == K_SCHED_ATTR_SIZE_VER0);
+
+struct k_sched_param {
+
+   int sched_priority;
+};
+
 
 
 #if defined(__i386__)
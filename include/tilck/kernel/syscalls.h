@@ -81,7 +81,7 @@ int sys_pause(void);
 int sys_utime32(const char *u_path, const struct k_utimbuf *u_times);
 int sys_access(const char *u_path, mode_t mode);
 
-CREATE_STUB_SYSCALL_IMPL(sys_nice)
+int sys_nice(int inc);
 
 int sys_sync(void);
 int sys_kill(int pid, int sig);
@@ -135,7 +135,6 @@ CREATE_STUB_SYSCALL_IMPL(sys_setregid16)
 CREATE_STUB_SYSCALL_IMPL(sys_sigsuspend)
 CREATE_STUB_SYSCALL_IMPL(sys_sigpending)
 CREATE_STUB_SYSCALL_IMPL(sys_sethostname)
-CREATE_STUB_SYSCALL_IMPL(sys_setrlimit)
 CREATE_STUB_SYSCALL_IMPL(sys_old_getrlimit)
 
 int sys_getrusage(int who, struct k_rusage *user_buf);
@@ -168,8 +167,8 @@ CREATE_STUB_SYSCALL_IMPL(sys_ftruncate)
 int sys_fchmod(int fd, mode_t mode);
 
 CREATE_STUB_SYSCALL_IMPL(sys_fchown16)
-CREATE_STUB_SYSCALL_IMPL(sys_getpriority)
-CREATE_STUB_SYSCALL_IMPL(sys_setpriority)
+int sys_getpriority(int which, int who);
+int sys_setpriority(int which, int who, int prio);
 CREATE_STUB_SYSCALL_IMPL(sys_statfs)
 CREATE_STUB_SYSCALL_IMPL(sys_fstatfs)
 CREATE_STUB_SYSCALL_IMPL(sys_ioperm)
@@ -231,7 +230,8 @@ int sys_select(int nfds, fd_set *readfds, fd_set *writefds,
                fd_set *exceptfds, struct k_timeval *timeout);
 
 CREATE_STUB_SYSCALL_IMPL(sys_flock)
-CREATE_STUB_SYSCALL_IMPL(sys_msync)
+
+int sys_msync(void *addr, size_t len, int flags);
 
 int sys_readv(int fd, const struct iovec *iov, int iovcnt);
 int sys_writev(int fd, const struct iovec *iov, int iovcnt);
@@ -243,15 +243,18 @@ CREATE_STUB_SYSCALL_IMPL(sys_mlock)
 CREATE_STUB_SYSCALL_IMPL(sys_munlock)
 CREATE_STUB_SYSCALL_IMPL(sys_mlockall)
 CREATE_STUB_SYSCALL_IMPL(sys_munlockall)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_setparam)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_getparam)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_setscheduler)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_getscheduler)
+int sys_sched_setparam(int pid, const struct k_sched_param *u_param);
+int sys_sched_getparam(int pid, struct k_sched_param *u_param);
+
+int sys_sched_setscheduler(int pid, int policy,
+                           const struct k_sched_param *u_param);
+
+int sys_sched_getscheduler(int pid);
 
 int sys_sched_yield(void);
 
-CREATE_STUB_SYSCALL_IMPL(sys_sched_get_priority_max)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_set_priority_min)
+int sys_sched_get_priority_max(int policy);
+int sys_sched_get_priority_min(int policy);
 CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval_time32)
 
 int sys_nanosleep_time32(const struct k_timespec32 *req,
@@ -260,7 +263,9 @@ int sys_nanosleep_time32(const struct k_timespec32 *req,
 long sys_nanosleep(const struct k_timespec64 *u_req,
                    struct k_timespec64 *u_rem);
 
-CREATE_STUB_SYSCALL_IMPL(sys_mremap)
+long sys_mremap(void *old_addr, size_t old_len, size_t new_len,
+                int flags, void *new_addr);
+
 CREATE_STUB_SYSCALL_IMPL(sys_setresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_getresuid16)
 CREATE_STUB_SYSCALL_IMPL(sys_vm86)
@@ -272,6 +277,10 @@ CREATE_STUB_SYSCALL_IMPL(sys_setresgid16)
 CREATE_STUB_SYSCALL_IMPL(sys_getresgid16)
 
 int sys_prctl(int option, ulong a2, ulong a3, ulong a4, ulong a5);
+int sys_prlimit64(int pid,
+                  int resource,
+                  const struct k_rlimit64 *user_new_rlim,
+                  struct k_rlimit64 *user_old_rlim);
 ulong sys_rt_sigreturn(void);
 
 int
@@ -287,8 +296,12 @@ sys_rt_sigprocmask(int how, sigset_t *u_set,
 int
 sys_rt_sigpending(sigset_t *u_set, size_t sigsetsize);
 
-CREATE_STUB_SYSCALL_IMPL(sys_rt_sigtimedwait_time32)
-CREATE_STUB_SYSCALL_IMPL(sys_rt_sigqueueinfo)
+int sys_rt_sigtimedwait_time32(const sigset_t *u_set,
+                               siginfo_t *u_info,
+                               const struct k_timespec32 *u_timeout,
+                               size_t sigsetsize);
+
+int sys_rt_sigqueueinfo(int pid, int sig, siginfo_t *u_info);
 
 int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize);
 int sys_pread64(int fd, void *buf, size_t count, s64 off);
@@ -301,11 +314,13 @@ int sys_getcwd(char *buf, size_t size);
 CREATE_STUB_SYSCALL_IMPL(sys_capget)
 CREATE_STUB_SYSCALL_IMPL(sys_capset)
 CREATE_STUB_SYSCALL_IMPL(sys_sigaltstack)
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile)
+
+long sys_sendfile(int out_fd, int in_fd, long *u_offset, size_t count);
 
 int sys_vfork(void *u_regs);
 
-CREATE_STUB_SYSCALL_IMPL(sys_getrlimit)
+int sys_getrlimit(int resource, struct k_rlimit *user_rlim);
+int sys_setrlimit(int resource, const struct k_rlimit *user_rlim);
 
 long sys_mmap_pgoff(void *addr, size_t length, int prot,
                     int flags, int fd, size_t pgoffset);
@@ -367,8 +382,14 @@ CREATE_STUB_SYSCALL_IMPL(sys_fremovexattr)
 
 int sys_tkill(int tid, int sig);
 
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile64)
-CREATE_STUB_SYSCALL_IMPL(sys_futex_time32)
+
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_offset, size_t count);
+
+
+int sys_futex_time32(u32 *uaddr, int futex_op, u32 val,
+                     const struct k_timespec32 *utime,
+                     u32 *uaddr2, u32 val3);
+
 CREATE_STUB_SYSCALL_IMPL(sys_sched_setaffinity)
 CREATE_STUB_SYSCALL_IMPL(sys_sched_getaffinity)
 
@@ -386,9 +407,14 @@ CREATE_STUB_SYSCALL_IMPL(sys_ia32_fadvise64)
 NORETURN int sys_exit_group(int status);
 
 CREATE_STUB_SYSCALL_IMPL(sys_lookup_dcookie)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_ctl)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_wait)
+
+struct epoll_event;
+
+int sys_epoll_create(int size);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *user_ev);
+int sys_epoll_wait(int epfd, struct epoll_event *events,
+                   int maxevents, int timeout);
+
 CREATE_STUB_SYSCALL_IMPL(sys_remap_file_pages)
 
 // TODO: complete the implementation when thread creation is implemented.
@@ -476,13 +502,22 @@ long sys_ppoll(struct pollfd *ufds, unsigned int nfds,
 CREATE_STUB_SYSCALL_IMPL(sys_unshare)
 CREATE_STUB_SYSCALL_IMPL(sys_set_robust_list)
 CREATE_STUB_SYSCALL_IMPL(sys_get_robust_list)
-CREATE_STUB_SYSCALL_IMPL(sys_splice)
+
+long sys_splice(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                size_t len, unsigned int flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_ia32_sync_file_range)
-CREATE_STUB_SYSCALL_IMPL(sys_tee)
-CREATE_STUB_SYSCALL_IMPL(sys_vmsplice)
+
+long sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+long sys_vmsplice(int fd, const struct iovec *u_iov, ulong nr_segs, u32 flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_move_pages)
 CREATE_STUB_SYSCALL_IMPL(sys_getcpu)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_pwait)
+
+int sys_epoll_pwait(int epfd, struct epoll_event *events,
+                    int maxevents, int timeout,
+                    const sigset_t *user_sigmask, size_t sigsetsize);
+
 
 int sys_utimensat_time32(int dirfd, const char *u_path,
                          const struct k_timespec32 times[2], int flags);
@@ -490,15 +525,26 @@ int sys_utimensat_time32(int dirfd, const char *u_path,
 long sys_utimensat(int dirfd, const char *u_path,
                    struct k_timespec64 utimes[2], int flags);
 
-CREATE_STUB_SYSCALL_IMPL(sys_signalfd)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_create)
-CREATE_STUB_SYSCALL_IMPL(sys_eventfd)
-CREATE_STUB_SYSCALL_IMPL(sys_fallocate)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_settime32)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_gettime32)
-CREATE_STUB_SYSCALL_IMPL(sys_signalfd4)
-CREATE_STUB_SYSCALL_IMPL(sys_eventfd2)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create1)
+int sys_signalfd(int ufd, const sigset_t *u_mask, size_t sizemask);
+
+int sys_timerfd_create(int clockid, int flags);
+
+int sys_eventfd(unsigned int initval);
+
+int sys_fallocate(int fd, int mode, s64 off, s64 len);
+
+int sys_timerfd_settime32(int fd,
+                          int flags,
+                          const struct k_itimerspec32 *u_new,
+                          struct k_itimerspec32 *u_old);
+
+int sys_timerfd_gettime32(int fd, struct k_itimerspec32 *u_curr);
+
+int sys_signalfd4(int ufd, const sigset_t *u_mask, size_t sizemask, int flags);
+
+int sys_eventfd2(unsigned int initval, int flags);
+
+int sys_epoll_create1(int flags);
 
 long sys_dup3(int oldfd, int newfd, int flags);
 
@@ -507,13 +553,14 @@ int sys_pipe2(int u_pipefd[2], int flags);
 CREATE_STUB_SYSCALL_IMPL(sys_inotify_init1)
 CREATE_STUB_SYSCALL_IMPL(sys_preadv)
 CREATE_STUB_SYSCALL_IMPL(sys_pwritev)
-CREATE_STUB_SYSCALL_IMPL(sys_rt_tgsigqueueinfo)
+
+int sys_rt_tgsigqueueinfo(int pid, int tid, int sig, siginfo_t *u_info);
+
 CREATE_STUB_SYSCALL_IMPL(sys_perf_event_open)
 CREATE_STUB_SYSCALL_IMPL(sys_recvmmsg_time32)
 
 CREATE_STUB_SYSCALL_IMPL(sys_fanotify_init)
 CREATE_STUB_SYSCALL_IMPL(sys_fanotify_mark)
-CREATE_STUB_SYSCALL_IMPL(sys_prlimit64)
 CREATE_STUB_SYSCALL_IMPL(sys_name_to_handle_at)
 CREATE_STUB_SYSCALL_IMPL(sys_open_by_handle_at)
 CREATE_STUB_SYSCALL_IMPL(sys_clock_adjtime32)
@@ -522,19 +569,37 @@ int sys_syncfs(int fd);
 
 CREATE_STUB_SYSCALL_IMPL(sys_sendmmsg)
 CREATE_STUB_SYSCALL_IMPL(sys_setns)
-CREATE_STUB_SYSCALL_IMPL(sys_process_vm_readv)
-CREATE_STUB_SYSCALL_IMPL(sys_process_vm_writev)
+
+long
+sys_process_vm_readv(int pid,
+                     const struct iovec *u_liov,
+                     ulong liovcnt,
+                     const struct iovec *u_riov,
+                     ulong riovcnt,
+                     ulong flags);
+
+long
+sys_process_vm_writev(int pid,
+                      const struct iovec *u_liov,
+                      ulong liovcnt,
+                      const struct iovec *u_riov,
+                      ulong riovcnt,
+                      ulong flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_kcmp)
 CREATE_STUB_SYSCALL_IMPL(sys_finit_module)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_setattr)
-CREATE_STUB_SYSCALL_IMPL(sys_sched_getattr)
+int sys_sched_setattr(int pid, struct k_sched_attr *u_attr, u32 flags);
+int sys_sched_getattr(int pid, struct k_sched_attr *u_attr,
+                      u32 size, u32 flags);
 
 long sys_renameat2(int olddfd, const char *oldname,
                    int newdfd, const char *newname, u32 flags);
 
 CREATE_STUB_SYSCALL_IMPL(sys_seccomp)
 CREATE_STUB_SYSCALL_IMPL(sys_getrandom)
-CREATE_STUB_SYSCALL_IMPL(sys_memfd_create)
+
+int sys_memfd_create(const char *u_name, u32 flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_bpf)
 CREATE_STUB_SYSCALL_IMPL(sys_execveat)
 CREATE_STUB_SYSCALL_IMPL(sys_socket)
@@ -556,14 +621,15 @@ CREATE_STUB_SYSCALL_IMPL(sys_shutdown)
 CREATE_STUB_SYSCALL_IMPL(sys_userfaultfd)
 CREATE_STUB_SYSCALL_IMPL(sys_membarrier)
 CREATE_STUB_SYSCALL_IMPL(sys_mlock2)
-CREATE_STUB_SYSCALL_IMPL(sys_copy_file_range)
+long sys_copy_file_range(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                         size_t len, unsigned int flags);
 CREATE_STUB_SYSCALL_IMPL(sys_preadv2)
 CREATE_STUB_SYSCALL_IMPL(sys_pwritev2)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_mprotect)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_alloc)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_free)
 CREATE_STUB_SYSCALL_IMPL(sys_statx)
-CREATE_STUB_SYSCALL_IMPL(sys_arch_prctl)
+int sys_arch_prctl(int code, ulong addr);
 CREATE_STUB_SYSCALL_IMPL(sys_io_pgetevents_time32)
 CREATE_STUB_SYSCALL_IMPL(sys_rseq)
 
@@ -589,8 +655,14 @@ int sys_clock_getres(clockid_t clk_id, struct k_timespec64 *user_res);
 CREATE_STUB_SYSCALL_IMPL(sys_clock_nanosleep)
 CREATE_STUB_SYSCALL_IMPL(sys_timer_gettime)
 CREATE_STUB_SYSCALL_IMPL(sys_timer_settime)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_gettime)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_settime)
+
+int sys_timerfd_gettime(int fd, struct k_itimerspec64 *u_curr);
+
+int sys_timerfd_settime(int fd,
+                        int flags,
+                        const struct k_itimerspec64 *u_new,
+                        struct k_itimerspec64 *u_old);
+
 CREATE_STUB_SYSCALL_IMPL(sys_pselect6_time32)
 CREATE_STUB_SYSCALL_IMPL(sys_ppoll_time32)
 CREATE_STUB_SYSCALL_IMPL(sys_io_pgetevents)
@@ -598,12 +670,24 @@ CREATE_STUB_SYSCALL_IMPL(sys_recvmmsg)
 CREATE_STUB_SYSCALL_IMPL(sys_mq_timedsend)
 CREATE_STUB_SYSCALL_IMPL(sys_mq_timedreceive)
 CREATE_STUB_SYSCALL_IMPL(sys_semtimedop)
-CREATE_STUB_SYSCALL_IMPL(sys_rt_sigtimedwait)
-CREATE_STUB_SYSCALL_IMPL(sys_futex)
+
+int sys_rt_sigtimedwait(const sigset_t *u_set,
+                        siginfo_t *u_info,
+                        const struct k_timespec64 *u_timeout,
+                        size_t sigsetsize);
+
+long sys_futex(u32 *uaddr, int futex_op, u32 val,
+               const struct k_timespec64 *utime,
+               u32 *uaddr2, u32 val3);
+
 CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval)
 CREATE_STUB_SYSCALL_IMPL(sys_pidfd_send_signal)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_setup)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_enter)
+
+struct io_uring_params;
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params);
+int sys_io_uring_enter(unsigned int fd, u32 to_submit, u32 min_complete,
+                       u32 flags, const void *u_sig, size_t sigsz);
+
 CREATE_STUB_SYSCALL_IMPL(sys_io_uring_register)
 CREATE_STUB_SYSCALL_IMPL(sys_open_tree)
 CREATE_STUB_SYSCALL_IMPL(sys_move_mount)
@@ -29,6 +29,14 @@ struct video_interface {
    void (*redraw_static_elements)(void);
    void (*disable_static_elems_refresh)(void);
    void (*enable_static_elems_refresh)(void);
+
+   /*
+    * Batching (optional): between begin_batch() and flush_batch(), the
+    * interface is allowed to just record the cells changed by set_char_at()
+    * and set_row() and draw them all at once in flush_batch().
+    */
+   void (*begin_batch)(void);
+   void (*flush_batch)(void);
 };
 
 enum term_type {
@@ -44,6 +52,25 @@ struct term_params {
    const struct video_interface *vi;
 };
 
+struct term_scrollback_stats {
+
+   u32 rows;                  /* rows currently in the scrollback */
+   u32 max_rows;              /* max rows in the scrollback */
+   size_t used_bytes;         /* bytes used by the compressed rows */
+   size_t alloc_bytes;        /* memory allocated for the scrollback */
+   size_t uncompressed_bytes; /* memory needed to store max_rows raw rows */
+};
+
+/* Memory used by a term, in bytes */
+struct term_mem_stats {
+
+   size_t screen_bytes;       /* the screen buffer */
+   size_t tabs_bytes;         /* the tab stops of the main screen */
+   size_t alt_bytes;          /* the alternate screen buffers, if allocated */
+   size_t sb_bytes;           /* the scrollback (see term_scrollback_stats) */
+   bool using_alt;            /* the alternate screen is in use */
+};
+
 enum term_fret {
    TERM_FILTER_WRITE_BLANK,
    TERM_FILTER_WRITE_C,
@@ -54,6 +81,16 @@ typedef enum term_fret (*term_filter)(u8 *c,                 /* in/out */
                                       struct term_action *a, /*  out   */
                                       void *ctx);            /*   in   */
 
+/*
+ * Optional fast path for a term filter: it returns a table mapping each char
+ * that the filter, in its current state, would just write (possibly translated)
+ * to the char to write and all the others to -1. It returns NULL when there's
+ * no such table in the current state (e.g. in the middle of an escape
+ * sequence). This allows the term to write whole runs of plain chars without
+ * calling the filter for each one of them.
+ */
+typedef const s16 *(*term_plain_chars_func)(void *ctx);
+
 struct term_interface {
 
    enum term_type (*get_type)(void);
@@ -67,6 +104,15 @@ struct term_interface {
    void (*pause_output)(term *t);
    void (*restart_output)(term *t);
    void (*set_filter)(term *t, term_filter func, void *ctx);
+   void (*set_plain_chars_func)(term *t, term_plain_chars_func func);
+   void (*get_scrollback_stats)(term *t, struct term_scrollback_stats *out);
+   void (*get_mem_stats)(term *t, struct term_mem_stats *out);
+
+   /*
+    * Free the scrollback, for good. Returns the bytes freed or about to be
+    * freed: the term might be busy, in which case it will happen soon.
+    */
+   size_t (*drop_scrollback)(term *t);
 
    /*
     * The first term must be pre-allocated but _not_ pre-initialized.
@@ -10,4 +10,5 @@ extern struct kmalloc_heap first_heap_struct;
 extern struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
 extern int used_heaps;
 extern size_t max_tot_heap_mem_free;
+extern struct kmalloc_cache *caches_list;
 #endif
@@ -3,6 +3,8 @@
 #pragma once
 #include <tilck_gen_headers/config_sched.h>
 #include <tilck/common/basic_defs.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/list.h>
 
 void kernel_sleep(u64 ticks);  /* sleep for `ticks` timer ticks (jiffies) */
 void kernel_sleep_ms(u64 ms);  /* sleep for `ms` milliseconds */
@@ -16,3 +18,39 @@ ms_to_ticks(u64 ms)
 
 u64 get_ticks(void);
 void init_timer(void);
+
+/* TSC cycles (rdtime on riscv) to ns. Returns 0 if the TSC is not usable */
+u64 tsc_to_ns(u64 cycles);
+u64 __tsc_ns_since_tick(void);
+
+/*
+ * Kernel timers, not tied to any task (unlike task_set_wakeup_timer()): when
+ * the tick counter reaches `deadline`, `func` is called once, in a worker
+ * thread and with preemption disabled. Periodic timers just re-arm themselves
+ * in `func`. After ktimer_cancel() returns, `func` won't be called anymore.
+ */
+struct ktimer {
+
+   struct bintree_node node;        /* node in the ktimers tree */
+   struct list_node fired_node;     /* node in the list of fired ktimers */
+   u64 deadline;                    /* absolute, in ticks. 0 = not armed */
+   void (*func)(struct ktimer *);
+};
+
+void ktimer_init(struct ktimer *t, void (*func)(struct ktimer *));
+void ktimer_arm(struct ktimer *t, u64 deadline);
+void ktimer_cancel(struct ktimer *t);
+
+/* Halt until the next IRQ, stopping the periodic tick if possible */
+void tickless_idle_halt(void);
+void __tickless_idle_exit(void);
+
+extern bool __in_tickless_idle;
+extern u64 tickless_skipped_ticks;
+
+/* Called with interrupts disabled, at the beginning of each IRQ */
+static ALWAYS_INLINE void tickless_idle_exit_if_needed(void)
+{
+   if (UNLIKELY(__in_tickless_idle))
+      __tickless_idle_exit();
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+#include <tilck/kernel/sys_types.h>
+
+/* Same values as Linux's <sys/timerfd.h> */
+#define TFD_CLOEXEC                     O_CLOEXEC
+#define TFD_NONBLOCK                    O_NONBLOCK
+#define TFD_TIMER_ABSTIME               (1 << 0)
+#define TFD_TIMER_CANCEL_ON_SET         (1 << 1)
+
+struct timerfd;
+
+struct timerfd *create_timerfd(int clockid);
+void destroy_timerfd(struct timerfd *tfd);
+fs_handle timerfd_create_handle(struct timerfd *tfd, int flags);
+bool is_timerfd_handle(fs_handle h);
+
+int timerfd_settime(fs_handle h,
+                    int flags,
+                    const struct k_itimerspec64 *new_val,
+                    struct k_itimerspec64 *old_val);
+
+void timerfd_gettime(fs_handle h, struct k_itimerspec64 *curr_val);
@@ -5,6 +5,22 @@
 #include <tilck/kernel/kb.h>
 
 struct tty;
+struct term_scrollback_stats;
+struct term_mem_stats;
+
+/*
+ * Histogram of the latency between a keyboard IRQ and the read() returning
+ * the key to user space. Bucket N counts the latencies < (64 << N) us, the
+ * last one all the rest.
+ */
+#define TTY_INPUT_LAT_BUCKETS          12
+#define TTY_INPUT_LAT_UNIT_US          64
+
+struct tty_input_lat_stats {
+   u32 events;
+   u32 max_us;
+   u32 buckets[TTY_INPUT_LAT_BUCKETS];
+};
 
 static ALWAYS_INLINE struct tty *get_curr_tty(void)
 {
@@ -13,6 +29,9 @@ static ALWAYS_INLINE struct tty *get_curr_tty(void)
 }
 
 void tty_send_keyevent(struct tty *t, struct key_event ke, bool block);
+
+/* Bulk version of tty_send_keyevent() for plain chars, like serial input */
+void tty_send_input(struct tty *t, const char *buf, size_t len, bool block);
 void tty_setup_for_panic(struct tty *t);
 int tty_get_num(struct tty *t);
 void tty_restore_kd_text_mode(struct tty *t);
@@ -30,6 +49,9 @@ static inline int get_curr_tty_num(void)
 
 /* Used only by the debug panel */
 int set_curr_tty(struct tty *t);
+bool tty_get_scrollback_stats(int n, struct term_scrollback_stats *s);
+bool tty_get_mem_stats(int n, struct term_mem_stats *s);
+void tty_get_input_lat_stats(struct tty_input_lat_stats *s);
 struct tty *create_tty_nodev(void);
 void tty_set_raw_mode(struct tty *t);
 void tty_set_medium_raw_mode(struct tty *t, bool enabled);
@@ -34,12 +34,15 @@ struct tty {
    struct kcond input_cond;     /* signal when we can read from input_rb */
    struct kcond output_cond;    /* signal when we can write to input_rb */
    int end_line_delim_count;
+   u32 raw_wake_min;            /* raw mode: bytes the reader is waiting for */
+   u64 input_tsc;               /* IRQ's TSC of the oldest unread input */
 
    bool mediumraw_mode;
    u8 curr_color;
    u16 serial_port_fwd;
 
    char *input_buf;
+   u32 input_buf_size;
    u32 kd_gfx_mode;
    tty_ctrl_sig_func *ctrl_handlers;
    struct termios c_term;
@@ -3,12 +3,100 @@
 #pragma once
 #include <tilck/common/basic_defs.h>
 #include <tilck/kernel/hal_types.h>
+#include <tilck/kernel/errno.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+
+   #include <tilck/kernel/arch/generic_x86/user_access.h>
+
+#elif defined(__riscv)
+
+   #include <tilck/kernel/arch/riscv/user_access.h>
+
+#else
+
+   /* Unit tests on other archs: they never touch user memory */
+   #define DEFINE_ARCH_USER_ACCESS(n, type)                                \
+      static ALWAYS_INLINE int                                             \
+      arch_get_user_##n(ulong *val, const void *uptr)                      \
+      {                                                                    \
+         *val = *(const type *)uptr;                                       \
+         return 0;                                                         \
+      }                                                                    \
+                                                                           \
+      static ALWAYS_INLINE int                                             \
+      arch_put_user_##n(ulong val, void *uptr)                             \
+      {                                                                    \
+         *(type *)uptr = (type)val;                                        \
+         return 0;                                                         \
+      }
+
+   DEFINE_ARCH_USER_ACCESS(1, u8)
+   DEFINE_ARCH_USER_ACCESS(2, u16)
+   DEFINE_ARCH_USER_ACCESS(4, u32)
+   DEFINE_ARCH_USER_ACCESS(long, ulong)
+
+#endif
+
+struct elf_program_info; /* forward declaration */
 
 static inline bool user_out_of_range(const void *user_ptr, size_t n)
 {
    return ((ulong)user_ptr + n) > BASE_VA;
 }
 
+/*
+ * Read (write) a single value of 1, 2, 4 or sizeof(ulong) bytes from (to) the
+ * user pointer `ptr`. Return 0 in case of success and -EFAULT otherwise.
+ *
+ * Unlike copy_from_user() and copy_to_user() for small objects, they cost just
+ * a range check and a load (store): a fault is handled by jumping to a fixup
+ * code (see extable.h).
+ */
+#define get_user(x, ptr)                                                   \
+   ({                                                                      \
+      ulong __gu_val = 0;                                                  \
+      int __gu_rc = -EFAULT;                                               \
+      STATIC_ASSERT(sizeof(*(ptr)) <= sizeof(ulong));                      \
+                                                                           \
+      if (!user_out_of_range((ptr), sizeof(*(ptr)))) {                     \
+         switch (sizeof(*(ptr))) {                                         \
+            case 1: __gu_rc = arch_get_user_1(&__gu_val, (ptr)); break;    \
+            case 2: __gu_rc = arch_get_user_2(&__gu_val, (ptr)); break;    \
+            case 4: __gu_rc = arch_get_user_4(&__gu_val, (ptr)); break;    \
+            default: __gu_rc = arch_get_user_long(&__gu_val, (ptr));       \
+         }                                                                 \
+      }                                                                    \
+                                                                           \
+      (x) = (__typeof__(*(ptr)))__gu_val;                                  \
+      __gu_rc;                                                             \
+   })
+
+#define put_user(x, ptr)                                                   \
+   ({                                                                      \
+      const ulong __pu_val = (ulong)(__typeof__(*(ptr)))(x);               \
+      int __pu_rc = -EFAULT;                                               \
+      STATIC_ASSERT(sizeof(*(ptr)) <= sizeof(ulong));                      \
+                                                                           \
+      if (!user_out_of_range((ptr), sizeof(*(ptr)))) {                     \
+         switch (sizeof(*(ptr))) {                                         \
+            case 1: __pu_rc = arch_put_user_1(__pu_val, (ptr)); break;     \
+            case 2: __pu_rc = arch_put_user_2(__pu_val, (ptr)); break;     \
+            case 4: __pu_rc = arch_put_user_4(__pu_val, (ptr)); break;     \
+            default: __pu_rc = arch_put_user_long(__pu_val, (ptr));        \
+         }                                                                 \
+      }                                                                    \
+                                                                           \
+      __pu_rc;                                                             \
+   })
+
+/*
+ * Arch-specific memcpy() for user memory, with an exception table entry for
+ * each instruction accessing it. Returns the number of bytes NOT copied: 0 in
+ * case of success.
+ */
+ulong asm_copy_user(void *dest, const void *src, size_t n);
+
 int copy_from_user(void *dest, const void *user_ptr, size_t n);
 int copy_to_user(void *user_ptr, const void *src, size_t n);
 
@@ -17,30 +105,63 @@ int copy_str_from_user(void *dest,
                        size_t max_size,
                        size_t *written_ptr);
 
-int copy_str_array_from_user(void *dest,
-                             const char *const *argv,
-                             size_t max_size,
-                             size_t *written_ptr);
-
 int duplicate_user_path(char *dest,
                         const char *user_path,
                         size_t dest_size,
                         size_t *written_ptr /* IN/OUT */);
 
-int duplicate_user_argv(char *dest,
-                        const char *const *user_argv,
-                        size_t dest_size,
-                        size_t *written_ptr /* IN/OUT */);
+/*
+ * The argv and env strings of a program being executed. They're copied just
+ * once, from the caller's address space (or from the kernel), in a buffer of
+ * USER_ARGS_MAX_PAGES pages: the argv strings first, followed by the env ones.
+ * When the new image is loaded, the pages used get mapped directly at the top
+ * of its stack, while the others are freed. Below the strings, only the argv,
+ * env and aux vectors are written.
+ *
+ * Like on Linux, the pointers to the strings (and the final NULL ones) are
+ * accounted as well: strings and pointers together cannot exceed
+ * USER_ARGS_MAX_PAGES pages, otherwise we fail with -E2BIG.
+ */
+struct exec_args {
+
+   char *buf;
+   size_t size;         /* bytes used in `buf` by the strings */
+   size_t acc;          /* bytes accounted against the limit */
+   u32 argc;
+   u32 envc;
+   bool mapped;         /* `buf`'s pages now belong to the new pdir */
+};
 
+int exec_args_init(struct exec_args *a);
+void exec_args_destroy(struct exec_args *a);
 
+/* Appends the strings of `arr`. All the argv ones must go before the env. */
 int
+exec_args_add_arr(struct exec_args *a,
+                  const char *const *arr,
+                  bool user_arr,
+                  bool env);
+
+/* Replaces argv[0] with the `n` kernel strings `strs` (#! scripts) */
+int
+exec_args_replace_arg0(struct exec_args *a, const char *const *strs, u32 n);
+
+/* The number of pages used by the strings, mapped at the top of the stack */
+size_t exec_args_pages(const struct exec_args *a);
+
+/* The user vaddr of the strings (argv[0]) in the new image */
+ulong exec_args_user_vaddr(const struct exec_args *a);
+
+/* The size of the argv, env and aux vectors, pushed below the strings */
+size_t
+exec_args_vec_size(const struct exec_args *a,
+                   const struct elf_program_info *pinfo);
+
+void
 push_args_on_user_stack(regs_t *r,
-                        const char *const *argv,
-                        u32 argc,
-                        const char *const *env,
-                        u32 envc);
+                        const struct elf_program_info *pinfo,
+                        const struct exec_args *a);
 
 void push_on_stack(ulong **stack_ptr_ref, ulong val);
 void push_on_stack2(pdir_t *pdir, ulong **stack_ptr_ref, ulong val);
 void push_on_user_stack(regs_t *r, ulong val);
-void push_string_on_user_stack(regs_t *r, const char *str);
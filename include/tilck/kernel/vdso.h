@@ -1,10 +1,87 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
 #pragma once
+#include <tilck_gen_headers/config_mm.h>
+
+/*
+ * On i386, the vdso page is also an ELF image exporting __vdso_clock_gettime()
+ * and friends, passed to the user space through AT_SYSINFO_EHDR. It contains
+ * also __kernel_vsyscall, passed through AT_SYSINFO.
+ */
+#if defined(__i386__) && !defined(__x86_64__)
+   #define VDSO_HAS_ELF_IMAGE                1
+#else
+   #define VDSO_HAS_ELF_IMAGE                0
+#endif
+
+/*
+ * The vvar page: a read-only page, mapped in user space right after the vdso
+ * one, containing the data used by the vdso's time functions. It's updated
+ * by the kernel at every tick, using `seq` as a seqlock: odd values mean an
+ * update in progress. The offsets here below are used by vdso.S.
+ */
+#define USER_VVAR_VADDR              (USER_VDSO_VADDR + PAGE_SIZE)
+
+#define VDSO_DATA_SEQ_OFF                    0
+#define VDSO_DATA_TIME_NS_OFF                8
+#define VDSO_DATA_BOOT_TS_OFF               16
+#define VDSO_DATA_TZ_MINWEST_OFF            24
+#define VDSO_DATA_TZ_DSTTIME_OFF            28
+
+#ifndef ASM_FILE
+
 #include <tilck/common/basic_defs.h>
 
+struct vdso_data {
+
+   volatile u32 seq;
+   u32 unused;
+   u64 time_ns;                  /* same as __time_ns */
+   s64 boot_timestamp;           /* UNIX timestamp at the time_ns == 0 */
+   s32 tz_minuteswest;           /* as returned by gettimeofday() */
+   s32 tz_dsttime;
+};
+
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, seq) == VDSO_DATA_SEQ_OFF);
+STATIC_ASSERT(OFFSET_OF(struct vdso_data, time_ns) == VDSO_DATA_TIME_NS_OFF);
+STATIC_ASSERT(
+   OFFSET_OF(struct vdso_data, boot_timestamp) == VDSO_DATA_BOOT_TS_OFF
+);
+STATIC_ASSERT(
+   OFFSET_OF(struct vdso_data, tz_minuteswest) == VDSO_DATA_TZ_MINWEST_OFF
+);
+STATIC_ASSERT(
+   OFFSET_OF(struct vdso_data, tz_dsttime) == VDSO_DATA_TZ_DSTTIME_OFF
+);
+
+/* A whole page, because it gets mapped in user space */
+union vdso_data_page {
+   struct vdso_data data;
+   char raw[PAGE_SIZE];
+};
+
 extern const ulong vdso_begin;
 extern const ulong vdso_end;
 extern const ulong sysexit_user_code_user_vaddr;
 extern const ulong post_sig_handler_user_vaddr;
 extern const ulong pause_trampoline_user_vaddr;
+extern const ulong kernel_vsyscall_user_vaddr;
+extern union vdso_data_page vdso_data_page;
+
+/*
+ * Called with interrupts disabled. Tilck runs on a single CPU, so the only
+ * readers the seqlock has to care about are user tasks interrupted in the
+ * middle of a read: a compiler barrier is enough to order the writes.
+ */
+static ALWAYS_INLINE void vdso_update_time(u64 time_ns)
+{
+   struct vdso_data *d = &vdso_data_page.data;
+
+   d->seq++;
+   asmVolatile("" : : : "memory");
+   d->time_ns = time_ns;
+   asmVolatile("" : : : "memory");
+   d->seq++;
+}
+
+#endif
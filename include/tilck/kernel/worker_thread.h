@@ -2,12 +2,28 @@
 
 #pragma once
 #include <tilck/common/basic_defs.h>
+#include <tilck/kernel/timer.h>
 
 #define WTH_PRIO_HIGHEST            0
 #define WTH_PRIO_LOWEST           255
 
+/*
+ * Jobs by the number of ticks they waited in the queue before running:
+ * 0, 1, 2-3, 4-7, 8-15, ... and the last bucket for everything else.
+ */
+#define WTH_LATENCY_BUCKETS        10
+
 struct worker_thread;
 
+struct wth_stats {
+
+   u32 enqueued;
+   u32 dropped;               /* failed enqueues, because of a full queue */
+   u32 grows;                 /* times the queue has been made bigger */
+   u16 max_depth;             /* max number of jobs in the queue, at once */
+   u32 latency[WTH_LATENCY_BUCKETS];
+};
+
 void
 init_worker_threads();
 
@@ -17,12 +33,25 @@ wth_get_task(struct worker_thread *wth);
 u32
 wth_get_queue_size(struct worker_thread *wth);
 
+/* Jobs in the queue, not counting the one running */
+u32
+wth_get_pending_jobs(struct worker_thread *wth);
+
 int
 wth_get_priority(struct worker_thread *wth);
 
 const char *
 wth_get_name(struct worker_thread *wth);
 
+const struct wth_stats *
+wth_get_stats(struct worker_thread *wth);
+
+int
+wth_get_count(void);
+
+struct worker_thread *
+wth_get_by_index(int index);
+
 struct task *
 wth_get_runnable_thread(void);
 
@@ -40,3 +69,37 @@ wth_enqueue_anywhere(int lowest_prio, void (*func)(void *), void *arg);
 
 void
 wth_wait_for_completion(struct worker_thread *wth);
+
+/*
+ * Delayed jobs: `func` is enqueued on the worker thread after a given number
+ * of ticks, using a ktimer. The object is owned by the caller and can be
+ * re-armed at any time, even by `func` itself: the new delay replaces the old
+ * one (if still pending). That's what periodic kernel activities (cursor
+ * blinking, banner refresh etc.) should use instead of a dedicated kthread
+ * sleeping in a loop. By default, the jobs run on the lowest-priority generic
+ * worker thread, with preemption enabled: they're allowed to sleep.
+ */
+struct wth_delayed_job {
+
+   struct ktimer timer;
+   struct worker_thread *wth;
+   void (*func)(void *);
+   void *arg;
+};
+
+/*
+ * `wth` can be NULL: use the default worker for delayed jobs, chosen when the
+ * timer fires. Therefore, delayed jobs can be armed during the early boot,
+ * before init_worker_threads().
+ */
+void
+wth_delayed_job_init(struct wth_delayed_job *dj,
+                     struct worker_thread *wth,
+                     void (*func)(void *),
+                     void *arg);
+
+void
+wth_enqueue_delayed(struct wth_delayed_job *dj, u64 ticks);
+
+void
+wth_cancel_delayed(struct wth_delayed_job *dj);
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Pool of pre-zeroed pages, refilled by the idle task with non-temporal
+ * stores (not polluting the cache with zeros). The page faults on anonymous
+ * memory take their pages from here in O(1), falling back to kmalloc() +
+ * bzero() only when the pool is empty. The target size of the pool, in pages,
+ * is set with -zero_pool (0 disables the pool).
+ */
+
+void *zpool_alloc_page(void);
+void zpool_refill(void);
+u32 zpool_get_count(void);
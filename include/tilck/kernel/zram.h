@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/paging.h>
+
+/*
+ * Compressed swap in RAM (ZRAM_SWAP). When the free memory is low, the cold
+ * anonymous user pages (not accessed since the previous scan, see their
+ * accessed bit) are compressed with LZ4 into a dedicated pool and their PTEs
+ * are replaced with swap entries, pointing to a zram slot. The pages are
+ * decompressed back on the first access, in the page fault handler.
+ *
+ * The slots are reference-counted because the swap entries, like any other
+ * PTE, get copied when a page table shared after fork() gets unshared.
+ */
+
+/* Pages compressing to more than that are not worth storing */
+#define ZRAM_MAX_OBJ_SIZE                      (PAGE_SIZE * 3 / 4)
+
+struct zram_stats {
+
+   size_t slots;              /* max number of pages stored at once */
+   size_t stored;             /* pages stored right now */
+   size_t compr_bytes;        /* their size, compressed */
+   size_t pool_pages;         /* pages used by the pool for that */
+   size_t max_pool_pages;
+
+   u64 swap_outs;
+   u64 swap_ins;
+   u64 rejected;              /* pages not compressing well enough */
+   u64 scans;                 /* reclaim passes over all the processes */
+};
+
+void init_zram(void);
+void zram_get_stats(struct zram_stats *s);
+
+/*
+ * Compresses the page at `page` into a new slot. Returns the slot number or
+ * -E2BIG if the page doesn't compress well and -ENOMEM if the pool or the
+ * slot table is full.
+ */
+int zram_store(void *page);
+
+/* Decompresses the content of `slot` at `page` and drops a slot reference */
+void zram_load_and_put(u32 slot, void *page);
+
+void zram_slot_get(u32 slot);
+void zram_slot_put(u32 slot);
+
+/*
+ * Arch interface. pdir_reclaim_cold_pages() walks the private page tables of
+ * `pdir` clearing the accessed bit of the swappable pages and swapping out
+ * the ones on which the bit was already clear, up to `max` pages. Returns the
+ * number of pages swapped out. handle_potential_swap_in() handles the faults
+ * on swap entries.
+ */
+size_t pdir_reclaim_cold_pages(pdir_t *pdir, size_t max);
+bool handle_potential_swap_in(void *r);
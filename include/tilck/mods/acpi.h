@@ -35,9 +35,45 @@ void acpi_set_root_pointer(ulong);
 
 #endif
 
+/* Stats of the OS services layer. Latencies are in TSC cycles */
+struct acpi_osl_stats {
+
+   u32 sci_count;
+   u32 notify_queued;            /* notify jobs run by the events worker */
+   u32 notify_inline;            /* notify jobs run in the caller's context */
+   u32 sci_notify_count;         /* notify jobs caused by an SCI */
+   u64 sci_notify_lat_tot;       /* SCI -> notify job start */
+   u64 sci_notify_lat_max;
+};
+
+void acpi_get_osl_stats(struct acpi_osl_stats *s);
+
 enum tristate acpi_is_8042_present(void);
 enum tristate acpi_is_vga_text_mode_avail(void);
 
+#define ACPI_MADT_MAX_LAPIC_IDS  32
+
+/* Processors and interrupt controllers, as described by the MADT */
+struct acpi_madt_info {
+
+   u32 lapic_paddr;              /* physical address of the local APICs */
+   u16 cpus;                     /* usable processors, the boot one included */
+   u16 online_capable_cpus;      /* processors that can be enabled later */
+   u16 ioapics;
+   bool has_8259;                /* dual 8259 PICs are present as well */
+
+   u16 lapic_ids_count;
+   u8 lapic_ids[ACPI_MADT_MAX_LAPIC_IDS];  /* xAPIC ids of the usable CPUs */
+
+   u32 ioapic_paddr;             /* the I/O APIC starting at GSI 0, if any */
+   u32 isa_irq_gsi[16];          /* ISA IRQ -> GSI, after the overrides */
+   u16 isa_irq_level_mask;       /* level-triggered ISA IRQs */
+   u16 isa_irq_low_mask;         /* active-low ISA IRQs */
+};
+
+/* Returns NULL if there's no MADT or it hasn't been read yet */
+const struct acpi_madt_info *acpi_get_madt_info(void);
+
 typedef u32 (*acpi_reg_callback)(void *);
 
 struct acpi_reg_callback_node {
@@ -63,6 +99,13 @@ void acpi_reg_on_subsys_enabled_cb(struct acpi_reg_callback_node *node);
  */
 void acpi_reg_on_full_init_cb(struct acpi_reg_callback_node *node);
 
+/*
+ * Register a callback that will be called every time a battery notifies a
+ * change of its status (e.g. charging <-> discharging). It runs in the ACPI's
+ * notify context: it must not block and shall just defer the actual work.
+ */
+void acpi_reg_on_battery_notify_cb(struct acpi_reg_callback_node *node);
+
 
 typedef u32 (*acpi_per_object_callback)(void *obj_handle,
                                         void *device_info,
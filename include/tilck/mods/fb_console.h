@@ -14,8 +14,9 @@ static ALWAYS_INLINE bool use_framebuffer(void)
 void set_framebuffer_info_from_mbi(multiboot_info_t *mbi);
 void init_fb_console(void);
 
-// Debug/devel function
+// Debug/devel functions
 void debug_dump_glyph(u32 n);
+void fb_run_benchmarks(void);
 
 // Runtime debug info funcs [debugpanel]
 
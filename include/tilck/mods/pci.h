@@ -29,6 +29,41 @@
 
 #define PCI_SUBCLASS_PCI_BRIDGE          0x04
 
+/* Offsets in the configuration space of a (header type 0) PCI device */
+#define PCI_CONF_COMMAND                 0x04
+#define PCI_CONF_STATUS                  0x06
+#define PCI_CONF_BAR0                    0x10
+#define PCI_CONF_CAP_PTR                 0x34
+#define PCI_CONF_IRQ_LINE                0x3c
+
+/* Bits of the command register */
+#define PCI_CMD_IO_SPACE                 (1 << 0)
+#define PCI_CMD_MEM_SPACE                (1 << 1)
+#define PCI_CMD_BUS_MASTER               (1 << 2)
+#define PCI_CMD_INTX_DISABLE             (1 << 10)
+
+/* Bits of the status register */
+#define PCI_STATUS_CAP_LIST              (1 << 4)
+
+/* Capability IDs */
+#define PCI_CAP_ID_MSI                   0x05
+#define PCI_CAP_ID_MSIX                  0x11
+
+/* BARs: bit 0 is 1 for I/O space BARs */
+#define PCI_BAR_IO                       (1 << 0)
+#define PCI_BAR_IO_MASK                  (~0x3u)
+#define PCI_BAR_MEM_64                   (1 << 2)
+#define PCI_BAR_MEM_MASK                 (~0xfu)
+
+/* Flags for pci_alloc_irq_vectors() */
+#define PCI_IRQ_MSI                      (1 << 0)
+#define PCI_IRQ_MSIX                     (1 << 1)
+
+#define PCI_MAX_IRQ_VECTORS              8
+
+#define PCI_BARS_COUNT                   6
+#define PCI_MAX_CACHED_CAPS              16
+
 
 struct pci_vendor {
    u16 vendor_id;
@@ -94,6 +129,11 @@ struct pci_device_basic_info {
    };
 };
 
+struct pci_cap {
+   u8 id;
+   u8 off;                    /* offset in the config space */
+};
+
 /*
  * PCI leaf node: a PCI device function.
  *
@@ -107,6 +147,25 @@ struct pci_device {
    struct pci_device_loc loc;
    struct pci_device_basic_info nfo;
    void *ext_config;
+
+   /*
+    * Cached at discovery time, in order to spare the (slow) config cycles:
+    * the BARs and the IRQ line are the ones assigned by the firmware. Bridges
+    * (header type 1) have only the first 2 BARs, the others are 0.
+    */
+   u32 bars[PCI_BARS_COUNT];
+   u8 irq_line;
+   u8 caps_count;
+   struct pci_cap caps[PCI_MAX_CACHED_CAPS];
+
+   u8 msi_cap;                /* config offset of the MSI cap, 0 if none */
+   u8 msix_cap;               /* config offset of the MSI-X cap, 0 if none */
+   bool msix_enabled;
+   u8 irqs_count;             /* MSI or MSI-X vectors allocated */
+   u8 irqs[PCI_MAX_IRQ_VECTORS];
+
+   volatile u32 *msix_table;  /* mapped only while MSI-X is enabled */
+   size_t msix_table_map_size;
 };
 
 static ALWAYS_INLINE struct pci_device_loc
@@ -142,3 +201,46 @@ pci_config_write(struct pci_device_loc loc, u32 off, u32 width, u32 val)
 
 struct pci_device *
 pci_get_object(struct pci_device_loc loc);
+
+struct pci_device *
+pci_find_device(u16 vendor_id, u16 device_id, struct pci_device *prev);
+
+struct pci_device *
+pci_find_device_by_class(u8 class_id, u8 subclass_id, struct pci_device *prev);
+
+/* Returns the offset of the capability `id` in the config space, or 0 */
+static inline u8
+pci_find_cap(struct pci_device *dev, u8 id)
+{
+   for (u32 i = 0; i < dev->caps_count; i++)
+      if (dev->caps[i].id == id)
+         return dev->caps[i].off;
+
+   return 0;
+}
+
+/* Returns the physical address of the memory BAR `bar` (using the cache) */
+int
+pci_get_bar_paddr(struct pci_device *dev, u32 bar, u64 *paddr);
+
+/*
+ * Allocates between `min` and `max` MSI-X or MSI vectors (as allowed by
+ * `flags`) for `dev`, preferring MSI-X, and enables them. Returns the number
+ * of vectors allocated or a negative errno value. Each vector has its own
+ * IRQ number: see pci_irq_vector(). Note: MSI delivery requires the device
+ * to be a bus master (PCI_CMD_BUS_MASTER), as the messages are memory writes.
+ */
+int
+pci_alloc_irq_vectors(struct pci_device *dev, u32 min, u32 max, u32 flags);
+
+/* Returns the IRQ number of the vector `n`, for irq_install_handler() */
+static inline u8
+pci_irq_vector(struct pci_device *dev, u32 n)
+{
+   ASSERT(n < dev->irqs_count);
+   return dev->irqs[n];
+}
+
+/* The handlers must be uninstalled before calling this */
+void
+pci_free_irq_vectors(struct pci_device *dev);
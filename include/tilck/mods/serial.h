@@ -14,6 +14,24 @@ bool serial_write_ready(u16 port);
 void serial_wait_for_write(u16 port);
 void serial_write(u16 port, char c);
 
+/*
+ * Interrupt-driven TX support. When serial_tx_intr_supported() returns true,
+ * serial_set_tx_intr() enables or disables the "TX holding register empty"
+ * interrupt and, once serial_write_ready() returned true, serial_tx_fifo_write()
+ * can be called up to SERIAL_TX_FIFO_SIZE times without waiting.
+ */
+#define SERIAL_TX_FIFO_SIZE                    16
+
+bool serial_tx_intr_supported(void);
+void serial_set_tx_intr(u16 port, bool enabled);
+void serial_tx_fifo_write(u16 port, char c);
+
+/*
+ * Buffered write: the data is queued in the port's TX ring buffer and sent
+ * by the TX interrupt handler. Blocks only when the ring is full.
+ */
+void serial_tx_write(u16 port, const char *buf, size_t len);
+
 #if MOD_serial
    void early_init_serial_ports(void);
 #else
@@ -57,6 +57,13 @@ struct sysobj_prop_type {
     * At the moment, that is supported only when get_buf_sz() returns < 0.
     */
    void *(*get_data_ptr)(struct sysobj *obj, void *data);
+
+   /*
+    * Get the value of a numeric property, without formatting it as text.
+    * Optional: the properties supporting it are included in the binary
+    * snapshot of their sysobj (see tilck_sysfs.h).
+    */
+   u64 (*get_num)(struct sysobj *obj, void *data);
 };
 
 struct sysobj_prop {
@@ -287,6 +294,17 @@ sysfs_symlink_obj(struct mnt_fs *fs,
                   const char *new_name,
                   struct sysobj *obj);
 
+/*
+ * Notify the readers of the property `prop` of `obj` that its value changed,
+ * or of all of its properties when `prop` is NULL. Processes poll()-ing the
+ * property's file get POLLPRI | POLLERR, until they read it again from offset
+ * 0 (typically, after a seek). Cheap and callable with preemption disabled,
+ * but not from IRQ handlers.
+ */
+
+void
+sysfs_notify(struct sysobj *obj, struct sysobj_prop *prop);
+
 /*
  * Create and initialize Tilck's main sysfs instance, /syst.
  */
@@ -117,8 +117,10 @@ extern const struct sysobj_prop_type sysobj_ptype_ro_ulong_literal;
 extern const struct sysobj_prop_type sysobj_ptype_ro_ulong_hex_literal;
 extern const struct sysobj_prop_type sysobj_ptype_ulong;
 extern const struct sysobj_prop_type sysobj_ptype_ro_ulong;
+extern const struct sysobj_prop_type sysobj_ptype_rw_ulong;
 extern const struct sysobj_prop_type sysobj_ptype_long;
 extern const struct sysobj_prop_type sysobj_ptype_ro_long;
+extern const struct sysobj_prop_type sysobj_ptype_rw_long;
 extern const struct sysobj_prop_type sysobj_ptype_rw_bool;
 extern const struct sysobj_prop_type sysobj_ptype_ro_bool;
 extern const struct sysobj_prop_type sysobj_ptype_rw_config_str;
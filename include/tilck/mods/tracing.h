@@ -4,6 +4,7 @@
 #include <tilck_gen_headers/mod_tracing.h>
 #include <tilck/common/basic_defs.h>
 #include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/static_key.h>
 
 #define INVALID_SYSCALL           ((u32) -1)
 #define NO_SLOT                           -1
@@ -17,6 +18,41 @@ enum trace_event_type {
    te_printk,
    te_signal_delivered,
    te_killed,
+   te_tracepoint,
+};
+
+/*
+ * Static tracepoints. When disabled, each one costs a load, a test and a
+ * not-taken branch. When enabled, it writes a te_tracepoint event in the same
+ * ring of the syscall events, for any task. They are enabled at runtime, by
+ * name, in /syst/tracing/tracepoints.
+ */
+enum tracepoint {
+   tp_sched_switch,     /* prev tid, next tid, prev state */
+   tp_sched_wakeup,     /* woken tid */
+   tp_page_fault,       /* vaddr, ip, write */
+   tp_irq_entry,        /* irq */
+   tp_irq_exit,         /* irq */
+   tp_kmalloc,          /* ptr, size, flags */
+   tp_kfree,            /* ptr, size, flags */
+   tp_vfs_op,           /* enum tp_vfs_op, handle, retval */
+
+   TP_COUNT,
+};
+
+enum tp_vfs_op {
+   tp_vfs_open,
+   tp_vfs_close,
+   tp_vfs_read,
+   tp_vfs_write,
+   tp_vfs_pread,
+   tp_vfs_pwrite,
+};
+
+struct tracepoint_info {
+   const char *name;
+   const char *args[3];    /* NULL for the unused args */
+   u32 hex_args;           /* bit i set: args[i] is better shown in hex */
 };
 
 struct syscall_event_data {
@@ -53,6 +89,13 @@ struct signal_event_data {
    int signum;
 };
 
+struct tp_event_data {
+   u32 tp;           /* enum tracepoint */
+   u32 __unused_0;
+   u64 tsc;          /* finer than sys_time, for the latencies */
+   ulong args[3];
+};
+
 struct trace_event {
 
    enum trace_event_type type;
@@ -64,6 +107,7 @@ struct trace_event {
       struct syscall_event_data sys_ev;
       struct printk_event_data p_ev;
       struct signal_event_data sig_ev;
+      struct tp_event_data tp_ev;
    };
 };
 
@@ -150,6 +194,43 @@ struct syscall_info {
    struct sys_param_info params[6];
 };
 
+/*
+ * Always-on per-syscall stats. Bucket `b` of `lat` counts the calls that took
+ * [2^(b-1), 2^b) * SYS_LAT_UNIT TSC cycles, with the last bucket counting all
+ * the slower ones too.
+ */
+#define SYS_LAT_BUCKETS                  16
+#define SYS_LAT_UNIT_SHIFT               10   /* 1024 cycles */
+
+struct syscall_stats {
+   u32 calls;
+   u32 errors;
+   u32 lat[SYS_LAT_BUCKETS];
+};
+
+void
+tracing_account_syscall(u32 sys, long retval, u64 start);
+
+const struct syscall_stats *
+tracing_get_syscall_stats(u32 sys);
+
+/*
+ * Sampling profiler: on every timer tick, it records the interrupted IP plus,
+ * for the kernel code, a short frame-pointer stack. Controlled through sysfs,
+ * in /syst/tracing/profiler.
+ */
+#define PROF_MAX_SAMPLES               2048
+#define PROF_MAX_FRAMES                   8
+
+void
+profiler_tick(regs_t *r);
+
+int
+profiler_start(void);
+
+void
+profiler_stop(void);
+
 void
 init_tracing(void);
 
@@ -173,6 +254,7 @@ trace_syscall_enter_int(u32 sys,
 void
 trace_syscall_exit_int(u32 sys,
                        long retval,
+                       u64 start,
                        ulong a1,
                        ulong a2,
                        ulong a3,
@@ -192,6 +274,21 @@ trace_signal_delivered_int(int target_tid, int signum);
 void
 trace_task_killed_int(int signum);
 
+void
+tracepoint_int(enum tracepoint tp, ulong a0, ulong a1, ulong a2);
+
+const struct tracepoint_info *
+tracepoint_get_info(u32 tp);
+
+const char *
+tracepoint_get_vfs_op_name(u32 op);
+
+u32
+tracepoints_get_enabled_mask(void);
+
+void
+tracepoints_set_enabled_mask(u32 mask);
+
 const char *
 tracing_get_syscall_name(u32 n);
 
@@ -229,6 +326,19 @@ set_traced_syscalls(const char *str);
 int
 tracing_get_in_buffer_events_count(void);
 
+/*
+ * The size of the used part of `e`: the rest of the struct is zero, for the
+ * readers of the event.
+ */
+size_t
+tracing_get_event_size(const struct trace_event *e);
+
+size_t
+tracing_get_buf_size(void);
+
+int
+tracing_set_buf_size(size_t size);
+
 extern const struct syscall_info *tracing_metadata;
 extern const struct sys_param_type ptype_int;
 extern const struct sys_param_type ptype_voidp;
@@ -258,25 +368,70 @@ tracing_is_enabled_on_sys(u32 sys_n)
    return traced_syscalls[sys_n];
 }
 
+/*
+ * Kernel-side filter on the syscall events, configured in /syst/tracing/filter
+ * and applied before saving any parameter:
+ *
+ *    pid:           trace only the task with this tid or the threads of the
+ *                   process with this pid (0: any traced task)
+ *
+ *    errors_only:   trace only the syscalls failing with an error
+ *
+ *    min_lat_us:    trace only the syscalls lasting at least this long
+ *
+ * The last two can be checked only when the syscall returns: when any of them
+ * is set, no syscall is traced as an enter + exit pair and the exit event has
+ * all the parameters, not just the output ones.
+ */
+static ALWAYS_INLINE bool
+tracing_filter_on_exit(void)
+{
+   extern bool __tracing_filter_errors_only;
+   extern ulong __tracing_filter_min_lat_us;
+   return __tracing_filter_errors_only || __tracing_filter_min_lat_us;
+}
+
 static ALWAYS_INLINE bool
 exp_block(const struct syscall_info *si)
 {
    extern bool __force_exp_block;
+
+   if (tracing_filter_on_exit())
+      return false;
+
    return __force_exp_block || si->exp_block;
 }
 
+/*
+ * A static key: checked at every syscall, while the tracing is almost always
+ * disabled. See static_key.h.
+ */
 static ALWAYS_INLINE void
 tracing_set_enabled(bool val)
 {
-   extern bool __tracing_on;
-   __tracing_on = val;
+   extern struct static_key __tracing_on;
+   static_key_set(&__tracing_on, val);
 }
 
 static ALWAYS_INLINE bool
 tracing_is_enabled(void)
 {
-   extern bool __tracing_on;
-   return __tracing_on;
+   extern struct static_key __tracing_on;
+   return static_branch_unlikely(&__tracing_on);
+}
+
+static ALWAYS_INLINE bool
+tracepoint_is_enabled(enum tracepoint tp)
+{
+   extern u32 __tracepoints_mask;
+   return __tracepoints_mask & (1u << tp);
+}
+
+static ALWAYS_INLINE bool
+profiler_is_enabled(void)
+{
+   extern bool __profiler_on;
+   return __profiler_on;
 }
 
 static ALWAYS_INLINE bool
@@ -335,11 +490,28 @@ tracing_set_printk_lvl(int lvl)
             trace_syscall_enter_int(sn, __VA_ARGS__);                          \
    }
 
-#define trace_sys_exit(sn, ret, ...)                                           \
+#define trace_sys_exit(sn, ret, start, ...)                                    \
    if (MOD_tracing && UNLIKELY(tracing_is_enabled())) {                        \
       if (UNLIKELY(get_curr_task()->traced))                                   \
          if (UNLIKELY(tracing_is_enabled_on_sys(sn)))                          \
-            trace_syscall_exit_int(sn, (long)(ret), __VA_ARGS__);              \
+            trace_syscall_exit_int(sn, (long)(ret), (start), __VA_ARGS__);     \
+   }
+
+/*
+ * Unlike trace_sys_enter() and trace_sys_exit(), these are always enabled:
+ * they don't save anything but the TSC at the beginning of the syscall.
+ */
+#define trace_sys_stats_begin()                                                \
+   (MOD_tracing ? RDTSC() : 0)
+
+#define trace_sys_stats_end(sn, ret, start)                                    \
+   if (MOD_tracing) {                                                          \
+      tracing_account_syscall(sn, (long)(ret), start);                         \
+   }
+
+#define trace_profiler_tick(regs)                                              \
+   if (MOD_tracing && UNLIKELY(profiler_is_enabled())) {                       \
+      profiler_tick(regs);                                                     \
    }
 
 #define trace_printk(lvl, fmt, ...)                                            \
@@ -362,3 +534,8 @@ tracing_set_printk_lvl(int lvl)
    if (MOD_tracing && UNLIKELY(tracing_is_enabled())) {                        \
       trace_task_killed_int(signum);                                           \
    }
+
+#define trace_point(tp, a0, a1, a2)                                            \
+   if (MOD_tracing && UNLIKELY(tracepoint_is_enabled(tp))) {                   \
+      tracepoint_int((tp), (ulong)(a0), (ulong)(a1), (ulong)(a2));             \
+   }
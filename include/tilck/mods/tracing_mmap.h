@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+#include <tilck/mods/tracing.h>
+
+/*
+ * Binary trace export: /dev/tracebuf can be mmap-ed by user space, which gets
+ * a control page followed by TRACE_MMAP_DATA_SIZE bytes of data, like the
+ * perf ring buffers. The kernel is the only producer and never waits for the
+ * consumer: it drops the records not fitting in the free space, counting them
+ * in `lost`.
+ *
+ * The consumer reads `data_head` (acquire), parses the records in the range
+ * [data_tail, data_head) of the data, wrapping at `data_size`, and then stores
+ * the new `data_tail` (release). Both the indexes are free-running byte
+ * counters: only their value modulo `data_size` is an offset in the data.
+ */
+
+#define TRACE_MMAP_MAGIC                              0x464d5254 /* TRMF */
+#define TRACE_MMAP_VERSION                                     1
+#define TRACE_MMAP_DATA_SIZE                           (128 * KB)
+
+enum trace_rec_type {
+   TRACE_REC_EVENT = 1,    /* payload: a struct trace_event (maybe truncated) */
+   TRACE_REC_PAD   = 2,    /* no payload: skip to the beginning of the data */
+};
+
+struct trace_rec_hdr {
+   u16 type;               /* enum trace_rec_type */
+   u16 size;               /* size of the record, this header included */
+   u32 __reserved;
+};
+
+/*
+ * Records are aligned at 8 bytes and never cross the end of the data: when a
+ * record does not fit there, a TRACE_REC_PAD one fills the rest.
+ */
+#define TRACE_REC_ALIGN                                        8
+
+struct trace_mmap_page {
+
+   u32 magic;
+   u32 version;
+   u32 data_offset;              /* offset of the data from the mapping */
+   u32 data_size;                /* power of 2 */
+
+   ATOMIC(u32) data_head;        /* written by the kernel */
+   ATOMIC(u32) data_tail;        /* written by the consumer */
+   ATOMIC(u32) lost;             /* written by the kernel */
+};
+
+void trace_mmap_write_event(const struct trace_event *e);
+void init_trace_mmap(void);
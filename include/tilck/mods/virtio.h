@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
+
+/*
+ * Definitions shared by the virtio PCI drivers. Only the legacy interface
+ * (transitional devices) is supported: the registers are in the I/O space
+ * pointed by BAR0 and each virtqueue is a single, physically contiguous, ring.
+ */
+
+#define VIRTIO_PCI_VENDOR_ID             0x1af4
+
+/* Legacy virtio PCI registers: offsets from BAR0, in the I/O space */
+#define VIRTIO_REG_DEV_FEATURES            0x00
+#define VIRTIO_REG_DRV_FEATURES            0x04
+#define VIRTIO_REG_QUEUE_PFN               0x08
+#define VIRTIO_REG_QUEUE_SIZE              0x0c
+#define VIRTIO_REG_QUEUE_SEL               0x0e
+#define VIRTIO_REG_QUEUE_NOTIFY            0x10
+#define VIRTIO_REG_STATUS                  0x12
+#define VIRTIO_REG_ISR                     0x13
+#define VIRTIO_REG_DEV_CONFIG              0x14   /* MSI-X disabled */
+
+/* Present only when MSI-X is enabled: the device config moves after them */
+#define VIRTIO_REG_MSI_CONFIG_VECTOR       0x14
+#define VIRTIO_REG_MSI_QUEUE_VECTOR        0x16
+#define VIRTIO_REG_DEV_CONFIG_MSIX         0x18
+#define VIRTIO_MSI_NO_VECTOR             0xffff
+
+#define VIRTIO_STATUS_ACK                (1 << 0)
+#define VIRTIO_STATUS_DRIVER             (1 << 1)
+#define VIRTIO_STATUS_DRIVER_OK          (1 << 2)
+#define VIRTIO_STATUS_FAILED             (1 << 7)
+
+#define VIRTIO_ISR_QUEUE                 (1 << 0)
+
+#define VRING_DESC_F_NEXT                     1
+#define VRING_DESC_F_WRITE                    2
+#define VRING_LEGACY_ALIGN                 4096
+
+/* The legacy interface takes the ring's PFN in a 32-bit register */
+#define VRING_LEGACY_DMA_MASK            ((1ull << (32 + PAGE_SHIFT)) - 1)
+
+struct vring_desc {
+   u64 addr;
+   u32 len;
+   u16 flags;
+   u16 next;
+};
+
+struct vring_avail {
+   u16 flags;
+   u16 idx;
+   u16 ring[];
+};
+
+struct vring_used_elem {
+   u32 id;
+   u32 len;
+};
+
+struct vring_used {
+   u16 flags;
+   u16 idx;
+   struct vring_used_elem ring[];
+};
+
+/* Legacy layout: descriptors, avail ring, then the aligned used ring */
+static inline size_t vring_legacy_used_off(u16 qsize)
+{
+   const size_t avail_end =
+      sizeof(struct vring_desc) * qsize + 2 * (3 + (size_t)qsize);
+
+   return pow2_round_up_at(avail_end, VRING_LEGACY_ALIGN);
+}
+
+static inline size_t vring_legacy_size(u16 qsize)
+{
+   return vring_legacy_used_off(qsize) +
+          pow2_round_up_at(6 + sizeof(struct vring_used_elem) * qsize,
+                           VRING_LEGACY_ALIGN);
+}
+
+/*
+ * On x86, writes are not reordered with other writes, and reads with other
+ * reads: preventing the compiler from reordering them is enough, when sharing
+ * memory with the device.
+ */
+static ALWAYS_INLINE void virtio_barrier(void)
+{
+   asmVolatile("" ::: "memory");
+}
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_acpi.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/mods/acpi.h>
+
+#include "apic.h"
+#include "lapic.h"
+#include "ioapic.h"
+#include "pit.h"
+
+/*
+ * When true, the ISA IRQs go through the I/O APIC and IRQ 0 is the LAPIC
+ * timer, instead of the PIT. Otherwise, we use the legacy PIC + PIT.
+ */
+bool x86_apic_mode;
+
+static u32 isa_irq_gsi[16];
+
+/*
+ * Routes the ISA IRQs through the I/O APIC, to the same vectors used with
+ * the PIC, as described by the ACPI MADT. Returns false if that's not
+ * possible: in that case, the PIC must be used.
+ */
+bool init_apic_irq_routing(void)
+{
+   const struct acpi_madt_info *madt = NULL;
+   u16 bit;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (kopt_noapic)
+      return false;
+
+   if (MOD_acpi && get_acpi_init_status() >= ais_tables_initialized)
+      madt = acpi_get_madt_info();
+
+   if (!madt || !madt->ioapic_paddr)
+      return false;
+
+   if (!init_lapic() || !init_ioapic(madt->ioapic_paddr))
+      return false;
+
+   for (int irq = 1; irq < 16; irq++) {
+
+      if (irq == 2)
+         continue; /* The PIC cascade: no device there */
+
+      bit = (u16)(1u << irq);
+      isa_irq_gsi[irq] = madt->isa_irq_gsi[irq];
+
+      ioapic_route(isa_irq_gsi[irq],
+                   (u8)(32 + irq),
+                   !!(madt->isa_irq_level_mask & bit),
+                   !!(madt->isa_irq_low_mask & bit));
+   }
+
+   x86_apic_mode = true;
+   printk("IRQ: using the LAPIC and the I/O APIC\n");
+   return true;
+}
+
+void apic_irq_set_mask(int irq)
+{
+   ASSERT(IN_RANGE(irq, 0, 16));
+
+   if (irq == X86_PC_TIMER_IRQ)
+      lapic_timer_set_masked(true);
+   else if (irq != 2)
+      ioapic_set_masked(isa_irq_gsi[irq], true);
+}
+
+void apic_irq_clear_mask(int irq)
+{
+   ASSERT(IN_RANGE(irq, 0, 16));
+
+   if (irq == X86_PC_TIMER_IRQ)
+      lapic_timer_set_masked(false);
+   else if (irq != 2)
+      ioapic_set_masked(isa_irq_gsi[irq], false);
+}
+
+bool apic_irq_is_masked(int irq)
+{
+   ASSERT(IN_RANGE(irq, 0, 16));
+
+   if (irq == X86_PC_TIMER_IRQ)
+      return lapic_timer_is_masked();
+
+   return irq == 2 || ioapic_is_masked(isa_irq_gsi[irq]);
+}
+
+/*
+ * Hardware timer interface (see kernel/timer.c): the LAPIC timer in APIC
+ * mode, the PIT otherwise.
+ */
+
+u32 hw_timer_setup(u32 interval)
+{
+   if (x86_apic_mode)
+      return lapic_timer_setup(interval);
+
+   return pit_timer_setup(interval);
+}
+
+u32 hw_timer_stop_tick(u32 max_ticks, u32 *phase)
+{
+   if (x86_apic_mode)
+      return lapic_timer_stop_tick(max_ticks, phase);
+
+   return pit_stop_tick(max_ticks, phase);
+}
+
+u64 hw_timer_restart_tick(bool *expired)
+{
+   if (x86_apic_mode)
+      return lapic_timer_restart_tick(expired);
+
+   return pit_restart_tick(expired);
+}
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+extern bool x86_apic_mode;
+
+bool init_apic_irq_routing(void);
+void apic_irq_set_mask(int irq);
+void apic_irq_clear_mask(int irq);
+bool apic_irq_is_masked(int irq);
@@ -22,14 +22,14 @@ static void handle_no_coproc_fault(regs_t *r);
 #define CPU_FXSAVE_AREA_SIZE   512
 
 /*
- * NOTE: calculating the exact area save area for XSAVE is tricky since it
- * depends on the features currently supported by the CPU (it is necessary
- * to iterate with CPUID calls to do the right calculation). For the moment,
- * just using a large buffer is a good-enough solution.
- *
- * TODO (future): calculate the exact size for the XSAVE area.
+ * Upper limit for the XSAVE area. Its actual size depends on the state
+ * components enabled in XCR0 and it's read from CPUID[0xd].EBX right after
+ * enabling AVX. With x87, SSE and AVX enabled (what Tilck does) that's just
+ * 832 bytes, so there's no point in allocating the max size for each task.
  */
-#define CPU_XSAVE_AREA_SIZE   8192
+#define CPU_XSAVE_AREA_MAX_SIZE   8192
+
+static u32 xsave_area_size = CPU_XSAVE_AREA_MAX_SIZE;
 
 static bool enable_sse(void)
 {
@@ -102,6 +102,16 @@ static bool enable_avx(void)
       return false;
    }
 
+   /* Now that XCR0 is set, get the size of the XSAVE area for its features */
+   u32 a, b, c, d;
+   cpuid_count(0xd, 0, &a, &b, &c, &d);
+
+   if (!b || b > CPU_XSAVE_AREA_MAX_SIZE) {
+      printk("CPU: Unexpected XSAVE area size: %u\n", b);
+      return false;
+   }
+
+   xsave_area_size = b;
    x86_cpu_features.can_use_avx = true;
 
    if (x86_cpu_features.avx2) {
@@ -111,9 +121,27 @@ static bool enable_avx(void)
       printk("CPU: AVX 1 enabled\n");
    }
 
+   printk("CPU: XSAVE area: %u bytes%s\n",
+          xsave_area_size, x86_cpu_features.xsaveopt ? " (xsaveopt)" : "");
+
    return true;
 }
 
+#ifdef __x86_64__
+
+/*
+ * Allow the RD/WR{FS,GS}BASE instructions, both in kernel and in user mode.
+ * Reading and writing the bases with them is way cheaper than with the MSRs.
+ */
+static void enable_fsgsbase(void)
+{
+   write_cr4(read_cr4() | CR4_FSGSBASE);
+   x86_cpu_features.can_use_fsgsbase = true;
+   printk("CPU: FSGSBASE enabled\n");
+}
+
+#endif
+
 void init_pat(void)
 {
    u64 pat = rdmsr(MSR_IA32_PAT);
@@ -177,10 +205,15 @@ out:
    if (x86_cpu_features.edx1.pat)
       init_pat();
 
+#ifdef __x86_64__
+   if (x86_cpu_features.fsgsbase)
+      enable_fsgsbase();
+#endif
+
    printk("CPU: Physical addr bits: %u\n", x86_cpu_features.phys_addr_bits);
 }
 
-static char fpu_kernel_regs[CPU_XSAVE_AREA_SIZE] ALIGNED_AT(64);
+static char fpu_kernel_regs[CPU_XSAVE_AREA_MAX_SIZE] ALIGNED_AT(64);
 
 void save_current_fpu_regs(bool in_kernel)
 {
@@ -203,10 +236,28 @@ void save_current_fpu_regs(bool in_kernel)
        * "everything".
        */
 
-      asmVolatile("xsave (%0)"
-                  : /* no output */
-                  : "r" (buf), "a" (-1), "d" (-1)
-                  : /* no clobber */);
+      if (x86_cpu_features.xsaveopt) {
+
+         /*
+          * XSAVEOPT skips the state components not modified since the last
+          * XRSTOR from the same buffer and the ones in their init state. In
+          * the common case of a task not touching AVX (or the FPU at all)
+          * during its time-slice, that saves most of the memory writes.
+          */
+
+         asmVolatile("xsaveopt (%0)"
+                     : /* no output */
+                     : "r" (buf), "a" (-1), "d" (-1)
+                     : /* no clobber */);
+
+      } else {
+
+         asmVolatile("xsave (%0)"
+                     : /* no output */
+                     : "r" (buf), "a" (-1), "d" (-1)
+                     : /* no clobber */);
+      }
+
    } else {
 
       asmVolatile("fxsave (%0)"
@@ -257,9 +308,9 @@ bool allocate_fpu_regs(arch_task_members_t *arch_fields)
    if (x86_cpu_features.can_use_avx) {
 
       arch_fields->fpu_regs =
-         aligned_kmalloc(CPU_XSAVE_AREA_SIZE, 8 * sizeof(void *));
+         aligned_kmalloc(xsave_area_size, 8 * sizeof(void *));
 
-      arch_fields->fpu_regs_size = CPU_XSAVE_AREA_SIZE;
+      arch_fields->fpu_regs_size = (u16)xsave_area_size;
 
    } else {
 
@@ -16,6 +16,33 @@ int debug_qemu_turn_off_machine(void)
    return -EIO;
 }
 
+size_t
+stackwalk_kernel_stack(void **frames, size_t count, void *fp, void *stack)
+{
+   const ulong lo = (ulong)stack;
+   const ulong hi = lo + KERNEL_STACK_SIZE - 2 * sizeof(void *);
+   ulong prev = 0;
+   size_t i;
+
+   for (i = 0; i < count; i++) {
+
+      /* Each frame must be above the previous one, inside the stack */
+      if ((ulong)fp <= prev || (ulong)fp < lo || (ulong)fp > hi)
+         break;
+
+      if ((ulong)fp & (sizeof(void *) - 1))
+         break;
+
+      if (!(frames[i] = *((void **)fp + 1)))
+         break;
+
+      prev = (ulong)fp;
+      fp = *(void **)fp;
+   }
+
+   return i;
+}
+
 void dump_raw_stack(ulong addr)
 {
    printk("Raw stack dump:\n");
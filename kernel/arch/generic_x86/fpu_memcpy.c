@@ -26,8 +26,24 @@
 
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/hal.h>
 #include <tilck/kernel/arch/generic_x86/fpu_memcpy.h>
 
+/*
+ * Below this size, `rep movsb` is not faster than `rep movsd` even with ERMS,
+ * because of its startup cost.
+ */
+#define FAST_MEMCPY_ERMS_MIN               256
+
+/*
+ * Saving and restoring the FPU state (up to a few KB, with XSAVE) costs
+ * roughly like copying a page with plain `rep movs`: below that, it's not
+ * worth it.
+ */
+#define FAST_MEMCPY_FPU_MIN          PAGE_SIZE
+
 void
 memcpy256_failsafe(void *dest, const void *src, u32 n)
 {
@@ -261,3 +277,79 @@ void init_fpu_memcpy(void)
       simple_hot_patch(&__asm_fpu_cpy_single_256_nt_read, func, 128);
    }
 }
+
+static ALWAYS_INLINE void rep_movsb(void *dest, const void *src, size_t n)
+{
+   asmVolatile("rep movsb"
+               : "+D" (dest), "+S" (src), "+c" (n)
+               : /* no input */
+               : "memory");
+}
+
+/*
+ * The FPU context disables the preemption: use it only when that's fine
+ * already, which also means we're not inside another FPU context, nor in
+ * an IRQ handler.
+ */
+static inline bool fast_memcpy_can_use_fpu(void)
+{
+   return !kopt_no_fpu_memcpy &&
+          x86_cpu_features.can_use_sse2 &&
+          is_preemption_enabled() &&
+          !in_panic();
+}
+
+void fast_memcpy(void *dest, const void *src, size_t n)
+{
+   if (n >= FAST_MEMCPY_FPU_MIN &&
+       !(((ulong)dest | (ulong)src) & 31) &&
+       fast_memcpy_can_use_fpu())
+   {
+      const size_t bulk = n & ~(size_t)31;
+
+      fpu_context_begin();
+      {
+         fpu_memcpy256(dest, src, (u32)(bulk >> 5));
+      }
+      fpu_context_end();
+
+      if (n != bulk)
+         memcpy(dest + bulk, src + bulk, n - bulk);
+
+      return;
+   }
+
+   if (n >= FAST_MEMCPY_ERMS_MIN && x86_cpu_features.erms) {
+      rep_movsb(dest, src, n);
+      return;
+   }
+
+   memcpy(dest, src, n);
+}
+
+/*
+ * Copy a whole page with non-temporal stores: the destination (e.g. a page
+ * just duplicated by the COW) is typically touched only in a small part,
+ * right after the copy. Not trashing the cache with the rest of it is worth.
+ */
+void fast_copy_page(void *dest, const void *src)
+{
+   ASSERT(IS_PAGE_ALIGNED(dest));
+   ASSERT(IS_PAGE_ALIGNED(src));
+
+   if (fast_memcpy_can_use_fpu()) {
+
+      fpu_context_begin();
+      {
+         fpu_memcpy256_nt(dest, src, PAGE_SIZE / 32);
+         asmVolatile("sfence" ::: "memory");
+      }
+      fpu_context_end();
+      return;
+   }
+
+   if (x86_cpu_features.erms)
+      rep_movsb(dest, src, PAGE_SIZE);
+   else
+      memcpy32(dest, src, PAGE_SIZE / 4);
+}
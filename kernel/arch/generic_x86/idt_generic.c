@@ -1,12 +1,16 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/fault_resumable.h>
+#include <tilck/kernel/extable.h>
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/zram.h>
 
 soft_int_handler_t fault_handlers[32];
 
@@ -85,7 +89,7 @@ static void fault_in_panic(regs_t *r)
 void handle_fault(regs_t *r)
 {
    const int int_num = r->int_num;
-   bool cow = false;
+   bool handled = false;
 
    ASSERT(is_fault(int_num));
 
@@ -93,14 +97,22 @@ void handle_fault(regs_t *r)
       return fault_in_panic(r);
 
    if (LIKELY(int_num == FAULT_PAGE_FAULT)) {
-      cow = handle_potential_cow(r);
+
+      handled = handle_potential_cow(r);
+
+      if (ZRAM_SWAP && !handled)
+         handled = handle_potential_swap_in(r);
    }
 
-   if (!cow) {
+   if (!handled) {
 
       if (is_fault_resumable(int_num))
          return handle_resumable_fault(r);
 
+      /* A fault in a user-access primitive (e.g. get_user()) */
+      if (extable_fixup(r))
+         return;
+
       if (LIKELY(fault_handlers[int_num] != NULL)) {
 
          fault_handlers[int_num](r);
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/paging.h>
+
+#include "ioapic.h"
+#include "lapic.h"
+
+/* The I/O APIC has just two MMIO registers: a selector and a data window */
+#define IOAPIC_REGSEL              0x00
+#define IOAPIC_WIN                 0x10
+
+#define IOAPIC_REG_VER             0x01
+#define IOAPIC_REG_REDTBL          0x10     /* 2 registers per entry */
+
+#define IOAPIC_RTE_ACTIVE_LOW      (1u << 13)
+#define IOAPIC_RTE_LEVEL           (1u << 15)
+#define IOAPIC_RTE_MASKED          (1u << 16)
+
+static volatile u32 *ioapic;
+static u32 ioapic_entries;
+
+static u32 ioapic_read(u32 reg)
+{
+   ioapic[IOAPIC_REGSEL / 4] = reg;
+   return ioapic[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(u32 reg, u32 val)
+{
+   ioapic[IOAPIC_REGSEL / 4] = reg;
+   ioapic[IOAPIC_WIN / 4] = val;
+}
+
+/*
+ * Maps the I/O APIC handling the GSIs starting from 0 and masks all of its
+ * inputs. Only that one is supported: it's where the ISA IRQs are routed.
+ */
+bool init_ioapic(ulong paddr)
+{
+   void *va;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (!(va = hi_vmem_reserve(PAGE_SIZE)))
+      return false;
+
+   if (map_kernel_page(va, paddr, PAGING_FL_RW) < 0) {
+      hi_vmem_release(va, PAGE_SIZE);
+      return false;
+   }
+
+   ioapic = va;
+   ioapic_entries = ((ioapic_read(IOAPIC_REG_VER) >> 16) & 0xff) + 1;
+
+   for (u32 i = 0; i < ioapic_entries; i++)
+      ioapic_write(IOAPIC_REG_REDTBL + 2 * i, IOAPIC_RTE_MASKED);
+
+   printk("IOAPIC: at %#lx, %u inputs\n", paddr, ioapic_entries);
+   return true;
+}
+
+/* Routes `gsi` to `vector` on this CPU, leaving it masked */
+void ioapic_route(u32 gsi, u8 vector, bool level, bool active_low)
+{
+   u32 lo = vector | IOAPIC_RTE_MASKED;
+
+   if (gsi >= ioapic_entries)
+      return;
+
+   if (level)
+      lo |= IOAPIC_RTE_LEVEL;
+
+   if (active_low)
+      lo |= IOAPIC_RTE_ACTIVE_LOW;
+
+   /* Fixed delivery, physical destination mode */
+   ioapic_write(IOAPIC_REG_REDTBL + 2 * gsi + 1, lapic_get_id() << 24);
+   ioapic_write(IOAPIC_REG_REDTBL + 2 * gsi, lo);
+}
+
+void ioapic_set_masked(u32 gsi, bool masked)
+{
+   const u32 reg = IOAPIC_REG_REDTBL + 2 * gsi;
+   ulong var;
+   u32 lo;
+
+   if (gsi >= ioapic_entries)
+      return;
+
+   disable_interrupts(&var);
+   {
+      lo = ioapic_read(reg);
+
+      if (masked)
+         lo |= IOAPIC_RTE_MASKED;
+      else
+         lo &= ~IOAPIC_RTE_MASKED;
+
+      ioapic_write(reg, lo);
+   }
+   enable_interrupts(&var);
+}
+
+bool ioapic_is_masked(u32 gsi)
+{
+   ulong var;
+   bool res;
+
+   if (gsi >= ioapic_entries)
+      return true;
+
+   disable_interrupts(&var);
+   {
+      res = !!(ioapic_read(IOAPIC_REG_REDTBL + 2 * gsi) & IOAPIC_RTE_MASKED);
+   }
+   enable_interrupts(&var);
+   return res;
+}
@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+bool init_ioapic(ulong paddr);
+void ioapic_route(u32 gsi, u8 vector, bool level, bool active_low);
+void ioapic_set_masked(u32 gsi, bool masked);
+bool ioapic_is_masked(u32 gsi);
@@ -6,6 +6,7 @@
 #include <tilck/common/utils.h>
 
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/errno.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/term.h>
 #include <tilck/kernel/sched.h>
@@ -13,8 +14,10 @@
 #include <tilck/kernel/timer.h>
 
 #include "pic.h"
+#include "lapic.h"
+#include "apic.h"
 
-struct list irq_handlers_lists[16] = {
+struct list irq_handlers_lists[X86_IRQS_COUNT] = {
    STATIC_LIST_INIT(irq_handlers_lists[ 0]),
    STATIC_LIST_INIT(irq_handlers_lists[ 1]),
    STATIC_LIST_INIT(irq_handlers_lists[ 2]),
@@ -31,11 +34,29 @@ struct list irq_handlers_lists[16] = {
    STATIC_LIST_INIT(irq_handlers_lists[13]),
    STATIC_LIST_INIT(irq_handlers_lists[14]),
    STATIC_LIST_INIT(irq_handlers_lists[15]),
+   STATIC_LIST_INIT(irq_handlers_lists[16]),
+   STATIC_LIST_INIT(irq_handlers_lists[17]),
+   STATIC_LIST_INIT(irq_handlers_lists[18]),
+   STATIC_LIST_INIT(irq_handlers_lists[19]),
+   STATIC_LIST_INIT(irq_handlers_lists[20]),
+   STATIC_LIST_INIT(irq_handlers_lists[21]),
+   STATIC_LIST_INIT(irq_handlers_lists[22]),
+   STATIC_LIST_INIT(irq_handlers_lists[23]),
+   STATIC_LIST_INIT(irq_handlers_lists[24]),
+   STATIC_LIST_INIT(irq_handlers_lists[25]),
+   STATIC_LIST_INIT(irq_handlers_lists[26]),
+   STATIC_LIST_INIT(irq_handlers_lists[27]),
+   STATIC_LIST_INIT(irq_handlers_lists[28]),
+   STATIC_LIST_INIT(irq_handlers_lists[29]),
+   STATIC_LIST_INIT(irq_handlers_lists[30]),
+   STATIC_LIST_INIT(irq_handlers_lists[31]),
 };
 
 u32 unhandled_irq_count[256];
 u32 spur_irq_count;
 
+static u32 msi_used_mask;
+
 void idt_set_entry(u8 num, void *handler, u16 sel, u8 flags);
 
 /* This installs a custom IRQ handler for the given IRQ */
@@ -47,7 +68,10 @@ void irq_install_handler(u8 irq, struct irq_handler_node *n)
       list_add_tail(&irq_handlers_lists[irq], &n->node);
    }
    enable_interrupts(&var);
-   irq_clear_mask(irq);
+
+   /* The MSI vectors are masked (if ever) by the device itself */
+   if (irq < X86_MSI_FIRST_IRQ)
+      irq_clear_mask(irq);
 }
 
 /* This clears the handler for a given IRQ */
@@ -58,12 +82,54 @@ void irq_uninstall_handler(u8 irq, struct irq_handler_node *n)
    {
       list_remove(&n->node);
 
-      if (list_is_empty(&irq_handlers_lists[irq]))
+      if (list_is_empty(&irq_handlers_lists[irq]) && irq < X86_MSI_FIRST_IRQ)
          irq_set_mask(irq);
    }
    enable_interrupts(&var);
 }
 
+void irq_set_mask(int irq)
+{
+   if (x86_apic_mode)
+      apic_irq_set_mask(irq);
+   else
+      pic_set_mask(irq);
+}
+
+void irq_clear_mask(int irq)
+{
+   if (x86_apic_mode)
+      apic_irq_clear_mask(irq);
+   else
+      pic_clear_mask(irq);
+}
+
+bool irq_is_masked(int irq)
+{
+   if (x86_apic_mode)
+      return apic_irq_is_masked(irq);
+
+   return pic_is_masked(irq);
+}
+
+static inline void irq_mask_and_send_eoi(int irq)
+{
+   if (x86_apic_mode) {
+      apic_irq_set_mask(irq);
+      lapic_send_eoi();
+   } else {
+      pic_mask_and_send_eoi(irq);
+   }
+}
+
+static inline void irq_send_eoi(int irq)
+{
+   if (x86_apic_mode)
+      lapic_send_eoi();
+   else
+      pic_send_eoi(irq);
+}
+
 static inline void handle_irq_set_mask_and_eoi(int irq)
 {
    if (KRN_TRACK_NESTED_INTERR) {
@@ -75,12 +141,12 @@ static inline void handle_irq_set_mask_and_eoi(int irq)
        */
 
       if (irq != X86_PC_TIMER_IRQ)
-         pic_mask_and_send_eoi(irq);
+         irq_mask_and_send_eoi(irq);
       else
-         pic_send_eoi(irq);
+         irq_send_eoi(irq);
 
    } else {
-      pic_mask_and_send_eoi(irq);
+      irq_mask_and_send_eoi(irq);
    }
 }
 
@@ -96,38 +162,130 @@ static inline void handle_irq_clear_mask(int irq)
    }
 }
 
-void arch_irq_handling(regs_t *r)
+static void run_irq_handlers(int irq)
 {
    enum irq_action hret = IRQ_NOT_HANDLED;
-   const int irq = r->int_num - 32;
    struct irq_handler_node *pos;
 
+   list_for_each_ro(pos, &irq_handlers_lists[irq], node) {
+
+      hret = pos->handler(pos->context);
+
+      if (hret != IRQ_NOT_HANDLED)
+         break;
+   }
+
+   if (hret == IRQ_NOT_HANDLED)
+      unhandled_irq_count[irq]++;
+}
+
+/*
+ * The MSI vectors are edge-triggered and there's nothing to mask on our side.
+ * Sending the EOI to the LAPIC only after running the handlers is enough to
+ * avoid nested MSI interrupts: until then, it won't deliver any other vector
+ * in the same priority class (48-63), while the PIC IRQs are unaffected.
+ */
+static void handle_msi_irq(regs_t *r, int irq)
+{
+   if (irq == X86_LAPIC_SPUR_IRQ) {
+      spur_irq_count++;       /* No EOI for the spurious vector */
+      return;
+   }
+
+   push_nested_interrupt(r->int_num);
+   enable_interrupts_forced();
+   {
+      run_irq_handlers(irq);
+   }
+   disable_interrupts_forced();
+   lapic_send_eoi();
+   pop_nested_interrupt();
+}
+
+void arch_irq_handling(regs_t *r)
+{
+   const int irq = r->int_num - 32;
+   u64 masked_start;
+
    ASSERT(!are_interrupts_enabled());
    ASSERT(!is_preemption_enabled());
 
-   if (pic_is_spur_irq(irq)) {
+   if (irq >= X86_MSI_FIRST_IRQ) {
+      handle_msi_irq(r, irq);
+      return;
+   }
+
+   if (!x86_apic_mode && pic_is_spur_irq(irq)) {
       spur_irq_count++;
       return;
    }
 
    push_nested_interrupt(r->int_num);
    handle_irq_set_mask_and_eoi(irq);
+   masked_start = RDTSC();
    enable_interrupts_forced();
    {
-      list_for_each_ro(pos, &irq_handlers_lists[irq], node) {
+      run_irq_handlers(irq);
+   }
+   disable_interrupts_forced();
+   handle_irq_clear_mask(irq);
+
+   if (!KRN_TRACK_NESTED_INTERR || irq != X86_PC_TIMER_IRQ)
+      irq_account_masked_time(irq, RDTSC() - masked_start);
+
+   pop_nested_interrupt();
+}
+
+int irq_alloc_msi(u32 count, struct msi_msg *msg)
+{
+   const u32 bits = (1u << count) - 1;
+   int irq = -ENOSPC;
+   ulong var;
 
-         hret = pos->handler(pos->context);
+   ASSERT(count > 0 && count <= 8);
+   ASSERT((count & (count - 1)) == 0);
 
-         if (hret != IRQ_NOT_HANDLED)
+   if (!init_lapic())
+      return -ENODEV;
+
+   disable_interrupts(&var);
+   {
+      for (u32 i = 0; i + count <= X86_MSI_IRQS_COUNT; i += count) {
+
+         if (!(msi_used_mask & (bits << i))) {
+            msi_used_mask |= bits << i;
+            irq = X86_MSI_FIRST_IRQ + (int)i;
             break;
+         }
       }
+   }
+   enable_interrupts(&var);
+
+   if (irq < 0)
+      return irq;
+
+   /* Fixed delivery, edge-triggered, to this CPU's LAPIC */
+   *msg = (struct msi_msg) {
+      .addr = 0xfee00000 | (lapic_get_id() << 12),
+      .data = 32 + (u32)irq,
+   };
+
+   return irq;
+}
 
-      if (hret == IRQ_NOT_HANDLED)
-         unhandled_irq_count[irq]++;
+void irq_free_msi(int irq, u32 count)
+{
+   const u32 first = (u32)(irq - X86_MSI_FIRST_IRQ);
+   ulong var;
+
+   ASSERT(IN_RANGE(irq, X86_MSI_FIRST_IRQ, X86_LAPIC_SPUR_IRQ));
+
+   disable_interrupts(&var);
+   {
+      ASSERT(list_is_empty(&irq_handlers_lists[irq]));
+      msi_used_mask &= ~(((1u << count) - 1) << first);
    }
-   disable_interrupts_forced();
-   handle_irq_clear_mask(irq);
-   pop_nested_interrupt();
+   enable_interrupts(&var);
 }
 
 int get_irq_num(regs_t *context)
@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/arch/generic_x86/cpu_features.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/datetime.h>
+
+#include "lapic.h"
+#include "pit.h"
+
+#define APIC_BASE_X2APIC           (1u << 10)
+#define APIC_BASE_ENABLE           (1u << 11)
+#define APIC_BASE_PADDR_MASK       0xfffff000u
+
+/* Local APIC registers: offsets in its MMIO page */
+#define LAPIC_ID                   0x020
+#define LAPIC_TPR                  0x080
+#define LAPIC_EOI                  0x0b0
+#define LAPIC_SVR                  0x0f0
+#define LAPIC_ICR_LO               0x300
+#define LAPIC_ICR_HI               0x310
+#define LAPIC_LVT_TIMER            0x320
+#define LAPIC_LVT_LINT0            0x350
+#define LAPIC_LVT_LINT1            0x360
+#define LAPIC_TIMER_INIT           0x380
+#define LAPIC_TIMER_CURR           0x390
+#define LAPIC_TIMER_DIV            0x3e0
+
+#define LAPIC_SVR_ENABLE           (1u << 8)
+#define LAPIC_ICR_DM_INIT          (5u << 8)
+#define LAPIC_ICR_DM_STARTUP       (6u << 8)
+#define LAPIC_ICR_PENDING          (1u << 12)
+#define LAPIC_ICR_ASSERT           (1u << 14)
+#define LAPIC_ICR_LEVEL            (1u << 15)
+#define LAPIC_LVT_DM_NMI           (4u << 8)
+#define LAPIC_LVT_DM_EXTINT        (7u << 8)
+#define LAPIC_LVT_MASKED           (1u << 16)
+#define LAPIC_LVT_PERIODIC         (1u << 17)
+
+#define LAPIC_TIMER_DIV_16         0x3
+#define LAPIC_TIMER_VECTOR         (32 + X86_PC_TIMER_IRQ)
+#define LAPIC_CALIBRATE_HZ         100
+
+static volatile u32 *lapic;
+
+static u32 lapic_timer_freq;        /* timer counts per second */
+static u32 lapic_tick_count;        /* timer counts per tick, periodic mode */
+static u32 lapic_oneshot_count;     /* when != 0, the one-shot mode is active */
+
+static ALWAYS_INLINE u32 lapic_read(u32 reg)
+{
+   return lapic[reg / 4];
+}
+
+static ALWAYS_INLINE void lapic_write(u32 reg, u32 val)
+{
+   lapic[reg / 4] = val;
+}
+
+/*
+ * Enables the local APIC in the "virtual wire" mode: the 8259 PIC remains
+ * connected to LINT0 and keeps delivering the legacy IRQs exactly as before,
+ * while the LAPIC accepts the MSI messages written by the PCI devices. When
+ * the I/O APIC is used, the PIC just stays masked.
+ *
+ * Called at boot by init_apic_irq_routing() or, when that fails, lazily by
+ * the first user of the MSI vectors.
+ */
+bool init_lapic(void)
+{
+   u64 base;
+   void *va;
+
+   if (lapic)
+      return true;
+
+   if (!x86_cpu_features.edx1.apic)
+      return false;
+
+   base = rdmsr(MSR_IA32_APIC_BASE);
+
+   if (!(base & APIC_BASE_ENABLE)) {
+      printk("LAPIC: disabled by the firmware\n");
+      return false;
+   }
+
+   if (base & APIC_BASE_X2APIC) {
+      printk("LAPIC: x2APIC mode not supported\n");
+      return false;
+   }
+
+   if (!(va = hi_vmem_reserve(PAGE_SIZE)))
+      return false;
+
+   if (map_kernel_page(va, (ulong)(base & APIC_BASE_PADDR_MASK),
+                       PAGING_FL_RW) < 0)
+   {
+      hi_vmem_release(va, PAGE_SIZE);
+      return false;
+   }
+
+   lapic = va;
+
+   lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_DM_EXTINT);
+   lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_DM_NMI);
+   lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+   lapic_write(LAPIC_TPR, 0);
+   lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | (32 + X86_LAPIC_SPUR_IRQ));
+
+   printk("LAPIC: enabled, id: %u\n", lapic_get_id());
+   return true;
+}
+
+void lapic_send_eoi(void)
+{
+   lapic_write(LAPIC_EOI, 0);
+}
+
+u32 lapic_get_id(void)
+{
+   return lapic_read(LAPIC_ID) >> 24;
+}
+
+static void lapic_send_ipi(u32 apic_id, u32 icr_lo)
+{
+   ASSERT(!are_interrupts_enabled());
+
+   lapic_write(LAPIC_ICR_HI, apic_id << 24);
+   lapic_write(LAPIC_ICR_LO, icr_lo);
+
+   while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING)
+      asmVolatile("pause");
+}
+
+/* Puts the given CPU in the wait-for-SIPI state */
+void lapic_send_init(u32 apic_id)
+{
+   lapic_send_ipi(apic_id,
+                  LAPIC_ICR_DM_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+}
+
+/* Starts the given CPU in real mode, at CS:IP = (paddr >> 4):0 */
+void lapic_send_startup(u32 apic_id, ulong paddr)
+{
+   ASSERT(IS_PAGE_ALIGNED(paddr));
+   ASSERT(paddr < MB);
+
+   lapic_send_ipi(apic_id, LAPIC_ICR_DM_STARTUP | (u32)(paddr >> PAGE_SHIFT));
+}
+
+/*
+ * Measure the frequency of the LAPIC timer (the bus clock divided by 16)
+ * against the PIT, during 1/LAPIC_CALIBRATE_HZ sec.
+ */
+static void lapic_timer_calibrate(void)
+{
+   ulong var;
+   u32 elapsed;
+
+   disable_interrupts(&var);
+   {
+      lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+      lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+      pit_busy_wait(PIT_FREQ / LAPIC_CALIBRATE_HZ);
+      elapsed = 0xffffffff - lapic_read(LAPIC_TIMER_CURR);
+      lapic_write(LAPIC_TIMER_INIT, 0);
+   }
+   enable_interrupts(&var);
+
+   lapic_timer_freq = elapsed * LAPIC_CALIBRATE_HZ;
+   printk("LAPIC: timer frequency: %u kHz\n", lapic_timer_freq / 1000);
+}
+
+/* Keep the mask bit: that's how irq_set_mask(X86_PC_TIMER_IRQ) works */
+static void lapic_timer_program(bool periodic, u32 count)
+{
+   u32 lvt = lapic_read(LAPIC_LVT_TIMER) & LAPIC_LVT_MASKED;
+
+   if (periodic)
+      lvt |= LAPIC_LVT_PERIODIC;
+
+   lapic_write(LAPIC_LVT_TIMER, lvt | LAPIC_TIMER_VECTOR);
+   lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+/* Same as pit_timer_setup(), but for the LAPIC timer */
+u32 lapic_timer_setup(u32 interval)
+{
+   if (!lapic_timer_freq)
+      lapic_timer_calibrate();
+
+   lapic_tick_count = (u32)((u64)lapic_timer_freq * interval / TS_SCALE);
+   VERIFY(lapic_tick_count > 0);
+
+   lapic_timer_program(true, lapic_tick_count);
+   return (u32)((u64)TS_SCALE * lapic_tick_count / lapic_timer_freq);
+}
+
+/* Same as pit_stop_tick(), but for the LAPIC timer */
+u32 lapic_timer_stop_tick(u32 max_ticks, u32 *phase)
+{
+   const u32 ticks = MIN(max_ticks, 0xffffffff / lapic_tick_count);
+   u32 phase_count;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(!lapic_oneshot_count);
+
+   if (ticks < 2)
+      return 0;
+
+   /* In periodic mode, the counter goes from `lapic_tick_count` down to 0 */
+   phase_count =
+      lapic_tick_count - MIN(lapic_read(LAPIC_TIMER_CURR), lapic_tick_count);
+
+   lapic_oneshot_count = ticks * lapic_tick_count - phase_count;
+   lapic_timer_program(false, lapic_oneshot_count);
+
+   *phase = (u32)((u64)TS_SCALE * phase_count / lapic_timer_freq);
+   return ticks;
+}
+
+/* Same as pit_restart_tick(), but for the LAPIC timer */
+u64 lapic_timer_restart_tick(bool *expired)
+{
+   u32 count, elapsed;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(lapic_oneshot_count > 0);
+
+   /* In one-shot mode, the counter stops at 0 */
+   count = lapic_read(LAPIC_TIMER_CURR);
+   *expired = count == 0;
+   elapsed = lapic_oneshot_count - count;
+
+   lapic_oneshot_count = 0;
+   lapic_timer_program(true, lapic_tick_count);
+   return (u64)TS_SCALE * elapsed / lapic_timer_freq;
+}
+
+void lapic_timer_set_masked(bool masked)
+{
+   ulong var;
+   u32 lvt;
+
+   disable_interrupts(&var);
+   {
+      lvt = lapic_read(LAPIC_LVT_TIMER);
+
+      if (masked)
+         lvt |= LAPIC_LVT_MASKED;
+      else
+         lvt &= ~LAPIC_LVT_MASKED;
+
+      lapic_write(LAPIC_LVT_TIMER, lvt);
+   }
+   enable_interrupts(&var);
+}
+
+bool lapic_timer_is_masked(void)
+{
+   return !!(lapic_read(LAPIC_LVT_TIMER) & LAPIC_LVT_MASKED);
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+bool init_lapic(void);
+void lapic_send_eoi(void);
+u32 lapic_get_id(void);
+void lapic_send_init(u32 apic_id);
+void lapic_send_startup(u32 apic_id, ulong paddr);
+
+u32 lapic_timer_setup(u32 interval);
+u32 lapic_timer_stop_tick(u32 max_ticks, u32 *phase);
+u64 lapic_timer_restart_tick(bool *expired);
+void lapic_timer_set_masked(bool masked);
+bool lapic_timer_is_masked(void);
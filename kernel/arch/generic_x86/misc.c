@@ -4,10 +4,12 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
+#include <tilck/common/arch/generic_x86/cpu_features.h>
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/idle.h>
 #include <tilck/mods/acpi.h>
 
 NORETURN void poweroff(void)
@@ -76,3 +78,66 @@ NORETURN void reboot(void)
 
    panic("Unable to reboot the machine");
 }
+
+/*
+ * The cache line watched by MONITOR: nobody writes here, so MWAIT is woken up
+ * only by the interrupts.
+ */
+static ALIGNED_AT(64) volatile u32 mwait_monitor_line;
+
+bool hw_idle_supported(int method)
+{
+   switch (method) {
+
+      case IDLE_M_HALT:
+      case IDLE_M_IO_PORT:
+         return true;
+
+      case IDLE_M_MWAIT:
+         return x86_cpu_features.ecx1.monitor;
+
+      default:
+         return false;
+   }
+}
+
+void hw_idle_enter(int method, ulong arg)
+{
+   switch (method) {
+
+      case IDLE_M_MWAIT:
+         monitor((void *)&mwait_monitor_line, 0, 0);
+         enable_interrupts_and_mwait((u32)arg, 0);
+         break;
+
+      case IDLE_M_IO_PORT:
+         /*
+          * The read of the P_LVLx port makes the chipset put the CPU in the
+          * C-state. Because of that, the interrupts have to be enabled only
+          * after it: in the worst case, an IRQ will wake us up immediately.
+          */
+         inb((u16)arg);
+         enable_interrupts_forced();
+         break;
+
+      default:
+         enable_interrupts_and_halt();
+         break;
+   }
+}
+
+/*
+ * The invariant TSC runs at a constant rate, regardless of the frequency
+ * scaling and of the C-states. The hypervisors don't always advertise it,
+ * but their TSC is constant-rate anyway.
+ */
+bool hw_tsc_is_stable(void)
+{
+   return x86_cpu_features.invariant_TSC || in_hypervisor();
+}
+
+/* The TSC frequency is not known upfront: the timer code calibrates it */
+u64 hw_tsc_get_hz(void)
+{
+   return 0;
+}
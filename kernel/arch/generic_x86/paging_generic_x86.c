@@ -9,6 +9,7 @@
 
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/pageframes.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/system_mmap.h>
@@ -17,95 +18,87 @@
 
 #include "paging_generic_x86.h"
 
-u32 *pageframes_refcount;
 ulong phys_mem_lim;
 struct kmalloc_heap *hi_vmem_heap;
 
-void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
+void invalidate_page(ulong vaddr)
 {
-   ASSERT(IS_PAGE_ALIGNED(vaddrp));
-   ASSERT(IS_PAGE_ALIGNED(len));
-
-   ulong paddr;
-   ulong vaddr = (ulong)vaddrp;
-   const ulong vaddr_end = vaddr + len;
-
-   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
-
-      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
-         continue; /* not mapped, that's fine */
-
-      __pf_ref_count_inc(paddr);
-   }
+   invalidate_page_hw(vaddr);
 }
 
-void release_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
+/*
+ * Invalidates the TLB entries for a range of pages of `pdir`, once the paging
+ * operations on the whole range are done. Past TLB_FLUSH_ALL_THRESHOLD pages,
+ * flushing the whole TLB is cheaper than an INVLPG per page.
+ */
+void invalidate_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
 {
-   ASSERT(IS_PAGE_ALIGNED(vaddrp));
-   ASSERT(IS_PAGE_ALIGNED(len));
+   const ulong vaddr = (ulong)vaddrp;
+   ulong var;
+
+   if (vaddr < BASE_VA) {
 
-   ulong paddr;
-   ulong vaddr = (ulong)vaddrp;
-   const ulong vaddr_end = vaddr + len;
+      /*
+       * Without PCID, the TLB contains only the entries of the current pdir
+       * plus the global ones, while the user pages are never global.
+       */
+      if (pdir != get_curr_pdir())
+         return;
 
-   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
+      if (page_count > TLB_FLUSH_ALL_THRESHOLD) {
+         set_curr_pdir(pdir); /* reload CR3 */
+         return;
+      }
 
-      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
-         continue; /* not mapped, that's fine */
+   } else if (page_count > TLB_FLUSH_ALL_THRESHOLD) {
 
-      __pf_ref_count_dec(paddr);
+      disable_interrupts(&var);
+      {
+         invalidate_all_pages_hw();
+      }
+      enable_interrupts(&var);
+      return;
    }
-}
 
-void invalidate_page(ulong vaddr)
-{
-   invalidate_page_hw(vaddr);
+   for (size_t i = 0; i < page_count; i++)
+      invalidate_page_hw(vaddr + (i << PAGE_SHIFT));
 }
 
 void init_paging(void)
 {
    int rc;
    void *user_vdso_vaddr;
-   size_t pagesframes_refcount_bufsize;
 
    phys_mem_lim = (ulong)MIN(get_phys_mem_size(),
                              (u64)LINEAR_MAPPING_SIZE);
 
    /*
-    * Allocate the buffer used for keeping a ref-count for each pageframe.
-    * This is necessary for COW.
+    * Allocate the page frame descriptors, necessary for COW in first place:
+    * it's the ref-count which tells whether a COW page is still shared.
     */
+   init_pageframes(0, phys_mem_lim);
 
-   pagesframes_refcount_bufsize =
-      (phys_mem_lim >> PAGE_SHIFT) * sizeof(pageframes_refcount[0]);
+   if (!pageframes)
+      return;        /* We're in panic: silently ignore the failure */
 
-   pageframes_refcount = kzmalloc(pagesframes_refcount_bufsize);
-
-   if (!pageframes_refcount) {
-
-      if (in_panic())
-         return;        /* We're in panic: silently ignore the failure */
-
-      panic("Unable to allocate pageframes_refcount");
-   }
-
-   pf_ref_count_inc(KERNEL_VA_TO_PA(zero_page));
+   pf_retain(KERNEL_VA_TO_PA(zero_page), PF_TYPE_ZERO);
 
    /* Initialize the kmalloc heap used for the "hi virtual mem" area */
    init_hi_vmem_heap();
 
    /*
-    * Now use the just-created hi vmem heap to reserve a page for the user
-    * vdso-like page and expect it to be == USER_VDSO_VADDR.
+    * Now use the just-created hi vmem heap to reserve two pages for the user
+    * vdso-like page and the vvar page, and expect it to be == USER_VDSO_VADDR.
     */
-   user_vdso_vaddr = hi_vmem_reserve(PAGE_SIZE);
+   user_vdso_vaddr = hi_vmem_reserve(2 * PAGE_SIZE);
 
    if (user_vdso_vaddr != (void *)USER_VDSO_VADDR)
       panic("user_vdso_vaddr != USER_VDSO_VADDR");
 
    /*
     * Map a special vdso-like page used for the sysenter interface.
-    * This is the only user-mapped page with a vaddr in the kernel space.
+    * This, along with the read-only vvar page right after it, are the only
+    * user-mapped pages with a vaddr in the kernel space.
     */
    rc = map_page(get_kernel_pdir(),
                  user_vdso_vaddr,
@@ -114,6 +107,14 @@ void init_paging(void)
 
    if (rc < 0)
       panic("Unable to map the vdso-like page");
+
+   rc = map_page(get_kernel_pdir(),
+                 (void *)USER_VVAR_VADDR,
+                 KERNEL_VA_TO_PA(&vdso_data_page),
+                 PAGING_FL_US);
+
+   if (rc < 0)
+      panic("Unable to map the vvar page");
 }
 
 void *
@@ -126,7 +127,7 @@ map_framebuffer(pdir_t *pdir,
    if (!get_kernel_pdir())
       return failsafe_map_framebuffer(paddr, size);
 
-   if (!pageframes_refcount)
+   if (!pageframes)
       return failsafe_map_framebuffer(paddr, size);
 
    size_t count;
@@ -190,8 +191,17 @@ map_framebuffer(pdir_t *pdir,
       panic("Unable to map the framebuffer in the virtual space");
    }
 
+   /*
+    * User mappings (see fbdev_mmap()) get the same memory type as the kernel
+    * one: apps blitting whole frames through /dev/fb0 rely on that. Note: the
+    * attribute bits live in the PTEs, which are copied as they are on fork().
+    */
    if (kopt_fb_no_wc) {
-      printk("paging: skip marking framebuffer pages as WC (kopt_fb_no_wc)\n");
+
+      if (!user_mmap)
+         printk("paging: skip marking framebuffer pages as WC "
+                "(kopt_fb_no_wc)\n");
+
       return (void *)vaddr;
    }
 
@@ -201,6 +211,12 @@ map_framebuffer(pdir_t *pdir,
       return (void *)vaddr;
    }
 
+   /*
+    * Without PAT, the memory type comes only from the MTRR set below for the
+    * kernel mapping, which covers the physical range: the user mappings are
+    * WC only if that succeeded (free MTRR, paddr aligned at the power-of-two
+    * size). Otherwise, both keep the type set by the firmware (usually UC).
+    */
    if (!x86_cpu_features.edx1.mtrr || user_mmap)
       return (void *)vaddr;
 
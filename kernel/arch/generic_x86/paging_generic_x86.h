@@ -9,6 +9,7 @@
 
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/pageframes.h>
 
 /*
  * When this flag is set in the 'avail' bits in page_t, in means that the page
@@ -23,50 +24,23 @@
  */
 #define PAGE_SHARED                            (1 << 1)
 
+/*
+ * ZRAM_SWAP. When this flag is set in the 'avail' bits of a NON-present page_t,
+ * the entry is a swap entry: `pageAddr` is a zram slot, while the RW and US
+ * bits are the ones of the page swapped out. In a present page_t, the flag
+ * means that the page didn't compress well: the reclaim skips it until it gets
+ * dirty again. See pdir_reclaim_cold_pages().
+ */
+#define PAGE_ZRAM                              (1 << 2)
+
 
 /* ---------------------------------------------- */
 
 extern char zero_page[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
-extern u32 *pageframes_refcount;
 extern ulong phys_mem_lim;
 extern struct kmalloc_heap *hi_vmem_heap;
 
-static ALWAYS_INLINE u32 __pf_ref_count_inc(u32 paddr)
-{
-   return ++pageframes_refcount[paddr >> PAGE_SHIFT];
-}
-
-static ALWAYS_INLINE u32 __pf_ref_count_dec(u32 paddr)
-{
-   ASSERT(pageframes_refcount[paddr >> PAGE_SHIFT] > 0);
-   return --pageframes_refcount[paddr >> PAGE_SHIFT];
-}
-
-static ALWAYS_INLINE u32 pf_ref_count_inc(u32 paddr)
-{
-   if (UNLIKELY(paddr >= phys_mem_lim))
-      return 0;
-
-   return __pf_ref_count_inc(paddr);
-}
-
-static ALWAYS_INLINE u32 pf_ref_count_dec(u32 paddr)
-{
-   if (UNLIKELY(paddr >= phys_mem_lim))
-      return 0;
-
-   return __pf_ref_count_dec(paddr);
-}
-
-static ALWAYS_INLINE u32 pf_ref_count_get(u32 paddr)
-{
-   if (UNLIKELY(paddr >= phys_mem_lim))
-      return 0;
-
-   return pageframes_refcount[paddr >> PAGE_SHIFT];
-}
-
 void init_hi_vmem_heap(void);
 void *failsafe_map_framebuffer(ulong paddr, ulong size);
 int virtual_read_unsafe(pdir_t *pdir, void *extern_va, void *dest, size_t len);
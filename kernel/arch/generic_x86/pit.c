@@ -5,7 +5,7 @@
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/datetime.h>
 
-#define PIT_FREQ           1193182
+#include "pit.h"
 
 #define PIT_CMD_PORT          0x43
 #define PIT_CH0_PORT          0x40
@@ -31,6 +31,34 @@
 #define PIT_CH2         0b10000000   // select channel 2
 
 #define PIT_READ_BACK   0b11000000   // read-back command (8254 only)
+#define PIT_LATCH       0b00000000   // counter latch command (access mode 0)
+
+#define PIT_CH2_CTRL_PORT     0x61
+#define PIT_CH2_GATE    0b00000001   // channel 2 gate input
+#define PIT_SPEAKER     0b00000010   // speaker data enable
+#define PIT_CH2_OUT     0b00100000   // channel 2 output (read-only)
+
+#define PIT_ONESHOT_MAX_COUNT      0xc000
+
+static u32 pit_divisor;          /* PIT counts per tick, in periodic mode */
+static u32 pit_oneshot_count;    /* when != 0, the one-shot mode is active */
+
+static void pit_program(u8 mode, u32 count)
+{
+   outb(PIT_CMD_PORT, PIT_MODE_BIN | mode | PIT_ACC_LOHI | PIT_CH0);
+   outb(PIT_CH0_PORT, count & 0xff);            /* Set low byte of count */
+   outb(PIT_CH0_PORT, (count >> 8) & 0xff);     /* Set high byte of count */
+}
+
+static u32 pit_read_count(void)
+{
+   u32 lo, hi;
+
+   outb(PIT_CMD_PORT, PIT_LATCH | PIT_CH0);
+   lo = inb(PIT_CH0_PORT);
+   hi = inb(PIT_CH0_PORT);
+   return (hi << 8) | lo;
+}
 
 /*
  * Set the time between ticks to be `interval`, where 1 means 1/TS_SCALE sec.
@@ -39,7 +67,7 @@
  *
  * Returns the _real_ interval between ticks, which is hw-specific.
  */
-u32 hw_timer_setup(u32 interval)
+u32 pit_timer_setup(u32 interval)
 {
    const u32 hz = TS_SCALE / interval;
    const u32 divisor = PIT_FREQ / hz;
@@ -78,9 +106,90 @@ u32 hw_timer_setup(u32 interval)
    actual_interval /= PIT_FREQ;
    ASSERT(actual_interval < UINT32_MAX);
 
-   outb(PIT_CMD_PORT, PIT_MODE_BIN | PIT_MODE_2 | PIT_ACC_LOHI | PIT_CH0);
-   outb(PIT_CH0_PORT, divisor & 0xff);            /* Set low byte of divisor */
-   outb(PIT_CH0_PORT, (divisor >> 8) & 0xff);     /* Set high byte of divisor */
-
+   pit_divisor = divisor;
+   pit_program(PIT_MODE_2, divisor);
    return (u32)actual_interval;
 }
+
+/*
+ * Stop the periodic tick and make the timer fire just once, at the time when
+ * `max_ticks` more ticks would have happened, or earlier if the hardware
+ * doesn't support such a long interval. Sets `*phase` to the time elapsed
+ * since the last tick, in TS_SCALE units, and returns the number of ticks
+ * actually programmed, or 0 if that's not worth it.
+ *
+ * Called with interrupts disabled.
+ */
+u32 pit_stop_tick(u32 max_ticks, u32 *phase)
+{
+   const u32 ticks = MIN(max_ticks, PIT_ONESHOT_MAX_COUNT / pit_divisor);
+   u32 phase_count;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(!pit_oneshot_count);
+
+   if (ticks < 2)
+      return 0;
+
+   /* In mode 2, the counter goes from `pit_divisor` down to 1 at each tick */
+   phase_count = pit_divisor - MIN(pit_read_count(), pit_divisor);
+
+   pit_oneshot_count = ticks * pit_divisor - phase_count;
+   pit_program(PIT_MODE_0, pit_oneshot_count);
+
+   *phase = (u32)((u64)TS_SCALE * phase_count / PIT_FREQ);
+   return ticks;
+}
+
+/*
+ * Restore the periodic tick, stopped by pit_stop_tick(). Returns the time
+ * elapsed since then, in TS_SCALE units, and sets `*expired` if the one-shot
+ * timer has fired (its IRQ might be still pending).
+ *
+ * Called with interrupts disabled.
+ */
+u64 pit_restart_tick(bool *expired)
+{
+   u32 count, elapsed;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(pit_oneshot_count > 0);
+
+   /*
+    * In mode 0, the counter keeps going after reaching 0 and wraps around:
+    * a value bigger than the initial count means the one-shot has expired.
+    * PIT_ONESHOT_MAX_COUNT leaves enough margin to tell the two cases apart.
+    */
+   count = pit_read_count();
+   *expired = count == 0 || count > pit_oneshot_count;
+   elapsed = *expired ? pit_oneshot_count : pit_oneshot_count - count;
+
+   pit_oneshot_count = 0;
+   pit_program(PIT_MODE_2, pit_divisor);
+   return (u64)TS_SCALE * elapsed / PIT_FREQ;
+}
+
+/*
+ * Busy-wait for `count` PIT cycles, using the channel 2 in mode 0 and polling
+ * its output. The channel 0 is left untouched. Used to calibrate the LAPIC
+ * timer. Called with interrupts disabled.
+ */
+void pit_busy_wait(u32 count)
+{
+   const u8 ctrl = inb(PIT_CH2_CTRL_PORT) & ~PIT_SPEAKER;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(IN_RANGE_INC(count, 1, 0xffff));
+
+   outb(PIT_CH2_CTRL_PORT, ctrl & ~PIT_CH2_GATE);
+   outb(PIT_CMD_PORT, PIT_MODE_BIN | PIT_MODE_0 | PIT_ACC_LOHI | PIT_CH2);
+   outb(PIT_CH2_PORT, count & 0xff);
+   outb(PIT_CH2_PORT, (count >> 8) & 0xff);
+   outb(PIT_CH2_CTRL_PORT, ctrl | PIT_CH2_GATE);   /* Start counting */
+
+   while (!(inb(PIT_CH2_CTRL_PORT) & PIT_CH2_OUT)) {
+      /* wait */
+   }
+
+   outb(PIT_CH2_CTRL_PORT, ctrl & ~PIT_CH2_GATE);
+}
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+#define PIT_FREQ           1193182
+
+u32 pit_timer_setup(u32 interval);
+u32 pit_stop_tick(u32 max_ticks, u32 *phase);
+u64 pit_restart_tick(bool *expired);
+void pit_busy_wait(u32 count);
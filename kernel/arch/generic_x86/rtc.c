@@ -4,6 +4,10 @@
 
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/errno.h>
 
 #define CMOS_CONTROL_PORT                 0x70
 #define CMOS_DATA_PORT                    0x71
@@ -18,8 +22,11 @@
 
 #define REG_STATUS_REG_A                  0x0A
 #define REG_STATUS_REG_B                  0x0B
+#define REG_STATUS_REG_C                  0x0C
 
 #define STATUS_REG_A_UPDATE_IN_PROGRESS   0x80
+#define STATUS_REG_B_UPDATE_IRQ           0x10
+#define STATUS_REG_C_UPDATE_ENDED         0x10
 
 static inline u8 bcd_to_dec(u8 bcd)
 {
@@ -33,6 +40,12 @@ static inline u32 cmos_read_reg(u8 reg)
    return inb(CMOS_DATA_PORT);
 }
 
+static inline void cmos_write_reg(u8 reg, u8 val)
+{
+   outb(CMOS_CONTROL_PORT, reg);
+   outb(CMOS_DATA_PORT, val);
+}
+
 static inline bool cmos_is_update_in_progress(void)
 {
    return cmos_read_reg(REG_STATUS_REG_A) & STATUS_REG_A_UPDATE_IN_PROGRESS;
@@ -110,3 +123,79 @@ void hw_read_clock_cmos(struct datetime *out)
    d.year = (u16)(d.year + (d.year < 70 ? 2000 : 1900));
    *out = d;
 }
+
+/*
+ * Waiting for the RTC to change the second: instead of polling the CMOS until
+ * the seconds change, which means slow port I/O for up to one second, enable
+ * the "update-ended" interrupt and sleep. The IRQ handler takes the system
+ * time at the edge, disables the interrupt and wakes up the waiter.
+ */
+static struct task *rtc_edge_waiter;
+static u64 rtc_edge_time;
+
+static enum irq_action rtc_irq_handler(void *ctx)
+{
+   ulong var;
+   u8 reg_c;
+
+   disable_interrupts(&var);
+   {
+      /* Reading the register C acks the IRQ */
+      reg_c = (u8)cmos_read_reg(REG_STATUS_REG_C);
+
+      if (reg_c & STATUS_REG_C_UPDATE_ENDED) {
+
+         cmos_write_reg(REG_STATUS_REG_B,
+                        (u8)cmos_read_reg(REG_STATUS_REG_B)
+                           & ~STATUS_REG_B_UPDATE_IRQ);
+
+         rtc_edge_time = get_sys_time();
+
+         if (rtc_edge_waiter)
+            task_update_wakeup_timer_if_any(rtc_edge_waiter, 1);
+      }
+   }
+   enable_interrupts(&var);
+   return reg_c & STATUS_REG_C_UPDATE_ENDED ? IRQ_HANDLED : IRQ_NOT_HANDLED;
+}
+
+DEFINE_IRQ_HANDLER_NODE(rtc_edge, rtc_irq_handler, NULL);
+
+int hw_clock_wait_edge(u64 *sys_time)
+{
+   u8 reg_b;
+
+   if (hw_read_clock != &hw_read_clock_cmos)
+      return -ENODEV;
+
+   rtc_edge_time = 0;
+   rtc_edge_waiter = get_curr_task();
+   irq_install_handler(X86_PC_RTC_IRQ, &rtc_edge);
+
+   disable_interrupts_forced();
+   {
+      reg_b = (u8)cmos_read_reg(REG_STATUS_REG_B);
+      cmos_write_reg(REG_STATUS_REG_B, reg_b | STATUS_REG_B_UPDATE_IRQ);
+      cmos_read_reg(REG_STATUS_REG_C); /* discard any stale IRQ */
+   }
+   enable_interrupts_forced();
+
+   /*
+    * The IRQ comes within a second and the handler cuts our sleep short. If
+    * it came before we started sleeping, we'd just wake up later: the time of
+    * the edge is saved anyway.
+    */
+   kernel_sleep(2 * TIMER_HZ);
+
+   disable_interrupts_forced();
+   {
+      reg_b = (u8)cmos_read_reg(REG_STATUS_REG_B);
+      cmos_write_reg(REG_STATUS_REG_B, reg_b & ~STATUS_REG_B_UPDATE_IRQ);
+      rtc_edge_waiter = NULL;
+      *sys_time = rtc_edge_time;
+   }
+   enable_interrupts_forced();
+
+   irq_uninstall_handler(X86_PC_RTC_IRQ, &rtc_edge);
+   return *sys_time ? 0 : -ETIMEDOUT;
+}
@@ -228,7 +228,7 @@ static struct syscall syscalls[MAX_SYSCALLS] =
    [157] = DECL_SYS(sys_sched_getscheduler, 0),
    [158] = DECL_SYS(sys_sched_yield, 0),
    [159] = DECL_SYS(sys_sched_get_priority_max, 0),
-   [160] = DECL_SYS(sys_sched_set_priority_min, 0),
+   [160] = DECL_SYS(sys_sched_get_priority_min, 0),
    [161] = DECL_SYS(sys_sched_rr_get_interval_time32, 0),
    [162] = DECL_SYS(sys_nanosleep_time32, 0),
    [163] = DECL_SYS(sys_mremap, 0),
@@ -556,6 +556,7 @@ static void do_special_syscall(regs_t *r)
    const bool preemptable = ~fl & SYSFL_NO_PREEMPT;
    const bool traceable = ~fl & SYSFL_NO_TRACE;
    const bool raw_regs = fl & SYSFL_RAW_REGS;
+   u64 start;
 
    if (signals)
       process_signals(curr, sig_pre_syscall, r);
@@ -563,13 +564,17 @@ static void do_special_syscall(regs_t *r)
    if (preemptable)
       enable_preemption();
 
+   start = trace_sys_stats_begin();
+
    if (traceable)
       trace_sys_enter(sn,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
 
    do_syscall_int(fptr, r, raw_regs);
 
-   if (traceable)
-      trace_sys_exit(sn,r->eax,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+   if (traceable) {
+      trace_sys_exit(sn,r->eax,start,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+      trace_sys_stats_end(sn, r->eax, start);
+   }
 
    if (preemptable)
       disable_preemption();
@@ -587,9 +592,11 @@ static void do_syscall(regs_t *r)
    process_signals(curr, sig_pre_syscall, r);
    enable_preemption();
    {
+      const u64 start = trace_sys_stats_begin();
       trace_sys_enter(sn,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
       do_syscall_int(fptr, r, false);
-      trace_sys_exit(sn,r->eax,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+      trace_sys_exit(sn,r->eax,start,r->ebx,r->ecx,r->edx,r->esi,r->edi,r->ebp);
+      trace_sys_stats_end(sn, r->eax, start);
    }
    disable_preemption();
    process_signals(curr, sig_in_syscall, r);
@@ -610,6 +617,19 @@ void handle_syscall(regs_t *r)
    save_current_task_state(r, false);
    set_current_task_in_kernel();
 
+   if (r->custom_flags & REGS_FL_SYSENTER) {
+
+      /*
+       * With sysenter, ebp contained the user ESP: the user's ebp (the 6th
+       * param) is at the top of the user stack. See sysenter_entry.
+       */
+      if (UNLIKELY(get_user(r->ebp, (ulong *)r->useresp))) {
+         r->eax = (ulong) -EFAULT;
+         set_current_task_in_user_mode();
+         return;
+      }
+   }
+
    if (LIKELY(sn < ARRAY_SIZE(syscalls))) {
 
       if (LIKELY(syscalls[sn].flags == 0))
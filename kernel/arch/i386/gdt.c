@@ -259,6 +259,12 @@ static void load_gdt(struct gdt_entry *g, u32 entries_count)
                : "memory");
 }
 
+/* The APs start with a temporary GDT: see ap_entry() */
+void gdt_load_on_ap(void)
+{
+   load_gdt(gdt, gdt_size);
+}
+
 void load_tss(u32 entry_index_in_gdt, u32 dpl)
 {
    ASSERT(!are_interrupts_enabled());
@@ -381,6 +387,15 @@ static void gdt_set_slot(struct process *pi, u16 slot, u16 gdt_index)
    get_proc_arch_fields(pi)->gdt_entries[slot] = gdt_index;
 }
 
+/*
+ * On i386, the FS/GS bases are set through set_thread_area() and the segment
+ * selectors: like Linux, reject the x86_64 ARCH_{GET,SET}_{FS,GS} codes.
+ */
+int sys_arch_prctl(int code, ulong addr)
+{
+   return -EINVAL;
+}
+
 int sys_set_thread_area(void *arg)
 {
    int rc = 0;
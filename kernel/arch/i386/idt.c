@@ -32,6 +32,11 @@ void load_idt(struct idt_entry *entries, u16 entries_count)
                : "memory");
 }
 
+void idt_load_on_ap(void)
+{
+   load_idt(idt, ARRAY_SIZE(idt));
+}
+
 
 void idt_set_entry(u8 num, void *handler, u16 selector, u8 flags)
 {
@@ -40,4 +40,5 @@ struct idt_entry {
 } PACKED;
 
 void load_idt(struct idt_entry *entries, u16 entries_count);
+void idt_load_on_ap(void);
 void idt_set_entry(u8 num, void *handler, u16 selector, u8 flags);
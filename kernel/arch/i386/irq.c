@@ -10,18 +10,22 @@
 
 #include "idt_int.h"
 #include "../generic_x86/pic.h"
+#include "../generic_x86/apic.h"
 
 
 /*
  * We first remap the interrupt controllers, and then we install
  * the appropriate ISRs to the correct entries in the IDT. This
- * is just like installing the exception handlers.
+ * is just like installing the exception handlers. The PIC is always
+ * initialized (and left masked): it's the fallback when the I/O APIC
+ * cannot be used.
  */
 
 void init_irq_handling(void)
 {
    ASSERT(!are_interrupts_enabled());
    init_pic_8259(32, 40);
+   init_apic_irq_routing();
 
    for (int i = 0; i < ARRAY_SIZE(irq_handlers_lists); i++) {
 
@@ -30,6 +34,7 @@ void init_irq_handling(void)
                     X86_KERNEL_CODE_SEL,
                     IDT_FLAG_PRESENT | IDT_FLAG_INT_GATE | IDT_FLAG_DPL0);
 
-      irq_set_mask(i);
+      if (i < X86_MSI_FIRST_IRQ)
+         irq_set_mask(i);
    }
 }
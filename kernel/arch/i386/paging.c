@@ -23,6 +23,10 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/vdso.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/lazyfree.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -40,6 +44,215 @@ pdir_get_page_table(pdir_t *pdir, u32 i)
    return PA_TO_LIN_VA(pdir->entries[i].ptaddr << PAGE_SHIFT);
 }
 
+/* Swap entries (ZRAM_SWAP): see PAGE_ZRAM */
+static ALWAYS_INLINE bool pte_is_swapped(page_t p)
+{
+   return ZRAM_SWAP && !p.present && (p.avail & PAGE_ZRAM);
+}
+
+/* True if the entry maps a page or it's a swap entry */
+static ALWAYS_INLINE bool pte_is_used(page_t p)
+{
+   return p.present || pte_is_swapped(p);
+}
+
+/*
+ * Page tables shared after fork(): see pdir_clone(). The frame descriptor of
+ * a shared page table counts the pdirs using it, while its PDEs are marked
+ * as read-only with PDE_SHARED_PT.
+ */
+static ALWAYS_INLINE struct pageframe *pt_get_pageframe(page_table_t *pt)
+{
+   struct pageframe *pf = pf_get(LIN_VA_TO_PA(pt));
+   ASSERT(pf != NULL);
+   return pf;
+}
+
+static void pdir_share_page_table(pdir_t *pdir, pdir_t *new_pdir, u32 pd_index)
+{
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   struct pageframe *pf = pt_get_pageframe(pdir_get_page_table(pdir, pd_index));
+
+   ASSERT(e->present && !e->psize);
+
+   if (!(e->avail & PDE_SHARED_PT)) {
+
+      ASSERT(pf->refcount == 0 && pf->mapcount == 0);
+      pf->refcount = 1;
+      pf->type = PF_TYPE_PGTABLE;
+
+      e->avail |= PDE_SHARED_PT;
+      e->rw = false;
+   }
+
+   pf->refcount++;
+   new_pdir->entries[pd_index].raw = e->raw;
+}
+
+/*
+ * Drops a reference to a shared page table. Returns true if the page table is
+ * still used by other pdirs, false if the caller was its last user: in that
+ * case, the page table is a regular (private) one again.
+ */
+static bool put_shared_page_table(page_table_t *pt)
+{
+   struct pageframe *pf = pt_get_pageframe(pt);
+
+   ASSERT(pf->type == PF_TYPE_PGTABLE && pf->refcount > 0);
+
+   if (--pf->refcount > 0)
+      return true;
+
+   pf->type = PF_TYPE_OTHER;
+   return false;
+}
+
+/*
+ * Gives `pdir` its own copy of a shared page table, marking as COW all of its
+ * non-shared pages: that's the work pdir_clone() did eagerly for every page
+ * table before the sharing was introduced. If `pdir` is the last user of the
+ * page table, it just takes it back, without copying anything.
+ */
+static int pdir_unshare_page_table(pdir_t *pdir, u32 pd_index)
+{
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   page_table_t *pt = pdir_get_page_table(pdir, pd_index);
+   page_table_t *new_pt;
+
+   ASSERT(e->present && !e->psize);
+   ASSERT(e->avail & PDE_SHARED_PT);
+
+   if (pt_get_pageframe(pt)->refcount > 1) {
+
+      if (!(new_pt = kmalloc_long_lived(sizeof(page_table_t))))
+         return -ENOMEM;
+
+      ASSERT(IS_PAGE_ALIGNED(new_pt));
+
+      for (u32 j = 0; j < 1024; j++) {
+
+         page_t *const p = &pt->pages[j];
+
+         /* The copy of a swap entry is a new user of its zram slot */
+         if (pte_is_swapped(*p)) {
+            zram_slot_get(p->pageAddr);
+            continue;
+         }
+
+         if (!p->present)
+            continue;
+
+         /* Sanity-check: a mapped page MUST have ref-count > 0 */
+         ASSERT(pf_ref_count_get((ulong)p->pageAddr << PAGE_SHIFT) > 0);
+
+         if (!(p->avail & PAGE_SHARED)) {
+
+            if (p->rw)
+               p->avail |= PAGE_COW_ORIG_RW;
+
+            p->rw = false;
+         }
+
+         pf_ref_count_inc((ulong)p->pageAddr << PAGE_SHIFT);
+      }
+
+      memcpy32(new_pt, pt, sizeof(page_table_t) / 4);
+      e->ptaddr = SHR_BITS(LIN_VA_TO_PA(new_pt), PAGE_SHIFT, u32);
+   }
+
+   /*
+    * Drop our reference to the old page table only now: if the allocation
+    * above failed, nothing has changed. When there was no copy, `pt` just
+    * becomes private again.
+    */
+   put_shared_page_table(pt);
+
+   e->avail &= ~PDE_SHARED_PT;
+   e->rw = true;
+
+   /*
+    * All the TLB entries for the whole 4 MB region have been created through
+    * a read-only PDE and some pages are now COW: flush the whole TLB, as fork
+    * does. The pdirs still sharing `pt` are not in use right now.
+    */
+   if (pdir == get_curr_pdir())
+      set_curr_pdir(pdir);
+
+   return 0;
+}
+
+static ALWAYS_INLINE int pdir_make_pt_private(pdir_t *pdir, u32 pd_index)
+{
+   if (UNLIKELY(pdir->entries[pd_index].avail & PDE_SHARED_PT))
+      return pdir_unshare_page_table(pdir, pd_index);
+
+   return 0;
+}
+
+static bool handle_fault_oom(const char *what)
+{
+   struct task *curr = get_curr_task();
+
+   if (!in_syscall(curr)) {
+
+      // The task was not running in kernel: we can safely kill it.
+      printk("Out-of-memory: killing pid %d\n", get_curr_pid());
+      send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
+      return true;
+
+   } else {
+
+      // We cannot kill a task running in kernel during a CoW page fault
+      // In this case (but in the one above too), Linux puts the process to
+      // sleep, while the OOM killer runs and frees some memory.
+      panic("Out-of-memory: can't %s [pid %d]", what, get_curr_pid());
+   }
+}
+
+/*
+ * Fault-around for the anonymous memory, mapped to the zero page copy-on-write
+ * (see map_zero_page()): the first write in an aligned window of
+ * ANON_FAULT_AROUND_PAGES pages allocates pages also for the other zero pages
+ * of the window, as most likely they're going to be written soon too (e.g. a
+ * buffer initialized sequentially). That saves most of the page faults. It's
+ * just an optimization: we stop at the first allocation failure.
+ */
+static void
+cow_fault_around_zero_pages(page_table_t *pt, u32 pt_index, u32 vaddr)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(&zero_page);
+   const u32 first = pt_index & ~(ANON_FAULT_AROUND_PAGES - 1u);
+   const u32 pt_vaddr = vaddr & ~((1u << BIG_PAGE_SHIFT) - 1);
+   page_t *pg;
+   void *va;
+   ulong paddr;
+
+   for (u32 j = first; j < first + ANON_FAULT_AROUND_PAGES; j++) {
+
+      pg = &pt->pages[j];
+
+      if (!pg->present || pg->rw || !(pg->avail & PAGE_COW_ORIG_RW))
+         continue;
+
+      if (((ulong)pg->pageAddr << PAGE_SHIFT) != zero_paddr)
+         continue;
+
+      if (!(va = zpool_alloc_page()))
+         break;
+
+      paddr = LIN_VA_TO_PA(va);
+
+      ASSERT(pf_ref_count_get(paddr) == 0);
+      pf_ref_count_inc(paddr);
+      pf_ref_count_dec(zero_paddr);
+
+      pg->pageAddr = SHR_BITS(paddr, PAGE_SHIFT, u32);
+      pg->rw = true;
+      pg->avail = 0;
+      invalidate_page_hw(pt_vaddr + (j << PAGE_SHIFT));
+   }
+}
+
 bool handle_potential_cow(void *context)
 {
    regs_t *r = context;
@@ -53,7 +266,29 @@ bool handle_potential_cow(void *context)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
    const void *const page_vaddr = (void *)(vaddr & PAGE_MASK);
-   page_table_t *pt = pdir_get_page_table(get_curr_pdir(), pd_index);
+   pdir_t *pdir = get_curr_pdir();
+   page_table_t *pt;
+   page_t page;
+
+   if (pdir->entries[pd_index].psize)
+      return false; /* User big pages are never COW: see pdir_clone() */
+
+   pt = pdir_get_page_table(pdir, pd_index);
+   page = pt->pages[pt_index];
+
+   if (!page.rw && !(page.avail & PAGE_COW_ORIG_RW))
+      return false; /* A truly read-only page */
+
+   if (pdir->entries[pd_index].avail & PDE_SHARED_PT) {
+
+      if (pdir_unshare_page_table(pdir, pd_index) < 0)
+         return handle_fault_oom("copy a CoW page");
+
+      pt = pdir_get_page_table(pdir, pd_index);
+
+      if (pt->pages[pt_index].rw)
+         return true; /* A shared page: it was read-only just because of PDE */
+   }
 
    if (!(pt->pages[pt_index].avail & PAGE_COW_ORIG_RW))
       return false; /* Not a COW page */
@@ -72,40 +307,31 @@ bool handle_potential_cow(void *context)
       ASSERT(paddr != KERNEL_VA_TO_PA(&zero_page));
 #endif
 
+      struct pageframe *pf = pf_get(orig_page_paddr);
+
+      if (pf && pf->type == PF_TYPE_LAZYFREE)
+         pf->type = PF_TYPE_OTHER;  /* Written after MADV_FREE: keep it */
+
       pt->pages[pt_index].rw = true;
       pt->pages[pt_index].avail = 0;
       invalidate_page_hw(vaddr);
       return true;
    }
 
-   // Allocate a new page.
-   void *new_page_vaddr = kmalloc(PAGE_SIZE);
+   const bool was_zero_page = orig_page_paddr == KERNEL_VA_TO_PA(&zero_page);
 
-   if (!new_page_vaddr) {
+   // Allocate a new page: an already zeroed one, for the zero page.
+   void *new_page_vaddr =
+      was_zero_page ? zpool_alloc_page() : kmalloc(PAGE_SIZE);
 
-      // Out-of-memory case
-      struct task *curr = get_curr_task();
-
-      if (!in_syscall(curr)) {
-
-         // The task was not running in kernel: we can safely kill it.
-         printk("Out-of-memory: killing pid %d\n", get_curr_pid());
-         send_signal(get_curr_pid(), SIGKILL, SIG_FL_PROCESS | SIG_FL_FAULT);
-         return true;
-
-      } else {
-
-         // We cannot kill a task running in kernel during a CoW page fault
-         // In this case (but in the one above too), Linux puts the process to
-         // sleep, while the OOM killer runs and frees some memory.
-         panic("Out-of-memory: can't copy a CoW page [pid %d]", get_curr_pid());
-      }
-   }
+   if (!new_page_vaddr)
+      return handle_fault_oom("copy a CoW page");
 
    ASSERT(IS_PAGE_ALIGNED(new_page_vaddr));
 
    // Copy page's contents
-   memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
+   if (!was_zero_page)
+      fast_copy_page(new_page_vaddr, page_vaddr);
 
    // Get the paddr of the new page
    const ulong paddr = LIN_VA_TO_PA(new_page_vaddr);
@@ -125,6 +351,83 @@ bool handle_potential_cow(void *context)
    pt->pages[pt_index].avail = 0;
 
    invalidate_page_hw(vaddr);
+
+   if (was_zero_page)
+      cow_fault_around_zero_pages(pt, pt_index, vaddr);
+
+   return true;
+}
+
+/*
+ * Replaces the swap entry for `vaddr` with a new page, holding the content
+ * stored in its zram slot. Returns 0 or -ENOMEM.
+ */
+static int pdir_swap_in_page(pdir_t *pdir, ulong vaddr)
+{
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_table_t *pt;
+   page_t *p;
+   ulong paddr;
+   void *va;
+
+   if (pdir_make_pt_private(pdir, pd_index))
+      return -ENOMEM;
+
+   if (!(va = kmalloc(PAGE_SIZE)))
+      return -ENOMEM;
+
+   ASSERT(IS_PAGE_ALIGNED(va));
+   pt = pdir_get_page_table(pdir, pd_index);
+   p = &pt->pages[pt_index];
+   ASSERT(pte_is_swapped(*p));
+
+   zram_load_and_put(p->pageAddr, va);
+   paddr = LIN_VA_TO_PA(va);
+
+   ASSERT(pf_ref_count_get(paddr) == 0);
+   pf_ref_count_inc(paddr);
+
+   /* Non-present entries are never cached in the TLB: no need to invalidate */
+   p->raw = PG_PRESENT_BIT | (p->raw & (PG_RW_BIT | PG_US_BIT)) | paddr;
+   return 0;
+}
+
+/*
+ * Called for every non-present page fault, also for the ones caused by the
+ * kernel accessing user memory (e.g. copy_to_user()) and, therefore, before
+ * the exception table fixups.
+ */
+bool handle_potential_swap_in(void *context)
+{
+   regs_t *r = context;
+   pdir_t *pdir;
+   page_dir_entry_t e;
+   page_table_t *pt;
+   u32 vaddr;
+
+   if (!ZRAM_SWAP || (r->err_code & PAGE_FAULT_FL_PRESENT))
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr >= BASE_VA)
+      return false;
+
+   pdir = get_curr_pdir();
+   e = pdir->entries[vaddr >> BIG_PAGE_SHIFT];
+
+   if (!e.present || e.psize)
+      return false;
+
+   pt = PA_TO_LIN_VA(e.ptaddr << PAGE_SHIFT);
+
+   if (!pte_is_swapped(pt->pages[(vaddr >> PAGE_SHIFT) & 1023]))
+      return false;
+
+   if (pdir_swap_in_page(pdir, vaddr & PAGE_MASK))
+      return handle_fault_oom("swap in a page");
+
    return true;
 }
 
@@ -132,6 +435,11 @@ static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
 {
    long off = 0;
    const char *sym_name = find_sym_at_addr_safe(r->eip, &off, NULL);
+
+   if (is_kernel_stack_guard_page(vaddr))
+      panic("Kernel stack overflow: %p, EIP: %p [%s + %d]\n",
+            vaddr, r->eip, sym_name ? sym_name : "???", off);
+
    panic("PAGE FAULT in attempt to %s %p from %s%s\nEIP: %p [%s + %d]\n",
          rw ? "WRITE" : "READ",
          vaddr,
@@ -151,6 +459,8 @@ void handle_page_fault_int(regs_t *r)
    int sig = SIGSEGV;
    struct user_mapping *um;
 
+   trace_point(tp_page_fault, vaddr, r->eip, rw);
+
    if (!us) {
       /*
        * Tilck does not support kernel-space page faults caused by the kernel,
@@ -167,9 +477,10 @@ void handle_page_fault_int(regs_t *r)
 
       /*
        * Call vfs_handle_fault() only if in first place the mapping allowed
-       * writing or if it didn't but the memory access type was a READ.
+       * writing or if it didn't but the memory access type was a READ. The
+       * private mappings (um->h == NULL) have all of their pages mapped.
        */
-      if (!!(um->prot & PROT_WRITE) || !rw) {
+      if (um->h && (!!(um->prot & PROT_WRITE) || !rw)) {
 
          if (vfs_handle_fault(um, (void *)vaddr, p, rw))
             return;
@@ -202,6 +513,113 @@ void handle_page_fault_int(regs_t *r)
    send_signal(get_curr_tid(), sig, SIG_FL_PROCESS | SIG_FL_FAULT);
 }
 
+/*
+ * User big pages are split in regular pages on demand (partial unmaps, fork,
+ * etc.). That's simple because the ref-count of each pageframe is kept also
+ * for the pageframes inside a big page.
+ */
+static int split_user_big_page(pdir_t *pdir, u32 pd_index)
+{
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   const ulong paddr = (ulong)e->big_4mb_page.paddr << BIG_PAGE_SHIFT;
+   const u32 pg_flags = PG_PRESENT_BIT | PG_US_BIT | (e->rw ? PG_RW_BIT : 0);
+   page_table_t *pt;
+
+   ASSERT(pd_index < BASE_VADDR_PD_IDX);
+   ASSERT(e->present && e->psize);
+
+   if (!(pt = kalloc_obj(page_table_t)))
+      return -ENOMEM;
+
+   ASSERT(IS_PAGE_ALIGNED(pt));
+
+   for (u32 j = 0; j < 1024; j++)
+      pt->pages[j].raw = pg_flags | (paddr + (j << PAGE_SHIFT));
+
+   e->raw = PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | LIN_VA_TO_PA(pt);
+
+   /* A single INVLPG flushes the whole 4-MB TLB entry */
+   invalidate_page_hw(pd_index << BIG_PAGE_SHIFT);
+   return 0;
+}
+
+/*
+ * Drops a whole user big page at once, without splitting it. Returns false
+ * if `vaddr` is not the beginning of a user big page.
+ */
+static bool unmap_whole_user_big_page(pdir_t *pdir, ulong vaddr, bool do_free)
+{
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   ulong paddr;
+
+   if ((vaddr & (4 * MB - 1)) || !e->present || !e->psize)
+      return false;
+
+   paddr = (ulong)e->big_4mb_page.paddr << BIG_PAGE_SHIFT;
+   e->raw = 0;
+   invalidate_page_hw(vaddr);
+
+   for (u32 j = 0; j < 1024; j++, paddr += PAGE_SIZE) {
+      if (!pf_ref_count_dec(paddr) && do_free)
+         kfree2(PA_TO_LIN_VA(paddr), PAGE_SIZE);
+   }
+
+   return true;
+}
+
+size_t get_user_big_page_size(void)
+{
+   return 4 * MB;
+}
+
+NODISCARD int
+map_user_big_page(pdir_t *pdir, void *vaddrp, ulong paddr, bool rw)
+{
+   const ulong vaddr = (ulong) vaddrp;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+
+   ASSERT(vaddr < BASE_VA);
+
+   if ((vaddr & (4 * MB - 1)) || (paddr & (4 * MB - 1)))
+      return -EINVAL;
+
+   if (e->present) {
+
+      page_table_t *pt;
+
+      if (e->psize)
+         return -EADDRINUSE;
+
+      if (pdir_make_pt_private(pdir, pd_index))
+         return -ENOMEM;
+
+      /*
+       * Page tables are never freed by unmap_page(): we can replace with a
+       * big page only a page table with no pages mapped.
+       */
+
+      pt = pdir_get_page_table(pdir, pd_index);
+
+      for (u32 j = 0; j < 1024; j++) {
+         if (pte_is_used(pt->pages[j]))
+            return -EADDRINUSE;
+      }
+
+      e->raw = 0;
+      kfree_obj(pt, page_table_t);
+   }
+
+   for (u32 j = 0; j < 1024; j++)
+      pf_ref_count_inc(paddr + (j << PAGE_SHIFT));
+
+   e->raw = PG_PRESENT_BIT | PG_US_BIT | PG_4MB_BIT | (rw ? PG_RW_BIT : 0);
+   e->raw |= paddr;
+   invalidate_page_hw(vaddr);
+   return 0;
+}
+
 bool is_mapped(pdir_t *pdir, void *vaddrp)
 {
    page_table_t *pt;
@@ -218,7 +636,7 @@ bool is_mapped(pdir_t *pdir, void *vaddrp)
       return e->present;
 
    pt = PA_TO_LIN_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   return pt->pages[pt_index].present;
+   return pte_is_used(pt->pages[pt_index]);
 }
 
 bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
@@ -237,32 +655,122 @@ bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
    if (e->psize) /* 4-MB page */
       return e->present && e->rw;
 
+   /* The page tables shared after fork() are read-only: see PDE_SHARED_PT */
+   if (!e->rw)
+      return false;
+
    pt = PA_TO_LIN_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    page = pt->pages[pt_index];
-   return page.present && page.rw;
+   return pte_is_used(page) && page.rw;
 }
 
-void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+static void __set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
 {
    page_table_t *pt;
    const ulong vaddr = (ulong) vaddrp;
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   /* Used only for ELF and file mappings: never backed by big pages */
+   ASSERT(!pdir->entries[pd_index].psize);
+
+   if (pdir_make_pt_private(pdir, pd_index))
+      panic("Out-of-memory: unable to copy a shared page table");
+
    pt = PA_TO_LIN_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(LIN_VA_TO_PA(pt) != 0);
    pt->pages[pt_index].rw = rw;
-   invalidate_page_hw(vaddr);
 }
 
+void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+{
+   __set_page_rw(pdir, vaddrp, rw);
+   invalidate_page_hw((ulong)vaddrp);
+}
+
+void set_pages_rw(pdir_t *pdir, void *vaddrp, size_t page_count, bool rw)
+{
+   for (size_t i = 0; i < page_count; i++)
+      __set_page_rw(pdir, (char *)vaddrp + (i << PAGE_SHIFT), rw);
+
+   invalidate_pages(pdir, vaddrp, page_count);
+}
+
+void swap_pages(pdir_t *pdir, void *vaddrp1, void *vaddrp2)
+{
+   page_table_t *pt1, *pt2;
+   const ulong va1 = (ulong) vaddrp1;
+   const ulong va2 = (ulong) vaddrp2;
+   const u32 pt_index1 = (va1 >> PAGE_SHIFT) & 1023;
+   const u32 pt_index2 = (va2 >> PAGE_SHIFT) & 1023;
+   const u32 pd_index1 = (va1 >> BIG_PAGE_SHIFT);
+   const u32 pd_index2 = (va2 >> BIG_PAGE_SHIFT);
+   page_t tmp;
+
+   if (pdir->entries[pd_index1].psize)
+      if (split_user_big_page(pdir, pd_index1))
+         panic("Out-of-memory: unable to split a user big page");
+
+   if (pdir->entries[pd_index2].psize)
+      if (split_user_big_page(pdir, pd_index2))
+         panic("Out-of-memory: unable to split a user big page");
+
+   if (pdir_make_pt_private(pdir, pd_index1) ||
+       pdir_make_pt_private(pdir, pd_index2))
+   {
+      panic("Out-of-memory: unable to copy a shared page table");
+   }
+
+   pt1 = PA_TO_LIN_VA(pdir->entries[pd_index1].ptaddr << PAGE_SHIFT);
+   pt2 = PA_TO_LIN_VA(pdir->entries[pd_index2].ptaddr << PAGE_SHIFT);
+   ASSERT(LIN_VA_TO_PA(pt1) != 0 && LIN_VA_TO_PA(pt2) != 0);
+   ASSERT(pte_is_used(pt1->pages[pt_index1]));
+   ASSERT(pte_is_used(pt2->pages[pt_index2]));
+
+   tmp = pt1->pages[pt_index1];
+   pt1->pages[pt_index1] = pt2->pages[pt_index2];
+   pt2->pages[pt_index2] = tmp;
+
+   invalidate_page_hw(va1);
+   invalidate_page_hw(va2);
+}
+
+/*
+ * When `inval` is false, the caller is responsible for invalidating the TLB
+ * entry, usually with a single invalidate_pages() call for a whole range.
+ */
 static inline int
-__unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
+__unmap_page(pdir_t *pdir,
+             void *vaddrp,
+             bool free_pageframe,
+             bool permissive,
+             bool inval)
 {
    page_table_t *pt;
    const ulong vaddr = (ulong) vaddrp;
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   if (pdir->entries[pd_index].psize) {
+
+      /* Partial unmap of a user big page: split it first */
+      if (split_user_big_page(pdir, pd_index)) {
+
+         if (permissive)
+            return -ENOMEM;
+
+         panic("Out-of-memory: unable to split a user big page");
+      }
+   }
+
+   if (pdir_make_pt_private(pdir, pd_index)) {
+
+      if (permissive)
+         return -ENOMEM;
+
+      panic("Out-of-memory: unable to copy a shared page table");
+   }
+
    pt = PA_TO_LIN_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
 
    if (permissive) {
@@ -270,21 +778,29 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       if (LIN_VA_TO_PA(pt) == 0)
          return -EINVAL;
 
-      if (!pt->pages[pt_index].present)
+      if (!pte_is_used(pt->pages[pt_index]))
          return -EINVAL;
 
    } else {
       ASSERT(LIN_VA_TO_PA(pt) != 0);
-      ASSERT(pt->pages[pt_index].present);
+      ASSERT(pte_is_used(pt->pages[pt_index]));
+   }
+
+   if (pte_is_swapped(pt->pages[pt_index])) {
+      zram_slot_put(pt->pages[pt_index].pageAddr);
+      pt->pages[pt_index].raw = 0;
+      return 0;
    }
 
    const ulong paddr = (ulong)
       pt->pages[pt_index].pageAddr << PAGE_SHIFT;
 
    pt->pages[pt_index].raw = 0;
-   invalidate_page_hw(vaddr);
 
-   if (!pf_ref_count_dec(paddr) && free_pageframe) {
+   if (inval)
+      invalidate_page_hw(vaddr);
+
+   if (!pf_ref_count_dec(paddr) && free_pageframe) {
       ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
       kfree2(PA_TO_LIN_VA(paddr), PAGE_SIZE);
    }
@@ -295,13 +811,91 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
 void
 unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   __unmap_page(pdir, vaddrp, free_pageframe, false);
+   __unmap_page(pdir, vaddrp, free_pageframe, false, true);
 }
 
 int
 unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   return __unmap_page(pdir, vaddrp, free_pageframe, true);
+   return __unmap_page(pdir, vaddrp, free_pageframe, true, true);
+}
+
+/*
+ * Unmapping doesn't free the page tables by itself, so a process mapping and
+ * unmapping buffers at always different addresses would accumulate empty page
+ * tables until its death. Therefore, after unmapping a user range, we check
+ * whether its private page tables became empty and free them. That requires
+ * scanning them, but only the (at most two) tables partially covered by the
+ * range can have other used entries: the rest were just fully cleared.
+ *
+ * The empty tables are first detached from the pdir and chained through
+ * their first entry. Only after the TLB flush for the whole range, which
+ * drops any cached paging-structure entry as well, they're actually freed.
+ */
+static bool pt_is_empty(page_table_t *pt, u32 start, u32 end)
+{
+   for (u32 j = 0; j < start; j++)
+      if (pte_is_used(pt->pages[j]))
+         return false;
+
+   for (u32 j = end; j < 1024; j++)
+      if (pte_is_used(pt->pages[j]))
+         return false;
+
+   return true;
+}
+
+static void
+unmap_range_done(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   const ulong vaddr = (ulong)vaddrp;
+   const ulong end = vaddr + (page_count << PAGE_SHIFT);
+   const u32 first_pd_index = vaddr >> BIG_PAGE_SHIFT;
+   const u32 last_pd_index = (end - 1) >> BIG_PAGE_SHIFT;
+   page_table_t *to_free = NULL;
+   page_table_t *pt;
+
+   if (vaddr >= BASE_VA || !page_count) {
+      invalidate_pages(pdir, vaddrp, page_count);
+      return;
+   }
+
+   for (u32 i = first_pd_index; i <= last_pd_index; i++) {
+
+      page_dir_entry_t *e = &pdir->entries[i];
+      const ulong pt_va = (ulong)i << BIG_PAGE_SHIFT;
+      const ulong s = MAX(vaddr, pt_va);
+      const ulong t = MIN(end, pt_va + 4 * MB);
+
+      if (i >= BASE_VADDR_PD_IDX)
+         break;
+
+      if (!e->present || e->psize || (e->avail & PDE_SHARED_PT))
+         continue;
+
+      pt = pdir_get_page_table(pdir, i);
+
+      /* [s, t) has just been unmapped: its entries are certainly unused */
+      if (!pt_is_empty(pt,
+                       (u32)((s - pt_va) >> PAGE_SHIFT),
+                       (u32)((t - pt_va) >> PAGE_SHIFT)))
+      {
+         continue;
+      }
+
+      e->raw = 0;
+      pt->pages[0].raw = (ulong)to_free;
+      to_free = pt;
+   }
+
+   invalidate_pages(pdir, vaddrp, page_count);
+
+   while (to_free) {
+      pt = to_free;
+      to_free = (page_table_t *)pt->pages[0].raw;
+      pt->pages[0].raw = 0;
+      kfree_obj(pt, page_table_t);
+   }
 }
 
 void
@@ -310,9 +904,24 @@ unmap_pages(pdir_t *pdir,
             size_t page_count,
             bool do_free)
 {
-   for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
+   size_t i = 0;
+
+   while (i < page_count) {
+
+      const ulong va = (ulong)vaddr + (i << PAGE_SHIFT);
+
+      if (page_count - i >= 1024) {
+         if (unmap_whole_user_big_page(pdir, va, do_free)) {
+            i += 1024;
+            continue;
+         }
+      }
+
+      __unmap_page(pdir, (void *)va, do_free, false, false);
+      i++;
    }
+
+   unmap_range_done(pdir, vaddr, page_count);
 }
 
 size_t
@@ -325,14 +934,15 @@ unmap_pages_permissive(pdir_t *pdir,
    int rc;
 
    for (size_t i = 0; i < page_count; i++) {
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+      rc = __unmap_page(pdir,
+                        (char *)vaddr + (i << PAGE_SHIFT),
+                        do_free,
+                        true,
+                        false);
       unmapped_pages += (rc == 0);
    }
 
+   unmap_range_done(pdir, vaddr, page_count);
    return unmapped_pages;
 }
 
@@ -353,12 +963,27 @@ ulong get_mapping(pdir_t *pdir, void *vaddrp)
 
    e.raw = pdir->entries[pd_index].raw;
    ASSERT(e.present);
+
+   if (e.psize) {
+      return ((ulong) e.big_4mb_page.paddr << BIG_PAGE_SHIFT) |
+             (vaddr & (4 * MB - 1));
+   }
+
    ASSERT(e.ptaddr != 0);
 
    pt = PA_TO_LIN_VA(e.ptaddr << PAGE_SHIFT);
    p.raw = pt->pages[pt_index].raw;
-   ASSERT(p.present);
 
+   if (pte_is_swapped(p)) {
+
+      if (pdir_swap_in_page(pdir, vaddr & PAGE_MASK))
+         panic("Out-of-memory: unable to swap in a page");
+
+      pt = pdir_get_page_table(pdir, pd_index);
+      p.raw = pt->pages[pt_index].raw;
+   }
+
+   ASSERT(p.present);
    return ((ulong) p.pageAddr << PAGE_SHIFT) | (vaddr & OFFSET_IN_PAGE_MASK);
 }
 
@@ -389,6 +1014,15 @@ int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref)
       /* Get the page entry for `vaddr` within the page table */
       p.raw = pt->pages[pt_index].raw;
 
+      if (pte_is_swapped(p)) {
+
+         if (pdir_swap_in_page(pdir, vaddr & PAGE_MASK))
+            return -ENOMEM;
+
+         pt = pdir_get_page_table(pdir, pd_index);
+         p.raw = pt->pages[pt_index].raw;
+      }
+
       if (!p.present)
          return -EFAULT;
 
@@ -417,13 +1051,16 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, ulong hw_flags)
    ASSERT(!(vaddr & OFFSET_IN_PAGE_MASK)); // the vaddr must be page-aligned
    ASSERT(!(paddr & OFFSET_IN_PAGE_MASK)); // the paddr must be page-aligned
 
+   if (UNLIKELY(pdir_make_pt_private(pdir, pd_index)))
+      return -ENOMEM;
+
    pt = PA_TO_LIN_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(IS_PAGE_ALIGNED(pt));
 
    if (UNLIKELY(LIN_VA_TO_PA(pt) == 0)) {
 
       // we have to create a page table for mapping 'vaddr'.
-      pt = kzalloc_obj(page_table_t);
+      pt = kzmalloc_long_lived(sizeof(page_table_t));
 
       if (UNLIKELY(!pt))
          return -ENOMEM;
@@ -437,7 +1074,7 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, ulong hw_flags)
          LIN_VA_TO_PA(pt);
    }
 
-   if (pt->pages[pt_index].present)
+   if (pte_is_used(pt->pages[pt_index]))
       return -EADDRINUSE;
 
    pt->pages[pt_index].raw = PG_PRESENT_BIT | hw_flags | paddr;
@@ -510,7 +1147,7 @@ out:
 NODISCARD int
 map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
 {
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool us = !!(pg_flags & PAGING_FL_US);
    u32 avail_bits = 0;
    int rc;
@@ -518,16 +1155,24 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+      ASSERT(!(pg_flags & PAGING_FL_COW_INCOMPAT));
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC) {
 
       void *va;
       ASSERT(paddr == 0);
 
-      if (!(va = kmalloc(PAGE_SIZE)))
-         return -ENOMEM;
-
       if (pg_flags & PAGING_FL_ZERO_PG)
-         bzero(va, PAGE_SIZE);
+         va = zpool_alloc_page();
+      else
+         va = kmalloc(PAGE_SIZE);
+
+      if (!va)
+         return -ENOMEM;
 
       paddr = LIN_VA_TO_PA(va);
 
@@ -584,13 +1229,19 @@ map_pages(pdir_t *pdir,
           u32 pg_flags)
 {
    const bool us = !!(pg_flags & PAGING_FL_US);
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool big_pages = !!(pg_flags & PAGING_FL_BIG_PAGES_ALLOWED);
    u32 avail_bits = 0;
 
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+      ASSERT(!(pg_flags & PAGING_FL_COW_INCOMPAT));
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC)
       NOT_IMPLEMENTED();
 
@@ -606,75 +1257,55 @@ map_pages(pdir_t *pdir,
                     (u32)((!us) << PG_GLOBAL_BIT_POS));
 }
 
-pdir_t *pdir_clone(pdir_t *pdir)
+static int split_all_user_big_pages(pdir_t *pdir)
 {
-   pdir_t *new_pdir = kalloc_obj(pdir_t);
-
-   if (!new_pdir)
-      return NULL;
-
-   ASSERT(IS_PAGE_ALIGNED(new_pdir));
-   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
-
    for (u32 i = 0; i < BASE_VADDR_PD_IDX; i++) {
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
-
-      if (!pdir->entries[i].present)
+      if (!pdir->entries[i].present || !pdir->entries[i].psize)
          continue;
 
-      page_table_t *pt = kalloc_obj(page_table_t);
+      if (split_user_big_page(pdir, i))
+         return -ENOMEM;
+   }
 
-      if (UNLIKELY(!pt)) {
+   return 0;
+}
 
-         for (; i > 0; i--) {
-            if (pdir->entries[i - 1].present)
-               kfree_obj(pdir_get_page_table(pdir, i - 1), page_table_t);
-         }
+pdir_t *pdir_clone(pdir_t *pdir)
+{
+   pdir_t *new_pdir = kalloc_obj(pdir_t);
 
-         kfree_obj(new_pdir, pdir_t);
-         return NULL;
-      }
+   if (!new_pdir)
+      return NULL;
 
-      ASSERT(IS_PAGE_ALIGNED(pt));
-      new_pdir->entries[i].ptaddr=SHR_BITS(LIN_VA_TO_PA(pt),PAGE_SHIFT,u32);
+   /*
+    * COW works at page granularity: split all the user big pages before
+    * cloning. After that, the parent won't use big pages anymore for those
+    * ranges, but that's the price for a correct (and simple) COW.
+    */
+   if (split_all_user_big_pages(pdir)) {
+      kfree_obj(new_pdir, pdir_t);
+      return NULL;
    }
 
+   ASSERT(IS_PAGE_ALIGNED(new_pdir));
+   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
+
+   /*
+    * Don't copy the page tables: share them, read-only, between the two pdirs.
+    * Because x86 combines the RW bits of the PDE and the PTE, any write to the
+    * 4 MB covered by a shared page table faults, in both the processes. Only
+    * then the page table gets copied and its pages marked as COW, in
+    * pdir_unshare_page_table(). Therefore, fork() costs just a walk
+    * on the page directory and the page tables never touched after that (the
+    * common case with fork + execve) are never copied.
+    */
    for (u32 i = 0; i < BASE_VADDR_PD_IDX; i++) {
 
       if (!pdir->entries[i].present)
          continue;
 
-      page_table_t *orig_pt = pdir_get_page_table(pdir, i);
-      page_table_t *new_pt = pdir_get_page_table(new_pdir, i);
-
-      /* Mark all the non-shared pages in that page-table as COW. */
-      for (u32 j = 0; j < 1024; j++) {
-
-         page_t *const p = &orig_pt->pages[j];
-
-         if (!p->present)
-            continue;
-
-         const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
-
-         /* Sanity-check: a mapped page MUST have ref-count > 0 */
-         ASSERT(pf_ref_count_get(orig_paddr) > 0);
-
-         if (!(p->avail & PAGE_SHARED)) {
-
-            if (p->rw)
-               p->avail |= PAGE_COW_ORIG_RW;
-
-            p->rw = false;
-         }
-
-         pf_ref_count_inc(orig_paddr);
-      }
-
-      // copy the page table
-      memcpy(new_pt, orig_pt, sizeof(page_table_t));
+      pdir_share_page_table(pdir, new_pdir, i);
    }
 
    return new_pdir;
@@ -687,6 +1318,10 @@ pdir_deep_clone(pdir_t *pdir)
    STATIC_ASSERT(sizeof(page_table_t) == PAGE_SIZE);
 
    struct kmalloc_acc acc;
+
+   if (split_all_user_big_pages(pdir))
+      return NULL;
+
    kmalloc_create_accelerator(&acc, PAGE_SIZE, 4);
 
    pdir_t *new_pdir = kmalloc_accelerator_get_elem(&acc);
@@ -699,13 +1334,15 @@ pdir_deep_clone(pdir_t *pdir)
    for (u32 i = 0; i < BASE_VADDR_PD_IDX; i++) {
 
       new_pdir->entries[i].raw = pdir->entries[i].raw;
-
-      /* User-space cannot use 4-MB pages */
       ASSERT(!pdir->entries[i].psize);
 
       if (!pdir->entries[i].present)
          continue;
 
+      /* The new page table is private, even if the original one is not */
+      new_pdir->entries[i].avail &= ~PDE_SHARED_PT;
+      new_pdir->entries[i].rw = true;
+
       page_table_t *orig_pt = pdir_get_page_table(pdir, i);
       page_table_t *new_pt = kmalloc_accelerator_get_elem(&acc);
 
@@ -718,6 +1355,11 @@ pdir_deep_clone(pdir_t *pdir)
 
          new_pt->pages[j].raw = orig_pt->pages[j].raw;
 
+         if (pte_is_swapped(orig_pt->pages[j])) {
+            zram_slot_get(orig_pt->pages[j].pageAddr);
+            continue;
+         }
+
          if (!orig_pt->pages[j].present)
             continue;
 
@@ -737,7 +1379,7 @@ pdir_deep_clone(pdir_t *pdir)
          ASSERT(pf_ref_count_get(new_page_paddr) == 0);
          pf_ref_count_inc(new_page_paddr);
 
-         memcpy32(new_page, orig_page, PAGE_SIZE / 4);
+         fast_copy_page(new_page, orig_page);
          new_pt->pages[j].pageAddr = SHR_BITS(new_page_paddr, PAGE_SHIFT, u32);
       }
 
@@ -762,7 +1404,7 @@ oom_exit:
    return NULL;
 }
 
-void pdir_destroy(pdir_t *pdir)
+static void pdir_destroy_int(pdir_t *pdir, bool preemptible)
 {
    // Kernel's pdir cannot be destroyed!
    ASSERT(pdir != __kernel_pdir);
@@ -772,10 +1414,28 @@ void pdir_destroy(pdir_t *pdir)
       if (!pdir->entries[i].present)
          continue;
 
+      if (preemptible)
+         cond_resched_preempt_disabled();
+
+      if (pdir->entries[i].psize) {
+         unmap_whole_user_big_page(pdir, i << BIG_PAGE_SHIFT, true);
+         continue;
+      }
+
       page_table_t *pt = pdir_get_page_table(pdir, i);
 
+      if (pdir->entries[i].avail & PDE_SHARED_PT) {
+         if (put_shared_page_table(pt))
+            continue; /* Still used by other pdirs: don't touch its pages */
+      }
+
       for (u32 j = 0; j < 1024; j++) {
 
+         if (pte_is_swapped(pt->pages[j])) {
+            zram_slot_put(pt->pages[j].pageAddr);
+            continue;
+         }
+
          if (!pt->pages[j].present)
             continue;
 
@@ -793,6 +1453,433 @@ void pdir_destroy(pdir_t *pdir)
    kfree_obj(pdir, pdir_t);
 }
 
+void pdir_destroy(pdir_t *pdir)
+{
+   pdir_destroy_int(pdir, false);
+}
+
+void pdir_destroy_preemptible(pdir_t *pdir)
+{
+   pdir_destroy_int(pdir, true);
+}
+
+void pdir_count_user_pages(pdir_t *pdir, size_t *mapped, size_t *resident)
+{
+   const u32 zero_page_pfn = KERNEL_VA_TO_PA(&zero_page) >> PAGE_SHIFT;
+   size_t m = 0, r = 0;
+
+   for (u32 i = 0; i < BASE_VADDR_PD_IDX; i++) {
+
+      if (!pdir->entries[i].present)
+         continue;
+
+      if (pdir->entries[i].psize) {
+         m += 1024;
+         r += 1024;
+         continue;
+      }
+
+      page_table_t *pt = pdir_get_page_table(pdir, i);
+
+      for (u32 j = 0; j < 1024; j++) {
+
+         if (pte_is_swapped(pt->pages[j])) {
+            m++;  /* Mapped, but not resident */
+            continue;
+         }
+
+         if (!pt->pages[j].present)
+            continue;
+
+         m++;
+
+         if (pt->pages[j].pageAddr != zero_page_pfn)
+            r++;
+      }
+   }
+
+   *mapped = m;
+   *resident = r;
+}
+
+size_t pdir_count_page_tables(pdir_t *pdir)
+{
+   size_t n = 0;
+
+   for (u32 i = 0; i < BASE_VADDR_PD_IDX; i++)
+      if (pdir->entries[i].present && !pdir->entries[i].psize)
+         n++;
+
+   return n;
+}
+
+/*
+ * Only private anonymous pages, mapped just here and not retained by anyone
+ * else (e.g. ramfs) can be swapped out. The zero page and the pages shared
+ * after fork() are read-only, therefore they're excluded too.
+ */
+static bool pte_is_swappable(page_t p)
+{
+   struct pageframe *pf;
+
+   if (!p.present || !p.us || !p.rw || (p.avail & PAGE_SHARED))
+      return false;
+
+   if ((p.avail & PAGE_ZRAM) && !p.dirty)
+      return false; /* Didn't compress well and not written since then */
+
+   pf = pf_get((ulong)p.pageAddr << PAGE_SHIFT);
+
+   return pf != NULL &&
+          pf->type == PF_TYPE_OTHER &&
+          pf->refcount == 1 &&
+          pf->mapcount == 1;
+}
+
+size_t pdir_reclaim_cold_pages(pdir_t *pdir, size_t max)
+{
+   const bool curr = pdir == get_curr_pdir();
+   size_t done = 0;
+   page_table_t *pt;
+   page_t *p;
+   ulong va, paddr;
+   int slot;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 i = 0; i < BASE_VADDR_PD_IDX && done < max; i++) {
+
+      const page_dir_entry_t e = pdir->entries[i];
+
+      /* Skip the big pages and the page tables shared after fork() */
+      if (!e.present || e.psize || (e.avail & PDE_SHARED_PT))
+         continue;
+
+      pt = pdir_get_page_table(pdir, i);
+
+      for (u32 j = 0; j < 1024 && done < max; j++) {
+
+         p = &pt->pages[j];
+
+         if (!pte_is_swappable(*p))
+            continue;
+
+         va = (i << BIG_PAGE_SHIFT) | (j << PAGE_SHIFT);
+
+         if (p->accessed) {
+
+            /* Accessed since the previous pass: not cold */
+            p->accessed = false;
+
+            if (curr)
+               invalidate_page_hw(va);
+
+            continue;
+         }
+
+         paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+         slot = zram_store(PA_TO_LIN_VA(paddr));
+
+         if (slot == -E2BIG) {
+
+            /* Don't try again until the page gets written */
+            p->avail |= PAGE_ZRAM;
+            p->dirty = false;
+
+            if (curr)
+               invalidate_page_hw(va);
+
+            continue;
+         }
+
+         if (slot < 0)
+            return done; /* The pool is full */
+
+         ASSERT((u32)slot < (1u << (32 - PAGE_SHIFT)));
+
+         p->raw = (p->raw & (PG_RW_BIT | PG_US_BIT))  |
+                  (PAGE_ZRAM << PG_CUSTOM_B0_POS)     |
+                  ((u32)slot << PAGE_SHIFT);
+
+         if (curr)
+            invalidate_page_hw(va);
+
+         pf_ref_count_dec(paddr);
+         kfree2(PA_TO_LIN_VA(paddr), PAGE_SIZE);
+         done++;
+      }
+   }
+
+   return done;
+}
+
+/*
+ * Pages that can be merged (KSM_MERGE): anonymous pages referenced only by
+ * page table entries, either private and writable or already read-only and
+ * copy-on-write (e.g. shared after fork() or merged by a previous pass).
+ */
+static bool pte_is_mergeable(page_t p)
+{
+   struct pageframe *pf;
+
+   if (!p.present || !p.us || (p.avail & PAGE_SHARED))
+      return false;
+
+   if (!p.rw && !(p.avail & PAGE_COW_ORIG_RW))
+      return false; /* A truly read-only page */
+
+   pf = pf_get((ulong)p.pageAddr << PAGE_SHIFT);
+
+   return pf != NULL &&
+          pf->type == PF_TYPE_OTHER &&
+          pf->refcount == pf->mapcount &&
+          (!p.rw || pf->refcount == 1);
+}
+
+static void ksm_write_protect(pdir_t *pdir, page_t *p, ulong va)
+{
+   if (!p->rw)
+      return;
+
+   p->rw = false;
+   p->avail = PAGE_COW_ORIG_RW;
+
+   if (pdir == get_curr_pdir())
+      invalidate_page_hw(va);
+}
+
+/* Makes `p` to point to the frame at `paddr`, read-only and copy-on-write */
+static void ksm_remap_page(pdir_t *pdir, page_t *p, ulong va, ulong paddr)
+{
+   const ulong old_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+   pf_ref_count_inc(paddr);
+   p->pageAddr = SHR_BITS(paddr, PAGE_SHIFT, u32);
+
+   if (p->rw) {
+      ksm_write_protect(pdir, p, va);
+   } else if (pdir == get_curr_pdir()) {
+      invalidate_page_hw(va);
+   }
+
+   if (!pf_ref_count_dec(old_paddr))
+      kfree2(PA_TO_LIN_VA(old_paddr), PAGE_SIZE);
+}
+
+static void
+ksm_merge_page(pdir_t *pdir, page_t *p, ulong va, struct ksm_scan_ctx *ctx)
+{
+   const ulong paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+   void *page = PA_TO_LIN_VA(paddr);
+   struct ksm_entry *e;
+   page_t *ep;
+   ulong e_paddr;
+   bool zero;
+   u32 hash;
+
+   hash = ksm_hash_page(page, &zero);
+   ctx->hashed++;
+
+   if (zero) {
+      ksm_remap_page(pdir, p, va, KERNEL_VA_TO_PA(&zero_page));
+      ctx->zero_merged++;
+      return;
+   }
+
+   e = ksm_get_entry(hash);
+
+   if (e->pdir && e->hash == hash) {
+
+      ep = e->pte;
+      e_paddr = (ulong)ep->pageAddr << PAGE_SHIFT;
+
+      if (e_paddr == paddr)
+         return; /* Already the same frame (e.g. after fork) */
+
+      if (!memcmp(PA_TO_LIN_VA(e_paddr), page, PAGE_SIZE)) {
+         ksm_write_protect(e->pdir, ep, e->va);
+         ksm_remap_page(pdir, p, va, e_paddr);
+         ctx->merged++;
+         return;
+      }
+   }
+
+   *e = (struct ksm_entry) {
+      .hash = hash,
+      .pte = p,
+      .pdir = pdir,
+      .va = va,
+   };
+}
+
+void pdir_merge_same_pages(pdir_t *pdir, struct ksm_scan_ctx *ctx)
+{
+   const bool curr = pdir == get_curr_pdir();
+   const u32 start_i = ctx->va >> BIG_PAGE_SHIFT;
+   const u32 start_j = (ctx->va >> PAGE_SHIFT) & 1023;
+   page_table_t *pt;
+   page_t *p;
+   ulong va;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 i = start_i; i < BASE_VADDR_PD_IDX; i++) {
+
+      const page_dir_entry_t e = pdir->entries[i];
+
+      /* Skip the big pages and the page tables shared after fork() */
+      if (!e.present || e.psize || (e.avail & PDE_SHARED_PT))
+         continue;
+
+      pt = pdir_get_page_table(pdir, i);
+
+      for (u32 j = (i == start_i ? start_j : 0); j < 1024; j++) {
+
+         p = &pt->pages[j];
+
+         if (!pte_is_mergeable(*p))
+            continue;
+
+         va = (i << BIG_PAGE_SHIFT) | (j << PAGE_SHIFT);
+
+         if (p->rw && p->dirty) {
+
+            /* Written since the previous pass: likely to change again */
+            p->dirty = false;
+
+            if (curr)
+               invalidate_page_hw(va);
+
+            continue;
+         }
+
+         if (ctx->hashed >= ctx->max) {
+            ctx->va = va;
+            ctx->stopped = true;
+            return;
+         }
+
+         ksm_merge_page(pdir, p, va, ctx);
+      }
+   }
+}
+
+/*
+ * Returns the frame of a private anonymous page (MADV_FREE candidate), mapped
+ * only by `p` and either writable or copy-on-write, or NULL.
+ */
+static struct pageframe *pte_get_lazyfree_pf(page_t p)
+{
+   struct pageframe *pf;
+
+   if (!p.present || !p.us || (p.avail & PAGE_SHARED))
+      return NULL;
+
+   if (!p.rw && !(p.avail & PAGE_COW_ORIG_RW))
+      return NULL; /* A truly read-only page */
+
+   pf = pf_get((ulong)p.pageAddr << PAGE_SHIFT);
+
+   if (!pf || pf->refcount != 1 || pf->mapcount != 1)
+      return NULL;
+
+   if (pf->type != PF_TYPE_OTHER && pf->type != PF_TYPE_LAZYFREE)
+      return NULL;
+
+   return pf;
+}
+
+size_t pdir_mark_lazyfree_pages(pdir_t *pdir, ulong va, size_t count)
+{
+   const bool curr = pdir == get_curr_pdir();
+   const ulong end = va + (count << PAGE_SHIFT);
+   struct pageframe *pf;
+   page_dir_entry_t e;
+   page_table_t *pt;
+   page_t *p;
+   size_t done = 0;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(IS_PAGE_ALIGNED(va));
+   ASSERT(end <= BASE_VA);
+
+   for (; va < end; va += PAGE_SIZE) {
+
+      e = pdir->entries[va >> BIG_PAGE_SHIFT];
+
+      /* Skip the big pages and the page tables shared after fork() */
+      if (!e.present || e.psize || (e.avail & PDE_SHARED_PT)) {
+         va |= (1u << BIG_PAGE_SHIFT) - PAGE_SIZE; /* Last page of the PT */
+         continue;
+      }
+
+      pt = pdir_get_page_table(pdir, va >> BIG_PAGE_SHIFT);
+      p = &pt->pages[(va >> PAGE_SHIFT) & 1023];
+
+      if (!(pf = pte_get_lazyfree_pf(*p)))
+         continue;
+
+      p->rw = false;
+      p->avail = PAGE_COW_ORIG_RW;
+      pf->type = PF_TYPE_LAZYFREE;
+
+      if (curr)
+         invalidate_page_hw(va);
+
+      done++;
+   }
+
+   return done;
+}
+
+size_t pdir_drop_lazyfree_pages(pdir_t *pdir, size_t max)
+{
+   const bool curr = pdir == get_curr_pdir();
+   const ulong zero_paddr = KERNEL_VA_TO_PA(&zero_page);
+   struct pageframe *pf;
+   page_table_t *pt;
+   page_t *p;
+   ulong va, paddr;
+   size_t done = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 i = 0; i < BASE_VADDR_PD_IDX && done < max; i++) {
+
+      const page_dir_entry_t e = pdir->entries[i];
+
+      /* Skip the big pages and the page tables shared after fork() */
+      if (!e.present || e.psize || (e.avail & PDE_SHARED_PT))
+         continue;
+
+      pt = pdir_get_page_table(pdir, i);
+
+      for (u32 j = 0; j < 1024 && done < max; j++) {
+
+         p = &pt->pages[j];
+         pf = pte_get_lazyfree_pf(*p);
+
+         /* Still read-only: not written since MADV_FREE */
+         if (!pf || pf->type != PF_TYPE_LAZYFREE || p->rw)
+            continue;
+
+         va = (i << BIG_PAGE_SHIFT) | (j << PAGE_SHIFT);
+         paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+         pf_ref_count_inc(zero_paddr);
+         p->pageAddr = SHR_BITS(zero_paddr, PAGE_SHIFT, u32);
+
+         if (curr)
+            invalidate_page_hw(va);
+
+         pf_ref_count_dec(paddr);
+         kfree2(PA_TO_LIN_VA(paddr), PAGE_SIZE);
+         done++;
+      }
+   }
+
+   return done;
+}
 
 void map_4mb_page_int(pdir_t *pdir,
                       void *vaddrp,
@@ -878,7 +1965,7 @@ void set_pages_pat_wc(pdir_t *pdir, void *vaddr, size_t size)
    }
 }
 
-void early_init_paging(void)
+void INIT_TEXT early_init_paging(void)
 {
    set_fault_handler(FAULT_PAGE_FAULT, handle_page_fault);
    __kernel_pdir = PA_TO_LIN_VA(KERNEL_VA_TO_PA(kpdir_buf));
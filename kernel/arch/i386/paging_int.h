@@ -109,6 +109,14 @@ union x86_page_dir_entry {
    u32 raw;
 };
 
+/*
+ * When this flag is set in the 'avail' bits of a page_dir_entry_t, it means
+ * that its page table is shared with other page directories (see pdir_clone())
+ * and that the entry is read-only only because of that. The page table is
+ * copied on the first write through any of the pdirs sharing it.
+ */
+#define PDE_SHARED_PT                          (1 << 0)
+
 // A page directory
 struct x86_pdir {
    union x86_page_dir_entry entries[1024];
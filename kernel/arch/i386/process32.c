@@ -185,6 +185,10 @@ switch_to_task(struct task *ti)
    ASSERT(!is_preemption_enabled());
    switch_to_task_safety_checks(curr, ti);
 
+   if (ti != curr) {
+      trace_point(tp_sched_switch, curr->tid, ti->tid, curr->state);
+   }
+
    /* Do as much as possible work before disabling the interrupts */
    task_change_state_idempotent(ti, TASK_STATE_RUNNING);
    ti->ticks.timeslice = 0;
@@ -227,6 +231,11 @@ switch_to_task(struct task *ti)
    set_curr_task(ti);
    ti->timer_ready = false;
    set_kernel_stack((ulong)ti->state_regs);
+
+   /* The interrupts-off interval, if any, ends with the IRET */
+   if (state->eflags & EFLAGS_IF)
+      irqs_off_trace_end();
+
    context_switch(state);
 }
 
@@ -0,0 +1,190 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_acpi.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/smp.h>
+#include <tilck/mods/acpi.h>
+
+#include "paging_int.h"
+#include "gdt_int.h"
+#include "idt_int.h"
+#include "../generic_x86/lapic.h"
+#include "../generic_x86/pit.h"
+
+/* The variables at the end of the trampoline: see ap_trampoline.S */
+struct ap_trampoline_params {
+   u32 cr0;
+   u32 cr3;
+   u32 cr4;
+   u32 stack;
+   u32 entry;
+};
+
+extern char ap_trampoline_begin[];
+extern char ap_trampoline_params[];
+extern char ap_trampoline_end[];
+
+static struct percpu *volatile ap_starting;
+
+/*
+ * Called by the trampoline on the AP's idle stack, with the interrupts
+ * disabled and the temporary page directory. Once online, the AP never
+ * leaves the idle loop below: with IF = 0, only an NMI or an INIT IPI can
+ * get it out of HLT.
+ */
+static NORETURN void ap_entry(void)
+{
+   struct percpu *pc = ap_starting;
+
+   set_curr_pdir(get_kernel_pdir());
+   gdt_load_on_ap();
+   idt_load_on_ap();
+
+   __atomic_store_n(&pc->online, true, __ATOMIC_RELEASE);
+
+   while (true)
+      halt();
+}
+
+/* All the kernel mappings, plus the first 4 MB identity-mapped */
+static pdir_t *smp_create_tmp_pdir(void)
+{
+   pdir_t *pdir = kalloc_obj(pdir_t);
+
+   if (!pdir)
+      return NULL;
+
+   ASSERT(IS_PAGE_ALIGNED(pdir));
+   memcpy32(pdir, get_kernel_pdir(), sizeof(pdir_t) / 4);
+   pdir->entries[0].raw = PG_PRESENT_BIT | PG_RW_BIT | PG_4MB_BIT;
+   return pdir;
+}
+
+/* INIT-SIPI-SIPI, as described in the Intel SDM, vol. 3, 8.4.4.1 */
+static bool smp_start_ap(struct percpu *pc, struct ap_trampoline_params *p)
+{
+   ulong var;
+
+   if (!(pc->idle_stack = kzmalloc(KERNEL_STACK_SIZE)))
+      return false;
+
+   p->stack = (u32)pc->idle_stack + KERNEL_STACK_SIZE;
+   ap_starting = pc;
+
+   disable_interrupts(&var);
+   {
+      lapic_send_init(pc->hw_id);
+      pit_busy_wait(PIT_FREQ / 100);            /* 10 ms */
+
+      for (int i = 0; i < 2 && !pc->online; i++) {
+         lapic_send_startup(pc->hw_id, AP_TRAMPOLINE_PADDR);
+         pit_busy_wait(PIT_FREQ / 5000);        /* 200 us */
+      }
+
+      for (int i = 0; i < 100 && !pc->online; i++)
+         pit_busy_wait(PIT_FREQ / 1000);        /* up to 100 ms */
+   }
+   enable_interrupts(&var);
+   return pc->online;
+}
+
+static void smp_start_all_aps(const struct acpi_madt_info *madt, void *tramp)
+{
+   struct ap_trampoline_params *p;
+   pdir_t *tmp_pdir;
+   u32 bsp_id, n = 1;
+
+   if (!(tmp_pdir = smp_create_tmp_pdir()))
+      return;
+
+   p = (void *)((char *)tramp + (ap_trampoline_params - ap_trampoline_begin));
+   p->cr0 = (u32)read_cr0();
+   p->cr3 = (u32)LIN_VA_TO_PA(tmp_pdir);
+   p->cr4 = (u32)read_cr4();
+   p->entry = (u32)&ap_entry;
+
+   bsp_id = lapic_get_id();
+   percpu_areas[0].hw_id = bsp_id;
+
+   for (u32 i = 0; i < madt->lapic_ids_count && n < MAX_CPUS; i++) {
+
+      struct percpu *pc = &percpu_areas[n];
+
+      if (madt->lapic_ids[i] == bsp_id)
+         continue;
+
+      pc->cpu = n;
+      pc->hw_id = madt->lapic_ids[i];
+
+      if (!smp_start_ap(pc, p)) {
+
+         /*
+          * The AP might still come up later, using the trampoline, its stack
+          * and `tmp_pdir`: leak them all and don't start any other AP.
+          */
+         printk("SMP: the CPU with LAPIC id %u did not start\n", pc->hw_id);
+         cpus_online = n;
+         return;
+      }
+
+      n++;
+   }
+
+   cpus_online = n;
+   kfree_obj(tmp_pdir, pdir_t);
+}
+
+/*
+ * Starts the APs listed in the MADT and parks them in their idle loop. Opt-in
+ * with the `smp` boot option: the APs don't run anything yet (see smp.h).
+ */
+void init_smp(void)
+{
+   const struct acpi_madt_info *madt = NULL;
+   const size_t tramp_size = (size_t)(ap_trampoline_end - ap_trampoline_begin);
+   void *va;
+
+   STATIC_ASSERT(AP_TRAMPOLINE_PADDR < 64 * KB); /* Reserved, see mmap.c */
+
+   if (MOD_acpi && get_acpi_init_status() >= ais_tables_initialized)
+      madt = acpi_get_madt_info();
+
+   if (!madt || madt->lapic_ids_count < 2)
+      return;
+
+   if (!kopt_smp) {
+      printk("SMP: %u CPUs, using only the boot one\n", madt->cpus);
+      return;
+   }
+
+   if (!init_lapic())
+      return;
+
+   ASSERT(tramp_size <= PAGE_SIZE);
+
+   if (!(va = hi_vmem_reserve(PAGE_SIZE)))
+      return;
+
+   if (map_kernel_page(va, AP_TRAMPOLINE_PADDR, PAGING_FL_RW) < 0) {
+      hi_vmem_release(va, PAGE_SIZE);
+      return;
+   }
+
+   memcpy(va, ap_trampoline_begin, tramp_size);
+   smp_start_all_aps(madt, va);
+
+   unmap_kernel_page(va, false);
+   hi_vmem_release(va, PAGE_SIZE);
+
+   printk("SMP: %u/%u CPUs online, the APs are idle\n",
+          cpus_online, madt->cpus);
+}
@@ -146,6 +146,15 @@ void fpu_context_begin(void)
    in_fpu_context = true;
    hw_fpu_enable();
    save_current_fpu_regs(true);
+
+   /*
+    * The vector unit is used only by the kernel, inside FPU contexts: user
+    * tasks get an illegal instruction fault for the V instructions, because
+    * we never enable it for them. Therefore, there's no vector state to save
+    * here: the registers are just scratch, until fpu_context_end().
+    */
+   if (riscv_cpu_features.isa_exts.v)
+      hw_vector_enable();
 }
 
 void fpu_context_end(void)
@@ -154,6 +163,7 @@ void fpu_context_end(void)
 
    restore_current_fpu_regs(true);
    hw_fpu_disable();
+   hw_vector_disable();
 
    in_fpu_context = false;
    enable_preemption();
@@ -161,6 +171,8 @@ void fpu_context_end(void)
 
 void init_fpu_memcpy(void)
 {
-   /* STUB function: do nothing */
+   /* The RVV or the integer funcs are selected at runtime, in fpu_memcpy.h */
+   if (riscv_cpu_features.isa_exts.v)
+      printk("fpu_memcpy: using the vector extension\n");
 }
 
@@ -35,6 +35,7 @@ volatile struct riscv_cpu_features riscv_cpu_features;
 static char isa_string_buf[128];
 static char isa_ext_string_buf[1024];
 static char model_name[64];
+static u32 cboz_block_size;
 
 static const char *isa_exts_names[] =
 {
@@ -153,6 +154,10 @@ static int fdt_parse_isa_extensions(void *fdt)
                    MIN((ulong)len, sizeof(isa_ext_string_buf)));
          }
 
+         prop = fdt_getprop(fdt, cpu_node, "riscv,cboz-block-size", &len);
+         if (prop && len == (int)sizeof(fdt32_t))
+            cboz_block_size = fdt32_to_cpu(*prop);
+
          return 0;
       }
    }
@@ -247,6 +252,20 @@ void early_get_cpu_features(void)
          (void *)KERNEL_VA_TO_PA(isa_exts_names[i]));
    }
 
+   /*
+    * cbo.zero is usable only if we know the size of the cache blocks and if
+    * pages can be zeroed with a whole number of them.
+    */
+   if (f->isa_exts.zicboz) {
+
+      const u32 bs = cboz_block_size;
+
+      if (bs >= 16 && bs <= PAGE_SIZE && !(bs & (bs - 1)))
+         f->cboz_block_size = bs;
+      else
+         f->isa_exts.zicboz = false;
+   }
+
    if (f->isa_exts.svpbmt) {
 
       f->page_mtmask = _PAGE_MTMASK_SVPBMT;
@@ -300,4 +319,7 @@ void dump_riscv_features(void)
 
    if (w)
       printk("%s\n", buf);
+
+   if (riscv_cpu_features.isa_exts.zicboz)
+      printk("cbo.zero block size: %u\n", riscv_cpu_features.cboz_block_size);
 }
@@ -89,6 +89,44 @@ stackwalk_riscv(void **frames,
    return i;
 }
 
+size_t
+stackwalk_kernel_stack(void **frames, size_t count, void *fp, void *stack)
+{
+   const ulong lo = (ulong)stack + 2 * sizeof(void *);
+   const ulong hi = (ulong)stack + KERNEL_STACK_SIZE;
+   ulong prev = 0;
+   void *ra;
+   size_t i = 0;
+
+   while (i < count) {
+
+      /* Each frame must be above the previous one, inside the stack */
+      if ((ulong)fp <= prev || (ulong)fp < lo || (ulong)fp > hi)
+         break;
+
+      if ((ulong)fp & (sizeof(void *) - 1))
+         break;
+
+      prev = (ulong)fp;
+      ra = *((void **)fp - 1);
+
+      if (IN_RANGE_INC((ulong)ra, lo, hi)) {
+
+         /* Leaf function without a saved `ra`: see stackwalk_riscv() */
+         fp = ra;
+         continue;
+      }
+
+      if (!ra)
+         break;
+
+      frames[i++] = ra;
+      fp = *((void **)fp - 2);
+   }
+
+   return i;
+}
+
 void dump_stacktrace(void *ebp, pdir_t *pdir)
 {
    void *frames[32] = {0};
@@ -40,7 +40,7 @@ static multiboot_memory_map_t *mmmap;
 static int mmmap_count = 0;
 static char *cmdline_buf;
 
-static struct simplefb_format simplefb_formats[] = {
+static struct simplefb_format simplefb_formats[] INIT_DATA = {
    {"r5g6b5", 16, {11, 5}, {5, 6}, {0, 5}, {0, 0}},
    {"r5g5b5a1", 16, {11, 5}, {6, 5}, {1, 5}, {0, 1}},
    {"x1r5g5b5", 16, {10, 5}, {5, 5}, {0, 5}, {0, 0}},
@@ -54,7 +54,7 @@ static struct simplefb_format simplefb_formats[] = {
    {"a2r10g10b10", 32, {20, 10}, {10, 10}, {0, 10}, {30, 2}},
 };
 
-void alloc_mbi(void)
+void INIT_TEXT alloc_mbi(void)
 {
    void *mbi_memtop;
 
@@ -74,7 +74,7 @@ void alloc_mbi(void)
    bzero(cmdline_buf, CMDLINE_BUF_SZ);
 }
 
-static void
+static void INIT_TEXT
 add_multiboot_mmap(u64 addr, u64 size, u32 type)
 {
    /* Allocate a new multiboot_memory_map */
@@ -100,7 +100,7 @@ add_multiboot_mmap(u64 addr, u64 size, u32 type)
    };
 }
 
-void setup_multiboot_info(ulong ramdisk_paddr, ulong ramdisk_size)
+void INIT_TEXT setup_multiboot_info(ulong ramdisk_paddr, ulong ramdisk_size)
 {
    mbi->flags |= MULTIBOOT_INFO_MEMORY;
 
@@ -120,7 +120,7 @@ void setup_multiboot_info(ulong ramdisk_paddr, ulong ramdisk_size)
    mbi->mmap_length = mmmap_count * sizeof(multiboot_memory_map_t);
 }
 
-static int
+static int INIT_TEXT
 fdt_get_node_linux_usable_memory(void *fdt, int node, int index,
                                  uint64_t *addr, uint64_t *size)
 {
@@ -167,7 +167,7 @@ fdt_get_node_linux_usable_memory(void *fdt, int node, int index,
    return 0;
 }
 
-static int
+static int INIT_TEXT
 fdt_add_multiboot_mmap(void *fdt, int node, u32 type)
 {
    int nomem = 1, index = 0;
@@ -214,7 +214,7 @@ fdt_read64(const fdt32_t *cell, size_t size)
    return val_64;
 }
 
-static int fdt_parse_chosen(void *fdt)
+static int INIT_TEXT fdt_parse_chosen(void *fdt)
 {
    u64 start, end;
    int node, len;
@@ -255,7 +255,7 @@ parse_cmd:
    return 0;
 }
 
-static int fdt_parse_memory(void *fdt)
+static int INIT_TEXT fdt_parse_memory(void *fdt)
 {
    int node, nomem = 1;
 
@@ -276,7 +276,7 @@ static int fdt_parse_memory(void *fdt)
    return nomem;
 }
 
-static int fdt_parse_reserved_memory(void *fdt)
+static int INIT_TEXT fdt_parse_reserved_memory(void *fdt)
 {
    u64 base, size;
    int n, node, child;
@@ -312,7 +312,7 @@ static int fdt_parse_reserved_memory(void *fdt)
    return 0;
 }
 
-static int fdt_parse_framebuffer(void *fdt)
+static int INIT_TEXT fdt_parse_framebuffer(void *fdt)
 {
    const fdt32_t *prop;
    int node, len, rc;
@@ -380,7 +380,7 @@ static int fdt_parse_framebuffer(void *fdt)
  * Parse flattened device tree(fdt), translate memory layout,
  * kernel command line and framebuffer into multiboot format used by tilck.
  */
-multiboot_info_t *parse_fdt(void *fdt_pa)
+multiboot_info_t * INIT_TEXT parse_fdt(void *fdt_pa)
 {
    /* check device tree validity */
    if (fdt_check_header(fdt_pa))
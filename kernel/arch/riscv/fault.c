@@ -5,9 +5,11 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/fault_resumable.h>
+#include <tilck/kernel/extable.h>
 #include <tilck/kernel/process.h>
 
 void asm_trap_entry(void);
+void asm_trap_vector(void);
 void handle_generic_fault_int(regs_t *r, const char *fault_name);
 void handle_inst_illegal_fault_int(regs_t *r, const char *fault_name);
 void handle_bus_fault_int(regs_t *r, const char *fault_name);
@@ -75,7 +77,12 @@ void set_fault_handler(int ex_num, void *ptr)
 
 void init_cpu_exception_handling(void)
 {
-   csr_write(CSR_STVEC, &asm_trap_entry);
+   /*
+    * Vectored mode: the timer, software and external interrupts get their own
+    * entry point. If the mode is not supported, stvec stays in direct mode and
+    * the vector table's first slot jumps to asm_trap_entry anyway.
+    */
+   csr_write(CSR_STVEC, (ulong)&asm_trap_vector | TVEC_MODE_VECTORED);
 
    set_fault_handler(EXC_INST_MISALIGNED, handle_bus_fault);
    set_fault_handler(EXC_INST_ACCESS, handle_generic_fault);
@@ -141,6 +148,10 @@ void handle_fault(regs_t *r)
       if (is_fault_resumable(int_num))
          return handle_resumable_fault(r);
 
+      /* A fault in a user-access primitive (e.g. get_user()) */
+      if (extable_fixup(r))
+         return;
+
       if (LIKELY(fault_handlers[int_num] != NULL)) {
 
          fault_handlers[int_num](r);
@@ -27,11 +27,128 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/cmdline.h>
 #include <tilck/kernel/arch/riscv/fpu_memcpy.h>
+#include <tilck/kernel/arch/riscv/cpu_features.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/hal.h>
 
+#define WORDS_256        (32 / sizeof(ulong))
+
+/*
+ * The generic memcpy() and memset() move one byte at a time: here we can
+ * rely on the 32-byte granularity and use the widest integer registers.
+ */
 void
 memcpy256_failsafe(void *dest, const void *src, u32 n)
 {
-   memcpy32(dest, src, n * 8);
+   ulong *d = dest;
+   const ulong *s = src;
+
+   if (((ulong)dest | (ulong)src) & (sizeof(ulong) - 1)) {
+      memcpy32(dest, src, n * 8);
+      return;
+   }
+
+   for (; n > 0; n--, d += WORDS_256, s += WORDS_256) {
+      for (u32 i = 0; i < WORDS_256; i++)
+         d[i] = s[i];
+   }
+}
+
+/*
+ * RVV 1.0 versions: they must be called only inside an FPU context, which
+ * enables the vector unit. With LMUL=8, each iteration moves 8 vector
+ * registers: at least 128 bytes, given the minimum VLEN for V, which is 128.
+ * The vector ISA has no non-temporal hints: the _nt variants use the same
+ * code.
+ */
+void memcpy256_rvv(void *dest, const void *src, u32 n)
+{
+   size_t len = (size_t)n << 5;
+   ulong vl;
+
+   asmVolatile(".option push\n"
+               ".option arch, +v\n"
+               "1:\n"
+               "vsetvli %0, %3, e8, m8, ta, ma\n"
+               "vle8.v v0, (%2)\n"
+               "vse8.v v0, (%1)\n"
+               "add %2, %2, %0\n"
+               "add %1, %1, %0\n"
+               "sub %3, %3, %0\n"
+               "bnez %3, 1b\n"
+               ".option pop\n"
+               : "=&r" (vl), "+r" (dest), "+r" (src), "+r" (len)
+               : /* no input */
+               : "memory");
+}
+
+void memset256_rvv(void *dest, u32 val32, u32 n)
+{
+   size_t cnt = (size_t)n << 3;   /* 32-bit elements */
+   ulong vl;
+
+   asmVolatile(".option push\n"
+               ".option arch, +v\n"
+               "vsetvli %0, %2, e32, m8, ta, ma\n"
+               "vmv.v.x v0, %3\n"
+               "1:\n"
+               "vsetvli %0, %2, e32, m8, ta, ma\n"
+               "vse32.v v0, (%1)\n"
+               "slli %0, %0, 2\n"
+               "add %1, %1, %0\n"
+               "srli %0, %0, 2\n"
+               "sub %2, %2, %0\n"
+               "bnez %2, 1b\n"
+               ".option pop\n"
+               : "=&r" (vl), "+r" (dest), "+r" (cnt)
+               : "r" ((ulong)val32)
+               : "memory");
+}
+
+/* Zicboz: zero a whole cache block per instruction, without reading it */
+static void cbo_zero_range(void *dest, size_t len)
+{
+   const u32 bs = riscv_cpu_features.cboz_block_size;
+   char *p = dest;
+   char *end = p + len;
+
+   for (; p < end; p += bs) {
+      asmVolatile(".insn i 0x0f, 2, x0, %0, 4"   /* cbo.zero (%0) */
+                  : /* no output */
+                  : "r" (p)
+                  : "memory");
+   }
+}
+
+void memset256_failsafe(void *dest, u32 val32, u32 n)
+{
+   const size_t len = (size_t)n << 5;
+   ulong *d = dest;
+   ulong val = val32;
+
+   if (!val32 && riscv_cpu_features.isa_exts.zicboz) {
+
+      const u32 bs = riscv_cpu_features.cboz_block_size;
+
+      if (!((ulong)dest & (bs - 1)) && !(len & (bs - 1))) {
+         cbo_zero_range(dest, len);
+         return;
+      }
+   }
+
+   if ((ulong)dest & (sizeof(ulong) - 1)) {
+      memset32(dest, val32, len / 4);
+      return;
+   }
+
+   if (sizeof(ulong) > 4)
+      val |= val << 16 << 16;
+
+   for (; n > 0; n--, d += WORDS_256) {
+      for (u32 i = 0; i < WORDS_256; i++)
+         d[i] = val;
+   }
 }
 
 FASTCALL void
@@ -40,3 +157,42 @@ memcpy_single_256_failsafe(void *dest, const void *src)
    memcpy32(dest, src, 8);
 }
 
+/*
+ * The generic memcpy() copies one byte at a time: when the buffers are
+ * aligned, copy whole words instead. The vector unit is used only for whole
+ * pages, when we can afford an FPU context (see the x86 version).
+ */
+void fast_memcpy(void *dest, const void *src, size_t n)
+{
+   const size_t bulk = n & ~(size_t)31;
+
+   if (bulk && !(((ulong)dest | (ulong)src) & (sizeof(ulong) - 1))) {
+
+      memcpy256_failsafe(dest, src, (u32)(bulk >> 5));
+
+      if (n != bulk)
+         memcpy(dest + bulk, src + bulk, n - bulk);
+
+      return;
+   }
+
+   memcpy(dest, src, n);
+}
+
+void fast_copy_page(void *dest, const void *src)
+{
+   ASSERT(IS_PAGE_ALIGNED(dest));
+   ASSERT(IS_PAGE_ALIGNED(src));
+
+   if (fpu_memcpy_can_use_rvv() && is_preemption_enabled() && !in_panic()) {
+
+      fpu_context_begin();
+      {
+         memcpy256_rvv(dest, src, PAGE_SIZE / 32);
+      }
+      fpu_context_end();
+      return;
+   }
+
+   memcpy256_failsafe(dest, src, PAGE_SIZE / 32);
+}
@@ -19,6 +19,25 @@ extern ulong irq_bitmap[MAX_IRQ_NUM / (sizeof(ulong) * 8)];
 
 struct list irq_handlers_lists[MAX_IRQ_NUM];
 
+/*
+ * Direct dispatch table: the handler of each IRQ having exactly one, by far
+ * the common case. It spares generic_irq_handler() the walk of the list.
+ */
+struct irq_handler_node *irq_direct_handlers[MAX_IRQ_NUM];
+
+static void irq_update_direct_handler(u8 irq)
+{
+   struct list *l = &irq_handlers_lists[irq];
+   struct irq_handler_node *n = NULL;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (!list_is_empty(l) && l->first == l->last)
+      n = list_first_obj(l, struct irq_handler_node, node);
+
+   irq_direct_handlers[irq] = n;
+}
+
 void irq_set_mask(int irq)
 {
    ulong var;
@@ -77,6 +96,7 @@ void irq_install_handler(u8 irq, struct irq_handler_node *n)
    disable_interrupts(&var);
    {
       list_add_tail(&irq_handlers_lists[irq], &n->node);
+      irq_update_direct_handler(irq);
    }
    enable_interrupts(&var);
    irq_clear_mask(irq);
@@ -89,6 +109,7 @@ void irq_uninstall_handler(u8 irq, struct irq_handler_node *n)
    disable_interrupts(&var);
    {
       list_remove(&n->node);
+      irq_update_direct_handler(irq);
 
       if (list_is_empty(&irq_handlers_lists[irq]))
          irq_set_mask(irq);
@@ -124,6 +145,7 @@ void init_irq_handling(void)
    for (int i = 0; i < MAX_IRQ_NUM; i++) {
 
       list_init(&irq_handlers_lists[i]);
+      irq_direct_handlers[i] = NULL;
       irq_datas[i].hwirq = 0;
       irq_datas[i].unhandled_count = 0;
       irq_datas[i].domain = 0;
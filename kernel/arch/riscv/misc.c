@@ -8,6 +8,8 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/arch/riscv/sbi.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/idle.h>
+#include <tilck/kernel/errno.h>
 
 void init_textmode_console(void)
 {
@@ -40,3 +42,20 @@ NORETURN void reboot(void)
    panic("Unable to reboot the machine");
 }
 
+
+/* WFI is the only idle state here: SBI's HSM suspend is not supported yet */
+bool hw_idle_supported(int method)
+{
+   return method == IDLE_M_HALT;
+}
+
+void hw_idle_enter(int method, ulong arg)
+{
+   enable_interrupts_and_halt();
+}
+
+/* The goldfish RTC is polled: see clock_sub_second_resync() */
+int hw_clock_wait_edge(u64 *sys_time)
+{
+   return -ENODEV;
+}
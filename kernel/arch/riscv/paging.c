@@ -22,6 +22,10 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/vdso.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/lazyfree.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -36,6 +40,19 @@ static ulong base_pa;
 pdir_t *__kernel_pdir;
 static char kpdir_buf[sizeof(pdir_t)] ALIGNED_AT(PAGE_SIZE);
 
+/*
+ * ASIDs: the recently used address spaces get one of the ASID slots here
+ * below, in order to keep their TLB entries across context switches. The ASID
+ * of slot `i` is `i + 1`: ASID 0 is used by set_curr_pdir(), which always
+ * flushes the whole TLB. When all the slots are taken, they're recycled in
+ * round-robin order.
+ */
+#define RV_ASID_SLOTS                 32
+
+static ulong asid_slots[RV_ASID_SLOTS];   /* paddr of each slot's pdir */
+static u32 asid_slots_count;              /* 0 if ASIDs are not supported */
+static u32 asid_next_victim;
+
 #define EARLY_PT_NUM 4
 static page_table_t early_pt[EARLY_PT_NUM] ALIGNED_AT(PAGE_SIZE);
 
@@ -128,7 +145,7 @@ bool handle_potential_cow(void *context)
    ASSERT(IS_L0_PAGE_ALIGNED(new_page_vaddr));
 
    // Copy page's contents
-   memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
+   fast_copy_page(new_page_vaddr, page_vaddr);
 
    // Get the paddr of the new page
    const ulong paddr = LIN_VA_TO_PA(new_page_vaddr);
@@ -157,6 +174,10 @@ kernel_page_fault_panic(regs_t *r, ulong vaddr, bool wr, bool ex, bool rd)
    long off = 0;
    const char *sym_name = find_sym_at_addr_safe(r->sepc, &off, NULL);
 
+   if (is_kernel_stack_guard_page(vaddr))
+      panic("Kernel stack overflow: %p, EIP: %p [%s + %d]\n",
+            vaddr, r->sepc, sym_name ? sym_name : "???", off);
+
    panic("PAGE FAULT in attempt to %s %p from %s\nEIP: %p [%s + %d]\n",
          wr ? "WRITE" : ex ? "EXE" : rd ? "READ" : "?",
          vaddr,
@@ -176,6 +197,8 @@ void handle_page_fault_int(regs_t *r)
    struct user_mapping *um;
    page_table_t *pt = pdir_get_page_table(get_curr_pdir(), vaddr);
 
+   trace_point(tp_page_fault, vaddr, r->sepc, wr);
+
    if (!us) {
       /*
        * Tilck does not support kernel-space page faults caused by the kernel,
@@ -192,9 +215,10 @@ void handle_page_fault_int(regs_t *r)
    if (um) {
       /*
        * Call vfs_handle_fault() only if in first place the mapping allowed
-       * writing or if it didn't but the memory access type was a READ.
+       * writing or if it didn't but the memory access type was a READ. The
+       * private mappings (um->h == NULL) have all of their pages mapped.
        */
-      if (!!(um->prot & PROT_WRITE) || rd) {
+      if (um->h && (!!(um->prot & PROT_WRITE) || rd)) {
 
          if (vfs_handle_fault(um, (void *)vaddr, p, wr))
             return;
@@ -273,7 +297,7 @@ bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
    return e->present && e->wr;
 }
 
-void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+static void __set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
 {
    page_table_t *pt;
    const ulong vaddr = (ulong) vaddrp;
@@ -282,11 +306,52 @@ void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
    ASSERT(pt && (LIN_VA_TO_PA(pt) != 0));
 
    pt->entries[PTE_INDEX(0, vaddr)].wr = rw;
-   invalidate_page_hw(vaddr);
 }
 
+void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
+{
+   __set_page_rw(pdir, vaddrp, rw);
+   invalidate_page_hw((ulong)vaddrp);
+}
+
+void set_pages_rw(pdir_t *pdir, void *vaddrp, size_t page_count, bool rw)
+{
+   for (size_t i = 0; i < page_count; i++)
+      __set_page_rw(pdir, (char *)vaddrp + (i << PAGE_SHIFT), rw);
+
+   invalidate_pages(pdir, vaddrp, page_count);
+}
+
+void swap_pages(pdir_t *pdir, void *vaddrp1, void *vaddrp2)
+{
+   page_table_t *pt1, *pt2;
+   const ulong va1 = (ulong) vaddrp1;
+   const ulong va2 = (ulong) vaddrp2;
+   page_t tmp;
+
+   pt1 = pdir_get_page_table(pdir, va1);
+   pt2 = pdir_get_page_table(pdir, va2);
+   ASSERT(pt1 && (LIN_VA_TO_PA(pt1) != 0));
+   ASSERT(pt2 && (LIN_VA_TO_PA(pt2) != 0));
+
+   tmp = pt1->entries[PTE_INDEX(0, va1)];
+   pt1->entries[PTE_INDEX(0, va1)] = pt2->entries[PTE_INDEX(0, va2)];
+   pt2->entries[PTE_INDEX(0, va2)] = tmp;
+
+   invalidate_page_hw(va1);
+   invalidate_page_hw(va2);
+}
+
+/*
+ * When `inval` is false, the caller is responsible for invalidating the TLB
+ * entry, usually with a single invalidate_pages() call for a whole range.
+ */
 static inline int
-__unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
+__unmap_page(pdir_t *pdir,
+             void *vaddrp,
+             bool free_pageframe,
+             bool permissive,
+             bool inval)
 {
    page_table_t *pt;
    const ulong vaddr = (ulong) vaddrp;
@@ -311,7 +376,9 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       pt->entries[PTE_INDEX(0, vaddr)].pfn << PAGE_SHIFT;
 
    pt->entries[PTE_INDEX(0, vaddr)].raw = 0;
-   invalidate_page_hw(vaddr);
+
+   if (inval)
+      invalidate_page_hw(vaddr);
 
    if (!pf_ref_count_dec(paddr) && free_pageframe) {
 
@@ -325,13 +392,13 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
 void
 unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   __unmap_page(pdir, vaddrp, free_pageframe, false);
+   __unmap_page(pdir, vaddrp, free_pageframe, false, true);
 }
 
 int
 unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   return __unmap_page(pdir, vaddrp, free_pageframe, true);
+   return __unmap_page(pdir, vaddrp, free_pageframe, true, true);
 }
 
 void
@@ -341,8 +408,14 @@ unmap_pages(pdir_t *pdir,
             bool do_free)
 {
    for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
+      __unmap_page(pdir,
+                   (char *)vaddr + (i << PAGE_SHIFT),
+                   do_free,
+                   false,
+                   false);
    }
+
+   invalidate_pages(pdir, vaddr, page_count);
 }
 
 size_t
@@ -356,14 +429,15 @@ unmap_pages_permissive(pdir_t *pdir,
 
    for (size_t i = 0; i < page_count; i++) {
 
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+      rc = __unmap_page(pdir,
+                        (char *)vaddr + (i << PAGE_SHIFT),
+                        do_free,
+                        true,
+                        false);
       unmapped_pages += (rc == 0);
    }
 
+   invalidate_pages(pdir, vaddr, page_count);
    return unmapped_pages;
 }
 
@@ -406,9 +480,9 @@ int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref)
          return -EFAULT;
 
       if (e.raw & _PAGE_LEAF) {
-         /* Big page (2/4 MB) entry */
+         /* Big page (2/4 MB) or huge page (1 GB) entry */
          *pa_ref = ((ulong) e.pfn << PAGE_SHIFT) |
-                   (vaddr & (L1_PAGE_SIZE - 1));
+                   (vaddr & ((1UL << PTE_SHIFT(level)) - 1));
          return 0;
       }
 
@@ -474,6 +548,64 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, ulong hw_flags)
    return 0;
 }
 
+#if RV_PAGE_LEVEL >= 2
+
+/*
+ * Maps a 1 GB page with a leaf entry in the root table. That's used only for
+ * the kernel's linear mapping: the root entries are copied by pdir_clone(), so
+ * every address space shares them. Returns false when the entry is already in
+ * use, e.g. by a page table of the early mappings: in that case, the caller
+ * falls back to 2 MB pages.
+ */
+static bool
+map_huge_page_int(pdir_t *pdir, ulong vaddr, ulong paddr, ulong hw_flags)
+{
+   page_t *e = &pdir->entries[PTE_INDEX(2, vaddr)];
+
+   ASSERT(IS_L2_PAGE_ALIGNED(vaddr)); // the vaddr must be 1GB-aligned
+   ASSERT(IS_L2_PAGE_ALIGNED(paddr)); // the paddr must be 1GB-aligned
+
+   if (e->present)
+      return false;
+
+   e->raw = _PAGE_PRESENT | hw_flags | (PFN(paddr) << _PAGE_PFN_SHIFT);
+   invalidate_page_hw(vaddr);
+   return true;
+}
+
+static ALWAYS_INLINE bool
+try_map_huge_page(pdir_t *pdir,
+                  ulong vaddr,
+                  ulong paddr,
+                  size_t rem_pages,
+                  ulong hw_flags)
+{
+   return rem_pages >= PTRS_PER_PT * PTRS_PER_PT &&
+          IS_L2_PAGE_ALIGNED(vaddr) &&
+          IS_L2_PAGE_ALIGNED(paddr) &&
+          map_huge_page_int(pdir, vaddr, paddr, hw_flags);
+}
+
+#else
+
+static ALWAYS_INLINE bool
+try_map_huge_page(pdir_t *pdir,
+                  ulong vaddr,
+                  ulong paddr,
+                  size_t rem_pages,
+                  ulong hw_flags)
+{
+   return false;
+}
+
+#endif
+
+/*
+ * When big pages are allowed, the range is mapped with the largest pages
+ * possible: 4 KB pages up to the first 2 MB boundary, then 2 MB pages and,
+ * where both `vaddr` and `paddr` are aligned at 1 GB, 1 GB pages. What
+ * remains at the end is mapped again with smaller pages.
+ */
 NODISCARD size_t
 map_pages_int(pdir_t *pdir,
               void *vaddr,
@@ -486,7 +618,6 @@ map_pages_int(pdir_t *pdir,
    size_t pages = 0;
    size_t big_pages = 0;
    size_t rem_pages = page_count;
-   ulong big_page_flags;
 
    ASSERT(IS_L0_PAGE_ALIGNED(vaddr));
    ASSERT(IS_L0_PAGE_ALIGNED(paddr));
@@ -508,16 +639,25 @@ map_pages_int(pdir_t *pdir,
       }
 
       rem_pages -= pages;
-      big_page_flags = hw_flags;
 
-      for (; big_pages < (rem_pages / PTRS_PER_PT); big_pages++) {
+      while (rem_pages >= PTRS_PER_PT) {
+
+         if (try_map_huge_page(pdir, (ulong)vaddr, paddr, rem_pages, hw_flags))
+         {
+            /* Account it as PTRS_PER_PT big pages */
+            big_pages += PTRS_PER_PT;
+            rem_pages -= PTRS_PER_PT * PTRS_PER_PT;
+            vaddr += PTRS_PER_PT * L1_PAGE_SIZE;
+            paddr += PTRS_PER_PT * L1_PAGE_SIZE;
+            continue;
+         }
 
-         map_big_page_int(pdir, vaddr, paddr, big_page_flags);
+         map_big_page_int(pdir, vaddr, paddr, hw_flags);
+         big_pages++;
+         rem_pages -= PTRS_PER_PT;
          vaddr += L1_PAGE_SIZE;
          paddr += L1_PAGE_SIZE;
       }
-
-      rem_pages -= (big_pages * PTRS_PER_PT);
    }
 
    for (size_t i = 0; i < rem_pages; i++, pages++) {
@@ -538,7 +678,7 @@ out:
 NODISCARD int
 map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
 {
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool us = !!(pg_flags & PAGING_FL_US);
    ulong avail_bits = 0;
    ulong hw_pg_flags = 0;
@@ -547,16 +687,24 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+      ASSERT(!(pg_flags & PAGING_FL_COW_INCOMPAT));
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC) {
 
       void *va;
       ASSERT(paddr == 0);
 
-      if (!(va = kmalloc(PAGE_SIZE)))
-         return -ENOMEM;
-
       if (pg_flags & PAGING_FL_ZERO_PG)
-         bzero(va, PAGE_SIZE);
+         va = zpool_alloc_page();
+      else
+         va = kmalloc(PAGE_SIZE);
+
+      if (!va)
+         return -ENOMEM;
 
       paddr = LIN_VA_TO_PA(va);
 
@@ -613,7 +761,7 @@ map_pages(pdir_t *pdir,
           u32 pg_flags)
 {
    const bool us = !!(pg_flags & PAGING_FL_US);
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool big_pages = !!(pg_flags & PAGING_FL_BIG_PAGES_ALLOWED);
    ulong avail_bits = 0;
    ulong hw_pg_flags = 0;
@@ -621,6 +769,12 @@ map_pages(pdir_t *pdir,
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+      ASSERT(!(pg_flags & PAGING_FL_COW_INCOMPAT));
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC)
       NOT_IMPLEMENTED();
 
@@ -689,7 +843,7 @@ pdir_clone_int(pdir_t *old_pdir,pdir_t *new_pdir,
             ASSERT(pf_ref_count_get(new_page_paddr) == 0);
             pf_ref_count_inc(new_page_paddr);
 
-            memcpy(new_page, orig_page, PAGE_SIZE);
+            fast_copy_page(new_page, orig_page);
             new_pdir->entries[j].pfn = PFN(new_page_paddr);
          }
       }
@@ -753,7 +907,7 @@ pdir_t *pdir_clone(pdir_t *pdir)
 }
 
 static void
-pdir_destroy_int(pdir_t *pdir, u32 pd_idx, u32 level)
+pdir_destroy_int(pdir_t *pdir, u32 pd_idx, u32 level, bool preemptible)
 {
    if (level == 0) {
       for (u32 j = 0; j < PTRS_PER_PT; j++) {
@@ -779,20 +933,200 @@ pdir_destroy_int(pdir_t *pdir, u32 pd_idx, u32 level)
       page_table_t *pt = PA_TO_LIN_VA(pdir->entries[i].pfn << PAGE_SHIFT);
 
       level--;
-      pdir_destroy_int((pdir_t *)pt, PTRS_PER_PT, level);
+      pdir_destroy_int((pdir_t *)pt, PTRS_PER_PT, level, preemptible);
       level++;
+
+      if (preemptible)
+         cond_resched_preempt_disabled();
    }
 
    kfree_obj(pdir, page_table_t);
    return;
 }
 
+static ALWAYS_INLINE void flush_asid(ulong asid)
+{
+   asmVolatile("sfence.vma zero, %0" : : "r" (asid) : "memory");
+}
+
+static void detect_asids(void)
+{
+   const ulong satp = csr_read(CSR_SATP);
+   ulong max_asid;
+
+   /* The ASID bits not supported by the hardware are hard-wired to zero */
+   csr_write(CSR_SATP, satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+   max_asid = (csr_read(CSR_SATP) >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+   csr_write(CSR_SATP, satp);
+   asmVolatile("sfence.vma" : : : "memory");
+
+   asid_slots_count = (u32)MIN(max_asid, (ulong)RV_ASID_SLOTS);
+   printk("riscv: using %u ASIDs (max: %lu)\n", asid_slots_count, max_asid);
+}
+
+void switch_to_pdir(pdir_t *pdir)
+{
+   const ulong paddr = LIN_VA_TO_PA(pdir);
+   u32 slot;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!asid_slots_count || pdir == __kernel_pdir) {
+      set_curr_pdir(pdir);
+      return;
+   }
+
+   for (slot = 0; slot < asid_slots_count; slot++)
+      if (asid_slots[slot] == paddr)
+         break;
+
+   if (slot == asid_slots_count) {
+
+      /* Not found: take the next slot, flushing its old TLB entries */
+      slot = asid_next_victim;
+      asid_next_victim = (asid_next_victim + 1) % asid_slots_count;
+      asid_slots[slot] = paddr;
+      flush_asid(slot + 1);
+   }
+
+   /*
+    * No flush needed here: all the changes to the page tables are followed by
+    * invalidate_page_hw(), which affects all the address spaces.
+    */
+   csr_write(CSR_SATP,
+             (paddr >> PAGE_SHIFT) |
+             SATP_MODE |
+             ((ulong)(slot + 1) << SATP_ASID_SHIFT));
+}
+
+/* Releases the ASID of `pdir`, if any, because its memory will be reused */
+static void release_asid(pdir_t *pdir)
+{
+   const ulong paddr = LIN_VA_TO_PA(pdir);
+
+   disable_preemption();
+   {
+      for (u32 slot = 0; slot < asid_slots_count; slot++) {
+         if (asid_slots[slot] == paddr) {
+            asid_slots[slot] = 0;
+            flush_asid(slot + 1);
+            break;
+         }
+      }
+   }
+   enable_preemption_nosched();
+}
+
 void pdir_destroy(pdir_t *pdir)
 {
    // Kernel's pdir cannot be destroyed!
    ASSERT(pdir != __kernel_pdir);
 
-   pdir_destroy_int(pdir, BASE_VADDR_PD_IDX, RV_PAGE_LEVEL);
+   release_asid(pdir);
+   pdir_destroy_int(pdir, BASE_VADDR_PD_IDX, RV_PAGE_LEVEL, false);
+}
+
+void pdir_destroy_preemptible(pdir_t *pdir)
+{
+   ASSERT(pdir != __kernel_pdir);
+
+   release_asid(pdir);
+   pdir_destroy_int(pdir, BASE_VADDR_PD_IDX, RV_PAGE_LEVEL, true);
+}
+
+static void
+pdir_count_user_pages_int(pdir_t *pdir,
+                          u32 pd_idx,
+                          u32 level,
+                          size_t *mapped,
+                          size_t *resident)
+{
+   const ulong zero_page_pfn = KERNEL_VA_TO_PA(&zero_page) >> PAGE_SHIFT;
+
+   if (level == 0) {
+      for (u32 j = 0; j < PTRS_PER_PT; j++) {
+
+         if (!pdir->entries[j].present)
+            continue;
+
+         (*mapped)++;
+
+         if (pdir->entries[j].pfn != zero_page_pfn)
+            (*resident)++;
+      }
+
+      return;
+   }
+
+   for (u32 i = 0; i < pd_idx; i++) {
+
+      if (!pdir->entries[i].present)
+         continue;
+
+      ASSERT(!(pdir->entries[i].raw & _PAGE_LEAF));
+      page_table_t *pt = PA_TO_LIN_VA(pdir->entries[i].pfn << PAGE_SHIFT);
+
+      pdir_count_user_pages_int((pdir_t *)pt,
+                                PTRS_PER_PT,
+                                level - 1,
+                                mapped,
+                                resident);
+   }
+}
+
+void pdir_count_user_pages(pdir_t *pdir, size_t *mapped, size_t *resident)
+{
+   *mapped = *resident = 0;
+   pdir_count_user_pages_int(pdir,
+                             BASE_VADDR_PD_IDX,
+                             RV_PAGE_LEVEL,
+                             mapped,
+                             resident);
+}
+
+static size_t
+pdir_count_page_tables_int(pdir_t *pdir, u32 pd_idx, u32 level)
+{
+   size_t n = 0;
+
+   if (level == 0)
+      return 0;   /* The entries of a last-level table point to pages */
+
+   for (u32 i = 0; i < pd_idx; i++) {
+
+      if (!pdir->entries[i].present)
+         continue;
+
+      page_table_t *pt = PA_TO_LIN_VA(pdir->entries[i].pfn << PAGE_SHIFT);
+      n += 1 + pdir_count_page_tables_int((pdir_t *)pt, PTRS_PER_PT, level - 1);
+   }
+
+   return n;
+}
+
+size_t pdir_count_page_tables(pdir_t *pdir)
+{
+   return pdir_count_page_tables_int(pdir, BASE_VADDR_PD_IDX, RV_PAGE_LEVEL);
+}
+
+size_t pdir_reclaim_cold_pages(pdir_t *pdir, size_t max)
+{
+   return 0; /* ZRAM_SWAP is not supported on riscv, yet */
+}
+
+void pdir_merge_same_pages(pdir_t *pdir, struct ksm_scan_ctx *ctx)
+{
+   /* KSM_MERGE is not supported on riscv, yet */
+}
+
+size_t pdir_mark_lazyfree_pages(pdir_t *pdir, ulong va, size_t count)
+{
+   return 0; /* MADV_FREE is not supported on riscv, yet */
+}
+
+size_t pdir_drop_lazyfree_pages(pdir_t *pdir, size_t max)
+{
+   return 0;
 }
 
 pdir_t *
@@ -1073,7 +1407,7 @@ void set_pages_io(pdir_t *pdir, void *vaddr, size_t size)
    }
 }
 
-void early_init_paging(void)
+void INIT_TEXT early_init_paging(void)
 {
    set_fault_handler(EXC_INST_PAGE_FAULT, handle_page_fault);
    set_fault_handler(EXC_LOAD_PAGE_FAULT, handle_page_fault);
@@ -1081,6 +1415,7 @@ void early_init_paging(void)
 
    __kernel_pdir = PA_TO_LIN_VA(KERNEL_VA_TO_PA(kpdir_buf));
    set_kernel_process_pdir(__kernel_pdir);
+   detect_asids();
    printk("kernel base va:    %p\n", TO_PTR(KERNEL_BASE_VA));
    printk("kernel vaddr:      %p\n", TO_PTR(KERNEL_VADDR));
    printk("base va:           %p\n", TO_PTR(BASE_VA));
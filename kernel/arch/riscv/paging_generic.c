@@ -9,6 +9,7 @@
 
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/pageframes.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/system_mmap.h>
@@ -22,7 +23,6 @@
 extern u32 __mem_lower_kb;
 extern u32 __mem_upper_kb;
 
-u32 *pageframes_refcount;
 ulong phys_mem_lim;
 struct kmalloc_heap *hi_vmem_heap;
 
@@ -75,76 +75,50 @@ void iounmap(void *vaddr)
    unmap_kernel_pages(vaddr, size / PAGE_SIZE, false);
 }
 
-void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
+void invalidate_page(ulong vaddr)
 {
-   ASSERT(IS_PAGE_ALIGNED(vaddrp));
-   ASSERT(IS_PAGE_ALIGNED(len));
-
-   ulong paddr;
-   ulong vaddr = (ulong)vaddrp;
-   const ulong vaddr_end = vaddr + len;
-
-   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
-
-      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
-         continue; /* not mapped, that's fine */
-
-      __pf_ref_count_inc(paddr);
-   }
+   invalidate_page_hw(vaddr);
 }
 
-void release_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
+/*
+ * Invalidates the TLB entries for a range of pages of `pdir`, once the paging
+ * operations on the whole range are done. Past TLB_FLUSH_ALL_THRESHOLD pages,
+ * a single SFENCE.VMA without arguments is cheaper than one per page. NOTE:
+ * the TLB might contain the entries of any pdir having an ASID, not only the
+ * ones of the current pdir.
+ */
+void invalidate_pages(pdir_t *pdir, void *vaddrp, size_t page_count)
 {
-   ASSERT(IS_PAGE_ALIGNED(vaddrp));
-   ASSERT(IS_PAGE_ALIGNED(len));
-
-   ulong paddr;
-   ulong vaddr = (ulong)vaddrp;
-   const ulong vaddr_end = vaddr + len;
-
-   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
+   const ulong vaddr = (ulong)vaddrp;
 
-      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
-         continue; /* not mapped, that's fine */
-
-      __pf_ref_count_dec(paddr);
+   if (page_count > TLB_FLUSH_ALL_THRESHOLD) {
+      invalidate_all_pages_hw();
+      return;
    }
-}
 
-void invalidate_page(ulong vaddr)
-{
-   invalidate_page_hw(vaddr);
+   for (size_t i = 0; i < page_count; i++)
+      invalidate_page_hw(vaddr + (i << PAGE_SHIFT));
 }
 
 void init_paging(void)
 {
    int rc;
    void *user_vdso_vaddr;
-   size_t pagesframes_refcount_bufsize;
 
    /* get_phys_mem_size() assumes that the physical address starts from zero */
    phys_mem_lim = (ulong)MIN((__mem_upper_kb << 10) - (__mem_lower_kb << 10),
                              (u64)LINEAR_MAPPING_SIZE);
 
    /*
-    * Allocate the buffer used for keeping a ref-count for each pageframe.
-    * This is necessary for COW.
+    * Allocate the page frame descriptors, necessary for COW in first place:
+    * it's the ref-count which tells whether a COW page is still shared.
     */
+   init_pageframes(MEM_LOW, phys_mem_lim);
 
-   pagesframes_refcount_bufsize =
-      (phys_mem_lim >> PAGE_SHIFT) * sizeof(pageframes_refcount[0]);
-
-   pageframes_refcount = kzmalloc(pagesframes_refcount_bufsize);
+   if (!pageframes)
+      return;        /* We're in panic: silently ignore the failure */
 
-   if (!pageframes_refcount) {
-
-      if (in_panic())
-         return;        /* We're in panic: silently ignore the failure */
-
-      panic("Unable to allocate pageframes_refcount");
-   }
-
-   pf_ref_count_inc(KERNEL_VA_TO_PA(zero_page));
+   pf_retain(KERNEL_VA_TO_PA(zero_page), PF_TYPE_ZERO);
 
    /* Initialize the kmalloc heap used for the "hi virtual mem" area */
    init_hi_vmem_heap();
@@ -181,7 +155,7 @@ map_framebuffer(pdir_t *pdir,
    if (!get_kernel_pdir())
       return failsafe_map_framebuffer(paddr, size);
 
-   if (!pageframes_refcount)
+   if (!pageframes)
       return failsafe_map_framebuffer(paddr, size);
 
    size_t count;
@@ -245,8 +219,17 @@ map_framebuffer(pdir_t *pdir,
       panic("Unable to map the framebuffer in the virtual space");
    }
 
+   /*
+    * User mappings (see fbdev_mmap()) get the same memory type as the kernel
+    * one: apps blitting whole frames through /dev/fb0 rely on that. Note: the
+    * attribute bits live in the PTEs, which are copied as they are on fork().
+    */
    if (kopt_fb_no_wc) {
-      printk("paging: skip marking framebuffer pages as WC (kopt_fb_no_wc)\n");
+
+      if (!user_mmap)
+         printk("paging: skip marking framebuffer pages as WC "
+                "(kopt_fb_no_wc)\n");
+
       return (void *)vaddr;
    }
 
@@ -160,3 +160,8 @@ void map_big_page_int(pdir_t *pdir,
 
 void set_pages_io(pdir_t *pdir, void *vaddr, size_t size);
 
+/*
+ * Like set_curr_pdir(), but tags the address space with an ASID, keeping its
+ * TLB entries from the last time it was used.
+ */
+void switch_to_pdir(pdir_t *pdir);
@@ -26,6 +26,8 @@
 
 #include <tilck/mods/tracing.h>
 
+#include "paging_int.h"
+
 void asm_trap_entry_resume(void);
 
 STATIC_ASSERT(
@@ -113,8 +115,21 @@ is_fpu_enabled_for_task(struct task *ti)
 static inline void
 save_curr_fpu_ctx_if_enabled(void)
 {
-   if (is_fpu_enabled_for_task(get_curr_task())) {
+   struct task *curr = get_curr_task();
+
+   if (!is_fpu_enabled_for_task(curr))
+      return;
+
+   /*
+    * The HW moves sstatus.FS to Dirty on the first write to any FPU register.
+    * We restore the FPU context in the Clean state, so if it's still Clean,
+    * the task didn't touch the FPU during its time-slice and its saved context
+    * is still valid: no need to save it again.
+    */
+   if ((curr->state_regs->sstatus & SR_FS) == SR_FS_DIRTY) {
       save_current_fpu_regs(false);
+      curr->state_regs->sstatus &= ~SR_FS;
+      curr->state_regs->sstatus |= SR_FS_CLEAN;
    }
 }
 
@@ -135,6 +150,10 @@ switch_to_task(struct task *ti)
    ASSERT(!is_preemption_enabled());
    switch_to_task_safety_checks(curr, ti);
 
+   if (ti != curr) {
+      trace_point(tp_sched_switch, curr->tid, ti->tid, curr->state);
+   }
+
    /* Do as much as possible work before disabling the interrupts */
    task_change_state_idempotent(ti, TASK_STATE_RUNNING);
    ti->ticks.timeslice = 0;
@@ -145,7 +164,7 @@ switch_to_task(struct task *ti)
    if (!is_kernel_thread(ti)) {
 
       if (get_curr_pdir() != ti->pi->pdir) {
-         set_curr_pdir(ti->pi->pdir);
+         switch_to_pdir(ti->pi->pdir);
       }
 
       if (!running_in_kernel(ti)) {
@@ -154,6 +173,8 @@ switch_to_task(struct task *ti)
 
       if (is_fpu_enabled_for_task(ti)) {
          restore_fpu_regs(ti, false);
+         state->sstatus &= ~SR_FS;
+         state->sstatus |= SR_FS_CLEAN;
       }
    }
 
@@ -171,6 +192,10 @@ switch_to_task(struct task *ti)
    set_curr_task(ti);
    ti->timer_ready = false;
 
+   /* The interrupts-off interval, if any, ends with the SRET */
+   if (state->sstatus & SR_SPIE)
+      irqs_off_trace_end();
+
    context_switch(state);
 }
 
@@ -23,6 +23,37 @@ extern struct irq_domain *root_domain;
 
 static ulong riscv_timebase;
 static ulong riscv_hz;
+static u64 riscv_next_tick;        /* rdtime() value of the next tick */
+static u64 riscv_oneshot_start;    /* rdtime() at hw_timer_stop_tick() */
+static u64 riscv_oneshot_end;      /* when != 0, the one-shot mode is active */
+static bool riscv_use_sstc;
+
+/*
+ * With the Sstc extension, the timer's deadline is a S-mode CSR: setting it
+ * doesn't require a trap into the SBI firmware, on every tick.
+ */
+static void riscv_set_timer(u64 t)
+{
+   if (!riscv_use_sstc) {
+      sbi_set_timer(t);
+      return;
+   }
+
+#if __riscv_xlen == 64
+   csr_write(CSR_STIMECMP, t);
+#else
+   /* Avoid a spurious IRQ while the two halves are inconsistent */
+   csr_write(CSR_STIMECMP, ~0ul);
+   csr_write(CSR_STIMECMPH, (ulong)(t >> 32));
+   csr_write(CSR_STIMECMP, (ulong)t);
+#endif
+}
+
+static void riscv_set_next_tick(u64 t)
+{
+   riscv_next_tick = t;
+   riscv_set_timer(t);
+}
 
 static enum irq_action riscv_timer_irq_handler(void *ctx)
 {
@@ -34,7 +65,7 @@ static enum irq_action riscv_timer_irq_handler(void *ctx)
    disable_interrupts_forced();
    csr_set(CSR_SIE, IE_TIE);
 
-   sbi_set_timer(rdtime() + riscv_timebase / riscv_hz);
+   riscv_set_next_tick(rdtime() + riscv_timebase / riscv_hz);
    return hret;
 }
 
@@ -63,6 +94,7 @@ u32 hw_timer_setup(u32 interval)
    u64 actual_interval;
 
    riscv_timebase = fdt_parse_timebase_frequency();
+   riscv_use_sstc = riscv_cpu_features.isa_exts.sstc;
    riscv_hz = TS_SCALE / interval;
    actual_interval = TS_SCALE;
    actual_interval *= riscv_timebase / riscv_hz;
@@ -75,7 +107,79 @@ u32 hw_timer_setup(u32 interval)
    root_domain->irq_map[IRQ_S_TIMER] = irq;
    irq_install_handler(irq, &riscv_timer_irq_node);
 
-   sbi_set_timer(rdtime() + riscv_timebase / riscv_hz);
+   riscv_set_next_tick(rdtime() + riscv_timebase / riscv_hz);
    return (u32)actual_interval;
 }
 
+/*
+ * Stop the periodic tick and make the timer fire just once, at the time when
+ * `max_ticks` more ticks would have happened. The RISC-V timer is one-shot:
+ * here we just program it further in the future. Sets `*phase` to the time
+ * elapsed since the last tick, in TS_SCALE units, and returns the number of
+ * ticks programmed.
+ *
+ * Called with interrupts disabled.
+ */
+u32 hw_timer_stop_tick(u32 max_ticks, u32 *phase)
+{
+   const u64 period = riscv_timebase / riscv_hz;
+   u64 phase_time;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(!riscv_oneshot_end);
+
+   if (max_ticks < 2)
+      return 0;
+
+   riscv_oneshot_start = rdtime();
+   riscv_oneshot_end = riscv_next_tick + (max_ticks - 1) * period;
+   riscv_set_timer(riscv_oneshot_end);
+
+   /*
+    * Since the last tick. It might be more than a period, if the tick's IRQ is
+    * pending right now: setting the new deadline clears it, so account it here.
+    */
+   phase_time = riscv_oneshot_start + period - riscv_next_tick;
+   *phase = (u32)(phase_time * TS_SCALE / riscv_timebase);
+   return max_ticks;
+}
+
+/*
+ * Restore the periodic tick, stopped by hw_timer_stop_tick(). Returns the time
+ * elapsed since then, in TS_SCALE units, and sets `*expired` if the one-shot
+ * timer has fired (its IRQ might be still pending).
+ *
+ * Called with interrupts disabled.
+ */
+u64 hw_timer_restart_tick(bool *expired)
+{
+   const u64 now = rdtime();
+   u64 elapsed;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(riscv_oneshot_end > 0);
+
+   *expired = now >= riscv_oneshot_end;
+   elapsed = MIN(now, riscv_oneshot_end) - riscv_oneshot_start;
+   riscv_oneshot_end = 0;
+
+   /*
+    * If the timer has expired, its IRQ handler will re-arm it: setting a new
+    * deadline here would clear the pending IRQ.
+    */
+   if (!*expired)
+      riscv_set_next_tick(now + riscv_timebase / riscv_hz);
+
+   return elapsed * TS_SCALE / riscv_timebase;
+}
+
+/* rdtime() runs at the timebase frequency, read from the device tree */
+bool hw_tsc_is_stable(void)
+{
+   return true;
+}
+
+u64 hw_tsc_get_hz(void)
+{
+   return riscv_timebase;
+}
@@ -190,7 +190,7 @@ static struct syscall syscalls[MAX_SYSCALLS] =
    [123] = DECL_SYS(sys_sched_getaffinity, 0),
    [124] = DECL_SYS(sys_sched_yield, 0),
    [125] = DECL_SYS(sys_sched_get_priority_max, 0),
-   [126] = DECL_SYS(sys_sched_set_priority_min, 0),
+   [126] = DECL_SYS(sys_sched_get_priority_min, 0),
    [127] = DECL_SYS(sys_sched_rr_get_interval, 0),
    [128] = DECL_SYS(sys_restart_syscall, 0),
    [129] = DECL_SYS(sys_kill, 0),
@@ -422,6 +422,7 @@ static void do_special_syscall(regs_t *r)
    const bool preemptable = ~fl & SYSFL_NO_PREEMPT;
    const bool traceable = ~fl & SYSFL_NO_TRACE;
    const bool raw_regs = fl & SYSFL_RAW_REGS;
+   u64 start;
 
    if (signals)
       process_signals(curr, sig_pre_syscall, r);
@@ -429,13 +430,17 @@ static void do_special_syscall(regs_t *r)
    if (preemptable)
       enable_preemption();
 
+   start = trace_sys_stats_begin();
+
    if (traceable)
       trace_sys_enter(sn,r->a0,r->a1,r->a2,r->a3,r->a4,r->a5);
 
    do_syscall_int(fptr, r, raw_regs);
 
-   if (traceable)
-      trace_sys_exit(sn,r->a0,r->a1,r->a2,r->a3,r->a4,r->a5, r->a7);
+   if (traceable) {
+      trace_sys_exit(sn,r->a0,start,r->a1,r->a2,r->a3,r->a4,r->a5, r->a7);
+      trace_sys_stats_end(sn, r->a0, start);
+   }
 
    if (preemptable)
       disable_preemption();
@@ -453,9 +458,11 @@ static void do_syscall(regs_t *r)
    process_signals(curr, sig_pre_syscall, r);
    enable_preemption();
    {
+      const u64 start = trace_sys_stats_begin();
       trace_sys_enter(sn,r->a0,r->a1,r->a2,r->a3,r->a4,r->a5);
       do_syscall_int(fptr, r, false);
-      trace_sys_exit(sn,r->a0,r->a1,r->a2,r->a3,r->a4,r->a5, r->a7);
+      trace_sys_exit(sn,r->a0,start,r->a1,r->a2,r->a3,r->a4,r->a5, r->a7);
+      trace_sys_stats_end(sn, r->a0, start);
    }
    disable_preemption();
    process_signals(curr, sig_in_syscall, r);
@@ -17,8 +17,8 @@
 #include <tilck/kernel/signal.h>
 #include <tilck/mods/tracing.h>
 
-void syscall_int80_entry(void);
-void sysenter_entry(void);
+void syscall_x64_entry(void);
+extern ulong syscall_kernel_rsp;
 
 typedef long (*syscall_type)();
 
@@ -65,6 +65,8 @@ static void __unknown_syscall(void)
  */
 static struct syscall syscalls[MAX_SYSCALLS] =
 {
+   [158] = DECL_SYS(sys_arch_prctl, 0),
+
    [TILCK_CMD_SYSCALL] = DECL_SYS(sys_tilck_cmd, 0),
 };
 
@@ -79,13 +81,75 @@ int get_syscall_num(void *func)
    NOT_IMPLEMENTED();
 }
 
+static NO_INLINE void
+do_syscall_int(syscall_type fptr, regs_t *r)
+{
+   r->rax = (ulong) fptr(r->rdi, r->rsi, r->rdx, r->r10, r->r8, r->r9);
+}
+
+static void do_syscall(regs_t *r)
+{
+   struct task *curr = get_curr_task();
+   const u32 sn = (u32)r->rax;
+   const syscall_type fptr = syscalls[sn].fptr;
+
+   process_signals(curr, sig_pre_syscall, r);
+   enable_preemption();
+   {
+      const u64 start = trace_sys_stats_begin();
+      trace_sys_enter(sn,r->rdi,r->rsi,r->rdx,r->r10,r->r8,r->r9);
+      do_syscall_int(fptr, r);
+      trace_sys_exit(sn,r->rax,start,r->rdi,r->rsi,r->rdx,r->r10,r->r8,r->r9);
+      trace_sys_stats_end(sn, r->rax, start);
+   }
+   disable_preemption();
+   process_signals(curr, sig_in_syscall, r);
+}
+
 void handle_syscall(regs_t *r)
 {
-   NOT_IMPLEMENTED();
+   const ulong sn = r->rax;
+
+   save_current_task_state(r, false);
+   set_current_task_in_kernel();
+
+   if (LIKELY(sn < ARRAY_SIZE(syscalls) && syscalls[sn].fptr))
+      do_syscall(r);
+   else
+      unknown_syscall_int(r, (u32)sn);
+
+   set_current_task_in_user_mode();
+}
+
+/*
+ * There's no TSS on x86_64 yet: the only user of the kernel stack pointer is
+ * the SYSCALL entry point.
+ */
+void set_kernel_stack(ulong stack)
+{
+   syscall_kernel_rsp = stack;
 }
 
 void init_syscall_interfaces(void)
 {
-   NOT_IMPLEMENTED();
+   /* Enable the SYSCALL and SYSRET instructions */
+   wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+
+   /*
+    * STAR[47:32]: SYSCALL loads CS from here and SS from here + 8.
+    * STAR[63:48]: SYSRET loads SS from here + 8 and CS from here + 16.
+    */
+   wrmsr(MSR_STAR,
+         (u64)(X86_USER_DATA_SEL - 8) << 48 |
+         (u64)X86_KERNEL_CODE_SEL << 32);
+
+   wrmsr(MSR_LSTAR, (ulong)&syscall_x64_entry);
+
+   /*
+    * RFLAGS bits cleared on SYSCALL. In particular, keep the interrupts
+    * disabled until we've switched to the kernel stack.
+    */
+   wrmsr(MSR_SFMASK,
+         EFLAGS_IF | EFLAGS_DF | EFLAGS_TF | EFLAGS_AC | EFLAGS_NT);
 }
 
@@ -9,6 +9,9 @@
 
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/lazyfree.h>
 
 #include "../generic_x86/paging_generic_x86.h"
 
@@ -72,6 +75,16 @@ void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
    NOT_IMPLEMENTED();
 }
 
+void set_pages_rw(pdir_t *pdir, void *vaddrp, size_t page_count, bool rw)
+{
+   NOT_IMPLEMENTED();
+}
+
+void swap_pages(pdir_t *pdir, void *vaddrp1, void *vaddrp2)
+{
+   NOT_IMPLEMENTED();
+}
+
 NODISCARD int
 map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
 {
@@ -142,6 +155,21 @@ void pdir_destroy(pdir_t *pdir)
    NOT_IMPLEMENTED();
 }
 
+void pdir_destroy_preemptible(pdir_t *pdir)
+{
+   NOT_IMPLEMENTED();
+}
+
+void pdir_count_user_pages(pdir_t *pdir, size_t *mapped, size_t *resident)
+{
+   NOT_IMPLEMENTED();
+}
+
+size_t pdir_count_page_tables(pdir_t *pdir)
+{
+   NOT_IMPLEMENTED();
+}
+
 void set_pages_pat_wc(pdir_t *pdir, void *vaddr, size_t size)
 {
    NOT_IMPLEMENTED();
@@ -152,6 +180,31 @@ bool handle_potential_cow(void *context)
    NOT_IMPLEMENTED();
 }
 
+bool handle_potential_swap_in(void *context)
+{
+   NOT_IMPLEMENTED();
+}
+
+size_t pdir_reclaim_cold_pages(pdir_t *pdir, size_t max)
+{
+   NOT_IMPLEMENTED();
+}
+
+void pdir_merge_same_pages(pdir_t *pdir, struct ksm_scan_ctx *ctx)
+{
+   NOT_IMPLEMENTED();
+}
+
+size_t pdir_mark_lazyfree_pages(pdir_t *pdir, ulong va, size_t count)
+{
+   NOT_IMPLEMENTED();
+}
+
+size_t pdir_drop_lazyfree_pages(pdir_t *pdir, size_t max)
+{
+   NOT_IMPLEMENTED();
+}
+
 void init_hi_vmem_heap(void)
 {
    NOT_IMPLEMENTED();
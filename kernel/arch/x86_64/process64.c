@@ -5,6 +5,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/utils.h>
+#include <tilck/common/arch/generic_x86/cpu_features.h>
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/process.h>
@@ -24,6 +25,93 @@
 
 #include <tilck/mods/tracing.h>
 
+/* arch_prctl() codes, see <asm/prctl.h> */
+#define ARCH_SET_GS        0x1001
+#define ARCH_SET_FS        0x1002
+#define ARCH_GET_FS        0x1003
+#define ARCH_GET_GS        0x1004
+
+/*
+ * The user FS and GS bases currently loaded in the CPU. Writing a base MSR is
+ * a serializing instruction costing hundreds of cycles, while most of the
+ * tasks never set their bases (or share the same values): reload them only
+ * when they actually differ.
+ */
+static ulong loaded_fs_base;
+static ulong loaded_gs_base;
+
+static ALWAYS_INLINE ulong read_fs_base(void)
+{
+   ulong val;
+
+   if (!x86_cpu_features.can_use_fsgsbase)
+      return rdmsr(MSR_FS_BASE);
+
+   asmVolatile("rdfsbase %0" : "=r" (val));
+   return val;
+}
+
+static ALWAYS_INLINE ulong read_gs_base(void)
+{
+   ulong val;
+
+   if (!x86_cpu_features.can_use_fsgsbase)
+      return rdmsr(MSR_GS_BASE);
+
+   asmVolatile("rdgsbase %0" : "=r" (val));
+   return val;
+}
+
+static ALWAYS_INLINE void write_fs_base(ulong val)
+{
+   if (val == loaded_fs_base)
+      return;
+
+   if (x86_cpu_features.can_use_fsgsbase)
+      asmVolatile("wrfsbase %0" : : "r" (val));
+   else
+      wrmsr(MSR_FS_BASE, val);
+
+   loaded_fs_base = val;
+}
+
+static ALWAYS_INLINE void write_gs_base(ulong val)
+{
+   if (val == loaded_gs_base)
+      return;
+
+   if (x86_cpu_features.can_use_fsgsbase)
+      asmVolatile("wrgsbase %0" : : "r" (val));
+   else
+      wrmsr(MSR_GS_BASE, val);
+
+   loaded_gs_base = val;
+}
+
+/*
+ * Called on the switch from the current task to `ti`. With FSGSBASE enabled,
+ * user space can change its bases without the kernel knowing it: in that
+ * case, save them back in the outgoing task first.
+ */
+static void switch_fs_gs_base(struct task *ti)
+{
+   struct task *curr = get_curr_task();
+   arch_task_members_t *arch;
+
+   if (x86_cpu_features.can_use_fsgsbase && !is_kernel_thread(curr)) {
+      arch = get_task_arch_fields(curr);
+      arch->fs_base = loaded_fs_base = read_fs_base();
+      arch->gs_base = loaded_gs_base = read_gs_base();
+   }
+
+   if (is_kernel_thread(ti))
+      return;        /* The kernel doesn't use FS nor GS: keep the old ones */
+
+   arch = get_task_arch_fields(ti);
+   write_fs_base(arch->fs_base);
+   write_gs_base(arch->gs_base);
+}
+
 void
 setup_usermode_task_regs(regs_t *r, void *entry, void *stack_addr)
 {
@@ -57,6 +145,7 @@ kthread_create_setup_initial_stack(struct task *ti, regs_t *r, void *arg)
 NORETURN void
 switch_to_task(struct task *ti)
 {
+   switch_fs_gs_base(ti);
    NOT_IMPLEMENTED();
 }
 
@@ -68,3 +157,56 @@ int setup_sig_handler(struct task *ti,
 {
    NOT_IMPLEMENTED();
 }
+
+int sys_arch_prctl(int code, ulong addr)
+{
+   arch_task_members_t *arch = get_task_arch_fields(get_curr_task());
+   ulong val;
+   int rc = 0;
+
+   switch (code) {
+
+      case ARCH_SET_FS:
+      case ARCH_SET_GS:
+
+         if (user_out_of_range(TO_PTR(addr), 0))
+            return -EPERM;
+
+         disable_preemption();
+         {
+            if (code == ARCH_SET_FS) {
+               arch->fs_base = addr;
+               write_fs_base(addr);
+            } else {
+               arch->gs_base = addr;
+               write_gs_base(addr);
+            }
+         }
+         enable_preemption();
+         break;
+
+      case ARCH_GET_FS:
+      case ARCH_GET_GS:
+
+         disable_preemption();
+         {
+            if (code == ARCH_GET_FS)
+               val = x86_cpu_features.can_use_fsgsbase
+                        ? read_fs_base() : arch->fs_base;
+            else
+               val = x86_cpu_features.can_use_fsgsbase
+                        ? read_gs_base() : arch->gs_base;
+         }
+         enable_preemption();
+
+         if (put_user(val, (ulong *)addr))
+            rc = -EFAULT;
+
+         break;
+
+      default:
+         rc = -EINVAL;
+   }
+
+   return rc;
+}
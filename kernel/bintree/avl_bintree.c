@@ -27,12 +27,15 @@ bintree_node_to_obj(struct bintree_node *node, long offset)
 
 #define LEFT_OF(obj) ( OBJTN((obj))->left_obj )
 #define RIGHT_OF(obj) ( OBJTN((obj))->right_obj )
-#define HEIGHT(obj) ((obj) ? OBJTN((obj))->height : -1)
+#define HEIGHT(obj) ((obj) ? (int)OBJTN((obj))->height : -1)
+#define SIZE(obj) ((obj) ? (u32)OBJTN((obj))->size : 0)
 
+/* Updates both the height and the size of the subtree rooted at `node` */
 static inline void
 update_height(struct bintree_node *node, long bintree_offset)
 {
-   node->height = (u16)MAX(HEIGHT(node->left_obj), HEIGHT(node->right_obj)) + 1;
+   node->height = (u32)MAX(HEIGHT(node->left_obj), HEIGHT(node->right_obj)) + 1;
+   node->size = SIZE(node->left_obj) + SIZE(node->right_obj) + 1;
 }
 
 #define UPDATE_HEIGHT(n) update_height((n), bintree_offset)
@@ -217,6 +220,203 @@ bintree_get_last_obj_internal(void *root_obj, long bintree_offset)
    return root_obj;
 }
 
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset)
+{
+   void *res = NULL;
+
+   while (root_obj) {
+
+      if (objval_cmpfun(root_obj, value_ptr) >= 0) {
+
+         // root_obj >= val: it's a candidate, but look for smaller ones.
+         res = root_obj;
+         root_obj = LEFT_OF(root_obj);
+
+      } else {
+
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
+void *
+bintree_find_gt_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset)
+{
+   void *res = NULL;
+
+   while (root_obj) {
+
+      if (objval_cmpfun(root_obj, value_ptr) > 0) {
+         res = root_obj;
+         root_obj = LEFT_OF(root_obj);
+      } else {
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
+ulong
+bintree_get_count_internal(void *root_obj, long bintree_offset)
+{
+   return SIZE(root_obj);
+}
+
+void *
+bintree_get_nth_obj_internal(void *root_obj, ulong n, long bintree_offset)
+{
+   ulong left_size;
+
+   while (root_obj) {
+
+      left_size = SIZE(LEFT_OF(root_obj));
+
+      if (n == left_size)
+         return root_obj;
+
+      if (n < left_size) {
+         root_obj = LEFT_OF(root_obj);
+      } else {
+         n -= left_size + 1;
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+
+   return NULL;
+}
+
+ulong
+bintree_get_rank_internal(void *root_obj,
+                          const void *value_ptr,
+                          cmpfun_ptr objval_cmpfun,
+                          long bintree_offset)
+{
+   ulong rank = 0;
+
+   while (root_obj) {
+
+      if (objval_cmpfun(root_obj, value_ptr) < 0) {
+         rank += SIZE(LEFT_OF(root_obj)) + 1;
+         root_obj = RIGHT_OF(root_obj);
+      } else {
+         root_obj = LEFT_OF(root_obj);
+      }
+   }
+
+   return rank;
+}
+
+static ALWAYS_INLINE void
+bintree_iter_push_left_path(struct bintree_iter *it, void *obj)
+{
+   const long bintree_offset = it->bintree_offset;
+
+   while (obj) {
+      ASSERT(it->stack_size < MAX_TREE_HEIGHT);
+      it->stack[it->stack_size++] = obj;
+      obj = LEFT_OF(obj);
+   }
+}
+
+void
+bintree_iter_start_internal(struct bintree_iter *it,
+                            void *root_obj,
+                            long bintree_offset)
+{
+   it->stack_size = 0;
+   it->bintree_offset = bintree_offset;
+   bintree_iter_push_left_path(it, root_obj);
+}
+
+void
+bintree_iter_start_ge_internal(struct bintree_iter *it,
+                               void *root_obj,
+                               const void *value_ptr,
+                               cmpfun_ptr objval_cmpfun,
+                               long bintree_offset)
+{
+   it->stack_size = 0;
+   it->bintree_offset = bintree_offset;
+
+   /*
+    * Keep on the stack only the objects >= value on the path: exactly the
+    * ones that an in-order visit would still have to return.
+    */
+   while (root_obj) {
+
+      if (objval_cmpfun(root_obj, value_ptr) >= 0) {
+         it->stack[it->stack_size++] = root_obj;
+         root_obj = LEFT_OF(root_obj);
+      } else {
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+}
+
+void *
+bintree_iter_next(struct bintree_iter *it)
+{
+   const long bintree_offset = it->bintree_offset;
+   void *obj;
+
+   if (!it->stack_size)
+      return NULL;
+
+   obj = it->stack[--it->stack_size];
+   bintree_iter_push_left_path(it, RIGHT_OF(obj));
+   return obj;
+}
+
+bool
+bintree_cached_insert_internal(struct bintree_cached *t,
+                               void *obj,
+                               cmpfun_ptr cmp,
+                               long bintree_offset)
+{
+   if (!bintree_insert_internal(&t->root, obj, cmp, bintree_offset))
+      return false;
+
+   if (!t->first || cmp(obj, t->first) < 0)
+      t->first = obj;
+
+   if (!t->last || cmp(obj, t->last) > 0)
+      t->last = obj;
+
+   return true;
+}
+
+void *
+bintree_cached_remove_internal(struct bintree_cached *t,
+                               void *value_ptr,
+                               cmpfun_ptr objval_cmpfun,
+                               long bintree_offset)
+{
+   void *obj;
+
+   obj = bintree_remove_internal(&t->root,
+                                 value_ptr,
+                                 objval_cmpfun,
+                                 bintree_offset);
+
+   if (obj == t->first)
+      t->first = bintree_get_first_obj_internal(t->root, bintree_offset);
+
+   if (obj == t->last)
+      t->last = bintree_get_last_obj_internal(t->root, bintree_offset);
+
+   return obj;
+}
+
 static ALWAYS_INLINE long
 bintree_insrem_ptr_cmp(const void *a, const void *b, long field_off)
 {
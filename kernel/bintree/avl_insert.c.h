@@ -23,6 +23,7 @@ bintree_insert_internal(void **root_obj_ref,
    ASSERT(root_obj_ref != NULL);
 
    if (!*root_obj_ref) {
+      OBJTN(obj_or_value)->size = 1;
       *root_obj_ref = obj_or_value;
       return true;
    }
@@ -43,6 +44,7 @@ bintree_insert_internal(void **root_obj_ref,
       return false; /* element already existing */
 
    /* Place our object in its right destination */
+   OBJTN(obj_or_value)->size = 1;
    *dest = obj_or_value;
 
    while (stack_size > 0)
@@ -0,0 +1,436 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/blkdev.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+
+#define BLKDEV_BOUNCE_SECTORS                  16
+
+static struct blk_device *blk_devices[BLK_MAX_DEVICES];
+static u16 blk_devices_count;
+static u16 blk_major;
+
+/*
+ * Done with the lock held: the bios of the request are completed and the
+ * waiters woken up. The request is freed.
+ */
+static void
+blk_complete_request(struct blk_device *dev, struct blk_request *req, int rc)
+{
+   struct blk_bio *bio, *tmp;
+
+   list_for_each(bio, tmp, &req->bios, node) {
+      list_remove(&bio->node);
+      bio->rc = rc;
+      bio->done = true;
+   }
+
+   if (dev->active == req)
+      dev->active = NULL;
+
+   kfree_obj(req, struct blk_request);
+   kcond_signal_all(&dev->done_cond);
+}
+
+/*
+ * The elevator (C-LOOK): serve the pending requests in ascending order of
+ * sector, starting from the current position of the head. After the last one,
+ * restart from the lowest sector.
+ */
+static struct blk_request *blk_elevator_next(struct blk_device *dev)
+{
+   struct blk_request *req;
+
+   list_for_each_ro(req, &dev->queue, node) {
+      if (req->sector >= dev->head)
+         return req;
+   }
+
+   return list_first_obj(&dev->queue, struct blk_request, node);
+}
+
+static void blk_dispatch(struct blk_device *dev)
+{
+   struct blk_request *req;
+   int rc;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&dev->lock));
+
+   while (!dev->active && !dev->plug_count && !list_is_empty(&dev->queue)) {
+
+      req = blk_elevator_next(dev);
+      list_remove(&req->node);
+
+      dev->active = req;
+      dev->head = req->sector + req->sectors;
+      dev->stats.requests++;
+
+      if ((rc = dev->ops->submit(dev, req)) < 0)
+         blk_complete_request(dev, req, rc);
+   }
+}
+
+static bool
+blk_can_merge(struct blk_request *req, struct blk_bio *bio)
+{
+   return req->write == bio->write &&
+          req->bios_count < BLK_MAX_REQ_BIOS &&
+          req->sectors + bio->sectors <= BLK_MAX_REQ_SECTORS;
+}
+
+/*
+ * Queues `bio`, merging it with an adjacent pending request when possible.
+ * Otherwise, a new request for it is inserted in the queue keeping the order
+ * by sector. A bio bigger than BLK_MAX_REQ_SECTORS just gets its own request.
+ */
+static int blk_queue_bio(struct blk_device *dev, struct blk_bio *bio)
+{
+   struct blk_request *req, *next = NULL;
+
+   list_for_each_ro(req, &dev->queue, node) {
+
+      if (blk_can_merge(req, bio)) {
+
+         if (req->sector + req->sectors == bio->sector) {
+            list_add_tail(&req->bios, &bio->node);
+            goto merged;
+         }
+
+         if (bio->sector + bio->sectors == req->sector) {
+            list_add_head(&req->bios, &bio->node);
+            req->sector = bio->sector;
+            goto merged;
+         }
+      }
+
+      if (!next && req->sector > bio->sector)
+         next = req;
+   }
+
+   if (!(req = kzalloc_obj(struct blk_request)))
+      return -ENOMEM;
+
+   list_node_init(&req->node);
+   list_init(&req->bios);
+   list_add_tail(&req->bios, &bio->node);
+   req->sector = bio->sector;
+   req->sectors = bio->sectors;
+   req->bios_count = 1;
+   req->write = bio->write;
+
+   if (next)
+      list_add_before(&next->node, &req->node);
+   else
+      list_add_tail(&dev->queue, &req->node);
+
+   return 0;
+
+merged:
+   req->sectors += bio->sectors;
+   req->bios_count++;
+   dev->stats.merges++;
+   return 0;
+}
+
+void blk_submit_bio(struct blk_device *dev, struct blk_bio *bio)
+{
+   int rc;
+
+   ASSERT(bio->sectors > 0);
+
+   list_node_init(&bio->node);
+   bio->done = false;
+   bio->rc = 0;
+
+   kmutex_lock(&dev->lock);
+   {
+      dev->stats.bios++;
+
+      if ((rc = blk_queue_bio(dev, bio)) < 0) {
+         bio->rc = rc;
+         bio->done = true;
+      }
+
+      blk_dispatch(dev);
+   }
+   kmutex_unlock(&dev->lock);
+}
+
+int blk_wait_bio(struct blk_device *dev, struct blk_bio *bio)
+{
+   kmutex_lock(&dev->lock);
+   {
+      while (!bio->done)
+         kcond_wait(&dev->done_cond, &dev->lock, KCOND_WAIT_FOREVER);
+   }
+   kmutex_unlock(&dev->lock);
+   return bio->rc;
+}
+
+/*
+ * Called by the drivers when the I/O for `req` is completed. Must NOT be called
+ * from the submit() callback (the lock is not recursive).
+ */
+void blk_end_request(struct blk_device *dev, struct blk_request *req, int rc)
+{
+   kmutex_lock(&dev->lock);
+   {
+      ASSERT(dev->active == req);
+      blk_complete_request(dev, req, rc);
+      blk_dispatch(dev);
+   }
+   kmutex_unlock(&dev->lock);
+}
+
+/*
+ * While the device is plugged, the bios are just queued (and merged): that
+ * allows the callers submitting a batch of bios to get them merged even when
+ * the device is idle.
+ */
+void blk_plug(struct blk_device *dev)
+{
+   kmutex_lock(&dev->lock);
+   {
+      dev->plug_count++;
+   }
+   kmutex_unlock(&dev->lock);
+}
+
+void blk_unplug(struct blk_device *dev)
+{
+   kmutex_lock(&dev->lock);
+   {
+      ASSERT(dev->plug_count > 0);
+
+      if (!--dev->plug_count)
+         blk_dispatch(dev);
+   }
+   kmutex_unlock(&dev->lock);
+}
+
+static int
+blk_rw(struct blk_device *dev, u64 sector, u32 count, void *buf, bool write)
+{
+   struct blk_bio bio = {
+      .sector = sector,
+      .sectors = count,
+      .write = write,
+      .buf = buf,
+   };
+
+   if (sector >= dev->sectors || count > dev->sectors - sector)
+      return -EINVAL;
+
+   if (write && dev->read_only)
+      return -EROFS;
+
+   blk_submit_bio(dev, &bio);
+   return blk_wait_bio(dev, &bio);
+}
+
+int blk_read(struct blk_device *dev, u64 sector, u32 count, void *buf)
+{
+   return blk_rw(dev, sector, count, buf, false);
+}
+
+int blk_write(struct blk_device *dev, u64 sector, u32 count, void *buf)
+{
+   return blk_rw(dev, sector, count, buf, true);
+}
+
+/*
+ * Byte-level access to the block devices, through their /dev/ files. All the
+ * I/O goes through a bounce buffer: the callers' buffers are not necessarily
+ * aligned at sector boundary nor in the linear mapping.
+ */
+static ssize_t
+blkdev_rw(struct blk_device *dev, char *buf, size_t len, offt *pos, bool write)
+{
+   const offt dev_size = (offt)(dev->sectors << BLK_SECTOR_SHIFT);
+   const size_t bsize = BLKDEV_BOUNCE_SECTORS * BLK_SECTOR_SIZE;
+   size_t tot = 0;
+   char *bounce;
+   int rc = 0;
+
+   if (write && dev->read_only)
+      return -EROFS;
+
+   if (*pos >= dev_size)
+      return 0;
+
+   len = (size_t)MIN((offt)len, dev_size - *pos);
+
+   if (!(bounce = kmalloc(bsize)))
+      return -ENOMEM;
+
+   while (tot < len) {
+
+      const u64 sector = (u64)*pos >> BLK_SECTOR_SHIFT;
+      const size_t off = (size_t)(*pos & (BLK_SECTOR_SIZE - 1));
+      const size_t n = MIN(len - tot, bsize - off);
+      const u32 count =
+         (u32)((off + n + BLK_SECTOR_SIZE - 1) >> BLK_SECTOR_SHIFT);
+
+      /* Reads and the partial-sector writes need the current data */
+      if (!write || off || (n & (BLK_SECTOR_SIZE - 1)))
+         if ((rc = blk_read(dev, sector, count, bounce)))
+            break;
+
+      if (write) {
+
+         memcpy(bounce + off, buf + tot, n);
+
+         if ((rc = blk_write(dev, sector, count, bounce)))
+            break;
+
+      } else {
+
+         memcpy(buf + tot, bounce + off, n);
+      }
+
+      tot += n;
+      *pos += (offt)n;
+   }
+
+   kfree2(bounce, bsize);
+   return tot ? (ssize_t)tot : rc;
+}
+
+static inline struct blk_device *blkdev_get_dev(fs_handle h)
+{
+   struct devfs_handle *dh = h;
+   return blk_devices[dh->file->dev_minor];
+}
+
+static ssize_t blkdev_read(fs_handle h, char *buf, size_t len, offt *pos)
+{
+   return blkdev_rw(blkdev_get_dev(h), buf, len, pos, false);
+}
+
+static ssize_t blkdev_write(fs_handle h, char *buf, size_t len, offt *pos)
+{
+   return blkdev_rw(blkdev_get_dev(h), buf, len, pos, true);
+}
+
+static offt blkdev_seek(fs_handle h, offt off, int whence)
+{
+   struct devfs_handle *dh = h;
+   struct blk_device *dev = blkdev_get_dev(h);
+
+   switch (whence) {
+
+      case SEEK_SET:
+         break;
+
+      case SEEK_CUR:
+         off += dh->h_fpos;
+         break;
+
+      case SEEK_END:
+         off += (offt)(dev->sectors << BLK_SECTOR_SHIFT);
+         break;
+
+      default:
+         return -EINVAL;
+   }
+
+   if (off < 0)
+      return -EINVAL;
+
+   dh->h_fpos = off;
+   return off;
+}
+
+static int
+blkdev_create_device_file(int minor,
+                          enum vfs_entry_type *type,
+                          struct devfs_file_info *nfo)
+{
+   static const struct file_ops static_ops_blkdev = {
+      .read = blkdev_read,
+      .write = blkdev_write,
+      .seek = blkdev_seek,
+   };
+
+   *type = VFS_BLOCK_DEV;
+   nfo->fops = &static_ops_blkdev;
+   nfo->spec_flags = 0;
+   return 0;
+}
+
+STATIC void blk_init_device(struct blk_device *dev)
+{
+   kmutex_init(&dev->lock, 0);
+   kcond_init(&dev->done_cond);
+   list_init(&dev->queue);
+   dev->active = NULL;
+   dev->plug_count = 0;
+   dev->head = 0;
+   bzero(&dev->stats, sizeof(dev->stats));
+}
+
+static int blk_register_driver(void)
+{
+   struct driver_info *di;
+   int rc;
+
+   if (!(di = kalloc_obj(struct driver_info)))
+      return -ENOMEM;
+
+   di->name = "blk";
+   di->create_dev_file = blkdev_create_device_file;
+
+   if ((rc = register_driver(di, -1)) < 0) {
+      kfree_obj(di, struct driver_info);
+      return rc;
+   }
+
+   blk_major = (u16)rc;
+   return 0;
+}
+
+/*
+ * Registers a block device, created by a driver, and its /dev/<name> file.
+ * The driver must have set `name`, `sectors`, `read_only`, `ops` and `priv`.
+ */
+int register_blk_device(struct blk_device *dev)
+{
+   int rc;
+
+   if (blk_devices_count == BLK_MAX_DEVICES)
+      return -ENOSPC;
+
+   if (!blk_major)
+      if ((rc = blk_register_driver()) < 0)
+         return rc;
+
+   blk_init_device(dev);
+   dev->minor = blk_devices_count;
+
+   if ((rc = create_dev_file(dev->name, blk_major, dev->minor, NULL)) < 0)
+      return rc;
+
+   blk_devices[blk_devices_count++] = dev;
+
+   printk("blk: registered /dev/%s, %lu MB%s\n",
+          dev->name,
+          (ulong)((dev->sectors << BLK_SECTOR_SHIFT) / MB),
+          dev->read_only ? ", read-only" : "");
+
+   return 0;
+}
+
+struct blk_device *get_blk_device(const char *name)
+{
+   for (u16 i = 0; i < blk_devices_count; i++)
+      if (!strcmp(blk_devices[i]->name, name))
+         return blk_devices[i];
+
+   return NULL;
+}
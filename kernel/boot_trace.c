@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/timer.h>
+
+static struct boot_trace_event events[BOOT_TRACE_MAX_EVENTS];
+static int events_count;
+
+/*
+ * Records the start of a boot step and returns its id, to be passed to
+ * boot_trace_end(). When the array is full, the step is just not recorded and
+ * -1 is returned. Safe to call from any context, even before the IDT is set.
+ */
+int boot_trace_begin(const char *name, const char *arg)
+{
+   const u64 ts = get_sys_time();
+   ulong var;
+   int id = -1;
+
+   disable_interrupts(&var);
+   {
+      if (events_count < BOOT_TRACE_MAX_EVENTS) {
+
+         id = events_count++;
+
+         events[id] = (struct boot_trace_event) {
+            .name = name,
+            .arg = arg,
+            .start = RDTSC(),
+            .sys_time = ts,
+         };
+      }
+   }
+   enable_interrupts(&var);
+   return id;
+}
+
+void boot_trace_end(int id)
+{
+   if (id >= 0)
+      events[id].end = RDTSC();
+}
+
+int boot_trace_get_count(void)
+{
+   return events_count;
+}
+
+const struct boot_trace_event *boot_trace_get_event(int i)
+{
+   return i < events_count ? &events[i] : NULL;
+}
+
+/*
+ * Converts TSC cycles to microseconds. When the timer code has not calibrated
+ * the TSC (yet), its frequency is measured against the system time, from the
+ * first step recorded after the timer started, until now. Returns 0 if that's
+ * not possible yet.
+ */
+u64 boot_trace_tsc_to_us(u64 tsc)
+{
+   const struct boot_trace_event *ref = NULL;
+   u64 now_tsc, now_ms, ref_ms, cycles_per_ms;
+   u64 ns;
+
+   if ((ns = tsc_to_ns(tsc)))
+      return ns / 1000;
+
+   for (int i = 0; i < events_count && !ref; i++)
+      if (events[i].sys_time)
+         ref = &events[i];
+
+   if (!ref)
+      return 0;
+
+   now_tsc = RDTSC();
+   now_ms = get_sys_time() / (TS_SCALE / 1000);
+   ref_ms = ref->sys_time / (TS_SCALE / 1000);
+
+   if (now_ms <= ref_ms || now_tsc <= ref->start)
+      return 0;
+
+   if (!(cycles_per_ms = (now_tsc - ref->start) / (now_ms - ref_ms)))
+      return 0;
+
+   return tsc * 1000 / cycles_per_ms;
+}
@@ -23,14 +23,14 @@ static char args_buf[PAGE_SIZE];
 static size_t args_buf_used;
 static size_t last_custom_cmd_n;
 
-static bool kopt_is_bool_value(const char *arg)
+static bool INIT_TEXT kopt_is_bool_value(const char *arg)
 {
    return !strcmp(arg, "0") || !strcmp(arg, "false") ||
           !strcmp(arg, "1") || !strcmp(arg, "true");
 }
 
 
-static void kopt_handle_bool(bool *var, const char *arg)
+static void INIT_TEXT kopt_handle_bool(bool *var, const char *arg)
 {
    if (*arg == '-')
       *var = true;
@@ -42,7 +42,7 @@ static void kopt_handle_bool(bool *var, const char *arg)
       printk("WARNING: Invalid value '%s' for a bool option", arg);
 }
 
-static void kopt_handle_long(long *var, const char *arg)
+static void INIT_TEXT kopt_handle_long(long *var, const char *arg)
 {
    int err = 0;
    long res;
@@ -57,7 +57,7 @@ static void kopt_handle_long(long *var, const char *arg)
    *var = res;
 }
 
-static void kopt_handle_ulong(ulong *var, const char *arg)
+static void INIT_TEXT kopt_handle_ulong(ulong *var, const char *arg)
 {
    int base = 10, err = 0;
    ulong res;
@@ -77,7 +77,7 @@ static void kopt_handle_ulong(ulong *var, const char *arg)
    *var = res;
 }
 
-static void kopt_handle_wordstr(const char **var, const char *arg)
+static void INIT_TEXT kopt_handle_wordstr(const char **var, const char *arg)
 {
    size_t len = strlen(arg);
 
@@ -97,13 +97,13 @@ static void kopt_handle_wordstr(const char **var, const char *arg)
 
 #define DEFINE_KOPT KOPT_DEFAULT_ELEM
 
-static const struct kopt all_kopts[] = {
+static const struct kopt all_kopts[] INIT_RODATA = {
    #include <tilck/common/cmdline_opts.h>
 };
 
 #undef DEFINE_KOPT
 
-static void
+static void INIT_TEXT
 handle_cmdline_arg(const char *arg)
 {
    size_t arg_len = strlen(arg);
@@ -119,7 +119,7 @@ handle_cmdline_arg(const char *arg)
    args_buf_used += arg_len + 1;
 }
 
-static void
+static void INIT_TEXT
 handle_selftest_kopt(void)
 {
    char buf[MAX_CMD_ARG_LEN + 1] = SELFTEST_PREFIX;
@@ -154,7 +154,7 @@ struct arg_parse_ctx {
    const struct kopt *last_opt;
 };
 
-static void
+static void INIT_TEXT
 handle_arg_generic(const struct kopt *opt, const char *arg)
 {
    switch (opt->type) {
@@ -180,7 +180,7 @@ handle_arg_generic(const struct kopt *opt, const char *arg)
    }
 }
 
-STATIC void
+STATIC void INIT_TEXT
 use_kernel_arg(struct arg_parse_ctx *ctx, int arg_num, const char *arg)
 {
    const struct kopt *opt;
@@ -266,7 +266,7 @@ use_kernel_arg(struct arg_parse_ctx *ctx, int arg_num, const char *arg)
    }
 }
 
-static void
+static void INIT_TEXT
 do_args_validation(void)
 {
    if (kopt_sercon) {
@@ -286,10 +286,74 @@ do_args_validation(void)
       kopt_ttys = TTY_COUNT;
    }
 
+   if (kopt_pipe_size < PAGE_SIZE || kopt_pipe_size > PIPE_MAX_SIZE) {
+
+      printk("WARNING: Invalid value '%lu' for pipe_size. "
+             "Expected range: [%lu, %u]\n",
+             kopt_pipe_size, PAGE_SIZE, PIPE_MAX_SIZE);
+
+      kopt_pipe_size = PIPE_DEFAULT_SIZE;
+   }
+
+   if (kopt_tty_inbuf < TTY_INPUT_BS || kopt_tty_inbuf > TTY_INPUT_MAX_BS) {
+
+      printk("WARNING: Invalid value '%lu' for tty_inbuf. "
+             "Expected range: [%u, %u]\n",
+             kopt_tty_inbuf, TTY_INPUT_BS, TTY_INPUT_MAX_BS);
+
+      kopt_tty_inbuf = TTY_INPUT_BS;
+   }
+
+   if (kopt_sched_wakeup_gran > SCHED_WAKEUP_GRAN_MAX_US) {
+
+      printk("WARNING: Invalid value '%lu' for sched_wakeup_gran. "
+             "Expected range: [0, %u] us\n",
+             kopt_sched_wakeup_gran, SCHED_WAKEUP_GRAN_MAX_US);
+
+      kopt_sched_wakeup_gran = SCHED_WAKEUP_GRAN_US;
+   }
+
+   if (kopt_zero_pool > ZERO_POOL_MAX_PAGES) {
+
+      printk("WARNING: Invalid value '%lu' for zero_pool. "
+             "Expected range: [0, %u] pages\n",
+             kopt_zero_pool, ZERO_POOL_MAX_PAGES);
+
+      kopt_zero_pool = ZERO_POOL_PAGES;
+   }
+
+   if (kopt_kmutex_spin > KMUTEX_SPIN_MAX_YIELDS) {
+
+      printk("WARNING: Invalid value '%lu' for kmutex_spin. "
+             "Expected range: [0, %u]\n",
+             kopt_kmutex_spin, KMUTEX_SPIN_MAX_YIELDS);
+
+      kopt_kmutex_spin = KMUTEX_SPIN_YIELDS;
+   }
+
+   if (kopt_trace_buf_kb < TRACE_BUF_MIN_KB ||
+       kopt_trace_buf_kb > TRACE_BUF_MAX_KB)
+   {
+      printk("WARNING: Invalid value '%lu' for trace_buf_kb. "
+             "Expected range: [%u, %u] KB\n",
+             kopt_trace_buf_kb, TRACE_BUF_MIN_KB, TRACE_BUF_MAX_KB);
+
+      kopt_trace_buf_kb = TRACE_BUF_KB;
+   }
+
+   if (kopt_kmalloc_sample > KMALLOC_SAMPLE_MAX_RATE) {
+
+      printk("WARNING: Invalid value '%lu' for kmalloc_sample. "
+             "Expected range: [0, %u]\n",
+             kopt_kmalloc_sample, KMALLOC_SAMPLE_MAX_RATE);
+
+      kopt_kmalloc_sample = KMALLOC_SAMPLE_RATE;
+   }
+
    handle_selftest_kopt();
 }
 
-static inline void
+static inline void INIT_TEXT
 end_arg(struct arg_parse_ctx *ctx,
         char *buf,
         char **argbuf_ref,
@@ -300,7 +364,7 @@ end_arg(struct arg_parse_ctx *ctx,
    use_kernel_arg(ctx, (*arg_count_ref)++, buf);
 }
 
-static void debug_check_all_kopts(void)
+static void INIT_TEXT debug_check_all_kopts(void)
 {
    for (u32 i = 0; i < ARRAY_SIZE(all_kopts); i++) {
       for (u32 j = 0; j < ARRAY_SIZE(all_kopts); j++) {
@@ -336,7 +400,7 @@ static void debug_check_all_kopts(void)
    }
 }
 
-void parse_kernel_cmdline(const char *cmdline)
+void INIT_TEXT parse_kernel_cmdline(const char *cmdline)
 {
    char buf[MAX_CMD_ARG_LEN + 1];
    char *argbuf = buf;
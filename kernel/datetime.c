@@ -11,6 +11,7 @@
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/vdso.h>
 
 #define FULL_RESYNC_MAX_ATTEMPTS       10
 
@@ -33,6 +34,8 @@ const char *months3[12] =
 static s64 boot_timestamp;
 static bool in_full_resync;
 
+union vdso_data_page vdso_data_page ALIGNED_AT(PAGE_SIZE);
+
 #if KRN_CLOCK_DRIFT_COMP
 static bool first_sssync_failed; /* first_sub_second_sync_failed */
 static int adj_cnt;              /* adjustments count (temporary, gets reset) */
@@ -124,18 +127,18 @@ static int clock_get_second_drift2(bool enable_preempt_on_exit)
    return (int)(sys_ts - hw_ts);
 }
 
-static bool clock_sub_second_resync(void)
+/*
+ * Polls the HW clock until it changes the second and returns the system time
+ * at that moment. Used only when the HW clock cannot notify that with an IRQ
+ * (see hw_clock_wait_edge()), because it means slow I/O for up to a second.
+ */
+static u64 clock_poll_second_edge(void)
 {
    struct datetime d;
    s64 hw_ts, ts;
-   u64 hw_time_ns;
-   int drift, abs_drift;
-   u32 micro_attempts_cnt;
-   u32 local_full_resync_fails = 0;
+   u32 micro_attempts_cnt = 0;
+   u64 edge;
 
-retry:
-   in_full_resync = true;
-   micro_attempts_cnt = 0;
    disable_preemption();
    hw_read_clock(&d);
    hw_ts = datetime_to_timestamp(d);
@@ -150,11 +153,9 @@ retry:
 
          /*
           * BOOM! We just detected the exact moment when the HW clock changed
-          * the timestamp (seconds). Now, we have to be super quick about
-          * calculating the adjustments.
-          *
-          * NOTE: we're leaving the loop with preemption disabled!
+          * the timestamp (seconds).
           */
+         edge = get_sys_time();
          break;
       }
 
@@ -192,22 +193,39 @@ retry:
       }
    }
 
+   enable_preemption();
+   return edge;
+}
+
+static bool clock_sub_second_resync(void)
+{
+   u64 edge, hw_time_ns;
+   int drift, abs_drift;
+   u32 local_full_resync_fails = 0;
+
+retry:
+   in_full_resync = true;
+
+   if (hw_clock_wait_edge(&edge) < 0)
+      edge = clock_poll_second_edge();
+
    /*
-    * Now that we waited until the seconds changed, we have to very quickly
-    * calculate our initial drift (offset) and set __tick_adj_val and
-    * __tick_adj_ticks_rem accordingly to compensate it.
+    * At `edge`, the HW clock just changed the second: our sub-second drift is
+    * the distance from there to the next second of the system time. Compensate
+    * it by setting __tick_adj_val and __tick_adj_ticks_rem accordingly: the
+    * adjustment is spread over the next ticks, adjtime-like.
     */
 
    disable_interrupts_forced();
    {
-      hw_time_ns = round_up_at64(__time_ns, TS_SCALE);
+      hw_time_ns = round_up_at64(edge, TS_SCALE);
 
-      if (hw_time_ns > __time_ns) {
+      if (hw_time_ns > edge) {
 
          STATIC_ASSERT(TS_SCALE <= BILLION);
 
          /* NOTE: abs_drift cannot be > TS_SCALE [typically, 1 BILLION] */
-         abs_drift = (int)(hw_time_ns - __time_ns);
+         abs_drift = (int)(hw_time_ns - edge);
          __tick_adj_val = (TS_SCALE / TIMER_HZ) / 10;
          __tick_adj_ticks_rem = abs_drift / __tick_adj_val;
       }
@@ -220,7 +238,6 @@ retry:
     * which is the max we can get at boot-time. Now, just to be sure, wait 15s
     * and then check we have absolutely no drift measurable in seconds.
     */
-   enable_preemption_nosched();
    kernel_sleep(15 * TIMER_HZ);
    drift = clock_get_second_drift2(true);
    abs_drift = (drift > 0 ? drift : -drift);
@@ -408,6 +425,8 @@ void init_system_time(void)
       panic("Invalid boot-time UNIX timestamp: %d\n", boot_timestamp);
 
    __time_ns = 0;
+   vdso_data_page.data.boot_timestamp = boot_timestamp;
+   vdso_update_time(__time_ns);
 }
 
 u64 get_sys_time(void)
@@ -416,7 +435,8 @@ u64 get_sys_time(void)
    ulong var;
    disable_interrupts(&var);
    {
-      ts = __time_ns;
+      /* Between two ticks, interpolate with the TSC, when available */
+      ts = __time_ns + __tsc_ns_since_tick();
    }
    enable_interrupts(&var);
    return ts;
@@ -493,13 +513,14 @@ void monotonic_time_get_timespec(struct k_timespec64 *tp)
 static void
 task_cpu_get_timespec(struct k_timespec64 *tp)
 {
-   struct task *ti = get_curr_task();
+   struct k_timespec64 utime, stime;
+   s64 nsec;
 
-   disable_preemption();
-   {
-      ticks_to_timespec(ti->ticks.total, tp);
-   }
-   enable_preemption();
+   task_get_cputime(get_curr_task(), &utime, &stime);
+   nsec = (s64)utime.tv_nsec + stime.tv_nsec;
+
+   tp->tv_sec = utime.tv_sec + stime.tv_sec + nsec / BILLION;
+   tp->tv_nsec = (long)(nsec % BILLION);
 }
 
 int sys_gettimeofday(struct k_timeval *user_tv, struct timezone *user_tz)
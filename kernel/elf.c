@@ -5,6 +5,7 @@
 
 #include <tilck/common/string_util.h>
 #include <tilck/common/utils.h>
+#include <tilck/common/printk.h>
 
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/paging.h>
@@ -16,6 +17,9 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/user.h>
 
 #include <sys/mman.h>      // system header
 
@@ -81,6 +85,26 @@ load_segment_by_copy(fs_handle *elf_h,
             return (int)rc;
          }
 
+      } else if (!is_rw_mapped(pdir, vaddr)) {
+
+         /*
+          * This page is shared with the previous segment, which mapped it
+          * read-only: it might be a file page, the zero page or a page made
+          * read-only by us. Just replace it with a private writable copy.
+          */
+         void *orig = PA_TO_LIN_VA(get_mapping(pdir, vaddr));
+
+         if (!(p = kmalloc(PAGE_SIZE)))
+            return -ENOMEM;
+
+         memcpy(p, orig, PAGE_SIZE);
+         unmap_page(pdir, vaddr, true);
+
+         if ((rc = map_page(pdir, vaddr, LIN_VA_TO_PA(p), PAGING_FL_RWUS))) {
+            kfree2(p, PAGE_SIZE);
+            return (int)rc;
+         }
+
       } else {
 
          /* Get user's vaddr as a kernel vaddr */
@@ -112,9 +136,7 @@ load_segment_by_copy(fs_handle *elf_h,
 
       /* Make the read-only pages to be read-only */
       vaddr = (char *) (phdr->p_vaddr & PAGE_MASK);
-
-      for (size_t j = 0; j < page_count; j++, vaddr += PAGE_SIZE)
-         set_page_rw(pdir, vaddr, false);
+      set_pages_rw(pdir, vaddr, page_count, false);
    }
 
    return 0;
@@ -166,18 +188,110 @@ static inline int check_segment_alignment(Elf_Phdr *phdr)
    return 0;
 }
 
+/*
+ * Writable segments get mapped privately: the pages fully covered by file data
+ * are shared with the file (and with all the other processes running the same
+ * program) until the first write, when they get copied like after fork().
+ * Only the page where the file data ends has to be materialized here, as its
+ * tail belongs to .bss and must be zeroed. The rest of .bss is zero-mapped.
+ */
+static int
+load_rw_segment_by_mmap(fs_handle *elf_h,
+                        pdir_t *pdir,
+                        Elf_Phdr *phdr,
+                        ulong *end_vaddr_ref)
+{
+   const ulong vaddr = phdr->p_vaddr & PAGE_MASK;
+   const ulong file_end = phdr->p_vaddr + phdr->p_filesz;
+   const ulong cow_end = file_end & PAGE_MASK;
+   const ulong mem_end =
+      round_up_at(phdr->p_vaddr + phdr->p_memsz, PAGE_SIZE);
+
+   ulong va = cow_end;
+   size_t count;
+   offt rc;
+
+   /*
+    * In the NO_COW case, everything has to be pre-allocated anyway. The first
+    * page might be shared with the previous segment instead: that's rare and
+    * load_segment_by_copy() already handles it.
+    */
+   if (MMAP_NO_COW || is_mapped(pdir, (void *)vaddr))
+      return load_segment_by_copy(elf_h, pdir, phdr, end_vaddr_ref);
+
+   *end_vaddr_ref = mem_end;
+
+   if (cow_end > vaddr) {
+
+      struct user_mapping um = {0};
+      um.pi = NULL;
+      um.h = elf_h;
+      um.off = phdr->p_offset & PAGE_MASK;
+      um.vaddr = vaddr;
+      um.len = cow_end - vaddr;
+      um.prot = PROT_READ | PROT_WRITE;
+
+      if ((rc = vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER | VFS_MM_PRIVATE)))
+         return (int)rc;
+   }
+
+   if (file_end > cow_end) {
+
+      /* The boundary page: file data, followed by zeros */
+      const ulong data_va = MAX(cow_end, (ulong)phdr->p_vaddr);
+      const size_t to_read = file_end - data_va;
+      char *p;
+
+      if (!(p = kzmalloc(PAGE_SIZE)))
+         return -ENOMEM;
+
+      if ((rc = map_page(pdir, (void *)va, LIN_VA_TO_PA(p), PAGING_FL_RWUS))) {
+         kfree2(p, PAGE_SIZE);
+         return (int)rc;
+      }
+
+      rc = vfs_seek(elf_h,
+                    (offt)(phdr->p_offset + (data_va - phdr->p_vaddr)),
+                    SEEK_SET);
+
+      if (rc < 0)
+         return (int)rc; /* I/O error during seek */
+
+      rc = vfs_read(elf_h, p + (data_va - cow_end), to_read);
+
+      if (rc < 0)
+         return (int)rc;           /* I/O error during read */
+
+      if (rc < (offt)to_read)
+         return -ENOEXEC;      /* The ELF file is corrupted */
+
+      va += PAGE_SIZE;
+   }
+
+   if (mem_end > va) {
+
+      const size_t pg_count = (mem_end - va) >> PAGE_SHIFT;
+      count = map_zero_pages(pdir, (void *)va, pg_count, PAGING_FL_RWUS);
+
+      if (count != pg_count)
+         return -ENOMEM;
+   }
+
+   return 0;
+}
+
 static int
 load_segment_by_mmap(fs_handle *elf_h,
                      pdir_t *pdir,
                      Elf_Phdr *phdr,
                      ulong *end_vaddr_ref)
 {
-   if (phdr->p_flags & PF_W)
-      return load_segment_by_copy(elf_h, pdir, phdr, end_vaddr_ref);
-
    if (UNLIKELY(phdr->p_memsz == 0))
       return 0; /* very weird (because the phdr has type LOAD) */
 
+   if (phdr->p_flags & PF_W)
+      return load_rw_segment_by_mmap(elf_h, pdir, phdr, end_vaddr_ref);
+
    /*
     * Logic behind the calculation of `um.len`.
     *
@@ -238,6 +352,7 @@ static int
 load_elf_headers(fs_handle elf_h,
                  char *hdr_buf,
                  struct elf_headers *eh,
+                 u16 e_type,
                  bool *wrong_arch)
 {
    offt rc;
@@ -256,7 +371,7 @@ load_elf_headers(fs_handle elf_h,
    if (strncmp((const char *)eh->header->e_ident, ELFMAG, 4))
       return -ENOEXEC;
 
-   if (eh->header->e_type != ET_EXEC)
+   if (eh->header->e_type != e_type)
       return -ENOEXEC;
 
    if (eh->header->e_ident[EI_CLASS] != ELF_CURR_CLASS ||
@@ -313,6 +428,43 @@ alloc_and_map_stack_page(pdir_t *pdir, void *stack_top, u32 i)
    return rc;
 }
 
+/*
+ * Maps the pages used by the argv and env strings at the top of the stack and
+ * frees the remaining ones. From now on, the pages belong to `pdir`.
+ */
+static int
+map_exec_args(pdir_t *pdir, struct exec_args *a)
+{
+   const size_t pages = exec_args_pages(a);
+   const size_t used = pages << PAGE_SHIFT;
+   size_t unused = USER_ARGS_MAX_PAGES * PAGE_SIZE - used;
+   void *vaddr = (void *)exec_args_user_vaddr(a);
+   size_t count;
+
+   /* Don't leak to userspace kernel's data after the last string */
+   bzero(a->buf + a->size, used - a->size);
+
+   count = map_pages(pdir,
+                     vaddr,
+                     LIN_VA_TO_PA(a->buf),
+                     pages,
+                     PAGING_FL_US | PAGING_FL_RW);
+
+   if (count != pages) {
+      unmap_pages(pdir, vaddr, count, false);
+      return -ENOMEM;
+   }
+
+   if (unused) {
+      general_kfree(a->buf + used,
+                    &unused,
+                    KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+   }
+
+   a->mapped = true;
+   return 0;
+}
+
 static int
 open_elf_file(const char *filepath, fs_handle *elf_file_ref)
 {
@@ -347,8 +499,8 @@ open_elf_file(const char *filepath, fs_handle *elf_file_ref)
    return 0;
 }
 
-static bool
-is_dyn_exec(struct elf_headers *eh)
+static Elf_Phdr *
+get_interp_phdr(struct elf_headers *eh)
 {
    Elf_Ehdr *hdr = eh->header;
 
@@ -357,10 +509,130 @@ is_dyn_exec(struct elf_headers *eh)
       Elf_Phdr *phdr = eh->phdrs + i;
 
       if (phdr->p_type == PT_INTERP)
-         return true;
+         return phdr;
+   }
+
+   return NULL;
+}
+
+/*
+ * Returns the vaddr of the program headers in memory, needed by the dynamic
+ * linker (AT_PHDR). Typically, the first PT_LOAD segment covers them.
+ */
+static ulong
+get_phdrs_vaddr(struct elf_headers *eh)
+{
+   Elf_Ehdr *hdr = eh->header;
+   const ulong ph_end = hdr->e_phoff + eh->total_phdrs_size;
+
+   for (int i = 0; i < hdr->e_phnum; i++) {
+
+      Elf_Phdr *phdr = eh->phdrs + i;
+
+      if (phdr->p_type == PT_PHDR)
+         return phdr->p_vaddr;
+   }
+
+   for (int i = 0; i < hdr->e_phnum; i++) {
+
+      Elf_Phdr *phdr = eh->phdrs + i;
+
+      if (phdr->p_type != PT_LOAD)
+         continue;
+
+      if (phdr->p_offset <= hdr->e_phoff &&
+          ph_end <= phdr->p_offset + phdr->p_filesz)
+      {
+         return phdr->p_vaddr + (hdr->e_phoff - phdr->p_offset);
+      }
+   }
+
+   return 0;
+}
+
+/*
+ * Load the interpreter of a dynamic executable (the dynamic linker), whose
+ * path is in the PT_INTERP segment, at USER_INTERP_VADDR. It must be an
+ * ET_DYN ELF, without an interpreter itself. Its segments are mapped exactly
+ * like program's ones: in particular, the read-only pages are shared with the
+ * file and therefore with all the other processes.
+ */
+static int
+load_elf_interp(fs_handle prog_h,
+                Elf_Phdr *interp_phdr,
+                struct elf_program_info *pinfo)
+{
+   char hdr_buf[ELF_RAW_HEADER_SIZE];
+   const size_t path_len = interp_phdr->p_filesz;
+   load_segment_func load_seg;
+   struct elf_headers eh;
+   fs_handle h = NULL;
+   bool wrong_arch;
+   char *path;
+   offt rc;
+
+   if (!path_len || path_len > MAX_PATH)
+      return -ENOEXEC;
+
+   if (!(path = kmalloc(path_len)))
+      return -ENOMEM;
+
+   rc = vfs_pread(prog_h, path, path_len, (offt)interp_phdr->p_offset);
+
+   if (rc != (offt)path_len || path[path_len - 1]) {
+      rc = rc < 0 ? rc : -ENOEXEC;
+      goto out;
+   }
+
+   if ((rc = open_elf_file(path, &h)))
+      goto out;
+
+   if ((rc = acquire_subsys_flock_h(h, SUBSYS_PROCMGNT, &pinfo->interp_lf))) {
+      rc = rc == -EBADF ? -ENOEXEC : rc;
+      goto out;
+   }
+
+   if ((rc = load_elf_headers(h, hdr_buf, &eh, ET_DYN, &wrong_arch)))
+      goto out;
+
+   if (get_interp_phdr(&eh)) {
+      rc = -ENOEXEC;          /* the interpreter cannot have an interpreter */
+      goto out_free_eh;
+   }
+
+   load_seg = is_mmap_supported(h)
+      ? &load_segment_by_mmap
+      : &load_segment_by_copy;
+
+   for (int i = 0; i < eh.header->e_phnum; i++) {
+
+      ulong end_vaddr = 0;
+      Elf_Phdr phdr = eh.phdrs[i];
+
+      if (phdr.p_type != PT_LOAD)
+         continue;
+
+      if ((rc = check_segment_alignment(&phdr)))
+         goto out_free_eh;
+
+      phdr.p_vaddr += USER_INTERP_VADDR;
+
+      if ((rc = load_seg(h, pinfo->pdir, &phdr, &end_vaddr)))
+         goto out_free_eh;
    }
 
-   return false;
+   pinfo->interp_base = (void *)USER_INTERP_VADDR;
+   pinfo->entry = (void *)(USER_INTERP_VADDR + eh.header->e_entry);
+
+out_free_eh:
+   free_elf_headers(&eh);
+
+out:
+   if (h)
+      vfs_close(h);
+
+   kfree2(path, path_len);
+   return (int)rc;
 }
 
 int
@@ -371,12 +643,15 @@ load_elf_program(const char *filepath,
    load_segment_func load_seg = NULL;
    fs_handle elf_h = NULL;
    struct elf_headers eh;
+   Elf_Phdr *interp_phdr;
    ulong brk = 0;
    size_t count;
    int rc;
 
    pinfo->wrong_arch = false;
    pinfo->dyn_exec = false;
+   pinfo->interp_lf = NULL;
+   pinfo->interp_base = NULL;
 
    if ((rc = open_elf_file(filepath, &elf_h)))
       return rc;
@@ -386,17 +661,13 @@ load_elf_program(const char *filepath,
       return rc == -EBADF ? -ENOEXEC : rc;
    }
 
-   if ((rc = load_elf_headers(elf_h, header_buf, &eh, &pinfo->wrong_arch))) {
+   rc = load_elf_headers(elf_h, header_buf, &eh, ET_EXEC, &pinfo->wrong_arch);
+
+   if (rc) {
       vfs_close(elf_h);
       return rc;
    }
 
-   if (is_dyn_exec(&eh)) {
-      pinfo->dyn_exec = true;
-      rc = -ENOEXEC;
-      goto out;
-   }
-
    load_seg = is_mmap_supported(elf_h)
       ? &load_segment_by_mmap
       : &load_segment_by_copy;
@@ -430,20 +701,48 @@ load_elf_program(const char *filepath,
          brk = end_vaddr;
    }
 
+   if ((interp_phdr = get_interp_phdr(&eh))) {
+
+      if (brk > USER_INTERP_VADDR) {
+         rc = -ENOEXEC;       /* the program would overlap its interpreter */
+         goto out;
+      }
+
+      if ((rc = load_elf_interp(elf_h, interp_phdr, pinfo))) {
+         pinfo->dyn_exec = true;
+         goto out;
+      }
+
+   } else {
+
+      pinfo->entry = (void *) eh.header->e_entry;
+   }
+
+   pinfo->prog_entry = (void *) eh.header->e_entry;
+   pinfo->phdrs = (void *) get_phdrs_vaddr(&eh);
+   pinfo->phnum = eh.header->e_phnum;
+
    /*
     * Mapping the user stack.
     *
-    * In the "NOCOW" case, all the pages are pre-allocated.
-    * In the default case instead, most of the pages are zero-mapped and so,
-    * therefore, allocated on-demand. But, `USER_ARGS_PAGE_COUNT` pages are
-    * pre-allocated anyway.
+    * At its top, there are argv and env's strings, followed by the pages for
+    * their vectors and the aux one: all of them are pre-allocated. Below them
+    * there are `USER_STACK_PAGES` pages: in the "NOCOW" case, they're
+    * pre-allocated as well. In the default case instead, they're zero-mapped
+    * and, therefore, allocated on-demand.
     */
 
+   const size_t vec_pages =
+      pow2_round_up_at(exec_args_vec_size(pinfo->args, pinfo),
+                       PAGE_SIZE) >> PAGE_SHIFT;
+
+   const size_t stack_pages = USER_STACK_PAGES + vec_pages;
    const size_t pre_allocated_pages =
-      MMAP_NO_COW ? USER_STACK_PAGES : USER_ARGS_PAGE_COUNT;
+      MMAP_NO_COW ? stack_pages : vec_pages;
 
-   const size_t zero_mapped_pages = USER_STACK_PAGES - pre_allocated_pages;
-   const ulong stack_top = (USERMODE_VADDR_END - USER_STACK_PAGES * PAGE_SIZE);
+   const size_t zero_mapped_pages = stack_pages - pre_allocated_pages;
+   const ulong stack_end = exec_args_user_vaddr(pinfo->args);
+   const ulong stack_top = stack_end - stack_pages * PAGE_SIZE;
 
    count = map_zero_pages(pinfo->pdir,
                           (void *)stack_top,
@@ -456,16 +755,17 @@ load_elf_program(const char *filepath,
       goto out;
    }
 
-   for (u32 i = zero_mapped_pages; i < USER_STACK_PAGES; i++) {
+   for (u32 i = zero_mapped_pages; i < stack_pages; i++) {
       if ((rc = alloc_and_map_stack_page(pinfo->pdir, (void *)stack_top, i)))
          goto out;
    }
 
+   if ((rc = map_exec_args(pinfo->pdir, pinfo->args)))
+      goto out;
 
    // Finally setting the output-params.
 
-   pinfo->stack = (void *) USERMODE_STACK_MAX;
-   pinfo->entry = (void *) eh.header->e_entry;
+   pinfo->stack = (void *) stack_end;
    pinfo->brk = (void *) brk;
 
 out:
@@ -481,6 +781,11 @@ out:
 
       if (pinfo->lf)
          release_subsys_flock(pinfo->lf);
+
+      if (pinfo->interp_lf) {
+         release_subsys_flock(pinfo->interp_lf);
+         pinfo->interp_lf = NULL;
+      }
    }
 
    return rc;
@@ -514,14 +819,104 @@ void get_symtab_and_strtab(Elf_Shdr **symtab, Elf_Shdr **strtab)
    VERIFY(*strtab != NULL);
 }
 
-const char *find_sym_at_addr(ulong vaddr, long *offset, u32 *sym_size)
+/*
+ * Index for find_sym_at_addr(): the kernel symbols having a size, sorted by
+ * address. Because the symbols might overlap, each entry has also the max end
+ * address of all the entries up to it: that allows the lookup to stop going
+ * backwards as soon as no symbol before can contain the address.
+ *
+ * It's built by init_ksyms_index() once kmalloc is ready: before that, or if
+ * the allocation failed, find_sym_at_addr() just scans the whole symtab.
+ */
+struct ksym_entry {
+   ulong start;
+   ulong end;
+   ulong max_end;
+   Elf_Sym *sym;
+};
+
+#define KSYM_CACHE_SIZE                       8
+
+static struct ksym_entry *ksyms_index;
+static u32 ksyms_index_count;
+static const char *ksyms_strtab;
+
+/* The symbols of the most recent lookups, the most recent first */
+static Elf_Sym *ksym_cache[KSYM_CACHE_SIZE];
+
+static ulong ksym_entry_key(const void *e)
 {
-   Elf_Shdr *symtab;
-   Elf_Shdr *strtab;
+   return ((const struct ksym_entry *)e)->start;
+}
+
+void init_ksyms_index(void)
+{
+   Elf_Shdr *symtab, *strtab;
+   struct ksym_entry *arr, *tmp;
+   ulong max_end = 0;
+   Elf_Sym *syms;
+   ulong sym_count;
+   u32 cnt = 0;
 
    if (!KERNEL_SYMBOLS)
-      return NULL;
+      return;
+
+   get_symtab_and_strtab(&symtab, &strtab);
+   syms = (Elf_Sym *) symtab->sh_addr;
+   sym_count = symtab->sh_size / sizeof(Elf_Sym);
+
+   for (ulong i = 0; i < sym_count; i++)
+      if (syms[i].st_size)
+         cnt++;
+
+   if (!cnt)
+      return;
+
+   arr = kalloc_array_obj(struct ksym_entry, cnt);
+   tmp = kalloc_array_obj(struct ksym_entry, cnt);
+
+   if (!arr || !tmp) {
+
+      if (arr)
+         kfree_array_obj(arr, struct ksym_entry, cnt);
+
+      if (tmp)
+         kfree_array_obj(tmp, struct ksym_entry, cnt);
+
+      printk("WARNING: no memory for the kernel symbols index\n");
+      return;
+   }
+
+   for (ulong i = 0, j = 0; i < sym_count; i++) {
+
+      Elf_Sym *s = syms + i;
 
+      if (s->st_size) {
+         arr[j++] = (struct ksym_entry) {
+            .start = s->st_value,
+            .end = s->st_value + s->st_size,
+            .sym = s,
+         };
+      }
+   }
+
+   /* Stable: the symbols at the same address keep the symtab's order */
+   radix_sort_generic(arr, tmp, sizeof(*arr), cnt, ksym_entry_key);
+   kfree_array_obj(tmp, struct ksym_entry, cnt);
+
+   for (u32 i = 0; i < cnt; i++) {
+      max_end = MAX(max_end, arr[i].end);
+      arr[i].max_end = max_end;
+   }
+
+   ksyms_strtab = (const char *)strtab->sh_addr;
+   ksyms_index_count = cnt;
+   ksyms_index = arr;
+}
+
+static Elf_Sym *ksym_linear_find(ulong vaddr)
+{
+   Elf_Shdr *symtab, *strtab;
    get_symtab_and_strtab(&symtab, &strtab);
 
    Elf_Sym *syms = (Elf_Sym *) symtab->sh_addr;
@@ -530,21 +925,119 @@ const char *find_sym_at_addr(ulong vaddr, long *offset, u32 *sym_size)
    for (ulong i = 0; i < sym_count; i++) {
       Elf_Sym *s = syms + i;
 
-      if (IN_RANGE(vaddr, s->st_value, s->st_value + s->st_size)) {
+      if (IN_RANGE(vaddr, s->st_value, s->st_value + s->st_size))
+         return s;
+   }
+
+   return NULL;
+}
+
+static Elf_Sym *ksym_index_find(ulong vaddr)
+{
+   u32 lo = 0, hi = ksyms_index_count;
+
+   /* Find the first entry starting after `vaddr` */
+   while (lo < hi) {
+
+      const u32 mid = lo + (hi - lo) / 2;
+
+      if (ksyms_index[mid].start <= vaddr)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   /* Then, go back until a symbol contains it, if any */
+   for (u32 i = lo; i > 0; i--) {
+
+      const struct ksym_entry *e = &ksyms_index[i - 1];
+
+      if (e->max_end <= vaddr)
+         break;
+
+      if (vaddr < e->end)
+         return e->sym;
+   }
+
+   return NULL;
+}
 
-         if (offset)
-            *offset = (long)(vaddr - s->st_value);
+/* Must be called with interrupts disabled */
+static Elf_Sym *ksym_cache_find(ulong vaddr)
+{
+   for (int i = 0; i < KSYM_CACHE_SIZE; i++) {
+
+      Elf_Sym *s = ksym_cache[i];
+
+      if (!s)
+         break;
 
-         if (sym_size)
-            *sym_size = (u32) s->st_size;
+      if (IN_RANGE(vaddr, s->st_value, s->st_value + s->st_size)) {
+
+         /* Move it to the front */
+         for (; i > 0; i--)
+            ksym_cache[i] = ksym_cache[i - 1];
 
-         return (char *)strtab->sh_addr + s->st_name;
+         ksym_cache[0] = s;
+         return s;
       }
    }
 
    return NULL;
 }
 
+/* Must be called with interrupts disabled */
+static void ksym_cache_add(Elf_Sym *s)
+{
+   for (int i = KSYM_CACHE_SIZE - 1; i > 0; i--)
+      ksym_cache[i] = ksym_cache[i - 1];
+
+   ksym_cache[0] = s;
+}
+
+const char *find_sym_at_addr(ulong vaddr, long *offset, u32 *sym_size)
+{
+   Elf_Shdr *symtab, *strtab;
+   const char *strs;
+   Elf_Sym *s;
+   ulong var;
+
+   if (!KERNEL_SYMBOLS)
+      return NULL;
+
+   if (!ksyms_index) {
+
+      if (!(s = ksym_linear_find(vaddr)))
+         return NULL;
+
+      get_symtab_and_strtab(&symtab, &strtab);
+      strs = (const char *)strtab->sh_addr;
+
+   } else {
+
+      disable_interrupts(&var);
+      {
+         if (!(s = ksym_cache_find(vaddr)))
+            if ((s = ksym_index_find(vaddr)))
+               ksym_cache_add(s);
+      }
+      enable_interrupts(&var);
+
+      if (!s)
+         return NULL;
+
+      strs = ksyms_strtab;
+   }
+
+   if (offset)
+      *offset = (long)(vaddr - s->st_value);
+
+   if (sym_size)
+      *sym_size = (u32) s->st_size;
+
+   return strs + s->st_name;
+}
+
 ulong find_addr_of_symbol(const char *searched_sym)
 {
    Elf_Shdr *symtab;
@@ -0,0 +1,631 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_userlim.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/epoll.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/syscalls.h>
+
+#include <sys/epoll.h>    // system header
+
+#ifndef EPOLLEXCLUSIVE
+   #define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+/*
+ * How it works
+ * ---------------
+ *
+ * Each registered fd gets an `epoll_item` which stays permanently linked in
+ * the wait lists of file's r/w/e kconds through WOBJ_EPOLL wait objects. When
+ * one of those kconds is signaled, epoll_on_cond_signal() appends the item
+ * to epoll's ready list (if it's not already there) and wakes up the tasks
+ * sleeping in epoll_wait(). Therefore, epoll_wait() has to look only at the
+ * items in the ready list, instead of re-registering on every fd on each call
+ * as sys_poll() does.
+ *
+ * Level-triggered items are put back in the ready list after being reported,
+ * so that the next epoll_wait() will check them again. Edge-triggered items
+ * re-enter the ready list only when their kcond is signaled again.
+ *
+ * Items added with EPOLLEXCLUSIVE are exclusive waiters on the file's kconds:
+ * when many epoll instances watch the same fd, kcond_signal_one() stops at the
+ * first of them having a task in epoll_wait(), instead of waking them all.
+ *
+ * Locking: items and the per-handle hash table are protected by `epoll_lock`,
+ * while the ready lists, touched by epoll_on_cond_signal(), are protected by
+ * disabling the preemption.
+ */
+
+#define EPOLL_HANDLE_BUCKETS                    32
+
+enum epoll_cond_type {
+   EPOLL_COND_READ,
+   EPOLL_COND_WRITE,
+   EPOLL_COND_EXCEPT,
+   EPOLL_COND_COUNT,
+};
+
+struct epoll {
+
+   KOBJ_BASE_FIELDS
+
+   struct kcond ready_cond;         /* signaled when an item becomes ready */
+   struct list items;               /* list of struct epoll_item */
+   struct list ready_list;          /* list of ready struct epoll_item */
+};
+
+struct epoll_item {
+
+   struct epoll *ep;
+   fs_handle h;
+   u32 events;
+   u64 data;
+   bool disabled;                   /* EPOLLONESHOT item already reported */
+
+   struct list_node node;           /* node in epoll's items list */
+   struct list_node ready_node;     /* node in epoll's ready_list */
+   struct list_node hnode;          /* node in the handle hash table */
+
+   struct wait_obj wobjs[EPOLL_COND_COUNT];
+};
+
+static const struct file_ops static_ops_epoll;
+static struct kmutex epoll_lock = STATIC_KMUTEX_INIT(epoll_lock, 0);
+static struct list epoll_handle_buckets[EPOLL_HANDLE_BUCKETS];
+static bool epoll_buckets_initialized;
+static int epoll_items_count;
+
+static inline struct list *epoll_handle_bucket(fs_handle h)
+{
+   /* Handles are MAX_FS_HANDLE_SIZE-sized objects: skip the low bits */
+   return &epoll_handle_buckets[((ulong)h / MAX_FS_HANDLE_SIZE) %
+                                EPOLL_HANDLE_BUCKETS];
+}
+
+static inline bool is_epoll_handle(fs_handle h)
+{
+   return ((struct fs_handle_base *)h)->fops == &static_ops_epoll;
+}
+
+static void epoll_item_add_to_ready_list(struct epoll_item *it)
+{
+   ASSERT(!is_preemption_enabled());
+
+   if (!list_is_node_in_list(&it->ready_node))
+      list_add_tail(&it->ep->ready_list, &it->ready_node);
+
+   kcond_signal_all(&it->ep->ready_cond);
+}
+
+bool epoll_on_cond_signal(struct wait_obj *wo)
+{
+   struct epoll_item *it = wait_obj_get_ptr(wo);
+   bool has_waiters;
+
+   ASSERT(wo->type == WOBJ_EPOLL);
+   ASSERT(!is_preemption_enabled());
+
+   if (it->disabled)
+      return false;
+
+   has_waiters = !list_is_empty(&it->ep->ready_cond.wait_list);
+   epoll_item_add_to_ready_list(it);
+   return has_waiters;
+}
+
+static void epoll_item_register(struct epoll_item *it)
+{
+   struct kcond *conds[EPOLL_COND_COUNT] = {
+      [EPOLL_COND_READ] =
+         (it->events & EPOLLIN) ? vfs_get_rready_cond(it->h) : NULL,
+      [EPOLL_COND_WRITE] =
+         (it->events & EPOLLOUT) ? vfs_get_wready_cond(it->h) : NULL,
+      [EPOLL_COND_EXCEPT] =
+         vfs_get_except_cond(it->h),
+   };
+
+   disable_preemption();
+   {
+      for (int i = 0; i < EPOLL_COND_COUNT; i++) {
+
+         if (!conds[i])
+            continue;
+
+         wait_obj_set(&it->wobjs[i], WOBJ_EPOLL, it,
+                      NO_EXTRA, &conds[i]->wait_list);
+
+         /*
+          * EPOLLEXCLUSIVE: kcond_signal_one() will stop at the first exclusive
+          * item whose epoll instance has a task waiting in epoll_wait().
+          */
+         it->wobjs[i].exclusive = !!(it->events & EPOLLEXCLUSIVE);
+      }
+   }
+   enable_preemption();
+
+   /* The fd might be already ready: let the next epoll_wait() check that */
+   disable_preemption();
+   {
+      epoll_item_add_to_ready_list(it);
+   }
+   enable_preemption();
+}
+
+static void epoll_item_unregister(struct epoll_item *it)
+{
+   for (int i = 0; i < EPOLL_COND_COUNT; i++)
+      wait_obj_reset(&it->wobjs[i]);
+
+   disable_preemption();
+   {
+      if (list_is_node_in_list(&it->ready_node))
+         list_remove(&it->ready_node);
+
+      list_node_init(&it->ready_node);
+   }
+   enable_preemption();
+}
+
+static struct epoll_item *
+epoll_find_item(struct epoll *ep, fs_handle h)
+{
+   struct epoll_item *pos;
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   list_for_each_ro(pos, epoll_handle_bucket(h), hnode) {
+      if (pos->ep == ep && pos->h == h)
+         return pos;
+   }
+
+   return NULL;
+}
+
+static void
+epoll_item_set(struct epoll_item *it, struct epoll_event *ev)
+{
+   it->events = ev->events;
+   it->data = ev->data.u64;
+   it->disabled = false;
+}
+
+static int
+epoll_add_item(struct epoll *ep, fs_handle h, struct epoll_event *ev)
+{
+   struct epoll_item *it;
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   /* Like on Linux, files without any kind of wait support are rejected */
+   if (!vfs_get_rready_cond(h) &&
+       !vfs_get_wready_cond(h) &&
+       !vfs_get_except_cond(h))
+   {
+      return -EPERM;
+   }
+
+   if (!(it = kzalloc_obj(struct epoll_item)))
+      return -ENOMEM;
+
+   it->ep = ep;
+   it->h = h;
+   epoll_item_set(it, ev);
+   list_node_init(&it->ready_node);
+   list_add_tail(&ep->items, &it->node);
+   list_add_tail(epoll_handle_bucket(h), &it->hnode);
+   epoll_items_count++;
+
+   epoll_item_register(it);
+   return 0;
+}
+
+static void epoll_item_destroy(struct epoll_item *it)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   epoll_item_unregister(it);
+   list_remove(&it->node);
+   list_remove(&it->hnode);
+   epoll_items_count--;
+   kfree_obj(it, struct epoll_item);
+}
+
+void epoll_on_handle_close(fs_handle h)
+{
+   struct epoll_item *pos, *temp;
+
+   if (LIKELY(!epoll_items_count))
+      return;
+
+   kmutex_lock(&epoll_lock);
+   {
+      list_for_each(pos, temp, epoll_handle_bucket(h), hnode) {
+         if (pos->h == h)
+            epoll_item_destroy(pos);
+      }
+   }
+   kmutex_unlock(&epoll_lock);
+}
+
+static u32 epoll_item_get_events(struct epoll_item *it)
+{
+   u32 ev = 0;
+   int rc;
+
+   if (it->disabled)
+      return 0;
+
+   if ((it->events & EPOLLIN) && vfs_read_ready(it->h))
+      ev |= EPOLLIN;
+
+   if ((it->events & EPOLLOUT) && vfs_write_ready(it->h))
+      ev |= EPOLLOUT;
+
+   /* Like poll(), epoll always listens for exception events */
+   if ((rc = vfs_except_ready(it->h)))
+      ev |= rc > 0 ? (u32)rc : EPOLLERR;
+
+   return ev;
+}
+
+/*
+ * Consumes epoll's ready list, filling `evs` with up to `max` events. The cost
+ * is O(ready items), no matter how many fds have been registered.
+ */
+static int
+epoll_collect(struct epoll *ep, struct epoll_event *evs, int max)
+{
+   struct epoll_item *it, *temp;
+   struct list reported;
+   int n = 0;
+   u32 ev;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+   list_init(&reported);
+
+   while (n < max) {
+
+      disable_preemption();
+      {
+         if (list_is_empty(&ep->ready_list)) {
+            enable_preemption();
+            break;
+         }
+
+         /*
+          * Remove the item from the ready list *before* checking it: if its
+          * kcond gets signaled while we're checking, the item will re-enter
+          * the ready list and no event will be lost.
+          */
+
+         it = list_first_obj(&ep->ready_list, struct epoll_item, ready_node);
+         list_remove(&it->ready_node);
+         list_node_init(&it->ready_node);
+      }
+      enable_preemption();
+
+      /* The r/w/e ready funcs might need to acquire a mutex */
+      if (!(ev = epoll_item_get_events(it)))
+         continue;
+
+      evs[n++] = (struct epoll_event) {
+         .events = ev,
+         .data.u64 = it->data,
+      };
+
+      if (it->events & EPOLLONESHOT) {
+
+         it->disabled = true;
+
+      } else if (!(it->events & EPOLLET)) {
+
+         /* Level-triggered: check the item again on the next call */
+         disable_preemption();
+         {
+            if (!list_is_node_in_list(&it->ready_node))
+               list_add_tail(&reported, &it->ready_node);
+         }
+         enable_preemption();
+      }
+   }
+
+   disable_preemption();
+   {
+      list_for_each(it, temp, &reported, ready_node) {
+         list_remove(&it->ready_node);
+         list_add_tail(&ep->ready_list, &it->ready_node);
+      }
+   }
+   enable_preemption();
+   return n;
+}
+
+/*
+ * Sleeps until an item enters the ready list, a signal arrives or `deadline`
+ * (in ticks, 0 means no deadline) expires. Returns false if the deadline has
+ * already expired, without sleeping.
+ */
+static bool
+epoll_wait_for_events(struct epoll *ep, u64 deadline)
+{
+   struct task *curr = get_curr_task();
+   u64 now = 0;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+   disable_preemption();
+
+   if (!list_is_empty(&ep->ready_list)) {
+      enable_preemption();
+      return true;
+   }
+
+   if (deadline) {
+
+      now = get_ticks();
+
+      if (now >= deadline) {
+         enable_preemption();
+         return false;
+      }
+   }
+
+   prepare_to_wait_on(WOBJ_KCOND, &ep->ready_cond,
+                      NO_EXTRA, &ep->ready_cond.wait_list);
+
+   if (deadline)
+      task_set_wakeup_timer(curr, (u32)MIN(deadline - now, (u64)UINT32_MAX));
+
+   kmutex_unlock(&epoll_lock);
+   enter_sleep_wait_state();
+
+   /* ------------------- We've been woken up ------------------- */
+
+   wait_obj_reset(&curr->wobj);
+   task_cancel_wakeup_timer(curr);
+   kmutex_lock(&epoll_lock);
+   return true;
+}
+
+static int
+do_epoll_wait(int epfd, struct epoll_event *user_evs, int maxevents, int tout)
+{
+   struct task *curr = get_curr_task();
+   struct epoll_event *evs = curr->args_copybuf;
+   const int max_evs = ARGS_COPYBUF_SIZE / sizeof(struct epoll_event);
+   struct kfs_handle *kh;
+   struct epoll *ep;
+   u64 deadline = 0;
+   int rc;
+
+   if (maxevents <= 0)
+      return -EINVAL;
+
+   if (!(kh = get_fs_handle(epfd)))
+      return -EBADF;
+
+   if (!is_epoll_handle(kh))
+      return -EINVAL;
+
+   ep = (void *)kh->kobj;
+   maxevents = MIN(maxevents, max_evs);
+
+   if (tout > 0)
+      deadline = get_ticks() + MAX((u64)tout / (1000 / TIMER_HZ), (u64)1);
+
+   kmutex_lock(&epoll_lock);
+
+   while (true) {
+
+      if ((rc = epoll_collect(ep, evs, maxevents)) > 0 || !tout)
+         break;
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         break;
+      }
+
+      if (!epoll_wait_for_events(ep, deadline))
+         break; /* timeout */
+   }
+
+   kmutex_unlock(&epoll_lock);
+
+   if (rc > 0) {
+      if (copy_to_user(user_evs, evs, sizeof(evs[0]) * (size_t)rc))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+static int epoll_read_ready(fs_handle h)
+{
+   struct epoll *ep = (void *)((struct kfs_handle *)h)->kobj;
+   int ret;
+
+   disable_preemption();
+   {
+      ret = !list_is_empty(&ep->ready_list);
+   }
+   enable_preemption();
+   return ret;
+}
+
+static struct kcond *epoll_get_rready_cond(fs_handle h)
+{
+   struct epoll *ep = (void *)((struct kfs_handle *)h)->kobj;
+   return &ep->ready_cond;
+}
+
+static const struct file_ops static_ops_epoll =
+{
+   .read_ready = epoll_read_ready,
+   .get_rready_cond = epoll_get_rready_cond,
+};
+
+static void epoll_init_buckets(void)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   if (LIKELY(epoll_buckets_initialized))
+      return;
+
+   for (int i = 0; i < EPOLL_HANDLE_BUCKETS; i++)
+      list_init(&epoll_handle_buckets[i]);
+
+   epoll_buckets_initialized = true;
+}
+
+struct epoll *create_epoll(void)
+{
+   struct epoll *ep;
+
+   if (!(ep = (void *)kzalloc_obj(struct epoll)))
+      return NULL;
+
+   ep->destory_obj = (void *)&destroy_epoll;
+   kcond_init(&ep->ready_cond);
+   list_init(&ep->items);
+   list_init(&ep->ready_list);
+
+   kmutex_lock(&epoll_lock);
+   {
+      epoll_init_buckets();
+   }
+   kmutex_unlock(&epoll_lock);
+   return ep;
+}
+
+void destroy_epoll(struct epoll *ep)
+{
+   struct epoll_item *pos, *temp;
+
+   kmutex_lock(&epoll_lock);
+   {
+      list_for_each(pos, temp, &ep->items, node) {
+         epoll_item_destroy(pos);
+      }
+   }
+   kmutex_unlock(&epoll_lock);
+
+   kcond_destory(&ep->ready_cond);
+   kfree_obj(ep, struct epoll);
+}
+
+fs_handle epoll_create_handle(struct epoll *ep)
+{
+   return kfs_create_new_handle(&static_ops_epoll, (void *)ep, O_RDONLY);
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *user_ev)
+{
+   struct epoll_event ev;
+   struct kfs_handle *kh;
+   struct epoll_item *it;
+   struct epoll *ep;
+   fs_handle h;
+   int rc = 0;
+
+   if (!(kh = get_fs_handle(epfd)) || !(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!is_epoll_handle(kh))
+      return -EINVAL;
+
+   /* Nested epoll instances are not supported (yet) */
+   if (is_epoll_handle(h))
+      return -EINVAL;
+
+   if (op != EPOLL_CTL_DEL) {
+
+      if (copy_from_user(&ev, user_ev, sizeof(ev)))
+         return -EFAULT;
+
+      if ((ev.events & EPOLLEXCLUSIVE) && (ev.events & EPOLLONESHOT))
+         return -EINVAL;
+   }
+
+   ep = (void *)kh->kobj;
+   kmutex_lock(&epoll_lock);
+   it = epoll_find_item(ep, h);
+
+   switch (op) {
+
+      case EPOLL_CTL_ADD:
+         rc = it ? -EEXIST : epoll_add_item(ep, h, &ev);
+         break;
+
+      case EPOLL_CTL_MOD:
+
+         if (!it) {
+            rc = -ENOENT;
+            break;
+         }
+
+         /* Like on Linux, EPOLLEXCLUSIVE can be set only by EPOLL_CTL_ADD */
+         if ((ev.events | it->events) & EPOLLEXCLUSIVE) {
+            rc = -EINVAL;
+            break;
+         }
+
+         epoll_item_unregister(it);
+         epoll_item_set(it, &ev);
+         epoll_item_register(it);
+         break;
+
+      case EPOLL_CTL_DEL:
+
+         if (!it) {
+            rc = -ENOENT;
+            break;
+         }
+
+         epoll_item_destroy(it);
+         break;
+
+      default:
+         rc = -EINVAL;
+   }
+
+   kmutex_unlock(&epoll_lock);
+   return rc;
+}
+
+int sys_epoll_wait(int epfd, struct epoll_event *events,
+                   int maxevents, int timeout)
+{
+   return do_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int sys_epoll_pwait(int epfd, struct epoll_event *events,
+                    int maxevents, int timeout,
+                    const sigset_t *user_sigmask, size_t sigsetsize)
+{
+   ulong sigmask[K_SIGACTION_MASK_WORDS];
+
+   if (user_sigmask) {
+
+      if (sigsetsize != sizeof(sigmask))
+         return -EINVAL;
+
+      if (copy_from_user(sigmask, user_sigmask, sizeof(sigmask)))
+         return -EFAULT;
+
+      for (int i = 0; i < K_SIGACTION_MASK_WORDS; i++) {
+
+         if (sigmask[i]) {
+            /* We don't support signal masks here yet. */
+            return -ENOSYS;
+         }
+      }
+   }
+
+   return do_epoll_wait(epfd, events, maxevents, timeout);
+}
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/eventfd.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+
+/*
+ * An eventfd is just a 64-bit counter: write() adds to it, read() returns it
+ * and resets it to 0 (or, in semaphore mode, returns 1 and decrements it).
+ * Compared to a pipe used as a wakeup channel, it needs no buffer and a
+ * single handle.
+ */
+
+#define EVENTFD_MAX                          (UINT64_MAX - 1)
+
+struct eventfd {
+
+   KOBJ_BASE_FIELDS
+
+   u64 count;
+   bool semaphore;
+   struct kmutex mutex;
+   struct kcond rready_cond;        /* signaled when count becomes > 0 */
+   struct kcond wready_cond;        /* signaled when count decreases */
+};
+
+static ssize_t eventfd_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   ssize_t rc = sizeof(u64);
+   u64 val;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   kmutex_lock(&efd->mutex);
+
+   while (!efd->count) {
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&efd->rready_cond, &efd->mutex, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   val = efd->semaphore ? 1 : efd->count;
+   efd->count -= val;
+   memcpy(buf, &val, sizeof(val));
+
+   kcond_signal_all(&efd->wready_cond);
+
+   if (efd->count) {
+      /* Semaphore mode: there's still something for another reader */
+      kcond_signal_one(&efd->rready_cond);
+   }
+
+out:
+   kmutex_unlock(&efd->mutex);
+   return rc;
+}
+
+static ssize_t eventfd_write(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   ssize_t rc = sizeof(u64);
+   u64 val;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   memcpy(&val, buf, sizeof(val));
+
+   if (val > EVENTFD_MAX)
+      return -EINVAL;
+
+   kmutex_lock(&efd->mutex);
+
+   while (EVENTFD_MAX - efd->count < val) {
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&efd->wready_cond, &efd->mutex, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   efd->count += val;
+
+   if (efd->count) {
+
+      if (efd->semaphore)
+         kcond_signal_all(&efd->rready_cond);
+      else
+         kcond_signal_one(&efd->rready_cond); /* it will take everything */
+   }
+
+out:
+   kmutex_unlock(&efd->mutex);
+   return rc;
+}
+
+static int eventfd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   bool ret;
+
+   kmutex_lock(&efd->mutex);
+   {
+      ret = efd->count > 0;
+   }
+   kmutex_unlock(&efd->mutex);
+   return ret;
+}
+
+static int eventfd_write_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   bool ret;
+
+   kmutex_lock(&efd->mutex);
+   {
+      ret = efd->count < EVENTFD_MAX;
+   }
+   kmutex_unlock(&efd->mutex);
+   return ret;
+}
+
+static struct kcond *eventfd_get_rready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   return &efd->rready_cond;
+}
+
+static struct kcond *eventfd_get_wready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *efd = (void *)kh->kobj;
+   return &efd->wready_cond;
+}
+
+static const struct file_ops static_ops_eventfd =
+{
+   .read = eventfd_read,
+   .write = eventfd_write,
+   .read_ready = eventfd_read_ready,
+   .write_ready = eventfd_write_ready,
+   .get_rready_cond = eventfd_get_rready_cond,
+   .get_wready_cond = eventfd_get_wready_cond,
+};
+
+void destroy_eventfd(struct eventfd *efd)
+{
+   kcond_destory(&efd->wready_cond);
+   kcond_destory(&efd->rready_cond);
+   kmutex_destroy(&efd->mutex);
+   kfree_obj(efd, struct eventfd);
+}
+
+struct eventfd *create_eventfd(u64 initval, int flags)
+{
+   struct eventfd *efd;
+
+   if (!(efd = (void *)kzalloc_obj(struct eventfd)))
+      return NULL;
+
+   efd->destory_obj = (void *)&destroy_eventfd;
+   efd->count = initval;
+   efd->semaphore = !!(flags & EFD_SEMAPHORE);
+   kmutex_init(&efd->mutex, 0);
+   kcond_init(&efd->rready_cond);
+   kcond_init(&efd->wready_cond);
+   return efd;
+}
+
+fs_handle eventfd_create_handle(struct eventfd *efd, int flags)
+{
+   return kfs_create_new_handle(&static_ops_eventfd,
+                                (void *)efd,
+                                O_RDWR | (flags & EFD_NONBLOCK));
+}
@@ -5,13 +5,17 @@
 #include <tilck/common/string_util.h>
 
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/process_int.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/fs/flock.h>
 
 static const char *const default_env[] =
 {
@@ -29,17 +33,14 @@ static const char *const default_env[] =
 struct execve_ctx {
 
    struct task *curr_user_task;
-   const char *const *env;
+   struct exec_args args;
    int reclvl;
+   bool spawn;       /* run the image in a new child of `curr_user_task` */
 
    char hdr_stack[MAX_SCRIPT_REC + 1][ELF_RAW_HEADER_SIZE];
-   const char *argv_stack[MAX_SCRIPT_REC][USERAPP_MAX_ARGS_COUNT];
 };
 
-static int
-do_execve_int(struct execve_ctx *ctx,
-              const char *path,
-              const char *const *argv);
+static int do_execve_int(struct execve_ctx *ctx, const char *path);
 
 static int
 execve_get_path(const char *user_path, char **path_ref)
@@ -56,57 +57,17 @@ execve_get_path(const char *user_path, char **path_ref)
 }
 
 
-static int
-execve_get_args(const char *const *user_argv,
-                const char *const *user_env,
-                char *const **argv_ref,
-                char *const **env_ref)
-{
-   int rc = 0;
-   char *const *argv = NULL;
-   char *const *env = NULL;
-   struct task *curr = get_curr_task();
-
-   char *dest = (char *)curr->args_copybuf;
-   size_t written = 0;
-
-   if (user_argv) {
-      argv = (char *const *)(void *)(dest + written);
-      rc = duplicate_user_argv(dest,
-                               user_argv,
-                               ARGS_COPYBUF_SIZE,
-                               &written);
-      if (rc != 0)
-         goto out;
-   }
-
-   if (user_env) {
-      env = (char *const *)(void *)(dest + written);
-      rc = duplicate_user_argv(dest,
-                               user_env,
-                               ARGS_COPYBUF_SIZE,
-                               &written);
-      if (rc != 0)
-         goto out;
-   }
-
-   *argv_ref = argv;
-   *env_ref = env;
-
-out:
-   return rc;
-}
-
 static void
-save_cmdline(struct process *pi, const char *const *argv)
+save_cmdline(struct process *pi, const struct exec_args *args)
 {
 
    char *p = pi->debug_cmdline;
    char *const end = p + PROCESS_CMDLINE_BUF_SIZE;
+   const char *s = args->buf;
 
-   for (int i = 0; argv[i]; i++) {
+   for (u32 i = 0; i < args->argc; i++, s++) {
 
-      for (const char *s = argv[i]; *s && p < end; s++)
+      for (; *s && p < end; s++)
          *p++ = *s;
 
       if (p == end)
@@ -124,7 +85,7 @@ save_cmdline(struct process *pi, const char *const *argv)
 static void
 execve_final_steps(struct task *ti,
                    void *brk,
-                   const char *const *argv,
+                   const struct exec_args *args,
                    regs_t *user_regs)
 {
    struct process *pi = ti->pi;
@@ -152,7 +113,7 @@ execve_final_steps(struct task *ti,
    reset_all_custom_signal_handlers(ti);
 
    if (pi->debug_cmdline)
-      save_cmdline(pi, argv);
+      save_cmdline(pi, args);
 
    if (pi->vforked) {
       unblock_parent_of_vforked_child(pi);
@@ -161,22 +122,14 @@ execve_final_steps(struct task *ti,
 }
 
 static inline int
-execve_handle_script(struct execve_ctx *ctx,
-                     const char *path,
-                     const char *const *argv)
+execve_handle_script(struct execve_ctx *ctx, const char *path)
 {
-   const char **new_argv = ctx->argv_stack[ctx->reclvl];
    char *hdr = ctx->hdr_stack[ctx->reclvl];
-   const char **na = new_argv;
-   int i;
+   const char *new_args[3];
+   u32 n = 0;
+   int rc;
 
    hdr[ELF_RAW_HEADER_SIZE - 1] = 0;
-
-   for (i = 0; argv[i]; i++) {
-      if (i >= USERAPP_MAX_ARGS_COUNT - 2)
-         return -E2BIG; /* too many args */
-   }
-
    hdr += 2; /* skip the shebang sequence ("#!") */
 
    /* skip the spaces between #! and the beginning of the path */
@@ -191,21 +144,21 @@ execve_handle_script(struct execve_ctx *ctx,
       if (*p == ' ' && !l) {
          *p++ = 0;
          l = p;
-         *na++ = hdr;
+         new_args[n++] = hdr;
       }
 
       if (*p == '\n') {
 
          *p = 0;
-         *na++ = l ? l : hdr;
+         new_args[n++] = l ? l : hdr;
+         new_args[n++] = path;
 
-         for (i = 0; argv[i]; i++)
-            na[i] = argv[i];
+         /* argv becomes: interpreter [optional arg] path argv[1] ... */
+         if ((rc = exec_args_replace_arg0(&ctx->args, new_args, n)))
+            return rc;
 
-         na[i] = NULL;
          ctx->reclvl++;
-         new_argv[l ? 2 : 1] = path;
-         return do_execve_int(ctx, new_argv[0], new_argv);
+         return do_execve_int(ctx, new_args[0]);
       }
    }
 
@@ -247,7 +200,6 @@ execve_do_task_switch(struct execve_ctx *ctx, struct task *ti)
 static int
 execve_load_elf(struct execve_ctx *ctx,
                 const char *path,
-                const char *const *argv,
                 struct elf_program_info *pinfo)
 {
    char *hdr = ctx->hdr_stack[ctx->reclvl];
@@ -261,7 +213,7 @@ execve_load_elf(struct execve_ctx *ctx,
          if (ctx->reclvl == MAX_SCRIPT_REC)
             return -ELOOP;
 
-         rc = execve_handle_script(ctx, path, argv);
+         rc = execve_handle_script(ctx, path);
       }
       return rc;
    }
@@ -297,18 +249,12 @@ handle_noexec(struct elf_program_info *pinfo, const char *path)
      /*
       * [BE_NICE]
       *
-      * Since Tilck has no support for dynamic executables, in this case it
-      * will ignore the INTERP segment and it will jump directly to ELF's entry
-      * point, instead of jumping to dynamic linker's entry point. Therefore,
-      * at the first access to a symbol not in the ELF file itself we'll get a
-      * SIGSEGV.
-      *
-      * In order to avoid wasting people's time debugging why a given program
-      * crashes on Tilck, but not on Linux, it's nice to fail early, and display
-      * a meaningful message.
+      * The ELF is a dynamic executable, but its interpreter (the dynamic
+      * linker) could not be loaded: it might not exist or it might not be a
+      * valid ET_DYN ELF for this arch. Display a meaningful message.
       */
 
-      printk("ERROR: Pid %d tried to execute a dynamic executable: %s\n",
+      printk("ERROR: Pid %d: cannot load the interpreter of: %s\n",
              get_curr_pid(), path);
 
       term_sig = SIGKILL;
@@ -325,34 +271,104 @@ handle_noexec(struct elf_program_info *pinfo, const char *path)
       terminate_process(0, term_sig);
 }
 
+static void
+free_spawned_process(struct task *ti)
+{
+   ti->state = TASK_STATE_ZOMBIE;
+   free_common_task_allocs(ti);
+   free_task(ti);
+}
+
+/*
+ * The spawn fast path: instead of fork() + execve(), create the child process
+ * directly with the new image, already loaded in `pinfo->pdir`. Parent's page
+ * tables are never touched, its mappings are not copied and its FD_CLOEXEC
+ * handles are not duplicated. Returns child's pid.
+ */
+static int
+spawn_new_process(struct execve_ctx *ctx, struct elf_program_info *pinfo)
+{
+   struct task *curr = ctx->curr_user_task;
+   struct task *child, *ti;
+   regs_t user_regs;
+   int pid, rc;
+
+   disable_preemption();
+
+   if ((pid = create_new_pid()) < 0) {
+      rc = -EAGAIN;
+      goto err_destroy_pdir;
+   }
+
+   if (!(child = allocate_new_spawned_process(curr, pid, pinfo->pdir))) {
+      rc = -ENOMEM;
+      goto err_destroy_pdir;
+   }
+
+   rc = setup_process(pinfo, child, &ti, &user_regs);
+
+   if (UNLIKELY(rc)) {
+      /* setup_process() already destroyed the pdir */
+      free_spawned_process(child);
+      goto err_release_elf;
+   }
+
+   ASSERT(ti == child);
+
+   /* setup_process() switched to child's pdir: go back to parent's one */
+   set_curr_pdir(curr->pi->pdir);
+
+   if ((rc = spawn_dup_handles(child->pi))) {
+      free_spawned_process(child);
+      goto err_destroy_pdir;
+   }
+
+   /* From now on, we cannot fail */
+   add_task(child);
+   execve_final_steps(child, pinfo->brk, &ctx->args, &user_regs);
+   enable_preemption();
+   return pid;
+
+err_destroy_pdir:
+   pdir_destroy(pinfo->pdir);
+
+err_release_elf:
+   if (pinfo->lf)
+      release_subsys_flock(pinfo->lf);
+
+   if (pinfo->interp_lf)
+      release_subsys_flock(pinfo->interp_lf);
+
+   enable_preemption();
+   return rc;
+}
+
 static int
-do_execve_int(struct execve_ctx *ctx, const char *path, const char *const *argv)
+do_execve_int(struct execve_ctx *ctx, const char *path)
 {
-   struct elf_program_info pinfo = {0};
+   struct elf_program_info pinfo = { .args = &ctx->args };
    struct task *ti = NULL;
    regs_t user_regs;
    int rc;
 
    ASSERT(is_preemption_enabled());
 
-   if ((rc = execve_load_elf(ctx, path, argv, &pinfo))) {
+   if ((rc = execve_load_elf(ctx, path, &pinfo))) {
 
       /* load failed */
 
-      if (rc == -ENOEXEC)
+      if (rc == -ENOEXEC && !ctx->spawn)
          handle_noexec(&pinfo, path);
 
       return rc;
    }
 
+   if (ctx->spawn)
+      return spawn_new_process(ctx, &pinfo);
+
    disable_preemption();
    {
-      rc = setup_process(&pinfo,
-                         ctx->curr_user_task,
-                         argv,
-                         ctx->env,
-                         &ti,
-                         &user_regs);
+      rc = setup_process(&pinfo, ctx->curr_user_task, &ti, &user_regs);
    }
    enable_preemption();
 
@@ -363,35 +379,65 @@ do_execve_int(struct execve_ctx *ctx, const char *path, const char *const *argv)
    close_cloexec_handles(ti->pi);
    disable_preemption();
    {
-      execve_final_steps(ti, pinfo.brk, argv, &user_regs);
+      execve_final_steps(ti, pinfo.brk, &ctx->args, &user_regs);
       execve_do_task_switch(ctx, ti); /* this might NOT return */
    }
    enable_preemption();
    return rc;
 }
 
+/*
+ * `argv` and `env` are user pointers when `user_args` is true. In both cases,
+ * their strings are copied just once, see struct exec_args.
+ */
 static int
 do_execve(struct task *curr_user_task,
           const char *path,
           const char *const *argv,
-          const char *const *env)
+          const char *const *env,
+          bool user_args,
+          bool spawn)
 {
    struct task *ti = get_curr_task();
    const char *const default_argv[] = { path, NULL };
+   int rc;
 
    struct execve_ctx *ctx = (void *) ti->misc_buf->execve_ctx;
    STATIC_ASSERT(sizeof(*ctx) <= sizeof(ti->misc_buf->execve_ctx));
 
    ctx->curr_user_task = curr_user_task;
-   ctx->env = env ? env : default_env;
    ctx->reclvl = 0;
+   ctx->spawn = spawn;
 
-   return do_execve_int(ctx, path, argv ? argv : default_argv);
+   if ((rc = exec_args_init(&ctx->args)))
+      return rc;
+
+   rc = exec_args_add_arr(&ctx->args,
+                          argv ? argv : default_argv,
+                          argv && user_args,
+                          false);
+
+   if (!rc) {
+      rc = exec_args_add_arr(&ctx->args,
+                             env ? env : default_env,
+                             env && user_args,
+                             true);
+   }
+
+   if (!rc)
+      rc = do_execve_int(ctx, path);
+
+   /*
+    * Free the args buffer, unless its pages have been mapped in the new image.
+    * NOTE: in case of success, a regular execve() doesn't get here at all.
+    */
+   exec_args_destroy(&ctx->args);
+   return rc;
 }
 
 int first_execve(const char *path, const char *const *argv)
 {
-   return do_execve(NULL, path, argv, NULL);
+   return do_execve(NULL, path, argv, NULL, false, false);
 }
 
 int sys_execve(const char *user_filename,
@@ -400,8 +446,6 @@ int sys_execve(const char *user_filename,
 {
    int rc;
    char *path;
-   char *const *argv = NULL;
-   char *const *env = NULL;
 
    struct task *curr = get_curr_task();
    ASSERT(curr != NULL);
@@ -409,11 +453,26 @@ int sys_execve(const char *user_filename,
    if ((rc = execve_get_path(user_filename, &path)))
       return rc;
 
-   if ((rc = execve_get_args(user_argv, user_env, &argv, &env)))
+   return do_execve(curr, path, user_argv, user_env, true, false);
+}
+
+/*
+ * Tilck-specific: the equivalent of vfork() + execve() in the child, with the
+ * difference that the parent is never stopped and that errors (e.g. -ENOENT)
+ * are returned directly to it. Returns child's pid.
+ */
+int tilck_sys_spawn(const char *user_path,
+                    const char *const *user_argv,
+                    const char *const *user_env)
+{
+   int rc;
+   char *path;
+
+   struct task *curr = get_curr_task();
+   ASSERT(curr != NULL);
+
+   if ((rc = execve_get_path(user_path, &path)))
       return rc;
 
-   return do_execve(curr,
-                    path,
-                    (const char *const *)argv,
-                    (const char *const *)env);
+   return do_execve(curr, path, user_argv, user_env, true, true);
 }
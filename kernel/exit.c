@@ -4,6 +4,7 @@
 
 #include <tilck_gen_headers/config_debug.h>
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_int.h>
@@ -13,9 +14,62 @@
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/worker_thread.h>
 
 #include <tilck/mods/tracing.h>
 
+/*
+ * Destroying the pdir of a big process means walking all of its page tables
+ * and dropping the refs of all of its page frames: it's the most expensive
+ * part of the exit path. Since nothing can use the pdir of a zombie process,
+ * the dying process hands it to a low-priority worker thread instead, so that
+ * the parent can get its exit status right away. The number of pdirs waiting
+ * for the worker is bounded: beyond PDIR_REAPER_MAX_BACKLOG (or without the
+ * worker), the dying process destroys its pdir by itself, as before.
+ */
+static struct worker_thread *pdir_reaper_wth;
+static int pdir_reaper_backlog;
+
+static void pdir_reaper_job(void *arg)
+{
+   disable_preemption();
+   {
+      /* Nothing else can reach a zombie's pdir: it's safe to yield */
+      pdir_destroy_preemptible(arg);
+      pdir_reaper_backlog--;
+   }
+   enable_preemption();
+}
+
+static void destroy_dead_proc_pdir(pdir_t *pdir)
+{
+   ASSERT(!is_preemption_enabled());
+   ASSERT(get_curr_pdir() != pdir);
+
+   if (pdir_reaper_wth && pdir_reaper_backlog < PDIR_REAPER_MAX_BACKLOG) {
+      if (wth_enqueue_on(pdir_reaper_wth, &pdir_reaper_job, pdir)) {
+         pdir_reaper_backlog++;
+         return;
+      }
+   }
+
+   pdir_destroy(pdir);
+}
+
+void init_pdir_reaper(void)
+{
+   disable_preemption();
+   {
+      pdir_reaper_wth = wth_create_thread("pdir_reaper",
+                                          WTH_PRIO_LOWEST,
+                                          PDIR_REAPER_MAX_BACKLOG);
+   }
+   enable_preemption();
+
+   if (!pdir_reaper_wth)
+      printk("WARNING: unable to create the pdir reaper thread\n");
+}
+
 static void
 task_free_all_kernel_allocs(struct task *ti)
 {
@@ -75,6 +129,7 @@ handle_children_of_dying_process(struct task *ti)
 
       list_remove(&pos->siblings_node);
       list_add_tail(&child_reaper->children, &pos->siblings_node);
+      wstatus_queue_move(pos, child_reaper);
 
       pos->pi->parent_pid = child_reaper->pid;
 
@@ -100,14 +155,16 @@ static void
 close_all_handles(void)
 {
    struct process *pi = get_curr_proc();
+   int fd;
+
    ASSERT(is_preemption_enabled());
 
-   for (int i = 0; i < MAX_HANDLES; i++) {
-      if (pi->handles[i]) {
-         vfs_close(pi->handles[i]);
-         pi->handles[i] = NULL;
-      }
+   fd_table_for_each(pi->fds, fd) {
+      vfs_close(fd_table_get(pi->fds, fd));
+      fd_table_set(pi->fds, fd, NULL);
    }
+
+   fd_table_destroy(pi->fds);
 }
 
 struct on_task_exit_cb {
@@ -280,6 +337,9 @@ void terminate_process(int exit_code, int term_sig)
       remove_all_user_zero_mem_mappings(pi);
       if (pi->elf)
          release_subsys_flock(pi->elf);
+
+      if (pi->elf_interp)
+         release_subsys_flock(pi->elf_interp);
    }
 
    if (LIKELY(ti->tid != 1)) {
@@ -324,7 +384,7 @@ void terminate_process(int exit_code, int term_sig)
    set_curr_pdir(get_kernel_pdir());
 
    if (!vforked)
-      pdir_destroy(pi->pdir);
+      destroy_dead_proc_pdir(pi->pdir);
 
    switch_stack_free_mem_and_schedule();
 }
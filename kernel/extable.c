@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/extable.h>
+#include <tilck/kernel/hal.h>
+
+bool extable_fixup(regs_t *r)
+{
+   const ulong ip = (ulong)regs_get_ip(r);
+   const struct extable_entry *e;
+
+   if (ip < BASE_VA)
+      return false; /* The fault happened in user space */
+
+   /*
+    * The entries come from many translation units and the table is not
+    * sorted: just scan it. That happens only when a user-access primitive
+    * faults (the user passed a bad pointer), never on the regular path.
+    */
+   for (e = ex_table; e < ex_table_end; e++) {
+
+      if (e->insn == ip) {
+         regs_set_ip(r, e->fixup);
+         return true;
+      }
+   }
+
+   return false;
+}
@@ -10,20 +10,29 @@
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/test/fork.h>
+#include <tilck/kernel/boot_trace.h>
 
-STATIC int fork_dup_all_handles(struct process *pi)
+static bool init_forked;
+
+static int dup_handles(struct process *pi, bool skip_cloexec)
 {
+   struct fd_table *fds = pi->fds;
+   int i, j;
+
    ASSERT(!is_preemption_enabled());
 
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
+   fd_table_for_each(fds, i) {
 
       int rc;
       fs_handle dup_h = NULL;
-      fs_handle h = pi->handles[i];
+      fs_handle h = fd_table_get(fds, i);
+      struct fs_handle_base *hb = h;
       struct user_mapping *um;
 
-      if (!h)
+      if (skip_cloexec && (hb->fd_flags & FD_CLOEXEC)) {
+         fd_table_set(fds, i, NULL);
          continue;
+      }
 
       rc = vfs_dup(h, &dup_h);
 
@@ -31,8 +40,13 @@ STATIC int fork_dup_all_handles(struct process *pi)
 
          enable_preemption();
          {
-            for (u32 j = 0; j < i; j++)
-               vfs_close(pi->handles[j]);
+            fd_table_for_each(fds, j) {
+
+               if (j >= i)
+                  break;
+
+               vfs_close(fd_table_get(fds, j));
+            }
          }
          disable_preemption();
          return -ENOMEM;
@@ -42,7 +56,7 @@ STATIC int fork_dup_all_handles(struct process *pi)
       ((struct fs_handle_base *)dup_h)->pi = pi;
 
       /* Replace the older (parent's) handle with the new one */
-      pi->handles[i] = dup_h;
+      fd_table_set(fds, i, dup_h);
 
       if (!pi->mi)
          continue;
@@ -56,6 +70,20 @@ STATIC int fork_dup_all_handles(struct process *pi)
    return 0;
 }
 
+STATIC int fork_dup_all_handles(struct process *pi)
+{
+   return dup_handles(pi, false);
+}
+
+/*
+ * Used by spawned processes (see do_execve_int()): the FD_CLOEXEC handles
+ * would be closed by the execve() anyway, so don't even duplicate them.
+ */
+int spawn_dup_handles(struct process *pi)
+{
+   return dup_handles(pi, true);
+}
+
 // Returns child's pid
 int do_fork(regs_t *user_regs, bool vfork)
 {
@@ -118,6 +146,11 @@ int do_fork(regs_t *user_regs, bool vfork)
 
    add_task(child);
 
+   if (curr_pi->pid == 1 && !init_forked) {
+      boot_trace_point(vfork ? "first vfork()" : "first fork()", "init");
+      init_forked = true;
+   }
+
    if (vfork) {
 
       curr->stopped = true;
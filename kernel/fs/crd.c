@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+#include <tilck/common/lz4.h>
+
+#include <tilck/kernel/fs/crd.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/errno.h>
+
+static inline u32 crd_bsize(struct crd *c)
+{
+   return 1u << c->hdr->block_shift;
+}
+
+static bool crd_check_hdr(const struct crd_hdr *h, size_t rd_size)
+{
+   u32 bsize;
+
+   if (rd_size < sizeof(*h) || !crd_is_image(h))
+      return false;
+
+   if (!IN_RANGE_INC(h->block_shift, CRD_MIN_BLOCK_SHIFT, CRD_MAX_BLOCK_SHIFT))
+      return false;
+
+   bsize = 1u << h->block_shift;
+
+   if (!h->size || h->blocks != div_round_up(h->size, bsize))
+      return false;
+
+   if (rd_size < crd_hdr_size(h) || rd_size < crd_image_size(h))
+      return false;
+
+   for (u32 i = 0; i < h->blocks; i++) {
+
+      if (h->offsets[i] < crd_hdr_size(h))
+         return false;
+
+      if (h->offsets[i + 1] < h->offsets[i])
+         return false;
+
+      if (h->offsets[i + 1] - h->offsets[i] > crd_block_size(h, i))
+         return false;
+   }
+
+   return true;
+}
+
+int crd_init(struct crd *c, void *rd, size_t rd_size)
+{
+   const struct crd_hdr *h = rd;
+
+   if (!crd_check_hdr(h, rd_size))
+      return -EINVAL;
+
+   *c = (struct crd) {
+      .hdr = h,
+      .image_vsize = (size_t)h->blocks << h->block_shift,
+      .scratch_block = CRD_NO_BLOCK,
+   };
+
+   if (!(c->blocks = kzalloc_array_obj(char *, h->blocks)))
+      goto oom;
+
+   if (!(c->scratch = kmalloc(crd_bsize(c))))
+      goto oom;
+
+   if (!(c->image = hi_vmem_reserve(c->image_vsize)))
+      goto oom;
+
+   kmutex_init(&c->lock, 0);
+   return 0;
+
+oom:
+   if (c->scratch)
+      kfree2(c->scratch, crd_bsize(c));
+
+   if (c->blocks)
+      kfree_array_obj(c->blocks, char *, h->blocks);
+
+   return -ENOMEM;
+}
+
+void crd_destroy(struct crd *c)
+{
+   const u32 shift = c->hdr->block_shift;
+
+   for (u32 i = 0; i < c->hdr->blocks; i++) {
+
+      if (!c->blocks[i])
+         continue;
+
+      unmap_kernel_pages(c->image + ((size_t)i << shift),
+                         crd_bsize(c) >> PAGE_SHIFT,
+                         false);
+
+      kfree2(c->blocks[i], crd_bsize(c));
+   }
+
+   hi_vmem_release(c->image, c->image_vsize);
+   kfree2(c->scratch, crd_bsize(c));
+   kfree_array_obj(c->blocks, char *, c->hdr->blocks);
+   kmutex_destroy(&c->lock);
+}
+
+static int crd_decompress(struct crd *c, u32 i, char *dst)
+{
+   const struct crd_hdr *h = c->hdr;
+   const char *src = (const char *)h + h->offsets[i];
+   const u32 slen = h->offsets[i + 1] - h->offsets[i];
+   const u32 len = crd_block_size(h, i);
+
+   if (slen == len) {
+      memcpy(dst, src, len);       /* stored uncompressed */
+      return 0;
+   }
+
+   if (lz4_decompress_block(src, slen, dst, len) != (int)len)
+      return -EIO;
+
+   return 0;
+}
+
+/*
+ * Decompresses the blocks in the range [off, off + len) of the image and maps
+ * them (read-only) at their place in `image`, so that they can be accessed
+ * directly from there. Called at mount time only.
+ */
+int crd_map(struct crd *c, u32 off, u32 len)
+{
+   const u32 shift = c->hdr->block_shift;
+   const size_t pages = crd_bsize(c) >> PAGE_SHIFT;
+   char *buf;
+   size_t cnt;
+   u32 last;
+   int rc;
+
+   if (!len)
+      return 0;
+
+   if (off >= c->hdr->size || len > c->hdr->size - off)
+      return -EINVAL;
+
+   last = (off + len - 1) >> shift;
+
+   for (u32 i = off >> shift; i <= last; i++) {
+
+      char *va = c->image + ((size_t)i << shift);
+
+      if (c->blocks[i])
+         continue;
+
+      if (!(buf = kmalloc(crd_bsize(c))))
+         return -ENOMEM;
+
+      if ((rc = crd_decompress(c, i, buf))) {
+         kfree2(buf, crd_bsize(c));
+         return rc;
+      }
+
+      bzero(buf + crd_block_size(c->hdr, i),
+            crd_bsize(c) - crd_block_size(c->hdr, i));
+
+      cnt = map_kernel_pages(va, LIN_VA_TO_PA(buf), pages, 0);
+
+      if (cnt != pages) {
+         unmap_kernel_pages(va, cnt, false);
+         kfree2(buf, crd_bsize(c));
+         return -ENOMEM;
+      }
+
+      c->blocks[i] = buf;
+   }
+
+   return 0;
+}
+
+/*
+ * Reads the range [off, off + len) of the uncompressed image. The blocks not
+ * mapped are decompressed in the scratch buffer, which keeps the last one:
+ * the page cache reads the files sequentially, page by page, so most of the
+ * reads just hit it.
+ */
+int crd_read(struct crd *c, u32 off, char *buf, u32 len)
+{
+   const u32 shift = c->hdr->block_shift;
+   int rc = 0;
+
+   if (off > c->hdr->size || len > c->hdr->size - off)
+      return -EINVAL;
+
+   while (len > 0) {
+
+      const u32 i = off >> shift;
+      const u32 boff = off & (crd_bsize(c) - 1);
+      const u32 n = MIN(len, crd_bsize(c) - boff);
+
+      if (c->blocks[i]) {
+
+         memcpy(buf, c->blocks[i] + boff, n);
+
+      } else {
+
+         kmutex_lock(&c->lock);
+         {
+            if (c->scratch_block != i) {
+
+               c->scratch_block = CRD_NO_BLOCK;
+
+               if (!(rc = crd_decompress(c, i, c->scratch)))
+                  c->scratch_block = i;
+            }
+
+            if (!rc)
+               memcpy(buf, c->scratch + boff, n);
+         }
+         kmutex_unlock(&c->lock);
+
+         if (rc)
+            return rc;
+      }
+
+      buf += n;
+      off += n;
+      len -= n;
+   }
+
+   return 0;
+}
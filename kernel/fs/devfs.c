@@ -15,16 +15,20 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/rwlock.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/hashtable.h>
 
 #include <dirent.h> // system header
 
 static struct mnt_fs *devfs;
 
 /*
- * Registered drivers.
+ * Registered drivers, indexed by major number. The dynamic majors are
+ * allocated starting from DEVFS_DYN_MAJOR_START.
  */
-static struct driver_info *drivers[32];
-static u32 drivers_count;
+#define DEVFS_MAX_MAJORS                  1024
+#define DEVFS_DYN_MAJOR_START              900
+
+static struct driver_info *drivers[DEVFS_MAX_MAJORS];
 
 struct mnt_fs *
 get_devfs(void)
@@ -35,56 +39,82 @@ get_devfs(void)
 struct driver_info *
 get_driver_info(u16 major)
 {
-   for (int i = 0; i < ARRAY_SIZE(drivers) && drivers[i]; i++) {
-      if (drivers[i]->major == major)
-         return drivers[i];
-   }
-
-   return NULL;
+   return major < ARRAY_SIZE(drivers) ? drivers[major] : NULL;
 }
 
 /*
  * Registers the driver described by 'info'.
  * Returns driver's major number.
+ *
+ * NOTE: the async modules (see init_modules()) call this concurrently with
+ * the other ones: that's why the preemption is disabled here.
  */
 int
 register_driver(struct driver_info *info, int arg_major)
 {
    u16 major;
 
-   /* Be sure there's always enough space. */
-   VERIFY(drivers_count < ARRAY_SIZE(drivers) - 1);
+   disable_preemption();
 
    if (arg_major < 0) {
 
-      major = 900; /* Dynamic major start */
+      major = DEVFS_DYN_MAJOR_START;
 
-      for (int i = 0; i < ARRAY_SIZE(drivers) && drivers[i]; i++) {
-         if (drivers[i]->major == major)
-            major++;
-      }
+      while (major < ARRAY_SIZE(drivers) && drivers[major])
+         major++;
+
+      VERIFY(major < ARRAY_SIZE(drivers));
 
    } else {
 
+      VERIFY(arg_major < DEVFS_DYN_MAJOR_START);
       major = (u16) arg_major;
 
-      if (get_driver_info(major))
+      if (drivers[major])
          panic("Duplicate major number: %d", major);
    }
 
    info->major = major;
-   drivers[drivers_count++] = info;
+   info->next_minor = 0;
+   drivers[major] = info;
+   enable_preemption();
    return major;
 }
 
+/*
+ * Returns a minor number never used by the driver of `major`, neither by a
+ * previous call of this function nor by create_dev_file().
+ */
+int
+devfs_alloc_minor(u16 major)
+{
+   struct driver_info *dinfo;
+   int minor = -EINVAL;
+
+   disable_preemption();
+   {
+      if ((dinfo = get_driver_info(major))) {
+
+         if (dinfo->next_minor < 0xffff)
+            minor = dinfo->next_minor++;
+         else
+            minor = -ENOSPC;
+      }
+   }
+   enable_preemption();
+   return minor;
+}
+
 struct devfs_dir {
 
    /*
     * Yes, sub-directories are NOT supported by devfs. The whole filesystem is
-    * just one flat directory.
+    * just one flat directory. The files are in a list, in creation order, for
+    * getdents() and in a hash table, by name, for the lookups.
     */
    enum vfs_entry_type type;     /* Must be FIRST, because of devfs_file */
    struct list files_list;
+   struct htable files_table;
    tilck_ino_t inode;
 };
 
@@ -102,6 +132,49 @@ devfs_get_next_inode(struct devfs_data *d)
    return d->next_inode++;
 }
 
+struct devfs_name_key {
+
+   const char *name;
+   size_t len;                   /* `name` might be not NUL-terminated */
+};
+
+static bool devfs_name_match(struct htable_node *n, const void *key)
+{
+   const struct devfs_file *f = CONTAINER_OF(n, struct devfs_file, hnode);
+   const struct devfs_name_key *k = key;
+
+   return !strncmp(f->name, k->name, k->len) && !f->name[k->len];
+}
+
+static struct devfs_file *
+devfs_find_file(struct devfs_dir *dir, const struct devfs_name_key *k)
+{
+   return htable_find_obj(&dir->files_table,
+                          hash_str(k->name, k->len),
+                          devfs_name_match,
+                          k,
+                          struct devfs_file,
+                          hnode);
+}
+
+/* Adds `f` to the root dir. Must be called with preemption disabled */
+static int devfs_add_file(struct devfs_data *d, struct devfs_file *f)
+{
+   const struct devfs_name_key k = { f->name, strlen(f->name) };
+
+   ASSERT(!is_preemption_enabled());
+
+   if (devfs_find_file(&d->root_dir, &k))
+      return -EEXIST;
+
+   htable_node_init(&f->hnode);
+   htable_add(&d->root_dir.files_table, &f->hnode, hash_str(k.name, k.len));
+
+   f->inode = devfs_get_next_inode(d);
+   list_add_tail(&d->root_dir.files_list, &f->dir_node);
+   return 0;
+}
+
 int
 create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
 {
@@ -120,8 +193,6 @@ create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
       return -ENOMEM;
 
    d = fs->device_data;
-
-   f->inode = devfs_get_next_inode(d);
    f->name = filename;
    f->dev_major = major;
    f->dev_minor = minor;
@@ -143,7 +214,19 @@ create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
       return -EINVAL;
    }
 
-   list_add_tail(&d->root_dir.files_list, &f->dir_node);
+   disable_preemption();
+   {
+      rc = devfs_add_file(d, f);
+
+      if (!rc && minor >= dinfo->next_minor && minor < 0xffff)
+         dinfo->next_minor = (u16)(minor + 1);
+   }
+   enable_preemption();
+
+   if (rc < 0) {
+      kfree_obj(f, struct devfs_file);
+      return rc;
+   }
 
    if (devfile)
       *devfile = f;
@@ -151,6 +234,40 @@ create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
    return 0;
 }
 
+/*
+ * Create an empty sub-directory of devfs, for mounting another file-system
+ * there (e.g. /dev/shm). It's not a real directory: it can be used ONLY as a
+ * mount-point, as it cannot be opened nor contain any files.
+ */
+int
+devfs_create_mp_dir(const char *name)
+{
+   struct devfs_data *d;
+   struct devfs_file *f;
+   int rc;
+
+   ASSERT(devfs != NULL);
+   d = devfs->device_data;
+
+   if (!(f = kzalloc_obj(struct devfs_file)))
+      return -ENOMEM;
+
+   f->type = VFS_DIR;
+   f->name = name;
+   list_node_init(&f->dir_node);
+
+   disable_preemption();
+   {
+      rc = devfs_add_file(d, f);
+   }
+   enable_preemption();
+
+   if (rc < 0)
+      kfree_obj(f, struct devfs_file);
+
+   return rc;
+}
+
 static ssize_t
 devfs_dir_read(fs_handle h, char *buf, size_t len, offt *pos)
 {
@@ -210,9 +327,9 @@ devfs_stat(struct mnt_fs *fs, vfs_inode_ptr_t i, struct k_stat64 *statbuf)
    switch (df->type) {
 
       case VFS_DIR:
-         ASSERT(i == &ddata->root_dir);
          statbuf->st_mode = 0555 | S_IFDIR;
-         statbuf->st_ino = ddata->root_dir.inode;
+         statbuf->st_ino =
+            i == &ddata->root_dir ? ddata->root_dir.inode : df->inode;
          break;
 
       case VFS_CHAR_DEV:
@@ -293,11 +410,17 @@ static int
 devfs_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mod)
 {
    struct devfs_path *dp = (struct devfs_path *) &p->fs_path;
+   struct devfs_data *d = p->fs->device_data;
 
    if (dp->inode) {
 
-      if (dp->type == VFS_DIR)
+      if (dp->type == VFS_DIR) {
+
+         if (dp->inode != (void *)&d->root_dir)
+            return -EACCES; /* See devfs_create_mp_dir() */
+
          return devfs_open_root_dir(p->fs, out);
+      }
 
       if ((fl & O_CREAT) && (fl & O_EXCL))
          return -EEXIST;
@@ -405,7 +528,8 @@ devfs_get_entry(struct mnt_fs *fs,
 {
    struct devfs_data *d = fs->device_data;
    struct devfs_dir *dir;
-   struct devfs_file *pos;
+   struct devfs_file *f;
+   struct devfs_name_key k;
 
    if ((!dir_inode && !name) || is_dot_or_dotdot(name, (int)nl)) {
 
@@ -422,18 +546,21 @@ devfs_get_entry(struct mnt_fs *fs,
    dir = dir_inode;
    bzero(fs_path, sizeof(*fs_path));
 
-   list_for_each_ro(pos, &dir->files_list, dir_node) {
-      if (!strncmp(pos->name, name, (size_t)nl))
-         if (!pos->name[nl])
-            break;
+   k = (struct devfs_name_key) { name, (size_t)nl };
+
+   /* Files are added without the exclusive lock: see devfs_add_file() */
+   disable_preemption();
+   {
+      f = devfs_find_file(dir, &k);
    }
+   enable_preemption();
 
-   if (&pos->dir_node != (struct list_node *) &dir->files_list) {
+   if (f) {
       *fs_path = (struct fs_path) {
-         .inode         = pos,
+         .inode         = f,
          .dir_inode     = dir,
-         .dir_entry     = pos,
-         .type          = pos->type,
+         .dir_entry     = f,
+         .type          = f->type,
       };
    }
 }
@@ -521,6 +648,7 @@ create_devfs(void)
    d->root_dir.type = VFS_DIR;
    d->root_dir.inode = devfs_get_next_inode(d);
    list_init(&d->root_dir.files_list);
+   htable_init(&d->root_dir.files_table);
    rwlock_wp_init(&d->rwlock, false);
    d->wrt_time = (time_t)get_timestamp();
 
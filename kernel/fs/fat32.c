@@ -2,13 +2,17 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
 
 #include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/fs/crd.h>
 #include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/flock.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/user.h>
+#include <tilck/kernel/sched.h>
 
 #include <dirent.h> // system header
 
@@ -20,34 +24,71 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size);
  * Special fat_walk() wrapper handling the special case where `e` is NOT a dir
  * entry but a pointer to the entries in the root directory.
  */
-
 static inline int
 fat_fs_walk_generic(struct fat_fs_device_data *d,
                     struct fat_walk_static_params *static_walk_params,
                     struct fat_entry *e)
 {
-   return fat_walk(static_walk_params,
-                   e == d->root_dir_entries
-                     ? d->root_cluster
-                     : fat_get_first_cluster(e));
+   return fat_walk(static_walk_params, fat_get_dir_first_cluster(d, e));
 }
 
-STATIC ssize_t
-fat_read(fs_handle handle, char *buf, size_t bufsize, offt *pos)
+/*
+ * Returns the cluster containing the byte at `*pos`, which must be inside the
+ * file. Reads through the handle's file position use the cluster cached in the
+ * handle, while pread() and friends go through the file's extent map. On r/w
+ * volumes, the cached cluster could have been freed by a truncate(): there,
+ * the extent map is always used.
+ */
+static u32
+fat_get_cluster_for_pos(struct fatfs_handle *h, offt *pos)
+{
+   struct fat_fs_device_data *d = h->fs->device_data;
+   u32 clu;
+
+   ASSERT(*pos < (offt)h->e->DIR_FileSize);
+
+   if (pos == &h->h_fpos && !d->rw)
+      return h->curr_cluster;
+
+   clu = fat_get_file_cluster(d, h->e, (u32)(*pos / (offt)d->cluster_size));
+   ASSERT(clu != FAT_INVALID_CLUSTER);
+   return clu;
+}
+
+static ssize_t
+fat_pc_splice_read(struct fatfs_handle *h,
+                   size_t len,
+                   offt *pos,
+                   func_splice_actor actor,
+                   void *arg)
+{
+   struct page_cache *pc = fat_get_page_cache(h->fs->device_data, h->e);
+
+   if (!pc)
+      return -ENOMEM;
+
+   return pc_splice_read(pc, &h->ra, len, pos, actor, arg);
+}
+
+static ssize_t
+fat_pc_read(struct fatfs_handle *h, char *buf, size_t len, offt *pos)
+{
+   struct page_cache *pc = fat_get_page_cache(h->fs->device_data, h->e);
+
+   if (!pc)
+      return -ENOMEM;
+
+   return pc_read(pc, &h->ra, buf, len, pos);
+}
+
+static ssize_t
+fat_read_nolock(fs_handle handle, char *buf, size_t bufsize, offt *pos)
 {
    struct fatfs_handle *h = (struct fatfs_handle *) handle;
    struct fat_fs_device_data *d = h->fs->device_data;
    offt fsize = (offt)h->e->DIR_FileSize;
    offt written_to_buf = 0;
-
-   if (pos != &h->h_fpos) {
-
-      /*
-       * We don't support pread() for this filesystem, at the moment.
-       * TODO: make fat32 support pread64().
-       */
-      return -EPERM;
-   }
+   u32 clu;
 
    if (h->e->directory)
       return -EISDIR;
@@ -61,9 +102,14 @@ fat_read(fs_handle handle, char *buf, size_t bufsize, offt *pos)
       return 0;
    }
 
+   if (d->use_pagecache)
+      return fat_pc_read(h, buf, bufsize, pos);
+
+   clu = fat_get_cluster_for_pos(h, pos);
+
    do {
 
-      char *data = fat_get_pointer_to_cluster_data(d->hdr, h->curr_cluster);
+      char *data = fat_get_pointer_to_cluster_data(d->hdr, clu);
 
       const offt file_rem       = fsize - *pos;
       const offt buf_rem        = (offt)bufsize - written_to_buf;
@@ -88,7 +134,7 @@ fat_read(fs_handle handle, char *buf, size_t bufsize, offt *pos)
       }
 
       // find the next cluster
-      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, h->curr_cluster);
+      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, clu);
 
       if (fat_is_end_of_clusterchain(d->type, fatval)) {
          ASSERT(*pos == fsize);
@@ -98,121 +144,215 @@ fat_read(fs_handle handle, char *buf, size_t bufsize, offt *pos)
       // we do not expect BAD CLUSTERS
       ASSERT(!fat_is_bad_cluster(d->type, fatval));
 
-      h->curr_cluster = fatval; // go reading the new cluster in the chain.
+      clu = fatval; // go reading the new cluster in the chain.
+      cond_resched();
 
    } while (true);
 
+   if (pos == &h->h_fpos)
+      h->curr_cluster = clu;
+
    return (ssize_t)written_to_buf;
 }
 
-
-STATIC int
-fat_rewind(fs_handle handle)
+STATIC ssize_t
+fat_read(fs_handle handle, char *buf, size_t bufsize, offt *pos)
 {
    struct fatfs_handle *h = (struct fatfs_handle *) handle;
-   h->h_fpos = 0;
-   h->curr_cluster = fat_get_first_cluster(h->e);
-   return 0;
+   ssize_t rc;
+
+   if (!h->map)
+      return fat_read_nolock(handle, buf, bufsize, pos);
+
+   rwlock_wp_shlock(&h->map->rwlock);
+   {
+      rc = fat_read_nolock(handle, buf, bufsize, pos);
+   }
+   rwlock_wp_shunlock(&h->map->rwlock);
+   return rc;
 }
 
-STATIC offt
-fat_seek_forward(fs_handle handle, offt dist)
+/*
+ * Same as fat_read(), but the clusters (or the cached pages) are fed directly
+ * to the splice actor: there's no need to copy the data in an intermediate
+ * buffer.
+ */
+static ssize_t
+fat_splice_read_nolock(fs_handle handle,
+                       size_t len,
+                       offt *pos,
+                       func_splice_actor actor,
+                       void *arg)
 {
    struct fatfs_handle *h = (struct fatfs_handle *) handle;
    struct fat_fs_device_data *d = h->fs->device_data;
    offt fsize = (offt)h->e->DIR_FileSize;
-   offt moved_distance = 0;
+   offt tot_read = 0;
+   ssize_t rc;
+   u32 clu;
 
-   if (dist == 0)
-      return h->h_fpos;
+   if (h->e->directory)
+      return -EISDIR;
 
-   if (h->h_fpos + dist > fsize) {
-      /* Allow, like Linux does, to seek past the end of a file. */
-      h->h_fpos += dist;
-      h->curr_cluster = (u32) -1; /* invalid cluster */
-      return (offt) h->h_fpos;
-   }
+   if (*pos >= fsize)
+      return 0;
 
-   do {
+   if (d->use_pagecache)
+      return fat_pc_splice_read(h, len, pos, actor, arg);
+
+   clu = fat_get_cluster_for_pos(h, pos);
+
+   while (*pos < fsize && (size_t)tot_read < len) {
+
+      char *data = fat_get_pointer_to_cluster_data(d->hdr, clu);
 
-      const offt file_rem       = fsize - h->h_fpos;
-      const offt dist_rem       = dist - moved_distance;
-      const offt cluster_off    = h->h_fpos % (offt)d->cluster_size;
+      const offt file_rem       = fsize - *pos;
+      const offt len_rem        = (offt)(len - (size_t)tot_read);
+      const offt cluster_off    = *pos % (offt)d->cluster_size;
       const offt cluster_rem    = (offt)d->cluster_size - cluster_off;
-      const offt to_move        = MIN3(cluster_rem, dist_rem, file_rem);
+      const offt to_read        = MIN3(cluster_rem, len_rem, file_rem);
+
+      ASSERT(to_read > 0);
+      rc = actor(arg, data + cluster_off, (size_t)to_read);
 
-      ASSERT(to_move >= 0);
+      if (rc < 0) {
 
-      moved_distance += to_move;
-      h->h_fpos += to_move;
+         if (!tot_read)
+            tot_read = rc;
 
-      if (to_move < cluster_rem)
          break;
+      }
 
-      // find the next cluster
-      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, h->curr_cluster);
+      tot_read += rc;
+      *pos += rc;
+
+      if (rc < cluster_rem)
+         break; /* Partial write, or we reached the end: see fat_read() */
+
+      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, clu);
 
       if (fat_is_end_of_clusterchain(d->type, fatval)) {
-         ASSERT(h->h_fpos == fsize);
+         ASSERT(*pos == fsize);
          break;
       }
 
-      // we do not expect BAD CLUSTERS
       ASSERT(!fat_is_bad_cluster(d->type, fatval));
+      clu = fatval;
+   }
 
-      h->curr_cluster = fatval; // go reading the new cluster in the chain.
+   if (pos == &h->h_fpos)
+      h->curr_cluster = clu;
 
-   } while (true);
+   return (ssize_t)tot_read;
+}
+
+static ssize_t
+fat_splice_read(fs_handle handle,
+                size_t len,
+                offt *pos,
+                func_splice_actor actor,
+                void *arg)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+   ssize_t rc;
+
+   if (!h->map)
+      return fat_splice_read_nolock(handle, len, pos, actor, arg);
 
-   return (offt)h->h_fpos;
+   rwlock_wp_shlock(&h->map->rwlock);
+   {
+      rc = fat_splice_read_nolock(handle, len, pos, actor, arg);
+   }
+   rwlock_wp_shunlock(&h->map->rwlock);
+   return rc;
 }
 
-struct fat_count_dirents_ctx {
-   offt count;
-};
+
+/*
+ * Moves the file position of `h` at `pos`, updating its current cluster. The
+ * extent map is used only when the new position is outside the current
+ * cluster, so that short relative seeks never need it.
+ */
+static offt
+fat_seek_to(struct fatfs_handle *h, offt pos)
+{
+   struct fat_fs_device_data *d = h->fs->device_data;
+   const offt fsize = (offt)h->e->DIR_FileSize;
+   const offt csize = (offt)d->cluster_size;
+   const offt old_pos = h->h_fpos;
+   u32 idx;
+
+   h->h_fpos = pos;
+
+   if (d->rw)
+      return pos; /* r/w volumes: the current cluster is not used */
+
+   if (pos > fsize || !fsize) {
+      /* Allow, like Linux does, to seek past the end of a file. */
+      h->curr_cluster = FAT_INVALID_CLUSTER;
+      return pos;
+   }
+
+   /* At the end of the file, the current cluster is the last one */
+   idx = (u32)(MIN(pos, fsize - 1) / csize);
+
+   if (h->curr_cluster != FAT_INVALID_CLUSTER && old_pos <= fsize)
+      if ((u32)(MIN(old_pos, fsize - 1) / csize) == idx)
+         return pos; /* Still in the same cluster */
+
+   h->curr_cluster = fat_get_file_cluster(d, h->e, idx);
+   ASSERT(h->curr_cluster != FAT_INVALID_CLUSTER);
+   return pos;
+}
 
 static int
-fat_count_dirents_cb(struct fat_hdr *hdr,
-                     enum fat_type ft,
-                     struct fat_entry *entry,
-                     const char *long_name,
-                     void *arg)
-{
-   struct fat_count_dirents_ctx *ctx = arg;
-   ctx->count++;
+fat_seek_dir_cb(struct fat_hdr *hdr,
+                enum fat_type ft,
+                struct fat_entry *entry,
+                const char *long_name,
+                void *arg)
+{
+   offt *left = arg;
+
+   if (!*left)
+      return 1; /* stop here: this is the entry at the new position */
+
+   (*left)--;
    return 0;
 }
 
 /*
- * Count the number of entries in a given FAT directory.
- * TODO: implement fat_count_dirents() in a more efficient way.
+ * Move the getdents() cursor to the `off`-th entry. That requires walking the
+ * directory from the beginning, but only on explicit seeks: getdents() just
+ * resumes from where the previous call stopped.
  */
-STATIC offt fat_count_dirents(struct fat_fs_device_data *d, struct fat_entry *e)
+static offt fat_seek_dir(struct fatfs_handle *fh, offt off)
 {
-   int rc;
-   struct fat_count_dirents_ctx ctx = { .count = 0 };
+   struct fat_fs_device_data *d = fh->fs->device_data;
+   struct fat_walk_pos pos = {
+      .cluster = fat_get_dir_first_cluster(d, fh->e),
+   };
    struct fat_walk_static_params walk_params = {
       .ctx = NULL,      /* no need for long name ctx */
       .h = d->hdr,
       .ft = d->type,
-      .cb = &fat_count_dirents_cb,
-      .arg = &ctx,
+      .cb = &fat_seek_dir_cb,
+      .arg = &off,
    };
+   const offt new_pos = off;
+   int rc;
 
-   ASSERT(e->directory);
-   rc = fat_fs_walk_generic(d, &walk_params, e);
-   return rc ? rc : ctx.count;
-}
-
-static offt fat_seek_dir(struct fatfs_handle *fh, offt off)
-{
    if (off < 0)
       return -EINVAL;
 
-   if (off > fat_count_dirents(fh->fs->device_data, fh->e))
-      return -EINVAL;
+   if ((rc = fat_walk_resume(&walk_params, &pos)))
+      return rc;
+
+   if (off > 0)
+      return -EINVAL; /* the directory has less than `new_pos` entries */
 
-   fh->dir_pos = off;
+   fh->dir_walk_pos = pos;
+   fh->dir_pos = new_pos;
    return fh->dir_pos;
 }
 
@@ -229,51 +369,27 @@ fat_seek(fs_handle handle, offt off, int whence)
       return fat_seek_dir(fh, off);
    }
 
-   offt curr_pos = fh->h_fpos;
-
    switch (whence) {
 
       case SEEK_SET:
-
-         if (off < 0)
-            return -EINVAL; /* invalid negative offset */
-
-         fat_rewind(handle);
          break;
 
       case SEEK_END:
-
-         if (off >= 0)
-            break;
-
-         struct fatfs_handle *h = (struct fatfs_handle *) handle;
-         off = (offt) h->e->DIR_FileSize + off;
-
-         if (off < 0)
-            return -EINVAL;
-
-         fat_rewind(handle);
+         off += (offt)fh->e->DIR_FileSize;
          break;
 
       case SEEK_CUR:
-
-         if (off < 0) {
-
-            off = curr_pos + off;
-
-            if (off < 0)
-               return -EINVAL;
-
-            fat_rewind(handle);
-         }
-
+         off += fh->h_fpos;
          break;
 
       default:
          return -EINVAL;
    }
 
-   return fat_seek_forward(handle, off);
+   if (off < 0)
+      return -EINVAL; /* invalid negative offset */
+
+   return fat_seek_to(fh, off);
 }
 
 struct datetime
@@ -373,7 +489,8 @@ fat_getdents_cb(struct fat_hdr *hdr,
       .name = entname,
    };
 
-   return ctx->vfs_cb(&dent, ctx->vfs_ctx);
+   ctx->rc = ctx->vfs_cb(&dent, ctx->vfs_ctx);
+   return ctx->rc;
 }
 
 static int fat_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
@@ -403,40 +520,49 @@ static int fat_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
       .arg = &ctx,
    };
 
-   rc = fat_fs_walk_generic(d, &walk_params, fh->e);
+   /* Resume from where the previous call stopped */
+   rc = fat_walk_resume(&walk_params, &fh->dir_walk_pos);
    return rc ? rc : ctx.rc;
 }
 
 STATIC void fat_exclusive_lock(struct mnt_fs *fs)
 {
+   struct fat_fs_device_data *d = fs->device_data;
+
    if (!(fs->flags & VFS_FS_RW))
       return; /* read-only: no lock is needed */
 
-   NOT_IMPLEMENTED();
+   rwlock_wp_exlock(&d->rw->fs_rwlock);
 }
 
 STATIC void fat_exclusive_unlock(struct mnt_fs *fs)
 {
+   struct fat_fs_device_data *d = fs->device_data;
+
    if (!(fs->flags & VFS_FS_RW))
       return; /* read-only: no lock is needed */
 
-   NOT_IMPLEMENTED();
+   rwlock_wp_exunlock(&d->rw->fs_rwlock);
 }
 
 STATIC void fat_shared_lock(struct mnt_fs *fs)
 {
+   struct fat_fs_device_data *d = fs->device_data;
+
    if (!(fs->flags & VFS_FS_RW))
       return; /* read-only: no lock is needed */
 
-   NOT_IMPLEMENTED();
+   rwlock_wp_shlock(&d->rw->fs_rwlock);
 }
 
 STATIC void fat_shared_unlock(struct mnt_fs *fs)
 {
+   struct fat_fs_device_data *d = fs->device_data;
+
    if (!(fs->flags & VFS_FS_RW))
       return; /* read-only: no lock is needed */
 
-   NOT_IMPLEMENTED();
+   rwlock_wp_shunlock(&d->rw->fs_rwlock);
 }
 
 STATIC ssize_t fat_write(fs_handle handle, char *buf, size_t len, offt *pos)
@@ -450,7 +576,7 @@ STATIC ssize_t fat_write(fs_handle handle, char *buf, size_t len, offt *pos)
    if (!(fs->flags & VFS_FS_RW))
       return -EBADF; /* read-only file system: can't write */
 
-   NOT_IMPLEMENTED();
+   return fat_rw_write(h, buf, len, pos);
 }
 
 STATIC int fat_ioctl(fs_handle h, ulong request, void *arg)
@@ -458,16 +584,83 @@ STATIC int fat_ioctl(fs_handle h, ulong request, void *arg)
    return -EINVAL;
 }
 
+static int fat_fsync(fs_handle handle)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+
+   fat_flush(h->fs->device_data);
+   return 0;
+}
+
+static void fat_syncfs(struct mnt_fs *fs)
+{
+   fat_flush(fs->device_data);
+}
+
 static const struct file_ops static_ops_fat =
 {
    .read = fat_read,
+   .splice_read = fat_splice_read,
    .seek = fat_seek,
    .write = fat_write,
    .ioctl = fat_ioctl,
    .mmap = fat_mmap,
    .munmap = fat_munmap,
+   .sync = fat_fsync,
 };
 
+/*
+ * On r/w volumes, the open files get their extent map, which holds the lock
+ * of the file's data, and the ones open for writing a locked_file object, as
+ * the VFS requires. See fat32_rw.c.
+ */
+static int
+fat_open_rw(struct vfs_path *p,
+            struct fat_entry *e,
+            int fl,
+            struct fat_extent_map **map_ref,
+            struct locked_file **lf_ref)
+{
+   struct mnt_fs *fs = p->fs;
+   struct fat_fs_device_data *d = fs->device_data;
+   int rc;
+
+   if (e->directory || e->volume_id) {
+
+      if (fl & (O_WRONLY | O_RDWR))
+         return -EISDIR;
+
+      return 0;
+   }
+
+   /* Like on ramfs, O_TRUNC | O_RDONLY is NOT allowed */
+   if ((fl & O_TRUNC) && !(fl & (O_WRONLY | O_RDWR)))
+      return -EINVAL;
+
+   if (fl & (O_WRONLY | O_RDWR)) {
+      if ((rc = acquire_subsys_flock(fs, e, SUBSYS_VFS, lf_ref)))
+         return rc;
+   }
+
+   if (!(*map_ref = fat_retain_file(d, e))) {
+
+      if (*lf_ref)
+         release_subsys_flock(*lf_ref);
+
+      return -ENOMEM;
+   }
+
+   if ((fl & O_TRUNC) && e->DIR_FileSize) {
+
+      DEBUG_ONLY_UNSAFE(rc =)
+         fat_rw_truncate(fs, e, 0);
+
+      ASSERT(rc == 0);
+   }
+
+   return 0;
+}
+
 STATIC int
 fat_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mode)
 {
@@ -476,33 +669,60 @@ fat_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mode)
    struct fat_fs_path *fp = (struct fat_fs_path *)&p->fs_path;
    struct fat_entry *e = fp->entry;
    struct fat_fs_device_data *d = fs->device_data;
+   struct fat_extent_map *map = NULL;
+   struct locked_file *lf = NULL;
+   int rc;
 
    if (!e) {
 
+      if (!(fl & O_CREAT))
+         return -ENOENT;
+
       if (!(fs->flags & VFS_FS_RW))
-         if (fl & O_CREAT)
-            return -EROFS;
+         return -EROFS;
 
-      return -ENOENT;
+      if ((rc = fat_rw_create(fs, fp->parent_entry, p->last_comp, &e)))
+         return rc;
+
+   } else {
+
+      if ((fl & O_CREAT) && (fl & O_EXCL))
+         return -EEXIST;
+
+      if (!(fs->flags & VFS_FS_RW))
+         if (fl & (O_WRONLY | O_RDWR))
+            return -EROFS;
    }
 
-   if ((fl & O_CREAT) && (fl & O_EXCL))
-      return -EEXIST;
+   if (d->rw && (rc = fat_open_rw(p, e, fl, &map, &lf)))
+      return rc;
 
-   if (!(fs->flags & VFS_FS_RW))
-      if (fl & (O_WRONLY | O_RDWR))
-         return -EROFS;
+   if (!(h = vfs_create_new_handle(fs, &static_ops_fat))) {
+
+      if (map)
+         fat_file_ref(d, e, -1);
+
+      if (lf)
+         release_subsys_flock(lf);
 
-   if (!(h = vfs_create_new_handle(fs, &static_ops_fat)))
       return -ENOMEM;
+   }
 
    h->e = e;
+   h->map = map;
+   h->lf = lf;
    h->h_fpos = 0;
    h->curr_cluster = fat_get_first_cluster(e);
 
-   if (d->mmap_support)
+   if (e->directory || e->volume_id)
+      h->dir_walk_pos.cluster = fat_get_dir_first_cluster(d, e);
+
+   if (d->mmap_support || d->use_pagecache)
       h->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
 
+   if (!e->directory && !e->volume_id)
+      h->spec_flags |= VFS_SPFL_USER_SPLICE_READ;
+
    *out = h;
    return 0;
 }
@@ -578,31 +798,65 @@ static vfs_inode_ptr_t fat_get_inode(fs_handle h)
    return ((struct fatfs_handle *)h)->e;
 }
 
+/*
+ * FAT has no inodes to keep alive: on r/w volumes, only the open handles of
+ * the files count, through their extent map. See fat_on_close().
+ */
 static int fat_retain_inode(struct mnt_fs *fs, vfs_inode_ptr_t inode)
 {
-   if (fs->flags & VFS_FS_RW)
-      NOT_IMPLEMENTED();
-
    return 1;
 }
 
 static int fat_release_inode(struct mnt_fs *fs, vfs_inode_ptr_t inode)
 {
-   if (fs->flags & VFS_FS_RW)
-      NOT_IMPLEMENTED();
-
    return 1;
 }
 
+static void fat_on_close(fs_handle handle)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+
+   if (h->map)
+      fat_file_ref(h->fs->device_data, h->e, -1);
+}
+
+static int fat_on_dup(fs_handle handle)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+
+   if (h->map)
+      fat_file_ref(h->fs->device_data, h->e, 1);
+
+   return 0;
+}
+
+static int fat_unlink(struct vfs_path *p)
+{
+   if (!(p->fs->flags & VFS_FS_RW))
+      return -EROFS;
+
+   return fat_rw_unlink(p);
+}
+
+static int fat_truncate(struct mnt_fs *fs, vfs_inode_ptr_t i, offt len)
+{
+   if (!(fs->flags & VFS_FS_RW))
+      return -EROFS;
+
+   return fat_rw_truncate(fs, i, len);
+}
+
 static const struct fs_ops static_fsops_fat =
 {
    .get_inode = fat_get_inode,
    .open = fat_open,
+   .on_close = fat_on_close,
+   .on_dup_cb = fat_on_dup,
    .getdents = fat_getdents,
-   .unlink = NULL,
+   .unlink = fat_unlink,
    .mkdir = NULL,
    .rmdir = NULL,
-   .truncate = NULL,
+   .truncate = fat_truncate,
    .stat = fat_stat,
    .chmod = NULL,
    .get_entry = fat_get_entry,
@@ -610,6 +864,7 @@ static const struct fs_ops static_fsops_fat =
    .link = NULL,
    .retain_inode = fat_retain_inode,
    .release_inode = fat_release_inode,
+   .syncfs = fat_syncfs,
 
    .fs_exlock = fat_exclusive_lock,
    .fs_exunlock = fat_exclusive_unlock,
@@ -622,37 +877,69 @@ struct mnt_fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags)
    struct fat_fs_device_data *d;
    struct mnt_fs *fs;
 
-   if (flags & VFS_FS_RW)
-      panic("fat_mount_ramdisk: r/w mode is NOT currently supported");
+   if ((flags & VFS_FS_RW) && crd_is_image(vaddr)) {
+      printk("fat: compressed ramdisks cannot be mounted r/w\n");
+      return NULL;
+   }
 
    d = kzalloc_obj(struct fat_fs_device_data);
 
    if (!d)
       return NULL;
 
+   if (crd_is_image(vaddr)) {
+
+      if (fat_crd_init(d, vaddr, rd_size))
+         goto err;
+
+      vaddr = d->hdr;
+   }
+
    d->hdr = (struct fat_hdr *) vaddr;
    d->type = fat_get_type(d->hdr);
    d->cluster_size = d->hdr->BPB_SecPerClus * d->hdr->BPB_BytsPerSec;
    d->root_dir_entries = fat_get_rootdir(d->hdr, d->type, &d->root_cluster);
 
-   fs = create_fs_obj("fat",
-                      &static_fsops_fat,
-                      d,
-                      flags | VFS_FS_RQ_DE_SKIP);
+   if (d->crd && fat_crd_map_dirs(d))
+      goto err;
 
-   if (!fs) {
-      kfree_obj(d, struct fat_fs_device_data);
-      return NULL;
-   }
+   fs = create_fs_obj("fat", &static_fsops_fat, d, flags);
+
+   if (!fs)
+      goto err;
 
-   if (!fat_ramdisk_prepare_for_mmap(d, rd_size))
+   /*
+    * On r/w volumes, mmap is not supported: the pages of the clusters freed by
+    * truncate() and unlink() would remain mapped. For the same reason (and
+    * because of the writes), neither the page cache is used.
+    */
+   if (flags & VFS_FS_RW) {
+
+      if (fat_rw_init(fs, rd_size)) {
+         destory_fs_obj(fs);
+         goto err;
+      }
+
+   } else if (d->crd)
+      d->use_pagecache = true;
+   else if (!fat_ramdisk_prepare_for_mmap(d, rd_size))
       d->mmap_support = true;
+   else
+      d->use_pagecache = true;
 
    return fs;
+
+err:
+   fat_crd_destroy(d);
+   kfree_obj(d, struct fat_fs_device_data);
+   return NULL;
 }
 
 void fat_umount_ramdisk(struct mnt_fs *fs)
 {
+   fat_rw_destroy(fs);
+   fat_destroy_extent_maps(fs->device_data);
+   fat_crd_destroy(fs->device_data);
    kfree_obj(fs->device_data, struct fat_fs_device_data);
    destory_fs_obj(fs);
 }
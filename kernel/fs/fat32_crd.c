@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/fs/crd.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * Support for compressed ramdisks (CRD). At mount time, only the FS metadata
+ * is decompressed: the reserved sectors, the FATs, the FAT16 root directory
+ * and the clusters of all the directories, because fat_walk() and the rest of
+ * the code shared with the bootloaders access them just through `hdr`. The
+ * file data, instead, is read through the page cache (see fat_fill_page()):
+ * the files never read cost no memory at all.
+ */
+
+struct fat_crd_walk_ctx {
+   struct fat_fs_device_data *d;
+   int rc;
+};
+
+static u32 fat_crd_cluster_off(struct fat_fs_device_data *d, u32 clu)
+{
+   return fat_get_sector_for_cluster(d->hdr, clu) * d->hdr->BPB_BytsPerSec;
+}
+
+int
+fat_crd_read(struct fat_fs_device_data *d,
+             u32 clu, u32 off, char *buf, u32 len)
+{
+   return crd_read(d->crd, fat_crd_cluster_off(d, clu) + off, buf, len);
+}
+
+static int fat_crd_map_chain(struct fat_fs_device_data *d, u32 clu)
+{
+   int rc;
+
+   while (true) {
+
+      rc = crd_map(d->crd, fat_crd_cluster_off(d, clu), d->cluster_size);
+
+      if (rc)
+         return rc;
+
+      clu = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+
+      if (fat_is_end_of_clusterchain(d->type, clu))
+         return 0;
+
+      if (fat_is_bad_cluster(d->type, clu))
+         return -EINVAL;
+   }
+}
+
+static int fat_crd_map_dir(struct fat_crd_walk_ctx *ctx, u32 clu);
+
+static int
+fat_crd_map_dir_cb(struct fat_hdr *hdr,
+                   enum fat_type ft,
+                   struct fat_entry *e,
+                   const char *long_name,
+                   void *arg)
+{
+   struct fat_crd_walk_ctx *ctx = arg;
+
+   if (!e->directory)
+      return 0;
+
+   if (!strncmp(e->DIR_Name, FAT_DIR_DOT, sizeof(e->DIR_Name)) ||
+       !strncmp(e->DIR_Name, FAT_DIR_DOT_DOT, sizeof(e->DIR_Name)))
+   {
+      return 0;
+   }
+
+   ctx->rc = fat_crd_map_dir(ctx, fat_get_first_cluster(e));
+   return ctx->rc; /* != 0 stops the walk */
+}
+
+/*
+ * Maps the clusters of the directory starting at `clu` (0 for the root dir)
+ * and then, recursively, the ones of all its sub-directories. The recursion
+ * depth is the one of the directory tree: that's fine for an initrd.
+ */
+static int fat_crd_map_dir(struct fat_crd_walk_ctx *ctx, u32 clu)
+{
+   struct fat_fs_device_data *d = ctx->d;
+   struct fat_walk_static_params p = {
+      .ctx = NULL,
+      .h = d->hdr,
+      .ft = d->type,
+      .cb = &fat_crd_map_dir_cb,
+      .arg = ctx,
+   };
+   int rc;
+
+   /* On FAT32, the root directory is a regular cluster chain */
+   if (!clu && d->root_cluster)
+      if ((rc = fat_crd_map_chain(d, d->root_cluster)))
+         return rc;
+
+   if (clu)
+      if ((rc = fat_crd_map_chain(d, clu)))
+         return rc;
+
+   fat_walk(&p, clu);
+   return ctx->rc;
+}
+
+/*
+ * Called before anything else at mount time: on success, `d->hdr` points to
+ * the uncompressed image, having just its metadata before the first data
+ * sector mapped. The directories get mapped later by fat_crd_map_dirs().
+ */
+int fat_crd_init(struct fat_fs_device_data *d, void *rd, size_t rd_size)
+{
+   struct fat_hdr *hdr;
+   int rc;
+
+   if (!(d->crd = kzalloc_obj(struct crd)))
+      return -ENOMEM;
+
+   if ((rc = crd_init(d->crd, rd, rd_size)))
+      goto err;
+
+   hdr = (void *)d->crd->image;
+
+   /* The first block always contains the whole boot sector */
+   if ((rc = crd_map(d->crd, 0, sizeof(struct fat_hdr))))
+      goto err_destroy;
+
+   rc = crd_map(d->crd,
+                0,
+                fat_get_first_data_sector(hdr) * fat_get_sector_size(hdr));
+
+   if (rc)
+      goto err_destroy;
+
+   d->hdr = hdr;
+   return 0;
+
+err_destroy:
+   crd_destroy(d->crd);
+err:
+   kfree_obj(d->crd, struct crd);
+   d->crd = NULL;
+   return rc;
+}
+
+int fat_crd_map_dirs(struct fat_fs_device_data *d)
+{
+   struct fat_crd_walk_ctx ctx = { .d = d, .rc = 0 };
+   return fat_crd_map_dir(&ctx, 0);
+}
+
+void fat_crd_destroy(struct fat_fs_device_data *d)
+{
+   if (!d->crd)
+      return;
+
+   crd_destroy(d->crd);
+   kfree_obj(d->crd, struct crd);
+   d->crd = NULL;
+}
@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/bintree.h>
+
+/*
+ * Walks the cluster chain starting at `clu` and counts its extents (runs of
+ * contiguous clusters). When `arr` is not NULL, the extents are stored there.
+ */
+static u32
+fat_scan_extents(struct fat_fs_device_data *d, u32 clu, struct fat_extent *arr)
+{
+   struct fat_extent ext = { .fclu = 0, .clu = clu, .len = 0 };
+   u32 count = 0;
+   u32 next;
+
+   if (!clu)
+      return 0; /* empty file: no clusters at all */
+
+   while (true) {
+
+      ext.len++;
+      next = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+
+      // we do not expect BAD CLUSTERS
+      ASSERT(!fat_is_bad_cluster(d->type, next));
+
+      if (next != clu + 1 || fat_is_end_of_clusterchain(d->type, next)) {
+
+         if (arr)
+            arr[count] = ext;
+
+         count++;
+
+         if (fat_is_end_of_clusterchain(d->type, next))
+            break;
+
+         ext = (struct fat_extent) {
+            .fclu = ext.fclu + ext.len,
+            .clu = next,
+            .len = 0,
+         };
+      }
+
+      clu = next;
+   }
+
+   return count;
+}
+
+static u32 fat_extent_map_lookup(struct fat_extent_map *map, u32 fclu);
+
+/*
+ * Reads a page of the file, cluster by cluster: with a real block device,
+ * this is where the I/O would be issued. On compressed ramdisks, that's where
+ * the data gets decompressed.
+ */
+static int fat_fill_page(struct page_cache *pc, ulong index, char *buf)
+{
+   struct fat_extent_map *map = CONTAINER_OF(pc, struct fat_extent_map, pc);
+   struct fat_fs_device_data *d = map->d;
+   const u32 csize = d->cluster_size;
+   const u32 end = MIN((u32)(index + 1) << PAGE_SHIFT, map->e->DIR_FileSize);
+   u32 off = (u32)index << PAGE_SHIFT;
+   char *dst = buf;
+   char *data;
+   int rc;
+
+   while (off < end) {
+
+      const u32 clu = fat_extent_map_lookup(map, off / csize);
+      const u32 clu_off = off % csize;
+      const u32 n = MIN(csize - clu_off, end - off);
+
+      ASSERT(clu != FAT_INVALID_CLUSTER);
+
+      if (d->crd) {
+
+         if ((rc = fat_crd_read(d, clu, clu_off, dst, n)))
+            return rc;
+
+      } else {
+
+         data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+         memcpy(dst, data + clu_off, n);
+      }
+
+      dst += n;
+      off += n;
+   }
+
+   bzero(dst, (size_t)(buf + PAGE_SIZE - dst));
+   return 0;
+}
+
+static struct fat_extent_map *
+fat_build_extent_map(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   const u32 first_clu = fat_get_first_cluster(e);
+   struct fat_extent_map *map;
+   u32 count;
+
+   if (!(map = kzalloc_obj(struct fat_extent_map)))
+      return NULL;
+
+   count = fat_scan_extents(d, first_clu, NULL);
+
+   if (count) {
+
+      if (!(map->extents = kalloc_array_obj(struct fat_extent, count))) {
+         kfree_obj(map, struct fat_extent_map);
+         return NULL;
+      }
+
+      fat_scan_extents(d, first_clu, map->extents);
+   }
+
+   bintree_node_init(&map->node);
+   map->e = e;
+   map->d = d;
+   map->count = count;
+   map->slots = count;
+   pc_init(&map->pc, &fat_fill_page, (offt)e->DIR_FileSize);
+   rwlock_wp_init(&map->rwlock, false);
+   return map;
+}
+
+static void
+fat_free_extent_map(struct fat_extent_map *map)
+{
+   rwlock_wp_destroy(&map->rwlock);
+   pc_destroy(&map->pc);
+
+   if (map->extents)
+      kfree_array_obj(map->extents, struct fat_extent, map->slots);
+
+   kfree_obj(map, struct fat_extent_map);
+}
+
+static struct fat_extent_map *
+fat_get_extent_map(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_extent_map *map, *new_map;
+
+   disable_preemption();
+   {
+      map = bintree_find_ptr(d->extent_maps_root,
+                             e,
+                             struct fat_extent_map,
+                             node,
+                             e);
+   }
+   enable_preemption();
+
+   if (map)
+      return map;
+
+   /*
+    * Build the map with preemption enabled: the cluster chain cannot change
+    * under our feet, because on r/w volumes it changes only through the open
+    * handles of the file, which already have the map. In the unlikely case
+    * another task built the same map in the meanwhile, just keep the other one.
+    */
+   if (!(new_map = fat_build_extent_map(d, e)))
+      return NULL;
+
+   disable_preemption();
+   {
+      map = bintree_find_ptr(d->extent_maps_root,
+                             e,
+                             struct fat_extent_map,
+                             node,
+                             e);
+
+      if (!map) {
+
+         bintree_insert_ptr(&d->extent_maps_root,
+                            new_map,
+                            struct fat_extent_map,
+                            node,
+                            e);
+
+         map = new_map;
+         new_map = NULL;
+      }
+   }
+   enable_preemption();
+
+   if (new_map)
+      fat_free_extent_map(new_map);
+
+   return map;
+}
+
+static u32
+fat_extent_map_lookup(struct fat_extent_map *map, u32 fclu)
+{
+   u32 lo = 0, hi = map->count;
+
+   /* Find the last extent with ext->fclu <= fclu */
+   while (hi - lo > 1) {
+
+      const u32 mid = lo + (hi - lo) / 2;
+
+      if (map->extents[mid].fclu <= fclu)
+         lo = mid;
+      else
+         hi = mid;
+   }
+
+   if (lo < map->count) {
+
+      const struct fat_extent *ext = &map->extents[lo];
+
+      if (fclu >= ext->fclu && fclu - ext->fclu < ext->len)
+         return ext->clu + (fclu - ext->fclu);
+   }
+
+   return FAT_INVALID_CLUSTER; /* beyond the end of the chain */
+}
+
+/*
+ * Returns the cluster number of the `fclu`-th cluster (zero-based) of the
+ * file `e`, or FAT_INVALID_CLUSTER if the chain is shorter than that.
+ */
+u32
+fat_get_file_cluster(struct fat_fs_device_data *d,
+                     struct fat_entry *e,
+                     u32 fclu)
+{
+   struct fat_extent_map *map;
+   u32 clu;
+
+   ASSERT(!e->directory);
+   clu = fat_get_first_cluster(e);
+
+   if (!fclu)
+      return clu ? clu : FAT_INVALID_CLUSTER;
+
+   if ((map = fat_get_extent_map(d, e)) && !map->stale)
+      return fat_extent_map_lookup(map, fclu);
+
+   /* Out of memory: fall back to walking the chain */
+   for (u32 i = 0; i < fclu; i++) {
+
+      clu = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+
+      if (fat_is_end_of_clusterchain(d->type, clu))
+         return FAT_INVALID_CLUSTER;
+
+      ASSERT(!fat_is_bad_cluster(d->type, clu));
+   }
+
+   return clu;
+}
+
+/*
+ * Returns the page cache of the file `e`, or NULL if we're out of memory.
+ */
+struct page_cache *
+fat_get_page_cache(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_extent_map *map;
+
+   ASSERT(d->use_pagecache);
+   ASSERT(!e->directory);
+
+   map = fat_get_extent_map(d, e);
+   return map ? &map->pc : NULL;
+}
+
+void fat_destroy_extent_maps(struct fat_fs_device_data *d)
+{
+   struct fat_extent_map *map;
+
+   while ((map = bintree_get_first_obj(d->extent_maps_root,
+                                       struct fat_extent_map,
+                                       node)))
+   {
+      bintree_remove_ptr(&d->extent_maps_root,
+                         map,
+                         struct fat_extent_map,
+                         node,
+                         e);
+
+      fat_free_extent_map(map);
+   }
+}
+
+/*
+ * On r/w volumes, each open handle of a file holds a reference to its extent
+ * map. Returns the map, or NULL if we're out of memory.
+ */
+struct fat_extent_map *
+fat_retain_file(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_extent_map *map;
+
+   ASSERT(d->rw != NULL);
+
+   if (!(map = fat_get_extent_map(d, e)))
+      return NULL;
+
+   disable_preemption();
+   {
+      map->ref_count++;
+   }
+   enable_preemption();
+   return map;
+}
+
+/*
+ * Adds `delta` to the ref-count of the map of `e` and returns the new value.
+ * The map must exist, unless `delta` is 0: files without a map are not open.
+ */
+int fat_file_ref(struct fat_fs_device_data *d, struct fat_entry *e, int delta)
+{
+   struct fat_extent_map *map;
+   int ref_count;
+
+   disable_preemption();
+   {
+      map = bintree_find_ptr(d->extent_maps_root,
+                             e,
+                             struct fat_extent_map,
+                             node,
+                             e);
+
+      ASSERT(map != NULL || !delta);
+      ref_count = map ? (map->ref_count += delta) : 0;
+      ASSERT(ref_count >= 0);
+   }
+   enable_preemption();
+   return ref_count;
+}
+
+/* The file `e` has been unlinked: drop its map, if any */
+void fat_forget_file(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_extent_map *map;
+
+   disable_preemption();
+   {
+      map = bintree_find_ptr(d->extent_maps_root,
+                             e,
+                             struct fat_extent_map,
+                             node,
+                             e);
+
+      if (map) {
+
+         ASSERT(map->ref_count == 0);
+
+         bintree_remove_ptr(&d->extent_maps_root,
+                            map,
+                            struct fat_extent_map,
+                            node,
+                            e);
+      }
+   }
+   enable_preemption();
+
+   if (map)
+      fat_free_extent_map(map);
+}
+
+/*
+ * Called on r/w volumes, holding the file's lock, after the cluster `clu` has
+ * been linked at the end of the chain, as the `fclu`-th cluster of the file.
+ * With contiguous allocations, that just makes the last extent longer.
+ */
+void fat_extent_map_append(struct fat_extent_map *map, u32 fclu, u32 clu)
+{
+   struct fat_extent *ext, *arr;
+   u32 slots;
+
+   if (map->stale)
+      return;
+
+   ext = map->count ? &map->extents[map->count - 1] : NULL;
+   ASSERT(!ext || ext->fclu + ext->len == fclu);
+
+   if (ext && ext->clu + ext->len == clu) {
+      ext->len++;
+      return;
+   }
+
+   if (map->count == map->slots) {
+
+      slots = MAX(4u, map->slots * 2);
+
+      if (!(arr = kalloc_array_obj(struct fat_extent, slots))) {
+         map->stale = true;      /* fat_get_file_cluster() walks the chain */
+         return;
+      }
+
+      if (map->extents) {
+         memcpy(arr, map->extents, map->count * sizeof(struct fat_extent));
+         kfree_array_obj(map->extents, struct fat_extent, map->slots);
+      }
+
+      map->extents = arr;
+      map->slots = slots;
+   }
+
+   map->extents[map->count++] = (struct fat_extent) {
+      .fclu = fclu,
+      .clu = clu,
+      .len = 1,
+   };
+}
+
+/* Same as fat_extent_map_append(), after the chain has been cut at `nclu` */
+void fat_extent_map_truncate(struct fat_extent_map *map, u32 nclu)
+{
+   struct fat_extent *ext;
+
+   while (map->count && map->extents[map->count - 1].fclu >= nclu)
+      map->count--;
+
+   if (map->count) {
+      ext = &map->extents[map->count - 1];
+      ext->len = MIN(ext->len, nclu - ext->fclu);
+   }
+}
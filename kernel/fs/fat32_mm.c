@@ -2,15 +2,19 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/fs/fat32.h>
 
+#include <sys/mman.h>      // system header
+
 int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
 {
    struct fat_hdr *hdr = d->hdr;
@@ -31,7 +35,10 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
       return -1;
    }
 
-   retain_pageframes_mapped_at(get_kernel_pdir(), hdr, rd_size);
+   retain_pageframes_mapped_at(get_kernel_pdir(),
+                               hdr,
+                               rd_size,
+                               PF_TYPE_FILE);
 
    if (fat_is_first_data_sector_aligned(hdr, PAGE_SIZE))
       return 0; /* Typical case: nothing to do */
@@ -73,7 +80,7 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
    const u32 used = fat_calculate_used_bytes(hdr);
    pdir_t *const pdir = get_kernel_pdir();
    char *const va_begin = (char *)hdr;
-   char *const va_end = va_begin + rd_size;
+   const size_t page_count = pow2_round_up_at(rd_size, PAGE_SIZE) >> PAGE_SHIFT;
    VERIFY(rd_size >= used);
 
    if (rd_size - used < PAGE_SIZE) {
@@ -81,13 +88,9 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
       return -1;
    }
 
-   for (char *va = va_begin; va < va_end; va += PAGE_SIZE)
-      set_page_rw(pdir, va, true);
-
+   set_pages_rw(pdir, va_begin, page_count, true);
    fat_align_first_data_sector(hdr, PAGE_SIZE);
-
-   for (char *va = va_begin; va < va_end; va += PAGE_SIZE)
-      set_page_rw(pdir, va, false);
+   set_pages_rw(pdir, va_begin, page_count, false);
 
    printk("fat ramdisk: align of ramdisk was necessary\n");
    return 0;
@@ -101,9 +104,10 @@ int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    const size_t off_end = off_begin + um->len;
    ulong vaddr = um->vaddr, off = 0;
    size_t mapped_cnt, tot_mapped_cnt = 0;
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
    u32 clu;
 
-   if (!d->mmap_support)
+   if (!d->mmap_support && !d->use_pagecache)
       return -ENODEV; /* We do NOT support mmap for this "superblock" */
 
    if (fh->e->directory)
@@ -112,6 +116,26 @@ int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (flags & VFS_MM_DONT_MMAP)
       return 0;
 
+   /* The ramdisk pages are retained: the first write will copy them */
+   if (flags & VFS_MM_PRIVATE) {
+
+      pg_flags = PAGING_FL_US;
+
+      if (um->prot & PROT_WRITE)
+         pg_flags |= PAGING_FL_COW;
+   }
+
+   if (d->use_pagecache) {
+
+      struct page_cache *pc = fat_get_page_cache(d, fh->e);
+
+      if (!pc)
+         return -ENOMEM;
+
+      /* Same flags: the cached pages are retained as well */
+      return pc_mmap(pc, um, pdir, pg_flags);
+   }
+
    clu = fat_get_first_cluster(fh->e);
 
    do {
@@ -148,7 +172,7 @@ int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
                                 (void *)vaddr,
                                 LIN_VA_TO_PA(data),
                                 pg_count,
-                                PAGING_FL_US | PAGING_FL_SHARED);
+                                pg_flags);
 
          if (mapped_cnt != pg_count) {
             unmap_pages_permissive(pdir,
@@ -187,7 +211,7 @@ int fat_munmap(struct user_mapping *um, void *vaddrp, size_t len)
    struct fatfs_handle *fh = um->h;
    struct fat_fs_device_data *d = fh->fs->device_data;
 
-   if (!d->mmap_support)
+   if (!d->mmap_support && !d->use_pagecache)
       return -ENODEV; /* We do NOT support mmap for this "superblock" */
 
    return generic_fs_munmap(um, vaddrp, len);
@@ -0,0 +1,1008 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Write support for the FAT ramdisks.
+ *
+ * The volume lives in RAM and there's no slower medium behind it: the data
+ * clusters and the directory entries are written in place. What gets cached
+ * is the redundant metadata: only the first FAT is updated on each change,
+ * while the dirty sectors are tracked in a bitmap and copied to the other
+ * FATs by fat_flush(), which also updates the FSInfo sector and writes back
+ * the modification times of the files. fat_flush() is called by fsync(),
+ * syncfs() and, every FAT_WB_PERIOD_MS, by the writeback thread.
+ *
+ * The clusters are allocated with a next-fit policy, trying first to extend
+ * the file in place, just after its last cluster, and then looking for a run
+ * of free clusters long enough for the whole allocation. That keeps the files
+ * unfragmented, so that their extent maps stay small and the reads fast.
+ *
+ * Locking order: fs-lock -> file's lock (map->rwlock) -> rw->lock.
+ *
+ *    - The directories change only under the exclusive fs-lock.
+ *    - The data and the size of a file, as well as its extent map, change
+ *      only under the file's exclusive lock.
+ *    - The FAT and the allocator state change only under rw->lock.
+ */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+
+#define FAT_FIRST_CLUSTER                          2
+#define FAT_MAX_FILE_SIZE                 0xFFFFFFFFu
+#define FAT_MAX_NAME_LEN                         255
+#define FAT_MAX_ALIAS_TAIL                    999999
+#define FAT_WB_PERIOD_MS                        5000
+
+static struct list fat_wb_list = STATIC_LIST_INIT(fat_wb_list);
+static struct kmutex fat_wb_lock = STATIC_KMUTEX_INIT(fat_wb_lock, 0);
+
+static inline u32 fat_eoc(struct fat_fs_device_data *d)
+{
+   return d->type == fat16_type ? 0xFFFF : 0x0FFFFFFF;
+}
+
+static inline u32 fat_next(struct fat_fs_device_data *d, u32 clu)
+{
+   return fat_read_fat_entry(d->hdr, d->type, 0, clu);
+}
+
+static inline u32 fat_size_to_clusters(struct fat_fs_device_data *d, u32 sz)
+{
+   return sz / d->cluster_size + !!(sz % d->cluster_size);
+}
+
+/* Updates the first FAT only, marking its sector as dirty */
+static void fat_set_next(struct fat_fs_device_data *d, u32 clu, u32 val)
+{
+   struct fat_rw_data *rw = d->rw;
+   const u32 sec = clu * (u32)d->type / d->hdr->BPB_BytsPerSec;
+   const ulong mask = 1UL << (sec % NBITS);
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&rw->lock));
+   fat_write_fat_entry(d->hdr, d->type, 0, clu, val);
+
+   if (!(rw->dirty_fat[sec / NBITS] & mask)) {
+      rw->dirty_fat[sec / NBITS] |= mask;
+      rw->dirty_fat_sectors++;
+   }
+}
+
+static void
+fat_encode_datetime(s64 ts, u16 *date, u16 *time)
+{
+   struct datetime dt;
+
+   if (timestamp_to_datetime(ts, &dt) || dt.year < 1980) {
+      *date = (1 << 5) | 1;      /* FAT's epoch: 1980-01-01 */
+      *time = 0;
+      return;
+   }
+
+   *date = (u16)(((dt.year - 1980) << 9) | (dt.month << 5) | dt.day);
+   *time = (u16)((dt.hour << 11) | (dt.min << 5) | (dt.sec / 2));
+}
+
+/* The file has been modified: its mtime will be written back by fat_flush() */
+static void fat_touch(struct fat_fs_device_data *d, struct fat_extent_map *map)
+{
+   map->mtime = get_timestamp();
+   map->mtime_dirty = true;
+   d->rw->dirty_files = true;
+}
+
+/* Returns the number of free clusters at `clu`, up to `max` */
+static u32 fat_free_run_len(struct fat_fs_device_data *d, u32 clu, u32 max)
+{
+   u32 n = 0;
+
+   while (n < max && clu + n < d->rw->max_cluster && !fat_next(d, clu + n))
+      n++;
+
+   return n;
+}
+
+/*
+ * Next-fit search of a run of `count` free clusters, starting from the
+ * allocation cursor. When there's no such run, returns the longest one.
+ * Returns the first cluster of the run (0 if there are no free clusters) and
+ * stores its length in `*len`.
+ */
+static u32
+fat_find_free_run(struct fat_fs_device_data *d, u32 count, u32 *len)
+{
+   struct fat_rw_data *rw = d->rw;
+   const u32 total = rw->max_cluster - FAT_FIRST_CLUSTER;
+   u32 clu = rw->next_free;
+   u32 run_start = 0, run = 0;
+   u32 best = 0, best_len = 0;
+
+   for (u32 n = 0; n < total; n++, clu++) {
+
+      if (clu >= rw->max_cluster) {
+         clu = FAT_FIRST_CLUSTER;
+         run = 0;             /* the runs cannot wrap around */
+      }
+
+      if (fat_next(d, clu)) {
+         run = 0;
+         continue;
+      }
+
+      if (!run++)
+         run_start = clu;
+
+      if (run > best_len) {
+
+         best = run_start;
+         best_len = run;
+
+         if (run == count)
+            break;
+      }
+   }
+
+   *len = best_len;
+   return best;
+}
+
+/*
+ * Appends `count` clusters to the chain having `nclu` clusters, the last one
+ * being `last` (0 for an empty file: in that case, the first cluster is stored
+ * in `e`). When `map` is not NULL, the file's extent map is updated as well.
+ * Allocates either all the clusters or none of them.
+ */
+static int
+fat_append_clusters(struct fat_fs_device_data *d,
+                    struct fat_extent_map *map,
+                    struct fat_entry *e,
+                    u32 last,
+                    u32 nclu,
+                    u32 count)
+{
+   struct fat_rw_data *rw = d->rw;
+   u32 clu, len;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&rw->lock));
+
+   if (count > rw->free_count)
+      return -ENOSPC;
+
+   while (count) {
+
+      clu = last + 1;
+
+      /* Extend the file in place, if possible */
+      if (!last || !(len = fat_free_run_len(d, clu, count)))
+         clu = fat_find_free_run(d, count, &len);
+
+      ASSERT(clu != 0 && len > 0);
+      len = MIN(len, count);
+      count -= len;
+      rw->free_count -= len;
+
+      for (u32 i = 0; i < len; i++, clu++, nclu++) {
+
+         fat_set_next(d, clu, fat_eoc(d));
+
+         if (last)
+            fat_set_next(d, last, clu);
+         else
+            fat_set_first_cluster(e, clu);
+
+         if (map)
+            fat_extent_map_append(map, nclu, clu);
+
+         last = clu;
+      }
+
+      rw->next_free = clu < rw->max_cluster ? clu : FAT_FIRST_CLUSTER;
+   }
+
+   return 0;
+}
+
+static void fat_free_chain(struct fat_fs_device_data *d, u32 clu)
+{
+   struct fat_rw_data *rw = d->rw;
+   u32 next;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&rw->lock));
+
+   while (clu && !fat_is_end_of_clusterchain(d->type, clu)) {
+
+      ASSERT(!fat_is_bad_cluster(d->type, clu));
+      next = fat_next(d, clu);
+      fat_set_next(d, clu, 0);
+
+      if (clu < rw->max_cluster)
+         rw->free_count++;
+      else
+         rw->free_beyond++;
+
+      clu = next;
+   }
+}
+
+/* Makes the file of `map`, having `have` clusters, `need` clusters long */
+static int
+fat_grow_file(struct fat_fs_device_data *d,
+              struct fat_extent_map *map,
+              u32 have,
+              u32 need)
+{
+   struct fat_rw_data *rw = d->rw;
+   u32 last = 0;
+   int rc;
+
+   if (need <= have)
+      return 0;
+
+   if (have) {
+      last = fat_get_file_cluster(d, map->e, have - 1);
+      ASSERT(last != FAT_INVALID_CLUSTER);
+   }
+
+   kmutex_lock(&rw->lock);
+   {
+      rc = fat_append_clusters(d, map, map->e, last, have, need - have);
+   }
+   kmutex_unlock(&rw->lock);
+   return rc;
+}
+
+/* Frees all the clusters of the file of `map` after the first `keep` ones */
+static void
+fat_shrink_file(struct fat_fs_device_data *d,
+                struct fat_extent_map *map,
+                u32 keep)
+{
+   struct fat_rw_data *rw = d->rw;
+   struct fat_entry *e = map->e;
+   u32 last, clu;
+
+   kmutex_lock(&rw->lock);
+   {
+      if (keep) {
+
+         last = fat_get_file_cluster(d, e, keep - 1);
+         ASSERT(last != FAT_INVALID_CLUSTER);
+         clu = fat_next(d, last);
+         fat_set_next(d, last, fat_eoc(d));
+
+      } else {
+
+         clu = fat_get_first_cluster(e);
+         fat_set_first_cluster(e, 0);
+      }
+
+      fat_free_chain(d, clu);
+   }
+   kmutex_unlock(&rw->lock);
+   fat_extent_map_truncate(map, keep);
+}
+
+/*
+ * Zeroes the bytes [start, end) of the file, whose clusters must be already
+ * allocated. The clusters beyond the end of a file are never zeroed when it
+ * shrinks: that's done here, when it grows again.
+ */
+static void
+fat_zero_range(struct fat_fs_device_data *d,
+               struct fat_entry *e,
+               u32 start,
+               u32 end)
+{
+   const u32 csize = d->cluster_size;
+   char *data;
+   u32 clu, off, n;
+
+   if (start >= end)
+      return;
+
+   clu = fat_get_file_cluster(d, e, start / csize);
+   ASSERT(clu != FAT_INVALID_CLUSTER);
+
+   while (true) {
+
+      off = start % csize;
+      n = MIN(csize - off, end - start);
+      data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+      bzero(data + off, n);
+      start += n;
+
+      if (start == end)
+         break;
+
+      clu = fat_next(d, clu);
+   }
+}
+
+ssize_t
+fat_rw_write(struct fatfs_handle *h, char *buf, size_t len, offt *pos)
+{
+   struct fat_fs_device_data *d = h->fs->device_data;
+   struct fat_extent_map *map = h->map;
+   struct fat_entry *e = h->e;
+   const u32 csize = d->cluster_size;
+   u32 fsize, off, end, clu, done = 0;
+   ssize_t rc;
+
+   rwlock_wp_exlock(&map->rwlock);
+   fsize = e->DIR_FileSize;
+
+   if (h->fl_flags & O_APPEND)
+      *pos = fsize;
+
+   if (*pos >= FAT_MAX_FILE_SIZE) {
+      rc = -EFBIG;
+      goto out;
+   }
+
+   off = (u32)*pos;
+   end = off + (u32)MIN(len, (size_t)(FAT_MAX_FILE_SIZE - off));
+
+   if (off == end) {
+      rc = 0;
+      goto out;
+   }
+
+   rc = fat_grow_file(d,
+                      map,
+                      fat_size_to_clusters(d, fsize),
+                      fat_size_to_clusters(d, end));
+
+   if (rc)
+      goto out;
+
+   /* Writing past the end leaves a gap, which must read as zeros */
+   fat_zero_range(d, e, fsize, off);
+
+   clu = fat_get_file_cluster(d, e, off / csize);
+   ASSERT(clu != FAT_INVALID_CLUSTER);
+
+   while (true) {
+
+      const u32 clu_off = off % csize;
+      const u32 n = MIN(csize - clu_off, end - off);
+      char *data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+
+      memcpy(data + clu_off, buf + done, n);
+      done += n;
+      off += n;
+
+      if (off == end)
+         break;
+
+      clu = fat_next(d, clu);
+      cond_resched();
+   }
+
+   *pos = off;
+
+   if (off > fsize)
+      e->DIR_FileSize = off;
+
+   fat_touch(d, map);
+   rc = (ssize_t)done;
+
+out:
+   rwlock_wp_exunlock(&map->rwlock);
+   return rc;
+}
+
+int fat_rw_truncate(struct mnt_fs *fs, struct fat_entry *e, offt len)
+{
+   struct fat_fs_device_data *d = fs->device_data;
+   struct fat_extent_map *map;
+   u32 fsize, size;
+   int rc = 0;
+
+   if (e->directory || e->volume_id)
+      return -EISDIR;
+
+   if (len < 0)
+      return -EINVAL;
+
+   if (len > FAT_MAX_FILE_SIZE)
+      return -EFBIG;
+
+   if (!(map = fat_retain_file(d, e)))
+      return -ENOMEM;
+
+   size = (u32)len;
+   rwlock_wp_exlock(&map->rwlock);
+   {
+      fsize = e->DIR_FileSize;
+
+      if (size > fsize) {
+
+         rc = fat_grow_file(d,
+                            map,
+                            fat_size_to_clusters(d, fsize),
+                            fat_size_to_clusters(d, size));
+
+         if (!rc)
+            fat_zero_range(d, e, fsize, size);
+
+      } else {
+
+         fat_shrink_file(d, map, fat_size_to_clusters(d, size));
+      }
+
+      if (!rc) {
+         e->DIR_FileSize = size;
+         fat_touch(d, map);
+      }
+   }
+   rwlock_wp_exunlock(&map->rwlock);
+   fat_file_ref(d, e, -1);
+   return rc;
+}
+
+/*
+ * Directory slots iteration. Unlike fat_walk(), that visits the entries, the
+ * functions below visit all the raw slots of a directory, free ones included.
+ * A position with cluster 0 refers to FAT16's root directory, which has a
+ * fixed number of slots.
+ */
+
+static u32 fat_dir_slots(struct fat_fs_device_data *d, u32 clu)
+{
+   const u32 n = fat_get_dir_entries_per_cluster(d->hdr);
+   return clu ? n : MIN(n, (u32)d->hdr->BPB_RootEntCnt);
+}
+
+static struct fat_entry *
+fat_dir_slot(struct fat_fs_device_data *d, struct fat_walk_pos *pos)
+{
+   struct fat_entry *base = pos->cluster
+      ? fat_get_pointer_to_cluster_data(d->hdr, pos->cluster)
+      : d->root_dir_entries;
+
+   return base + pos->index;
+}
+
+/* Moves `pos` to the next slot. Returns false at the end of the directory */
+static bool fat_dir_next_slot(struct fat_fs_device_data *d,
+                              struct fat_walk_pos *pos)
+{
+   u32 next;
+
+   if (++pos->index < fat_dir_slots(d, pos->cluster))
+      return true;
+
+   if (!pos->cluster)
+      return false;
+
+   next = fat_next(d, pos->cluster);
+
+   if (fat_is_end_of_clusterchain(d->type, next))
+      return false;
+
+   pos->cluster = next;
+   pos->index = 0;
+   return true;
+}
+
+static int
+fat_find_free_slots(struct fat_fs_device_data *d,
+                    u32 dir_clu,
+                    u32 count,
+                    struct fat_walk_pos *res)
+{
+   struct fat_walk_pos pos = { .cluster = dir_clu };
+   struct fat_entry *s;
+   u32 run = 0;
+
+   do {
+
+      s = fat_dir_slot(d, &pos);
+
+      if (s->DIR_Name[0] != FAT_ENTRY_LAST &&
+          s->DIR_Name[0] != FAT_ENTRY_AVAILABLE)
+      {
+         run = 0;
+         continue;
+      }
+
+      if (!run++)
+         *res = pos;
+
+      if (run == count)
+         return 0;
+
+   } while (fat_dir_next_slot(d, &pos));
+
+   return -ENOSPC;
+}
+
+/* Appends a zeroed cluster to the directory starting at `dir_clu` */
+static int fat_grow_dir(struct fat_fs_device_data *d, u32 dir_clu)
+{
+   struct fat_rw_data *rw = d->rw;
+   u32 last = dir_clu, nclu = 1, next;
+   int rc;
+
+   if (!dir_clu)
+      return -ENOSPC;      /* FAT16's root directory cannot grow */
+
+   while (!fat_is_end_of_clusterchain(d->type, next = fat_next(d, last))) {
+      last = next;
+      nclu++;
+   }
+
+   kmutex_lock(&rw->lock);
+   {
+      rc = fat_append_clusters(d, NULL, NULL, last, nclu, 1);
+   }
+   kmutex_unlock(&rw->lock);
+
+   if (!rc) {
+      next = fat_next(d, last);
+      bzero(fat_get_pointer_to_cluster_data(d->hdr, next), d->cluster_size);
+   }
+
+   return rc;
+}
+
+static int
+fat_find_alias_cb(struct fat_hdr *hdr,
+                  enum fat_type ft,
+                  struct fat_entry *entry,
+                  const char *long_name,
+                  void *arg)
+{
+   return !memcmp(entry->DIR_Name, arg, sizeof(entry->DIR_Name));
+}
+
+static bool
+fat_alias_exists(struct fat_fs_device_data *d, u32 dir_clu, char *alias)
+{
+   struct fat_walk_pos pos = { .cluster = dir_clu };
+   struct fat_walk_static_params walk_params = {
+      .ctx = NULL,
+      .h = d->hdr,
+      .ft = d->type,
+      .cb = &fat_find_alias_cb,
+      .arg = alias,
+   };
+
+   fat_walk_resume(&walk_params, &pos);
+   return !pos.eof;
+}
+
+static char fat_alias_char(char c)
+{
+   if (c >= 'a' && c <= 'z')
+      return (char)(c - 'a' + 'A');
+
+   switch (c) {
+
+      case '+': case ',': case ';': case '=': case '[': case ']':
+         return '_';    /* valid in long names only */
+
+      default:
+         return c;
+   }
+}
+
+/*
+ * Generates the short name (alias) of a new entry, in the DIR_Name format:
+ * the first chars of the name (up to 6), followed by "~N" and by the first 3
+ * chars of the extension. Like the other files in Tilck's FAT volumes, the
+ * new entries are always looked up by their long name, case-sensitively (see
+ * fat_search_entry_cb()): the alias has just to be unique in the directory.
+ */
+static int
+fat_gen_alias(struct fat_fs_device_data *d,
+              u32 dir_clu,
+              const char *name,
+              u32 len,
+              char *alias)
+{
+   char basis[8], tail[8];
+   u32 blen = 0, dot = len, tlen, i, n;
+
+   for (i = 1; i < len; i++)
+      if (name[i] == '.')
+         dot = i;       /* a leading dot does not start an extension */
+
+   for (i = 0; i < dot && blen < 6; i++)
+      if (name[i] != '.')
+         basis[blen++] = fat_alias_char(name[i]);
+
+   if (!blen)
+      basis[blen++] = '_';
+
+   memset(alias, ' ', 11);
+
+   for (i = dot + 1, n = 8; i < len && n < 11; i++)
+      if (name[i] != '.')
+         alias[n++] = fat_alias_char(name[i]);
+
+   for (n = 1; n <= FAT_MAX_ALIAS_TAIL; n++) {
+
+      tlen = (u32)snprintk(tail, sizeof(tail), "~%u", n);
+      i = MIN(blen, 8 - tlen);
+      memcpy(alias, basis, i);
+      memcpy(alias + i, tail, tlen);
+      memset(alias + i + tlen, ' ', 8 - i - tlen);
+
+      if (!fat_alias_exists(d, dir_clu, alias))
+         return 0;
+   }
+
+   return -EEXIST;
+}
+
+static void
+fat_fill_long_entry(struct fat_long_entry *le,
+                    const char *name,
+                    u32 len,
+                    u32 ord,
+                    u8 chksum)
+{
+   u8 *fields[3] = { le->LDIR_Name1, le->LDIR_Name2, le->LDIR_Name3 };
+   const u32 sizes[3] = { 5, 6, 2 };
+   u32 idx = (ord - 1) * FAT_LONG_ENTRY_CHARS;
+   u16 c;
+
+   bzero(le, sizeof(*le));
+   le->LDIR_Ord = (u8)ord;
+   le->LDIR_Attr = FAT_ATTR_LONG_NAME;
+   le->LDIR_Chksum = chksum;
+
+   if (idx + FAT_LONG_ENTRY_CHARS >= len)
+      le->LDIR_Ord |= FAT_LONG_ENTRY_LAST;
+
+   /* The name is 0-terminated (if it fits) and padded with 0xFFFF */
+   for (u32 f = 0; f < 3; f++) {
+      for (u32 i = 0; i < sizes[f]; i++, idx++) {
+         c = idx < len ? (u8)name[idx] : (idx == len ? 0 : 0xFFFF);
+         fields[f][2 * i] = c & 0xFF;
+         fields[f][2 * i + 1] = c >> 8;
+      }
+   }
+}
+
+int
+fat_rw_create(struct mnt_fs *fs,
+              struct fat_entry *dir,
+              const char *name,
+              struct fat_entry **out)
+{
+   struct fat_fs_device_data *d = fs->device_data;
+   const u32 dir_clu = fat_get_dir_first_cluster(d, dir);
+   struct fat_walk_pos pos;
+   struct fat_long_entry *le;
+   struct fat_entry *e;
+   char alias[11];
+   u16 date, time;
+   u32 len, nlong;
+   u8 chksum;
+   int rc;
+
+   for (len = 0; name[len] && name[len] != '/'; len++) {
+      if (!fat32_is_valid_filename_character(name[len]))
+         return -EINVAL;
+   }
+
+   if (!len)
+      return -EINVAL;
+
+   if (len > FAT_MAX_NAME_LEN)
+      return -ENAMETOOLONG;
+
+   if ((rc = fat_gen_alias(d, dir_clu, name, len, alias)))
+      return rc;
+
+   nlong = (len + FAT_LONG_ENTRY_CHARS - 1) / FAT_LONG_ENTRY_CHARS;
+
+   while (fat_find_free_slots(d, dir_clu, nlong + 1, &pos)) {
+      if ((rc = fat_grow_dir(d, dir_clu)))
+         return rc;
+   }
+
+   /* The long name entries come first, starting from the last part */
+   chksum = fat_shortname_checksum((u8 *)alias);
+
+   for (u32 ord = nlong; ord > 0; ord--) {
+      le = (struct fat_long_entry *)fat_dir_slot(d, &pos);
+      fat_fill_long_entry(le, name, len, ord, chksum);
+      fat_dir_next_slot(d, &pos);
+   }
+
+   e = fat_dir_slot(d, &pos);
+   bzero(e, sizeof(*e));
+   memcpy(e->DIR_Name, alias, sizeof(e->DIR_Name));
+   e->archive = 1;
+
+   fat_encode_datetime(get_timestamp(), &date, &time);
+   e->DIR_CrtDate = e->DIR_WrtDate = e->DIR_LstAccDate = date;
+   e->DIR_CrtTime = e->DIR_WrtTime = time;
+
+   *out = e;
+   return 0;
+}
+
+static int
+fat_find_entry_cb(struct fat_hdr *hdr,
+                  enum fat_type ft,
+                  struct fat_entry *entry,
+                  const char *long_name,
+                  void *arg)
+{
+   return entry == arg;
+}
+
+/*
+ * Unlike on UNIX file systems, the files cannot outlive their directory entry
+ * on FAT: the open files cannot be unlinked.
+ */
+int fat_rw_unlink(struct vfs_path *p)
+{
+   struct fat_fs_path *fp = (struct fat_fs_path *)&p->fs_path;
+   struct fat_fs_device_data *d = p->fs->device_data;
+   struct fat_rw_data *rw = d->rw;
+   struct fat_entry *e = fp->entry;
+   struct fat_walk_pos pos = {
+      .cluster = fat_get_dir_first_cluster(d, fp->parent_entry),
+   };
+   struct fat_walk_static_params walk_params = {
+      .ctx = NULL,
+      .h = d->hdr,
+      .ft = d->type,
+      .cb = &fat_find_entry_cb,
+      .arg = e,
+   };
+
+   if (e->directory || e->volume_id)
+      return -EISDIR;
+
+   if (fat_file_ref(d, e, 0) > 0)
+      return -EBUSY;
+
+   /* Find the first slot of the entry, its long name included */
+   fat_walk_resume(&walk_params, &pos);
+   ASSERT(!pos.eof);
+
+   kmutex_lock(&rw->lock);
+   {
+      fat_free_chain(d, fat_get_first_cluster(e));
+   }
+   kmutex_unlock(&rw->lock);
+   fat_forget_file(d, e);
+
+   while (true) {
+
+      struct fat_entry *s = fat_dir_slot(d, &pos);
+      s->DIR_Name[0] = FAT_ENTRY_AVAILABLE;
+
+      if (s == e)
+         break;
+
+      fat_dir_next_slot(d, &pos);
+   }
+
+   return 0;
+}
+
+/* Copies the dirty sectors of the first FAT to the other ones */
+static void fat_flush_fats(struct fat_fs_device_data *d)
+{
+   struct fat_rw_data *rw = d->rw;
+   struct fat_hdr *hdr = d->hdr;
+   const u32 bps = hdr->BPB_BytsPerSec;
+   const u32 fat_sz = fat_get_FATSz(hdr);
+   char *fat0 = (char *)hdr + hdr->BPB_RsvdSecCnt * bps;
+   ulong w;
+   u32 sec;
+
+   for (u32 i = 0; i < rw->dirty_fat_words && rw->dirty_fat_sectors; i++) {
+
+      while ((w = rw->dirty_fat[i])) {
+
+         sec = i * NBITS + get_first_set_bit_index_l(w);
+
+         for (u32 n = 1; n < hdr->BPB_NumFATs; n++)
+            memcpy(fat0 + (n * fat_sz + sec) * bps, fat0 + sec * bps, bps);
+
+         rw->dirty_fat[i] &= ~(1UL << (sec % NBITS));
+         rw->dirty_fat_sectors--;
+      }
+   }
+}
+
+static void fat_flush_fsinfo(struct fat_fs_device_data *d)
+{
+   struct fat32_header2 *h2 = (struct fat32_header2 *)(d->hdr + 1);
+   struct fat_rw_data *rw = d->rw;
+   struct fat_fsinfo *fsi;
+
+   if (d->type != fat32_type || !h2->BPB_FSInfo || h2->BPB_FSInfo == 0xFFFF)
+      return;
+
+   fsi = (void *)((char *)d->hdr + h2->BPB_FSInfo * d->hdr->BPB_BytsPerSec);
+
+   if (fsi->FSI_LeadSig != FAT_FSI_LEAD_SIG ||
+       fsi->FSI_StrucSig != FAT_FSI_STRUC_SIG)
+   {
+      return;
+   }
+
+   fsi->FSI_Free_Count = rw->free_count + rw->free_beyond;
+   fsi->FSI_Nxt_Free = rw->next_free;
+}
+
+static int fat_flush_mtime_cb(void *obj, void *arg)
+{
+   struct fat_extent_map *map = obj;
+   u16 date, time;
+
+   if (map->mtime_dirty) {
+      fat_encode_datetime(map->mtime, &date, &time);
+      map->e->DIR_WrtDate = map->e->DIR_LstAccDate = date;
+      map->e->DIR_WrtTime = time;
+      map->mtime_dirty = false;
+   }
+
+   return 0;
+}
+
+void fat_flush(struct fat_fs_device_data *d)
+{
+   struct fat_rw_data *rw = d->rw;
+
+   kmutex_lock(&rw->lock);
+   {
+      fat_flush_fats(d);
+      fat_flush_fsinfo(d);
+   }
+   kmutex_unlock(&rw->lock);
+
+   if (!rw->dirty_files)
+      return;
+
+   disable_preemption();
+   {
+      rw->dirty_files = false;
+      bintree_in_order_visit(d->extent_maps_root,
+                             &fat_flush_mtime_cb,
+                             NULL,
+                             struct fat_extent_map,
+                             node);
+   }
+   enable_preemption();
+}
+
+#ifndef UNIT_TEST_ENVIRONMENT
+
+static bool fat_wb_thread_created;
+
+static void fat_wb_thread(void *unused)
+{
+   struct fat_rw_data *rw;
+
+   while (true) {
+
+      kernel_sleep_ms(FAT_WB_PERIOD_MS);
+
+      kmutex_lock(&fat_wb_lock);
+      {
+         list_for_each_ro(rw, &fat_wb_list, wb_node) {
+            if (rw->dirty_fat_sectors || rw->dirty_files)
+               fat_flush(rw->d);
+         }
+      }
+      kmutex_unlock(&fat_wb_lock);
+   }
+}
+
+static void fat_start_wb_thread(void)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&fat_wb_lock));
+
+   if (fat_wb_thread_created)
+      return;
+
+   if (kthread_create(&fat_wb_thread, 0, NULL) < 0) {
+      printk("WARNING: fat: unable to create the writeback thread\n");
+      return;
+   }
+
+   fat_wb_thread_created = true;
+}
+
+#else
+
+static void fat_start_wb_thread(void)
+{
+   /* No kernel threads in the unit tests: fat_flush() is called directly */
+}
+
+#endif
+
+int fat_rw_init(struct mnt_fs *fs, size_t rd_size)
+{
+   struct fat_fs_device_data *d = fs->device_data;
+   struct fat_hdr *hdr = d->hdr;
+   const u32 rd_sectors = (u32)(rd_size / hdr->BPB_BytsPerSec);
+   const u32 first_data_sec = fat_get_first_data_sector(hdr);
+   const u32 end = fat_get_cluster_count(hdr) + FAT_FIRST_CLUSTER;
+   struct fat_rw_data *rw;
+   u32 max_cluster = FAT_FIRST_CLUSTER;
+
+   if (!(rw = kzalloc_obj(struct fat_rw_data)))
+      return -ENOMEM;
+
+   rw->dirty_fat_words = (fat_get_FATSz(hdr) + NBITS - 1) / NBITS;
+
+   if (!(rw->dirty_fat = kzalloc_array_obj(ulong, rw->dirty_fat_words))) {
+      kfree_obj(rw, struct fat_rw_data);
+      return -ENOMEM;
+   }
+
+   /* The clusters beyond the end of the ramdisk cannot be used */
+   if (rd_sectors > first_data_sec)
+      max_cluster += (rd_sectors - first_data_sec) / hdr->BPB_SecPerClus;
+
+   rw->d = d;
+   rw->max_cluster = MIN(max_cluster, end);
+   rw->next_free = FAT_FIRST_CLUSTER;
+
+   for (u32 clu = FAT_FIRST_CLUSTER; clu < end; clu++) {
+
+      if (fat_next(d, clu))
+         continue;
+
+      if (clu < rw->max_cluster)
+         rw->free_count++;
+      else
+         rw->free_beyond++;
+   }
+
+   rwlock_wp_init(&rw->fs_rwlock, false);
+   kmutex_init(&rw->lock, 0);
+   list_node_init(&rw->wb_node);
+   d->rw = rw;
+
+   kmutex_lock(&fat_wb_lock);
+   {
+      list_add_tail(&fat_wb_list, &rw->wb_node);
+      fat_start_wb_thread();
+   }
+   kmutex_unlock(&fat_wb_lock);
+   return 0;
+}
+
+void fat_rw_destroy(struct mnt_fs *fs)
+{
+   struct fat_fs_device_data *d = fs->device_data;
+   struct fat_rw_data *rw = d->rw;
+
+   if (!rw)
+      return;
+
+   kmutex_lock(&fat_wb_lock);
+   {
+      list_remove(&rw->wb_node);
+   }
+   kmutex_unlock(&fat_wb_lock);
+
+   fat_flush(d);
+   kmutex_destroy(&rw->lock);
+   rwlock_wp_destroy(&rw->fs_rwlock);
+   kfree_array_obj(rw->dirty_fat, ulong, rw->dirty_fat_words);
+   kfree_obj(rw, struct fat_rw_data);
+   d->rw = NULL;
+}
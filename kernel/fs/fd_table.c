@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/fs/fd_table.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+static ALWAYS_INLINE u32 fd_table_words(u32 size)
+{
+   return (size + NBITS - 1) / NBITS;
+}
+
+static ALWAYS_INLINE bool fd_table_is_inline(struct fd_table *t)
+{
+   return t->handles == t->inline_handles;
+}
+
+static void fd_table_reset_inline(struct fd_table *t)
+{
+   bzero(t->inline_handles, sizeof(t->inline_handles));
+   bzero(t->inline_open_fds, sizeof(t->inline_open_fds));
+   t->handles = t->inline_handles;
+   t->open_fds = t->inline_open_fds;
+   t->size = MAX_HANDLES;
+}
+
+static void fd_table_free_arrays(struct fd_table *t)
+{
+   if (fd_table_is_inline(t))
+      return;
+
+   kfree_array_obj(t->handles, fs_handle, t->size);
+   kfree_array_obj(t->open_fds, ulong, fd_table_words(t->size));
+}
+
+void fd_table_init(struct fd_table *t)
+{
+   fd_table_reset_inline(t);
+   t->nofile_cur = NOFILE_DEFAULT_LIMIT;
+   t->nofile_max = NOFILE_MAX_LIMIT;
+}
+
+/*
+ * Make `dst` a copy of `src`, with its own arrays. The handles are NOT
+ * duplicated: that's up to the caller. In case of failure, `dst` is left as
+ * an empty table.
+ */
+int fd_table_copy(struct fd_table *dst, struct fd_table *src)
+{
+   const u32 words = fd_table_words(src->size);
+
+   *dst = *src;
+
+   if (fd_table_is_inline(src)) {
+      dst->handles = dst->inline_handles;
+      dst->open_fds = dst->inline_open_fds;
+      return 0;
+   }
+
+   dst->handles = kalloc_array_obj(fs_handle, src->size);
+   dst->open_fds = kalloc_array_obj(ulong, words);
+
+   if (!dst->handles || !dst->open_fds) {
+      kfree_array_obj(dst->handles, fs_handle, src->size);
+      kfree_array_obj(dst->open_fds, ulong, words);
+      fd_table_reset_inline(dst);
+      return -ENOMEM;
+   }
+
+   memcpy(dst->handles, src->handles, src->size * sizeof(fs_handle));
+   memcpy(dst->open_fds, src->open_fds, words * sizeof(ulong));
+   return 0;
+}
+
+/* Free the table's memory, leaving it empty. The handles are NOT closed. */
+void fd_table_destroy(struct fd_table *t)
+{
+   fd_table_free_arrays(t);
+   fd_table_reset_inline(t);
+}
+
+/*
+ * Allocates on the heap a copy of `src`, as fd_table_copy() does. Returns NULL
+ * in case of OOM.
+ */
+struct fd_table *fd_table_clone(struct fd_table *src)
+{
+   struct fd_table *t = kalloc_obj(struct fd_table);
+
+   if (!t)
+      return NULL;
+
+   if (fd_table_copy(t, src)) {
+      kfree_obj(t, struct fd_table);
+      return NULL;
+   }
+
+   return t;
+}
+
+/* Frees a table allocated by fd_table_clone(). The handles are NOT closed. */
+void fd_table_free(struct fd_table *t)
+{
+   fd_table_free_arrays(t);
+   kfree_obj(t, struct fd_table);
+}
+
+static int fd_table_grow(struct fd_table *t, u32 min_size)
+{
+   u32 new_size = t->size;
+   fs_handle *handles;
+   ulong *open_fds;
+
+   while (new_size < min_size)
+      new_size *= 2;
+
+   new_size = pow2_round_up_at(new_size, NBITS);
+   handles = kzalloc_array_obj(fs_handle, new_size);
+   open_fds = kzalloc_array_obj(ulong, fd_table_words(new_size));
+
+   if (!handles || !open_fds) {
+      kfree_array_obj(handles, fs_handle, new_size);
+      kfree_array_obj(open_fds, ulong, fd_table_words(new_size));
+      return -ENOMEM;
+   }
+
+   memcpy(handles, t->handles, t->size * sizeof(fs_handle));
+   memcpy(open_fds, t->open_fds, fd_table_words(t->size) * sizeof(ulong));
+   fd_table_free_arrays(t);
+
+   t->handles = handles;
+   t->open_fds = open_fds;
+   t->size = new_size;
+   return 0;
+}
+
+/*
+ * Returns the lowest free fd >= `ge`, growing the table if necessary, or
+ * -EMFILE if that would exceed the RLIMIT_NOFILE limit. Note: the fd is not
+ * reserved until fd_table_set() is called.
+ */
+int fd_table_get_free_fd(struct fd_table *t, int ge)
+{
+   const u32 words = fd_table_words(t->size);
+   u32 fd = (u32)ge;
+   ulong used;
+   int rc;
+
+   ASSERT(ge >= 0);
+
+   for (u32 w = fd / NBITS; w < words; w++) {
+
+      used = t->open_fds[w];
+
+      /* In the first word, skip the fds below `ge` */
+      if (w == (u32)ge / NBITS && (ge % NBITS))
+         used |= make_bitmask((u32)ge % NBITS);
+
+      if (used != ~0UL) {
+         fd = w * NBITS + get_first_zero_bit_index_l(used);
+         break;
+      }
+
+      fd = (w + 1) * NBITS;
+   }
+
+   /* Note: with the inline table, `fd` might be >= size even if its bit is 0 */
+   if (fd >= t->nofile_cur)
+      return -EMFILE;
+
+   if ((rc = fd_table_reserve(t, (int)fd)))
+      return rc;
+
+   return (int)fd;
+}
+
+/* Make sure the table has a slot for `fd`, growing it if necessary */
+int fd_table_reserve(struct fd_table *t, int fd)
+{
+   ASSERT(fd >= 0);
+
+   if ((u32)fd < t->size)
+      return 0;
+
+   return fd_table_grow(t, (u32)fd + 1);
+}
+
+void fd_table_set(struct fd_table *t, int fd, fs_handle h)
+{
+   const ulong bit = 1UL << (fd % NBITS);
+
+   ASSERT(IN_RANGE(fd, 0, (int)t->size));
+   t->handles[fd] = h;
+
+   if (h)
+      t->open_fds[fd / NBITS] |= bit;
+   else
+      t->open_fds[fd / NBITS] &= ~bit;
+}
+
+/* Returns the lowest open fd >= `fd`, or -1 if there are none */
+int fd_table_next_open(struct fd_table *t, int fd)
+{
+   const u32 words = fd_table_words(t->size);
+   ulong open;
+
+   ASSERT(fd >= 0);
+
+   for (u32 w = (u32)fd / NBITS; w < words; w++) {
+
+      open = t->open_fds[w];
+
+      /* In the first word, skip the fds below `fd` */
+      if (w == (u32)fd / NBITS && (fd % NBITS))
+         open &= ~make_bitmask((u32)fd % NBITS);
+
+      if (open)
+         return (int)(w * NBITS + get_first_set_bit_index_l(open));
+   }
+
+   return -1;
+}
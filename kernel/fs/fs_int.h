@@ -2,6 +2,7 @@
 
 #pragma once
 #include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/hashtable.h>
 
 struct mountpoint {
 
@@ -10,6 +11,7 @@ struct mountpoint {
    vfs_inode_ptr_t host_fs_inode;
    struct mnt_fs *host_fs;
    struct mnt_fs *target_fs;
+   struct htable_node hnode;           /* node in `mp_table`, by inode */
 };
 
 #define RESOLVE_STACK_SIZE       4
@@ -6,26 +6,34 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/shm.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/pipe.h>
-
-static inline bool is_fd_in_valid_range(int fd)
+#include <tilck/kernel/epoll.h>
+#include <tilck/kernel/eventfd.h>
+#include <tilck/kernel/signalfd.h>
+#include <tilck/kernel/timerfd.h>
+#include <tilck/kernel/io_uring.h>
+#include <tilck/kernel/datetime.h>
+
+#include <sys/epoll.h> // system header
+#include <linux/io_uring.h> // system header
+#include <linux/memfd.h> // system header
+#include <sys/signalfd.h> // system header
+
+static inline bool is_fd_in_valid_range(struct process *pi, int fd)
 {
-   return IN_RANGE(fd, 0, MAX_HANDLES);
+   return IN_RANGE(fd, 0, (int)pi->fds->nofile_cur);
 }
 
+/* Returns the lowest free fd >= `ge` or -EMFILE/-ENOMEM */
 static int get_free_handle_num_ge(struct process *pi, int ge)
 {
    ASSERT(kmutex_is_curr_task_holding_lock(&pi->fslock));
-
-   for (int free_fd = ge; free_fd < MAX_HANDLES; free_fd++)
-      if (!pi->handles[free_fd])
-         return free_fd;
-
-   return -1;
+   return fd_table_get_free_fd(pi->fds, ge);
 }
 
 static int get_free_handle_num(struct process *pi)
@@ -47,10 +55,9 @@ fs_handle get_fs_handle(int fd)
    fs_handle handle = NULL;
 
    kmutex_lock(&curr->pi->fslock);
-
-   if (is_fd_in_valid_range(fd) && curr->pi->handles[fd])
-      handle = curr->pi->handles[fd];
-
+   {
+      handle = fd_table_get(curr->pi->fds, fd);
+   }
    kmutex_unlock(&curr->pi->fslock);
    return handle;
 }
@@ -85,34 +92,73 @@ int sys_open(const char *u_path, int flags, mode_t mode)
 
    kmutex_lock(&curr->pi->fslock);
 
-   if ((free_fd = get_free_handle_num(curr->pi)) < 0)
-      goto no_fds;
+   if ((free_fd = get_free_handle_num(curr->pi)) < 0) {
+      ret = free_fd;
+      goto end;
+   }
 
    if ((ret = vfs_open(path, &h, flags, mode)) < 0)
       goto end;
 
    ASSERT(h != NULL);
 
-   curr->pi->handles[free_fd] = h;
+   fd_table_set(curr->pi->fds, free_fd, h);
    ret = free_fd;
 
 end:
    kmutex_unlock(&curr->pi->fslock);
    return ret;
-
-no_fds:
-   ret = -EMFILE;
-   goto end;
 }
 
 long sys_openat(int dfd, const char *u_path, int flags, mode_t mode)
 {
-   // TODO: Add full support for openat()
+   int ret, free_fd;
+   struct task *curr = get_curr_task();
+   char *path = curr->args_copybuf;
+   size_t written = 0;
+   fs_handle dirh, h = NULL;
 
    if (dfd == AT_FDCWD)
       return sys_open(u_path, flags, mode);
-   else
-      return -ENOSYS;
+
+   if (flags & O_ASYNC)
+      return -EINVAL;
+
+   if ((flags & O_TMPFILE) == O_TMPFILE)
+      return -EOPNOTSUPP;
+
+   mode &= ~curr->pi->umask;
+
+   if ((ret = duplicate_user_path(path, u_path, MAX_PATH, &written)))
+      return ret;
+
+   /*
+    * Holding the `fslock` for the whole call guarantees that `dfd` cannot be
+    * closed meanwhile, so its handle keeps retained its inode.
+    */
+   kmutex_lock(&curr->pi->fslock);
+
+   if (!(dirh = get_fs_handle(dfd))) {
+      ret = -EBADF;
+      goto end;
+   }
+
+   if ((free_fd = get_free_handle_num(curr->pi)) < 0) {
+      ret = free_fd;
+      goto end;
+   }
+
+   if ((ret = vfs_openat(dirh, path, &h, flags, mode)) < 0)
+      goto end;
+
+   ASSERT(h != NULL);
+
+   fd_table_set(curr->pi->fds, free_fd, h);
+   ret = free_fd;
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return ret;
 }
 
 int sys_creat(const char *u_path, mode_t mode)
@@ -170,7 +216,7 @@ int sys_close(int fd)
    kmutex_lock(&curr->pi->fslock);
    {
       vfs_close(handle);
-      curr->pi->handles[fd] = NULL;
+      fd_table_set(curr->pi->fds, fd, NULL);
    }
    kmutex_unlock(&curr->pi->fslock);
    return ret;
@@ -230,6 +276,10 @@ int sys_read(int fd, void *u_buf, size_t count)
 
       ret = (int) vfs_read(h, u_buf, count);
 
+   } else if (h->spec_flags & VFS_SPFL_USER_SPLICE_READ) {
+
+      ret = (int) vfs_read_user(h, u_buf, count);
+
    } else {
 
       count = MIN(count, IO_COPYBUF_SIZE);
@@ -292,6 +342,10 @@ int sys_pread64(int fd, void *u_buf, size_t count, s64 off)
 
       ret = (int) vfs_pread(h, u_buf, count, (offt)off);
 
+   } else if (h->spec_flags & VFS_SPFL_USER_SPLICE_READ) {
+
+      ret = (int) vfs_pread_user(h, u_buf, count, (offt)off);
+
    } else {
 
       count = MIN(count, IO_COPYBUF_SIZE);
@@ -339,6 +393,240 @@ int sys_pwrite64(int fd, const void *u_buf, size_t count, s64 off)
    return ret;
 }
 
+static long
+do_sendfile(int out_fd, int in_fd, offt *off, size_t count)
+{
+   struct fs_handle_base *in_h, *out_h;
+
+   if (!(in_h = get_fs_handle(in_fd)) || !(out_h = get_fs_handle(out_fd)))
+      return -EBADF;
+
+   if (off && *off < 0)
+      return -EINVAL;
+
+   count = MIN(count, (size_t)INT32_MAX);
+   return vfs_splice(in_h, off ? off : &in_h->h_fpos,
+                     out_h, &out_h->h_fpos, count);
+}
+
+long sys_sendfile(int out_fd, int in_fd, long *u_offset, size_t count)
+{
+   long rc, off_val;
+   offt off;
+
+   if (!u_offset)
+      return do_sendfile(out_fd, in_fd, NULL, count);
+
+   if (copy_from_user(&off_val, u_offset, sizeof(off_val)))
+      return -EFAULT;
+
+   off = (offt)off_val;
+   rc = do_sendfile(out_fd, in_fd, &off, count);
+   off_val = (long)off;
+
+   if (rc >= 0 && copy_to_user(u_offset, &off_val, sizeof(off_val)))
+      return -EFAULT;
+
+   return rc;
+}
+
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_offset, size_t count)
+{
+   long rc;
+   s64 off_val;
+   offt off;
+
+   if (!u_offset)
+      return (int)do_sendfile(out_fd, in_fd, NULL, count);
+
+   if (copy_from_user(&off_val, u_offset, sizeof(off_val)))
+      return -EFAULT;
+
+   if (off_val > OFFT_MAX)
+      return -EINVAL;
+
+   off = (offt)off_val;
+   rc = do_sendfile(out_fd, in_fd, &off, count);
+   off_val = off;
+
+   if (rc >= 0 && copy_to_user(u_offset, &off_val, sizeof(off_val)))
+      return -EFAULT;
+
+   return (int)rc;
+}
+
+/* The SPLICE_F_* flags are GNU-specific: fcntl.h might not define them */
+#ifndef SPLICE_F_MOVE
+   #define SPLICE_F_MOVE         1
+   #define SPLICE_F_NONBLOCK     2
+   #define SPLICE_F_MORE         4
+   #define SPLICE_F_GIFT         8
+#endif
+
+#define SPLICE_F_ALL      (SPLICE_F_MOVE | SPLICE_F_NONBLOCK |      \
+                           SPLICE_F_MORE | SPLICE_F_GIFT)
+
+long sys_splice(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                size_t len, unsigned int flags)
+{
+   struct fs_handle_base *in_h, *out_h;
+   offt *in_pos, *out_pos;
+   offt in_off, out_off;
+   s64 val;
+   long rc;
+
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (!(in_h = get_fs_handle(fd_in)) || !(out_h = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   /* Like on Linux, at least one of the two ends must be a pipe */
+   if (!is_pipe_handle(in_h) && !is_pipe_handle(out_h))
+      return -EINVAL;
+
+   in_pos = &in_h->h_fpos;
+   out_pos = &out_h->h_fpos;
+
+   if (u_off_in) {
+
+      if (is_pipe_handle(in_h))
+         return -ESPIPE;
+
+      if (copy_from_user(&val, u_off_in, sizeof(val)))
+         return -EFAULT;
+
+      if (val < 0 || val > OFFT_MAX)
+         return -EINVAL;
+
+      in_off = (offt)val;
+      in_pos = &in_off;
+   }
+
+   if (u_off_out) {
+
+      if (is_pipe_handle(out_h))
+         return -ESPIPE;
+
+      if (copy_from_user(&val, u_off_out, sizeof(val)))
+         return -EFAULT;
+
+      if (val < 0 || val > OFFT_MAX)
+         return -EINVAL;
+
+      out_off = (offt)val;
+      out_pos = &out_off;
+   }
+
+   len = MIN(len, (size_t)INT32_MAX);
+
+   if (is_pipe_handle(in_h) && is_pipe_handle(out_h)) {
+
+      /* Pipe to pipe: just move the data between their rings */
+      return pipe_to_pipe(in_h, out_h, len,
+                          !!(flags & SPLICE_F_NONBLOCK), true);
+   }
+
+   rc = vfs_splice(in_h, in_pos, out_h, out_pos, len);
+
+   if (rc < 0)
+      return rc;
+
+   if (u_off_in) {
+      val = in_off;
+      if (copy_to_user(u_off_in, &val, sizeof(val)))
+         return -EFAULT;
+   }
+
+   if (u_off_out) {
+      val = out_off;
+      if (copy_to_user(u_off_out, &val, sizeof(val)))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+long sys_copy_file_range(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                         size_t len, unsigned int flags)
+{
+   struct fs_handle_base *in_h, *out_h;
+   offt *in_pos, *out_pos;
+   offt in_off, out_off;
+   s64 val;
+   long rc;
+
+   if (flags)
+      return -EINVAL;
+
+   if (!(in_h = get_fs_handle(fd_in)) || !(out_h = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   in_pos = &in_h->h_fpos;
+   out_pos = &out_h->h_fpos;
+
+   if (u_off_in) {
+
+      if (copy_from_user(&val, u_off_in, sizeof(val)))
+         return -EFAULT;
+
+      if (val < 0 || val > OFFT_MAX)
+         return -EINVAL;
+
+      in_off = (offt)val;
+      in_pos = &in_off;
+   }
+
+   if (u_off_out) {
+
+      if (copy_from_user(&val, u_off_out, sizeof(val)))
+         return -EFAULT;
+
+      if (val < 0 || val > OFFT_MAX)
+         return -EINVAL;
+
+      out_off = (offt)val;
+      out_pos = &out_off;
+   }
+
+   len = MIN(len, (size_t)INT32_MAX);
+   rc = vfs_copy_file_range(in_h, in_pos, out_h, out_pos, len);
+
+   if (rc < 0)
+      return rc;
+
+   if (u_off_in) {
+      val = in_off;
+      if (copy_to_user(u_off_in, &val, sizeof(val)))
+         return -EFAULT;
+   }
+
+   if (u_off_out) {
+      val = out_off;
+      if (copy_to_user(u_off_out, &val, sizeof(val)))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+long sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+   struct fs_handle_base *in_h, *out_h;
+
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (!(in_h = get_fs_handle(fd_in)) || !(out_h = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   if (!is_pipe_handle(in_h) || !is_pipe_handle(out_h))
+      return -EINVAL;
+
+   len = MIN(len, (size_t)INT32_MAX);
+   return pipe_to_pipe(in_h, out_h, len, !!(flags & SPLICE_F_NONBLOCK), false);
+}
+
 int sys_ioctl(int fd, ulong request, void *argp)
 {
    fs_handle handle = get_fs_handle(fd);
@@ -414,6 +702,34 @@ int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
    return (int)vfs_readv(handle, iov, u_iovcnt);
 }
 
+long sys_vmsplice(int fd, const struct iovec *u_iov, ulong nr_segs, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   struct iovec *iov = (void *)curr->args_copybuf;
+   fs_handle handle;
+
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (!(handle = get_fs_handle(fd)) || !is_pipe_handle(handle))
+      return -EBADF;
+
+   if (!nr_segs)
+      return 0;
+
+   if (sizeof(struct iovec) * nr_segs > ARGS_COPYBUF_SIZE)
+      return -EINVAL;
+
+   if (copy_from_user(iov, u_iov, sizeof(struct iovec) * nr_segs))
+      return -EFAULT;
+
+   if (iov_len_overflow(iov, (int)nr_segs))
+      return -EINVAL;
+
+   return pipe_vmsplice(handle, iov, (int)nr_segs,
+                        !!(flags & SPLICE_F_NONBLOCK));
+}
+
 static int
 call_vfs_stat64(const char *u_path,
                 struct k_stat64 *u_statbuf,
@@ -601,6 +917,22 @@ int sys_ia32_ftruncate64(int fd, s64 len)
    return vfs_ftruncate(h, (offt)len);
 }
 
+int sys_fallocate(int fd, int mode, s64 off, s64 len)
+{
+   fs_handle h;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (off < 0 || len <= 0)
+      return -EINVAL;
+
+   if (off > (s64)OFFT_MAX || len > (s64)OFFT_MAX - off)
+      return -EFBIG;
+
+   return vfs_fallocate(h, mode, (offt)off, (offt)len);
+}
+
 int sys_llseek(int fd, size_t off_hi, size_t off_low, u64 *u_result, u32 whence)
 {
    const s64 off64 = (s64)(((u64)off_hi << 32) | off_low);
@@ -680,10 +1012,10 @@ int sys_dup2(int oldfd, int newfd)
    fs_handle old_h, new_h;
    struct task *curr = get_curr_task();
 
-   if (!is_fd_in_valid_range(oldfd))
+   if (!is_fd_in_valid_range(curr->pi, oldfd))
       return -EBADF;
 
-   if (!is_fd_in_valid_range(newfd))
+   if (!is_fd_in_valid_range(curr->pi, newfd))
       return -EBADF;
 
    if (newfd == oldfd)
@@ -732,7 +1064,7 @@ int sys_dup2(int oldfd, int newfd)
       goto out;
    }
 
-   curr->pi->handles[newfd] = new_h;
+   fd_table_set(curr->pi->fds, newfd, new_h);
    rc = newfd;
 
 out:
@@ -758,9 +1090,7 @@ int sys_dup(int oldfd)
    kmutex_lock(&pi->fslock);
    {
       free_fd = get_free_handle_num(pi);
-
-      if (is_fd_in_valid_range(free_fd))
-         rc = sys_dup2(oldfd, free_fd);
+      rc = free_fd >= 0 ? sys_dup2(oldfd, free_fd) : free_fd;
    }
    kmutex_unlock(&pi->fslock);
    return rc;
@@ -807,15 +1137,18 @@ static void debug_print_fcntl_command(int cmd)
 
 void close_cloexec_handles(struct process *pi)
 {
+   struct fs_handle_base *h;
+   int fd;
+
    kmutex_lock(&pi->fslock);
 
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
+   fd_table_for_each(pi->fds, fd) {
 
-      struct fs_handle_base *h = pi->handles[i];
+      h = fd_table_get(pi->fds, fd);
 
-      if (h && (h->fd_flags & FD_CLOEXEC)) {
+      if (h->fd_flags & FD_CLOEXEC) {
          vfs_close(h);
-         pi->handles[i] = NULL;
+         fd_table_set(pi->fds, fd, NULL);
       }
    }
 
@@ -835,18 +1168,25 @@ int sys_fcntl64(int fd, int cmd, int arg)
 
       case F_DUPFD:
          {
+            if (!is_fd_in_valid_range(curr->pi, arg))
+               return -EINVAL;
+
             kmutex_lock(&curr->pi->fslock);
             int new_fd = get_free_handle_num_ge(curr->pi, arg);
-            rc = sys_dup2(fd, new_fd);
+            rc = new_fd >= 0 ? sys_dup2(fd, new_fd) : new_fd;
             kmutex_unlock(&curr->pi->fslock);
             return rc;
          }
 
       case F_DUPFD_CLOEXEC:
          {
+            if (!is_fd_in_valid_range(curr->pi, arg))
+               return -EINVAL;
+
             kmutex_lock(&curr->pi->fslock);
             int new_fd = get_free_handle_num_ge(curr->pi, arg);
-            if (!(rc = sys_dup2(fd, new_fd))) {
+            rc = new_fd >= 0 ? sys_dup2(fd, new_fd) : new_fd;
+            if (rc >= 0) {
                /* dup2 succeeded */
                struct fs_handle_base *h2 = get_fs_handle(new_fd);
                ASSERT(h2 != NULL);
@@ -866,20 +1206,27 @@ int sys_fcntl64(int fd, int cmd, int arg)
       case F_SETFL:
 
          /*
-          * In general, O_DIRECT is implicitly supported by Tilck, but for
-          * pipes O_DIRECT has a different meaning: it makes the pipes to work
-          * in a "packet" mode, which is not supported by Tilck, at the moment.
-          *
-          * Therefore, in order to avoid debugging weird stuff, while in
-          * development, just crash the kernel with NOT_IMPLEMENTED() making the
-          * problem evident. At some point, all the NOT_IMPLEMENTED() statements
-          * will need to be replaced somehow for non-dev builds, where crashing
-          * is certainly not acceptable.
+          * O_ASYNC is not supported by Tilck, at the moment. In order to avoid
+          * debugging weird stuff, while in development, just crash the kernel
+          * with NOT_IMPLEMENTED() making the problem evident. At some point,
+          * all the NOT_IMPLEMENTED() statements will need to be replaced
+          * somehow for non-dev builds, where crashing is certainly not
+          * acceptable.
           */
 
-         if (arg & (O_ASYNC | O_DIRECT))
+         if (arg & O_ASYNC)
             NOT_IMPLEMENTED();
 
+         /*
+          * In general, O_DIRECT is implicitly supported by Tilck, but for
+          * pipes O_DIRECT has a different meaning: it switches them to the
+          * "packet" mode (see pipe.c).
+          */
+         if (((arg ^ hb->fl_flags) & O_DIRECT) && is_pipe_handle(hb)) {
+            if ((rc = pipe_set_packet_mode(hb, !!(arg & O_DIRECT))))
+               return rc;
+         }
+
          int unchangeable = hb->fl_flags & ~FCNTL_CHANGEABLE_FL;
          hb->fl_flags = (arg & FCNTL_CHANGEABLE_FL) | unchangeable;
          break;
@@ -887,6 +1234,12 @@ int sys_fcntl64(int fd, int cmd, int arg)
       case F_GETFL:
          return hb->fl_flags;
 
+      case F_SETPIPE_SZ:
+         return is_pipe_handle(hb) ? pipe_set_size(hb, arg) : -EBADF;
+
+      case F_GETPIPE_SZ:
+         return is_pipe_handle(hb) ? pipe_get_size(hb) : -EBADF;
+
       default:
          printk("fcntl64: Ignored unknown cmd %d\n", cmd);
    }
@@ -1098,9 +1451,6 @@ int sys_pipe2(int u_pipefd[2], int flags)
    int fds[2];
    int ret = 0;
 
-   if (flags & O_DIRECT)
-      return -EINVAL;
-
    if (flags & O_NONBLOCK)
       return -EINVAL;
 
@@ -1137,7 +1487,7 @@ int sys_pipe2(int u_pipefd[2], int flags)
    if (!(read_h = pipe_create_read_handle(p)))
       goto fault;
 
-   curr->pi->handles[fds[0]] = read_h;
+   fd_table_set(curr->pi->fds, fds[0], read_h);
 
    if ((fds[1] = get_free_handle_num(curr->pi)) < 0)
       goto no_fds;
@@ -1145,7 +1495,7 @@ int sys_pipe2(int u_pipefd[2], int flags)
    if (!(write_h = pipe_create_write_handle(p)))
       goto fault;
 
-   curr->pi->handles[fds[1]] = write_h;
+   fd_table_set(curr->pi->fds, fds[1], write_h);
 
    if (copy_to_user(u_pipefd, fds, sizeof(fds)))
       goto fault;
@@ -1155,6 +1505,12 @@ int sys_pipe2(int u_pipefd[2], int flags)
       write_h->fd_flags |= FD_CLOEXEC;
    }
 
+   if (flags & O_DIRECT) {
+      pipe_set_packet_mode(read_h, true);   /* Cannot fail: the pipe is empty */
+      read_h->fl_flags |= O_DIRECT;
+      write_h->fl_flags |= O_DIRECT;
+   }
+
 end:
    kmutex_unlock(&curr->pi->fslock);
    return ret;
@@ -1162,12 +1518,12 @@ end:
 err_end:
 
    if (read_h) {
-      curr->pi->handles[fds[0]] = NULL;
+      fd_table_set(curr->pi->fds, fds[0], NULL);
       kfs_destroy_handle((void *)read_h);
    }
 
    if (write_h) {
-      curr->pi->handles[fds[1]] = NULL;
+      fd_table_set(curr->pi->fds, fds[1], NULL);
       kfs_destroy_handle((void *)write_h);
    }
 
@@ -1186,7 +1542,413 @@ no_mem:
    goto err_end;
 
 no_fds:
-   ret = -EMFILE;
+   ret = fds[0] < 0 ? fds[0] : fds[1]; /* -EMFILE or -ENOMEM */
    goto err_end;
 }
 
+int sys_epoll_create1(int flags)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   struct epoll *ep;
+   int fd;
+
+   if (flags & ~EPOLL_CLOEXEC)
+      return -EINVAL;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   if (!(ep = create_epoll())) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (!(h = epoll_create_handle(ep))) {
+      destroy_epoll(ep);
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & EPOLL_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+int sys_epoll_create(int size)
+{
+   if (size <= 0)
+      return -EINVAL;
+
+   return sys_epoll_create1(0);
+}
+
+int sys_eventfd2(unsigned int initval, int flags)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   struct eventfd *efd;
+   int fd;
+
+   if (flags & ~(EFD_SEMAPHORE | EFD_CLOEXEC | EFD_NONBLOCK))
+      return -EINVAL;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   if (!(efd = create_eventfd(initval, flags))) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (!(h = eventfd_create_handle(efd, flags))) {
+      destroy_eventfd(efd);
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & EFD_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+int sys_eventfd(unsigned int initval)
+{
+   return sys_eventfd2(initval, 0);
+}
+
+int sys_signalfd4(int ufd, const sigset_t *u_mask, size_t sizemask, int flags)
+{
+   struct task *curr = get_curr_task();
+   ulong mask[K_SIGACTION_MASK_WORDS];
+   struct fs_handle_base *h;
+   struct signalfd *sfd;
+   int fd;
+
+   if (flags & ~(SFD_CLOEXEC | SFD_NONBLOCK))
+      return -EINVAL;
+
+   if (sizemask != sizeof(mask))
+      return -EINVAL;
+
+   if (copy_from_user(mask, u_mask, sizeof(mask)))
+      return -EFAULT;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if (ufd != -1) {
+
+      /* Just update the mask of an existing signalfd */
+      h = fd_table_get(curr->pi->fds, ufd);
+
+      if (!h || !is_signalfd_handle(h)) {
+         fd = -EINVAL;
+         goto end;
+      }
+
+      signalfd_set_mask(h, mask);
+      fd = ufd;
+      goto end;
+   }
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   if (!(sfd = create_signalfd(mask))) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (!(h = signalfd_create_handle(sfd, flags))) {
+      destroy_signalfd(sfd);
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & SFD_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+int sys_signalfd(int ufd, const sigset_t *u_mask, size_t sizemask)
+{
+   return sys_signalfd4(ufd, u_mask, sizemask, 0);
+}
+
+int sys_timerfd_create(int clockid, int flags)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   struct timerfd *tfd;
+   int fd;
+
+   if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+      return -EINVAL;
+
+   if (flags & ~(TFD_CLOEXEC | TFD_NONBLOCK))
+      return -EINVAL;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   if (!(tfd = create_timerfd(clockid))) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (!(h = timerfd_create_handle(tfd, flags))) {
+      destroy_timerfd(tfd);
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & TFD_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+static int get_timerfd_handle(int fd, fs_handle *out)
+{
+   fs_handle h = get_fs_handle(fd);
+
+   if (!h)
+      return -EBADF;
+
+   if (!is_timerfd_handle(h))
+      return -EINVAL;
+
+   *out = h;
+   return 0;
+}
+
+int sys_timerfd_settime(int fd,
+                        int flags,
+                        const struct k_itimerspec64 *u_new,
+                        struct k_itimerspec64 *u_old)
+{
+   struct k_itimerspec64 new_val, old_val;
+   fs_handle h;
+   int rc;
+
+   if (flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET))
+      return -EINVAL;
+
+   if ((rc = get_timerfd_handle(fd, &h)))
+      return rc;
+
+   if (copy_from_user(&new_val, u_new, sizeof(new_val)))
+      return -EFAULT;
+
+   if ((rc = timerfd_settime(h, flags, &new_val, &old_val)))
+      return rc;
+
+   if (u_old && copy_to_user(u_old, &old_val, sizeof(old_val)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_timerfd_gettime(int fd, struct k_itimerspec64 *u_curr)
+{
+   struct k_itimerspec64 curr_val;
+   fs_handle h;
+   int rc;
+
+   if ((rc = get_timerfd_handle(fd, &h)))
+      return rc;
+
+   timerfd_gettime(h, &curr_val);
+
+   if (copy_to_user(u_curr, &curr_val, sizeof(curr_val)))
+      return -EFAULT;
+
+   return 0;
+}
+
+static struct k_timespec64 k_ts32_to_k_ts64(struct k_timespec32 ts)
+{
+   return (struct k_timespec64) {
+      .tv_sec = ts.tv_sec,
+      .tv_nsec = ts.tv_nsec,
+   };
+}
+
+static struct k_itimerspec32 k_its64_to_k_its32(struct k_itimerspec64 its)
+{
+   return (struct k_itimerspec32) {
+      .it_interval = to_k_timespec32(its.it_interval),
+      .it_value = to_k_timespec32(its.it_value),
+   };
+}
+
+int sys_timerfd_settime32(int fd,
+                          int flags,
+                          const struct k_itimerspec32 *u_new,
+                          struct k_itimerspec32 *u_old)
+{
+   struct k_itimerspec64 new_val, old_val;
+   struct k_itimerspec32 val32;
+   fs_handle h;
+   int rc;
+
+   if (flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET))
+      return -EINVAL;
+
+   if ((rc = get_timerfd_handle(fd, &h)))
+      return rc;
+
+   if (copy_from_user(&val32, u_new, sizeof(val32)))
+      return -EFAULT;
+
+   new_val = (struct k_itimerspec64) {
+      .it_interval = k_ts32_to_k_ts64(val32.it_interval),
+      .it_value = k_ts32_to_k_ts64(val32.it_value),
+   };
+
+   if ((rc = timerfd_settime(h, flags, &new_val, &old_val)))
+      return rc;
+
+   if (u_old) {
+
+      val32 = k_its64_to_k_its32(old_val);
+
+      if (copy_to_user(u_old, &val32, sizeof(val32)))
+         return -EFAULT;
+   }
+
+   return 0;
+}
+
+int sys_timerfd_gettime32(int fd, struct k_itimerspec32 *u_curr)
+{
+   struct k_itimerspec64 curr_val;
+   struct k_itimerspec32 val32;
+   fs_handle h;
+   int rc;
+
+   if ((rc = get_timerfd_handle(fd, &h)))
+      return rc;
+
+   timerfd_gettime(h, &curr_val);
+   val32 = k_its64_to_k_its32(curr_val);
+
+   if (copy_to_user(u_curr, &val32, sizeof(val32)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_memfd_create(const char *u_name, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   char *name = curr->args_copybuf;
+   fs_handle h = NULL;
+   int fd, rc;
+
+   STATIC_ASSERT(ARGS_COPYBUF_SIZE > MEMFD_NAME_MAX_LEN);
+
+   if (flags & ~(MFD_CLOEXEC | MFD_ALLOW_SEALING))
+      return -EINVAL; /* MFD_HUGETLB is not supported */
+
+   /*
+    * The name is used only for debugging purposes on Linux: here, it's just
+    * validated. Note: MFD_ALLOW_SEALING is accepted, but the F_ADD_SEALS
+    * command of fcntl() is not supported.
+    */
+   rc = copy_str_from_user(name, u_name, MEMFD_NAME_MAX_LEN + 1, NULL);
+
+   if (rc < 0)
+      return -EFAULT;
+
+   if (rc > 0)
+      return -EINVAL; /* Name too long */
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   rc = shm_create_memfd((flags & MFD_CLOEXEC) ? O_CLOEXEC : 0, &h);
+
+   if (rc) {
+      fd = rc;
+      goto end;
+   }
+
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   struct io_uring_params p;
+   struct io_ring *r;
+   int fd, rc;
+
+   if (copy_from_user(&p, u_params, sizeof(p)))
+      return -EFAULT;
+
+   for (int i = 0; i < ARRAY_SIZE(p.resv); i++)
+      if (p.resv[i])
+         return -EINVAL;
+
+   if ((rc = create_io_ring(entries, &p, &r)))
+      return rc;
+
+   if (copy_to_user(u_params, &p, sizeof(p))) {
+      destroy_io_ring(r);
+      return -EFAULT;
+   }
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0) {
+      destroy_io_ring(r);
+      goto end;
+   }
+
+   if (!(h = io_ring_create_handle(r))) {
+      destroy_io_ring(r);
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   /* Like on Linux, io_uring fds are always close-on-exec */
+   h->fd_flags |= FD_CLOEXEC;
+   fd_table_set(curr->pi->fds, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
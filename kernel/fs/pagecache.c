@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/fs/pagecache.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/process_mm.h>
+
+void pc_init(struct page_cache *pc, func_pc_fill_page fill_page, offt fsize)
+{
+   *pc = (struct page_cache) {
+      .pages_root = NULL,
+      .fill_page = fill_page,
+      .fsize = fsize,
+      .nr_pages = 0,
+   };
+}
+
+static inline ulong pc_file_pages(struct page_cache *pc)
+{
+   return (ulong)(pow2_round_up_at((u64)pc->fsize, PAGE_SIZE) >> PAGE_SHIFT);
+}
+
+static void pc_free_page(struct pc_page *p)
+{
+   pf_release(LIN_VA_TO_PA(p->vaddr));
+   kfree2(p->vaddr, PAGE_SIZE);
+   kfree_obj(p, struct pc_page);
+}
+
+static struct pc_page *pc_find(struct page_cache *pc, ulong index)
+{
+   struct pc_page *p;
+
+   disable_preemption();
+   {
+      p = bintree_find_ptr(pc->pages_root, index, struct pc_page, node, index);
+   }
+   enable_preemption();
+   return p;
+}
+
+static struct pc_page *pc_new_page(struct page_cache *pc, ulong index)
+{
+   struct pc_page *p;
+
+   if (!(p = kalloc_obj(struct pc_page)))
+      return NULL;
+
+   if (!(p->vaddr = kmalloc(PAGE_SIZE))) {
+      kfree_obj(p, struct pc_page);
+      return NULL;
+   }
+
+   if (pc->fill_page(pc, index, p->vaddr) < 0) {
+      kfree2(p->vaddr, PAGE_SIZE);
+      kfree_obj(p, struct pc_page);
+      return NULL;
+   }
+
+   /* Retained by the cache: private mappings will copy it on write */
+   pf_retain(LIN_VA_TO_PA(p->vaddr), PF_TYPE_FILE);
+   bintree_node_init(&p->node);
+   p->index = index;
+   return p;
+}
+
+/*
+ * Returns the page with the given index, reading it with fill_page() if it's
+ * not cached yet, or NULL in case of failure. The page is filled with the
+ * preemption enabled, as a FS reading it from a device would sleep: in the
+ * unlikely case another task cached the same page in the meanwhile, just keep
+ * the other one.
+ */
+char *pc_get_page(struct page_cache *pc, ulong index)
+{
+   struct pc_page *p, *new_page;
+
+   ASSERT(index < pc_file_pages(pc));
+
+   if ((p = pc_find(pc, index)))
+      return p->vaddr;
+
+   if (!(new_page = pc_new_page(pc, index)))
+      return NULL;
+
+   disable_preemption();
+   {
+      p = bintree_find_ptr(pc->pages_root, index, struct pc_page, node, index);
+
+      if (!p) {
+         bintree_insert_ptr(&pc->pages_root,
+                            new_page,
+                            struct pc_page,
+                            node,
+                            index);
+         pc->nr_pages++;
+         p = new_page;
+         new_page = NULL;
+      }
+   }
+   enable_preemption();
+
+   if (new_page)
+      pc_free_page(new_page);
+
+   return p->vaddr;
+}
+
+/*
+ * Called for each page accessed through a handle: detects sequential streams
+ * and reads ahead the next pages for them. A sequential reader triggers the
+ * next readahead when it's in the middle of the previous window, so the pages
+ * it needs are (mostly) already cached by the time it gets there.
+ */
+void
+pc_update_readahead(struct page_cache *pc,
+                    struct pc_readahead *ra,
+                    ulong index)
+{
+   const ulong file_pages = pc_file_pages(pc);
+   ulong start, end;
+
+   if (index != ra->next) {
+
+      /* Random access: no readahead, until a new stream is detected */
+      ra->win = 0;
+      ra->end = index + 1;
+
+   } else if (ra->end <= index + ra->win / 2) {
+
+      ra->win = ra->win
+         ? MIN(2 * ra->win, (u32)PC_RA_MAX_PAGES)
+         : PC_RA_MIN_PAGES;
+      start = MAX(ra->end, index + 1);
+      end = MIN(start + ra->win, file_pages);
+
+      for (ulong i = start; i < end; i++)
+         if (!pc_get_page(pc, i))
+            break;   /* Out of memory: readahead is just an optimization */
+
+      ra->end = start + ra->win;
+   }
+
+   ra->next = index + 1;
+}
+
+ssize_t
+pc_splice_read(struct page_cache *pc,
+               struct pc_readahead *ra,
+               size_t len,
+               offt *pos,
+               func_splice_actor actor,
+               void *arg)
+{
+   offt tot_read = 0;
+   ssize_t rc;
+   char *page;
+
+   while (*pos < pc->fsize && (size_t)tot_read < len) {
+
+      const ulong index = (ulong)(*pos >> PAGE_SHIFT);
+      const offt page_off = *pos & (PAGE_SIZE - 1);
+      const offt file_rem = pc->fsize - *pos;
+      const offt len_rem = (offt)(len - (size_t)tot_read);
+      const offt to_read = MIN3((offt)PAGE_SIZE - page_off, len_rem, file_rem);
+
+      if (ra)
+         pc_update_readahead(pc, ra, index);
+
+      if (!(page = pc_get_page(pc, index))) {
+
+         if (!tot_read)
+            tot_read = -ENOMEM;
+
+         break;
+      }
+
+      rc = actor(arg, page + page_off, (size_t)to_read);
+
+      if (rc < 0) {
+
+         if (!tot_read)
+            tot_read = rc;
+
+         break;
+      }
+
+      tot_read += rc;
+      *pos += rc;
+
+      if (rc < to_read)
+         break; /* Partial write */
+   }
+
+   return (ssize_t)tot_read;
+}
+
+struct pc_read_ctx {
+   char *buf;
+   size_t written;
+};
+
+static ssize_t pc_read_actor(void *arg, char *data, size_t len)
+{
+   struct pc_read_ctx *ctx = arg;
+
+   memcpy(ctx->buf + ctx->written, data, len);
+   ctx->written += len;
+   return (ssize_t)len;
+}
+
+ssize_t
+pc_read(struct page_cache *pc,
+        struct pc_readahead *ra,
+        char *buf,
+        size_t len,
+        offt *pos)
+{
+   struct pc_read_ctx ctx = { .buf = buf, .written = 0 };
+   return pc_splice_read(pc, ra, len, pos, &pc_read_actor, &ctx);
+}
+
+/*
+ * Maps the cached pages of the [um->off, um->off + um->len) range of the file
+ * at um->vaddr, reading all the missing ones. Pages past EOF are not mapped.
+ */
+int
+pc_mmap(struct page_cache *pc,
+        struct user_mapping *um,
+        pdir_t *pdir,
+        u32 pg_flags)
+{
+   const ulong first = um->off >> PAGE_SHIFT;
+   const ulong end = MIN(first + (um->len >> PAGE_SHIFT), pc_file_pages(pc));
+   ulong vaddr = um->vaddr;
+   char *page;
+   int rc = 0;
+
+   ASSERT(IS_PAGE_ALIGNED(um->off));
+   ASSERT(IS_PAGE_ALIGNED(um->len));
+
+   for (ulong i = first; i < end; i++, vaddr += PAGE_SIZE) {
+
+      if (!(page = pc_get_page(pc, i))) {
+         rc = -ENOMEM;
+         break;
+      }
+
+      if ((rc = map_page(pdir, (void *)vaddr, LIN_VA_TO_PA(page), pg_flags)))
+         break;
+   }
+
+   if (rc)
+      unmap_pages_permissive(pdir,
+                             um->vaddrp,
+                             (vaddr - um->vaddr) >> PAGE_SHIFT,
+                             false);
+
+   return rc;
+}
+
+void pc_destroy(struct page_cache *pc)
+{
+   struct pc_page *p;
+
+   while ((p = bintree_get_first_obj(pc->pages_root, struct pc_page, node))) {
+
+      bintree_remove_ptr(&pc->pages_root, p, struct pc_page, node, index);
+      pc_free_page(p);
+   }
+
+   pc->nr_pages = 0;
+}
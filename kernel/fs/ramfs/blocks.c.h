@@ -1,6 +1,45 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
-static struct ramfs_block *ramfs_new_block(offt page)
+static inline offt ramfs_block_end(struct ramfs_block *b)
+{
+   return b->offset + (offt)(b->pages << PAGE_SHIFT);
+}
+
+/*
+ * Allocates and zeroes the data for a block of `pages` pages. The multi-step
+ * allocation allows us to free later just a part of it, when the file gets
+ * truncated or a hole gets punched in it.
+ */
+static void *ramfs_alloc_block_data(size_t pages)
+{
+   const u32 kmalloc_flags =
+      KMALLOC_FL_MULTI_STEP | KMALLOC_FL_LONG_LIVED | PAGE_SIZE;
+   size_t size = pages << PAGE_SHIFT;
+   void *vaddr;
+
+   if (!(vaddr = general_kmalloc(&size, kmalloc_flags)))
+      return NULL;
+
+   ASSERT(size == pages << PAGE_SHIFT);
+   bzero(vaddr, size);
+
+   /* Retain the pageframes used by this block */
+   retain_pageframes_mapped_at(get_kernel_pdir(), vaddr, size, PF_TYPE_FILE);
+   return vaddr;
+}
+
+static void ramfs_free_block_data(void *vaddr, size_t pages)
+{
+   size_t size = pages << PAGE_SHIFT;
+
+   /* Release the pageframes used by these pages */
+   release_pageframes_mapped_at(get_kernel_pdir(), vaddr, size);
+
+   /* Free the memory pointed by them */
+   general_kfree(vaddr, &size, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+}
+
+static struct ramfs_block *ramfs_new_block(offt page, size_t pages)
 {
    struct ramfs_block *b;
 
@@ -9,32 +48,136 @@ static struct ramfs_block *ramfs_new_block(offt page)
       return NULL;
 
    /* Allocate block's data */
-   if (!(b->vaddr = kzmalloc(PAGE_SIZE))) {
+   if (!(b->vaddr = ramfs_alloc_block_data(pages))) {
       kfree_obj(b, struct ramfs_block);
       return NULL;
    }
 
-   /* Retain the pageframe used by this block */
-   retain_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
-
    /* Init the block object */
    bintree_node_init(&b->node);
    b->offset = page;
+   b->pages = pages;
+   b->sh = NULL;
    return b;
 }
 
+static void ramfs_put_shared_pages(struct ramfs_shared_pages *sh)
+{
+   if (release_obj(sh) == 0) {
+      ramfs_free_block_data(sh->vaddr, sh->pages);
+      kfree_obj(sh, struct ramfs_shared_pages);
+   }
+}
+
+/*
+ * Frees `count` pages of `b` starting from its page `first`, without updating
+ * the block object: that's up to the caller. The shared pages are not freed
+ * here: they're freed all together, when their last block goes away.
+ */
+static void
+ramfs_free_block_range(struct ramfs_block *b, size_t first, size_t count)
+{
+   ASSERT(count > 0);
+   ASSERT(first + count <= b->pages);
+
+   if (!b->sh)
+      ramfs_free_block_data(b->vaddr + (first << PAGE_SHIFT), count);
+}
+
+/* Frees the pages of `b` starting from its page `first` */
+static void ramfs_free_block_pages(struct ramfs_block *b, size_t first)
+{
+   ASSERT(first < b->pages);
+   ramfs_free_block_range(b, first, b->pages - first);
+   b->pages = first;
+}
+
 static void ramfs_destroy_block(struct ramfs_block *b)
 {
-   /* Release the pageframe used by this block */
-   release_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   ramfs_free_block_pages(b, 0);
 
-   /* Free the memory pointed by this block */
-   kfree2(b->vaddr, PAGE_SIZE);
+   if (b->sh)
+      ramfs_put_shared_pages(b->sh);
 
    /* Free the memory used by the block object itself */
    kfree_obj(b, struct ramfs_block);
 }
 
+/*
+ * The pages backing the file range [start, stop) have just changed: either a
+ * new block filled a hole of the file, where its mappings might have the zero
+ * page (read-only) mapped, or a hole has been punched there. Unmap those
+ * pages, so that the next access will fault and map the right ones. That keeps
+ * all the shared mappings of a file coherent with each other and with read()
+ * and write().
+ *
+ * Note: all the mappings in `mappings_list` are shared ones. The private
+ * (copy-on-write) mappings are never registered: see VFS_MM_PRIVATE.
+ */
+static void
+ramfs_unmap_range_mappings(struct ramfs_inode *i, offt start, offt stop)
+{
+   struct user_mapping *um;
+   size_t off, end;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(um, &i->mappings_list, inode_node) {
+
+      off = MAX((size_t)start, um->off);
+      end = MIN((size_t)stop, um->off + um->len);
+
+      for (; off < end; off += PAGE_SIZE) {
+         unmap_page_permissive(um->pi->pdir,
+                               (void *)(um->vaddr + (off - um->off)),
+                               false);
+      }
+   }
+}
+
+/*
+ * Gives to `b` its own copy of its shared pages (see ramfs_copy_range()).
+ * Shared pages are never written: they're mapped read-only in the user
+ * mappings too, so that the first write will get here.
+ */
+static int ramfs_unshare_block(struct ramfs_inode *i, struct ramfs_block *b)
+{
+   struct ramfs_shared_pages *sh = b->sh;
+   void *vaddr;
+
+   ASSERT(sh != NULL);
+
+   if (get_ref_count(sh) == 1 &&
+       sh->vaddr == b->vaddr &&
+       sh->pages == b->pages)
+   {
+      /* We're the last user of all the shared pages: just take them */
+      vaddr = b->vaddr;
+      kfree_obj(sh, struct ramfs_shared_pages);
+      sh = NULL;
+
+   } else {
+
+      if (!(vaddr = ramfs_alloc_block_data(b->pages)))
+         return -ENOMEM;
+
+      memcpy(vaddr, b->vaddr, b->pages << PAGE_SHIFT);
+   }
+
+   disable_preemption();
+   {
+      /* The mappings have the shared pages mapped read-only: unmap them */
+      b->vaddr = vaddr;
+      b->sh = NULL;
+      ramfs_unmap_range_mappings(i, b->offset, ramfs_block_end(b));
+   }
+   enable_preemption();
+
+   if (sh)
+      ramfs_put_shared_pages(sh);
+
+   return 0;
+}
+
 static void
 ramfs_append_new_block(struct ramfs_inode *inode, struct ramfs_block *block)
 {
@@ -46,7 +189,91 @@ ramfs_append_new_block(struct ramfs_inode *inode, struct ramfs_block *block)
                          offset);
 
    ASSERT(success);
-   inode->blocks_count++;
+   inode->blocks_count += block->pages;
+
+   disable_preemption();
+   {
+      ramfs_unmap_range_mappings(inode, block->offset, ramfs_block_end(block));
+   }
+   enable_preemption();
+}
+
+static long ramfs_block_range_cmp(const void *obj, const void *valptr)
+{
+   struct ramfs_block *b = (void *)obj;
+   const offt off = *(const offt *)valptr;
+
+   if (off < b->offset)
+      return 1;
+
+   return off < ramfs_block_end(b) ? 0 : -1;
+}
+
+/*
+ * Returns the block containing the file offset `off`, if any. Otherwise,
+ * returns NULL and sets `*next` (if not NULL) to the first block after `off`,
+ * or to NULL when there are no blocks after it.
+ */
+static struct ramfs_block *
+ramfs_get_block(struct ramfs_inode *i, offt off, struct ramfs_block **next)
+{
+   struct ramfs_block *b;
+
+   b = bintree_find_ge(i->blocks_tree_root,
+                       &off,
+                       ramfs_block_range_cmp,
+                       struct ramfs_block,
+                       node);
+
+   if (b && b->offset <= off)
+      return b;
+
+   if (next)
+      *next = b;
+
+   return NULL;
+}
+
+/*
+ * Allocates a new block at `page`, where there's no block yet, for a write
+ * ending at `end`. When the file grows sequentially (the block before `page`
+ * ends right there), the new extent is twice as big as the previous one, up
+ * to RAMFS_MAX_EXTENT_PAGES, even if that's more than the write needs. That
+ * way, a file written in small chunks gets just a few big extents.
+ */
+static struct ramfs_block *
+ramfs_alloc_block(struct ramfs_inode *i, offt page, offt end)
+{
+   struct ramfs_block *prev = NULL, *next = NULL, *b;
+   size_t pages;
+
+   ASSERT(IS_PAGE_ALIGNED(page));
+   VERIFY(!ramfs_get_block(i, page, &next));
+
+   pages = pow2_round_up_at((ulong)(end - page), PAGE_SIZE) >> PAGE_SHIFT;
+
+   if (page > 0)
+      prev = ramfs_get_block(i, page - 1, NULL);
+
+   if (prev)
+      pages = MAX(pages, prev->pages * 2);
+
+   pages = MIN(pages, (size_t)RAMFS_MAX_EXTENT_PAGES);
+
+   if (next)
+      pages = MIN(pages, (size_t)(next->offset - page) >> PAGE_SHIFT);
+
+   ASSERT(pages > 0);
+
+   if (!(b = ramfs_new_block(page, pages))) {
+
+      /* The memory might be too fragmented: try with a single page */
+      if (pages == 1 || !(b = ramfs_new_block(page, 1)))
+         return NULL;
+   }
+
+   ramfs_append_new_block(i, b);
+   return b;
 }
 
 static int ramfs_inode_extend(struct ramfs_inode *i, offt new_len)
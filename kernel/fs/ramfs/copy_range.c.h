@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Makes the destination range starting at `out` refer to the pages of the
+ * source block `b`, starting from the file offset `in` for `len` bytes (whole
+ * pages). The existing blocks in the destination range get freed.
+ */
+static int
+ramfs_share_block_range(struct ramfs_inode *src,
+                        struct ramfs_block *b,
+                        offt in,
+                        struct ramfs_inode *dst,
+                        offt out,
+                        offt len)
+{
+   struct ramfs_shared_pages *sh = b->sh;
+   struct ramfs_block *nb;
+   int rc;
+
+   ASSERT(b->offset <= in && in + len <= ramfs_block_end(b));
+
+   if (!(nb = kalloc_obj(struct ramfs_block)))
+      return -ENOMEM;
+
+   if (!sh) {
+
+      if (!(sh = kalloc_obj(struct ramfs_shared_pages))) {
+         kfree_obj(nb, struct ramfs_block);
+         return -ENOMEM;
+      }
+
+      sh->ref_count = 1;
+      sh->vaddr = b->vaddr;
+      sh->pages = b->pages;
+
+      disable_preemption();
+      {
+         /* The source mappings might have these pages writable: unmap them */
+         b->sh = sh;
+         ramfs_unmap_range_mappings(src, b->offset, ramfs_block_end(b));
+      }
+      enable_preemption();
+   }
+
+   if ((rc = ramfs_free_range(dst, out, out + len))) {
+      kfree_obj(nb, struct ramfs_block);
+      return rc;
+   }
+
+   bintree_node_init(&nb->node);
+   nb->offset = out;
+   nb->pages = (size_t)len >> PAGE_SHIFT;
+   nb->vaddr = b->vaddr + (in - b->offset);
+   nb->sh = sh;
+   retain_obj(sh);
+
+   ramfs_append_new_block(dst, nb);
+   return 0;
+}
+
+/*
+ * Copies the range [in, in + len) of `src` at `out` in `dst` by sharing the
+ * source's pages, without copying them. Only whole pages get shared, plus
+ * the last one of the source when the copy extends the destination anyway:
+ * the bytes past EOF are always zero. Returns the number of bytes copied,
+ * which might be less than `len`: the caller will copy the rest.
+ */
+static ssize_t
+ramfs_copy_range_locked(struct ramfs_inode *src,
+                        offt in,
+                        struct ramfs_inode *dst,
+                        offt out,
+                        size_t len)
+{
+   struct ramfs_block *b, *next;
+   offt bytes, end, off, n;
+
+   ASSERT(IS_PAGE_ALIGNED(in));
+   ASSERT(IS_PAGE_ALIGNED(out));
+
+   if (in >= src->fsize)
+      return 0;
+
+   bytes = (offt)MIN(len, (size_t)OFFT_MAX);
+   bytes = MIN(bytes, src->fsize - in);
+   end = in + (bytes & (offt)PAGE_MASK);
+
+   if (in + bytes == src->fsize && out + bytes >= dst->fsize)
+      end = (offt)pow2_round_up_at((ulong)src->fsize, PAGE_SIZE);
+
+   for (off = in; off < end; off += n) {
+
+      next = NULL;
+
+      if ((b = ramfs_get_block(src, off, &next))) {
+
+         n = MIN(ramfs_block_end(b), end) - off;
+
+         if (ramfs_share_block_range(src, b, off, dst, out + (off - in), n))
+            break;
+
+      } else {
+
+         /* A hole in the source: just punch it in the destination too */
+         n = (next ? MIN(next->offset, end) : end) - off;
+
+         if (ramfs_free_range(dst, out + (off - in), out + (off - in) + n))
+            break;
+      }
+
+      cond_resched();
+   }
+
+   bytes = MIN(off - in, bytes);
+
+   if (bytes > 0 && out + bytes > dst->fsize)
+      dst->fsize = out + bytes;
+
+   return (ssize_t)bytes;
+}
+
+static ssize_t
+ramfs_copy_range(fs_handle in, offt *in_pos,
+                 fs_handle out, offt *out_pos, size_t len)
+{
+   struct ramfs_inode *src = ((struct ramfs_handle *)in)->inode;
+   struct ramfs_inode *dst = ((struct ramfs_handle *)out)->inode;
+   struct ramfs_inode *first = src < dst ? src : dst;
+   struct ramfs_inode *second = src < dst ? dst : src;
+   ssize_t rc;
+
+   ASSERT(src != dst);
+
+   if (src->type == VFS_DIR)
+      return -EISDIR;
+
+   ASSERT(src->type == VFS_FILE);
+
+   /* Always lock the two inodes in the same order, to avoid deadlocks */
+   rwlock_wp_exlock(&first->rwlock);
+   rwlock_wp_exlock(&second->rwlock);
+   {
+      rc = ramfs_copy_range_locked(src, *in_pos, dst, *out_pos, len);
+   }
+   rwlock_wp_exunlock(&second->rwlock);
+   rwlock_wp_exunlock(&first->rwlock);
+
+   if (rc > 0) {
+      *in_pos += rc;
+      *out_pos += rc;
+   }
+
+   return rc;
+}
@@ -1,17 +1,131 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+/* Entries of different sizes: all of them powers of 2 */
+static struct kmalloc_cache ramfs_entry_caches[] = {
+   KMALLOC_CACHE_INIT("ramfs_entry64", 64, NULL),
+   KMALLOC_CACHE_INIT("ramfs_entry128", 128, NULL),
+   KMALLOC_CACHE_INIT("ramfs_entry256", RAMFS_ENTRY_SIZE, NULL),
+};
+
+/* `name_len` includes the final \0 */
+static struct kmalloc_cache *
+ramfs_entry_get_cache(size_t name_len)
+{
+   const size_t sz = OFFSET_OF(struct ramfs_entry, name) + name_len;
+
+   for (u32 i = 0; i < ARRAY_SIZE(ramfs_entry_caches); i++)
+      if (sz <= ramfs_entry_caches[i].obj_size)
+         return &ramfs_entry_caches[i];
+
+   NOT_REACHED();
+}
+
+struct ramfs_entry_key {
+
+   u32 hash;
+   const char *name;
+   size_t len;                   /* without the final \0 */
+};
+
+/* Order by hash first and only then, in case of collision, by name */
+static long
+ramfs_entry_key_cmp(const struct ramfs_entry *e,
+                    const struct ramfs_entry_key *k)
+{
+   const size_t elen = e->name_len - 1u;
+   int rc;
+
+   if (e->hash != k->hash)
+      return e->hash < k->hash ? -1 : 1;
+
+   if ((rc = memcmp(e->name, k->name, MIN(elen, k->len))))
+      return rc;
+
+   return (long)elen - (long)k->len;
+}
+
 static long ramfs_insert_remove_entry_cmp(const void *a, const void *b)
 {
-   const struct ramfs_entry *e1 = a;
    const struct ramfs_entry *e2 = b;
-   return strcmp(e1->name, e2->name);
+   const struct ramfs_entry_key k = {
+      .hash = e2->hash,
+      .name = e2->name,
+      .len = e2->name_len - 1u,
+   };
+
+   return ramfs_entry_key_cmp(a, &k);
 }
 
 static long ramfs_find_entry_cmp(const void *obj, const void *valptr)
 {
-   const struct ramfs_entry *e = obj;
-   const char *searched_str = valptr;
-   return strcmp(e->name, searched_str);
+   return ramfs_entry_key_cmp(obj, valptr);
+}
+
+static ALWAYS_INLINE struct ramfs_entry **
+ramfs_dir_get_tree(struct ramfs_inode *idir, u32 hash)
+{
+   if (idir->entries_buckets)
+      return &idir->entries_buckets[hash & (idir->buckets_count - 1)];
+
+   return &idir->entries_tree_root;
+}
+
+/*
+ * Move all the entries in a hash table with `count` buckets or, when `count`
+ * is 0, in the single tree. In case of OOM, just keep the current index.
+ */
+static void
+ramfs_dir_rehash(struct ramfs_inode *idir, u32 count)
+{
+   struct ramfs_entry **buckets = NULL;
+   struct ramfs_entry *e;
+
+   if (count && !(buckets = kzalloc_array_obj(struct ramfs_entry *, count)))
+      return;
+
+   if (idir->entries_buckets) {
+      kfree_array_obj(idir->entries_buckets,
+                      struct ramfs_entry *,
+                      idir->buckets_count);
+   }
+
+   idir->entries_buckets = buckets;
+   idir->buckets_count = count;
+   idir->entries_tree_root = NULL;
+
+   list_for_each_ro(e, &idir->entries_list, lnode) {
+
+      bintree_node_init(&e->node);
+
+      bintree_insert(ramfs_dir_get_tree(idir, e->hash),
+                     e,
+                     ramfs_insert_remove_entry_cmp,
+                     struct ramfs_entry,
+                     node);
+   }
+}
+
+/* Keep about 1 to 2 entries per bucket, with some hysteresis */
+static void
+ramfs_dir_resize_index(struct ramfs_inode *idir)
+{
+   const offt cnt = idir->num_entries;
+   const u32 n = idir->buckets_count;
+
+   if (!n) {
+
+      if (cnt >= RAMFS_DIR_HASH_MIN_ENTRIES)
+         ramfs_dir_rehash(idir, RAMFS_DIR_HASH_MIN_BUCKETS);
+
+      return;
+   }
+
+   if (cnt > 2 * (offt)n)
+      ramfs_dir_rehash(idir, 2 * n);
+   else if (cnt < RAMFS_DIR_HASH_MIN_ENTRIES / 2)
+      ramfs_dir_rehash(idir, 0);
+   else if (n > RAMFS_DIR_HASH_MIN_BUCKETS && cnt < (offt)n / 2)
+      ramfs_dir_rehash(idir, n / 2);
 }
 
 static int
@@ -26,10 +140,13 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
    if (enl == 1)
       return -ENOENT;
 
-   if (enl > sizeof(e->name))
+   if (enl > RAMFS_ENTRY_MAX_LEN)
       return -ENAMETOOLONG;
 
-   if (!(e = kalloc_obj(struct ramfs_entry)))
+   if (iname[enl-2] == '/')
+      enl--; /* drop the trailing slash */
+
+   if (!(e = kmalloc_cache_alloc(ramfs_entry_get_cache(enl))))
       return -ENOSPC;
 
    ASSERT(ie->parent_dir != NULL);
@@ -38,25 +155,23 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
    list_node_init(&e->lnode);
 
    e->inode = ie;
-   memcpy(e->name, iname, enl);
-
-   if (e->name[enl-2] == '/') {
-      e->name[enl-2] = 0; /* drop the trailing slash */
-      enl--;
-   }
-
+   memcpy(e->name, iname, enl - 1);
+   e->name[enl-1] = 0;
    e->name_len = (u8) enl;
+   e->hash = hash_str(e->name, enl - 1);
 
-   bintree_insert(&idir->entries_tree_root,
+   bintree_insert(ramfs_dir_get_tree(idir, e->hash),
                   e,
                   ramfs_insert_remove_entry_cmp,
                   struct ramfs_entry,
                   node);
 
    list_add_tail(&idir->entries_list, &e->lnode);
+   vfs_dcache_invalidate(idir, e->name, enl - 1);
 
    ie->nlink++;
    idir->num_entries++;
+   ramfs_dir_resize_index(idir);
    return 0;
 }
 
@@ -73,24 +188,30 @@ ramfs_dir_remove_entry(struct ramfs_inode *idir, struct ramfs_entry *e)
     * to move `dpos` forward, before removing the entry `e`.
     */
 
-   list_for_each_ro(pos, &idir->handles_list, node) {
+   disable_preemption();
+   {
+      list_for_each_ro(pos, &idir->handles_list, node) {
 
-      if (pos->dpos == e)
-         pos->dpos = list_next_obj(pos->dpos, lnode);
+         if (pos->dpos == e)
+            pos->dpos = list_next_obj(pos->dpos, lnode);
+      }
    }
+   enable_preemption();
 
-   bintree_remove(&idir->entries_tree_root,
+   bintree_remove(ramfs_dir_get_tree(idir, e->hash),
                   e,
                   ramfs_insert_remove_entry_cmp,
                   struct ramfs_entry,
                   node);
 
    list_remove(&e->lnode);
+   vfs_dcache_invalidate(idir, e->name, e->name_len - 1u);
 
    ASSERT(ie->nlink > 0);
    ie->nlink--;
    idir->num_entries--;
-   kfree_obj(e, struct ramfs_entry);
+   kmalloc_cache_free(ramfs_entry_get_cache(e->name_len), e);
+   ramfs_dir_resize_index(idir);
 }
 
 static struct ramfs_entry *
@@ -98,12 +219,14 @@ ramfs_dir_get_entry_by_name(struct ramfs_inode *idir,
                             const char *name,
                             ssize_t len)
 {
-   char buf[RAMFS_ENTRY_MAX_LEN];
-   memcpy(buf, name, (size_t) len);
-   buf[len] = 0;
-
-   return bintree_find(idir->entries_tree_root,
-                       buf,
+   const struct ramfs_entry_key k = {
+      .hash = hash_str(name, (size_t)len),
+      .name = name,
+      .len = (size_t)len,
+   };
+
+   return bintree_find(*ramfs_dir_get_tree(idir, k.hash),
+                       &k,
                        ramfs_find_entry_cmp,
                        struct ramfs_entry,
                        node);
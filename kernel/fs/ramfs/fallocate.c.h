@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/* Zeroes the bytes of the file range [start, end), skipping the holes */
+static int ramfs_zero_range(struct ramfs_inode *i, offt start, offt end)
+{
+   struct ramfs_block *b, *next = NULL;
+   offt stop;
+
+   while (start < end) {
+
+      if (!(b = ramfs_get_block(i, start, &next))) {
+
+         if (!next || next->offset >= end)
+            break;
+
+         start = next->offset;
+         continue;
+      }
+
+      if (b->sh && ramfs_unshare_block(i, b))
+         return -ENOMEM;
+
+      stop = MIN(end, ramfs_block_end(b));
+      bzero(b->vaddr + (start - b->offset), (size_t)(stop - start));
+      start = stop;
+   }
+
+   return 0;
+}
+
+/*
+ * Frees the pages of the blocks in the page-aligned file range [start, end),
+ * after unmapping them from the file's shared mappings. A block covering the
+ * whole range gets split in two: that's the only case requiring a memory
+ * allocation (for the new block object), done before touching anything.
+ */
+static int ramfs_free_range(struct ramfs_inode *i, offt start, offt end)
+{
+   struct ramfs_block *b, *tail = NULL;
+   size_t first, count;
+
+   ASSERT(IS_PAGE_ALIGNED(start));
+   ASSERT(IS_PAGE_ALIGNED(end));
+   ASSERT(start < end);
+
+   b = ramfs_get_block(i, start, NULL);
+
+   if (b && b->offset < start && ramfs_block_end(b) > end) {
+      if (!(tail = kalloc_obj(struct ramfs_block)))
+         return -ENOMEM;
+   }
+
+   disable_preemption();
+   {
+      ramfs_unmap_range_mappings(i, start, end);
+   }
+   enable_preemption();
+
+   if (b && b->offset < start) {
+
+      first = (size_t)(start - b->offset) >> PAGE_SHIFT;
+
+      if (tail) {
+
+         /* The pages past the range become a new block */
+         count = (size_t)(end - start) >> PAGE_SHIFT;
+         bintree_node_init(&tail->node);
+         tail->offset = end;
+         tail->vaddr = b->vaddr + ((first + count) << PAGE_SHIFT);
+         tail->pages = b->pages - first - count;
+         tail->sh = b->sh;
+
+         if (tail->sh)
+            retain_obj(tail->sh);
+
+         ramfs_free_block_range(b, first, count);
+         b->pages = first;
+         i->blocks_count -= count;
+
+         DEBUG_ONLY_UNSAFE(bool success =)
+            bintree_insert_ptr(&i->blocks_tree_root,
+                               tail,
+                               struct ramfs_block,
+                               node,
+                               offset);
+
+         ASSERT(success);
+         return 0;
+      }
+
+      i->blocks_count -= b->pages - first;
+      ramfs_free_block_pages(b, first);
+   }
+
+   /* Now, no block contains `start`: `b` is the first one after it, if any */
+   while (!ramfs_get_block(i, start, &b) && b && b->offset < end) {
+
+      if (ramfs_block_end(b) <= end) {
+
+         bintree_remove_ptr(&i->blocks_tree_root,
+                            b,
+                            struct ramfs_block,
+                            node,
+                            offset);
+
+         i->blocks_count -= b->pages;
+         ramfs_destroy_block(b);
+
+         /* Punching a big hole frees many blocks: we hold a sleeping lock */
+         cond_resched();
+         continue;
+      }
+
+      /*
+       * The block ends past the range: free its first pages. Moving its offset
+       * to `end` keeps it between the same neighbours, so the tree is still
+       * ordered.
+       */
+      count = (size_t)(end - b->offset) >> PAGE_SHIFT;
+      ramfs_free_block_range(b, 0, count);
+      b->vaddr += count << PAGE_SHIFT;
+      b->offset = end;
+      b->pages -= count;
+      i->blocks_count -= count;
+   }
+
+   return 0;
+}
+
+/*
+ * Punches a hole in the file range [start, end): the whole pages inside it are
+ * freed, while the partial ones at its edges are just zeroed. The file size
+ * never changes (FALLOC_FL_KEEP_SIZE is mandatory with FALLOC_FL_PUNCH_HOLE).
+ */
+static int ramfs_punch_hole(struct ramfs_inode *i, offt start, offt end)
+{
+   const offt pstart = (offt)pow2_round_up_at((ulong)start, PAGE_SIZE);
+   const offt pend = end & (offt)PAGE_MASK;
+   int rc;
+
+   if (pstart >= pend)
+      return ramfs_zero_range(i, start, end);  /* no whole pages in range */
+
+   if ((rc = ramfs_zero_range(i, start, pstart)))
+      return rc;
+
+   if ((rc = ramfs_zero_range(i, pend, end)))
+      return rc;
+
+   return ramfs_free_range(i, pstart, pend);
+}
+
+/*
+ * Allocates blocks for all the holes in the file range [start, end), so that
+ * writing there later won't need to allocate anything. Unless `keep_size` is
+ * true, the file gets extended to `end`, if shorter. The blocks past EOF (with
+ * `keep_size`) are zero-filled, like all the new blocks, and get freed by the
+ * next truncate() of the file.
+ */
+static int
+ramfs_prealloc(struct ramfs_inode *i, offt start, offt end, bool keep_size)
+{
+   struct ramfs_block *b, *next;
+   offt off = start & (offt)PAGE_MASK;
+   size_t pages;
+
+   while (off < end) {
+
+      next = NULL;
+
+      if ((b = ramfs_get_block(i, off, &next))) {
+         off = ramfs_block_end(b);
+         continue;
+      }
+
+      pages = pow2_round_up_at((ulong)(end - off), PAGE_SIZE) >> PAGE_SHIFT;
+      pages = MIN(pages, (size_t)RAMFS_MAX_EXTENT_PAGES);
+
+      if (next)
+         pages = MIN(pages, (size_t)(next->offset - off) >> PAGE_SHIFT);
+
+      if (!(b = ramfs_new_block(off, pages))) {
+
+         /* The memory might be too fragmented: try with a single page */
+         if (pages == 1 || !(b = ramfs_new_block(off, 1)))
+            return -ENOSPC;
+      }
+
+      ramfs_append_new_block(i, b);
+      off = ramfs_block_end(b);
+      cond_resched();
+   }
+
+   if (!keep_size && end > i->fsize)
+      i->fsize = end;
+
+   return 0;
+}
+
+static int ramfs_fallocate(fs_handle h, int mode, offt off, offt len)
+{
+   struct ramfs_handle *rh = h;
+   struct ramfs_inode *i = rh->inode;
+   int rc;
+
+   /* We can be sure it's a file because dirs cannot be open for writing */
+   ASSERT(i->type == VFS_FILE);
+
+   ramfs_file_exlock(h);
+   {
+      if (mode & FALLOC_FL_PUNCH_HOLE)
+         rc = ramfs_punch_hole(i, off, off + len);
+      else
+         rc = ramfs_prealloc(i, off, off + len, !!(mode & FALLOC_FL_KEEP_SIZE));
+   }
+   ramfs_file_exunlock(h);
+   return rc;
+}
@@ -12,6 +12,9 @@ static int ramfs_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
    if ((inode->mode & 0400) != 0400) /* read permission */
       return -EACCES;
 
+   /* Entries can be added under the directory's lock (see ramfs_dir_exlock) */
+   rwlock_wp_shlock(&inode->rwlock);
+
    list_for_each_ro_kp(rh->dpos, &inode->entries_list, lnode) {
 
       struct vfs_dent64 dent = {
@@ -25,5 +28,7 @@ static int ramfs_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
          break;
    }
 
+   rwlock_wp_shunlock(&inode->rwlock);
+
    return rc;
 }
@@ -10,10 +10,17 @@ static struct ramfs_inode *ramfs_new_inode(struct ramfs_data *d)
       return NULL;
 
    rwlock_wp_init(&i->rwlock, true);
+   rwlock_wp_set_lock_class(&i->rwlock, &ramfs_inode_lock_class);
    list_init(&i->mappings_list);
 
    i->type = VFS_NONE;
-   i->ino = d->next_inode_num++;
+
+   /* Inodes can be created concurrently in different directories */
+   disable_preemption();
+   {
+      i->ino = d->next_inode_num++;
+   }
+   enable_preemption();
 
    if (DEBUG_RAMFS_CREATE_INODE_PRINTK) {
       printk("ramfs: Create inode with ref_count at %p\n", &i->ref_count);
@@ -104,6 +111,8 @@ static int ramfs_destroy_inode(struct ramfs_data *d, struct ramfs_inode *i)
 
       case VFS_DIR:
          ASSERT(i->entries_tree_root == NULL);
+         ASSERT(i->entries_buckets == NULL);
+         vfs_dcache_invalidate(i, NULL, 0);
          break;
 
       case VFS_SYMLINK:
@@ -48,3 +48,39 @@ static void ramfs_shunlock(struct mnt_fs *fs)
    struct ramfs_data *d = fs->device_data;
    rwlock_wp_shunlock(&d->rwlock);
 }
+
+/*
+ * Lock the directory where the last component of `p` is (see the comment about
+ * the per-directory locks in vfs.h). The path has been resolved before taking
+ * the lock, so the entry must be checked again: if it changed in the meanwhile
+ * (e.g. a concurrent creat() of the same name), let the VFS retry with the
+ * exclusive fs-lock.
+ */
+static int ramfs_dir_exlock(struct vfs_path *p)
+{
+   struct ramfs_path *rp = (struct ramfs_path *) &p->fs_path;
+   struct ramfs_inode *idir = rp->dir_inode;
+   const char *name = p->last_comp;
+   ssize_t len = 0;
+
+   if (rp->inode && !rp->dir_entry)
+      return -EAGAIN; /* root dir case */
+
+   while (name[len] && name[len] != '/')
+      len++;
+
+   rwlock_wp_exlock(&idir->rwlock);
+
+   if (ramfs_dir_get_entry_by_name(idir, name, len) != rp->dir_entry) {
+      rwlock_wp_exunlock(&idir->rwlock);
+      return -EAGAIN;
+   }
+
+   return 0;
+}
+
+static void ramfs_dir_exunlock(struct vfs_path *p)
+{
+   struct ramfs_inode *idir = p->fs_path.dir_inode;
+   rwlock_wp_exunlock(&idir->rwlock);
+}
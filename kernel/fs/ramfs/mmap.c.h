@@ -1,5 +1,34 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+/*
+ * Max number of pages mapped by a single page fault: see ramfs_fault_around().
+ * Must be a power of 2.
+ */
+#define RAMFS_FAULT_AROUND_PAGES                16
+
+/* The paging flags for mapping the file's blocks in a (shared) mapping */
+static inline u32 ramfs_um_pg_flags(struct user_mapping *um)
+{
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   return pg_flags;
+}
+
+/* Like ramfs_um_pg_flags(), but shared blocks are always mapped read-only */
+static inline u32
+ramfs_block_pg_flags(struct user_mapping *um, struct ramfs_block *b)
+{
+   u32 pg_flags = ramfs_um_pg_flags(um);
+
+   if (b->sh)
+      pg_flags &= ~PAGING_FL_RW;     /* the first write will unshare it */
+
+   return pg_flags;
+}
+
 static int ramfs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
 {
    return generic_fs_munmap(um, vaddrp, len);
@@ -10,14 +39,17 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 {
    struct ramfs_handle *rh = um->h;
    struct ramfs_inode *i = rh->inode;
-   ulong vaddr = um->vaddr;
    struct bintree_walk_ctx ctx;
    struct ramfs_block *b;
-   u32 pg_flags;
+   ulong vaddr;
+   u32 pg_flags, b_pg_flags;
    int rc;
 
    const size_t off_begin = um->off;
-   const size_t off_end = off_begin + um->len;
+   const size_t off_end = MIN(
+      off_begin + um->len,
+      pow2_round_up_at((size_t)i->fsize, PAGE_SIZE) /* no pages past EOF */
+   );
 
    ASSERT(IS_PAGE_ALIGNED(um->len));
 
@@ -33,37 +65,59 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
                                 node,
                                 false);
 
-   pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   if (flags & VFS_MM_PRIVATE) {
 
-   if ((rh->fl_flags & O_RDWR) == O_RDWR)
-      pg_flags |= PAGING_FL_RW;
+      /* Our blocks' pages are retained: the first write will copy them */
+      pg_flags = PAGING_FL_US;
+
+      if (um->prot & PROT_WRITE)
+         pg_flags |= PAGING_FL_COW;
+
+   } else {
+
+      pg_flags = ramfs_um_pg_flags(um);
+   }
 
    while ((b = bintree_in_order_visit_next(&ctx))) {
 
-      if ((size_t)b->offset < off_begin)
+      if ((size_t)ramfs_block_end(b) <= off_begin)
          continue; /* skip this block */
 
       if ((size_t)b->offset >= off_end)
          break;
 
-      rc = map_page(pdir,
-                    (void *)vaddr,
-                    LIN_VA_TO_PA(b->vaddr),
-                    pg_flags);
+      /* Map the pages of this extent inside the [off_begin, off_end) range */
+      size_t off = MAX((size_t)b->offset, off_begin);
+      const size_t end = MIN((size_t)ramfs_block_end(b), off_end);
 
-      if (rc) {
+      b_pg_flags = pg_flags;
 
-         /* mmap failed, we have to unmap the pages already mapped */
-         vaddr -= PAGE_SIZE;
+      if (b->sh && !(flags & VFS_MM_PRIVATE))
+         b_pg_flags = ramfs_block_pg_flags(um, b);
 
-         for (; vaddr >= um->vaddr; vaddr -= PAGE_SIZE) {
-            unmap_page_permissive(pdir, (void *)vaddr, false);
-         }
+      for (; off < end; off += PAGE_SIZE) {
 
-         return rc;
-      }
+         vaddr = um->vaddr + (off - off_begin);
+
+         rc = map_page(pdir,
+                       (void *)vaddr,
+                       LIN_VA_TO_PA(b->vaddr + (off - (size_t)b->offset)),
+                       b_pg_flags);
 
-      vaddr += PAGE_SIZE;
+         if (rc) {
+
+            /*
+             * mmap failed, we have to unmap the pages already mapped. There
+             * might be holes among them: unmap_page_permissive() is fine.
+             */
+            while (vaddr > um->vaddr) {
+               vaddr -= PAGE_SIZE;
+               unmap_page_permissive(pdir, (void *)vaddr, false);
+            }
+
+            return rc;
+         }
+      }
    }
 
 register_mapping:
@@ -74,6 +128,58 @@ register_mapping:
    return 0;
 }
 
+/*
+ * Map, together with the page at `abs_off` which just faulted, the other pages
+ * of the file's blocks inside the same aligned window of
+ * RAMFS_FAULT_AROUND_PAGES pages. Accessing a mapped file sequentially then
+ * costs one page fault every RAMFS_FAULT_AROUND_PAGES pages, instead of one
+ * per page. The holes are skipped: they're left to the regular fault path.
+ */
+static void
+ramfs_fault_around(struct process *pi, struct user_mapping *um, size_t abs_off)
+{
+   struct ramfs_inode *i = ((struct ramfs_handle *)um->h)->inode;
+   const size_t win_size = RAMFS_FAULT_AROUND_PAGES << PAGE_SHIFT;
+   const size_t win_start = abs_off & ~(win_size - 1);
+   struct ramfs_block *b, *next;
+   size_t off, end, b_end;
+   void *va;
+
+   off = MAX(win_start, um->off);
+   end = MIN(win_start + win_size, um->off + um->len);
+   end = MIN(end, pow2_round_up_at((size_t)i->fsize, PAGE_SIZE));
+
+   while (off < end) {
+
+      if (!(b = ramfs_get_block(i, (offt)off, &next))) {
+
+         if (!next)
+            break;
+
+         off = (size_t)next->offset;
+         continue;
+      }
+
+      b_end = MIN(end, (size_t)ramfs_block_end(b));
+
+      for (; off < b_end; off += PAGE_SIZE) {
+
+         va = (void *)(um->vaddr + (off - um->off));
+
+         if (is_mapped(pi->pdir, va))
+            continue;
+
+         if (map_page(pi->pdir,
+                      va,
+                      LIN_VA_TO_PA(b->vaddr + (off - (size_t)b->offset)),
+                      ramfs_block_pg_flags(um, b)))
+         {
+            return; /* Not a problem: the page will fault later */
+         }
+      }
+   }
+}
+
 static bool
 ramfs_handle_fault_int(struct process *pi,
                        struct user_mapping *um,
@@ -82,52 +188,85 @@ ramfs_handle_fault_int(struct process *pi,
                        bool rw)
 {
    struct ramfs_handle *rh = um->h;
+   struct ramfs_inode *i = rh->inode;
    ulong vaddr = (ulong) vaddrp;
-   ulong abs_off;
    struct ramfs_block *block;
+   size_t abs_off;
+   ulong pa;
+   u32 pg_flags;
    int rc;
 
    ASSERT(um != NULL);
+   abs_off = um->off + (vaddr - um->vaddr);
+
+   if (abs_off >= (size_t)i->fsize)
+      return false; /* Read/write past EOF */
+
+   abs_off &= PAGE_MASK;
+   block = ramfs_get_block(i, (offt)abs_off, NULL);
 
    if (p) {
 
       /*
-       * The page is present, just is read-only and the user code tried to
-       * write: there's nothing we can do.
+       * The page is present, but read-only and the user code tried to write.
+       * If the mapping is writable, that's either the zero page we mapped on
+       * a read from a hole of the file, and it's time to allocate a block for
+       * it, or a page of a shared block, which has to be unshared. Otherwise,
+       * there's nothing we can do.
        */
 
       ASSERT(rw);
-      ASSERT((um->prot & PROT_WRITE) == 0);
-      return false;
+
+      if ((block && !block->sh) || !(um->prot & PROT_WRITE))
+         return false;
    }
 
-   /* The page is *not* present */
-   abs_off = um->off + (vaddr - um->vaddr);
+   if (block && block->sh && rw) {
 
-   if (abs_off >= (ulong)rh->inode->fsize)
-      return false; /* Read/write past EOF */
+      /* This unmaps also the shared page, if `p` is true */
+      if (ramfs_unshare_block(i, block))
+         panic("Out-of-memory: unable to unshare a ramfs_block. No OOM killer");
+   }
 
-   if (rw) {
-      /* Create and map on-the-fly a struct ramfs_block */
-      if (!(block = ramfs_new_block((offt)(abs_off & PAGE_MASK))))
+   if (!block && rw) {
+
+      /* Create and map on-the-fly a single-page struct ramfs_block */
+      if (!(block = ramfs_new_block((offt)abs_off, 1)))
          panic("Out-of-memory: unable to alloc a ramfs_block. No OOM killer");
 
-      ramfs_append_new_block(rh->inode, block);
+      /* This unmaps also our zero page, if `p` is true */
+      ramfs_append_new_block(i, block);
    }
 
-   rc = map_page(pi->pdir,
-                 (void *)(vaddr & PAGE_MASK),
-                 rw ? LIN_VA_TO_PA(block->vaddr) : KERNEL_VA_TO_PA(&zero_page),
-                 PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+   if (block) {
+
+      pa = LIN_VA_TO_PA(block->vaddr + (abs_off - (size_t)block->offset));
+      pg_flags = ramfs_block_pg_flags(um, block);
+
+   } else {
+
+      /*
+       * A read from a hole: map the zero page, read-only even if the mapping
+       * is writable, because it's shared with the whole system. A write will
+       * fault again and get here with `p` set.
+       */
+      pa = KERNEL_VA_TO_PA(&zero_page);
+      pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   }
+
+   rc = map_page(pi->pdir, (void *)(vaddr & PAGE_MASK), pa, pg_flags);
 
    if (rc)
       panic("Out-of-memory: unable to map a ramfs_block. No OOM killer");
 
    invalidate_page(vaddr);
+
+   if (block)
+      ramfs_fault_around(pi, um, abs_off);
+
    return true;
 }
 
-
 static bool
 ramfs_handle_fault(struct user_mapping *um, void *vaddrp, bool p, bool rw)
 {
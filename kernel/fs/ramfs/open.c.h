@@ -6,8 +6,11 @@ static const struct file_ops static_ops_ramfs =
    .write = ramfs_write,
    .readv = ramfs_readv,
    .writev = ramfs_writev,
+   .splice_read = ramfs_splice_read,
    .seek = ramfs_seek,
    .ioctl = ramfs_ioctl,
+   .fallocate = ramfs_fallocate,
+   .copy_range = ramfs_copy_range,
    .mmap = ramfs_mmap,
    .munmap = ramfs_munmap,
    .handle_fault = ramfs_handle_fault,
@@ -28,6 +31,9 @@ ramfs_open_int(struct mnt_fs *fs,
    h->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
    retain_obj(inode);
 
+   if (inode->type == VFS_FILE)
+      h->spec_flags |= VFS_SPFL_USER_SPLICE_READ;
+
    if (inode->type == VFS_DIR) {
 
       /*
@@ -37,9 +43,18 @@ ramfs_open_int(struct mnt_fs *fs,
        * forward. This is a VERY CORNER CASE, but it *MUST BE* handled.
        */
       list_node_init(&h->node);
-      list_add_tail(&inode->handles_list, &h->node);
       h->dpos = list_first_obj(&inode->entries_list, struct ramfs_entry, lnode);
 
+      /*
+       * Opening an existing directory requires just a shared fs-lock, while
+       * closing a handle requires no lock at all.
+       */
+      disable_preemption();
+      {
+         list_add_tail(&inode->handles_list, &h->node);
+      }
+      enable_preemption();
+
    } else {
 
       if (fl & O_TRUNC) {
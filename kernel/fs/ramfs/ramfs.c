@@ -6,20 +6,31 @@
 #include <tilck/common/utils.h>
 
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/pageframes.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fs/ramfs.h>
+#include <tilck/kernel/hashtable.h>
 #include <tilck/kernel/test/vfs.h>
 
 #include <sys/mman.h>      // system header
+#include <linux/falloc.h>  // system header
 
 #include "ramfs_int.h"
+
+static DEFINE_LOCK_CLASS(ramfs_fs_lock_class, "ramfs_fs");
+static DEFINE_LOCK_CLASS(ramfs_inode_lock_class, "ramfs_inode");
+
 #include "getdents.c.h"
-#include "locking.c.h"
 #include "dir_entries.c.h"
+#include "locking.c.h"
 #include "inodes.c.h"
 #include "stat.c.h"
 #include "blocks.c.h"
 #include "mmap.c.h"
 #include "rw_ops.c.h"
+#include "fallocate.c.h"
+#include "copy_range.c.h"
 #include "open.c.h"
 #include "mkdir.c.h"
 
@@ -70,7 +81,11 @@ static void ramfs_on_close(fs_handle h)
 
    if (i->type == VFS_DIR) {
       /* Remove this handle from h->inode->handles_list */
-      list_remove(&rh->node);
+      disable_preemption();
+      {
+         list_remove(&rh->node);
+      }
+      enable_preemption();
    }
 }
 
@@ -144,7 +159,11 @@ ramfs_get_entry(struct mnt_fs *fs,
       return;
    }
 
-   re = ramfs_dir_get_entry_by_name(idir, name, name_len);
+   rwlock_wp_shlock(&idir->rwlock);
+   {
+      re = ramfs_dir_get_entry_by_name(idir, name, name_len);
+   }
+   rwlock_wp_shunlock(&idir->rwlock);
 
    *fs_path = (struct fs_path) {
       .inode      = re ? re->inode : NULL,
@@ -337,6 +356,8 @@ static const struct fs_ops static_fsops_ramfs =
    .fs_exunlock = ramfs_exunlock,
    .fs_shlock = ramfs_shlock,
    .fs_shunlock = ramfs_shunlock,
+   .dir_exlock = ramfs_dir_exlock,
+   .dir_exunlock = ramfs_dir_exunlock,
 };
 
 struct mnt_fs *ramfs_create(void)
@@ -347,7 +368,10 @@ struct mnt_fs *ramfs_create(void)
    if (!(d = kzalloc_obj(struct ramfs_data)))
       return NULL;
 
-   fs = create_fs_obj("ramfs", &static_fsops_ramfs, d, VFS_FS_RW);
+   fs = create_fs_obj("ramfs",
+                      &static_fsops_ramfs,
+                      d,
+                      VFS_FS_RW | VFS_FS_DCACHE);
 
    if (!fs) {
       kfree_obj(d, struct ramfs_data);
@@ -355,6 +379,7 @@ struct mnt_fs *ramfs_create(void)
    }
 
    rwlock_wp_init(&d->rwlock, false);
+   rwlock_wp_set_lock_class(&d->rwlock, &ramfs_fs_lock_class);
    d->next_inode_num = 1;
    d->root = ramfs_create_inode_dir(d, 0777, NULL);
 
@@ -366,3 +391,50 @@ struct mnt_fs *ramfs_create(void)
    return fs;
 }
 
+
+/*
+ * Create a new file in `fs`, not linked to any directory, and open it with
+ * the flags `fl`. The file will be destroyed on its last close, like the files
+ * unlinked while they're still open. Used by memfd_create().
+ */
+int
+ramfs_create_anon_file(struct mnt_fs *fs, mode_t mode, int fl, fs_handle *out)
+{
+   struct ramfs_data *d = fs->device_data;
+   struct locked_file *lf = NULL;
+   struct fs_handle_base *hb;
+   struct ramfs_inode *i;
+   int rc;
+
+   ramfs_exlock(fs);
+
+   if (!(i = ramfs_create_inode_file(d, mode, d->root))) {
+      rc = -ENOSPC;
+      goto out;
+   }
+
+   if ((rc = acquire_subsys_flock(fs, i, SUBSYS_VFS, &lf))) {
+      ramfs_destroy_inode(d, i);
+      goto out;
+   }
+
+   if ((rc = ramfs_open_int(fs, i, out, fl))) {
+      release_subsys_flock(lf);
+      ramfs_destroy_inode(d, i);
+      goto out;
+   }
+
+   hb = *out;
+   hb->lf = lf;
+   hb->fl_flags = fl;
+
+   if (fl & O_CLOEXEC)
+      hb->fd_flags |= FD_CLOEXEC;
+
+   /* As in vfs_open(), the handle retains its FS */
+   retain_obj(fs);
+
+out:
+   ramfs_exunlock(fs);
+   return rc;
+}
@@ -20,38 +20,64 @@
 
 struct ramfs_inode;
 
+/*
+ * Pages shared by several blocks, of the same file or of different ones, after
+ * a copy_file_range() inside a ramfs instance. Shared pages are read-only:
+ * writing to a block having them gives it a private copy first. They're freed
+ * all together, when the last block referring to them goes away.
+ */
+struct ramfs_shared_pages {
+
+   REF_COUNTED_OBJECT;           /* number of blocks referring to them */
+   void *vaddr;
+   size_t pages;
+};
+
+/*
+ * Each block is an extent of `pages` contiguous pages, covering the file range
+ * [offset, offset + pages * PAGE_SIZE). Blocks never overlap. Files growing
+ * sequentially get bigger and bigger extents, up to RAMFS_MAX_EXTENT_PAGES.
+ */
 struct ramfs_block {
 
    struct bintree_node node;
    offt offset;                  /* MUST BE divisible by PAGE_SIZE */
+   size_t pages;
    void *vaddr;
+   struct ramfs_shared_pages *sh;   /* NULL when the pages are private */
 };
 
+#define RAMFS_MAX_EXTENT_PAGES                  16
+
 /*
- * Ramfs entries do not *necessarily* need to have a fixed size, as they are
- * allocated dynamically on the heap. Said that, a fixed-size entry struct is
- * simpler to manage and faster to alloc/free, in particular with Tilck's
- * current kmalloc implementation.
+ * Ramfs entries are sized to their name: they are allocated from a few object
+ * caches of different sizes (see ramfs_entry_caches), the biggest one
+ * being RAMFS_ENTRY_SIZE, which determines the max length of a name.
  */
-#define RAMFS_ENTRY_SIZE 256
-#define RAMFS_ENTRY_MAX_LEN (                   \
-   RAMFS_ENTRY_SIZE                             \
-   - sizeof(struct bintree_node)                \
-   - sizeof(struct list_node)                   \
-   - sizeof(struct ramfs_inode *)               \
-   - sizeof(u8)                                 \
-)
-
 struct ramfs_entry {
 
    struct bintree_node node;
    struct list_node lnode;
    struct ramfs_inode *inode;
+   u32 hash;                        /* hash of `name`, compared first */
    u8 name_len;                     /* NOTE: includes the final \0 */
-   char name[RAMFS_ENTRY_MAX_LEN];
+   char name[];
 };
 
-STATIC_ASSERT(sizeof(struct ramfs_entry) == RAMFS_ENTRY_SIZE);
+#define RAMFS_ENTRY_SIZE 256
+#define RAMFS_ENTRY_MAX_LEN \
+   (RAMFS_ENTRY_SIZE - OFFSET_OF(struct ramfs_entry, name))
+
+STATIC_ASSERT(RAMFS_ENTRY_MAX_LEN <= 255); /* it must fit in `name_len` */
+
+/*
+ * Directories start with all their entries in a single tree. Once they get
+ * RAMFS_DIR_HASH_MIN_ENTRIES entries, the entries get spread in a hash table
+ * of trees (`entries_buckets`), growing and shrinking with the directory.
+ * The trees are ordered by hash first, so name comparisons are rare anyway.
+ */
+#define RAMFS_DIR_HASH_MIN_ENTRIES             64
+#define RAMFS_DIR_HASH_MIN_BUCKETS             32
 
 struct ramfs_inode {
 
@@ -66,7 +92,7 @@ struct ramfs_inode {
    struct rwlock_wp rwlock;
    nlink_t nlink;
    mode_t mode;
-   size_t blocks_count;                /* count of page-size blocks */
+   size_t blocks_count;                /* count of pages in blocks */
    struct ramfs_inode *parent_dir;
    struct list mappings_list;          /* see ramfs_unmap_past_eof_mappings() */
 
@@ -81,7 +107,9 @@ struct ramfs_inode {
       /* valid when type == VFS_DIR */
       struct {
          offt num_entries;
-         struct ramfs_entry *entries_tree_root;
+         struct ramfs_entry *entries_tree_root;    /* without buckets */
+         struct ramfs_entry **entries_buckets;     /* hashed mode */
+         u32 buckets_count;                        /* power of 2 */
          struct list entries_list;
          struct list handles_list;
       };
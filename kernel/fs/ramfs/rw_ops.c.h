@@ -175,6 +175,8 @@ static void ramfs_unmap_past_eof_mappings(struct ramfs_inode *i, size_t len)
 
 static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
 {
+   const offt rlen = (offt)pow2_round_up_at((ulong)len, PAGE_SIZE);
+   struct ramfs_block *b;
    ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
 
    if (len < 0 || len >= i->fsize)
@@ -191,6 +193,13 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
     */
    ASSERT(i->type == VFS_FILE);
 
+   if (len < rlen && (b = ramfs_get_block(i, len, NULL)) && b->sh) {
+
+      /* We'll have to clear the last page past EOF: we need our own copy */
+      if (ramfs_unshare_block(i, b))
+         return -ENOMEM;
+   }
+
    disable_preemption();
    {
       ramfs_unmap_past_eof_mappings(i, (size_t) len);
@@ -199,10 +208,9 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
 
    while (true) {
 
-      struct ramfs_block *b =
-         bintree_get_last_obj(i->blocks_tree_root, struct ramfs_block, node);
+      b = bintree_get_last_obj(i->blocks_tree_root, struct ramfs_block, node);
 
-      if (!b || b->offset < len)
+      if (!b || b->offset < rlen)
          break;
 
       /* Remove the block object from the tree */
@@ -212,11 +220,32 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
                          node,
                          offset);
 
+      i->blocks_count -= b->pages;
       ramfs_destroy_block(b);
+
+      /* Truncating a big file frees a lot of blocks: we hold a sleeping lock */
+      cond_resched();
+   }
+
+   if (b && ramfs_block_end(b) > rlen) {
+
+      /* The last extent ends past the new EOF: free its extra pages */
+      const size_t keep = (size_t)(rlen - b->offset) >> PAGE_SHIFT;
+
+      i->blocks_count -= b->pages - keep;
+      ramfs_free_block_pages(b, keep);
+   }
+
+   if (b && len < rlen && ramfs_block_end(b) >= rlen) {
+
+      /*
+       * Clear what's left past EOF in the last page: the bytes past EOF must
+       * always be zero, in case the file gets extended again later.
+       */
+      bzero(b->vaddr + (len - b->offset), (size_t)(rlen - len));
    }
 
    i->fsize = len;
-   i->blocks_count = pow2_round_up_at((ulong) len, PAGE_SIZE);
    return 0;
 }
 
@@ -248,8 +277,55 @@ static int ramfs_truncate(struct mnt_fs *fs, vfs_inode_ptr_t i, offt len)
    return ramfs_inode_truncate_safe(i, len, false);
 }
 
+/*
+ * Copies `n` bytes from `src` to `dst` where, when `user` is true, one of the
+ * two is an user buffer: `dst` if `out` is true, otherwise `src`.
+ */
+static int
+ramfs_memcpy(void *dst, const void *src, size_t n, bool user, bool out)
+{
+   if (!user) {
+      fast_memcpy(dst, src, n);
+      return 0;
+   }
+
+   if (out)
+      return copy_to_user(dst, src, n) ? -EFAULT : 0;
+
+   return copy_from_user(dst, src, n) ? -EFAULT : 0;
+}
+
+static int ramfs_memzero(char *buf, size_t n, bool user)
+{
+   size_t chunk;
+
+   if (!user) {
+      memset(buf, 0, n);
+      return 0;
+   }
+
+   for (; n > 0; n -= chunk, buf += chunk) {
+
+      chunk = MIN(n, PAGE_SIZE);
+
+      if (copy_to_user(buf, zero_page, chunk))
+         return -EFAULT;
+   }
+
+   return 0;
+}
+
+/*
+ * Reads up to `len` bytes at `*pos` in `buf` which, when `user` is true, is
+ * an user buffer. In that case, if the buffer becomes invalid in the middle,
+ * the bytes copied so far are returned, or -EFAULT if there are none.
+ */
 static ssize_t
-ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
+ramfs_read_nolock(struct ramfs_handle *rh,
+                  char *buf,
+                  size_t len,
+                  offt *pos,
+                  bool user)
 {
    struct ramfs_inode *inode = rh->inode;
    offt tot_read = 0;
@@ -262,40 +338,53 @@ ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
 
    while (buf_rem > 0) {
 
-      struct ramfs_block *block;
-      const offt page     = *pos & (offt)PAGE_MASK;
-      const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
-      const offt page_rem = (offt)PAGE_SIZE - page_off;
+      struct ramfs_block *block, *next = NULL;
       const offt file_rem = inode->fsize - *pos;
-      const offt to_read  = MIN3(page_rem, buf_rem, file_rem);
+      offt to_read;
 
       if (*pos >= inode->fsize)
          break;
 
-      ASSERT(to_read >= 0);
+      block = ramfs_get_block(inode, *pos, &next);
 
-      if (!to_read)
-         break;
+      if (block) {
 
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+         /* reading a regular block: copy as much as possible at once */
+         const offt block_off = *pos - block->offset;
+         const offt block_rem = ramfs_block_end(block) - *pos;
+
+         to_read = MIN3(block_rem, buf_rem, file_rem);
+
+         if (ramfs_memcpy(buf + tot_read,
+                          block->vaddr + block_off,
+                          (size_t)to_read,
+                          user,
+                          true))
+         {
+            break;
+         }
 
-      if (block) {
-         /* reading a regular block */
-         memcpy(buf + tot_read, block->vaddr + page_off, (size_t)to_read);
       } else {
-         /* reading a hole */
-         memset(buf + tot_read, 0, (size_t)to_read);
+
+         /* reading a hole, up to the next block (if any) */
+         to_read = MIN(buf_rem, file_rem);
+
+         if (next)
+            to_read = MIN(to_read, next->offset - *pos);
+
+         if (ramfs_memzero(buf + tot_read, (size_t)to_read, user))
+            break;
       }
 
+      ASSERT(to_read > 0);
       tot_read += to_read;
       *pos  += to_read;
       buf_rem  -= to_read;
    }
 
+   if (buf_rem > 0 && !tot_read && *pos < inode->fsize)
+      return -EFAULT; /* We could not copy anything to the user buffer */
+
    return (ssize_t) tot_read;
 }
 
@@ -306,14 +395,89 @@ static ssize_t ramfs_read(fs_handle h, char *buf, size_t len, offt *pos)
 
    ramfs_file_shlock(h);
    {
-      ret = ramfs_read_nolock(rh, buf, len, pos);
+      ret = ramfs_read_nolock(rh, buf, len, pos, false);
    }
    ramfs_file_shunlock(h);
    return ret;
 }
 
+/*
+ * Feeds the ramfs blocks directly to the splice actor, without copying them
+ * in an intermediate buffer. Holes are fed using the zero page.
+ */
+static ssize_t
+ramfs_splice_read(fs_handle h,
+                  size_t len,
+                  offt *pos,
+                  func_splice_actor actor,
+                  void *arg)
+{
+   struct ramfs_handle *rh = h;
+   struct ramfs_inode *inode = rh->inode;
+   offt tot_read = 0;
+   offt rem = (offt)MIN(len, (size_t)OFFT_MAX);
+   ssize_t rc;
+
+   if (inode->type == VFS_DIR)
+      return -EISDIR;
+
+   ASSERT(inode->type == VFS_FILE);
+   ramfs_file_shlock(h);
+
+   while (rem > 0) {
+
+      struct ramfs_block *block;
+      const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
+      const offt file_rem = inode->fsize - *pos;
+      offt to_read;
+      void *data;
+
+      if (*pos >= inode->fsize)
+         break;
+
+      if ((block = ramfs_get_block(inode, *pos, NULL))) {
+
+         /* Feed the whole extent (or what we need of it) at once */
+         to_read = MIN3(ramfs_block_end(block) - *pos, rem, file_rem);
+         data = block->vaddr + (*pos - block->offset);
+
+      } else {
+
+         /* Holes are fed one page at a time, using the zero page */
+         to_read = MIN3((offt)PAGE_SIZE - page_off, rem, file_rem);
+         data = zero_page;
+      }
+
+      ASSERT(to_read > 0);
+      rc = actor(arg, data, (size_t)to_read);
+
+      if (rc < 0) {
+
+         if (!tot_read)
+            tot_read = rc;
+
+         break;
+      }
+
+      tot_read += rc;
+      *pos += rc;
+      rem -= rc;
+
+      if (rc < to_read)
+         break;
+   }
+
+   ramfs_file_shunlock(h);
+   return (ssize_t)tot_read;
+}
+
+/* Like ramfs_read_nolock(), `buf` is an user buffer when `user` is true */
 static ssize_t
-ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
+ramfs_write_nolock(struct ramfs_handle *rh,
+                   char *buf,
+                   size_t len,
+                   offt *pos,
+                   bool user)
 {
    struct ramfs_inode *inode = rh->inode;
    offt tot_written = 0;
@@ -328,31 +492,34 @@ ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len, offt *pos)
    while (buf_rem > 0) {
 
       struct ramfs_block *block;
-      const offt page     = *pos & (offt)PAGE_MASK;
-      const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
-      const offt page_rem = (offt)PAGE_SIZE - page_off;
-      const offt to_write = MIN(page_rem, buf_rem);
+      const offt page = *pos & (offt)PAGE_MASK;
+      offt block_off, to_write;
 
-      ASSERT(to_write > 0);
-
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+      if (!(block = ramfs_get_block(inode, *pos, NULL))) {
+         if (!(block = ramfs_alloc_block(inode, page, *pos + buf_rem)))
+            break;
+      }
 
-      /* Assert that if page_off > 0, the block is present */
-      ASSERT(!page_off || block);
+      if (block->sh && ramfs_unshare_block(inode, block))
+         break;
 
-      if (!block) {
+      /* Write as much as possible in this extent at once */
+      block_off = *pos - block->offset;
+      to_write = MIN(ramfs_block_end(block) - *pos, buf_rem);
+      ASSERT(to_write > 0);
 
-         if (!(block = ramfs_new_block(page)))
-            break;
+      if (ramfs_memcpy(block->vaddr + block_off,
+                       buf + tot_written,
+                       (size_t)to_write,
+                       user,
+                       false))
+      {
+         if (!tot_written)
+            return -EFAULT;
 
-         ramfs_append_new_block(inode, block);
+         break;
       }
 
-      memcpy(block->vaddr + page_off, buf + tot_written, (size_t)to_write);
       tot_written += to_write;
       buf_rem     -= to_write;
       *pos     += to_write;
@@ -374,33 +541,39 @@ static ssize_t ramfs_write(fs_handle h, char *buf, size_t len, offt *pos)
 
    ramfs_file_exlock(h);
    {
-      ret = ramfs_write_nolock(rh, buf, len, pos);
+      ret = ramfs_write_nolock(rh, buf, len, pos, false);
    }
    ramfs_file_exunlock(h);
    return ret;
 }
 
+/*
+ * The vectored read and write functions copy the data directly from/to the
+ * user buffers, holding the lock for the whole call: that makes them atomic
+ * with respect to other readv() and writev() calls on the same file.
+ */
 static ssize_t
 ramfs_readv_nolock(struct ramfs_handle *rh, const struct iovec *iov, int iovcnt)
 {
-   struct task *curr = get_curr_task();
    ssize_t ret = 0;
    ssize_t rc;
-   size_t len;
 
    for (int i = 0; i < iovcnt; i++) {
 
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
-      rc = ramfs_read_nolock(rh, curr->io_copybuf, len, &rh->h_fpos);
+      rc = ramfs_read_nolock(rh,
+                             iov[i].iov_base,
+                             iov[i].iov_len,
+                             &rh->h_fpos,
+                             true);
 
       if (rc < 0) {
-         ret = rc;
+
+         if (!ret)
+            ret = rc;
+
          break;
       }
 
-      if (copy_to_user(iov[i].iov_base, curr->io_copybuf, len))
-         return -EFAULT;
-
       ret += rc;
 
       if (rc < (ssize_t)iov[i].iov_len)
@@ -427,22 +600,22 @@ ramfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
 static ssize_t
 ramfs_writev_nolock(struct ramfs_handle *h, const struct iovec *iov, int iovcnt)
 {
-   struct task *curr = get_curr_task();
    ssize_t ret = 0;
    ssize_t rc;
-   size_t len;
 
    for (int i = 0; i < iovcnt; i++) {
 
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
+      rc = ramfs_write_nolock(h,
+                              iov[i].iov_base,
+                              iov[i].iov_len,
+                              &h->h_fpos,
+                              true);
 
-      if (copy_from_user(curr->io_copybuf, iov[i].iov_base, len))
-         return -EFAULT;
+      if (rc < 0) {
 
-      rc = ramfs_write_nolock(h, curr->io_copybuf, len, &h->h_fpos);
+         if (!ret)
+            ret = rc;
 
-      if (rc < 0) {
-         ret = rc;
          break;
       }
 
@@ -28,7 +28,7 @@ ramfs_stat_nolock(struct mnt_fs *fs,
 
       case VFS_DIR:
          statbuf->st_size = (typeof(statbuf->st_size))
-            (inode->num_entries * (offt) sizeof(struct ramfs_entry));
+            (inode->num_entries * (offt) RAMFS_ENTRY_SIZE);
          break;
 
       case VFS_SYMLINK:
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/shm.h>
+#include <tilck/kernel/fs/ramfs.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * Shared memory objects. A ramfs instance is mounted at /dev/shm, where
+ * libc's shm_open() creates its files, and it hosts also the anonymous files
+ * returned by memfd_create(). In both cases, the processes share the data by
+ * mapping the file with mmap(MAP_SHARED), which maps directly the ramfs
+ * blocks: no copies are involved.
+ */
+
+static struct mnt_fs *shm_fs;
+
+void init_shm(void)
+{
+   int rc;
+
+   if ((rc = devfs_create_mp_dir("shm")))
+      panic("devfs_create_mp_dir(\"shm\") failed with error: %d", rc);
+
+   if (!(shm_fs = ramfs_create()))
+      panic("Unable to create the ramfs for /dev/shm");
+
+   if ((rc = mp_add(shm_fs, "/dev/shm")))
+      panic("mp_add() failed with error: %d", rc);
+}
+
+/* Create an anonymous (not linked) file in /dev/shm's ramfs */
+int shm_create_memfd(int fl, fs_handle *out)
+{
+   ASSERT(shm_fs != NULL);
+   return ramfs_create_anon_file(shm_fs, 0777, O_RDWR | fl, out);
+}
@@ -2,6 +2,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/flock.h>
@@ -11,11 +12,15 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/epoll.h>
+#include <tilck/mods/tracing.h>
 
 #include <dirent.h> // system header
+#include <linux/falloc.h> // system header
 
 #include "../fs_int.h"
 #include "vfs_mp.c.h"
+#include "vfs_dcache.c.h"
 #include "vfs_locking.c.h"
 #include "vfs_resolve.c.h"
 #include "vfs_getdents.c.h"
@@ -36,9 +41,13 @@ void vfs_close(fs_handle h)
    struct locked_file *lf = hb->lf;
    const struct fs_ops *fsops = fs->fsops;
 
+   trace_point(tp_vfs_op, tp_vfs_close, h, 0);
+
    if (!pi->vforked)
       remove_all_mappings_of_handle(pi, h);
 
+   epoll_on_handle_close(h);
+
    if (fsops->on_close)
       fsops->on_close(h);
 
@@ -114,6 +123,7 @@ ssize_t vfs_read(fs_handle h, void *buf, size_t buf_size)
    ASSERT(h != NULL);
 
    struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
 
    if (!hb->fops->read)
       return -EBADF;
@@ -121,7 +131,76 @@ ssize_t vfs_read(fs_handle h, void *buf, size_t buf_size)
    if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
       return -EBADF; /* file not opened for reading */
 
-   return hb->fops->read(h, buf, buf_size, &hb->h_fpos);
+   rc = hb->fops->read(h, buf, buf_size, &hb->h_fpos);
+   trace_point(tp_vfs_op, tp_vfs_read, h, rc);
+   return rc;
+}
+
+struct user_read_ctx {
+   char *u_buf;
+   size_t done;
+};
+
+static ssize_t vfs_user_read_actor(void *arg, char *data, size_t len)
+{
+   struct user_read_ctx *ctx = arg;
+
+   if (copy_to_user(ctx->u_buf + ctx->done, data, len))
+      return -EFAULT;
+
+   ctx->done += len;
+   return (ssize_t)len;
+}
+
+static ssize_t
+vfs_read_user_int(struct fs_handle_base *hb, void *u_buf, size_t len, offt *pos)
+{
+   struct user_read_ctx ctx = { .u_buf = u_buf, .done = 0 };
+
+   ASSERT(hb->spec_flags & VFS_SPFL_USER_SPLICE_READ);
+   ASSERT(hb->fops->splice_read != NULL);
+
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
+   if (!len)
+      return 0;
+
+   return hb->fops->splice_read(hb, len, pos, &vfs_user_read_actor, &ctx);
+}
+
+/*
+ * Like vfs_read(), but `u_buf` is an user buffer and there's no need to bounce
+ * the data through the per-task io_copybuf, nor to limit `len` to its size:
+ * the file system feeds its blocks (or cached pages) with splice_read()
+ * directly to copy_to_user(), which is fault-safe. If the user buffer becomes
+ * invalid in the middle, the bytes copied so far are returned. Supported only
+ * by the handles having VFS_SPFL_USER_SPLICE_READ.
+ */
+ssize_t vfs_read_user(fs_handle h, void *u_buf, size_t len)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
+
+   rc = vfs_read_user_int(hb, u_buf, len, &hb->h_fpos);
+   trace_point(tp_vfs_op, tp_vfs_read, h, rc);
+   return rc;
+}
+
+ssize_t vfs_pread_user(fs_handle h, void *u_buf, size_t len, offt off)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
+
+   rc = vfs_read_user_int(hb, u_buf, len, &off);
+   trace_point(tp_vfs_op, tp_vfs_pread, h, rc);
+   return rc;
 }
 
 ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size)
@@ -130,6 +209,7 @@ ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size)
    ASSERT(h != NULL);
 
    struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
 
    if (!hb->fops->write)
       return -EBADF;
@@ -137,7 +217,9 @@ ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size)
    if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
       return -EBADF; /* file not opened for writing */
 
-   return hb->fops->write(h, buf, buf_size, &hb->h_fpos);
+   rc = hb->fops->write(h, buf, buf_size, &hb->h_fpos);
+   trace_point(tp_vfs_op, tp_vfs_write, h, rc);
+   return rc;
 }
 ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off)
 {
@@ -145,6 +227,7 @@ ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off)
    ASSERT(h != NULL);
 
    struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
 
    if (!hb->fops->read)
       return -EBADF;
@@ -152,7 +235,9 @@ ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off)
    if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
       return -EBADF; /* file not opened for reading */
 
-   return hb->fops->read(h, buf, buf_size, &off);
+   rc = hb->fops->read(h, buf, buf_size, &off);
+   trace_point(tp_vfs_op, tp_vfs_pread, h, rc);
+   return rc;
 }
 
 ssize_t vfs_pwrite(fs_handle h, void *buf, size_t buf_size, offt off)
@@ -161,6 +246,7 @@ ssize_t vfs_pwrite(fs_handle h, void *buf, size_t buf_size, offt off)
    ASSERT(h != NULL);
 
    struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
 
    if (!hb->fops->write)
       return -EBADF;
@@ -168,7 +254,9 @@ ssize_t vfs_pwrite(fs_handle h, void *buf, size_t buf_size, offt off)
    if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
       return -EBADF; /* file not opened for writing */
 
-   return hb->fops->write(h, buf, buf_size, &off);
+   rc = hb->fops->write(h, buf, buf_size, &off);
+   trace_point(tp_vfs_op, tp_vfs_pwrite, h, rc);
+   return rc;
 }
 
 offt vfs_seek(fs_handle h, offt off, int whence)
@@ -258,6 +346,37 @@ int vfs_fdatasync(fs_handle h)
    return rc;
 }
 
+/*
+ * Only preallocation (with or without FALLOC_FL_KEEP_SIZE) and hole punching
+ * are supported: the other modes are quite specific to disk file systems.
+ */
+int vfs_fallocate(fs_handle h, int mode, offt off, offt len)
+{
+   struct fs_handle_base *hb = h;
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   if (off < 0 || len <= 0)
+      return -EINVAL;
+
+   if (off > OFFT_MAX - len)
+      return -EFBIG;
+
+   if ((hb->fl_flags & O_ACCMODE) == O_RDONLY)
+      return -EBADF;
+
+   if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+      return -EOPNOTSUPP;
+
+   if ((mode & FALLOC_FL_PUNCH_HOLE) && !(mode & FALLOC_FL_KEEP_SIZE))
+      return -EOPNOTSUPP;
+
+   if (!hb->fops->fallocate)
+      return -EOPNOTSUPP;
+
+   return hb->fops->fallocate(h, mode, off, len);
+}
+
 /* ----------- path-based functions -------------- */
 
 typedef int (*vfs_func_impl)(struct mnt_fs *,
@@ -265,7 +384,8 @@ typedef int (*vfs_func_impl)(struct mnt_fs *,
                              ulong, ulong, ulong);
 
 static ALWAYS_INLINE int
-__vfs_path_funcs_wrapper(const char *path,
+__vfs_path_funcs_wrapper(const struct vfs_path *dir,
+                         const char *path,
                          bool exlock,
                          bool res_last_sl,
                          vfs_func_impl func,
@@ -276,7 +396,7 @@ __vfs_path_funcs_wrapper(const char *path,
 
    NO_TEST_ASSERT(is_preemption_enabled());
 
-   if ((rc = vfs_resolve(path, &p, exlock, res_last_sl)) < 0)
+   if ((rc = vfs_resolve_at(dir, path, &p, exlock, res_last_sl)) < 0)
       return rc;
 
    ASSERT(p.fs != NULL);
@@ -288,12 +408,71 @@ __vfs_path_funcs_wrapper(const char *path,
 }
 
 #define vfs_path_funcs_wrapper(path, exlock, rsl, func, a1, a2, a3)           \
-   __vfs_path_funcs_wrapper(path,                                             \
+   __vfs_path_funcs_wrapper(NULL,                                             \
+                            path,                                             \
                             exlock,                                           \
                             rsl,                                              \
                             (vfs_func_impl)(void *)func,                      \
                             (ulong)a1, (ulong)a2, (ulong)a3)
 
+/*
+ * Wrapper for open() and the ops creating new entries, which would normally
+ * require an exclusive fs-lock. On the file systems having per-directory locks
+ * (see the comment in vfs.h), it holds just a shared fs-lock plus, when
+ * `dirlock` is true, the exclusive lock of the directory where the last
+ * component is. Otherwise, it falls back to the exclusive fs-lock.
+ */
+static ALWAYS_INLINE int
+__vfs_path_funcs_wrapper_dl(const struct vfs_path *dir,
+                            const char *path,
+                            bool dirlock,
+                            bool res_last_sl,
+                            vfs_func_impl func,
+                            ulong a1, ulong a2, ulong a3)
+{
+   const struct fs_ops *fsops;
+   struct vfs_path p;
+   int rc;
+
+   NO_TEST_ASSERT(is_preemption_enabled());
+
+   if ((rc = vfs_resolve_at(dir, path, &p, false, res_last_sl)) < 0)
+      return rc;
+
+   ASSERT(p.fs != NULL);
+   fsops = p.fs->fsops;
+
+   if (!fsops->dir_exlock || (dirlock && fsops->dir_exlock(&p))) {
+
+      /*
+       * No per-directory locks or the last component changed before we could
+       * lock its directory: do everything again, with the exclusive fs-lock.
+       */
+      vfs_smart_fs_unlock(p.fs, false);
+      release_obj(p.fs);
+
+      return __vfs_path_funcs_wrapper(dir, path, true, res_last_sl,
+                                      func, a1, a2, a3);
+   }
+
+   rc = func(p.fs, &p, a1, a2, a3);
+
+   if (dirlock)
+      fsops->dir_exunlock(&p);
+
+   vfs_smart_fs_unlock(p.fs, false);
+   release_obj(p.fs);
+   return rc;
+}
+
+#define vfs_path_funcs_wrapper_dl(path, dirlock, rsl, func, a1, a2, a3)       \
+   __vfs_path_funcs_wrapper_dl(NULL,                                          \
+                               path,                                          \
+                               dirlock,                                       \
+                               rsl,                                           \
+                               (vfs_func_impl)(void *)func,                   \
+                               (ulong)a1, (ulong)a2, (ulong)a3)
+
 static ALWAYS_INLINE int
 vfs_open_impl(struct mnt_fs *fs, struct vfs_path *p,
               fs_handle *out, int flags, mode_t mode)
@@ -333,15 +512,70 @@ vfs_open_impl(struct mnt_fs *fs, struct vfs_path *p,
 
 int vfs_open(const char *path, fs_handle *out, int flags, mode_t mode)
 {
-   return vfs_path_funcs_wrapper(
+   int rc = vfs_path_funcs_wrapper_dl(
       path,
-      true,             /* exlock */
-      true,             /* res_last_sl */
+      !!(flags & O_CREAT), /* dirlock */
+      true,                /* res_last_sl */
       &vfs_open_impl,
       out,
       flags,
       mode
    );
+
+   trace_point(tp_vfs_op, tp_vfs_open, rc ? NULL : *out, rc);
+   return rc;
+}
+
+/*
+ * Like vfs_open(), but the relative paths start directly from the directory
+ * opened as `dirh`, without deriving its path.
+ */
+int vfs_openat(fs_handle dirh,
+               const char *path,
+               fs_handle *out,
+               int flags,
+               mode_t mode)
+{
+   struct fs_handle_base *hb = dirh;
+   struct k_stat64 st;
+   struct vfs_path dir;
+   vfs_inode_ptr_t inode;
+   int rc;
+
+   if (*path == '/')
+      return vfs_open(path, out, flags, mode);
+
+   if ((rc = vfs_fstat64(dirh, &st)))
+      return rc;
+
+   if ((st.st_mode & S_IFMT) != S_IFDIR)
+      return -ENOTDIR;
+
+   /*
+    * The handle retains both its FS and its inode. The dir itself is also the
+    * directory containing its "." entry: that's the `dir_inode` we need for
+    * paths like "." or "./".
+    */
+   inode = hb->fs->fsops->get_inode(dirh);
+   dir = (struct vfs_path) {
+      .fs = hb->fs,
+      .fs_path = {
+         .inode = inode,
+         .dir_inode = inode,
+         .dir_entry = NULL,
+         .type = VFS_DIR,
+      },
+   };
+
+   rc = __vfs_path_funcs_wrapper_dl(&dir,
+                                    path,
+                                    !!(flags & O_CREAT),  /* dirlock */
+                                    true,                 /* res_last_sl */
+                                    (vfs_func_impl)(void *)&vfs_open_impl,
+                                    (ulong)out, (ulong)flags, (ulong)mode);
+
+   trace_point(tp_vfs_op, tp_vfs_open, rc ? NULL : *out, rc);
+   return rc;
 }
 
 static ALWAYS_INLINE int
@@ -390,9 +624,9 @@ vfs_mkdir_impl(struct mnt_fs *fs,
 
 int vfs_mkdir(const char *path, mode_t mode)
 {
-   return vfs_path_funcs_wrapper(
+   return vfs_path_funcs_wrapper_dl(
       path,
-      true,             /* exlock */
+      true,             /* dirlock */
       false,            /* res_last_sl */
       vfs_mkdir_impl,
       mode,
@@ -520,9 +754,9 @@ vfs_symlink_impl(struct mnt_fs *fs,
 
 int vfs_symlink(const char *target, const char *linkpath)
 {
-   return vfs_path_funcs_wrapper(
+   return vfs_path_funcs_wrapper_dl(
       linkpath,
-      true,             /* exlock */
+      true,             /* dirlock */
       false,            /* res_last_sl */
       vfs_symlink_impl,
       target,
@@ -766,6 +1000,9 @@ int vfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
       return -ENODEV;
 
    ASSERT(fops->munmap != NULL);
+
+   ASSERT(!(flags & VFS_MM_PRIVATE) || (flags & VFS_MM_DONT_REGISTER));
+
    return fops->mmap(um, pdir, flags);
 }
 
@@ -792,6 +1029,23 @@ bool vfs_handle_fault(struct user_mapping *um, void *va, bool p, bool rw)
    return fops->handle_fault(um, va, p, rw);
 }
 
+/*
+ * Drop the pages of `um` in [va, va + len), as in madvise(MADV_DONTNEED).
+ * That's possible only for the file-systems handling page faults, since the
+ * next access will have to map the pages again. For the others (e.g. the
+ * devices mapping their memory at mmap() time), it's a no-op.
+ */
+int vfs_mm_drop_pages(struct user_mapping *um, void *va, size_t len)
+{
+   struct fs_handle_base *hb = um->h;
+   const struct file_ops *fops = hb->fops;
+
+   if (!fops->handle_fault)
+      return 0;
+
+   return vfs_munmap(um, va, len);
+}
+
 int vfs_futimens(fs_handle h, const struct k_timespec64 times[2])
 {
    struct fs_handle_base *hb = h;
@@ -811,6 +1065,9 @@ ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
    ssize_t rc;
    size_t len;
 
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
    if (hb->fops->readv)
       return hb->fops->readv(h, iov, iovcnt);
 
@@ -857,6 +1114,9 @@ ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
    ssize_t rc;
    size_t len;
 
+   if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* file not opened for writing */
+
    if (hb->fops->writev)
       return hb->fops->writev(h, iov, iovcnt);
 
@@ -898,6 +1158,208 @@ ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
    return ret;
 }
 
+struct splice_ctx {
+   fs_handle out;
+   offt *out_pos;
+};
+
+static ssize_t vfs_splice_write_actor(void *arg, char *buf, size_t len)
+{
+   struct splice_ctx *ctx = arg;
+   struct fs_handle_base *hb = ctx->out;
+   return hb->fops->write(ctx->out, buf, len, ctx->out_pos);
+}
+
+static ssize_t
+vfs_splice_bounce(fs_handle in, offt *in_pos, struct splice_ctx *ctx, size_t len)
+{
+   struct fs_handle_base *hb = in;
+   struct task *curr = get_curr_task();
+   ssize_t tot = 0;
+   ssize_t rc, n;
+
+   while ((size_t)tot < len) {
+
+      /* Don't block on streams (e.g. pipes) after having moved some data */
+      if (tot > 0 && !vfs_read_ready(in))
+         break;
+
+      n = hb->fops->read(in, curr->io_copybuf,
+                         MIN(len - (size_t)tot, IO_COPYBUF_SIZE), in_pos);
+
+      if (n <= 0) {
+
+         if (!tot)
+            tot = n;
+
+         break;
+      }
+
+      rc = vfs_splice_write_actor(ctx, curr->io_copybuf, (size_t)n);
+
+      if (rc < n) {
+
+         /* Seekable files can give back the data we couldn't write */
+         if (hb->fops->seek)
+            *in_pos -= n - MAX(rc, 0);
+
+         if (rc < 0) {
+
+            if (!tot)
+               tot = rc;
+
+            break;
+         }
+
+         tot += rc;
+         break;
+      }
+
+      tot += rc;
+   }
+
+   return tot;
+}
+
+/*
+ * Moves up to `len` bytes from `in` to `out`, without passing through the
+ * user space. When the source file system supports splice_read(), its data is
+ * passed directly to the destination's write() function.
+ */
+static int vfs_splice_check_handles(fs_handle in, fs_handle out)
+{
+   struct fs_handle_base *in_hb = in;
+   struct fs_handle_base *out_hb = out;
+   const struct fs_ops *in_fsops = in_hb->fs->fsops;
+   const struct fs_ops *out_fsops = out_hb->fs->fsops;
+
+   if (!in_hb->fops->read)
+      return -EBADF;
+
+   if ((in_hb->fl_flags & O_WRONLY) && !(in_hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
+   if (!out_hb->fops->write)
+      return -EBADF;
+
+   if (!(out_hb->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* file not opened for writing */
+
+   if (in_hb->fs == out_hb->fs &&
+       in_fsops->get_inode(in) == out_fsops->get_inode(out))
+   {
+      return -EINVAL;
+   }
+
+   return 0;
+}
+
+ssize_t
+vfs_splice(fs_handle in, offt *in_pos,
+           fs_handle out, offt *out_pos, size_t len)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+
+   struct fs_handle_base *in_hb = in;
+   struct fs_handle_base *out_hb = out;
+   struct splice_ctx ctx = { .out = out, .out_pos = out_pos };
+   int rc;
+
+   if ((rc = vfs_splice_check_handles(in, out)))
+      return rc;
+
+   if (!len)
+      return 0;
+
+   /*
+    * The source's splice_read() calls the destination's write() while holding
+    * the source's lock. That's safe only when the destination belongs to
+    * a different file system: otherwise, two tasks splicing in opposite
+    * directions between the same two files could deadlock.
+    */
+   if (in_hb->fops->splice_read && in_hb->fs != out_hb->fs) {
+      return in_hb->fops->splice_read(in, len, in_pos,
+                                      &vfs_splice_write_actor, &ctx);
+   }
+
+   return vfs_splice_bounce(in, in_pos, &ctx, len);
+}
+
+/*
+ * Copies up to `len` bytes between two regular files. When both belong to the
+ * same file system supporting copy_range() and the two positions have the same
+ * offset in the page, the first bytes up to a page boundary are copied with
+ * vfs_splice(), then copy_range() shares whatever it can (e.g. ramfs blocks).
+ * Anything left gets copied with vfs_splice().
+ */
+ssize_t
+vfs_copy_file_range(fs_handle in, offt *in_pos,
+                    fs_handle out, offt *out_pos, size_t len)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+
+   struct fs_handle_base *in_hb = in;
+   struct fs_handle_base *out_hb = out;
+   struct k_stat64 st;
+   ssize_t tot = 0, rc;
+   size_t head;
+
+   if ((rc = vfs_splice_check_handles(in, out)))
+      return rc;
+
+   if (out_hb->fl_flags & O_APPEND)
+      return -EBADF;
+
+   if ((rc = vfs_fstat64(in, &st)))
+      return rc;
+
+   if (!S_ISREG(st.st_mode))
+      return S_ISDIR(st.st_mode) ? -EISDIR : -EINVAL;
+
+   if ((rc = vfs_fstat64(out, &st)))
+      return rc;
+
+   if (!S_ISREG(st.st_mode))
+      return S_ISDIR(st.st_mode) ? -EISDIR : -EINVAL;
+
+   if (in_hb->fs == out_hb->fs &&
+       in_hb->fops->copy_range &&
+       !((*in_pos - *out_pos) & (offt)OFFSET_IN_PAGE_MASK))
+   {
+      head = PAGE_SIZE - ((size_t)*in_pos & OFFSET_IN_PAGE_MASK);
+      head = MIN(head & OFFSET_IN_PAGE_MASK, len);
+
+      if (head) {
+
+         rc = vfs_splice(in, in_pos, out, out_pos, head);
+
+         if (rc < (ssize_t)head)
+            return rc;
+
+         tot = rc;
+      }
+
+      rc = in_hb->fops->copy_range(in, in_pos, out, out_pos, len - (size_t)tot);
+
+      if (rc < 0)
+         return tot ? tot : rc;
+
+      tot += rc;
+   }
+
+   if ((size_t)tot < len) {
+
+      rc = vfs_splice(in, in_pos, out, out_pos, len - (size_t)tot);
+
+      if (rc < 0)
+         return tot ? tot : rc;
+
+      tot += rc;
+   }
+
+   return tot;
+}
+
 u32 vfs_get_new_device_id(void)
 {
    return next_device_id++;
@@ -927,6 +1389,7 @@ create_fs_obj(const char *type,
 void destory_fs_obj(struct mnt_fs *fs)
 {
    ASSERT(!fs->pss_lock_root);
+   vfs_dcache_invalidate_fs(fs);
    kfree_obj(fs, struct mnt_fs);
 }
 
@@ -994,6 +1457,15 @@ panic_handles[PANIC_HANDLES][MAX_FS_HANDLE_SIZE] ALIGNED_AT(MAX_FS_HANDLE_SIZE);
 static bool
 panic_handles_used[PANIC_HANDLES];
 
+/*
+ * Handles are allocated and freed at a high rate by open/close-heavy workloads:
+ * keep them in a pool, starting with a whole slab of them.
+ */
+static struct kmalloc_cache fs_handle_cache =
+   KMALLOC_POOL_INIT("fs_handle",
+                     MAX_FS_HANDLE_SIZE,
+                     KMALLOC_CACHE_SLAB_SIZE / MAX_FS_HANDLE_SIZE);
+
 fs_handle vfs_alloc_handle_raw(void)
 {
    if (UNLIKELY(in_panic())) {
@@ -1008,7 +1480,7 @@ fs_handle vfs_alloc_handle_raw(void)
       return NULL;
    }
 
-   return kmalloc(MAX_FS_HANDLE_SIZE);
+   return kmalloc_cache_alloc(&fs_handle_cache);
 }
 
 void vfs_free_handle(fs_handle h)
@@ -1025,7 +1497,7 @@ void vfs_free_handle(fs_handle h)
       return;
    }
 
-   kfree2(h, MAX_FS_HANDLE_SIZE);
+   kmalloc_cache_free(&fs_handle_cache, h);
 }
 
 fs_handle vfs_alloc_handle(void)
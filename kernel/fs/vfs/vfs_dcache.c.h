@@ -0,0 +1,281 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * A small dentry cache in front of fsops->get_entry(), used by vfs_resolve()
+ * for the file systems having the VFS_FS_DCACHE flag. Both positive and
+ * negative (no such entry) results are cached.
+ *
+ * Entries are keyed by (device_id, directory inode, name): the device_id is
+ * used instead of the struct mnt_fs pointer because it's never re-used. The
+ * file systems using the cache are responsible for invalidating the entries
+ * when a directory changes (see vfs_dcache_invalidate()).
+ *
+ * The cache is a fixed pool of entries, hashed in buckets and evicted in LRU
+ * order. All the operations run with preemption disabled.
+ */
+
+#define VFS_DCACHE_ENTRIES                     256
+#define VFS_DCACHE_BUCKETS                      64
+#define VFS_DCACHE_NAME_MAX                     32
+
+struct vfs_dentry {
+
+   struct list_node bucket_node;
+   struct list_node lru_node;
+
+   u32 device_id;
+   u32 hash;
+   vfs_inode_ptr_t idir;
+   struct fs_path fs_path;
+
+   u8 name_len;
+   char name[VFS_DCACHE_NAME_MAX];
+};
+
+struct vfs_dcache_stats vfs_dcache_stats;
+
+static struct vfs_dentry dcache_entries[VFS_DCACHE_ENTRIES];
+static struct list dcache_buckets[VFS_DCACHE_BUCKETS];
+static struct list dcache_lru;        /* head = most recently used */
+static struct list dcache_free_list;
+static bool dcache_initialized;
+static u32 dcache_gen;                /* incremented on each invalidation */
+
+static void vfs_dcache_init(void)
+{
+   ASSERT(!is_preemption_enabled());
+
+   list_init(&dcache_lru);
+   list_init(&dcache_free_list);
+
+   for (int i = 0; i < VFS_DCACHE_BUCKETS; i++)
+      list_init(&dcache_buckets[i]);
+
+   for (int i = 0; i < VFS_DCACHE_ENTRIES; i++) {
+      list_node_init(&dcache_entries[i].bucket_node);
+      list_node_init(&dcache_entries[i].lru_node);
+      list_add_tail(&dcache_free_list, &dcache_entries[i].lru_node);
+   }
+
+   dcache_initialized = true;
+}
+
+/*
+ * NOTE: the device_id is not part of the hash, in order to allow the
+ * invalidation by (idir, name) to look just at one bucket.
+ */
+static u32
+vfs_dcache_hash(vfs_inode_ptr_t idir, const char *n, size_t len)
+{
+   /* FNV-1a */
+   u32 h = 2166136261u ^ (u32)((ulong)idir >> 4);
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)n[i];
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+static struct vfs_dentry *
+vfs_dcache_lookup(u32 device_id,
+                  vfs_inode_ptr_t idir,
+                  const char *name,
+                  size_t len,
+                  u32 hash)
+{
+   struct list *b = &dcache_buckets[hash % VFS_DCACHE_BUCKETS];
+   struct vfs_dentry *pos;
+
+   list_for_each_ro(pos, b, bucket_node) {
+
+      if (pos->hash != hash || pos->idir != idir)
+         continue;
+
+      if (pos->device_id != device_id || pos->name_len != len)
+         continue;
+
+      if (!memcmp(pos->name, name, len))
+         return pos;
+   }
+
+   return NULL;
+}
+
+static void vfs_dcache_drop(struct vfs_dentry *e)
+{
+   list_remove(&e->bucket_node);
+   list_remove(&e->lru_node);
+   list_add_tail(&dcache_free_list, &e->lru_node);
+   vfs_dcache_stats.entries--;
+}
+
+static void
+vfs_dcache_insert(u32 device_id,
+                  vfs_inode_ptr_t idir,
+                  const char *name,
+                  size_t len,
+                  u32 hash,
+                  struct fs_path *fs_path)
+{
+   struct vfs_dentry *e;
+
+   if (list_is_empty(&dcache_free_list)) {
+
+      /* Evict the least recently used entry */
+      e = list_last_obj(&dcache_lru, struct vfs_dentry, lru_node);
+      vfs_dcache_drop(e);
+      vfs_dcache_stats.evictions++;
+   }
+
+   e = list_first_obj(&dcache_free_list, struct vfs_dentry, lru_node);
+   list_remove(&e->lru_node);
+
+   e->device_id = device_id;
+   e->hash = hash;
+   e->idir = idir;
+   e->fs_path = *fs_path;
+   e->name_len = (u8)len;
+   memcpy(e->name, name, len);
+
+   list_add_tail(&dcache_buckets[hash % VFS_DCACHE_BUCKETS], &e->bucket_node);
+   list_add_head(&dcache_lru, &e->lru_node);
+   vfs_dcache_stats.entries++;
+}
+
+/*
+ * Like vfs_get_entry(), but using the dentry cache when the FS supports it.
+ * The caller must hold (at least) a shared lock on `fs`.
+ */
+static void
+vfs_dcache_get_entry(struct mnt_fs *fs,
+                     vfs_inode_ptr_t idir,
+                     const char *name,
+                     ssize_t name_len,
+                     struct fs_path *fs_path)
+{
+   const size_t len = (size_t)name_len;
+   struct vfs_dentry *e;
+   u32 hash, gen;
+
+   if (!(fs->flags & VFS_FS_DCACHE) || len > VFS_DCACHE_NAME_MAX) {
+      vfs_get_entry(fs, idir, name, name_len, fs_path);
+      return;
+   }
+
+   hash = vfs_dcache_hash(idir, name, len);
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!dcache_initialized))
+         vfs_dcache_init();
+
+      e = vfs_dcache_lookup(fs->device_id, idir, name, len, hash);
+      gen = dcache_gen;
+
+      if (e) {
+
+         *fs_path = e->fs_path;
+
+         /* Move the entry at the head of the LRU list */
+         list_remove(&e->lru_node);
+         list_add_head(&dcache_lru, &e->lru_node);
+
+         if (fs_path->inode)
+            vfs_dcache_stats.hits++;
+         else
+            vfs_dcache_stats.neg_hits++;
+      }
+   }
+   enable_preemption();
+
+   if (e)
+      return;
+
+   /*
+    * Cache miss: call the FS. Entries cannot be removed concurrently because
+    * that requires an exclusive lock on `fs`, but they can be created when the
+    * FS has per-directory locks (see vfs.h). In that case, our result might be
+    * already stale: just don't cache it if anything got invalidated meanwhile.
+    */
+   vfs_get_entry(fs, idir, name, name_len, fs_path);
+
+   disable_preemption();
+   {
+      vfs_dcache_stats.misses++;
+
+      if (gen == dcache_gen &&
+          !vfs_dcache_lookup(fs->device_id, idir, name, len, hash))
+      {
+         vfs_dcache_insert(fs->device_id, idir, name, len, hash, fs_path);
+      }
+   }
+   enable_preemption();
+}
+
+void vfs_dcache_invalidate(vfs_inode_ptr_t idir, const char *name, size_t len)
+{
+   struct vfs_dentry *pos, *temp;
+   struct list *b;
+   u32 hash;
+
+   if (name && len > VFS_DCACHE_NAME_MAX)
+      return; /* Such long names are never cached */
+
+   disable_preemption();
+   dcache_gen++;
+
+   if (!dcache_initialized)
+      goto out;
+
+   if (name) {
+
+      /*
+       * We don't know the device_id here, but that's not a problem: inodes
+       * are unique objects in memory, across all the file systems.
+       */
+      hash = vfs_dcache_hash(idir, name, len);
+      b = &dcache_buckets[hash % VFS_DCACHE_BUCKETS];
+
+      list_for_each(pos, temp, b, bucket_node) {
+
+         if (pos->idir != idir || pos->name_len != len)
+            continue;
+
+         if (!memcmp(pos->name, name, len)) {
+            vfs_dcache_drop(pos);
+            vfs_dcache_stats.invalidations++;
+         }
+      }
+
+   } else {
+
+      /* Drop all the entries of the directory `idir` */
+      list_for_each(pos, temp, &dcache_lru, lru_node) {
+         if (pos->idir == idir) {
+            vfs_dcache_drop(pos);
+            vfs_dcache_stats.invalidations++;
+         }
+      }
+   }
+
+out:
+   enable_preemption();
+}
+
+void vfs_dcache_invalidate_fs(struct mnt_fs *fs)
+{
+   struct vfs_dentry *pos, *temp;
+
+   disable_preemption();
+   {
+      if (dcache_initialized) {
+         list_for_each(pos, temp, &dcache_lru, lru_node) {
+            if (pos->device_id == fs->device_id)
+               vfs_dcache_drop(pos);
+         }
+      }
+   }
+   enable_preemption();
+}
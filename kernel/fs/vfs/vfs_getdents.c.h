@@ -3,12 +3,10 @@
 struct vfs_getdents_ctx {
 
    struct fs_handle_base *h;
-   struct linux_dirent64 *user_dirp;
+   char *buf;                    /* kernel buffer: copied to user at the end */
    u32 buf_size;
    u32 offset;
-   u32 fs_flags;
    offt off;
-   struct linux_dirent64 ent;
 };
 
 static inline unsigned char
@@ -31,30 +29,12 @@ vfs_type_to_linux_dirent_type(enum vfs_entry_type t)
 
 static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
 {
-   const u16 entry_size = sizeof(struct linux_dirent64) + vde->name_len;
-   struct linux_dirent64 *user_ent;
+   /* Like Linux, keep the entries aligned: they contain 64-bit fields */
+   const u16 entry_size = (u16)pow2_round_up_at(
+      sizeof(struct linux_dirent64) + vde->name_len, sizeof(u64)
+   );
    struct vfs_getdents_ctx *ctx = arg;
-   char *user_ent_dname;
-
-   if (ctx->fs_flags & VFS_FS_RQ_DE_SKIP) {
-
-      /*
-       * Pseudo-hack used fortunately *only* by the FAT32 struct mnt_fs: it
-       * implements here in the VFS layer a trivial mechanism to skip the first
-       * `pos` entries of a directory in case the struct mnt_fs does not have a
-       * way to just "save" the current position and resume from there in each
-       * call of the mnt_fs-op getdents().
-       *
-       * TODO: implement in FAT32 a way to walk a directory step-by-step,
-       * instead of having to walk all the entries every time and skipping the
-       * already "returned" entries. This way we could drop VFS_FS_RQ_DE_SKIP.
-       */
-
-      if (ctx->off < ctx->h->dir_pos) {
-         ctx->off++;
-         return 0; /* skip the dentry */
-      }
-   }
+   struct linux_dirent64 *ent;
 
    if (ctx->offset + entry_size > ctx->buf_size) {
 
@@ -72,19 +52,13 @@ static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
       return (int) ctx->offset;
    }
 
-   ctx->ent.d_ino    = vde->ino;
-   ctx->ent.d_off    = (u64) ctx->off + 1; /* "offset" (=ID) of the next dent */
-   ctx->ent.d_reclen = entry_size;
-   ctx->ent.d_type   = vfs_type_to_linux_dirent_type(vde->type);
-
-   user_ent = (void *)((char *)ctx->user_dirp + ctx->offset);
-   user_ent_dname = (char *)user_ent + OFFSET_OF(struct linux_dirent64, d_name);
-
-   if (copy_to_user(user_ent, &ctx->ent, sizeof(ctx->ent)) < 0)
-      return -EFAULT;
-
-   if (copy_to_user(user_ent_dname, vde->name, vde->name_len) < 0)
-      return -EFAULT;
+   ent = (void *)(ctx->buf + ctx->offset);
+   bzero(ent, entry_size);      /* don't leak the buffer's old content */
+   ent->d_ino    = vde->ino;
+   ent->d_off    = (u64) ctx->off + 1; /* "offset" (=ID) of the next dent */
+   ent->d_reclen = entry_size;
+   ent->d_type   = vfs_type_to_linux_dirent_type(vde->type);
+   memcpy(ent->d_name, vde->name, vde->name_len);
 
    ctx->offset += entry_size;
    ctx->off++;
@@ -92,6 +66,11 @@ static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
    return 0;
 }
 
+/*
+ * The entries are staged in the task's `io_copybuf` and copied to user space
+ * all at once. Returning less entries than the user buffer could contain is
+ * fine, exactly as for read().
+ */
 int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
 {
    NO_TEST_ASSERT(is_preemption_enabled());
@@ -103,12 +82,10 @@ int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
 
    struct vfs_getdents_ctx ctx = {
       .h             = hb,
-      .user_dirp     = user_dirp,
-      .buf_size      = buf_size,
+      .buf           = get_curr_task()->io_copybuf,
+      .buf_size      = MIN(buf_size, (u32)IO_COPYBUF_SIZE),
       .offset        = 0,
-      .fs_flags      = hb->fs->flags,
-      .off           = hb->fs->flags & VFS_FS_RQ_DE_SKIP ? 0 : ctx.h->dir_pos,
-      .ent           = { 0 },
+      .off           = hb->dir_pos,
    };
 
    /* See the comment in vfs.h about the "fs-locks" */
@@ -120,5 +97,9 @@ int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
          rc = (int) ctx.offset;
    }
    vfs_fs_shunlock(hb->fs);
+
+   if (rc > 0 && copy_to_user(user_dirp, ctx.buf, (size_t)rc))
+      return -EFAULT;
+
    return rc;
 }
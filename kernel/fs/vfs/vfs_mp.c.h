@@ -4,6 +4,40 @@ static struct kmutex mp_mutex = STATIC_KMUTEX_INIT(mp_mutex, 0);
 static struct mountpoint mps2[MAX_MOUNTPOINTS];
 static struct mnt_fs *mp_root;
 
+/*
+ * The entries in `mps2`, hashed by host inode. It's modified holding both the
+ * `mp_mutex` and having the preemption disabled, so the lookups can be done
+ * either way. Together with the `hosted_mps` and `mp` fields in struct mnt_fs,
+ * that allows vfs_resolve() to never take the mutex nor scan `mps2`.
+ */
+static struct htable mp_table;
+
+struct mp_key {
+   struct mnt_fs *host_fs;
+   vfs_inode_ptr_t inode;
+};
+
+static bool mp_match(struct htable_node *n, const void *key)
+{
+   const struct mountpoint *mp = CONTAINER_OF(n, struct mountpoint, hnode);
+   const struct mp_key *k = key;
+
+   return mp->host_fs_inode == k->inode && mp->host_fs == k->host_fs;
+}
+
+static struct mountpoint *
+mp_lookup(struct mnt_fs *host_fs, vfs_inode_ptr_t inode)
+{
+   const struct mp_key k = { host_fs, inode };
+
+   return htable_find_obj(&mp_table,
+                          hash_ulong((ulong)inode),
+                          mp_match,
+                          &k,
+                          struct mountpoint,
+                          hnode);
+}
+
 int mp_init(struct mnt_fs *root_fs)
 {
    /* do not support changing the root struct mnt_fs */
@@ -11,6 +45,7 @@ int mp_init(struct mnt_fs *root_fs)
 
 #ifdef UNIT_TEST_ENVIRONMENT
    bzero(mps2, sizeof(mps2));
+   htable_init(&mp_table);
 #endif
 
    mp_root = root_fs;
@@ -26,44 +61,42 @@ struct mnt_fs *mp_get_root(void)
 
 struct mnt_fs *mp_get_at_nolock(struct mnt_fs *host_fs, vfs_inode_ptr_t inode)
 {
+   struct mountpoint *mp;
    ASSERT(kmutex_is_curr_task_holding_lock(&mp_mutex));
 
-   for (int i = 0; i < ARRAY_SIZE(mps2); i++)
-      if (mps2[i].host_fs_inode == inode && mps2[i].host_fs == host_fs)
-         return mps2[i].target_fs;
-
-   return NULL;
+   mp = mp_lookup(host_fs, inode);
+   return mp ? mp->target_fs : NULL;
 }
 
 struct mnt_fs *mp_get_retained_at(struct mnt_fs *host_fs, vfs_inode_ptr_t inode)
 {
-   struct mnt_fs *ret;
-   kmutex_lock(&mp_mutex);
+   struct mountpoint *mp;
+   struct mnt_fs *ret = NULL;
+
+   if (!host_fs->hosted_mps)
+      return NULL; /* Common case: nothing is mounted on this FS */
+
+   disable_preemption();
    {
-      if ((ret = mp_get_at_nolock(host_fs, inode)))
+      if ((mp = mp_lookup(host_fs, inode))) {
+         ret = mp->target_fs;
          retain_obj(ret);
+      }
    }
-   kmutex_unlock(&mp_mutex);
+   enable_preemption();
    return ret;
 }
 
 struct mountpoint *mp_get_retained_mp_of(struct mnt_fs *target_fs)
 {
-   int i;
-   struct mountpoint *res = NULL;
+   struct mountpoint *res;
 
-   kmutex_lock(&mp_mutex);
+   disable_preemption();
    {
-      for (i = 0; i < ARRAY_SIZE(mps2); i++)
-         if (mps2[i].target_fs == target_fs)
-            break;
-
-      if (i < ARRAY_SIZE(mps2)) {
-         res = &mps2[i];
+      if ((res = target_fs->mp))
          retain_obj(res);
-      }
    }
-   kmutex_unlock(&mp_mutex);
+   enable_preemption();
    return res;
 }
 
@@ -128,6 +161,19 @@ int mp_add(struct mnt_fs *target_fs, const char *target_path)
          .target_fs = target_fs,
       };
 
+      htable_node_init(&mps2[i].hnode);
+
+      disable_preemption();
+      {
+         htable_add(&mp_table,
+                    &mps2[i].hnode,
+                    hash_ulong((ulong)p.fs_path.inode));
+
+         p.fs->hosted_mps++;
+         target_fs->mp = &mps2[i];
+      }
+      enable_preemption();
+
       rc = 0;
 
       /* Now that we've succeeded, we must retain the target_fs as well */
@@ -68,7 +68,7 @@ __vfs_resolve_get_entry(vfs_inode_ptr_t idir,
                         struct vfs_path *rp,
                         bool exlock)
 {
-   vfs_get_entry(rp->fs, idir, pc, path - pc, &rp->fs_path);
+   vfs_dcache_get_entry(rp->fs, idir, pc, path - pc, &rp->fs_path);
    rp->last_comp = pc;
 
    struct mnt_fs *target_fs = mp_get_retained_at(rp->fs, rp->fs_path.inode);
@@ -356,6 +356,19 @@ get_locked_retained_cwd(struct vfs_path *rp, bool exlock)
    vfs_smart_fs_lock(rp->fs, exlock);
 }
 
+static void
+get_locked_retained_dir(const struct vfs_path *dir,
+                        struct vfs_path *rp,
+                        bool exlock)
+{
+   ASSERT(dir->fs != NULL);
+   ASSERT(dir->fs_path.type == VFS_DIR);
+
+   *rp = *dir;
+   retain_obj(rp->fs);
+   vfs_smart_fs_lock(rp->fs, exlock);
+}
+
 /*
  * Resolves the path, locking the last struct mnt_fs with an exclusive or a
  * shared lock depending on `exlock`. The last component of the path, if a
@@ -367,10 +380,11 @@ get_locked_retained_cwd(struct vfs_path *rp, bool exlock)
  * to release the FS with release_obj().
  */
 int
-vfs_resolve(const char *path,
-            struct vfs_path *rp,
-            bool exlock,
-            bool res_last_sl)
+vfs_resolve_at(const struct vfs_path *dir,
+               const char *path,
+               struct vfs_path *rp,
+               bool exlock,
+               bool res_last_sl)
 {
    int rc;
 
@@ -394,6 +408,8 @@ vfs_resolve(const char *path,
 
    if (*path == '/')
       get_locked_retained_root(rp, exlock);
+   else if (dir)
+      get_locked_retained_dir(dir, rp, exlock);
    else
       get_locked_retained_cwd(rp, exlock);
 
@@ -432,3 +448,12 @@ vfs_resolve(const char *path,
 
    return rc;
 }
+
+int
+vfs_resolve(const char *path,
+            struct vfs_path *rp,
+            bool exlock,
+            bool res_last_sl)
+{
+   return vfs_resolve_at(NULL, path, rp, exlock, res_last_sl);
+}
@@ -0,0 +1,447 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/fs/vfs.h>
+
+#include <linux/futex.h>
+
+/*
+ * The private futexes (FUTEX_PRIVATE_FLAG) and the ones in private memory are
+ * keyed by (pdir, user vaddr). The others, living in a MAP_SHARED file mapping
+ * (e.g. a memfd or a file in /dev/shm), are keyed by (inode, file offset)
+ * instead, because each process can map the shared word at a different vaddr.
+ * The two kinds of keys cannot collide, since a pdir is never an inode.
+ */
+
+#define FUTEX_HASH_BUCKETS                      32
+
+struct futex_key {
+   void *obj;                 /* pdir or inode */
+   ulong off;                 /* user vaddr or offset in the file */
+};
+
+/* Lives on the stack of the waiting task, pointed by its wobj */
+struct futex_waiter {
+   struct futex_key key;
+   u32 bitset;
+   bool woken;                /* set by futex_wake_waiter() */
+};
+
+struct futex_bucket {
+   struct list wait_list;     /* list of struct wait_obj (task->wobj) */
+};
+
+static struct futex_bucket futex_buckets[FUTEX_HASH_BUCKETS];
+
+static inline bool futex_key_eq(struct futex_key a, struct futex_key b)
+{
+   return a.obj == b.obj && a.off == b.off;
+}
+
+static struct futex_bucket *futex_get_bucket(struct futex_key k)
+{
+   ulong h = ((ulong)k.obj >> 4) ^ (k.off >> 2);
+   h ^= h >> 7;
+   return &futex_buckets[h % FUTEX_HASH_BUCKETS];
+}
+
+/*
+ * Must be called with preemption disabled, because of the lookup of the user
+ * mapping: it cannot change while we're checking or enqueueing the waiters.
+ */
+static struct futex_key futex_make_key(u32 *uaddr, bool priv)
+{
+   struct user_mapping *um;
+   struct fs_handle_base *hb;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!priv && (um = process_get_user_mapping(uaddr)) && um->h) {
+
+      hb = um->h;
+
+      /* Shared file mapping: the handles differ, the inode does not */
+      return (struct futex_key) {
+         .obj = hb->fs->fsops->get_inode(hb),
+         .off = um->off + ((ulong)uaddr - um->vaddr),
+      };
+   }
+
+   return (struct futex_key) {
+      .obj = get_curr_proc()->pdir,
+      .off = (ulong)uaddr,
+   };
+}
+
+static inline struct futex_waiter *futex_wobj_waiter(struct wait_obj *wo)
+{
+   ASSERT(wo->type == WOBJ_FUTEX);
+   return wait_obj_get_ptr(wo);
+}
+
+static void futex_wake_waiter(struct wait_obj *wo)
+{
+   struct task *ti = CONTAINER_OF(wo, struct task, wobj);
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * wake_up() resets the wobj, which removes the task from the bucket. That
+    * happens also when the task is woken up by a signal: the `woken` flag
+    * tells futex_wait() that the wakeup came from us and has been counted.
+    */
+   futex_wobj_waiter(wo)->woken = true;
+   task_cancel_wakeup_timer(ti);
+   wake_up(ti);
+}
+
+static void init_futex_buckets(void)
+{
+   static bool initialized;
+
+   if (LIKELY(initialized))
+      return;
+
+   disable_preemption();
+   {
+      if (!initialized) {
+
+         for (int i = 0; i < FUTEX_HASH_BUCKETS; i++)
+            list_init(&futex_buckets[i].wait_list);
+
+         initialized = true;
+      }
+   }
+   enable_preemption();
+}
+
+/*
+ * Converts the user timeout in ticks. In case of `abs_clock` >= 0, `ts` is
+ * an absolute time measured with that clock. Returns 0 if no timeout has been
+ * specified, -ETIMEDOUT if the deadline is already in the past.
+ */
+static int
+futex_timeout_to_ticks(const struct k_timespec64 *ts, int abs_clock, u32 *res)
+{
+   struct k_timespec64 rel = *ts;
+   u64 ticks;
+
+   *res = 0;
+
+   if (rel.tv_sec < 0 || rel.tv_nsec < 0 || rel.tv_nsec >= TS_SCALE)
+      return -EINVAL;
+
+   if (abs_clock >= 0) {
+
+      struct k_timespec64 now;
+
+      if (abs_clock == CLOCK_REALTIME)
+         real_time_get_timespec(&now);
+      else
+         monotonic_time_get_timespec(&now);
+
+      rel.tv_sec -= now.tv_sec;
+      rel.tv_nsec -= now.tv_nsec;
+
+      if (rel.tv_nsec < 0) {
+         rel.tv_sec--;
+         rel.tv_nsec += TS_SCALE;
+      }
+
+      if (rel.tv_sec < 0 || (!rel.tv_sec && !rel.tv_nsec))
+         return -ETIMEDOUT;
+   }
+
+   ticks = timespec_to_ticks(&rel);
+   *res = (u32)CLAMP(ticks, (u64)1, (u64)UINT32_MAX);
+   return 0;
+}
+
+static int
+futex_wait(u32 *uaddr,
+           u32 val,
+           const struct k_timespec64 *timeout,
+           int abs_clock,
+           u32 bitset,
+           bool priv)
+{
+   struct task *curr = get_curr_task();
+   struct futex_waiter w;
+   struct futex_bucket *b;
+   u32 timeout_ticks = 0;
+   u32 uval;
+   int rc;
+
+   if (!bitset)
+      return -EINVAL;
+
+   if (timeout) {
+      if ((rc = futex_timeout_to_ticks(timeout, abs_clock, &timeout_ticks)))
+         return rc;
+   }
+
+   disable_preemption();
+
+   w = (struct futex_waiter) {
+      .key = futex_make_key(uaddr, priv),
+      .bitset = bitset,
+   };
+
+   b = futex_get_bucket(w.key);
+
+   /*
+    * Reading the user value with preemption disabled makes the check and the
+    * enqueue atomic with respect to futex_wake(): no wakeup can be lost.
+    */
+
+   if (copy_from_user(&uval, uaddr, sizeof(uval))) {
+      enable_preemption();
+      return -EFAULT;
+   }
+
+   if (uval != val) {
+      enable_preemption();
+      return -EAGAIN;
+   }
+
+   prepare_to_wait_on(WOBJ_FUTEX, &w, NO_EXTRA, &b->wait_list);
+
+   if (timeout_ticks)
+      task_set_wakeup_timer(curr, timeout_ticks);
+
+   enter_sleep_wait_state();
+
+   /* ------------------- We've been woken up ------------------- */
+
+   wait_obj_reset(&curr->wobj);
+   task_cancel_wakeup_timer(curr);
+
+   /*
+    * NOTE: a waiter woken by futex_wake() has already been counted there, so
+    * it must return 0 even if a signal arrived in the meanwhile: otherwise,
+    * the wakeup would be lost.
+    */
+   if (w.woken)
+      return 0;
+
+   return pending_signals() ? -EINTR : -ETIMEDOUT;
+}
+
+static int
+futex_wake(u32 *uaddr, u32 nr, u32 bitset, bool priv)
+{
+   struct futex_key key;
+   struct futex_bucket *b;
+   struct wait_obj *pos, *temp;
+   int count = 0;
+
+   if (!bitset)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      key = futex_make_key(uaddr, priv);
+      b = futex_get_bucket(key);
+
+      list_for_each(pos, temp, &b->wait_list, wait_list_node) {
+
+         struct futex_waiter *w = futex_wobj_waiter(pos);
+
+         if ((u32)count >= nr)
+            break;
+
+         if (!futex_key_eq(w->key, key) || !(w->bitset & bitset))
+            continue;
+
+         futex_wake_waiter(pos);
+         count++;
+      }
+   }
+   enable_preemption();
+   return count;
+}
+
+static int
+futex_requeue(u32 *uaddr,
+              u32 nr_wake,
+              u32 nr_requeue,
+              u32 *uaddr2,
+              bool cmp,
+              u32 cmpval,
+              bool priv)
+{
+   struct futex_key key, key2;
+   struct futex_bucket *b, *b2;
+   struct wait_obj *pos, *temp;
+   u32 woken = 0, requeued = 0;
+   u32 uval;
+
+   disable_preemption();
+
+   key = futex_make_key(uaddr, priv);
+   key2 = futex_make_key(uaddr2, priv);
+   b = futex_get_bucket(key);
+   b2 = futex_get_bucket(key2);
+
+   if (cmp) {
+
+      if (copy_from_user(&uval, uaddr, sizeof(uval))) {
+         enable_preemption();
+         return -EFAULT;
+      }
+
+      if (uval != cmpval) {
+         enable_preemption();
+         return -EAGAIN;
+      }
+   }
+
+   list_for_each(pos, temp, &b->wait_list, wait_list_node) {
+
+      struct futex_waiter *w = futex_wobj_waiter(pos);
+
+      if (!futex_key_eq(w->key, key))
+         continue;
+
+      if (woken < nr_wake) {
+
+         futex_wake_waiter(pos);
+         woken++;
+
+      } else if (requeued < nr_requeue) {
+
+         w->key = key2;
+
+         if (b2 != b) {
+            list_remove(&pos->wait_list_node);
+            list_add_tail(&b2->wait_list, &pos->wait_list_node);
+         }
+
+         requeued++;
+
+      } else {
+
+         break;
+      }
+   }
+
+   enable_preemption();
+
+   /* Like Linux, FUTEX_CMP_REQUEUE returns also the number of requeued tasks */
+   return (int)(woken + (cmp ? requeued : 0));
+}
+
+static long
+do_futex(u32 *uaddr, int futex_op, u32 val,
+         const struct k_timespec64 *timeout, ulong val2,
+         u32 *uaddr2, u32 val3)
+{
+   const int cmd = futex_op & FUTEX_CMD_MASK;
+   const bool priv = !!(futex_op & FUTEX_PRIVATE_FLAG);
+   const int clk = (futex_op & FUTEX_CLOCK_REALTIME)
+      ? CLOCK_REALTIME
+      : CLOCK_MONOTONIC;
+
+   if ((ulong)uaddr % sizeof(u32))
+      return -EINVAL;
+
+   if ((futex_op & FUTEX_CLOCK_REALTIME) && cmd != FUTEX_WAIT_BITSET)
+      return -ENOSYS;
+
+   init_futex_buckets();
+
+   switch (cmd) {
+
+      case FUTEX_WAIT:
+         return futex_wait(uaddr, val, timeout, -1,
+                           FUTEX_BITSET_MATCH_ANY, priv);
+
+      case FUTEX_WAIT_BITSET:
+         return futex_wait(uaddr, val, timeout, clk, val3, priv);
+
+      case FUTEX_WAKE:
+         return futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY, priv);
+
+      case FUTEX_WAKE_BITSET:
+         return futex_wake(uaddr, val, val3, priv);
+
+      case FUTEX_REQUEUE:
+      case FUTEX_CMP_REQUEUE:
+
+         if ((ulong)uaddr2 % sizeof(u32))
+            return -EINVAL;
+
+         return futex_requeue(uaddr, val, (u32)MIN(val2, (ulong)INT32_MAX),
+                              uaddr2, cmd == FUTEX_CMP_REQUEUE, val3, priv);
+
+      default:
+         /* WAKE_OP and the PI futexes are not supported */
+         return -ENOSYS;
+   }
+}
+
+static bool futex_op_has_timeout(int futex_op)
+{
+   const int cmd = futex_op & FUTEX_CMD_MASK;
+   return cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_BITSET;
+}
+
+long
+sys_futex(u32 *uaddr, int futex_op, u32 val,
+          const struct k_timespec64 *user_timeout,
+          u32 *uaddr2, u32 val3)
+{
+   struct k_timespec64 ts;
+
+   if (!futex_op_has_timeout(futex_op)) {
+
+      /* For the REQUEUE ops, the `timeout` parameter is actually `val2` */
+      return do_futex(uaddr, futex_op, val, NULL,
+                      (ulong)user_timeout, uaddr2, val3);
+   }
+
+   if (user_timeout) {
+      if (copy_from_user(&ts, user_timeout, sizeof(ts)))
+         return -EFAULT;
+   }
+
+   return do_futex(uaddr, futex_op, val,
+                   user_timeout ? &ts : NULL, 0, uaddr2, val3);
+}
+
+int
+sys_futex_time32(u32 *uaddr, int futex_op, u32 val,
+                 const struct k_timespec32 *user_timeout,
+                 u32 *uaddr2, u32 val3)
+{
+   struct k_timespec32 ts32;
+   struct k_timespec64 ts;
+
+   if (!futex_op_has_timeout(futex_op)) {
+      return (int)do_futex(uaddr, futex_op, val, NULL,
+                           (ulong)user_timeout, uaddr2, val3);
+   }
+
+   if (user_timeout) {
+
+      if (copy_from_user(&ts32, user_timeout, sizeof(ts32)))
+         return -EFAULT;
+
+      ts = (struct k_timespec64) {
+         .tv_sec = ts32.tv_sec,
+         .tv_nsec = ts32.tv_nsec,
+      };
+   }
+
+   return (int)do_futex(uaddr, futex_op, val,
+                        user_timeout ? &ts : NULL, 0, uaddr2, val3);
+}
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hashtable.h>
+#include <tilck/kernel/kmalloc.h>
+
+#define HTABLE_MAX_BITS                      20
+
+static inline struct htable_node **ht_buckets(struct htable *ht)
+{
+   return ht->buckets ? ht->buckets : &ht->single;
+}
+
+static inline u32 ht_mask(u32 bits)
+{
+   return (1u << bits) - 1;
+}
+
+static void bucket_add(struct htable_node **b, struct htable_node *n)
+{
+   n->next = *b;
+   n->pprev = b;
+
+   if (*b)
+      (*b)->pprev = &n->next;
+
+   *b = n;
+}
+
+static void node_unlink(struct htable_node *n)
+{
+   *n->pprev = n->next;
+
+   if (n->next)
+      n->next->pprev = n->pprev;
+
+   n->next = NULL;
+   n->pprev = NULL;
+}
+
+/*
+ * The bucket where a node with the given hash is (or has to be inserted): the
+ * old buckets not moved yet by the incremental rehash are still in use.
+ */
+static struct htable_node **ht_bucket_for(struct htable *ht, u32 hash)
+{
+   if (ht->old_buckets) {
+
+      const u32 oi = hash & ht_mask(ht->old_bits);
+
+      if (oi >= ht->rehash_pos)
+         return &ht->old_buckets[oi];
+   }
+
+   return &ht_buckets(ht)[hash & ht_mask(ht->bits)];
+}
+
+/* Moves the nodes of the next `max_buckets` old buckets to the new array */
+static void ht_rehash_step(struct htable *ht, u32 max_buckets)
+{
+   const u32 old_cnt = 1u << ht->old_bits;
+   const u32 mask = ht_mask(ht->bits);
+   struct htable_node *n;
+
+   if (!ht->old_buckets)
+      return;
+
+   for (u32 i = 0; i < max_buckets && ht->rehash_pos < old_cnt; i++) {
+
+      struct htable_node **ob = &ht->old_buckets[ht->rehash_pos++];
+
+      while ((n = *ob)) {
+         node_unlink(n);
+         bucket_add(&ht->buckets[n->hash & mask], n);
+      }
+   }
+
+   if (ht->rehash_pos == old_cnt) {
+
+      if (ht->old_bits > 0)
+         kfree_array_obj(ht->old_buckets, struct htable_node *, old_cnt);
+
+      ht->old_buckets = NULL;
+      ht->old_bits = 0;
+      ht->rehash_pos = 0;
+   }
+}
+
+static void ht_maybe_grow(struct htable *ht)
+{
+   const u32 cnt = 1u << ht->bits;
+   struct htable_node **new_buckets;
+
+   if (ht->count <= cnt * HTABLE_MAX_LOAD || ht->bits >= HTABLE_MAX_BITS)
+      return;
+
+   /*
+    * Each operation moves HTABLE_REHASH_STEP buckets: the previous rehash is
+    * always complete long before the table needs to grow again, but let's
+    * not rely on that.
+    */
+   ht_rehash_step(ht, cnt);
+
+   if (!(new_buckets = kzalloc_array_obj(struct htable_node *, cnt * 2)))
+      return; /* just keep the current buckets */
+
+   ht->old_buckets = ht_buckets(ht);
+   ht->old_bits = ht->bits;
+   ht->rehash_pos = 0;
+   ht->buckets = new_buckets;
+   ht->bits++;
+}
+
+void htable_init(struct htable *ht)
+{
+   bzero(ht, sizeof(*ht));
+}
+
+void htable_destroy(struct htable *ht)
+{
+   ht_rehash_step(ht, 1u << ht->old_bits);
+
+   if (ht->buckets)
+      kfree_array_obj(ht->buckets, struct htable_node *, 1u << ht->bits);
+
+   htable_init(ht);
+}
+
+void htable_add(struct htable *ht, struct htable_node *n, u32 hash)
+{
+   ASSERT(!htable_node_is_in_table(n));
+
+   ht->count++;
+   ht_rehash_step(ht, HTABLE_REHASH_STEP);
+   ht_maybe_grow(ht);
+
+   n->hash = hash;
+   bucket_add(ht_bucket_for(ht, hash), n);
+}
+
+void htable_del(struct htable *ht, struct htable_node *n)
+{
+   ASSERT(htable_node_is_in_table(n));
+   ASSERT(ht->count > 0);
+
+   node_unlink(n);
+   ht->count--;
+   ht_rehash_step(ht, HTABLE_REHASH_STEP);
+}
+
+struct htable_node *
+htable_find(struct htable *ht, u32 hash, htable_match_func m, const void *key)
+{
+   struct htable_node *n = *ht_bucket_for(ht, hash);
+
+   for (; n; n = n->next) {
+      if (n->hash == hash && m(n, key))
+         return n;
+   }
+
+   return NULL;
+}
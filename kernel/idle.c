@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/idle.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/errno.h>
+
+static struct idle_state idle_states[MAX_IDLE_STATES] = {
+
+   {
+      .name = "C1",
+      .method = IDLE_M_HALT,
+      .exit_latency_us = 1,
+      .target_residency_us = 1,
+   },
+};
+
+static int idle_states_count = 1;
+
+static void idle_sort_states(void)
+{
+   struct idle_state tmp;
+
+   /* Insertion sort: we have at most MAX_IDLE_STATES states */
+   for (int i = 1; i < idle_states_count; i++) {
+
+      for (int j = i; j > 0; j--) {
+
+         const u32 prev = idle_states[j - 1].exit_latency_us;
+
+         if (prev <= idle_states[j].exit_latency_us)
+            break;
+
+         tmp = idle_states[j];
+         idle_states[j] = idle_states[j - 1];
+         idle_states[j - 1] = tmp;
+      }
+   }
+}
+
+int idle_register_state(const char *name,
+                        enum idle_method method,
+                        ulong arg,
+                        u32 exit_latency_us)
+{
+   struct idle_state *s = NULL;
+   int rc = 0;
+
+   if (!hw_idle_supported(method))
+      return -EINVAL;
+
+   /* The idle task reads the states with the interrupts disabled */
+   disable_preemption();
+
+   for (int i = 0; i < idle_states_count; i++) {
+      if (!strncmp(idle_states[i].name, name, IDLE_STATE_NAME_LEN)) {
+         s = &idle_states[i];
+         break;
+      }
+   }
+
+   if (!s) {
+
+      if (idle_states_count == MAX_IDLE_STATES) {
+         rc = -ENOSPC;
+         goto out;
+      }
+
+      s = &idle_states[idle_states_count++];
+      bzero(s, sizeof(*s));
+      strncpy(s->name, name, IDLE_STATE_NAME_LEN - 1);
+   }
+
+   s->method = method;
+   s->arg = arg;
+   s->exit_latency_us = exit_latency_us;
+   s->target_residency_us = exit_latency_us * IDLE_RESIDENCY_FACTOR;
+   idle_sort_states();
+
+out:
+   enable_preemption();
+   return rc;
+}
+
+int idle_get_states(struct idle_state *arr, int max)
+{
+   int n;
+
+   disable_preemption();
+   {
+      n = MIN(max, idle_states_count);
+      memcpy(arr, idle_states, sizeof(idle_states[0]) * (size_t)n);
+   }
+   enable_preemption();
+   return n;
+}
+
+void idle_enter(u64 predicted_ns)
+{
+   struct idle_state *s = &idle_states[0];
+   u64 start;
+
+   ASSERT(!are_interrupts_enabled());
+
+   for (int i = idle_states_count - 1; i > 0; i--) {
+      if ((u64)idle_states[i].target_residency_us * 1000 <= predicted_ns) {
+         s = &idle_states[i];
+         break;
+      }
+   }
+
+   start = get_sys_time();
+
+   /* Returns with the interrupts enabled */
+   hw_idle_enter(s->method, s->arg);
+
+   /*
+    * NOTE: when the periodic tick has not been stopped, the residency has the
+    * precision of a tick. That's fine for the stats.
+    */
+   disable_preemption();
+   {
+      s->usage++;
+      s->time_ns += get_sys_time() - start;
+   }
+   enable_preemption();
+}
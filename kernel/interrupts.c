@@ -11,6 +11,10 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/process_int.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/mods/tracing.h>
 
 void handle_syscall(regs_t *);
 void handle_fault(regs_t *);
@@ -38,6 +42,94 @@ static ALWAYS_INLINE void dec_irq_count(void)
    ASSERT(oldval > 0);
 }
 
+/*
+ * The registers saved on entry of the innermost IRQ being handled, for the
+ * handlers wanting to know what got interrupted (e.g. the profiler).
+ */
+static regs_t *curr_irq_regs;
+
+regs_t *get_irq_regs(void)
+{
+   return in_irq() ? curr_irq_regs : NULL;
+}
+
+/*
+ * Per-IRQ statistics (see irq.h). An IRQ can't nest with itself and its
+ * entry is updated only with the interrupts disabled, so nothing else is
+ * needed to protect it.
+ */
+static struct irq_stats irq_stats[IRQ_STATS_MAX_IRQS];
+static u32 irq_stats_cycles_per_us;
+
+static u32 irq_stats_get_cycles_per_us(void)
+{
+   u64 ns;
+
+   if (LIKELY(irq_stats_cycles_per_us))
+      return irq_stats_cycles_per_us;
+
+   /* Zero until the TSC gets calibrated */
+   if ((ns = tsc_to_ns(1000 * 1000)))
+      irq_stats_cycles_per_us = (u32)MAX(1000ull * 1000 * 1000 / ns, 1ull);
+
+   return irq_stats_cycles_per_us;
+}
+
+static void irq_stats_account(int irq, u64 cycles, int depth)
+{
+   struct irq_stats *s = &irq_stats[irq];
+   const u32 cpu = irq_stats_get_cycles_per_us();
+   const u64 now = get_ticks();
+   u32 b = 0;
+
+   s->count++;
+   s->tot_cycles += cycles;
+   s->max_cycles = MAX(s->max_cycles, cycles);
+   s->max_depth = MAX(s->max_depth, (u32)depth);
+
+   if (now - s->win_start >= TIMER_HZ) {
+      s->win_start = now;
+      s->win_count = 0;
+   }
+
+   s->max_rate = MAX(s->max_rate, ++s->win_count);
+
+   if (cpu) {
+
+      while (b < IRQ_STATS_HIST_BUCKETS - 1 && cycles >= ((u64)cpu << b))
+         b++;
+
+      s->hist[b]++;
+   }
+}
+
+void irq_account_masked_time(int irq, u64 cycles)
+{
+   struct irq_stats *s;
+
+   if (irq < 0 || irq >= IRQ_STATS_MAX_IRQS)
+      return;
+
+   s = &irq_stats[irq];
+   s->masked_tot_cycles += cycles;
+   s->masked_max_cycles = MAX(s->masked_max_cycles, cycles);
+}
+
+bool irq_get_stats(int irq, struct irq_stats *s)
+{
+   ulong var;
+
+   if (irq < 0 || irq >= IRQ_STATS_MAX_IRQS)
+      return false;
+
+   disable_interrupts(&var);
+   {
+      *s = irq_stats[irq];
+   }
+   enable_interrupts(&var);
+   return true;
+}
+
 #if KRN_TRACK_NESTED_INTERR
 
 static int nested_interrupts_count;
@@ -196,11 +288,22 @@ static void irq_resched(regs_t *r)
 
 void irq_entry(regs_t *r)
 {
+   const int irq = int_to_irq(regs_intnum(r));
+   regs_t *prev_regs;
+   u64 start;
+
    ASSERT(get_curr_task() != NULL);
    DEBUG_check_not_same_interrupt_nested(regs_intnum(r));
 
    /* We expect here that the CPU disabled the interrupts */
    ASSERT(!are_interrupts_enabled());
+   irqs_off_trace_cancel();
+
+   /* Restart the periodic tick, if it was stopped while idle */
+   tickless_idle_exit_if_needed();
+
+   /* Charge the time before the IRQ: `running_in_kernel` tells us where */
+   sched_account_cputime(!get_curr_task()->running_in_kernel);
 
    /* Disable the preemption */
    disable_preemption();
@@ -209,8 +312,21 @@ void irq_entry(regs_t *r)
    inc_irq_count();
 
    /* Call the arch-dependent IRQ handling logic */
+   trace_point(tp_irq_entry, irq, 0, 0);
+   prev_regs = curr_irq_regs;
+   curr_irq_regs = r;
+   start = RDTSC();
    arch_irq_handling(r);
 
+   if (irq >= 0 && irq < IRQ_STATS_MAX_IRQS) {
+      irq_stats_account(irq,
+                        RDTSC() - start,
+                        atomic_load_explicit(&__in_irq_count, mo_relaxed));
+   }
+
+   curr_irq_regs = prev_regs;
+   trace_point(tp_irq_exit, irq, 0, 0);
+
    /* Decrease the always-enabled in_irq_count counter */
    dec_irq_count();
 
@@ -220,6 +336,9 @@ void irq_entry(regs_t *r)
    /* Check that the preemption is disabled as well */
    ASSERT(!is_preemption_enabled());
 
+   /* The IRQ time is charged to the interrupted task as system time */
+   sched_account_cputime(false);
+
    /* Run the scheduler if necessary (it will enable interrupts) */
    if (need_reschedule())
       irq_resched(r);
@@ -241,13 +360,34 @@ void syscall_entry(regs_t *r)
    ASSERT(!are_interrupts_enabled());
    ASSERT(is_preemption_enabled());
 
+   sched_account_cputime(true);
    push_nested_interrupt(SYSCALL_SOFT_INTERRUPT);
    disable_preemption();
    enable_interrupts_forced();
    {
-      handle_syscall(r);
+      /*
+       * The task's copy buffers are leased for the duration of the syscall.
+       * NOTE: execve() switches directly to the new image, without returning
+       * here: in that case, the buffers are kept until the next syscall.
+       */
+      if (LIKELY(task_lease_bufs(get_curr_task())))
+         handle_syscall(r);
+      else
+         set_return_register(r, (ulong)-ENOMEM);
+
+      task_release_bufs(get_curr_task());
+
+      /*
+       * The syscall might have woken up a task which has to preempt us (see
+       * sched_check_wakeup_preempt()): don't wait for the next timer IRQ.
+       */
+      if (need_reschedule()) {
+         schedule_preempt_disabled();  /* returns with preemption enabled */
+         disable_preemption();
+      }
    }
    disable_interrupts_forced();
+   sched_account_cputime(false);
    enable_preemption_nosched();
    pop_nested_interrupt();
 
@@ -263,6 +403,7 @@ void fault_entry(regs_t *r)
     */
    ASSERT(!are_interrupts_enabled());
 
+   sched_account_cputime(!get_curr_task()->running_in_kernel);
    get_curr_task()->running_in_kernel++;
    push_nested_interrupt(regs_intnum(r));
    disable_preemption();
@@ -281,6 +422,7 @@ void fault_entry(regs_t *r)
 
    enable_preemption();
    disable_interrupts_forced();
+   sched_account_cputime(false);
    get_curr_task()->running_in_kernel--;
 }
 
@@ -0,0 +1,536 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+#include <tilck/common/atomics.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/io_uring.h>
+
+#include <sys/mman.h>         // system header
+#include <linux/io_uring.h>   // system header
+
+/*
+ * A minimal io_uring: the submission (SQ) and the completion (CQ) rings live
+ * in kernel memory, shared with the user space via mmap(), using the same
+ * layout and offsets as Linux. That allows a process to queue many I/O
+ * operations and to submit them all with a single io_uring_enter() call.
+ *
+ * The operations are executed in the context of the submitting task, one
+ * after the other, by io_uring_enter() itself: that's because they need the
+ * address space and the handles of the process, while Tilck's worker threads
+ * are kernel threads which must never block. Therefore, every SQE gets its
+ * CQE before io_uring_enter() returns.
+ */
+
+struct io_rings {
+
+   ATOMIC(u32) sq_head;          /* written by the kernel */
+   ATOMIC(u32) sq_tail;          /* written by the user */
+   u32 sq_ring_mask;
+   u32 sq_ring_entries;
+   u32 sq_flags;
+   u32 sq_dropped;
+
+   ATOMIC(u32) cq_head;          /* written by the user */
+   ATOMIC(u32) cq_tail;          /* written by the kernel */
+   u32 cq_ring_mask;
+   u32 cq_ring_entries;
+   u32 cq_overflow;
+   u32 cq_flags;
+
+   struct io_uring_cqe cqes[];
+
+   /* The SQ array (u32 indexes in the SQEs) follows the CQEs */
+};
+
+struct io_ring {
+
+   KOBJ_BASE_FIELDS
+
+   struct io_rings *rings;
+   size_t rings_size;
+
+   struct io_uring_sqe *sqes;
+   size_t sqes_size;
+
+   u32 *sq_array;
+   u32 sq_entries;
+   u32 cq_entries;
+
+   struct kmutex lock;           /* serializes the submitters */
+   struct kcond cq_cond;         /* signaled when new CQEs are posted */
+};
+
+static const struct file_ops static_ops_io_ring;
+
+static void *io_ring_alloc_shared(size_t size)
+{
+   const u32 kmalloc_flags = KMALLOC_FL_MULTI_STEP | PAGE_SIZE;
+   void *ptr;
+
+   ASSERT(IS_PAGE_ALIGNED(size));
+
+   if (!(ptr = general_kmalloc(&size, kmalloc_flags)))
+      return NULL;
+
+   bzero(ptr, size);
+
+   /* These pages will be mapped in the user space, as ramfs does */
+   retain_pageframes_mapped_at(get_kernel_pdir(),
+                               ptr,
+                               size,
+                               PF_TYPE_USHARED);
+   return ptr;
+}
+
+static void io_ring_free_shared(void *ptr, size_t size)
+{
+   if (!ptr)
+      return;
+
+   release_pageframes_mapped_at(get_kernel_pdir(), ptr, size);
+   general_kfree(ptr, &size, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+}
+
+void destroy_io_ring(struct io_ring *r)
+{
+   io_ring_free_shared(r->sqes, r->sqes_size);
+   io_ring_free_shared(r->rings, r->rings_size);
+   kcond_destory(&r->cq_cond);
+   kmutex_destroy(&r->lock);
+   kfree_obj(r, struct io_ring);
+}
+
+static int
+io_ring_get_sizes(u32 entries, struct io_uring_params *p, u32 *sq, u32 *cq)
+{
+   if (!entries)
+      return -EINVAL;
+
+   if (entries > IO_URING_MAX_ENTRIES) {
+
+      if (!(p->flags & IORING_SETUP_CLAMP))
+         return -EINVAL;
+
+      entries = IO_URING_MAX_ENTRIES;
+   }
+
+   *sq = (u32)roundup_next_power_of_2(entries);
+   *cq = 2 * *sq;
+
+   if (p->flags & IORING_SETUP_CQSIZE) {
+
+      if (!p->cq_entries)
+         return -EINVAL;
+
+      if (p->cq_entries > 2 * IO_URING_MAX_ENTRIES) {
+
+         if (!(p->flags & IORING_SETUP_CLAMP))
+            return -EINVAL;
+
+         p->cq_entries = 2 * IO_URING_MAX_ENTRIES;
+      }
+
+      *cq = (u32)roundup_next_power_of_2(p->cq_entries);
+
+      if (*cq < *sq)
+         return -EINVAL;
+   }
+
+   return 0;
+}
+
+int create_io_ring(u32 entries, struct io_uring_params *p, struct io_ring **out)
+{
+   struct io_ring *r;
+   size_t sq_array_off;
+   u32 sq, cq;
+   int rc;
+
+   if (p->flags & ~(IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP))
+      return -EINVAL;
+
+   if ((rc = io_ring_get_sizes(entries, p, &sq, &cq)))
+      return rc;
+
+   if (!(r = (void *)kzalloc_obj(struct io_ring)))
+      return -ENOMEM;
+
+   r->destory_obj = (void *)&destroy_io_ring;
+   r->sq_entries = sq;
+   r->cq_entries = cq;
+   kmutex_init(&r->lock, 0);
+   kcond_init(&r->cq_cond);
+
+   sq_array_off = sizeof(struct io_rings) + cq * sizeof(struct io_uring_cqe);
+   r->rings_size = pow2_round_up_at(sq_array_off + sq * 4, PAGE_SIZE);
+   r->sqes_size = pow2_round_up_at(sq * sizeof(struct io_uring_sqe), PAGE_SIZE);
+
+   if (!(r->rings = io_ring_alloc_shared(r->rings_size)))
+      goto oom;
+
+   if (!(r->sqes = io_ring_alloc_shared(r->sqes_size)))
+      goto oom;
+
+   r->sq_array = (void *)r->rings + sq_array_off;
+   r->rings->sq_ring_mask = sq - 1;
+   r->rings->sq_ring_entries = sq;
+   r->rings->cq_ring_mask = cq - 1;
+   r->rings->cq_ring_entries = cq;
+
+   p->sq_entries = sq;
+   p->cq_entries = cq;
+   p->features = IORING_FEAT_SINGLE_MMAP |
+                 IORING_FEAT_NODROP |
+                 IORING_FEAT_SUBMIT_STABLE |
+                 IORING_FEAT_RW_CUR_POS;
+
+   p->sq_off = (struct io_sqring_offsets) {
+      .head = offsetof(struct io_rings, sq_head),
+      .tail = offsetof(struct io_rings, sq_tail),
+      .ring_mask = offsetof(struct io_rings, sq_ring_mask),
+      .ring_entries = offsetof(struct io_rings, sq_ring_entries),
+      .flags = offsetof(struct io_rings, sq_flags),
+      .dropped = offsetof(struct io_rings, sq_dropped),
+      .array = (u32)sq_array_off,
+   };
+
+   p->cq_off = (struct io_cqring_offsets) {
+      .head = offsetof(struct io_rings, cq_head),
+      .tail = offsetof(struct io_rings, cq_tail),
+      .ring_mask = offsetof(struct io_rings, cq_ring_mask),
+      .ring_entries = offsetof(struct io_rings, cq_ring_entries),
+      .overflow = offsetof(struct io_rings, cq_overflow),
+      .cqes = offsetof(struct io_rings, cqes),
+      .flags = offsetof(struct io_rings, cq_flags),
+   };
+
+   *out = r;
+   return 0;
+
+oom:
+   destroy_io_ring(r);
+   return -ENOMEM;
+}
+
+static int io_ring_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct kfs_handle *kh = um->h;
+   struct io_ring *r = (void *)kh->kobj;
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   size_t pg_count, mapped_cnt;
+   void *data;
+   size_t size;
+
+   switch (um->off) {
+
+      case IORING_OFF_SQ_RING:
+      case IORING_OFF_CQ_RING:
+         /* IORING_FEAT_SINGLE_MMAP: both the rings are in the same region */
+         data = r->rings;
+         size = r->rings_size;
+         break;
+
+      case IORING_OFF_SQES:
+         data = r->sqes;
+         size = r->sqes_size;
+         break;
+
+      default:
+         return -EINVAL;
+   }
+
+   if (um->len > size)
+      return -EINVAL;
+
+   if (flags & VFS_MM_DONT_MMAP)
+      return 0;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   pg_count = um->len >> PAGE_SHIFT;
+   mapped_cnt = map_pages(pdir,
+                          um->vaddrp,
+                          LIN_VA_TO_PA(data),
+                          pg_count,
+                          pg_flags);
+
+   if (mapped_cnt != pg_count) {
+      unmap_pages_permissive(pdir, um->vaddrp, mapped_cnt, false);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static bool io_ring_is_ring_fd(struct io_ring *r, int fd)
+{
+   struct fs_handle_base *h = get_fs_handle(fd);
+
+   if (!h || h->fops != &static_ops_io_ring)
+      return false;
+
+   return ((struct kfs_handle *)h)->kobj == (void *)r;
+}
+
+static void *io_ring_user_ptr(u64 addr)
+{
+   return (void *)(ulong)addr;
+}
+
+static int
+io_ring_rw_vec(const struct io_uring_sqe *sqe, bool write)
+{
+   const struct iovec *u_iov = io_ring_user_ptr(sqe->addr);
+   s64 off = (s64)sqe->off;
+   struct iovec iov;
+   int tot = 0, rc;
+
+   for (u32 i = 0; i < sqe->len; i++) {
+
+      if (copy_from_user(&iov, u_iov + i, sizeof(iov)))
+         return tot ? tot : -EFAULT;
+
+      if (write)
+         rc = sys_pwrite64(sqe->fd, iov.iov_base, iov.iov_len, off);
+      else
+         rc = sys_pread64(sqe->fd, iov.iov_base, iov.iov_len, off);
+
+      if (rc < 0)
+         return tot ? tot : rc;
+
+      tot += rc;
+      off += rc;
+
+      if ((size_t)rc < iov.iov_len)
+         break; /* short transfer */
+   }
+
+   return tot;
+}
+
+static int
+io_ring_exec(struct io_ring *r, const struct io_uring_sqe *sqe)
+{
+   const bool cur_pos = sqe->off == (u64)-1;
+   void *u_ptr = io_ring_user_ptr(sqe->addr);
+
+   if (sqe->flags & (IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT))
+      return -EINVAL;
+
+   if (sqe->addr != (ulong)sqe->addr)
+      return -EFAULT;
+
+   switch (sqe->opcode) {
+
+      case IORING_OP_NOP:
+         return 0;
+
+      case IORING_OP_READ:
+         return cur_pos
+            ? sys_read(sqe->fd, u_ptr, sqe->len)
+            : sys_pread64(sqe->fd, u_ptr, sqe->len, (s64)sqe->off);
+
+      case IORING_OP_WRITE:
+         return cur_pos
+            ? sys_write(sqe->fd, u_ptr, sqe->len)
+            : sys_pwrite64(sqe->fd, u_ptr, sqe->len, (s64)sqe->off);
+
+      case IORING_OP_READV:
+         return cur_pos
+            ? sys_readv(sqe->fd, u_ptr, (int)sqe->len)
+            : io_ring_rw_vec(sqe, false);
+
+      case IORING_OP_WRITEV:
+         return cur_pos
+            ? sys_writev(sqe->fd, u_ptr, (int)sqe->len)
+            : io_ring_rw_vec(sqe, true);
+
+      case IORING_OP_FSYNC:
+         return (sqe->fsync_flags & IORING_FSYNC_DATASYNC)
+            ? sys_fdatasync(sqe->fd)
+            : sys_fsync(sqe->fd);
+
+      case IORING_OP_OPENAT:
+         return (int)sys_openat(sqe->fd,
+                                u_ptr,
+                                (int)sqe->open_flags,
+                                (mode_t)sqe->len);
+
+      case IORING_OP_CLOSE:
+
+         /* Closing the ring itself, while using it, is not allowed */
+         if (io_ring_is_ring_fd(r, sqe->fd))
+            return -EBADF;
+
+         return sys_close(sqe->fd);
+
+      default:
+         return -EINVAL;
+   }
+}
+
+static inline u32 io_ring_cq_count(struct io_rings *rings)
+{
+   const u32 tail = atomic_load_explicit(&rings->cq_tail, mo_relaxed);
+   return tail - atomic_load_explicit(&rings->cq_head, mo_acquire);
+}
+
+static void io_ring_post_cqe(struct io_ring *r, u64 user_data, int res)
+{
+   struct io_rings *rings = r->rings;
+   const u32 tail = atomic_load_explicit(&rings->cq_tail, mo_relaxed);
+   struct io_uring_cqe *cqe = &rings->cqes[tail & rings->cq_ring_mask];
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&r->lock));
+   ASSERT(io_ring_cq_count(rings) < r->cq_entries);
+
+   cqe->user_data = user_data;
+   cqe->res = res;
+   cqe->flags = 0;
+
+   /* Publish the CQE: the release pairs with the user's acquire on cq_tail */
+   atomic_store_explicit(&rings->cq_tail, tail + 1, mo_release);
+   kcond_signal_all(&r->cq_cond);
+}
+
+/*
+ * Consumes up to `to_submit` SQEs and executes them, in order. An operation
+ * failing in a chain of IOSQE_IO_LINK SQEs cancels the rest of the chain.
+ * Returns the number of consumed SQEs or -EBUSY when the CQ ring is full.
+ */
+static int io_ring_submit(struct io_ring *r, u32 to_submit)
+{
+   struct io_rings *rings = r->rings;
+   u32 head = atomic_load_explicit(&rings->sq_head, mo_relaxed);
+   const u32 tail = atomic_load_explicit(&rings->sq_tail, mo_acquire);
+   const u32 link_flags = IOSQE_IO_LINK | IOSQE_IO_HARDLINK;
+   struct io_uring_sqe sqe;
+   bool cancel = false;
+   u32 submitted = 0;
+   u32 idx;
+   int res;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&r->lock));
+
+   while (submitted < to_submit && head != tail) {
+
+      if (io_ring_cq_count(rings) >= r->cq_entries) {
+
+         /* IORING_FEAT_NODROP: don't consume SQEs we cannot complete */
+         if (!submitted)
+            return -EBUSY;
+
+         break;
+      }
+
+      idx = r->sq_array[head & rings->sq_ring_mask];
+      head++;
+
+      if (idx >= r->sq_entries) {
+         rings->sq_dropped++;
+         atomic_store_explicit(&rings->sq_head, head, mo_release);
+         continue;
+      }
+
+      /* The user might change the SQE meanwhile: use a stable copy */
+      sqe = r->sqes[idx];
+      atomic_store_explicit(&rings->sq_head, head, mo_release);
+
+      res = cancel ? -ECANCELED : io_ring_exec(r, &sqe);
+      io_ring_post_cqe(r, sqe.user_data, res);
+      submitted++;
+
+      if (!(sqe.flags & link_flags))
+         cancel = false;        /* end of the chain (if any) */
+      else if (res < 0 && !(sqe.flags & IOSQE_IO_HARDLINK))
+         cancel = true;
+   }
+
+   return (int)submitted;
+}
+
+static int
+io_ring_wait_cqes(struct io_ring *r, u32 min_complete)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&r->lock));
+   min_complete = MIN(min_complete, r->cq_entries);
+
+   while (io_ring_cq_count(r->rings) < min_complete) {
+
+      kcond_wait(&r->cq_cond, &r->lock, KCOND_WAIT_FOREVER);
+
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   return 0;
+}
+
+int sys_io_uring_enter(unsigned int fd, u32 to_submit, u32 min_complete,
+                       u32 flags, const void *u_sig, size_t sigsz)
+{
+   struct fs_handle_base *h;
+   struct io_ring *r;
+   int rc, submitted = 0;
+
+   if (!(h = get_fs_handle((int)fd)))
+      return -EBADF;
+
+   if (h->fops != &static_ops_io_ring)
+      return -EOPNOTSUPP;
+
+   if (flags & ~IORING_ENTER_GETEVENTS)
+      return -EINVAL;
+
+   if (u_sig)
+      return -ENOSYS; /* not supported yet */
+
+   r = (void *)((struct kfs_handle *)h)->kobj;
+   kmutex_lock(&r->lock);
+
+   if (to_submit) {
+      if ((submitted = io_ring_submit(r, to_submit)) < 0)
+         goto out;
+   }
+
+   if (flags & IORING_ENTER_GETEVENTS) {
+      if ((rc = io_ring_wait_cqes(r, min_complete)) && !submitted)
+         submitted = rc;
+   }
+
+out:
+   kmutex_unlock(&r->lock);
+   return submitted;
+}
+
+static const struct file_ops static_ops_io_ring =
+{
+   .mmap = io_ring_mmap,
+   .munmap = generic_fs_munmap,
+};
+
+fs_handle io_ring_create_handle(struct io_ring *r)
+{
+   struct kfs_handle *h;
+
+   if (!(h = kfs_create_new_handle(&static_ops_io_ring, (void *)r, O_RDWR)))
+      return NULL;
+
+   h->spec_flags |= VFS_SPFL_MMAP_SUPPORTED;
+   return h;
+}
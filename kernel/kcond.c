@@ -6,11 +6,17 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/epoll.h>
 
 void kcond_init(struct kcond *c)
 {
    DEBUG_ONLY(check_not_in_irq_handler());
    list_init(&c->wait_list);
+   c->wake_boost = false;
+
+#if LOCK_STATS
+   c->lc = NULL;
+#endif
 }
 
 bool kcond_is_anyone_waiting(struct kcond *c)
@@ -31,10 +37,15 @@ bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks)
    struct task *curr = get_curr_task();
    bool ret;
 
+#if LOCK_STATS
+   const u64 wait_start = lock_stats_contended(c->lc, NULL);
+#endif
+
 panic_retry_hack:
 
    disable_preemption();
    prepare_to_wait_on(WOBJ_KCOND, c, NO_EXTRA, &c->wait_list);
+   curr->wobj.exclusive = true;
 
    if (timeout_ticks != KCOND_WAIT_FOREVER)
       task_set_wakeup_timer(curr, timeout_ticks);
@@ -74,6 +85,10 @@ panic_retry_hack:
 
    ret = !wait_obj_reset(&curr->wobj);
 
+#if LOCK_STATS
+   lock_stats_acquired(c->lc, wait_start);
+#endif
+
    if (m) {
       kmutex_lock(m); // Re-acquire the lock [if any]
    }
@@ -102,12 +117,26 @@ panic_retry_hack:
    return ret;
 }
 
-static void
+/*
+ * Returns true if `wo` consumed the signal: a sleeping task has been woken up
+ * or, for epoll items, a task waiting in epoll_wait() has been.
+ */
+static bool
 kcond_signal_int(struct kcond *c, struct wait_obj *wo)
 {
    ASSERT(!is_preemption_enabled());
    DEBUG_ONLY(check_not_in_irq_handler());
 
+   if (wo->type == WOBJ_EPOLL) {
+
+      /*
+       * Epoll registrations are not tasks waiting on the condition: they stay
+       * in the wait list until explicitly removed and just need to be told
+       * that the condition has been signaled.
+       */
+      return epoll_on_cond_signal(wo);
+   }
+
    struct task *ti =
       wo->type != WOBJ_MWO_ELEM
          ? CONTAINER_OF(wo, struct task, wobj)
@@ -123,7 +152,7 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
        * See the comments above in kcond_wait() for more context.
        */
       wait_obj_reset(wo);
-      return;
+      return true;
    }
 
    if (ti->state != TASK_STATE_SLEEPING) {
@@ -133,7 +162,7 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
       if (wo->type == WOBJ_MWO_ELEM)
          wait_obj_reset(wo);
 
-      return;
+      return false;
    }
 
    if (wo->type != WOBJ_MWO_ELEM) {
@@ -144,21 +173,33 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
    }
 
    wait_obj_reset(wo);
+   ti->wake_boost = c->wake_boost;
    wake_up(ti);
+   ti->wake_boost = false;
+   return true;
 }
 
 void kcond_signal_one(struct kcond *c)
 {
+   struct wait_obj *wo_pos, *temp;
+   bool woken = false;
+
    disable_preemption();
    {
       DEBUG_ONLY(check_not_in_irq_handler());
 
-      if (!list_is_empty(&c->wait_list)) {
-
-         struct wait_obj *wobj =
-            list_first_obj(&c->wait_list, struct wait_obj, wait_list_node);
+      /*
+       * Non-exclusive waiters (poll/select and epoll registrations) always
+       * get notified. Among the exclusive ones, only the first that actually
+       * consumes the signal does: a task that already woke up because of its
+       * timeout is still in the list, but signaling it would lose the event.
+       */
+      list_for_each(wo_pos, temp, &c->wait_list, wait_list_node) {
 
-         kcond_signal_int(c, wobj);
+         if (!wo_pos->exclusive)
+            kcond_signal_int(c, wo_pos);
+         else if (!woken)
+            woken = kcond_signal_int(c, wo_pos);
       }
    }
    enable_preemption();
@@ -14,13 +14,19 @@
 #endif
 
 static void *
-main_heaps_kmalloc(size_t *size, u32 flags)
+main_heaps_kmalloc_in(u32 fit, size_t *size, u32 flags)
 {
    ASSERT(kmalloc_initialized);
 
-   // Iterate in reverse-order because the first heaps are the biggest ones.
-   for (int i = used_heaps - 1; i >= 0; i--) {
+   /*
+    * Consider only the heaps that might fit the block, in reverse-order
+    * because the first heaps are the biggest ones.
+    */
+   while (fit) {
+
+      const int i = 31 - __builtin_clz(fit);
 
+      fit &= ~(1u << i);
       ASSERT(heaps[i] != NULL);
 
       void *vaddr;
@@ -35,10 +41,18 @@ main_heaps_kmalloc(size_t *size, u32 flags)
       if (heap_size < *size || heap_free < *size)
          continue;
 
-      if (heaps[i]->dma != !!(flags & KMALLOC_FL_DMA))
-         continue;
+      /*
+       * Each heap is protected by its own `in_use` flag: the preemption needs
+       * to be disabled only while we're operating on this specific heap, not
+       * while looking for one with enough free space.
+       */
+      disable_preemption();
+      {
+         vaddr = per_heap_kmalloc(heaps[i], size, flags);
+      }
+      enable_preemption();
 
-      if ((vaddr = per_heap_kmalloc(heaps[i], size, flags))) {
+      if (vaddr) {
 
          if (KMALLOC_SUPPORT_LEAK_DETECTOR && leak_detector_enabled) {
             debug_kmalloc_register_alloc(vaddr, *size);
@@ -51,6 +65,23 @@ main_heaps_kmalloc(size_t *size, u32 flags)
    return NULL;
 }
 
+static void *
+main_heaps_kmalloc(size_t *size, u32 flags)
+{
+   const u32 fit = kmalloc_get_fit_heaps(*size, !!(flags & KMALLOC_FL_DMA));
+   const u32 ll_mask = (flags & KMALLOC_FL_LONG_LIVED)
+      ? long_lived_heaps_mask
+      : ~long_lived_heaps_mask;
+
+   void *vaddr;
+
+   /* First the heaps of the block's lifetime class, then all the others */
+   if ((vaddr = main_heaps_kmalloc_in(fit & ll_mask, size, flags)))
+      return vaddr;
+
+   return main_heaps_kmalloc_in(fit & ~ll_mask, size, flags);
+}
+
 static int
 main_heaps_kfree(void *ptr, size_t *size, u32 flags)
 {
@@ -78,11 +109,16 @@ main_heaps_kfree(void *ptr, size_t *size, u32 flags)
     */
    ASSERT((vaddr & (h->min_block_size - 1)) == 0);
 
-   per_heap_kfree(h, ptr, size, flags);
+   disable_preemption();
+   {
+      per_heap_kfree(h, ptr, size, flags);
 
-   if (KMALLOC_FREE_MEM_POISONING) {
-      memset32(ptr, FREE_MEM_POISON_VAL, *size / 4);
+      /* Poison the chunk before anybody else has the chance to allocate it */
+      if (KMALLOC_FREE_MEM_POISONING) {
+         memset32(ptr, FREE_MEM_POISON_VAL, *size / 4);
+      }
    }
+   enable_preemption();
 
    if (KMALLOC_SUPPORT_LEAK_DETECTOR && leak_detector_enabled) {
       debug_kmalloc_register_free((void *)vaddr, *size);
@@ -91,7 +127,7 @@ main_heaps_kfree(void *ptr, size_t *size, u32 flags)
    return 0;
 }
 
-void *general_kmalloc(size_t *size, u32 flags)
+static void *do_general_kmalloc(size_t *size, u32 flags, void *caller)
 {
    void *res;
    const u32 sub_block_sz = flags & KMALLOC_FL_SUB_BLOCK_MIN_SIZE_MASK;
@@ -99,33 +135,119 @@ void *general_kmalloc(size_t *size, u32 flags)
    ASSERT(size != NULL);
    ASSERT(*size);
 
-   disable_preemption();
+   const size_t orig_size = *size;
+
+   if (*size <= SMALL_HEAP_MAX_ALLOC ||
+       UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
    {
-      const size_t orig_size = *size;
+      /* Small DMA allocations are not allowed */
+      ASSERT(~flags & KMALLOC_FL_DMA);
 
-      if (*size <= SMALL_HEAP_MAX_ALLOC ||
-          UNLIKELY(sub_block_sz && sub_block_sz <= SMALL_HEAP_MAX_ALLOC))
+      /*
+       * The small heaps are tiny, so the allocation itself is fast, but their
+       * lists are shared: keep the preemption disabled for the whole thing.
+       */
+      disable_preemption();
       {
-         /* Small DMA allocations are not allowed */
-         ASSERT(~flags & KMALLOC_FL_DMA);
          res = small_heaps_kmalloc(size, flags);
+      }
+      enable_preemption();
 
-      } else {
+   } else {
 
-         res = main_heaps_kmalloc(size, flags);
+      /* Preemptible, except while operating on a specific heap */
+      res = main_heaps_kmalloc(size, flags);
 
-         if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
-            res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
+      if (UNLIKELY(res == NULL && ~flags & KMALLOC_FL_DMA))
+         res = main_heaps_kmalloc(size, flags | KMALLOC_FL_DMA);
+
+      if (UNLIKELY(res == NULL) && !in_irq()) {
+
+         /* Slow path: ask the shrinkers for memory and retry, once */
+         if (kmalloc_shrink(*size))
+            res = main_heaps_kmalloc(size, flags);
       }
 
-      if (KMALLOC_HEAVY_STATS && res != NULL)
-         if (~flags & KMALLOC_FL_DONT_ACCOUNT)
+      if (LIKELY(res != NULL))
+         kmalloc_check_low_mem();
+   }
+
+   if (KMALLOC_HEAVY_STATS && res != NULL) {
+      if (~flags & KMALLOC_FL_DONT_ACCOUNT) {
+         disable_preemption();
+         {
             kmalloc_account_alloc(orig_size);
+         }
+         enable_preemption();
+      }
    }
-   enable_preemption();
+
+   if (KMALLOC_CALLSITE_STATS && res != NULL) {
+      if (~flags & KMALLOC_FL_DONT_ACCOUNT) {
+         disable_preemption();
+         {
+            kmalloc_account_callsite_alloc(res, orig_size, (ulong)caller);
+         }
+         enable_preemption();
+      }
+   }
+
+   if (UNLIKELY(samples != NULL) && res != NULL && !in_irq()) {
+      if ((~flags & KMALLOC_FL_DONT_ACCOUNT) && kmalloc_should_sample()) {
+         disable_preemption();
+         {
+            kmalloc_sample_alloc(res, orig_size, (ulong)caller);
+         }
+         enable_preemption();
+      }
+   }
+
+   trace_point(tp_kmalloc, res, orig_size, flags);
    return res;
 }
 
+void *general_kmalloc(size_t *size, u32 flags)
+{
+   void *caller = __builtin_extract_return_addr(__builtin_return_address(0));
+   return do_general_kmalloc(size, flags, caller);
+}
+
+static void *do_kzmalloc(size_t size, u32 flags, void *caller)
+{
+   void *res = do_general_kmalloc(&size, flags, caller);
+
+   if (!res)
+      return NULL;
+
+   bzero(res, size);
+   return res;
+}
+
+void *kzmalloc(size_t size)
+{
+   /* Attribute the allocation to our caller, for the call-site stats */
+   void *caller = __builtin_extract_return_addr(__builtin_return_address(0));
+   return do_kzmalloc(size, 0, caller);
+}
+
+void *kzmalloc_long_lived(size_t size)
+{
+   void *caller = __builtin_extract_return_addr(__builtin_return_address(0));
+   return do_kzmalloc(size, KMALLOC_FL_LONG_LIVED, caller);
+}
+
+static int
+small_heaps_kfree_locked(void *ptr, size_t *size, u32 flags)
+{
+   int rc;
+   disable_preemption();
+   {
+      rc = small_heaps_kfree(ptr, size, flags);
+   }
+   enable_preemption();
+   return rc;
+}
+
 void general_kfree(void *ptr, size_t *size, u32 flags)
 {
    int rc;
@@ -141,30 +263,54 @@ void general_kfree(void *ptr, size_t *size, u32 flags)
       ASSERT(*size);
    }
 
-   disable_preemption();
-   {
-      if (*size) {
+   if (in_irq()) {
 
-         /* We know which heap set contains our chunk */
+      /*
+       * Don't touch the heaps (and the small heaps lists) from IRQ context, as
+       * the interrupted task might be in the middle of an operation on them:
+       * let a worker thread do the actual free.
+       */
+      defer_kfree(NULL, ptr, size, flags);
+      return;
+   }
 
-         if (*size <= SMALL_HEAP_MAX_ALLOC) {
-            rc = small_heaps_kfree(ptr, size, flags);
-         } else {
-            rc = main_heaps_kfree(ptr, size, flags);
-         }
+   trace_point(tp_kfree, ptr, *size, flags);
+
+   if (KMALLOC_CALLSITE_STATS) {
+      disable_preemption();
+      {
+         kmalloc_account_callsite_free(ptr);
+      }
+      enable_preemption();
+   }
+
+   if (UNLIKELY(samples_used != 0)) {
+      disable_preemption();
+      {
+         kmalloc_sample_free(ptr);
+      }
+      enable_preemption();
+   }
 
+   if (*size) {
 
+      /* We know which heap set contains our chunk */
+
+      if (*size <= SMALL_HEAP_MAX_ALLOC) {
+         rc = small_heaps_kfree_locked(ptr, size, flags);
       } else {
+         rc = main_heaps_kfree(ptr, size, flags);
+      }
 
-         /* We don't know which heap set contains our chunk: try them both */
+   } else {
 
-         rc = small_heaps_kfree(ptr, size, flags);
+      /* We don't know which heap set contains our chunk: try them both */
 
-         if (rc)
-            rc = main_heaps_kfree(ptr, size, flags);
-      }
+      rc = small_heaps_kfree_locked(ptr, size, flags);
+
+      if (rc)
+         rc = main_heaps_kfree(ptr, size, flags);
    }
-   enable_preemption();
 
    if (rc)
       panic("kfree: Heap not found for block: %p\n", ptr);
@@ -12,9 +12,13 @@
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/sort.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/mods/tracing.h>
 
 #include <tilck_gen_headers/config_kmalloc.h>
 
@@ -53,6 +57,15 @@ internal_kfree(struct kmalloc_heap *h,
                bool allow_split,
                bool do_actual_free);
 
+static void
+heap_set_max_free(struct kmalloc_heap *h, size_t max_free);
+
+static void
+kmalloc_init_shrinkers(void);
+
+static void
+kmalloc_check_low_mem(void);
+
 bool is_kmalloc_initialized(void)
 {
    return kmalloc_initialized;
@@ -472,6 +485,11 @@ per_heap_kmalloc_unsafe(struct kmalloc_heap *h, size_t *size, u32 flags)
    const size_t rounded_up_size =
       MAX(roundup_next_power_of_2(original_desired_size), h->min_block_size);
 
+   if (rounded_up_size > h->max_free) {
+      /* We already know that there's no free block big enough */
+      return NULL;
+   }
+
    if (!multi_step_alloc ||
        ((rounded_up_size - original_desired_size) < h->min_block_size))
    {
@@ -487,6 +505,11 @@ per_heap_kmalloc_unsafe(struct kmalloc_heap *h, size_t *size, u32 flags)
                               true,       /* mark node as allocated */
                               do_actual_alloc);
 
+      if (!addr && h->linear_mapping) {
+         /* No free block of `rounded_up_size` bytes: remember that */
+         heap_set_max_free(h, HALF(rounded_up_size));
+      }
+
       if (do_split && addr) {
          internal_kmalloc_split_block(h, addr, *size, sub_blocks_min_size);
       }
@@ -513,8 +536,10 @@ per_heap_kmalloc_unsafe(struct kmalloc_heap *h, size_t *size, u32 flags)
                                       false,            /* mark as allocated */
                                       false);           /* do actual alloc */
 
-   if (!big_block)
+   if (!big_block) {
+      heap_set_max_free(h, HALF(rounded_up_size));
       return NULL;
+   }
 
    const int big_block_node = ptr_to_node(h, big_block, rounded_up_size);
    const int power_of_two_start = (int)h->heap_data_size_log2 - 1;
@@ -626,6 +651,153 @@ per_heap_kmalloc(struct kmalloc_heap *h, size_t *size, u32 flags)
    return res;
 }
 
+/*
+ * Returns true if the leaf node (size: h->min_block_size) at `vaddr` is free.
+ * Note: the leaves of a block allocated as a whole are NOT marked as full:
+ * we must stop at the first non-split node walking down from the root.
+ */
+static bool is_leaf_free(struct kmalloc_heap *h, ulong vaddr)
+{
+   struct block_node *nodes = h->metadata_nodes;
+   int n = 0; /* root's node index */
+   ulong va = h->vaddr;
+   size_t size = h->size;
+
+   while (size > h->min_block_size) {
+
+      if (!nodes[n].split)
+         return !nodes[n].full;
+
+      size >>= 1;
+
+      if (vaddr >= (va + size)) {
+         va += size;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
+
+   return !nodes[n].full;
+}
+
+/*
+ * Allocates the free leaf node at `vaddr`, splitting all of its ancestors and
+ * marking them as full when both of their children are full.
+ */
+static bool
+internal_kmalloc_leaf_at(struct kmalloc_heap *h,
+                         ulong vaddr,
+                         bool do_actual_alloc)
+{
+   struct block_node *nodes = h->metadata_nodes;
+   int n = 0; /* root's node index */
+   ulong va = h->vaddr;
+   size_t size = h->size;
+   void *res;
+   bool success;
+
+   while (size > h->min_block_size) {
+
+      nodes[n].split = true;
+      size >>= 1;
+
+      if (vaddr >= (va + size)) {
+         va += size;
+         n = NODE_RIGHT(n);
+      } else {
+         n = NODE_LEFT(n);
+      }
+   }
+
+   ASSERT(va == vaddr);
+   ASSERT(is_block_node_free(nodes[n]));
+
+   success = actual_allocate_node(h, size, n, &res, do_actual_alloc);
+   ASSERT(res == (void *)vaddr);
+
+   for (int p = n; p != 0; ) {
+
+      p = NODE_PARENT(p);
+
+      if (!nodes[NODE_LEFT(p)].full || !nodes[NODE_RIGHT(p)].full)
+         break;
+
+      nodes[p].full = true;
+   }
+
+   if (UNLIKELY(!success)) {
+      /* See the comment in internal_kmalloc() */
+      size_t actual_size = size;
+      per_heap_kfree_unsafe(h, res, &actual_size, 0);
+      return false;
+   }
+
+   if (do_actual_alloc)
+      h->mem_allocated += size;
+
+   return true;
+}
+
+/*
+ * Allocates exactly the range [vaddr, vaddr + size), if it's completely free.
+ * Useful to grow in-place a chunk previously allocated with the multi-step
+ * and split flags (h->min_block_size sub-blocks), like the user mmap heaps.
+ * The allocation is made one leaf node at a time, so it's meant for heaps with
+ * a relatively big min_block_size. The result can be freed, also partially,
+ * with the KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP flags.
+ */
+bool
+per_heap_kmalloc_at(struct kmalloc_heap *h, void *ptr, size_t size, u32 flags)
+{
+   const bool do_actual_alloc = !(flags & KMALLOC_FL_NO_ACTUAL_ALLOC);
+   const ulong vaddr = (ulong)ptr;
+   bool expected = false;
+   bool success = true;
+   size_t tot;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(size != 0);
+   ASSERT((vaddr & (h->min_block_size - 1)) == 0);
+   ASSERT((size & (h->min_block_size - 1)) == 0);
+
+   if (vaddr < h->vaddr || vaddr + size - 1 > h->heap_last_byte)
+      return false;
+
+   if (!atomic_cas_strong(&h->in_use, &expected, true, mo_relaxed, mo_relaxed))
+      return false; /* heap already in use (we're in IRQ context) */
+
+   for (tot = 0; tot < size; tot += h->min_block_size) {
+      if (!is_leaf_free(h, vaddr + tot)) {
+         success = false;
+         goto out;
+      }
+   }
+
+   for (tot = 0; tot < size; tot += h->min_block_size) {
+      if (!internal_kmalloc_leaf_at(h, vaddr + tot, do_actual_alloc)) {
+         success = false;
+         break;
+      }
+   }
+
+   if (!success && tot > 0) {
+
+      size_t actual_size = tot;
+
+      per_heap_kfree_unsafe(h,
+                            ptr,
+                            &actual_size,
+                            KFREE_FL_ALLOW_SPLIT |
+                            KFREE_FL_MULTI_STEP  |
+                            (do_actual_alloc ? 0 : KFREE_FL_NO_ACTUAL_FREE));
+   }
+
+out:
+   atomic_store_explicit(&h->in_use, false, mo_relaxed);
+   return success;
+}
+
 static void
 internal_kfree(struct kmalloc_heap *h,
                void *ptr,
@@ -666,6 +838,9 @@ internal_kfree(struct kmalloc_heap *h,
 
       ASSERT(biggest_free_node == node || biggest_free_size != size);
 
+      if (biggest_free_size > h->max_free)
+         heap_set_max_free(h, biggest_free_size);
+
       if (biggest_free_size < h->alloc_block_size)
          return;
    }
@@ -801,12 +976,24 @@ per_heap_kfree_unsafe(struct kmalloc_heap *h,
 
    size_t tot = 0;
 
-   for (int i = (int)h->heap_data_size_log2 - 1; i >= 0 && tot < size; i--) {
+   while (tot < size) {
 
-      const size_t sub_block_size = (1 << i);
+      /*
+       * Free the biggest power-of-two sub-block that fits in what's left and
+       * it's naturally aligned at its offset in the heap. For chunks returned
+       * by a multi-step per_heap_kmalloc(), that's exactly the same sequence
+       * of sub-blocks used for the allocation, while for chunks not aligned at
+       * their rounded-up size (e.g. grown with per_heap_kmalloc_at()) that's
+       * the only sequence of valid nodes.
+       */
+      const ulong off = vaddr + tot - h->vaddr;
+      size_t sub_block_size = roundup_next_power_of_2(size - tot);
 
-      if (!(size & sub_block_size))
-         continue;
+      if (sub_block_size > size - tot)
+         sub_block_size >>= 1;
+
+      if (off)
+         sub_block_size = MIN(sub_block_size, (size_t)(off & -off));
 
       internal_kfree(h, ptr + tot, sub_block_size, allow_split, do_actual_free);
       tot += sub_block_size;
@@ -815,6 +1002,11 @@ per_heap_kfree_unsafe(struct kmalloc_heap *h,
    ASSERT(tot == size);
 }
 
+/*
+ * Frees which cannot be done right away, because they happen in IRQ context,
+ * are deferred to a worker thread. When `h` is NULL, the chunk belongs to the
+ * general heaps and general_kfree() is used.
+ */
 struct deferred_kfree_ctx {
 
    struct kmalloc_heap *h;
@@ -828,14 +1020,22 @@ static struct deferred_kfree_ctx emergency_deferred_kfree_ctx_array[8];
 static struct deferred_kfree_ctx *
 get_emergency_deferred_kfree_ctx(void *ptr)
 {
-   for (int i = 0; i < ARRAY_SIZE(emergency_deferred_kfree_ctx_array); i++) {
-      if (emergency_deferred_kfree_ctx_array[i].ptr == NULL) {
-         emergency_deferred_kfree_ctx_array[i].ptr = ptr;
-         return &emergency_deferred_kfree_ctx_array[i];
+   struct deferred_kfree_ctx *res = NULL;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      for (int i = 0; i < ARRAY_SIZE(emergency_deferred_kfree_ctx_array); i++)
+      {
+         if (emergency_deferred_kfree_ctx_array[i].ptr == NULL) {
+            emergency_deferred_kfree_ctx_array[i].ptr = ptr;
+            res = &emergency_deferred_kfree_ctx_array[i];
+            break;
+         }
       }
    }
-
-   return NULL;
+   enable_interrupts(&var);
+   return res;
 }
 
 static bool
@@ -853,16 +1053,67 @@ static void
 do_deferred_kfree(void *arg)
 {
    struct deferred_kfree_ctx *ctx = arg;
+   struct deferred_kfree_ctx c = *ctx;
+   ulong var;
+
+   /* Release the context before the actual free, as soon as possible */
+   if (is_emerg_deferred_kfree_ctx(ctx)) {
+
+      disable_interrupts(&var);
+      {
+         bzero(ctx, sizeof(*ctx));
+      }
+      enable_interrupts(&var);
+
+   } else {
+
+      kfree_obj(ctx, struct deferred_kfree_ctx);
+   }
+
+   if (!c.h) {
+      general_kfree(c.ptr, &c.user_size, c.flags);
+      return;
+   }
 
    disable_preemption();
    {
-      per_heap_kfree(ctx->h, ctx->ptr, &ctx->user_size, ctx->flags);
-      bzero(ctx, sizeof(*ctx));
+      per_heap_kfree(c.h, c.ptr, &c.user_size, c.flags);
    }
    enable_preemption_nosched();
+}
 
-   if (!is_emerg_deferred_kfree_ctx(ctx))
-      kfree_obj(ctx, struct deferred_kfree_ctx);
+static void
+defer_kfree(struct kmalloc_heap *h, void *ptr, size_t *size, u32 flags)
+{
+   struct deferred_kfree_ctx *ctx;
+
+   /*
+    * We're in IRQ context: prefer the static contexts, in order to avoid
+    * touching the heaps at all. Fall back to kmalloc() only when all of them
+    * are in use.
+    */
+   ctx = get_emergency_deferred_kfree_ctx(ptr);
+
+   if (!ctx) {
+
+      ctx = kalloc_obj(struct deferred_kfree_ctx);
+
+      if (!ctx) {
+         /* Give up */
+         printk("kmalloc: ERROR: can't defer kfree %p: OOM\n", ptr);
+         return;
+      }
+   }
+
+   *ctx = (struct deferred_kfree_ctx) {
+      .h = h,
+      .ptr = ptr,
+      .user_size = *size,
+      .flags = flags
+   };
+
+   if (!wth_enqueue_anywhere(WTH_PRIO_HIGHEST, &do_deferred_kfree, ctx))
+      printk("kmalloc: ERROR: can't defer kfree %p: enqueue fail\n", ptr);
 }
 
 NO_INLINE static void
@@ -893,29 +1144,7 @@ per_heap_kfree_used_heap_corner_case(struct kmalloc_heap *h,
       ASSERT(*size);
    }
 
-   struct deferred_kfree_ctx *ctx = kalloc_obj(struct deferred_kfree_ctx);
-
-   if (!ctx) {
-
-      /* Could we get more unlucky than that? */
-      ctx = get_emergency_deferred_kfree_ctx(ptr);
-
-      if (!ctx) {
-         /* Give up */
-         printk("kmalloc: ERROR: can't defer kfree %p: OOM\n", ptr);
-         return;
-      }
-   }
-
-   *ctx = (struct deferred_kfree_ctx) {
-      .h = h,
-      .ptr = ptr,
-      .user_size = *size,
-      .flags = flags
-   };
-
-   if (!wth_enqueue_anywhere(WTH_PRIO_HIGHEST, &do_deferred_kfree, ctx))
-      printk("kmalloc: ERROR: can't defer kfree %p: enqueue fail\n", ptr);
+   defer_kfree(h, ptr, size, flags);
 }
 
 void
@@ -939,17 +1168,6 @@ per_heap_kfree(struct kmalloc_heap *h,
    atomic_store_explicit(&h->in_use, false, mo_relaxed);
 }
 
-void *kzmalloc(size_t size)
-{
-   void *res = kmalloc(size);
-
-   if (!res)
-      return NULL;
-
-   bzero(res, size);
-   return res;
-}
-
 static
 void vfree_internal(ulong va_begin, ulong va_end)
 {
@@ -1016,4 +1234,5 @@ void vfree2(void *ptr, size_t size)
 #include "kmalloc_heaps.c.h"
 #include "general_kmalloc.c.h"
 #include "kmalloc_accelerator.c.h"
-
+#include "kmalloc_cache.c.h"
+#include "kmalloc_shrinkers.c.h"
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#ifndef _KMALLOC_C_
+
+   #error This is NOT a header file and it is not meant to be included
+
+   /*
+    * The only purpose of this file is to keep kmalloc.c shorter.
+    * Yes, this file could be turned into a regular C source file, but at the
+    * price of making several static functions and variables in kmalloc.c to be
+    * just non-static. We don't want that. Code isolation is a GOOD thing.
+    */
+
+#endif
+
+STATIC struct kmalloc_cache *caches_list;
+
+static ALWAYS_INLINE void
+pool_push(struct kmalloc_cache *c, void *obj)
+{
+   *(void **)obj = c->free_list;
+   c->free_list = obj;
+   c->free_count++;
+}
+
+static ALWAYS_INLINE void *
+pool_pop(struct kmalloc_cache *c)
+{
+   void *obj = c->free_list;
+
+   if (obj) {
+      c->free_list = *(void **)obj;
+      c->free_count--;
+   }
+
+   return obj;
+}
+
+static void
+kmalloc_cache_init(struct kmalloc_cache *c)
+{
+   const u32 min_sz = MAX(c->obj_size, (u32)SMALL_HEAP_MBS);
+   const u32 sz = (u32)roundup_next_power_of_2(min_sz);
+   const u32 elem_c = MAX(KMALLOC_CACHE_SLAB_SIZE / sz, 1u);
+   void *obj;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(c->obj_size > 0);
+   ASSERT(!c->pool || !c->ctor);
+
+   c->obj_size = sz;
+   kmalloc_create_accelerator(&c->acc, sz, elem_c);
+
+   for (u32 i = 0; i < c->prealloc; i++) {
+
+      if (!(obj = kmalloc_accelerator_get_elem(&c->acc)))
+         break;
+
+      pool_push(c, obj);
+   }
+
+   c->next = caches_list;
+   caches_list = c;
+   c->initialized = true;
+}
+
+void *
+kmalloc_cache_alloc(struct kmalloc_cache *c)
+{
+   void *obj;
+   bool fresh = false;
+
+   DEBUG_ONLY(check_not_in_irq_handler());
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!c->initialized))
+         kmalloc_cache_init(c);
+
+      c->allocs++;
+
+      if (LIKELY(c->mag_count > 0)) {
+
+         obj = c->mag[--c->mag_count];
+         c->hits++;
+
+      } else if ((obj = pool_pop(c))) {
+
+         c->hits++;
+
+      } else {
+
+         obj = kmalloc_accelerator_get_elem(&c->acc);
+         fresh = true;
+      }
+   }
+   enable_preemption();
+
+   if (fresh && obj && c->ctor)
+      c->ctor(obj);
+
+   return obj;
+}
+
+void
+kmalloc_cache_free(struct kmalloc_cache *c, void *obj)
+{
+   size_t actual_size;
+
+   if (!obj)
+      return;
+
+   DEBUG_ONLY(check_not_in_irq_handler());
+   ASSERT(c->initialized);
+
+   disable_preemption();
+   {
+      c->frees++;
+
+      if (LIKELY(c->mag_count < ARRAY_SIZE(c->mag))) {
+         c->mag[c->mag_count++] = obj;
+         obj = NULL;
+      } else if (c->pool) {
+         pool_push(c, obj);
+         obj = NULL;
+      } else {
+         c->spills++;
+      }
+   }
+   enable_preemption();
+
+   if (obj) {
+
+      /* The magazine is full: return the object to the heap */
+      actual_size = c->obj_size;
+      general_kfree(obj, &actual_size, KFREE_FL_ALLOW_SPLIT);
+      ASSERT(actual_size == c->obj_size);
+   }
+}
+
+void
+kmalloc_cache_shrink(struct kmalloc_cache *c)
+{
+   size_t actual_size;
+   void *obj;
+
+   if (!c->initialized)
+      return;
+
+   while (true) {
+
+      disable_preemption();
+      {
+         obj = c->mag_count > 0 ? c->mag[--c->mag_count] : pool_pop(c);
+      }
+      enable_preemption();
+
+      if (!obj)
+         break;
+
+      actual_size = c->obj_size;
+      general_kfree(obj, &actual_size, KFREE_FL_ALLOW_SPLIT);
+   }
+
+   disable_preemption();
+   {
+      /* Free also the not-yet-used objects of the current slab */
+      kmalloc_destroy_accelerator(&c->acc);
+   }
+   enable_preemption();
+}
+
+void
+kmalloc_cache_destroy(struct kmalloc_cache *c)
+{
+   struct kmalloc_cache **p;
+
+   if (!c->initialized)
+      return;
+
+   kmalloc_cache_shrink(c);
+
+   disable_preemption();
+   {
+      for (p = &caches_list; *p && *p != c; p = &(*p)->next) { }
+
+      if (*p)
+         *p = c->next;
+
+      c->next = NULL;
+      c->initialized = false;
+   }
+   enable_preemption();
+}
+
+bool
+debug_kmalloc_get_cache_info(int n, struct debug_kmalloc_cache_info *i)
+{
+   struct kmalloc_cache *c;
+   bool found = false;
+
+   disable_preemption();
+   {
+      for (c = caches_list; c && n > 0; c = c->next, n--) { }
+
+      if (c) {
+
+         *i = (struct debug_kmalloc_cache_info) {
+            .name = c->name,
+            .obj_size = c->obj_size,
+            .cached = c->mag_count + c->free_count,
+            .allocs = c->allocs,
+            .hits = c->hits,
+            .frees = c->frees,
+            .spills = c->spills,
+         };
+
+         found = true;
+      }
+   }
+   enable_preemption();
+   return found;
+}
@@ -15,8 +15,16 @@ struct kmalloc_heap {
    size_t mem_allocated;
    void *metadata_nodes;
    int region;
+   int main_idx;        /* index in heaps[] or -1 if not a main heap */
    ATOMIC(bool) in_use;
 
+   /*
+    * Upper bound of the biggest free block in the heap: it gets lowered when
+    * an allocation fails and raised by kfree, so it's never smaller than the
+    * actual value. Always a power of 2.
+    */
+   size_t max_free;
+
    size_t min_block_size;
    size_t alloc_block_size;
 
@@ -22,6 +22,100 @@ STATIC struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
 STATIC int used_heaps;
 STATIC size_t max_tot_heap_mem_free;
 
+/*
+ * Index of the main heaps by free-size class: the bit `i` of heaps_fit[k] is
+ * set when heaps[i]->max_free >= 2^k. That allows main_heaps_kmalloc() to
+ * skip, with a single lookup, all the heaps that certainly cannot fit a block
+ * of a given size.
+ */
+#define HEAPS_FIT_CLASSES                 ((int)(sizeof(ulong) * 8))
+
+STATIC_ASSERT(KMALLOC_HEAPS_COUNT <= 32);
+
+STATIC u32 heaps_fit[HEAPS_FIT_CLASSES];
+STATIC u32 dma_heaps_mask;
+
+/*
+ * Long-lived heaps: the smallest (non-DMA) main heaps, up to a total size of
+ * 1/KMALLOC_LONG_LIVED_DIV of the memory in the heaps. The biggest heap is
+ * never one of them. See kmalloc_long_lived().
+ */
+#define KMALLOC_LONG_LIVED_DIV            8
+
+STATIC u32 long_lived_heaps_mask;
+
+static inline int heap_fit_class(size_t max_free)
+{
+   return max_free ? (int)log2_for_power_of_2(max_free) : -1;
+}
+
+static void heap_set_max_free(struct kmalloc_heap *h, size_t max_free)
+{
+   const int old_cls = heap_fit_class(h->max_free);
+   const int new_cls = heap_fit_class(max_free);
+   u32 bit;
+   ulong var;
+
+   ASSERT(roundup_next_power_of_2(max_free) == max_free);
+   h->max_free = max_free;
+
+   if (h->main_idx < 0)
+      return;
+
+   bit = 1u << h->main_idx;
+
+   /* The main heaps are used also in IRQ context */
+   disable_interrupts(&var);
+   {
+      for (int k = old_cls + 1; k <= new_cls; k++)
+         heaps_fit[k] |= bit;
+
+      for (int k = new_cls + 1; k <= old_cls; k++)
+         heaps_fit[k] &= ~bit;
+   }
+   enable_interrupts(&var);
+}
+
+static void kmalloc_index_heap(int i)
+{
+   struct kmalloc_heap *h = heaps[i];
+   const int cls = heap_fit_class(h->max_free);
+   const u32 bit = 1u << i;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      h->main_idx = i;
+
+      for (int k = 0; k < HEAPS_FIT_CLASSES; k++) {
+         if (k <= cls)
+            heaps_fit[k] |= bit;
+         else
+            heaps_fit[k] &= ~bit;
+      }
+
+      if (h->dma)
+         dma_heaps_mask |= bit;
+      else
+         dma_heaps_mask &= ~bit;
+   }
+   enable_interrupts(&var);
+}
+
+/*
+ * Returns the mask of the main heaps that might have a free block of `size`
+ * bytes. Heaps not in the mask certainly don't have such a block.
+ */
+static u32 kmalloc_get_fit_heaps(size_t size, bool dma)
+{
+   const int cls = heap_fit_class(roundup_next_power_of_2(size));
+
+   if (cls < 0 || cls >= HEAPS_FIT_CLASSES)
+      return 0; /* `size` is so big that roundup_next_power_of_2() overflowed */
+
+   return heaps_fit[cls] & (dma ? dma_heaps_mask : ~dma_heaps_mask);
+}
+
 void *kmalloc_get_first_heap(size_t *size)
 {
    static char buf[KMALLOC_FIRST_HEAP_SIZE] ALIGNED_AT(KMALLOC_MAX_ALIGN);
@@ -105,6 +199,8 @@ kmalloc_create_heap(struct kmalloc_heap *h,
    h->alloc_block_size = alloc_block_size;
    h->metadata_nodes = metadata_nodes;
    h->region = -1;
+   h->main_idx = -1;
+   h->max_free = size;
    kmalloc_heap_set_pre_calculated_values(h);
 
    bzero(h->metadata_nodes, h->metadata_size);
@@ -166,6 +262,7 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t new_size)
 
    memcpy(new_heap, h, sizeof(struct kmalloc_heap));
 
+   new_heap->main_idx = -1;
    new_heap->size = new_size;
    new_heap->metadata_size =
       calculate_heap_metadata_size(new_size, new_heap->min_block_size);
@@ -185,6 +282,9 @@ kmalloc_heap_dup_expanded(struct kmalloc_heap *h, size_t new_size)
    kmalloc_heap_set_pre_calculated_values(new_heap);
    bzero(new_heap->metadata_nodes, new_heap->metadata_size);
 
+   /* The new part of the heap is free, but it won't coalesce with the rest */
+   new_heap->max_free = MAX(h->max_free, new_size / 2);
+
    struct block_node *new_nodes = new_heap->metadata_nodes;
    struct block_node *old_nodes = h->metadata_nodes;
    size_t nodes_per_row = 1;
@@ -338,10 +438,39 @@ init_kmalloc_fill_region(int region, ulong vaddr, ulong limit, bool dma)
 
       heaps[heap_index]->region = region;
       heaps[heap_index]->dma = dma;
+      kmalloc_index_heap(heap_index);
       vaddr = heaps[heap_index]->vaddr + heaps[heap_index]->size;
    }
 }
 
+static void kmalloc_select_long_lived_heaps(void)
+{
+   size_t tot = 0, ll_tot = 0, target;
+   u32 mask = 0;
+
+   for (int i = 0; i < used_heaps; i++)
+      tot += heaps[i]->size;
+
+   target = tot / KMALLOC_LONG_LIVED_DIV;
+
+   /* The heaps are sorted by size (see init_kmalloc), the biggest first */
+   for (int i = used_heaps - 1; i > 0; i--) {
+
+      struct kmalloc_heap *h = heaps[i];
+
+      if (h->dma)
+         continue;
+
+      if (ll_tot + h->size > target)
+         break;
+
+      ll_tot += h->size;
+      mask |= (1u << i);
+   }
+
+   long_lived_heaps_mask = mask;
+}
+
 void early_init_kmalloc(void)
 {
    int heap_index;
@@ -349,9 +478,13 @@ void early_init_kmalloc(void)
    ASSERT(!kmalloc_initialized);
    list_init(&small_heaps_list);
    list_init(&avail_small_heaps_list);
+   kmalloc_init_shrinkers();
 
    used_heaps = 0;
    bzero(heaps, sizeof(heaps));
+   bzero(heaps_fit, sizeof(heaps_fit));
+   dma_heaps_mask = 0;
+   long_lived_heaps_mask = 0;
 
    {
       size_t first_heap_size;
@@ -361,6 +494,7 @@ void early_init_kmalloc(void)
    }
 
    VERIFY(heap_index == 0);
+   kmalloc_index_heap(heap_index);
 
    kmalloc_initialized = true; /* we have at least 1 heap */
 
@@ -368,6 +502,9 @@ void early_init_kmalloc(void)
       kmalloc_init_heavy_stats();
       kmalloc_account_alloc(heaps[0]->metadata_size);
    }
+
+   if (KMALLOC_CALLSITE_STATS)
+      kmalloc_init_callsite_stats();
 }
 
 void init_kmalloc(void)
@@ -411,8 +548,43 @@ void init_kmalloc(void)
       if (!h)
          continue;
 
+      /* The sort moved the heaps around: index them again */
+      kmalloc_index_heap(i);
       max_tot_heap_mem_free += (h->size - h->mem_allocated);
    }
+
+   kmalloc_select_long_lived_heaps();
+
+   kmalloc_init_leak_sampler();
+}
+
+/*
+ * Turns the free memory at [vaddr, limit), in the linear mapping, into new
+ * heaps after boot. The range is expected to be aligned at
+ * KMALLOC_MIN_HEAP_SIZE: whatever doesn't fit in a heap is just lost.
+ *
+ * NOTE: the new heaps are appended without sorting `heaps` again, because a
+ * task preempted while walking the array must find the heaps where it left
+ * them. Nothing breaks: the order just makes kmalloc prefer the small heaps.
+ */
+void kmalloc_add_heaps(ulong vaddr, ulong limit)
+{
+   const int region = system_mmap_get_region_of(LIN_VA_TO_PA(vaddr));
+   int first;
+
+   ASSERT(kmalloc_initialized);
+
+   disable_preemption();
+   {
+      first = used_heaps;
+      init_kmalloc_fill_region(region, vaddr, limit, false);
+
+      for (int i = first; i < used_heaps; i++) {
+         struct kmalloc_heap *h = heaps[i];
+         max_tot_heap_mem_free += (h->size - h->mem_allocated);
+      }
+   }
+   enable_preemption();
 }
 
 size_t kmalloc_get_max_tot_heap_free(void)
@@ -431,6 +603,8 @@ debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
       .min_block_size = h->min_block_size,
       .alloc_block_size = h->alloc_block_size,
       .region = h->region,
+      .long_lived = h->main_idx >= 0 &&
+                    !!(long_lived_heaps_mask & (1u << h->main_idx)),
    };
 }
 
@@ -446,6 +620,44 @@ debug_kmalloc_get_heap_info(int heap_num, struct debug_kmalloc_heap_info *i)
    return true;
 }
 
+static size_t
+heap_largest_free_block(struct kmalloc_heap *h, int node, size_t size)
+{
+   struct block_node *nodes = h->metadata_nodes;
+   size_t left;
+
+   if (is_block_node_free(nodes[node]))
+      return size;
+
+   /* Allocated or completely full */
+   if (!nodes[node].split || nodes[node].full || size == h->min_block_size)
+      return 0;
+
+   left = heap_largest_free_block(h, NODE_LEFT(node), size / 2);
+
+   if (left == size / 2)
+      return left;
+
+   return MAX(left, heap_largest_free_block(h, NODE_RIGHT(node), size / 2));
+}
+
+/*
+ * Returns the size of the biggest free block in the given main heap, by
+ * walking its metadata. Unlike `max_free`, that's the exact value, but it's
+ * slow: use it only for debugging. The preemption must be disabled.
+ */
+size_t
+debug_kmalloc_get_heap_largest_free(int heap_num)
+{
+   struct kmalloc_heap *h = heaps[heap_num];
+   ASSERT(!is_preemption_enabled());
+
+   if (!h)
+      return 0;
+
+   return heap_largest_free_block(h, 0, h->size);
+}
+
 void
 debug_kmalloc_get_stats(struct debug_kmalloc_stats *stats)
 {
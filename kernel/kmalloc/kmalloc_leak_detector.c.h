@@ -174,3 +174,160 @@ static NO_INLINE void debug_kmalloc_register_free(void *vaddr, size_t s)
 #define debug_kmalloc_register_free(...)
 
 #endif
+
+/*
+ * Leak sampling (-kmalloc_sample N): unlike the leak detector above, it's
+ * cheap enough to stay on all the time. One allocation every N is tracked in a
+ * fixed-size open-addressing hash table keyed by address, together with its
+ * call site and the time of the allocation: the sampled blocks still alive
+ * after a long time are likely leaks. Allocations in IRQ context are never
+ * sampled, so the table is touched only with preemption disabled.
+ */
+
+#define KMALLOC_SAMPLES_COUNT                     1024
+
+struct kmalloc_sample {
+
+   ulong ptr;                       /* 0 means empty slot */
+   ulong caller;
+   u64 ticks;                       /* get_ticks() at the time of the alloc */
+   u32 size;
+};
+
+static struct kmalloc_sample *samples;
+static u32 samples_used;
+static u32 samples_dropped;
+static u32 sample_countdown;
+
+static void kmalloc_init_leak_sampler(void)
+{
+   samples = NULL;
+   samples_used = 0;
+   samples_dropped = 0;
+   sample_countdown = (u32)kopt_kmalloc_sample;
+
+   if (!kopt_kmalloc_sample)
+      return;
+
+   samples = kzalloc_array_obj(struct kmalloc_sample, KMALLOC_SAMPLES_COUNT);
+
+   if (!samples) {
+      printk("kmalloc: WARNING: no memory for the leak sampler\n");
+      return;
+   }
+
+   printk("kmalloc: sampling 1 alloc every %lu\n", kopt_kmalloc_sample);
+}
+
+/*
+ * Called for each allocation when the sampler is on. The countdown is not
+ * protected on purpose: a race with another task can only make us sample one
+ * allocation more or less.
+ */
+static ALWAYS_INLINE bool kmalloc_should_sample(void)
+{
+   if (--sample_countdown)
+      return false;
+
+   sample_countdown = (u32)kopt_kmalloc_sample;
+   return true;
+}
+
+static void kmalloc_sample_alloc(void *ptr, size_t size, ulong caller)
+{
+   u32 i;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* Keep the table at most 3/4 full, for the linear probing */
+   if (samples_used >= KMALLOC_SAMPLES_COUNT / 4 * 3) {
+      samples_dropped++;
+      return;
+   }
+
+   i = callsite_hash((ulong)ptr) % KMALLOC_SAMPLES_COUNT;
+
+   /* A stale entry for the same address is just replaced */
+   while (samples[i].ptr && samples[i].ptr != (ulong)ptr)
+      i = (i + 1) % KMALLOC_SAMPLES_COUNT;
+
+   if (!samples[i].ptr)
+      samples_used++;
+
+   samples[i] = (struct kmalloc_sample) {
+      .ptr = (ulong)ptr,
+      .caller = caller,
+      .ticks = get_ticks(),
+      .size = (u32)size,
+   };
+}
+
+static void kmalloc_sample_free(void *ptr)
+{
+   u32 i, j, h;
+
+   ASSERT(!is_preemption_enabled());
+   i = callsite_hash((ulong)ptr) % KMALLOC_SAMPLES_COUNT;
+
+   while (samples[i].ptr != (ulong)ptr) {
+
+      if (!samples[i].ptr)
+         return;        /* Not sampled */
+
+      i = (i + 1) % KMALLOC_SAMPLES_COUNT;
+   }
+
+   samples_used--;
+
+   /* Backward-shift deletion, as in kmalloc_account_callsite_free() */
+   j = i;
+
+   while (true) {
+
+      j = (j + 1) % KMALLOC_SAMPLES_COUNT;
+
+      if (!samples[j].ptr)
+         break;
+
+      h = callsite_hash(samples[j].ptr) % KMALLOC_SAMPLES_COUNT;
+
+      /* Skip the entry if its home slot `h` is cyclically in (i, j] */
+      if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+         continue;
+
+      samples[i] = samples[j];
+      i = j;
+   }
+
+   samples[i].ptr = 0;
+}
+
+/*
+ * Reads the slot `n` of the samples table, with i->ptr = 0 for empty slots.
+ * Returns false when `n` is past the end of the table or the sampler is off.
+ */
+bool
+debug_kmalloc_get_sample(int n, struct debug_kmalloc_sample_info *i)
+{
+   if (!samples || n < 0 || n >= KMALLOC_SAMPLES_COUNT)
+      return false;
+
+   disable_preemption();
+   {
+      *i = (struct debug_kmalloc_sample_info) {
+         .ptr = samples[n].ptr,
+         .caller = samples[n].caller,
+         .ticks = samples[n].ticks,
+         .size = samples[n].size,
+      };
+   }
+   enable_preemption();
+   return true;
+}
+
+void
+debug_kmalloc_get_samples_stats(u32 *used, u32 *dropped)
+{
+   *used = samples_used;
+   *dropped = samples_dropped;
+}
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#ifndef _KMALLOC_C_
+
+   #error This is NOT a header file and it is not meant to be included
+
+   /*
+    * The only purpose of this file is to keep kmalloc.c shorter.
+    * Yes, this file could be turned into a regular C source file, but at the
+    * price of making several static functions and variables in kmalloc.c to be
+    * just non-static. We don't want that. Code isolation is a GOOD thing.
+    */
+
+#endif
+
+static struct shrinker *shrinkers_list;
+static bool shrinking;
+static bool low_mem_job_enqueued;
+static u64 low_mem_job_last_run;
+
+/*
+ * The built-in shrinker: it returns to the heaps the objects in the magazines
+ * of the regular caches. Pool caches are skipped on purpose: they exist to
+ * guarantee that their objects will be available.
+ */
+static size_t kmalloc_caches_shrink(struct shrinker *s, size_t bytes)
+{
+   struct kmalloc_cache *c;
+   size_t actual_size, freed = 0;
+   void *obj;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (c = caches_list; c && freed < bytes; c = c->next) {
+
+      if (c->pool)
+         continue;
+
+      while (c->mag_count > 0 && freed < bytes) {
+
+         obj = c->mag[--c->mag_count];
+         actual_size = c->obj_size;
+         general_kfree(obj, &actual_size, KFREE_FL_ALLOW_SPLIT);
+         freed += c->obj_size;
+      }
+   }
+
+   return freed;
+}
+
+static struct shrinker caches_shrinker = {
+   .name = "kmalloc_caches",
+   .shrink = &kmalloc_caches_shrink,
+};
+
+static void kmalloc_init_shrinkers(void)
+{
+   caches_shrinker.next = NULL;
+   shrinkers_list = &caches_shrinker;
+   low_mem_job_enqueued = false;
+}
+
+void register_shrinker(struct shrinker *s)
+{
+   struct shrinker **p;
+
+   disable_preemption();
+   {
+      /* Append, in order to call first the shrinkers registered first */
+      for (p = &shrinkers_list; *p && *p != s; p = &(*p)->next) { }
+
+      if (!*p) {
+         s->next = NULL;
+         *p = s;
+      }
+   }
+   enable_preemption();
+}
+
+void unregister_shrinker(struct shrinker *s)
+{
+   struct shrinker **p;
+
+   disable_preemption();
+   {
+      for (p = &shrinkers_list; *p; p = &(*p)->next) {
+
+         if (*p == s) {
+            *p = s->next;
+            break;
+         }
+      }
+   }
+   enable_preemption();
+}
+
+size_t kmalloc_shrink(size_t bytes)
+{
+   struct shrinker *s;
+   size_t freed = 0, n;
+
+   disable_preemption();
+
+   if (shrinking) {
+
+      /* A shrinker called kmalloc(): don't recurse */
+      enable_preemption();
+      return 0;
+   }
+
+   shrinking = true;
+
+   for (s = shrinkers_list; s && freed < bytes; s = s->next) {
+
+      n = s->shrink(s, bytes - freed);
+      s->calls++;
+      s->freed += n;
+      freed += n;
+   }
+
+   shrinking = false;
+   enable_preemption();
+   return freed;
+}
+
+static void kmalloc_get_heaps_free_mem(size_t *tot, size_t *free)
+{
+   *tot = *free = 0;
+
+   for (int i = 0; i < used_heaps; i++) {
+      *tot += heaps[i]->size;
+      *free += heaps[i]->size - heaps[i]->mem_allocated;
+   }
+}
+
+static void kmalloc_low_mem_job(void *unused)
+{
+   size_t tot, free, high_wm;
+
+   disable_preemption();
+   {
+      kmalloc_get_heaps_free_mem(&tot, &free);
+   }
+   enable_preemption();
+
+   /* Free memory up to twice the low watermark, to avoid running too often */
+   high_wm = 2 * (tot / KMALLOC_LOW_WATERMARK_DIV);
+
+   if (free < high_wm)
+      kmalloc_shrink(high_wm - free);
+
+   low_mem_job_last_run = get_ticks();
+   low_mem_job_enqueued = false;
+}
+
+/*
+ * Called after each allocation in the main heaps: if the free memory is below
+ * the low watermark, ask a worker thread to run the shrinkers. Don't do that
+ * more than once per second, because it's pointless when the shrinkers have
+ * nothing left to free.
+ */
+static void kmalloc_check_low_mem(void)
+{
+   size_t tot, free;
+
+   if (KERNEL_TEST_INT || low_mem_job_enqueued)
+      return;
+
+   disable_preemption();
+   {
+      kmalloc_get_heaps_free_mem(&tot, &free);
+
+      if (free >= tot / KMALLOC_LOW_WATERMARK_DIV ||
+          low_mem_job_enqueued ||
+          (low_mem_job_last_run &&
+           get_ticks() - low_mem_job_last_run < TIMER_HZ))
+      {
+         enable_preemption();
+         return;
+      }
+
+      low_mem_job_enqueued = true;
+   }
+   enable_preemption();
+
+   if (!wth_enqueue_anywhere(WTH_PRIO_LOWEST, &kmalloc_low_mem_job, NULL))
+      low_mem_job_enqueued = false;
+}
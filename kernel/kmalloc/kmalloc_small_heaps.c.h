@@ -124,10 +124,14 @@ alloc_new_small_heap_unsafe(void)
     * kmalloc stats (when enabled) to account this allocation, as it's not
     * really a proper allocation: it's the creation of a small heap. Instead,
     * the allocation for its metadata is explicitly accounted (see below) since
-    * some memory was actually consumed.
+    * some memory was actually consumed. The small heaps are long-lived, as
+    * they're shared by many small blocks with unrelated lifetimes.
     */
 
-   if (!(heap_data = general_kmalloc(&small_heap_sz, KMALLOC_FL_DONT_ACCOUNT)))
+   heap_data = general_kmalloc(&small_heap_sz,
+                               KMALLOC_FL_DONT_ACCOUNT | KMALLOC_FL_LONG_LIVED);
+
+   if (!heap_data)
       return NULL;
 
    ASSERT(small_heap_sz == SMALL_HEAP_SIZE);
@@ -129,3 +129,209 @@ debug_kmalloc_chunks_stats_next(struct debug_kmalloc_chunks_ctx *ctx,
    return true;
 }
 
+
+/*
+ * Call-site stats (KMALLOC_CALLSITE_STATS): each allocation is attributed to
+ * the return address of general_kmalloc(), i.e. to the code that called
+ * kmalloc() or kzmalloc(). The sites live in a fixed-size open-addressing hash
+ * table: when it's full, the allocations of the new sites are just counted as
+ * `untracked`. In order to compute the live bytes per site, the live chunks
+ * are also kept in a (bigger) hash table, mapping each pointer to its site.
+ */
+
+#define CALLSITES_COUNT                            512
+#define CALLSITE_PTRS_COUNT                       8192
+
+struct kmalloc_callsite {
+
+   ulong caller;                    /* 0 means empty slot */
+   u32 count;
+   u64 bytes;
+   size_t live_bytes;
+};
+
+struct kmalloc_callsite_ptr {
+
+   ulong ptr;                       /* 0 means empty slot */
+   u32 size;
+   u32 site;                        /* index in `callsites` */
+};
+
+static struct kmalloc_callsite *callsites;
+static struct kmalloc_callsite_ptr *callsite_ptrs;
+static u32 callsite_ptrs_used;
+static u32 callsites_untracked;
+
+static inline u32 callsite_hash(ulong val)
+{
+   return (u32)((val >> 2) * 2654435761u);
+}
+
+static struct kmalloc_callsite *kmalloc_get_callsite(ulong caller)
+{
+   u32 i = callsite_hash(caller) % CALLSITES_COUNT;
+
+   for (u32 n = 0; n < CALLSITES_COUNT; n++) {
+
+      struct kmalloc_callsite *s = &callsites[i];
+
+      if (s->caller == caller)
+         return s;
+
+      if (!s->caller) {
+         s->caller = caller;
+         return s;
+      }
+
+      i = (i + 1) % CALLSITES_COUNT;
+   }
+
+   return NULL;
+}
+
+static void
+kmalloc_account_callsite_alloc(void *ptr, size_t size, ulong caller)
+{
+   struct kmalloc_callsite *s;
+   u32 i;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!callsites)
+      return;
+
+   if (!(s = kmalloc_get_callsite(caller))) {
+      callsites_untracked++;
+      return;
+   }
+
+   s->count++;
+   s->bytes += size;
+
+   /* Keep the ptr table at most 3/4 full, for the linear probing */
+   if (callsite_ptrs_used >= CALLSITE_PTRS_COUNT / 4 * 3)
+      return;
+
+   i = callsite_hash((ulong)ptr) % CALLSITE_PTRS_COUNT;
+
+   while (callsite_ptrs[i].ptr)
+      i = (i + 1) % CALLSITE_PTRS_COUNT;
+
+   callsite_ptrs[i] = (struct kmalloc_callsite_ptr) {
+      .ptr = (ulong)ptr,
+      .size = (u32)size,
+      .site = (u32)(s - callsites),
+   };
+
+   callsite_ptrs_used++;
+   s->live_bytes += size;
+}
+
+static void kmalloc_account_callsite_free(void *ptr)
+{
+   struct kmalloc_callsite_ptr *e;
+   u32 i, j, h;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!callsite_ptrs)
+      return;
+
+   i = callsite_hash((ulong)ptr) % CALLSITE_PTRS_COUNT;
+
+   while (callsite_ptrs[i].ptr != (ulong)ptr) {
+
+      if (!callsite_ptrs[i].ptr)
+         return;        /* Not tracked */
+
+      i = (i + 1) % CALLSITE_PTRS_COUNT;
+   }
+
+   e = &callsite_ptrs[i];
+   callsites[e->site].live_bytes -= e->size;
+   callsite_ptrs_used--;
+
+   /*
+    * Backward-shift deletion: move back the following entries of the cluster
+    * that would not be reachable anymore, starting from their home slot, once
+    * the i-th slot becomes empty. That way, we don't need tombstones.
+    */
+   j = i;
+
+   while (true) {
+
+      j = (j + 1) % CALLSITE_PTRS_COUNT;
+
+      if (!callsite_ptrs[j].ptr)
+         break;
+
+      h = callsite_hash(callsite_ptrs[j].ptr) % CALLSITE_PTRS_COUNT;
+
+      /* Skip the entry if its home slot `h` is cyclically in (i, j] */
+      if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+         continue;
+
+      callsite_ptrs[i] = callsite_ptrs[j];
+      i = j;
+   }
+
+   callsite_ptrs[i].ptr = 0;
+}
+
+static void kmalloc_init_callsite_stats(void)
+{
+   struct kmalloc_callsite *sites;
+   struct kmalloc_callsite_ptr *ptrs;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (KERNEL_TEST_INT)
+      return;
+
+   sites = kzalloc_array_obj(struct kmalloc_callsite, CALLSITES_COUNT);
+   ptrs = kzalloc_array_obj(struct kmalloc_callsite_ptr, CALLSITE_PTRS_COUNT);
+
+   if (!sites || !ptrs)
+      panic("Unable to alloc memory for the kmalloc call-site stats");
+
+   callsites = sites;
+   callsite_ptrs = ptrs;
+   printk("kmalloc: call-site stats enabled (%d sites)\n", CALLSITES_COUNT);
+}
+
+bool
+debug_kmalloc_get_callsite_info(int n, struct debug_kmalloc_callsite_info *i)
+{
+   bool found = false;
+
+   if (!KMALLOC_CALLSITE_STATS || !callsites)
+      return false;
+
+   disable_preemption();
+   {
+      for (int k = 0; k < CALLSITES_COUNT; k++) {
+
+         struct kmalloc_callsite *s = &callsites[k];
+
+         if (!s->caller || n-- > 0)
+            continue;
+
+         *i = (struct debug_kmalloc_callsite_info) {
+            .caller = s->caller,
+            .count = s->count,
+            .bytes = s->bytes,
+            .live_bytes = s->live_bytes,
+         };
+
+         found = true;
+         break;
+      }
+   }
+   enable_preemption();
+   return found;
+}
+
+u32 debug_kmalloc_get_untracked_callsites_allocs(void)
+{
+   return callsites_untracked;
+}
@@ -6,6 +6,9 @@
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/irq.h>
+#include <tilck/kernel/cmdline.h>
+
+static struct kmutex_spin_stats spin_stats;
 
 bool kmutex_is_curr_task_holding_lock(struct kmutex *m)
 {
@@ -25,6 +28,81 @@ void kmutex_destroy(struct kmutex *m)
    bzero(m, sizeof(struct kmutex));
 }
 
+/*
+ * Priority inheritance
+ * ---------------------
+ *
+ * When a task blocks on a kmutex, the owner (and the owner of the kmutex the
+ * owner is blocked on, if any, and so on) inherits its effective RT priority.
+ * This way, an RT task blocked on a mutex held by a fair task waits only for
+ * the critical section, not for the timeslices of all the other fair tasks.
+ *
+ * The boost is dropped only when the owner releases ALL of its kmutexes: the
+ * kmutexes don't track which waiter boosted them and a task holds very few
+ * kmutexes at a time anyway, so that's a good trade-off.
+ */
+
+#define KMUTEX_PI_MAX_DEPTH                        8
+
+static void kmutex_set_owner(struct kmutex *m, struct task *ti)
+{
+   m->owner_task = ti;
+   ti->held_kmutexes++;
+}
+
+static void kmutex_pi_boost(struct kmutex *m, int prio)
+{
+   struct task *owner = m->owner_task;
+
+   for (int i = 0; owner && i < KMUTEX_PI_MAX_DEPTH; i++) {
+
+      if (is_worker_thread(owner) || owner->eff_rt_prio >= prio)
+         break;
+
+      sched_set_eff_rt_prio(owner, prio);
+
+      /* Propagate the boost through the chain of blocked owners */
+      if (owner->state != TASK_STATE_SLEEPING)
+         break;
+
+      if (owner->wobj.type != WOBJ_KMUTEX)
+         break;
+
+      if (!(m = wait_obj_get_ptr(&owner->wobj)))
+         break;
+
+      owner = m->owner_task;
+   }
+}
+
+static void kmutex_pi_release(struct task *ti)
+{
+   ASSERT(ti->held_kmutexes > 0);
+
+   if (!--ti->held_kmutexes && ti->eff_rt_prio != ti->rt_prio)
+      sched_set_eff_rt_prio(ti, ti->rt_prio);
+}
+
+/* Returns the waiter with the highest effective RT priority (FIFO on ties) */
+static struct task *kmutex_get_top_waiter(struct kmutex *m, struct task *skip)
+{
+   struct task *top = NULL;
+   struct wait_obj *wo;
+
+   list_for_each_ro(wo, &m->wait_list, wait_list_node) {
+
+      struct task *ti = CONTAINER_OF(wo, struct task, wobj);
+
+      if (ti == skip)
+         continue;
+
+      if (!top || ti->eff_rt_prio > top->eff_rt_prio)
+         top = ti;
+   }
+
+   return top;
+}
+
 static ALWAYS_INLINE void
 kmutex_lock_enable_preemption_wrapper(struct kmutex *m)
 {
@@ -36,21 +114,94 @@ kmutex_lock_enable_preemption_wrapper(struct kmutex *m)
 #endif
 }
 
+void kmutex_get_spin_stats(struct kmutex_spin_stats *s)
+{
+   disable_preemption();
+   {
+      *s = spin_stats;
+   }
+   enable_preemption();
+}
+
+/*
+ * Optimistic spinning, the single-CPU way
+ * ----------------------------------------
+ *
+ * With one CPU, busy-waiting for the owner to release the mutex is pointless:
+ * the owner cannot run while we spin. The mutex can still be held for a very
+ * short time though, by an owner that got preempted in the middle of its
+ * critical section. In that case, instead of going through the wait list, the
+ * sleep, the wake-up and the hand-off of the mutex, just yield and re-check
+ * the mutex, up to `kopt_kmutex_spin` times. As soon as the owner is not
+ * runnable anymore (e.g. it's sleeping on I/O) or someone else is already
+ * waiting on the mutex, there's no point in yielding: go to sleep instead.
+ *
+ * RT tasks never spin: yielding would just select them again. They rely on
+ * the priority inheritance, instead.
+ *
+ * Expects the preemption to be disabled exactly once. Returns true if the
+ * mutex has been acquired.
+ */
+static bool kmutex_spin(struct kmutex *m)
+{
+   struct task *curr = get_curr_task();
+   struct task *owner;
+
+   if (curr->eff_rt_prio || get_preempt_disable_count() != 1)
+      return false;
+
+   for (ulong i = 0; ; i++) {
+
+      if (!(owner = m->owner_task)) {
+
+         kmutex_set_owner(m, curr);
+
+         if (m->flags & KMUTEX_FL_RECURSIVE)
+            m->lock_count++;
+
+         spin_stats.spin_acquired++;
+         return true;
+      }
+
+      if (i == kopt_kmutex_spin ||
+          owner->state != TASK_STATE_RUNNABLE ||
+          !list_is_empty(&m->wait_list))
+      {
+         if (i > 0)
+            spin_stats.spin_failed++;
+
+         return false;
+      }
+
+      spin_stats.yields++;
+      kernel_yield_preempt_disabled();
+      disable_preemption();
+   }
+}
+
 void kmutex_lock(struct kmutex *m)
 {
+#if LOCK_STATS
+   u64 wait_start;
+#endif
+
    disable_preemption();
    DEBUG_ONLY(check_not_in_irq_handler());
 
    if (!m->owner_task) {
 
       /* Nobody owns this mutex, just make this task own it */
-      m->owner_task = get_curr_task();
+      kmutex_set_owner(m, get_curr_task());
 
       if (m->flags & KMUTEX_FL_RECURSIVE) {
          ASSERT(m->lock_count == 0);
          m->lock_count++;
       }
 
+#if LOCK_STATS
+      lock_stats_acquired(m->lc, 0);
+#endif
+
       kmutex_lock_enable_preemption_wrapper(m);
       enable_preemption();
       return;
@@ -70,11 +221,30 @@ void kmutex_lock(struct kmutex *m)
       ASSERT(!kmutex_is_curr_task_holding_lock(m));
    }
 
+#if LOCK_STATS
+   wait_start = lock_stats_contended(m->lc, m->owner_task);
+#endif
+
+   if (kmutex_spin(m)) {
+
+#if LOCK_STATS
+      lock_stats_acquired(m->lc, wait_start);
+#endif
+
+      enable_preemption();
+      return;
+   }
+
+   spin_stats.slept++;
+
 #if KMUTEX_STATS_ENABLED
    m->num_waiters++;
    m->max_num_waiters = MAX(m->num_waiters, m->max_num_waiters);
 #endif
 
+   if (get_curr_task()->eff_rt_prio)
+      kmutex_pi_boost(m, get_curr_task()->eff_rt_prio);
+
    prepare_to_wait_on(WOBJ_KMUTEX, m, NO_EXTRA, &m->wait_list);
    kmutex_lock_enable_preemption_wrapper(m);
 
@@ -100,6 +270,10 @@ void kmutex_lock(struct kmutex *m)
    if (m->flags & KMUTEX_FL_RECURSIVE) {
       ASSERT(m->lock_count == 1);
    }
+
+#if LOCK_STATS
+   lock_stats_acquired(m->lc, wait_start);
+#endif
 }
 
 bool kmutex_trylock(struct kmutex *m)
@@ -112,7 +286,7 @@ bool kmutex_trylock(struct kmutex *m)
    if (!m->owner_task) {
 
       /* Nobody owns this mutex, just make this task own it */
-      m->owner_task = get_curr_task();
+      kmutex_set_owner(m, get_curr_task());
       success = true;
 
       if (m->flags & KMUTEX_FL_RECURSIVE)
@@ -134,6 +308,11 @@ bool kmutex_trylock(struct kmutex *m)
       }
    }
 
+#if LOCK_STATS
+   if (success)
+      lock_stats_acquired(m->lc, 0);
+#endif
+
    enable_preemption();
    return success;
 }
@@ -158,20 +337,23 @@ void kmutex_unlock(struct kmutex *m)
    }
 
    m->owner_task = NULL;
+   kmutex_pi_release(get_curr_task());
 
-   /* Unlock one task waiting to acquire the mutex 'm' (if any) */
+   /* Unlock the top task waiting to acquire the mutex 'm' (if any) */
    if (!list_is_empty(&m->wait_list)) {
 
-      struct wait_obj *task_wo =
-         list_first_obj(&m->wait_list, struct wait_obj, wait_list_node);
+      struct task *ti = kmutex_get_top_waiter(m, NULL);
+      struct task *next = kmutex_get_top_waiter(m, ti);
 
-      struct task *ti = CONTAINER_OF(task_wo, struct task, wobj);
-
-      m->owner_task = ti;
+      kmutex_set_owner(m, ti);
 
       if (m->flags & KMUTEX_FL_RECURSIVE)
          m->lock_count++;
 
+      /* The new owner inherits the priority of the remaining waiters */
+      if (next && next->eff_rt_prio)
+         kmutex_pi_boost(m, next->eff_rt_prio);
+
       ASSERT_TASK_STATE(ti->state, TASK_STATE_SLEEPING);
       wake_up(ti);
 
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/lat_tracer.h>
+#include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/hal.h>
+
+const char *const lat_trace_kind_names[LAT_TRACE_KINDS] = {
+   [LAT_TRACE_PREEMPT_OFF] = "preempt-off",
+   [LAT_TRACE_IRQS_OFF]    = "irqs-off",
+};
+
+#if LATENCY_TRACER
+
+struct lat_trace_ctx {
+
+   u64 start_tsc;                   /* 0 = no pending interval */
+   int start_tid;
+   struct lat_trace_stack start;
+
+   int count;
+   struct lat_trace_entry entries[LAT_TRACE_MAX_ENTRIES];  /* longest first */
+};
+
+static struct lat_trace_ctx lat_ctx[LAT_TRACE_KINDS];
+
+/*
+ * The tracer cannot use disable_interrupts(), as it would call the irqs-off
+ * hooks: just use the raw functions.
+ */
+static ALWAYS_INLINE bool lat_irqs_save(void)
+{
+   const bool enabled = are_interrupts_enabled();
+   disable_interrupts_forced();
+   return enabled;
+}
+
+static ALWAYS_INLINE void lat_irqs_restore(bool enabled)
+{
+   if (enabled)
+      enable_interrupts_forced();
+}
+
+/*
+ * `fp` is the frame pointer of the hook itself and `ret` its return address,
+ * which is the call site, because the hooks are called by inline functions.
+ */
+static void
+lat_trace_save_stack(struct lat_trace_stack *s, void *fp, void *ret)
+{
+   struct task *ti = get_curr_task();
+
+   s->nframes = 0;
+
+   if (ti && ti->kernel_stack) {
+      s->nframes = (u32)stackwalk_kernel_stack(s->frames,
+                                               LAT_TRACE_MAX_FRAMES,
+                                               fp,
+                                               ti->kernel_stack);
+   }
+
+   if (!s->nframes) {
+      s->frames[0] = ret;     /* Not on the task's stack (early boot) */
+      s->nframes = 1;
+   }
+}
+
+static void
+lat_trace_start(struct lat_trace_ctx *ctx, void *fp, void *ret)
+{
+   struct task *ti = get_curr_task();
+
+   ctx->start_tid = ti ? ti->tid : 0;
+   lat_trace_save_stack(&ctx->start, fp, ret);
+   ctx->start_tsc = RDTSC();
+}
+
+static void
+lat_trace_end(struct lat_trace_ctx *ctx, void *fp, void *ret)
+{
+   const u64 now = RDTSC();
+   struct lat_trace_entry *e;
+   u64 cycles;
+   int i;
+
+   if (!ctx->start_tsc)
+      return;
+
+   cycles = now - ctx->start_tsc;
+   ctx->start_tsc = 0;
+
+   if (ctx->count == LAT_TRACE_MAX_ENTRIES) {
+
+      if (cycles <= ctx->entries[LAT_TRACE_MAX_ENTRIES - 1].cycles)
+         return;   /* The common case: not among the longest ones */
+
+      i = LAT_TRACE_MAX_ENTRIES - 1;
+
+   } else {
+
+      i = ctx->count++;
+   }
+
+   /* Insertion sort step: move down the shorter entries */
+   for (; i > 0 && ctx->entries[i - 1].cycles < cycles; i--)
+      ctx->entries[i] = ctx->entries[i - 1];
+
+   e = &ctx->entries[i];
+   e->cycles = cycles;
+   e->tid = ctx->start_tid;
+   e->start = ctx->start;
+   lat_trace_save_stack(&e->end, fp, ret);
+}
+
+void preempt_off_trace_start(void)
+{
+   const bool en = lat_irqs_save();
+   {
+      lat_trace_start(&lat_ctx[LAT_TRACE_PREEMPT_OFF],
+                      __builtin_frame_address(0),
+                      __builtin_return_address(0));
+   }
+   lat_irqs_restore(en);
+}
+
+void preempt_off_trace_end(void)
+{
+   const bool en = lat_irqs_save();
+   {
+      lat_trace_end(&lat_ctx[LAT_TRACE_PREEMPT_OFF],
+                    __builtin_frame_address(0),
+                    __builtin_return_address(0));
+   }
+   lat_irqs_restore(en);
+}
+
+#if IRQS_OFF_TRACE_HOOKS
+
+/* The irqs-off hooks are always called with the interrupts disabled */
+
+void irqs_off_trace_start(void)
+{
+   lat_trace_start(&lat_ctx[LAT_TRACE_IRQS_OFF],
+                   __builtin_frame_address(0),
+                   __builtin_return_address(0));
+}
+
+void irqs_off_trace_end(void)
+{
+   lat_trace_end(&lat_ctx[LAT_TRACE_IRQS_OFF],
+                 __builtin_frame_address(0),
+                 __builtin_return_address(0));
+}
+
+/*
+ * An IRQ can arrive only with the interrupts enabled: a pending irqs-off
+ * interval at that point is stale, i.e. it ended without passing through
+ * enable_interrupts() (e.g. with enable_interrupts_forced()).
+ */
+void irqs_off_trace_cancel(void)
+{
+   lat_ctx[LAT_TRACE_IRQS_OFF].start_tsc = 0;
+}
+
+#endif // IRQS_OFF_TRACE_HOOKS
+
+int lat_trace_get_entries(enum lat_trace_kind kind,
+                          struct lat_trace_entry *arr,
+                          int max_elems)
+{
+   struct lat_trace_ctx *ctx = &lat_ctx[kind];
+   bool en;
+   int n;
+
+   ASSERT(kind < LAT_TRACE_KINDS);
+
+   en = lat_irqs_save();
+   {
+      n = MIN(ctx->count, max_elems);
+      memcpy(arr, ctx->entries, sizeof(arr[0]) * (size_t)n);
+   }
+   lat_irqs_restore(en);
+   return n;
+}
+
+void lat_trace_reset(void)
+{
+   const bool en = lat_irqs_save();
+   {
+      for (int k = 0; k < LAT_TRACE_KINDS; k++)
+         lat_ctx[k].count = 0;
+   }
+   lat_irqs_restore(en);
+}
+
+#endif // LATENCY_TRACER
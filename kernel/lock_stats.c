@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/lock_stats.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sort.h>
+
+#if LOCK_STATS
+
+static struct list lock_classes = STATIC_LIST_INIT(lock_classes);
+
+static void lock_class_register(struct lock_class *lc)
+{
+   ASSERT(!is_preemption_enabled());
+
+   if (!lc->registered) {
+      list_node_init(&lc->node);
+      list_add_tail(&lock_classes, &lc->node);
+      lc->registered = true;
+   }
+}
+
+/*
+ * Called just before going to sleep waiting for a lock of the class `lc`,
+ * held by `owner` (NULL when unknown). Returns the timestamp to be passed
+ * to lock_stats_acquired() once the lock has been acquired.
+ */
+u64 lock_stats_contended(struct lock_class *lc, struct task *owner)
+{
+   if (!lc)
+      return 0;
+
+   disable_preemption();
+   {
+      lock_class_register(lc);
+      lc->contentions++;
+      lc->blocker_tid = owner ? owner->tid : -1;
+   }
+   enable_preemption();
+   return RDTSC();
+}
+
+void lock_stats_acquired(struct lock_class *lc, u64 wait_start)
+{
+   u64 wait;
+
+   if (!lc)
+      return;
+
+   wait = wait_start ? RDTSC() - wait_start : 0;
+
+   disable_preemption();
+   {
+      lock_class_register(lc);
+      lc->acquisitions++;
+      lc->holder_tid = get_curr_tid();
+      lc->total_wait += wait;
+      lc->max_wait = MAX(lc->max_wait, wait);
+   }
+   enable_preemption();
+}
+
+static long lock_class_cmp(const void *a, const void *b)
+{
+   const struct lock_class *x = a;
+   const struct lock_class *y = b;
+
+   if (x->contentions != y->contentions)
+      return x->contentions > y->contentions ? -1 : 1;
+
+   return 0;
+}
+
+int lock_stats_get_classes(struct lock_class *arr, int max_elems)
+{
+   struct lock_class *pos;
+   int n = 0;
+
+   disable_preemption();
+   {
+      list_for_each_ro(pos, &lock_classes, node) {
+
+         if (n == max_elems)
+            break;
+
+         arr[n++] = *pos;
+      }
+   }
+   enable_preemption();
+
+   intro_sort_generic(arr, sizeof(arr[0]), (u32)n, &lock_class_cmp);
+   return n;
+}
+
+void lock_stats_reset(void)
+{
+   struct lock_class *pos;
+
+   disable_preemption();
+   {
+      list_for_each_ro(pos, &lock_classes, node) {
+         pos->acquisitions = 0;
+         pos->contentions = 0;
+         pos->total_wait = 0;
+         pos->max_wait = 0;
+         pos->holder_tid = 0;
+         pos->blocker_tid = 0;
+      }
+   }
+   enable_preemption();
+}
+
+void lock_stats_dump(void)
+{
+   static struct lock_class arr[8];
+   const int n = lock_stats_get_classes(arr, ARRAY_SIZE(arr));
+
+   printk("Most contended lock classes: [\n");
+
+   for (int i = 0; i < n && arr[i].contentions; i++) {
+      printk("  %-16s waits: %" PRIu64 ", holder: %d, blocker: %d\n",
+             arr[i].name,
+             arr[i].contentions,
+             arr[i].holder_tid,
+             arr[i].blocker_tid);
+   }
+
+   printk("]\n");
+}
+
+#endif // #if LOCK_STATS
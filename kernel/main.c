@@ -23,6 +23,8 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/fs/fat32.h>
 #include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/ramfs.h>
+#include <tilck/kernel/fs/shm.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/system_mmap.h>
@@ -34,6 +36,12 @@
 #include <tilck/kernel/fs/kernelfs.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/uefi.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/lazyfree.h>
+#include <tilck/kernel/init_mem.h>
+#include <tilck/kernel/smp.h>
 
 #include <tilck/mods/console.h>
 #include <tilck/mods/fb_console.h>
@@ -43,6 +51,14 @@
 #include <3rd_party/acpi/acpi.h>
 #include <3rd_party/acpi/acexcep.h>
 
+/* Runs an init step, recording it in the boot trace */
+#define BOOT_STEP(call)                                                 \
+   do {                                                                 \
+      const int __bt_id = boot_trace_begin(#call, NULL);                \
+      call;                                                             \
+      boot_trace_end(__bt_id);                                          \
+   } while (0)
+
 static bool read_multiboot_info_passed;
 static u32 saved_multiboot_magic;
 static multiboot_info_t *saved_multiboot_mbi;
@@ -249,12 +265,41 @@ out:
    saved_multiboot_mbi = NULL;
 }
 
+/*
+ * With initrd_rw_kb > 0, the initrd is mounted r/w. The bootloaders pass it
+ * truncated to its used clusters and it's mapped read-only: therefore, it's
+ * copied in a buffer having `initrd_rw_kb` KB of free space at the end. When
+ * that's not possible (e.g. compressed ramdisks), it's mounted read-only.
+ */
+static struct mnt_fs *
+mount_initrd_fat(void *ramdisk, size_t ramdisk_size)
+{
+   struct mnt_fs *fs;
+   size_t size;
+   void *buf;
+
+   if (!kopt_initrd_rw_kb)
+      return fat_mount_ramdisk(ramdisk, ramdisk_size, 0);
+
+   size = pow2_round_up_at(ramdisk_size, PAGE_SIZE) + kopt_initrd_rw_kb * KB;
+
+   if ((buf = kmalloc_long_lived(size))) {
+
+      memcpy(buf, ramdisk, ramdisk_size);
+
+      if ((fs = fat_mount_ramdisk(buf, size, VFS_FS_RW)))
+         return fs;
+
+      kfree2(buf, size);
+   }
+
+   printk("WARNING: unable to mount the initrd r/w\n");
+   return fat_mount_ramdisk(ramdisk, ramdisk_size, 0);
+}
+
 static void
 mount_initrd(void)
 {
-   /* declare the ramfs_create() function */
-   struct mnt_fs *ramfs_create(void);
-
    struct mnt_fs *initrd, *ramfs;
    void *ramdisk;
    size_t ramdisk_size;
@@ -285,7 +330,7 @@ mount_initrd(void)
 
    if (LIKELY(ramdisk != NULL)) {
 
-      if (!(initrd = fat_mount_ramdisk(ramdisk, ramdisk_size, 0)))
+      if (!(initrd = mount_initrd_fat(ramdisk, ramdisk_size)))
          panic("Unable to mount the initrd fat32 RAMDISK");
 
       if ((rc = vfs_mkdir("/initrd", 0777)))
@@ -318,23 +363,44 @@ run_init_or_selftest(void)
          panic("No ramdisk and no selftest requested: nothing to do.");
 
       /* Run init or whatever program was passed in the cmdline */
+      const int bt_id = boot_trace_begin("first_execve()", cmd_args[0]);
       long rc = first_execve(cmd_args[0], cmd_args);
+      boot_trace_end(bt_id);
 
       if (rc != 0)
          panic("execve('%s') failed with %i\n", cmd_args[0], rc);
+
+      free_init_mem();
    }
 }
 
+/*
+ * The TSC (rdtime on riscv) starts from 0 at the CPU reset: therefore, the
+ * start of the first boot step tells how long the firmware and the bootloader
+ * took, in total.
+ */
+static void log_time_to_kmain(void)
+{
+   const struct boot_trace_event *e = boot_trace_get_event(0);
+   u64 us;
+
+   if (e && (us = boot_trace_tsc_to_us(e->start)))
+      printk("Time from the CPU reset to kmain(): %lu ms\n",
+             (ulong)(us / 1000));
+}
+
 static void do_async_init()
 {
    /* declare the show_hello_message() function */
    void show_hello_message(void);
 
-   mount_initrd();
-   init_devfs();
-   init_modules();
-   init_extra_debug_features();
+   BOOT_STEP(mount_initrd());
+   BOOT_STEP(init_devfs());
+   BOOT_STEP(init_shm());
+   BOOT_STEP(init_modules());
+   BOOT_STEP(init_extra_debug_features());
 
+   log_time_to_kmain();
    show_hello_message();
    run_init_or_selftest();
 }
@@ -349,34 +415,42 @@ async_init(void)
 void
 kmain(u32 multiboot_magic, u32 mbi_addr)
 {
+   boot_trace_point("kmain", NULL);
    call_kernel_global_ctors();
    save_multiboot_info(multiboot_magic, mbi_addr);
 
-   early_init_serial_ports();
-   init_cpu_exception_handling();
-   early_init_paging();
-   early_init_kmalloc();
-
-   read_multiboot_info();
-   enable_cpu_features();
-   kmain_early_checks();
-   init_segmentation();
-   init_fpu_memcpy();
-   init_kmalloc();
-   init_paging();
-
-   setup_uefi_runtime_services();
-   acpi_mod_init_tables();
-
-   init_console();
-   init_self_tests();
-   init_irq_handling();
-   init_sched();
-   init_syscall_interfaces();
-   init_worker_threads();
-   init_timer();
-   init_system_time();
-   init_kernelfs();
+   BOOT_STEP(early_init_serial_ports());
+   BOOT_STEP(init_cpu_exception_handling());
+   BOOT_STEP(early_init_paging());
+   BOOT_STEP(early_init_kmalloc());
+
+   BOOT_STEP(read_multiboot_info());
+   BOOT_STEP(enable_cpu_features());
+   BOOT_STEP(kmain_early_checks());
+   BOOT_STEP(init_segmentation());
+   BOOT_STEP(init_fpu_memcpy());
+   BOOT_STEP(init_kmalloc());
+   BOOT_STEP(init_paging());
+   BOOT_STEP(init_ksyms_index());
+
+   BOOT_STEP(setup_uefi_runtime_services());
+   BOOT_STEP(acpi_mod_init_tables());
+
+   BOOT_STEP(init_console());
+   BOOT_STEP(init_self_tests());
+   BOOT_STEP(init_irq_handling());
+   BOOT_STEP(init_sched());
+   BOOT_STEP(init_syscall_interfaces());
+   BOOT_STEP(init_worker_threads());
+   BOOT_STEP(init_printk_flush_thread());
+   BOOT_STEP(init_pdir_reaper());
+   BOOT_STEP(init_timer());
+   BOOT_STEP(init_smp());
+   BOOT_STEP(init_system_time());
+   BOOT_STEP(init_kernelfs());
+   BOOT_STEP(init_lazyfree());
+   BOOT_STEP(init_zram());
+   BOOT_STEP(init_ksm());
 
    async_init();
    do_schedule();
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/dma_mapping.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/errno.h>
+
+static ALWAYS_INLINE bool is_linear_va(ulong va)
+{
+   return va >= BASE_VA && va < LINEAR_MAPPING_END;
+}
+
+static ulong dma_va_to_pa(void *vaddr)
+{
+   ulong pa;
+
+   if (is_linear_va((ulong)vaddr))
+      return LIN_VA_TO_PA(vaddr);
+
+   /* vmalloc, the kernel image etc. A DMA to unmapped memory is a bug */
+   VERIFY(get_mapping2(get_kernel_pdir(), vaddr, &pa) == 0);
+   return pa;
+}
+
+static ALWAYS_INLINE bool dma_below_mask(ulong pa, size_t len, u64 mask)
+{
+   return (u64)pa + len - 1 <= mask;
+}
+
+/*
+ * Regular memory first: the DMA heap is tiny, leave it to the devices which
+ * cannot reach anything else. Note: kmalloc() falls back to the DMA heap by
+ * itself when the regular heaps are full.
+ */
+static void *dma_alloc_below(size_t size, u64 mask)
+{
+   const u32 flags[] = { 0, KMALLOC_FL_DMA };
+   size_t sz;
+   void *ptr;
+
+   for (u32 i = 0; i < ARRAY_SIZE(flags); i++) {
+
+      sz = size;
+
+      if (!(ptr = general_kmalloc(&sz, flags[i])))
+         continue;
+
+      if (dma_below_mask(LIN_VA_TO_PA(ptr), size, mask))
+         return ptr;
+
+      sz = size;
+      general_kfree(ptr, &sz, 0);
+   }
+
+   return NULL;
+}
+
+static void dma_free(void *ptr, size_t size)
+{
+   general_kfree(ptr, &size, 0);
+}
+
+void *dma_alloc_coherent(size_t size, u64 mask, ulong *paddr)
+{
+   void *ptr;
+
+   /* Allocations of whole pages are page-aligned */
+   size = pow2_round_up_at(size, PAGE_SIZE);
+
+   if (!(ptr = dma_alloc_below(size, mask)))
+      return NULL;
+
+   bzero(ptr, size);
+   *paddr = LIN_VA_TO_PA(ptr);
+   return ptr;
+}
+
+void dma_free_coherent(void *vaddr, size_t size)
+{
+   dma_free(vaddr, pow2_round_up_at(size, PAGE_SIZE));
+}
+
+/*
+ * Builds the scatter-gather list for `buf`, page by page. Returns false if
+ * the buffer cannot be accessed directly by the device: part of it is beyond
+ * `mask` or it's split in more than `max_sg` physical ranges.
+ */
+static bool
+dma_build_sg(char *buf,
+             size_t len,
+             u64 mask,
+             struct dma_sg *sg,
+             u32 max_sg,
+             u32 *count)
+{
+   size_t chunk;
+   ulong pa;
+   u32 n = 0;
+
+   if (is_linear_va((ulong)buf) && is_linear_va((ulong)buf + len - 1)) {
+
+      /* Physically contiguous: that's the common case */
+      chunk = len;
+      len = 0;
+      pa = LIN_VA_TO_PA(buf);
+
+      if (!dma_below_mask(pa, chunk, mask))
+         return false;
+
+      sg[n++] = (struct dma_sg) { .paddr = pa, .len = (u32)chunk };
+   }
+
+   while (len > 0) {
+
+      chunk = MIN(len, PAGE_SIZE - ((ulong)buf & OFFSET_IN_PAGE_MASK));
+      pa = dma_va_to_pa(buf);
+
+      if (!dma_below_mask(pa, chunk, mask))
+         return false;
+
+      if (n > 0 && sg[n - 1].paddr + sg[n - 1].len == pa) {
+
+         sg[n - 1].len += (u32)chunk;
+
+      } else {
+
+         if (n == max_sg)
+            return false;
+
+         sg[n++] = (struct dma_sg) { .paddr = pa, .len = (u32)chunk };
+      }
+
+      buf += chunk;
+      len -= chunk;
+   }
+
+   *count = n;
+   return true;
+}
+
+int
+dma_map_buf(void *buf,
+            size_t len,
+            enum dma_dir dir,
+            u64 mask,
+            struct dma_sg *sg,
+            u32 max_sg,
+            struct dma_map *m)
+{
+   ASSERT(len > 0);
+   ASSERT(max_sg > 0);
+
+   *m = (struct dma_map) {
+      .buf = buf,
+      .len = len,
+      .dir = dir,
+   };
+
+   if (dma_build_sg(buf, len, mask, sg, max_sg, &m->sg_count))
+      return 0;
+
+   /* The bounce buffer is a single physically contiguous range */
+   if (!(m->bounce = dma_alloc_below(len, mask)))
+      return -ENOMEM;
+
+   m->bounce_size = len;
+
+   if (dir != DMA_FROM_DEVICE)
+      memcpy(m->bounce, buf, len);
+
+   sg[0] = (struct dma_sg) {
+      .paddr = LIN_VA_TO_PA(m->bounce),
+      .len = (u32)len,
+   };
+
+   m->sg_count = 1;
+   return 0;
+}
+
+void dma_unmap_buf(struct dma_map *m)
+{
+   if (!m->bounce)
+      return;
+
+   if (m->dir != DMA_TO_DEVICE)
+      memcpy(m->buf, m->bounce, m->len);
+
+   dma_free(m->bounce, m->bounce_size);
+   m->bounce = NULL;
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/init_mem.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
+
+/* The linker scripts align the init sections at 64 KB */
+STATIC_ASSERT(KMALLOC_MIN_HEAP_SIZE == 64 * KB);
+
+static bool init_mem_freed;
+
+void free_init_mem(void)
+{
+   const ulong pbegin = KERNEL_VA_TO_PA(init_begin);
+   const ulong pend = KERNEL_VA_TO_PA(init_end);
+
+   ASSERT(!init_mem_freed);
+   ASSERT((pbegin & (KMALLOC_MIN_HEAP_SIZE - 1)) == 0);
+   ASSERT((pend & (KMALLOC_MIN_HEAP_SIZE - 1)) == 0);
+
+   init_mem_freed = true;
+
+   if (pbegin == pend)
+      return;
+
+   /*
+    * The kernel image is mapped also in the linear mapping, writable: that's
+    * where kmalloc expects its heaps to be. The frames are still marked as
+    * PF_TYPE_KERNEL, like the rest of the image: now they're regular memory.
+    */
+   pageframes_set_type(pbegin, pend, PF_TYPE_OTHER);
+   kmalloc_add_heaps((ulong)PA_TO_LIN_VA(pbegin), (ulong)PA_TO_LIN_VA(pend));
+
+   printk("Freed the init memory: %lu KB\n", (pend - pbegin) / KB);
+}
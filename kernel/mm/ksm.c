@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/worker_thread.h>
+
+#define KSM_TABLE_BITS                                    10
+#define KSM_TABLE_SIZE                    (1u << KSM_TABLE_BITS)
+
+/* Max pages hashed by a single pass: ~4 MB to read, with preemption off */
+#define KSM_PASS_MAX_PAGES                              1024
+
+#define KSM_WTH_QUEUE_SIZE                                 4
+
+/*
+ * The table is valid only during a single pass: its entries point to page
+ * table entries, which can go away as soon as the preemption gets enabled.
+ * The merged frames are still found by the next passes, because they are
+ * candidates too.
+ */
+static struct ksm_entry table[KSM_TABLE_SIZE];
+static struct ksm_stats stats;
+static struct worker_thread *ksm_wth;
+static bool job_enqueued;
+
+/* Where the next pass starts: each pass continues the previous one */
+static int resume_pid;
+static ulong resume_va;
+
+/* FNV-1a, on 32-bit words */
+u32 ksm_hash_page(const void *page, bool *zero)
+{
+   const u32 *w = page;
+   u32 h = 2166136261u, all = 0;
+
+   for (u32 i = 0; i < PAGE_SIZE / 4; i++) {
+      all |= w[i];
+      h = (h ^ w[i]) * 16777619u;
+   }
+
+   *zero = !all;
+   return h;
+}
+
+struct ksm_entry *ksm_get_entry(u32 hash)
+{
+   ASSERT(!is_preemption_enabled());
+   return &table[hash & (KSM_TABLE_SIZE - 1)];
+}
+
+void ksm_get_stats(struct ksm_stats *s)
+{
+   disable_preemption();
+   {
+      *s = stats;
+   }
+   enable_preemption();
+}
+
+struct ksm_walk_ctx {
+
+   struct ksm_scan_ctx scan;
+   int start_pid;
+   bool wrapped;              /* second round: the pids before start_pid */
+};
+
+static int ksm_scan_cb(void *obj, void *arg)
+{
+   struct ksm_walk_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+
+   if (is_kernel_thread(ti) || !ti->is_main_thread)
+      return 0;
+
+   /* Zombies have no pdir, vforked children use their parent's one */
+   if (ti->state == TASK_STATE_ZOMBIE || pi->vforked)
+      return 0;
+
+   if ((pi->pid < ctx->start_pid) != ctx->wrapped)
+      return 0;
+
+   pdir_merge_same_pages(pi->pdir, &ctx->scan);
+
+   if (ctx->scan.stopped) {
+      resume_pid = pi->pid;
+      resume_va = ctx->scan.va;
+      return 1;
+   }
+
+   ctx->scan.va = 0;          /* The next process starts from the beginning */
+   return 0;
+}
+
+static void ksm_scan_job(void *unused)
+{
+   struct ksm_walk_ctx ctx = {
+      .scan = {
+         .max = KSM_PASS_MAX_PAGES,
+         .va = resume_va,
+      },
+      .start_pid = resume_pid,
+   };
+
+   disable_preemption();
+   {
+      bzero(table, sizeof(table));
+      iterate_over_tasks(&ksm_scan_cb, &ctx);
+
+      if (!ctx.scan.stopped && ctx.start_pid > 0) {
+         ctx.wrapped = true;
+         ctx.scan.va = 0;
+         iterate_over_tasks(&ksm_scan_cb, &ctx);
+      }
+
+      if (!ctx.scan.stopped) {
+         resume_pid = 0;      /* Visited everything: start over next time */
+         resume_va = 0;
+      }
+
+      stats.scans++;
+      stats.hashed += ctx.scan.hashed;
+      stats.merged += ctx.scan.merged;
+      stats.zero_merged += ctx.scan.zero_merged;
+      job_enqueued = false;
+   }
+   enable_preemption();
+}
+
+/*
+ * Called with preemption disabled, possibly in the middle of a page fault
+ * which is copying a page: don't touch any page table here, just ask the
+ * worker thread to run a pass. The memory gets freed asynchronously.
+ */
+static size_t ksm_shrink(struct shrinker *s, size_t bytes)
+{
+   if (!job_enqueued)
+      job_enqueued = wth_enqueue_on(ksm_wth, &ksm_scan_job, NULL);
+
+   return 0;
+}
+
+static struct shrinker ksm_shrinker = {
+   .name = "ksm",
+   .shrink = &ksm_shrink,
+};
+
+void init_ksm(void)
+{
+   if (!KSM_MERGE)
+      return;
+
+   disable_preemption();
+   {
+      ksm_wth = wth_create_thread("ksm", WTH_PRIO_LOWEST, KSM_WTH_QUEUE_SIZE);
+   }
+   enable_preemption();
+
+   if (!ksm_wth) {
+      printk("WARNING: ksm: unable to create the worker thread\n");
+      return;
+   }
+
+   register_shrinker(&ksm_shrinker);
+}
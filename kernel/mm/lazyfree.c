@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/lazyfree.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/worker_thread.h>
+
+static struct lazyfree_stats stats;
+static size_t drop_target;          /* pages requested by the shrinker */
+static bool job_enqueued;
+
+void lazyfree_get_stats(struct lazyfree_stats *s)
+{
+   disable_preemption();
+   {
+      *s = stats;
+   }
+   enable_preemption();
+}
+
+size_t lazyfree_mark_pages(pdir_t *pdir, ulong va, size_t count)
+{
+   size_t n;
+
+   ASSERT(!is_preemption_enabled());
+   n = pdir_mark_lazyfree_pages(pdir, va, count);
+   stats.marked += n;
+   return n;
+}
+
+struct lazyfree_drop_ctx {
+
+   size_t max;
+   size_t done;
+};
+
+static int lazyfree_drop_cb(void *obj, void *arg)
+{
+   struct lazyfree_drop_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+
+   if (is_kernel_thread(ti) || !ti->is_main_thread)
+      return 0;
+
+   /* Zombies have no pdir, vforked children use their parent's one */
+   if (ti->state == TASK_STATE_ZOMBIE || pi->vforked)
+      return 0;
+
+   ctx->done += pdir_drop_lazyfree_pages(pi->pdir, ctx->max - ctx->done);
+   return ctx->done >= ctx->max;
+}
+
+/*
+ * Dropping a page doesn't copy nor compress anything: a single pass over all
+ * the processes is cheap enough to be done with preemption disabled.
+ */
+static void lazyfree_drop_job(void *unused)
+{
+   struct lazyfree_drop_ctx ctx;
+
+   disable_preemption();
+   {
+      ctx = (struct lazyfree_drop_ctx) {
+         .max = drop_target,
+      };
+
+      iterate_over_tasks(&lazyfree_drop_cb, &ctx);
+
+      stats.scans++;
+      stats.dropped += ctx.done;
+      drop_target = 0;
+      job_enqueued = false;
+   }
+   enable_preemption();
+}
+
+/*
+ * Called with preemption disabled, possibly in the middle of a page fault:
+ * don't touch any page table here, just ask a worker thread to run a pass.
+ * The memory gets freed asynchronously.
+ */
+static size_t lazyfree_shrink(struct shrinker *s, size_t bytes)
+{
+   const size_t pages = pow2_round_up_at(bytes, PAGE_SIZE) >> PAGE_SHIFT;
+
+   if (!stats.marked)
+      return 0;          /* Nobody ever used MADV_FREE: nothing to drop */
+
+   drop_target = MAX(drop_target, pages);
+
+   if (!job_enqueued) {
+      job_enqueued = wth_enqueue_anywhere(WTH_PRIO_LOWEST,
+                                          &lazyfree_drop_job,
+                                          NULL);
+   }
+
+   return 0;
+}
+
+static struct shrinker lazyfree_shrinker = {
+   .name = "lazyfree",
+   .shrink = &lazyfree_shrink,
+};
+
+void init_lazyfree(void)
+{
+   register_shrinker(&lazyfree_shrinker);
+}
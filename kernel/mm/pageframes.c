@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/utils.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/system_mmap.h>
+#include <tilck/kernel/sched.h>
+
+struct pageframe *pageframes;
+ulong pageframes_base_paddr;
+size_t pageframes_count;
+
+static const char *pf_type_names[PF_TYPES_COUNT] =
+{
+   [PF_TYPE_OTHER]      = "other",
+   [PF_TYPE_RESERVED]   = "reserved",
+   [PF_TYPE_KERNEL]     = "kernel",
+   [PF_TYPE_ZERO]       = "zero",
+   [PF_TYPE_FILE]       = "file",
+   [PF_TYPE_USHARED]    = "ushared",
+   [PF_TYPE_PGTABLE]    = "pgtable",
+   [PF_TYPE_LAZYFREE]   = "lazyfree",
+};
+
+const char *pf_type_str(enum pf_type t)
+{
+   return t < PF_TYPES_COUNT ? pf_type_names[t] : "?";
+}
+
+void
+pageframes_set_type(u64 begin, u64 end, enum pf_type type)
+{
+   const u64 base = pageframes_base_paddr;
+   const u64 lim = base + ((u64)pageframes_count << PAGE_SHIFT);
+
+   begin = MAX(begin, base);
+   end = MIN(end, lim);
+
+   for (u64 pa = begin & PAGE_MASK; pa < end; pa += PAGE_SIZE)
+      pageframes[(pa - base) >> PAGE_SHIFT].type = type & 0xf;
+}
+
+static enum pf_type mem_region_to_pf_type(struct mem_region *r)
+{
+   if (r->type != MULTIBOOT_MEMORY_AVAILABLE)
+      return PF_TYPE_RESERVED;
+
+   if (r->extra)
+      return PF_TYPE_KERNEL; /* kernel, ramdisk, lowmem, DMA etc. */
+
+   return PF_TYPE_OTHER;
+}
+
+void init_pageframes(ulong base_paddr, ulong mem_lim)
+{
+   struct mem_region r;
+
+   pageframes_base_paddr = base_paddr;
+   pageframes_count = mem_lim >> PAGE_SHIFT;
+   pageframes = kzmalloc(pageframes_count * sizeof(struct pageframe));
+
+   if (!pageframes) {
+
+      pageframes_count = 0;
+
+      if (in_panic())
+         return;        /* We're in panic: silently ignore the failure */
+
+      panic("Unable to allocate the pageframes array");
+   }
+
+   /*
+    * Everything not covered by the system memory map is reserved. Usable
+    * memory regions are then marked, in order: system_mmap guarantees that
+    * there are no overlaps.
+    */
+   pageframes_set_type(base_paddr, base_paddr + mem_lim, PF_TYPE_RESERVED);
+
+   for (int i = 0; i < get_mem_regions_count(); i++) {
+      get_mem_region(i, &r);
+      pageframes_set_type(r.addr, r.addr + r.len, mem_region_to_pf_type(&r));
+   }
+}
+
+void pf_retain(ulong paddr, enum pf_type type)
+{
+   struct pageframe *pf = pf_get(paddr);
+
+   if (UNLIKELY(!pf))
+      return;
+
+   pf->refcount++;
+   pf->type = type & 0xf;
+}
+
+void pf_release(ulong paddr)
+{
+   struct pageframe *pf = pf_get(paddr);
+
+   if (UNLIKELY(!pf))
+      return;
+
+   ASSERT(pf->refcount > pf->mapcount);
+   pf->refcount--;
+
+   /* The owner is gone: whatever mapping is left, it's private now */
+   pf->type = PF_TYPE_OTHER;
+}
+
+/*
+ * Used by the owners of the page frames mapped at [vaddr, vaddr + len) when
+ * they want to share them with user space: e.g. ramfs retains its blocks'
+ * pages. Thanks to that, COW mappings of such pages always copy them on write.
+ */
+void
+retain_pageframes_mapped_at(pdir_t *pdir,
+                            void *vaddrp,
+                            size_t len,
+                            enum pf_type type)
+{
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   ulong paddr;
+   ulong vaddr = (ulong)vaddrp;
+   const ulong vaddr_end = vaddr + len;
+
+   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
+
+      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
+         continue; /* not mapped, that's fine */
+
+      pf_retain(paddr, type);
+   }
+}
+
+void release_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
+{
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   ulong paddr;
+   ulong vaddr = (ulong)vaddrp;
+   const ulong vaddr_end = vaddr + len;
+
+   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
+
+      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
+         continue; /* not mapped, that's fine */
+
+      pf_release(paddr);
+   }
+}
+
+void get_pageframe_stats(struct pageframe_stats *s)
+{
+   bzero(s, sizeof(*s));
+   s->total = pageframes_count;
+
+   disable_preemption();
+   {
+      for (size_t i = 0; i < pageframes_count; i++) {
+
+         const struct pageframe *pf = &pageframes[i];
+
+         s->by_type[pf->type]++;
+
+         if (!pf->mapcount)
+            continue;
+
+         s->mapped++;
+
+         if (pf->type == PF_TYPE_OTHER)
+            s->anon++;
+
+         if (pf->mapcount > 1) {
+            s->shared++;
+            s->saved += pf->mapcount - 1;
+         }
+      }
+   }
+   enable_preemption();
+}
@@ -11,12 +11,57 @@
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/lazyfree.h>
 
 #include <sys/mman.h>      // system header
 
+#ifndef MREMAP_MAYMOVE
+   #define MREMAP_MAYMOVE     1
+#endif
+
+#ifndef MAP_HUGETLB
+   #define MAP_HUGETLB        0x40000
+#endif
+
+#ifndef MADV_HUGEPAGE
+   #define MADV_HUGEPAGE      14
+#endif
+
+#ifndef MADV_FREE
+   #define MADV_FREE          8
+#endif
+
 char page_size_buf[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
+/*
+ * Returns true if growing the address space of `pi` by `extra` bytes would
+ * exceed its RLIMIT_AS soft limit. The VSZ is computed only when there is a
+ * limit, because walking the page tables is not free.
+ */
+static bool
+exceeds_as_limit(struct process *pi, size_t extra)
+{
+   size_t vsz, rss;
+
+   if (pi->as_limit_cur == K_RLIM_INFINITY)
+      return false;
+
+   process_get_mem_usage(pi, &vsz, &rss);
+   return ((u64)vsz << PAGE_SHIFT) + extra > pi->as_limit_cur;
+}
+
+/*
+ * brk() maps and unmaps the pages in chunks of BRK_CHUNK_PAGES, with a
+ * preemption point between them. That's safe because `pi->brk` is always
+ * consistent with what's mapped and only the process itself changes its
+ * address space: its vfork parent, if any, is stopped.
+ */
+#define BRK_CHUNK_PAGES                   64
+
 static void
 brk_syscall_int(struct process *pi, void *new_brk)
 {
@@ -26,15 +71,20 @@ brk_syscall_int(struct process *pi, void *new_brk)
 
       /* we have to free pages */
 
-      for (void *vaddr = new_brk; vaddr < pi->brk; vaddr += PAGE_SIZE) {
-         unmap_page(pi->pdir, vaddr, true);
+      for (u32 n = 1; pi->brk > new_brk; n++) {
+
+         pi->brk -= PAGE_SIZE;
+         unmap_page(pi->pdir, pi->brk, true);
+
+         if (!(n % BRK_CHUNK_PAGES))
+            cond_resched_preempt_disabled();
       }
 
-      pi->brk = new_brk;
       return;
    }
 
    void *vaddr = pi->brk;
+   size_t count, n;
 
    while (vaddr < new_brk) {
 
@@ -44,29 +94,29 @@ brk_syscall_int(struct process *pi, void *new_brk)
       vaddr += PAGE_SIZE;
    }
 
-   /* OK, everything looks good here */
-
-   vaddr = pi->brk;
+   /*
+    * OK, everything looks good here. Map the whole increment to the zero page
+    * with COW semantics: the actual page frames will be allocated on the first
+    * write, in handle_potential_cow(). Programs that reserve a big arena and
+    * touch only a part of it won't pay for the whole increment upfront.
+    */
 
-   while (vaddr < new_brk) {
+   while (pi->brk < new_brk) {
 
-      void *kernel_vaddr = kmalloc(PAGE_SIZE);
+      n = (size_t)(new_brk - pi->brk) >> PAGE_SHIFT;
+      n = MIN(n, (size_t)BRK_CHUNK_PAGES);
+      count = map_zero_pages(pi->pdir,
+                             pi->brk,
+                             n,
+                             PAGING_FL_US | PAGING_FL_RW);
 
-      if (!kernel_vaddr)
-         break; /* we've allocated as much as possible */
+      pi->brk += count << PAGE_SHIFT;
 
-      const ulong paddr = LIN_VA_TO_PA(kernel_vaddr);
+      if (count < n)
+         break;   /* Out of memory: stop where we are */
 
-      if (map_page(pi->pdir, vaddr, paddr, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
-         break;
-      }
-
-      vaddr += PAGE_SIZE;
+      cond_resched_preempt_disabled();
    }
-
-   /* We're done. */
-   pi->brk = vaddr;
 }
 
 void *sys_brk(void *new_brk)
@@ -91,6 +141,9 @@ void *sys_brk(void *new_brk)
    if (new_brk == pi->brk)
       return pi->brk;
 
+   if (new_brk > pi->brk && exceeds_as_limit(pi, (size_t)(new_brk - pi->brk)))
+      return pi->brk;
+
    /*
     * Disable preemption to avoid any threads to mess-up with the address space
     * of the current process (i.e. they might call brk(), mmap() etc.)
@@ -122,6 +175,8 @@ create_process_mmap_heap(struct process *pi)
    }
 
    list_init(&pi->mi->mappings);
+   pi->mi->mappings_tree = NULL;
+   pi->mi->last_um = NULL;
    pi->mi->mmap_heap = mmap_heap;
    pi->mi->mmap_heap_size = USER_MMAP_MIN_SZ;
 
@@ -150,6 +205,28 @@ create_process_mmap_heap(struct process *pi)
    return 0;
 }
 
+/* Doubles the size of the mmap heap of `pi`. Returns false on failure. */
+static bool
+expand_process_mmap_heap(struct process *pi)
+{
+   struct kmalloc_heap *new_heap;
+   struct kmalloc_heap *h = pi->mi->mmap_heap;
+   size_t heap_sz = pi->mi->mmap_heap_size;
+
+   if (heap_sz == USER_MMAP_MAX_SZ)
+      return false; /* cannot expand the heap more than that */
+
+   new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
+
+   if (!new_heap)
+      return false; /* no enough memory */
+
+   pi->mi->mmap_heap_size = heap_sz * 2;
+   pi->mi->mmap_heap = new_heap;
+   kmalloc_destroy_heap(h);
+   return true;
+}
+
 static inline void
 mmap_err_case_free(struct process *pi, void *ptr, size_t actual_len)
 {
@@ -174,28 +251,15 @@ mmap_on_user_heap(struct process *pi,
 
    while (true) {
 
-      struct kmalloc_heap *new_heap;
-      struct kmalloc_heap *h = pi->mi->mmap_heap;
-      size_t heap_sz = pi->mi->mmap_heap_size;
-
-      res = per_heap_kmalloc(h,
+      res = per_heap_kmalloc(pi->mi->mmap_heap,
                              actual_len_ref,
                              per_heap_kmalloc_flags);
 
       if (LIKELY(res != NULL))
          break;        /* great! */
 
-      if (heap_sz == USER_MMAP_MAX_SZ)
-         return NULL; /* cannot expand the heap more than that */
-
-      new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
-
-      if (!new_heap)
-         return NULL; /* no enough memory */
-
-      pi->mi->mmap_heap_size = heap_sz * 2;
-      pi->mi->mmap_heap = new_heap;
-      kmalloc_destroy_heap(h);
+      if (!expand_process_mmap_heap(pi))
+         return NULL;
    }
 
    /* NOTE: here `handle` might be NULL (zero-map case) and that's OK */
@@ -209,6 +273,313 @@ mmap_on_user_heap(struct process *pi,
    return um;
 }
 
+#ifdef ARCH_HAS_USER_BIG_PAGES
+
+/*
+ * Replaces the regular pages mapped at `va` with a single big page, copying
+ * their content. Returns false if it's not possible to allocate a physically
+ * contiguous and aligned block of memory for the big page.
+ */
+static bool
+promote_to_user_big_page(pdir_t *pdir, ulong va, size_t bp_size)
+{
+   const ulong zero_page_pa = KERNEL_VA_TO_PA(zero_page);
+   size_t size = bp_size;
+   ulong pa, page_pa;
+   char *buf;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!(buf = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return false;
+
+   ASSERT(size == bp_size);
+   pa = LIN_VA_TO_PA(buf);
+
+   if (pa & (bp_size - 1))
+      goto fail; /* Not aligned in physical memory: we cannot use it */
+
+   for (size_t off = 0; off < bp_size; off += PAGE_SIZE) {
+
+      if (get_mapping2(pdir, (void *)(va + off), &page_pa))
+         goto fail;
+
+      if (page_pa == zero_page_pa)
+         bzero(buf + off, PAGE_SIZE);
+      else
+         memcpy32(buf + off, PA_TO_LIN_VA(page_pa), PAGE_SIZE / 4);
+   }
+
+   unmap_pages(pdir, (void *)va, bp_size >> PAGE_SHIFT, true);
+   rc = map_user_big_page(pdir, (void *)va, pa, true);
+
+   /* It cannot fail: both `va` and `pa` are aligned and the range is free */
+   VERIFY(rc == 0);
+   return true;
+
+fail:
+   general_kfree(buf, &size, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+   return false;
+}
+
+/*
+ * Best-effort: backs with big pages all the big-page-aligned parts of the
+ * anonymous range [vaddr, vaddr + len). Parts for which that's not possible
+ * just keep using regular pages.
+ */
+static void
+user_range_use_big_pages(struct process *pi, ulong vaddr, size_t len)
+{
+   const size_t bp_size = get_user_big_page_size();
+   ulong va, end;
+
+   va = pow2_round_up_at(vaddr, bp_size);
+   end = (vaddr + len) & ~(bp_size - 1);
+
+   for (; va < end; va += bp_size) {
+      if (!promote_to_user_big_page(pi->pdir, va, bp_size))
+         break;
+   }
+}
+
+#else
+
+static inline void
+user_range_use_big_pages(struct process *pi, ulong vaddr, size_t len)
+{
+   /* Big pages for user space not supported on this arch */
+}
+
+#endif
+
+/* Pre-fault the not-mapped pages of the file mapping `um` in the range */
+static void
+prefault_file_range(struct process *pi,
+                    struct user_mapping *um,
+                    ulong va,
+                    ulong end)
+{
+   for (; va < end; va += PAGE_SIZE) {
+
+      if (is_mapped(pi->pdir, (void *)va))
+         continue;
+
+      if (!vfs_handle_fault(um, (void *)va, false, false))
+         break; /* Past EOF */
+   }
+}
+
+/*
+ * MAP_POPULATE for the private anonymous mappings: replace upfront the zero
+ * pages with actual pages, instead of doing that on the first write to each
+ * one of them (see handle_potential_cow()).
+ */
+static void
+populate_anon_range(struct process *pi, ulong va, ulong end)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(&zero_page);
+   ulong paddr;
+   int rc;
+
+   for (; va < end; va += PAGE_SIZE) {
+
+      if (get_mapping2(pi->pdir, (void *)va, &paddr) || paddr != zero_paddr)
+         continue; /* E.g. already backed by a big page */
+
+      unmap_page(pi->pdir, (void *)va, false);
+
+      rc = map_page(pi->pdir,
+                    (void *)va,
+                    0,
+                    PAGING_FL_RWUS | PAGING_FL_DO_ALLOC | PAGING_FL_ZERO_PG);
+
+      if (rc) {
+
+         /* Out of memory: the rest will be allocated on demand */
+         rc = map_zero_page(pi->pdir, (void *)va, PAGING_FL_RWUS);
+         VERIFY(rc == 0); /* The page table is already there */
+         break;
+      }
+   }
+}
+
+static int munmap_int(struct process *pi, void *vaddrp, size_t len);
+
+/* Map the zero page at the not-mapped pages in [va, va + len) */
+static bool
+map_zero_page_holes(struct process *pi, ulong va, size_t len, int prot)
+{
+   const u32 pg_flags =
+      PAGING_FL_US | ((prot & PROT_WRITE) ? PAGING_FL_RW : 0);
+
+   for (const ulong end = va + len; va < end; va += PAGE_SIZE) {
+
+      if (is_mapped(pi->pdir, (void *)va))
+         continue;
+
+      if (map_zero_page(pi->pdir, (void *)va, pg_flags))
+         return false;
+   }
+
+   return true;
+}
+
+static void
+unmap_private_range(struct process *pi, ulong va, size_t len)
+{
+   for (const ulong end = va + len; va < end; va += PAGE_SIZE)
+      unmap_page_permissive(pi->pdir, (void *)va, true);
+}
+
+/*
+ * Reset the range [va, va + len) of a private mapping to zero-filled memory,
+ * exactly as a brand new anonymous mapping with protection `prot`.
+ */
+static int
+reset_private_range(struct process *pi, ulong va, size_t len, int prot)
+{
+   bool ok;
+
+   if (MMAP_NO_COW) {
+      bzero((void *)va, len);
+      return 0;
+   }
+
+   disable_preemption();
+   {
+      unmap_private_range(pi, va, len);
+      ok = map_zero_page_holes(pi, va, len, prot);
+   }
+   enable_preemption();
+   return ok ? 0 : -ENOMEM;
+}
+
+/*
+ * Fill the range [va, va + len) of the private mapping `um`, expected to be
+ * zero-filled (see reset_private_range()), with the content of the file `h`
+ * at `off`.
+ *
+ * Private file mappings are anonymous mappings as far as the rest of the
+ * kernel is concerned (um->h is NULL): they don't need the file handle, which
+ * can be closed right after mmap(). When the FS supports mmap, file's pages
+ * are mapped directly, read-only or copy-on-write depending on `prot`, as the
+ * ELF loader does for programs' segments. Therefore, the text and the rodata
+ * of a shared library are loaded just once (by the FS itself) and shared by
+ * all the processes using it: the FS is the mapping cache. Otherwise, file's
+ * content gets just copied.
+ */
+static int
+map_private_file_range(struct process *pi,
+                       struct user_mapping *um,
+                       fs_handle h,
+                       ulong va,
+                       size_t len,
+                       size_t off,
+                       int prot)
+{
+   struct user_mapping tmp = {0};
+   struct locked_file *lf = NULL;
+   int rc;
+   offt ret;
+
+   ASSERT(is_preemption_enabled());
+
+   if (!MMAP_NO_COW && is_mmap_supported(h)) {
+      if (acquire_subsys_flock_h(h, SUBSYS_PROCMGNT, &lf))
+         lf = NULL;
+   }
+
+   if (lf && um->lf && um->lf != lf) {
+
+      /* We can hold only one lock per mapping: fall back to copying */
+      release_subsys_flock(lf);
+      lf = NULL;
+   }
+
+   if (lf) {
+
+      tmp.pi = pi;
+      tmp.h = h;
+      tmp.off = off;
+      tmp.vaddr = va;
+      tmp.len = len;
+      tmp.prot = prot;
+
+      disable_preemption();
+      {
+         unmap_private_range(pi, va, len);
+         rc = vfs_mmap(&tmp, pi->pdir, VFS_MM_DONT_REGISTER | VFS_MM_PRIVATE);
+
+         /*
+          * Map the zero page at file's holes and past EOF. If vfs_mmap()
+          * failed, at the whole range instead, in order to copy the content.
+          */
+         if (!map_zero_page_holes(pi, va, len, rc ? PROT_WRITE : prot))
+            rc = -ENOMEM;
+      }
+      enable_preemption();
+
+      if (!rc) {
+
+         if (!um->lf)
+            um->lf = lf;
+         else
+            release_subsys_flock(lf);
+
+         return 0;
+      }
+
+      release_subsys_flock(lf);
+
+      if (rc == -ENOMEM)
+         return rc;
+   }
+
+   ret = vfs_pread(h, (void *)va, len, (offt)off);
+   return ret < 0 ? (int)ret : 0;
+}
+
+/*
+ * MAP_FIXED is supported only inside an existing private mapping. That's what
+ * the dynamic linkers do: first they reserve the whole address range needed
+ * by a library by mapping it and then they map there each one of its segments
+ * (and the bss) at the right place, with MAP_FIXED.
+ */
+static long
+mmap_fixed(struct process *pi,
+           ulong va,
+           size_t len,
+           int prot,
+           fs_handle h,
+           size_t off)
+{
+   struct user_mapping *um = NULL;
+   int rc;
+
+   if (va & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (pi->mi) {
+      disable_preemption();
+      {
+         um = process_get_user_mapping((void *)va);
+      }
+      enable_preemption();
+   }
+
+   if (!um || um->h || va + len > um->vaddr + um->len)
+      return -EINVAL;
+
+   if ((rc = reset_private_range(pi, va, len, h ? PROT_WRITE : prot)))
+      return rc;
+
+   if (h && (rc = map_private_file_range(pi, um, h, va, len, off, prot)))
+      return rc;
+
+   return (long)va;
+}
+
 long
 sys_mmap_pgoff(void *addr, size_t len, int prot,
                int flags, int fd, size_t pgoffset)
@@ -227,12 +598,21 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    if (!len)
       return -EINVAL;
 
-   if (addr)
-      return -EINVAL; /* addr != NULL not supported */
+   if ((flags & MAP_FIXED) && !(flags & MAP_PRIVATE))
+      return -EINVAL; /* MAP_FIXED supported only for private mappings */
 
    if (!(prot & PROT_READ))
       return -EINVAL;
 
+   if ((flags & MAP_HUGETLB) && get_user_big_page_size()) {
+
+      /*
+       * Like Linux, round-up the length to the big page size. That makes also
+       * the allocation in the mmap heap aligned at the big page size.
+       */
+      len = pow2_round_up_at(len, get_user_big_page_size());
+   }
+
    actual_len = pow2_round_up_at(len, PAGE_SIZE);
 
    if (fd == -1) {
@@ -254,7 +634,7 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
    } else {
 
-      if (!(flags & MAP_SHARED))
+      if (!(flags & (MAP_SHARED | MAP_PRIVATE)))
          return -EINVAL;
 
       handle = get_fs_handle(fd);
@@ -270,14 +650,38 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if ((prot & (PROT_READ | PROT_WRITE)) == PROT_WRITE)
          return -EINVAL; /* disallow write-only mappings */
 
-      if (prot & PROT_WRITE) {
-         if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
+      if (flags & MAP_PRIVATE) {
+
+         /* Private mappings just read the file, even if writable */
+         if ((fl & O_ACCMODE) == O_WRONLY)
             return -EACCES;
+
+      } else {
+
+         if (prot & PROT_WRITE) {
+            if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
+               return -EACCES;
+         }
+
+         per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
       }
+   }
+
+   if (exceeds_as_limit(pi, actual_len))
+      return -ENOMEM;
+
+   if (flags & MAP_FIXED) {
 
-      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+      return mmap_fixed(pi,
+                        (ulong)addr,
+                        pow2_round_up_at(len, PAGE_SIZE),
+                        prot,
+                        handle,
+                        pgoffset << PAGE_SHIFT);
    }
 
+   /* Without MAP_FIXED, `addr` is just a hint: ignore it, as Linux can do */
+
    if (!pi->mi) {
       if ((rc = create_process_mmap_heap(pi))) {
          return rc;
@@ -288,7 +692,7 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    {
       um = mmap_on_user_heap(pi,
                              &actual_len,
-                             handle,
+                             (flags & MAP_SHARED) ? handle : NULL,
                              per_heap_kmalloc_flags,
                              pgoffset << PAGE_SHIFT,
                              prot);
@@ -300,7 +704,29 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
    ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
 
-   if (handle) {
+   if (handle && (flags & MAP_PRIVATE)) {
+
+      if (MMAP_NO_COW)
+         bzero(um->vaddrp, actual_len);
+
+      rc = map_private_file_range(pi,
+                                  um,
+                                  handle,
+                                  um->vaddr,
+                                  actual_len,
+                                  pgoffset << PAGE_SHIFT,
+                                  prot);
+
+      if (rc) {
+         disable_preemption();
+         {
+            munmap_int(pi, um->vaddrp, actual_len);
+         }
+         enable_preemption();
+         return rc;
+      }
+
+   } else if (handle) {
 
       if ((rc = vfs_mmap(um, pi->pdir, 0))) {
 
@@ -319,11 +745,34 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
          return rc;
       }
 
+      if (flags & MAP_POPULATE) {
+         disable_preemption();
+         {
+            prefault_file_range(pi, um, um->vaddr, um->vaddr + actual_len);
+         }
+         enable_preemption();
+      }
 
    } else {
 
       if (MMAP_NO_COW)
          bzero(um->vaddrp, actual_len);
+
+      if (flags & MAP_HUGETLB) {
+         disable_preemption();
+         {
+            user_range_use_big_pages(pi, um->vaddr, actual_len);
+         }
+         enable_preemption();
+      }
+
+      if ((flags & MAP_POPULATE) && !MMAP_NO_COW) {
+         disable_preemption();
+         {
+            populate_anon_range(pi, um->vaddr, um->vaddr + actual_len);
+         }
+         enable_preemption();
+      }
    }
 
    return (long)um->vaddr;
@@ -411,6 +860,9 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
             um->len = um_vend - um->vaddr;
             return -ENOMEM;
          }
+
+         if ((um2->lf = um->lf))
+            retain_subsys_flock(um2->lf);
       }
    }
 
@@ -466,3 +918,484 @@ int sys_munmap(void *vaddrp, size_t len)
    return rc;
 }
 
+
+static long
+mremap_grow(struct process *pi,
+            struct user_mapping *um,
+            size_t new_len,
+            int flags)
+{
+   const ulong old_end = um->vaddr + um->len;
+   const size_t old_len = um->len;
+   const size_t delta = new_len - old_len;
+   struct user_mapping *new_um;
+   size_t actual_len = new_len;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* First, try to grow the mapping in-place */
+   while (old_end + delta > USER_MMAP_BEGIN + pi->mi->mmap_heap_size) {
+      if (!expand_process_mmap_heap(pi))
+         break;
+   }
+
+   if (per_heap_kmalloc_at(pi->mi->mmap_heap, TO_PTR(old_end), delta, 0)) {
+
+      if (MMAP_NO_COW)
+         bzero(TO_PTR(old_end), delta);
+
+      um->len = new_len;
+      return (long)um->vaddr;
+   }
+
+   if (!(flags & MREMAP_MAYMOVE))
+      return -ENOMEM;
+
+   /*
+    * The pages after the mapping are not free: allocate a new region and move
+    * there the page table entries of the old one, instead of copying the data.
+    * The new region comes already mapped (to the zero page, in the COW case),
+    * so we just swap the PTEs: this way, after the loop, the old region is
+    * mapped exactly like a freshly allocated one and it can be unmapped with
+    * munmap_int(). The ref-count of the moved pageframes doesn't change.
+    */
+   new_um = mmap_on_user_heap(pi,
+                              &actual_len,
+                              NULL,
+                              KMALLOC_FL_MULTI_STEP | PAGE_SIZE,
+                              0,
+                              um->prot);
+
+   if (!new_um)
+      return -ENOMEM;
+
+   ASSERT(actual_len == new_len);
+
+   /* The moved pages might be file's ones (private file mapping) */
+   if ((new_um->lf = um->lf))
+      retain_subsys_flock(new_um->lf);
+
+   for (size_t off = 0; off < old_len; off += PAGE_SIZE)
+      swap_pages(pi->pdir, um->vaddrp + off, new_um->vaddrp + off);
+
+   if (MMAP_NO_COW)
+      bzero(new_um->vaddrp + old_len, delta);
+
+   munmap_int(pi, um->vaddrp, old_len);
+   return (long)new_um->vaddr;
+}
+
+static long
+mremap_int(struct process *pi,
+           void *old_addr,
+           size_t old_len,
+           size_t new_len,
+           int flags)
+{
+   struct user_mapping *um = process_get_user_mapping(old_addr);
+   const ulong vaddr = (ulong)old_addr;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!um || vaddr + old_len > um->vaddr + um->len)
+      return -EFAULT;
+
+   if (new_len <= old_len) {
+
+      if (new_len < old_len) {
+         if ((rc = munmap_int(pi, old_addr + new_len, old_len - new_len)))
+            return rc;
+      }
+
+      return (long)vaddr;
+   }
+
+   /* Growing a part of a mapping is not supported */
+   if (vaddr != um->vaddr || old_len != um->len)
+      return -EINVAL;
+
+   /* Growing file mappings is not supported (yet) */
+   if (um->h)
+      return -EINVAL;
+
+   return mremap_grow(pi, um, new_len, flags);
+}
+
+long
+sys_mremap(void *old_addr, size_t old_len, size_t new_len,
+           int flags, void *new_addr)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   long rc;
+
+   if (((ulong)old_addr & OFFSET_IN_PAGE_MASK) || !old_len || !new_len)
+      return -EINVAL;
+
+   if (flags & ~MREMAP_MAYMOVE)
+      return -EINVAL; /* MREMAP_FIXED and MREMAP_DONTUNMAP are not supported */
+
+   if (!pi->mi)
+      return -EFAULT;
+
+   old_len = pow2_round_up_at(old_len, PAGE_SIZE);
+   new_len = pow2_round_up_at(new_len, PAGE_SIZE);
+
+   if (new_len > old_len && exceeds_as_limit(pi, new_len - old_len))
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      rc = mremap_int(pi, old_addr, old_len, new_len, flags);
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * Drop the pages of a private anonymous mapping: the next access will find
+ * zero-filled memory, as with Linux.
+ */
+static int
+madvise_dontneed_anon(ulong va, ulong end)
+{
+   const size_t count = (end - va) >> PAGE_SHIFT;
+
+   if (MMAP_NO_COW) {
+      bzero((void *)va, end - va);
+      return 0;
+   }
+
+   user_unmap_zero_page(va, count);
+   return user_map_zero_page(va, count) ? 0 : -ENOMEM;
+}
+
+/*
+ * Let the pages of a private anonymous mapping be dropped under memory
+ * pressure, unless written before (see lazyfree.h). Without COW, the writes
+ * cannot be detected: just drop the pages now, as MADV_DONTNEED.
+ */
+static int
+madvise_free_anon(struct process *pi, ulong va, ulong end)
+{
+   if (MMAP_NO_COW)
+      return madvise_dontneed_anon(va, end);
+
+   lazyfree_mark_pages(pi->pdir, va, (end - va) >> PAGE_SHIFT);
+   return 0;
+}
+
+static int
+madvise_int(struct process *pi,
+            struct user_mapping *um,
+            ulong va,
+            ulong end,
+            int advice)
+{
+   switch (advice) {
+
+      case MADV_HUGEPAGE:
+
+         /* Only private anonymous mappings can be backed by big pages */
+         if (!um->h && !um->lf)
+            user_range_use_big_pages(pi, va, end - va);
+
+         return 0;
+
+      case MADV_WILLNEED:
+
+         /* The anonymous mappings have the zero page already mapped */
+         if (um->h)
+            prefault_file_range(pi, um, va, end);
+
+         return 0;
+
+      case MADV_DONTNEED:
+
+         if (um->h)
+            return vfs_mm_drop_pages(um, (void *)va, end - va);
+
+         return madvise_dontneed_anon(va, end);
+
+      case MADV_FREE:
+
+         /* Like on Linux, only private anonymous memory can be freed */
+         if (um->h || um->lf)
+            return -EINVAL;
+
+         return madvise_free_anon(pi, va, end);
+
+      default:
+         NOT_REACHED();
+   }
+}
+
+int sys_madvise(void *addr, size_t len, int advice)
+{
+   struct process *pi = get_curr_proc();
+   struct user_mapping *um;
+   ulong va = (ulong)addr;
+   ulong end;
+   int rc = 0;
+
+   if (va & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (advice != MADV_HUGEPAGE &&
+       advice != MADV_WILLNEED &&
+       advice != MADV_DONTNEED &&
+       advice != MADV_FREE)
+   {
+      return 0; /* The other advices are just hints: ignore them */
+   }
+
+   if (!pi->mi)
+      return 0;
+
+   end = va + pow2_round_up_at(len, PAGE_SIZE);
+
+   disable_preemption();
+   {
+      while (va < end && !rc) {
+
+         um = process_get_user_mapping((void *)va);
+
+         if (!um) {
+            va += PAGE_SIZE;
+            continue;
+         }
+
+         const ulong um_end = MIN(end, um->vaddr + um->len);
+         rc = madvise_int(pi, um, va, um_end, advice);
+         va = um_end;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * The shared file mappings map directly the pages of the file (see for example
+ * ramfs_mmap()): there's no separate page cache to write back, as the writes
+ * through a mapping are immediately visible to read() and vice-versa. So,
+ * msync() has just to validate its arguments and the range, like Linux does.
+ */
+int sys_msync(void *addr, size_t len, int flags)
+{
+   struct process *pi = get_curr_proc();
+   struct user_mapping *um;
+   ulong va = (ulong)addr;
+   ulong end;
+   int rc = 0;
+
+   if (va & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE))
+      return -EINVAL;
+
+   if ((flags & MS_ASYNC) && (flags & MS_SYNC))
+      return -EINVAL;
+
+   end = va + pow2_round_up_at(len, PAGE_SIZE);
+
+   if (va == end)
+      return 0;
+
+   if (!pi->mi)
+      return -ENOMEM;
+
+   disable_preemption();
+   {
+      while (va < end) {
+
+         if (!(um = process_get_user_mapping((void *)va))) {
+            rc = -ENOMEM; /* Part of the range is not mapped */
+            break;
+         }
+
+         va = um->vaddr + um->len;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+/*
+ * Copies `len` bytes between `buf` and the user memory at `va` of the process
+ * `pid`, page by page. Only the pages already writable can be written: in
+ * particular, the copy-on-write ones are not copied on behalf of the target.
+ * Returns the number of bytes copied, stopping at the first page that cannot
+ * be accessed, or -ESRCH.
+ */
+static long
+process_vm_copy(int pid, ulong va, void *buf, size_t len, bool write)
+{
+   struct process *pi;
+   struct task *ti;
+   size_t tot = 0, n;
+   int rc;
+
+   disable_preemption();
+
+   ti = get_task(pid);
+
+   if (!ti || is_kernel_thread(ti) || ti->state == TASK_STATE_ZOMBIE) {
+      enable_preemption();
+      return -ESRCH;
+   }
+
+   pi = ti->pi;
+
+   for (; tot < len; tot += n) {
+
+      n = MIN(PAGE_SIZE - ((va + tot) & OFFSET_IN_PAGE_MASK), len - tot);
+
+      if (user_out_of_range((void *)(va + tot), n))
+         break;
+
+      if (write) {
+
+         if (!is_rw_mapped(pi->pdir, (void *)(va + tot)))
+            break;
+
+         rc = virtual_write(pi->pdir, (void *)(va + tot), buf + tot, n);
+
+      } else {
+
+         rc = virtual_read(pi->pdir, (void *)(va + tot), buf + tot, n);
+      }
+
+      if (rc < 0)
+         break;
+   }
+
+   enable_preemption();
+   return (long)tot;
+}
+
+static bool iov_len_overflow(const struct iovec *iov, ulong iovcnt)
+{
+   ssize_t tot_len = 0;
+
+   for (ulong i = 0; i < iovcnt; i++) {
+
+      tot_len += iov[i].iov_len;
+
+      if (tot_len < 0)
+         return true; /* overflow detected */
+   }
+
+   return false;
+}
+
+/*
+ * The core of process_vm_readv() and process_vm_writev(): the data goes
+ * through the per-task io_copybuf, in chunks which never cross the boundary
+ * of a local or a remote iovec element. Like on Linux, a partial transfer
+ * returns the number of bytes copied so far, if any.
+ */
+static long
+process_vm_rw(int pid,
+              const struct iovec *u_liov,
+              ulong liovcnt,
+              const struct iovec *u_riov,
+              ulong riovcnt,
+              ulong flags,
+              bool write)
+{
+   struct task *curr = get_curr_task();
+   struct iovec *liov = curr->args_copybuf;
+   struct iovec *riov = liov + liovcnt;
+   void *buf = curr->io_copybuf;
+   size_t loff = 0, roff = 0, n;
+   ulong li = 0, ri = 0;
+   long tot = 0, rc = 0;
+
+   if (flags)
+      return -EINVAL;
+
+   if (liovcnt > ARGS_COPYBUF_SIZE / sizeof(struct iovec) ||
+       riovcnt > ARGS_COPYBUF_SIZE / sizeof(struct iovec) - liovcnt)
+   {
+      return -EINVAL; /* Too many iovec elements */
+   }
+
+   if (copy_from_user(liov, u_liov, sizeof(struct iovec) * liovcnt))
+      return -EFAULT;
+
+   if (copy_from_user(riov, u_riov, sizeof(struct iovec) * riovcnt))
+      return -EFAULT;
+
+   if (iov_len_overflow(liov, liovcnt) || iov_len_overflow(riov, riovcnt))
+      return -EINVAL;
+
+   while (li < liovcnt && ri < riovcnt) {
+
+      if (loff == liov[li].iov_len) {
+         li++;
+         loff = 0;
+         continue;
+      }
+
+      if (roff == riov[ri].iov_len) {
+         ri++;
+         roff = 0;
+         continue;
+      }
+
+      n = MIN(liov[li].iov_len - loff, riov[ri].iov_len - roff);
+      n = MIN(n, (size_t)IO_COPYBUF_SIZE);
+
+      if (write && copy_from_user(buf, liov[li].iov_base + loff, n)) {
+         rc = -EFAULT;
+         break;
+      }
+
+      rc = process_vm_copy(pid, (ulong)riov[ri].iov_base + roff, buf, n, write);
+
+      if (rc > 0 && !write) {
+         if (copy_to_user(liov[li].iov_base + loff, buf, (size_t)rc))
+            rc = -EFAULT;
+      }
+
+      if (rc <= 0) {
+         rc = rc ? rc : -EFAULT;
+         break;
+      }
+
+      tot += rc;
+      loff += (size_t)rc;
+      roff += (size_t)rc;
+
+      if ((size_t)rc < n) {
+         rc = -EFAULT;  /* Part of the remote range cannot be accessed */
+         break;
+      }
+   }
+
+   return tot > 0 ? tot : rc;
+}
+
+long
+sys_process_vm_readv(int pid,
+                     const struct iovec *u_liov,
+                     ulong liovcnt,
+                     const struct iovec *u_riov,
+                     ulong riovcnt,
+                     ulong flags)
+{
+   return process_vm_rw(pid, u_liov, liovcnt, u_riov, riovcnt, flags, false);
+}
+
+long
+sys_process_vm_writev(int pid,
+                      const struct iovec *u_liov,
+                      ulong liovcnt,
+                      const struct iovec *u_riov,
+                      ulong riovcnt,
+                      ulong flags)
+{
+   return process_vm_rw(pid, u_liov, liovcnt, u_riov, riovcnt, flags, true);
+}
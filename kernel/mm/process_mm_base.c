@@ -3,6 +3,44 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/fs/flock.h>
+
+static long um_cmp(const void *a, const void *b)
+{
+   const struct user_mapping *um1 = a;
+   const struct user_mapping *um2 = b;
+
+   if (um1->vaddr == um2->vaddr)
+      return 0;
+
+   return um1->vaddr < um2->vaddr ? -1 : 1;
+}
+
+/* Compares the range of the mapping `obj` with the address `*valptr` */
+static long um_range_cmp(const void *obj, const void *valptr)
+{
+   const struct user_mapping *um = obj;
+   const ulong vaddr = *(const ulong *)valptr;
+
+   if (vaddr < um->vaddr)
+      return 1;
+
+   return vaddr < um->vaddr + um->len ? 0 : -1;
+}
+
+static void mappings_tree_add(struct mappings_info *mi, struct user_mapping *um)
+{
+   bool added;
+   bintree_node_init(&um->pi_tree_node);
+
+   added = bintree_insert(&mi->mappings_tree,
+                          um,
+                          um_cmp,
+                          struct user_mapping,
+                          pi_tree_node);
+   ASSERT(added);
+   (void)added;
+}
 
 struct user_mapping *
 process_add_user_mapping(fs_handle h,
@@ -33,15 +71,34 @@ process_add_user_mapping(fs_handle h,
    um->prot = prot;
 
    list_add_tail(&pi->mi->mappings, &um->pi_node);
+   mappings_tree_add(pi->mi, um);
    return um;
 }
 
 void process_remove_user_mapping(struct user_mapping *um)
 {
+   struct mappings_info *mi = um->pi->mi;
+   struct user_mapping *removed;
+
    ASSERT(!is_preemption_enabled());
 
+   removed = bintree_remove(&mi->mappings_tree,
+                            &um->vaddr,
+                            um_range_cmp,
+                            struct user_mapping,
+                            pi_tree_node);
+   ASSERT(removed == um);
+   (void)removed;
+
+   if (mi->last_um == um)
+      mi->last_um = NULL;
+
    list_remove(&um->pi_node);
    list_remove(&um->inode_node);
+
+   if (um->lf)
+      release_subsys_flock(um->lf);
+
    kfree_obj(um, struct user_mapping);
 }
 
@@ -49,32 +106,38 @@ struct user_mapping *process_get_user_mapping(void *vaddrp)
 {
    const ulong vaddr = (ulong)vaddrp;
    struct process *pi = get_curr_proc();
-   struct user_mapping *pos;
+   struct mappings_info *mi = pi->mi;
+   struct user_mapping *um;
 
    ASSERT(!is_preemption_enabled());
 
-   if (pi->mi) {
+   /*
+    * Given that pi->mi->mappings contains at the moment only the memory
+    * mappings done with mmap(), some small processes that don't use dynamic
+    * memory allocation will not even have this field (pi->mi == NULL).
+    */
+   if (!mi)
+      return NULL;
 
-      /*
-       * Given that pi->mi->mappings contains at the moment only the memory
-       * mappings done with mmap(), some small processes that don't use dynamic
-       * memory allocation will not even have this field (pi->mi == NULL).
-       *
-       * For the rest, the list is supposed to be *short*, so a linear scan
-       * is acceptable for the moment. If in the future we start to put
-       * there also the mappings for program's text and data and expect to have
-       * more than a few elements, it will be necessary to use a BST to perform
-       * the lookup here below.
-       */
+   /*
+    * Page faults, mprotect() etc. tend to hit the same mapping many times in
+    * a row: check the last one found, before searching in the tree.
+    */
+   um = mi->last_um;
 
-      list_for_each_ro(pos, &pi->mi->mappings, pi_node) {
+   if (um && IN_RANGE(vaddr, um->vaddr, um->vaddr + um->len))
+      return um;
 
-         if (IN_RANGE(vaddr, pos->vaddr, pos->vaddr + pos->len))
-            return pos;
-      }
-   }
+   um = bintree_find(mi->mappings_tree,
+                     &vaddr,
+                     um_range_cmp,
+                     struct user_mapping,
+                     pi_tree_node);
 
-   return NULL;
+   if (um)
+      mi->last_um = um;
+
+   return um;
 }
 
 void remove_all_user_zero_mem_mappings(struct process *pi)
@@ -139,15 +202,10 @@ void full_remove_user_mapping(struct process *pi, struct user_mapping *um)
 
 void remove_all_file_mappings(struct process *pi)
 {
-   fs_handle *h;
-
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
+   int fd;
 
-      if (!(h = pi->handles[i]))
-         continue;
-
-      remove_all_mappings_of_handle(pi, h);
-   }
+   fd_table_for_each(pi->fds, fd)
+      remove_all_mappings_of_handle(pi, fd_table_get(pi->fds, fd));
 }
 
 struct mappings_info *
@@ -160,6 +218,8 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       goto oom_case;
 
    list_init(&new_mi->mappings);
+   new_mi->mappings_tree = NULL;
+   new_mi->last_um = NULL;
 
    if (!(new_mi->mmap_heap = kmalloc_heap_dup(mi->mmap_heap)))
       goto oom_case;
@@ -177,12 +237,16 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       /* Re-assign the process pointer */
       um2->pi = new_pi;
 
+      if (um2->lf)
+         retain_subsys_flock(um2->lf);
+
       /* Re-init the new nodes */
       list_node_init(&um2->pi_node);
       list_node_init(&um2->inode_node);
 
       /* Add the pi_node to new process's mappings list */
       list_add_tail(&new_mi->mappings, &um2->pi_node);
+      mappings_tree_add(new_mi, um2);
 
       /*
        * If the inode_node belongs to a list (mappings per inode)
@@ -204,7 +268,12 @@ oom_case:
       }
 
       list_for_each(um, um2, &new_mi->mappings, pi_node) {
+
          list_remove(&um->pi_node);
+
+         if (um->lf)
+            release_subsys_flock(um->lf);
+
          kfree_obj(um, struct user_mapping);
       }
 
@@ -214,6 +283,44 @@ oom_case:
    return NULL;
 }
 
+/*
+ * Computes the memory usage of `pi`, in pages: `vsz` is the size of its whole
+ * address space, while `rss` counts only the pages actually backed by page
+ * frames. The counts are computed on demand by walking the page tables: that
+ * costs nothing in the map/unmap paths and stays correct with COW, shared page
+ * tables and big pages. Shared file mappings are populated on demand, so their
+ * pages not mapped yet have to be added to the VSZ.
+ *
+ * NOTE: `pi` must not be a zombie, as its page directory is already gone.
+ */
+void process_get_mem_usage(struct process *pi, size_t *vsz, size_t *rss)
+{
+   struct user_mapping *um;
+   size_t mapped, resident;
+
+   disable_preemption();
+   {
+      pdir_count_user_pages(pi->pdir, &mapped, &resident);
+
+      if (pi->mi) {
+
+         list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+
+            if (!um->h)
+               continue;
+
+            for (size_t off = 0; off < um->len; off += PAGE_SIZE)
+               if (!is_mapped(pi->pdir, um->vaddrp + off))
+                  mapped++;
+         }
+      }
+   }
+   enable_preemption();
+
+   *vsz = mapped;
+   *rss = resident;
+}
+
 void user_vfree_and_unmap(ulong user_vaddr, size_t page_count)
 {
    pdir_t *pdir = get_curr_pdir();
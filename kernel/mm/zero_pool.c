@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/cmdline.h>
+
+/*
+ * The free pages are kept in a stack, linked through their first word, which
+ * is cleared again when a page is taken out. Both the ends of the stack run
+ * with preemption disabled, which is enough on a single CPU: the pool is
+ * never touched by IRQ handlers.
+ */
+static void *zpool_head;
+static u32 zpool_count;
+
+u32 zpool_get_count(void)
+{
+   return zpool_count;
+}
+
+/* Returns a zeroed, page-aligned, PAGE_SIZE block or NULL if out of memory */
+void *zpool_alloc_page(void)
+{
+   void *va;
+
+   disable_preemption();
+   {
+      if ((va = zpool_head)) {
+         zpool_head = *(void **)va;
+         zpool_count--;
+      }
+   }
+   enable_preemption_nosched();
+
+   if (va) {
+      *(void **)va = NULL;
+      return va;
+   }
+
+   if ((va = kmalloc(PAGE_SIZE)))
+      bzero(va, PAGE_SIZE);
+
+   return va;
+}
+
+static void zpool_zero_page(void *va)
+{
+   if (kopt_no_fpu_memcpy) {
+      bzero(va, PAGE_SIZE);
+      return;
+   }
+
+   fpu_context_begin();
+   {
+      fpu_memset256(va, 0, PAGE_SIZE / 32);
+   }
+   fpu_context_end();
+}
+
+/*
+ * Called by the idle task: fill the pool up to its target size, one page at
+ * a time, stopping as soon as there's something else to run.
+ */
+void zpool_refill(void)
+{
+   void *va;
+   ASSERT(is_preemption_enabled());
+
+   while (zpool_count < kopt_zero_pool && !need_reschedule()) {
+
+      if (!(va = kmalloc(PAGE_SIZE)))
+         break;
+
+      zpool_zero_page(va);
+
+      disable_preemption();
+      {
+         *(void **)va = zpool_head;
+         zpool_head = va;
+         zpool_count++;
+      }
+      enable_preemption_nosched();
+   }
+}
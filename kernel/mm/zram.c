@@ -0,0 +1,364 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+#include <tilck/common/lz4.h>
+
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/list.h>
+
+/*
+ * The pool is made by pages split in 64-byte chunks, the first one holding the
+ * header of the page. Each compressed page uses a run of contiguous chunks in
+ * a single pool page (first fit). The pool pages are freed as soon as they
+ * become empty. Everything here runs with preemption disabled.
+ */
+#define ZRAM_CHUNK_SHIFT                                   6
+#define ZRAM_CHUNK_SIZE                  (1u << ZRAM_CHUNK_SHIFT)
+#define ZRAM_CHUNKS                (PAGE_SIZE >> ZRAM_CHUNK_SHIFT)
+
+#define ZRAM_HASH_BITS                                    10
+#define ZRAM_NO_SLOT                                ((u32)-1)
+
+/* The pool cannot use more than 1 / ZRAM_MAX_POOL_DIV of the memory */
+#define ZRAM_MAX_POOL_DIV                                  4
+
+/* Max pages swapped out by a single reclaim pass */
+#define ZRAM_PASS_MAX_PAGES                               64
+
+/* Time between two passes: a page not accessed meanwhile is cold */
+#define ZRAM_PASS_PERIOD_MS                             1000
+
+/* Give up on a reclaim request after this number of passes with no progress */
+#define ZRAM_MAX_IDLE_PASSES                               3
+
+STATIC_ASSERT(ZRAM_CHUNKS == 64);
+
+struct zram_page {
+
+   struct list_node node;
+   u64 used;                  /* bitmap of the used chunks, header included */
+   u32 free_chunks;
+};
+
+STATIC_ASSERT(sizeof(struct zram_page) <= ZRAM_CHUNK_SIZE);
+
+struct zram_slot {
+
+   union {
+      void *data;             /* the compressed page, in the pool */
+      u32 next_free;          /* free slots: next slot in the free list */
+   };
+
+   u16 len;
+   u16 refcount;              /* swap entries using the slot, 0 if free */
+};
+
+static struct zram_slot *slots;
+static u32 free_slot = ZRAM_NO_SLOT;
+static struct list pool_pages = STATIC_LIST_INIT(pool_pages);
+static struct zram_stats stats;
+static size_t reclaim_target;      /* pages */
+
+static u32 hash_table[1 << ZRAM_HASH_BITS];
+static char cbuf[ZRAM_MAX_OBJ_SIZE];
+
+static ALWAYS_INLINE u32 zram_chunks(u32 len)
+{
+   return (len + ZRAM_CHUNK_SIZE - 1) >> ZRAM_CHUNK_SHIFT;
+}
+
+static void *zram_page_alloc_chunks(struct zram_page *zp, u32 n)
+{
+   const u64 mask = (1ull << n) - 1;
+
+   for (u32 i = 1; i + n <= ZRAM_CHUNKS; i++) {
+
+      if (!(zp->used & (mask << i))) {
+         zp->used |= mask << i;
+         zp->free_chunks -= n;
+         return (char *)zp + (i << ZRAM_CHUNK_SHIFT);
+      }
+   }
+
+   return NULL;
+}
+
+static void *zram_pool_alloc(u32 len)
+{
+   const u32 n = zram_chunks(len);
+   struct zram_page *zp;
+   void *ptr;
+
+   list_for_each_ro(zp, &pool_pages, node) {
+      if (zp->free_chunks >= n && (ptr = zram_page_alloc_chunks(zp, n)))
+         return ptr;
+   }
+
+   if (stats.pool_pages >= stats.max_pool_pages)
+      return NULL;
+
+   if (!(zp = kmalloc(PAGE_SIZE)))
+      return NULL;
+
+   ASSERT(IS_PAGE_ALIGNED(zp));
+   list_node_init(&zp->node);
+   zp->used = 1;              /* the header */
+   zp->free_chunks = ZRAM_CHUNKS - 1;
+
+   /* Pages with more free chunks first */
+   list_add_head(&pool_pages, &zp->node);
+   stats.pool_pages++;
+
+   return zram_page_alloc_chunks(zp, n);
+}
+
+static void zram_pool_free(void *ptr, u32 len)
+{
+   struct zram_page *zp = (void *)((ulong)ptr & PAGE_MASK);
+   const u32 i = ((ulong)ptr & OFFSET_IN_PAGE_MASK) >> ZRAM_CHUNK_SHIFT;
+   const u32 n = zram_chunks(len);
+   const u64 mask = ((1ull << n) - 1) << i;
+
+   ASSERT(i > 0);
+   ASSERT((zp->used & mask) == mask);
+
+   zp->used &= ~mask;
+   zp->free_chunks += n;
+
+   if (zp->free_chunks == ZRAM_CHUNKS - 1) {
+      list_remove(&zp->node);
+      kfree2(zp, PAGE_SIZE);
+      stats.pool_pages--;
+   }
+}
+
+int zram_store(void *page)
+{
+   struct zram_slot *s;
+   void *data;
+   u32 len, slot;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (free_slot == ZRAM_NO_SLOT)
+      return -ENOMEM;
+
+   len = lz4_compress_block(page,
+                            PAGE_SIZE,
+                            cbuf,
+                            ZRAM_MAX_OBJ_SIZE,
+                            hash_table,
+                            ZRAM_HASH_BITS);
+
+   if (!len) {
+      stats.rejected++;
+      return -E2BIG;
+   }
+
+   if (!(data = zram_pool_alloc(len)))
+      return -ENOMEM;
+
+   memcpy(data, cbuf, len);
+
+   slot = free_slot;
+   s = &slots[slot];
+   free_slot = s->next_free;
+
+   s->data = data;
+   s->len = (u16)len;
+   s->refcount = 1;
+
+   stats.stored++;
+   stats.compr_bytes += len;
+   stats.swap_outs++;
+   return (int)slot;
+}
+
+static void zram_slot_put_int(u32 slot)
+{
+   struct zram_slot *s = &slots[slot];
+
+   ASSERT(slot < stats.slots);
+   ASSERT(s->refcount > 0);
+
+   if (--s->refcount > 0)
+      return;
+
+   zram_pool_free(s->data, s->len);
+   stats.stored--;
+   stats.compr_bytes -= s->len;
+
+   s->next_free = free_slot;
+   s->len = 0;
+   free_slot = slot;
+}
+
+void zram_slot_get(u32 slot)
+{
+   disable_preemption();
+   {
+      ASSERT(slot < stats.slots);
+      ASSERT(slots[slot].refcount > 0);
+      VERIFY(slots[slot].refcount < 0xffff);
+      slots[slot].refcount++;
+   }
+   enable_preemption_nosched();
+}
+
+void zram_slot_put(u32 slot)
+{
+   disable_preemption();
+   {
+      zram_slot_put_int(slot);
+   }
+   enable_preemption_nosched();
+}
+
+void zram_load_and_put(u32 slot, void *page)
+{
+   struct zram_slot *s = &slots[slot];
+   int rc;
+
+   disable_preemption();
+   {
+      ASSERT(slot < stats.slots);
+      ASSERT(s->refcount > 0);
+
+      rc = lz4_decompress_block(s->data, s->len, page, PAGE_SIZE);
+      VERIFY(rc == PAGE_SIZE);
+      stats.swap_ins++;
+      zram_slot_put_int(slot);
+   }
+   enable_preemption_nosched();
+}
+
+void zram_get_stats(struct zram_stats *s)
+{
+   disable_preemption();
+   {
+      *s = stats;
+   }
+   enable_preemption();
+}
+
+struct zram_reclaim_ctx {
+
+   size_t max;
+   size_t done;
+};
+
+static int zram_reclaim_cb(void *obj, void *arg)
+{
+   struct zram_reclaim_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+
+   if (is_kernel_thread(ti) || !ti->is_main_thread)
+      return 0;
+
+   /* Zombies have no pdir, vforked children use their parent's one */
+   if (ti->state == TASK_STATE_ZOMBIE || pi->vforked)
+      return 0;
+
+   ctx->done += pdir_reclaim_cold_pages(pi->pdir, ctx->max - ctx->done);
+   return ctx->done >= ctx->max;
+}
+
+/*
+ * The reclaim passes are spaced by ZRAM_PASS_PERIOD_MS: a pass clears the
+ * accessed bit of the pages it visits, the next one swaps out the pages on
+ * which the bit is still clear. Therefore, the first pass after a reclaim
+ * request usually just ages the pages.
+ */
+static void zram_reclaim_thread(void *unused)
+{
+   struct zram_reclaim_ctx ctx;
+   u32 idle_passes = 0;
+
+   while (true) {
+
+      kernel_sleep_ms(ZRAM_PASS_PERIOD_MS);
+
+      disable_preemption();
+
+      if (!reclaim_target) {
+         enable_preemption();
+         continue;
+      }
+
+      ctx = (struct zram_reclaim_ctx) {
+         .max = MIN(reclaim_target, (size_t)ZRAM_PASS_MAX_PAGES),
+      };
+
+      iterate_over_tasks(&zram_reclaim_cb, &ctx);
+      stats.scans++;
+
+      reclaim_target -= MIN(reclaim_target, ctx.done);
+      idle_passes = ctx.done ? 0 : idle_passes + 1;
+
+      if (idle_passes >= ZRAM_MAX_IDLE_PASSES) {
+         reclaim_target = 0;     /* All the pages are hot */
+         idle_passes = 0;
+      }
+
+      enable_preemption();
+   }
+}
+
+/*
+ * Compressing pages requires memory for the pool, while the shrinkers must
+ * not allocate memory: just ask the reclaim thread to do the job.
+ */
+static size_t zram_shrink(struct shrinker *s, size_t bytes)
+{
+   const size_t pages = pow2_round_up_at(bytes, PAGE_SIZE) >> PAGE_SHIFT;
+   reclaim_target = MAX(reclaim_target, pages);
+   return 0;
+}
+
+static struct shrinker zram_shrinker = {
+   .name = "zram",
+   .shrink = &zram_shrink,
+};
+
+void init_zram(void)
+{
+   const u32 count = (u32)pageframes_count;
+
+   if (!ZRAM_SWAP)
+      return;
+
+   /* One slot per page frame: up to twice the memory, in the best case */
+   if (!(slots = vmalloc(count * sizeof(struct zram_slot)))) {
+      printk("WARNING: zram: unable to allocate the slot table\n");
+      return;
+   }
+
+   for (u32 i = 0; i < count; i++) {
+      slots[i].next_free = i + 1 < count ? i + 1 : ZRAM_NO_SLOT;
+      slots[i].len = 0;
+      slots[i].refcount = 0;
+   }
+
+   free_slot = 0;
+   stats.slots = count;
+   stats.max_pool_pages = pageframes_count / ZRAM_MAX_POOL_DIV;
+
+   if (kthread_create(&zram_reclaim_thread, 0, NULL) < 0) {
+      printk("WARNING: zram: unable to create the reclaim thread\n");
+      return;
+   }
+
+   register_shrinker(&zram_shrinker);
+}
@@ -0,0 +1,543 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+#include <tilck/common/elf_types.h>
+
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/init_mem.h>
+
+/*
+ * Loader of the modules built as relocatable ELF objects (LOADABLE_MODULES in
+ * the main CMakeLists.txt), which are stored in the initrd. The SHF_ALLOC
+ * sections of the object are copied in a single block, the relocations are
+ * applied resolving the undefined symbols with the kernel's symbol table and,
+ * at the end, the constructors of the object are run: exactly as for the
+ * built-in modules, REGISTER_MODULE() registers there the struct module.
+ *
+ * NOTE: the modules cannot be unloaded.
+ */
+
+#if defined(__x86_64__)
+   #define KMOD_ARCH            EM_X86_64
+   #define KMOD_CLASS           ELFCLASS64
+   #define KMOD_RELOC_SECTION   SHT_RELA
+#elif defined(__i386__)
+   #define KMOD_ARCH            EM_386
+   #define KMOD_CLASS           ELFCLASS32
+   #define KMOD_RELOC_SECTION   SHT_REL
+#else
+   #define KMOD_ARCH            EM_NONE  /* relocations not implemented */
+   #define KMOD_CLASS           ELFCLASSNONE
+   #define KMOD_RELOC_SECTION   SHT_NULL
+#endif
+
+#define KMOD_MAX_FILE_SIZE      (4 * MB)
+
+struct kmod {
+
+   const char *path;
+   char *file;                /* the whole ELF object */
+   size_t file_sz;
+   Elf_Ehdr *eh;
+   Elf_Shdr *sh;              /* sh_addr: where the section has been loaded */
+   const char *shstrtab;
+   char *mem;                 /* the loaded sections */
+   size_t mem_sz;
+   u32 mem_align;
+};
+
+static int
+kmod_read_file(struct kmod *m)
+{
+   struct k_stat64 statbuf;
+   fs_handle h;
+   ssize_t rc;
+   size_t tot = 0;
+
+   if ((rc = vfs_open(m->path, &h, O_RDONLY, 0)))
+      return (int)rc;
+
+   if ((rc = vfs_fstat64(h, &statbuf)))
+      goto out;
+
+   if ((statbuf.st_mode & S_IFREG) != S_IFREG) {
+      rc = -EACCES;
+      goto out;
+   }
+
+   if (statbuf.st_size < (s64)sizeof(Elf_Ehdr) ||
+       statbuf.st_size > KMOD_MAX_FILE_SIZE)
+   {
+      rc = -ENOEXEC;
+      goto out;
+   }
+
+   m->file_sz = (size_t)statbuf.st_size;
+
+   if (!(m->file = kmalloc(m->file_sz))) {
+      rc = -ENOMEM;
+      goto out;
+   }
+
+   while (tot < m->file_sz) {
+
+      rc = vfs_read(h, m->file + tot, m->file_sz - tot);
+
+      if (rc <= 0) {
+         rc = rc ? rc : -EIO;
+         goto out;
+      }
+
+      tot += (size_t)rc;
+   }
+
+   rc = 0;
+
+out:
+   vfs_close(h);
+   return (int)rc;
+}
+
+static inline bool
+kmod_in_file(struct kmod *m, ulong off, ulong size)
+{
+   return off <= m->file_sz && size <= m->file_sz - off;
+}
+
+static int
+kmod_check_headers(struct kmod *m)
+{
+   Elf_Ehdr *eh = m->eh = (void *)m->file;
+   Elf_Shdr *s;
+
+   if (memcmp(eh->e_ident, ELFMAG, SELFMAG))
+      return -ENOEXEC;
+
+   if (eh->e_ident[EI_CLASS] != KMOD_CLASS ||
+       eh->e_machine != KMOD_ARCH ||
+       eh->e_type != ET_REL)
+   {
+      return -ENOEXEC;
+   }
+
+   if (eh->e_shentsize != sizeof(Elf_Shdr) ||
+       eh->e_shstrndx >= eh->e_shnum ||
+       !kmod_in_file(m, eh->e_shoff, eh->e_shnum * sizeof(Elf_Shdr)))
+   {
+      return -ENOEXEC;
+   }
+
+   m->sh = (void *)(m->file + eh->e_shoff);
+
+   for (u32 i = 0; i < eh->e_shnum; i++) {
+
+      s = &m->sh[i];
+
+      if (s->sh_type == SHT_NOBITS)
+         continue;
+
+      if (!kmod_in_file(m, s->sh_offset, s->sh_size))
+         return -ENOEXEC;
+
+      if (s->sh_addralign & (s->sh_addralign - 1))
+         return -ENOEXEC;
+   }
+
+   s = &m->sh[eh->e_shstrndx];
+   m->shstrtab = m->file + s->sh_offset;
+
+   if (!s->sh_size || m->shstrtab[s->sh_size - 1])
+      return -ENOEXEC;
+
+   return 0;
+}
+
+static const char *
+kmod_section_name(struct kmod *m, Elf_Shdr *s)
+{
+   const Elf_Shdr *strs = &m->sh[m->eh->e_shstrndx];
+   return s->sh_name < strs->sh_size ? m->shstrtab + s->sh_name : "";
+}
+
+/*
+ * The exception table and the static keys are collected by the kernel's
+ * linker script: their entries in a module would be never seen.
+ */
+static int
+kmod_check_sections(struct kmod *m)
+{
+   static const char *const unsupported[] = { ".ex_table", ".static_keys" };
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+
+      const char *name = kmod_section_name(m, &m->sh[i]);
+
+      for (u32 j = 0; j < ARRAY_SIZE(unsupported); j++) {
+         if (!strcmp(name, unsupported[j])) {
+            printk("kmod: %s: unsupported section %s\n", m->path, name);
+            return -ENOEXEC;
+         }
+      }
+   }
+
+   return 0;
+}
+
+static int
+kmod_load_sections(struct kmod *m)
+{
+   Elf_Shdr *s;
+   ulong off = 0;
+
+   m->mem_align = sizeof(ulong);
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+
+      s = &m->sh[i];
+
+      if (!(s->sh_flags & SHF_ALLOC) || !s->sh_size)
+         continue;
+
+      if (s->sh_addralign > 1) {
+         off = pow2_round_up_at(off, s->sh_addralign);
+         m->mem_align = MAX(m->mem_align, (u32)s->sh_addralign);
+      }
+
+      s->sh_addr = off;  /* relative, for the moment */
+      off += s->sh_size;
+   }
+
+   if (!off || m->mem_align > PAGE_SIZE)
+      return -ENOEXEC;
+
+   m->mem_sz = off;
+
+   if (!(m->mem = aligned_kmalloc(m->mem_sz, m->mem_align)))
+      return -ENOMEM;
+
+   bzero(m->mem, m->mem_sz);
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+
+      s = &m->sh[i];
+
+      if (!(s->sh_flags & SHF_ALLOC) || !s->sh_size)
+         continue;
+
+      s->sh_addr += (ulong)m->mem;
+
+      if (s->sh_type != SHT_NOBITS)
+         memcpy(TO_PTR(s->sh_addr), m->file + s->sh_offset, s->sh_size);
+   }
+
+   return 0;
+}
+
+static int
+kmod_resolve_symbols(struct kmod *m, Elf_Shdr *symtab)
+{
+   Elf_Shdr *strtab;
+   Elf_Sym *syms;
+   const char *strs, *name;
+   ulong count, addr;
+
+   if (symtab->sh_link >= m->eh->e_shnum ||
+       symtab->sh_entsize != sizeof(Elf_Sym))
+   {
+      return -ENOEXEC;
+   }
+
+   strtab = &m->sh[symtab->sh_link];
+   strs = m->file + strtab->sh_offset;
+   syms = (void *)(m->file + symtab->sh_offset);
+   count = symtab->sh_size / sizeof(Elf_Sym);
+
+   if (!strtab->sh_size || strs[strtab->sh_size - 1])
+      return -ENOEXEC;
+
+   for (ulong i = 1; i < count; i++) {
+
+      Elf_Sym *sym = &syms[i];
+
+      if (sym->st_name >= strtab->sh_size)
+         return -ENOEXEC;
+
+      name = strs + sym->st_name;
+
+      switch (sym->st_shndx) {
+
+         case SHN_UNDEF:
+
+            addr = find_addr_of_symbol(name);
+
+            if (!addr && ELF_ST_BIND(sym->st_info) != STB_WEAK) {
+               printk("kmod: %s: unknown symbol %s\n", m->path, name);
+               return -ENOENT;
+            }
+
+            if (in_init_mem(addr)) {
+               printk("kmod: %s: symbol %s is boot-only\n", m->path, name);
+               return -ENOENT;
+            }
+
+            sym->st_value = addr;
+            break;
+
+         case SHN_ABS:
+            break;
+
+         case SHN_COMMON:
+            printk("kmod: %s: common symbol %s (use -fno-common)\n",
+                   m->path, name);
+            return -ENOEXEC;
+
+         default:
+
+            if (sym->st_shndx >= m->eh->e_shnum)
+               return -ENOEXEC;
+
+            sym->st_value += m->sh[sym->st_shndx].sh_addr;
+            break;
+      }
+   }
+
+   return 0;
+}
+
+#if defined(__i386__)
+
+static int
+kmod_apply_reloc(u32 type, ulong p, ulong s, long a)
+{
+   switch (type) {
+
+      case R_386_NONE:
+         break;
+
+      case R_386_32:
+         *(u32 *)p = (u32)(s + (ulong)a);
+         break;
+
+      case R_386_PC32:
+      case R_386_PLT32:
+         *(u32 *)p = (u32)(s + (ulong)a - p);
+         break;
+
+      default:
+         return -ENOEXEC;
+   }
+
+   return 0;
+}
+
+#elif defined(__x86_64__)
+
+static int
+kmod_apply_reloc(u32 type, ulong p, ulong s, long a)
+{
+   const long val = (long)(s + (ulong)a);
+
+   switch (type) {
+
+      case R_X86_64_NONE:
+         break;
+
+      case R_X86_64_64:
+         *(u64 *)p = (u64)val;
+         break;
+
+      case R_X86_64_32:
+
+         if ((ulong)val != (u32)val)
+            return -ERANGE;
+
+         *(u32 *)p = (u32)val;
+         break;
+
+      case R_X86_64_32S:
+
+         if (val != (s32)val)
+            return -ERANGE;
+
+         *(s32 *)p = (s32)val;
+         break;
+
+      case R_X86_64_PC32:
+      case R_X86_64_PLT32:
+
+         if (val - (long)p != (s32)(val - (long)p))
+            return -ERANGE;
+
+         *(s32 *)p = (s32)(val - (long)p);
+         break;
+
+      default:
+         return -ENOEXEC;
+   }
+
+   return 0;
+}
+
+#else
+
+static int
+kmod_apply_reloc(u32 type, ulong p, ulong s, long a)
+{
+   return -ENOEXEC;
+}
+
+#endif
+
+static int
+kmod_apply_relocs(struct kmod *m, Elf_Shdr *rs, Elf_Shdr *symtab)
+{
+   const bool rela = rs->sh_type == SHT_RELA;
+   const ulong ent_sz = rela ? sizeof(Elf_Rela) : sizeof(Elf_Rel);
+   const ulong count = rs->sh_size / ent_sz;
+   const ulong sym_count = symtab->sh_size / sizeof(Elf_Sym);
+   Elf_Sym *syms = (void *)(m->file + symtab->sh_offset);
+   Elf_Shdr *target;
+   int rc;
+
+   if (rs->sh_info >= m->eh->e_shnum || rs->sh_entsize != ent_sz)
+      return -ENOEXEC;
+
+   target = &m->sh[rs->sh_info];
+
+   if (!(target->sh_flags & SHF_ALLOC))
+      return 0; /* e.g. the debug info */
+
+   for (ulong i = 0; i < count; i++) {
+
+      Elf_Rela *r = (void *)(m->file + rs->sh_offset + i * ent_sz);
+      const ulong sym = ELF_R_SYM(r->r_info);
+      const u32 type = (u32)ELF_R_TYPE(r->r_info);
+      const ulong p = target->sh_addr + r->r_offset;
+      long a;
+
+      if (sym >= sym_count || r->r_offset + sizeof(u32) > target->sh_size)
+         return -ENOEXEC;
+
+      /* SHT_REL: the addend is the value at the place to relocate */
+      a = rela ? (long)r->r_addend : *(long *)p;
+
+      if ((rc = kmod_apply_reloc(type, p, syms[sym].st_value, a))) {
+         printk("kmod: %s: cannot apply the relocation type %u: %d\n",
+                m->path, type, rc);
+         return rc;
+      }
+   }
+
+   return 0;
+}
+
+static int
+kmod_link(struct kmod *m)
+{
+   Elf_Shdr *symtab = NULL;
+   int rc;
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+      if (m->sh[i].sh_type == SHT_SYMTAB) {
+         symtab = &m->sh[i];
+         break;
+      }
+   }
+
+   if (!symtab)
+      return -ENOEXEC;
+
+   if ((rc = kmod_resolve_symbols(m, symtab)))
+      return rc;
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+
+      Elf_Shdr *s = &m->sh[i];
+
+      if (s->sh_type == SHT_REL || s->sh_type == SHT_RELA) {
+
+         if (s->sh_type != KMOD_RELOC_SECTION)
+            return -ENOEXEC;
+
+         if ((rc = kmod_apply_relocs(m, s, symtab)))
+            return rc;
+      }
+   }
+
+   return 0;
+}
+
+static void
+kmod_run_ctors(struct kmod *m)
+{
+   void (*ctor)(void);
+
+   for (u32 i = 0; i < m->eh->e_shnum; i++) {
+
+      Elf_Shdr *s = &m->sh[i];
+      const char *name = kmod_section_name(m, s);
+
+      if (!(s->sh_flags & SHF_ALLOC))
+         continue;
+
+      if (strcmp(name, ".init_array") && strcmp(name, ".ctors"))
+         continue;
+
+      void **begin = TO_PTR(s->sh_addr);
+      void **end = TO_PTR(s->sh_addr + s->sh_size);
+
+      for (void **p = begin; p < end; p++) {
+         *(void **)(&ctor) = *p;
+         ctor();
+      }
+   }
+}
+
+int kmod_load(const char *path)
+{
+   struct kmod m = { .path = path };
+   int rc;
+
+   if (!KERNEL_SYMBOLS || KMOD_ARCH == EM_NONE)
+      return -ENOSYS;
+
+   if ((rc = kmod_read_file(&m)))
+      goto out;
+
+   if ((rc = kmod_check_headers(&m)))
+      goto out;
+
+   if ((rc = kmod_check_sections(&m)))
+      goto out;
+
+   if ((rc = kmod_load_sections(&m)))
+      goto out;
+
+   if ((rc = kmod_link(&m)))
+      goto out;
+
+   kmod_run_ctors(&m);
+   m.mem = NULL; /* the module stays there forever */
+
+out:
+
+   if (m.mem)
+      aligned_kfree2(m.mem, m.mem_sz);
+
+   if (m.file)
+      kfree2(m.file, m.file_sz);
+
+   if (rc)
+      printk("kmod: unable to load %s: error %d\n", path, rc);
+
+   return rc;
+}
@@ -2,19 +2,53 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
 
 #include <tilck/kernel/modules.h>
 #include <tilck/kernel/sort.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/errno.h>
 
 static int mods_count;
 static struct module *modules[32];
 
+/* Protect the `initialized` flag of the modules and signal its changes */
+static struct kmutex mods_lock;
+static struct kcond mods_cond;
+
+/* Serializes the load_module() calls after boot */
+static struct kmutex load_lock;
+static bool mods_initialized;
+
 void register_module(struct module *m)
 {
    ASSERT(mods_count < ARRAY_SIZE(modules) - 1);
    modules[mods_count++] = m;
 }
 
+int get_modules_count(void)
+{
+   return mods_count;
+}
+
+struct module *get_module(int i)
+{
+   return i < mods_count ? modules[i] : NULL;
+}
+
+static struct module *find_module(const char *name)
+{
+   for (int i = 0; i < mods_count; i++)
+      if (!strcmp(modules[i]->name, name))
+         return modules[i];
+
+   return NULL;
+}
+
 static long mod_cmp_func(const void *a, const void *b)
 {
    const struct module * const *ma = a;
@@ -22,13 +56,184 @@ static long mod_cmp_func(const void *a, const void *b)
    return (*ma)->priority - (*mb)->priority;
 }
 
+/*
+ * Checks the dependencies of `m`: because the modules are started in order of
+ * priority, a dependency with a higher priority would be a deadlock. The
+ * dependencies on modules not built-in are just ignored.
+ */
+static void mod_check_deps(struct module *m)
+{
+   struct module *dep;
+
+   if (!m->deps)
+      return;
+
+   for (const char *const *d = m->deps; *d; d++) {
+
+      if (!(dep = find_module(*d)))
+         continue;
+
+      if (dep->priority >= m->priority)
+         panic("Module %s depends on %s, with priority %d >= %d",
+               m->name, dep->name, dep->priority, m->priority);
+   }
+}
+
+static void mod_wait_deps(struct module *m)
+{
+   struct module *dep;
+
+   if (!m->deps)
+      return;
+
+   kmutex_lock(&mods_lock);
+   {
+      for (const char *const *d = m->deps; *d; d++) {
+
+         if (!(dep = find_module(*d)))
+            continue;
+
+         while (!dep->initialized)
+            kcond_wait(&mods_cond, &mods_lock, KCOND_WAIT_FOREVER);
+      }
+   }
+   kmutex_unlock(&mods_lock);
+}
+
+static void mod_run_init(void *arg)
+{
+   struct module *m = arg;
+   int bt_id;
+
+   mod_wait_deps(m);
+
+   bt_id = boot_trace_begin("module", m->name);
+   m->init_start = get_sys_time();
+   m->init();
+   m->init_time = get_sys_time() - m->init_start;
+   boot_trace_end(bt_id);
+
+   kmutex_lock(&mods_lock);
+   {
+      m->initialized = true;
+      kcond_signal_all(&mods_cond);
+   }
+   kmutex_unlock(&mods_lock);
+}
+
+int load_module(const char *name)
+{
+   char path[sizeof(MODULES_DIR) + MODULE_NAME_MAX_LEN + 4];
+   const size_t len = strlen(name);
+   int first, rc;
+
+   if (!len || len > MODULE_NAME_MAX_LEN || strstr(name, "/"))
+      return -EINVAL;
+
+   snprintk(path, sizeof(path), MODULES_DIR "/%s.ko", name);
+   kmutex_lock(&load_lock);
+
+   if (find_module(name)) {
+      rc = -EEXIST;
+      goto out;
+   }
+
+   first = mods_count;
+
+   if ((rc = kmod_load(path)))
+      goto out;
+
+   if (!mods_initialized)
+      goto out; /* init_modules() will initialize them */
+
+   for (int i = first; i < mods_count; i++) {
+      printk("*** Init kernel module: %s (loaded)\n", modules[i]->name);
+      mod_run_init(modules[i]);
+   }
+
+out:
+   kmutex_unlock(&load_lock);
+   return rc;
+}
+
+/* Loads the modules in -mods, a comma-separated list of names */
+static void load_boot_modules(void)
+{
+   char name[MODULE_NAME_MAX_LEN + 1];
+   const char *s = kopt_mods;
+   size_t len;
+
+   while (s && *s) {
+
+      for (len = 0; s[len] && s[len] != ','; len++) { }
+
+      if (len && len < sizeof(name)) {
+         memcpy(name, s, len);
+         name[len] = 0;
+         load_module(name);
+      }
+
+      s += len + (s[len] == ',');
+   }
+}
+
+/*
+ * Initializes the modules in order of priority. The ones flagged with
+ * MODULE_FL_ASYNC run on their own kernel thread, concurrently with the
+ * modules that follow them: those needing an async module to be initialized
+ * must declare it in their `deps`. This function returns after all the
+ * modules have been initialized.
+ */
 void init_modules(void)
 {
+   int async_tids[ARRAY_SIZE(modules)];
+   int async_count = 0;
+   u64 start = get_sys_time();
+   int tid;
+
+   kmutex_init(&mods_lock, 0);
+   kmutex_init(&load_lock, 0);
+   kcond_init(&mods_cond);
+   load_boot_modules();
    insertion_sort_ptr(modules, (u32)mods_count, &mod_cmp_func);
 
+   for (int i = 0; i < mods_count; i++)
+      mod_check_deps(modules[i]);
+
    for (int i = 0; i < mods_count; i++) {
+
       struct module *m = modules[i];
       printk("*** Init kernel module: %s\n", m->name);
-      m->init();
+
+      if (m->flags & MODULE_FL_ASYNC) {
+
+         tid = kthread_create2(&mod_run_init, m->name, 0, m);
+
+         if (tid > 0) {
+            async_tids[async_count++] = tid;
+            continue;
+         }
+
+         printk("WARNING: cannot create a kthread for module %s\n", m->name);
+      }
+
+      mod_run_init(m);
+   }
+
+   kthread_join_all(async_tids, (size_t)async_count, true);
+   mods_initialized = true;
+
+   printk("*** Kernel modules initialized in %u ms\n",
+          (u32)((get_sys_time() - start) / (TS_SCALE / 1000)));
+
+   /* Just the slow ones: all the timings are in /syst/boot/modules */
+   for (int i = 0; i < mods_count; i++) {
+
+      struct module *m = modules[i];
+      const u32 ms = (u32)(m->init_time / (TS_SCALE / 1000));
+
+      if (ms > 0)
+         printk("    %-12s %4u ms%s\n",
+                m->name, ms, m->flags & MODULE_FL_ASYNC ? " (async)" : "");
    }
 }
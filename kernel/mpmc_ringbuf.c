@@ -0,0 +1,207 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/atomics.h>
+
+#include <tilck/kernel/mpmc_ringbuf.h>
+
+/*
+ * Slot states, with `pos` being the enqueue/dequeue position in the current
+ * lap: seq == pos means free for the producer at `pos`, seq == pos + 1 means
+ * ready for the consumer at `pos`. Any other value means that the slot still
+ * belongs to the previous lap (ring full/empty) or that `pos` is stale.
+ */
+
+void
+mpmc_ringbuf_init(struct mpmc_ringbuf *rb, u32 max_elems, u32 e_size, void *b)
+{
+   ASSERT(max_elems > 0 && !(max_elems & (max_elems - 1)));
+
+   rb->max_elems = max_elems;
+   rb->elem_size = e_size;
+   rb->seqs = b;
+   rb->buf = (u8 *)b + max_elems * sizeof(u32);
+
+   for (u32 i = 0; i < max_elems; i++)
+      atomic_store_explicit(&rb->seqs[i], i, mo_relaxed);
+
+   atomic_store_explicit(&rb->enqueue_pos, 0, mo_relaxed);
+   atomic_store_explicit(&rb->dequeue_pos, 0, mo_release);
+}
+
+void mpmc_ringbuf_destroy(struct mpmc_ringbuf *rb)
+{
+   bzero(rb, sizeof(struct mpmc_ringbuf));
+}
+
+u32 mpmc_ringbuf_get_elems(struct mpmc_ringbuf *rb)
+{
+   const u32 deq = atomic_load_explicit(&rb->dequeue_pos, mo_acquire);
+   const u32 enq = atomic_load_explicit(&rb->enqueue_pos, mo_acquire);
+   const u32 n = enq - deq;
+
+   /* A consumer might have moved dequeue_pos after we read it */
+   return (s32)n < 0 ? 0 : MIN(n, rb->max_elems);
+}
+
+bool mpmc_ringbuf_is_empty(struct mpmc_ringbuf *rb)
+{
+   return mpmc_ringbuf_get_elems(rb) == 0;
+}
+
+bool mpmc_ringbuf_is_full(struct mpmc_ringbuf *rb)
+{
+   return mpmc_ringbuf_get_elems(rb) == rb->max_elems;
+}
+
+/*
+ * Reserves up to `n` contiguous slots in state `pos + state_off` (0: free for
+ * the producers, 1: ready for the consumers), moving `*pos_ptr` forward with
+ * a CAS. Returns the number of slots reserved, starting from `*start`.
+ */
+static u32
+mpmc_reserve(struct mpmc_ringbuf *rb,
+             ATOMIC(u32) *pos_ptr,
+             u32 state_off,
+             u32 n,
+             u32 *start)
+{
+   const u32 mask = rb->max_elems - 1;
+   u32 pos, seq, k;
+   s32 diff;
+
+   if (!(n = MIN(n, rb->max_elems)))
+      return 0;
+
+   pos = atomic_load_explicit(pos_ptr, mo_relaxed);
+
+   while (true) {
+
+      for (k = 0; k < n; k++) {
+
+         seq = atomic_load_explicit(&rb->seqs[(pos + k) & mask], mo_acquire);
+
+         if (seq != pos + k + state_off)
+            break;
+      }
+
+      if (!k) {
+
+         diff = (s32)(seq - (pos + state_off));
+
+         if (diff < 0)
+            return 0;      /* full (empty): the slot is in the previous lap */
+
+         /* Another producer (consumer) moved the position: reload it */
+         pos = atomic_load_explicit(pos_ptr, mo_relaxed);
+         continue;
+      }
+
+      if (atomic_compare_exchange_weak_explicit(pos_ptr,
+                                                &pos,
+                                                pos + k,
+                                                mo_relaxed,
+                                                mo_relaxed))
+      {
+         break;
+      }
+   }
+
+   *start = pos;
+   return k;
+}
+
+u32
+mpmc_ringbuf_write_elems(struct mpmc_ringbuf *rb,
+                         void *elems,
+                         u32 n,
+                         bool *was_empty)
+{
+   const u32 mask = rb->max_elems - 1;
+   const u32 e_size = rb->elem_size;
+   u32 pos, k, deq;
+
+   k = mpmc_reserve(rb, &rb->enqueue_pos, 0, n, &pos);
+
+   if (was_empty) {
+      deq = atomic_load_explicit(&rb->dequeue_pos, mo_relaxed);
+      *was_empty = k && deq == pos;
+   }
+
+   for (u32 i = 0; i < k; i++) {
+
+      memcpy(rb->buf + ((pos + i) & mask) * e_size,
+             (u8 *)elems + i * e_size,
+             e_size);
+
+      /* Publish the slot for the consumers */
+      atomic_store_explicit(&rb->seqs[(pos + i) & mask],
+                            pos + i + 1,
+                            mo_release);
+   }
+
+   return k;
+}
+
+u32
+mpmc_ringbuf_read_elems(struct mpmc_ringbuf *rb, void *elems, u32 n)
+{
+   const u32 mask = rb->max_elems - 1;
+   const u32 e_size = rb->elem_size;
+   u32 pos, k;
+
+   k = mpmc_reserve(rb, &rb->dequeue_pos, 1, n, &pos);
+
+   for (u32 i = 0; i < k; i++) {
+
+      memcpy((u8 *)elems + i * e_size,
+             rb->buf + ((pos + i) & mask) * e_size,
+             e_size);
+
+      /* The slot becomes free for the producer of the next lap */
+      atomic_store_explicit(&rb->seqs[(pos + i) & mask],
+                            pos + i + rb->max_elems,
+                            mo_release);
+   }
+
+   return k;
+}
+
+bool mpmc_ringbuf_write_elem(struct mpmc_ringbuf *rb, void *e, bool *was_empty)
+{
+   return mpmc_ringbuf_write_elems(rb, e, 1, was_empty) == 1;
+}
+
+bool mpmc_ringbuf_read_elem(struct mpmc_ringbuf *rb, void *elem_ptr)
+{
+   return mpmc_ringbuf_read_elems(rb, elem_ptr, 1) == 1;
+}
+
+void *
+mpmc_ringbuf_resize(struct mpmc_ringbuf *rb, u32 max_elems, void *buf)
+{
+   const u32 n = mpmc_ringbuf_get_elems(rb);
+   const u32 e_size = rb->elem_size;
+   const u32 old_mask = rb->max_elems - 1;
+   const u32 deq = atomic_load_explicit(&rb->dequeue_pos, mo_relaxed);
+   void *old_buf = (void *)rb->seqs;
+   u8 *old_elems = rb->buf;
+
+   ASSERT(max_elems > n);
+
+   mpmc_ringbuf_init(rb, max_elems, e_size, buf);
+
+   /* Copy the elements in order, starting from the oldest one */
+   for (u32 i = 0; i < n; i++) {
+
+      memcpy(rb->buf + i * e_size,
+             old_elems + ((deq + i) & old_mask) * e_size,
+             e_size);
+
+      atomic_store_explicit(&rb->seqs[i], i + 1, mo_relaxed);
+   }
+
+   atomic_store_explicit(&rb->enqueue_pos, n, mo_release);
+   return old_buf;
+}
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/pgroup.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+static struct pgroup *groups_root;
+static struct session *sessions_root;
+
+struct pgroup *pgroup_get(int pgid)
+{
+   ASSERT(!is_preemption_enabled());
+   return bintree_find_ptr(groups_root, (long)pgid, struct pgroup, node, pgid);
+}
+
+struct session *session_get(int sid)
+{
+   ASSERT(!is_preemption_enabled());
+   return bintree_find_ptr(sessions_root, (long)sid, struct session, node, sid);
+}
+
+static struct session *session_create(int sid)
+{
+   struct session *s;
+
+   if (!(s = kzalloc_obj(struct session)))
+      return NULL;
+
+   bintree_node_init(&s->node);
+   list_init(&s->groups);
+   s->sid = sid;
+
+   bintree_insert_ptr(&sessions_root, s, struct session, node, sid);
+   sched_reserve_pgsid(sid);
+   return s;
+}
+
+static void session_destroy(struct session *s)
+{
+   ASSERT(list_is_empty(&s->groups));
+   bintree_remove_ptr(&sessions_root, s, struct session, node, sid);
+
+   if (!pgroup_get((int)s->sid))
+      sched_release_pgsid((int)s->sid);
+
+   kfree_obj(s, struct session);
+}
+
+static struct pgroup *pgroup_create(int pgid, struct session *s)
+{
+   struct pgroup *g;
+
+   if (!(g = kzalloc_obj(struct pgroup)))
+      return NULL;
+
+   bintree_node_init(&g->node);
+   list_node_init(&g->session_node);
+   list_init(&g->members);
+   g->pgid = pgid;
+   g->session = s;
+
+   bintree_insert_ptr(&groups_root, g, struct pgroup, node, pgid);
+   list_add_tail(&s->groups, &g->session_node);
+   sched_reserve_pgsid(pgid);
+   return g;
+}
+
+static void pgroup_destroy(struct pgroup *g)
+{
+   struct session *s = g->session;
+
+   ASSERT(g->count == 0);
+   list_remove(&g->session_node);
+   bintree_remove_ptr(&groups_root, g, struct pgroup, node, pgid);
+
+   if (!session_get((int)g->pgid))
+      sched_release_pgsid((int)g->pgid);
+
+   kfree_obj(g, struct pgroup);
+
+   if (list_is_empty(&s->groups))
+      session_destroy(s);
+}
+
+void pgroup_add_member(struct pgroup *g, struct process *pi)
+{
+   ASSERT(!is_preemption_enabled());
+
+   list_add_tail(&g->members, &pi->pgrp_node);
+   g->count++;
+   pi->pgrp = g;
+   pi->pgid = (int)g->pgid;
+   pi->sid = (int)g->session->sid;
+}
+
+void pgroup_remove_member(struct process *pi)
+{
+   struct pgroup *g = pi->pgrp;
+   ASSERT(!is_preemption_enabled());
+
+   if (!g)
+      return;
+
+   list_remove(&pi->pgrp_node);
+   pi->pgrp = NULL;
+
+   if (--g->count == 0)
+      pgroup_destroy(g);
+}
+
+int pgroup_join(struct process *pi, int pgid, int sid)
+{
+   struct pgroup *g = pgroup_get(pgid);
+   struct session *s;
+   bool new_session = false;
+
+   if (g) {
+
+      ASSERT(g->session->sid == sid);
+
+      if (g == pi->pgrp)
+         return 0; /* Nothing to do */
+
+   } else {
+
+      if (!(s = session_get(sid))) {
+
+         if (!(s = session_create(sid)))
+            return -ENOMEM;
+
+         new_session = true;
+      }
+
+      if (!(g = pgroup_create(pgid, s))) {
+
+         if (new_session)
+            session_destroy(s);
+
+         return -ENOMEM;
+      }
+   }
+
+   /*
+    * NOTE: leave the old group only after the new one got created: in case
+    * they're in the same session, the session won't be destroyed.
+    */
+   pgroup_remove_member(pi);
+   pgroup_add_member(g, pi);
+   return 0;
+}
@@ -2,22 +2,43 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/hal.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/pipe.h>
 #include <tilck/kernel/fs/kernelfs.h>
-#include <tilck/kernel/ringbuf.h>
+#include <tilck/kernel/cmdline.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/user.h>
+
+/*
+ * The pipe's buffer is a ring of pages, allocated on demand: only the pages
+ * actually reached by the data are allocated. Therefore, pipes used for small
+ * messages cost just one page, no matter how big their capacity is.
+ *
+ * In packet mode (pipe2() with O_DIRECT), each write() of up to PIPE_BUF
+ * bytes is a packet, stored in the ring after a PIPE_PKT_HDR_SZ header with
+ * its length, and each read() returns at most one packet. Bigger writes are
+ * split in multiple packets. Like on Linux, when the read buffer is smaller
+ * than the packet, the rest of the packet is discarded.
+ */
+
+#define PIPE_PKT_HDR_SZ                   ((u32)sizeof(u32))
 
 struct pipe {
 
    KOBJ_BASE_FIELDS
 
-   char *buf;
-   struct ringbuf rb;
+   void **pages;
+   u32 nr_pages;                 /* capacity, in pages (a power of 2) */
+   u32 read_pos;
+   u32 used;                     /* bytes in the buffer */
+
    struct kmutex mutex;
    struct kcond not_full_cond;
    struct kcond not_empty_cond;
@@ -25,129 +46,653 @@ struct pipe {
 
    ATOMIC(int) read_handles;
    ATOMIC(int) write_handles;
+
+   bool packet;                  /* packet mode (O_DIRECT) */
+   bool poll_usage;              /* ever used with poll/select/epoll */
 };
 
-static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
+struct pipe_stats pipe_stats;
+static DEFINE_LOCK_CLASS(pipe_lock_class, "pipe");
+static DEFINE_LOCK_CLASS(pipe_cond_lock_class, "pipe_cond");
+
+static inline u32 pipe_capacity(struct pipe *p)
 {
-   struct kfs_handle *kh = h;
-   struct pipe *p = (void *)kh->kobj;
-   bool sig_pending = false;
-   ssize_t rc = 0;
-   ASSERT(*pos == 0);
+   return p->nr_pages << PAGE_SHIFT;
+}
 
-   if (!size)
+static inline bool pipe_is_empty(struct pipe *p)
+{
+   return p->used == 0;
+}
+
+static inline bool pipe_is_full(struct pipe *p)
+{
+   return p->used == pipe_capacity(p);
+}
+
+static inline u32 pipe_room(struct pipe *p)
+{
+   return pipe_capacity(p) - p->used;
+}
+
+/* Max payload of a packet: the capacity is at least one page */
+static inline u32 pipe_max_packet(struct pipe *p)
+{
+   return MIN((u32)PIPE_BUF, pipe_capacity(p) - PIPE_PKT_HDR_SZ);
+}
+
+/*
+ * The room the writers are woken up for: enough for a whole PIPE_BUF write
+ * (packet). See pipe_after_read().
+ */
+static inline u32 pipe_wake_room(struct pipe *p)
+{
+   if (p->packet)
+      return pipe_max_packet(p) + PIPE_PKT_HDR_SZ;
+
+   return MIN((u32)PIPE_BUF, pipe_capacity(p));
+}
+
+static void pipe_stats_add(ulong *counter, ulong val)
+{
+   disable_preemption();
+   {
+      *counter += val;
+   }
+   enable_preemption();
+}
+
+/* Values for the `user` parameter of the functions below */
+#define PIPE_KERNEL_BUF                       0
+#define PIPE_USER_BUF                         1
+
+static int pipe_memcpy(void *dst, const void *src, size_t n, int user, bool out)
+{
+   if (user == PIPE_KERNEL_BUF) {
+      fast_memcpy(dst, src, n);
       return 0;
+   }
 
-   kmutex_lock(&p->mutex);
+   if (out)
+      return copy_to_user(dst, src, n) ? -EFAULT : 0;
 
-   while (true) {
+   return copy_from_user(dst, src, n) ? -EFAULT : 0;
+}
 
-      rc = (ssize_t)ringbuf_read_bytes(&p->rb, (u8 *)buf, size);
+/* Copies `size` bytes from the ring, starting at its position `pos` */
+static int
+pipe_copy_out(struct pipe *p, u32 pos, char *buf, size_t size, int user)
+{
+   size_t tot = 0;
 
-      if (rc)
-         break; /* Everything is alright, we read something */
+   while (tot < size) {
 
-      if (atomic_load_explicit(&p->write_handles, mo_relaxed) == 0) {
-         /* No more writers, always return 0, no matter what. */
-         break;
+      const u32 off = pos & (PAGE_SIZE - 1);
+      const size_t n = MIN(size - tot, PAGE_SIZE - off);
+      void *page = p->pages[pos >> PAGE_SHIFT];
+
+      if (pipe_memcpy(buf + tot, page + off, n, user, true))
+         return -EFAULT;
+
+      pos = (pos + (u32)n) & (pipe_capacity(p) - 1);
+      tot += n;
+   }
+
+   return 0;
+}
+
+/* Drops `size` bytes from the beginning of the data in the ring */
+static void pipe_consume(struct pipe *p, size_t size)
+{
+   ASSERT(size <= p->used);
+   p->read_pos = (p->read_pos + (u32)size) & (pipe_capacity(p) - 1);
+   p->used -= (u32)size;
+
+   if (pipe_is_empty(p)) {
+
+      /*
+       * Restart from the beginning: that way, a pipe never holding more than
+       * one page worth of data will keep using just its first page.
+       */
+      p->read_pos = 0;
+   }
+}
+
+static ssize_t pipe_read_bytes(struct pipe *p, char *buf, size_t size, int user)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+   size = MIN(size, p->used);
+
+   if (pipe_copy_out(p, p->read_pos, buf, size, user))
+      return -EFAULT;
+
+   pipe_consume(p, size);
+   return (ssize_t)size;
+}
+
+/*
+ * Returns the number of bytes written, which is 0 if we're out of memory, or
+ * -EFAULT if nothing could be copied from the user buffer.
+ */
+static ssize_t
+pipe_write_bytes(struct pipe *p, const char *buf, size_t size, int user)
+{
+   size_t tot = 0;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+   size = MIN(size, pipe_capacity(p) - p->used);
+
+   while (tot < size) {
+
+      const u32 pos = (p->read_pos + p->used) & (pipe_capacity(p) - 1);
+      const u32 off = pos & (PAGE_SIZE - 1);
+      const size_t n = MIN(size - tot, PAGE_SIZE - off);
+      void **page = &p->pages[pos >> PAGE_SHIFT];
+
+      if (!*page && !(*page = kmalloc(PAGE_SIZE)))
+         break; /* Out of memory: let the caller handle that */
+
+      if (pipe_memcpy(*page + off, buf + tot, n, user, false))
+         return tot ? (ssize_t)tot : -EFAULT;
+
+      p->used += (u32)n;
+      tot += n;
+   }
+
+   return (ssize_t)tot;
+}
+
+/*
+ * Reads the packet at the beginning of the ring, scattering it into the
+ * given buffers. The part of the packet not fitting in them is discarded.
+ */
+static ssize_t
+pipe_read_packet(struct pipe *p, const struct iovec *iov, int iovcnt, int user)
+{
+   const u32 mask = pipe_capacity(p) - 1;
+   size_t tot = 0, n;
+   u32 len;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+   ASSERT(p->used >= PIPE_PKT_HDR_SZ);
+
+   pipe_copy_out(p, p->read_pos, (void *)&len, PIPE_PKT_HDR_SZ,
+                 PIPE_KERNEL_BUF);
+
+   for (int i = 0; i < iovcnt && tot < len; i++) {
+
+      n = MIN(iov[i].iov_len, len - tot);
+
+      if (pipe_copy_out(p, (p->read_pos + PIPE_PKT_HDR_SZ + (u32)tot) & mask,
+                        iov[i].iov_base, n, user))
+      {
+         return -EFAULT;   /* Leave the packet in the pipe */
       }
 
-      if (kh->fl_flags & O_NONBLOCK) {
-         rc = -EAGAIN;
+      tot += n;
+   }
+
+   pipe_consume(p, PIPE_PKT_HDR_SZ + len);
+   return (ssize_t)tot;
+}
+
+/*
+ * Writes `size` bytes as packets of up to pipe_max_packet() bytes, as long as
+ * whole packets fit in the ring. Returns the number of bytes written, which
+ * is 0 if we're out of memory, or -EFAULT if nothing could be copied from the
+ * user buffer. A packet is never written partially.
+ */
+static ssize_t
+pipe_write_packets(struct pipe *p, const char *buf, size_t size, int user)
+{
+   size_t tot = 0;
+   ssize_t rc;
+   u32 n, used;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+
+   while (tot < size) {
+
+      n = (u32)MIN(size - tot, pipe_max_packet(p));
+
+      if (pipe_room(p) < PIPE_PKT_HDR_SZ + n)
+         break;
+
+      used = p->used;
+      rc = pipe_write_bytes(p, (void *)&n, PIPE_PKT_HDR_SZ, PIPE_KERNEL_BUF);
+
+      if (rc == (ssize_t)PIPE_PKT_HDR_SZ)
+         rc = pipe_write_bytes(p, buf + tot, n, user);
+
+      if (rc != (ssize_t)n) {
+
+         p->used = used;   /* Drop the incomplete packet */
+
+         if (!tot && rc < 0)
+            return rc;
+
          break;
       }
 
+      tot += n;
+   }
+
+   return (ssize_t)tot;
+}
+
+static void pipe_free_pages(void **pages, u32 nr_pages)
+{
+   for (u32 i = 0; i < nr_pages; i++) {
+      if (pages[i])
+         kfree2(pages[i], PAGE_SIZE);
+   }
+
+   kfree2(pages, sizeof(void *) * nr_pages);
+}
+
+static u32 pipe_size_to_pages(ulong size)
+{
+   size = MAX(size, PAGE_SIZE);
+   return (u32)roundup_next_power_of_2(
+      pow2_round_up_at(size, PAGE_SIZE) >> PAGE_SHIFT
+   );
+}
+
+/*
+ * Waits for some data in the pipe, with its mutex held. Returns 1 if there's
+ * data, 0 if there's no data and no writers, or a negative error.
+ */
+static int pipe_wait_data(struct pipe *p, bool nonblock)
+{
+   while (pipe_is_empty(p)) {
+
+      if (atomic_load_explicit(&p->write_handles, mo_relaxed) == 0) {
+         /* No more writers, always return 0, no matter what. */
+         return 0;
+      }
+
+      if (nonblock)
+         return -EAGAIN;
+
       /* Wait for writers to fill up the buffer */
+      pipe_stats_add(&pipe_stats.read_waits, 1);
       kcond_wait(&p->not_empty_cond, &p->mutex, KCOND_WAIT_FOREVER);
 
       /* After wake up */
-      if (pending_signals()) {
-         sig_pending = true;
-         break;
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   return 1;
+}
+
+/*
+ * Waits for at least `need` bytes of room in the pipe, with its mutex held.
+ * Returns 1 if there's room, or a negative error.
+ */
+static int pipe_wait_room(struct pipe *p, u32 need, bool nonblock)
+{
+   while (true) {
+
+      if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
+
+         /* Broken pipe */
+         send_signal(get_curr_pid(), SIGPIPE, true);
+         return -EPIPE;
       }
+
+      if (pipe_room(p) >= need)
+         return 1;
+
+      if (nonblock)
+         return -EAGAIN;
+
+      /* Wait for readers to empty the buffer */
+      pipe_stats_add(&pipe_stats.write_waits, 1);
+      kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+
+      /* After wake up */
+      if (pending_signals())
+         return -EINTR;
    }
+}
 
-   /*
-    * Wake up one blocked writer instead of all of them.
-    *
-    * Rationale: it is totally possible that just a single writer will fill up
-    * the whole buffer and, after that, the other writers will wake up just to
-    * discover they need to go back sleeping again. To spare those unnecessary
-    * context switches, we just wake up a single writer and, after it's done it
-    * will wake up writer if the buffer is still not full.
-    *
-    * The situation is perfectly symmetric for the readers as well, that's why
-    * here below we wake up another reader if the buffer is not empty.
-    */
-   kcond_signal_one(&p->not_full_cond);
-
-   if (!ringbuf_is_empty(&p->rb)) {
+/*
+ * Wakeup coalescing: the readers wait only when the pipe is empty, therefore
+ * they need to be signaled only when it becomes non-empty. Symmetrically, the
+ * writers wait only for pipe_wake_room() bytes of room at most, therefore
+ * they need to be signaled only when the room crosses that watermark. That
+ * spares a context switch per read/write to the producer/consumer pairs
+ * exchanging small messages. The exception are the pipes used with poll,
+ * select or epoll: an edge-triggered epoll expects an event for every write,
+ * like on Linux, therefore the readers of those pipes are always signaled.
+ *
+ * Also, we wake up one blocked writer instead of all of them. Rationale: it
+ * is totally possible that just a single writer will fill up the whole buffer
+ * and, after that, the other writers will wake up just to discover they need
+ * to go back sleeping again. To spare those unnecessary context switches, we
+ * just wake up a single writer and, after it's done it will wake up another
+ * writer if there's still enough room. The situation is perfectly symmetric
+ * for the readers as well, that's why here below we wake up another reader if
+ * the buffer is not empty.
+ */
+static void pipe_after_read(struct pipe *p, u32 room_before)
+{
+   const u32 wake_room = pipe_wake_room(p);
+
+   if (room_before < wake_room && pipe_room(p) >= wake_room)
+      kcond_signal_one(&p->not_full_cond);
+
+   if (!pipe_is_empty(p)) {
       /* The buffer is not empty: wake up one more reader, if any */
       kcond_signal_one(&p->not_empty_cond);
    }
+}
+
+/* See pipe_after_read() */
+static void pipe_after_write(struct pipe *p, u32 used_before)
+{
+   if (!pipe_is_empty(p) && (!used_before || p->poll_usage))
+      kcond_signal_one(&p->not_empty_cond);
+
+   if (pipe_room(p) >= pipe_wake_room(p)) {
+      /* There's still room: wake up one more writer, if any */
+      kcond_signal_one(&p->not_full_cond);
+   }
+}
+
+static ssize_t
+pipe_do_read(struct pipe *p, char *buf, size_t size, int user, bool nonblock)
+{
+   const struct iovec iov = { .iov_base = buf, .iov_len = size };
+   u32 room_before;
+   ssize_t rc;
+
+   if (!size)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   room_before = pipe_room(p);
+
+   if ((rc = pipe_wait_data(p, nonblock)) > 0) {
+
+      room_before = pipe_room(p);
+
+      if (p->packet)
+         rc = pipe_read_packet(p, &iov, 1, user);
+      else
+         rc = pipe_read_bytes(p, buf, size, user);
+
+      if (rc > 0) {
+         /* Everything is alright, we read something */
+         pipe_stats_add(&pipe_stats.reads, 1);
+         pipe_stats_add(&pipe_stats.bytes_read, (ulong)rc);
+      }
+   }
+
+   pipe_after_read(p, room_before);
 
    /* Unlock the pipe's state lock and return */
    kmutex_unlock(&p->mutex);
-   return !sig_pending ? rc : -EINTR;
+   return rc;
+}
+
+/* The room a write of `size` bytes has to wait for */
+static u32 pipe_write_need(struct pipe *p, size_t size)
+{
+   if (p->packet)
+      return PIPE_PKT_HDR_SZ + (u32)MIN(size, pipe_max_packet(p));
+
+   return 1;
+}
+
+static ssize_t
+pipe_do_write(struct pipe *p, const char *buf, size_t size, int user,
+              bool nonblock)
+{
+   u32 used_before;
+   ssize_t rc;
+
+   if (!size)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   used_before = p->used;
+
+   if ((rc = pipe_wait_room(p, pipe_write_need(p, size), nonblock)) > 0) {
+
+      used_before = p->used;
+
+      if (p->packet)
+         rc = pipe_write_packets(p, buf, size, user);
+      else
+         rc = pipe_write_bytes(p, buf, size, user);
+
+      if (!rc) {
+         rc = -ENOMEM;
+      } else if (rc > 0) {
+         /* Everything is alright, we wrote something */
+         pipe_stats_add(&pipe_stats.writes, 1);
+         pipe_stats_add(&pipe_stats.bytes_written, (ulong)rc);
+      }
+   }
+
+   pipe_after_write(p, used_before);
+
+   /* Unlock the pipe's state lock and return */
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+static ssize_t pipe_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   ASSERT(*pos == 0);
+
+   return pipe_do_read((void *)kh->kobj, buf, size, PIPE_KERNEL_BUF,
+                       !!(kh->fl_flags & O_NONBLOCK));
 }
 
 static ssize_t pipe_write(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   ASSERT(*pos == 0);
+
+   return pipe_do_write((void *)kh->kobj, buf, size, PIPE_KERNEL_BUF,
+                        !!(kh->fl_flags & O_NONBLOCK));
+}
+
+/*
+ * splice() from a pipe: the data is passed to the actor directly from the
+ * ring's pages and only the bytes the actor accepted are consumed. The pipe's
+ * mutex is held in the meanwhile: writers to the pipe wait for the actor.
+ */
+static ssize_t
+pipe_splice_read(fs_handle h,
+                 size_t len,
+                 offt *pos,
+                 func_splice_actor actor,
+                 void *arg)
 {
    struct kfs_handle *kh = h;
    struct pipe *p = (void *)kh->kobj;
-   bool sig_pending = false;
-   ssize_t rc = 0;
+   ssize_t tot = 0, rc;
+   u32 room_before;
    ASSERT(*pos == 0);
 
-   if (!size)
+   kmutex_lock(&p->mutex);
+
+   if (p->packet) {
+      kmutex_unlock(&p->mutex);
+      return -EINVAL;   /* The packet boundaries would be lost */
+   }
+
+   if ((rc = pipe_wait_data(p, !!(kh->fl_flags & O_NONBLOCK))) <= 0) {
+      kmutex_unlock(&p->mutex);
+      return rc;
+   }
+
+   room_before = pipe_room(p);
+   len = MIN(len, p->used);
+
+   while ((size_t)tot < len) {
+
+      const u32 off = p->read_pos & (PAGE_SIZE - 1);
+      const size_t n = MIN(len - (size_t)tot, PAGE_SIZE - off);
+
+      rc = actor(arg, p->pages[p->read_pos >> PAGE_SHIFT] + off, n);
+
+      if (rc <= 0) {
+
+         if (!tot)
+            tot = rc;
+
+         break;
+      }
+
+      pipe_consume(p, (size_t)rc);
+      tot += rc;
+
+      if ((size_t)rc < n)
+         break;
+   }
+
+   if (tot > 0) {
+      pipe_stats_add(&pipe_stats.reads, 1);
+      pipe_stats_add(&pipe_stats.bytes_read, (ulong)tot);
+   }
+
+   pipe_after_read(p, room_before);
+   kmutex_unlock(&p->mutex);
+   return tot;
+}
+
+/*
+ * readv() and writev() on pipes: all the segments are handled holding the
+ * pipe's mutex, copying directly from/to the user buffers. Like read() and
+ * write(), they wait only once: for some data or for some room.
+ */
+static size_t pipe_iov_len(const struct iovec *iov, int iovcnt)
+{
+   size_t tot = 0;
+
+   for (int i = 0; i < iovcnt; i++)
+      tot += iov[i].iov_len;
+
+   return tot;
+}
+
+static ssize_t pipe_readv(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   ssize_t tot = 0, rc;
+   u32 room_before;
+
+   if (!pipe_iov_len(iov, iovcnt))
       return 0;
 
    kmutex_lock(&p->mutex);
+   room_before = pipe_room(p);
 
-   while (true) {
+   if ((rc = pipe_wait_data(p, !!(kh->fl_flags & O_NONBLOCK))) <= 0)
+      goto out;
 
-      if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
+   room_before = pipe_room(p);
+
+   if (p->packet) {
+
+      /* A single packet, scattered into the buffers */
+      tot = pipe_read_packet(p, iov, iovcnt, PIPE_USER_BUF);
+      iovcnt = 0;
+   }
+
+   for (int i = 0; i < iovcnt && !pipe_is_empty(p); i++) {
+
+      rc = pipe_read_bytes(p, iov[i].iov_base, iov[i].iov_len, PIPE_USER_BUF);
+
+      if (rc < 0) {
+
+         if (!tot)
+            tot = rc;
 
-         /* Broken pipe */
-         send_signal(get_curr_pid(), SIGPIPE, true);
-         rc = -EPIPE;
          break;
       }
 
-      rc = (ssize_t)ringbuf_write_bytes(&p->rb, (u8 *)buf, size);
+      tot += rc;
+   }
 
-      if (rc)
-         break; /* Everything is alright, we wrote something */
+   rc = tot;
+
+   if (tot > 0) {
+      pipe_stats_add(&pipe_stats.reads, 1);
+      pipe_stats_add(&pipe_stats.bytes_read, (ulong)tot);
+   }
+
+out:
+   pipe_after_read(p, room_before);
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+static ssize_t pipe_writev(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   const size_t len = pipe_iov_len(iov, iovcnt);
+   const bool nonblock = !!(kh->fl_flags & O_NONBLOCK);
+   ssize_t tot = 0, rc;
+   u32 used_before;
+
+   if (!len)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   used_before = p->used;
+
+   if ((rc = pipe_wait_room(p, pipe_write_need(p, len), nonblock)) <= 0)
+      goto out;
+
+   used_before = p->used;
+
+   /* In packet mode, each buffer is written as separate packet(s) */
+   for (int i = 0; i < iovcnt && !pipe_is_full(p); i++) {
+
+      char *base = iov[i].iov_base;
+
+      if (!iov[i].iov_len)
+         continue;
+
+      if (p->packet)
+         rc = pipe_write_packets(p, base, iov[i].iov_len, PIPE_USER_BUF);
+      else
+         rc = pipe_write_bytes(p, base, iov[i].iov_len, PIPE_USER_BUF);
+
+      if (rc <= 0) {
+
+         if (!tot)
+            tot = rc ? rc : -ENOMEM;
 
-      if (kh->fl_flags & O_NONBLOCK) {
-         rc = -EAGAIN;
          break;
       }
 
-      /* Wait for readers to empty the buffer */
-      kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+      tot += rc;
 
-      /* After wake up */
-      if (pending_signals()) {
-         sig_pending = true;
+      if ((size_t)rc < iov[i].iov_len)
          break;
-      }
    }
 
-   /*
-    * Wake up one blocked reader, instead of all of them.
-    * See the comments in pipe_read() above.
-    */
-   kcond_signal_one(&p->not_empty_cond);
+   rc = tot;
 
-   if (!ringbuf_is_full(&p->rb)) {
-      /* The buffer is not full: wake up one more writer, if any */
-      kcond_signal_one(&p->not_full_cond);
+   if (tot > 0) {
+      pipe_stats_add(&pipe_stats.writes, 1);
+      pipe_stats_add(&pipe_stats.bytes_written, (ulong)tot);
    }
 
-   /* Unlock the pipe's state lock and return */
+out:
+   pipe_after_write(p, used_before);
    kmutex_unlock(&p->mutex);
-   return !sig_pending ? rc : -EINTR;
+   return rc;
 }
 
 static int pipe_read_ready(fs_handle h)
@@ -158,17 +703,19 @@ static int pipe_read_ready(fs_handle h)
 
    kmutex_lock(&p->mutex);
    {
-      ret = !ringbuf_is_empty(&p->rb) ||
+      ret = !pipe_is_empty(p) ||
             atomic_load_explicit(&p->write_handles, mo_relaxed) == 0;
    }
    kmutex_unlock(&p->mutex);
    return ret;
 }
 
+/* Called only by poll, select and epoll: see pipe_after_read() */
 static struct kcond *pipe_get_rready_cond(fs_handle h)
 {
    struct kfs_handle *kh = h;
    struct pipe *p = (void *)kh->kobj;
+   p->poll_usage = true;
    return &p->not_empty_cond;
 }
 
@@ -180,7 +727,7 @@ static int pipe_write_ready(fs_handle h)
 
    kmutex_lock(&p->mutex);
    {
-      ret = !ringbuf_is_full(&p->rb) ||
+      ret = pipe_room(p) >= pipe_wake_room(p) ||
             atomic_load_explicit(&p->read_handles, mo_relaxed) == 0;
    }
    kmutex_unlock(&p->mutex);
@@ -222,6 +769,8 @@ static struct kcond *pipe_get_except_cond(fs_handle h)
 static const struct file_ops static_ops_pipe_read_end =
 {
    .read = pipe_read,
+   .readv = pipe_readv,
+   .splice_read = pipe_splice_read,
    .read_ready = pipe_read_ready,
    .except_ready = pipe_except_ready,
    .get_rready_cond = pipe_get_rready_cond,
@@ -231,20 +780,37 @@ static const struct file_ops static_ops_pipe_read_end =
 static const struct file_ops static_ops_pipe_write_end =
 {
    .write = pipe_write,
+   .writev = pipe_writev,
    .except_ready = pipe_except_ready,
    .write_ready = pipe_write_ready,
    .get_wready_cond = pipe_get_wready_cond,
    .get_except_cond = pipe_get_except_cond,
 };
 
+bool is_pipe_handle(fs_handle h)
+{
+   const struct file_ops *fops = ((struct fs_handle_base *)h)->fops;
+   return fops == &static_ops_pipe_read_end ||
+          fops == &static_ops_pipe_write_end;
+}
+
+static bool is_pipe_read_end(fs_handle h)
+{
+   return ((struct fs_handle_base *)h)->fops == &static_ops_pipe_read_end;
+}
+
+static bool is_pipe_write_end(fs_handle h)
+{
+   return ((struct fs_handle_base *)h)->fops == &static_ops_pipe_write_end;
+}
+
 void destroy_pipe(struct pipe *p)
 {
    kcond_destory(&p->err_cond);
    kcond_destory(&p->not_empty_cond);
    kcond_destory(&p->not_full_cond);
    kmutex_destroy(&p->mutex);
-   ringbuf_destory(&p->rb);
-   kfree2(p->buf, PIPE_BUF_SIZE);
+   pipe_free_pages(p->pages, p->nr_pages);
    kfree_obj(p, struct pipe);
 }
 
@@ -288,7 +854,16 @@ struct pipe *create_pipe(void)
    if (!(p = (void *)kzalloc_obj(struct pipe)))
       return NULL;
 
-   if (!(p->buf = kmalloc(PIPE_BUF_SIZE))) {
+   p->nr_pages = pipe_size_to_pages(kopt_pipe_size);
+
+   if (!(p->pages = kzmalloc(sizeof(void *) * p->nr_pages))) {
+      kfree_obj(p, struct pipe);
+      return NULL;
+   }
+
+   /* Allocate the first page in advance: most of the pipes need just it */
+   if (!(p->pages[0] = kmalloc(PAGE_SIZE))) {
+      kfree2(p->pages, sizeof(void *) * p->nr_pages);
       kfree_obj(p, struct pipe);
       return NULL;
    }
@@ -296,11 +871,13 @@ struct pipe *create_pipe(void)
    p->on_handle_close = &pipe_on_handle_close;
    p->on_handle_dup = &pipe_on_handle_dup;
    p->destory_obj = (void *)&destroy_pipe;
-   ringbuf_init(&p->rb, PIPE_BUF_SIZE, 1, p->buf);
    kmutex_init(&p->mutex, 0);
    kcond_init(&p->not_full_cond);
    kcond_init(&p->not_empty_cond);
    kcond_init(&p->err_cond);
+   kmutex_set_lock_class(&p->mutex, &pipe_lock_class);
+   kcond_set_lock_class(&p->not_full_cond, &pipe_cond_lock_class);
+   kcond_set_lock_class(&p->not_empty_cond, &pipe_cond_lock_class);
    return p;
 }
 
@@ -327,3 +904,293 @@ fs_handle pipe_create_write_handle(struct pipe *p)
 
    return res;
 }
+
+int pipe_get_size(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   return (int)pipe_capacity(p);
+}
+
+/*
+ * Changes the capacity of the pipe, like Linux's F_SETPIPE_SZ: the size is
+ * rounded up to a power-of-2 number of pages and the buffer cannot shrink
+ * below the amount of data in it. Returns the new capacity.
+ */
+int pipe_set_size(fs_handle h, ulong size)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   void **new_pages, **old_pages;
+   u32 nr_pages, old_nr_pages, pos;
+   size_t used, off, n;
+   int rc;
+
+   if (size > PIPE_MAX_SIZE)
+      return -EPERM;
+
+   nr_pages = pipe_size_to_pages(size);
+
+   if (!(new_pages = kzmalloc(sizeof(void *) * nr_pages)))
+      return -ENOMEM;
+
+   kmutex_lock(&p->mutex);
+
+   if (nr_pages == p->nr_pages) {
+      rc = (int)pipe_capacity(p);
+      kmutex_unlock(&p->mutex);
+      kfree2(new_pages, sizeof(void *) * nr_pages);
+      return rc;
+   }
+
+   if ((nr_pages << PAGE_SHIFT) < p->used) {
+      kmutex_unlock(&p->mutex);
+      kfree2(new_pages, sizeof(void *) * nr_pages);
+      return -EBUSY;
+   }
+
+   /* Copy the data at the beginning of the new ring */
+   used = p->used;
+
+   for (u32 i = 0; i == 0 || (i << PAGE_SHIFT) < used; i++) {
+
+      if (!(new_pages[i] = kmalloc(PAGE_SIZE))) {
+         kmutex_unlock(&p->mutex);
+         pipe_free_pages(new_pages, nr_pages);
+         return -ENOMEM;
+      }
+
+      off = i << PAGE_SHIFT;
+      n = used > off ? MIN(used - off, PAGE_SIZE) : 0;
+      pos = (p->read_pos + (u32)off) & (pipe_capacity(p) - 1);
+      pipe_copy_out(p, pos, new_pages[i], n, PIPE_KERNEL_BUF);
+   }
+
+   old_pages = p->pages;
+   old_nr_pages = p->nr_pages;
+   p->pages = new_pages;
+   p->nr_pages = nr_pages;
+   p->read_pos = 0;
+   p->used = (u32)used;
+   rc = (int)pipe_capacity(p);
+
+   /* The pipe might have more room now */
+   kcond_signal_all(&p->not_full_cond);
+   kmutex_unlock(&p->mutex);
+
+   pipe_free_pages(old_pages, old_nr_pages);
+   pipe_stats_add(&pipe_stats.resizes, 1);
+   return rc;
+}
+
+/*
+ * Switches the pipe to the packet mode (O_DIRECT) or back to the stream mode.
+ * The pipe must be empty: the data in it has been written in the other mode.
+ */
+int pipe_set_packet_mode(fs_handle h, bool enabled)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   int rc = 0;
+
+   kmutex_lock(&p->mutex);
+   {
+      if (p->packet != enabled) {
+
+         if (pipe_is_empty(p))
+            p->packet = enabled;
+         else
+            rc = -EBUSY;
+      }
+   }
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+/*
+ * Copies up to `len` bytes from the pipe `in` to the pipe `out`, directly
+ * between their rings, holding both their mutexes. When `consume` is false,
+ * the data is left in `in` (tee), otherwise it's moved (splice).
+ */
+static ssize_t
+pipe_move_bytes(struct pipe *in, struct pipe *out, size_t len, bool consume)
+{
+   u32 pos = in->read_pos;
+   size_t tot = 0;
+   ssize_t rc;
+
+   len = MIN(len, in->used);
+   len = MIN(len, pipe_capacity(out) - out->used);
+
+   while (tot < len) {
+
+      const u32 off = pos & (PAGE_SIZE - 1);
+      const size_t n = MIN(len - tot, PAGE_SIZE - off);
+      void *page = in->pages[pos >> PAGE_SHIFT];
+
+      rc = pipe_write_bytes(out, page + off, n, PIPE_KERNEL_BUF);
+      tot += (size_t)rc;
+
+      if ((size_t)rc < n)
+         break; /* Out of memory */
+
+      pos = (pos + (u32)n) & (pipe_capacity(in) - 1);
+   }
+
+   if (consume)
+      pipe_consume(in, tot);
+
+   return tot ? (ssize_t)tot : -ENOMEM;
+}
+
+/*
+ * Implementation of tee() (consume = false) and of splice() between two pipes
+ * (consume = true). The data is copied once, from ring to ring, instead of
+ * going through a bounce buffer or the user space.
+ *
+ * NOTE: the mutexes of the two pipes are always taken in the same order (by
+ * address) and only one of them is held while waiting.
+ */
+ssize_t
+pipe_to_pipe(fs_handle in_h, fs_handle out_h, size_t len,
+             bool nonblock, bool consume)
+{
+   struct pipe *in = (void *)((struct kfs_handle *)in_h)->kobj;
+   struct pipe *out = (void *)((struct kfs_handle *)out_h)->kobj;
+   struct pipe *first = in < out ? in : out;
+   struct pipe *second = in < out ? out : in;
+   struct pipe *wp;
+   u32 in_room, out_used;
+   ssize_t rc;
+
+   if (!is_pipe_read_end(in_h) || !is_pipe_write_end(out_h))
+      return -EBADF;
+
+   if (in == out)
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   while (true) {
+
+      kmutex_lock(&first->mutex);
+      kmutex_lock(&second->mutex);
+
+      if (atomic_load_explicit(&out->read_handles, mo_relaxed) == 0) {
+
+         /* Broken pipe */
+         send_signal(get_curr_pid(), SIGPIPE, true);
+         rc = -EPIPE;
+         break;
+      }
+
+      if (in->packet || out->packet) {
+         rc = -EINVAL;   /* The packet boundaries would be lost */
+         break;
+      }
+
+      if (!pipe_is_empty(in) && !pipe_is_full(out)) {
+         in_room = pipe_room(in);
+         out_used = out->used;
+         rc = pipe_move_bytes(in, out, len, consume);
+         break;
+      }
+
+      if (pipe_is_empty(in) &&
+          atomic_load_explicit(&in->write_handles, mo_relaxed) == 0)
+      {
+         /* No more writers and no data */
+         rc = 0;
+         break;
+      }
+
+      if (nonblock) {
+         rc = -EAGAIN;
+         break;
+      }
+
+      /* Keep just the mutex of the pipe we have to wait for */
+      wp = pipe_is_empty(in) ? in : out;
+      kmutex_unlock(wp == first ? &second->mutex : &first->mutex);
+
+      if (wp == in) {
+         pipe_stats_add(&pipe_stats.read_waits, 1);
+         kcond_wait(&in->not_empty_cond, &in->mutex, KCOND_WAIT_FOREVER);
+      } else {
+         pipe_stats_add(&pipe_stats.write_waits, 1);
+         kcond_wait(&out->not_full_cond, &out->mutex, KCOND_WAIT_FOREVER);
+      }
+
+      kmutex_unlock(&wp->mutex);
+
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   if (rc > 0) {
+
+      pipe_stats_add(&pipe_stats.writes, 1);
+      pipe_stats_add(&pipe_stats.bytes_written, (ulong)rc);
+
+      if (consume) {
+         pipe_stats_add(&pipe_stats.reads, 1);
+         pipe_stats_add(&pipe_stats.bytes_read, (ulong)rc);
+         pipe_after_read(in, in_room);
+      }
+
+      pipe_after_write(out, out_used);
+   }
+
+   kmutex_unlock(&second->mutex);
+   kmutex_unlock(&first->mutex);
+   return rc;
+}
+
+/*
+ * vmsplice(): copies the user buffers directly to the ring of the pipe (write
+ * end) or from it (read end), like pipe_writev() and pipe_readv(), but taking
+ * the mutex once per buffer. It blocks only until the first buffer can be
+ * (partially) moved.
+ */
+ssize_t
+pipe_vmsplice(fs_handle h, const struct iovec *iov, int iovcnt, bool nonblock)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   const bool wr = is_pipe_write_end(h);
+   ssize_t tot = 0, rc;
+
+   nonblock = nonblock || (kh->fl_flags & O_NONBLOCK);
+
+   for (int i = 0; i < iovcnt; i++) {
+
+      const size_t len = iov[i].iov_len;
+
+      if (!len)
+         continue;
+
+      if (wr) {
+         rc = pipe_do_write(p, iov[i].iov_base, len,
+                            PIPE_USER_BUF, nonblock || tot > 0);
+      } else {
+         rc = pipe_do_read(p, iov[i].iov_base, len,
+                           PIPE_USER_BUF, nonblock || tot > 0);
+      }
+
+      if (rc <= 0) {
+
+         if (!tot)
+            tot = rc;
+
+         break;
+      }
+
+      tot += rc;
+
+      if ((size_t)rc < len)
+         break;
+   }
+
+   return tot;
+}
@@ -25,9 +25,13 @@ poll_count_conds(struct pollfd *fds, nfds_t nfds)
          continue;
       }
 
-      if (fds[i].events & (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI)) {
+      if (fds[i].events & (POLLIN | POLLRDNORM | POLLRDBAND)) {
 
-         fds[i].events |= POLLIN; /* treat all IN events as POLLIN */
+         /*
+          * Treat all the IN events as POLLIN, except POLLPRI: that's reported
+          * through the exception condition, which poll() always waits for.
+          */
+         fds[i].events |= POLLIN;
 
          if (vfs_get_rready_cond(h))
             cnt++;
@@ -126,30 +130,24 @@ poll_count_ready_fds(struct pollfd *fds, nfds_t nfds)
       }
 
       if (fds[i].events & POLLIN) {
-         if (vfs_read_ready(h)) {
-
+         if (vfs_read_ready(h))
             fds[i].revents |= POLLIN;
-            cnt++;
-            continue;
-         }
       }
 
       if (fds[i].events & POLLOUT) {
-         if (vfs_write_ready(h)) {
-
+         if (vfs_write_ready(h))
             fds[i].revents |= POLLOUT;
-            cnt++;
-            continue;
-         }
       }
 
-      if (true) { /* just for symmetry */
-         if ((rc = vfs_except_ready(h))) {
-            fds[i].revents |= rc > 0 ? rc : POLLERR;
-            cnt++;
-            continue;
-         }
-      }
+      /*
+       * Report the exceptions even along with the other events: files always
+       * readable (e.g. the sysfs ones) signal their changes with POLLPRI.
+       */
+      if ((rc = vfs_except_ready(h)))
+         fds[i].revents |= rc > 0 ? rc : POLLERR;
+
+      if (fds[i].revents)
+         cnt++;
    }
 
    return cnt;
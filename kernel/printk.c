@@ -13,11 +13,15 @@
 #include <tilck/kernel/term.h>
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/worker_thread.h>
 
 #include <tilck/mods/tracing.h>
 
 #define PRINTK_BUF_SZ                         224
 #define PRINTK_PREFIXBUF_SZ                   32
+#define PRINTK_WTH_QUEUE_SIZE                  4
 
 #ifdef BITS32
    #define PRINTK_SAFE_STACK_SPACE         1536
@@ -63,6 +67,18 @@ static volatile struct ringbuf_stat printk_rbuf_stat =
 
 bool __in_printk;
 
+/*
+ * Once the console is up, printk() just appends to the ring buffer and the
+ * text is written to the ttys by a low priority worker thread, because on the
+ * framebuffer console that might take milliseconds. Appending is lock-free:
+ * each writer reserves its space with a CAS and then copies the text there,
+ * with preemption disabled. Because there's a single CPU, an IRQ's printk()
+ * always completes before the interrupted one resumes and the flush thread
+ * cannot run while any copy is in progress, so it never sees partial text.
+ */
+static struct worker_thread *printk_wth;
+static ATOMIC(bool) printk_flush_pending;
+
 /*
  * NOTE: the ring buf cannot be larger than 16K elems because of the size of the
  * read_pos and write_pos bit-fields.
@@ -192,11 +208,49 @@ printk_direct_flush(const char *buf, size_t size, u8 color)
    return;
 }
 
+/*
+ * Moves up to `buf_size` bytes from the ring buffer to `tmpbuf`. Returns the
+ * number of bytes read: when that's 0, it clears also `first_printk`.
+ */
+static u32
+printk_read_ringbuf(char *tmpbuf, u32 buf_size)
+{
+   struct ringbuf_stat cs, ns;
+   u32 used, to_read;
+
+   do {
+      cs = printk_rbuf_stat;
+      ns = printk_rbuf_stat;
+      used = printk_calc_used(&cs);
+
+      /* We can read at most 'buf_size' bytes at a time */
+      to_read = UNSAFE_MIN(buf_size, used);
+
+      /* And copy them to our minibuf */
+      for (u32 i = 0; i < to_read; i++)
+         tmpbuf[i] = printk_rbuf[(cs.read_pos + i) % sizeof(printk_rbuf)];
+
+      /* Increase read_pos and decrease used */
+      ns.read_pos = (ns.read_pos + to_read) % sizeof(printk_rbuf);
+
+      if (!to_read)
+         ns.first_printk = 0;
+
+      /* Repeat that until we were able to do that atomically */
+
+   } while (!atomic_cas_weak(&printk_rbuf_stat.raw,
+                             &cs.__raw,
+                             ns.__raw,
+                             mo_relaxed,
+                             mo_relaxed));
+
+   return to_read;
+}
+
 static void
 __printk_flush_ringbuf(char *tmpbuf, u32 buf_size)
 {
-   struct ringbuf_stat cs, ns;
-   u32 used, to_read = 0;
+   u32 to_read;
 
    if (MOD_tracing_actual) {
       static bool printk_flush_ringbuf_done_once;
@@ -209,47 +263,84 @@ __printk_flush_ringbuf(char *tmpbuf, u32 buf_size)
       }
    }
 
-   while (true) {
+   while ((to_read = printk_read_ringbuf(tmpbuf, buf_size)))
+      printk_direct_flush(tmpbuf, to_read, PRINTK_RINGBUF_FLUSH_COLOR);
+}
+
+void
+printk_flush_ringbuf(void)
+{
+   char minibuf[80];
+   __printk_flush_ringbuf(minibuf, sizeof(minibuf));
+}
+
+static void
+printk_flush_job(void *unused)
+{
+   char minibuf[80];
+   u32 to_read;
 
-      do {
-         cs = printk_rbuf_stat;
-         ns = printk_rbuf_stat;
-         used = printk_calc_used(&cs);
+   /* Clear the flag first: any later append will enqueue another job */
+   atomic_store_explicit(&printk_flush_pending, false, mo_relaxed);
 
-         /* We can read at most 'buf_size' bytes at a time */
-         to_read = UNSAFE_MIN(buf_size, used);
+   /*
+    * Flush one small chunk at a time, with preemption disabled only while
+    * writing it, so that the rest of the system keeps running meanwhile.
+    */
+   do {
 
-         /* And copy them to our minibuf */
-         for (u32 i = 0; i < to_read; i++)
-            tmpbuf[i] = printk_rbuf[(cs.read_pos + i) % sizeof(printk_rbuf)];
+      disable_preemption();
+      {
+         to_read = printk_read_ringbuf(minibuf, sizeof(minibuf));
+         printk_direct_flush(minibuf, to_read, PRINTK_COLOR);
+      }
+      enable_preemption();
 
-         /* Increase read_pos and decrease used */
-         ns.read_pos = (ns.read_pos + to_read) % sizeof(printk_rbuf);
+   } while (to_read);
+}
 
-         if (!to_read)
-            ns.first_printk = 0;
+/*
+ * Returns true if the flush thread will write the ring buffer's contents.
+ * Otherwise, the caller has to flush it synchronously.
+ */
+static bool
+printk_defer_flush(void)
+{
+   bool exp = false;
 
-         /* Repeat that until we were able to do that atomically */
+   if (!printk_wth || in_kernel_shutdown())
+      return false;
 
-      } while (!atomic_cas_weak(&printk_rbuf_stat.raw,
-                                &cs.__raw,
-                                ns.__raw,
-                                mo_relaxed,
-                                mo_relaxed));
+   if (get_curr_task() == wth_get_task(printk_wth))
+      return true;   /* printk_flush_job() loops until the buffer is empty */
 
-      /* Note: we checked that `first_printk` in `cs` was unset! */
-      if (!to_read)
-         break;
+   if (!atomic_cas_strong(&printk_flush_pending,
+                          &exp, true, mo_relaxed, mo_relaxed))
+   {
+      return true;   /* a flush job is already in the queue */
+   }
 
-      printk_direct_flush(tmpbuf, to_read, PRINTK_RINGBUF_FLUSH_COLOR);
+   if (!wth_enqueue_on(printk_wth, &printk_flush_job, NULL)) {
+      atomic_store_explicit(&printk_flush_pending, false, mo_relaxed);
+      return false;
    }
+
+   return true;
 }
 
 void
-printk_flush_ringbuf(void)
+init_printk_flush_thread(void)
 {
-   char minibuf[80];
-   __printk_flush_ringbuf(minibuf, sizeof(minibuf));
+   disable_preemption();
+   {
+      printk_wth = wth_create_thread("printk",
+                                     WTH_PRIO_LOWEST,
+                                     PRINTK_WTH_QUEUE_SIZE);
+   }
+   enable_preemption();
+
+   if (!printk_wth)
+      printk("WARNING: printk: unable to create the flush thread\n");
 }
 
 static void printk_append_to_ringbuf(const char *buf, size_t size)
@@ -362,6 +453,27 @@ vsnprintk_with_truc_suffix(char *buf, u32 bufsz, const char *fmt, va_list args)
    return written;
 }
 
+/*
+ * The timestamp of a message, in microseconds since kmain(). It comes from
+ * the TSC, read when printk() is called: the time the message spent in the
+ * ring buffer doesn't matter. Before the TSC has been calibrated against the
+ * system time, fall back to the latter.
+ */
+static u64
+printk_get_timestamp_us(void)
+{
+   const struct boot_trace_event *first = boot_trace_get_event(0);
+   u64 us = 0;
+
+   if (first)
+      us = boot_trace_tsc_to_us(RDTSC() - first->start);
+
+   if (!us)
+      us = get_sys_time() / (TS_SCALE / MILLION);
+
+   return us;
+}
+
 static void
 __tilck_vprintk(char *prefixbuf,
                 char *buf,
@@ -406,12 +518,12 @@ __tilck_vprintk(char *prefixbuf,
 
    if (prefix && old.newline) {
 
-      const u64 systime = get_sys_time();
+      const u64 ts = printk_get_timestamp_us();
 
       prefix_sz = snprintk(
          prefixbuf, PRINTK_PREFIXBUF_SZ, "[%5u.%03u] %s",
-         (u32)(systime / TS_SCALE),
-         (u32)((systime % TS_SCALE) / (TS_SCALE / 1000)),
+         (u32)(ts / MILLION),
+         (u32)((ts % MILLION) / 1000),
          bufsz < PRINTK_BUF_SZ ? "[LOWSS] " : ""
       );
 
@@ -430,6 +542,9 @@ __tilck_vprintk(char *prefixbuf,
 
    if (panic) {
       u8 color = in_panic_debugger() ? DEFAULT_FG_COLOR : PRINTK_PANIC_COLOR;
+
+      /* The messages still waiting for the flush thread come first */
+      printk_flush_ringbuf();
       printk_direct_flush(buf, (size_t) written, color);
       restore_first_printk_value();
       return;
@@ -438,7 +553,22 @@ __tilck_vprintk(char *prefixbuf,
    trace_printk_raw(1, buf, (size_t) written);
    disable_preemption();
    {
-      if (!old.first_printk) {
+      if (!old.first_printk && printk_wth && !in_kernel_shutdown()) {
+
+         /*
+          * Common case: just append our text and let the flush thread write
+          * it to the ttys. We were the first printk on the stack, so we have
+          * to clear the `first_printk` bit.
+          */
+
+         printk_append_to_ringbuf(prefixbuf, (size_t) prefix_sz);
+         printk_append_to_ringbuf(buf, (size_t) written);
+         restore_first_printk_value();
+
+         if (!printk_defer_flush())
+            __printk_flush_ringbuf(buf, bufsz);
+
+      } else if (!old.first_printk) {
 
          /*
           * OK, we were the first. Now, flush our buffer directly and loop
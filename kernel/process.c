@@ -6,7 +6,6 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/string_util.h>
-#include <tilck/common/unaligned.h>
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
@@ -19,6 +18,7 @@
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_int.h>
+#include <tilck/kernel/pgroup.h>
 
 #include <sys/prctl.h>        // system header
 
@@ -28,6 +28,8 @@ STATIC_ASSERT(IS_PAGE_ALIGNED(ARGS_COPYBUF_SIZE));
 
 #define ISOLATED_STACK_HI_VMEM_SPACE   (KERNEL_STACK_SIZE + (2 * PAGE_SIZE))
 
+static DEFINE_LOCK_CLASS(fslock_lock_class, "proc_fslock");
+
 static void *alloc_kernel_isolated_stack(struct process *pi)
 {
    void *vaddr_in_block;
@@ -38,7 +40,7 @@ static void *alloc_kernel_isolated_stack(struct process *pi)
 
    ASSERT(pi->pdir != NULL);
 
-   direct_va = kzmalloc(KERNEL_STACK_SIZE);
+   direct_va = kzmalloc_long_lived(KERNEL_STACK_SIZE);
 
    if (!direct_va)
       return NULL;
@@ -95,42 +97,150 @@ STATIC_ASSERT(
 
 #undef TOT_IOBUF_AND_ARGS_BUF_PG
 
+/*
+ * The kernel stacks of the dead tasks are kept in a small pool, instead of
+ * being freed: that way, creating a thread just pops a ready-to-use stack,
+ * with no kmalloc() and, with KERNEL_STACK_ISOLATION, no hi_vmem reservation
+ * and no page mapping either. The isolated stacks keep their unmapped guard
+ * pages while in the pool, so an overflow still causes a page fault.
+ *
+ * NOTE: the recycled stacks are NOT zeroed: the code setting up a new task
+ * never relies on that, as it explicitly writes its initial state regs.
+ */
+bool is_kernel_stack_guard_page(ulong vaddr)
+{
+   struct task *curr = get_curr_task();
+   ulong stack;
+
+   if (!KERNEL_STACK_ISOLATION || !curr || !curr->kernel_stack)
+      return false;
+
+   stack = (ulong)curr->kernel_stack;
+   return IN_RANGE(vaddr, stack - PAGE_SIZE, stack);
+}
+
+#define KERNEL_STACK_POOL_MAX          8
+
+static void *kernel_stack_pool[KERNEL_STACK_POOL_MAX];
+static int kernel_stack_pool_cnt;
+
 static void alloc_kernel_stack(struct task *ti)
 {
-   if (KERNEL_STACK_ISOLATION) {
-      ti->kernel_stack = alloc_kernel_isolated_stack(ti->pi);
-   } else {
-      ti->kernel_stack = kzmalloc(KERNEL_STACK_SIZE);
+   void *stack = NULL;
+
+   disable_preemption();
+   {
+      if (kernel_stack_pool_cnt > 0)
+         stack = kernel_stack_pool[--kernel_stack_pool_cnt];
    }
+   enable_preemption_nosched();
+
+   if (!stack) {
+      if (KERNEL_STACK_ISOLATION) {
+         stack = alloc_kernel_isolated_stack(ti->pi);
+      } else {
+         stack = kzmalloc_long_lived(KERNEL_STACK_SIZE);
+      }
+   }
+
+   ti->kernel_stack = stack;
 }
 
 static void free_kernel_stack(struct task *ti)
 {
+   void *stack = ti->kernel_stack;
+
+   disable_preemption();
+   {
+      if (kernel_stack_pool_cnt < KERNEL_STACK_POOL_MAX) {
+         kernel_stack_pool[kernel_stack_pool_cnt++] = stack;
+         stack = NULL;
+      }
+   }
+   enable_preemption_nosched();
+
+   if (!stack)
+      return;
+
    if (KERNEL_STACK_ISOLATION) {
-      free_kernel_isolated_stack(ti->pi, ti->kernel_stack);
+      free_kernel_isolated_stack(ti->pi, stack);
    } else {
-      kfree2(ti->kernel_stack, KERNEL_STACK_SIZE);
+      kfree2(stack, KERNEL_STACK_SIZE);
    }
 }
 
-static bool do_common_task_allocs(struct task *ti, bool alloc_bufs)
+/*
+ * The I/O and args copy buffers of the user tasks are needed only while they
+ * run a syscall: instead of keeping a pair of them per task, syscall_entry()
+ * leases one from a small pool of free buffers and gives it back on exit.
+ * That way, the memory used is proportional to the number of tasks inside a
+ * syscall (typically, sleeping in it) instead of the number of tasks. The
+ * kernel threads created with KTH_ALLOC_BUFS, instead, keep theirs for their
+ * whole life.
+ */
+#define TASK_BUFS_SIZE                 (IO_COPYBUF_SIZE + ARGS_COPYBUF_SIZE)
+#define TASK_BUFS_POOL_MAX             4
+
+static void *task_bufs_pool[TASK_BUFS_POOL_MAX];
+static int task_bufs_pool_cnt;
+
+bool task_lease_bufs(struct task *ti)
 {
-   alloc_kernel_stack(ti);
+   void *buf = NULL;
 
-   if (!ti->kernel_stack)
+   if (ti->io_copybuf)
+      return true;
+
+   disable_preemption();
+   {
+      if (task_bufs_pool_cnt > 0)
+         buf = task_bufs_pool[--task_bufs_pool_cnt];
+   }
+   enable_preemption_nosched();
+
+   if (!buf && !(buf = kmalloc(TASK_BUFS_SIZE)))
       return false;
 
-   if (alloc_bufs) {
+   ti->io_copybuf = buf;
+   ti->args_copybuf = (void *)((ulong)buf + IO_COPYBUF_SIZE);
+   return true;
+}
+
+void task_release_bufs(struct task *ti)
+{
+   void *buf = ti->io_copybuf;
+
+   if (!buf)
+      return;
 
-      ti->io_copybuf = kmalloc(IO_COPYBUF_SIZE + ARGS_COPYBUF_SIZE);
+   ti->io_copybuf = NULL;
+   ti->args_copybuf = NULL;
 
-      if (!ti->io_copybuf) {
-         free_kernel_stack(ti);
-         return false;
+   disable_preemption();
+   {
+      if (task_bufs_pool_cnt < TASK_BUFS_POOL_MAX) {
+         task_bufs_pool[task_bufs_pool_cnt++] = buf;
+         buf = NULL;
       }
+   }
+   enable_preemption_nosched();
 
-      ti->args_copybuf = (void *)((ulong)ti->io_copybuf + IO_COPYBUF_SIZE);
+   if (buf)
+      kfree2(buf, TASK_BUFS_SIZE);
+}
+
+static bool do_common_task_allocs(struct task *ti, bool alloc_bufs)
+{
+   alloc_kernel_stack(ti);
+
+   if (!ti->kernel_stack)
+      return false;
+
+   if (alloc_bufs && !task_lease_bufs(ti)) {
+      free_kernel_stack(ti);
+      return false;
    }
+
    return true;
 }
 
@@ -153,10 +263,8 @@ void free_common_task_allocs(struct task *ti)
    process_free_mappings_info(pi);
 
    free_kernel_stack(ti);
-   kfree2(ti->io_copybuf, IO_COPYBUF_SIZE + ARGS_COPYBUF_SIZE);
-
-   ti->io_copybuf = NULL;
-   ti->args_copybuf = NULL;
+   task_release_bufs(ti);
+   free_task_mobj_waiter(ti);
    ti->kernel_stack = NULL;
 }
 
@@ -183,11 +291,16 @@ void free_mem_for_zombie_task(struct task *ti)
 void init_task_lists(struct task *ti)
 {
    bintree_node_init(&ti->tree_by_tid_node);
-   list_node_init(&ti->runnable_node);
+   htable_node_init(&ti->tid_hnode);
+   bintree_node_init(&ti->runnable_node);
+   list_node_init(&ti->timer_ready_node);
    list_node_init(&ti->wakeup_timer_node);
    list_node_init(&ti->siblings_node);
+   list_node_init(&ti->wstatus_node);
+   list_node_init(&ti->rt_node);
 
    list_init(&ti->tasks_waiting_list);
+   list_init(&ti->sigqueue);
    list_init(&ti->on_exit);
    bzero(&ti->wobj, sizeof(struct wait_obj));
 }
@@ -195,17 +308,24 @@ void init_task_lists(struct task *ti)
 void init_process_lists(struct process *pi)
 {
    list_init(&pi->children);
+   list_init(&pi->wstatus_queue);
+   list_node_init(&pi->pgrp_node);
    kmutex_init(&pi->fslock, KMUTEX_FL_RECURSIVE);
+   kmutex_set_lock_class(&pi->fslock, &fslock_lock_class);
 }
 
-struct task *
-allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
+static struct task *
+allocate_new_process_int(struct task *parent,
+                         int pid,
+                         pdir_t *new_pdir,
+                         bool new_image)
 {
    struct process *pi, *parent_pi = parent->pi;
    struct task_and_process *tp;
    struct task *ti = NULL;
    bool common_allocs = false;
    bool arch_fields = false;
+   bool fd_table = false;
 
    if (UNLIKELY(!(tp = kalloc_obj(struct task_and_process))))
       goto oom_case;
@@ -241,7 +361,20 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    pi->vforked = false;
    pi->inherited_mmap_heap = false;
 
-   if (new_pdir != parent_pi->pdir) {
+   /* The handles will be duplicated by the caller (see fork.c) */
+   if (UNLIKELY(!(pi->fds = fd_table_clone(parent_pi->fds))))
+      goto oom_case;
+
+   fd_table = true;
+
+   if (new_image) {
+
+      /* The mappings and the ELF file will be the ones of the new image */
+      pi->mi = NULL;
+      pi->elf = NULL;
+      pi->elf_interp = NULL;
+
+   } else if (new_pdir != parent_pi->pdir) {
 
       if (parent_pi->mi) {
          if (UNLIKELY(!(pi->mi = duplicate_mappings_info(pi, parent_pi->mi))))
@@ -251,6 +384,9 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
       if (pi->elf)
          retain_subsys_flock(pi->elf);
 
+      if (pi->elf_interp)
+         retain_subsys_flock(pi->elf_interp);
+
    } else {
       pi->vforked = true;
       pi->inherited_mmap_heap = !!pi->mi;
@@ -260,6 +396,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    ti->tid = pid;
    ti->is_main_thread = true;
    ti->timer_ready = false;
+   ti->wakeup_deadline = 0;
 
    /*
     * From fork(2):
@@ -268,16 +405,34 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
     * From sigpending(2):
     *    A child created via fork(2) initially has an empty pending signal
     *    set; the pending signal set is preserved across an execve(2).
+    *
+    * NOTE: the `sigqueue` list copied from the parent is not ours.
     */
+   list_init(&ti->sigqueue);
+   ti->sigqueue_len = 0;
    drop_all_pending_signals(ti);
 
-   /* Reset sched ticks in the new process */
+   /*
+    * Reset sched ticks and stats in the new process. The nice value and the
+    * scheduling policy are inherited, but not the priority inheritance boost.
+    */
    bzero(&ti->ticks, sizeof(ti->ticks));
+   bzero(&ti->sched_stats, sizeof(ti->sched_stats));
+   bzero(&ti->cputime, sizeof(ti->cputime));
+   ti->eff_rt_prio = ti->rt_prio;
+   ti->rt_yield = false;
+   ti->wake_boost = false;
+   ti->held_kmutexes = 0;
 
    /* Copy parent's `cwd` while retaining the `fs` and the inode obj */
    process_set_cwd2_nolock_raw(pi, &parent_pi->cwd);
 
-   if (UNLIKELY(!(common_allocs = do_common_task_allocs(ti, true))))
+   /* The parent's copy buffers are leased by its syscall, not ours */
+   ti->io_copybuf = NULL;
+   ti->args_copybuf = NULL;
+   ti->mobj_waiter = NULL;
+
+   if (UNLIKELY(!(common_allocs = do_common_task_allocs(ti, false))))
       goto oom_case;
 
    if (UNLIKELY(!(arch_fields = arch_specific_new_task_setup(ti, parent))))
@@ -288,6 +443,11 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    init_process_lists(pi);
    list_add_tail(&parent_pi->children, &ti->siblings_node);
 
+   pi->pgrp = NULL;
+
+   if (parent_pi->pgrp)
+      pgroup_add_member(parent_pi->pgrp, pi);
+
    pi->proc_tty = parent_pi->proc_tty;
    return ti;
 
@@ -308,6 +468,9 @@ oom_case:
 
       process_free_mappings_info(ti->pi);
 
+      if (fd_table)
+         fd_table_free(pi->fds);
+
       if (MOD_debugpanel && pi->debug_cmdline)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
 
@@ -317,6 +480,22 @@ oom_case:
    return NULL;
 }
 
+struct task *
+allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
+{
+   return allocate_new_process_int(parent, pid, new_pdir, false);
+}
+
+/*
+ * Allocates a child of `parent` which will directly run a new image, whose
+ * pdir is `new_pdir`. Compared to a fork, parent's mappings are not copied.
+ */
+struct task *
+allocate_new_spawned_process(struct task *parent, int pid, pdir_t *new_pdir)
+{
+   return allocate_new_process_int(parent, pid, new_pdir, true);
+}
+
 struct task *allocate_new_thread(struct process *pi, int tid, bool alloc_bufs)
 {
    ASSERT(pi != NULL);
@@ -359,6 +538,7 @@ static void free_process_int(struct process *pi)
 
    if (release_obj(pi) == 0) {
 
+      fd_table_free(pi->fds);
       arch_specific_free_proc(pi);
       kfree_obj((void *)get_process_task(pi), struct task_and_process);
 
@@ -377,10 +557,12 @@ void free_task(struct task *ti)
    ASSERT(!ti->args_copybuf);
 
    list_remove(&ti->siblings_node);
+   list_remove(&ti->wstatus_node);
 
-   if (is_main_thread(ti))
+   if (is_main_thread(ti)) {
+      pgroup_remove_member(ti->pi);
       free_process_int(ti->pi);
-   else
+   } else
       kfree_obj(ti, struct task);
 }
 
@@ -468,7 +650,7 @@ mode_t sys_umask(mode_t mask)
 {
    struct process *pi = get_curr_proc();
    mode_t old = pi->umask;
-   pi->umask = mask & 0777;
+   pi->umask = (u16)(mask & 0777);
    return old;
 }
 
@@ -613,11 +795,14 @@ int sys_setsid(void)
 
    disable_preemption();
 
-   if (!sched_count_proc_in_group(pi->pid)) {
-      pi->pgid = pi->pid;
-      pi->sid = pi->pid;
-      pi->proc_tty = NULL;
-      rc = pi->sid;
+   if (!pgroup_get(pi->pid)) {
+
+      rc = pgroup_join(pi, pi->pid, pi->pid);
+
+      if (!rc) {
+         pi->proc_tty = NULL;
+         rc = pi->sid;
+      }
    }
 
    enable_preemption();
@@ -680,13 +865,13 @@ int sys_setpgid(int pid, int pgid)
          goto out;
       }
 
-      /* Set process' pgid to `pgid` */
-      pi->pgid = pgid;
+      /* Move the process to the group `pgid` */
+      rc = pgroup_join(pi, pgid, pi->sid);
 
    } else {
 
       /* pgid is 0: make the process a group leader */
-      pi->pgid = pi->pid;
+      rc = pgroup_join(pi, pi->pid, pi->sid);
    }
 
 out:
@@ -730,6 +915,162 @@ int sys_prctl(int option, ulong a2, ulong a3, ulong a4, ulong a5)
    return -EINVAL;
 }
 
+static ALWAYS_INLINE u64 rlim_to_rlim64(ulong val)
+{
+   return val == K_RLIM_INFINITY ? K_RLIM64_INFINITY : val;
+}
+
+static ALWAYS_INLINE ulong rlim64_to_rlim(u64 val)
+{
+   return val >= K_RLIM_INFINITY ? K_RLIM_INFINITY : (ulong)val;
+}
+
+/*
+ * Like on Linux, the RLIMIT_AS limits are stored in a ulong: on 32-bit systems,
+ * the ones that don't fit are treated as infinity, since the address space
+ * could never reach them anyway.
+ */
+static void
+do_prlimit_as(struct process *pi,
+              const struct k_rlimit64 *new_rl,
+              struct k_rlimit64 *old_rl)
+{
+   /* The address space changes with preemption disabled: see sys_brk() */
+   disable_preemption();
+   {
+      if (old_rl) {
+         old_rl->rlim_cur = rlim_to_rlim64(pi->as_limit_cur);
+         old_rl->rlim_max = rlim_to_rlim64(pi->as_limit_max);
+      }
+
+      if (new_rl) {
+         pi->as_limit_cur = rlim64_to_rlim(new_rl->rlim_cur);
+         pi->as_limit_max = rlim64_to_rlim(new_rl->rlim_max);
+      }
+   }
+   enable_preemption();
+}
+
+/*
+ * Only RLIMIT_NOFILE and RLIMIT_AS are actually supported: the other resources
+ * have no limits and trying to set one of them fails, unless the new hard
+ * limit is infinity.
+ */
+static int
+do_prlimit(struct process *pi,
+           int resource,
+           const struct k_rlimit64 *new_rl,
+           struct k_rlimit64 *old_rl)
+{
+   struct fd_table *fds = pi->fds;
+
+   if (!IN_RANGE(resource, 0, RLIM_NLIMITS))
+      return -EINVAL;
+
+   if (new_rl && new_rl->rlim_cur > new_rl->rlim_max)
+      return -EINVAL;
+
+   if (resource == RLIMIT_AS) {
+      do_prlimit_as(pi, new_rl, old_rl);
+      return 0;
+   }
+
+   if (resource != RLIMIT_NOFILE) {
+
+      if (new_rl && new_rl->rlim_max != K_RLIM64_INFINITY)
+         return -EINVAL;
+
+      if (old_rl) {
+         old_rl->rlim_cur = K_RLIM64_INFINITY;
+         old_rl->rlim_max = K_RLIM64_INFINITY;
+      }
+
+      return 0;
+   }
+
+   if (new_rl && new_rl->rlim_max > NOFILE_MAX_LIMIT)
+      return -EPERM;
+
+   kmutex_lock(&pi->fslock);
+   {
+      if (old_rl) {
+         old_rl->rlim_cur = fds->nofile_cur;
+         old_rl->rlim_max = fds->nofile_max;
+      }
+
+      if (new_rl) {
+         fds->nofile_cur = (u32)new_rl->rlim_cur;
+         fds->nofile_max = (u32)new_rl->rlim_max;
+      }
+   }
+   kmutex_unlock(&pi->fslock);
+   return 0;
+}
+
+int sys_getrlimit(int resource, struct k_rlimit *user_rlim)
+{
+   struct k_rlimit64 rl64;
+   struct k_rlimit rl;
+   int rc;
+
+   if ((rc = do_prlimit(get_curr_proc(), resource, NULL, &rl64)))
+      return rc;
+
+   rl.rlim_cur = rlim64_to_rlim(rl64.rlim_cur);
+   rl.rlim_max = rlim64_to_rlim(rl64.rlim_max);
+
+   if (copy_to_user(user_rlim, &rl, sizeof(rl)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_setrlimit(int resource, const struct k_rlimit *user_rlim)
+{
+   struct k_rlimit64 rl64;
+   struct k_rlimit rl;
+
+   if (copy_from_user(&rl, user_rlim, sizeof(rl)))
+      return -EFAULT;
+
+   rl64.rlim_cur = rlim_to_rlim64(rl.rlim_cur);
+   rl64.rlim_max = rlim_to_rlim64(rl.rlim_max);
+   return do_prlimit(get_curr_proc(), resource, &rl64, NULL);
+}
+
+int sys_prlimit64(int pid,
+                  int resource,
+                  const struct k_rlimit64 *user_new_rlim,
+                  struct k_rlimit64 *user_old_rlim)
+{
+   struct k_rlimit64 new_rl, old_rl;
+   int rc;
+
+   /* Changing the limits of other processes is not supported */
+   if (pid && pid != get_curr_pid())
+      return -EPERM;
+
+   if (user_new_rlim) {
+      if (copy_from_user(&new_rl, user_new_rlim, sizeof(new_rl)))
+         return -EFAULT;
+   }
+
+   rc = do_prlimit(get_curr_proc(),
+                   resource,
+                   user_new_rlim ? &new_rl : NULL,
+                   user_old_rlim ? &old_rl : NULL);
+
+   if (rc)
+      return rc;
+
+   if (user_old_rlim) {
+      if (copy_to_user(user_old_rlim, &old_rl, sizeof(old_rl)))
+         return -EFAULT;
+   }
+
+   return 0;
+}
+
 
 int
 setup_first_process(pdir_t *pdir, struct task **ti_ref)
@@ -743,8 +1084,14 @@ setup_first_process(pdir_t *pdir, struct task **ti_ref)
       return -ENOMEM;
 
    pi = ti->pi;
-   pi->pgid = 1;
-   pi->sid = 1;
+
+   if (pgroup_join(pi, 1, 1)) {
+      ti->state = TASK_STATE_ZOMBIE;
+      free_common_task_allocs(ti);
+      free_task(ti);
+      return -ENOMEM;
+   }
+
    pi->umask = 0022;
    ti->state = TASK_STATE_RUNNING;
    add_task(ti);
@@ -771,14 +1118,10 @@ finalize_usermode_task_setup(struct task *ti, regs_t *user_regs)
 
 int setup_process(struct elf_program_info *pinfo,
                   struct task *ti,
-                  const char *const *argv,
-                  const char *const *env,
                   struct task **ti_ref,
                   regs_t *r)
 {
    int rc = 0;
-   u32 argv_elems = 0;
-   u32 env_elems = 0;
    pdir_t *old_pdir;
    struct process *pi = NULL;
 
@@ -791,11 +1134,7 @@ int setup_process(struct elf_program_info *pinfo,
    old_pdir = get_curr_pdir();
    set_curr_pdir(pinfo->pdir);
 
-   while (READ_PTR(&argv[argv_elems])) argv_elems++;
-   while (READ_PTR(&env[env_elems])) env_elems++;
-
-   if ((rc = push_args_on_user_stack(r, argv, argv_elems, env, env_elems)))
-      goto err;
+   push_args_on_user_stack(r, pinfo, pinfo->args);
 
    if (UNLIKELY(!ti)) {
 
@@ -824,6 +1163,14 @@ int setup_process(struct elf_program_info *pinfo,
          */
          vforked_child_transfer_dispose_mi(pi);
 
+      } else if (pi->pdir == pinfo->pdir) {
+
+         /*
+          * A spawned process (see allocate_new_spawned_process()): it was
+          * created directly with the new pdir, there's no old image.
+          */
+         ASSERT(!pi->mi && !pi->elf);
+
       } else {
 
          remove_all_user_zero_mem_mappings(pi);
@@ -835,6 +1182,9 @@ int setup_process(struct elf_program_info *pinfo,
 
          if (pi->elf)
             release_subsys_flock(pi->elf);
+
+         if (pi->elf_interp)
+            release_subsys_flock(pi->elf_interp);
       }
 
       pi->pdir = pinfo->pdir;
@@ -848,6 +1198,7 @@ int setup_process(struct elf_program_info *pinfo,
    }
 
    pi->elf = pinfo->lf;
+   pi->elf_interp = pinfo->interp_lf;
    *ti_ref = ti;
    return 0;
 
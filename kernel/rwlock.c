@@ -9,6 +9,10 @@ void rwlock_rp_init(struct rwlock_rp *r)
    ksem_init(&r->writers_sem, 1, 1);
    r->readers_count = 0;
    DEBUG_ONLY(r->ex_owner = NULL);
+
+#if LOCK_STATS
+   r->lc = NULL;
+#endif
 }
 
 void rwlock_rp_destroy(struct rwlock_rp *r)
@@ -19,12 +23,39 @@ void rwlock_rp_destroy(struct rwlock_rp *r)
    kmutex_destroy(&r->readers_lock);
 }
 
+/*
+ * For the stats, a lock operation on a rwlock_rp is contended when the
+ * writers semaphore is already taken. The holder is not known here.
+ */
+static ALWAYS_INLINE u64 rwlock_rp_contended(struct rwlock_rp *r)
+{
+#if LOCK_STATS
+   if (r->writers_sem.counter <= 0)
+      return lock_stats_contended(r->lc, NULL);
+#endif
+
+   return 0;
+}
+
+static ALWAYS_INLINE void rwlock_rp_acquired(struct rwlock_rp *r, u64 start)
+{
+#if LOCK_STATS
+   lock_stats_acquired(r->lc, start);
+#endif
+}
+
 void rwlock_rp_shlock(struct rwlock_rp *r)
 {
    kmutex_lock(&r->readers_lock);
    {
-      if (++r->readers_count == 1)
+      u64 wait_start = 0;
+
+      if (++r->readers_count == 1) {
+         wait_start = rwlock_rp_contended(r);
          ksem_wait(&r->writers_sem, 1, KSEM_WAIT_FOREVER);
+      }
+
+      rwlock_rp_acquired(r, wait_start);
    }
    kmutex_unlock(&r->readers_lock);
 }
@@ -41,10 +72,13 @@ void rwlock_rp_shunlock(struct rwlock_rp *r)
 
 void rwlock_rp_exlock(struct rwlock_rp *r)
 {
+   const u64 wait_start = rwlock_rp_contended(r);
    ksem_wait(&r->writers_sem, 1, KSEM_WAIT_FOREVER);
 
    ASSERT(r->ex_owner == NULL);
    DEBUG_ONLY(r->ex_owner = get_curr_task());
+
+   rwlock_rp_acquired(r, wait_start);
 }
 
 void rwlock_rp_exunlock(struct rwlock_rp *r)
@@ -62,85 +96,148 @@ void rwlock_wp_init(struct rwlock_wp *rw, bool recursive)
    kmutex_init(&rw->m, 0);
    kcond_init(&rw->c);
    rw->ex_owner = NULL;
-   rw->r = 0;
-   rw->w = false;
+   atomic_store_explicit(&rw->state, 0, mo_relaxed);
    rw->rec = recursive;
+
+#if LOCK_STATS
+   rw->lc = NULL;
+#endif
 }
 
 void rwlock_wp_destroy(struct rwlock_wp *rw)
 {
    rw->ex_owner = NULL;
-   rw->w = false;
-   rw->r = 0;
+   atomic_store_explicit(&rw->state, 0, mo_relaxed);
    kcond_destory(&rw->c);
    kmutex_destroy(&rw->m);
 }
 
+static ALWAYS_INLINE u32 rwlock_wp_state(struct rwlock_wp *rw)
+{
+   return atomic_load_explicit(&rw->state, mo_acquire);
+}
+
+/*
+ * For the stats, a lock operation on a rwlock_wp is contended when it has to
+ * wait on the condition variable. The time spent on the inner mutex is not
+ * counted, as that mutex is held only for short critical sections.
+ */
+static ALWAYS_INLINE u64 rwlock_wp_contended(struct rwlock_wp *rw, bool ex)
+{
+#if LOCK_STATS
+   const u32 state = rwlock_wp_state(rw);
+
+   if ((state & RWLOCK_WP_WRITER) || (ex && (state & RWLOCK_WP_READERS)))
+      return lock_stats_contended(rw->lc, rw->ex_owner);
+#endif
+
+   return 0;
+}
+
+static ALWAYS_INLINE void rwlock_wp_acquired(struct rwlock_wp *rw, u64 start)
+{
+#if LOCK_STATS
+   lock_stats_acquired(rw->lc, start);
+#endif
+}
+
 void rwlock_wp_shlock(struct rwlock_wp *rw)
 {
+   u32 state = atomic_load_explicit(&rw->state, mo_relaxed);
+
+   /* Fast path: no writer holding the lock, nor waiting for it */
+   while (!(state & RWLOCK_WP_WRITER)) {
+
+      if (atomic_compare_exchange_weak_explicit(&rw->state,
+                                                &state,
+                                                state + 1,
+                                                mo_acquire,
+                                                mo_relaxed))
+      {
+         rwlock_wp_acquired(rw, 0);
+         return;
+      }
+   }
+
    kmutex_lock(&rw->m);
    {
+      const u64 wait_start = rwlock_wp_contended(rw, false);
+
       /* Wait until there's at least one writer waiting (they have priority) */
-      while (rw->w) {
+      while (rwlock_wp_state(rw) & RWLOCK_WP_WRITER) {
          kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
       }
 
       /*
-       * OK, no writer is waiting and we're holding the mutex: we can safely
-       * increment the readers count and claim that the acquired a shared
-       * lock.
+       * OK, no writer is waiting and we're holding the mutex: writers cannot
+       * set RWLOCK_WP_WRITER without it, so we can safely increment the
+       * readers count and claim that the acquired a shared lock.
        */
-      rw->r++;
+      atomic_fetch_add_explicit(&rw->state, 1, mo_acquire);
+
+      rwlock_wp_acquired(rw, wait_start);
    }
    kmutex_unlock(&rw->m);
 }
 
 void rwlock_wp_shunlock(struct rwlock_wp *rw)
 {
+   const u32 old = atomic_fetch_sub_explicit(&rw->state, 1, mo_release);
+   ASSERT(old & RWLOCK_WP_READERS);
+
+   /* Fast path: there are other readers, or no writer is waiting for us */
+   if (old != (RWLOCK_WP_WRITER | 1))
+      return;
+
+   /*
+    * We were the last reader and a writer is waiting for the readers count
+    * to drop to 0. Take the mutex, in order to not signal the condition
+    * between the writer's check and its kcond_wait(). Wake up everybody:
+    * readers and other writers are waiting on the same condition.
+    */
    kmutex_lock(&rw->m);
    {
-      /*
-       * Decrement the readers count and, in case there no more readers, signal
-       * the condition in order to wake-up the writers are waiting on it.
-       */
-      if (--rw->r == 0)
-         kcond_signal_one(&rw->c);
+      kcond_signal_all(&rw->c);
    }
    kmutex_unlock(&rw->m);
 }
 
 static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
 {
+   u64 wait_start;
+
    if (rw->rec) {
       if (rw->ex_owner == get_curr_task()) {
-         ASSERT(rw->w);
+         ASSERT(rwlock_wp_state(rw) & RWLOCK_WP_WRITER);
          ASSERT(rw->rc >= 1);
          rw->rc++;
          return;
       }
    }
 
+   wait_start = rwlock_wp_contended(rw, true);
 
    /* Wait our turn until other writers are waiting to write */
-   while (rw->w) {
+   while (rwlock_wp_state(rw) & RWLOCK_WP_WRITER) {
       kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
    }
 
    /*
     * OK, no writer is waiting to write and we're holding the mutex: now
-    * it's our turn to wait on the condition `readers > 0`.
+    * it's our turn to wait on the condition `readers > 0`. From now on,
+    * the readers' fast path fails.
     */
-   rw->w = true;
+   atomic_fetch_or_explicit(&rw->state, RWLOCK_WP_WRITER, mo_relaxed);
 
    /* Wait until there are any readers currently holding the rwlock */
-   while (rw->r > 0) {
+   while (rwlock_wp_state(rw) & RWLOCK_WP_READERS) {
       kcond_wait(&rw->c, &rw->m, KCOND_WAIT_FOREVER);
    }
 
    /*
     * No more readers: great. Now we're really holding an exclusive access to
-    * the rwlock. New readers cannot acquire a shared lock because `w` is set
-    * and other writes cannot acquire it, for the same reason.
+    * the rwlock. New readers cannot acquire a shared lock because the writer
+    * flag is set and other writes cannot acquire it, for the same reason.
     */
 
    ASSERT(rw->ex_owner == NULL);
@@ -151,6 +248,8 @@ static void rwlock_wp_exlock_int(struct rwlock_wp *rw)
       ASSERT(rw->rc == 0);
       rw->rc++;
    }
+
+   rwlock_wp_acquired(rw, wait_start);
 }
 
 void rwlock_wp_exlock(struct rwlock_wp *rw)
@@ -170,7 +269,7 @@ static void rwlock_wp_exunlock_int(struct rwlock_wp *rw)
 
       /* recursive locking count */
       ASSERT(rw->rec > 0);
-      ASSERT(rw->w);
+      ASSERT(rwlock_wp_state(rw) & RWLOCK_WP_WRITER);
       rw->rc--;
 
       if (rw->rc > 0)
@@ -179,11 +278,11 @@ static void rwlock_wp_exunlock_int(struct rwlock_wp *rw)
 
    rw->ex_owner = NULL;
 
-   /* The `w` flag must be set */
-   ASSERT(rw->w);
+   /* The writer flag must be set, with no readers */
+   ASSERT(rwlock_wp_state(rw) == RWLOCK_WP_WRITER);
 
-   /* Unset the `w` flag (no more writers) */
-   rw->w = false;
+   /* Unset the writer flag (no more writers) */
+   atomic_fetch_and_explicit(&rw->state, ~RWLOCK_WP_WRITER, mo_release);
 
    /* Signal all the readers potentially waiting on the condition */
    kcond_signal_all(&rw->c);
@@ -95,6 +95,40 @@ void safe_ringbuf_destory(struct safe_ringbuf *rb)
    bzero(rb, sizeof(struct safe_ringbuf));
 }
 
+u16 safe_ringbuf_get_elems(struct safe_ringbuf *rb)
+{
+   struct generic_safe_ringbuf_stat cs;
+   cs.__raw = atomic_load_explicit(&rb->s.raw, mo_relaxed);
+
+   if (cs.full)
+      return rb->max_elems;
+
+   return (u16)((cs.write_pos + rb->max_elems - cs.read_pos) % rb->max_elems);
+}
+
+void *
+safe_ringbuf_resize(struct safe_ringbuf *rb, u16 max_elems, void *buf)
+{
+   const u16 n = safe_ringbuf_get_elems(rb);
+   const u16 e_size = rb->elem_size;
+   const u16 first = rb->s.read_pos;
+   const u16 first_part = MIN(n, (u16)(rb->max_elems - first));
+   void *old_buf = rb->buf;
+
+   ASSERT(max_elems > n && max_elems <= 32768);
+   DEBUG_ONLY(ASSERT(rb->nested_writes == 0));
+
+   /* Copy the elements in order, starting from the oldest one */
+   memcpy(buf, rb->buf + first * e_size, first_part * e_size);
+   memcpy((u8 *)buf + first_part * e_size, rb->buf, (n - first_part) * e_size);
+
+   rb->max_elems = max_elems;
+   rb->buf = (u8 *)buf;
+   rb->s.raw = 0;
+   rb->s.write_pos = n;
+   return old_buf;
+}
+
 } // extern "C"
 
 template <int static_elem_size = 0>
@@ -2,6 +2,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_int.h>
@@ -11,6 +12,11 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/zero_pool.h>
+#include <tilck/kernel/pgroup.h>
 
 /* Shared global variables */
 struct task *__current;
@@ -20,17 +26,51 @@ ATOMIC(int) __need_resched;               /* see docs/atomics.md */
 struct task *kernel_process;
 struct process *kernel_process_pi;
 
-/* Task lists */
-struct list runnable_tasks_list;
-
 /* Static variables */
-static struct task *tree_by_tid_root;
+static struct task *tree_by_tid_root;        /* for the ordered visits */
+static struct htable tasks_by_tid;           /* for get_task() */
+static struct bintree_cached runnable_tree;  /* ordered by vruntime */
+static struct list timer_ready_tasks_list;
 static u64 idle_ticks;
 static volatile int runnable_tasks_count;
-static int current_max_pid = -1;
-static int current_max_kernel_tid = -1;
+static struct sched_global_stats gstats;
+static u64 min_vruntime;                     /* monotonic, see below */
+static u64 wakeup_gran;                      /* in vruntime units */
+static struct list rt_queues[MAX_RT_PRIO];   /* one FIFO list per priority */
+static u32 rt_bitmap[(MAX_RT_PRIO + 31) / 32];  /* non-empty rt_queues */
 struct task *idle_task;
 
+/*
+ * Same as Linux's sched_prio_to_weight[]: the weight of a nice-0 task is
+ * NICE_0_WEIGHT and each nice level is worth ~10% of CPU time, relative to
+ * the other runnable tasks.
+ */
+static const u32 nice_to_weight[MAX_NICE - MIN_NICE + 1] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+/*
+ * The runqueue walks touch just the first two cache lines of each task: its
+ * identity and state, the priorities, the ticks (vruntime) and the node in
+ * the runnable tree. See the comment above struct task.
+ */
+STATIC_ASSERT(
+   OFFSET_OF(struct task, runnable_node) + sizeof(struct bintree_node) <= 128
+);
+
+static void runnable_tree_insert(struct task *ti);
+static void runnable_tree_remove(struct task *ti);
+static void sched_stats_rq_change(int delta);
+static void task_add_to_state_list(struct task *ti);
+static void task_remove_from_state_list(struct task *ti);
+
 const char *const task_state_str[5] = {
    [TASK_STATE_INVALID]  = "invalid",
    [TASK_STATE_RUNNABLE] = "runnable",
@@ -46,12 +86,36 @@ void enable_preemption(void)
 
    ASSERT(oldval > 0);
 
+   if (LATENCY_TRACER && oldval == 1)
+      preempt_off_trace_end();
+
    if (KRN_RESCHED_ENABLE_PREEMPT) {
       if (oldval == 1 && need_reschedule() && are_interrupts_enabled())
          schedule();
    }
 }
 
+bool __cond_resched(bool preempt_disabled)
+{
+   bool context_switch;
+
+   if (preempt_disabled) {
+      ASSERT(get_preempt_disable_count() == 1);
+   } else if (!is_preemption_enabled()) {
+      return false;
+   }
+
+   if (!are_interrupts_enabled())
+      return false;
+
+   if (!preempt_disabled)
+      return schedule();
+
+   context_switch = schedule_preempt_disabled();
+   disable_preemption();
+   return context_switch;
+}
+
 bool save_regs_and_schedule(bool skip_disable_preempt)
 {
    /* Private declaraction of the low-level yield function */
@@ -102,23 +166,13 @@ get_traced_tasks_count(void)
 
 int sched_count_proc_in_group(int pgid)
 {
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
-   int count = 0;
+   struct pgroup *g;
+   int count;
 
    disable_preemption();
    {
-      bintree_in_order_visit_start(&ctx,
-                                   tree_by_tid_root,
-                                   struct task,
-                                   tree_by_tid_node,
-                                   false);
-
-      while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-         if (ti->pi->pgid == pgid)
-            count++;
-      }
+      g = pgroup_get(pgid);
+      count = g ? g->count : 0;
    }
    enable_preemption();
    return count;
@@ -126,25 +180,13 @@ int sched_count_proc_in_group(int pgid)
 
 int sched_get_session_of_group(int pgid)
 {
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
-   int sid = -ESRCH;
+   struct pgroup *g;
+   int sid;
 
    disable_preemption();
    {
-      bintree_in_order_visit_start(&ctx,
-                                   tree_by_tid_root,
-                                   struct task,
-                                   tree_by_tid_node,
-                                   false);
-
-      while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-         if (ti->pi->pgid == pgid) {
-            sid = ti->pi->sid;
-            break;
-         }
-      }
+      g = pgroup_get(pgid);
+      sid = g ? (int)g->session->sid : -ESRCH;
    }
    enable_preemption();
    return sid;
@@ -162,202 +204,149 @@ int get_curr_pid(void)
    return c ? c->pi->pid : 0;
 }
 
-struct create_pid_visit_ctx {
-
-   bool kernel_tid;
-   bool lowest_avail_invalid;
-   int id_off;
-   int lowest_available;
-   int lowest_after_current_max;
-};
-
-static inline int inc_candicate_if_matches(int *cand, int id, int val)
+/*
+ * PID and kernel TID allocation
+ * -----------------------------
+ *
+ * The IDs in use are tracked by bitmaps, updated by add_task() and
+ * remove_task(): `pid_bmp` for the user processes (no user threads in Tilck:
+ * tid == pid) and `ktid_bmp` for the kernel threads (tid - KERNEL_TID_START).
+ * A rolling cursor makes the IDs be allocated in increasing order, like on
+ * Linux, wrapping around when the max ID is reached.
+ *
+ * In addition, a PID cannot be reused while it's still the ID of a process
+ * group or of a session, even if the leader died: otherwise the new process
+ * would accidentally become the leader of that group/session. `pgsid_bmp`
+ * tracks those IDs: see pgroup.c.
+ */
+
+#define ID_BMP_WORDS(max_id)     (((max_id) + 1 + NBITS - 1) / NBITS)
+
+static ulong pid_bmp[ID_BMP_WORDS(MAX_PID)];
+static ulong pgsid_bmp[ID_BMP_WORDS(MAX_PID)];
+static ulong ktid_bmp[ID_BMP_WORDS(KERNEL_MAX_TID)];
+static int next_pid;
+static int next_kernel_tid;
+
+static ALWAYS_INLINE bool id_bmp_test(ulong *bmp, int id)
 {
-   if (*cand != val)
-      return 0; /* Everything is OK */
-
-   /* The lowest_<something> candicate cannot be > id */
-   ASSERT(*cand <= val);
-
-   /*
-    * We've found a case where the candicate is equal to current task's pgid/sid
-    * and that might be a problem.
-    *
-    * Two cases:
-    *
-    *    1) Candidate == id. This means: candidate == pgid/sid == id.
-    *       That's fine: we just hit a group/session leader. By default we'll
-    *       skip this candiate (see the impl. below).
-    *
-    *    2) Candidate < id. This means that the pgid/sid is < id and we didn't
-    *       hit it before (note: we're doing an in-order visit). For example:
-    *
-    *    pid | sid | what
-    *    ----+-----+-----------
-    *     1  |  1  | init
-    *     2  |  1  | ash
-    *     8  |  3  | prog1
-    *
-    *    lowest_available = 3   [our candidate]
-    *
-    *    We don't want this to happen because 3 is the ID of a session, with
-    *    a dead leader. In order to handle this case, we have to increment
-    *    lowest_available and restart the whole iteration. We must end up with
-    *    lowest_available = 4. Actually, if lowest_after_current_max is a good
-    *    value, we're going to use it without restarting the iteration.
-    */
-
-   if (*cand == id)
-      return 0; /* We just hit a group/session leader. That's fine */
-
-   (*cand)++;
-   return 1;
+   return !!(bmp[id / NBITS] & (1UL << (id % NBITS)));
 }
 
-static int create_new_pid_visit_cb(void *obj, void *arg)
+static ALWAYS_INLINE void id_bmp_set(ulong *bmp, int id)
 {
-   struct task *ti = obj;
-   struct create_pid_visit_ctx *ctx = arg;
-   const int tid = ti->tid - ctx->id_off;
-
-   if (ctx->kernel_tid) {
-
-      if (!is_kernel_thread(ti))
-         return 0; /* skip non-kernel tasks */
-
-      ASSERT(tid >= 0);
-
-
-   } else {
+   bmp[id / NBITS] |= 1UL << (id % NBITS);
+}
 
-      if (!is_main_thread(ti))
-         return 0; /* skip threads */
+static ALWAYS_INLINE void id_bmp_clear(ulong *bmp, int id)
+{
+   bmp[id / NBITS] &= ~(1UL << (id % NBITS));
+}
 
-      ASSERT(tid >= 0);
+/*
+ * Returns the first ID in [start, max_id] free in both `bmp` and `bmp2` (if
+ * not NULL), or -1. Looks at a whole word at a time.
+ */
+static int
+id_bmp_find_free(ulong *bmp, ulong *bmp2, int start, int max_id)
+{
+   const int words = ID_BMP_WORDS(max_id);
+   ulong used;
+   int id;
 
-      if (tid < ctx->lowest_available)
-         return 0;
+   for (int w = start / NBITS; w < words; w++) {
 
-      /*
-       * Both ctx->lowest_available and ctx->lowest_after_current_max are
-       * candidates for the next tid. If one of them gets equal to a sid
-       * without a session leader process or to a pgid without a group leader,
-       * the new process could accidentally become leader of a group/session:
-       * we have to ensure that could never happen.
-       */
+      used = bmp[w] | (bmp2 ? bmp2[w] : 0);
 
-      const int pgid = ti->pi->pgid;
-      const int sid = ti->pi->sid;
-      const int should_restart =
-         inc_candicate_if_matches(&ctx->lowest_available, tid, pgid) +
-         inc_candicate_if_matches(&ctx->lowest_available, tid, sid) +
-         inc_candicate_if_matches(&ctx->lowest_after_current_max, tid, pgid) +
-         inc_candicate_if_matches(&ctx->lowest_after_current_max, tid, sid);
+      /* In the first word, skip the IDs below `start` */
+      if (w == start / NBITS && (start % NBITS))
+         used |= make_bitmask((u32)start % NBITS);
 
-      if (should_restart) {
-         ctx->lowest_avail_invalid = true;
+      if (used != ~0UL) {
+         id = w * NBITS + (int)get_first_zero_bit_index_l(used);
+         return id <= max_id ? id : -1;
       }
    }
 
+   return -1;
+}
 
-   /*
-    * Algorithm: we start with lowest_available (L) == 0. When we hit
-    * tid == L, that means L is not really the lowest, therefore, we guess
-    * the right value of L is L + 1. The first time tid skips one, for example
-    * jumping from 3 to 5, the value of L set by the iteration with tid == 3,
-    * will stuck. That value will be clearly 4.
-    */
+/*
+ * Returns a PID not used by any task nor as pgid/sid. The ID is not reserved
+ * until add_task() is called: the caller must keep the preemption disabled.
+ */
+int create_new_pid(void)
+{
+   int r;
+   ASSERT(!is_preemption_enabled());
 
-   if (ctx->lowest_available == tid)
-      ctx->lowest_available++;
+   r = id_bmp_find_free(pid_bmp, pgsid_bmp, next_pid, MAX_PID);
 
-   /*
-    * For lowest_after_current_max (A) the logic is similar.
-    * We start with A = current_max_pid + 1. The first time A is == tid, will
-    * be when tid is current_max_pid + 1. We continue to update A, until the
-    * first hole is found. In case tid never reaches current_max_pid + 1, `A`
-    * will be just be current_max_pid + 1, as expected.
-    */
+   if (r < 0) /* Wrap around, skipping the kernel process' PID 0 */
+      r = id_bmp_find_free(pid_bmp, pgsid_bmp, 1, MAX_PID);
 
-   if (ctx->lowest_after_current_max == tid)
-      ctx->lowest_after_current_max++;
+   if (r >= 0)
+      next_pid = r + 1;
 
-   return 0;
+   return r;
 }
 
-static int
-create_id_common(struct create_pid_visit_ctx *ctx, int max_id)
+/* Same as create_new_pid(), but for kernel threads */
+int create_new_kernel_tid(void)
 {
    int r;
+   ASSERT(!is_preemption_enabled());
 
-   do {
-
-      ctx->lowest_avail_invalid = false;
-      iterate_over_tasks(&create_new_pid_visit_cb, ctx);
-
-      r = ctx->lowest_after_current_max <= max_id
-            ? ctx->lowest_after_current_max
-            : ctx->lowest_available <= max_id
-               ? ctx->lowest_available
-               : -1;
+   r = id_bmp_find_free(ktid_bmp, NULL, next_kernel_tid, KERNEL_MAX_TID);
 
-      /*
-       * Typically, ctx->lowest_avail_invalid is not a problem because the new
-       * id will be ctx->lowest_after_current_max. But, in the case we've
-       * finished the IDs, we have to pick the absolutely lowest ID available,
-       * which might be invalid we it matched with a process' pgid/sid. This
-       * can happen only in case of orphaned sessions/process groups.
-       *
-       * NOTE: in case we're going to repeat the loop, lowest_avail_invalid is
-       * reset, but all the rest of the context is unchanged: that's because
-       * ctx->lowest_available has actually a meaningful value: the lowest ID
-       * after pgid/sid we hit. It doesn't mean we can use this value, but it
-       * means we cannot pick consider IDs smaller than it.
-       */
+   if (r < 0)
+      r = id_bmp_find_free(ktid_bmp, NULL, 0, KERNEL_MAX_TID);
 
-   } while (r == ctx->lowest_available && ctx->lowest_avail_invalid);
+   if (r < 0)
+      return -1;
 
-   return r;
+   next_kernel_tid = r + 1;
+   return r + KERNEL_TID_START;
 }
 
-int create_new_pid(void)
+/*
+ * Called by pgroup.c when a process group or a session gets created: its ID
+ * must not be reused as PID until sched_release_pgsid() is called.
+ */
+void sched_reserve_pgsid(int id)
 {
    ASSERT(!is_preemption_enabled());
 
-   struct create_pid_visit_ctx ctx = {
-      .kernel_tid = false,
-      .id_off = 0,
-      .lowest_available = 0,
-      .lowest_after_current_max = current_max_pid + 1,
-   };
-
-   int r = create_id_common(&ctx, MAX_PID);
-
-   if (r >= 0)
-      current_max_pid = r;
-
-   return r;
+   if (IN_RANGE_INC(id, 0, MAX_PID))
+      id_bmp_set(pgsid_bmp, id);
 }
 
-int create_new_kernel_tid(void)
+void sched_release_pgsid(int id)
 {
    ASSERT(!is_preemption_enabled());
 
-   struct create_pid_visit_ctx ctx = {
-      .kernel_tid = true,
-      .id_off = KERNEL_TID_START,
-      .lowest_available = 0,
-      .lowest_after_current_max = current_max_kernel_tid + 1,
-   };
+   if (IN_RANGE_INC(id, 0, MAX_PID))
+      id_bmp_clear(pgsid_bmp, id);
+}
 
-   int r = create_id_common(&ctx, KERNEL_MAX_TID);
+static void task_id_set_used(struct task *ti, bool used)
+{
+   ulong *bmp = pid_bmp;
+   int id = ti->tid;
 
-   if (r >= 0) {
-      current_max_kernel_tid = r;
-      return r + KERNEL_TID_START;
+   if (id >= KERNEL_TID_START) {
+      bmp = ktid_bmp;
+      id -= KERNEL_TID_START;
+      ASSERT(id <= KERNEL_MAX_TID);
    }
 
-   return -1;
+   ASSERT(id >= 0);
+   ASSERT(id_bmp_test(bmp, id) != used);
+
+   if (used)
+      id_bmp_set(bmp, id);
+   else
+      id_bmp_clear(bmp, id);
 }
 
 int iterate_over_tasks(bintree_visit_cb func, void *arg)
@@ -378,7 +367,8 @@ static void idle(void)
       ASSERT(is_preemption_enabled());
 
       idle_ticks++;
-      halt();
+      zpool_refill();
+      tickless_idle_halt();
 
       if (need_reschedule() || runnable_tasks_count > 1)
          schedule();
@@ -397,17 +387,26 @@ __attribute__((constructor))
 static void create_kernel_process(void)
 {
    static struct task_and_process tp;
+   static struct fd_table kernel_fds;
 
    struct task *s_kernel_ti = &tp.main_task_obj;
    struct process *s_kernel_pi = &tp.process_obj;
 
-   list_init(&runnable_tasks_list);
+   list_init(&timer_ready_tasks_list);
+
+   for (int i = 0; i < MAX_RT_PRIO; i++)
+      list_init(&rt_queues[i]);
+
    s_kernel_pi->pid = create_new_pid();
    s_kernel_ti->tid = create_new_kernel_tid();
    s_kernel_pi->ref_count = 1;
    s_kernel_ti->pi = s_kernel_pi;
    init_task_lists(s_kernel_ti);
    init_process_lists(s_kernel_pi);
+   fd_table_init(&kernel_fds);
+   s_kernel_pi->fds = &kernel_fds;
+   s_kernel_pi->as_limit_cur = K_RLIM_INFINITY;
+   s_kernel_pi->as_limit_max = K_RLIM_INFINITY;
 
    s_kernel_ti->is_main_thread = true;
    s_kernel_ti->running_in_kernel = IN_SYSCALL_FLAG;
@@ -456,6 +455,253 @@ void init_sched(void)
       panic("Unable to create the idle_task!");
 
    idle_task = get_task(tid);
+
+   /*
+    * The idle task is selected only as a fall-back, in do_schedule(): keep it
+    * out of the runnable tree, otherwise its vruntime (always 0) would make it
+    * the leftmost node forever. Because `idle_task` was still NULL when the
+    * thread has been added, we have to remove it here. Preemption has never
+    * been enabled so far, so the idle thread cannot have run yet. For the
+    * same reason, it has to be removed from the runqueue length.
+    */
+   ulong var;
+   disable_interrupts(&var);
+   {
+      ASSERT_TASK_STATE(idle_task->state, TASK_STATE_RUNNABLE);
+      runnable_tree_remove(idle_task);
+      sched_stats_rq_change(-1);
+   }
+   enable_interrupts(&var);
+
+   /* The granularity is in us: convert it to nice-0 vruntime units */
+   wakeup_gran =
+      (u64)kopt_sched_wakeup_gran * TIMER_HZ * NICE_0_WEIGHT / 1000000;
+
+   sched_reset_global_stats();
+}
+
+u32 sched_nice_to_weight(int nice)
+{
+   return nice_to_weight[CLAMP(nice, MIN_NICE, MAX_NICE) - MIN_NICE];
+}
+
+void sched_set_nice(struct task *ti, int nice)
+{
+   /*
+    * The weight is used only when accounting the ticks: no need to touch the
+    * runnable tree, as the vruntime of the task is not changed here.
+    */
+   ti->nice = CLAMP(nice, MIN_NICE, MAX_NICE);
+}
+
+/*
+ * The vruntime advanced by one tick of a task with the given nice value: it's
+ * NICE_0_WEIGHT for nice-0 tasks, less for tasks with a bigger weight, more
+ * for the others.
+ */
+static ALWAYS_INLINE u32 sched_vruntime_per_tick(int nice)
+{
+   return (NICE_0_WEIGHT * NICE_0_WEIGHT) / sched_nice_to_weight(nice);
+}
+
+/*
+ * Keeps min_vruntime as the smallest vruntime among the current task and the
+ * runnable ones, without ever letting it go backwards. Tasks just created are
+ * placed at min_vruntime and the ones waking up close to it (see
+ * sched_place_woken_task()): otherwise, a task that slept for a long time (or
+ * a new one, starting at 0) would monopolize the CPU until its vruntime caught
+ * up with the others.
+ */
+static void sched_update_min_vruntime(struct task *curr, bool is_running)
+{
+   struct task *left = runnable_tree.first;
+   u64 v;
+
+   if (is_running && curr != idle_task && !is_worker_thread(curr)) {
+
+      v = curr->ticks.vruntime;
+
+      if (left)
+         v = MIN(v, left->ticks.vruntime);
+
+   } else if (left) {
+
+      v = left->ticks.vruntime;
+
+   } else {
+
+      return;
+   }
+
+   min_vruntime = MAX(min_vruntime, v);
+}
+
+static void rt_enqueue(struct task *ti)
+{
+   const int prio = ti->eff_rt_prio;
+
+   list_add_tail(&rt_queues[prio], &ti->rt_node);
+   rt_bitmap[prio / 32] |= (1u << (prio % 32));
+}
+
+static void rt_dequeue(struct task *ti)
+{
+   const int prio = ti->eff_rt_prio;
+
+   list_remove(&ti->rt_node);
+   list_node_init(&ti->rt_node);
+
+   if (list_is_empty(&rt_queues[prio]))
+      rt_bitmap[prio / 32] &= ~(1u << (prio % 32));
+}
+
+/*
+ * Changes the effective RT priority of `ti`, moving it between the runqueues
+ * if it's runnable. Used both for the static priority and for the priority
+ * inheritance boost (see kmutex.c).
+ */
+void sched_set_eff_rt_prio(struct task *ti, int prio)
+{
+   struct task *curr = get_curr_task();
+   ulong var;
+
+   ASSERT(0 <= prio && prio < MAX_RT_PRIO);
+
+   disable_interrupts(&var);
+
+   if (ti->eff_rt_prio != prio) {
+
+      const bool runnable = ti->state == TASK_STATE_RUNNABLE;
+      const u64 runnable_since = ti->sched_stats.runnable_since;
+
+      if (runnable)
+         task_remove_from_state_list(ti);
+
+      /* Back to the fair class: same as for a woken up task */
+      if (!prio)
+         ti->ticks.vruntime = MAX(ti->ticks.vruntime, min_vruntime);
+
+      ti->eff_rt_prio = (u8)prio;
+
+      if (runnable) {
+         task_add_to_state_list(ti);
+         ti->sched_stats.runnable_since = runnable_since;
+      }
+
+      if (ti != curr && prio > curr->eff_rt_prio)
+         sched_set_need_resched();
+   }
+
+   enable_interrupts(&var);
+}
+
+void sched_set_policy(struct task *ti, enum sched_policy policy, int rt_prio)
+{
+   ASSERT(policy == sched_policy_normal || (0 < rt_prio && rt_prio < MAX_RT_PRIO));
+   ASSERT(policy != sched_policy_normal || rt_prio == 0);
+
+   disable_preemption();
+   {
+      ti->policy = (u8)policy;
+      ti->rt_prio = (u8)rt_prio;
+
+      /* Don't drop an ongoing priority inheritance boost */
+      if (!ti->held_kmutexes || rt_prio > ti->eff_rt_prio)
+         sched_set_eff_rt_prio(ti, rt_prio);
+   }
+   enable_preemption();
+}
+
+/*
+ * Woken up tasks are placed at min_vruntime minus a bonus of half timeslice,
+ * like Linux's GENTLE_FAIR_SLEEPERS: that allows I/O-bound tasks to preempt
+ * CPU hogs (see sched_check_wakeup_preempt()), but not to accumulate credit
+ * while sleeping.
+ *
+ * Tasks woken up by a kcond with `wake_boost` set (e.g. readers of the tty
+ * input) are placed at least at min_vruntime, even if they slept for a very
+ * short time: that makes them the leftmost task, in the common case.
+ */
+#define SCHED_SLEEPER_CREDIT      ((u64)TIME_SLICE_TICKS * NICE_0_WEIGHT / 2)
+
+static void sched_place_woken_task(struct task *ti)
+{
+   const u64 min_v =
+      min_vruntime > SCHED_SLEEPER_CREDIT
+         ? min_vruntime - SCHED_SLEEPER_CREDIT
+         : 0;
+
+   ti->ticks.vruntime = MAX(ti->ticks.vruntime, min_v);
+
+   if (ti->wake_boost)
+      ti->ticks.vruntime = MIN(ti->ticks.vruntime, min_vruntime);
+}
+
+/*
+ * Wake-up preemption: a task which became runnable preempts the current one
+ * when it has a higher RT priority or, in the fair class, when its vruntime
+ * is lower than the current task's one by more than `wakeup_gran`. Without
+ * that, it would have to wait until the current task blocks or consumes its
+ * whole timeslice. The granularity avoids too frequent context switches
+ * between tasks with a similar vruntime, but it doesn't apply to boosted
+ * tasks: waiting for them means adding latency to user's input.
+ */
+static void sched_check_wakeup_preempt(struct task *ti)
+{
+   struct task *curr = get_curr_task();
+
+   if (!curr || ti == curr || is_worker_thread(ti) || is_worker_thread(curr))
+      return;
+
+   if (ti->eff_rt_prio || curr->eff_rt_prio) {
+
+      if (ti->eff_rt_prio > curr->eff_rt_prio)
+         sched_set_need_resched();
+
+      return;
+   }
+
+   if (ti->wake_boost ||
+       curr->ticks.vruntime > ti->ticks.vruntime + wakeup_gran)
+   {
+      sched_set_need_resched();
+   }
+}
+
+static long runnable_task_cmp(const void *a, const void *b)
+{
+   const struct task *t1 = a;
+   const struct task *t2 = b;
+
+   if (t1->ticks.vruntime != t2->ticks.vruntime)
+      return t1->ticks.vruntime < t2->ticks.vruntime ? -1 : 1;
+
+   /* Same vruntime: use the tid, in order to keep the keys unique */
+   return (long)t1->tid - (long)t2->tid;
+}
+
+static void runnable_tree_insert(struct task *ti)
+{
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_cached_insert(&runnable_tree,
+                            ti,
+                            &runnable_task_cmp,
+                            struct task,
+                            runnable_node);
+
+   ASSERT(success);
+}
+
+static void runnable_tree_remove(struct task *ti)
+{
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_cached_remove(&runnable_tree,
+                            ti,
+                            &runnable_task_cmp,
+                            struct task,
+                            runnable_node);
+
+   ASSERT(removed == ti);
 }
 
 void set_current_task_in_kernel(void)
@@ -464,15 +710,179 @@ void set_current_task_in_kernel(void)
    get_curr_task()->running_in_kernel |= IN_SYSCALL_FLAG;
 }
 
+/*
+ * Accounts the time spent with the current runqueue length and then changes
+ * it by `delta`. Called with interrupts disabled or, as in add_task(), with
+ * preemption disabled.
+ */
+static void sched_stats_rq_change(int delta)
+{
+   const u64 now = RDTSC();
+   const u64 elapsed = now - gstats.rq_last_change;
+   const int len = gstats.rq_len;
+
+   gstats.rq_time[MIN(len, SCHED_RQ_HIST_SIZE - 1)] += elapsed;
+   gstats.rq_len_time += (u64)len * elapsed;
+   gstats.rq_last_change = now;
+   gstats.rq_len = len + delta;
+   gstats.rq_max = MAX(gstats.rq_max, gstats.rq_len);
+}
+
+/*
+ * Called when `ti` has been switched in, after having been RUNNABLE: accounts
+ * its wake-to-run latency, both per-task and globally.
+ */
+static void sched_stats_account_wait(struct task *ti)
+{
+   struct sched_stats *st = &ti->sched_stats;
+   u64 wait;
+
+   if (ti == idle_task || !st->runnable_since)
+      return;
+
+   wait = RDTSC() - st->runnable_since;
+   st->runnable_since = 0;
+
+   st->wait_total += wait;
+   st->wait_max = MAX(st->wait_max, wait);
+   st->wait_count++;
+
+   gstats.wait_total += wait;
+   gstats.wait_max = MAX(gstats.wait_max, wait);
+   gstats.wait_count++;
+}
+
+static void sched_stats_account_switch(struct task *curr, bool preempted)
+{
+   if (curr == idle_task)
+      return;
+
+   if (preempted) {
+      curr->sched_stats.nivcsw++;
+      gstats.nivcsw++;
+   } else {
+      curr->sched_stats.nvcsw++;
+      gstats.nvcsw++;
+   }
+}
+
+/*
+ * Charges the time elapsed since the last accounting to the current task, as
+ * user time if `user` is true (i.e. we're just entering the kernel from user
+ * space), as system time otherwise. Called with interrupts disabled.
+ */
+void sched_account_cputime(bool user)
+{
+   struct task *curr = get_curr_task();
+   struct sched_cputime *ct = &curr->cputime;
+   const u64 now = RDTSC();
+
+   if (ct->last) {
+
+      if (user)
+         ct->user += now - ct->last;
+      else
+         ct->system += now - ct->last;
+   }
+
+   ct->last = now;
+}
+
+static void tsc_to_timespec(u64 tsc, struct k_timespec64 *tp)
+{
+   const u64 us = boot_trace_tsc_to_us(tsc);
+
+   tp->tv_sec = (s64)(us / 1000000);
+   tp->tv_nsec = (long)(us % 1000000) * 1000;
+}
+
+/*
+ * Returns the precise user and system time of `ti`. When the TSC frequency
+ * is not known (yet), falls back to the statistical tick-based accounting.
+ */
+void task_get_cputime(struct task *ti,
+                      struct k_timespec64 *utime,
+                      struct k_timespec64 *stime)
+{
+   struct sched_cputime ct;
+   struct sched_ticks t;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      if (ti == get_curr_task())
+         sched_account_cputime(false);   /* we're in a syscall */
+
+      ct = ti->cputime;
+      t = ti->ticks;
+   }
+   enable_interrupts(&var);
+
+   if (ct.user + ct.system && !boot_trace_tsc_to_us(ct.user + ct.system)) {
+      ticks_to_timespec(t.total - t.total_kernel, utime);
+      ticks_to_timespec(t.total_kernel, stime);
+      return;
+   }
+
+   tsc_to_timespec(ct.user, utime);
+   tsc_to_timespec(ct.system, stime);
+}
+
+void sched_get_global_stats(struct sched_global_stats *s)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      sched_stats_rq_change(0);    /* account the time up to now */
+      *s = gstats;
+   }
+   enable_interrupts(&var);
+}
+
+void sched_reset_global_stats(void)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      const int rq_len = gstats.rq_len;
+
+      bzero(&gstats, sizeof(gstats));
+      gstats.start = gstats.rq_last_change = RDTSC();
+      gstats.rq_len = gstats.rq_max = rq_len;
+   }
+   enable_interrupts(&var);
+}
+
 static void task_add_to_state_list(struct task *ti)
 {
+   if (atomic_load_explicit(&ti->state, mo_relaxed) == TASK_STATE_RUNNABLE)
+      ti->sched_stats.runnable_since = RDTSC();
+
    if (is_worker_thread(ti))
       return;
 
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_add_tail(&runnable_tasks_list, &ti->runnable_node);
+
+         if (ti == idle_task) {
+
+            /* The idle task is not in any runqueue */
+
+         } else if (ti->eff_rt_prio) {
+
+            sched_stats_rq_change(+1);
+            rt_enqueue(ti);
+
+         } else {
+
+            sched_stats_rq_change(+1);
+            runnable_tree_insert(ti);
+
+            if (ti->timer_ready)
+               list_add_tail(&timer_ready_tasks_list, &ti->timer_ready_node);
+         }
+
          runnable_tasks_count++;
          break;
 
@@ -501,7 +911,27 @@ static void task_remove_from_state_list(struct task *ti)
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_remove(&ti->runnable_node);
+
+         if (ti == idle_task) {
+
+            /* The idle task is not in any runqueue */
+
+         } else if (ti->eff_rt_prio) {
+
+            sched_stats_rq_change(-1);
+            rt_dequeue(ti);
+
+         } else {
+
+            sched_stats_rq_change(-1);
+            runnable_tree_remove(ti);
+
+            if (list_is_node_in_list(&ti->timer_ready_node)) {
+               list_remove(&ti->timer_ready_node);
+               list_node_init(&ti->timer_ready_node);
+            }
+         }
+
          runnable_tasks_count--;
          ASSERT(runnable_tasks_count >= 0);
          break;
@@ -531,9 +961,22 @@ void task_change_state(struct task *ti, enum task_state new_state)
 
    disable_interrupts(&var);
    {
+      const enum task_state old_state = ti->state;
+
+      if (new_state == TASK_STATE_RUNNING)
+         sched_stats_account_wait(ti);
+
       task_remove_from_state_list(ti);
       atomic_store_explicit(&ti->state, new_state, mo_relaxed);
+
+      /* Woken up: don't let the task keep a stale, too small, vruntime */
+      if (old_state == TASK_STATE_SLEEPING && new_state == TASK_STATE_RUNNABLE)
+         sched_place_woken_task(ti);
+
       task_add_to_state_list(ti);
+
+      if (new_state == TASK_STATE_RUNNABLE)
+         sched_check_wakeup_preempt(ti);
    }
    enable_interrupts(&var);
 }
@@ -554,6 +997,8 @@ void add_task(struct task *ti)
 {
    disable_preemption();
    {
+      /* New tasks start from min_vruntime, see sched_update_min_vruntime() */
+      ti->ticks.vruntime = min_vruntime;
       task_add_to_state_list(ti);
 
       bintree_insert_ptr(&tree_by_tid_root,
@@ -561,6 +1006,9 @@ void add_task(struct task *ti)
                          struct task,
                          tree_by_tid_node,
                          tid);
+
+      htable_add(&tasks_by_tid, &ti->tid_hnode, hash_u32((u32)ti->tid));
+      task_id_set_used(ti, true);
    }
    enable_preemption();
 }
@@ -579,6 +1027,8 @@ void remove_task(struct task *ti)
                          tree_by_tid_node,
                          tid);
 
+      htable_del(&tasks_by_tid, &ti->tid_hnode);
+      task_id_set_used(ti, false);
       free_task(ti);
    }
    enable_preemption();
@@ -601,32 +1051,67 @@ void sched_account_ticks(void)
    if (curr->running_in_kernel)
       t->total_kernel++;
 
-   if (curr != idle_task) {
+   if (curr != idle_task && !curr->eff_rt_prio) {
 
       /*
        * The more currently runnable tasks are, the higher vruntime has to
        * grow: if case of just 1 runnable task (+1 for idle ignored), vruntime
-       * will increase by just +1. In case of 15 runnable tasks, vruntime will
-       * increase by +15. The logic behind is the following: supposing all the
-       * 15 tasks are runnable and they all start with vruntime = 0, after the
-       * first has run, it will have vruntime = 15 * TIME_SLICE_TICKS and will
-       * have to wait until all the other 14 tasks ran until it can be picked
-       * again.
+       * will increase by just +1 unit. In case of 15 runnable tasks, vruntime
+       * will increase by +15 units. The logic behind is the following:
+       * supposing all the 15 tasks are runnable and they all start with
+       * vruntime = 0, after the first has run, it will have vruntime =
+       * 15 * TIME_SLICE_TICKS units and will have to wait until all the other
+       * 14 tasks ran until it can be picked again.
        *
        * Now, picking the task with the lowest vruntime will be more fair than
        * picking the task with the lowest `total` number of ticks, because
        * tasks that that consumed 100% of the CPU when no other task was
        * runnable won't be so much penalized.
+       *
+       * The unit is scaled by the weight of the task's nice value, like in
+       * Linux's CFS: a nice-0 task accrues NICE_0_WEIGHT per unit, while a
+       * task with twice that weight accrues half of it and, therefore, gets
+       * picked twice as often.
        */
-      t->vruntime += (u64)(runnable_tasks_count - 1);
+      const u64 delta =
+         (u64)(runnable_tasks_count - 1) * sched_vruntime_per_tick(curr->nice);
+
+      if (state == TASK_STATE_RUNNABLE && !is_worker) {
+
+         /*
+          * The current task is already in the runnable tree (e.g. it has been
+          * woken up before it had the chance to call the scheduler): because
+          * vruntime is the key of the tree, we have to re-insert it.
+          */
+
+         ulong var;
+         disable_interrupts(&var);
+         {
+            runnable_tree_remove(curr);
+            t->vruntime += delta;
+            runnable_tree_insert(curr);
+         }
+         enable_interrupts(&var);
+
+      } else {
+
+         t->vruntime += delta;
+      }
+
+      sched_update_min_vruntime(curr, is_running);
    }
 
    /*
     * need_resched is never set for worker threads when they used too much
     * CPU time: their timeslice is unlimited and can preempted only be another
-    * worker thread.
+    * worker thread. The same applies to SCHED_FIFO tasks and to the fair
+    * tasks boosted by priority inheritance: only SCHED_RR tasks have an RT
+    * timeslice.
     */
-   const bool timeout = !is_worker && t->timeslice >= TIME_SLICE_TICKS;
+   const bool has_timeslice =
+      !is_worker && (!curr->eff_rt_prio || curr->policy == sched_policy_rr);
+
+   const bool timeout = has_timeslice && t->timeslice >= TIME_SLICE_TICKS;
 
    if (curr->stopped || !is_running || timeout)
       sched_set_need_resched();
@@ -664,6 +1149,91 @@ sched_should_return_immediately(struct task *curr, enum task_state curr_state)
    return false;
 }
 
+static struct task *
+sched_get_min_vruntime_task(void)
+{
+   struct task *left = runnable_tree.first;
+   struct bintree_iter it;
+   struct task *pos;
+
+   /* Typical case: O(1), just use the cached leftmost node */
+   if (!left || !left->stopped)
+      return left;
+
+   /* Slow path: the leftmost task is stopped, do an in-order visit */
+   bintree_iter_start(&it, runnable_tree.root, struct task, runnable_node);
+
+   while ((pos = bintree_iter_next(&it))) {
+
+      ASSERT_TASK_STATE(pos->state, TASK_STATE_RUNNABLE);
+
+      if (!pos->stopped)
+         return pos;
+   }
+
+   return NULL;
+}
+
+static struct task *rt_first_non_stopped(struct list *queue)
+{
+   struct task *pos;
+
+   list_for_each_ro(pos, queue, rt_node) {
+
+      ASSERT_TASK_STATE(pos->state, TASK_STATE_RUNNABLE);
+
+      if (!pos->stopped)
+         return pos;
+   }
+
+   return NULL;
+}
+
+/*
+ * Selects the highest priority RT task, if any. Returns the current task when
+ * it's an RT task which should continue running: SCHED_FIFO tasks run until
+ * they block, yield or a higher priority task becomes runnable, while
+ * SCHED_RR tasks give the CPU also to same-priority tasks, once their
+ * timeslice is over.
+ */
+static struct task *
+sched_select_rt_task(struct task *curr, enum task_state curr_state)
+{
+   struct task *best = NULL;
+   bool rotate;
+
+   for (int w = (int)ARRAY_SIZE(rt_bitmap) - 1; w >= 0 && !best; w--) {
+
+      u32 bits = rt_bitmap[w];
+
+      while (bits && !best) {
+         const int bit = 31 - __builtin_clz(bits);
+         best = rt_first_non_stopped(&rt_queues[w * 32 + bit]);
+         bits &= ~(1u << bit);
+      }
+   }
+
+   if (!curr->eff_rt_prio || is_worker_thread(curr))
+      return best;
+
+   if (curr_state != TASK_STATE_RUNNING || curr->stopped)
+      return best;
+
+   rotate = curr->rt_yield ||
+            (curr->policy == sched_policy_rr &&
+             curr->ticks.timeslice >= TIME_SLICE_TICKS);
+
+   curr->rt_yield = false;
+
+   if (!best || best->eff_rt_prio < curr->eff_rt_prio)
+      return curr;
+
+   if (best->eff_rt_prio == curr->eff_rt_prio && !rotate)
+      return curr;
+
+   return best;
+}
+
 static struct task *
 sched_do_select_runnable_task(enum task_state curr_state, bool resched)
 {
@@ -671,22 +1241,20 @@ sched_do_select_runnable_task(enum task_state curr_state, bool resched)
    struct task *selected = NULL;
    struct task *pos;
 
-   list_for_each_ro(pos, &runnable_tasks_list, runnable_node) {
+   /* Fast path: tasks that have just been woken up by their timer */
+   list_for_each_ro(pos, &timer_ready_tasks_list, timer_ready_node) {
 
       ASSERT_TASK_STATE(pos->state, TASK_STATE_RUNNABLE);
 
-      if (pos->stopped || pos == idle_task)
-         continue;
-
-      if (pos->timer_ready) {
+      if (pos->timer_ready && !pos->stopped) {
          selected = pos;
          break;
       }
-
-      if (!selected || pos->ticks.vruntime < selected->ticks.vruntime)
-         selected = pos;
    }
 
+   if (!selected)
+      selected = sched_get_min_vruntime_task();
+
    /* If there is still no selected task, check for current task */
    if (!selected) {
 
@@ -699,8 +1267,8 @@ sched_do_select_runnable_task(enum task_state curr_state, bool resched)
       /*
        * If need_resched is not set, the caller didn't want necessarily to
        * yield, but just give the scheduler an opportunity to switch the current
-       * task. In the loop avoid, the current task was not included because its
-       * state is typically RUNNING, so it's not present in the runnable_list.
+       * task. Above, the current task was not considered because its state is
+       * typically RUNNING, so it's not present in the runnable tree.
        */
 
       if (curr_state == TASK_STATE_RUNNING && !curr->stopped)
@@ -730,6 +1298,10 @@ void do_schedule(void)
    /* Check for worker threads ready to run */
    selected = wth_get_runnable_thread();
 
+   /* Check for realtime tasks */
+   if (!selected)
+      selected = sched_select_rt_task(curr, curr_state);
+
    /* Check for regular runnable tasks */
    if (!selected) {
 
@@ -744,6 +1316,12 @@ void do_schedule(void)
       /* Sanity check */
       ASSERT(!selected->stopped);
 
+      sched_stats_account_switch(curr, curr_state == TASK_STATE_RUNNING);
+
+      /* Charge the current task up to now and start the clock for the next */
+      sched_account_cputime(false);
+      selected->cputime.last = curr->cputime.last;
+
       /* If we preempted the process, it is still `running` */
       if (curr_state == TASK_STATE_RUNNING)
          task_change_state(curr, TASK_STATE_RUNNABLE);
@@ -766,19 +1344,21 @@ void do_schedule(void)
    }
 }
 
+static bool task_tid_match(struct htable_node *n, const void *key)
+{
+   return CONTAINER_OF(n, struct task, tid_hnode)->tid == *(const int *)key;
+}
+
 struct task *get_task(int tid)
 {
-   long ltid = tid;
-   struct task *res = NULL;
    ASSERT(!is_preemption_enabled());
 
-   res = bintree_find_ptr(tree_by_tid_root,
-                          ltid,
+   return htable_find_obj(&tasks_by_tid,
+                          hash_u32((u32)tid),
+                          task_tid_match,
+                          &tid,
                           struct task,
-                          tree_by_tid_node,
-                          tid);
-
-   return res;
+                          tid_hnode);
 }
 
 struct process *get_process(int pid)
@@ -799,29 +1379,25 @@ bool in_currently_dying_task(void)
    return get_curr_task_state() == TASK_STATE_ZOMBIE;
 }
 
-int send_signal_to_group(int pgid, int sig)
+/*
+ * Sends `sig` to all the members of `g` except `curr_pi` and init, sending it
+ * to the leader (if any) last. Returns the number of processes signaled.
+ */
+static int
+send_signal_to_group_members(struct pgroup *g,
+                             struct process *curr_pi,
+                             int leader_pid,
+                             int sig)
 {
-   struct process *curr_pi = get_curr_proc();
    struct process *leader = NULL;
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
+   struct process *pi;
    int count = 0;
 
-   disable_preemption();
-
-   bintree_in_order_visit_start(&ctx,
-                                tree_by_tid_root,
-                                struct task,
-                                tree_by_tid_node,
-                                false);
-
-   while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-      struct process *pi = ti->pi;
+   list_for_each_ro(pi, &g->members, pgrp_node) {
 
-      if (pi->pgid == pgid && pi != curr_pi && pi->pid != 1) {
+      if (pi != curr_pi && pi->pid != 1) {
 
-         if (pi->pid != pgid)
+         if (pi->pid != leader_pid)
             send_signal(pi->pid, sig, true);
          else
             leader = pi;
@@ -833,6 +1409,20 @@ int send_signal_to_group(int pgid, int sig)
    if (leader)
       send_signal(leader->pid, sig, true); /* kill the leader last */
 
+   return count;
+}
+
+int send_signal_to_group(int pgid, int sig)
+{
+   struct process *curr_pi = get_curr_proc();
+   struct pgroup *g;
+   int count = 0;
+
+   disable_preemption();
+   {
+      if ((g = pgroup_get(pgid)))
+         count = send_signal_to_group_members(g, curr_pi, pgid, sig);
+   }
    enable_preemption();
 
    if (curr_pi->pgid == pgid) {
@@ -848,41 +1438,22 @@ int send_signal_to_group(int pgid, int sig)
 int send_signal_to_session(int sid, int sig)
 {
    struct process *curr_pi = get_curr_proc();
-   struct process *leader = NULL;
-   struct bintree_walk_ctx ctx;
-   struct task *ti;
+   struct session *s;
+   struct pgroup *g;
    int count = 0;
 
    disable_preemption();
-
-   bintree_in_order_visit_start(&ctx,
-                                tree_by_tid_root,
-                                struct task,
-                                tree_by_tid_node,
-                                false);
-
-   while ((ti = bintree_in_order_visit_next(&ctx))) {
-
-      struct process *pi = ti->pi;
-
-      if (pi->pgid == sid && pi != curr_pi && pi->pid != 1) {
-
-         if (pi->pid != sid)
-            send_signal(pi->pid, sig, true);
-         else
-            leader = pi;
-
-         count++;
+   {
+      if ((s = session_get(sid))) {
+         list_for_each_ro(g, &s->groups, session_node) {
+            count += send_signal_to_group_members(g, curr_pi, sid, sig);
+         }
       }
    }
-
-   if (leader)
-      send_signal(leader->pid, sig, true); /* kill the leader last */
-
    enable_preemption();
 
    /* kill the current process, as _very_ last */
-   if (curr_pi->pgid == sid) {
+   if (curr_pi->sid == sid) {
       send_signal(curr_pi->pid, sig, true);
       count++;
    }
@@ -9,6 +9,16 @@
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/timer.h>
 
+/*
+ * For each condition the select() waits on, the fd and the set it comes from.
+ * Element `i` corresponds to `waiter->elems[i]`: that allows re-checking only
+ * the streams whose conditions have been signaled, after a wake-up.
+ */
+struct select_cond_ref {
+   int fd;
+   int set;
+};
+
 struct select_ctx {
    int nfds;
    fd_set *sets[3];
@@ -17,6 +27,7 @@ struct select_ctx {
    struct k_timeval *user_tv;
    int cond_cnt;
    u32 timeout_ticks;
+   struct select_cond_ref *refs;
 };
 
 static const func_get_rwe_cond gcf[3] = {
@@ -31,18 +42,51 @@ static const func_rwe_ready grf[3] = {
    &vfs_except_ready,
 };
 
+/*
+ * Returns the first fd >= `fd` set in `set`, or `nfds` if there's none. The
+ * fd_set is scanned one word at a time, so that sparse sets with high fd
+ * numbers cost proportionally to the number of words, not of bits.
+ */
+static int
+fdset_next(fd_set *set, int nfds, int fd)
+{
+   const ulong *words = (const ulong *)set;
+   int w = fd / NBITS;
+   ulong bits;
+
+   if (fd >= nfds)
+      return nfds;
+
+   bits = words[w] & (~0UL << (fd % NBITS));
+
+   while (!bits) {
+
+      if (++w * NBITS >= nfds)
+         return nfds;
+
+      bits = words[w];
+   }
+
+   fd = w * NBITS + __builtin_ctzl(bits);
+   return MIN(fd, nfds);
+}
+
+#define fdset_for_each(fd, set, nfds)                                    \
+   for (fd = fdset_next(set, nfds, 0);                                   \
+        fd < (nfds);                                                     \
+        fd = fdset_next(set, nfds, fd + 1))
+
 static int
 select_count_cond_per_set(struct select_ctx *c,
                           fd_set *set,
                           func_get_rwe_cond gcfunc)
 {
+   int i;
+
    if (!set)
       return 0;
 
-   for (int i = 0; i < c->nfds; i++) {
-
-      if (!FD_ISSET(i, set))
-         continue;
+   fdset_for_each(i, set, c->nfds) {
 
       fs_handle h = get_fs_handle(i);
 
@@ -57,30 +101,29 @@ select_count_cond_per_set(struct select_ctx *c,
 }
 
 static int
-select_set_kcond(int nfds,
+select_set_kcond(struct select_ctx *ctx,
                  struct multi_obj_waiter *w,
                  int *idx,
-                 fd_set *set,
-                 func_get_rwe_cond get_cond)
+                 int set_idx)
 {
+   fd_set *set = ctx->sets[set_idx];
    fs_handle h;
    struct kcond *c;
+   int i;
 
    if (!set)
       return 0;
 
-   for (int i = 0; i < nfds; i++) {
-
-      if (!FD_ISSET(i, set))
-         continue;
+   fdset_for_each(i, set, ctx->nfds) {
 
       if (!(h = get_fs_handle(i)))
          return -EBADF;
 
-      c = get_cond(h);
+      c = gcf[set_idx](h);
 
       if (c) {
          ASSERT((*idx) < w->count);
+         ctx->refs[*idx] = (struct select_cond_ref) { i, set_idx };
          mobj_waiter_set(w, (*idx)++, WOBJ_KCOND, c, &c->wait_list);
       }
    }
@@ -92,14 +135,12 @@ static int
 select_set_ready(int nfds, fd_set *set, func_rwe_ready is_ready)
 {
    int tot = 0;
+   int i;
 
    if (!set)
       return tot;
 
-   for (int i = 0; i < nfds; i++) {
-
-      if (!FD_ISSET(i, set))
-         continue;
+   fdset_for_each(i, set, nfds) {
 
       fs_handle h = get_fs_handle(i);
 
@@ -117,14 +158,12 @@ static int
 count_ready_streams_per_set(int nfds, fd_set *set, func_rwe_ready is_ready)
 {
    int count = 0;
+   int j;
 
    if (!set)
       return count;
 
-   for (int j = 0; j < nfds; j++) {
-
-      if (!FD_ISSET(j, set))
-         continue;
+   fdset_for_each(j, set, nfds) {
 
       fs_handle h = get_fs_handle(j);
 
@@ -147,6 +186,41 @@ count_ready_streams(int nfds, fd_set *sets[3])
    return count;
 }
 
+/*
+ * Checks only the streams whose conditions have been signaled: kcond_signal_*
+ * resets the wait object of the signaled elements, while the others are still
+ * in the wait lists of their conditions. A signaled element is armed again
+ * *before* checking its stream, so that no signal can be lost in between.
+ */
+static int
+count_signaled_ready_streams(struct select_ctx *c,
+                             struct multi_obj_waiter *w)
+{
+   int count = 0;
+
+   for (int i = 0; i < w->count; i++) {
+
+      struct mwobj_elem *e = &w->elems[i];
+      struct select_cond_ref *r = &c->refs[i];
+      struct kcond *kc;
+      fs_handle h;
+
+      if (e->wobj.type != WOBJ_NONE)
+         continue; /* Not signaled */
+
+      if (!(h = get_fs_handle(r->fd)))
+         continue; /* Closed meanwhile */
+
+      if ((kc = gcf[r->set](h)))
+         mobj_waiter_set(w, i, WOBJ_KCOND, kc, &kc->wait_list);
+
+      if (grf[r->set](h))
+         count++;
+   }
+
+   return count;
+}
+
 static int
 select_wait_on_cond(struct select_ctx *c)
 {
@@ -158,8 +232,15 @@ select_wait_on_cond(struct select_ctx *c)
    if (!(waiter = allocate_mobj_waiter(c->cond_cnt)))
       return -ENOMEM;
 
+   c->refs = task_temp_kernel_alloc(sizeof(c->refs[0]) * (u32)c->cond_cnt);
+
+   if (!c->refs) {
+      free_mobj_waiter(waiter);
+      return -ENOMEM;
+   }
+
    for (int i = 0; i < 3; i++) {
-      if ((rc = select_set_kcond(c->nfds, waiter, &idx, c->sets[i], gcf[i])))
+      if ((rc = select_set_kcond(c, waiter, &idx, i)))
          goto out;
    }
 
@@ -194,7 +275,7 @@ select_wait_on_cond(struct select_ctx *c)
              * streams. We have to check that.
              */
 
-            if (!count_ready_streams(c->nfds, c->sets))
+            if (!count_signaled_ready_streams(c, waiter))
                continue; /* No ready streams, we have to wait again. */
 
             u32 rem = task_cancel_wakeup_timer(curr);
@@ -206,16 +287,17 @@ select_wait_on_cond(struct select_ctx *c)
 
          /* No timeout: we woke-up because of a kcond was signaled */
 
-         if (!count_ready_streams(c->nfds, c->sets))
+         if (!count_signaled_ready_streams(c, waiter))
             continue; /* No ready streams, we have to wait again. */
       }
 
-      /* count_ready_streams() returned > 0 */
+      /* count_signaled_ready_streams() returned > 0 */
       break;
    }
 
 out:
    free_mobj_waiter(waiter);
+   task_temp_kernel_free(c->refs);
 
    if (pending_signals())
       return -EINTR;
@@ -320,11 +402,12 @@ int sys_select(int user_nfds,
       .user_tv = user_tv,
       .cond_cnt = 0,
       .timeout_ticks = 0,
+      .refs = NULL,
    };
 
    int rc;
 
-   if (user_nfds < 0 || user_nfds > MAX_HANDLES)
+   if (user_nfds < 0 || user_nfds > FD_SETSIZE)
       return -EINVAL;
 
    if ((rc = select_read_user_sets(ctx.sets, ctx.u_sets)))
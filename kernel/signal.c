@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_userlim.h>
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/utils.h>
@@ -18,6 +19,53 @@
 
 typedef void (*action_type)(struct task *, int signum, int fl);
 
+/*
+ * Signals carrying a siginfo (sent by sigqueue() or real-time ones) get an
+ * entry in the `sigqueue` list of the target task, along with their bit in
+ * `sa_pending`. Real-time signals queue up: each instance is delivered, in
+ * FIFO order, and the bit is cleared only after the last one. Standard
+ * signals, instead, keep coalescing: at most one entry per signal.
+ *
+ * The entries come from a global pool pre-allocated at build time, so that
+ * sending a signal never needs to allocate memory. When the pool or the per
+ * task limit are exhausted, sigqueue() fails with -EAGAIN, while kill() falls
+ * back to just setting the bit (the signal will have no siginfo).
+ */
+struct sigqueue_entry {
+
+   struct list_node node;        /* node in task->sigqueue or in the pool */
+   siginfo_t info;
+};
+
+STATIC_ASSERT(SIGQUEUE_MAX_PER_TASK <= 0xFFFF); /* task->sigqueue_len: u16 */
+
+static struct sigqueue_entry sigq_pool[SIGQUEUE_POOL_SIZE];
+static struct list sigq_free_list = STATIC_LIST_INIT(sigq_free_list);
+static u32 sigq_pool_used;       /* entries taken from the pool at least once */
+
+static struct sigqueue_entry *sigq_alloc(void)
+{
+   struct sigqueue_entry *e;
+   ASSERT(!is_preemption_enabled());
+
+   if (!list_is_empty(&sigq_free_list)) {
+      e = list_first_obj(&sigq_free_list, struct sigqueue_entry, node);
+      list_remove(&e->node);
+      return e;
+   }
+
+   if (sigq_pool_used < ARRAY_SIZE(sigq_pool))
+      return &sigq_pool[sigq_pool_used++];
+
+   return NULL;
+}
+
+static void sigq_free(struct sigqueue_entry *e)
+{
+   ASSERT(!is_preemption_enabled());
+   list_add_head(&sigq_free_list, &e->node);
+}
+
 static void __add_sig(ulong *set, int signum)
 {
    ASSERT(signum > 0);
@@ -29,7 +77,21 @@ static void __add_sig(ulong *set, int signum)
    if (slot >= K_SIGACTION_MASK_WORDS)
       return; /* just silently ignore signals that we don't support */
 
-   set[slot] |= (1 << index);
+   set[slot] |= (1UL << index);
+}
+
+/*
+ * Must be called every time `sa_pending` or `sa_mask` change. See the comment
+ * above `sig_deliverable` in sched.h.
+ */
+static void update_sig_deliverable(struct task *ti)
+{
+   ulong any = 0;
+
+   for (u32 i = 0; i < K_SIGACTION_MASK_WORDS; i++)
+      any |= ti->sa_pending[i] & ~ti->sa_mask[i];
+
+   ti->sig_deliverable = !!any;
 }
 
 static void add_pending_sig(struct task *ti, int signum, int fl)
@@ -38,6 +100,9 @@ static void add_pending_sig(struct task *ti, int signum, int fl)
 
    if (fl & SIG_FL_FAULT)
       __add_sig(ti->sa_fault_pending, signum);
+
+   update_sig_deliverable(ti);
+   signalfd_notify();
 }
 
 static void __del_sig(ulong *set, int signum)
@@ -51,13 +116,14 @@ static void __del_sig(ulong *set, int signum)
    if (slot >= K_SIGACTION_MASK_WORDS)
       return; /* just silently ignore signals that we don't support */
 
-   set[slot] &= ~(1 << index);
+   set[slot] &= ~(1UL << index);
 }
 
 static void del_pending_sig(struct task *ti, int signum)
 {
    __del_sig(ti->sa_pending, signum);
    __del_sig(ti->sa_fault_pending, signum);
+   update_sig_deliverable(ti);
 }
 
 static bool __is_sig_set(ulong *set, int signum)
@@ -71,7 +137,7 @@ static bool __is_sig_set(ulong *set, int signum)
    if (slot >= K_SIGACTION_MASK_WORDS)
       return false; /* just silently ignore signals that we don't support */
 
-   return !!(set[slot] & (1 << index));
+   return !!(set[slot] & (1UL << index));
 }
 
 static bool is_pending_sig(struct task *ti, int signum)
@@ -103,15 +169,128 @@ static int get_first_pending_sig(struct task *ti, enum sig_state sig_state)
    return -1;
 }
 
+static int
+get_first_pending_sig_in_set(struct task *ti, const ulong *set)
+{
+   for (u32 i = 0; i < K_SIGACTION_MASK_WORDS; i++) {
+
+      ulong val = ti->sa_pending[i] & set[i];
+
+      if (val != 0)
+         return (int)(i * NBITS + get_first_set_bit_index_l(val) + 1);
+   }
+
+   return -1;
+}
+
+static int
+enqueue_siginfo(struct task *ti, int signum, const siginfo_t *info)
+{
+   struct sigqueue_entry *e;
+
+   if (signum < K_SIGRTMIN && is_pending_sig(ti, signum))
+      return 0; /* Standard signal already pending: it just coalesces */
+
+   if (ti->sigqueue_len >= SIGQUEUE_MAX_PER_TASK || !(e = sigq_alloc()))
+      return -EAGAIN;
+
+   if (info) {
+
+      e->info = *info;
+
+   } else {
+
+      bzero(&e->info, sizeof(e->info));
+      e->info.si_signo = signum;
+      e->info.si_code = SI_USER;
+      e->info.si_pid = get_curr_pid();
+   }
+
+   list_add_tail(&ti->sigqueue, &e->node);
+   ti->sigqueue_len++;
+   return 0;
+}
+
+/*
+ * Consumes one instance of the pending signal `signum`: see the comment above
+ * `struct sigqueue_entry`. If `info` is not NULL, it gets the siginfo of that
+ * instance (a minimal one, in case the signal had no entry).
+ */
+static void dequeue_sig(struct task *ti, int signum, siginfo_t *info)
+{
+   struct sigqueue_entry *e, *found = NULL;
+   bool more = false;
+
+   list_for_each_ro(e, &ti->sigqueue, node) {
+
+      if (e->info.si_signo != signum)
+         continue;
+
+      if (found) {
+         more = true;
+         break;
+      }
+
+      found = e;
+   }
+
+   if (info) {
+
+      if (found) {
+         *info = found->info;
+      } else {
+         bzero(info, sizeof(*info));
+         info->si_signo = signum;
+         info->si_code = SI_USER;
+      }
+   }
+
+   if (found) {
+      list_remove(&found->node);
+      sigq_free(found);
+      ti->sigqueue_len--;
+   }
+
+   if (!more)
+      del_pending_sig(ti, signum);
+}
+
+int dequeue_signal(void *__ti, const ulong *set, siginfo_t *info)
+{
+   ASSERT(!is_preemption_enabled());
+   struct task *ti = __ti;
+   int sig = get_first_pending_sig_in_set(ti, set);
+
+   if (sig < 0)
+      return 0;
+
+   dequeue_sig(ti, sig, info);
+   return sig;
+}
+
+bool is_any_pending_sig_in_set(void *__ti, const ulong *set)
+{
+   return get_first_pending_sig_in_set(__ti, set) > 0;
+}
+
 void drop_all_pending_signals(void *__curr)
 {
    ASSERT(!is_preemption_enabled());
    struct task *ti = __curr;
+   struct sigqueue_entry *e, *tmp;
 
    for (u32 i = 0; i < K_SIGACTION_MASK_WORDS; i++) {
       ti->sa_pending[i] = 0;
       ti->sa_fault_pending[i] = 0;
    }
+
+   list_for_each(e, tmp, &ti->sigqueue, node) {
+      list_remove(&e->node);
+      sigq_free(e);
+   }
+
+   ti->sigqueue_len = 0;
+   ti->sig_deliverable = false;
 }
 
 void reset_all_custom_signal_handlers(void *__curr)
@@ -160,6 +339,8 @@ bool process_signals(void *__ti, enum sig_state sig_state, void *regs)
       ti->sa_mask[i] &= ~ti->sa_fault_pending[i];
    }
 
+   update_sig_deliverable(ti);
+
    if (is_pending_sig(ti, SIGKILL)) {
 
       /*
@@ -194,7 +375,7 @@ bool process_signals(void *__ti, enum sig_state sig_state, void *regs)
       trace_printk(10, "Setup signal handler %p for TID %d for signal %s[%d]",
                    handler, ti->tid, get_signal_name(sig), sig);
 
-      del_pending_sig(ti, sig);
+      dequeue_sig(ti, sig, NULL);
 
       if (setup_sig_handler(ti, sig_state, regs, (ulong)handler, sig) < 0) {
 
@@ -336,9 +517,11 @@ static const action_type signal_default_actions[_NSIG] =
    [SIGWINCH] = action_terminate,
 };
 
-static void do_send_signal(struct task *ti, int signum, int fl)
+static int
+do_send_signal(struct task *ti, int signum, int fl, const siginfo_t *info)
 {
    ASSERT(IN_RANGE(signum, 0, _NSIG));
+   action_type action_func = NULL;
 
    if (signum == 0) {
 
@@ -350,14 +533,14 @@ static void do_send_signal(struct task *ti, int signum, int fl)
        *    performed; this can be used to check for the existence of a
        *    process ID or process group ID.
        */
-      return;
+      return 0;
    }
 
    if (signum >= _NSIG)
-      return; /* ignore unknown and unsupported signal */
+      return 0; /* ignore unknown and unsupported signal */
 
    if (ti->nested_sig_handlers < 0)
-      return; /* the task is dying, no signals allowed */
+      return 0; /* the task is dying, no signals allowed */
 
    __sighandler_t h = ti->pi->sa_handlers[signum - 1];
 
@@ -373,19 +556,32 @@ static void do_send_signal(struct task *ti, int signum, int fl)
       h = SIG_IGN;
    }
 
+   if (h == SIG_DFL) {
+      action_func =
+         signal_default_actions[signum] != NULL
+            ? signal_default_actions[signum]
+            : action_terminate;
+   }
+
+   if (h != SIG_IGN && (!action_func || action_func == action_terminate)) {
+
+      /* The signal is going to become pending: queue its siginfo, if any */
+      if (info || signum >= K_SIGRTMIN) {
+
+         int rc = enqueue_siginfo(ti, signum, info);
+
+         if (rc && info)
+            return rc; /* sigqueue() must not lose the payload silently */
+      }
+   }
+
    if (h == SIG_IGN) {
 
       action_ignore(ti, signum, fl);
 
-   } else if (h == SIG_DFL) {
+   } else if (action_func) {
 
-      action_type action_func =
-         signal_default_actions[signum] != NULL
-            ? signal_default_actions[signum]
-            : action_terminate;
-
-      if (action_func)
-         action_func(ti, signum, fl);
+      action_func(ti, signum, fl);
 
    } else {
 
@@ -394,9 +590,12 @@ static void do_send_signal(struct task *ti, int signum, int fl)
       if (!is_sig_masked(ti, signum))
          signal_wakeup_task(ti);
    }
+
+   return 0;
 }
 
-int send_signal2(int pid, int tid, int signum, int flags)
+int send_signal_info(int pid, int tid, int signum, int flags,
+                     const siginfo_t *info)
 {
    struct task *ti;
    int rc = -ESRCH;
@@ -404,39 +603,45 @@ int send_signal2(int pid, int tid, int signum, int flags)
    disable_preemption();
 
    if (!(ti = get_task(tid)))
-      goto err_end;
+      goto out;
 
    if (is_kernel_thread(ti))
-      goto err_end; /* cannot send signals to kernel threads */
+      goto out; /* cannot send signals to kernel threads */
 
    /* When `whole_process` is true, tid must be == pid */
    if ((flags & SIG_FL_PROCESS) && ti->pi->pid != tid)
-      goto err_end;
+      goto out;
 
    if (ti->pi->pid != pid)
-      goto err_end;
+      goto out;
+
+   rc = 0;
 
    if (signum == 0)
-      goto end; /* the user app is just checking permissions */
+      goto out; /* the user app is just checking permissions */
 
    if (ti->state == TASK_STATE_ZOMBIE)
-      goto end; /* do nothing */
+      goto out; /* do nothing */
 
    /* TODO: update this code when thread support is added */
-   do_send_signal(ti, signum, flags);
-
-end:
-   rc = 0;
+   rc = do_send_signal(ti, signum, flags, info);
 
-err_end:
+out:
    enable_preemption();
    return rc;
 }
 
+int send_signal2(int pid, int tid, int signum, int flags)
+{
+   return send_signal_info(pid, tid, signum, flags, NULL);
+}
+
 bool pending_signals(void)
 {
    struct task *curr = get_curr_task();
-   STATIC_ASSERT(K_SIGACTION_MASK_WORDS <= 2);
+
+   if (LIKELY(!curr->sig_deliverable))
+      return false; /* Fast path: see update_sig_deliverable() */
 
    if (curr->nested_sig_handlers > 0) {
 
@@ -452,14 +657,7 @@ bool pending_signals(void)
       return false;
    }
 
-   if (K_SIGACTION_MASK_WORDS == 1)
-
-      return (curr->sa_pending[0] & ~curr->sa_mask[0]) != 0;
-
-   else
-
-      return (curr->sa_pending[0] & ~curr->sa_mask[0]) != 0 ||
-             (curr->sa_pending[1] & ~curr->sa_mask[1]) != 0;
+   return true;
 }
 
 /*
@@ -490,6 +688,163 @@ int sys_tgkill(int pid /* linux: tgid */, int tid, int sig)
    return send_signal2(pid, tid, sig, false);
 }
 
+static int
+do_sigqueueinfo(int pid, int tid, int sig, siginfo_t *u_info, int flags)
+{
+   siginfo_t info;
+
+   if (!IN_RANGE(sig, 0, _NSIG) || pid <= 0 || tid <= 0)
+      return -EINVAL;
+
+   if (copy_from_user(&info, u_info, sizeof(info)))
+      return -EFAULT;
+
+   /*
+    * From rt_sigqueueinfo(2):
+    *    The caller can't send a signal pretending to be the kernel (si_code
+    *    >= 0) or tkill() (SI_TKILL) to a process other than itself.
+    */
+   if ((info.si_code >= 0 || info.si_code == SI_TKILL) &&
+       pid != get_curr_pid())
+   {
+      return -EPERM;
+   }
+
+   info.si_signo = sig;
+   return send_signal_info(pid, tid, sig, flags, &info);
+}
+
+int sys_rt_sigqueueinfo(int pid, int sig, siginfo_t *u_info)
+{
+   return do_sigqueueinfo(pid, pid, sig, u_info, SIG_FL_PROCESS);
+}
+
+int sys_rt_tgsigqueueinfo(int pid, int tid, int sig, siginfo_t *u_info)
+{
+   return do_sigqueueinfo(pid, tid, sig, u_info, 0);
+}
+
+/*
+ * Common implementation of rt_sigtimedwait(): `timeout` is NULL when waiting
+ * forever. While sleeping, the waited signals get temporarily unblocked, so
+ * that their arrival wakes us up (see do_send_signal()). Then, they're
+ * dequeued before returning to user space, with the original mask restored:
+ * therefore, they never reach a handler.
+ */
+static int
+do_sigtimedwait(const sigset_t *u_set,
+                siginfo_t *u_info,
+                const struct k_timespec64 *timeout,
+                size_t sigsetsize)
+{
+   struct task *curr = get_curr_task();
+   ulong set[K_SIGACTION_MASK_WORDS];
+   ulong saved_mask[K_SIGACTION_MASK_WORDS];
+   siginfo_t info;
+   u64 ticks = 0;
+   int sig;
+
+   if (sigsetsize != sizeof(set))
+      return -EINVAL;
+
+   if (copy_from_user(set, u_set, sizeof(set)))
+      return -EFAULT;
+
+   __del_sig(set, SIGKILL);
+   __del_sig(set, SIGSTOP);
+
+   if (timeout) {
+
+      if (!IN_RANGE(timeout->tv_nsec, 0, 1000000000))
+         return -EINVAL;
+
+      if (timeout->tv_sec || timeout->tv_nsec)
+         ticks = MAX(timespec_to_ticks(timeout), 1ull);
+   }
+
+   disable_preemption();
+   sig = dequeue_signal(curr, set, &info);
+
+   if (!sig && (!timeout || ticks)) {
+
+      if (timeout)
+         task_set_wakeup_timer(curr, (u32)MIN(ticks, (u64)UINT32_MAX));
+
+      memcpy(saved_mask, curr->sa_mask, sizeof(saved_mask));
+
+      for (u32 i = 0; i < K_SIGACTION_MASK_WORDS; i++)
+         curr->sa_mask[i] &= ~set[i];
+
+      update_sig_deliverable(curr);
+
+      /*
+       * NOTE: check `sig_deliverable` directly, instead of pending_signals(),
+       * because the latter is always false inside signal handlers.
+       */
+      while (!curr->sig_deliverable) {
+
+         if (timeout && !curr->wakeup_deadline)
+            break; /* timeout */
+
+         task_change_state(curr, TASK_STATE_SLEEPING);
+         schedule_preempt_disabled();
+         disable_preemption();
+      }
+
+      memcpy(curr->sa_mask, saved_mask, sizeof(saved_mask));
+      update_sig_deliverable(curr);
+      sig = dequeue_signal(curr, set, &info);
+
+      if (timeout)
+         task_cancel_wakeup_timer(curr);
+   }
+
+   enable_preemption();
+
+   if (!sig)
+      return pending_signals() ? -EINTR : -EAGAIN;
+
+   if (u_info && copy_to_user(u_info, &info, sizeof(info)))
+      return -EFAULT;
+
+   return sig;
+}
+
+int sys_rt_sigtimedwait(const sigset_t *u_set,
+                        siginfo_t *u_info,
+                        const struct k_timespec64 *u_timeout,
+                        size_t sigsetsize)
+{
+   struct k_timespec64 ts;
+
+   if (u_timeout && copy_from_user(&ts, u_timeout, sizeof(ts)))
+      return -EFAULT;
+
+   return do_sigtimedwait(u_set, u_info, u_timeout ? &ts : NULL, sigsetsize);
+}
+
+int sys_rt_sigtimedwait_time32(const sigset_t *u_set,
+                               siginfo_t *u_info,
+                               const struct k_timespec32 *u_timeout,
+                               size_t sigsetsize)
+{
+   struct k_timespec32 ts32;
+   struct k_timespec64 ts;
+
+   if (u_timeout) {
+
+      if (copy_from_user(&ts32, u_timeout, sizeof(ts32)))
+         return -EFAULT;
+
+      ts = (struct k_timespec64) {
+         .tv_sec = ts32.tv_sec,
+         .tv_nsec = ts32.tv_nsec,
+      };
+   }
+
+   return do_sigtimedwait(u_set, u_info, u_timeout ? &ts : NULL, sigsetsize);
+}
+
 static int kill_each_task(void *obj, void *arg)
 {
    struct task *ti = obj;
@@ -718,6 +1073,7 @@ sys_rt_sigprocmask(int how,
 
       __del_sig(ti->sa_mask, SIGSTOP);
       __del_sig(ti->sa_mask, SIGKILL);
+      update_sig_deliverable(ti);
 
    }
 
@@ -795,6 +1151,7 @@ int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
       /* Oops, u_mask pointed to invalid memory in userspace */
       /* Restore the saved mask */
       memcpy(curr->sa_mask, curr->sa_old_mask, sizeof(curr->sa_old_mask));
+      update_sig_deliverable(curr);
       return -EFAULT;
    }
 
@@ -811,6 +1168,7 @@ int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
 
    __del_sig(curr->sa_mask, SIGKILL);
    __del_sig(curr->sa_mask, SIGSTOP);
+   update_sig_deliverable(curr);
 
    /*
     * OK, now go to sleep, behaving like sys_pause(). sys_rt_sigreturn() will
@@ -876,6 +1234,7 @@ ulong sys_rt_sigreturn(void)
          if (curr->in_sigsuspend) {
             memcpy(curr->sa_mask, curr->sa_old_mask, sizeof(curr->sa_mask));
             curr->in_sigsuspend = false;
+            update_sig_deliverable(curr);
          }
 
          restore_regs_from_user_stack(r);
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/signalfd.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+
+#include <sys/signalfd.h>        // system header
+
+/*
+ * A signalfd allows reading the pending signals of the *reading* task (not of
+ * the one that created it) belonging to a given mask, as `signalfd_siginfo`
+ * records, instead of having them delivered to handlers. Typically, those
+ * signals are blocked with sigprocmask(). A single read() drains as many of
+ * them as they fit in the buffer, in the same order rt_sigtimedwait() would
+ * return them (see dequeue_signal()).
+ *
+ * All the signalfd objects share a single condition, signaled every time any
+ * signal becomes pending for any task: that's simple and cheap, as the only
+ * cost for a spurious wake-up is a check of the pending signals.
+ */
+
+struct signalfd {
+
+   KOBJ_BASE_FIELDS
+
+   ulong mask[K_SIGACTION_MASK_WORDS];
+};
+
+static struct kcond signalfd_cond = STATIC_KCOND_INIT(signalfd_cond);
+
+void signalfd_notify(void)
+{
+   kcond_signal_all(&signalfd_cond);
+}
+
+static void
+signalfd_fill_siginfo(struct signalfd_siginfo *out, const siginfo_t *info)
+{
+   bzero(out, sizeof(*out));
+   out->ssi_signo = (u32)info->si_signo;
+   out->ssi_errno = info->si_errno;
+   out->ssi_code = info->si_code;
+   out->ssi_pid = (u32)info->si_pid;
+   out->ssi_uid = (u32)info->si_uid;
+   out->ssi_int = info->si_value.sival_int;
+   out->ssi_ptr = (u64)(ulong)info->si_value.sival_ptr;
+}
+
+static ssize_t signalfd_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   struct signalfd *sfd = (void *)kh->kobj;
+   struct signalfd_siginfo *out = (void *)buf;
+   const size_t max = size / sizeof(*out);
+   struct task *curr = get_curr_task();
+   siginfo_t info;
+   size_t n = 0;
+
+   if (!max)
+      return -EINVAL;
+
+   while (true) {
+
+      disable_preemption();
+
+      while (n < max && dequeue_signal(curr, sfd->mask, &info))
+         signalfd_fill_siginfo(&out[n++], &info);
+
+      if (n) {
+         enable_preemption();
+         break;
+      }
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         enable_preemption();
+         return -EAGAIN;
+      }
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &signalfd_cond,
+                         NO_EXTRA,
+                         &signalfd_cond.wait_list);
+
+      enter_sleep_wait_state();
+
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   return (ssize_t)(n * sizeof(*out));
+}
+
+static int signalfd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct signalfd *sfd = (void *)kh->kobj;
+   bool ret;
+
+   disable_preemption();
+   {
+      ret = is_any_pending_sig_in_set(get_curr_task(), sfd->mask);
+   }
+   enable_preemption();
+   return ret;
+}
+
+static struct kcond *signalfd_get_rready_cond(fs_handle h)
+{
+   return &signalfd_cond;
+}
+
+static const struct file_ops static_ops_signalfd =
+{
+   .read = signalfd_read,
+   .read_ready = signalfd_read_ready,
+   .get_rready_cond = signalfd_get_rready_cond,
+};
+
+bool is_signalfd_handle(fs_handle h)
+{
+   return ((struct fs_handle_base *)h)->fops == &static_ops_signalfd;
+}
+
+void signalfd_set_mask(fs_handle h, const ulong *mask)
+{
+   struct kfs_handle *kh = h;
+   struct signalfd *sfd = (void *)kh->kobj;
+
+   ASSERT(is_signalfd_handle(h));
+   memcpy(sfd->mask, mask, sizeof(sfd->mask));
+
+   /* The readers might be interested in the already pending signals */
+   kcond_signal_all(&signalfd_cond);
+}
+
+void destroy_signalfd(struct signalfd *sfd)
+{
+   kfree_obj(sfd, struct signalfd);
+}
+
+struct signalfd *create_signalfd(const ulong *mask)
+{
+   struct signalfd *sfd;
+
+   if (!(sfd = (void *)kzalloc_obj(struct signalfd)))
+      return NULL;
+
+   sfd->destory_obj = (void *)&destroy_signalfd;
+   memcpy(sfd->mask, mask, sizeof(sfd->mask));
+   return sfd;
+}
+
+fs_handle signalfd_create_handle(struct signalfd *sfd, int flags)
+{
+   return kfs_create_new_handle(&static_ops_signalfd,
+                                (void *)sfd,
+                                O_RDONLY | (flags & SFD_NONBLOCK));
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/smp.h>
+
+struct percpu percpu_areas[MAX_CPUS] = {
+   [0] = { .cpu = 0, .online = true },
+};
+
+u32 cpus_online = 1;
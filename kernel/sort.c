@@ -51,6 +51,225 @@ insertion_sort_generic(void *a, ulong elem_size, u32 elem_count, cmpfun_ptr cmp)
    }
 }
 
+/*
+ * Introsort: quicksort with the median-of-three pivot, falling back to heapsort
+ * when the recursion gets too deep, so that the worst case is O(N log N). The
+ * small partitions are left unsorted and fixed at the end by a single pass of
+ * insertion sort. No memory is allocated and the recursion happens only on the
+ * smaller partition, so the stack usage is O(log N).
+ */
+
+#define INTRO_SORT_CUTOFF                         16
+
+#define ELEM(i)                    (a + (ulong)(i) * sz)
+
+static void
+sort_swap(char *x, char *y, ulong sz)
+{
+   char tmp;
+
+   if (!(((ulong)x | (ulong)y | sz) & (sizeof(ulong) - 1))) {
+
+      ulong *p = (ulong *)x, *q = (ulong *)y, t;
+
+      for (ulong i = 0; i < sz / sizeof(ulong); i++) {
+         t = p[i];
+         p[i] = q[i];
+         q[i] = t;
+      }
+
+      return;
+   }
+
+   for (ulong i = 0; i < sz; i++) {
+      tmp = x[i];
+      x[i] = y[i];
+      y[i] = tmp;
+   }
+}
+
+static void
+heap_sift_down(char *a, ulong sz, u32 root, u32 n, cmpfun_ptr cmp)
+{
+   u32 child;
+
+   while ((child = 2 * root + 1) < n) {
+
+      if (child + 1 < n && cmp(ELEM(child), ELEM(child + 1)) < 0)
+         child++;
+
+      if (cmp(ELEM(root), ELEM(child)) >= 0)
+         break;
+
+      sort_swap(ELEM(root), ELEM(child), sz);
+      root = child;
+   }
+}
+
+static void
+heap_sort(char *a, ulong sz, u32 n, cmpfun_ptr cmp)
+{
+   for (u32 i = n / 2; i > 0; i--)
+      heap_sift_down(a, sz, i - 1, n, cmp);
+
+   for (u32 end = n - 1; end > 0; end--) {
+      sort_swap(ELEM(0), ELEM(end), sz);
+      heap_sift_down(a, sz, 0, end, cmp);
+   }
+}
+
+/* Moves the median of the first, middle and last elements to a[0] */
+static void
+median_of_three_to_front(char *a, ulong sz, u32 n, cmpfun_ptr cmp)
+{
+   char *lo = ELEM(0), *mid = ELEM(n / 2), *hi = ELEM(n - 1);
+
+   if (cmp(mid, lo) < 0)
+      sort_swap(mid, lo, sz);
+
+   if (cmp(hi, mid) < 0) {
+
+      sort_swap(hi, mid, sz);
+
+      if (cmp(mid, lo) < 0)
+         sort_swap(mid, lo, sz);
+   }
+
+   /* Now lo <= mid <= hi */
+   sort_swap(lo, mid, sz);
+}
+
+static void
+intro_sort_rec(char *a, ulong sz, u32 n, cmpfun_ptr cmp, int depth)
+{
+   u32 i, j;
+
+   while (n > INTRO_SORT_CUTOFF) {
+
+      if (!depth--) {
+         heap_sort(a, sz, n, cmp);
+         return;
+      }
+
+      median_of_three_to_front(a, sz, n, cmp);
+
+      /* Hoare partition around the pivot in a[0] */
+      i = 0;
+      j = n;
+
+      while (true) {
+
+         do { i++; } while (i < n && cmp(ELEM(i), ELEM(0)) < 0);
+         do { j--; } while (cmp(ELEM(j), ELEM(0)) > 0);
+
+         if (i >= j)
+            break;
+
+         sort_swap(ELEM(i), ELEM(j), sz);
+      }
+
+      sort_swap(ELEM(0), ELEM(j), sz);
+
+      /* Now a[0, j) <= a[j] <= a(j, n): recurse on the smaller side */
+      if (j < n - j - 1) {
+         intro_sort_rec(a, sz, j, cmp, depth);
+         a = ELEM(j + 1);
+         n = n - j - 1;
+      } else {
+         intro_sort_rec(ELEM(j + 1), sz, n - j - 1, cmp, depth);
+         n = j;
+      }
+   }
+}
+
+void
+intro_sort_generic(void *a, ulong elem_size, u32 elem_count, cmpfun_ptr cmp)
+{
+   int depth = 0;
+
+   for (u32 n = elem_count; n > 1; n >>= 1)
+      depth += 2;
+
+   intro_sort_rec(a, elem_size, elem_count, cmp, depth);
+   insertion_sort_generic(a, elem_size, elem_count, cmp);
+}
+
+void
+intro_sort_ptr(void *a, u32 elem_count, cmpfun_ptr cmp)
+{
+   int depth = 0;
+
+   for (u32 n = elem_count; n > 1; n >>= 1)
+      depth += 2;
+
+   intro_sort_rec(a, sizeof(ulong), elem_count, cmp, depth);
+   insertion_sort_ptr(a, elem_count, cmp);
+}
+
+/*
+ * Stable LSD radix sort, one byte of the key per pass. The passes over the
+ * bytes that are the same for all the keys are skipped. The caller provides
+ * `tmp`, a scratch buffer as big as the array.
+ */
+void
+radix_sort_generic(void *arr,
+                   void *tmp,
+                   ulong sz,
+                   u32 elem_count,
+                   sortkey_ptr key)
+{
+   u32 cnt[256];
+   char *a = arr, *dst = tmp, *t;
+   ulong k, all_or = 0, all_and = (ulong)-1, diff;
+   u32 c;
+
+   for (u32 i = 0; i < elem_count; i++) {
+      k = key(ELEM(i));
+      all_or |= k;
+      all_and &= k;
+   }
+
+   /* The bits set in some keys, but not in all of them */
+   diff = all_or & ~all_and;
+
+   for (u32 shift = 0; shift < 8 * sizeof(ulong); shift += 8) {
+
+      if (!((diff >> shift) & 0xff))
+         continue;   /* all the keys have the same byte here */
+
+      bzero(cnt, sizeof(cnt));
+
+      for (u32 i = 0; i < elem_count; i++)
+         cnt[(key(ELEM(i)) >> shift) & 0xff]++;
+
+      for (u32 d = 0, sum = 0; d < 256; d++) {
+         c = cnt[d];
+         cnt[d] = sum;
+         sum += c;
+      }
+
+      for (u32 i = 0; i < elem_count; i++) {
+         k = (key(ELEM(i)) >> shift) & 0xff;
+         memcpy(dst + (ulong)cnt[k]++ * sz, ELEM(i), sz);
+      }
+
+      t = a;
+      a = dst;
+      dst = t;
+   }
+
+   if (a != arr)
+      memcpy(arr, a, (ulong)elem_count * sz);
+}
+
+void
+radix_sort_ptr(void *a, void *tmp, u32 elem_count, sortkey_ptr key)
+{
+   radix_sort_generic(a, tmp, sizeof(ulong), elem_count, key);
+}
+
+#undef ELEM
+
 /* Reverse an array of pointer-sized elements */
 
 void
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/static_key.h>
+#include <tilck/kernel/hal.h>
+
+#ifdef ARCH_HAS_STATIC_KEYS
+
+static void
+static_key_patch(const struct static_key_entry *e, bool enabled)
+{
+   static const u8 nop5[STATIC_KEY_INSN_SIZE] = { STATIC_KEY_NOP5 };
+   u8 insn[STATIC_KEY_INSN_SIZE];
+   s32 rel;
+
+   if (!enabled) {
+      memcpy(TO_PTR(e->code), nop5, sizeof(nop5));
+      return;
+   }
+
+   rel = (s32)(e->target - (e->code + STATIC_KEY_INSN_SIZE));
+   insn[0] = STATIC_KEY_JMP_REL32;
+   memcpy(&insn[1], &rel, sizeof(rel));
+   memcpy(TO_PTR(e->code), insn, sizeof(insn));
+}
+
+#else
+
+static void
+static_key_patch(const struct static_key_entry *e, bool enabled)
+{
+   /* No sites to patch: static_branch_unlikely() reads key->enabled */
+}
+
+#endif
+
+void static_key_set(struct static_key *key, bool enabled)
+{
+   const struct static_key_entry *e;
+   ulong var;
+
+   /*
+    * The kernel's text is mapped as RW and Tilck runs on a single CPU: with
+    * the interrupts disabled, nothing can execute the sites while we're
+    * patching them.
+    */
+   disable_interrupts(&var);
+   {
+      if (key->enabled != enabled) {
+
+         for (e = static_keys; e < static_keys_end; e++)
+            if (e->key == (ulong)key)
+               static_key_patch(e, enabled);
+
+         key->enabled = enabled;
+      }
+   }
+   enable_interrupts(&var);
+}
@@ -90,7 +90,10 @@ void restore_regs_from_user_stack(regs_t *r)
    r->cs = X86_USER_CODE_SEL;
    r->eflags |= EFLAGS_IF;
 #elif defined(__x86_64__)
-   NOT_IMPLEMENTED();
+   r->cs = X86_USER_CODE_SEL;
+   r->ss = X86_USER_DATA_SEL;
+   r->rflags |= EFLAGS_IF;
+   r->custom_flags &= ~(u64)REGS_FL_SYSCALL; /* SYSRET can't restore RCX, R11 */
 #elif defined(__riscv)
    r->sstatus |= SR_SPIE;
 #elif defined(KERNEL_TEST)
@@ -214,10 +217,8 @@ set_current_task_in_user_mode(void)
    curr->running_in_kernel &= ~((u32)IN_SYSCALL_FLAG);
    task_info_reset_kernel_stack(curr);
 
-#if defined(__i386__)
-   set_kernel_stack((u32)curr->state_regs);
-#elif defined(__x86_64__)
-   NOT_IMPLEMENTED();
+#if defined(__i386__) || defined(__x86_64__)
+   set_kernel_stack((ulong)curr->state_regs);
 #endif
 }
 
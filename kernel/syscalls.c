@@ -29,12 +29,6 @@
 #define LINUX_REBOOT_CMD_HALT       0xcdef0123
 #define LINUX_REBOOT_CMD_POWER_OFF  0x4321fedc
 
-int sys_madvise(void *addr, size_t len, int advice)
-{
-   // TODO (future): consider implementing at least part of sys_madvice().
-   return 0;
-}
-
 int
 do_nanosleep(const struct k_timespec64 *req, struct k_timespec64 *rem)
 {
@@ -149,26 +143,29 @@ NORETURN int sys_exit_group(int status)
    sys_exit(status);
 }
 
+static clock_t cputime_to_clock_t(const struct k_timespec64 *tp)
+{
+   const u64 us = (u64)tp->tv_sec * 1000000 + (u64)tp->tv_nsec / 1000;
+   return (clock_t)(us * TIMER_HZ / 1000000);
+}
+
 ulong sys_times(struct tms *user_buf)
 {
    struct task *curr = get_curr_task();
+   struct k_timespec64 utime, stime;
    struct tms buf;
 
    // TODO (threads): when threads are supported, update sys_times()
    // TODO: consider supporting tms_cutime and tms_cstime in sys_times()
 
-   disable_preemption();
-   {
-
-      buf = (struct tms) {
-         .tms_utime = (clock_t) curr->ticks.total,
-         .tms_stime = (clock_t) curr->ticks.total_kernel,
-         .tms_cutime = 0,
-         .tms_cstime = 0,
-      };
+   task_get_cputime(curr, &utime, &stime);
 
-   }
-   enable_preemption();
+   buf = (struct tms) {
+      .tms_utime = cputime_to_clock_t(&utime),
+      .tms_stime = cputime_to_clock_t(&stime),
+      .tms_cutime = 0,
+      .tms_cstime = 0,
+   };
 
    if (copy_to_user(user_buf, &buf, sizeof(buf)) != 0)
       return (ulong) -EBADF;
@@ -180,8 +177,6 @@ int sys_getrusage(int who, struct k_rusage *user_buf)
 {
    struct task *curr = get_curr_task();
    struct k_rusage buf;
-   u64 utime_ticks;
-   u64 stime_ticks;
    struct k_timespec64 utime;
    struct k_timespec64 stime;
 
@@ -205,15 +200,7 @@ int sys_getrusage(int who, struct k_rusage *user_buf)
     * Since there can only be one thread per process,
     * RUSAGE_SELF and RUSAGE_THREAD have the same meaning.
     */
-   disable_interrupts_forced();
-   {
-      stime_ticks = curr->ticks.total_kernel;
-      utime_ticks = curr->ticks.total - curr->ticks.total_kernel;
-   }
-   enable_interrupts_forced();
-
-   ticks_to_timespec(utime_ticks, &utime);
-   ticks_to_timespec(stime_ticks, &stime);
+   task_get_cputime(curr, &utime, &stime);
 
    buf = (struct k_rusage) {
 
@@ -233,8 +220,8 @@ int sys_getrusage(int who, struct k_rusage *user_buf)
       .ru_msgsnd = 0,
       .ru_msgrcv = 0,
       .ru_nsignals = 0,
-      .ru_nvcsw  = 0,
-      .ru_nivcsw = 0,
+      .ru_nvcsw  = (long)curr->sched_stats.nvcsw,
+      .ru_nivcsw = (long)curr->sched_stats.nivcsw,
    };
 
    if (copy_to_user(user_buf, &buf, sizeof(buf)))
@@ -342,10 +329,236 @@ int sys_reboot(u32 magic, u32 magic2, u32 cmd, void *arg)
 
 int sys_sched_yield(void)
 {
+   struct task *curr = get_curr_task();
+
+   /* RT tasks are moved after the other tasks with the same priority */
+   if (curr->eff_rt_prio)
+      curr->rt_yield = true;
+
    kernel_yield();
    return 0;
 }
 
+struct prio_iter_ctx {
+
+   int which;
+   int who;
+   int nice;            /* the new nice value, for setpriority() */
+   int min_nice;        /* the highest priority found, for getpriority() */
+   bool set;
+   bool found;
+};
+
+static int prio_per_task_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct prio_iter_ctx *ctx = arg;
+   bool match;
+
+   if (is_kernel_thread(ti) || ti->state == TASK_STATE_ZOMBIE)
+      return 0;
+
+   switch (ctx->which) {
+
+      case PRIO_PROCESS:
+         match = ti->tid == ctx->who;
+         break;
+
+      case PRIO_PGRP:
+         match = ti->pi->pgid == ctx->who;
+         break;
+
+      case PRIO_USER:
+         match = ctx->who == 0; /* only the root user exists */
+         break;
+
+      default:
+         NOT_REACHED();
+   }
+
+   if (!match)
+      return 0;
+
+   if (ctx->set)
+      sched_set_nice(ti, ctx->nice);
+
+   ctx->min_nice = ctx->found ? MIN(ctx->min_nice, ti->nice) : ti->nice;
+   ctx->found = true;
+   return 0;
+}
+
+static int
+prio_iterate_tasks(struct prio_iter_ctx *ctx)
+{
+   struct task *curr = get_curr_task();
+
+   if (ctx->which != PRIO_PROCESS &&
+       ctx->which != PRIO_PGRP &&
+       ctx->which != PRIO_USER)
+   {
+      return -EINVAL;
+   }
+
+   if (!ctx->who) {
+      if (ctx->which == PRIO_PROCESS)
+         ctx->who = curr->tid;
+      else if (ctx->which == PRIO_PGRP)
+         ctx->who = curr->pi->pgid;
+   }
+
+   disable_preemption();
+   {
+      iterate_over_tasks(prio_per_task_cb, ctx);
+   }
+   enable_preemption();
+   return ctx->found ? 0 : -ESRCH;
+}
+
+/*
+ * Like the raw Linux syscall, return 20 - nice, in order to avoid negative
+ * values: it's up to libc to convert it back to a nice value.
+ */
+int sys_getpriority(int which, int who)
+{
+   struct prio_iter_ctx ctx = { .which = which, .who = who };
+   int rc;
+
+   if ((rc = prio_iterate_tasks(&ctx)))
+      return rc;
+
+   return 20 - ctx.min_nice;
+}
+
+int sys_setpriority(int which, int who, int prio)
+{
+   struct prio_iter_ctx ctx = {
+      .which = which,
+      .who = who,
+      .nice = CLAMP(prio, MIN_NICE, MAX_NICE),
+      .set = true,
+   };
+
+   return prio_iterate_tasks(&ctx);
+}
+
+int sys_nice(int inc)
+{
+   struct task *curr = get_curr_task();
+   inc = CLAMP(inc, -40, 40);
+   sched_set_nice(curr, curr->nice + inc);
+   return 0;
+}
+
+STATIC_ASSERT(SCHED_NORMAL == sched_policy_normal);
+STATIC_ASSERT(SCHED_FIFO == sched_policy_fifo);
+STATIC_ASSERT(SCHED_RR == sched_policy_rr);
+
+static int sched_check_policy(u32 policy, u32 prio)
+{
+   switch (policy) {
+
+      case SCHED_NORMAL:
+      case SCHED_BATCH:
+         return prio == 0 ? 0 : -EINVAL;
+
+      case SCHED_FIFO:
+      case SCHED_RR:
+         return 0 < prio && prio < MAX_RT_PRIO ? 0 : -EINVAL;
+
+      default:
+         return -EINVAL;
+   }
+}
+
+/* SCHED_BATCH is accepted as well, but treated like SCHED_NORMAL */
+static enum sched_policy to_sched_policy(u32 policy)
+{
+   return policy == SCHED_BATCH
+      ? sched_policy_normal
+      : (enum sched_policy)policy;
+}
+
+static struct task *sched_attr_get_task(int pid)
+{
+   struct task *ti;
+
+   if (!pid)
+      return get_curr_task();
+
+   ti = get_task(pid);
+   return ti && !is_kernel_thread(ti) ? ti : NULL;
+}
+
+int sys_sched_setattr(int pid, struct k_sched_attr *u_attr, u32 flags)
+{
+   struct k_sched_attr attr;
+   struct task *ti;
+   int rc = 0;
+
+   if (pid < 0 || flags)
+      return -EINVAL;
+
+   if (copy_from_user(&attr, u_attr, sizeof(attr)))
+      return -EFAULT;
+
+   if (attr.size && attr.size < K_SCHED_ATTR_SIZE_VER0)
+      return -E2BIG;
+
+   if ((rc = sched_check_policy(attr.sched_policy, attr.sched_priority)))
+      return rc;
+
+   if (attr.sched_flags)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      if ((ti = sched_attr_get_task(pid))) {
+
+         sched_set_policy(ti,
+                          to_sched_policy(attr.sched_policy),
+                          (int)attr.sched_priority);
+
+         sched_set_nice(ti, attr.sched_nice);
+
+      } else {
+
+         rc = -ESRCH;
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+int sys_sched_getattr(int pid, struct k_sched_attr *u_attr,
+                      u32 size, u32 flags)
+{
+   struct k_sched_attr attr = {
+      .size = sizeof(attr),
+   };
+   struct task *ti;
+
+   if (pid < 0 || flags || size < K_SCHED_ATTR_SIZE_VER0)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      if ((ti = sched_attr_get_task(pid))) {
+         attr.sched_policy = ti->policy;
+         attr.sched_priority = ti->rt_prio;
+         attr.sched_nice = ti->nice;
+      }
+   }
+   enable_preemption();
+
+   if (!ti)
+      return -ESRCH;
+
+   if (copy_to_user(u_attr, &attr, sizeof(attr)))
+      return -EFAULT;
+
+   return 0;
+}
+
 int sys_utimes(const char *u_path, const struct k_timeval u_times[2])
 {
    struct k_timeval ts[2];
@@ -462,3 +675,105 @@ int sys_socketcall(int call, ulong *args)
    return -ENOSYS;
 }
 
+
+static int
+sched_do_setscheduler(int pid, bool keep_policy, u32 policy,
+                      const struct k_sched_param *u_param)
+{
+   struct k_sched_param param;
+   struct task *ti;
+   int rc = 0;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   if (copy_from_user(&param, u_param, sizeof(param)))
+      return -EFAULT;
+
+   disable_preemption();
+   {
+      if (!(ti = sched_attr_get_task(pid))) {
+         rc = -ESRCH;
+         goto out;
+      }
+
+      if (keep_policy)
+         policy = ti->policy;
+
+      if ((rc = sched_check_policy(policy, (u32)param.sched_priority)))
+         goto out;
+
+      sched_set_policy(ti, to_sched_policy(policy), param.sched_priority);
+   }
+out:
+   enable_preemption();
+   return rc;
+}
+
+int sys_sched_setscheduler(int pid, int policy,
+                           const struct k_sched_param *u_param)
+{
+   return sched_do_setscheduler(pid, false, (u32)policy, u_param);
+}
+
+int sys_sched_setparam(int pid, const struct k_sched_param *u_param)
+{
+   return sched_do_setscheduler(pid, true, 0, u_param);
+}
+
+int sys_sched_getscheduler(int pid)
+{
+   struct task *ti;
+   int rc;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      ti = sched_attr_get_task(pid);
+      rc = ti ? ti->policy : -ESRCH;
+   }
+   enable_preemption();
+   return rc;
+}
+
+int sys_sched_getparam(int pid, struct k_sched_param *u_param)
+{
+   struct k_sched_param param = {0};
+   struct task *ti;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      if ((ti = sched_attr_get_task(pid)))
+         param.sched_priority = ti->rt_prio;
+   }
+   enable_preemption();
+
+   if (!ti)
+      return -ESRCH;
+
+   if (copy_to_user(u_param, &param, sizeof(param)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_sched_get_priority_max(int policy)
+{
+   if (policy == SCHED_FIFO || policy == SCHED_RR)
+      return MAX_RT_PRIO - 1;
+
+   return sched_check_policy((u32)policy, 0);
+}
+
+int sys_sched_get_priority_min(int policy)
+{
+   if (policy == SCHED_FIFO || policy == SCHED_RR)
+      return 1;
+
+   return sched_check_policy((u32)policy, 0);
+}
@@ -4,18 +4,21 @@
 #include <tilck/common/basic_defs.h>
 
 #include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/process.h>
 #include <tilck/kernel/self_tests.h>
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/gcov.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/modules.h>
 
 typedef int (*tilck_cmd_func)();
 static int tilck_sys_run_selftest(const char *user_selftest);
 static int tilck_call_fn_0(const char *fn_name);
 static int tilck_get_var_long(const char *var_name, long *buf);
 static int tilck_busy_wait(ulong n);
+static int tilck_sys_load_module(const char *user_name);
 
 static void *tilck_cmds[TILCK_CMD_COUNT] = {
 
@@ -32,6 +35,8 @@ static void *tilck_cmds[TILCK_CMD_COUNT] = {
    [TILCK_CMD_CALL_FUNC_0] = NULL,
    [TILCK_CMD_GET_VAR_LONG] = NULL,
    [TILCK_CMD_BUSY_WAIT] = NULL,
+   [TILCK_CMD_SPAWN] = tilck_sys_spawn,
+   [TILCK_CMD_LOAD_MODULE] = tilck_sys_load_module,
 };
 
 void register_tilck_cmd(int cmd_n, void *func)
@@ -65,6 +70,17 @@ static int tilck_sys_run_selftest(const char *u_selftest)
    return se_run(se);
 }
 
+static int tilck_sys_load_module(const char *u_name)
+{
+   char buf[MODULE_NAME_MAX_LEN + 1];
+   int rc;
+
+   if ((rc = copy_str_from_user(buf, u_name, sizeof(buf), NULL)))
+      return rc > 0 ? -ENAMETOOLONG : -EFAULT;
+
+   return load_module(buf);
+}
+
 int sys_tilck_cmd(int cmd_n, ulong a1, ulong a2, ulong a3, ulong a4)
 {
    tilck_cmd_func func;
@@ -13,6 +13,13 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/vdso.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/idle.h>
+
+#include <tilck/mods/tracing.h>
 
 FASTCALL void asm_nop_loop(u32 iters);
 
@@ -31,12 +38,23 @@ u32 slow_timer_irq_handler_count;
 /* Temporary global used by asm_do_bogomips_loop() */
 volatile ATOMIC(u32) __bogo_loops;
 
+/* Tickless idle */
+bool __in_tickless_idle;
+u64 tickless_skipped_ticks;  /* total ticks skipped, for debugging purposes */
+static u32 tickless_carry_ns;
+
 /* Static variables */
-static struct list timer_wakeup_list = STATIC_LIST_INIT(timer_wakeup_list);
+static struct bintree_cached ktimers;
+static struct list fired_ktimers = STATIC_LIST_INIT(fired_ktimers);
+static bool fired_ktimers_job_enqueued;
 static u32 loops_per_tick;         /* Tilck bogoMips as loops/tick    */
 static u32 loops_per_ms = 5000000; /* loops/millisecond (initial val)  */
 static u32 loops_per_us = 5000;    /* loops/microsecond (initial val) */
 
+/* Stable TSC (rdtime on riscv), used instead of the bogoMips when available */
+static u64 tsc_hz;                 /* 0 = not calibrated (yet) */
+static u64 tsc_last_tick;          /* TSC when __time_ns was last updated */
+
 u64 get_ticks(void)
 {
    u64 curr_ticks;
@@ -50,6 +68,110 @@ u64 get_ticks(void)
    return curr_ticks;
 }
 
+/*
+ * Wakeup timers: hierarchical timing wheel
+ * -------------------------------------------
+ *
+ * Each level has TW_SLOTS slots, each one a list of tasks. Level 0 has one
+ * slot per tick and contains the timers expiring in the next TW_SLOTS ticks;
+ * each slot of the level N covers TW_SLOTS times the ticks of a slot of the
+ * level N-1. Every TW_SLOTS ticks, the next slot of the level 1 is cascaded:
+ * its timers are moved to the level 0 and so on, for the higher levels.
+ *
+ * That way, setting, updating or cancelling a timer is O(1) and, at each
+ * tick, the only work is running the timers in the current level 0 slot,
+ * plus an occasional cascade. The deadlines beyond the last level are kept
+ * in its farthest slot and get re-inserted at every cascade, until they fit.
+ */
+
+#define TW_BITS                       6
+#define TW_SLOTS                      (1u << TW_BITS)
+#define TW_MASK                       (TW_SLOTS - 1)
+#define TW_LEVELS                     5
+#define TW_MAX_DELTA                  ((1ull << (TW_BITS * TW_LEVELS)) - 1)
+
+static struct list timer_wheel[TW_LEVELS][TW_SLOTS];
+static u64 wheel_ticks;            /* next tick to process */
+static u32 wheel_timers_count;
+
+static void wakeup_timers_insert(struct task *ti)
+{
+   u64 expires = MAX(ti->wakeup_deadline, wheel_ticks);
+   u64 delta = expires - wheel_ticks;
+   int lvl = 0;
+
+   if (delta > TW_MAX_DELTA) {
+      delta = TW_MAX_DELTA;
+      expires = wheel_ticks + delta;
+   }
+
+   while (delta >= (1ull << (TW_BITS * (lvl + 1))))
+      lvl++;
+
+   list_add_tail(&timer_wheel[lvl][(expires >> (TW_BITS * lvl)) & TW_MASK],
+                 &ti->wakeup_timer_node);
+
+   wheel_timers_count++;
+}
+
+static void wakeup_timers_remove(struct task *ti)
+{
+   ASSERT(wheel_timers_count > 0);
+   list_remove(&ti->wakeup_timer_node);
+   list_node_init(&ti->wakeup_timer_node);
+   wheel_timers_count--;
+}
+
+/* Re-inserts all the timers in the given slot: they'll go to lower levels */
+static u32 wheel_cascade(int lvl)
+{
+   const u32 idx = (wheel_ticks >> (TW_BITS * lvl)) & TW_MASK;
+   struct list *slot = &timer_wheel[lvl][idx];
+   struct task *ti;
+
+   while (!list_is_empty(slot)) {
+      ti = list_first_obj(slot, struct task, wakeup_timer_node);
+      wakeup_timers_remove(ti);
+      wakeup_timers_insert(ti);
+   }
+
+   return idx;
+}
+
+/*
+ * Returns the first tick at which the wheel has to be processed, because a
+ * timer in the level 0 expires or because a cascade is due, whichever comes
+ * first. Returns 0 when there are no timers at all.
+ */
+static u64 wheel_next_event(void)
+{
+   u64 next = wheel_ticks;
+
+   if (!wheel_timers_count)
+      return 0;
+
+   if (!(next & TW_MASK))
+      return next;      /* a cascade is due right now */
+
+   do {
+
+      if (!list_is_empty(&timer_wheel[0][next & TW_MASK]))
+         break;
+
+   } while (++next & TW_MASK);
+
+   return next;
+}
+
+static void init_timer_wheel(void)
+{
+   for (int lvl = 0; lvl < TW_LEVELS; lvl++)
+      for (u32 i = 0; i < TW_SLOTS; i++)
+         list_init(&timer_wheel[lvl][i]);
+
+   wheel_ticks = __ticks + 1;
+}
+
 void task_set_wakeup_timer(struct task *ti, u32 ticks)
 {
    ulong var;
@@ -57,14 +179,11 @@ void task_set_wakeup_timer(struct task *ti, u32 ticks)
 
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up == 0) {
-         ASSERT(!list_is_node_in_list(&ti->wakeup_timer_node));
-         list_add_tail(&timer_wakeup_list, &ti->wakeup_timer_node);
-      } else {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-      }
+      if (ti->wakeup_deadline)
+         wakeup_timers_remove(ti);
 
-      ti->ticks_before_wake_up = ticks;
+      ti->wakeup_deadline = __ticks + ticks;
+      wakeup_timers_insert(ti);
    }
    enable_interrupts(&var);
 }
@@ -76,9 +195,10 @@ void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks)
 
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up > 0) {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-         ti->ticks_before_wake_up = new_ticks;
+      if (ti->wakeup_deadline) {
+         wakeup_timers_remove(ti);
+         ti->wakeup_deadline = __ticks + new_ticks;
+         wakeup_timers_insert(ti);
       }
    }
    enable_interrupts(&var);
@@ -87,79 +207,209 @@ void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks)
 u32 task_cancel_wakeup_timer(struct task *ti)
 {
    ulong var;
-   u32 old;
+   u32 old = 0;
    disable_interrupts(&var);
    {
-      old = ti->ticks_before_wake_up;
+      if (ti->wakeup_deadline) {
 
-      if (old > 0) {
+         /* Expired timers are removed right away in wake_up_expired_tasks() */
+         ASSERT(ti->wakeup_deadline > __ticks);
+         old = (u32)MIN(ti->wakeup_deadline - __ticks, (u64)UINT32_MAX);
+
+         wakeup_timers_remove(ti);
          ti->timer_ready = false;
-         ti->ticks_before_wake_up = 0;
-         list_remove(&ti->wakeup_timer_node);
+         ti->wakeup_deadline = 0;
       }
    }
    enable_interrupts(&var);
    return old;
 }
 
-static void tick_all_timers(void)
+static long ktimer_cmp(const void *a, const void *b)
+{
+   const struct ktimer *t1 = a;
+   const struct ktimer *t2 = b;
+
+   if (t1->deadline != t2->deadline)
+      return t1->deadline < t2->deadline ? -1 : 1;
+
+   /* Same deadline: use the address, in order to keep the keys unique */
+   if (t1 != t2)
+      return t1 < t2 ? -1 : 1;
+
+   return 0;
+}
+
+static void ktimers_insert(struct ktimer *t)
+{
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_cached_insert(&ktimers, t, &ktimer_cmp, struct ktimer, node);
+
+   ASSERT(success);
+}
+
+static void ktimers_remove(struct ktimer *t)
+{
+   DEBUG_ONLY_UNSAFE(void *removed =)
+      bintree_cached_remove(&ktimers, t, &ktimer_cmp, struct ktimer, node);
+
+   ASSERT(removed == t);
+}
+
+void ktimer_init(struct ktimer *t, void (*func)(struct ktimer *))
+{
+   bintree_node_init(&t->node);
+   list_node_init(&t->fired_node);
+   t->deadline = 0;
+   t->func = func;
+}
+
+void ktimer_arm(struct ktimer *t, u64 deadline)
+{
+   ulong var;
+   ASSERT(deadline > 0);
+
+   disable_interrupts(&var);
+   {
+      if (t->deadline)
+         ktimers_remove(t);
+
+      if (!list_node_is_empty(&t->fired_node)) {
+         list_remove(&t->fired_node);
+         list_node_init(&t->fired_node);
+      }
+
+      t->deadline = deadline;
+      ktimers_insert(t);
+   }
+   enable_interrupts(&var);
+}
+
+void ktimer_cancel(struct ktimer *t)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      if (t->deadline) {
+         ktimers_remove(t);
+         t->deadline = 0;
+      }
+
+      if (!list_node_is_empty(&t->fired_node)) {
+         list_remove(&t->fired_node);
+         list_node_init(&t->fired_node);
+      }
+   }
+   enable_interrupts(&var);
+}
+
+/*
+ * Runs in a worker thread the callbacks of the fired ktimers, one at a time
+ * and with preemption disabled. That way, ktimer_cancel() called by a task
+ * (e.g. while destroying the object containing the ktimer) can never race
+ * with the callback.
+ */
+static void run_fired_ktimers(void *unused)
+{
+   struct ktimer *t;
+   ulong var;
+
+   while (true) {
+
+      disable_preemption();
+      disable_interrupts(&var);
+      {
+         t = NULL;
+
+         if (!list_is_empty(&fired_ktimers)) {
+            t = list_first_obj(&fired_ktimers, struct ktimer, fired_node);
+            list_remove(&t->fired_node);
+            list_node_init(&t->fired_node);
+         } else {
+            fired_ktimers_job_enqueued = false;
+         }
+      }
+      enable_interrupts(&var);
+
+      if (!t) {
+         enable_preemption();
+         break;
+      }
+
+      t->func(t);
+      enable_preemption();
+   }
+}
+
+/* Like wake_up_expired_tasks(), but for the ktimers */
+static void fire_expired_ktimers(void)
+{
+   struct ktimer *t;
+   bool enqueue = false;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      while ((t = ktimers.first) && t->deadline <= __ticks) {
+         ktimers_remove(t);
+         t->deadline = 0;
+         list_add_tail(&fired_ktimers, &t->fired_node);
+      }
+
+      if (!list_is_empty(&fired_ktimers) && !fired_ktimers_job_enqueued)
+         enqueue = fired_ktimers_job_enqueued = true;
+   }
+   enable_interrupts(&var);
+
+   if (enqueue) {
+      if (!wth_enqueue_anywhere(WTH_PRIO_HIGHEST, &run_fired_ktimers, NULL)) {
+         /* The queue is full: just retry on the next tick */
+         fired_ktimers_job_enqueued = false;
+      }
+   }
+}
+
+/*
+ * Processes all the ticks of the timing wheel up to the current one, waking up
+ * the tasks whose timer expired. The cost is proportional to the number of
+ * expiring timers, not to the number of the armed ones.
+ */
+static void wake_up_expired_tasks(void)
 {
    struct task *pos, *temp;
    bool any_woken_up_task = false;
+   struct list *slot;
    ulong var;
+   u32 idx;
 
-   /*
-    * This is *NOT* the best we can do. In particular, it's terrible to keep
-    * the interrupts disabled while iterating the _whole_ timer_wakeup_list.
-    *
-    * Possible better solutions
-    * -----------------------------
-    * 1. Keep the tasks to wake-up in a sort of ordered list and then use
-    * relative timers. This way, at each tick we'll have to decrement just one
-    * single counter. We'll start decrement the next counter only when the first
-    * counter reaches 0 and its list node is removed. Of course, if we cannot
-    * use kmalloc() in case of sleep, it gets much harder to create such an
-    * ordered list and make it live inside a member of struct task. Maybe a BST
-    * will do the job, but that would require paying O(logN) per tick for
-    * finding the earliest timer. Not sure how better would be now for N < 50
-    * (typical), given the huge added constant for the BST functions. Also, the
-    * cancellation of a timer would require some extra effort in order to
-    * re-calculate the relative timer values, while we want the cancellation to
-    * be light-fast because it's run by IRQ handlers.
-    *
-    * 2. Use a fixed number of wakeup lists like: short-term, mid-term and
-    * long-term. Current task's wakeup list node will be placed in one those
-    * lists, depending on far in the future the task is supposted to be woke up.
-    * On every tick, here in tick_all_timers(), ONLY the short-term list will be
-    * iterated. That's a considerable improvement. In a system, there might be
-    * even 1,000 active timers, but how many of them will expire in the next
-    * second? Only a small percentage of them. To further improve the
-    * scalability, it's possible to have even more than 3 lists, or to further
-    * reduce the time-horizon of the short-term list. Periodically, but NOT on
-    * every tick, the `ticks_before_wake_up` field belonging to tasks in the
-    * other wakeup lists will adjusted with bigger decrements and tasks will be
-    * moved from one list to another. That will also happen in case the wakeup
-    * timer is changed for task with an already active timer. This solution
-    * looks much better than solution 1.
-    *
-    * Conclusion
-    * ---------------------
-    * For the moment, given the very limited scale of Tilck (tens of tasks at
-    * most running on the whole system), the current solution is safe and
-    * good-enough but, at some point, a smarter ad-hoc solution should be
-    * devised. Probably solution 2 is the right candidate.
-    */
    disable_interrupts(&var);
 
-   list_for_each(pos, temp, &timer_wakeup_list, wakeup_timer_node) {
+   if (!wheel_timers_count) {
+
+      /* Nothing to process: just skip the ticks */
+      wheel_ticks = __ticks + 1;
+      enable_interrupts(&var);
+      return;
+   }
+
+   while (wheel_ticks <= __ticks) {
+
+      idx = wheel_ticks & TW_MASK;
+
+      if (!idx) {
+         for (int lvl = 1; lvl < TW_LEVELS && !wheel_cascade(lvl); lvl++)
+            { /* cascade the next level as well */ }
+      }
 
-      /* If task is part of this list, it's counter must be > 0 */
-      ASSERT(pos->ticks_before_wake_up > 0);
+      wheel_ticks++;
+      slot = &timer_wheel[0][idx];
 
-      if (UNLIKELY(--pos->ticks_before_wake_up == 0)) {
+      list_for_each(pos, temp, slot, wakeup_timer_node) {
 
+         ASSERT(pos->wakeup_deadline < wheel_ticks);
+         wakeup_timers_remove(pos);
+         pos->wakeup_deadline = 0;
          pos->timer_ready = true;
-         list_remove(&pos->wakeup_timer_node);
 
          if (pos->state == TASK_STATE_SLEEPING) {
             task_change_state(pos, TASK_STATE_RUNNABLE);
@@ -174,6 +424,108 @@ static void tick_all_timers(void)
       sched_set_need_resched();
 }
 
+/*
+ * Tickless idle
+ * ----------------
+ *
+ * When there's nothing to run, the idle task calls tickless_idle_halt() which
+ * stops the periodic tick and programs the timer to fire just once, at the
+ * time of the earliest wakeup timer or ktimer (or as late as the hardware
+ * allows). Any IRQ ends the tickless period: irq_entry() calls
+ * __tickless_idle_exit(), which accounts the ticks that would have happened
+ * in the meanwhile and restarts the periodic tick.
+ */
+void tickless_idle_halt(void)
+{
+   u64 ticks = UINT32_MAX, next;
+   struct ktimer *t;
+   u32 phase;
+
+   ASSERT(are_interrupts_enabled());
+   disable_interrupts_forced();
+
+   if (kopt_no_tickless) {
+      idle_enter(__tick_duration);
+      return;
+   }
+
+   if ((next = wheel_next_event()))
+      ticks = next > __ticks ? next - __ticks : 1;
+
+   if (ktimers.first) {
+      t = ktimers.first;
+      ticks = MIN(ticks, t->deadline - __ticks);
+   }
+
+   /*
+    * An IRQ might have woken up a task after idle() checked for that: in that
+    * case, just halt until the next tick, as usual.
+    */
+   if (!need_reschedule() && ticks > 1) {
+
+      if (hw_timer_stop_tick((u32)MIN(ticks, (u64)UINT32_MAX), &phase)) {
+         tickless_carry_ns += phase;
+         __in_tickless_idle = true;
+      }
+   }
+
+   /*
+    * The time until the next timer event is our prediction of the idle period
+    * for choosing the C-state: any other IRQ would just end it earlier.
+    */
+   if (need_reschedule())
+      idle_enter(0);
+   else if (__in_tickless_idle)
+      idle_enter(ticks * __tick_duration);
+   else
+      idle_enter(__tick_duration);
+}
+
+void __tickless_idle_exit(void)
+{
+   bool expired;
+   u64 elapsed, total, ticks;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(__in_tickless_idle);
+
+   elapsed = hw_timer_restart_tick(&expired);
+   __in_tickless_idle = false;
+
+   if (expired) {
+
+      /*
+       * The IRQ of the one-shot timer is pending or being handled right now:
+       * leave the last tick to timer_irq_handler().
+       */
+      elapsed -= MIN(elapsed, (u64)__tick_duration);
+   }
+
+   /*
+    * The ticks skipped while idle are counted including the fraction of tick
+    * already elapsed before stopping the periodic timer. What remains, less
+    * than a tick, is carried to the next time.
+    */
+   total = tickless_carry_ns + elapsed;
+   ticks = total / __tick_duration;
+   tickless_carry_ns = (u32)(total % __tick_duration);
+
+   if (__tick_adj_ticks_rem) {
+      const u32 n = (u32)MIN(ticks, (u64)__tick_adj_ticks_rem);
+      elapsed = (u64)((s64)elapsed + (s64)__tick_adj_val * n);
+      __tick_adj_ticks_rem -= (int)n;
+   }
+
+   __ticks += ticks;
+   __time_ns += elapsed;
+   tsc_last_tick = RDTSC();
+   vdso_update_time(__time_ns);
+   tickless_skipped_ticks += ticks;
+
+   wake_up_expired_tasks();
+   fire_expired_ktimers();
+}
+
 static void do_sleep_internal(u32 ticks)
 {
    ASSERT(are_interrupts_enabled());
@@ -213,14 +565,11 @@ void kernel_sleep(u64 ticks)
     *    }
     *    kernel_yield();
     *
-    * But that would require task->ticks_before_wake_up to be actually 64-bit,
-    * wide and that's bad on 32-bit systems because:
-    *
-    *    - it would require using the soft 64-bit integers (slow)
-    *    - it would make impossible, in the case we wanted that, the counter
-    *      to be atomic.
+    * But that would require task_set_wakeup_timer() to accept a 64-bit wide
+    * number of ticks and that's bad on 32-bit systems, because it would
+    * require all of its callers to use the soft 64-bit integers (slow).
     *
-    * Therefore, in order to use a 32-bit value for 'ticks_before_wake_up' and,
+    * Therefore, in order to use a 32-bit value for the timer's ticks and,
     * at the same time being able to sleep for more than 2^32-1 ticks, we need
     * a more tricky implementation (below), and the little extra runtime price
     * for it is totally fine, since we're going to sleep anyways!
@@ -229,7 +578,7 @@ void kernel_sleep(u64 ticks)
     * ----------------------
     *
     * The simpler way to explain the algorithm is to just assume everything
-    * is in base 10 and that ticks_before_wake_up has 2 digits, while we want
+    * is in base 10 and that the timer's ticks have 2 digits, while we want
     * to support 4 digits sleep time. For example, we want to sleep for 234
     * ticks. The algorithm first computes 534 % 100 = 34 and then 534 / 100 = 5.
     * After that, it sleeps q (= 5) times for 99 ticks (max allowed). Clearly,
@@ -331,18 +680,91 @@ static enum irq_action timer_irq_handler(void *ctx)
        */
       __ticks++;
       __time_ns += ns_delta;
+      tsc_last_tick = RDTSC();
+      vdso_update_time(__time_ns);
    }
    enable_interrupts_forced();
 
    sched_account_ticks();
-   tick_all_timers();
+   trace_profiler_tick(get_irq_regs());
+   wake_up_expired_tasks();
+   fire_expired_ktimers();
    return IRQ_HANDLED;
 }
 
 static enum irq_action measure_bogomips_irq_handler(void *ctx);
+static enum irq_action calibrate_tsc_irq_handler(void *ctx);
 
 DEFINE_IRQ_HANDLER_NODE(timer, timer_irq_handler, NULL);
 DEFINE_IRQ_HANDLER_NODE(measure_bogomips, measure_bogomips_irq_handler, NULL);
+DEFINE_IRQ_HANDLER_NODE(calibrate_tsc, calibrate_tsc_irq_handler, NULL);
+
+/*
+ * Converts TSC cycles to nanoseconds, avoiding the overflow of cycles * 10^9.
+ * Returns 0 when the TSC is not stable or not calibrated yet.
+ */
+u64 tsc_to_ns(u64 cycles)
+{
+   const u64 hz = tsc_hz;
+
+   if (!hz)
+      return 0;
+
+   return (cycles / hz) * TS_SCALE + (cycles % hz) * TS_SCALE / hz;
+}
+
+/*
+ * Nanoseconds elapsed since the last update of __time_ns, according to the
+ * TSC. Called with the interrupts disabled. The value is clamped below 90% of
+ * a tick: the drift compensation in datetime.c can shorten a tick by 10%, and
+ * get_sys_time() must never go backwards when the next tick comes.
+ */
+u64 __tsc_ns_since_tick(void)
+{
+   if (!tsc_hz || !tsc_last_tick)
+      return 0;
+
+   return MIN(tsc_to_ns(RDTSC() - tsc_last_tick),
+              (u64)(__tick_duration - __tick_duration / 10 - 1));
+}
+
+struct tsc_calib_ctx {
+   u64 start_tsc;
+   u64 start_ticks;
+};
+
+/*
+ * Measures the TSC frequency against the ticks, passively: unlike the
+ * bogoMips loop, nothing spins while waiting. The ticks are used instead of
+ * __time_ns because the latter is skewed by the drift compensation, while
+ * __tickless_idle_exit() accounts precisely the ticks skipped while idle.
+ */
+static enum irq_action calibrate_tsc_irq_handler(void *arg)
+{
+   struct tsc_calib_ctx *ctx = arg;
+   const u64 now = RDTSC();
+   u64 ns;
+
+   if (UNLIKELY(!ctx->start_tsc)) {
+      ctx->start_tsc = now;
+      ctx->start_ticks = __ticks;
+      return IRQ_NOT_HANDLED;
+   }
+
+   if (__ticks - ctx->start_ticks < TSC_CALIB_TICKS)
+      return IRQ_NOT_HANDLED;
+
+   irq_uninstall_handler(X86_PC_TIMER_IRQ, &calibrate_tsc);
+   ns = (__ticks - ctx->start_ticks) * __tick_duration;
+
+   disable_interrupts_forced();
+   {
+      tsc_hz = (now - ctx->start_tsc) * MILLION / (ns / 1000);
+      tsc_last_tick = 0; /* don't interpolate until the next tick */
+   }
+   enable_interrupts_forced();
+   return IRQ_NOT_HANDLED;   /* always allow the real IRQ handler to go */
+}
 
 struct bogo_measure_ctx {
    bool started;
@@ -412,6 +834,17 @@ void delay_us(u32 us)
    u32 loops;
    ASSERT(us <= 100 * 1000);
 
+   if (LIKELY(tsc_hz)) {
+
+      const u64 start = RDTSC();
+      const u64 cycles = us * tsc_hz / MILLION;
+
+      while (RDTSC() - start < cycles)
+         asm_nop_loop(16);
+
+      return;
+   }
+
    if (LIKELY(loops_per_us >= 10))
       loops = us * loops_per_us;
    else
@@ -421,18 +854,47 @@ void delay_us(u32 us)
       asm_nop_loop(loops);
 }
 
-void init_timer(void)
+static void INIT_TEXT init_bogomips(void)
 {
    static struct bogo_measure_ctx ctx;
    measure_bogomips.context = &ctx;
 
+   if (!wth_enqueue_anywhere(WTH_PRIO_HIGHEST, &do_bogomips_loop, &ctx))
+      panic("Timer: unable to enqueue job in wth 0");
+
+   irq_install_handler(X86_PC_TIMER_IRQ, &measure_bogomips);
+}
+
+/*
+ * When there's a stable TSC, we don't need the bogoMips: that saves the
+ * MEASURE_BOGOMIPS_TICKS ticks spent spinning at boot. Until the TSC is
+ * calibrated, delay_us() uses the initial (overestimated) loops values.
+ */
+static void INIT_TEXT init_tsc(void)
+{
+   static struct tsc_calib_ctx ctx;
+   u64 hz;
+
+   if ((hz = hw_tsc_get_hz())) {
+      tsc_hz = hz;
+      return;
+   }
+
+   calibrate_tsc.context = &ctx;
+   irq_install_handler(X86_PC_TIMER_IRQ, &calibrate_tsc);
+}
+
+void INIT_TEXT init_timer(void)
+{
+   init_timer_wheel();
    __tick_duration = hw_timer_setup(TS_SCALE / TIMER_HZ);
 
    printk("*** Init the kernel timer\n");
 
-   if (!wth_enqueue_anywhere(WTH_PRIO_HIGHEST, &do_bogomips_loop, &ctx))
-      panic("Timer: unable to enqueue job in wth 0");
+   if (hw_tsc_is_stable() && !kopt_no_tsc)
+      init_tsc();
+   else
+      init_bogomips();
 
-   irq_install_handler(X86_PC_TIMER_IRQ, &measure_bogomips);
    irq_install_handler(X86_PC_TIMER_IRQ, &timer);
 }
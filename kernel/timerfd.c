@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/timerfd.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+
+/*
+ * A timerfd is a ktimer exposed as a file: read() returns, as a 64-bit
+ * integer, the number of expirations since the last read() or settime(),
+ * blocking while it's 0. Therefore, a program can wait for timers with the
+ * same poll(), select() or epoll loop it uses for its other file descriptors.
+ *
+ * The resolution is the one of the system tick: the expiration times are
+ * rounded up to the next tick. All the fields below are accessed only with
+ * preemption disabled, both by the syscalls and by the ktimer's callback.
+ */
+
+struct timerfd {
+
+   KOBJ_BASE_FIELDS
+
+   int clockid;
+   struct ktimer timer;
+   u64 deadline;                    /* absolute, in ticks. 0 = disarmed */
+   u64 interval;                    /* in ticks. 0 = one-shot */
+   u64 expirations;
+   struct kcond rready_cond;        /* signaled when expirations becomes > 0 */
+};
+
+static void timerfd_expired(struct ktimer *t)
+{
+   struct timerfd *tfd = CONTAINER_OF(t, struct timerfd, timer);
+   const u64 now = get_ticks();
+   u64 missed;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(tfd->deadline && tfd->deadline <= now);
+
+   tfd->expirations++;
+
+   if (tfd->interval) {
+
+      tfd->deadline += tfd->interval;
+
+      if (tfd->deadline <= now) {
+
+         /* We're late: account all the periods we missed, at once */
+         missed = (now - tfd->deadline) / tfd->interval + 1;
+         tfd->expirations += missed;
+         tfd->deadline += missed * tfd->interval;
+      }
+
+      ktimer_arm(&tfd->timer, tfd->deadline);
+
+   } else {
+
+      tfd->deadline = 0;
+   }
+
+   kcond_signal_all(&tfd->rready_cond);
+}
+
+static ssize_t timerfd_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *tfd = (void *)kh->kobj;
+   u64 val;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   while (true) {
+
+      disable_preemption();
+
+      if (tfd->expirations) {
+         val = tfd->expirations;
+         tfd->expirations = 0;
+         enable_preemption();
+         break;
+      }
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         enable_preemption();
+         return -EAGAIN;
+      }
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &tfd->rready_cond,
+                         NO_EXTRA,
+                         &tfd->rready_cond.wait_list);
+
+      enter_sleep_wait_state();
+
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   memcpy(buf, &val, sizeof(val));
+   return sizeof(u64);
+}
+
+static int timerfd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *tfd = (void *)kh->kobj;
+   return tfd->expirations > 0;
+}
+
+static struct kcond *timerfd_get_rready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *tfd = (void *)kh->kobj;
+   return &tfd->rready_cond;
+}
+
+static const struct file_ops static_ops_timerfd =
+{
+   .read = timerfd_read,
+   .read_ready = timerfd_read_ready,
+   .get_rready_cond = timerfd_get_rready_cond,
+};
+
+bool is_timerfd_handle(fs_handle h)
+{
+   return ((struct fs_handle_base *)h)->fops == &static_ops_timerfd;
+}
+
+static void
+timerfd_get_curr_val(struct timerfd *tfd, struct k_itimerspec64 *val)
+{
+   const u64 now = get_ticks();
+   u64 left = 0;
+
+   if (tfd->deadline) {
+
+      /*
+       * The deadline might have just passed, with the callback not run yet:
+       * the timer is still armed, so don't report 0 as time left.
+       */
+      left = tfd->deadline > now ? tfd->deadline - now : 1;
+   }
+
+   ticks_to_timespec(tfd->interval, &val->it_interval);
+   ticks_to_timespec(left, &val->it_value);
+}
+
+static bool is_valid_timespec(const struct k_timespec64 *ts)
+{
+   return ts->tv_sec >= 0 && ts->tv_nsec >= 0 && ts->tv_nsec < BILLION;
+}
+
+int timerfd_settime(fs_handle h,
+                    int flags,
+                    const struct k_itimerspec64 *new_val,
+                    struct k_itimerspec64 *old_val)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *tfd = (void *)kh->kobj;
+   const struct k_timespec64 *value = &new_val->it_value;
+   struct k_timespec64 now_ts, rel;
+   u64 deadline = 0;
+
+   ASSERT(is_timerfd_handle(h));
+
+   if (!is_valid_timespec(value) || !is_valid_timespec(&new_val->it_interval))
+      return -EINVAL;
+
+   if (value->tv_sec || value->tv_nsec) {
+
+      rel = *value;
+
+      if (flags & TFD_TIMER_ABSTIME) {
+
+         /* CLOCK_MONOTONIC and CLOCK_REALTIME are the same clock, here */
+         real_time_get_timespec(&now_ts);
+         rel.tv_sec -= now_ts.tv_sec;
+         rel.tv_nsec -= now_ts.tv_nsec;
+
+         if (rel.tv_nsec < 0) {
+            rel.tv_sec--;
+            rel.tv_nsec += BILLION;
+         }
+
+         if (rel.tv_sec < 0) {
+            /* Already expired: fire on the next tick */
+            rel = (struct k_timespec64) { .tv_sec = 0, .tv_nsec = 1 };
+         }
+      }
+
+      deadline = get_ticks() + MAX(timespec_to_ticks(&rel), 1ull);
+   }
+
+   disable_preemption();
+   {
+      if (old_val)
+         timerfd_get_curr_val(tfd, old_val);
+
+      ktimer_cancel(&tfd->timer);
+      tfd->deadline = deadline;
+      tfd->interval = deadline ? timespec_to_ticks(&new_val->it_interval) : 0;
+      tfd->expirations = 0;
+
+      if (deadline)
+         ktimer_arm(&tfd->timer, deadline);
+   }
+   enable_preemption();
+   return 0;
+}
+
+void timerfd_gettime(fs_handle h, struct k_itimerspec64 *curr_val)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *tfd = (void *)kh->kobj;
+
+   ASSERT(is_timerfd_handle(h));
+
+   disable_preemption();
+   {
+      timerfd_get_curr_val(tfd, curr_val);
+   }
+   enable_preemption();
+}
+
+void destroy_timerfd(struct timerfd *tfd)
+{
+   ktimer_cancel(&tfd->timer);
+   kcond_destory(&tfd->rready_cond);
+   kfree_obj(tfd, struct timerfd);
+}
+
+struct timerfd *create_timerfd(int clockid)
+{
+   struct timerfd *tfd;
+
+   if (!(tfd = (void *)kzalloc_obj(struct timerfd)))
+      return NULL;
+
+   tfd->destory_obj = (void *)&destroy_timerfd;
+   tfd->clockid = clockid;
+   ktimer_init(&tfd->timer, &timerfd_expired);
+   kcond_init(&tfd->rready_cond);
+   return tfd;
+}
+
+fs_handle timerfd_create_handle(struct timerfd *tfd, int flags)
+{
+   return kfs_create_new_handle(&static_ops_timerfd,
+                                (void *)tfd,
+                                O_RDONLY | (flags & TFD_NONBLOCK));
+}
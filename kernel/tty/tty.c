@@ -17,6 +17,8 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/term.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/user.h>
 #include <tilck/kernel/test/tty_test.h>
 
 #include <tilck/mods/console.h>
@@ -60,6 +62,24 @@ static ssize_t tty_write(fs_handle h, char *buf, size_t size, offt *pos)
    return tty_write_int(t, dh, buf, size);
 }
 
+static ssize_t tty_readv(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   struct devfs_handle *dh = h;
+   struct devfs_file *df = dh->file;
+   struct tty *t = df->dev_minor ? ttys[df->dev_minor] : get_curr_tty();
+
+   return tty_readv_int(t, dh, iov, iovcnt);
+}
+
+static ssize_t tty_writev(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   struct devfs_handle *dh = h;
+   struct devfs_file *df = dh->file;
+   struct tty *t = df->dev_minor ? ttys[df->dev_minor] : get_curr_tty();
+
+   return tty_writev_int(t, dh, iov, iovcnt);
+}
+
 static int tty_ioctl(fs_handle h, ulong request, void *argp)
 {
    struct devfs_handle *dh = h;
@@ -131,6 +151,8 @@ tty_create_device_file(int minor,
 
       .read = tty_read,
       .write = tty_write,
+      .readv = tty_readv,
+      .writev = tty_writev,
       .ioctl = tty_ioctl,
       .get_rready_cond = tty_get_rready_cond,
       .read_ready = tty_read_ready,
@@ -166,6 +188,34 @@ int tty_get_num(struct tty *t)
    return t->minor;
 }
 
+bool tty_get_scrollback_stats(int n, struct term_scrollback_stats *s)
+{
+   struct tty *t;
+
+   if (n <= 0 || n > kopt_ttys || !(t = ttys[n]))
+      return false;
+
+   if (!t->tintf->get_scrollback_stats)
+      return false;
+
+   t->tintf->get_scrollback_stats(t->tstate, s);
+   return true;
+}
+
+bool tty_get_mem_stats(int n, struct term_mem_stats *s)
+{
+   struct tty *t;
+
+   if (n <= 0 || n > kopt_ttys || !(t = ttys[n]))
+      return false;
+
+   if (!t->tintf->get_mem_stats)
+      return false;
+
+   t->tintf->get_mem_stats(t->tstate, s);
+   return true;
+}
+
 void
 tty_create_devfile_or_panic(const char *filename,
                             u16 major,
@@ -231,7 +281,7 @@ tty_full_destroy(struct tty *t)
    }
 
    kfree_array_obj(t->ctrl_handlers, tty_ctrl_sig_func, 256);
-   kfree_obj(t->input_buf, TTY_INPUT_BS);
+   kfree2(t->input_buf, t->input_buf_size);
    kfree_obj(t, struct tty);
 }
 
@@ -246,7 +296,9 @@ allocate_and_init_tty(u16 minor, u16 serial_port_fwd, int rows_buf)
    if (!(t = kzalloc_obj(struct tty)))
       return NULL;
 
-   if (!(t->input_buf = kzmalloc(TTY_INPUT_BS))) {
+   t->input_buf_size = (u32)kopt_tty_inbuf;
+
+   if (!(t->input_buf = kzmalloc(t->input_buf_size))) {
       tty_full_destroy(t);
       return NULL;
    }
@@ -369,6 +421,76 @@ tty_write_int(struct tty *t,
    return (ssize_t) size;
 }
 
+/*
+ * The terminal cannot consume user buffers directly: therefore, the segments
+ * are gathered in the per-task copy buffer and written with a single call, so
+ * that they cannot be interleaved with the output of other writers.
+ */
+ssize_t
+tty_writev_int(struct tty *t,
+               struct devfs_handle *h,
+               const struct iovec *iov,
+               int iovcnt)
+{
+   char *buf = get_curr_task()->io_copybuf;
+   size_t tot = 0, n;
+
+   for (int i = 0; i < iovcnt && tot < IO_COPYBUF_SIZE; i++) {
+
+      n = MIN(iov[i].iov_len, IO_COPYBUF_SIZE - tot);
+
+      if (copy_from_user(buf + tot, iov[i].iov_base, n)) {
+
+         if (!tot)
+            return -EFAULT;
+
+         break;
+      }
+
+      tot += n;
+   }
+
+   if (!tot)
+      return 0;
+
+   return tty_write_int(t, h, buf, tot);
+}
+
+/* Reads once in the per-task copy buffer, then scatters the data */
+ssize_t
+tty_readv_int(struct tty *t,
+              struct devfs_handle *h,
+              const struct iovec *iov,
+              int iovcnt)
+{
+   char *buf = get_curr_task()->io_copybuf;
+   size_t tot = 0, n;
+   ssize_t rc;
+
+   for (int i = 0; i < iovcnt; i++)
+      tot += iov[i].iov_len;
+
+   if (!tot)
+      return 0;
+
+   if ((rc = tty_read_int(t, h, buf, MIN(tot, IO_COPYBUF_SIZE))) <= 0)
+      return rc;
+
+   tot = 0;
+
+   for (int i = 0; i < iovcnt && tot < (size_t)rc; i++) {
+
+      n = MIN(iov[i].iov_len, (size_t)rc - tot);
+
+      if (copy_to_user(iov[i].iov_base, buf + tot, n))
+         return -EFAULT;
+
+      tot += n;
+   }
+
+   return rc;
+}
+
 ssize_t tty_curr_proc_write(const char *buf, size_t size)
 {
    return tty_write_int(get_curr_process_tty(), NULL, buf, size);
@@ -383,6 +505,33 @@ void tty_write_on_all_ttys(const char *buf, size_t size)
    }
 }
 
+/*
+ * On memory pressure, drop the scrollback of the ttys in background, starting
+ * from the last one. The current tty keeps its scrollback.
+ */
+static size_t tty_scrollback_shrink(struct shrinker *s, size_t bytes)
+{
+   struct tty *curr = get_curr_tty();
+   size_t freed = 0;
+
+   for (int i = kopt_ttys; i >= 1 && freed < bytes; i--) {
+
+      struct tty *t = ttys[i];
+
+      if (!t || t == curr || !t->tintf->drop_scrollback)
+         continue;
+
+      freed += t->tintf->drop_scrollback(t->tstate);
+   }
+
+   return freed;
+}
+
+static struct shrinker tty_shrinker = {
+   .name = "tty_scrollback",
+   .shrink = &tty_scrollback_shrink,
+};
+
 STATIC void init_tty(void)
 {
    process_term_read_info(&first_term_i);
@@ -401,9 +550,10 @@ STATIC void init_tty(void)
     */
    tty_create_devfile_or_panic("tty0", di->major, 0, NULL);
 
-   if (!kopt_sercon)
-      if (video_term_intf)
-         init_video_ttys();
+   if (!kopt_sercon && video_term_intf) {
+      init_video_ttys();
+      register_shrinker(&tty_shrinker);
+   }
 
    if (serial_term_intf)
       init_serial_ttys();
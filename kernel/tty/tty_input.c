@@ -13,6 +13,9 @@
 #include <tilck/kernel/kb.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/hal.h>
 
 #include <termios.h>      // system header
 #include <fcntl.h>        // system header
@@ -25,6 +28,59 @@ static void tty_keypress_echo(struct tty *t, char c);
 
 #include "tty_ctrl_handlers.c.h"
 
+static u64 tty_key_tsc;         /* event_tsc of the key being processed */
+static struct tty_input_lat_stats input_lat_stats;
+
+/*
+ * Called when the reader can get the input just written: remember when the
+ * oldest key not read yet arrived, in order to measure its latency.
+ */
+static inline void tty_stamp_input(struct tty *t)
+{
+   if (!t->input_tsc)
+      t->input_tsc = tty_key_tsc;
+}
+
+static void tty_account_input_latency(struct tty *t)
+{
+   u64 tsc, lat_us;
+   int b = 0;
+
+   disable_preemption();
+   {
+      tsc = t->input_tsc;
+      t->input_tsc = 0;
+   }
+   enable_preemption();
+
+   if (!tsc || !(lat_us = boot_trace_tsc_to_us(RDTSC() - tsc)))
+      return;
+
+   while (b < TTY_INPUT_LAT_BUCKETS - 1 &&
+          lat_us >= ((u64)TTY_INPUT_LAT_UNIT_US << b))
+   {
+      b++;
+   }
+
+   disable_preemption();
+   {
+      input_lat_stats.events++;
+      input_lat_stats.buckets[b]++;
+      lat_us = MIN(lat_us, (u64)UINT32_MAX);
+      input_lat_stats.max_us = MAX(input_lat_stats.max_us, (u32)lat_us);
+   }
+   enable_preemption();
+}
+
+void tty_get_input_lat_stats(struct tty_input_lat_stats *s)
+{
+   disable_preemption();
+   {
+      *s = input_lat_stats;
+   }
+   enable_preemption();
+}
+
 static void tty_keypress_echo(struct tty *t, char c)
 {
    struct termios *const c_term = &t->c_term;
@@ -128,6 +184,7 @@ void tty_inbuf_reset(struct tty *t)
    {
       ringbuf_reset(&t->input_ringbuf);
       t->end_line_delim_count = 0;
+      t->input_tsc = 0;
    }
    enable_preemption();
 }
@@ -145,6 +202,45 @@ static inline u8 tty_inbuf_read_elem(struct tty *t)
    return ret;
 }
 
+/*
+ * Read up to `size` bytes at once from the input ringbuf, waking up the
+ * writers blocked on a full buffer just once.
+ */
+static size_t tty_inbuf_read_bytes(struct tty *t, char *buf, size_t size)
+{
+   size_t ret;
+   disable_preemption();
+   {
+      ret = ringbuf_read_bytes(&t->input_ringbuf, (u8 *)buf, size);
+
+      if (ret)
+         kcond_signal_all(&t->output_cond);
+   }
+   enable_preemption();
+   return ret;
+}
+
+/*
+ * In raw mode, wake up the reader only when it has enough data to return:
+ * the bytes it's waiting for or, when there's no reader in tty_read_raw(),
+ * VMIN bytes, the same tty_read_ready_int() checks for. A full buffer wakes
+ * up the reader anyway.
+ */
+static void tty_raw_signal_input(struct tty *t)
+{
+   const u32 min = t->raw_wake_min
+      ? t->raw_wake_min
+      : MAX(1u, (u32)t->c_term.c_cc[VMIN]);
+
+   tty_stamp_input(t);
+
+   if (ringbuf_get_elems(&t->input_ringbuf) >= min ||
+       ringbuf_is_full(&t->input_ringbuf))
+   {
+      kcond_signal_one(&t->input_cond);
+   }
+}
+
 static inline bool tty_inbuf_drop_last_written_elem(struct tty *t)
 {
    bool ret;
@@ -214,7 +310,7 @@ tty_handle_non_printable_key(struct kb_dev *kb,
    }
 
    if (!(t->c_term.c_lflag & ICANON))
-      kcond_signal_one(&t->input_cond);
+      tty_raw_signal_input(t);
 
    return kb_handler_ok_and_continue;
 }
@@ -240,19 +336,22 @@ tty_keypress_handle_canon_mode(struct tty *t, u32 key, u8 c, bool block)
 
       if (tty_is_line_delim_char(t, c)) {
          t->end_line_delim_count++;
+         tty_stamp_input(t);
          kcond_signal_one(&t->input_cond);
       }
    }
 }
 
-void tty_send_keyevent(struct tty *t, struct key_event ke, bool block)
+/*
+ * Processes one input char. Returns true when it got written to the input
+ * buffer in raw mode: the caller has to call tty_raw_signal_input().
+ */
+static bool tty_input_char(struct tty *t, u32 key, u8 c, bool block)
 {
-   u8 c = (u8)ke.print_char;
-
    if (c == '\r') {
 
       if (t->c_term.c_iflag & IGNCR)
-         return; /* ignore the carriage return */
+         return false; /* ignore the carriage return */
 
       if (t->c_term.c_iflag & ICRNL)
          c = '\n';
@@ -265,17 +364,34 @@ void tty_send_keyevent(struct tty *t, struct key_event ke, bool block)
 
    /* Ctrl+C, Ctrl+D, Ctrl+Z etc.*/
    if (tty_handle_special_controls(t, c, block))
-      return;
+      return false;
 
    if (t->c_term.c_lflag & ICANON) {
-      tty_keypress_handle_canon_mode(t, ke.key, c, block);
-      return;
+      tty_keypress_handle_canon_mode(t, key, c, block);
+      return false;
    }
 
    /* raw mode input handling */
    tty_inbuf_write_elem(t, c, block);
-   kcond_signal_one(&t->input_cond);
-   return;
+   return true;
+}
+
+void tty_send_keyevent(struct tty *t, struct key_event ke, bool block)
+{
+   if (tty_input_char(t, ke.key, (u8)ke.print_char, block))
+      tty_raw_signal_input(t);
+}
+
+void tty_send_input(struct tty *t, const char *buf, size_t len, bool block)
+{
+   bool signal = false;
+
+   for (size_t i = 0; i < len; i++)
+      signal |= tty_input_char(t, 0, (u8)buf[i], block);
+
+   /* In raw mode, wake up the readers just once for the whole batch */
+   if (signal)
+      tty_raw_signal_input(t);
 }
 
 static int
@@ -323,10 +439,9 @@ int set_curr_tty(struct tty *t)
    return res;
 }
 
-enum kb_handler_action
-tty_keypress_handler(struct kb_dev *kb, struct key_event ke)
+static enum kb_handler_action
+tty_keypress_handler_main(struct tty *t, struct kb_dev *kb, struct key_event ke)
 {
-   struct tty *const t = get_curr_tty();
    const u32 key = ke.key;
 
    if (t->mediumraw_mode) {
@@ -343,7 +458,7 @@ tty_keypress_handler(struct kb_dev *kb, struct key_event ke)
       }
 
       tty_inbuf_write_elem(t, mr, false);
-      kcond_signal_one(&t->input_cond);
+      tty_raw_signal_input(t);
       return kb_handler_ok_and_stop;
    }
 
@@ -385,6 +500,17 @@ tty_keypress_handler(struct kb_dev *kb, struct key_event ke)
    return tty_keypress_handler_int(t, kb, ke);
 }
 
+enum kb_handler_action
+tty_keypress_handler(struct kb_dev *kb, struct key_event ke)
+{
+   enum kb_handler_action rc;
+
+   tty_key_tsc = kb->event_tsc;
+   rc = tty_keypress_handler_main(get_curr_tty(), kb, ke);
+   tty_key_tsc = 0;
+   return rc;
+}
+
 static size_t tty_flush_read_buf(struct devfs_handle *h, char *buf, size_t size)
 {
    struct tty_handle_extra *eh = (void *)&h->extra;
@@ -404,7 +530,7 @@ static size_t tty_flush_read_buf(struct devfs_handle *h, char *buf, size_t size)
 }
 
 /*
- * Returns:
+ * Canonical mode only. Returns:
  *    - TRUE when caller's read loop should continue
  *    - FALSE when caller's read loop should STOP
  */
@@ -417,26 +543,17 @@ tty_internal_read_single_char_from_kb(struct tty *t,
    u8 c = tty_inbuf_read_elem(t);
    eh->read_buf[eh->read_buf_used++] = (char)c;
 
-   if (t->c_term.c_lflag & ICANON) {
-
-      if (tty_is_line_delim_char(t, c)) {
-         ASSERT(t->end_line_delim_count > 0);
-         t->end_line_delim_count--;
-         *delim_break = true;
-
-         /* All line delimiters except EOF are kept */
-         if (c == t->c_term.c_cc[VEOF])
-            eh->read_buf_used--;
-      }
+   if (tty_is_line_delim_char(t, c)) {
+      ASSERT(t->end_line_delim_count > 0);
+      t->end_line_delim_count--;
+      *delim_break = true;
 
-      return !*delim_break;
+      /* All line delimiters except EOF are kept */
+      if (c == t->c_term.c_cc[VEOF])
+         eh->read_buf_used--;
    }
 
-   /*
-    * In raw mode it makes no sense to read until a line delim is
-    * found: we should read the minimum necessary.
-    */
-   return !(eh->read_buf_used >= t->c_term.c_cc[VMIN]);
+   return !*delim_break;
 }
 
 static inline bool
@@ -447,15 +564,76 @@ tty_internal_should_read_return(struct tty *t,
 {
    struct tty_handle_extra *eh = (void *)&h->extra;
 
-   if (t->c_term.c_lflag & ICANON) {
-      return
-         delim_break ||
-            (t->end_line_delim_count > 0 &&
-               (eh->read_buf_used == TTY_READ_BS || read_cnt == TTY_INPUT_BS));
+   return
+      delim_break ||
+         (t->end_line_delim_count > 0 &&
+            (eh->read_buf_used == TTY_READ_BS ||
+             read_cnt == t->input_buf_size));
+}
+
+/*
+ * Raw mode read: the data is moved in bulk from the input ringbuf to the
+ * caller's buffer, without going through the per-handle read buffer. VMIN and
+ * VTIME are honored as described in termios(3):
+ *
+ *    VMIN > 0, VTIME == 0    block until MIN(VMIN, size) bytes are available
+ *    VMIN > 0, VTIME > 0     same, but once the first byte arrived, wait at
+ *                            most VTIME tenths of second for the others
+ *    VMIN == 0, VTIME > 0    wait at most VTIME tenths of second for any data
+ *    VMIN == 0, VTIME == 0   return immediately whatever is available
+ *
+ * Note: in the VMIN > 0, VTIME > 0 case the timer starts with the first byte
+ * and it's not restarted after each following byte.
+ */
+static ssize_t
+tty_read_raw(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
+{
+   struct tty_handle_extra *eh = (void *)&h->extra;
+   const u32 vmin = t->c_term.c_cc[VMIN];
+   const u32 vtime = t->c_term.c_cc[VTIME];
+   const size_t want = vmin ? MIN(vmin, size) : 1;
+   u64 deadline = 0, now;
+   u32 timeout;
+   size_t cnt = 0;
+
+   /* Data left in the read buffer by a previous read in canonical mode */
+   if (eh->read_buf_used)
+      cnt = tty_flush_read_buf(h, buf, size);
+
+   while (true) {
+
+      cnt += tty_inbuf_read_bytes(t, buf + cnt, size - cnt);
+
+      if (cnt >= want || (!vmin && !vtime))
+         break;
+
+      if (h->fl_flags & O_NONBLOCK)
+         return cnt ? (ssize_t)cnt : -EAGAIN;
+
+      timeout = KCOND_WAIT_FOREVER;
+
+      if (vtime && (cnt || !vmin)) {
+
+         now = get_ticks();
+
+         if (!deadline)
+            deadline = now + MAX(1u, ms_to_ticks(vtime * 100));
+
+         if (now >= deadline)
+            break;
+
+         timeout = (u32)(deadline - now);
+      }
+
+      t->raw_wake_min = (u32)(want - cnt);
+      kcond_wait(&t->input_cond, NULL, timeout);
+      t->raw_wake_min = 0;
+
+      if (pending_signals())
+         return cnt ? (ssize_t)cnt : -EINTR;
    }
 
-   /* Raw mode handling */
-   return read_cnt >= t->c_term.c_cc[VMIN];
+   return (ssize_t)cnt;
 }
 
 bool tty_read_ready_int(struct tty *t, struct devfs_handle *h)
@@ -470,8 +648,8 @@ bool tty_read_ready_int(struct tty *t, struct devfs_handle *h)
    return ringbuf_get_elems(&t->input_ringbuf) >= t->c_term.c_cc[VMIN];
 }
 
-ssize_t
-tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
+static ssize_t
+tty_read_input(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
 {
    struct tty_handle_extra *eh = (void *)&h->extra;
    struct process *pi = get_curr_proc();
@@ -504,6 +682,9 @@ tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
    if (!size)
       return 0;
 
+   if (!(t->c_term.c_lflag & ICANON))
+      return tty_read_raw(t, h, buf, size);
+
    if (eh->read_buf_used) {
 
       if (!(h->fl_flags & O_NONBLOCK))
@@ -532,8 +713,7 @@ tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
       }
    }
 
-   if (t->c_term.c_lflag & ICANON)
-      t->tintf->set_col_offset(t->tstate, -1 /* current col */);
+   t->tintf->set_col_offset(t->tstate, -1 /* current col */);
 
    eh->read_allowed_to_return = false;
 
@@ -561,7 +741,7 @@ tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
              eh->read_buf_used < TTY_READ_BS &&
              tty_internal_read_single_char_from_kb(t, h, &delim_break)) { }
 
-      if (!(h->fl_flags & O_NONBLOCK) || !(t->c_term.c_lflag & ICANON))
+      if (!(h->fl_flags & O_NONBLOCK))
          read_count += tty_flush_read_buf(h, buf+read_count, size-read_count);
 
       ASSERT(t->end_line_delim_count >= 0);
@@ -585,6 +765,17 @@ tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
    return (ssize_t) read_count;
 }
 
+ssize_t
+tty_read_int(struct tty *t, struct devfs_handle *h, char *buf, size_t size)
+{
+   ssize_t rc = tty_read_input(t, h, buf, size);
+
+   if (rc > 0)
+      tty_account_input_latency(t);
+
+   return rc;
+}
+
 void tty_update_ctrl_handlers(struct tty *t)
 {
    bzero(t->ctrl_handlers, 256 * sizeof(tty_ctrl_sig_func));
@@ -605,6 +796,7 @@ void tty_input_init(struct tty *t)
 {
    kcond_init(&t->output_cond);
    kcond_init(&t->input_cond);
-   ringbuf_init(&t->input_ringbuf, TTY_INPUT_BS, 1, t->input_buf);
+   kcond_set_wake_boost(&t->input_cond, true);
+   ringbuf_init(&t->input_ringbuf, t->input_buf_size, 1, t->input_buf);
    tty_update_ctrl_handlers(t);
 }
@@ -39,6 +39,18 @@ tty_write_int(struct tty *t,
               const char *buf,
               size_t size);
 
+ssize_t
+tty_readv_int(struct tty *t,
+              struct devfs_handle *h,
+              const struct iovec *iov,
+              int iovcnt);
+
+ssize_t
+tty_writev_int(struct tty *t,
+               struct devfs_handle *h,
+               const struct iovec *iov,
+               int iovcnt);
+
 int
 tty_ioctl_int(struct tty *t, struct devfs_handle *h, ulong request, void *argp);
 
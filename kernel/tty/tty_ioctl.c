@@ -176,11 +176,7 @@ static int tty_ioctl_kdsetmode(struct tty *t, void *argp)
 static int tty_ioctl_KDGKBMODE(struct tty *t, void *argp)
 {
    int mode = t->mediumraw_mode ? K_MEDIUMRAW : K_XLATE;
-
-   if (!copy_to_user(argp, &mode, sizeof(int)))
-      return 0;
-
-   return -EFAULT;
+   return put_user(mode, (int *)argp);
 }
 
 static int tty_ioctl_KDSKBMODE(struct tty *t, void *argp)
@@ -291,7 +287,7 @@ static int tty_ioctl_TIOCSPGRP(struct tty *t, const int *user_pgrp)
    if (pi->proc_tty != t)
       return -ENOTTY;
 
-   if (copy_from_user(&pgid, user_pgrp, sizeof(int)))
+   if (get_user(pgid, user_pgrp))
       return -EFAULT;
 
    if (pgid < 0)
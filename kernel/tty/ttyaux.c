@@ -35,6 +35,18 @@ static ssize_t ttyaux_write(fs_handle h, char *buf, size_t size, offt *pos)
    return tty_write_int(get_curr_process_tty(), h, buf, size);
 }
 
+static ssize_t
+ttyaux_readv(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   return tty_readv_int(get_curr_process_tty(), h, iov, iovcnt);
+}
+
+static ssize_t
+ttyaux_writev(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   return tty_writev_int(get_curr_process_tty(), h, iov, iovcnt);
+}
+
 static int ttyaux_ioctl(fs_handle h, ulong request, void *argp)
 {
    return tty_ioctl_int(get_curr_process_tty(), h, request, argp);
@@ -59,6 +71,8 @@ ttyaux_create_device_file(int minor,
 
       .read = ttyaux_read,
       .write = ttyaux_write,
+      .readv = ttyaux_readv,
+      .writev = ttyaux_writev,
       .ioctl = ttyaux_ioctl,
       .get_rready_cond = ttyaux_get_rready_cond,
       .read_ready = ttyaux_read_ready,
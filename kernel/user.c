@@ -1,14 +1,18 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+#include <tilck/common/elf_types.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/unaligned.h>
 #include <tilck/common/utils.h>
 
 #include <tilck/kernel/user.h>
+#include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/errno.h>
-#include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/vdso.h>
 
 #include <linux/auxvec.h> // system header
 
@@ -17,8 +21,7 @@ int copy_from_user(void *dest, const void *user_ptr, size_t n)
    if (user_out_of_range(user_ptr, n))
       return -1;
 
-   u32 r = fault_resumable_call(PAGE_FAULT_MASK, memcpy, 3, dest, user_ptr, n);
-   return !r ? 0 : -1;
+   return !asm_copy_user(dest, user_ptr, n) ? 0 : -1;
 }
 
 int copy_to_user(void *user_ptr, const void *src, size_t n)
@@ -26,40 +29,7 @@ int copy_to_user(void *user_ptr, const void *src, size_t n)
    if (user_out_of_range(user_ptr, n))
       return -1;
 
-   u32 r = fault_resumable_call(PAGE_FAULT_MASK, memcpy, 3, user_ptr, src, n);
-   return !r ? 0 : -1;
-}
-
-static void internal_copy_user_str(void *dest,
-                                   const void *user_ptr,
-                                   void *dest_end,
-                                   size_t *written_ptr,
-                                   int *rc)
-{
-   ASSERT(in_fault_resumable_code());
-
-   const char *ptr = user_ptr;
-   char *d = dest;
-   *written_ptr = 0;
-   *rc = 0;
-
-   do {
-
-      if (d >= (char *)dest_end) {
-         *rc = 1;
-         return;
-      }
-
-      if (user_out_of_range(ptr, 1)) {
-         *rc = -1;
-         return;
-      }
-
-      *d++ = *ptr; /* NOTE: `ptr` is NOT increased here */
-
-   } while (*ptr++);
-
-   *written_ptr = (size_t)(d - (char *)dest); /* NOTE: counting the final \0 */
+   return !asm_copy_user(user_ptr, src, n) ? 0 : -1;
 }
 
 /*
@@ -74,119 +44,26 @@ int copy_str_from_user(void *dest,
                        size_t max_size,
                        size_t *written_ptr)
 {
-   int rc;
-   u32 faults;
-   size_t written;
-
-   faults = fault_resumable_call(PAGE_FAULT_MASK,
-                                 internal_copy_user_str,
-                                 5,
-                                 dest,
-                                 user_ptr,
-                                 (char *)dest + max_size,
-                                 &written,
-                                 &rc);
+   const char *ptr = user_ptr;
+   char *d = dest;
 
    if (written_ptr)
-      *written_ptr = written;
-
-   if (faults)
-      return -1;
-
-   return rc;
-}
-
-static void
-internal_copy_str_array_from_user(void *dest,
-                                  const char *const *user_arr,
-                                  size_t max_size,
-                                  size_t *written_ptr,
-                                  int *rc)
-{
-   int argc;
-   char **dest_arr = (char **)dest;
-   char *dest_end = (char *)dest + max_size;
-   char *after_ptrs_arr;
-   size_t written = 0;
-   *rc = 0;
-
-   ASSERT(in_fault_resumable_code());
-
-   for (argc = 0; ; argc++) {
-
-      const char *const *ptr_ptr = user_arr + argc;
-
-      if (user_out_of_range(ptr_ptr, sizeof(void *))) {
-         *rc = -1;
-         goto out;
-      }
-
-      /*
-       * OK, the double-pointer is in range, so we can de-reference it to
-       * read the single (char *) pointer. We don't care at the moment if the
-       * single pointer is valid, but we have to check whether it is NULL in
-       * order to calculate 'argc'.
-       */
-
-      if (!*ptr_ptr)
-         break;
-   }
-
-   if ((char *)&dest_arr[argc] > dest_end - sizeof(void *)) {
-      *rc = 1;
-      goto out;
-   }
-
-   /* this is safe, we've just checked that */
-   WRITE_PTR(&dest_arr[argc], NULL);
+      *written_ptr = 0;
 
-   after_ptrs_arr = (char *) &dest_arr[argc + 1];
-   written += (u32)(after_ptrs_arr - (char *)dest_arr);
-
-   for (int i = 0; i < argc; i++) {
-
-      size_t local_written = 0;
-      WRITE_PTR(&dest_arr[i], after_ptrs_arr);
-
-      internal_copy_user_str(after_ptrs_arr,
-                             user_arr[i],
-                             dest_end,
-                             &local_written,
-                             rc);
-
-      if (*rc != 0)
-         break;
+   do {
 
-      written += local_written;
-      after_ptrs_arr += local_written;
-   }
+      if (d >= (char *)dest + max_size)
+         return 1;
 
-out:
-   *written_ptr = written;
-}
+      if (get_user(*d, ptr++))
+         return -1;
 
+   } while (*d++);
 
-int copy_str_array_from_user(void *dest,
-                             const char *const *user_arr,
-                             size_t max_size,
-                             size_t *written_ptr)
-{
-   int rc;
-   u32 faults;
-
-   faults = fault_resumable_call(PAGE_FAULT_MASK,
-                                 internal_copy_str_array_from_user,
-                                 5,
-                                 dest,
-                                 user_arr,
-                                 max_size,
-                                 written_ptr,
-                                 &rc);
-
-   if (faults)
-      return -1;
+   if (written_ptr)
+      *written_ptr = (size_t)(d - (char *)dest); /* counting the final \0 */
 
-   return rc;
+   return 0;
 }
 
 int duplicate_user_path(char *dest,
@@ -218,32 +95,165 @@ int duplicate_user_path(char *dest,
    return 0;
 }
 
-int duplicate_user_argv(char *dest,
-                        const char *const *user_argv,
-                        size_t dest_size,
-                        size_t *written_ptr /* IN/OUT */)
+#define EXEC_ARGS_BUF_SIZE             (USER_ARGS_MAX_PAGES * PAGE_SIZE)
+
+int exec_args_init(struct exec_args *a)
 {
+   size_t size = EXEC_ARGS_BUF_SIZE;
+
+   *a = (struct exec_args) {
+      .acc = 2 * sizeof(void *),    /* the final NULL pointers of argv, env */
+   };
+
+   if (!(a->buf = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return -ENOMEM;
+
+   ASSERT(size == EXEC_ARGS_BUF_SIZE);
+   return 0;
+}
+
+void exec_args_destroy(struct exec_args *a)
+{
+   size_t size = EXEC_ARGS_BUF_SIZE;
+
+   if (a->buf && !a->mapped)
+      general_kfree(a->buf, &size, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+
+   a->buf = NULL;
+}
+
+static int
+exec_args_add_str(struct exec_args *a, const char *str, bool user_str)
+{
+   size_t len, max;
    int rc;
-   size_t curr_written = 0;
 
-   if (*written_ptr >= dest_size)
+   if (a->acc + sizeof(void *) >= EXEC_ARGS_BUF_SIZE)
       return -E2BIG;
 
-   rc = copy_str_array_from_user(dest + *written_ptr,
-                                 user_argv,
-                                 dest_size - *written_ptr,
-                                 &curr_written);
+   /* What's left for the string, after accounting its pointer */
+   max = EXEC_ARGS_BUF_SIZE - a->acc - sizeof(void *);
 
-   if (rc < 0)
-      return -EFAULT;
+   if (user_str) {
 
-   if (rc > 0)
+      if ((rc = copy_str_from_user(a->buf + a->size, str, max, &len)))
+         return rc < 0 ? -EFAULT : -E2BIG;
+
+   } else {
+
+      if ((len = strlen(str) + 1) > max)
+         return -E2BIG;
+
+      memcpy(a->buf + a->size, str, len);
+   }
+
+   a->size += len;
+   a->acc += len + sizeof(void *);
+   return 0;
+}
+
+int
+exec_args_add_arr(struct exec_args *a,
+                  const char *const *arr,
+                  bool user_arr,
+                  bool env)
+{
+   const char *str;
+   int rc;
+
+   ASSERT(!a->mapped);
+   ASSERT(env || !a->envc);
+
+   for (u32 i = 0; ; i++) {
+
+      if (user_arr) {
+
+         if (get_user(str, arr + i))
+            return -EFAULT;
+
+      } else {
+
+         str = READ_PTR(&arr[i]);
+      }
+
+      if (!str)
+         break;
+
+      if ((rc = exec_args_add_str(a, str, user_arr)))
+         return rc;
+
+      if (env)
+         a->envc++;
+      else
+         a->argc++;
+   }
+
+   return 0;
+}
+
+int
+exec_args_replace_arg0(struct exec_args *a, const char *const *strs, u32 n)
+{
+   const size_t len0 = a->argc ? strlen(a->buf) + 1 : 0;
+   size_t new_len = 0, acc, len;
+   char *p = a->buf;
+
+   ASSERT(!a->mapped);
+
+   for (u32 i = 0; i < n; i++)
+      new_len += strlen(strs[i]) + 1;
+
+   acc = a->acc + new_len + n * sizeof(void *);
+   acc -= len0 + (a->argc ? sizeof(void *) : 0);
+
+   if (acc > EXEC_ARGS_BUF_SIZE)
       return -E2BIG;
 
-   *written_ptr += curr_written;
+   memmove(a->buf + new_len, a->buf + len0, a->size - len0);
+
+   for (u32 i = 0; i < n; i++) {
+      len = strlen(strs[i]) + 1;
+      memcpy(p, strs[i], len);
+      p += len;
+   }
+
+   a->size = a->size - len0 + new_len;
+   a->acc = acc;
+   a->argc = a->argc - !!len0 + n;
    return 0;
 }
 
+size_t exec_args_pages(const struct exec_args *a)
+{
+   return MAX(1ul, pow2_round_up_at(a->size, PAGE_SIZE) >> PAGE_SHIFT);
+}
+
+ulong exec_args_user_vaddr(const struct exec_args *a)
+{
+   return USERMODE_VADDR_END - (exec_args_pages(a) << PAGE_SHIFT);
+}
+
+size_t
+exec_args_vec_size(const struct exec_args *a,
+                   const struct elf_program_info *pinfo)
+{
+   const size_t len = (
+      1 + // argc
+      a->argc +
+      1 + // mandatory final NULL pointer (end of 'argv')
+      a->envc +
+      1 + // mandatory final NULL pointer (end of 'env' ptrs)
+      2 * !!pinfo->interp_base + // AT_BASE vector
+      2 * 3 * !!pinfo->phdrs + // AT_PHDR, AT_PHENT, AT_PHNUM vectors
+      2 + // AT_ENTRY vector
+      2 * 2 * VDSO_HAS_ELF_IMAGE + // AT_SYSINFO_EHDR, AT_SYSINFO vectors
+      2 + // AT_PAGESZ vector
+      2   // AT_NULL vector
+   ) * sizeof(ulong);
+
+   return round_up_at(len, USERMODE_STACK_ALIGN);
+}
+
 void push_on_stack(ulong **stack_ptr_ref, ulong val)
 {
    (*stack_ptr_ref)--;     // Decrease the value of the stack pointer
@@ -266,95 +276,78 @@ void push_on_user_stack(regs_t *r, ulong val)
    regs_set_usersp(r, user_sp);
 }
 
-void push_string_on_user_stack(regs_t *r, const char *str)
+static ulong *
+put_str_pointers(ulong *p, const char **str_ref, ulong *vaddr_ref, u32 n)
 {
-   const size_t len = strlen(str) + 1; // count also the '\0'
-   const size_t aligned_len = round_down_at(len, USERMODE_STACK_ALIGN);
-   const size_t rem = len - aligned_len;
+   for (u32 i = 0; i < n; i++) {
 
-   ulong user_sp = regs_get_usersp(r);
-   user_sp -= aligned_len + (rem > 0 ? USERMODE_STACK_ALIGN : 0);
-   regs_set_usersp(r, user_sp);
-   memcpy(TO_PTR(user_sp), str, aligned_len);
+      const size_t len = strlen(*str_ref) + 1; // count also the '\0'
 
-   if (rem > 0) {
-      char smallbuf[USERMODE_STACK_ALIGN] = {0};
-      memcpy(&smallbuf, str + aligned_len, rem);
-      memcpy(TO_PTR(user_sp + aligned_len), &smallbuf, sizeof(smallbuf));
+      *p++ = *vaddr_ref;
+      *str_ref += len;
+      *vaddr_ref += len;
    }
+
+   *p++ = 0; // mandatory final NULL pointer
+   return p;
 }
 
-int
+void
 push_args_on_user_stack(regs_t *r,
-                        const char *const *argv,
-                        u32 argc,
-                        const char *const *env,
-                        u32 envc)
+                        const struct elf_program_info *pinfo,
+                        const struct exec_args *a)
 {
-   ulong pointers[32];
-   ulong env_pointers[96];
-   ulong aligned_len, len, rem;
-
-   if (argc > ARRAY_SIZE(pointers))
-      return -E2BIG;
+   const ulong user_sp = regs_get_usersp(r) - exec_args_vec_size(a, pinfo);
+   ulong vaddr = exec_args_user_vaddr(a);
+   const char *str = a->buf;
+   ulong *p = TO_PTR(user_sp);
+
+   ASSERT(a->mapped);
+   ASSERT(regs_get_usersp(r) == vaddr);
+
+   /*
+    * The strings are already in place, right above the vectors: we just have
+    * to fill them, from the bottom, starting with argc. The alignment padding
+    * at the end, if any, is already zero because the pages are fresh.
+    */
+   regs_set_usersp(r, user_sp);
+   *p++ = a->argc;
 
-   if (envc > ARRAY_SIZE(env_pointers))
-      return -E2BIG;
+   p = put_str_pointers(p, &str, &vaddr, a->argc); // the argv array
+   p = put_str_pointers(p, &str, &vaddr, a->envc); // the env array
 
-   // push argv data on stack (it could be anywhere else, as well)
-   for (u32 i = 0; i < argc; i++) {
-      push_string_on_user_stack(r, READ_PTR(&argv[i]));
-      pointers[i] = regs_get_usersp(r);
-   }
+   // the aux array
 
-   // push env data on stack (it could be anywhere else, as well)
-   for (u32 i = 0; i < envc; i++) {
-      push_string_on_user_stack(r, READ_PTR(&env[i]));
-      env_pointers[i] = regs_get_usersp(r);
+   if (pinfo->interp_base) {
+      *p++ = AT_BASE;
+      *p++ = (ulong)pinfo->interp_base;
    }
 
-   // make stack pointer align to 16 bytes
-
-   len = (
-      2 + // AT_NULL vector
-      2 + // AT_PAGESZ vector
-      1 + // mandatory final NULL pointer (end of 'env' ptrs)
-      envc +
-      1 + // mandatory final NULL pointer (end of 'argv')
-      argc +
-      1   // push argc as last (since it will be the first to be pop-ed)
-   ) * sizeof(ulong);
-   aligned_len = round_up_at(len, USERMODE_STACK_ALIGN);
-   rem = aligned_len - len;
-
-   for (u32 i = 0; i < rem / sizeof(ulong); i++) {
-      push_on_user_stack(r, 0);
+   if (pinfo->phdrs) {
+      *p++ = AT_PHDR;
+      *p++ = (ulong)pinfo->phdrs;
+      *p++ = AT_PHENT;
+      *p++ = sizeof(Elf_Phdr);
+      *p++ = AT_PHNUM;
+      *p++ = pinfo->phnum;
    }
 
-   // push the aux array (in reverse order)
-
-   push_on_user_stack(r, AT_NULL); // AT_NULL vector
-   push_on_user_stack(r, 0);
-
-   push_on_user_stack(r, PAGE_SIZE); // AT_PAGESZ vector
-   push_on_user_stack(r, AT_PAGESZ);
-
-   // push the env array (in reverse order)
+   /* Needed by the dynamic linker, if any, in order to start the program */
+   *p++ = AT_ENTRY;
+   *p++ = (ulong)pinfo->prog_entry;
 
-   push_on_user_stack(r, 0); // mandatory final NULL pointer (end of 'env' ptrs)
+#if VDSO_HAS_ELF_IMAGE
+   *p++ = AT_SYSINFO_EHDR;
+   *p++ = USER_VDSO_VADDR;
 
-   for (u32 i = envc; i > 0; i--) {
-      push_on_user_stack(r, env_pointers[i - 1]);
-   }
-
-   // push the argv array (in reverse order)
-   push_on_user_stack(r, 0); // mandatory final NULL pointer (end of 'argv')
+   /* The fast syscall entry point (sysenter), used by libc when available */
+   *p++ = AT_SYSINFO;
+   *p++ = kernel_vsyscall_user_vaddr;
+#endif
 
-   for (u32 i = argc; i > 0; i--) {
-      push_on_user_stack(r, pointers[i - 1]);
-   }
+   *p++ = AT_PAGESZ;
+   *p++ = PAGE_SIZE;
 
-   // push argc as last (since it will be the first to be pop-ed)
-   push_on_user_stack(r, (ulong)argc);
-   return 0;
+   *p++ = AT_NULL;
+   *p++ = 0;
 }
@@ -78,6 +78,67 @@ get_task_if_changed(struct task *ti, int opts)
    return NULL;
 }
 
+static bool
+has_pending_state_change(struct task *ti)
+{
+   enum task_state s = atomic_load_explicit(&ti->state, mo_relaxed);
+   return s == TASK_STATE_ZOMBIE || ti->stopped != ti->was_stopped;
+}
+
+static void
+wstatus_queue_remove(struct task *ti)
+{
+   list_remove(&ti->wstatus_node);
+   list_node_init(&ti->wstatus_node);
+}
+
+static void
+wstatus_queue_add(struct process *parent_pi, struct task *ti)
+{
+   if (list_node_is_empty(&ti->wstatus_node))
+      list_add_tail(&parent_pi->wstatus_queue, &ti->wstatus_node);
+}
+
+/*
+ * Moves the pending state change of `ti` (if any) from the queue of its old
+ * parent to the one of `new_parent_pi`. Used when `ti` gets re-parented.
+ */
+void wstatus_queue_move(struct task *ti, struct process *new_parent_pi)
+{
+   ASSERT(!is_preemption_enabled());
+
+   if (!list_node_is_empty(&ti->wstatus_node)) {
+      wstatus_queue_remove(ti);
+      wstatus_queue_add(new_parent_pi, ti);
+   }
+}
+
+static u32
+count_children_to_wait(struct process *pi, int tid)
+{
+   struct task *curr = get_curr_task();
+   struct task *pos;
+   u32 cnt = 0;
+
+   if (tid == -1)
+      return !list_is_empty(&pi->children);
+
+   list_for_each_ro(pos, &pi->children, siblings_node) {
+      if (!waitpid_should_skip_child(curr, pos, tid))
+         cnt++;
+   }
+
+   return cnt;
+}
+
+/*
+ * Instead of visiting all the children, visit only the ones in the queue of
+ * state changes of `pi`. A child is added there by wake_up_tasks_waiting_on()
+ * when it dies, stops or continues and gets removed when its state change has
+ * been consumed (or its task freed). Only when there's nothing to report, we
+ * need to count the children matching `tid`, in order to distinguish between
+ * ECHILD and having to sleep.
+ */
 static struct task *
 get_child_with_changed_status(struct process *pi,
                               int tid,
@@ -85,23 +146,30 @@ get_child_with_changed_status(struct process *pi,
                               u32 *child_cnt_ref)
 {
    struct task *curr = get_curr_task();
-   struct task *chtask = NULL;
-   struct task *pos;
-   u32 cnt = 0;
+   struct task *pos, *temp;
 
-   list_for_each_ro(pos, &pi->children, siblings_node) {
+   list_for_each(pos, temp, &pi->wstatus_queue, wstatus_node) {
 
       if (waitpid_should_skip_child(curr, pos, tid))
          continue;
 
-      cnt++;
+      if (get_task_if_changed(pos, opts)) {
+
+         /* Zombie tasks leave the queue when they're freed */
+         if (pos->state != TASK_STATE_ZOMBIE)
+            wstatus_queue_remove(pos);
 
-      if ((chtask = get_task_if_changed(pos, opts)))
-         break;
+         *child_cnt_ref = 1;
+         return pos;
+      }
+
+      /* E.g. stopped and then continued before anybody waited for it */
+      if (!has_pending_state_change(pos))
+         wstatus_queue_remove(pos);
    }
 
-   *child_cnt_ref = cnt;
-   return chtask;
+   *child_cnt_ref = count_children_to_wait(pi, tid);
+   return NULL;
 }
 
 static bool
@@ -159,6 +227,8 @@ void wake_up_tasks_waiting_on(struct task *ti, enum wakeup_reason r)
       struct task *parent_task = get_task(pi->parent_pid);
       int tid;
 
+      wstatus_queue_add(parent_task->pi, ti);
+
       if (is_waiting_on_multiple_children(parent_task, &tid)      &&
           !waitpid_should_skip_child(parent_task, ti, tid)        &&
           is_good_reason_to_wake_up_task(&parent_task->wobj, r))
@@ -257,24 +327,25 @@ int sys_wait4(int tid, int *user_wstatus, int options, void *user_rusage)
    ASSERT(!is_preemption_enabled());
 
    if (user_wstatus) {
-      if (copy_to_user(user_wstatus, &chtask->wstatus, sizeof(s32)) < 0)
+      if (put_user(chtask->wstatus, user_wstatus))
          chtask_tid = -EFAULT;
    }
 
    if (user_rusage) {
 
       struct k_rusage ru = {0};
-      struct k_timespec64 tp;
-      u64 user_ticks = chtask->ticks.total - chtask->ticks.total_kernel;
+      struct k_timespec64 utime, stime;
+
+      task_get_cputime(chtask, &utime, &stime);
 
-      ticks_to_timespec(user_ticks, &tp);
+      ru.ru_utime.tv_sec = (long) utime.tv_sec;
+      ru.ru_utime.tv_usec = utime.tv_nsec / 1000;
 
-      ru.ru_utime.tv_sec = (long) tp.tv_sec;
-      ru.ru_utime.tv_usec = tp.tv_nsec / 1000;
+      ru.ru_stime.tv_sec = (long) stime.tv_sec;
+      ru.ru_stime.tv_usec = stime.tv_nsec / 1000;
 
-      ticks_to_timespec(chtask->ticks.total_kernel, &tp);
-      ru.ru_stime.tv_sec = (long) tp.tv_sec;
-      ru.ru_stime.tv_usec = tp.tv_nsec / 1000;
+      ru.ru_nvcsw = (long) chtask->sched_stats.nvcsw;
+      ru.ru_nivcsw = (long) chtask->sched_stats.nivcsw;
 
       if (copy_to_user(user_rusage, &ru, sizeof(ru)) < 0)
          chtask_tid = -EFAULT;
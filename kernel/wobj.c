@@ -3,9 +3,12 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/mods/tracing.h>
 
 void wait_obj_set(struct wait_obj *wo,
                   enum wo_type type,
@@ -22,6 +25,7 @@ void wait_obj_set(struct wait_obj *wo,
 
       wo->type = type;
       wo->extra = extra;
+      wo->exclusive = false;
       list_node_init(&wo->wait_list_node);
 
       if (wait_list)
@@ -85,6 +89,8 @@ void *wake_up(struct task *ti)
 
       if (ti != get_curr_task()) {
 
+         trace_point(tp_sched_wakeup, ti->tid, 0, 0);
+
          /*
           * TODO: if SMP will be ever introduced, here we should call a
           * function that does NOT "downgrade" a task from RUNNING to RUNNABLE.
@@ -99,17 +105,61 @@ void *wake_up(struct task *ti)
 
 /* Multi wait obj stuff */
 
-struct multi_obj_waiter *allocate_mobj_waiter(int elems)
+/*
+ * Each task keeps the largest waiter it used so far, up to
+ * MOBJ_WAITER_CACHE_MAX bytes, and reuses it in the next poll() or select()
+ * calls instead of allocating a new one. Larger or nested requests fall back
+ * to temporary allocations.
+ */
+#define MOBJ_WAITER_CACHE_MAX                   (16 * KB)
+#define MOBJ_WAITER_CACHE_UNIT                  8
+
+static inline size_t mobj_waiter_size(int elems)
 {
-   size_t s =
-      sizeof(struct multi_obj_waiter) + sizeof(struct mwobj_elem) * (u32)elems;
+   return sizeof(struct multi_obj_waiter) +
+          sizeof(struct mwobj_elem) * (u32)elems;
+}
 
-   struct multi_obj_waiter *w = task_temp_kernel_alloc(s);
+static struct multi_obj_waiter *get_cached_mobj_waiter(int elems)
+{
+   struct task *curr = get_curr_task();
+   struct multi_obj_waiter *w = curr->mobj_waiter;
+   const int cap = (int)pow2_round_up_at((ulong)elems, MOBJ_WAITER_CACHE_UNIT);
 
-   if (!w)
+   if (w && w->in_use)
       return NULL;
 
-   bzero(w, s);
+   if (!w || w->cap < elems) {
+
+      if (mobj_waiter_size(cap) > MOBJ_WAITER_CACHE_MAX)
+         return NULL;
+
+      if (!(w = kmalloc(mobj_waiter_size(cap))))
+         return NULL;
+
+      free_task_mobj_waiter(curr);
+      curr->mobj_waiter = w;
+      w->cap = cap;
+   }
+
+   w->in_use = true;
+   return w;
+}
+
+struct multi_obj_waiter *allocate_mobj_waiter(int elems)
+{
+   struct multi_obj_waiter *w = get_cached_mobj_waiter(elems);
+
+   if (!w) {
+
+      if (!(w = task_temp_kernel_alloc(mobj_waiter_size(elems))))
+         return NULL;
+
+      w->cap = elems;
+      w->in_use = false;
+   }
+
+   bzero(w->elems, sizeof(struct mwobj_elem) * (u32)elems);
    w->count = elems;
    return w;
 }
@@ -123,9 +173,26 @@ void free_mobj_waiter(struct multi_obj_waiter *w)
       mobj_waiter_reset2(w, i);
    }
 
+   if (w == get_curr_task()->mobj_waiter) {
+      w->in_use = false;
+      return;
+   }
+
    task_temp_kernel_free(w);
 }
 
+void free_task_mobj_waiter(struct task *ti)
+{
+   struct multi_obj_waiter *w = ti->mobj_waiter;
+
+   if (!w)
+      return;
+
+   ASSERT(!w->in_use);
+   ti->mobj_waiter = NULL;
+   kfree2(w, mobj_waiter_size(w->cap));
+}
+
 void
 mobj_waiter_set(struct multi_obj_waiter *w,
                 int index,
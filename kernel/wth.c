@@ -24,6 +24,11 @@ u32 wth_get_queue_size(struct worker_thread *wth)
    return wth->rb.max_elems;
 }
 
+u32 wth_get_pending_jobs(struct worker_thread *wth)
+{
+   return mpmc_ringbuf_get_elems(&wth->rb);
+}
+
 struct task *wth_get_task(struct worker_thread *wth)
 {
    return wth->task;
@@ -40,6 +45,23 @@ wth_get_name(struct worker_thread *wth)
    return wth->name;
 }
 
+const struct wth_stats *
+wth_get_stats(struct worker_thread *wth)
+{
+   return &wth->stats;
+}
+
+int wth_get_count(void)
+{
+   return worker_threads_cnt;
+}
+
+struct worker_thread *
+wth_get_by_index(int index)
+{
+   return index < worker_threads_cnt ? worker_threads[index] : NULL;
+}
+
 static long wth_cmp_func(const void *a, const void *b)
 {
    const struct worker_thread *const *wa = a;
@@ -56,7 +78,9 @@ wth_enqueue_on(struct worker_thread *t, void (*func)(void *), void *arg)
    struct wjob new_job = {
       .func = func,
       .arg = arg,
+      .enqueue_ticks = (u32)get_ticks(),
    };
+   u32 depth;
 
    disable_preemption();
 
@@ -79,10 +103,21 @@ wth_enqueue_on(struct worker_thread *t, void (*func)(void *), void *arg)
 
 #endif
 
-   success = safe_ringbuf_write_elem(&t->rb, &new_job, &was_empty);
+   success = mpmc_ringbuf_write_elem(&t->rb, &new_job, &was_empty);
+
+   if (success) {
+
+      t->stats.enqueued++;
+      depth = mpmc_ringbuf_get_elems(&t->rb);
+
+      if (depth > t->stats.max_depth)
+         t->stats.max_depth = (u16)depth;
 
-   if (success && was_empty && t->waiting_for_jobs) {
-      wth_wakeup(t);
+      if (was_empty && t->waiting_for_jobs)
+         wth_wakeup(t);
+
+   } else {
+      t->stats.dropped++;
    }
 
    enable_preemption();
@@ -136,14 +171,29 @@ wth_find_worker(int lowest_prio)
    return worker_threads[0];
 }
 
+static void wth_account_latency(struct worker_thread *t, struct wjob *job)
+{
+   u32 waited = (u32)get_ticks() - job->enqueue_ticks;
+   int b = 0;
+
+   /* Bucket `b` counts the jobs that waited [2^(b-1), 2^b) ticks */
+   for (; waited && b < WTH_LATENCY_BUCKETS - 1; b++)
+      waited >>= 1;
+
+   t->stats.latency[b]++;
+}
+
 bool wth_process_single_job(struct worker_thread *t)
 {
    bool success;
    struct wjob job_to_run;
 
-   success = safe_ringbuf_read_elem(&t->rb, &job_to_run);
+   success = mpmc_ringbuf_read_elem(&t->rb, &job_to_run);
 
    if (success) {
+
+      wth_account_latency(t, &job_to_run);
+
       /* Run the job with preemption enabled */
       job_to_run.func(job_to_run.arg);
    }
@@ -151,6 +201,56 @@ bool wth_process_single_job(struct worker_thread *t)
    return success;
 }
 
+static inline size_t wth_rb_buf_size(u32 queue_size)
+{
+   return mpmc_ringbuf_buf_size(queue_size, sizeof(struct wjob));
+}
+
+/*
+ * Makes the queue of `t` twice as big, up to WTH_MAX_QUEUE_SIZE, moving the
+ * pending jobs to the new one. Must be called by the worker thread itself:
+ * with the interrupts disabled, nobody else can be in the middle of a read or
+ * a write on the ring buffer (see mpmc_ringbuf_resize()).
+ */
+bool wth_grow_queue(struct worker_thread *t)
+{
+   const u32 old_size = t->rb.max_elems;
+   const u32 new_size = MIN(2u * old_size, (u32)WTH_MAX_QUEUE_SIZE);
+   void *new_buf, *old_buf;
+   ulong var;
+
+   if (new_size <= old_size)
+      return false;
+
+   if (!(new_buf = kmalloc(wth_rb_buf_size(new_size))))
+      return false;
+
+   disable_interrupts(&var);
+   {
+      old_buf = mpmc_ringbuf_resize(&t->rb, new_size, new_buf);
+      t->stats.grows++;
+   }
+   enable_interrupts(&var);
+
+   ASSERT(old_buf == t->rb_buf);
+   kfree2(old_buf, wth_rb_buf_size(old_size));
+   t->rb_buf = new_buf;
+   return true;
+}
+
+/*
+ * Jobs are enqueued also by IRQ handlers, which cannot allocate memory:
+ * grow the queue early, while it still has some free slots.
+ */
+static ALWAYS_INLINE void wth_grow_queue_if_needed(struct worker_thread *t)
+{
+   const u32 max_elems = t->rb.max_elems;
+
+   if (UNLIKELY(mpmc_ringbuf_get_elems(&t->rb) >= max_elems - max_elems / 4))
+      if (max_elems < WTH_MAX_QUEUE_SIZE)
+         wth_grow_queue(t);
+}
+
 void wth_run(void *arg)
 {
    struct worker_thread *t = arg;
@@ -166,13 +266,14 @@ void wth_run(void *arg)
 
       do {
 
+         wth_grow_queue_if_needed(t);
          job_run = wth_process_single_job(t);
 
       } while (job_run);
 
       disable_interrupts_forced();
       {
-         if (safe_ringbuf_is_empty(&t->rb)) {
+         if (mpmc_ringbuf_is_empty(&t->rb)) {
             t->task->state = TASK_STATE_SLEEPING;
             t->waiting_for_jobs = true;
          }
@@ -223,22 +324,19 @@ wth_create_thread(const char *name, int priority, u16 queue_size)
    idx = worker_threads_cnt;
    t->name = name;
    t->priority = priority;
-   t->jobs = kzalloc_array_obj(struct wjob, queue_size);
+   t->rb_buf = kmalloc(wth_rb_buf_size(queue_size));
 
-   if (!t->jobs) {
+   if (!t->rb_buf) {
       kfree_obj(t, struct worker_thread);
       return NULL;
    }
 
    kcond_init(&t->completion);
 
-   safe_ringbuf_init(&t->rb,
-                     queue_size,
-                     sizeof(struct wjob),
-                     t->jobs);
+   mpmc_ringbuf_init(&t->rb, queue_size, sizeof(struct wjob), t->rb_buf);
 
    if ((rc = wth_create_thread_for(t))) {
-      kfree_array_obj(t->jobs, struct wjob, queue_size);
+      kfree2(t->rb_buf, wth_rb_buf_size(queue_size));
       kfree_obj(t, struct worker_thread);
       return NULL;
    }
@@ -261,6 +359,51 @@ wth_wait_for_completion(struct worker_thread *wth)
       kcond_wait(&wth->completion, NULL, TIMER_HZ / 10);
 }
 
+/*
+ * The ktimers fire in the highest-priority worker thread and a worker cannot
+ * enqueue jobs on itself (see wth_enqueue_on()): the delayed jobs are moved,
+ * when their timer fires, on another worker thread.
+ */
+static void wth_delayed_job_fired(struct ktimer *t)
+{
+   struct wth_delayed_job *dj = CONTAINER_OF(t, struct wth_delayed_job, timer);
+   struct worker_thread *wth = dj->wth;
+
+   if (!wth)
+      wth = wth_find_worker(WTH_PRIO_LOWEST);
+
+   ASSERT(wth != worker_threads[0]);
+
+   if (!wth_enqueue_on(wth, dj->func, dj->arg)) {
+      /* The queue is full: just retry on the next tick */
+      ktimer_arm(&dj->timer, get_ticks() + 1);
+   }
+}
+
+void
+wth_delayed_job_init(struct wth_delayed_job *dj,
+                     struct worker_thread *wth,
+                     void (*func)(void *),
+                     void *arg)
+{
+   ktimer_init(&dj->timer, &wth_delayed_job_fired);
+   dj->wth = wth;
+   dj->func = func;
+   dj->arg = arg;
+}
+
+void
+wth_enqueue_delayed(struct wth_delayed_job *dj, u64 ticks)
+{
+   ktimer_arm(&dj->timer, get_ticks() + MAX(ticks, 1ull));
+}
+
+void
+wth_cancel_delayed(struct wth_delayed_job *dj)
+{
+   ktimer_cancel(&dj->timer);
+}
+
 static void
 init_wth_create_worker_or_die(int prio, u16 queue_size)
 {
@@ -272,4 +415,7 @@ void init_worker_threads(void)
 {
    worker_threads_cnt = 0;
    init_wth_create_worker_or_die(0, WTH_MAX_PRIO_QUEUE_SIZE);
+
+   /* Low-priority jobs and delayed jobs (see wth_delayed_job_init()) */
+   init_wth_create_worker_or_die(WTH_PRIO_LOWEST, WTH_LOW_PRIO_QUEUE_SIZE);
 }
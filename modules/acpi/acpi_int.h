@@ -26,6 +26,10 @@ register_acpi_obj_in_sysfs(ACPI_HANDLE parent_obj,
                            ACPI_HANDLE obj,
                            ACPI_DEVICE_INFO *obj_info);
 
+/* Wake up the processes polling the sysfs files of `obj` */
+void
+acpi_sysfs_notify_obj(ACPI_HANDLE obj);
+
 bool
 acpi_has_method(ACPI_HANDLE obj, const char *name);
 
@@ -30,6 +30,9 @@ static u8 acpi_fadt_revision;
 static u16 acpi_iapc_boot_arch;
 static u32 acpi_fadt_flags;
 
+/* Processors and interrupt controllers read from MADT */
+static struct acpi_madt_info acpi_madt_info;
+
 /* Callback lists */
 static struct list on_subsystem_enabled_cb_list
    = STATIC_LIST_INIT(on_subsystem_enabled_cb_list);
@@ -151,6 +154,125 @@ acpi_read_acpi_hw_flags(void)
    AcpiPutTable((struct acpi_table_header *)fadt);
 }
 
+const struct acpi_madt_info *
+acpi_get_madt_info(void)
+{
+   return acpi_madt_info.cpus ? &acpi_madt_info : NULL;
+}
+
+static void
+acpi_madt_add_cpu(u32 lapic_id, u32 lapic_flags)
+{
+   struct acpi_madt_info *mi = &acpi_madt_info;
+
+   if (lapic_flags & ACPI_MADT_ENABLED) {
+
+      /* x2APIC-only ids (> 255) cannot be targeted in xAPIC mode */
+      if (lapic_id <= 0xff && mi->lapic_ids_count < ARRAY_SIZE(mi->lapic_ids))
+         mi->lapic_ids[mi->lapic_ids_count++] = (u8)lapic_id;
+
+      mi->cpus++;
+
+   } else if (lapic_flags & ACPI_MADT_ONLINE_CAPABLE) {
+      mi->online_capable_cpus++;
+   }
+}
+
+static void
+acpi_madt_add_ioapic(struct acpi_madt_io_apic *e)
+{
+   if (e->GlobalIrqBase == 0)
+      acpi_madt_info.ioapic_paddr = e->Address;
+
+   acpi_madt_info.ioapics++;
+}
+
+static void
+acpi_madt_add_override(struct acpi_madt_interrupt_override *e)
+{
+   const u16 bit = (u16)(1u << e->SourceIrq);
+   const u16 polarity = e->IntiFlags & ACPI_MADT_POLARITY_MASK;
+   const u16 trigger = e->IntiFlags & ACPI_MADT_TRIGGER_MASK;
+
+   if (e->Bus != 0 || e->SourceIrq >= 16)
+      return; /* Not an ISA IRQ */
+
+   /* "Conforms" means the bus default: edge-triggered, active-high for ISA */
+   acpi_madt_info.isa_irq_gsi[e->SourceIrq] = e->GlobalIrq;
+
+   if (polarity == ACPI_MADT_POLARITY_ACTIVE_LOW)
+      acpi_madt_info.isa_irq_low_mask |= bit;
+
+   if (trigger == ACPI_MADT_TRIGGER_LEVEL)
+      acpi_madt_info.isa_irq_level_mask |= bit;
+}
+
+static void
+acpi_read_madt(void)
+{
+   ACPI_STATUS rc;
+   struct acpi_table_madt *madt;
+   struct acpi_subtable_header *h;
+   char *p, *end;
+
+   rc = AcpiGetTable(ACPI_SIG_MADT, 1, (struct acpi_table_header **)&madt);
+
+   if (rc == AE_NOT_FOUND)
+      return;
+
+   if (ACPI_FAILURE(rc)) {
+      print_acpi_failure("AcpiGetTable", "MADT", rc);
+      return;
+   }
+
+   acpi_madt_info.lapic_paddr = madt->Address;
+   acpi_madt_info.has_8259 = !!(madt->Flags & ACPI_MADT_PCAT_COMPAT);
+
+   for (u32 i = 0; i < ARRAY_SIZE(acpi_madt_info.isa_irq_gsi); i++)
+      acpi_madt_info.isa_irq_gsi[i] = i;
+
+   p = (char *)madt + sizeof(*madt);
+   end = (char *)madt + madt->Header.Length;
+
+   for (; p + sizeof(*h) <= end; p += h->Length) {
+
+      h = (void *)p;
+
+      if (!h->Length)
+         break; /* Broken table */
+
+      switch (h->Type) {
+
+         case ACPI_MADT_TYPE_LOCAL_APIC:
+            acpi_madt_add_cpu(((struct acpi_madt_local_apic *)h)->Id,
+                              ((struct acpi_madt_local_apic *)h)->LapicFlags);
+            break;
+
+         case ACPI_MADT_TYPE_LOCAL_X2APIC:
+            acpi_madt_add_cpu(
+               ((struct acpi_madt_local_x2apic *)h)->LocalApicId,
+               ((struct acpi_madt_local_x2apic *)h)->LapicFlags
+            );
+            break;
+
+         case ACPI_MADT_TYPE_IO_APIC:
+            acpi_madt_add_ioapic((void *)h);
+            break;
+
+         case ACPI_MADT_TYPE_INTERRUPT_OVERRIDE:
+            acpi_madt_add_override((void *)h);
+            break;
+      }
+   }
+
+   AcpiPutTable((struct acpi_table_header *)madt);
+
+   printk("ACPI: MADT: %u CPU(s), %u I/O APIC(s), LAPIC at %#x\n",
+          acpi_madt_info.cpus,
+          acpi_madt_info.ioapics,
+          acpi_madt_info.lapic_paddr);
+}
+
 void
 acpi_reboot(void)
 {
@@ -280,6 +402,7 @@ acpi_mod_init_tables(void)
 
    acpi_init_status = ais_tables_initialized;
    acpi_read_acpi_hw_flags();
+   acpi_read_madt();
 }
 
 void
@@ -579,6 +702,7 @@ static struct module acpi_module = {
    .name = "acpi",
    .priority = MOD_acpi_prio,
    .init = &acpi_module_init,
+   .deps = MOD_DEPS("pci"),
 };
 
 REGISTER_MODULE(&acpi_module);
@@ -654,6 +654,15 @@ register_acpi_obj_in_sysfs(ACPI_HANDLE parent_obj,
    return AE_OK;
 }
 
+void
+acpi_sysfs_notify_obj(ACPI_HANDLE obj)
+{
+   void *s_obj;
+
+   if (ACPI_SUCCESS(AcpiGetData(obj, &acpi_sysobj_data_dtor, &s_obj)))
+      sysfs_notify(s_obj, NULL);
+}
+
 #else
 
 ACPI_STATUS
@@ -664,4 +673,10 @@ register_acpi_obj_in_sysfs(ACPI_HANDLE parent_obj,
    return AE_OK;
 }
 
+void
+acpi_sysfs_notify_obj(ACPI_HANDLE obj)
+{
+   /* Nothing to do */
+}
+
 #endif
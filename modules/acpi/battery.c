@@ -11,6 +11,7 @@
 #include "acpi_int.h"
 
 static struct list batteries_list = STATIC_LIST_INIT(batteries_list);
+static struct list notify_cb_list = STATIC_LIST_INIT(notify_cb_list);
 
 struct battery {
 
@@ -266,6 +267,24 @@ acpi_get_all_batteries_charge_per_mille(ulong *ret)
    return 0;
 }
 
+void acpi_reg_on_battery_notify_cb(struct acpi_reg_callback_node *cbnode)
+{
+   list_add_tail(&notify_cb_list, &cbnode->node);
+}
+
+static void
+battery_notify_handler(ACPI_HANDLE obj, UINT32 value, void *ctx)
+{
+   struct acpi_reg_callback_node *pos;
+
+   /* The battery's status changed: its charge, charging state etc. */
+   acpi_sysfs_notify_obj(obj);
+
+   list_for_each_ro(pos, &notify_cb_list, node) {
+      pos->cb(pos->ctx);
+   }
+}
+
 static ACPI_STATUS
 on_battery_cb(void *obj_handle,
               void *device_info,
@@ -287,6 +306,17 @@ on_battery_cb(void *obj_handle,
    }
 
    list_add_tail(&batteries_list, &b->node);
+
+   rc = AcpiInstallNotifyHandler(obj_handle,
+                                 ACPI_DEVICE_NOTIFY,
+                                 &battery_notify_handler,
+                                 b);
+
+   if (ACPI_FAILURE(rc)) {
+      print_acpi_failure("AcpiInstallNotifyHandler", NULL, rc);
+      /* NOTE: Don't consider it as a fatal failure */
+   }
+
    return AE_OK;
 }
 
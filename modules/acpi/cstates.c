@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/idle.h>
+
+#include "acpi_int.h"
+
+/* The Generic Register Descriptor (ACPI spec, 6.4.3.7), as found in _CST */
+struct PACKED cst_gen_reg {
+
+   u8 tag;                 /* 0x82 */
+   u16 len;
+   u8 space_id;
+   u8 bit_width;           /* FFH: vendor */
+   u8 bit_offset;          /* FFH: class */
+   u8 access_size;
+   u64 address;            /* FFH: the MWAIT hint */
+};
+
+#define CST_GEN_REG_TAG                  0x82
+
+static bool
+cst_get_int(ACPI_OBJECT *obj, u32 *val)
+{
+   if (obj->Type != ACPI_TYPE_INTEGER)
+      return false;
+
+   *val = (u32)obj->Integer.Value;
+   return true;
+}
+
+static void
+cst_register_state(ACPI_OBJECT *cst)
+{
+   ACPI_OBJECT *elems = cst->Package.Elements;
+   struct cst_gen_reg *reg;
+   enum idle_method method;
+   u32 type, latency;
+   char name[IDLE_STATE_NAME_LEN];
+   int rc;
+
+   if (cst->Type != ACPI_TYPE_PACKAGE || cst->Package.Count < 4)
+      return;
+
+   if (elems[0].Type != ACPI_TYPE_BUFFER)
+      return;
+
+   if (elems[0].Buffer.Length < sizeof(struct cst_gen_reg))
+      return;
+
+   if (!cst_get_int(&elems[1], &type) || !cst_get_int(&elems[2], &latency))
+      return;
+
+   reg = (void *)elems[0].Buffer.Pointer;
+
+   if (reg->tag != CST_GEN_REG_TAG)
+      return;
+
+   switch (reg->space_id) {
+
+      case ACPI_ADR_SPACE_FIXED_HARDWARE:
+         method = IDLE_M_MWAIT;
+         break;
+
+      case ACPI_ADR_SPACE_SYSTEM_IO:
+
+         if (type == 1)
+            return; /* C1 is always HLT, unless it's FFH */
+
+         method = IDLE_M_IO_PORT;
+         break;
+
+      default:
+         return;
+   }
+
+   snprintk(name, sizeof(name), "C%u", type);
+   rc = idle_register_state(name, method, (ulong)reg->address, latency);
+
+   if (rc) {
+      printk("ACPI: unable to use the idle state %s, error: %d\n", name, rc);
+      return;
+   }
+
+   printk("ACPI: idle state %s, %s %#lx, latency: %u us\n",
+          name,
+          method == IDLE_M_MWAIT ? "mwait" : "port",
+          (ulong)reg->address,
+          latency);
+}
+
+static ACPI_STATUS
+cst_on_processor(ACPI_HANDLE obj, UINT32 lvl, void *ctx, void **retval)
+{
+   ACPI_STATUS rc;
+   ACPI_BUFFER res;
+   ACPI_OBJECT *pkg;
+   u32 count;
+
+   res.Length = ACPI_ALLOCATE_BUFFER;
+   res.Pointer = NULL;
+
+   rc = AcpiEvaluateObject(obj, "_CST", NULL, &res);
+
+   if (ACPI_FAILURE(rc))
+      return AE_OK; /* No _CST: try with the next processor object */
+
+   pkg = res.Pointer;
+
+   /* _CST: { Count, CState, CState, ... } */
+   if (pkg->Type == ACPI_TYPE_PACKAGE &&
+       pkg->Package.Count >= 1 &&
+       cst_get_int(&pkg->Package.Elements[0], &count))
+   {
+      count = MIN(count, pkg->Package.Count - 1);
+
+      for (u32 i = 0; i < count; i++)
+         cst_register_state(&pkg->Package.Elements[i + 1]);
+   }
+
+   ACPI_FREE(res.Pointer);
+   *(bool *)ctx = true;
+
+   /*
+    * Tilck runs on a single CPU: the first processor object having a _CST
+    * method is enough.
+    */
+   return AE_CTRL_TERMINATE;
+}
+
+static ACPI_STATUS
+cstates_init(void *__ctx)
+{
+   bool found = false;
+
+   /* Old firmware uses the deprecated Processor object, the new one ACPI0007 */
+   AcpiWalkNamespace(ACPI_TYPE_PROCESSOR,
+                     ACPI_ROOT_OBJECT,
+                     ACPI_UINT32_MAX,
+                     &cst_on_processor,
+                     NULL,
+                     &found,
+                     NULL);
+
+   if (!found)
+      AcpiGetDevices("ACPI0007", &cst_on_processor, &found, NULL);
+
+   return AE_OK;
+}
+
+__attribute__((constructor))
+static void __reg_callbacks(void)
+{
+   static struct acpi_reg_callback_node cstates_init_cb = {
+      .cb = &cstates_init,
+      .ctx = NULL
+   };
+
+   list_node_init(&cstates_init_cb.node);
+   acpi_reg_on_full_init_cb(&cstates_init_cb);
+}
@@ -12,3 +12,7 @@ osl_init_tasks(void);
 
 ACPI_STATUS
 osl_init_irqs(void);
+
+/* Set by the SCI handler, see osl_hw.c */
+extern volatile u64 osl_last_sci_tsc;
+extern u32 osl_sci_count;
@@ -9,6 +9,8 @@
 #include <tilck/kernel/errno.h>
 #include <tilck/mods/pci.h>
 
+#include "osl.h"
+
 #include <3rd_party/acpi/acpi.h>
 #include <3rd_party/acpi/accommon.h>
 
@@ -17,12 +19,34 @@ ACPI_MODULE_NAME("osl_hw")
 STATIC_ASSERT(IRQ_HANDLED == ACPI_INTERRUPT_HANDLED);
 STATIC_ASSERT(IRQ_NOT_HANDLED == ACPI_INTERRUPT_NOT_HANDLED);
 
-static struct irq_handler_node *osl_irq_handlers;
+/*
+ * ACPICA installs an interrupt handler only for the SCI: wrap it in order to
+ * know when the last SCI fired. See osl_tasks.c.
+ */
+struct osl_irq {
+
+   struct irq_handler_node node;
+   ACPI_OSD_HANDLER routine;
+   void *ctx;
+};
+
+static struct osl_irq *osl_irq_handlers;
+volatile u64 osl_last_sci_tsc;
+u32 osl_sci_count;
+
+static enum irq_action osl_irq_handler(void *ctx)
+{
+   struct osl_irq *i = ctx;
+
+   osl_last_sci_tsc = RDTSC();
+   osl_sci_count++;
+   return (enum irq_action)i->routine(i->ctx);
+}
 
 ACPI_STATUS
 osl_init_irqs(void)
 {
-   osl_irq_handlers = kzalloc_array_obj(struct irq_handler_node, 16);
+   osl_irq_handlers = kzalloc_array_obj(struct osl_irq, 16);
 
    if (!osl_irq_handlers)
       panic("ACPI: unable to allocate memory for IRQ handlers");
@@ -36,7 +60,7 @@ AcpiOsInstallInterruptHandler(
     ACPI_OSD_HANDLER        ServiceRoutine,
     void                    *Context)
 {
-   struct irq_handler_node *n;
+   struct osl_irq *i;
    ACPI_FUNCTION_TRACE(__FUNC__);
 
    if (!ServiceRoutine)
@@ -45,17 +69,19 @@ AcpiOsInstallInterruptHandler(
    if (!IN_RANGE((int)InterruptNumber, 0, 16))
       return_ACPI_STATUS(AE_BAD_PARAMETER);
 
-   n = &osl_irq_handlers[InterruptNumber];
+   i = &osl_irq_handlers[InterruptNumber];
 
-   if (n->handler)
+   if (i->routine)
       return_ACPI_STATUS(AE_ALREADY_EXISTS);
 
-   list_node_init(&n->node);
-   n->handler = (irq_handler_t)ServiceRoutine;
-   n->context = Context;
+   i->routine = ServiceRoutine;
+   i->ctx = Context;
+   list_node_init(&i->node.node);
+   i->node.handler = &osl_irq_handler;
+   i->node.context = i;
 
    printk("ACPI: install handler for IRQ #%u\n", InterruptNumber);
-   irq_install_handler(InterruptNumber, n);
+   irq_install_handler(InterruptNumber, &i->node);
    return_ACPI_STATUS(AE_OK);
 }
 
@@ -64,7 +90,7 @@ AcpiOsRemoveInterruptHandler(
     UINT32                  InterruptNumber,
     ACPI_OSD_HANDLER        ServiceRoutine)
 {
-   struct irq_handler_node *n;
+   struct osl_irq *i;
    ACPI_FUNCTION_TRACE(__FUNC__);
 
    if (!ServiceRoutine)
@@ -73,16 +99,17 @@ AcpiOsRemoveInterruptHandler(
    if (!IN_RANGE((int)InterruptNumber, 0, 16))
       return_ACPI_STATUS(AE_BAD_PARAMETER);
 
-   n = &osl_irq_handlers[InterruptNumber];
+   i = &osl_irq_handlers[InterruptNumber];
 
-   if (!n->handler)
+   if (!i->routine)
       return_ACPI_STATUS(AE_NOT_EXIST);
 
-   if (n->handler != ServiceRoutine)
+   if (i->routine != ServiceRoutine)
       return_ACPI_STATUS(AE_BAD_PARAMETER);
 
    printk("ACPI: remove handler for IRQ #%u\n", InterruptNumber);
-   irq_uninstall_handler(InterruptNumber, n);
+   irq_uninstall_handler(InterruptNumber, &i->node);
+   i->routine = NULL;
    return_ACPI_STATUS(AE_OK);
 }
 
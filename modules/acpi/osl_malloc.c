@@ -111,6 +111,100 @@ AcpiOsFree(void *Memory)
    return_VOID;
 }
 
+/*
+ * ---------------------------------------
+ * OSL OBJECT CACHES
+ * ---------------------------------------
+ *
+ * ACPICA's caches (namespace nodes, parse nodes, operands, states) map onto
+ * kmalloc object caches instead of ACPICA's own free lists built on top of
+ * AcpiOsAllocate(). That saves the interrupts-off section of AcpiOsAllocate()
+ * and lets the kmalloc shrinker reclaim the unused objects.
+ *
+ * Objects are acquired only while interpreting AML or walking the namespace,
+ * never in the SCI handler, which just dispatches the GPE methods and the
+ * notifications through AcpiOsExecute(): therefore, using caches not meant
+ * for IRQ context is fine here.
+ */
+
+ACPI_STATUS
+AcpiOsCreateCache(
+    char                    *CacheName,
+    UINT16                  ObjectSize,
+    UINT16                  MaxDepth,
+    ACPI_CACHE_T            **ReturnCache)
+{
+   struct kmalloc_cache *c;
+   ACPI_FUNCTION_TRACE(__FUNC__);
+
+   if (!CacheName || !ObjectSize || !ReturnCache)
+      return_ACPI_STATUS(AE_BAD_PARAMETER);
+
+   if (!(c = kzalloc_obj(struct kmalloc_cache)))
+      return_ACPI_STATUS(AE_NO_MEMORY);
+
+   /* MaxDepth is ignored: the magazine has a fixed size */
+   c->name = CacheName;
+   c->obj_size = ObjectSize;
+   *ReturnCache = c;
+   return_ACPI_STATUS(AE_OK);
+}
+
+ACPI_STATUS
+AcpiOsDeleteCache(ACPI_CACHE_T *Cache)
+{
+   ACPI_FUNCTION_TRACE(__FUNC__);
+
+   if (!Cache)
+      return_ACPI_STATUS(AE_BAD_PARAMETER);
+
+   kmalloc_cache_destroy(Cache);
+   kfree_obj(Cache, struct kmalloc_cache);
+   return_ACPI_STATUS(AE_OK);
+}
+
+ACPI_STATUS
+AcpiOsPurgeCache(ACPI_CACHE_T *Cache)
+{
+   ACPI_FUNCTION_TRACE(__FUNC__);
+
+   if (!Cache)
+      return_ACPI_STATUS(AE_BAD_PARAMETER);
+
+   kmalloc_cache_shrink(Cache);
+   return_ACPI_STATUS(AE_OK);
+}
+
+void *
+AcpiOsAcquireObject(ACPI_CACHE_T *Cache)
+{
+   void *obj;
+   ACPI_FUNCTION_TRACE(__FUNC__);
+
+   if (!Cache)
+      return_PTR(NULL);
+
+   /* ACPICA expects zeroed objects, like its own cache implementation does */
+   if ((obj = kmalloc_cache_alloc(Cache)))
+      bzero(obj, Cache->obj_size);
+
+   return_PTR(obj);
+}
+
+ACPI_STATUS
+AcpiOsReleaseObject(
+    ACPI_CACHE_T            *Cache,
+    void                    *Object)
+{
+   ACPI_FUNCTION_TRACE(__FUNC__);
+
+   if (!Cache || !Object)
+      return_ACPI_STATUS(AE_BAD_PARAMETER);
+
+   kmalloc_cache_free(Cache, Object);
+   return_ACPI_STATUS(AE_OK);
+}
+
 ACPI_STATUS
 osl_init_malloc(void)
 {
@@ -4,6 +4,8 @@
 #include <tilck/common/printk.h>
 
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/sched.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
@@ -20,8 +22,25 @@ ACPI_MODULE_NAME("osl_sync")
  * ---------------------------------------
  * OSL SPINLOCK
  * ---------------------------------------
+ *
+ * Tilck does not support SMP, therefore there's no need for real spinlocks:
+ * disabling the interrupts is enough. The handles are just distinct addresses
+ * in `osl_locks`, in order to tell the locks apart.
+ *
+ * ACPICA takes the GPE, hardware and global lock pending locks in the SCI
+ * handler, while the reference count lock, by far the most used one (every
+ * reference to an operand object goes through it), is taken only while
+ * interpreting AML. For the latter, disabling the preemption is enough.
  */
 
+static u8 osl_locks[8];
+static u32 osl_locks_count;
+
+static ALWAYS_INLINE bool osl_is_preempt_only_lock(ACPI_SPINLOCK Handle)
+{
+   return Handle == AcpiGbl_ReferenceCountLock;
+}
+
 ACPI_STATUS
 AcpiOsCreateLock(ACPI_SPINLOCK *OutHandle)
 {
@@ -30,12 +49,10 @@ AcpiOsCreateLock(ACPI_SPINLOCK *OutHandle)
    if (!OutHandle)
       return_ACPI_STATUS(AE_BAD_PARAMETER);
 
-   /*
-    * Tilck does not support SMP, therefore there's no need for real spinlocks:
-    * disabling the interrupts is enough. Hopefully, ACPI will accept a NULL
-    * value, by treating the handle as completely opaque value.
-    */
-   *OutHandle = NULL;
+   if (osl_locks_count == ARRAY_SIZE(osl_locks))
+      return_ACPI_STATUS(AE_NO_MEMORY);
+
+   *OutHandle = &osl_locks[osl_locks_count++];
    return_ACPI_STATUS(AE_OK);
 }
 
@@ -48,9 +65,16 @@ AcpiOsDeleteLock(ACPI_SPINLOCK Handle)
 ACPI_CPU_FLAGS
 AcpiOsAcquireLock(ACPI_SPINLOCK Handle)
 {
-   ulong flags;
+   ulong flags = 0;
    ACPI_FUNCTION_TRACE(__FUNC__);
-   disable_interrupts(&flags);
+
+   if (osl_is_preempt_only_lock(Handle)) {
+      ASSERT(!in_irq());
+      disable_preemption();
+   } else {
+      disable_interrupts(&flags);
+   }
+
    return_VALUE(flags);
 }
 
@@ -60,7 +84,13 @@ AcpiOsReleaseLock(
     ACPI_CPU_FLAGS          Flags)
 {
    ulong flags = (ulong) Flags;
-   enable_interrupts(&flags);
+
+   /* Other locks might be held: don't yield here */
+   if (osl_is_preempt_only_lock(Handle))
+      enable_preemption_nosched();
+   else
+      enable_interrupts(&flags);
+
    ACPI_FUNCTION_TRACE(__FUNC__);
    return_VOID;
 }
@@ -117,7 +147,7 @@ AcpiOsWaitSemaphore(
     UINT16                  Timeout)
 {
    struct ksem *s = Handle;
-   u64 ticks;
+   int timeout;
    int rc;
 
    ACPI_FUNCTION_TRACE(__FUNC__);
@@ -125,12 +155,21 @@ AcpiOsWaitSemaphore(
    if (Units > INT_MAX || !Handle)
       return_ACPI_STATUS(AE_BAD_PARAMETER);
 
-   ticks = ms_to_ticks(Timeout);
+   if (Timeout == ACPI_WAIT_FOREVER) {
 
-   if (ticks > INT_MAX)
-      return_ACPI_STATUS(AE_BAD_PARAMETER);
+      timeout = KSEM_WAIT_FOREVER;
+
+   } else if (Timeout == 0) {
+
+      timeout = KSEM_NO_WAIT;
+
+   } else {
+
+      /* Timeout < 64 K ms, no overflow. Don't let it become KSEM_NO_WAIT */
+      timeout = (int)MAX(ms_to_ticks(Timeout), 1u);
+   }
 
-   rc = ksem_wait(s, (int)Units, (int)ticks);
+   rc = ksem_wait(s, (int)Units, timeout);
 
    switch (rc) {
 
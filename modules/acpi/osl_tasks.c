@@ -6,17 +6,150 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/hal.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/mods/acpi.h>
 
 #include <3rd_party/acpi/acpi.h>
 #include <3rd_party/acpi/accommon.h>
 
+#include "osl.h"
+
 ACPI_MODULE_NAME("osl_tasks")
 
 static struct worker_thread *wth_events;
 static struct worker_thread *wth_main;
 static struct worker_thread *wth_debug;
+static struct acpi_osl_stats osl_stats;
+
+/*
+ * Notify jobs: the GPE methods run on `wth_events` and queue there the
+ * notifications (and the re-enabling of the GPE), to be run after them. When
+ * queued by a GPE method, the jobs carry the TSC of the last SCI, in order to
+ * measure the SCI-to-handler latency.
+ */
+struct osl_notify_job {
+
+   ACPI_OSD_EXEC_CALLBACK func;
+   void *ctx;
+   u64 sci_tsc;                     /* 0 if not caused by an SCI */
+};
+
+static struct kmalloc_cache osl_notify_jobs_cache =
+   KMALLOC_CACHE_INIT("acpi_notify_jobs", sizeof(struct osl_notify_job), NULL);
+
+static void osl_account_notify(u64 sci_tsc)
+{
+   const u64 lat = RDTSC() - sci_tsc;
+
+   disable_preemption();
+   {
+      osl_stats.sci_notify_count++;
+      osl_stats.sci_notify_lat_tot += lat;
+      osl_stats.sci_notify_lat_max = MAX(osl_stats.sci_notify_lat_max, lat);
+   }
+   enable_preemption();
+}
+
+static void osl_notify_job_func(void *arg)
+{
+   struct osl_notify_job job = *(struct osl_notify_job *)arg;
+   kmalloc_cache_free(&osl_notify_jobs_cache, arg);
+
+   if (job.sci_tsc)
+      osl_account_notify(job.sci_tsc);
+
+   job.func(job.ctx);
+}
+
+static bool osl_holding_acpi_mutexes(void)
+{
+   const ACPI_THREAD_ID tid = AcpiOsGetThreadId();
+
+   for (int i = 0; i < ACPI_NUM_MUTEX; i++)
+      if (AcpiGbl_MutexInfo[i].ThreadId == tid)
+         return true;
+
+   return false;
+}
+
+/*
+ * A notify job can run inline when queued by a job on `wth_events` itself
+ * (never an IRQ handler), with nothing else in the queue it should run after
+ * and with no ACPICA mutex held: the notify handlers are allowed to evaluate
+ * methods. In practice, that's the case of the GPE re-enabling after a GPE
+ * method which didn't notify anything: one less job and wake-up per SCI.
+ */
+static bool osl_can_run_notify_inline(void)
+{
+   return get_curr_task() == wth_get_task(wth_events) &&
+          is_preemption_enabled() &&
+          !wth_get_pending_jobs(wth_events) &&
+          !osl_holding_acpi_mutexes();
+}
+
+static ACPI_STATUS
+osl_execute_notify(ACPI_OSD_EXEC_CALLBACK Function, void *Context)
+{
+   struct osl_notify_job *job;
+   u64 sci_tsc = 0;
+   ulong var;
+
+   if (in_irq()) {
+
+      if (!wth_enqueue_on(wth_events, Function, Context))
+         panic("AcpiOsExecute: unable to enqueue job");
+
+      return AE_OK;
+   }
+
+   if (get_curr_task() == wth_get_task(wth_events)) {
+
+      /* A 64-bit read, not atomic on 32-bit machines */
+      disable_interrupts(&var);
+      {
+         sci_tsc = osl_last_sci_tsc;
+      }
+      enable_interrupts(&var);
+   }
+
+   if (osl_can_run_notify_inline()) {
+
+      if (sci_tsc)
+         osl_account_notify(sci_tsc);
+
+      osl_stats.notify_inline++;
+      Function(Context);
+      return AE_OK;
+   }
+
+   if (!(job = kmalloc_cache_alloc(&osl_notify_jobs_cache)))
+      return AE_NO_MEMORY;
+
+   *job = (struct osl_notify_job) {
+      .func = Function,
+      .ctx = Context,
+      .sci_tsc = sci_tsc,
+   };
+
+   if (!wth_enqueue_on(wth_events, &osl_notify_job_func, job))
+      panic("AcpiOsExecute: unable to enqueue job");
+
+   osl_stats.notify_queued++;
+   return AE_OK;
+}
+
+void acpi_get_osl_stats(struct acpi_osl_stats *s)
+{
+   disable_preemption();
+   {
+      *s = osl_stats;
+      s->sci_count = osl_sci_count;
+   }
+   enable_preemption();
+}
 
 ACPI_STATUS
 AcpiOsExecute(
@@ -33,6 +166,8 @@ AcpiOsExecute(
    switch (Type) {
 
       case OSL_NOTIFY_HANDLER:
+         return_ACPI_STATUS(osl_execute_notify(Function, Context));
+
       case OSL_GPE_HANDLER:
          wth = wth_events;
          break;
@@ -52,6 +52,22 @@ void reset_console_data(struct tty *t)
    cd->filter_ctx.cd = cd;
 }
 
+/* See term_plain_chars_func */
+static const s16 *tty_get_plain_chars(void *ctx_arg)
+{
+   struct twfilter_ctx *const ctx = ctx_arg;
+   struct console_data *const cd = ctx->cd;
+
+   if (ctx->non_default_state)
+      return NULL;
+
+   /*
+    * In the default state, tty_state_default() just writes the chars having
+    * a translation in the current charset, without any action.
+    */
+   return cd->c_sets_tables[cd->c_set];
+}
+
 void tty_reset_filter_ctx(struct tty *t)
 {
    struct console_data *cd = t->console_data;
@@ -64,6 +80,9 @@ void tty_reset_filter_ctx(struct tty *t)
    ctx->t = t;
    ctx->cd = cd;
    tty_set_state(ctx, &tty_state_default);
+
+   if (t->tintf->set_plain_chars_func)
+      t->tintf->set_plain_chars_func(t->tstate, &tty_get_plain_chars);
 }
 
 static void
@@ -330,8 +349,7 @@ tty_csi_n_handler(u32 *params,
 
       tty_reset_filter_ctx(ctx->t);
 
-      for (char *p = dsr; *p; p++)
-         tty_send_keyevent(t, make_key_event(0, *p, true), true);
+      tty_send_input(t, dsr, strlen(dsr), true);
    }
 }
 
@@ -512,8 +530,7 @@ tty_csi_c_handler(u32 *params,
 
    tty_reset_filter_ctx(ctx->t);
 
-   for (const char *p = buf; *p; p++)
-      tty_send_keyevent(t, make_key_event(0, *p, true), true);
+   tty_send_input(t, buf, sizeof(buf) - 1, true);
 }
 
 static void
@@ -115,6 +115,8 @@ static const struct video_interface ega_text_mode_i =
    NULL, /* redraw_static_elements */
    NULL, /* disable_static_elems_refresh */
    NULL, /* enable_static_elems_refresh */
+   NULL, /* begin_batch: writing to the text mode VRAM is cheap */
+   NULL, /* flush_batch */
 };
 
 void init_textmode_console(void)
@@ -31,6 +31,8 @@ static const struct actions_table_item actions_table[] = {
    [a_insert_blank_chars]   = ENTRY(ins_blank_chars, 1),
    [a_simple_del_chars]     = ENTRY(del_chars_in_line, 1),
    [a_simple_erase_chars]   = ENTRY(erase_chars_in_line, 1),
+   [a_drop_scrollback]      = ENTRY(drop_scrollback, 0),
+   [a_free_alt_buffers]     = ENTRY(free_alt_buffers, 0),
 };
 
 #undef ENTRY
@@ -119,6 +121,23 @@ vterm_pause_output(term *t)
    term_execute_or_enqueue_action(t, &a);
 }
 
+static size_t
+vterm_drop_scrollback(term *_t)
+{
+   struct vterm *const t = _t;
+   struct term_scrollback_stats s;
+   struct term_action a;
+
+   term_sb_get_stats(&t->sb, &s);
+
+   if (!s.alloc_bytes)
+      return 0;
+
+   term_make_action_drop_scrollback(&a);
+   term_execute_or_enqueue_action(t, &a);
+   return s.alloc_bytes;
+}
+
 static void
 vterm_restart_output(term *t)
 {
@@ -147,6 +166,13 @@ vterm_set_filter(term *_t, term_filter func, void *ctx)
    t->filter_ctx = ctx;
 }
 
+static void
+vterm_set_plain_chars_func(term *_t, term_plain_chars_func func)
+{
+   struct vterm *const t = _t;
+   t->plain_chars = func;
+}
+
 static bool
 vterm_is_initialized(term *_t)
 {
@@ -98,10 +98,17 @@ static void
 term_action_write(struct vterm *const t, const char *buf, u32 len, u8 color)
 {
    const struct video_interface *const vi = t->vi;
+   const s16 *plain = NULL;
+
+   if (vi->begin_batch)
+      vi->begin_batch();
 
    ts_scroll_to_bottom(t);
    vi->enable_cursor();
 
+   if (t->filter && t->plain_chars)
+      plain = t->plain_chars(t->filter_ctx);
+
    for (u32 i = 0; i < len; i++) {
 
       if (UNLIKELY(t->filter == NULL)) {
@@ -110,6 +117,16 @@ term_action_write(struct vterm *const t, const char *buf, u32 len, u8 color)
          continue;
       }
 
+      if (plain && plain[(u8)buf[i]] >= 0) {
+
+         /*
+          * Fast path: write the whole run of plain chars at once, without
+          * going through the filter and the actions for each char.
+          */
+         i += term_internal_write_plain_run(t, buf+i, len-i, color, plain) - 1;
+         continue;
+      }
+
       /*
        * NOTE: We MUST store buf[i] in a local variable because the filter
        * function is absolutely allowed to modify its contents!!
@@ -124,10 +141,21 @@ term_action_write(struct vterm *const t, const char *buf, u32 len, u8 color)
          term_internal_write_char2(t, c, color);
 
       term_execute_action(t, &a);
+
+      /* The filter might have changed its state or its translation tables */
+      if (t->plain_chars)
+         plain = t->plain_chars(t->filter_ctx);
    }
 
    if (t->cursor_enabled)
       vi->move_cursor(t->r, t->c, get_curr_cell_fg_color(t));
+
+   /*
+    * Draw everything the write changed in a single pass. Note: we must use
+    * `vi` and not `t->vi` because an action might have paused the output.
+    */
+   if (vi->flush_batch)
+      vi->flush_batch();
 }
 
 DEFINE_TERM_ACTION_3(write, const char *, u32, u8)
@@ -170,6 +198,7 @@ static void term_action_reset(struct vterm *const t)
    t->vi->enable_cursor();
    term_int_move_cur(t, 0, 0);
    t->scroll = t->max_scroll = 0;
+   term_sb_clear(&t->sb);
 
    for (u16 i = 0; i < t->rows; i++)
       ts_clear_row(t, i, DEFAULT_COLOR16);
@@ -180,6 +209,15 @@ static void term_action_reset(struct vterm *const t)
 
 DEFINE_TERM_ACTION_0(reset)
 
+/* Free the scrollback's memory: used by the shrinker, on memory pressure */
+static void term_action_drop_scrollback(struct vterm *const t)
+{
+   ts_scroll_to_bottom(t);
+   term_sb_destroy(&t->sb);
+}
+
+DEFINE_TERM_ACTION_0(drop_scrollback)
+
 static void
 term_action_erase_in_display(struct vterm *const t, int mode)
 {
@@ -393,7 +431,8 @@ DEFINE_TERM_ACTION_0(restart_output)
 static void
 term_action_use_alt_buffer(struct vterm *const t, bool use_alt_buffer)
 {
-   u16 *b = get_buf_row(t, 0);
+   const size_t row_size = sizeof(u16) * t->cols;
+   u16 *copy;
 
    if (t->using_alt_buffer == use_alt_buffer)
       return;
@@ -406,23 +445,35 @@ term_action_use_alt_buffer(struct vterm *const t, bool use_alt_buffer)
             return; /* just do nothing: the main buffer will be used */
       }
 
+      ktimer_cancel(&t->alt_bufs_timer);
+
       t->start_scroll_region = &t->alt_scroll_region_start;
       t->end_scroll_region = &t->alt_scroll_region_end;
       t->tabs_buf = t->alt_tabs_buf;
       t->saved_cur_row = t->r;
       t->saved_cur_col = t->c;
-      memcpy(t->screen_buf_copy, b, sizeof(u16) * t->rows * t->cols);
+      copy = t->screen_buf_copy;
+
+      for (u16 row = 0; row < t->rows; row++)
+         memcpy(&copy[row * t->cols], get_buf_row(t, row), row_size);
 
    } else {
 
       ASSERT(t->screen_buf_copy != NULL);
+      copy = t->screen_buf_copy;
+
+      for (u16 row = 0; row < t->rows; row++)
+         memcpy(get_buf_row(t, row), &copy[row * t->cols], row_size);
 
-      memcpy(b, t->screen_buf_copy, sizeof(u16) * t->rows * t->cols);
       t->r = t->saved_cur_row;
       t->c = t->saved_cur_col;
       t->tabs_buf = t->main_tabs_buf;
       t->start_scroll_region = &t->main_scroll_region_start;
       t->end_scroll_region = &t->main_scroll_region_end;
+
+      /* Keep the alt buffers for a while: apps are often run many times */
+      ktimer_arm(&t->alt_bufs_timer,
+                 get_ticks() + ms_to_ticks(ALT_BUFS_IDLE_TIMEOUT_MS));
    }
 
    t->using_alt_buffer = use_alt_buffer;
@@ -433,6 +484,15 @@ term_action_use_alt_buffer(struct vterm *const t, bool use_alt_buffer)
 
 DEFINE_TERM_ACTION_1(use_alt_buffer, bool)
 
+/* Free the alt buffers, not used since ALT_BUFS_IDLE_TIMEOUT_MS */
+static void term_action_free_alt_buffers(struct vterm *const t)
+{
+   if (!t->using_alt_buffer)
+      term_free_alt_buffers(t);
+}
+
+DEFINE_TERM_ACTION_0(free_alt_buffers)
+
 static void
 term_action_ins_blank_lines(struct vterm *const t, u32 n)
 {
@@ -0,0 +1,318 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/color_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/term.h>
+
+#include "video_term_int.h"
+
+/*
+ * Compressed scrollback for the video terms.
+ *
+ * The rows which scroll off the top of the screen are stored in a byte ring
+ * buffer (`buf`), each one as a record in one of the following formats:
+ *
+ *    SB_ROW_RAW:    the row's cells, as they are (2 * cols bytes)
+ *
+ *    SB_ROW_PACKED: a sequence of color spans, each one made by:
+ *                      <color> <cells count> <PackBits-encoded chars>
+ *
+ * PackBits: a control byte `n` in [0, 127] is followed by n + 1 literal chars,
+ * while `n` in [128, 255] is followed by a single char repeated n - 125 times.
+ *
+ * The raw format is used only when the packed one would be bigger, which
+ * bounds the size of a record to 1 + 2 * cols bytes. The offset of each record
+ * is kept in the `rows_off` ring. When there's no room for a new row, the
+ * oldest ones are dropped.
+ */
+
+#define SB_ROW_RAW                     0
+#define SB_ROW_PACKED                  1
+
+#define SB_MAX_LITERAL               128
+#define SB_MIN_RUN                     3
+#define SB_MAX_RUN                   130
+#define SB_MAX_SPAN                  255
+
+static ALWAYS_INLINE u32 sb_max_record_size(u16 cols)
+{
+   return 1 + 2 * (u32)cols;
+}
+
+/*
+ * Worst case for the packed format: each cell in its own color span, made by
+ * 2 bytes of header, a control byte and the char.
+ */
+static ALWAYS_INLINE u32 sb_tmp_size(u16 cols)
+{
+   return 1 + 4 * (u32)cols;
+}
+
+/* Encode the chars of row[s..e) with PackBits. Returns the bytes written */
+static u32
+sb_pack_chars(const u16 *row, u32 s, u32 e, u8 *out)
+{
+   u32 n = 0, i = s, run, lit_start;
+   u8 ch;
+
+   while (i < e) {
+
+      ch = vgaentry_get_char(row[i]);
+
+      for (run = 1; i + run < e && run < SB_MAX_RUN; run++)
+         if (vgaentry_get_char(row[i + run]) != ch)
+            break;
+
+      if (run >= SB_MIN_RUN) {
+         out[n++] = (u8)(run - SB_MIN_RUN + 128);
+         out[n++] = ch;
+         i += run;
+         continue;
+      }
+
+      /* Literal chars, up to the next run of at least SB_MIN_RUN chars */
+      for (lit_start = i; i < e && i - lit_start < SB_MAX_LITERAL; i++) {
+
+         ch = vgaentry_get_char(row[i]);
+
+         if (i + 2 < e &&
+             vgaentry_get_char(row[i + 1]) == ch &&
+             vgaentry_get_char(row[i + 2]) == ch)
+         {
+            break;
+         }
+      }
+
+      out[n++] = (u8)(i - lit_start - 1);
+
+      for (u32 j = lit_start; j < i; j++)
+         out[n++] = vgaentry_get_char(row[j]);
+   }
+
+   return n;
+}
+
+/* Encode `row` in `out`, which must be sb_tmp_size() bytes long */
+static u32
+sb_encode_row(const u16 *row, u16 cols, u8 *out)
+{
+   const u32 max_size = sb_max_record_size(cols);
+   u32 n = 0, s = 0, e;
+   u8 color;
+
+   out[n++] = SB_ROW_PACKED;
+
+   while (s < cols) {
+
+      color = vgaentry_get_color(row[s]);
+
+      for (e = s + 1; e < cols && e - s < SB_MAX_SPAN; e++)
+         if (vgaentry_get_color(row[e]) != color)
+            break;
+
+      out[n++] = color;
+      out[n++] = (u8)(e - s);
+      n += sb_pack_chars(row, s, e, out + n);
+      s = e;
+   }
+
+   if (n <= max_size)
+      return n;
+
+   /* The packed row is bigger than the raw one: store the raw one */
+   out[0] = SB_ROW_RAW;
+   memcpy(out + 1, row, 2 * (size_t)cols);
+   return max_size;
+}
+
+static void
+sb_decode_row(const u8 *in, u16 cols, u16 *row)
+{
+   u32 c = 0, span_end, cnt;
+   u8 color, ctl;
+
+   if (*in++ == SB_ROW_RAW) {
+      memcpy(row, in, 2 * (size_t)cols);
+      return;
+   }
+
+   while (c < cols) {
+
+      color = *in++;
+      span_end = c + *in++;
+
+      while (c < span_end) {
+
+         ctl = *in++;
+
+         if (ctl < 128) {
+
+            for (cnt = (u32)ctl + 1; cnt > 0; cnt--)
+               row[c++] = make_vgaentry(*in++, color);
+
+         } else {
+
+            for (cnt = (u32)ctl - 128 + SB_MIN_RUN; cnt > 0; cnt--)
+               row[c++] = make_vgaentry(*in, color);
+
+            in++;
+         }
+      }
+   }
+}
+
+static ALWAYS_INLINE u32 sb_row_off(struct term_scrollback *sb, u32 n)
+{
+   return sb->rows_off[(sb->first + n) % sb->max_rows];
+}
+
+static void
+sb_drop_oldest_row(struct term_scrollback *sb)
+{
+   ASSERT(sb->count > 0);
+   sb->first = (sb->first + 1) % sb->max_rows;
+   sb->count--;
+   sb->tail = sb->count ? sb_row_off(sb, 0) : sb->head;
+}
+
+static void
+sb_ring_write(struct term_scrollback *sb, const u8 *data, u32 len)
+{
+   const u32 off = sb->head & (sb->buf_size - 1);
+   const u32 len1 = MIN(len, sb->buf_size - off);
+
+   memcpy(sb->buf + off, data, len1);
+   memcpy(sb->buf, data + len1, len - len1);
+   sb->head += len;
+}
+
+static void
+sb_ring_read(struct term_scrollback *sb, u32 pos, u8 *data, u32 len)
+{
+   const u32 off = pos & (sb->buf_size - 1);
+   const u32 len1 = MIN(len, sb->buf_size - off);
+
+   memcpy(data, sb->buf + off, len1);
+   memcpy(data + len1, sb->buf, len - len1);
+}
+
+int
+term_sb_init(struct term_scrollback *sb, u16 cols, u32 max_rows)
+{
+   const u32 raw_size = max_rows * cols * 2;
+   u32 buf_size = 1 * KB;
+
+   bzero(sb, sizeof(*sb));
+
+   if (!max_rows)
+      return 0;
+
+   /*
+    * Text rows typically compress well: use a quarter of the memory the raw
+    * rows would need, rounded up to a power of 2. When the content compresses
+    * worse than that, we'll just keep fewer rows.
+    */
+   while (buf_size < MAX(raw_size / 4, 2 * sb_max_record_size(cols)))
+      buf_size *= 2;
+
+   sb->cols = cols;
+   sb->max_rows = max_rows;
+   sb->buf_size = buf_size;
+   sb->buf = kmalloc(buf_size);
+   sb->rows_off = kalloc_array_obj(u32, max_rows);
+   sb->tmp = kmalloc(sb_tmp_size(cols));
+   sb->row = kalloc_array_obj(u16, cols);
+
+   if (!sb->buf || !sb->rows_off || !sb->tmp || !sb->row) {
+      term_sb_destroy(sb);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+void
+term_sb_destroy(struct term_scrollback *sb)
+{
+   if (sb->buf)
+      kfree2(sb->buf, sb->buf_size);
+
+   if (sb->rows_off)
+      kfree_array_obj(sb->rows_off, u32, sb->max_rows);
+
+   if (sb->tmp)
+      kfree2(sb->tmp, sb_tmp_size(sb->cols));
+
+   if (sb->row)
+      kfree_array_obj(sb->row, u16, sb->cols);
+
+   bzero(sb, sizeof(*sb));
+}
+
+void
+term_sb_clear(struct term_scrollback *sb)
+{
+   sb->first = sb->count = 0;
+   sb->head = sb->tail = 0;
+}
+
+void
+term_sb_push_row(struct term_scrollback *sb, const u16 *row)
+{
+   u32 len;
+
+   if (!sb->max_rows)
+      return;
+
+   len = sb_encode_row(row, sb->cols, sb->tmp);
+
+   while (sb->count == sb->max_rows || sb->head - sb->tail + len > sb->buf_size)
+      sb_drop_oldest_row(sb);
+
+   sb->rows_off[(sb->first + sb->count) % sb->max_rows] = sb->head;
+   sb->count++;
+   sb_ring_write(sb, sb->tmp, len);
+}
+
+/*
+ * Decompress the row `n` (0 is the oldest) of the scrollback. The returned
+ * buffer is valid until the next call.
+ */
+u16 *
+term_sb_get_row(struct term_scrollback *sb, u32 n)
+{
+   u32 pos, end;
+
+   ASSERT(n < sb->count);
+
+   pos = sb_row_off(sb, n);
+   end = n + 1 < sb->count ? sb_row_off(sb, n + 1) : sb->head;
+
+   sb_ring_read(sb, pos, sb->tmp, end - pos);
+   sb_decode_row(sb->tmp, sb->cols, sb->row);
+   return sb->row;
+}
+
+void
+term_sb_get_stats(struct term_scrollback *sb, struct term_scrollback_stats *s)
+{
+   const size_t alloc =
+      sb->max_rows
+         ? sb->buf_size
+           + sb->max_rows * sizeof(u32)
+           + sb_tmp_size(sb->cols)
+           + sb->cols * sizeof(u16)
+         : 0;
+
+   *s = (struct term_scrollback_stats) {
+      .rows = sb->count,
+      .max_rows = sb->max_rows,
+      .used_bytes = sb->head - sb->tail,
+      .alloc_bytes = alloc,
+      .uncompressed_bytes = (size_t)sb->max_rows * sb->cols * 2,
+   };
+}
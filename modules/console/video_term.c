@@ -16,9 +16,16 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/timer.h>
 
 #include "video_term_int.h"
 
+/*
+ * The alternate screen buffers are allocated on the first switch to the alt
+ * screen and freed when it's not used for that long.
+ */
+#define ALT_BUFS_IDLE_TIMEOUT_MS                      (60 * 1000)
+
 struct vterm {
 
    bool initialized;
@@ -38,13 +45,13 @@ struct vterm {
    const struct video_interface *vi;
    const struct video_interface *saved_vi;
 
-   u16 *buffer;               /* the whole screen buffer */
+   u16 *buffer;               /* the screen buffer (rows x cols) */
    u16 *screen_buf_copy;      /* when != NULL, contains one screenshot */
    u32 scroll;                /* != max_scroll only while scrolling */
-   u32 max_scroll;            /* buffer rows used - rows. Its value is 0 until
-                                 the screen scrolls for the first time */
-   u32 total_buffer_rows;     /* >= term rows */
-   u32 extra_buffer_rows;     /* => total_buffer_rows - rows. Always >= 0 */
+   u32 max_scroll;            /* rows scrolled off the screen. Its value is 0
+                                 until the screen scrolls for the first time */
+
+   struct term_scrollback sb; /* the rows above the screen, compressed */
 
    u16 saved_cur_row;         /* keeps primary buffer's cursor's row */
    u16 saved_cur_col;         /* keeps primary buffer's cursor's col */
@@ -62,10 +69,13 @@ struct vterm {
    bool *main_tabs_buf;
    bool *alt_tabs_buf;
 
+   struct ktimer alt_bufs_timer; /* frees the alt buffers, when not used */
+
    struct term_action actions_buf[32];
 
    term_filter filter;
    void *filter_ctx;
+   term_plain_chars_func plain_chars;
 };
 
 static struct vterm first_instance;
@@ -83,6 +93,8 @@ static void no_vi_scroll_one_line_up(void) { }
 static void no_vi_redraw_static_elements(void) { }
 static void no_vi_disable_static_elems_refresh(void) { }
 static void no_vi_enable_static_elems_refresh(void) { }
+static void no_vi_begin_batch(void) { }
+static void no_vi_flush_batch(void) { }
 
 static const struct video_interface no_output_vi =
 {
@@ -95,7 +107,9 @@ static const struct video_interface no_output_vi =
    no_vi_scroll_one_line_up,
    no_vi_redraw_static_elements,
    no_vi_disable_static_elems_refresh,
-   no_vi_enable_static_elems_refresh
+   no_vi_enable_static_elems_refresh,
+   no_vi_begin_batch,
+   no_vi_flush_batch,
 };
 
 /* --------------------------------------------------------- */
@@ -133,7 +147,14 @@ static const struct video_interface no_output_vi =
  *  301288    29388  250610   581286   8dea6   tilck
  */
 
-#define calc_buf_row(t, r) (((r) + (t)->scroll) % (t)->total_buffer_rows)
+/*
+ * `buffer` contains only the rows on the screen, as a ring: the rows scrolled
+ * off the top are in the compressed scrollback and `r` is always relative to
+ * the bottom of the scrollback, no matter what we're showing on the screen.
+ * That's fine because all the actions modifying the buffer either happen with
+ * scroll == max_scroll or call ts_scroll_to_bottom() first.
+ */
+#define calc_buf_row(t, r) (((r) + (t)->max_scroll) % (t)->rows)
 #define get_buf_row(t, r) (&(t)->buffer[calc_buf_row((t), (r)) * (t)->cols])
 #define buf_set_entry(t, r, c, e) (get_buf_row((t), (r))[(c)] = (e))
 #define buf_get_entry(t, r, c) (get_buf_row((t), (r))[(c)])
@@ -153,6 +174,18 @@ static ALWAYS_INLINE bool ts_is_at_bottom(struct vterm *t)
    return t->scroll == t->max_scroll;
 }
 
+/* Returns the row to show at `row`, which might come from the scrollback */
+static u16 *ts_get_screen_row(struct vterm *t, u16 row)
+{
+   const u32 line = t->scroll + row;
+
+   if (line >= t->max_scroll)
+      return get_buf_row(t, line - t->max_scroll);
+
+   ASSERT(t->max_scroll - line <= t->sb.count);
+   return term_sb_get_row(&t->sb, t->sb.count - (t->max_scroll - line));
+}
+
 static ALWAYS_INLINE u8 get_curr_cell_color(struct vterm *t)
 {
    if (!t->buffer)
@@ -196,7 +229,7 @@ static void term_redraw2(struct vterm *t, u16 s, u16 e)
       fpu_context_begin();
 
    for (u16 row = s; row < e; row++)
-      t->vi->set_row(row, get_buf_row(t, row), fpu_allowed);
+      t->vi->set_row(row, ts_get_screen_row(t, row), fpu_allowed);
 
    if (fpu_allowed)
       fpu_context_end();
@@ -216,16 +249,14 @@ static void ts_set_scroll(struct vterm *t, u32 requested_scroll)
 {
    /*
     * 1. scroll cannot be > max_scroll
-    * 2. scroll cannot be < max_scroll - extra_buffer_rows, where
-    *    extra_buffer_rows = total_buffer_rows - VIDEO_ROWS.
-    *    In other words, if for example total_buffer_rows is 26, and max_scroll
-    *    is 1000, scroll cannot be less than 1000 + 25 - 26 = 999, which means
-    *    exactly 1 scroll row (extra_buffer_rows == 1).
+    * 2. scroll cannot be < max_scroll - sb.count, where sb.count is the number
+    *    of rows currently in the scrollback. For example, if max_scroll is 1000
+    *    and the scrollback contains just 1 row, scroll cannot be less than 999.
     */
 
    const u32 min_scroll =
-      t->max_scroll > t->extra_buffer_rows
-         ? t->max_scroll - t->extra_buffer_rows
+      t->max_scroll > t->sb.count
+         ? t->max_scroll - t->sb.count
          : 0;
 
    requested_scroll = CLAMP(requested_scroll, min_scroll, t->max_scroll);
@@ -375,6 +406,8 @@ static void term_internal_incr_row(struct vterm *t)
       return;
    }
 
+   /* The top row is going to be reused for the new bottom row: save it */
+   term_sb_push_row(&t->sb, get_buf_row(t, 0));
    t->max_scroll++;
 
    if (t->vi->scroll_one_line_up) {
@@ -497,6 +530,48 @@ static void term_internal_write_char2(struct vterm *t, char c, u8 color)
    }
 }
 
+/*
+ * Write the longest prefix of `buf` made by chars which are plain according to
+ * the `plain` table (see term_plain_chars_func), translating them. Returns the
+ * number of chars written.
+ */
+static u32
+term_internal_write_plain_run(struct vterm *t,
+                              const char *buf,
+                              u32 len,
+                              u8 color,
+                              const s16 *plain)
+{
+   u32 i;
+   s16 tv;
+
+   for (i = 0; i < len && (tv = plain[(u8)buf[i]]) >= 0; i++) {
+
+      if (t->c == t->cols) {
+         t->c = 0;
+         term_internal_incr_row(t);
+      }
+
+      term_internal_write_printable_char(t, (u8)tv, color);
+   }
+
+   return i;
+}
+
+static void
+term_free_alt_buffers(struct vterm *t)
+{
+   if (t->alt_tabs_buf) {
+      kfree2(t->alt_tabs_buf, t->cols * t->rows);
+      t->alt_tabs_buf = NULL;
+   }
+
+   if (t->screen_buf_copy) {
+      kfree_array_obj(t->screen_buf_copy, u16, t->rows * t->cols);
+      t->screen_buf_copy = NULL;
+   }
+}
+
 static int
 term_allocate_alt_buffers(struct vterm *t)
 {
@@ -574,6 +649,20 @@ debug_term_dump_font_table(term *_t)
 
 #endif
 
+/*
+ * Called in a worker thread: the alt buffers are freed by an action, in order
+ * to be serialized with all the other actions on the term.
+ */
+static void
+term_alt_bufs_timer_func(struct ktimer *kt)
+{
+   struct vterm *const t = CONTAINER_OF(kt, struct vterm, alt_bufs_timer);
+   struct term_action a;
+
+   term_make_action_free_alt_buffers(&a);
+   term_execute_or_enqueue_action(t, &a);
+}
+
 static term *
 alloc_term_struct(void)
 {
@@ -597,24 +686,19 @@ dispose_term(term *_t)
    dispose_term_rb_data(&t->rb_data);
 
    if (t->buffer) {
-      kfree_array_obj(t->buffer, u16, t->total_buffer_rows * t->cols);
+      kfree_array_obj(t->buffer, u16, t->rows * t->cols);
       t->buffer = NULL;
    }
 
+   term_sb_destroy(&t->sb);
+
    if (t->main_tabs_buf) {
       kfree2(t->main_tabs_buf, t->cols * t->rows);
       t->main_tabs_buf = NULL;
    }
 
-   if (t->alt_tabs_buf) {
-      kfree2(t->alt_tabs_buf, t->cols * t->rows);
-      t->alt_tabs_buf = NULL;
-   }
-
-   if (t->screen_buf_copy) {
-      kfree_array_obj(t->screen_buf_copy, u16, t->rows * t->cols);
-      t->screen_buf_copy = NULL;
-   }
+   ktimer_cancel(&t->alt_bufs_timer);
+   term_free_alt_buffers(t);
 }
 
 static void
@@ -630,10 +714,36 @@ vterm_get_params(term *_t, struct term_params *out)
    };
 }
 
+static void
+vterm_get_scrollback_stats(term *_t, struct term_scrollback_stats *out)
+{
+   struct vterm *const t = _t;
+   term_sb_get_stats(&t->sb, out);
+}
+
+static void
+vterm_get_mem_stats(term *_t, struct term_mem_stats *out)
+{
+   struct vterm *const t = _t;
+   struct term_scrollback_stats s;
+   const size_t cells = (size_t)t->rows * t->cols;
+
+   term_sb_get_stats(&t->sb, &s);
+
+   *out = (struct term_mem_stats) {
+      .screen_bytes = t->buffer != failsafe_buffer ? cells * sizeof(u16) : 0,
+      .tabs_bytes = t->main_tabs_buf ? cells : 0,
+      .alt_bytes = t->screen_buf_copy ? cells * (sizeof(u16) + 1) : 0,
+      .sb_bytes = s.alloc_bytes,
+      .using_alt = t->using_alt_buffer,
+   };
+}
+
 /*
- * Calculate an optimal number of extra buffer rows to use for a term of size
- * `rows` x `cols`, in order to minimize the memory waste (happening when the
- * buffer size is not a power of 2).
+ * Calculate the number of scrollback rows to use for a term of size
+ * `rows` x `cols`. The numbers come from the times when the scrollback was
+ * not compressed and it was part of a single power-of-2 sized buffer, along
+ * with the screen rows: they're still a reasonable amount of history.
  */
 static u32 term_calc_extra_buf_rows(u16 rows, u16 cols)
 {
@@ -668,6 +778,7 @@ init_vterm(term *_t,
 #endif
 
    t->tabsize = 8;
+   ktimer_init(&t->alt_bufs_timer, &term_alt_bufs_timer_func);
 
    if (intf) {
 
@@ -697,19 +808,17 @@ init_vterm(term *_t,
 
    if (!in_panic() && intf) {
 
-      t->extra_buffer_rows =
-         rows_buf >= 0
-            ? (u32)rows_buf
-            : term_calc_extra_buf_rows(rows, cols);
-
-      t->total_buffer_rows = t->rows + t->extra_buffer_rows;
-
       if (is_kmalloc_initialized())
-         t->buffer = kmalloc(2 * t->total_buffer_rows * t->cols);
+         t->buffer = kalloc_array_obj(u16, t->rows * t->cols);
    }
 
    if (t->buffer) {
 
+      const u32 sb_rows =
+         rows_buf >= 0
+            ? (u32)rows_buf
+            : term_calc_extra_buf_rows(rows, cols);
+
       t->main_tabs_buf = kzmalloc(t->cols * t->rows);
 
       if (t->main_tabs_buf) {
@@ -719,13 +828,16 @@ init_vterm(term *_t,
       } else {
 
          if (t != &first_instance) {
-            kfree2(t->buffer, 2 * t->total_buffer_rows * t->cols);
+            kfree_array_obj(t->buffer, u16, t->rows * t->cols);
             return -ENOMEM;
          }
 
          printk("WARNING: unable to allocate main_tabs_buf\n");
       }
 
+      if (term_sb_init(&t->sb, t->cols, sb_rows) < 0)
+         printk("WARNING: unable to allocate the term scrollback\n");
+
    } else {
 
       /* We're in panic or we were unable to allocate the buffer */
@@ -736,8 +848,6 @@ init_vterm(term *_t,
       t->cols = (u16) MIN((u16)FAILSAFE_COLS, t->cols);
       t->rows = (u16) MIN((u16)FAILSAFE_ROWS, t->rows);
 
-      t->extra_buffer_rows = 0;
-      t->total_buffer_rows = t->rows;
       t->buffer = failsafe_buffer;
 
       if (!in_panic() && intf)
@@ -751,8 +861,8 @@ init_vterm(term *_t,
    t->vi->enable_cursor();
    term_int_move_cur(t, 0, 0);
    t->initialized = true;
-   printk("video_term: buffer rows: %u (%u screens)\n",
-          t->total_buffer_rows, t->total_buffer_rows / t->rows);
+   printk("video_term: scrollback rows: %u (%u screens), %u KB\n",
+          t->sb.max_rows, t->sb.max_rows / t->rows, t->sb.buf_size / KB);
    return 0;
 }
 
@@ -779,6 +889,10 @@ static const struct term_interface intf = {
    .pause_output = vterm_pause_output,
    .restart_output = vterm_restart_output,
    .set_filter = vterm_set_filter,
+   .set_plain_chars_func = vterm_set_plain_chars_func,
+   .get_scrollback_stats = vterm_get_scrollback_stats,
+   .get_mem_stats = vterm_get_mem_stats,
+   .drop_scrollback = vterm_drop_scrollback,
 
    .get_first_term = vterm_get_first_inst,
    .video_term_init = init_vterm,
@@ -32,6 +32,8 @@ enum term_action_type {
    a_insert_blank_chars,
    a_simple_del_chars,
    a_simple_erase_chars,
+   a_drop_scrollback,
+   a_free_alt_buffers,
 };
 
 /*
@@ -99,6 +101,33 @@ STATIC_ASSERT(sizeof(struct term_action) == (2 * sizeof(ulong)));
 u16 vterm_get_curr_row(struct vterm *t);
 u16 vterm_get_curr_col(struct vterm *t);
 
+/* --- compressed scrollback (see term_scrollback.c) --- */
+
+struct term_scrollback_stats;
+
+struct term_scrollback {
+
+   u8 *buf;                   /* ring buffer of compressed rows */
+   u32 *rows_off;             /* ring of the rows' offsets in `buf` */
+   u8 *tmp;                   /* scratch buffer for a single record */
+   u16 *row;                  /* the last row returned by term_sb_get_row() */
+   u32 buf_size;              /* power of 2 */
+   u32 head;                  /* free-running write offset in `buf` */
+   u32 tail;                  /* free-running offset of the oldest row */
+   u32 max_rows;              /* capacity of `rows_off` */
+   u32 first;                 /* index in `rows_off` of the oldest row */
+   u32 count;                 /* rows currently stored */
+   u16 cols;
+};
+
+int term_sb_init(struct term_scrollback *sb, u16 cols, u32 max_rows);
+void term_sb_destroy(struct term_scrollback *sb);
+void term_sb_clear(struct term_scrollback *sb);
+void term_sb_push_row(struct term_scrollback *sb, const u16 *row);
+u16 *term_sb_get_row(struct term_scrollback *sb, u32 n);
+void term_sb_get_stats(struct term_scrollback *sb,
+                       struct term_scrollback_stats *s);
+
 static ALWAYS_INLINE void
 term_make_action_write(struct term_action *a,
                        const char *buf,
@@ -214,6 +243,22 @@ term_make_action_reset(struct term_action *a)
    };
 }
 
+static ALWAYS_INLINE void
+term_make_action_drop_scrollback(struct term_action *a)
+{
+   *a = (struct term_action) {
+      .type1 = a_drop_scrollback,
+   };
+}
+
+static ALWAYS_INLINE void
+term_make_action_free_alt_buffers(struct term_action *a)
+{
+   *a = (struct term_action) {
+      .type1 = a_free_alt_buffers,
+   };
+}
+
 static ALWAYS_INLINE void
 term_make_action_pause_output(struct term_action *a)
 {
@@ -40,11 +40,16 @@ struct dp_screen *dp_ctx;
 fs_handle dp_input_handle;
 
 static bool skip_next_keypress;
+static bool dp_paused;
+static int dp_refresh_idx = 2;
 static ATOMIC(bool) dp_running;
+
+/* Intervals between the automatic redraws, selected with the '+'/'-' keys */
+static const u32 dp_refresh_ms[] = { 250, 500, 1000, 2000, 5000 };
 static struct list dp_screens_list = STATIC_LIST_INIT(dp_screens_list);
 
 static inline void
-dp_write_header(int i, const char *s, bool selected)
+dp_write_header(int i, const char *s, bool selected, bool compact)
 {
    if (selected) {
 
@@ -53,11 +58,29 @@ dp_write_header(int i, const char *s, bool selected)
          i, s
       );
 
+   } else if (compact) {
+      dp_write_raw("%d " RESET_ATTRS, i);
    } else {
       dp_write_raw("%d[%s]" RESET_ATTRS " ", i, s);
    }
 }
 
+/*
+ * When the labels of all the screens don't fit in the header, only the label
+ * of the current screen is shown: the other ones get just their number.
+ */
+static bool dp_use_compact_header(void)
+{
+   struct dp_screen *pos;
+   int len = sizeof("q[Quit] ") - 1;
+
+   list_for_each_ro(pos, &dp_screens_list, node) {
+      len += (int)strlen(pos->label) + 4;   /* "N[label] " */
+   }
+
+   return len > DP_W - 4;
+}
+
 static void dp_enter(void)
 {
    struct term_params tparams;
@@ -76,6 +99,7 @@ static void dp_enter(void)
    dp_end_row = dp_start_row + DP_H;
    dp_screen_start_row = dp_start_row + 3;
    dp_screen_rows = (DP_H - 2 - (dp_screen_start_row - dp_start_row));
+   dp_frame_init();
 
    list_for_each_ro(pos, &dp_screens_list, node) {
 
@@ -107,6 +131,7 @@ static void dp_exit(void)
       dp_write_raw("\n");
    }
 
+   dp_frame_destroy();
    dp_set_cursor_enabled(true);
 }
 
@@ -128,17 +153,29 @@ void dp_register_screen(struct dp_screen *screen)
    list_add_after(pred, &screen->node);
 }
 
-static void redraw_screen(void)
+static u32 dp_get_refresh_ticks(void)
+{
+   if (dp_paused)
+      return 0;
+
+   return MAX(1u, (u32)ms_to_ticks(dp_refresh_ms[dp_refresh_idx]));
+}
+
+static void dp_draw_frame(void)
 {
    struct dp_screen *pos;
    char buf[64];
    int rc;
 
-   dp_clear();
+   const bool compact = dp_use_compact_header();
+
    dp_move_cursor(dp_start_row + 1, dp_start_col + 2);
 
    list_for_each_ro(pos, &dp_screens_list, node) {
-      dp_write_header(pos->index+1, pos->label, pos == dp_ctx);
+      dp_write_header((pos->index + 1) % 10,
+                      pos->label,
+                      pos == dp_ctx,
+                      compact);
    }
 
    dp_write_raw("q[Quit]" RESET_ATTRS " ");
@@ -156,6 +193,28 @@ static void redraw_screen(void)
 
    dp_move_cursor(dp_end_row - 1, dp_start_col + DP_W - rc - 2);
    dp_write_raw(E_COLOR_BR_RED "%s" RESET_ATTRS, buf);
+
+   dp_move_cursor(dp_end_row - 1, dp_start_col + 2);
+
+   if (dp_paused)
+      dp_write_raw(E_COLOR_BR_RED "[ paused: p ]" RESET_ATTRS);
+   else
+      dp_write_raw(E_COLOR_BR_WHITE "[ refresh %u ms: +/-, p ]" RESET_ATTRS,
+                   dp_refresh_ms[dp_refresh_idx]);
+}
+
+/*
+ * The frame is recorded and only the rows changed since the last one get
+ * written to the terminal. When that's not possible (see dp_frame_end()), the
+ * frame is drawn again, this time directly.
+ */
+static void redraw_screen(void)
+{
+   do {
+      dp_frame_begin();
+      dp_draw_frame();
+   } while (!dp_frame_end());
+
    dp_move_cursor(dp_rows, 1);
    ui_need_update = false;
 }
@@ -168,7 +227,9 @@ dp_main_handle_keypress(struct key_event ke)
    if ('0' <= ke.print_char && ke.print_char <= '9') {
 
       struct dp_screen *pos;
-      rc = ke.print_char - '0';
+
+      /* The key '0' selects the 10th screen, as on a keyboard's top row */
+      rc = ke.print_char == '0' ? 10 : ke.print_char - '0';
 
       list_for_each_ro(pos, &dp_screens_list, node) {
 
@@ -179,6 +240,25 @@ dp_main_handle_keypress(struct key_event ke)
          }
       }
 
+   } else if (ke.print_char == 'p') {
+
+      dp_paused = !dp_paused;
+      ui_need_update = true;
+
+   } else if (ke.print_char == '+') {
+
+      if (dp_refresh_idx > 0) {
+         dp_refresh_idx--;
+         ui_need_update = true;
+      }
+
+   } else if (ke.print_char == '-') {
+
+      if (dp_refresh_idx < (int)ARRAY_SIZE(dp_refresh_ms) - 1) {
+         dp_refresh_idx++;
+         ui_need_update = true;
+      }
+
    } else if (ke.key == KEY_PAGE_DOWN) {
 
       if (dp_ctx->row_off + dp_screen_rows < dp_ctx->row_max) {
@@ -201,7 +281,16 @@ dp_main_body(enum term_type tt, struct key_event ke)
    int rc;
    bool dp_screen_key_handled = false;
 
-   if (!skip_next_keypress) {
+   if (!ke.pressed) {
+
+      /*
+       * No key pressed before the refresh interval elapsed: redraw, unless
+       * paused or a modal message is waiting for a key.
+       */
+      if (!skip_next_keypress && !dp_paused)
+         ui_need_update = true;
+
+   } else if (!skip_next_keypress) {
 
       dp_main_handle_keypress(ke);
 
@@ -316,7 +405,9 @@ dp_common_entry(bool only_tracing)
          if (!rc && ke.print_char == 'q')
             break;
 
-         if (dp_read_ke_from_tty(&ke) < 0)
+         rc = dp_read_ke_from_tty_timeout(&ke, dp_get_refresh_ticks());
+
+         if (rc < 0)
             break;
 
          if (ke.print_char == DP_KEY_CTRL_C)
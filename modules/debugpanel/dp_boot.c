@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/boot_trace.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+static int row;
+
+static void dp_show_boot(void)
+{
+   const struct boot_trace_event *e;
+   u64 dur;
+
+   row = dp_screen_start_row;
+
+   dp_writeln(
+      "             step             "
+      TERM_VLINE "     arg     "
+      TERM_VLINE "  start (us)  "
+      TERM_VLINE "  time (us) "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqqqqqqqqqqqqqnqqqqqqqqqqqqqnqqqqqqqqqqqqqqnqqqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; (e = boot_trace_get_event(i)) != NULL; i++) {
+
+      dur = e->end > e->start ? e->end - e->start : 0;
+
+      dp_writeln(
+         " %-28.28s "
+         TERM_VLINE " %-11.11s "
+         TERM_VLINE " %12lu "
+         TERM_VLINE " %10lu ",
+         e->name,
+         e->arg ? e->arg : "",
+         (ulong)boot_trace_tsc_to_us(e->start),
+         (ulong)boot_trace_tsc_to_us(dur)
+      );
+   }
+
+   dp_writeln("");
+   dp_writeln("Start times are since the CPU reset: "
+              "the one of kmain includes the bootloader");
+}
+
+static struct dp_screen dp_boot_screen =
+{
+   .index = 7,
+   .label = "Boot",
+   .draw_func = dp_show_boot,
+   .on_keypress_func = NULL,
+};
+
+__attribute__((constructor))
+static void dp_boot_init(void)
+{
+   dp_register_screen(&dp_boot_screen);
+}
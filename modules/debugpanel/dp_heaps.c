@@ -1,10 +1,16 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_kmalloc.h>
+
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/term.h>
+#include <tilck/kernel/tty.h>
 
 #include "termutil.h"
 #include "dp_int.h"
@@ -16,6 +22,42 @@ static size_t tot_usable_mem_kb;
 static size_t tot_used_mem_kb;
 static long tot_diff;
 
+#define DP_TOP_CALLSITES                               16
+
+static struct debug_kmalloc_callsite_info top_sites[DP_TOP_CALLSITES];
+static int top_sites_count;
+
+/* Keeps in `top_sites` the call sites with the most allocations */
+static void dp_heaps_load_top_callsites(void)
+{
+   struct debug_kmalloc_callsite_info ci;
+   int j;
+
+   top_sites_count = 0;
+
+   for (int i = 0; debug_kmalloc_get_callsite_info(i, &ci); i++) {
+
+      if (top_sites_count == DP_TOP_CALLSITES &&
+          ci.count <= top_sites[DP_TOP_CALLSITES - 1].count)
+      {
+         continue;
+      }
+
+      if (top_sites_count < DP_TOP_CALLSITES)
+         top_sites_count++;
+
+      for (j = top_sites_count - 1; j > 0; j--) {
+
+         if (top_sites[j - 1].count >= ci.count)
+            break;
+
+         top_sites[j] = top_sites[j - 1];
+      }
+
+      top_sites[j] = ci;
+   }
+}
+
 static void dp_heaps_on_enter(void)
 {
    tot_usable_mem_kb = 0;
@@ -40,6 +82,197 @@ static void dp_heaps_on_enter(void)
    ASSERT(tot_usable_mem_kb > 0);
 
    debug_kmalloc_get_stats(&stats);
+
+   if (KMALLOC_CALLSITE_STATS)
+      dp_heaps_load_top_callsites();
+}
+
+static int dp_show_kmalloc_caches(int row)
+{
+   struct debug_kmalloc_cache_info ci;
+
+   dp_writeln(
+      "     cache name     "
+      TERM_VLINE " size "
+      TERM_VLINE " cached "
+      TERM_VLINE "   allocs   "
+      TERM_VLINE "  hits  "
+      TERM_VLINE "  spills  "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqqqnqqqqqqnqqqqqqqqnqqqqqqqqqqqqnqqqqqqqqnqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; debug_kmalloc_get_cache_info(i, &ci); i++) {
+
+      const u32 hits_pm =
+         ci.allocs ? (u32)((u64)ci.hits * 1000 / ci.allocs) : 0;
+
+      dp_writeln(
+         " %-18s "
+         TERM_VLINE " %4u "
+         TERM_VLINE "   %2u   "
+         TERM_VLINE " %10u "
+         TERM_VLINE " %3u.%u%% "
+         TERM_VLINE " %8u ",
+         ci.name,
+         ci.obj_size,
+         ci.cached,
+         ci.allocs,
+         hits_pm / 10, hits_pm % 10,
+         ci.spills
+      );
+   }
+
+   dp_writeln("");
+   return row;
+}
+
+static int dp_show_kmalloc_callsites(int row)
+{
+   char site[64];
+   const char *sym;
+   long off;
+
+   if (!KMALLOC_CALLSITE_STATS)
+      return row;
+
+   dp_writeln(
+      "   allocs   "
+      TERM_VLINE "  bytes   "
+      TERM_VLINE "   live   "
+      TERM_VLINE " call site (untracked allocs: %u)",
+      debug_kmalloc_get_untracked_callsites_allocs()
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqnqqqqqqqqqqnqqqqqqqqqqnqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; i < top_sites_count; i++) {
+
+      const struct debug_kmalloc_callsite_info *ci = &top_sites[i];
+      sym = find_sym_at_addr(ci->caller, &off, NULL);
+
+      if (sym)
+         snprintk(site, sizeof(site), "%s+%ld", sym, off);
+      else
+         snprintk(site, sizeof(site), "%p", TO_PTR(ci->caller));
+
+      dp_writeln(
+         " %10u "
+         TERM_VLINE " %5u KB "
+         TERM_VLINE " %5u KB "
+         TERM_VLINE " %s",
+         ci->count,
+         (u32)(ci->bytes / KB),
+         (u32)(ci->live_bytes / KB),
+         site
+      );
+   }
+
+   dp_writeln("");
+   return row;
+}
+
+static int dp_show_scrollback_stats(int row)
+{
+   struct term_scrollback_stats s;
+
+   dp_writeln(
+      " tty "
+      TERM_VLINE "  rows  "
+      TERM_VLINE " max rows "
+      TERM_VLINE "  used  "
+      TERM_VLINE " alloc  "
+      TERM_VLINE "  raw   "
+      TERM_VLINE " saved  "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqnqqqqqqqqnqqqqqqqqqqnqqqqqqqqnqqqqqqqqnqqqqqqqqnqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 1; i <= kopt_ttys; i++) {
+
+      if (!tty_get_scrollback_stats(i, &s))
+         continue;
+
+      dp_writeln(
+         " %3d "
+         TERM_VLINE " %6u "
+         TERM_VLINE "  %6u  "
+         TERM_VLINE " %3u KB "
+         TERM_VLINE " %3u KB "
+         TERM_VLINE " %3u KB "
+         TERM_VLINE " %3d KB ",
+         i, s.rows, s.max_rows,
+         s.used_bytes / KB,
+         s.alloc_bytes / KB,
+         s.uncompressed_bytes / KB,
+         ((long)s.uncompressed_bytes - (long)s.alloc_bytes) / (long)KB
+      );
+   }
+
+   dp_writeln("");
+   return row;
+}
+
+static int dp_show_console_mem_stats(int row)
+{
+   struct term_mem_stats s;
+   size_t tot;
+
+   dp_writeln(
+      " tty "
+      TERM_VLINE " screen "
+      TERM_VLINE "  tabs  "
+      TERM_VLINE "   alt   "
+      TERM_VLINE " scrollb "
+      TERM_VLINE " total  "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqnqqqqqqqqnqqqqqqqqnqqqqqqqqqnqqqqqqqqqnqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 1; i <= kopt_ttys; i++) {
+
+      if (!tty_get_mem_stats(i, &s))
+         continue;
+
+      tot = s.screen_bytes + s.tabs_bytes + s.alt_bytes + s.sb_bytes;
+
+      dp_writeln(
+         " %3d "
+         TERM_VLINE " %3u KB "
+         TERM_VLINE " %3u KB "
+         TERM_VLINE " %3u KB%c "
+         TERM_VLINE "  %3u KB "
+         TERM_VLINE " %3u KB ",
+         i,
+         s.screen_bytes / KB,
+         s.tabs_bytes / KB,
+         s.alt_bytes / KB,
+         s.using_alt ? '*' : ' ',
+         s.sb_bytes / KB,
+         tot / KB
+      );
+   }
+
+   dp_writeln("");
+   dp_writeln("(*) alternate screen in use");
+   dp_writeln("");
+   return row;
 }
 
 static void dp_show_kmalloc_heaps(void)
@@ -121,6 +354,10 @@ static void dp_show_kmalloc_heaps(void)
    }
 
    dp_writeln("");
+   row = dp_show_kmalloc_caches(row);
+   row = dp_show_kmalloc_callsites(row);
+   row = dp_show_scrollback_stats(row);
+   row = dp_show_console_mem_stats(row);
 }
 
 static void dp_heaps_on_exit(void)
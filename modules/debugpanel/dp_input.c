@@ -13,6 +13,7 @@
 static int line_pos;
 static int line_len;
 static char line[72];
+static u64 read_deadline;
 
 typedef void (*key_handler_type)(char *, int);
 
@@ -30,6 +31,9 @@ read_single_byte(fs_handle h, char *buf, u32 len)
 
       if (rc == -EAGAIN) {
 
+         if (!len && read_deadline && get_ticks() >= read_deadline)
+            return 0; /* timeout: no key pressed */
+
          if (len > 0 && buf[0] == DP_KEY_ESC) {
 
             /*
@@ -140,6 +144,21 @@ convert_seq_to_key(char *buf, struct key_event *ke)
    }
 }
 
+/*
+ * Like dp_read_ke_from_tty(), but gives up after `timeout` ticks without any
+ * input, returning 0 with `ke` zeroed. A zero `timeout` means no timeout.
+ */
+int
+dp_read_ke_from_tty_timeout(struct key_event *ke, u32 timeout)
+{
+   int rc;
+
+   read_deadline = timeout ? get_ticks() + timeout : 0;
+   rc = dp_read_ke_from_tty(ke);
+   read_deadline = 0;
+   return rc;
+}
+
 int
 dp_read_ke_from_tty(struct key_event *ke)
 {
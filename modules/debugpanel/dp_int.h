@@ -43,6 +43,7 @@ static inline long dp_int_abs(long val) {
 
 void dp_register_screen(struct dp_screen *screen);
 int dp_read_ke_from_tty(struct key_event *ke);
+int dp_read_ke_from_tty_timeout(struct key_event *ke, u32 timeout);
 void dp_set_input_blocking(bool blocking);
 int dp_read_line(char *buf, int buf_size);
 enum kb_handler_action dp_tracing_screen(void);
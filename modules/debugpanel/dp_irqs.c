@@ -5,10 +5,14 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/lat_tracer.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/kb.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/tty.h>
+#include <tilck/mods/acpi.h>
 
 #include "termutil.h"
 
@@ -72,6 +76,165 @@ static void debug_dump_masked_irqs(void)
    dp_writeln("");
 }
 
+static void debug_dump_input_latency(void)
+{
+   struct tty_input_lat_stats s;
+   tty_get_input_lat_stats(&s);
+
+   dp_writeln("");
+   dp_writeln("Keyboard input latency (IRQ to read), events: %u, max: %u us",
+              s.events, s.max_us);
+
+   if (!s.events)
+      return;
+
+   for (int b = 0; b < TTY_INPUT_LAT_BUCKETS; b++) {
+
+      const u32 limit = TTY_INPUT_LAT_UNIT_US << b;
+
+      if (b < TTY_INPUT_LAT_BUCKETS - 1)
+         dp_write_raw("    < %6u us: ", limit);
+      else
+         dp_write_raw("   >= %6u us: ", limit >> 1);
+
+      dp_writeln("%6u (%2u%%)", s.buckets[b], s.buckets[b] * 100 / s.events);
+   }
+}
+
+static const char *const irq_hist_labels[] = {
+   "<1", "<2", "<4", "<8", "<16", "<32",
+   "<64", "<128", "<256", "<512", "<1k", ">=1k",
+};
+
+STATIC_ASSERT(ARRAY_SIZE(irq_hist_labels) == IRQ_STATS_HIST_BUCKETS);
+
+static inline u32 cycles_to_us(u64 cycles)
+{
+   return (u32)(tsc_to_ns(cycles) / 1000);
+}
+
+static void debug_dump_irq_latency(void)
+{
+   const u64 secs = get_ticks() / TIMER_HZ;
+   struct irq_stats s;
+
+   dp_writeln("");
+   dp_writeln("Per-IRQ stats (times in us)");
+   dp_writeln("   IRQ      count  avg/s  max/s   avg    max  "
+              "mask avg  mask max  depth");
+
+   for (int i = 0; i < IRQ_STATS_MAX_IRQS; i++) {
+
+      if (!irq_get_stats(i, &s) || !s.count)
+         continue;
+
+      dp_writeln("   #%-3d %9u %6u %6u %5u %6u  %8u  %8u  %5u",
+                 i,
+                 s.count,
+                 secs ? (u32)(s.count / secs) : s.count,
+                 s.max_rate,
+                 cycles_to_us(s.tot_cycles / s.count),
+                 cycles_to_us(s.max_cycles),
+                 cycles_to_us(s.masked_tot_cycles / s.count),
+                 cycles_to_us(s.masked_max_cycles),
+                 s.max_depth);
+   }
+
+   dp_writeln("");
+   dp_write_raw("   us:    ");
+
+   for (int b = 0; b < IRQ_STATS_HIST_BUCKETS; b++)
+      dp_write_raw("%5s", irq_hist_labels[b]);
+
+   dp_writeln("");
+
+   for (int i = 0; i < IRQ_STATS_MAX_IRQS; i++) {
+
+      if (!irq_get_stats(i, &s) || !s.count)
+         continue;
+
+      dp_write_raw("   #%-3d %%:", i);
+
+      for (int b = 0; b < IRQ_STATS_HIST_BUCKETS; b++)
+         dp_write_raw("%5u", (u32)((u64)s.hist[b] * 100 / s.count));
+
+      dp_writeln("");
+   }
+}
+
+#if MOD_acpi
+
+static void debug_dump_acpi_sci_latency(void)
+{
+   struct acpi_osl_stats s;
+   acpi_get_osl_stats(&s);
+
+   if (!s.sci_count)
+      return;
+
+   dp_writeln("");
+   dp_writeln("ACPI SCIs: %u, notify jobs: %u queued, %u inline",
+              s.sci_count, s.notify_queued, s.notify_inline);
+
+   if (s.sci_notify_count) {
+      dp_writeln("   SCI -> notify handler: %u events, avg: %u us, max: %u us",
+                 s.sci_notify_count,
+                 cycles_to_us(s.sci_notify_lat_tot / s.sci_notify_count),
+                 cycles_to_us(s.sci_notify_lat_max));
+   }
+}
+
+#else
+
+static void debug_dump_acpi_sci_latency(void) { }
+
+#endif
+
+#if LATENCY_TRACER
+
+static void dp_print_lat_frame(void *addr)
+{
+   long off = 0;
+   const char *sym = find_sym_at_addr_safe((ulong)addr, &off, NULL);
+
+   if (sym)
+      dp_write_raw("%s+%ld", sym, off);
+   else
+      dp_write_raw("%p", addr);
+}
+
+static void debug_dump_lat_trace(void)
+{
+   struct lat_trace_entry entries[LAT_TRACE_MAX_ENTRIES];
+   int n;
+
+   for (int k = 0; k < LAT_TRACE_KINDS; k++) {
+
+      n = lat_trace_get_entries(k, entries, ARRAY_SIZE(entries));
+
+      dp_writeln("");
+      dp_writeln("Longest %s intervals (stacks in /syst/cpu/latency)",
+                 lat_trace_kind_names[k]);
+
+      for (int i = 0; i < n; i++) {
+
+         struct lat_trace_entry *e = &entries[i];
+
+         dp_write_raw("   %6u us tid %5d: ", cycles_to_us(e->cycles), e->tid);
+         dp_print_lat_frame(e->start.frames[0]);
+         dp_write_raw(" -> ");
+         dp_print_lat_frame(e->end.frames[0]);
+         dp_writeln("");
+      }
+   }
+}
+
+#else
+
+static void debug_dump_lat_trace(void) { }
+
+#endif
+
 static void dp_show_irq_stats(void)
 {
    row = dp_screen_start_row;
@@ -81,6 +244,10 @@ static void dp_show_irq_stats(void)
    debug_dump_spur_irq_count();
    debug_dump_unhandled_irq_count();
    debug_dump_masked_irqs();
+   debug_dump_irq_latency();
+   debug_dump_acpi_sci_latency();
+   debug_dump_lat_trace();
+   debug_dump_input_latency();
 }
 
 static struct dp_screen dp_irqs_screen =
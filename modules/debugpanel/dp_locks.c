@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_debug.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/lock_stats.h>
+#include <tilck/kernel/boot_trace.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#if LOCK_STATS
+
+#define DP_MAX_LOCK_CLASSES         64
+
+static int row;
+static struct lock_class classes[DP_MAX_LOCK_CLASSES];
+
+static void dp_show_locks(void)
+{
+   const int n = lock_stats_get_classes(classes, ARRAY_SIZE(classes));
+   row = dp_screen_start_row;
+
+   dp_writeln("Lock classes by contentions. Press 'r' to reset the stats.");
+   dp_writeln("");
+
+   dp_writeln(
+      "   class    "
+      TERM_VLINE "   acquired  "
+      TERM_VLINE "  waits  "
+      TERM_VLINE " avg us  "
+      TERM_VLINE "  max us  "
+      TERM_VLINE " hold "
+      TERM_VLINE " blkr "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqnqqqqqqqqqqqqqnqqqqqqqqqnqqqqqqqqqnqqqqqqqqqqnqqqqqqnqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; i < n; i++) {
+
+      const struct lock_class *lc = &classes[i];
+      const u64 avg = lc->contentions ? lc->total_wait / lc->contentions : 0;
+
+      dp_writeln(
+         " %-10.10s "
+         TERM_VLINE " %11" PRIu64 " "
+         TERM_VLINE " %7" PRIu64 " "
+         TERM_VLINE " %7lu "
+         TERM_VLINE " %8lu "
+         TERM_VLINE " %4d "
+         TERM_VLINE " %4d ",
+         lc->name,
+         lc->acquisitions,
+         lc->contentions,
+         (ulong)boot_trace_tsc_to_us(avg),
+         (ulong)boot_trace_tsc_to_us(lc->max_wait),
+         lc->holder_tid,
+         lc->blocker_tid
+      );
+   }
+}
+
+static enum kb_handler_action
+dp_locks_keypress(struct key_event ke)
+{
+   if (ke.print_char == 'r') {
+      lock_stats_reset();
+      ui_need_update = true;
+      return kb_handler_ok_and_continue;
+   }
+
+   return kb_handler_nak;
+}
+
+static struct dp_screen dp_locks_screen =
+{
+   .index = 9,
+   .label = "Locks",
+   .draw_func = dp_show_locks,
+   .on_keypress_func = dp_locks_keypress,
+};
+
+__attribute__((constructor))
+static void dp_locks_init(void)
+{
+   dp_register_screen(&dp_locks_screen);
+}
+
+#endif // #if LOCK_STATS
@@ -24,7 +24,17 @@ struct chunk_info {
    u32 max_waste_p;
 };
 
+struct frag_info {
+
+   size_t tot_free;
+   size_t largest_free;             /* biggest free block in any heap */
+   u32 ll_heaps;                    /* long-lived heaps */
+   size_t ll_size;
+   size_t ll_used;
+};
+
 static struct debug_kmalloc_stats stats;
+static struct frag_info frag;
 static u64 lf_allocs;
 static u64 lf_waste;
 static size_t chunks_count;
@@ -60,11 +70,40 @@ static long dp_chunks_cmpf_waste_p(const void *a, const void *b)
    return (long)y->max_waste_p - (long)x->max_waste_p;
 }
 
+static void dp_chunks_read_frag_info(void)
+{
+   struct debug_kmalloc_heap_info hi;
+
+   frag = (struct frag_info) { 0 };
+
+   disable_preemption();
+   {
+      for (int i = 0; i < KMALLOC_HEAPS_COUNT; i++) {
+
+         if (!debug_kmalloc_get_heap_info(i, &hi))
+            break;
+
+         frag.tot_free += hi.size - hi.mem_allocated;
+         frag.largest_free =
+            MAX(frag.largest_free, debug_kmalloc_get_heap_largest_free(i));
+
+         if (hi.long_lived) {
+            frag.ll_heaps++;
+            frag.ll_size += hi.size;
+            frag.ll_used += hi.mem_allocated;
+         }
+      }
+   }
+   enable_preemption();
+}
+
 static void dp_chunks_enter(void)
 {
    struct debug_kmalloc_chunks_ctx ctx;
    size_t s, c;
 
+   dp_chunks_read_frag_info();
+
    if (!KMALLOC_HEAVY_STATS)
       return;
 
@@ -131,37 +170,37 @@ static int dp_chunks_keypress(struct key_event ke)
    switch (c) {
 
       case 's':
-         insertion_sort_generic(chunks_arr,
-                                sizeof(chunks_arr[0]),
-                                (u32)chunks_count,
-                                dp_chunks_cmpf_size);
+         intro_sort_generic(chunks_arr,
+                            sizeof(chunks_arr[0]),
+                            (u32)chunks_count,
+                            dp_chunks_cmpf_size);
          ui_need_update = true;
          chunks_order_by = c;
          return kb_handler_ok_and_continue;
 
       case 'c':
-         insertion_sort_generic(chunks_arr,
-                                sizeof(chunks_arr[0]),
-                                (u32)chunks_count,
-                                dp_chunks_cmpf_count);
+         intro_sort_generic(chunks_arr,
+                            sizeof(chunks_arr[0]),
+                            (u32)chunks_count,
+                            dp_chunks_cmpf_count);
          ui_need_update = true;
          chunks_order_by = c;
          return kb_handler_ok_and_continue;
 
       case 'w':
-         insertion_sort_generic(chunks_arr,
-                                sizeof(chunks_arr[0]),
-                                (u32)chunks_count,
-                                dp_chunks_cmpf_waste);
+         intro_sort_generic(chunks_arr,
+                            sizeof(chunks_arr[0]),
+                            (u32)chunks_count,
+                            dp_chunks_cmpf_waste);
          ui_need_update = true;
          chunks_order_by = c;
          return kb_handler_ok_and_continue;
 
       case 't':
-         insertion_sort_generic(chunks_arr,
-                                sizeof(chunks_arr[0]),
-                                (u32)chunks_count,
-                                dp_chunks_cmpf_waste_p);
+         intro_sort_generic(chunks_arr,
+                            sizeof(chunks_arr[0]),
+                            (u32)chunks_count,
+                            dp_chunks_cmpf_waste_p);
          ui_need_update = true;
          chunks_order_by = c;
          return kb_handler_ok_and_continue;
@@ -177,6 +216,24 @@ static void dp_show_chunks(void)
    int row = dp_screen_start_row;
    const u64 lf_tot = lf_allocs + lf_waste;
 
+   /*
+    * The fragmentation is the fraction of the free memory that is NOT in the
+    * biggest free block: 0% means that all of it could be allocated at once.
+    */
+   const u32 frag_p = frag.tot_free
+      ? (u32)((u64)(frag.tot_free - frag.largest_free) * 1000 / frag.tot_free)
+      : 0;
+
+   dp_writeln("Heaps fragmentation:       %3u.%u%% "
+              "(biggest free block: %zu KB of %zu KB free)",
+              frag_p / 10, frag_p % 10,
+              frag.largest_free / KB, frag.tot_free / KB);
+
+   dp_writeln("Long-lived heaps:          %5u heaps, %zu KB used of %zu KB",
+              frag.ll_heaps, frag.ll_used / KB, frag.ll_size / KB);
+
+   dp_writeln("");
+
    if (!KMALLOC_HEAVY_STATS) {
       dp_writeln("Not available: recompile with KMALLOC_HEAVY_STATS=1");
       return;
@@ -100,8 +100,11 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(KERNEL_GCOV);
    DUMP_BOOL_OPT(FORK_NO_COW);
    DUMP_BOOL_OPT(MMAP_NO_COW);
+   DUMP_BOOL_OPT(ZRAM_SWAP);
+   DUMP_BOOL_OPT(KSM_MERGE);
    DUMP_BOOL_OPT(PANIC_SHOW_REGS);
    DUMP_BOOL_OPT(KMALLOC_HEAVY_STATS);
+   DUMP_BOOL_OPT(KMALLOC_CALLSITE_STATS);
    DUMP_BOOL_OPT(KMALLOC_FREE_MEM_POISONING);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_DEBUG_LOG);
    DUMP_BOOL_OPT(KMALLOC_SUPPORT_LEAK_DETECTOR);
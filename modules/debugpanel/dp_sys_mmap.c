@@ -8,6 +8,7 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/kmalloc_debug.h>
@@ -166,6 +167,43 @@ static void dump_global_mem_stats(void)
    dp_writeln("");
 }
 
+#define PF_KB(n)          ((u32)((n) * (PAGE_SIZE / KB)))
+
+static void dump_pageframe_stats(void)
+{
+   static struct pageframe_stats s;
+   get_pageframe_stats(&s);
+
+   dp_writeln(
+      "Page frames: kernel  %8u KB, file  %8u KB, ushared  %8u KB",
+      PF_KB(s.by_type[PF_TYPE_KERNEL]),
+      PF_KB(s.by_type[PF_TYPE_FILE]),
+      PF_KB(s.by_type[PF_TYPE_USHARED])
+   );
+
+   dp_writeln(
+      "             anon    %8u KB, other %8u KB, reserved %8u KB",
+      PF_KB(s.anon),
+      PF_KB(s.by_type[PF_TYPE_OTHER] - s.anon),
+      PF_KB(s.by_type[PF_TYPE_RESERVED])
+   );
+
+   dp_writeln(
+      "Mapped:      %8u KB, shared: %8u KB, saved by sharing: %8u KB",
+      PF_KB(s.mapped),
+      PF_KB(s.shared),
+      PF_KB(s.saved)
+   );
+
+   dp_writeln(
+      "Page tables shared by fork: %u, lazily freed: %8u KB",
+      (u32)s.by_type[PF_TYPE_PGTABLE],
+      PF_KB(s.by_type[PF_TYPE_LAZYFREE])
+   );
+
+   dp_writeln("");
+}
+
 static void dp_show_sys_mmap(void)
 {
    row = dp_screen_start_row;
@@ -173,6 +211,7 @@ static void dp_show_sys_mmap(void)
    disable_preemption();
    {
       dump_global_mem_stats();
+      dump_pageframe_stats();
    }
    enable_preemption();
 
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_tracing.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/mods/tracing.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+#if MOD_tracing
+
+static int row;
+
+/* Upper bound, in microseconds, of the bucket containing the p-th percentile */
+static ulong sys_stats_percentile(const struct syscall_stats *s, u32 p)
+{
+   const u64 target = ((u64)s->calls * p + 99) / 100;
+   u64 sum = 0;
+   int b;
+
+   for (b = 0; b < SYS_LAT_BUCKETS - 1; b++) {
+
+      sum += s->lat[b];
+
+      if (sum >= target)
+         break;
+   }
+
+   return (ulong)boot_trace_tsc_to_us(1ull << (b + SYS_LAT_UNIT_SHIFT));
+}
+
+static void dp_show_syscalls(void)
+{
+   row = dp_screen_start_row;
+
+   dp_writeln(
+      "     syscall      "
+      TERM_VLINE "  calls   "
+      TERM_VLINE " errors "
+      TERM_VLINE " p50 (us) "
+      TERM_VLINE " p90 (us) "
+      TERM_VLINE " p99 (us) "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqqqqqnqqqqqqqqqqnqqqqqqqqnqqqqqqqqqqnqqqqqqqqqqnqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (u32 i = 0; i < MAX_SYSCALLS; i++) {
+
+      const struct syscall_stats *s = tracing_get_syscall_stats(i);
+      const char *name = tracing_get_syscall_name(i);
+
+      if (!s->calls)
+         continue;
+
+      dp_writeln(
+         " %-16.16s "
+         TERM_VLINE " %8u "
+         TERM_VLINE " %6u "
+         TERM_VLINE " %8lu "
+         TERM_VLINE " %8lu "
+         TERM_VLINE " %8lu ",
+         name ? name + 4 : "?",
+         s->calls,
+         s->errors,
+         sys_stats_percentile(s, 50),
+         sys_stats_percentile(s, 90),
+         sys_stats_percentile(s, 99)
+      );
+   }
+}
+
+static struct dp_screen dp_syscalls_screen =
+{
+   .index = 8,
+   .label = "Syscalls",
+   .draw_func = dp_show_syscalls,
+   .on_keypress_func = NULL,
+};
+
+__attribute__((constructor))
+static void dp_syscalls_init(void)
+{
+   dp_register_screen(&dp_syscalls_screen);
+}
+
+#endif // #if MOD_tracing
@@ -6,11 +6,13 @@
 #include <tilck/common/printk.h>
 
 #include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/cmdline.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/boot_trace.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -28,6 +30,8 @@ static int curr_idx;
 static int max_idx;
 static int sel_tid;
 static bool sel_tid_found;
+static bool sched_view;
+static bool mem_view;
 
 static enum {
 
@@ -153,6 +157,155 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
    }
 }
 
+/*
+ * Same as debug_get_task_dump_util_str(), but for the scheduler stats view,
+ * where the pgid/sid/ppid/tty columns are replaced by the context switches
+ * and the wake-to-run latency.
+ */
+static const char *
+debug_get_sched_dump_util_str(enum task_dump_util_str t)
+{
+   static bool initialized;
+   static char fmt[120];
+   static char hfmt[120];
+   static char header[120];
+   static char hline_sep[120] = "qqqqqqqnqqqqqnqqqqqqqqqnqqqqqqqqqnqqqqqqqqqn"
+                                "qqqqqqqqqqn";
+
+   static char *hline_sep_end = &hline_sep[sizeof(hline_sep)];
+
+   if (!initialized) {
+
+      int name_field_len = DP_W - 60;
+
+      snprintk(fmt, sizeof(fmt),
+               " %%-5d "
+               TERM_VLINE " %%-3s "
+               TERM_VLINE " %%7u "
+               TERM_VLINE " %%7u "
+               TERM_VLINE " %%7lu "
+               TERM_VLINE " %%8lu "
+               TERM_VLINE " %%-%d.%ds",
+               name_field_len, name_field_len);
+
+      snprintk(hfmt, sizeof(hfmt),
+               " %%-5s "
+               TERM_VLINE " %%-3s "
+               TERM_VLINE " %%7s "
+               TERM_VLINE " %%7s "
+               TERM_VLINE " %%7s "
+               TERM_VLINE " %%8s "
+               TERM_VLINE " %%-%ds",
+               name_field_len);
+
+      snprintk(header,
+               sizeof(header),
+               hfmt,
+               "pid",
+               "S",
+               "vol cs",
+               "inv cs",
+               "avg us",
+               "max us",
+               "cmdline");
+
+      char *p = hline_sep + strlen(hline_sep);
+
+      for (int i = 0; i < name_field_len + 2 && p < hline_sep_end; i++, p++) {
+         *p = 'q';
+      }
+
+      initialized = true;
+   }
+
+   switch (t) {
+      case HEADER:
+         return header;
+
+      case ROW_FMT:
+         return fmt;
+
+      case HLINE:
+         return hline_sep;
+
+      default:
+         NOT_REACHED();
+   }
+}
+
+/*
+ * Same as debug_get_task_dump_util_str(), but for the memory view, showing
+ * the virtual size, the resident set size and the memory used for the page
+ * tables of each process, in KB.
+ */
+static const char *
+debug_get_mem_dump_util_str(enum task_dump_util_str t)
+{
+   static bool initialized;
+   static char fmt[120];
+   static char hfmt[120];
+   static char header[120];
+   static char hline_sep[120] =
+      "qqqqqqqnqqqqqnqqqqqqqqqqqnqqqqqqqqqqqnqqqqqqqqqn";
+
+   static char *hline_sep_end = &hline_sep[sizeof(hline_sep)];
+
+   if (!initialized) {
+
+      int name_field_len = DP_W - 52;
+
+      snprintk(fmt, sizeof(fmt),
+               " %%-5d "
+               TERM_VLINE " %%-3s "
+               TERM_VLINE " %%9lu "
+               TERM_VLINE " %%9lu "
+               TERM_VLINE " %%7lu "
+               TERM_VLINE " %%-%d.%ds",
+               name_field_len, name_field_len);
+
+      snprintk(hfmt, sizeof(hfmt),
+               " %%-5s "
+               TERM_VLINE " %%-3s "
+               TERM_VLINE " %%9s "
+               TERM_VLINE " %%9s "
+               TERM_VLINE " %%7s "
+               TERM_VLINE " %%-%ds",
+               name_field_len);
+
+      snprintk(header,
+               sizeof(header),
+               hfmt,
+               "pid",
+               "S",
+               "vsz KB",
+               "rss KB",
+               "pgt KB",
+               "cmdline");
+
+      char *p = hline_sep + strlen(hline_sep);
+
+      for (int i = 0; i < name_field_len + 2 && p < hline_sep_end; i++, p++) {
+         *p = 'q';
+      }
+
+      initialized = true;
+   }
+
+   switch (t) {
+      case HEADER:
+         return header;
+
+      case ROW_FMT:
+         return fmt;
+
+      case HLINE:
+         return hline_sep;
+
+      default:
+         NOT_REACHED();
+   }
+}
+
 struct per_task_cb_opts {
 
    bool kernel_tasks;
@@ -230,14 +383,48 @@ static int debug_per_task_cb(void *obj, void *arg)
          }
       }
 
-      dp_writeln(fmt,
-                 ti->tid,
-                 pi->pgid,
-                 pi->sid,
-                 pi->parent_pid,
-                 state_str,
-                 ttynum,
-                 buf);
+      if (sched_view) {
+
+         const struct sched_stats *st = &ti->sched_stats;
+         const u64 avg = st->wait_count ? st->wait_total / st->wait_count : 0;
+
+         dp_writeln(debug_get_sched_dump_util_str(ROW_FMT),
+                    ti->tid,
+                    state_str,
+                    st->nvcsw,
+                    st->nivcsw,
+                    (ulong)boot_trace_tsc_to_us(avg),
+                    (ulong)boot_trace_tsc_to_us(st->wait_max),
+                    buf);
+
+      } else if (mem_view) {
+
+         size_t vsz = 0, rss = 0, pgt = 0;
+
+         if (!is_kernel_thread(ti) && ti->state != TASK_STATE_ZOMBIE) {
+            process_get_mem_usage(pi, &vsz, &rss);
+            pgt = pdir_count_page_tables(pi->pdir);
+         }
+
+         dp_writeln(debug_get_mem_dump_util_str(ROW_FMT),
+                    ti->tid,
+                    state_str,
+                    (ulong)(vsz << PAGE_SHIFT) / KB,
+                    (ulong)(rss << PAGE_SHIFT) / KB,
+                    (ulong)(pgt << PAGE_SHIFT) / KB,
+                    buf);
+
+      } else {
+
+         dp_writeln(fmt,
+                    ti->tid,
+                    pi->pgid,
+                    pi->sid,
+                    pi->parent_pid,
+                    state_str,
+                    ttynum,
+                    buf);
+      }
 
       if (sel)
          dp_reset_attrs();
@@ -265,6 +452,10 @@ static void debug_dump_task_table_hr(bool plain_text)
    if (plain_text)
       dp_write_raw(GFX_ON "%s" GFX_OFF "\r\n",
                    debug_get_task_dump_util_str(HLINE));
+   else if (sched_view)
+      dp_writeln(GFX_ON "%s" GFX_OFF, debug_get_sched_dump_util_str(HLINE));
+   else if (mem_view)
+      dp_writeln(GFX_ON "%s" GFX_OFF, debug_get_mem_dump_util_str(HLINE));
    else
       dp_writeln(GFX_ON "%s" GFX_OFF, debug_get_task_dump_util_str(HLINE));
 }
@@ -405,6 +596,32 @@ dp_tasks_handle_sel_mode_keypress_r(void)
    return kb_handler_ok_and_continue;
 }
 
+static enum kb_handler_action
+dp_tasks_handle_keypress_l(void)
+{
+   sched_view = !sched_view;
+   mem_view = false;
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static enum kb_handler_action
+dp_tasks_handle_keypress_m(void)
+{
+   mem_view = !mem_view;
+   sched_view = false;
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
+static enum kb_handler_action
+dp_tasks_handle_keypress_z(void)
+{
+   sched_reset_global_stats();
+   ui_need_update = true;
+   return kb_handler_ok_and_continue;
+}
+
 static enum kb_handler_action
 dp_tasks_handle_sel_mode_keypress(struct key_event ke)
 {
@@ -422,6 +639,15 @@ dp_tasks_handle_sel_mode_keypress(struct key_event ke)
       case 'r':
          return dp_tasks_handle_sel_mode_keypress_r();
 
+      case 'l':
+         return dp_tasks_handle_keypress_l();
+
+      case 'm':
+         return dp_tasks_handle_keypress_m();
+
+      case 'z':
+         return dp_tasks_handle_keypress_z();
+
       case 'k':
          return dp_tasks_handle_sel_mode_keypress_k();
 
@@ -458,6 +684,15 @@ dp_tasks_handle_default_mode_keypress(struct key_event ke)
       case 'r':
          return dp_tasks_handle_sel_mode_keypress_r();
 
+      case 'l':
+         return dp_tasks_handle_keypress_l();
+
+      case 'm':
+         return dp_tasks_handle_keypress_m();
+
+      case 'z':
+         return dp_tasks_handle_keypress_z();
+
       case DP_KEY_ENTER:
          return dp_tasks_handle_default_mode_enter();
 
@@ -509,7 +744,11 @@ static void show_actions_menu(void)
          E_COLOR_BR_WHITE "Ctrl+T" RESET_ATTRS ": tracing mode"
       );
 
-      dp_writeln("");
+      dp_writeln(
+         E_COLOR_BR_WHITE "l" RESET_ATTRS ": sched stats view " TERM_VLINE " "
+         E_COLOR_BR_WHITE "m" RESET_ATTRS ": memory view " TERM_VLINE " "
+         E_COLOR_BR_WHITE "z" RESET_ATTRS ": reset global sched stats"
+      );
 
    } else if (mode == dp_tasks_mode_sel) {
 
@@ -523,7 +762,9 @@ static void show_actions_menu(void)
       dp_writeln(
          E_COLOR_BR_WHITE "k" RESET_ATTRS ": kill " TERM_VLINE " "
          E_COLOR_BR_WHITE "s" RESET_ATTRS ": stop " TERM_VLINE " "
-         E_COLOR_BR_WHITE "c" RESET_ATTRS ": continue "
+         E_COLOR_BR_WHITE "c" RESET_ATTRS ": continue " TERM_VLINE " "
+         E_COLOR_BR_WHITE "l" RESET_ATTRS ": sched stats " TERM_VLINE " "
+         E_COLOR_BR_WHITE "m" RESET_ATTRS ": memory"
       );
 
    }
@@ -540,6 +781,10 @@ void dp_dump_task_list(bool kernel_tasks, bool plain_text)
 
    if (plain_text)
       dp_write_raw("\r\n%s\r\n", debug_get_task_dump_util_str(HEADER));
+   else if (sched_view)
+      dp_writeln("%s", debug_get_sched_dump_util_str(HEADER));
+   else if (mem_view)
+      dp_writeln("%s", debug_get_mem_dump_util_str(HEADER));
    else
       dp_writeln("%s", debug_get_task_dump_util_str(HEADER));
 
@@ -573,11 +818,67 @@ void dp_dump_task_list(bool kernel_tasks, bool plain_text)
       dp_writeln("");
 }
 
+static void dp_show_global_sched_stats(void)
+{
+   struct sched_global_stats gs;
+   struct kmutex_spin_stats ks;
+   u64 tot = 0;
+   ulong avg_len_x100 = 0;
+   ulong avg_wait;
+   char buf[80];
+   int n = 0;
+
+   sched_get_global_stats(&gs);
+   kmutex_get_spin_stats(&ks);
+
+   for (int i = 0; i < SCHED_RQ_HIST_SIZE; i++)
+      tot += gs.rq_time[i];
+
+   avg_wait = (ulong)boot_trace_tsc_to_us(
+      gs.wait_count ? gs.wait_total / gs.wait_count : 0
+   );
+
+   if (tot)
+      avg_len_x100 = (ulong)(gs.rq_len_time * 100 / tot);
+
+   dp_writeln(
+      "Switches: %" PRIu64 " vol, %" PRIu64 " inv " TERM_VLINE
+      " Wait: avg %lu us, max %lu us",
+      gs.nvcsw, gs.nivcsw,
+      avg_wait, (ulong)boot_trace_tsc_to_us(gs.wait_max)
+   );
+
+   for (int i = 0; i < SCHED_RQ_HIST_SIZE && n < (int)sizeof(buf); i++) {
+      n += snprintk(buf + n, sizeof(buf) - (size_t)n, " %d%s:%u%%",
+                    i, i == SCHED_RQ_HIST_SIZE - 1 ? "+" : "",
+                    tot ? (u32)(gs.rq_time[i] * 100 / tot) : 0);
+   }
+
+   dp_writeln(
+      "Runqueue: len %d, max %d, avg %lu.%02lu",
+      gs.rq_len, gs.rq_max, avg_len_x100 / 100, avg_len_x100 % 100
+   );
+
+   dp_writeln("Time by runqueue len:%s", buf);
+
+   dp_writeln(
+      "Kmutex waits: %" PRIu64 " slept " TERM_VLINE
+      " Spin: %" PRIu64 " yields, %" PRIu64 " acquired, %" PRIu64 " failed",
+      ks.slept, ks.yields, ks.spin_acquired, ks.spin_failed
+   );
+
+   dp_writeln("");
+}
+
 static void dp_show_tasks(void)
 {
    row = dp_screen_start_row;
 
    show_actions_menu();
+
+   if (sched_view)
+      dp_show_global_sched_stats();
+
    dp_dump_task_list(true, false);
 }
 
@@ -318,6 +318,34 @@ dp_dump_trace_printk_event(struct trace_event *e,
    }
 }
 
+static void
+dp_dump_tracepoint_event(struct trace_event *e)
+{
+   const struct tracepoint_info *tpi = tracepoint_get_info(e->tp_ev.tp);
+
+   if (!tpi) {
+      dp_write_raw(E_COLOR_BR_RED "<unknown tracepoint>\r\n" RESET_ATTRS);
+      return;
+   }
+
+   dp_write_raw(E_COLOR_BR_BLUE "%s" RESET_ATTRS, tpi->name);
+
+   for (int i = 0; i < 3 && tpi->args[i]; i++) {
+
+      if (e->tp_ev.tp == tp_vfs_op && i == 0) {
+         dp_write_raw(" %s", tracepoint_get_vfs_op_name(e->tp_ev.args[0]));
+         continue;
+      }
+
+      if (tpi->hex_args & (1u << i))
+         dp_write_raw(" %s=%p", tpi->args[i], TO_PTR(e->tp_ev.args[i]));
+      else
+         dp_write_raw(" %s=%ld", tpi->args[i], (long)e->tp_ev.args[i]);
+   }
+
+   dp_write_raw("\r\n");
+}
+
 static void
 dp_dump_tracing_event(struct trace_event *e,
                       struct dump_trace_event_context *ctx)
@@ -357,6 +385,10 @@ dp_dump_tracing_event(struct trace_event *e,
          );
          break;
 
+      case te_tracepoint:
+         dp_dump_tracepoint_event(e);
+         break;
+
       default:
          dp_write_raw(
             E_COLOR_BR_RED "<unknown event %d>\r\n" RESET_ATTRS,
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/worker_thread.h>
+
+#include "termutil.h"
+#include "dp_int.h"
+
+static int row;
+
+static void dp_show_wth_queues(void)
+{
+   dp_writeln(
+      "    name    "
+      TERM_VLINE " prio "
+      TERM_VLINE " tid "
+      TERM_VLINE " queue "
+      TERM_VLINE " max "
+      TERM_VLINE "  enqueued  "
+      TERM_VLINE " dropped "
+      TERM_VLINE " grows "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqnqqqqqqnqqqqqnqqqqqqqnqqqqqnqqqqqqqqqqqqnqqqqqqqqqnqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; i < wth_get_count(); i++) {
+
+      struct worker_thread *wth = wth_get_by_index(i);
+      const struct wth_stats *s = wth_get_stats(wth);
+      const char *name = wth_get_name(wth);
+
+      dp_writeln(
+         " %-10s "
+         TERM_VLINE " %4d "
+         TERM_VLINE " %3d "
+         TERM_VLINE " %5u "
+         TERM_VLINE " %3u "
+         TERM_VLINE " %10u "
+         TERM_VLINE " %7u "
+         TERM_VLINE " %5u ",
+         name ? name : "generic",
+         wth_get_priority(wth),
+         wth_get_task(wth)->tid,
+         wth_get_queue_size(wth),
+         s->max_depth,
+         s->enqueued,
+         s->dropped,
+         s->grows
+      );
+   }
+}
+
+static void dp_show_wth_latency(void)
+{
+   dp_writeln("Jobs by ticks waited in the queue:");
+   dp_writeln("");
+   dp_write_raw("    name    ");
+
+   for (int b = 0; b < WTH_LATENCY_BUCKETS; b++) {
+
+      if (b == 0)
+         dp_write_raw(TERM_VLINE "    0 ");
+      else if (b < WTH_LATENCY_BUCKETS - 1)
+         dp_write_raw(TERM_VLINE " <%3u ", 1u << b);
+      else
+         dp_write_raw(TERM_VLINE " more ");
+   }
+
+   dp_writeln("");
+
+   for (int i = 0; i < wth_get_count(); i++) {
+
+      struct worker_thread *wth = wth_get_by_index(i);
+      const struct wth_stats *s = wth_get_stats(wth);
+      const char *name = wth_get_name(wth);
+
+      dp_write_raw(" %-10s ", name ? name : "generic");
+
+      for (int b = 0; b < WTH_LATENCY_BUCKETS; b++)
+         dp_write_raw(TERM_VLINE " %4u ", s->latency[b]);
+
+      dp_writeln("");
+   }
+}
+
+static void dp_show_wth(void)
+{
+   row = dp_screen_start_row;
+
+   dp_show_wth_queues();
+   dp_writeln("");
+   dp_show_wth_latency();
+}
+
+static struct dp_screen dp_wth_screen =
+{
+   .index = 6,
+   .label = "Workers",
+   .draw_func = dp_show_wth,
+   .on_keypress_func = NULL,
+};
+
+__attribute__((constructor))
+static void dp_wth_init(void)
+{
+   dp_register_screen(&dp_wth_screen);
+}
@@ -7,18 +7,265 @@
 #include <tilck/kernel/term.h>
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/tty_struct.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/hashtable.h>
 #include "termutil.h"
 
-static bool rev_colors;
+/*
+ * Damage-based redraw
+ * ---------------------
+ *
+ * Between dp_frame_begin() and dp_frame_end(), the output directed to the rows
+ * of the panel is not written to the terminal: it gets recorded in per-row
+ * buffers, while a hash of each row's content is kept. At the end of the
+ * frame, only the rows whose hash changed since the previous frame are erased
+ * and replayed. The damage is tracked per row, not per cell, because the
+ * screens emit escape sequences (colors, cursor movements) directly: replaying
+ * a whole row is the smallest unit which is always correct.
+ *
+ * Each row's recording starts from a cursor movement, because the current row
+ * is known only through dp_move_cursor(). The GFX charset and the reverse
+ * colors state at that point are recorded as well, so that replaying a row
+ * doesn't depend on what was emitted before it. On video terminals the
+ * reverse colors are a parameter of the write op, not an escape sequence:
+ * they are recorded as a NUL byte followed by the new state.
+ *
+ * When there is no previous frame on the screen (first draw, after the screen
+ * has been cleared or overwritten by something else), the frame is written
+ * directly, after clearing the screen, while still computing the hashes.
+ */
+
+#define DP_FRAME_ROW_SIZE        1024
+#define DP_FRAME_REV_MARK        '\0'
+
+struct dp_frame_row {
+
+   u32 hash;            /* hash of the content recorded in this frame */
+   u32 prev_hash;       /* hash of the content currently on the screen */
+   int len;             /* -1 when the content didn't fit in `buf` */
+   bool rev;            /* reverse colors state, as last recorded */
+   char *buf;
+};
 
-void dp_write_raw_int(const char *buf, int len)
+static bool rev_colors;
+static bool rev_attr;         /* REVERSE_VIDEO written on a serial term */
+
+static struct dp_frame_row frame_rows[DP_H];
+static char *frame_buf;
+static int frame_row = -1;    /* index in frame_rows[] of the cursor's row */
+static bool frame_active;     /* between dp_frame_begin() and dp_frame_end() */
+static bool frame_direct;     /* the frame goes straight to the terminal */
+static bool frame_valid;      /* the prev_hash values match the screen */
+static bool frame_video;
+static bool frame_gfx;
+
+static void dp_term_write(const char *buf, int len, bool rev)
 {
    struct tty *t = get_curr_process_tty();
 
    t->tintf->write(t->tstate,
                    buf,
                    (size_t)len,
-                   !rev_colors ? DP_COLOR : DP_REV_COLOR);
+                   !rev ? DP_COLOR : DP_REV_COLOR);
+}
+
+static void dp_frame_add(const char *buf, int len)
+{
+   struct dp_frame_row *r = &frame_rows[frame_row];
+
+   r->hash = hash_u32(r->hash ^ hash_str(buf, (size_t)len));
+
+   if (r->len < 0)
+      return;
+
+   if (!r->buf || r->len + len > DP_FRAME_ROW_SIZE) {
+      r->len = -1;
+      return;
+   }
+
+   memcpy(r->buf + r->len, buf, (size_t)len);
+   r->len += len;
+}
+
+static void dp_frame_add_rev_mark(void)
+{
+   const char mark[2] = { DP_FRAME_REV_MARK, (char)rev_colors };
+
+   dp_frame_add(mark, 2);
+   frame_rows[frame_row].rev = rev_colors;
+}
+
+/* Tracks the GFX_ON and GFX_OFF sequences written in the current frame */
+static void dp_frame_track_gfx(const char *buf, int len)
+{
+   for (int i = 0; i < len - 2; i++) {
+      if (buf[i] == '\033' && buf[i + 1] == '(')
+         frame_gfx = buf[i + 2] == '0';
+   }
+}
+
+static void dp_frame_set_row(int row)
+{
+   const int idx = row - dp_start_row;
+
+   if (idx < 0 || idx >= DP_H) {
+      frame_row = -1;
+      return;
+   }
+
+   frame_row = idx;
+
+   if (frame_gfx)
+      dp_frame_add(GFX_ON, sizeof(GFX_ON) - 1);
+
+   if (frame_video) {
+
+      if (frame_rows[idx].rev != rev_colors)
+         dp_frame_add_rev_mark();
+
+   } else if (rev_attr) {
+      dp_frame_add(REVERSE_VIDEO, sizeof(REVERSE_VIDEO) - 1);
+   }
+}
+
+void dp_write_raw_int(const char *buf, int len)
+{
+   if (frame_active) {
+
+      dp_frame_track_gfx(buf, len);
+
+      if (frame_row >= 0) {
+
+         if (frame_video && frame_rows[frame_row].rev != rev_colors)
+            dp_frame_add_rev_mark();
+
+         dp_frame_add(buf, len);
+
+         if (!frame_direct)
+            return;
+      }
+   }
+
+   dp_term_write(buf, len, rev_colors);
+}
+
+static void dp_frame_replay_row(int idx)
+{
+   struct dp_frame_row *r = &frame_rows[idx];
+   char buf[32];
+   bool rev = false;
+   int rc, s = 0;
+
+   rc = snprintk(buf, sizeof(buf),
+                 RESET_ATTRS GFX_OFF "\033[%d;1H\033[2K",
+                 dp_start_row + idx);
+
+   dp_term_write(buf, rc, false);
+
+   for (int i = 0; i < r->len; i++) {
+
+      if (r->buf[i] != DP_FRAME_REV_MARK)
+         continue;
+
+      if (i > s)
+         dp_term_write(r->buf + s, i - s, rev);
+
+      rev = r->buf[++i];
+      s = i + 1;
+   }
+
+   if (r->len > s)
+      dp_term_write(r->buf + s, r->len - s, rev);
+}
+
+void dp_frame_init(void)
+{
+   frame_buf = kmalloc(DP_H * DP_FRAME_ROW_SIZE);
+
+   for (int i = 0; i < DP_H; i++)
+      frame_rows[i].buf = frame_buf ? frame_buf + i * DP_FRAME_ROW_SIZE : NULL;
+
+   frame_valid = false;
+}
+
+void dp_frame_destroy(void)
+{
+   if (frame_buf)
+      kfree2(frame_buf, DP_H * DP_FRAME_ROW_SIZE);
+
+   for (int i = 0; i < DP_H; i++)
+      frame_rows[i].buf = NULL;
+
+   frame_buf = NULL;
+   frame_valid = false;
+}
+
+void dp_frame_invalidate(void)
+{
+   frame_valid = false;
+}
+
+void dp_frame_begin(void)
+{
+   struct tty *t = get_curr_process_tty();
+
+   ASSERT(!frame_active);
+   frame_direct = !frame_buf || !frame_valid;
+
+   if (frame_direct)
+      dp_clear();
+
+   for (int i = 0; i < DP_H; i++) {
+      frame_rows[i].hash = 0;
+      frame_rows[i].len = 0;
+      frame_rows[i].rev = false;
+   }
+
+   frame_video = t->tparams.type == term_type_video;
+   frame_gfx = false;
+   frame_row = -1;
+   frame_active = true;
+}
+
+bool dp_frame_end(void)
+{
+   ASSERT(frame_active);
+   frame_active = false;
+   frame_row = -1;
+
+   if (!frame_direct) {
+
+      for (int i = 0; i < DP_H; i++) {
+
+         if (frame_rows[i].len < 0) {
+
+            /*
+             * The content of a changed row (or of a row whose hash we cannot
+             * trust) didn't fit in its buffer: the caller has to draw the
+             * frame again, directly this time.
+             */
+            if (frame_rows[i].hash != frame_rows[i].prev_hash) {
+               frame_valid = false;
+               return false;
+            }
+         }
+      }
+
+      for (int i = 0; i < DP_H; i++) {
+         if (frame_rows[i].hash != frame_rows[i].prev_hash)
+            dp_frame_replay_row(i);
+      }
+
+      dp_term_write(RESET_ATTRS GFX_OFF,
+                    sizeof(RESET_ATTRS GFX_OFF) - 1,
+                    false);
+   }
+
+   for (int i = 0; i < DP_H; i++)
+      frame_rows[i].prev_hash = frame_rows[i].hash;
+
+   frame_valid = true;
+   return true;
 }
 
 void dp_write_raw(const char *fmt, ...)
@@ -38,20 +285,24 @@ void dp_reverse_colors(void)
 {
    struct tty *t = get_curr_process_tty();
 
-   if (t->tparams.type == term_type_video)
+   if (t->tparams.type == term_type_video) {
       rev_colors = true;
-   else
+   } else {
+      rev_attr = true;
       dp_write_raw("%s", REVERSE_VIDEO);
+   }
 }
 
 void dp_reset_attrs(void)
 {
    struct tty *t = get_curr_process_tty();
 
-   if (t->tparams.type == term_type_video)
+   if (t->tparams.type == term_type_video) {
       rev_colors = false;
-   else
+   } else {
+      rev_attr = false;
       dp_write_raw("%s", RESET_ATTRS);
+   }
 }
 
 void dp_move_right(int n) {
@@ -67,11 +318,15 @@ void dp_move_to_col(int n) {
 }
 
 void dp_clear(void) {
+   frame_valid = false;
    dp_write_raw(ERASE_DISPLAY);
 }
 
 void dp_move_cursor(int row, int col)
 {
+   if (frame_active)
+      dp_frame_set_row(row);
+
    dp_write_raw("\033[%d;%dH", row, col);
 }
 
@@ -205,6 +460,7 @@ void dp_show_modal_msg(const char *msg)
 
    char buf[DP_W+1];
    ASSERT(msg_len <= max_line_len); /* for the moment, no multi-line */
+   dp_frame_invalidate();            /* the box overwrites the last frame */
    memset(buf, ' ', sizeof(buf) - 1);
    buf[row_len] = 0;
 
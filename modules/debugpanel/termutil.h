@@ -67,6 +67,12 @@ void dp_switch_to_alt_buffer(void);
 void dp_switch_to_default_buffer(void);
 void dp_show_modal_msg(const char *msg);
 
+void dp_frame_init(void);
+void dp_frame_destroy(void);
+void dp_frame_invalidate(void);
+void dp_frame_begin(void);
+bool dp_frame_end(void);
+
 static inline const char *
 dp_sign_value_esc_color(long val)
 {
@@ -9,6 +9,7 @@
 
 #include <tilck/kernel/term.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/interrupts.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/timer.h>
@@ -16,6 +17,7 @@
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/worker_thread.h>
 
 #include <tilck/mods/fb_console.h>
 #include <tilck/mods/acpi.h>
@@ -36,10 +38,33 @@ static u16 cursor_row;
 static u16 cursor_col;
 static u32 *under_cursor_buf;
 static volatile bool cursor_visible = true;
-static struct task *blink_thread_ti;
+static struct wth_delayed_job blink_job;
+static bool blink_job_ready;
 static const u32 blink_half_period = (TIMER_HZ * 45)/100;
 static u32 cursor_color;
 
+/*
+ * The cursor blinks only for a while after the last write or cursor move:
+ * after that, it stays visible and the blink job is not re-armed until the
+ * next write (see fb_reset_blink_timer()). That avoids waking up the CPU twice
+ * per second on idle systems.
+ */
+#define FB_BLINK_IDLE_HALF_PERIODS              20
+
+static u32 blink_idle_halfs;
+
+/*
+ * The banner is redrawn only when its content might change: at the minute
+ * rollover (for the clock) and when a battery notifies a status change. As
+ * batteries are not required to notify the charge changes, the charge is read
+ * also every FB_BANNER_BATT_READ_MINS clock updates.
+ */
+#define FB_BANNER_BATT_READ_MINS                 5
+
+static struct wth_delayed_job banner_job;
+static bool banner_job_ready;
+static volatile bool banner_batt_changed;
+
 /*
  * Battery charge per mille. Valid values in range [0, 1000].
  *
@@ -52,6 +77,31 @@ static u32 cursor_color;
  */
 static int batt_charge_pm = -1;
 
+/*
+ * Output batching. While a batch is open (see fb_begin_batch()), set_char_at()
+ * and set_row() just store the new entries in `shadow_buf` and extend the
+ * dirty span of their row: fb_flush_batch() draws all the dirty cells at once.
+ * That way, a write scrolling the screen N times costs a single redraw of the
+ * screen instead of N.
+ *
+ * In addition to that, `screen_cells` remembers the entries currently drawn on
+ * the screen, so that the flush skips the cells which didn't really change.
+ * Scrolling is just an offset change in video_term's ring buffer, which makes
+ * all the rows dirty: with this, the VRAM traffic it causes is proportional to
+ * the cells actually changing on screen (e.g. the trailing blanks of the lines
+ * are not redrawn) instead of always being a full screen.
+ */
+struct fb_row_state {
+   u16 s;         /* first dirty column */
+   u16 e;         /* last dirty column + 1, or 0 if the row is clean */
+   bool known;    /* screen_cells[] matches what's on the screen */
+};
+
+static u16 *shadow_buf;
+static u16 *screen_cells;
+static struct fb_row_state *rows_state;
+static bool batch_open;
+
 static struct video_interface framebuffer_vi;
 
 static void fb_save_under_cursor_buf(void)
@@ -82,21 +132,64 @@ static void fb_restore_under_cursor_buf(void)
 
 static void fb_reset_blink_timer(void)
 {
-   if (!blink_thread_ti)
+   if (!blink_job_ready)
       return;
 
    cursor_visible = true;
-   task_update_wakeup_timer_if_any(blink_thread_ti, blink_half_period);
+   blink_idle_halfs = 0;
+   wth_enqueue_delayed(&blink_job, blink_half_period);
+}
+
+static void fb_screen_cells_set(u16 row, u16 col, u16 *entries, u16 count)
+{
+   if (!screen_cells)
+      return;
+
+   memcpy(&screen_cells[row * fb_term_cols + col], entries, count * 2);
+
+   if (count == fb_term_cols)
+      rows_state[row].known = true;
+}
+
+static void fb_screen_cells_forget(void)
+{
+   if (!screen_cells)
+      return;
+
+   for (u32 row = 0; row < fb_term_rows; row++)
+      rows_state[row].known = false;
+}
+
+static void fb_batch_set_cells(u16 row, u16 col, u16 *entries, u16 count)
+{
+   struct fb_row_state *ds = &rows_state[row];
+
+   memcpy(&shadow_buf[row * fb_term_cols + col], entries, count * 2);
+
+   if (!ds->e) {
+      ds->s = col;
+      ds->e = col + count;
+   } else {
+      ds->s = MIN(ds->s, col);
+      ds->e = MAX(ds->e, (u16)(col + count));
+   }
 }
 
 /* video_interface */
 
 static void fb_set_char_at_failsafe(u16 row, u16 col, u16 entry)
 {
+   if (batch_open) {
+      fb_batch_set_cells(row, col, &entry, 1);
+      return;
+   }
+
    fb_draw_char_failsafe(col * font_w,
                          fb_offset_y + row * font_h,
                          entry);
 
+   fb_screen_cells_set(row, col, &entry, 1);
+
    if (row == cursor_row && col == cursor_col)
       fb_save_under_cursor_buf();
 
@@ -105,10 +198,17 @@ static void fb_set_char_at_failsafe(u16 row, u16 col, u16 entry)
 
 static void fb_set_char_at_optimized(u16 row, u16 col, u16 entry)
 {
+   if (batch_open) {
+      fb_batch_set_cells(row, col, &entry, 1);
+      return;
+   }
+
    fb_draw_char_optimized(col * font_w,
                           fb_offset_y + row * font_h,
                           entry);
 
+   fb_screen_cells_set(row, col, &entry, 1);
+
    if (row == cursor_row && col == cursor_col)
       fb_save_under_cursor_buf();
 
@@ -118,8 +218,20 @@ static void fb_set_char_at_optimized(u16 row, u16 col, u16 entry)
 static void fb_clear_row(u16 row_num, u8 color)
 {
    const u32 iy = fb_offset_y + row_num * font_h;
+
+   /* The pending cells of this row are going to be overwritten anyway */
+   if (batch_open)
+      rows_state[row_num].e = 0;
+
    fb_raw_color_lines(iy, font_h, vga_rgb_colors[get_color_bg(color)]);
 
+   if (screen_cells) {
+      memset16(&screen_cells[row_num * fb_term_cols],
+               make_vgaentry(' ', color),
+               fb_term_cols);
+      rows_state[row_num].known = true;
+   }
+
    if (cursor_row == row_num)
       fb_save_under_cursor_buf();
 }
@@ -185,19 +297,127 @@ static void fb_disable_cursor(void)
 
 static void fb_set_row_failsafe(u16 row, u16 *data, bool fpu_allowed)
 {
+   if (batch_open) {
+      fb_batch_set_cells(row, 0, data, (u16)fb_term_cols);
+      return;
+   }
+
    for (u16 i = 0; i < fb_term_cols; i++)
       fb_set_char_at_failsafe(row, i, data[i]);
 
+   fb_screen_cells_set(row, 0, data, (u16)fb_term_cols);
    fb_reset_blink_timer();
 }
 
 static void fb_set_row_optimized(u16 row, u16 *data, bool fpu_allowed)
 {
+   if (batch_open) {
+      fb_batch_set_cells(row, 0, data, (u16)fb_term_cols);
+      return;
+   }
+
    fb_draw_row_optimized(fb_offset_y + row * font_h,
                          data,
                          fb_term_cols,
                          fpu_allowed);
 
+   fb_screen_cells_set(row, 0, data, (u16)fb_term_cols);
+   fb_reset_blink_timer();
+}
+
+static void fb_begin_batch(void)
+{
+   /* In panic, draw everything immediately: keep it as simple as possible */
+   if (!in_panic())
+      batch_open = true;
+}
+
+static void fb_flush_row(u16 row, bool fpu_allowed)
+{
+   struct fb_row_state *ds = &rows_state[row];
+   u16 *entries = &shadow_buf[row * fb_term_cols];
+   u16 *on_screen = &screen_cells[row * fb_term_cols];
+   const u32 iy = fb_offset_y + row * font_h;
+   u16 s = ds->s, e = ds->e;
+
+   if (ds->known) {
+
+      /* Skip the unchanged cells at the beginning and at the end */
+      while (s < e && entries[s] == on_screen[s])
+         s++;
+
+      while (e > s && entries[e - 1] == on_screen[e - 1])
+         e--;
+   }
+
+   if (use_optimized && s == 0 && e == fb_term_cols) {
+
+      fb_draw_row_optimized(iy, entries, fb_term_cols, fpu_allowed);
+
+   } else {
+
+      for (u16 c = s; c < e; c++) {
+
+         if (ds->known && entries[c] == on_screen[c])
+            continue;
+
+         if (use_optimized)
+            fb_draw_char_optimized(c * font_w, iy, entries[c]);
+         else
+            fb_draw_char_failsafe(c * font_w, iy, entries[c]);
+      }
+   }
+
+   memcpy(&on_screen[ds->s], &entries[ds->s], (size_t)(ds->e - ds->s) * 2);
+
+   if (ds->s == 0 && ds->e == fb_term_cols)
+      ds->known = true;
+
+   ds->e = 0;
+}
+
+static void fb_flush_batch(void)
+{
+   const bool fpu_allowed = use_optimized && !in_irq() && !in_panic();
+
+   if (!batch_open)
+      return;
+
+   /*
+    * Keep the blinking thread away while the cells under the cursor are
+    * being redrawn: it would save and restore them behind our back.
+    */
+   disable_preemption();
+   {
+      batch_open = false;
+
+      if (cursor_enabled)
+         fb_restore_under_cursor_buf();
+
+      if (fpu_allowed)
+         fpu_context_begin();
+
+      for (u16 row = 0; row < fb_term_rows; row++)
+         if (rows_state[row].e)
+            fb_flush_row(row, fpu_allowed);
+
+      if (fpu_allowed)
+         fpu_context_end();
+
+      if (cursor_enabled) {
+
+         fb_save_under_cursor_buf();
+
+         if (cursor_visible &&
+             cursor_row < fb_term_rows && cursor_col < fb_term_cols)
+         {
+            fb_draw_cursor_raw(cursor_col * font_w,
+                               fb_offset_y + cursor_row * font_h,
+                               cursor_color);
+         }
+      }
+   }
+   enable_preemption();
    fb_reset_blink_timer();
 }
 
@@ -206,6 +426,13 @@ void fb_draw_banner(void);
 static void fb_disable_banner_refresh(void)
 {
    banner_refresh_disabled = true;
+
+   /*
+    * This is called when the console's output is paused because someone
+    * else (e.g. a graphical app using /dev/fb0) is going to draw on the
+    * screen: we cannot trust `screen_cells` anymore.
+    */
+   fb_screen_cells_forget();
 }
 
 static void fb_enable_banner_refresh(void)
@@ -228,20 +455,30 @@ static struct video_interface framebuffer_vi =
    fb_draw_banner,
    fb_disable_banner_refresh,
    fb_enable_banner_refresh,
+   NULL,  /* begin_batch: set by fb_alloc_batch_buffers() */
+   NULL,  /* flush_batch: set by fb_alloc_batch_buffers() */
 };
 
 
-static void fb_blink_thread()
+static void fb_blink_job(void *unused)
 {
-   while (true) {
+   if (++blink_idle_halfs >= FB_BLINK_IDLE_HALF_PERIODS) {
 
-      if (cursor_enabled) {
-         cursor_visible = !cursor_visible;
+      /* Nobody is writing on the tty: stop blinking, leaving it visible */
+      if (cursor_enabled && !cursor_visible) {
+         cursor_visible = true;
          fb_move_cursor(cursor_row, cursor_col, -1);
       }
 
-      kernel_sleep(blink_half_period);
+      return;
+   }
+
+   if (cursor_enabled) {
+      cursor_visible = !cursor_visible;
+      fb_move_cursor(cursor_row, cursor_col, -1);
    }
+
+   wth_enqueue_delayed(&blink_job, blink_half_period);
 }
 
 static void fb_draw_string_at_raw(u32 x, u32 y, const char *str, u8 color)
@@ -314,7 +551,7 @@ static u32 fb_banner_right_side(char *buf, size_t buf_sz)
        * been read. The purpose of this is to avoid forcing battery's controller
        * to do too many charge reads.
        *
-       * The actual value is updated peridically by fb_update_banner().
+       * The actual value is updated by fb_update_banner().
        */
 
       fb_banner_update_battery_pm();
@@ -420,19 +657,42 @@ void fb_draw_banner(void)
                       vga_rgb_colors[COLOR_BLACK]);
 }
 
-static void fb_update_banner()
+static void fb_update_banner(void *unused)
 {
-   while (true) {
+   static u32 mins;
+   s64 ts;
 
-      if (!banner_refresh_disabled) {
-         fb_banner_update_battery_pm();
-         fb_draw_banner();
-      }
-
-      kernel_sleep(30 * TIMER_HZ);
+   if (banner_batt_changed || ++mins >= FB_BANNER_BATT_READ_MINS) {
+      banner_batt_changed = false;
+      mins = 0;
+      fb_banner_update_battery_pm();
    }
+
+   if (!banner_refresh_disabled)
+      fb_draw_banner();
+
+   /* Run again at the next minute rollover */
+   ts = get_timestamp();
+   wth_enqueue_delayed(&banner_job, (u64)(60 - ts % 60) * TIMER_HZ);
 }
 
+static u32 fb_console_on_battery_notify(void *ctx)
+{
+   banner_batt_changed = true;
+
+   /* Update the banner now: the job might be armed for up to a minute */
+   if (banner_job_ready)
+      wth_enqueue_delayed(&banner_job, 1);
+
+   return 0;
+}
+
+static struct acpi_reg_callback_node fb_console_on_battery_notify_node = {
+   .node = STATIC_LIST_NODE_INIT(fb_console_on_battery_notify_node.node),
+   .cb = &fb_console_on_battery_notify,
+   .ctx = NULL
+};
+
 static u32 fb_console_on_acpi_full_init_func(void *ctx)
 {
    if (!banner_refresh_disabled)
@@ -451,6 +711,10 @@ static void fb_scroll_one_line_up(void)
 {
    bool enabled = cursor_enabled;
 
+   /* Shifting the lines up is meaningful only with no pending cells */
+   fb_flush_batch();
+   fb_screen_cells_forget();
+
    if (enabled)
      fb_disable_cursor();
 
@@ -524,7 +788,7 @@ static void fb_use_optimized_funcs_if_possible(void)
       return;
    }
 
-   if (fb_get_bpp() != 32) {
+   if (fb_get_bpp() != 32 && fb_get_bpp() != 24 && fb_get_bpp() != 16) {
       printk("fb_console: WARNING: using slower code for bpp = %d\n",
              fb_get_bpp());
       printk("fb_console: switch to a resolution with bpp = 32 if possible\n");
@@ -546,21 +810,43 @@ bool fb_is_using_opt_funcs(void)
    return use_optimized;
 }
 
-static void fb_create_cursor_blinking_thread(void)
+static void fb_alloc_batch_buffers(void)
 {
-   int tid = kthread_create(fb_blink_thread, 0, NULL);
+   const u32 cells = fb_term_rows * fb_term_cols;
 
-   if (tid < 0) {
-      printk("WARNING: unable to create the fb_blink_thread\n");
-      return;
-   }
+   shadow_buf = kalloc_array_obj(u16, cells);
+   screen_cells = kalloc_array_obj(u16, cells);
+   rows_state = kzalloc_array_obj(struct fb_row_state, fb_term_rows);
 
-   disable_preemption();
-   {
-      blink_thread_ti = get_task(tid);
-      ASSERT(blink_thread_ti != NULL);
+   if (!shadow_buf || !screen_cells || !rows_state) {
+
+      if (shadow_buf)
+         kfree_array_obj(shadow_buf, u16, cells);
+
+      if (screen_cells)
+         kfree_array_obj(screen_cells, u16, cells);
+
+      if (rows_state)
+         kfree_array_obj(rows_state, struct fb_row_state, fb_term_rows);
+
+      shadow_buf = screen_cells = NULL;
+      rows_state = NULL;
+      goto oom;
    }
-   enable_preemption();
+
+   framebuffer_vi.begin_batch = fb_begin_batch;
+   framebuffer_vi.flush_batch = fb_flush_batch;
+   return;
+
+oom:
+   printk("WARNING: fb_console: unable to allocate the batch buffers\n");
+}
+
+static void fb_start_cursor_blinking(void)
+{
+   wth_delayed_job_init(&blink_job, NULL, &fb_blink_job, NULL);
+   blink_job_ready = true;
+   fb_reset_blink_timer();
 }
 
 void init_fb_console(void)
@@ -590,6 +876,8 @@ void init_fb_console(void)
       if (!under_cursor_buf)
          printk("WARNING: fb_console: unable to allocate under_cursor_buf!\n");
 
+      fb_alloc_batch_buffers();
+
    } else {
 
       fb_term_cols = MIN(fb_term_cols, FAILSAFE_COLS);
@@ -614,20 +902,17 @@ void init_fb_console(void)
       return;
 
    if (FB_CONSOLE_CURSOR_BLINK)
-      fb_create_cursor_blinking_thread();
+      fb_start_cursor_blinking();
 
    if (fb_offset_y) {
-      if (kthread_create(fb_update_banner, 0, NULL) > 0) {
-
-         /* Success */
-         if (MOD_acpi) {
-            acpi_reg_on_full_init_cb(&fb_console_on_acpi_full_init_node);
-         }
 
-      } else {
+      wth_delayed_job_init(&banner_job, NULL, &fb_update_banner, NULL);
+      banner_job_ready = true;
+      wth_enqueue_delayed(&banner_job, 1);
 
-         /* Oops! Something went wrong */
-         printk("WARNING: unable to create the fb_update_banner\n");
+      if (MOD_acpi) {
+         acpi_reg_on_full_init_cb(&fb_console_on_acpi_full_init_node);
+         acpi_reg_on_battery_notify_cb(&fb_console_on_battery_notify_node);
       }
    }
 }
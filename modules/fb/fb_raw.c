@@ -52,6 +52,7 @@ static u32 fb_line_length;
 
 ulong fb_vaddr;
 static u32 *fb_w8_char_scanlines;
+static u32 fb_sl_dwords;   /* size of a pre-rendered 8-pixel scanline */
 
 u32 font_w;
 u32 font_h;
@@ -240,6 +241,11 @@ static inline void fb_draw_pixel(u32 x, u32 y, u32 color)
       *(volatile u32 *)
          (fb_vaddr + (fb_pitch * y) + (x << 2)) = color;
 
+   } else if (fb_bpp == 16) {
+
+      *(volatile u16 *)
+         (fb_vaddr + (fb_pitch * y) + (x << 1)) = (u16)color;
+
    } else {
 
       // Assumption: bpp is 24
@@ -247,6 +253,30 @@ static inline void fb_draw_pixel(u32 x, u32 y, u32 color)
    }
 }
 
+/*
+ * Fill a whole line of pixels at `v` with `color`, for bpp != 32. In the 24 bpp
+ * case, write 4 pixels (12 bytes) at a time, as 3 dwords.
+ */
+static void fb_fill_line_nb(ulong v, u32 color)
+{
+   if (fb_bpp == 16) {
+      memset16((u16 *)v, (u16)color, fb_width);
+      return;
+   }
+
+   const u32 c = color & 0xffffff;
+   const u32 pattern[3] = {
+      c | (c << 24), (c >> 8) | (c << 16), (c >> 16) | (c << 8)
+   };
+   u32 x = 0;
+
+   for (; x + 4 <= fb_width; x += 4, v += 12)
+      memcpy32((void *)v, pattern, 3);
+
+   for (; x < fb_width; x++, v += 3)
+      memcpy((void *)v, &c, 3);
+}
+
 void fb_raw_color_lines(u32 iy, u32 h, u32 color)
 {
    if (LIKELY(fb_bpp == 32)) {
@@ -265,14 +295,10 @@ void fb_raw_color_lines(u32 iy, u32 h, u32 color)
 
    } else {
 
-      /*
-       * Generic (but slower version)
-       * NOTE: Optimizing for bpp != 32 is completely out of Tilck's goals.
-       */
+      ulong v = fb_vaddr + (fb_pitch * iy);
 
-      for (u32 y = iy; y < (iy + h); y++)
-         for (u32 x = 0; x < fb_width; x++)
-            fb_draw_pixel(x, y, color);
+      for (u32 i = 0; i < h; i++, v += fb_pitch)
+         fb_fill_line_nb(v, color);
    }
 }
 
@@ -289,12 +315,20 @@ void fb_draw_cursor_raw(u32 ix, u32 iy, u32 color)
                   font_w);
       }
 
+   } else if (fb_bpp == 16) {
+
+      ix <<= 1;
+
+      for (u32 y = iy; y < (iy + font_h); y++) {
+
+         memset16((u16 *)(fb_vaddr + (fb_pitch * y) + ix),
+                  (u16)color,
+                  font_w);
+      }
+
    } else {
 
-      /*
-       * Generic (but slower version)
-       * NOTE: Optimizing for bpp != 32 is completely out of Tilck's goals.
-       */
+      /* Generic version: the cursor is just a few pixels wide anyway */
 
       for (u32 y = iy; y < (iy + font_h); y++)
          for (u32 x = ix; x < (ix + font_w); x++)
@@ -313,10 +347,7 @@ void fb_copy_from_screen(u32 ix, u32 iy, u32 w, u32 h, u32 *buf)
 
    } else {
 
-      /*
-       * Generic (but slower version)
-       * NOTE: Optimizing for bpp != 32 is completely out of Tilck's goals.
-       */
+      /* Generic version: rows are contiguous, just copy them byte-wise */
 
       for (u32 y = 0; y < h; y++, vaddr += fb_pitch)
          memcpy((u8 *)buf + y * w * fb_bytes_per_pixel,
@@ -336,10 +367,7 @@ void fb_copy_to_screen(u32 ix, u32 iy, u32 w, u32 h, u32 *buf)
 
    } else {
 
-      /*
-       * Generic (but slower version)
-       * NOTE: Optimizing for bpp != 32 is completely out of Tilck's goals.
-       */
+      /* Generic version: rows are contiguous, just copy them byte-wise */
 
       for (u32 y = 0; y < h; y++, vaddr += fb_pitch)
          memcpy((void *)vaddr,
@@ -443,31 +471,44 @@ void fb_draw_char_failsafe(u32 x, u32 y, u16 e)
  * -------------------------------------------
  */
 
-#define PSZ         4     /* pixel size = 32 bpp / 8 = 4 bytes */
 #define SL_COUNT  256     /* all possible 8-pixel scanlines */
 #define SL_SIZE     8     /* scanline size: 8 pixels */
 #define FG_COLORS  16     /* #fg colors */
 #define BG_COLORS  16     /* #bg colors */
 
-#define TOT_CHAR_SCANLINES_SIZE (PSZ*SL_COUNT*FG_COLORS*BG_COLORS*SL_SIZE)
+#define TOT_CHAR_SCANLINES (SL_COUNT * FG_COLORS * BG_COLORS)
 
+/*
+ * Pre-render all the 8-pixel scanlines for every (fg, bg) pair, in the pixel
+ * format of the framebuffer: a scanline is 32 bytes long at 32 bpp, 24 bytes
+ * at 24 bpp and 16 bytes at 16 bpp. Always a multiple of 4 bytes.
+ */
 bool fb_pre_render_char_scanlines(void)
 {
-   fb_w8_char_scanlines = kmalloc(TOT_CHAR_SCANLINES_SIZE);
+   const u32 psz = fb_bytes_per_pixel;
+   const u32 sl_bytes = psz * SL_SIZE;
+   u8 *p;
+
+   ASSERT(fb_bpp == 32 || fb_bpp == 24 || fb_bpp == 16);
+
+   fb_w8_char_scanlines = kmalloc(TOT_CHAR_SCANLINES * sl_bytes);
 
    if (!fb_w8_char_scanlines)
       return false;
 
+   fb_sl_dwords = sl_bytes / 4;
+   p = (u8 *)fb_w8_char_scanlines;
+
    for (u32 fg = 0; fg < FG_COLORS; fg++) {
       for (u32 bg = 0; bg < BG_COLORS; bg++) {
-         for (u32 sl = 0; sl < SL_COUNT; sl++) {
+         for (u32 sl = 0; sl < SL_COUNT; sl++, p += sl_bytes) {
             for (u32 pix = 0; pix < SL_SIZE; pix++) {
-               fb_w8_char_scanlines[
-                  fg * (BG_COLORS * SL_COUNT * SL_SIZE) +
-                  bg * (SL_COUNT * SL_SIZE) +
-                  sl * SL_SIZE +
-                  (SL_SIZE - pix - 1)
-               ] = (sl & (1 << pix)) ? vga_rgb_colors[fg] : vga_rgb_colors[bg];
+
+               const u32 color =
+                  (sl & (1 << pix)) ? vga_rgb_colors[fg] : vga_rgb_colors[bg];
+
+               /* Note: this works only on little endian machines */
+               memcpy(p + (SL_SIZE - pix - 1) * psz, &color, psz);
             }
          }
       }
@@ -476,27 +517,68 @@ bool fb_pre_render_char_scanlines(void)
    return true;
 }
 
+/*
+ * Versions of fb_draw_char_optimized() and fb_draw_row_optimized() for 16 and
+ * 24 bpp. The pre-rendered scanlines are `fb_sl_dwords` dwords long (4 or 6)
+ * instead of 8: too short for fpu_cpy_single_256_nt(), so there's no FPU
+ * variant.
+ */
+static void fb_draw_char_optimized_nb(u32 x, u32 y, u16 e)
+{
+   const u32 sl_dw = fb_sl_dwords;
+   const u32 sl_bytes = sl_dw << 2;
+   const u32 c_off = (u32)(
+      (vgaentry_get_fg(e) * BG_COLORS + vgaentry_get_bg(e)) * SL_COUNT * sl_dw
+   );
+   const u32 *scanlines = &fb_w8_char_scanlines[c_off];
+   void *vaddr = (void *)fb_vaddr + (fb_pitch * y) + x * fb_bytes_per_pixel;
+   const u8 *d = font_glyph_data + font_bytes_per_glyph * vgaentry_get_char(e);
+
+   if (LIKELY(font_width_bytes == 1)) {
+
+      for (u32 r = 0; r < font_h; r++, d++, vaddr += fb_pitch)
+         memcpy32(vaddr, &scanlines[d[0] * sl_dw], sl_dw);
+
+      return;
+   }
+
+   for (u32 r = 0; r < font_h; r++, vaddr += fb_pitch)
+      for (u32 b = 0; b < font_width_bytes; b++, d++)
+         memcpy32(vaddr + b * sl_bytes, &scanlines[d[0] * sl_dw], sl_dw);
+}
+
+static void fb_draw_row_optimized_nb(u32 y, u16 *entries, u32 count)
+{
+   for (u32 ei = 0; ei < count; ei++)
+      fb_draw_char_optimized_nb(ei * font_w, y, entries[ei]);
+}
+
 void fb_draw_char_optimized(u32 x, u32 y, u16 e)
 {
    /* Static variables, set once! */
    static void *op;
 
+   if (UNLIKELY(fb_bpp != 32)) {
+      fb_draw_char_optimized_nb(x, y, e);
+      return;
+   }
+
    if (UNLIKELY(!op)) {
 
-      ASSERT(font_w == 8 || font_w == 16);
+      ASSERT(!(font_w % 8));
 
       if (font_w == 8)
          op = &&width1;
-      else
+      else if (font_w == 16)
          op = &&width2;
+      else
+         op = &&width_n;
    }
 
    /* -------------- Regular variables --------------- */
    const u8 c = vgaentry_get_char(e);
 
    ASSUME_WITHOUT_CHECK(!(font_w % 8));
-   ASSUME_WITHOUT_CHECK(font_h == 16 || font_h == 32);
-   ASSUME_WITHOUT_CHECK(font_bytes_per_glyph==16 || font_bytes_per_glyph==64);
 
    void *vaddr = (void *)fb_vaddr + (fb_pitch * y) + (x << 2);
    u8 *d = font_glyph_data + font_bytes_per_glyph * c;
@@ -521,6 +603,52 @@ void fb_draw_char_optimized(u32 x, u32 y, u16 e)
       }
 
       return;
+
+   width_n:
+
+      /* Any other width multiple of 8 (e.g. 24, 32): one scanline per byte */
+      for (u32 r = 0; r < font_h; r++, vaddr += fb_pitch)
+         for (u32 b = 0; b < font_width_bytes; b++, d++)
+            memcpy32(vaddr + (b << 5), &scanlines[d[0] << 3], SL_SIZE);
+
+      return;
+}
+
+/*
+ * Generic version of fb_draw_row_optimized() for fonts having a width multiple
+ * of 8, but different from 8 and 16. Each byte of glyph data selects one of the
+ * pre-rendered 8-pixel scanlines, which is exactly 32 bytes long: the same size
+ * copied by fpu_cpy_single_256_nt().
+ */
+static void
+fb_draw_row_optimized_generic(u32 y, u16 *entries, u32 count, bool fpu)
+{
+   const ulong vaddr_base = fb_vaddr + (fb_pitch * y);
+   const u32 char_w_bytes = font_w << 2;
+
+   for (u32 ei = 0; ei < count; ei++) {
+
+      const u16 e = entries[ei];
+      const u32 c_off = (u32) (
+         (vgaentry_get_fg(e) << 15) + (vgaentry_get_bg(e) << 11)
+      );
+      void *vaddr = (void *)vaddr_base + ei * char_w_bytes;
+      const u8 *d = &font_glyph_data[font_bytes_per_glyph*vgaentry_get_char(e)];
+      u32 *scanlines = &fb_w8_char_scanlines[c_off];
+
+      if (fpu) {
+
+         for (u32 r = 0; r < font_h; r++, vaddr += fb_pitch)
+            for (u32 b = 0; b < font_width_bytes; b++, d++)
+               fpu_cpy_single_256_nt(vaddr + (b << 5), &scanlines[d[0] << 3]);
+
+      } else {
+
+         for (u32 r = 0; r < font_h; r++, vaddr += fb_pitch)
+            for (u32 b = 0; b < font_width_bytes; b++, d++)
+               memcpy32(vaddr + (b << 5), &scanlines[d[0] << 3], SL_SIZE);
+      }
+   }
 }
 
 void fb_draw_row_optimized(u32 y, u16 *entries, u32 count, bool fpu)
@@ -529,6 +657,16 @@ void fb_draw_row_optimized(u32 y, u16 *entries, u32 count, bool fpu)
       &&width_1_nofpu, &&width_1_fpu, &&width_2_nofpu, &&width_2_fpu
    };
 
+   if (UNLIKELY(fb_bpp != 32)) {
+      fb_draw_row_optimized_nb(y, entries, count);
+      return;
+   }
+
+   if (UNLIKELY(font_w != 8 && font_w != 16)) {
+      fb_draw_row_optimized_generic(y, entries, count, fpu);
+      return;
+   }
+
    const u32 bpg_shift = 4 + (font_bytes_per_glyph == 64) * 2; // 4 or 6
    const u32 w4_shift  = 5 + (font_w == 16);                   // 5 or 6
    const void *const op = ops[(font_w == 16) * 2 + fpu];       // ops[0..3]
@@ -9,6 +9,8 @@
 #include <tilck/mods/fb_console.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/hal.h>
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/process.h>
@@ -28,6 +30,21 @@ extern u32 fb_size;
 static ssize_t total_fb_pages_mapped;
 static struct list mappings_list = STATIC_LIST_INIT(mappings_list);
 
+/*
+ * Double buffering. The firmware framebuffer we get cannot pan, so when a
+ * client asks for yres_virtual = 2 * yres (FBIOPUT_VSCREENINFO), the second
+ * half of the virtual screen is a back buffer in RAM, mapped right after the
+ * framebuffer itself. FBIOPAN_DISPLAY with yoffset = yres "flips" by copying
+ * the back buffer to the framebuffer with a single non-temporal blit, while
+ * yoffset = 0 has nothing to copy: the first half is the screen itself.
+ * Therefore, clients should always draw in the second half and pan to yres.
+ *
+ * The back buffer is allocated the first time it's requested and then kept.
+ */
+static void *back_buf;
+static bool back_buf_enabled;
+static u32 curr_yoffset;
+
 static ssize_t fb_read(fs_handle h, char *user_buf, size_t size, offt *pos)
 {
    ssize_t actual_size = MIN((ssize_t)fb_size - (ssize_t)*pos, (ssize_t)size);
@@ -80,6 +97,111 @@ static offt fb_seek(fs_handle h, offt off, int whence)
    return dh->h_fpos;
 }
 
+static int fb_alloc_back_buf(void)
+{
+   size_t size = fb_size;
+   void *p;
+
+   if (back_buf)
+      return 0;
+
+   if (!(p = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return -ENOMEM;
+
+   bzero(p, size);
+
+   /* These pages will be mapped in the user space, as ramfs does */
+   retain_pageframes_mapped_at(get_kernel_pdir(), p, size, PF_TYPE_USHARED);
+
+   disable_preemption();
+   {
+      if (!back_buf) {
+         back_buf = p;
+         p = NULL;
+      }
+   }
+   enable_preemption();
+
+   if (p) {
+      /* Somebody else did the allocation in the meanwhile */
+      release_pageframes_mapped_at(get_kernel_pdir(), p, size);
+      kfree2(p, size);
+   }
+
+   return 0;
+}
+
+static void fb_fill_var_info_dbuf(struct fb_var_screeninfo *vi)
+{
+   fb_fill_var_info(vi);
+
+   if (back_buf_enabled) {
+      vi->yres_virtual = 2 * vi->yres;
+      vi->yoffset = curr_yoffset;
+   }
+}
+
+static int fb_set_var_info(struct fb_var_screeninfo *req)
+{
+   struct fb_var_screeninfo curr;
+   int rc;
+
+   fb_fill_var_info(&curr);
+
+   /* The mode cannot change: only the virtual height, for double buffering */
+   if (req->xres != curr.xres || req->yres != curr.yres ||
+       req->xres_virtual != curr.xres_virtual ||
+       req->bits_per_pixel != curr.bits_per_pixel)
+   {
+      return -EINVAL;
+   }
+
+   if (req->yres_virtual == curr.yres) {
+      back_buf_enabled = false;
+      curr_yoffset = 0;
+      return 0;
+   }
+
+   if (req->yres_virtual != 2 * curr.yres)
+      return -EINVAL;
+
+   /* The back buffer gets mapped right after the framebuffer */
+   if (!IS_PAGE_ALIGNED(fb_size) || (fb_size % 32))
+      return -EINVAL;
+
+   if ((rc = fb_alloc_back_buf()))
+      return rc;
+
+   back_buf_enabled = true;
+   return 0;
+}
+
+static int fb_pan_display(struct fb_var_screeninfo *req)
+{
+   const u32 yres = fb_get_height();
+
+   if (req->xoffset != 0)
+      return -EINVAL;
+
+   if (req->yoffset == 0) {
+      curr_yoffset = 0;
+      return 0;
+   }
+
+   if (!back_buf_enabled || req->yoffset != yres)
+      return -EINVAL;
+
+   /* Flip: a single non-temporal copy of the whole back buffer */
+   fpu_context_begin();
+   {
+      fpu_memcpy256_nt((void *)fb_vaddr, back_buf, fb_size / 32);
+   }
+   fpu_context_end();
+
+   curr_yoffset = yres;
+   return 0;
+}
+
 static int fb_ioctl(fs_handle h, ulong request, void *argp)
 {
    if (request == FBIOGET_FSCREENINFO) {
@@ -88,6 +210,12 @@ static int fb_ioctl(fs_handle h, ulong request, void *argp)
       int rc;
 
       fb_fill_fix_info(&fix_info);
+
+      if (back_buf_enabled) {
+         fix_info.smem_len += fb_size;
+         fix_info.ypanstep = fb_get_height();
+      }
+
       rc = copy_to_user(argp, &fix_info, sizeof(fix_info));
 
       if (rc != 0)
@@ -101,7 +229,7 @@ static int fb_ioctl(fs_handle h, ulong request, void *argp)
       struct fb_var_screeninfo var_info;
       int rc;
 
-      fb_fill_var_info(&var_info);
+      fb_fill_var_info_dbuf(&var_info);
       rc = copy_to_user(argp, &var_info, sizeof(var_info));
 
       if (rc != 0)
@@ -110,6 +238,34 @@ static int fb_ioctl(fs_handle h, ulong request, void *argp)
       return 0;
    }
 
+   if (request == FBIOPUT_VSCREENINFO || request == FBIOPAN_DISPLAY) {
+
+      struct fb_var_screeninfo var_info;
+      int rc;
+
+      if (copy_from_user(&var_info, argp, sizeof(var_info)))
+         return -EFAULT;
+
+      if (request == FBIOPUT_VSCREENINFO)
+         rc = fb_set_var_info(&var_info);
+      else
+         rc = fb_pan_display(&var_info);
+
+      if (rc != 0)
+         return rc;
+
+      /* Like on Linux, FBIOPUT_VSCREENINFO returns the actual var info */
+      if (request == FBIOPUT_VSCREENINFO) {
+
+         fb_fill_var_info_dbuf(&var_info);
+
+         if (copy_to_user(argp, &var_info, sizeof(var_info)))
+            return -EFAULT;
+      }
+
+      return 0;
+   }
+
    return -EINVAL;
 }
 
@@ -122,12 +278,34 @@ fbdev_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (um->off != 0)
       return -EINVAL; /* not supported, at least for the moment */
 
+   if (um->len > fb_size && (!back_buf_enabled || um->len > 2 * fb_size))
+      return -EINVAL;
+
    if (flags & VFS_MM_DONT_MMAP)
       goto register_mapping;
 
-   if ((rc = fb_user_mmap(pdir, um->vaddrp, um->len)) < 0)
+   if ((rc = fb_user_mmap(pdir, um->vaddrp, MIN(um->len, fb_size))) < 0)
       return rc;
 
+   if (um->len > fb_size) {
+
+      /* Map the back buffer right after the framebuffer */
+      const size_t pg_count = (um->len - fb_size) >> PAGE_SHIFT;
+      size_t count = map_pages(pdir,
+                               um->vaddrp + fb_size,
+                               LIN_VA_TO_PA(back_buf),
+                               pg_count,
+                               PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+
+      if (count != pg_count) {
+         unmap_pages_permissive(pdir,
+                                um->vaddrp,
+                                (fb_size >> PAGE_SHIFT) + count,
+                                false);
+         return -ENOMEM;
+      }
+   }
+
    total_fb_pages_mapped += um->len >> PAGE_SHIFT;
 
 register_mapping:
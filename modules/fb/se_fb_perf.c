@@ -11,9 +11,60 @@
 #include <tilck/mods/fb_console.h>
 #include <tilck/kernel/self_tests.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/bench.h>
 
 #include "fb_int.h"
 
+/*
+ * Measure how fast we can render full screens of text with the optimized funcs,
+ * the ones using the pre-rendered scanlines (and fpu_cpy_single_256_nt() when
+ * `use_fpu` is true), for the current font.
+ */
+static void internal_selftest_fb_glyphs_perf(bool use_fpu)
+{
+   const u32 rows = fb_get_height() / font_h;
+   const u32 cols = fb_get_width() / font_w;
+   const int iters = 30;
+   u64 start, duration, cycles;
+   u16 *entries;
+
+   if (!fb_is_using_opt_funcs()) {
+      printk("glyphs: skipped (not using the optimized funcs)\n");
+      return;
+   }
+
+   if (!(entries = kalloc_array_obj(u16, cols)))
+      panic("Unable to allocate the entries buffer");
+
+   for (u32 i = 0; i < cols; i++) {
+      entries[i] = make_vgaentry(
+         'A' + (i % 26), make_color(1 + i % 15, COLOR_BLACK)
+      );
+   }
+
+   if (use_fpu)
+      fpu_context_begin();
+   {
+      start = RDTSC();
+
+      for (int i = 0; i < iters; i++)
+         for (u32 r = 0; r < rows; r++)
+            fb_draw_row_optimized(r * font_h, entries, cols, use_fpu);
+
+      duration = RDTSC() - start;
+   }
+   if (use_fpu)
+      fpu_context_end();
+
+   cycles = duration / iters;
+   kfree_array_obj(entries, u16, cols);
+
+   printk("font: %u x %u\n", font_w, font_h);
+   printk("cycles per text screen: %" PRIu64 "\n", cycles);
+   printk("cycles per glyph: %" PRIu64 "\n", cycles / (rows * cols));
+}
+
 void internal_selftest_fb_perf(bool use_fpu)
 {
    if (!use_framebuffer())
@@ -45,6 +96,45 @@ void internal_selftest_fb_perf(bool use_fpu)
    printk("cycles per 32 pixels: %" PRIu64 "\n", 32 * cycles / pixels);
    printk("use_fpu: %d\n", use_fpu);
 
+   internal_selftest_fb_glyphs_perf(use_fpu);
+   fb_draw_banner();
+}
+
+static void fb_bench_redraw_func(void *arg)
+{
+   const bool use_fpu = (bool)arg;
+
+   if (use_fpu)
+      fpu_context_begin();
+
+   fb_raw_perf_screen_redraw(vga_rgb_colors[COLOR_BLACK], use_fpu);
+
+   if (use_fpu)
+      fpu_context_end();
+}
+
+/* Called by the `bench` self test: see tests/self/se_bench.c */
+void fb_run_benchmarks(void)
+{
+   struct bench_result res;
+
+   struct bench b = {
+      .name = "fb_blit_screen_nofpu",
+      .warmup = 2,
+      .iters = 30,
+      .func = &fb_bench_redraw_func,
+      .arg = (void *)false,
+   };
+
+   if (bench_run(&b, &res))
+      panic("bench_run() failed");
+
+   b.name = "fb_blit_screen_fpu";
+   b.arg = (void *)true;
+
+   if (bench_run(&b, &res))
+      panic("bench_run() failed");
+
    fb_draw_banner();
 }
 
@@ -38,6 +38,7 @@ static bool capsLock;
 static struct list keypress_handlers = STATIC_LIST_INIT(keypress_handlers);
 static struct kb_dev ps2_keyboard;
 static struct safe_ringbuf kb_input_rb;
+static u64 kb_irq_tsc;          /* TSC of the IRQ which filled kb_input_rb */
 
 static bool kb_is_pressed(u32 key)
 {
@@ -226,11 +227,21 @@ static void kb_dump_regs(u8 ctr, u8 cto, u8 status)
 static void kb_irq_bottom_half(void *arg)
 {
    u8 scancode;
+   ulong var;
+
    disable_preemption();
    {
+      disable_interrupts(&var);
+      {
+         ps2_keyboard.event_tsc = kb_irq_tsc;
+      }
+      enable_interrupts(&var);
+
       while (safe_ringbuf_read_1(&kb_input_rb, &scancode)) {
          kb_process_scancode(scancode);
       }
+
+      ps2_keyboard.event_tsc = 0;
    }
    enable_preemption();
 }
@@ -250,6 +261,9 @@ static int kb_irq_handler_read_scancodes(void)
          i8042_drain_any_data();
       }
 
+      if (was_empty)
+         kb_irq_tsc = RDTSC();
+
       count++;
    }
 
@@ -489,6 +503,7 @@ static struct module kb_ps2_module = {
    .name = "kb8042",
    .priority = MOD_kb_prio,
    .init = &init_kb,
+   .deps = MOD_DEPS("acpi"),
 };
 
 REGISTER_MODULE(&kb_ps2_module);
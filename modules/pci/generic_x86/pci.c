@@ -55,6 +55,7 @@ struct pci_segment {
 static u32 pcie_segments_cnt;
 static struct pci_segment *pcie_segments;
 static struct list pci_device_list;
+static struct pci_device *pci_last_obj;  /* see pci_get_object() */
 static ulong (*pcie_get_conf_vaddr)(struct pci_device_loc);
 
 static u8 *pci_buses;                  /* valid ONLY during init_pci() */
@@ -65,8 +66,9 @@ int (*__pci_config_read_func)(struct pci_device_loc, u32, u32, u32 *);
 int (*__pci_config_write_func)(struct pci_device_loc, u32, u32, u32);
 
 #include "pci_sysfs.c.h"
+#include "pci_msi.c.h"
 
-static void
+static void INIT_TEXT
 pci_mark_bus_to_visit(u8 bus)
 {
    if (pci_buses[bus] == BUS_NOT_VISITED) {
@@ -74,7 +76,7 @@ pci_mark_bus_to_visit(u8 bus)
    }
 }
 
-static void
+static void INIT_TEXT
 pci_mark_bus_as_visited(u8 bus)
 {
    pci_buses[bus] = BUS_VISITED;
@@ -257,17 +259,91 @@ pcie_calc_config_paddr(struct pci_device_loc loc, ulong *paddr)
 struct pci_device *
 pci_get_object(struct pci_device_loc loc)
 {
-   struct pci_device *pos;
+   /*
+    * With PCI Express, every config access after the discovery looks up the
+    * device: remember the last one found, as drivers tend to make many config
+    * accesses in a row on the same device.
+    */
+   struct pci_device *pos = pci_last_obj;
+
+   if (pos && pos->loc.raw == loc.raw)
+      return pos;
 
    list_for_each_ro(pos, &pci_device_list, node) {
       if (pos->loc.raw == loc.raw)
+         return (pci_last_obj = pos);
+   }
+
+   return NULL;
+}
+
+/*
+ * Returns the first device with the given vendor and device ID found after
+ * `prev` (or from the beginning, if `prev` is NULL), or NULL.
+ */
+struct pci_device *
+pci_find_device(u16 vendor_id, u16 device_id, struct pci_device *prev)
+{
+   struct pci_device *pos;
+
+   if (prev)
+      pos = list_next_obj(prev, node);
+   else
+      pos = list_first_obj(&pci_device_list, struct pci_device, node);
+
+   list_for_each_ro_kp(pos, &pci_device_list, node) {
+      if (pos->nfo.vendor_id == vendor_id && pos->nfo.device_id == device_id)
          return pos;
    }
 
    return NULL;
 }
 
-static ulong
+/* Like pci_find_device(), but looking for a class and subclass */
+struct pci_device *
+pci_find_device_by_class(u8 class_id, u8 subclass_id, struct pci_device *prev)
+{
+   struct pci_device *pos;
+
+   if (prev)
+      pos = list_next_obj(prev, node);
+   else
+      pos = list_first_obj(&pci_device_list, struct pci_device, node);
+
+   list_for_each_ro_kp(pos, &pci_device_list, node) {
+      if (pos->nfo.class_id == class_id && pos->nfo.subclass_id == subclass_id)
+         return pos;
+   }
+
+   return NULL;
+}
+
+int
+pci_get_bar_paddr(struct pci_device *dev, u32 bar, u64 *paddr)
+{
+   u32 lo, hi = 0;
+
+   if (bar >= PCI_BARS_COUNT)
+      return -EINVAL;
+
+   lo = dev->bars[bar];
+
+   if (lo & PCI_BAR_IO)
+      return -EINVAL;
+
+   if (lo & PCI_BAR_MEM_64) {
+
+      if (bar == PCI_BARS_COUNT - 1)
+         return -EINVAL;
+
+      hi = dev->bars[bar + 1];
+   }
+
+   *paddr = ((u64)hi << 32) | (lo & PCI_BAR_MEM_MASK);
+   return 0;
+}
+
+static ulong INIT_TEXT
 discovery_pcie_get_conf_vaddr(struct pci_device_loc loc)
 {
    struct pci_segment *seg = pcie_get_segment(loc.seg);
@@ -383,7 +459,7 @@ int pci_device_get_info(struct pci_device_loc loc,
  * Initialize the support for the Enhanced Configuration Access Mechanism,
  * used by PCI Express.
  */
-static void
+static void INIT_TEXT
 init_pci_ecam(void)
 {
    ACPI_STATUS rc;
@@ -519,6 +595,25 @@ pci_dump_device_info(struct pci_device_loc loc,
    }
 }
 
+/* Reads the config space fields cached in struct pci_device, but the caps */
+static void
+pci_read_cached_config(struct pci_device *dev)
+{
+   const u32 bars = dev->nfo.header_type == 0 ? PCI_BARS_COUNT : 2;
+   u32 val;
+
+   if (dev->nfo.header_type > 1)
+      return; /* CardBus bridge: we don't care */
+
+   for (u32 i = 0; i < bars; i++) {
+      if (!pci_config_read(dev->loc, PCI_CONF_BAR0 + 4 * i, 32, &val))
+         dev->bars[i] = val;
+   }
+
+   if (!pci_config_read(dev->loc, PCI_CONF_IRQ_LINE, 8, &val))
+      dev->irq_line = (u8)val;
+}
+
 static int
 pci_discover_leaf_node(struct pci_device_loc loc,
                        struct pci_device_basic_info *nfo)
@@ -537,6 +632,8 @@ pci_discover_leaf_node(struct pci_device_loc loc,
    dev->nfo = *nfo;
 
    list_add_tail(&pci_device_list, &dev->node);
+   pci_read_cached_config(dev);
+   pci_parse_caps(dev);
 
    if (!pcie_segments_cnt)
       return 0; /* No PCI express, we're done */
@@ -569,12 +666,15 @@ err_end:
    if (dev->ext_config)
       hi_vmem_release(dev->ext_config, 4096);
 
+   if (pci_last_obj == dev)
+      pci_last_obj = NULL;
+
    list_remove(&dev->node);
    kfree2(dev, sizeof(struct pci_device));
    return rc;
 }
 
-static bool
+static bool INIT_TEXT
 pci_discover_device_func(struct pci_device_loc loc,
                          struct pci_device_basic_info *dev_nfo)
 {
@@ -622,7 +722,7 @@ pci_discover_device_func(struct pci_device_loc loc,
    return true;
 }
 
-static bool
+static bool INIT_TEXT
 pci_discover_device(struct pci_device_loc loc)
 {
    struct pci_device_basic_info nfo;
@@ -647,7 +747,7 @@ pci_discover_device(struct pci_device_loc loc)
    return true;
 }
 
-static bool
+static bool INIT_TEXT
 pci_before_discover_bus(struct pci_segment *seg, u8 bus)
 {
    const size_t mmap_sz = 1 * MB;
@@ -713,7 +813,7 @@ pci_before_discover_bus(struct pci_segment *seg, u8 bus)
    return true;
 }
 
-static void
+static void INIT_TEXT
 pci_after_discover_bus(struct pci_segment *seg, u8 bus)
 {
    const size_t mmap_sz = 1 * MB;
@@ -730,7 +830,7 @@ pci_after_discover_bus(struct pci_segment *seg, u8 bus)
    mmio_bus_va = 0;
 }
 
-static void
+static void INIT_TEXT
 pci_discover_bus(struct pci_segment *seg, u8 bus)
 {
    const u16 seg_num = seg ? seg->segment : 0;
@@ -757,7 +857,7 @@ pci_discover_bus(struct pci_segment *seg, u8 bus)
    pci_after_discover_bus(seg, bus);
 }
 
-static void
+static void INIT_TEXT
 pci_discover_segment(struct pci_segment *seg)
 {
    const u16 seg_num = seg ? seg->segment : 0;
@@ -778,7 +878,7 @@ pci_discover_segment(struct pci_segment *seg)
       /* Multiple PCI controllers */
       for (u8 func = 1; func < 8; func++) {
 
-         if (pci_device_get_info(pci_make_loc(0, 0, 0, func), &nfo))
+         if (pci_device_get_info(pci_make_loc(seg_num, 0, 0, func), &nfo))
             break;
 
          pci_mark_bus_to_visit(func);
@@ -802,7 +902,7 @@ pci_discover_segment(struct pci_segment *seg)
    } while (visit_count > 0);
 }
 
-static void
+static void INIT_TEXT
 init_pci(void)
 {
    int rc;
@@ -0,0 +1,339 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/utils.h>
+#include <tilck/kernel/irq.h>
+
+/* MSI capability */
+#define PCI_MSI_CTRL                        0x02
+#define PCI_MSI_ADDR_LO                     0x04
+#define PCI_MSI_ADDR_HI                     0x08     /* 64-bit only */
+#define PCI_MSI_DATA_32                     0x08
+#define PCI_MSI_DATA_64                     0x0c
+#define PCI_MSI_MASK_32                     0x0c
+#define PCI_MSI_MASK_64                     0x10
+
+#define PCI_MSI_CTRL_ENABLE                 (1 << 0)
+#define PCI_MSI_CTRL_MMC_SHIFT              1        /* multi-msg capable */
+#define PCI_MSI_CTRL_MME_SHIFT              4        /* multi-msg enable */
+#define PCI_MSI_CTRL_MME_MASK               (0x7 << 4)
+#define PCI_MSI_CTRL_64BIT                  (1 << 7)
+#define PCI_MSI_CTRL_MASKABLE               (1 << 8)
+
+/* MSI-X capability */
+#define PCI_MSIX_CTRL                       0x02
+#define PCI_MSIX_TABLE                      0x04
+
+#define PCI_MSIX_CTRL_SIZE_MASK             0x7ff    /* table size - 1 */
+#define PCI_MSIX_CTRL_FUNC_MASK             (1 << 14)
+#define PCI_MSIX_CTRL_ENABLE                (1 << 15)
+#define PCI_MSIX_TABLE_BIR_MASK             0x7
+
+/* MSI-X table entries: 4 dwords each */
+#define PCI_MSIX_ENTRY_DWORDS               4
+#define PCI_MSIX_ENTRY_ADDR_LO              0
+#define PCI_MSIX_ENTRY_ADDR_HI              1
+#define PCI_MSIX_ENTRY_DATA                 2
+#define PCI_MSIX_ENTRY_CTRL                 3
+#define PCI_MSIX_ENTRY_MASKED               (1 << 0)
+
+/* Upper bound for walking the capability list: 48 fit in 256 bytes */
+#define PCI_MAX_CAPS                        48
+
+/*
+ * Walks the capability list in the config space, caching the IDs and the
+ * offsets of the capabilities (see pci_find_cap()). Called once, at discovery
+ * time.
+ */
+static void
+pci_parse_caps(struct pci_device *dev)
+{
+   const struct pci_device_loc loc = dev->loc;
+   u32 status, off, id;
+
+   if (dev->nfo.header_type > 1)
+      return; /* CardBus bridges have the capability pointer elsewhere */
+
+   if (pci_config_read(loc, PCI_CONF_STATUS, 16, &status))
+      return;
+
+   if (!(status & PCI_STATUS_CAP_LIST))
+      return;
+
+   if (pci_config_read(loc, PCI_CONF_CAP_PTR, 8, &off))
+      return;
+
+   for (int i = 0; i < PCI_MAX_CAPS && off >= 0x40; i++) {
+
+      off &= ~0x3u;
+
+      if (pci_config_read(loc, off, 8, &id))
+         return;
+
+      if (dev->caps_count < PCI_MAX_CACHED_CAPS) {
+         dev->caps[dev->caps_count++] = (struct pci_cap) {
+            .id = (u8)id,
+            .off = (u8)off,
+         };
+      }
+
+      if (id == PCI_CAP_ID_MSI)
+         dev->msi_cap = (u8)off;
+      else if (id == PCI_CAP_ID_MSIX)
+         dev->msix_cap = (u8)off;
+
+      if (pci_config_read(loc, off + 1, 8, &off))
+         return;
+   }
+}
+
+static int
+pci_set_intx(struct pci_device *dev, bool enabled)
+{
+   u32 cmd;
+   int rc;
+
+   if ((rc = pci_config_read(dev->loc, PCI_CONF_COMMAND, 16, &cmd)))
+      return rc;
+
+   if (enabled)
+      cmd &= ~(u32)PCI_CMD_INTX_DISABLE;
+   else
+      cmd |= PCI_CMD_INTX_DISABLE;
+
+   return pci_config_write(dev->loc, PCI_CONF_COMMAND, 16, cmd);
+}
+
+static int
+pci_enable_msi(struct pci_device *dev, u32 min, u32 max)
+{
+   const struct pci_device_loc loc = dev->loc;
+   const u32 cap = dev->msi_cap;
+   struct msi_msg msg;
+   u32 ctrl, n, log2n = 0;
+   int rc, irq = -ENOSPC;
+
+   if ((rc = pci_config_read(loc, cap + PCI_MSI_CTRL, 16, &ctrl)))
+      return rc;
+
+   /* The device supports 2^mmc vectors: take the largest power of 2 we can */
+   n = MIN(max, 1u << ((ctrl >> PCI_MSI_CTRL_MMC_SHIFT) & 0x7));
+
+   while ((2u << log2n) <= n)
+      log2n++;
+
+   for (n = 1u << log2n; n >= min && n > 0; n >>= 1, log2n--) {
+      if ((irq = irq_alloc_msi(n, &msg)) >= 0)
+         break;
+   }
+
+   if (irq < 0)
+      return irq;
+
+   pci_config_write(loc, cap + PCI_MSI_ADDR_LO, 32, (u32)msg.addr);
+
+   if (ctrl & PCI_MSI_CTRL_64BIT) {
+      pci_config_write(loc, cap + PCI_MSI_ADDR_HI, 32, (u32)(msg.addr >> 32));
+      pci_config_write(loc, cap + PCI_MSI_DATA_64, 16, msg.data);
+   } else {
+      pci_config_write(loc, cap + PCI_MSI_DATA_32, 16, msg.data);
+   }
+
+   if (ctrl & PCI_MSI_CTRL_MASKABLE) {
+      pci_config_write(loc,
+                       cap + ((ctrl & PCI_MSI_CTRL_64BIT)
+                                 ? PCI_MSI_MASK_64
+                                 : PCI_MSI_MASK_32),
+                       32, 0);
+   }
+
+   ctrl &= ~(u32)PCI_MSI_CTRL_MME_MASK;
+   ctrl |= (log2n << PCI_MSI_CTRL_MME_SHIFT) | PCI_MSI_CTRL_ENABLE;
+   pci_config_write(loc, cap + PCI_MSI_CTRL, 16, ctrl);
+   pci_set_intx(dev, false);
+
+   for (u32 i = 0; i < n; i++)
+      dev->irqs[i] = (u8)(irq + (int)i);
+
+   dev->irqs_count = (u8)n;
+   dev->msix_enabled = false;
+   return (int)n;
+}
+
+static int
+pci_map_msix_table(struct pci_device *dev, u32 n)
+{
+   const struct pci_device_loc loc = dev->loc;
+   ulong page_paddr, off_in_page;
+   size_t map_size, cnt;
+   u64 paddr;
+   u32 table;
+   void *va;
+   int rc;
+
+   if ((rc = pci_config_read(loc, dev->msix_cap + PCI_MSIX_TABLE, 32, &table)))
+      return rc;
+
+   rc = pci_get_bar_paddr(dev, table & PCI_MSIX_TABLE_BIR_MASK, &paddr);
+
+   if (rc)
+      return rc;
+
+   paddr += table & ~(u32)PCI_MSIX_TABLE_BIR_MASK;
+
+   if (NBITS == 32 && paddr > (0xffffffff - 2 * PAGE_SIZE))
+      return -E2BIG;
+
+   off_in_page = (ulong)paddr & OFFSET_IN_PAGE_MASK;
+   page_paddr = (ulong)paddr - off_in_page;
+   map_size = pow2_round_up_at(off_in_page + n * PCI_MSIX_ENTRY_DWORDS * 4,
+                               PAGE_SIZE);
+
+   if (!(va = hi_vmem_reserve(map_size)))
+      return -ENOMEM;
+
+   cnt = map_pages(get_kernel_pdir(),
+                   va,
+                   page_paddr,
+                   map_size >> PAGE_SHIFT,
+                   PAGING_FL_RW);
+
+   if (cnt != map_size >> PAGE_SHIFT) {
+      unmap_kernel_pages(va, cnt, false);
+      hi_vmem_release(va, map_size);
+      return -ENOMEM;
+   }
+
+   dev->msix_table = (volatile u32 *)((ulong)va + off_in_page);
+   dev->msix_table_map_size = map_size;
+   return 0;
+}
+
+static void
+pci_unmap_msix_table(struct pci_device *dev)
+{
+   void *va = (void *)((ulong)dev->msix_table & PAGE_MASK);
+   const size_t size = dev->msix_table_map_size;
+
+   unmap_kernel_pages(va, size >> PAGE_SHIFT, false);
+   hi_vmem_release(va, size);
+   dev->msix_table = NULL;
+   dev->msix_table_map_size = 0;
+}
+
+static int
+pci_enable_msix(struct pci_device *dev, u32 min, u32 max)
+{
+   const struct pci_device_loc loc = dev->loc;
+   const u32 cap = dev->msix_cap;
+   volatile u32 *e;
+   struct msi_msg msg;
+   u32 ctrl, n;
+   int rc, irq;
+
+   if ((rc = pci_config_read(loc, cap + PCI_MSIX_CTRL, 16, &ctrl)))
+      return rc;
+
+   n = MIN(max, (ctrl & PCI_MSIX_CTRL_SIZE_MASK) + 1);
+
+   if (n < min)
+      return -ENOSPC;
+
+   if ((rc = pci_map_msix_table(dev, n)))
+      return rc;
+
+   /* Keep all the vectors masked while programming the table */
+   ctrl |= PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_FUNC_MASK;
+   pci_config_write(loc, cap + PCI_MSIX_CTRL, 16, ctrl);
+
+   /* Unlike MSI, each MSI-X vector has its own message */
+   for (dev->irqs_count = 0; dev->irqs_count < n; dev->irqs_count++) {
+
+      if ((irq = irq_alloc_msi(1, &msg)) < 0)
+         break;
+
+      e = dev->msix_table + dev->irqs_count * PCI_MSIX_ENTRY_DWORDS;
+      e[PCI_MSIX_ENTRY_ADDR_LO] = (u32)msg.addr;
+      e[PCI_MSIX_ENTRY_ADDR_HI] = (u32)(msg.addr >> 32);
+      e[PCI_MSIX_ENTRY_DATA] = msg.data;
+      e[PCI_MSIX_ENTRY_CTRL] = 0;
+      dev->irqs[dev->irqs_count] = (u8)irq;
+   }
+
+   if (dev->irqs_count < min) {
+      dev->msix_enabled = true;
+      pci_free_irq_vectors(dev);
+      return -ENOSPC;
+   }
+
+   ctrl &= ~(u32)PCI_MSIX_CTRL_FUNC_MASK;
+   pci_config_write(loc, cap + PCI_MSIX_CTRL, 16, ctrl);
+   pci_set_intx(dev, false);
+
+   dev->msix_enabled = true;
+   return dev->irqs_count;
+}
+
+int
+pci_alloc_irq_vectors(struct pci_device *dev, u32 min, u32 max, u32 flags)
+{
+   int rc = -ENODEV;
+
+   ASSERT(min > 0 && min <= max);
+
+   if (dev->irqs_count)
+      return -EBUSY;
+
+   max = MIN(max, (u32)PCI_MAX_IRQ_VECTORS);
+
+   if (min > max)
+      return -ENOSPC;
+
+   if ((flags & PCI_IRQ_MSIX) && dev->msix_cap) {
+
+      if ((rc = pci_enable_msix(dev, min, max)) > 0)
+         return rc;
+   }
+
+   if ((flags & PCI_IRQ_MSI) && dev->msi_cap)
+      rc = pci_enable_msi(dev, min, max);
+
+   return rc;
+}
+
+void
+pci_free_irq_vectors(struct pci_device *dev)
+{
+   const struct pci_device_loc loc = dev->loc;
+   u32 ctrl;
+
+   if (dev->msix_enabled) {
+
+      if (!pci_config_read(loc, dev->msix_cap + PCI_MSIX_CTRL, 16, &ctrl)) {
+         ctrl &= ~(u32)PCI_MSIX_CTRL_ENABLE;
+         pci_config_write(loc, dev->msix_cap + PCI_MSIX_CTRL, 16, ctrl);
+      }
+
+      for (u32 i = 0; i < dev->irqs_count; i++) {
+         dev->msix_table[i * PCI_MSIX_ENTRY_DWORDS + PCI_MSIX_ENTRY_CTRL] =
+            PCI_MSIX_ENTRY_MASKED;
+         irq_free_msi(dev->irqs[i], 1);
+      }
+
+      pci_unmap_msix_table(dev);
+
+   } else if (dev->irqs_count) {
+
+      if (!pci_config_read(loc, dev->msi_cap + PCI_MSI_CTRL, 16, &ctrl)) {
+         ctrl &= ~(u32)(PCI_MSI_CTRL_ENABLE | PCI_MSI_CTRL_MME_MASK);
+         pci_config_write(loc, dev->msi_cap + PCI_MSI_CTRL, 16, ctrl);
+      }
+
+      irq_free_msi(dev->irqs[0], dev->irqs_count);
+   }
+
+   if (dev->irqs_count)
+      pci_set_intx(dev, true);
+
+   dev->irqs_count = 0;
+   dev->msix_enabled = false;
+}
@@ -9,6 +9,53 @@
 
 static struct sysobj *dir_sysfs_pci;                /* /sysfs/pci           */
 
+/* The BARs, from the cache in struct pci_device: one per line, in hex */
+static offt
+pci_bars_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct pci_device *dev = data;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (u32 i = 0; i < PCI_BARS_COUNT && tot < sz; i++) {
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%#010x\n",
+                      dev->bars[i]);
+   }
+
+   return MIN(tot, sz);
+}
+
+/* The capabilities, as cached: one per line, "<id> <offset>" in hex */
+static offt
+pci_caps_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct pci_device *dev = data;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (u32 i = 0; i < dev->caps_count && tot < sz; i++) {
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%#04x %#04x\n",
+                      dev->caps[i].id,
+                      dev->caps[i].off);
+   }
+
+   return MIN(tot, sz);
+}
+
+static const struct sysobj_prop_type pci_bars_ptype = {
+   .load = &pci_bars_load,
+};
+
+static const struct sysobj_prop_type pci_caps_ptype = {
+   .load = &pci_caps_load,
+};
+
 /* Properties */
 DEF_STATIC_SYSOBJ_PROP(vendor_id, &sysobj_ptype_ro_ulong_hex_literal);
 DEF_STATIC_SYSOBJ_PROP(device_id, &sysobj_ptype_ro_ulong_hex_literal);
@@ -21,6 +68,9 @@ DEF_STATIC_SYSOBJ_PROP(class_name, &sysobj_ptype_ro_string_literal);
 DEF_STATIC_SYSOBJ_PROP(subclass_name, &sysobj_ptype_ro_string_literal);
 DEF_STATIC_SYSOBJ_PROP(progif_name, &sysobj_ptype_ro_string_literal);
 DEF_STATIC_SYSOBJ_PROP(vendor_name, &sysobj_ptype_ro_string_literal);
+DEF_STATIC_SYSOBJ_PROP(irq_line, &sysobj_ptype_ro_ulong_literal);
+DEF_STATIC_SYSOBJ_PROP(bars, &pci_bars_ptype);
+DEF_STATIC_SYSOBJ_PROP(caps, &pci_caps_ptype);
 
 /* Sysfs obj types */
 DEF_STATIC_SYSOBJ_TYPE(pci_device_sysobj_type,
@@ -35,6 +85,9 @@ DEF_STATIC_SYSOBJ_TYPE(pci_device_sysobj_type,
                        &prop_subclass_name,
                        &prop_progif_name,
                        &prop_vendor_name,
+                       &prop_irq_line,
+                       &prop_bars,
+                       &prop_caps,
                        NULL);
 
 static int
@@ -69,7 +122,10 @@ pci_create_obj_for_device(struct pci_device *dev)
                           dc.class_name,
                           dc.subclass_name,
                           dc.progif_name,
-                          vendor);
+                          vendor,
+                          TO_PTR(dev->irq_line),
+                          dev,
+                          dev);
 
    if (!obj)
       return -ENOMEM;
@@ -65,13 +65,20 @@ void irqchip_put_irq(int irq)
 enum irq_action generic_irq_handler(u8 irq)
 {
    enum irq_action hret = IRQ_NOT_HANDLED;
-   struct irq_handler_node *pos;
+   struct irq_handler_node *pos = irq_direct_handlers[irq];
 
-   list_for_each_ro(pos, &irq_handlers_lists[irq], node) {
+   if (LIKELY(pos != NULL)) {
 
       hret = pos->handler(pos->context);
-      if (hret != IRQ_NOT_HANDLED)
-         break;
+
+   } else {
+
+      list_for_each_ro(pos, &irq_handlers_lists[irq], node) {
+
+         hret = pos->handler(pos->context);
+         if (hret != IRQ_NOT_HANDLED)
+            break;
+      }
    }
 
    if (hret == IRQ_NOT_HANDLED) {
@@ -164,17 +164,25 @@ static enum irq_action plic_irq_handler(void *ctx)
    /*
     * Reading and writing claim register automatically enables
     * and disables the interrupt, nothing else to do.
+    *
+    * Keep claiming until the PLIC has nothing pending for us (claim = 0):
+    * sources firing while we handle the others get served in the same trap,
+    * instead of paying a whole trap round trip each.
     */
-   hwirq = mmio_readl(claim);
-   irq = plic->domain->irq_map[hwirq];
-   ASSERT(irq);
-
-   enable_interrupts_forced();
-   {
-      hret = generic_irq_handler(irq);
+   while ((hwirq = mmio_readl(claim)) != 0) {
+
+      irq = plic->domain->irq_map[hwirq];
+      ASSERT(irq);
+
+      enable_interrupts_forced();
+      {
+         if (generic_irq_handler(irq) == IRQ_HANDLED)
+            hret = IRQ_HANDLED;
+      }
+      disable_interrupts_forced();
+      mmio_writel(hwirq, claim);
    }
-   disable_interrupts_forced();
-   mmio_writel(hwirq, claim);
+
    return hret;
 }
 
@@ -25,24 +25,41 @@ struct sb16_info sb16_info;
 static u16 sb16_major;
 
 /*
- * Shared state between the IRQ handler and the rest of the code.
+ * The 64 KB DMA buffer is a ring of `periods` periods of `period_sz` bytes:
+ * the DMA controller and the DSP run in auto-init mode over all of it and the
+ * DSP raises an IRQ at the end of each period. The periods in the range
+ * [tail, head) are queued: the card is playing `tail`. Both the indexes are
+ * free-running: the slot of the period N is (N % periods).
  *
  * NOTE: it's not necessary to use atomics because most of the time we disable
  * the interrupts while accessing the following state variables. In other cases,
- * like in sb16_ioctl_wait_for_completion() do just poll on sb16_playing:
+ * like in sb16_ioctl_wait_for_completion() do just poll on sb16_state:
  * volatile is mandatory, but no need for atomics. It's worth remarking that
  * in the simple model used by this driver, only ONE task at a time can acquire
  * and use this sound device. Therefore, no need for need for any kind of fancy
  * synchronization mechanisms.
  */
+enum sb16_state {
+   SB16_STOPPED,     /* DMA and DSP not programmed: the ring is empty */
+   SB16_RUNNING,
+   SB16_UNDERRUN,    /* DSP paused at the beginning of the period `tail` */
+};
+
 static volatile bool producer_is_sleeping;
-static volatile bool sb16_have_slot[2];
-static volatile bool sb16_playing;
-static volatile u8 sb16_slot;
+static volatile enum sb16_state sb16_state;
+static volatile bool sb16_draining;
+static volatile u32 sb16_head;
+static volatile u32 sb16_tail;
+
+/* Bytes already copied in the period `head`, not queued yet */
+static u32 sb16_fill_off;
+
+static u32 period_sz;
+static u32 periods;
+static struct tilck_sound_stats stats;
 
 /* DSP config */
 static struct tilck_sound_params dsp_params;
-static u32 curr_buf_sz;
 
 /* The task currently owning the sound device */
 static struct task *owner;
@@ -50,7 +67,7 @@ static struct task *owner;
 static int
 sb16_alloc_buf(void)
 {
-   size_t sz = 64 * KB;
+   size_t sz = SB16_BUF_SIZE;
    sb16_info.buf = general_kmalloc(&sz, KMALLOC_FL_DMA);
 
    if (!sb16_info.buf)
@@ -63,30 +80,60 @@ sb16_alloc_buf(void)
    return 0;
 }
 
-static enum irq_action
-sb16_handle_irq(void *ctx)
+static void
+sb16_fill_buf_with_mute(void *buf, size_t len)
 {
-   SB16_DBG("sb16, irq, completed slot: %u\n", sb16_slot);
+   u16 mute = (u16)(dsp_params.sign ? 0 : (1 << ((u32)dsp_params.bits-1)) - 1);
+
+   if (dsp_params.bits == 8)
+      memset(buf, mute, len);
+   else
+      memset16(buf, mute, len / 2);
+}
 
-   /* Mark the current slot as "used" */
-   sb16_have_slot[sb16_slot] = false;
+static inline u8 *
+sb16_period_buf(u32 n)
+{
+   return sb16_info.buf + (n % periods) * period_sz;
+}
 
-   /* Switch to the other slot */
-   sb16_slot = !sb16_slot;
+static enum irq_action
+sb16_handle_irq(void *ctx)
+{
+   SB16_DBG("sb16, irq, completed period: %u\n", sb16_tail);
 
    /* ACK the hardware */
    sb16_irq_ack();
 
-   if (!sb16_have_slot[sb16_slot]) {
+   if (sb16_state != SB16_RUNNING)
+      return IRQ_HANDLED;
 
-      SB16_DBG("sb16, irq, no data for slot %u: STOP\n", sb16_slot);
-      /* We don't have data ready in the new slot, stop */
-      sb16_pause();
-      sb16_playing = false;
+   /*
+    * The period just played is free: fill it with mute, so that the card
+    * never plays it again, in case of underrun.
+    */
+   sb16_fill_buf_with_mute(sb16_period_buf(sb16_tail), period_sz);
+   sb16_tail++;
+   stats.played++;
 
-   } else {
+   if (sb16_tail == sb16_head) {
+
+      /*
+       * Nothing queued for the period the card has just started: pause it.
+       * If the writer is just late, it's an underrun and the DSP will
+       * continue from this period. Otherwise, we're done.
+       */
+      sb16_pause();
 
-      SB16_DBG("sb16, irq, switch to slot: %u\n", sb16_slot);
+      if (sb16_draining) {
+         SB16_DBG("sb16, irq, drained: STOP\n");
+         sb16_state = SB16_STOPPED;
+         sb16_head = sb16_tail = 0;
+      } else {
+         SB16_DBG("sb16, irq, no data for period %u: UNDERRUN\n", sb16_tail);
+         sb16_state = SB16_UNDERRUN;
+         stats.underruns++;
+      }
    }
 
    if (producer_is_sleeping) {
@@ -115,64 +162,75 @@ sb16_read(fs_handle h, char *user_buf, size_t size, offt *pos)
    return 0;
 }
 
+/*
+ * Starts (or continues, after an underrun) the playback, if there are enough
+ * periods queued. Called with the interrupts disabled.
+ */
 static void
-sb16_fill_buf_with_mute(void *buf, size_t len)
+sb16_maybe_start(u32 min_queued)
 {
-   u16 mute = (u16)(dsp_params.sign ? 0 : (1 << ((u32)dsp_params.bits-1)) - 1);
+   if (sb16_state == SB16_RUNNING || sb16_head - sb16_tail < min_queued)
+      return;
 
-   if (dsp_params.bits == 8)
-      memset(buf, mute, len);
-   else
-      memset16(buf, mute, len / 2);
-}
+   if (sb16_state == SB16_STOPPED) {
 
-static void
-sb16_fill_slot_with_mute(u8 slot)
-{
-   u8 *buf = sb16_info.buf + (slot << 15);
-   sb16_fill_buf_with_mute(buf, 32 * KB);
+      SB16_DBG("sb16: START\n");
+      ASSERT(sb16_tail == 0);
+      sb16_program_dma(dsp_params.bits, SB16_BUF_SIZE);
+      sb16_program(&dsp_params, period_sz);
+
+   } else {
+
+      SB16_DBG("sb16: CONTINUE after underrun\n");
+      sb16_continue();
+   }
+
+   sb16_state = SB16_RUNNING;
 }
 
+/* Queues the period `head`, completely filled by the writer */
 static void
-do_start_play(u8 next_slot, u32 sz)
+sb16_queue_period(void)
 {
-   static bool played_anything;
+   u32 queued;
 
-   bool currently_playing;
+   sb16_fill_off = 0;
 
    disable_interrupts_forced();
    {
-      /* Mark the data in the next slot as "ready" */
-      SB16_DBG("write(): mark slot %u as available\n", next_slot);
-      sb16_have_slot[next_slot] = true;
-      currently_playing = sb16_playing;
+      sb16_head++;
+      queued = sb16_head - sb16_tail;
+      stats.high_water = MAX(stats.high_water, queued);
+      sb16_maybe_start(MIN(periods, (u32)SB16_START_PERIODS));
    }
    enable_interrupts_forced();
+}
 
-   if (!currently_playing) {
-
-      SB16_DBG("write(): not playing, START!\n");
-      ASSERT(next_slot == 0);
-      sb16_slot = next_slot;
-      sb16_have_slot[1] = false;
-      sb16_fill_slot_with_mute(1);
-
-      sb16_playing = true;
-      curr_buf_sz = MAX(sz, played_anything ? 4 * KB : 8 * KB);
-      played_anything = true;
-
-      sb16_program_dma(dsp_params.bits, sz < 32 * KB ? sz : 64 * KB);
-      sb16_program(&dsp_params, curr_buf_sz);
-
-   } else {
+static bool
+sb16_ring_full(void)
+{
+   bool full;
 
-      SB16_DBG("write(): playing slot %u, do nothing\n", !next_slot);
+   disable_interrupts_forced();
+   {
+      full = sb16_head - sb16_tail == periods;
    }
+   enable_interrupts_forced();
+   return full;
 }
 
+/*
+ * Copies as many periods as there are in the user buffer, waiting only when
+ * the ring is full. The remainder stays in the period `head`, which gets
+ * queued by the next writes or by TILCK_IOCTL_SOUND_WAIT_COMPLETION.
+ */
 static ssize_t
 sb16_write(fs_handle h, char *user_buf, size_t size, offt *pos)
 {
+   const u32 frame_sz = (u32)dsp_params.bits / 8 * dsp_params.channels;
+   size_t written = 0;
+   u32 n;
+
    if (get_curr_task() != owner) {
       /* The current task, does not own the resource */
       return -EPERM;
@@ -183,74 +241,43 @@ sb16_write(fs_handle h, char *user_buf, size_t size, offt *pos)
       return -EINVAL;
    }
 
-   const size_t sz = MIN(size, 32 * KB);
-   bool must_sleep;
-   u8 next_slot;
-   u8 *dest_buf;
-
-   do {
-
-      must_sleep = false;
-      disable_interrupts_forced();
-      {
-         if (sb16_playing) {
-
-            next_slot = !sb16_slot;
-
-            if (sb16_have_slot[next_slot] || curr_buf_sz < 32 * KB) {
-
-               if (curr_buf_sz < 32 * KB)
-                  SB16_DBG("force sleep on write() because buf < 32KB\n");
-
-               must_sleep = true;
-            }
+   if (size % frame_sz)
+      return -EINVAL;
 
-         } else {
-            next_slot = 0;
-         }
-      }
-      enable_interrupts_forced();
+   while (written < size) {
 
-      if (must_sleep) {
+      if (sb16_ring_full()) {
 
-         SB16_DBG("write() requires to sleep (waiting for slot)\n");
+         SB16_DBG("write() requires to sleep (waiting for a period)\n");
 
          producer_is_sleeping = true;
          kernel_sleep_ms(100);
          task_cancel_wakeup_timer(get_curr_task());
+         producer_is_sleeping = false;
 
          if (pending_signals())
-            return -EINTR;
+            return written ? (ssize_t)written : -EINTR;
 
-         producer_is_sleeping = false;
+         continue;
       }
 
-   } while (must_sleep);
-
-   SB16_DBG("write(): using slot: %u\n", next_slot);
-   dest_buf = sb16_info.buf + (next_slot << 15);
-
-   if (copy_from_user(dest_buf, user_buf, sz))
-      return -EFAULT;
-
-   if (sz < 32 * KB) {
-
-      if (dsp_params.bits == 16 || dsp_params.channels == 2) {
+      n = (u32)MIN(size - written, period_sz - sb16_fill_off);
 
-         if (sz % 2)
-            return -EINVAL;
-
-         if (dsp_params.bits == 16 && dsp_params.channels == 2)
-            if (sz % 4)
-               return -EINVAL;
+      if (copy_from_user(sb16_period_buf(sb16_head) + sb16_fill_off,
+                         user_buf + written,
+                         n))
+      {
+         return written ? (ssize_t)written : -EFAULT;
       }
 
-      SB16_DBG("write(): small buf %u, fill %u with mute\n", sz, 32*KB - sz);
-      sb16_fill_buf_with_mute(dest_buf + sz, 32 * KB - sz);
+      written += n;
+      sb16_fill_off += n;
+
+      if (sb16_fill_off == period_sz)
+         sb16_queue_period();
    }
 
-   do_start_play(next_slot, sz);
-   return (ssize_t)sz;
+   return (ssize_t)written;
 }
 
 static int
@@ -261,21 +288,35 @@ sb16_ioctl_sound_setup(struct tilck_sound_params *user_params)
       return -EPERM;
    }
 
-   if (sb16_playing)
+   if (sb16_state == SB16_RUNNING)
       return -EBUSY;
 
    if (copy_from_user(&dsp_params, user_params, sizeof(dsp_params)))
       return -EFAULT;
 
+   if (!dsp_params.period_kb)
+      dsp_params.period_kb = SB16_DEFAULT_PERIOD_KB;
+
    if (dsp_params.sample_rate <= 44100 &&
        (dsp_params.bits == 8 || dsp_params.bits == 16) &&
        (dsp_params.channels == 1 || dsp_params.channels == 2) &&
-       (dsp_params.sign == 0 || dsp_params.sign == 1))
+       (dsp_params.sign == 0 || dsp_params.sign == 1) &&
+       dsp_params.period_kb <= SB16_BUF_SIZE / KB / 2 &&
+       (dsp_params.period_kb & (dsp_params.period_kb - 1)) == 0)
    {
-      sb16_have_slot[0] = false;
-      sb16_have_slot[1] = false;
-      sb16_fill_slot_with_mute(0);
-      sb16_fill_slot_with_mute(1);
+      /* Note: after an underrun, the DSP is still paused: just forget it */
+      sb16_state = SB16_STOPPED;
+      sb16_head = sb16_tail = 0;
+      sb16_fill_off = 0;
+
+      period_sz = dsp_params.period_kb * KB;
+      periods = SB16_BUF_SIZE / period_sz;
+
+      bzero(&stats, sizeof(stats));
+      stats.period_size = period_sz;
+      stats.periods = periods;
+
+      sb16_fill_buf_with_mute(sb16_info.buf, SB16_BUF_SIZE);
       return 0;
    }
 
@@ -358,22 +399,72 @@ sb16_ioctl_get_info(struct tilck_sound_card_info *user_info)
 static int
 sb16_ioctl_wait_for_completion(void)
 {
+   int rc = 0;
+
    if (get_curr_task() != owner) {
       /* The current task does not own the resource */
       return -EPERM;
    }
 
-   while (sb16_playing) {
+   if (!dsp_params.bits)
+      return 0;
+
+   /* Queue the last, incomplete, period */
+   if (sb16_fill_off) {
+
+      sb16_fill_buf_with_mute(sb16_period_buf(sb16_head) + sb16_fill_off,
+                              period_sz - sb16_fill_off);
+      sb16_queue_period();
+   }
+
+   disable_interrupts_forced();
+   {
+      sb16_draining = true;
+
+      if (sb16_head != sb16_tail) {
+
+         sb16_maybe_start(1);
+
+      } else if (sb16_state == SB16_UNDERRUN) {
+
+         /* Nothing more to play: the DSP is already paused */
+         sb16_state = SB16_STOPPED;
+         sb16_head = sb16_tail = 0;
+      }
+   }
+   enable_interrupts_forced();
+
+   while (sb16_state != SB16_STOPPED) {
 
       producer_is_sleeping = true;
       kernel_sleep_ms(100);
       task_cancel_wakeup_timer(get_curr_task());
+      producer_is_sleeping = false;
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         break;
+      }
+   }
 
-      if (pending_signals())
-         return -EINTR;
+   sb16_draining = false;
+   return rc;
+}
 
-      producer_is_sleeping = false;
+static int
+sb16_ioctl_get_stats(struct tilck_sound_stats *user_stats)
+{
+   struct tilck_sound_stats s;
+
+   disable_interrupts_forced();
+   {
+      s = stats;
+      s.queued = sb16_head - sb16_tail;
    }
+   enable_interrupts_forced();
+
+   if (copy_to_user(user_stats, &s, sizeof(s)))
+      return -EFAULT;
 
    return 0;
 }
@@ -398,6 +489,9 @@ sb16_ioctl(fs_handle h, ulong request, void *user_argp)
       case TILCK_IOCTL_SOUND_WAIT_COMPLETION:
          return sb16_ioctl_wait_for_completion();
 
+      case TILCK_IOCTL_SOUND_GET_STATS:
+         return sb16_ioctl_get_stats(user_argp);
+
       default:
          return -EINVAL;
    }
@@ -472,6 +566,7 @@ static struct module sb16_module = {
    .name = "sb16",
    .priority = MOD_sb16_prio,
    .init = &init_sb16,
+   .flags = MODULE_FL_ASYNC,
 };
 
 REGISTER_MODULE(&sb16_module);
@@ -34,6 +34,13 @@
 #define DSP_16_BIT_PAUSE   0xD5
 #define DSP_16_BIT_CONT    0xD6
 
+/* The DMA buffer: a ring of periods, played in auto-init mode */
+#define SB16_BUF_SIZE          (64 * KB)
+#define SB16_DEFAULT_PERIOD_KB 8
+
+/* Periods queued before starting the playback (unless draining) */
+#define SB16_START_PERIODS     2
+
 struct sb16_info {
    u8 *buf;
    ulong buf_paddr;
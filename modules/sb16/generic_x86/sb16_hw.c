@@ -146,14 +146,8 @@ sb16_program_dma(u8 bits, u32 buf_sz)
       channel = DMA_CHANNEL_5;
    }
 
-   dma_mode = DMA_SINGLE_MODE | DMA_READ_TX | channel;
-
-   if (buf_sz == 64 * KB) {
-      SB16_DBG("prog DMA in AUTO INIT mode\n");
-      dma_mode |= DMA_AUTO_INIT;
-   } else {
-      SB16_DBG("prog DMA in SINGLE CYCLE mode\n");
-   }
+   /* The whole buffer, over and over: the DSP splits it in periods */
+   dma_mode = DMA_SINGLE_MODE | DMA_READ_TX | DMA_AUTO_INIT | channel;
 
    outb(mask_reg_cmd, DMA_MASK_CHANNEL | channel);
    outb(rst_ff_cmd, 1);
@@ -186,14 +180,8 @@ sb16_program(struct tilck_sound_params *p, u32 buf_sz)
    u8 sound_fmt = 0;
    u32 samples_cnt;
 
-   prog_mode |= DSP_PLAY;
-
-   if (buf_sz == 32 * KB) {
-      SB16_DBG("prog DSP in AUTO_INIT mode\n");
-      prog_mode |= DSP_AUTO_INIT;
-   } else {
-      SB16_DBG("prog DSP in SINGLE CYCLE mode\n");
-   }
+   /* An IRQ at the end of each block of `buf_sz` bytes (a period) */
+   prog_mode |= DSP_PLAY | DSP_AUTO_INIT;
 
    if (p->bits == 8) {
 
@@ -120,10 +120,15 @@ void init_serial_port(u16 port)
 
    outb(port + UART_LCR, LCR_8_BITS | LCR_1_STOP_BIT | LCR_NO_PARITY);
 
+   /*
+    * Raise the RX interrupt with 8 bytes in the FIFO (or after a timeout, with
+    * fewer): the IRQ handler drains the whole FIFO at once, while the 8 free
+    * bytes leave room for the IRQ latency before an overrun.
+    */
    outb(port + UART_FCR, FCR_ENABLE_FIFOs |
                          FCR_CLEAR_RECV_FIFO |
                          FCR_CLEAR_TR_FIFO |
-                         FCR_INT_TRIG_LEVEL_3);
+                         FCR_INT_TRIG_LEVEL_2);
 
    outb(port + UART_MCR, MCR_DTR | MCR_RTS | MCR_AUX_OUTPUT_2);
    outb(port + UART_IER, IER_RCV_AVAIL_INTR);
@@ -160,3 +165,26 @@ void serial_write(u16 port, char c)
    serial_wait_for_write(port);
    outb(port, (u8)c);
 }
+
+bool serial_tx_intr_supported(void)
+{
+   return true;
+}
+
+void serial_set_tx_intr(u16 port, bool enabled)
+{
+   u8 ier = inb(port + UART_IER);
+
+   if (enabled)
+      ier |= IER_TR_EMPTY_INTR;
+   else
+      ier &= (u8)~IER_TR_EMPTY_INTR;
+
+   outb(port + UART_IER, ier);
+}
+
+void serial_tx_fifo_write(u16 port, char c)
+{
+   /* The caller checked that the TX FIFO is empty: no need to wait */
+   outb(port + UART_THR, (u8)c);
+}
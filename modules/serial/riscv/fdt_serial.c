@@ -110,6 +110,22 @@ void serial_write(u16 port, char c)
       uart->ops->tx_c(uart->priv, c);
 }
 
+bool serial_tx_intr_supported(void)
+{
+   /* Not supported by the fdt_serial_ops: serial_tx_write() just polls */
+   return false;
+}
+
+void serial_set_tx_intr(u16 port, bool enabled)
+{
+   /* do nothing */
+}
+
+void serial_tx_fifo_write(u16 port, char c)
+{
+   serial_write(port, c);
+}
+
 enum irq_action fdt_serial_generic_irq_handler(void *ctx)
 {
    struct fdt_serial_dev *serial = ctx;
@@ -11,9 +11,17 @@
 #include <tilck/kernel/cmdline.h>
 #include <tilck/kernel/tty.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/ringbuf.h>
+#include <tilck/kernel/safe_ringbuf.h>
+#include <tilck/kernel/sync.h>
 
 #include <tilck/mods/serial.h>
 
+#define SERIAL_TX_BUF_SIZE                     1024
+#define SERIAL_RX_BUF_SIZE                     512
+#define SERIAL_RX_BATCH                        64
+
 /* NOTE: hw-specific stuff in generic code. TODO: fix that. */
 
 struct serial_device {
@@ -21,8 +29,22 @@ struct serial_device {
    const char *name;
    u16 ioport;
    struct tty *tty;
-   ATOMIC(int) jobs_cnt;
    struct worker_thread *wth;
+
+   /*
+    * RX: the IRQ handler drains the whole UART FIFO into rx_rb and a single
+    * ser_rx_bh_handler() job pushes everything received to the tty.
+    */
+   u8 rx_buf[SERIAL_RX_BUF_SIZE];
+   struct safe_ringbuf rx_rb;
+   ATOMIC(bool) rx_bh_pending;   /* ser_rx_bh_handler() has been enqueued */
+
+   /* Interrupt-driven TX: used only when tx_buf != NULL */
+   u8 *tx_buf;
+   struct ringbuf tx_rb;         /* protected by disabling the interrupts */
+   struct kcond tx_cond;         /* signalled when there's space in tx_rb */
+   bool tx_intr_on;              /* the TX interrupt is enabled */
+   bool tx_signal_pending;       /* ser_tx_bh_handler() has been enqueued */
 };
 
 struct serial_device legacy_serial_ports[] =
@@ -45,31 +67,200 @@ struct serial_device legacy_serial_ports[] =
    },
 };
 
-static void ser_bh_handler(void *ctx)
+static void ser_rx_bh_handler(void *ctx)
 {
    struct serial_device *const dev = ctx;
-   struct tty *const t = dev->tty;
-   const u16 p = dev->ioport;
+   char buf[SERIAL_RX_BATCH];
+   size_t n;
+
+   /* From now on, a new IRQ has to enqueue another job */
+   dev->rx_bh_pending = false;
+
+   do {
+
+      for (n = 0; n < sizeof(buf); n++) {
+         if (!safe_ringbuf_read_1(&dev->rx_rb, &buf[n]))
+            break;
+      }
+
+      if (n > 0)
+         tty_send_input(dev->tty, buf, n, true);
+
+   } while (n == sizeof(buf));
+}
+
+/* Move everything in the UART's RX FIFO to the ring buffer */
+static bool ser_rx_drain_fifo(struct serial_device *dev)
+{
+   bool was_empty, dropped = false;
+   int count = 0;
    char c;
 
-   while (serial_read_ready(p)) {
+   while (serial_read_ready(dev->ioport)) {
+
+      c = serial_read(dev->ioport);
+
+      if (!safe_ringbuf_write_1(&dev->rx_rb, &c, &was_empty))
+         dropped = true;
+
+      count++;
+   }
+
+   if (dropped)
+      printk("Serial: WARNING: %s hit input limit, data lost\n", dev->name);
+
+   return count > 0;
+}
+
+static struct serial_device *ser_get_dev(u16 port)
+{
+   for (int i = 0; i < ARRAY_SIZE(legacy_serial_ports); i++)
+      if (legacy_serial_ports[i].ioport == port)
+         return &legacy_serial_ports[i];
+
+   return NULL;
+}
+
+static void ser_tx_set_intr(struct serial_device *dev, bool enabled)
+{
+   if (dev->tx_intr_on != enabled) {
+      serial_set_tx_intr(dev->ioport, enabled);
+      dev->tx_intr_on = enabled;
+   }
+}
+
+/*
+ * Move up to a FIFO worth of bytes from the TX ring buffer to the UART.
+ * Called with the interrupts disabled, once the TX FIFO is empty.
+ */
+static void ser_tx_fill_fifo(struct serial_device *dev)
+{
+   u8 c;
+
+   for (int i = 0; i < SERIAL_TX_FIFO_SIZE; i++) {
+
+      if (!ringbuf_read_elem1(&dev->tx_rb, &c))
+         break;
+
+      serial_tx_fifo_write(dev->ioport, (char)c);
+   }
+
+   if (ringbuf_is_empty(&dev->tx_rb))
+      ser_tx_set_intr(dev, false);
+}
+
+/* Busy-wait until everything in the TX ring buffer has been sent */
+static void ser_tx_flush_sync(struct serial_device *dev)
+{
+   while (!ringbuf_is_empty(&dev->tx_rb)) {
+      serial_wait_for_write(dev->ioport);
+      ser_tx_fill_fifo(dev);
+   }
+}
+
+static void ser_tx_bh_handler(void *ctx)
+{
+   struct serial_device *const dev = ctx;
+
+   dev->tx_signal_pending = false;
+   kcond_signal_all(&dev->tx_cond);
+}
+
+static bool ser_tx_handle_irq(struct serial_device *dev)
+{
+   if (!dev->tx_intr_on || !serial_write_ready(dev->ioport))
+      return false;
+
+   ser_tx_fill_fifo(dev);
+
+   if (dev->tx_signal_pending || in_panic())
+      return true;
+
+   if (ringbuf_get_elems(&dev->tx_rb) > SERIAL_TX_BUF_SIZE / 2)
+      return true; /* Let the writers wait for more space */
+
+   if (kcond_is_anyone_waiting(&dev->tx_cond)) {
+
+      /*
+       * We cannot signal a condition from an IRQ handler: do that in the
+       * worker thread. If the queue is full, the writers will wake up anyway
+       * because they wait with a timeout.
+       */
+      if (wth_enqueue_on(dev->wth, &ser_tx_bh_handler, dev))
+         dev->tx_signal_pending = true;
+   }
+
+   return true;
+}
+
+void serial_tx_write(u16 port, const char *buf, size_t len)
+{
+   struct serial_device *const dev = ser_get_dev(port);
+   size_t n;
+   ulong var;
+
+   if (!dev || !dev->tx_buf || UNLIKELY(in_panic())) {
+
+      if (dev && dev->tx_buf) {
+
+         /* In panic, the IRQs are off: send what's left in the ring first */
+         disable_interrupts(&var);
+         {
+            ser_tx_flush_sync(dev);
+         }
+         enable_interrupts(&var);
+      }
 
-      c = serial_read(p);
-      tty_send_keyevent(t, make_key_event(0, c, true), true);
+      for (size_t i = 0; i < len; i++)
+         serial_write(port, buf[i]);
+
+      return;
    }
 
-   dev->jobs_cnt--;
+   while (len > 0) {
+
+      disable_interrupts(&var);
+      {
+         n = ringbuf_write_bytes(&dev->tx_rb, (u8 *)buf, len);
+
+         /*
+          * Enabling the TX interrupt when the FIFO is already empty makes the
+          * UART fire it immediately, starting the transmission.
+          */
+         if (n > 0)
+            ser_tx_set_intr(dev, true);
+
+         /*
+          * The ring is full and we cannot sleep: busy-wait for a FIFO worth
+          * of space, as the old unbuffered code did for every byte.
+          */
+         if (!n && (!is_preemption_enabled() || in_irq())) {
+            serial_wait_for_write(port);
+            ser_tx_fill_fifo(dev);
+         }
+      }
+      enable_interrupts(&var);
+
+      buf += n;
+      len -= n;
+
+      if (!n && is_preemption_enabled() && !in_irq())
+         kcond_wait(&dev->tx_cond, NULL, TIME_SLICE_TICKS);
+   }
 }
 
 static enum irq_action serial_con_irq_handler(void *ctx)
 {
    struct serial_device *const dev = ctx;
+   const bool tx_handled = dev->tx_buf && ser_tx_handle_irq(dev);
 
-   if (!serial_read_ready(dev->ioport))
-      return IRQ_NOT_HANDLED; /* Not an IRQ from this "device" [irq sharing] */
+   if (!ser_rx_drain_fifo(dev)) {
 
-   if (dev->jobs_cnt >= 2)
-      return IRQ_HANDLED;
+      if (tx_handled)
+         return IRQ_HANDLED;
+
+      return IRQ_NOT_HANDLED; /* Not an IRQ from this "device" [irq sharing] */
+   }
 
    if (UNLIKELY(in_panic())) {
 
@@ -77,19 +268,25 @@ static enum irq_action serial_con_irq_handler(void *ctx)
       ulong val;
       disable_interrupts(&val);
       {
-         dev->jobs_cnt++;
-         ser_bh_handler(dev);
+         ser_rx_bh_handler(dev);
       }
       enable_interrupts(&val);
       return IRQ_HANDLED;
    }
 
-   if (!wth_enqueue_on(dev->wth, &ser_bh_handler, dev)) {
+   /*
+    * A job already enqueued will consume what we just wrote in the ring. If
+    * the queue is full, the data stays there until the next IRQ retries.
+    */
+   if (dev->rx_bh_pending)
+      return IRQ_HANDLED;
+
+   if (!wth_enqueue_on(dev->wth, &ser_rx_bh_handler, dev)) {
       printk("Serial: WARNING: hit job queue limit\n");
       return IRQ_HANDLED;
    }
 
-   dev->jobs_cnt++;
+   dev->rx_bh_pending = true;
    return IRQ_HANDLED;
 }
 
@@ -125,6 +322,18 @@ static void init_serial_comm(void)
 
       dev->tty = get_serial_tty((int)i);
       dev->wth = wth;
+      safe_ringbuf_init(&dev->rx_rb, SERIAL_RX_BUF_SIZE, 1, dev->rx_buf);
+
+      if (!serial_tx_intr_supported())
+         continue;
+
+      if (!(dev->tx_buf = kmalloc(SERIAL_TX_BUF_SIZE))) {
+         printk("Serial: no memory for the %s TX buffer\n", dev->name);
+         continue;
+      }
+
+      kcond_init(&dev->tx_cond);
+      ringbuf_init(&dev->tx_rb, SERIAL_TX_BUF_SIZE, 1, dev->tx_buf);
    }
 
    irq_install_handler(X86_PC_COM1_COM3_IRQ, &com1);
@@ -56,14 +56,19 @@ static void
 sterm_action_write(term *_t, const char *buf, size_t len)
 {
    struct sterm *const t = _t;
+   u32 s = 0;
 
+   /* Send the data in runs, translating each '\n' into "\r\n" */
    for (u32 i = 0; i < len; i++) {
 
-      if (buf[i] == '\n')
-         serial_write(t->serial_port_fwd, '\r');
-
-      serial_write(t->serial_port_fwd, buf[i]);
+      if (buf[i] == '\n') {
+         serial_tx_write(t->serial_port_fwd, buf + s, i - s);
+         serial_tx_write(t->serial_port_fwd, "\r\n", 2);
+         s = i + 1;
+      }
    }
+
+   serial_tx_write(t->serial_port_fwd, buf + s, len - s);
 }
 
 static ALWAYS_INLINE void
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* sysfs path: /boot */
+
+#define BOOT_MODULES_LINE_SZ                     64
+#define BOOT_TIMELINE_LINE_SZ                    80
+
+static offt
+boot_modules_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return (offt)(get_modules_count() + 1) * BOOT_MODULES_LINE_SZ;
+}
+
+/*
+ * One line per module, in order of initialization: name, start time and
+ * duration of its init() in microseconds, and "async" for the modules
+ * initialized concurrently with the others.
+ */
+static offt
+boot_modules_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   const ulong us = TS_SCALE / 1000000;
+   struct module *m;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (int i = 0; (m = get_module(i)) != NULL; i++) {
+
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%-12s %10lu %8lu%s\n",
+                      m->name,
+                      (ulong)(m->init_start / us),
+                      (ulong)(m->init_time / us),
+                      m->flags & MODULE_FL_ASYNC ? " async" : "");
+
+      if (tot >= sz)
+         return sz;
+   }
+
+   return tot;
+}
+
+static offt
+boot_timeline_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return (offt)(boot_trace_get_count() + 1) * BOOT_TIMELINE_LINE_SZ;
+}
+
+/*
+ * One line per boot step, in order of start: name, argument, start time since
+ * the CPU reset (so, the first step includes the firmware and the bootloader)
+ * and duration, both in microseconds.
+ */
+static offt
+boot_timeline_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   const struct boot_trace_event *e;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (int i = 0; (e = boot_trace_get_event(i)) != NULL; i++) {
+
+      const u64 dur = e->end > e->start ? e->end - e->start : 0;
+
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%-32s %-12s %12lu %10lu\n",
+                      e->name,
+                      e->arg ? e->arg : "-",
+                      (ulong)boot_trace_tsc_to_us(e->start),
+                      (ulong)boot_trace_tsc_to_us(dur));
+
+      if (tot >= sz)
+         return sz;
+   }
+
+   return tot;
+}
+
+static const struct sysobj_prop_type boot_modules_ptype = {
+   .get_buf_sz = &boot_modules_get_buf_sz,
+   .load = &boot_modules_load,
+};
+
+static const struct sysobj_prop_type boot_timeline_ptype = {
+   .get_buf_sz = &boot_timeline_get_buf_sz,
+   .load = &boot_timeline_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(modules, &boot_modules_ptype);
+DEF_STATIC_SYSOBJ_PROP(timeline, &boot_timeline_ptype);
+
+DEF_STATIC_SYSOBJ_TYPE(type_boot, &prop_modules, &prop_timeline, NULL);
+DEF_STATIC_SYSOBJ(obj_boot, &type_boot, NULL /* hooks */, NULL, NULL);
+
+void
+sysfs_create_boot_obj(void)
+{
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "boot", &obj_boot))
+      panic("sysfs: unable to register object 'boot'");
+}
@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/idle.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/lat_tracer.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* sysfs path: /cpu */
+
+#define CPU_IDLE_LINE_SZ                          96
+#define CPU_IRQS_LINE_SZ                         256
+#define CPU_LAT_ENTRY_SZ                         768
+#define CPU_TASKS_LINE_SZ                         80
+
+static offt
+cpu_idle_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return MAX_IDLE_STATES * CPU_IDLE_LINE_SZ;
+}
+
+/*
+ * One line per idle state, sorted by depth: name, exit latency and target
+ * residency in us, number of times entered and total residency in ms.
+ */
+static offt
+cpu_idle_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct idle_state states[MAX_IDLE_STATES];
+   offt tot = 0;
+   int n;
+
+   ASSERT(off == 0);
+   n = idle_get_states(states, MAX_IDLE_STATES);
+
+   for (int i = 0; i < n && tot < sz; i++) {
+
+      struct idle_state *s = &states[i];
+
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%-4s %8u %8u %12" PRIu64 " %12" PRIu64 "\n",
+                      s->name,
+                      s->exit_latency_us,
+                      s->target_residency_us,
+                      s->usage,
+                      s->time_ns / 1000000);
+   }
+
+   return MIN(tot, sz);
+}
+
+static const struct sysobj_prop_type cpu_idle_ptype = {
+   .get_buf_sz = &cpu_idle_get_buf_sz,
+   .load = &cpu_idle_load,
+};
+
+static offt
+cpu_irqs_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return IRQ_STATS_MAX_IRQS * CPU_IRQS_LINE_SZ;
+}
+
+static inline u64 cycles_to_us(u64 cycles)
+{
+   return tsc_to_ns(cycles) / 1000;
+}
+
+/*
+ * One line per IRQ fired at least once: IRQ number, count, max IRQs/sec,
+ * avg and max handling time in us, avg and max masked time in us, max
+ * nesting depth and then the IRQ_STATS_HIST_BUCKETS histogram counters.
+ */
+static offt
+cpu_irqs_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct irq_stats s;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (int i = 0; i < IRQ_STATS_MAX_IRQS && tot < sz; i++) {
+
+      if (!irq_get_stats(i, &s) || !s.count)
+         continue;
+
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%-3d %10u %6u %8" PRIu64 " %8" PRIu64
+                      " %8" PRIu64 " %8" PRIu64 " %3u",
+                      i,
+                      s.count,
+                      s.max_rate,
+                      cycles_to_us(s.tot_cycles / s.count),
+                      cycles_to_us(s.max_cycles),
+                      cycles_to_us(s.masked_tot_cycles / s.count),
+                      cycles_to_us(s.masked_max_cycles),
+                      s.max_depth);
+
+      for (int b = 0; b < IRQ_STATS_HIST_BUCKETS && tot < sz; b++)
+         tot += snprintk((char *)buf + tot,
+                         (size_t)(sz - tot),
+                         " %u", s.hist[b]);
+
+      if (tot < sz)
+         tot += snprintk((char *)buf + tot, (size_t)(sz - tot), "\n");
+   }
+
+   return MIN(tot, sz);
+}
+
+static const struct sysobj_prop_type cpu_irqs_ptype = {
+   .get_buf_sz = &cpu_irqs_get_buf_sz,
+   .load = &cpu_irqs_load,
+};
+
+struct cpu_tasks_load_ctx {
+
+   char *buf;
+   offt sz;
+   offt tot;
+};
+
+static int cpu_count_tasks_cb(void *obj, void *arg)
+{
+   (*(int *)arg)++;
+   return 0;
+}
+
+static offt
+cpu_tasks_get_buf_sz(struct sysobj *obj, void *data)
+{
+   int n = 0;
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&cpu_count_tasks_cb, &n);
+   }
+   enable_preemption();
+
+   /* Leave some room for the tasks created in the meanwhile */
+   return (offt)(n + 8) * CPU_TASKS_LINE_SZ;
+}
+
+static inline u64 timespec_to_us(struct k_timespec64 *ts)
+{
+   return (u64)ts->tv_sec * 1000000 + (u64)ts->tv_nsec / 1000;
+}
+
+static int cpu_tasks_load_cb(void *obj, void *arg)
+{
+   static const char state_chars[] = {
+      [TASK_STATE_INVALID] = '?',
+      [TASK_STATE_RUNNABLE] = 'r',
+      [TASK_STATE_RUNNING] = 'R',
+      [TASK_STATE_SLEEPING] = 'S',
+      [TASK_STATE_ZOMBIE] = 'Z',
+   };
+
+   struct cpu_tasks_load_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+   struct k_timespec64 ut, st;
+   const char *name;
+
+   if (ti->tid == KERNEL_TID_START || ctx->tot >= ctx->sz)
+      return 0;
+
+   if (is_kernel_thread(ti))
+      name = ti->kthread_name;
+   else
+      name = pi->debug_cmdline ? pi->debug_cmdline : "<n/a>";
+
+   task_get_cputime(ti, &ut, &st);
+
+   ctx->tot += snprintk(ctx->buf + ctx->tot,
+                        (size_t)(ctx->sz - ctx->tot),
+                        "%-5d %-5d %c %12" PRIu64 " %12" PRIu64 " %.40s\n",
+                        ti->tid,
+                        pi->pid,
+                        ti->stopped ? 'T' : state_chars[ti->state],
+                        timespec_to_us(&ut),
+                        timespec_to_us(&st),
+                        name);
+   return 0;
+}
+
+/*
+ * One line per task, kernel threads included: tid, pid, state, the CPU time
+ * spent in user and kernel mode in us and the name (the command line for the
+ * user processes). Monitoring apps compute the CPU usage from the deltas.
+ */
+static offt
+cpu_tasks_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct cpu_tasks_load_ctx ctx = { .buf = buf, .sz = sz };
+
+   ASSERT(off == 0);
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&cpu_tasks_load_cb, &ctx);
+   }
+   enable_preemption();
+
+   return MIN(ctx.tot, sz);
+}
+
+static const struct sysobj_prop_type cpu_tasks_ptype = {
+   .get_buf_sz = &cpu_tasks_get_buf_sz,
+   .load = &cpu_tasks_load,
+};
+
+enum cpu_sched_num {
+   CPU_SCHED_CTX_SWITCHES,
+   CPU_SCHED_RQ_LEN,
+};
+
+static u64
+cpu_sched_get_num(struct sysobj *obj, void *data)
+{
+   struct sched_global_stats gs;
+   sched_get_global_stats(&gs);
+
+   switch ((enum cpu_sched_num)(ulong)data) {
+
+      case CPU_SCHED_CTX_SWITCHES:
+         return gs.nvcsw + gs.nivcsw;
+
+      case CPU_SCHED_RQ_LEN:
+         return (u64)gs.rq_len;
+   }
+
+   return 0;
+}
+
+static offt
+cpu_sched_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)sz, "%" PRIu64 "\n",
+                   cpu_sched_get_num(obj, data));
+}
+
+/* Scheduler counters, also part of /cpu/.snapshot */
+static const struct sysobj_prop_type cpu_sched_ptype = {
+   .load = &cpu_sched_load,
+   .get_num = &cpu_sched_get_num,
+};
+
+#if LATENCY_TRACER
+
+static offt
+cpu_lat_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return LAT_TRACE_KINDS * LAT_TRACE_MAX_ENTRIES * CPU_LAT_ENTRY_SZ;
+}
+
+static offt
+cpu_lat_dump_stack(char *buf, offt sz, const char *label,
+                   struct lat_trace_stack *st)
+{
+   offt tot = snprintk(buf, (size_t)sz, "   %s:", label);
+   const char *sym;
+   long off;
+
+   for (u32 i = 0; i < st->nframes && tot < sz; i++) {
+
+      sym = find_sym_at_addr_safe((ulong)st->frames[i], &off, NULL);
+
+      if (sym)
+         tot += snprintk(buf + tot, (size_t)(sz - tot), " %s+%ld", sym, off);
+      else
+         tot += snprintk(buf + tot, (size_t)(sz - tot), " %p", st->frames[i]);
+   }
+
+   if (tot < sz)
+      tot += snprintk(buf + tot, (size_t)(sz - tot), "\n");
+
+   return tot;
+}
+
+/*
+ * For each kind, the longest intervals: duration in us, tid of the task at
+ * the beginning and then the two stacks, innermost frame first.
+ */
+static offt
+cpu_lat_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct lat_trace_entry entries[LAT_TRACE_MAX_ENTRIES];
+   char *p = buf;
+   offt tot = 0;
+   int n;
+
+   ASSERT(off == 0);
+
+   for (int k = 0; k < LAT_TRACE_KINDS && tot < sz; k++) {
+
+      n = lat_trace_get_entries(k, entries, ARRAY_SIZE(entries));
+
+      for (int i = 0; i < n && tot < sz; i++) {
+
+         struct lat_trace_entry *e = &entries[i];
+
+         tot += snprintk(p + tot,
+                         (size_t)(sz - tot),
+                         "%s %" PRIu64 " us tid %d\n",
+                         lat_trace_kind_names[k],
+                         tsc_to_ns(e->cycles) / 1000,
+                         e->tid);
+
+         if (tot < sz)
+            tot += cpu_lat_dump_stack(p + tot, sz - tot, "start", &e->start);
+
+         if (tot < sz)
+            tot += cpu_lat_dump_stack(p + tot, sz - tot, "end", &e->end);
+      }
+   }
+
+   return MIN(tot, sz);
+}
+
+/* Writing anything resets the tracer */
+static offt
+cpu_lat_store(struct sysobj *obj, void *data, void *buf, offt sz)
+{
+   lat_trace_reset();
+   return sz;
+}
+
+static const struct sysobj_prop_type cpu_lat_ptype = {
+   .get_buf_sz = &cpu_lat_get_buf_sz,
+   .load = &cpu_lat_load,
+   .store = &cpu_lat_store,
+};
+
+DEF_STATIC_SYSOBJ_PROP(latency, &cpu_lat_ptype);
+#define PROP_LATENCY    &prop_latency,
+
+#else
+
+#define PROP_LATENCY
+
+#endif // LATENCY_TRACER
+
+DEF_STATIC_SYSOBJ_PROP(idle, &cpu_idle_ptype);
+DEF_STATIC_SYSOBJ_PROP(irqs, &cpu_irqs_ptype);
+DEF_STATIC_SYSOBJ_PROP(tasks, &cpu_tasks_ptype);
+DEF_STATIC_SYSOBJ_PROP(ctx_switches, &cpu_sched_ptype);
+DEF_STATIC_SYSOBJ_PROP(rq_len, &cpu_sched_ptype);
+
+DEF_STATIC_SYSOBJ_TYPE(type_cpu,
+                       &prop_idle,
+                       &prop_irqs,
+                       &prop_tasks,
+                       &prop_ctx_switches,
+                       &prop_rq_len,
+                       PROP_LATENCY
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_cpu,
+                  &type_cpu,
+                  NULL /* hooks */,
+                  NULL,
+                  NULL,
+                  NULL,
+                  TO_PTR(CPU_SCHED_CTX_SWITCHES),
+                  TO_PTR(CPU_SCHED_RQ_LEN),
+                  NULL);
+
+void
+sysfs_create_cpu_obj(void)
+{
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "cpu", &obj_cpu))
+      panic("sysfs: unable to register object 'cpu'");
+}
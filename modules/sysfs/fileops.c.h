@@ -158,6 +158,25 @@ sysfs_fsync(fs_handle h)
    return 0;
 }
 
+/*
+ * Reading the file from its beginning acknowledges the sysfs_notify() calls
+ * made so far. If the content has changed since the per-handle buffer was
+ * loaded, drop the buffer: the read below will load it again.
+ */
+static void
+sysfs_ack_notify(struct sysfs_handle *sh)
+{
+   const u32 seq = sh->inode->file.notify_seq;
+
+   if (sh->file.seen_seq == seq)
+      return;
+
+   sh->file.seen_seq = seq;
+
+   if (sh->file.data && !list_is_node_in_list(&sh->file.dirty_node))
+      sysfs_free_data(sh);
+}
+
 static ssize_t
 sysfs_file_read(fs_handle h, char *buf, size_t len, offt *pos)
 {
@@ -171,6 +190,19 @@ sysfs_file_read(fs_handle h, char *buf, size_t len, offt *pos)
    if (!prop->type || !prop->type->load)
       return 0;
 
+   if (*pos == 0) {
+
+      sysfs_ack_notify(sh);
+
+      /*
+       * Reading a read-only table again from the beginning gets fresh data,
+       * like on Linux: monitoring apps can keep the file open and just
+       * pread() it at offset 0, instead of re-opening it every time.
+       */
+      if (sh->file.data && !prop->type->store)
+         sysfs_free_data(sh);
+   }
+
    if (LIKELY(sh->file.data_max_len == 0)) {
 
       if (*pos == 0) {
@@ -405,6 +437,24 @@ int sysfs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
    return generic_fs_munmap(um, vaddrp, len);
 }
 
+static int
+sysfs_file_except_ready(fs_handle h)
+{
+   struct sysfs_handle *sh = h;
+
+   if (sh->file.seen_seq != sh->inode->file.notify_seq)
+      return POLLPRI | POLLERR;    /* like Linux's sysfs_notify() */
+
+   return 0;
+}
+
+static struct kcond *
+sysfs_file_get_except_cond(fs_handle h)
+{
+   struct sysfs_handle *sh = h;
+   return &sh->inode->file.notify_cond;
+}
+
 static const struct file_ops static_ops_file_sysfs =
 {
    .read = sysfs_file_read,
@@ -415,6 +465,8 @@ static const struct file_ops static_ops_file_sysfs =
    .munmap = sysfs_munmap,
    .sync = sysfs_fsync,
    .datasync = sysfs_fsync,
+   .except_ready = sysfs_file_except_ready,
+   .get_except_cond = sysfs_file_get_except_cond,
 };
 
 static int
@@ -439,6 +491,7 @@ sysfs_open_file(struct mnt_fs *fs, struct sysfs_inode *pos, fs_handle *out)
    h->file.data_max_len = buf_sz;
    h->spec_flags = VFS_SPFL_NO_LF;
    h->inode = pos;
+   h->file.seen_seq = pos->file.notify_seq;
    list_node_init(&h->file.dirty_node);
    retain_obj(pos);
 
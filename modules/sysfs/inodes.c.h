@@ -74,6 +74,7 @@ sysfs_create_inode_file(struct sysfs_data *d,
 
    i->type = VFS_FILE;
    i->file.obj = obj;
+   kcond_init(&i->file.notify_cond);
 
    if (obj->type) {
       i->file.prop = obj->type->properties[prop_idx];
@@ -0,0 +1,456 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/zram.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/lazyfree.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* sysfs path: /mm */
+
+#define MM_PROCS_LINE_SZ                         96
+
+struct mm_procs_load_ctx {
+
+   char *buf;
+   offt sz;
+   offt tot;
+};
+
+static int mm_count_procs_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+
+   if (!is_kernel_thread(ti) && ti->is_main_thread)
+      (*(int *)arg)++;
+
+   return 0;
+}
+
+static offt
+mm_procs_get_buf_sz(struct sysobj *obj, void *data)
+{
+   int n = 0;
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&mm_count_procs_cb, &n);
+   }
+   enable_preemption();
+
+   /* Leave some room for the processes created in the meanwhile */
+   return (offt)(n + 8) * MM_PROCS_LINE_SZ;
+}
+
+static int mm_procs_load_cb(void *obj, void *arg)
+{
+   struct mm_procs_load_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct process *pi = ti->pi;
+   size_t vsz, rss;
+   char lim[24] = "unlimited";
+
+   if (is_kernel_thread(ti) || !ti->is_main_thread)
+      return 0;
+
+   if (ti->state == TASK_STATE_ZOMBIE || ctx->tot >= ctx->sz)
+      return 0;
+
+   process_get_mem_usage(pi, &vsz, &rss);
+
+   if (pi->as_limit_cur != K_RLIM_INFINITY)
+      snprintk(lim, sizeof(lim), "%lu", pi->as_limit_cur / KB);
+
+   ctx->tot += snprintk(ctx->buf + ctx->tot,
+                        (size_t)(ctx->sz - ctx->tot),
+                        "%-5d %10lu %10lu %10s %s\n",
+                        pi->pid,
+                        (ulong)(vsz << PAGE_SHIFT) / KB,
+                        (ulong)(rss << PAGE_SHIFT) / KB,
+                        lim,
+                        pi->debug_cmdline ? pi->debug_cmdline : "<n/a>");
+   return 0;
+}
+
+/*
+ * One line per user process: pid, virtual size and resident set size in KB,
+ * the RLIMIT_AS soft limit in KB and the command line. Zombies are skipped.
+ */
+static offt
+mm_procs_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct mm_procs_load_ctx ctx = { .buf = buf, .sz = sz };
+
+   ASSERT(off == 0);
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&mm_procs_load_cb, &ctx);
+   }
+   enable_preemption();
+
+   return MIN(ctx.tot, sz);
+}
+
+static const struct sysobj_prop_type mm_procs_ptype = {
+   .get_buf_sz = &mm_procs_get_buf_sz,
+   .load = &mm_procs_load,
+};
+
+#define MM_ZRAM_BUF_SZ                          512
+
+static offt
+mm_zram_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return MM_ZRAM_BUF_SZ;
+}
+
+/* The counters of the compressed swap in RAM: see kernel/mm/zram.c */
+static offt
+mm_zram_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct zram_stats s;
+   int rc;
+
+   ASSERT(off == 0);
+   zram_get_stats(&s);
+
+   rc = snprintk(buf, (size_t)sz,
+                 "slots          %zu\n"
+                 "stored         %zu\n"
+                 "compr_kb       %zu\n"
+                 "pool_kb        %zu\n"
+                 "max_pool_kb    %zu\n"
+                 "swap_outs      %" PRIu64 "\n"
+                 "swap_ins       %" PRIu64 "\n"
+                 "rejected       %" PRIu64 "\n"
+                 "scans          %" PRIu64 "\n",
+                 s.slots,
+                 s.stored,
+                 s.compr_bytes / KB,
+                 (s.pool_pages << PAGE_SHIFT) / KB,
+                 (s.max_pool_pages << PAGE_SHIFT) / KB,
+                 s.swap_outs,
+                 s.swap_ins,
+                 s.rejected,
+                 s.scans);
+
+   return MIN((offt)rc, sz);
+}
+
+static const struct sysobj_prop_type mm_zram_ptype = {
+   .get_buf_sz = &mm_zram_get_buf_sz,
+   .load = &mm_zram_load,
+};
+
+#define MM_KSM_BUF_SZ                           256
+
+static offt
+mm_ksm_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return MM_KSM_BUF_SZ;
+}
+
+/* The counters of the same-page merging: see kernel/mm/ksm.c */
+static offt
+mm_ksm_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct ksm_stats s;
+   int rc;
+
+   ASSERT(off == 0);
+   ksm_get_stats(&s);
+
+   rc = snprintk(buf, (size_t)sz,
+                 "scans          %" PRIu64 "\n"
+                 "hashed         %" PRIu64 "\n"
+                 "merged         %" PRIu64 "\n"
+                 "zero_merged    %" PRIu64 "\n",
+                 s.scans,
+                 s.hashed,
+                 s.merged,
+                 s.zero_merged);
+
+   return MIN((offt)rc, sz);
+}
+
+static const struct sysobj_prop_type mm_ksm_ptype = {
+   .get_buf_sz = &mm_ksm_get_buf_sz,
+   .load = &mm_ksm_load,
+};
+
+#define MM_LAZYFREE_BUF_SZ                      128
+
+static offt
+mm_lazyfree_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return MM_LAZYFREE_BUF_SZ;
+}
+
+/* The counters of the MADV_FREE-ed pages: see kernel/mm/lazyfree.c */
+static offt
+mm_lazyfree_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct lazyfree_stats s;
+   int rc;
+
+   ASSERT(off == 0);
+   lazyfree_get_stats(&s);
+
+   rc = snprintk(buf, (size_t)sz,
+                 "marked         %" PRIu64 "\n"
+                 "dropped        %" PRIu64 "\n"
+                 "scans          %" PRIu64 "\n",
+                 s.marked,
+                 s.dropped,
+                 s.scans);
+
+   return MIN((offt)rc, sz);
+}
+
+static const struct sysobj_prop_type mm_lazyfree_ptype = {
+   .get_buf_sz = &mm_lazyfree_get_buf_sz,
+   .load = &mm_lazyfree_load,
+};
+
+#define MM_KMALLOC_BUF_SZ                       128
+
+static u32 low_mem_events;
+
+static offt
+mm_kmalloc_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return MM_KMALLOC_BUF_SZ;
+}
+
+static void mm_get_kmalloc_kb(ulong *tot_kb, ulong *used_kb)
+{
+   struct debug_kmalloc_heap_info hi;
+
+   *tot_kb = *used_kb = 0;
+
+   disable_preemption();
+   {
+      for (int i = 0; i < KMALLOC_HEAPS_COUNT; i++) {
+
+         if (!debug_kmalloc_get_heap_info(i, &hi))
+            break;
+
+         *tot_kb += hi.size / KB;
+         *used_kb += hi.mem_allocated / KB;
+      }
+   }
+   enable_preemption();
+}
+
+/* The memory of the kmalloc heaps and the low-memory events so far */
+static offt
+mm_kmalloc_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   ulong tot_kb, used_kb;
+   int rc;
+
+   ASSERT(off == 0);
+   mm_get_kmalloc_kb(&tot_kb, &used_kb);
+
+   rc = snprintk(buf, (size_t)sz,
+                 "heaps_kb       %lu\n"
+                 "used_kb        %lu\n"
+                 "low_mem        %u\n",
+                 tot_kb,
+                 used_kb,
+                 low_mem_events);
+
+   return MIN((offt)rc, sz);
+}
+
+static const struct sysobj_prop_type mm_kmalloc_ptype = {
+   .get_buf_sz = &mm_kmalloc_get_buf_sz,
+   .load = &mm_kmalloc_load,
+};
+
+enum mm_kmalloc_num {
+   MM_KMALLOC_HEAPS_KB,
+   MM_KMALLOC_USED_KB,
+   MM_KMALLOC_LOW_MEM,
+};
+
+static u64
+mm_kmalloc_get_num(struct sysobj *obj, void *data)
+{
+   ulong tot_kb, used_kb;
+
+   switch ((enum mm_kmalloc_num)(ulong)data) {
+
+      case MM_KMALLOC_HEAPS_KB:
+         mm_get_kmalloc_kb(&tot_kb, &used_kb);
+         return tot_kb;
+
+      case MM_KMALLOC_USED_KB:
+         mm_get_kmalloc_kb(&tot_kb, &used_kb);
+         return used_kb;
+
+      case MM_KMALLOC_LOW_MEM:
+         return low_mem_events;
+   }
+
+   return 0;
+}
+
+static offt
+mm_kmalloc_num_load(struct sysobj *obj,
+                    void *data,
+                    void *buf,
+                    offt sz,
+                    offt off)
+{
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)sz, "%" PRIu64 "\n",
+                   mm_kmalloc_get_num(obj, data));
+}
+
+/*
+ * The same values of /mm/kmalloc, one per file: being numeric, they make
+ * /mm/.snapshot available to the monitoring apps.
+ */
+static const struct sysobj_prop_type mm_kmalloc_num_ptype = {
+   .load = &mm_kmalloc_num_load,
+   .get_num = &mm_kmalloc_get_num,
+};
+
+#define MM_KLEAKS_LINE_SZ                        96
+
+static offt
+mm_kleaks_get_buf_sz(struct sysobj *obj, void *data)
+{
+   u32 used, dropped;
+   debug_kmalloc_get_samples_stats(&used, &dropped);
+
+   /* Leave some room for the blocks sampled in the meanwhile */
+   return (offt)(used + 16) * MM_KLEAKS_LINE_SZ;
+}
+
+/*
+ * The sampled kmalloc() blocks (see -kmalloc_sample) still alive after at
+ * least KMALLOC_SAMPLE_OLD_SEC seconds, one per line: address, size in bytes,
+ * age in seconds and call site. Likely leaks, if the count keeps growing.
+ */
+static offt
+mm_kleaks_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   const u64 now = get_ticks();
+   struct debug_kmalloc_sample_info si;
+   const char *sym;
+   char site[64];
+   offt tot = 0;
+   long sym_off;
+   u64 age;
+
+   ASSERT(off == 0);
+
+   for (int i = 0; debug_kmalloc_get_sample(i, &si); i++) {
+
+      if (!si.ptr)
+         continue;
+
+      age = (now - si.ticks) / TIMER_HZ;
+
+      if (age < KMALLOC_SAMPLE_OLD_SEC)
+         continue;
+
+      if ((sym = find_sym_at_addr(si.caller, &sym_off, NULL)))
+         snprintk(site, sizeof(site), "%s+%ld", sym, sym_off);
+      else
+         snprintk(site, sizeof(site), "%p", TO_PTR(si.caller));
+
+      tot += snprintk((char *)buf + tot,
+                      (size_t)(sz - tot),
+                      "%p %8u %8lu %s\n",
+                      TO_PTR(si.ptr),
+                      si.size,
+                      (ulong)age,
+                      site);
+
+      if (tot >= sz)
+         return sz;
+   }
+
+   return tot;
+}
+
+static const struct sysobj_prop_type mm_kleaks_ptype = {
+   .get_buf_sz = &mm_kleaks_get_buf_sz,
+   .load = &mm_kleaks_load,
+};
+
+DEF_STATIC_SYSOBJ_PROP(processes, &mm_procs_ptype);
+DEF_STATIC_SYSOBJ_PROP(zram, &mm_zram_ptype);
+DEF_STATIC_SYSOBJ_PROP(ksm, &mm_ksm_ptype);
+DEF_STATIC_SYSOBJ_PROP(lazyfree, &mm_lazyfree_ptype);
+DEF_STATIC_SYSOBJ_PROP(kmalloc, &mm_kmalloc_ptype);
+DEF_STATIC_SYSOBJ_PROP(kmalloc_leaks, &mm_kleaks_ptype);
+DEF_STATIC_SYSOBJ_PROP(heaps_kb, &mm_kmalloc_num_ptype);
+DEF_STATIC_SYSOBJ_PROP(used_kb, &mm_kmalloc_num_ptype);
+DEF_STATIC_SYSOBJ_PROP(low_mem, &mm_kmalloc_num_ptype);
+
+DEF_STATIC_SYSOBJ_TYPE(type_mm,
+                       &prop_processes,
+                       &prop_zram,
+                       &prop_ksm,
+                       &prop_lazyfree,
+                       &prop_kmalloc,
+                       &prop_kmalloc_leaks,
+                       &prop_heaps_kb,
+                       &prop_used_kb,
+                       &prop_low_mem,
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_mm,
+                  &type_mm,
+                  NULL /* hooks */,
+                  NULL,
+                  NULL,
+                  NULL,
+                  NULL,
+                  NULL,
+                  NULL,
+                  TO_PTR(MM_KMALLOC_HEAPS_KB),
+                  TO_PTR(MM_KMALLOC_USED_KB),
+                  TO_PTR(MM_KMALLOC_LOW_MEM));
+
+/*
+ * Not a real shrinker: it never frees anything. It just lets the monitoring
+ * apps poll()-ing the /mm files know about the memory pressure. Registered
+ * after the kernel's shrinkers (zram, ksm, ...), it's called only when they
+ * couldn't free enough memory.
+ */
+static size_t mm_low_mem_notify(struct shrinker *s, size_t bytes)
+{
+   low_mem_events++;
+   sysfs_notify(&obj_mm, NULL);
+   return 0;
+}
+
+static struct shrinker mm_notify_shrinker = {
+   .name = "sysfs_mm",
+   .shrink = &mm_low_mem_notify,
+};
+
+void
+sysfs_create_mm_obj(void)
+{
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "mm", &obj_mm))
+      panic("sysfs: unable to register object 'mm'");
+
+   register_shrinker(&mm_notify_shrinker);
+}
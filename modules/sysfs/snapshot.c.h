@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/tilck_sysfs.h>
+
+/*
+ * The binary snapshot of an object: all of its numeric properties, loaded
+ * directly into the reader's buffer, without any formatting or allocation.
+ * See tilck_sysfs.h for the layout.
+ */
+
+static u32
+sysfs_snapshot_count(struct sysobj *obj)
+{
+   struct sysobj_prop **ptr;
+   u32 cnt = 0;
+
+   for (ptr = &obj->type->properties[0]; *ptr != NULL; ptr++) {
+      if ((*ptr)->type && (*ptr)->type->get_num)
+         cnt++;
+   }
+
+   return cnt;
+}
+
+static offt
+sysfs_snapshot_load(struct sysobj *obj,
+                    void *data,
+                    void *buf,
+                    offt buf_sz,
+                    offt off)
+{
+   struct tilck_sysfs_snap *s = buf;
+   void **prop_data_arr = obj->prop_data;
+   const struct sysobj_prop_type *pt;
+   struct sysobj_prop **ptr;
+   u32 cnt = sysfs_snapshot_count(obj);
+   int idx = 0;
+
+   if (buf_sz < (offt)(sizeof(*s) + cnt * sizeof(s->values[0])))
+      return -EINVAL;
+
+   s->magic = TILCK_SYSFS_SNAPSHOT_MAGIC;
+   s->count = 0;
+
+   for (ptr = &obj->type->properties[0]; *ptr != NULL; ptr++, idx++) {
+
+      pt = (*ptr)->type;
+
+      if (pt && pt->get_num)
+         s->values[s->count++] = pt->get_num(obj, prop_data_arr[idx]);
+   }
+
+   return (offt)(sizeof(*s) + s->count * sizeof(s->values[0]));
+}
+
+static const struct sysobj_prop_type sysfs_snapshot_ptype = {
+   .load = &sysfs_snapshot_load,
+};
+
+static struct sysobj_prop sysfs_snapshot_prop = {
+   .name = TILCK_SYSFS_SNAPSHOT_NAME,
+   .type = &sysfs_snapshot_ptype,
+};
+
+static int
+sysfs_create_snapshot_file(struct mnt_fs *fs, struct sysobj *obj)
+{
+   struct sysfs_inode *i;
+
+   if (!sysfs_snapshot_count(obj))
+      return 0;
+
+   if (!(i = sysfs_new_inode(fs->device_data)))
+      return -ENOMEM;
+
+   i->type = VFS_FILE;
+   i->file.obj = obj;
+   i->file.prop = &sysfs_snapshot_prop;
+   i->file.prop_data = NULL;
+   kcond_init(&i->file.notify_cond);
+
+   /* NOTE: like for the other files, don't rollback on failure */
+   return sysfs_dir_add_entry(obj->inode, TILCK_SYSFS_SNAPSHOT_NAME, i, NULL);
+}
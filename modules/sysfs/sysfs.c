@@ -22,9 +22,14 @@
 #include "dirops.c.h"
 #include "fileops.c.h"
 #include "types.c.h"
+#include "snapshot.c.h"
 #include "lock_and_retain.c.h"
 
 void sysfs_create_config_obj(void);
+void sysfs_create_vfs_obj(void);
+void sysfs_create_boot_obj(void);
+void sysfs_create_mm_obj(void);
+void sysfs_create_cpu_obj(void);
 static struct mnt_fs *sysfs;
 
 static int
@@ -421,7 +426,7 @@ sysfs_create_files_for_obj(struct mnt_fs *fs, struct sysobj *obj)
          return rc; /* NOTE: don't rollback everything */
    }
 
-   return 0;
+   return sysfs_create_snapshot_file(fs, obj);
 }
 
 void
@@ -495,6 +500,39 @@ sysfs_register_obj(struct mnt_fs *fs,
    return sysfs_create_files_for_obj(fs, obj);
 }
 
+void
+sysfs_notify(struct sysobj *obj, struct sysobj_prop *prop)
+{
+   struct sysfs_inode *idir = obj->inode;
+   struct sysfs_entry *e;
+   struct sysfs_inode *i;
+
+   if (!idir)
+      return;     /* Not registered, nobody can be polling its files */
+
+   disable_preemption();
+   {
+      list_for_each_ro(e, &idir->dir.entries_list, lnode) {
+
+         i = e->inode;
+
+         if (i->type != VFS_FILE)
+            continue;   /* Skip ".", "..", the children and the symlinks */
+
+         /* The snapshot contains all the properties: it changes as well */
+         if (prop && i->file.prop != prop &&
+             i->file.prop != &sysfs_snapshot_prop)
+         {
+            continue;
+         }
+
+         i->file.notify_seq++;
+         kcond_signal_all(&i->file.notify_cond);
+      }
+   }
+   enable_preemption();
+}
+
 struct symlink_tmp {
 
    char path[MAX_PATH];
@@ -756,6 +794,10 @@ init_sysfs(void)
       panic("Unable to create default objects");
 
    sysfs_create_config_obj();
+   sysfs_create_vfs_obj();
+   sysfs_create_boot_obj();
+   sysfs_create_mm_obj();
+   sysfs_create_cpu_obj();
 }
 
 static struct module sysfs_module = {
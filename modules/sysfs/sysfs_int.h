@@ -39,6 +39,8 @@ struct sysfs_inode {
          struct sysobj *obj;
          struct sysobj_prop *prop;
          void *prop_data;
+         struct kcond notify_cond;  /* signaled by sysfs_notify() */
+         u32 notify_seq;            /* number of sysfs_notify() calls */
 
       } file;
 
@@ -86,6 +88,7 @@ struct sysfs_handle {
          offt data_len;
          offt data_max_len;
          struct list_node dirty_node;
+         u32 seen_seq;              /* `notify_seq` at the last load */
 
       } file;
 
@@ -34,8 +34,15 @@ sysfs_ulong_literal_load(struct sysobj *obj,
    return snprintk(buf, (size_t)buf_sz, "%lu\n", (ulong)data);
 }
 
+static u64
+sysfs_ulong_literal_get_num(struct sysobj *obj, void *data)
+{
+   return (ulong)data;
+}
+
 const struct sysobj_prop_type sysobj_ptype_ro_ulong_literal = {
-   .load = &sysfs_ulong_literal_load
+   .load = &sysfs_ulong_literal_load,
+   .get_num = &sysfs_ulong_literal_get_num,
 };
 
 /*                literal ulong_hex             */
@@ -52,7 +59,8 @@ sysfs_ulong_hex_literal_load(struct sysobj *obj,
 }
 
 const struct sysobj_prop_type sysobj_ptype_ro_ulong_hex_literal = {
-   .load = &sysfs_ulong_hex_literal_load
+   .load = &sysfs_ulong_hex_literal_load,
+   .get_num = &sysfs_ulong_literal_get_num,
 };
 
 /*                ulong             */
@@ -93,13 +101,21 @@ sysfs_ulong_store(struct sysobj *obj,
    return buf_sz;
 }
 
+static u64
+sysfs_ulong_get_num(struct sysobj *obj, void *data)
+{
+   return *(ulong *)data;
+}
+
 const struct sysobj_prop_type sysobj_ptype_rw_ulong = {
    .load = &sysfs_ulong_load,
    .store = &sysfs_ulong_store,
+   .get_num = &sysfs_ulong_get_num,
 };
 
 const struct sysobj_prop_type sysobj_ptype_ro_ulong = {
    .load = &sysfs_ulong_load,
+   .get_num = &sysfs_ulong_get_num,
 };
 
 
@@ -141,14 +157,22 @@ sysfs_long_store(struct sysobj *obj,
    return buf_sz;
 }
 
+static u64
+sysfs_long_get_num(struct sysobj *obj, void *data)
+{
+   return (u64)(s64)*(long *)data;
+}
+
 const struct sysobj_prop_type sysobj_ptype_rw_long = {
    .load = &sysfs_long_load,
    .store = &sysfs_long_store,
+   .get_num = &sysfs_long_get_num,
 };
 
 const struct sysobj_prop_type sysobj_ptype_ro_long = {
    .load = &sysfs_long_load,
    .store = NULL,
+   .get_num = &sysfs_long_get_num,
 };
 
 /*               bool             */
@@ -172,7 +196,7 @@ sysfs_bool_store(struct sysobj *obj,
 {
    char *s = buf;
 
-   if (s[0] == '0' || s[1] == '1') {
+   if (s[0] == '0' || s[0] == '1') {
       if (!s[1] || s[1] == '\n' || s[1] == '\r') {
          *(bool *)data = s[0] - '0';
       }
@@ -181,13 +205,21 @@ sysfs_bool_store(struct sysobj *obj,
    return buf_sz;
 }
 
+static u64
+sysfs_bool_get_num(struct sysobj *obj, void *data)
+{
+   return *(bool *)data;
+}
+
 const struct sysobj_prop_type sysobj_ptype_rw_bool = {
    .load = &sysfs_bool_load,
    .store = &sysfs_bool_store,
+   .get_num = &sysfs_bool_get_num,
 };
 
 const struct sysobj_prop_type sysobj_ptype_ro_bool = {
    .load = &sysfs_bool_load,
+   .get_num = &sysfs_bool_get_num,
 };
 
 
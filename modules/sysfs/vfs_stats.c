@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/pipe.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* sysfs path: /vfs/dcache */
+
+DEF_STATIC_SYSOBJ_PROP(hits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(neg_hits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(misses, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(invalidations, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(evictions, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(entries, &sysobj_ptype_ro_ulong);
+
+DEF_STATIC_SYSOBJ_TYPE(
+   type_dcache,
+   &prop_hits,
+   &prop_neg_hits,
+   &prop_misses,
+   &prop_invalidations,
+   &prop_evictions,
+   &prop_entries,
+   NULL
+);
+
+DEF_STATIC_SYSOBJ(
+   obj_dcache,
+   &type_dcache,
+   NULL /* hooks */,
+   &vfs_dcache_stats.hits,
+   &vfs_dcache_stats.neg_hits,
+   &vfs_dcache_stats.misses,
+   &vfs_dcache_stats.invalidations,
+   &vfs_dcache_stats.evictions,
+   &vfs_dcache_stats.entries,
+);
+
+/* sysfs path: /vfs/pipes */
+
+DEF_STATIC_SYSOBJ_PROP(bytes_read, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(bytes_written, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(reads, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(writes, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(read_waits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(write_waits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(resizes, &sysobj_ptype_ro_ulong);
+
+DEF_STATIC_SYSOBJ_TYPE(
+   type_pipes,
+   &prop_bytes_read,
+   &prop_bytes_written,
+   &prop_reads,
+   &prop_writes,
+   &prop_read_waits,
+   &prop_write_waits,
+   &prop_resizes,
+   NULL
+);
+
+DEF_STATIC_SYSOBJ(
+   obj_pipes,
+   &type_pipes,
+   NULL /* hooks */,
+   &pipe_stats.bytes_read,
+   &pipe_stats.bytes_written,
+   &pipe_stats.reads,
+   &pipe_stats.writes,
+   &pipe_stats.read_waits,
+   &pipe_stats.write_waits,
+   &pipe_stats.resizes,
+);
+
+void
+sysfs_create_vfs_obj(void)
+{
+   struct sysobj *obj_vfs;
+
+   if (!(obj_vfs = sysfs_create_empty_obj()))
+      panic("sysfs: unable to create the 'vfs' object");
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "vfs", obj_vfs))
+      panic("sysfs: unable to register object 'vfs'");
+
+   if (sysfs_register_obj(NULL, obj_vfs, "dcache", &obj_dcache))
+      panic("sysfs: unable to register object 'dcache'");
+
+   if (sysfs_register_obj(NULL, obj_vfs, "pipes", &obj_pipes))
+      panic("sysfs: unable to register object 'pipes'");
+}
@@ -0,0 +1,415 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/mods/tracing.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+#include "tracing_int.h"
+
+#define PROF_COMM_LEN                           16
+#define PROF_LINE_SZ                           512
+
+/*
+ * Average size of a folded line, used to size the buffer of the `folded`
+ * file: in the unlikely case all the samples are different and have very
+ * long symbol names, the output just gets truncated.
+ */
+#define PROF_AVG_LINE_SZ                       128
+
+struct prof_sample {
+
+   u16 nframes;
+   bool user;
+   char comm[PROF_COMM_LEN];
+   void *frames[PROF_MAX_FRAMES];      /* frames[0] is the interrupted IP */
+};
+
+struct prof_sym {
+
+   struct bintree_node node;
+
+   void *vaddr;
+   u32 size;
+   const char *name;
+};
+
+bool __profiler_on;
+
+/* Allocated on the first start: they cost nothing, if never used */
+static struct prof_sample *samples;
+static struct prof_sym *syms_buf;
+static struct prof_sym *syms_bintree;
+static u32 syms_max;
+static u32 syms_count;
+
+static u32 samples_pos;                 /* next slot to write */
+static ulong samples_count;             /* samples taken since the start */
+
+/* Serializes start, stop and the build of the symbols tree */
+static struct kmutex prof_lock = STATIC_KMUTEX_INIT(prof_lock, 0);
+
+static void prof_get_comm(struct task *ti, char *comm)
+{
+   const char *s = NULL;
+   const char *p;
+   size_t i;
+
+   if (is_kernel_thread(ti))
+      s = ti->kthread_name ? ti->kthread_name : "kernel";
+   else if (ti->pi->debug_cmdline)
+      s = ti->pi->debug_cmdline;
+
+   if (!s || !*s)
+      s = "?";
+
+   /* Just the basename of argv[0]: the folded format uses ' ' and ';' */
+   for (p = s; *p && *p != ' '; p++)
+      if (*p == '/')
+         s = p + 1;
+
+   for (i = 0; i < PROF_COMM_LEN - 1 && s[i] && s[i] != ' '; i++)
+      comm[i] = s[i] != ';' ? s[i] : '_';
+
+   comm[i] = 0;
+}
+
+/*
+ * Called by the timer IRQ handler, when the profiler is enabled. Nested timer
+ * IRQs are ignored (see timer_irq_handler()), so there's a single writer here:
+ * the readers just need to disable the interrupts while copying a sample.
+ *
+ * User samples contain just the IP: walking user stacks in IRQ context is not
+ * safe, because their pages might not be mapped.
+ */
+void profiler_tick(regs_t *r)
+{
+   struct task *ti = get_curr_task();
+   struct prof_sample *s;
+   void *ip;
+
+   if (!r || !samples)
+      return;
+
+   ip = regs_get_ip(r);
+   s = &samples[samples_pos];
+   s->frames[0] = ip;
+   s->nframes = 1;
+   s->user = (ulong)ip < BASE_VA;
+   prof_get_comm(ti, s->comm);
+
+   if (!s->user) {
+      s->nframes += (u16)stackwalk_kernel_stack(s->frames + 1,
+                                                PROF_MAX_FRAMES - 1,
+                                                regs_get_frame_ptr(r),
+                                                ti->kernel_stack);
+   }
+
+   samples_pos = (samples_pos + 1) % PROF_MAX_SAMPLES;
+   samples_count++;
+}
+
+static int
+prof_count_sym_cb(struct elf_symbol_info *i, void *arg)
+{
+   if (i->size && i->name)
+      syms_max++;
+
+   return 0;
+}
+
+static int
+prof_add_sym_cb(struct elf_symbol_info *i, void *arg)
+{
+   struct prof_sym *sym;
+
+   if (!i->size || !i->name || syms_count == syms_max)
+      return 0;
+
+   sym = &syms_buf[syms_count];
+
+   *sym = (struct prof_sym) {
+      .vaddr = i->vaddr,
+      .size = i->size,
+      .name = i->name,
+   };
+
+   bintree_node_init(&sym->node);
+
+   /* Skip the aliases: the first symbol at a given address wins */
+   if (bintree_insert_ptr(&syms_bintree, sym, struct prof_sym, node, vaddr))
+      syms_count++;
+
+   return 0;
+}
+
+static long prof_sym_cmp(const void *obj, const void *value)
+{
+   const struct prof_sym *sym = obj;
+   const ulong va = *(const ulong *)value;
+
+   if (va < (ulong)sym->vaddr)
+      return 1;
+
+   if (va >= (ulong)sym->vaddr + sym->size)
+      return -1;
+
+   return 0;
+}
+
+/*
+ * The symbols tree of the tracing module contains just the syscalls: build
+ * here one with all the symbols, in order to resolve any kernel address.
+ */
+static int prof_build_syms_tree(void)
+{
+   if (syms_buf)
+      return 0;
+
+   foreach_symbol(prof_count_sym_cb, NULL);
+
+   if (!(syms_buf = kalloc_array_obj(struct prof_sym, syms_max)))
+      return -ENOMEM;
+
+   foreach_symbol(prof_add_sym_cb, NULL);
+   return 0;
+}
+
+static const char *prof_find_sym(void *va)
+{
+   struct prof_sym *sym;
+
+   sym = bintree_find(syms_bintree, &va, prof_sym_cmp, struct prof_sym, node);
+   return sym ? sym->name : NULL;
+}
+
+int profiler_start(void)
+{
+   int rc = 0;
+
+   kmutex_lock(&prof_lock);
+
+   if (__profiler_on)
+      goto out;
+
+   if ((rc = prof_build_syms_tree()))
+      goto out;
+
+   if (!samples) {
+      if (!(samples = kalloc_array_obj(struct prof_sample, PROF_MAX_SAMPLES))) {
+         rc = -ENOMEM;
+         goto out;
+      }
+   }
+
+   samples_pos = 0;
+   samples_count = 0;
+   __profiler_on = true;
+
+out:
+   kmutex_unlock(&prof_lock);
+   return rc;
+}
+
+void profiler_stop(void)
+{
+   kmutex_lock(&prof_lock);
+   {
+      __profiler_on = false;
+   }
+   kmutex_unlock(&prof_lock);
+}
+
+#if MOD_sysfs
+
+/* sysfs path: /tracing/profiler */
+
+static u32 prof_get_samples_in_buf(void)
+{
+   return (u32)MIN(samples_count, (ulong)PROF_MAX_SAMPLES);
+}
+
+/*
+ * Writes the folded stack of `s` (root first) in `buf`, in the format used by
+ * the FlameGraph tools: "comm;outer_func;...;leaf_func". The addresses not
+ * belonging to any symbol and the user IPs are written in hex.
+ */
+static void prof_fold_sample(const struct prof_sample *s, char *buf)
+{
+   const char *name;
+   size_t n;
+
+   n = (size_t)snprintk(buf, PROF_LINE_SZ, "%s", s->comm);
+
+   if (s->user && n < PROF_LINE_SZ)
+      n += (size_t)snprintk(buf + n, PROF_LINE_SZ - n, ";[user]");
+
+   for (int i = s->nframes - 1; i >= 0 && n < PROF_LINE_SZ; i--) {
+
+      name = s->user ? NULL : prof_find_sym(s->frames[i]);
+
+      if (name)
+         n += (size_t)snprintk(buf + n, PROF_LINE_SZ - n, ";%s", name);
+      else
+         n += (size_t)snprintk(buf + n, PROF_LINE_SZ - n, ";%p", s->frames[i]);
+   }
+}
+
+static offt
+prof_emit_line(char *dst, offt sz, const char *line, ulong cnt)
+{
+   return snprintk(dst, (size_t)sz, "%s %lu\n", line, cnt);
+}
+
+static offt
+prof_folded_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return (offt)(prof_get_samples_in_buf() + 1) * PROF_AVG_LINE_SZ;
+}
+
+/*
+ * One line per sample, from the oldest to the newest one. The consecutive
+ * identical stacks are merged in a single line: the FlameGraph tools sum the
+ * counts of the identical lines anyway.
+ */
+static offt
+prof_folded_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   struct prof_sample s;
+   char *dst = buf;
+   char *line, *prev;
+   ulong var, cnt = 0;
+   u32 n, start;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   if (!samples)
+      return 0;
+
+   if (!(line = kmalloc(2 * PROF_LINE_SZ)))
+      return -ENOMEM;
+
+   prev = line + PROF_LINE_SZ;
+
+   disable_interrupts(&var);
+   {
+      n = prof_get_samples_in_buf();
+      start = n < PROF_MAX_SAMPLES ? 0 : samples_pos;
+   }
+   enable_interrupts(&var);
+
+   for (u32 i = 0; i < n && tot < sz; i++) {
+
+      disable_interrupts(&var);
+      {
+         s = samples[(start + i) % PROF_MAX_SAMPLES];
+      }
+      enable_interrupts(&var);
+
+      prof_fold_sample(&s, line);
+
+      if (cnt && !strcmp(line, prev)) {
+         cnt++;
+         continue;
+      }
+
+      if (cnt)
+         tot += prof_emit_line(dst + tot, sz - tot, prev, cnt);
+
+      memcpy(prev, line, PROF_LINE_SZ);
+      cnt = 1;
+   }
+
+   if (cnt && tot < sz)
+      tot += prof_emit_line(dst + tot, sz - tot, prev, cnt);
+
+   kfree2(line, 2 * PROF_LINE_SZ);
+   return MIN(tot, sz);
+}
+
+static offt
+prof_enabled_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)sz, "%u\n", profiler_is_enabled());
+}
+
+static offt
+prof_enabled_store(struct sysobj *obj, void *data, void *buf, offt sz)
+{
+   char *s = buf;
+   int rc;
+
+   if (sz < 1 || (sz > 1 && s[1] != '\n' && s[1] != '\r'))
+      return -EINVAL;
+
+   if (s[0] == '1') {
+
+      if ((rc = profiler_start()))
+         return rc;
+
+   } else if (s[0] == '0') {
+
+      profiler_stop();
+
+   } else {
+
+      return -EINVAL;
+   }
+
+   return sz;
+}
+
+static const struct sysobj_prop_type prof_folded_ptype = {
+   .get_buf_sz = &prof_folded_get_buf_sz,
+   .load = &prof_folded_load,
+};
+
+static const struct sysobj_prop_type prof_enabled_ptype = {
+   .load = &prof_enabled_load,
+   .store = &prof_enabled_store,
+};
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &prof_enabled_ptype);
+DEF_STATIC_SYSOBJ_PROP(folded, &prof_folded_ptype);
+DEF_STATIC_SYSOBJ_PROP(samples, &sysobj_ptype_ro_ulong);
+
+DEF_STATIC_SYSOBJ_TYPE(type_profiler,
+                       &prop_enabled,
+                       &prop_folded,
+                       &prop_samples,
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_profiler,
+                  &type_profiler,
+                  NULL /* hooks */,
+                  NULL,
+                  NULL,
+                  &samples_count);
+
+void profiler_create_sysfs_obj(struct sysobj *parent)
+{
+   if (sysfs_register_obj(NULL, parent, "profiler", &obj_profiler))
+      panic("tracing: unable to register the profiler sysfs object");
+}
+
+#else
+
+void profiler_create_sysfs_obj(struct sysobj *parent) { }
+
+#endif
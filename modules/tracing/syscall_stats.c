@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/mods/tracing.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+#include "tracing_int.h"
+
+#define SYS_STATS_LINE_SZ                       256
+
+static struct syscall_stats sys_stats[MAX_SYSCALLS];
+static u64 sys_stats_notify_ticks;
+
+static void sys_stats_notify(void);
+
+/*
+ * Called at the end of every syscall, even when the tracing is disabled: it
+ * must stay cheap. The latency includes the time spent sleeping.
+ */
+void tracing_account_syscall(u32 sys, long retval, u64 start)
+{
+   struct syscall_stats *s;
+   u64 c = (RDTSC() - start) >> SYS_LAT_UNIT_SHIFT;
+   int b = 0;
+
+   if (sys >= MAX_SYSCALLS)
+      return;
+
+   s = &sys_stats[sys];
+
+   for (; c && b < SYS_LAT_BUCKETS - 1; b++)
+      c >>= 1;
+
+   disable_preemption();
+   {
+      s->calls++;
+      s->lat[b]++;
+
+      if (retval < 0 && retval >= -4095)   /* see MAX_ERRNO in Linux */
+         s->errors++;
+   }
+   enable_preemption();
+
+   /*
+    * The stats change at every syscall, including the ones of their readers:
+    * don't wake them up more than once per second.
+    */
+   if (get_ticks() - sys_stats_notify_ticks >= TIMER_HZ) {
+      sys_stats_notify_ticks = get_ticks();
+      sys_stats_notify();
+   }
+}
+
+const struct syscall_stats *
+tracing_get_syscall_stats(u32 sys)
+{
+   return sys < MAX_SYSCALLS ? &sys_stats[sys] : NULL;
+}
+
+#if MOD_sysfs
+
+/* sysfs path: /tracing/syscalls */
+
+static offt
+sys_stats_get_buf_sz(struct sysobj *obj, void *data)
+{
+   int n = 0;
+
+   for (u32 i = 0; i < MAX_SYSCALLS; i++)
+      if (sys_stats[i].calls)
+         n++;
+
+   /* Leave some room for the syscalls called in the meanwhile */
+   return (offt)(n + 8) * SYS_STATS_LINE_SZ;
+}
+
+/*
+ * One line per syscall called at least once: name, calls, errors and then the
+ * SYS_LAT_BUCKETS counters of the latency histogram (see tracing.h).
+ */
+static offt
+sys_stats_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   char *dst = buf;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (u32 i = 0; i < MAX_SYSCALLS && tot < sz; i++) {
+
+      const struct syscall_stats *s = &sys_stats[i];
+      const char *name = tracing_get_syscall_name(i);
+
+      if (!s->calls)
+         continue;
+
+      if (name)
+         tot += snprintk(dst + tot, (size_t)(sz - tot), "%-24s", name + 4);
+      else
+         tot += snprintk(dst + tot, (size_t)(sz - tot), "%-24u", i);
+
+      if (tot >= sz)
+         break;
+
+      tot += snprintk(dst + tot, (size_t)(sz - tot),
+                      " %10u %8u", s->calls, s->errors);
+
+      for (int b = 0; b < SYS_LAT_BUCKETS && tot < sz; b++)
+         tot += snprintk(dst + tot, (size_t)(sz - tot), " %u", s->lat[b]);
+
+      if (tot < sz)
+         tot += snprintk(dst + tot, (size_t)(sz - tot), "\n");
+   }
+
+   return MIN(tot, sz);
+}
+
+static const struct sysobj_prop_type sys_stats_ptype = {
+   .get_buf_sz = &sys_stats_get_buf_sz,
+   .load = &sys_stats_load,
+};
+
+static offt
+buf_kb_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   const ulong kb = tracing_get_buf_size() / KB;
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)sz, "%lu\n", kb);
+}
+
+/* Resizes the ring buffer of the events, dropping the ones in it */
+static offt
+buf_kb_store(struct sysobj *obj, void *data, void *buf, offt sz)
+{
+   char tmp[32] = {0};
+   int err = 0, rc;
+   ulong val;
+
+   memcpy(tmp, buf, (size_t)MIN(sz, (offt)sizeof(tmp) - 1));
+   val = tilck_strtoul(tmp, NULL, 10, &err);
+
+   if (err || val > TRACE_BUF_MAX_KB)
+      return -EINVAL;
+
+   if ((rc = tracing_set_buf_size(val * KB)))
+      return rc;
+
+   return sz;
+}
+
+static const struct sysobj_prop_type buf_kb_ptype = {
+   .load = &buf_kb_load,
+   .store = &buf_kb_store,
+};
+
+DEF_STATIC_SYSOBJ_PROP(syscalls, &sys_stats_ptype);
+DEF_STATIC_SYSOBJ_PROP(lat_unit_cycles, &sysobj_ptype_ro_ulong_literal);
+DEF_STATIC_SYSOBJ_PROP(buf_kb, &buf_kb_ptype);
+
+DEF_STATIC_SYSOBJ_TYPE(type_tracing,
+                       &prop_syscalls,
+                       &prop_lat_unit_cycles,
+                       &prop_buf_kb,
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_tracing,
+                  &type_tracing,
+                  NULL /* hooks */,
+                  NULL,
+                  TO_PTR(1ul << SYS_LAT_UNIT_SHIFT),
+                  NULL);
+
+/* sysfs path: /tracing/filter (see tracing_filter_on_exit()) */
+
+extern long __tracing_filter_pid;
+extern bool __tracing_filter_errors_only;
+extern ulong __tracing_filter_min_lat_us;
+
+DEF_STATIC_SYSOBJ_PROP(pid, &sysobj_ptype_rw_long);
+DEF_STATIC_SYSOBJ_PROP(errors_only, &sysobj_ptype_rw_bool);
+DEF_STATIC_SYSOBJ_PROP(min_lat_us, &sysobj_ptype_rw_ulong);
+
+DEF_STATIC_SYSOBJ_TYPE(type_filter,
+                       &prop_pid,
+                       &prop_errors_only,
+                       &prop_min_lat_us,
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_filter,
+                  &type_filter,
+                  NULL /* hooks */,
+                  &__tracing_filter_pid,
+                  &__tracing_filter_errors_only,
+                  &__tracing_filter_min_lat_us);
+
+static void sys_stats_notify(void)
+{
+   sysfs_notify(&obj_tracing, &prop_syscalls);
+}
+
+void tracing_create_sysfs_obj(void)
+{
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "tracing", &obj_tracing))
+      panic("tracing: unable to register the sysfs object");
+
+   profiler_create_sysfs_obj(&obj_tracing);
+   tracepoints_create_sysfs_obj(&obj_tracing);
+
+   if (sysfs_register_obj(NULL, &obj_tracing, "filter", &obj_filter))
+      panic("tracing: unable to register the filter sysfs object");
+}
+
+#else
+
+static void sys_stats_notify(void) { }
+void tracing_create_sysfs_obj(void) { }
+
+#endif
@@ -0,0 +1,176 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_sysfs.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/errno.h>
+#include <tilck/mods/tracing.h>
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+#include "tracing_int.h"
+
+STATIC_ASSERT(TP_COUNT <= 32);
+
+#define TP_NAME_MAX_LEN                          32
+
+u32 __tracepoints_mask;
+
+static const struct tracepoint_info tracepoints[TP_COUNT] =
+{
+   [tp_sched_switch] = { "sched_switch", { "prev", "next", "prev_state" } },
+   [tp_sched_wakeup] = { "sched_wakeup", { "tid" } },
+   [tp_page_fault]   = { "page_fault",   { "vaddr", "ip", "write" }, 0x3 },
+   [tp_irq_entry]    = { "irq_entry",    { "irq" } },
+   [tp_irq_exit]     = { "irq_exit",     { "irq" } },
+   [tp_kmalloc]      = { "kmalloc",      { "ptr", "size", "flags" }, 0x5 },
+   [tp_kfree]        = { "kfree",        { "ptr", "size", "flags" }, 0x5 },
+   [tp_vfs_op]       = { "vfs_op",       { "op", "handle", "ret" }, 0x2 },
+};
+
+static const char *vfs_op_names[] =
+{
+   [tp_vfs_open]   = "open",
+   [tp_vfs_close]  = "close",
+   [tp_vfs_read]   = "read",
+   [tp_vfs_write]  = "write",
+   [tp_vfs_pread]  = "pread",
+   [tp_vfs_pwrite] = "pwrite",
+};
+
+const struct tracepoint_info *
+tracepoint_get_info(u32 tp)
+{
+   return tp < TP_COUNT ? &tracepoints[tp] : NULL;
+}
+
+const char *
+tracepoint_get_vfs_op_name(u32 op)
+{
+   return op < ARRAY_SIZE(vfs_op_names) ? vfs_op_names[op] : "?";
+}
+
+u32
+tracepoints_get_enabled_mask(void)
+{
+   return __tracepoints_mask;
+}
+
+void
+tracepoints_set_enabled_mask(u32 mask)
+{
+   __tracepoints_mask = mask & ((1u << TP_COUNT) - 1);
+}
+
+#if MOD_sysfs
+
+/* sysfs path: /tracing/tracepoints */
+
+static int tp_find_by_name(const char *name)
+{
+   for (int i = 0; i < TP_COUNT; i++)
+      if (!strcmp(tracepoints[i].name, name))
+         return i;
+
+   return -1;
+}
+
+static bool tp_is_separator(char c)
+{
+   return c == ' ' || c == ',' || c == '\n' || c == '\r';
+}
+
+/* One tracepoint per line: its name followed by 1 if enabled, 0 otherwise */
+static offt
+tp_load(struct sysobj *obj, void *data, void *buf, offt sz, offt off)
+{
+   const u32 mask = tracepoints_get_enabled_mask();
+   char *dst = buf;
+   offt tot = 0;
+
+   ASSERT(off == 0);
+
+   for (int i = 0; i < TP_COUNT && tot < sz; i++) {
+      tot += snprintk(dst + tot, (size_t)(sz - tot), "%s %u\n",
+                      tracepoints[i].name, !!(mask & (1u << i)));
+   }
+
+   return MIN(tot, sz);
+}
+
+/*
+ * Accepts a list of tracepoint names, separated by spaces or commas, which
+ * replaces the set of the enabled ones. "all" enables all of them, while an
+ * empty list or "none" disables them all.
+ */
+static offt
+tp_store(struct sysobj *obj, void *data, void *buf, offt sz)
+{
+   const char *s = buf, *end = s + sz;
+   char name[TP_NAME_MAX_LEN];
+   u32 mask = 0;
+   int len, tp;
+
+   while (s < end) {
+
+      for (len = 0; s < end && !tp_is_separator(*s); s++) {
+
+         if (len == (int)sizeof(name) - 1)
+            return -EINVAL;
+
+         name[len++] = *s;
+      }
+
+      name[len] = 0;
+
+      if (s < end)
+         s++; /* skip the separator */
+
+      if (!len || !strcmp(name, "none"))
+         continue;
+
+      if (!strcmp(name, "all")) {
+         mask = (1u << TP_COUNT) - 1;
+         continue;
+      }
+
+      if ((tp = tp_find_by_name(name)) < 0)
+         return -EINVAL;
+
+      mask |= (1u << tp);
+   }
+
+   tracepoints_set_enabled_mask(mask);
+   return sz;
+}
+
+static const struct sysobj_prop_type tp_ptype = {
+   .load = &tp_load,
+   .store = &tp_store,
+};
+
+DEF_STATIC_SYSOBJ_PROP(enabled, &tp_ptype);
+
+DEF_STATIC_SYSOBJ_TYPE(type_tracepoints,
+                       &prop_enabled,
+                       NULL);
+
+DEF_STATIC_SYSOBJ(obj_tracepoints,
+                  &type_tracepoints,
+                  NULL /* hooks */,
+                  NULL);
+
+void tracepoints_create_sysfs_obj(struct sysobj *parent)
+{
+   if (sysfs_register_obj(NULL, parent, "tracepoints", &obj_tracepoints))
+      panic("tracing: unable to register the tracepoints sysfs object");
+}
+
+#else
+
+void tracepoints_create_sysfs_obj(struct sysobj *parent) { }
+
+#endif
@@ -6,6 +6,7 @@
 
 #include <tilck/kernel/modules.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/ringbuf.h>
@@ -15,10 +16,25 @@
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/boot_trace.h>
+#include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/errno.h>
 
 #include <tilck/mods/tracing.h>
+#include <tilck/mods/tracing_mmap.h>
 
-#define TRACE_BUF_SIZE                       (128 * KB)
+#include "tracing_int.h"
+
+/*
+ * The events are stored in a byte ring, each one prefixed by this header:
+ * only the used part of a struct trace_event is written (e.g. the printk
+ * events without the unused tail of the buffer and the syscall events without
+ * the slots unused by the given syscall), which usually is a fraction of it.
+ */
+struct trace_ring_hdr {
+   u16 len;
+};
 
 struct symbol_node {
 
@@ -32,6 +48,8 @@ struct symbol_node {
 static struct kcond tracing_cond;
 static struct ringbuf tracing_rb;
 static void *tracing_buf;
+static size_t tracing_buf_size;
+static u32 tracing_rb_events;
 
 static u32 syms_count;
 static struct symbol_node *syms_buf;
@@ -46,8 +64,11 @@ static int traced_syscalls_count;
 
 bool *traced_syscalls;
 bool __force_exp_block;
-bool __tracing_on;
+DEFINE_STATIC_KEY(__tracing_on);
 bool __tracing_dump_big_bufs;
+long __tracing_filter_pid;
+bool __tracing_filter_errors_only;
+ulong __tracing_filter_min_lat_us;
 bool __tracing_initialized;
 bool __trace_printk_initialized;
 int __tracing_printk_lvl = 10;
@@ -249,16 +270,68 @@ trace_syscall_exit_save_params(const struct syscall_info *si,
    }
 }
 
-static void
-enqueue_trace_event(struct trace_event *e)
+static size_t
+trace_sys_event_size(const struct trace_event *e);
+
+size_t
+tracing_get_event_size(const struct trace_event *e)
 {
+   size_t len;
+
+   switch (e->type) {
+
+      case te_sys_enter:
+      case te_sys_exit:
+         return trace_sys_event_size(e);
+
+      case te_printk:
+
+         /* Might be not NUL-terminated: see trace_printk_raw_int() */
+         for (len = 0; len < sizeof(e->p_ev.buf) - 1; len++)
+            if (!e->p_ev.buf[len])
+               break;
+
+         return offsetof(struct trace_event, p_ev.buf) + len + 1;
+
+      case te_signal_delivered:
+      case te_killed:
+         return offsetof(struct trace_event, sig_ev) + sizeof(e->sig_ev);
+
+      case te_tracepoint:
+         return offsetof(struct trace_event, tp_ev) + sizeof(e->tp_ev);
+
+      default:
+         return sizeof(*e);
+   }
+}
+
+static bool
+enqueue_trace_event_nosignal(struct trace_event *e)
+{
+   struct trace_ring_hdr h = { .len = (u16)tracing_get_event_size(e) };
+   bool success = false;
    ulong var;
-   bool success;
+
    disable_interrupts(&var);
    {
-      success = ringbuf_write_elem(&tracing_rb, e);
+      /* Write the whole record or nothing: the reader must never see halves */
+      if (tracing_rb.max_elems - tracing_rb.elems >= sizeof(h) + h.len) {
+         ringbuf_write_bytes(&tracing_rb, (u8 *)&h, sizeof(h));
+         ringbuf_write_bytes(&tracing_rb, (u8 *)e, h.len);
+         tracing_rb_events++;
+         success = true;
+      }
+
+      trace_mmap_write_event(e);
    }
    enable_interrupts(&var);
+   return success;
+}
+
+static void
+enqueue_trace_event(struct trace_event *e)
+{
+   const bool success = enqueue_trace_event_nosignal(e);
 
    if (success && !in_irq()) {
       /*
@@ -271,6 +344,32 @@ enqueue_trace_event(struct trace_event *e)
    }
 }
 
+static bool
+trace_filter_match_task(void)
+{
+   const long pid = __tracing_filter_pid;
+   struct task *curr = get_curr_task();
+
+   if (!curr->traced)
+      return false;
+
+   return !pid || curr->tid == pid || curr->pi->pid == pid;
+}
+
+static bool
+trace_filter_match_exit(long retval, u64 start)
+{
+   const ulong min_lat_us = __tracing_filter_min_lat_us;
+
+   if (__tracing_filter_errors_only && !(retval < 0 && retval >= -4095))
+      return false; /* not an error: see MAX_ERRNO in Linux */
+
+   if (min_lat_us && boot_trace_tsc_to_us(RDTSC() - start) < min_lat_us)
+      return false;
+
+   return true;
+}
+
 void
 trace_syscall_enter_int(u32 sys,
                         ulong a1,
@@ -282,10 +381,10 @@ trace_syscall_enter_int(u32 sys,
 {
    const struct syscall_info *si = tracing_get_syscall_info(sys);
 
-   if (!get_curr_task()->traced)
+   if (!trace_filter_match_task())
       return; /* the current task is not traced */
 
-   if (si && !exp_block(si))
+   if ((si && !exp_block(si)) || tracing_filter_on_exit())
       return; /* don't trace the enter event */
 
    struct trace_event e = {
@@ -306,6 +405,7 @@ trace_syscall_enter_int(u32 sys,
 void
 trace_syscall_exit_int(u32 sys,
                        long retval,
+                       u64 start,
                        ulong a1,
                        ulong a2,
                        ulong a3,
@@ -315,9 +415,12 @@ trace_syscall_exit_int(u32 sys,
 {
    const struct syscall_info *si = tracing_get_syscall_info(sys);
 
-   if (!get_curr_task()->traced)
+   if (!trace_filter_match_task())
       return; /* the current task is not traced */
 
+   if (!trace_filter_match_exit(retval, start))
+      return; /* discard the event before saving anything */
+
    struct trace_event e = {
       .type = te_sys_exit,
       .tid = get_curr_tid(),
@@ -451,6 +554,32 @@ trace_task_killed_int(int signum)
    enqueue_trace_event(&e);
 }
 
+/*
+ * Tracepoints sit in the scheduler, in kmalloc() and in the IRQ entry: they
+ * must not signal `tracing_cond`, as that might wake up a task and, therefore,
+ * hit a tracepoint again. The reader does not need that: it polls the ring
+ * with a timeout anyway.
+ */
+void
+tracepoint_int(enum tracepoint tp, ulong a0, ulong a1, ulong a2)
+{
+   if (!__trace_printk_initialized)
+      return;
+
+   struct trace_event e = {
+      .type = te_tracepoint,
+      .tid = get_curr_tid(),
+      .sys_time = get_sys_time(),
+      .tp_ev = {
+         .tp = tp,
+         .tsc = RDTSC(),
+         .args = {a0, a1, a2},
+      }
+   };
+
+   enqueue_trace_event_nosignal(&e);
+}
+
 bool read_trace_event_noblock(struct trace_event *e)
 {
    bool success;
@@ -460,7 +589,18 @@ bool read_trace_event_noblock(struct trace_event *e)
    ASSERT(are_interrupts_enabled());
    disable_interrupts_forced();
    {
-      success = ringbuf_read_elem(&tracing_rb, e);
+      struct trace_ring_hdr h;
+      success = !ringbuf_is_empty(&tracing_rb);
+
+      if (success) {
+
+         ringbuf_read_bytes(&tracing_rb, (u8 *)&h, sizeof(h));
+         ASSERT(h.len <= sizeof(*e));
+
+         bzero(e, sizeof(*e));
+         ringbuf_read_bytes(&tracing_rb, (u8 *)e, h.len);
+         tracing_rb_events--;
+      }
    }
    enable_interrupts_forced();
    return success;
@@ -564,6 +704,30 @@ tracing_get_slot(struct trace_event *e,
    return true;
 }
 
+/* The used part of a syscall event: up to the end of its last slot */
+static size_t
+trace_sys_event_size(const struct trace_event *e)
+{
+   const u32 sys = e->sys_ev.sys;
+   size_t end = offsetof(struct trace_event, sys_ev.fmt0);
+   s8 slot, fmt;
+
+   if (sys >= MAX_SYSCALLS)
+      return sizeof(struct trace_event);
+
+   fmt = syscalls_fmts[sys];
+
+   for (int i = 0; i < 6; i++) {
+
+      if ((slot = (*params_slots)[sys][i]) == NO_SLOT)
+         continue;
+
+      end = MAX(end, fmt_offsets[fmt][slot] + fmt_sizes[fmt][slot]);
+   }
+
+   return end;
+}
+
 static bool
 is_slot_free(u32 sys, int slot)
 {
@@ -848,12 +1012,52 @@ tracing_get_in_buffer_events_count(void)
 
    disable_interrupts(&var);
    {
-      rc = (int)ringbuf_get_elems(&tracing_rb); // integer narrowing
+      rc = (int)tracing_rb_events; // integer narrowing
    }
    enable_interrupts(&var);
    return rc;
 }
 
+size_t
+tracing_get_buf_size(void)
+{
+   return tracing_buf_size;
+}
+
+/*
+ * Replaces the ring buffer with a new one of `size` bytes. The events still in
+ * the old buffer are dropped.
+ */
+int
+tracing_set_buf_size(size_t size)
+{
+   void *new_buf, *old_buf;
+   size_t old_size;
+   ulong var;
+
+   if (size < TRACE_BUF_MIN_KB * KB || size > TRACE_BUF_MAX_KB * KB)
+      return -EINVAL;
+
+   if (!(new_buf = kmalloc(size)))
+      return -ENOMEM;
+
+   disable_interrupts(&var);
+   {
+      old_buf = tracing_buf;
+      old_size = tracing_buf_size;
+      tracing_buf = new_buf;
+      tracing_buf_size = size;
+      tracing_rb_events = 0;
+      ringbuf_init(&tracing_rb, size, 1, tracing_buf);
+   }
+   enable_interrupts(&var);
+
+   if (old_buf)
+      kfree2(old_buf, old_size);
+
+   return 0;
+}
+
 static void
 tracing_init_oom_panic(const char *buf_name)
 {
@@ -866,14 +1070,9 @@ init_trace_printk(void)
    if (__trace_printk_initialized)
       return;
 
-   if (!(tracing_buf = kzmalloc(TRACE_BUF_SIZE)))
+   if (tracing_set_buf_size(kopt_trace_buf_kb * KB))
       tracing_init_oom_panic("tracing_buf");
 
-   ringbuf_init(&tracing_rb,
-                TRACE_BUF_SIZE / sizeof(struct trace_event),
-                sizeof(struct trace_event),
-                tracing_buf);
-
    kcond_init(&tracing_cond);
    __trace_printk_initialized = true;
 }
@@ -907,6 +1106,8 @@ init_tracing(void)
    tracing_allocate_slots_for_params();
 
    set_traced_syscalls("*");
+   init_trace_mmap();
+   tracing_create_sysfs_obj();
    __tracing_initialized = true;
 }
 
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+struct sysobj;
+
+void tracing_create_sysfs_obj(void);
+void profiler_create_sysfs_obj(struct sysobj *parent);
+void tracepoints_create_sysfs_obj(struct sysobj *parent);
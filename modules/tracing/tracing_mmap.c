@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/errno.h>
+
+#include <tilck/mods/tracing_mmap.h>
+
+#include <sys/mman.h>         // system header
+
+#define TRACE_MMAP_SIZE              (PAGE_SIZE + TRACE_MMAP_DATA_SIZE)
+
+STATIC_ASSERT(sizeof(struct trace_mmap_page) <= PAGE_SIZE);
+STATIC_ASSERT((TRACE_MMAP_DATA_SIZE & (TRACE_MMAP_DATA_SIZE - 1)) == 0);
+
+/* Allocated on the first mmap(): it costs nothing, if never used */
+static struct trace_mmap_page *tm_page;
+static char *tm_data;
+
+static void
+trace_mmap_put_rec(u32 head, u16 type, u16 size, const void *p, u32 len)
+{
+   const u32 off = head & (TRACE_MMAP_DATA_SIZE - 1);
+   struct trace_rec_hdr *h = (void *)(tm_data + off);
+
+   *h = (struct trace_rec_hdr) { .type = type, .size = size };
+
+   if (len)
+      memcpy(h + 1, p, len);
+}
+
+/*
+ * Appends `e` to the ring. Called by enqueue_trace_event() with the interrupts
+ * disabled: therefore, there's always a single producer.
+ */
+void trace_mmap_write_event(const struct trace_event *e)
+{
+   struct trace_mmap_page *p = tm_page;
+   u32 head, tail, len, size, to_end, needed;
+
+   if (!p)
+      return;
+
+   len = (u32)tracing_get_event_size(e);
+   size = (u32)pow2_round_up_at(sizeof(struct trace_rec_hdr) + len,
+                                TRACE_REC_ALIGN);
+
+   head = atomic_load_explicit(&p->data_head, mo_relaxed);
+   tail = atomic_load_explicit(&p->data_tail, mo_acquire);
+   to_end = TRACE_MMAP_DATA_SIZE - (head & (TRACE_MMAP_DATA_SIZE - 1));
+
+   /* The record must not cross the end: pad the space there, if needed */
+   needed = size + (to_end < size ? to_end : 0);
+
+   if (needed > TRACE_MMAP_DATA_SIZE - (head - tail)) {
+      atomic_fetch_add_explicit(&p->lost, 1, mo_relaxed);
+      return;
+   }
+
+   if (to_end < size) {
+      trace_mmap_put_rec(head, TRACE_REC_PAD, (u16)to_end, NULL, 0);
+      head += to_end;
+   }
+
+   trace_mmap_put_rec(head, TRACE_REC_EVENT, (u16)size, e, len);
+
+   /* Publish the record: the release pairs with the consumer's acquire */
+   atomic_store_explicit(&p->data_head, head + size, mo_release);
+}
+
+static int trace_mmap_alloc(void)
+{
+   size_t size = TRACE_MMAP_SIZE;
+   struct trace_mmap_page *p;
+
+   if (!(p = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return -ENOMEM;
+
+   bzero(p, size);
+
+   /* These pages will be mapped in the user space, as ramfs does */
+   retain_pageframes_mapped_at(get_kernel_pdir(), p, size, PF_TYPE_USHARED);
+
+   *p = (struct trace_mmap_page) {
+      .magic = TRACE_MMAP_MAGIC,
+      .version = TRACE_MMAP_VERSION,
+      .data_offset = PAGE_SIZE,
+      .data_size = TRACE_MMAP_DATA_SIZE,
+   };
+
+   disable_preemption();
+   {
+      if (!tm_page) {
+         tm_data = (char *)p + PAGE_SIZE;
+         tm_page = p;
+         p = NULL;
+      }
+   }
+   enable_preemption();
+
+   if (p) {
+      /* Somebody else did the allocation in the meanwhile */
+      release_pageframes_mapped_at(get_kernel_pdir(), p, size);
+      kfree2(p, size);
+   }
+
+   return 0;
+}
+
+static int
+trace_mmap_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   size_t pg_count, mapped_cnt;
+   int rc;
+
+   if (um->off != 0 || um->len > TRACE_MMAP_SIZE)
+      return -EINVAL;
+
+   if (flags & VFS_MM_DONT_MMAP)
+      return 0;
+
+   if (!tm_page)
+      if ((rc = trace_mmap_alloc()))
+         return rc;
+
+   /* The consumer needs to write `data_tail` */
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   pg_count = um->len >> PAGE_SHIFT;
+   mapped_cnt = map_pages(pdir,
+                          um->vaddrp,
+                          LIN_VA_TO_PA(tm_page),
+                          pg_count,
+                          pg_flags);
+
+   if (mapped_cnt != pg_count) {
+      unmap_pages_permissive(pdir, um->vaddrp, mapped_cnt, false);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static int
+create_trace_mmap_device(int minor,
+                         enum vfs_entry_type *type,
+                         struct devfs_file_info *nfo)
+{
+   static const struct file_ops static_ops_trace_mmap = {
+      .mmap = trace_mmap_mmap,
+      .munmap = generic_fs_munmap,
+   };
+
+   *type = VFS_CHAR_DEV;
+   nfo->fops = &static_ops_trace_mmap;
+   nfo->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
+   return 0;
+}
+
+void init_trace_mmap(void)
+{
+   struct driver_info *di;
+   int major, rc;
+
+   if (!(di = kzalloc_obj(struct driver_info)))
+      panic("tracing: no memory for the tracebuf driver");
+
+   di->name = "tracebuf";
+   di->create_dev_file = create_trace_mmap_device;
+   major = register_driver(di, -1);
+
+   if ((rc = create_dev_file("tracebuf", (u16)major, 0 /* minor */, NULL)))
+      panic("tracing: unable to create /dev/tracebuf (error: %d)", rc);
+}
@@ -0,0 +1,348 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/dma_mapping.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/worker_thread.h>
+
+#include "virtio_blk.h"
+
+static const char *vblk_names[VIRTIO_BLK_MAX_DEVICES] = {
+   "vda", "vdb", "vdc", "vdd"
+};
+
+static int vblk_count;
+static struct worker_thread *vblk_wth;   /* Bottom halves of all the devices */
+
+static void
+vblk_set_desc(struct virtio_blk *vb, u16 i, u64 paddr, u32 len, u16 flags)
+{
+   vb->desc[i] = (struct vring_desc) {
+      .addr = paddr,
+      .len = len,
+      .flags = flags,
+      .next = (u16)(i + 1),
+   };
+}
+
+static void vblk_unmap_bios(struct virtio_blk *vb)
+{
+   for (u32 i = 0; i < vb->maps_count; i++)
+      dma_unmap_buf(&vb->maps[i]);
+
+   vb->maps_count = 0;
+}
+
+/*
+ * Maps the buffers of all the bios in `req` for DMA, filling vb->sg. Because
+ * the buffers don't need to be physically contiguous, a bio might need more
+ * than one descriptor. Returns the number of sg entries or an error.
+ */
+static int vblk_map_bios(struct virtio_blk *vb, struct blk_request *req)
+{
+   const enum dma_dir dir = req->write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+   const u32 max_sg = vb->qsize - 2u;     /* room for header and status */
+   struct blk_bio *bio;
+   struct dma_map *m;
+   u32 n = 0;
+   int rc;
+
+   ASSERT(req->bios_count <= ARRAY_SIZE(vb->maps));
+
+   list_for_each_ro(bio, &req->bios, node) {
+
+      if (n == max_sg) {
+         rc = -EINVAL;
+         goto fail;
+      }
+
+      m = &vb->maps[vb->maps_count];
+
+      rc = dma_map_buf(bio->buf,
+                       bio->sectors << BLK_SECTOR_SHIFT,
+                       dir,
+                       DMA_MASK_ALL,
+                       vb->sg + n,
+                       max_sg - n,
+                       m);
+      if (rc)
+         goto fail;
+
+      vb->maps_count++;
+      n += m->sg_count;
+   }
+
+   return (int)n;
+
+fail:
+   vblk_unmap_bios(vb);
+   return rc;
+}
+
+/*
+ * Submits a virtio-blk request: the header, the data descriptors for the bios
+ * merged in `req` by the block layer and the status byte, chained together.
+ */
+static int vblk_submit(struct blk_device *blk, struct blk_request *req)
+{
+   struct virtio_blk *vb = blk->priv;
+   const u16 data_flags = req->write ? 0 : VRING_DESC_F_WRITE;
+   int sg_count;
+   u16 i = 0;
+
+   ASSERT(!vb->req);
+
+   if ((sg_count = vblk_map_bios(vb, req)) < 0)
+      return sg_count;
+
+   vb->hdr = (struct virtio_blk_req_hdr) {
+      .type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN,
+      .reserved = 0,
+      .sector = req->sector,
+   };
+
+   vb->status = 0xff;
+   vblk_set_desc(vb,
+                 i++,
+                 LIN_VA_TO_PA(&vb->hdr),
+                 sizeof(vb->hdr),
+                 VRING_DESC_F_NEXT);
+
+   for (int j = 0; j < sg_count; j++) {
+      vblk_set_desc(vb,
+                    i++,
+                    vb->sg[j].paddr,
+                    vb->sg[j].len,
+                    VRING_DESC_F_NEXT | data_flags);
+   }
+
+   vblk_set_desc(vb,
+                 i,
+                 LIN_VA_TO_PA(&vb->status),
+                 1,
+                 VRING_DESC_F_WRITE);
+   vb->req = req;
+
+   /* The chain always starts at descriptor 0 */
+   vb->avail->ring[vb->avail->idx % vb->qsize] = 0;
+   virtio_barrier();
+   vb->avail->idx++;
+   virtio_barrier();
+
+   outw(vb->iobase + VIRTIO_REG_QUEUE_NOTIFY, 0);
+   return 0;
+}
+
+static void vblk_bottom_half(void *arg)
+{
+   struct virtio_blk *vb = arg;
+   struct blk_request *req;
+
+   while (vb->last_used != vb->used->idx) {
+
+      vb->last_used++;
+      virtio_barrier();
+
+      if (!(req = vb->req))
+         continue;
+
+      vb->req = NULL;
+      vblk_unmap_bios(vb);
+      blk_end_request(&vb->blk, req, vb->status == VIRTIO_BLK_S_OK ? 0 : -EIO);
+   }
+}
+
+static enum irq_action vblk_irq_handler(void *ctx)
+{
+   struct virtio_blk *vb = ctx;
+
+   /* Reading the ISR status acknowledges the interrupt */
+   if (!(inb(vb->iobase + VIRTIO_REG_ISR) & VIRTIO_ISR_QUEUE))
+      return IRQ_NOT_HANDLED; /* Not an IRQ from this device [irq sharing] */
+
+   if (!wth_enqueue_on(vblk_wth, &vblk_bottom_half, vb))
+      printk("virtio_blk: WARNING: hit job queue limit\n");
+
+   return IRQ_HANDLED;
+}
+
+static const struct blk_ops vblk_ops = {
+   .submit = vblk_submit,
+};
+
+static int vblk_setup_queue(struct virtio_blk *vb)
+{
+   ulong ring_paddr;
+
+   outw(vb->iobase + VIRTIO_REG_QUEUE_SEL, 0);
+
+   if (!(vb->qsize = inw(vb->iobase + VIRTIO_REG_QUEUE_SIZE)))
+      return -ENODEV;
+
+   vb->ring_size = vring_legacy_size(vb->qsize);
+
+   vb->ring_mem =
+      dma_alloc_coherent(vb->ring_size, VRING_LEGACY_DMA_MASK, &ring_paddr);
+
+   if (!vb->ring_mem)
+      return -ENOMEM;
+
+   if (!(vb->sg = kalloc_array_obj(struct dma_sg, vb->qsize)))
+      return -ENOMEM;
+
+   vb->desc = vb->ring_mem;
+   vb->avail = vb->ring_mem + sizeof(struct vring_desc) * vb->qsize;
+   vb->used = vb->ring_mem + vring_legacy_used_off(vb->qsize);
+
+   outl(vb->iobase + VIRTIO_REG_QUEUE_PFN, (u32)(ring_paddr >> PAGE_SHIFT));
+
+   return 0;
+}
+
+static int vblk_init_device(struct virtio_blk *vb)
+{
+   struct pci_device_loc loc = vb->pdev->loc;
+   const u32 bar0 = vb->pdev->bars[0];
+   const u32 irq = vb->pdev->irq_line;
+   u32 cmd, features;
+   u64 capacity;
+   int rc;
+
+   if (!(bar0 & PCI_BAR_IO))
+      return -ENODEV; /* Not a legacy/transitional device */
+
+   if (irq >= 16)
+      return -ENODEV; /* No legacy IRQ routed to the device */
+
+   if ((rc = pci_config_read(loc, PCI_CONF_COMMAND, 16, &cmd)))
+      return rc;
+
+   cmd |= PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER;
+
+   if ((rc = pci_config_write(loc, PCI_CONF_COMMAND, 16, cmd)))
+      return rc;
+
+   vb->iobase = (u16)(bar0 & PCI_BAR_IO_MASK);
+   vb->irq = (u8)irq;
+
+   /* Reset the device, then tell it that we found it and we can drive it */
+   outb(vb->iobase + VIRTIO_REG_STATUS, 0);
+   outb(vb->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK);
+   outb(vb->iobase + VIRTIO_REG_STATUS,
+        VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+   /* We don't need any optional feature */
+   features = inl(vb->iobase + VIRTIO_REG_DEV_FEATURES);
+   outl(vb->iobase + VIRTIO_REG_DRV_FEATURES, 0);
+
+   if ((rc = vblk_setup_queue(vb)))
+      goto fail;
+
+   capacity = inl(vb->iobase + VIRTIO_REG_DEV_CONFIG);
+   capacity |= (u64)inl(vb->iobase + VIRTIO_REG_DEV_CONFIG + 4) << 32;
+
+   disable_preemption();
+   {
+      if (!vblk_wth)
+         vblk_wth = wth_create_thread("virtio_blk", 1, WTH_VBLK_QUEUE_SIZE);
+   }
+   enable_preemption();
+
+   if (!vblk_wth) {
+      rc = -ENOMEM;
+      goto fail;
+   }
+
+   list_node_init(&vb->irq_node.node);
+   vb->irq_node.handler = &vblk_irq_handler;
+   vb->irq_node.context = vb;
+   irq_install_handler(vb->irq, &vb->irq_node);
+
+   outb(vb->iobase + VIRTIO_REG_STATUS,
+        VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+   vb->blk = (struct blk_device) {
+      .name = vblk_names[vblk_count],
+      .sectors = capacity,
+      .read_only = !!(features & VIRTIO_BLK_F_RO),
+      .ops = &vblk_ops,
+      .priv = vb,
+   };
+
+   if ((rc = register_blk_device(&vb->blk))) {
+      irq_uninstall_handler(vb->irq, &vb->irq_node);
+      goto fail;
+   }
+
+   printk("virtio_blk: %s: irq #%u, queue size: %u\n",
+          vb->blk.name, vb->irq, vb->qsize);
+
+   vblk_count++;
+   return 0;
+
+fail:
+   outb(vb->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+
+   if (vb->ring_mem) {
+      dma_free_coherent(vb->ring_mem, vb->ring_size);
+      vb->ring_mem = NULL;
+   }
+
+   if (vb->sg) {
+      kfree_array_obj(vb->sg, struct dma_sg, vb->qsize);
+      vb->sg = NULL;
+   }
+
+   return rc;
+}
+
+static void init_virtio_blk(void)
+{
+   struct pci_device *pdev = NULL;
+   struct virtio_blk *vb;
+   int rc;
+
+   while (vblk_count < VIRTIO_BLK_MAX_DEVICES) {
+
+      pdev = pci_find_device(VIRTIO_PCI_VENDOR_ID,
+                             VIRTIO_PCI_BLK_DEVICE_ID,
+                             pdev);
+      if (!pdev)
+         break;
+
+      if (!(vb = kzalloc_obj(struct virtio_blk))) {
+         printk("virtio_blk: out of memory\n");
+         break;
+      }
+
+      vb->pdev = pdev;
+
+      if ((rc = vblk_init_device(vb))) {
+
+         printk("virtio_blk: failed to init device %02x:%02x.%u: %d\n",
+                pdev->loc.bus, pdev->loc.dev, pdev->loc.func, rc);
+
+         kfree_obj(vb, struct virtio_blk);
+      }
+   }
+}
+
+static struct module virtio_blk_module = {
+
+   .name = "virtio_blk",
+   .priority = MOD_virtio_blk_prio,
+   .init = &init_virtio_blk,
+   .deps = MOD_DEPS("pci"),
+   .flags = MODULE_FL_ASYNC,
+};
+
+REGISTER_MODULE(&virtio_blk_module);
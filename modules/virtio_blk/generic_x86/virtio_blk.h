@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/blkdev.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/dma_mapping.h>
+#include <tilck/mods/pci.h>
+#include <tilck/mods/virtio.h>
+
+#define VIRTIO_PCI_BLK_DEVICE_ID         0x1001   /* transitional device */
+
+#define VIRTIO_BLK_F_RO                  (1 << 5)
+
+#define VIRTIO_BLK_T_IN                       0
+#define VIRTIO_BLK_T_OUT                      1
+#define VIRTIO_BLK_S_OK                       0
+
+#define VIRTIO_BLK_MAX_DEVICES                4
+
+struct virtio_blk_req_hdr {
+   u32 type;
+   u32 reserved;
+   u64 sector;
+};
+
+struct virtio_blk {
+
+   struct blk_device blk;
+   struct pci_device *pdev;
+   struct irq_handler_node irq_node;
+   u16 iobase;
+   u8 irq;
+
+   /* The one and only virtqueue (requestq) */
+   u16 qsize;
+   u16 last_used;
+   void *ring_mem;
+   size_t ring_size;
+   volatile struct vring_desc *desc;
+   volatile struct vring_avail *avail;
+   volatile struct vring_used *used;
+
+   /*
+    * The request in flight. The block layer submits one request at a time,
+    * so a single header and status byte are enough.
+    */
+   struct blk_request *req;
+   struct virtio_blk_req_hdr hdr;
+   volatile u8 status;
+
+   /* The DMA mappings of the bios of `req` */
+   struct dma_map maps[BLK_MAX_REQ_BIOS];
+   u32 maps_count;
+   struct dma_sg *sg;            /* qsize entries */
+};
@@ -0,0 +1,753 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/modules.h>
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/dma_mapping.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/pageframes.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/worker_thread.h>
+#include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
+
+#include <sys/mman.h>         // system header
+
+#include "virtio_net.h"
+
+static struct virtio_net *vnet_devices[VIRTIO_NET_MAX_DEVICES];
+static int vnet_count;
+static u16 vnet_major;
+static struct worker_thread *vnet_wth;   /* Bottom halves of all the devices */
+
+static ALWAYS_INLINE struct tilck_net_slot *
+vnet_rx_slot(struct virtio_net *vn, u32 n)
+{
+   return (void *)(vn->rx_slots + (n % vn->rx_count) * TILCK_NET_SLOT_SIZE);
+}
+
+static ALWAYS_INLINE struct tilck_net_slot *
+vnet_tx_slot(struct virtio_net *vn, u32 n)
+{
+   return (void *)(vn->tx_slots + (n % vn->tx_count) * TILCK_NET_SLOT_SIZE);
+}
+
+static ALWAYS_INLINE void
+vnet_avail_add(struct virtio_net_queue *q, u16 *idx, u32 slot)
+{
+   q->avail->ring[*idx % q->qsize] = (u16)(2 * slot);
+   (*idx)++;
+}
+
+/* Publishes all the chains added with vnet_avail_add() with a single kick */
+static void
+vnet_avail_publish(struct virtio_net *vn, struct virtio_net_queue *q,
+                   u16 idx, u16 queue)
+{
+   if (idx == q->avail->idx)
+      return;
+
+   virtio_barrier();
+   q->avail->idx = idx;
+   virtio_barrier();
+
+   outw(vn->iobase + VIRTIO_REG_QUEUE_NOTIFY, queue);
+}
+
+/*
+ * Takes the RX slots consumed by the reader (rx_tail in the control page)
+ * and gives them back to the device. Called with vn->lock held.
+ */
+static void vnet_refill_rx(struct virtio_net *vn)
+{
+   struct virtio_net_queue *q = &vn->rxq;
+   u16 idx = q->avail->idx;
+   u32 tail;
+
+   tail = atomic_load_explicit(&vn->ring->rx_tail, mo_acquire);
+
+   /* Ignore any value outside of [rx_tail, rx_head] */
+   if (tail - vn->rx_tail <= vn->rx_head - vn->rx_tail)
+      vn->rx_tail = tail;
+
+   while (vn->rx_posted != vn->rx_tail + vn->rx_count) {
+      vnet_avail_add(q, &idx, vn->rx_posted % vn->rx_count);
+      vn->rx_posted++;
+   }
+
+   vnet_avail_publish(vn, q, idx, VIRTIO_NET_RX_QUEUE);
+}
+
+/*
+ * Submits the TX slots filled by the writer, [tx_head, new tx_head), in a
+ * single batch. Called with vn->lock held.
+ */
+static int vnet_submit_tx(struct virtio_net *vn)
+{
+   struct virtio_net_queue *q = &vn->txq;
+   u16 idx = q->avail->idx;
+   struct tilck_net_slot *s;
+   u32 head, slot, len;
+
+   head = atomic_load_explicit(&vn->ring->tx_head, mo_acquire);
+
+   if (head - vn->tx_head > vn->tx_tail + vn->tx_count - vn->tx_head)
+      return -EINVAL;
+
+   for (; vn->tx_head != head; vn->tx_head++) {
+
+      slot = vn->tx_head % vn->tx_count;
+      s = vnet_tx_slot(vn, vn->tx_head);
+      len = MIN(s->len, (u32)TILCK_NET_MAX_FRAME);
+
+      /* No checksum offload, no segmentation: an all-zero header */
+      bzero(s->dev_hdr, sizeof(s->dev_hdr));
+      q->desc[2 * slot + 1].len = len;
+      vnet_avail_add(q, &idx, slot);
+   }
+
+   vnet_avail_publish(vn, q, idx, VIRTIO_NET_TX_QUEUE);
+   return 0;
+}
+
+/* Collects the used chains of `q`, marking their slots in `done` */
+static bool
+vnet_reap_used(struct virtio_net_queue *q, bool *done, u32 count, char *slots)
+{
+   volatile struct vring_used_elem *e;
+   struct tilck_net_slot *s;
+   bool any = false;
+   u32 slot;
+
+   while (q->last_used != q->used->idx) {
+
+      virtio_barrier();
+      e = &q->used->ring[q->last_used % q->qsize];
+      q->last_used++;
+      slot = e->id / 2;
+
+      if (slot >= count)
+         continue; /* Should never happen */
+
+      if (slots) {
+         s = (void *)(slots + slot * TILCK_NET_SLOT_SIZE);
+         s->len = e->len > VIRTIO_NET_HDR_SIZE
+            ? e->len - VIRTIO_NET_HDR_SIZE
+            : 0;
+      }
+
+      done[slot] = true;
+      any = true;
+   }
+
+   return any;
+}
+
+static void vnet_bottom_half(void *arg)
+{
+   struct virtio_net *vn = arg;
+   bool rx, tx;
+
+   kmutex_lock(&vn->lock);
+   {
+      rx = vnet_reap_used(&vn->rxq, vn->rx_done, vn->rx_count, vn->rx_slots);
+      tx = vnet_reap_used(&vn->txq, vn->tx_done, vn->tx_count, NULL);
+
+      while (vn->rx_head != vn->rx_posted &&
+             vn->rx_done[vn->rx_head % vn->rx_count])
+      {
+         vn->rx_done[vn->rx_head % vn->rx_count] = false;
+         vn->rx_head++;
+      }
+
+      while (vn->tx_tail != vn->tx_head &&
+             vn->tx_done[vn->tx_tail % vn->tx_count])
+      {
+         vn->tx_done[vn->tx_tail % vn->tx_count] = false;
+         vn->tx_tail++;
+      }
+
+      /* Publish the frames: the release pairs with the reader's acquire */
+      atomic_store_explicit(&vn->ring->rx_head, vn->rx_head, mo_release);
+      atomic_store_explicit(&vn->ring->tx_tail, vn->tx_tail, mo_release);
+
+      vnet_refill_rx(vn);
+
+      if (rx)
+         kcond_signal_all(&vn->rx_cond);
+
+      if (tx)
+         kcond_signal_all(&vn->tx_cond);
+   }
+   kmutex_unlock(&vn->lock);
+}
+
+static enum irq_action vnet_irq_handler(void *ctx)
+{
+   struct virtio_net *vn = ctx;
+
+   /* Reading the ISR status acknowledges the interrupt */
+   if (!vn->msix && !(inb(vn->iobase + VIRTIO_REG_ISR) & VIRTIO_ISR_QUEUE))
+      return IRQ_NOT_HANDLED; /* Not an IRQ from this device [irq sharing] */
+
+   if (!wth_enqueue_on(vnet_wth, &vnet_bottom_half, vn))
+      printk("virtio_net: WARNING: hit job queue limit\n");
+
+   return IRQ_HANDLED;
+}
+
+static inline struct virtio_net *vnet_get_dev(fs_handle h)
+{
+   struct devfs_handle *dh = h;
+   return vnet_devices[dh->file->dev_minor];
+}
+
+static ssize_t vnet_read(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct devfs_handle *dh = h;
+   struct virtio_net *vn = vnet_get_dev(h);
+   struct tilck_net_slot *s;
+   ssize_t rc;
+
+   kmutex_lock(&vn->lock);
+
+   vnet_refill_rx(vn);
+
+   while (vn->rx_tail == vn->rx_head) {
+
+      if (dh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&vn->rx_cond, &vn->lock, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   s = vnet_rx_slot(vn, vn->rx_tail);
+   rc = (ssize_t)MIN(size, (size_t)s->len);
+   memcpy(buf, (char *)s + TILCK_NET_FRAME_OFF, (size_t)rc);
+
+   vn->rx_tail++;
+   atomic_store_explicit(&vn->ring->rx_tail, vn->rx_tail, mo_release);
+   vnet_refill_rx(vn);
+
+out:
+   kmutex_unlock(&vn->lock);
+   return rc;
+}
+
+static ssize_t vnet_write(fs_handle h, char *buf, size_t size, offt *pos)
+{
+   struct devfs_handle *dh = h;
+   struct virtio_net *vn = vnet_get_dev(h);
+   struct tilck_net_slot *s;
+   ssize_t rc = (ssize_t)size;
+
+   if (size > TILCK_NET_MAX_FRAME)
+      return -EMSGSIZE;
+
+   kmutex_lock(&vn->lock);
+
+   while (vn->tx_head - vn->tx_tail == vn->tx_count) {
+
+      if (dh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&vn->tx_cond, &vn->lock, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   s = vnet_tx_slot(vn, vn->tx_head);
+   memcpy((char *)s + TILCK_NET_FRAME_OFF, buf, size);
+   s->len = (u32)size;
+
+   atomic_store_explicit(&vn->ring->tx_head, vn->tx_head + 1, mo_release);
+   vnet_submit_tx(vn);
+
+out:
+   kmutex_unlock(&vn->lock);
+   return rc;
+}
+
+static int vnet_ioctl(fs_handle h, ulong request, void *user_argp)
+{
+   struct virtio_net *vn = vnet_get_dev(h);
+   int rc;
+
+   switch (request) {
+
+      case TILCK_IOCTL_NET_SYNC:
+
+         kmutex_lock(&vn->lock);
+         {
+            vnet_refill_rx(vn);
+            rc = vnet_submit_tx(vn);
+         }
+         kmutex_unlock(&vn->lock);
+         return rc;
+
+      case TILCK_IOCTL_NET_GET_MAC:
+
+         if (copy_to_user(user_argp, vn->mac, sizeof(vn->mac)))
+            return -EFAULT;
+
+         return 0;
+
+      default:
+         return -EINVAL;
+   }
+}
+
+static int vnet_read_ready(fs_handle h)
+{
+   struct virtio_net *vn = vnet_get_dev(h);
+   bool ret;
+
+   kmutex_lock(&vn->lock);
+   {
+      vnet_refill_rx(vn);
+      ret = vn->rx_tail != vn->rx_head;
+   }
+   kmutex_unlock(&vn->lock);
+   return ret;
+}
+
+static int vnet_write_ready(fs_handle h)
+{
+   struct virtio_net *vn = vnet_get_dev(h);
+   bool ret;
+
+   kmutex_lock(&vn->lock);
+   {
+      ret = vn->tx_head - vn->tx_tail < vn->tx_count;
+   }
+   kmutex_unlock(&vn->lock);
+   return ret;
+}
+
+static struct kcond *vnet_get_rready_cond(fs_handle h)
+{
+   return &vnet_get_dev(h)->rx_cond;
+}
+
+static struct kcond *vnet_get_wready_cond(fs_handle h)
+{
+   return &vnet_get_dev(h)->tx_cond;
+}
+
+static int
+vnet_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct virtio_net *vn = vnet_get_dev(um->h);
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   size_t pg_count, mapped_cnt;
+
+   if (um->off != 0 || um->len > vn->area_size)
+      return -EINVAL;
+
+   if (flags & VFS_MM_DONT_MMAP)
+      return 0;
+
+   /* The reader writes `rx_tail`, the writer the TX slots and `tx_head` */
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   pg_count = um->len >> PAGE_SHIFT;
+   mapped_cnt = map_pages(pdir,
+                          um->vaddrp,
+                          LIN_VA_TO_PA(vn->ring),
+                          pg_count,
+                          pg_flags);
+
+   if (mapped_cnt != pg_count) {
+      unmap_pages_permissive(pdir, um->vaddrp, mapped_cnt, false);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static int
+vnet_create_device_file(int minor,
+                        enum vfs_entry_type *type,
+                        struct devfs_file_info *nfo)
+{
+   static const struct file_ops static_ops_vnet = {
+      .read = vnet_read,
+      .write = vnet_write,
+      .ioctl = vnet_ioctl,
+      .mmap = vnet_mmap,
+      .munmap = generic_fs_munmap,
+      .read_ready = vnet_read_ready,
+      .write_ready = vnet_write_ready,
+      .get_rready_cond = vnet_get_rready_cond,
+      .get_wready_cond = vnet_get_wready_cond,
+   };
+
+   *type = VFS_CHAR_DEV;
+   nfo->fops = &static_ops_vnet;
+   nfo->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
+   return 0;
+}
+
+static int vnet_register_driver(void)
+{
+   struct driver_info *di;
+   int rc;
+
+   if (!(di = kalloc_obj(struct driver_info)))
+      return -ENOMEM;
+
+   di->name = "vnet";
+   di->create_dev_file = vnet_create_device_file;
+
+   if ((rc = register_driver(di, -1)) < 0) {
+      kfree_obj(di, struct driver_info);
+      return rc;
+   }
+
+   vnet_major = (u16)rc;
+   return 0;
+}
+
+static int
+vnet_setup_queue(struct virtio_net *vn, struct virtio_net_queue *q, u16 idx)
+{
+   ulong ring_paddr;
+
+   outw(vn->iobase + VIRTIO_REG_QUEUE_SEL, idx);
+
+   if (!(q->qsize = inw(vn->iobase + VIRTIO_REG_QUEUE_SIZE)))
+      return -ENODEV;
+
+   if (q->qsize & (q->qsize - 1))
+      return -ENODEV;
+
+   q->ring_size = vring_legacy_size(q->qsize);
+   q->ring_mem =
+      dma_alloc_coherent(q->ring_size, VRING_LEGACY_DMA_MASK, &ring_paddr);
+
+   if (!q->ring_mem)
+      return -ENOMEM;
+
+   q->desc = q->ring_mem;
+   q->avail = q->ring_mem + sizeof(struct vring_desc) * q->qsize;
+   q->used = q->ring_mem + vring_legacy_used_off(q->qsize);
+
+   if (vn->msix) {
+
+      /* All the queues share the vector 0 */
+      outw(vn->iobase + VIRTIO_REG_MSI_QUEUE_VECTOR, 0);
+
+      if (inw(vn->iobase + VIRTIO_REG_MSI_QUEUE_VECTOR) != 0)
+         return -ENODEV;
+   }
+
+   outl(vn->iobase + VIRTIO_REG_QUEUE_PFN, (u32)(ring_paddr >> PAGE_SHIFT));
+   return 0;
+}
+
+static void vnet_free_queue(struct virtio_net_queue *q)
+{
+   if (q->ring_mem) {
+      dma_free_coherent(q->ring_mem, q->ring_size);
+      q->ring_mem = NULL;
+   }
+}
+
+/*
+ * Allocates the area shared with user space and sets up, once and for all,
+ * the pair of descriptors of each slot. The slots never cross a page: each
+ * one of them is physically contiguous.
+ */
+static int vnet_setup_slots(struct virtio_net *vn)
+{
+   struct tilck_net_slot *s;
+   size_t size;
+   ulong pa;
+
+   vn->rx_count = MIN((u32)VIRTIO_NET_RING_SLOTS, vn->rxq.qsize / 2u);
+   vn->tx_count = MIN((u32)VIRTIO_NET_RING_SLOTS, vn->txq.qsize / 2u);
+
+   if (!vn->rx_count || !vn->tx_count)
+      return -ENODEV;
+
+   size = PAGE_SIZE + (vn->rx_count + vn->tx_count) * TILCK_NET_SLOT_SIZE;
+   size = pow2_round_up_at(size, PAGE_SIZE);
+   vn->area_size = size;
+
+   if (!(vn->ring = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return -ENOMEM;
+
+   bzero(vn->ring, size);
+
+   /* These pages will be mapped in the user space, as ramfs does */
+   retain_pageframes_mapped_at(get_kernel_pdir(), vn->ring, size,
+                               PF_TYPE_USHARED);
+
+   vn->rx_slots = (char *)vn->ring + PAGE_SIZE;
+   vn->tx_slots = vn->rx_slots + vn->rx_count * TILCK_NET_SLOT_SIZE;
+
+   *vn->ring = (struct tilck_net_ring) {
+      .magic = TILCK_NET_RING_MAGIC,
+      .version = TILCK_NET_RING_VERSION,
+      .slot_size = TILCK_NET_SLOT_SIZE,
+      .rx_offset = PAGE_SIZE,
+      .rx_count = vn->rx_count,
+      .tx_offset = PAGE_SIZE + vn->rx_count * TILCK_NET_SLOT_SIZE,
+      .tx_count = vn->tx_count,
+   };
+
+   memcpy(vn->ring->mac, vn->mac, sizeof(vn->mac));
+
+   for (u32 i = 0; i < vn->rx_count; i++) {
+
+      s = vnet_rx_slot(vn, i);
+      pa = LIN_VA_TO_PA(s);
+
+      vn->rxq.desc[2 * i] = (struct vring_desc) {
+         .addr = pa + offsetof(struct tilck_net_slot, dev_hdr),
+         .len = VIRTIO_NET_HDR_SIZE,
+         .flags = VRING_DESC_F_NEXT | VRING_DESC_F_WRITE,
+         .next = (u16)(2 * i + 1),
+      };
+
+      vn->rxq.desc[2 * i + 1] = (struct vring_desc) {
+         .addr = pa + TILCK_NET_FRAME_OFF,
+         .len = TILCK_NET_MAX_FRAME,
+         .flags = VRING_DESC_F_WRITE,
+      };
+   }
+
+   for (u32 i = 0; i < vn->tx_count; i++) {
+
+      s = vnet_tx_slot(vn, i);
+      pa = LIN_VA_TO_PA(s);
+
+      vn->txq.desc[2 * i] = (struct vring_desc) {
+         .addr = pa + offsetof(struct tilck_net_slot, dev_hdr),
+         .len = VIRTIO_NET_HDR_SIZE,
+         .flags = VRING_DESC_F_NEXT,
+         .next = (u16)(2 * i + 1),
+      };
+
+      vn->txq.desc[2 * i + 1] = (struct vring_desc) {
+         .addr = pa + TILCK_NET_FRAME_OFF,
+      };
+   }
+
+   return 0;
+}
+
+static void vnet_free_slots(struct virtio_net *vn)
+{
+   if (!vn->ring)
+      return;
+
+   release_pageframes_mapped_at(get_kernel_pdir(), vn->ring, vn->area_size);
+   kfree2(vn->ring, vn->area_size);
+   vn->ring = NULL;
+}
+
+/* MSI-X when available, to avoid sharing the legacy IRQ line */
+static int vnet_setup_irq(struct virtio_net *vn)
+{
+   if (pci_alloc_irq_vectors(vn->pdev, 1, 1, PCI_IRQ_MSIX) > 0) {
+
+      vn->msix = true;
+      vn->irq = pci_irq_vector(vn->pdev, 0);
+
+      /* We don't care about config changes */
+      outw(vn->iobase + VIRTIO_REG_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+      return 0;
+   }
+
+   if (vn->pdev->irq_line >= 16)
+      return -ENODEV; /* No legacy IRQ routed to the device */
+
+   vn->irq = vn->pdev->irq_line;
+   return 0;
+}
+
+static int vnet_init_device(struct virtio_net *vn)
+{
+   struct pci_device_loc loc = vn->pdev->loc;
+   const u32 bar0 = vn->pdev->bars[0];
+   u32 cmd, features;
+   u16 cfg;
+   int rc;
+
+   if (!(bar0 & PCI_BAR_IO))
+      return -ENODEV; /* Not a legacy/transitional device */
+
+   if ((rc = pci_config_read(loc, PCI_CONF_COMMAND, 16, &cmd)))
+      return rc;
+
+   cmd |= PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER;
+
+   if ((rc = pci_config_write(loc, PCI_CONF_COMMAND, 16, cmd)))
+      return rc;
+
+   vn->iobase = (u16)(bar0 & PCI_BAR_IO_MASK);
+
+   /* Reset the device, then tell it that we found it and we can drive it */
+   outb(vn->iobase + VIRTIO_REG_STATUS, 0);
+   outb(vn->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK);
+   outb(vn->iobase + VIRTIO_REG_STATUS,
+        VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+   /* The MAC address is the only optional feature we need */
+   features = inl(vn->iobase + VIRTIO_REG_DEV_FEATURES);
+   outl(vn->iobase + VIRTIO_REG_DRV_FEATURES, features & VIRTIO_NET_F_MAC);
+
+   if ((rc = vnet_setup_irq(vn)))
+      goto fail;
+
+   /* The device config comes after the MSI-X registers, when enabled */
+   cfg = vn->msix ? VIRTIO_REG_DEV_CONFIG_MSIX : VIRTIO_REG_DEV_CONFIG;
+
+   if (features & VIRTIO_NET_F_MAC)
+      for (u32 i = 0; i < sizeof(vn->mac); i++)
+         vn->mac[i] = inb(vn->iobase + cfg + i);
+
+   if ((rc = vnet_setup_queue(vn, &vn->rxq, VIRTIO_NET_RX_QUEUE)))
+      goto fail;
+
+   if ((rc = vnet_setup_queue(vn, &vn->txq, VIRTIO_NET_TX_QUEUE)))
+      goto fail;
+
+   if ((rc = vnet_setup_slots(vn)))
+      goto fail;
+
+   disable_preemption();
+   {
+      if (!vnet_wth)
+         vnet_wth = wth_create_thread("virtio_net", 1, WTH_VNET_QUEUE_SIZE);
+   }
+   enable_preemption();
+
+   if (!vnet_wth) {
+      rc = -ENOMEM;
+      goto fail;
+   }
+
+   if (!vnet_major)
+      if ((rc = vnet_register_driver()) < 0)
+         goto fail;
+
+   kmutex_init(&vn->lock, 0);
+   kcond_init(&vn->rx_cond);
+   kcond_init(&vn->tx_cond);
+
+   list_node_init(&vn->irq_node.node);
+   vn->irq_node.handler = &vnet_irq_handler;
+   vn->irq_node.context = vn;
+   irq_install_handler(vn->irq, &vn->irq_node);
+
+   outb(vn->iobase + VIRTIO_REG_STATUS,
+        VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+   vn->minor = (u16)vnet_count;
+   vnet_devices[vnet_count] = vn;
+
+   kmutex_lock(&vn->lock);
+   {
+      vnet_refill_rx(vn);
+   }
+   kmutex_unlock(&vn->lock);
+
+   snprintk(vn->name, sizeof(vn->name), "vnet%d", vnet_count);
+
+   if ((rc = create_dev_file(vn->name, vnet_major, vn->minor, NULL)) < 0) {
+      outb(vn->iobase + VIRTIO_REG_STATUS, 0);
+      irq_uninstall_handler(vn->irq, &vn->irq_node);
+      vnet_devices[vnet_count] = NULL;
+      goto fail;
+   }
+
+   printk("virtio_net: /dev/%s: %02x:%02x:%02x:%02x:%02x:%02x, irq #%u%s, "
+          "slots: %u RX, %u TX\n",
+          vn->name,
+          vn->mac[0], vn->mac[1], vn->mac[2],
+          vn->mac[3], vn->mac[4], vn->mac[5],
+          vn->irq, vn->msix ? " (MSI-X)" : "",
+          vn->rx_count, vn->tx_count);
+
+   vnet_count++;
+   return 0;
+
+fail:
+   outb(vn->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+
+   if (vn->msix) {
+      pci_free_irq_vectors(vn->pdev);
+      vn->msix = false;
+   }
+
+   vnet_free_slots(vn);
+   vnet_free_queue(&vn->rxq);
+   vnet_free_queue(&vn->txq);
+   return rc;
+}
+
+static void init_virtio_net(void)
+{
+   struct pci_device *pdev = NULL;
+   struct virtio_net *vn;
+   int rc;
+
+   while (vnet_count < VIRTIO_NET_MAX_DEVICES) {
+
+      pdev = pci_find_device(VIRTIO_PCI_VENDOR_ID,
+                             VIRTIO_PCI_NET_DEVICE_ID,
+                             pdev);
+      if (!pdev)
+         break;
+
+      if (!(vn = kzalloc_obj(struct virtio_net))) {
+         printk("virtio_net: out of memory\n");
+         break;
+      }
+
+      vn->pdev = pdev;
+
+      if ((rc = vnet_init_device(vn))) {
+
+         printk("virtio_net: failed to init device %02x:%02x.%u: %d\n",
+                pdev->loc.bus, pdev->loc.dev, pdev->loc.func, rc);
+
+         kfree_obj(vn, struct virtio_net);
+      }
+   }
+}
+
+static struct module virtio_net_module = {
+
+   .name = "virtio_net",
+   .priority = MOD_virtio_net_prio,
+   .init = &init_virtio_net,
+   .deps = MOD_DEPS("pci"),
+   .flags = MODULE_FL_ASYNC,
+};
+
+REGISTER_MODULE(&virtio_net_module);
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/tilck_net.h>
+#include <tilck/kernel/irq.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/mods/pci.h>
+#include <tilck/mods/virtio.h>
+
+#define VIRTIO_PCI_NET_DEVICE_ID         0x1000   /* transitional device */
+
+#define VIRTIO_NET_F_MAC                 (1 << 5)
+
+#define VIRTIO_NET_RX_QUEUE                   0
+#define VIRTIO_NET_TX_QUEUE                   1
+
+/* Without VIRTIO_NET_F_MRG_RXBUF, the header preceding each frame */
+#define VIRTIO_NET_HDR_SIZE                  10
+
+#define VIRTIO_NET_MAX_DEVICES                4
+
+/* Slots per ring: the actual count might be lower, if the queue is small */
+#define VIRTIO_NET_RING_SLOTS                64
+
+STATIC_ASSERT(sizeof(struct tilck_net_slot) == TILCK_NET_FRAME_OFF);
+STATIC_ASSERT(sizeof(struct tilck_net_ring) <= PAGE_SIZE);
+STATIC_ASSERT(VIRTIO_NET_HDR_SIZE ==
+              sizeof(((struct tilck_net_slot *)0)->dev_hdr));
+
+struct virtio_net_queue {
+
+   u16 qsize;
+   u16 last_used;
+   void *ring_mem;
+   size_t ring_size;
+   volatile struct vring_desc *desc;
+   volatile struct vring_avail *avail;
+   volatile struct vring_used *used;
+};
+
+struct virtio_net {
+
+   struct pci_device *pdev;
+   struct irq_handler_node irq_node;
+   u16 iobase;
+   u8 irq;
+   bool msix;
+   u16 minor;
+   char name[8];
+   u8 mac[6];
+
+   struct virtio_net_queue rxq;
+   struct virtio_net_queue txq;
+
+   /*
+    * The control page and the slots, mapped by user space. Each slot uses
+    * a fixed pair of descriptors: 2*N for the header and 2*N+1 for the frame.
+    */
+   struct tilck_net_ring *ring;
+   char *rx_slots;
+   char *tx_slots;
+   size_t area_size;
+   u32 rx_count;
+   u32 tx_count;
+
+   /*
+    * Our copies of the ring indexes: the ones in the control page can be
+    * overwritten by user space at any time. The RX slots in the range
+    * [rx_head, rx_posted) are owned by the device.
+    */
+   u32 rx_head;
+   u32 rx_tail;
+   u32 rx_posted;
+   u32 tx_head;
+   u32 tx_tail;
+
+   /* The device can complete the slots out of order */
+   bool rx_done[VIRTIO_NET_RING_SLOTS];
+   bool tx_done[VIRTIO_NET_RING_SLOTS];
+
+   struct kmutex lock;
+   struct kcond rx_cond;         /* signaled when frames are received */
+   struct kcond tx_cond;         /* signaled when TX slots become free */
+};
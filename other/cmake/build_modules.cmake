@@ -217,3 +217,64 @@ function(build_all_modules TARGET_NAME)
 
    target_link_libraries(${TARGET_NAME} -Wl,--no-whole-archive)
 endfunction()
+
+#
+# Build a module as a relocatable ELF object, <modname>.ko, loaded at runtime
+# by the kernel from the initrd (see kernel/module_loader.c). Must be called
+# after build_all_modules(), with the same ACTUAL_KERNEL_ONLY_FLAGS.
+#
+
+function(build_loadable_module modname)
+
+   set(KO_FILE ${CMAKE_BINARY_DIR}/modules/${modname}.ko)
+   separate_arguments(C_FLAGS_LIST UNIX_COMMAND "${CMAKE_C_FLAGS}")
+
+   file(
+      GLOB
+      KMOD_SOURCES
+      ${GLOB_CONF_DEP}
+      "${CMAKE_SOURCE_DIR}/modules/${modname}/*.c"
+      "${CMAKE_SOURCE_DIR}/modules/${modname}/${ARCH}/*.c"
+      "${CMAKE_SOURCE_DIR}/modules/${modname}/${ARCH_FAMILY}/*.c"
+   )
+
+   add_library(kmod_${modname} STATIC EXCLUDE_FROM_ALL ${KMOD_SOURCES})
+
+   set_target_properties(
+
+      kmod_${modname}
+
+      PROPERTIES
+         COMPILE_FLAGS
+            "${KERNEL_FLAGS} ${ACTUAL_KERNEL_ONLY_FLAGS} -DKERNEL_LOADABLE_MODULE"
+   )
+
+   add_custom_command(
+
+      OUTPUT
+         ${KO_FILE}
+      COMMAND
+         mkdir -p ${CMAKE_BINARY_DIR}/modules
+      COMMAND
+         ${CMAKE_C_COMPILER} ${C_FLAGS_LIST} -nostdlib -r -o ${KO_FILE}
+            -Wl,--whole-archive $<TARGET_FILE:kmod_${modname}>
+            -Wl,--no-whole-archive
+      COMMAND
+         ${CMAKE_STRIP} --strip-debug ${KO_FILE}
+      DEPENDS
+         kmod_${modname}
+      COMMENT
+         "Linking the loadable module ${modname}.ko"
+      VERBATIM
+   )
+
+   add_custom_target(kmod_${modname}_ko DEPENDS ${KO_FILE})
+endfunction()
+
+function(build_loadable_modules)
+
+   foreach (mod ${LOADABLE_MODULES})
+      build_loadable_module(${mod})
+   endforeach()
+
+endfunction()
@@ -38,6 +38,47 @@ if (TEST_GCOV)
    set(GCOV_LINK_FLAGS "-fprofile-arcs -lgcov")
 endif()
 
+if (KERNEL_PGO_PROFILE)
+
+   if (KERNEL_GCOV)
+      message(FATAL_ERROR "KERNEL_PGO_PROFILE requires KERNEL_GCOV=0")
+   endif()
+
+   if (NOT EXISTS ${KERNEL_PGO_PROFILE}/CMakeCache.txt)
+      message(FATAL_ERROR "KERNEL_PGO_PROFILE='${KERNEL_PGO_PROFILE}' "
+                          "is not a build directory")
+   endif()
+
+   if (${KERNEL_SYSCC} OR ${USE_SYSCC})
+      set(KERNEL_CC_ID "${CMAKE_C_COMPILER_ID}")
+      set(KERNEL_CC_VER "${CMAKE_C_COMPILER_VERSION}")
+   else()
+      set(KERNEL_CC_ID "GNU")
+      set(KERNEL_CC_VER "${GCC_TC_VER}")
+   endif()
+
+   if (NOT KERNEL_CC_ID STREQUAL "GNU")
+      message(FATAL_ERROR "KERNEL_PGO_PROFILE is supported only with GCC")
+   endif()
+
+   # The kernel's counters are not updated atomically: IRQs can make them
+   # slightly inconsistent, hence -fprofile-correction. The functions whose
+   # CFG differs from the instrumented build (because KERNEL_GCOV=1 there)
+   # just don't get a profile: that must not break the build.
+
+   set(
+      KERNEL_PGO_FLAGS_LIST
+
+      -fprofile-use
+      -fprofile-correction
+      -Wno-error=coverage-mismatch
+   )
+
+   if (${KERNEL_CC_VER} VERSION_GREATER_EQUAL "9.0.0")
+      list(APPEND KERNEL_PGO_FLAGS_LIST -Wno-error=missing-profile)
+   endif()
+endif()
+
 set(
    DBG_FLAGS_LIST
 
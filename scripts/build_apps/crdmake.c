@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * crdmake: converts a FAT ramdisk image to the compressed ramdisk (CRD)
+ * format described in <tilck/common/crd.h>.
+ *
+ * The compressor (see lz4_compress_block()) is a simple greedy one: not as
+ * good as the reference implementation, but, being the initrd made mostly of
+ * ELF binaries, the ratio is good enough. Each block is verified by
+ * decompressing it back.
+ */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/fat32_base.h>
+#include <tilck/common/crd.h>
+#include <tilck/common/lz4.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEFAULT_BLOCK_SHIFT                   15   /* 32 KB */
+#define HASH_BITS                             14
+
+static u32 hash_table[1 << HASH_BITS];
+
+static u8 *read_file(const char *path, u32 *size)
+{
+   FILE *fh;
+   long len;
+   u8 *buf;
+
+   if (!(fh = fopen(path, "rb"))) {
+      fprintf(stderr, "ERROR: cannot open '%s': %s\n", path, strerror(errno));
+      return NULL;
+   }
+
+   fseek(fh, 0, SEEK_END);
+   len = ftell(fh);
+   fseek(fh, 0, SEEK_SET);
+
+   if (len <= 0 || !(buf = malloc((size_t)len))) {
+      fprintf(stderr, "ERROR: cannot read '%s'\n", path);
+      fclose(fh);
+      return NULL;
+   }
+
+   if (fread(buf, 1, (size_t)len, fh) != (size_t)len) {
+      fprintf(stderr, "ERROR: cannot read '%s'\n", path);
+      free(buf);
+      fclose(fh);
+      return NULL;
+   }
+
+   fclose(fh);
+   *size = (u32)len;
+   return buf;
+}
+
+static int
+write_crd(FILE *out, const u8 *img, u32 size, u32 block_shift)
+{
+   const u32 bsize = 1u << block_shift;
+   const u32 blocks = (size + bsize - 1) / bsize;
+   const size_t hdr_size = sizeof(struct crd_hdr) + 4 * (blocks + 1);
+   struct crd_hdr *h = calloc(1, hdr_size);
+   u8 *cbuf = malloc(bsize);
+   u8 *vbuf = malloc(bsize);
+   u32 off = (u32)hdr_size;
+   int rc = 1;
+
+   if (!h || !cbuf || !vbuf)
+      goto out;
+
+   *h = (struct crd_hdr) {
+      .magic = CRD_MAGIC,
+      .block_shift = block_shift,
+      .blocks = blocks,
+      .size = size,
+   };
+
+   /* Leave room for the header: we'll write it at the end */
+   if (fseek(out, (long)hdr_size, SEEK_SET) < 0)
+      goto out;
+
+   for (u32 i = 0; i < blocks; i++) {
+
+      const u8 *src = img + ((size_t)i << block_shift);
+      const u32 len = crd_block_size(h, i);
+      u32 clen = lz4_compress_block(src, len, cbuf, len,
+                                    hash_table, HASH_BITS);
+
+      if (clen) {
+
+         if (lz4_decompress_block(cbuf, clen, vbuf, len) != (int)len ||
+             memcmp(vbuf, src, len))
+         {
+            fprintf(stderr, "ERROR: block %u: verification failed\n", i);
+            goto out;
+         }
+
+      } else {
+
+         memcpy(cbuf, src, len);   /* incompressible: store it as it is */
+         clen = len;
+      }
+
+      if (fwrite(cbuf, 1, clen, out) != clen)
+         goto out;
+
+      h->offsets[i] = off;
+      off += clen;
+   }
+
+   h->offsets[blocks] = off;
+
+   if (fseek(out, 0, SEEK_SET) < 0)
+      goto out;
+
+   if (fwrite(h, 1, hdr_size, out) != hdr_size)
+      goto out;
+
+   printf("crdmake: %u -> %u bytes (%u%%)\n", size, off, 100 * off / size);
+   rc = 0;
+
+out:
+   free(vbuf);
+   free(cbuf);
+   free(h);
+   return rc;
+}
+
+static void show_help_and_exit(void)
+{
+   printf("Syntax: crdmake <FAT image> <output file> [<block shift>]\n");
+   exit(1);
+}
+
+int main(int argc, char **argv)
+{
+   u32 block_shift = DEFAULT_BLOCK_SHIFT;
+   u32 size;
+   FILE *out;
+   u8 *img;
+   int rc;
+
+   if (argc < 3)
+      show_help_and_exit();
+
+   if (argc > 3)
+      block_shift = (u32)atoi(argv[3]);
+
+   if (!IN_RANGE_INC(block_shift, CRD_MIN_BLOCK_SHIFT, CRD_MAX_BLOCK_SHIFT)) {
+      fprintf(stderr, "ERROR: block shift must be in [%u, %u]\n",
+              CRD_MIN_BLOCK_SHIFT, CRD_MAX_BLOCK_SHIFT);
+      return 1;
+   }
+
+   if (!(img = read_file(argv[1], &size)))
+      return 1;
+
+   if (fat_get_type((void *)img) == fat_unknown) {
+      fprintf(stderr, "ERROR: '%s' is not a FAT image\n", argv[1]);
+      free(img);
+      return 1;
+   }
+
+   /*
+    * Compact the clusters here, as the bootloaders do for the uncompressed
+    * ramdisks: they cannot do that on a compressed image. Then, drop the
+    * free clusters at the end.
+    */
+   if (fat_get_first_free_cluster_off((void *)img) < size) {
+      fat_compact_clusters((void *)img);
+      size = MIN(size, fat_calculate_used_bytes((void *)img));
+   }
+
+   if (!(out = fopen(argv[2], "wb"))) {
+      fprintf(stderr,
+              "ERROR: cannot open '%s': %s\n", argv[2], strerror(errno));
+      free(img);
+      return 1;
+   }
+
+   rc = write_crd(out, img, size, block_shift);
+   fclose(out);
+   free(img);
+
+   if (rc)
+      fprintf(stderr, "ERROR: failed to write '%s'\n", argv[2]);
+
+   return rc;
+}
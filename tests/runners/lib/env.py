@@ -18,6 +18,7 @@ IN_AZURE = env_bool('AZURE_HTTP_USER_AGENT')
 CI = env_bool('CI')
 DUMP_COV = env_bool('DUMP_COV')
 REPORT_COV = env_bool('REPORT_COV')
+MERGE_GCDA = env_bool('MERGE_GCDA')
 VERBOSE = env_bool('VERBOSE')
 IN_ANY_CI = Const(IN_TRAVIS.val or IN_CIRCLECI.val or IN_AZURE.val or CI.val)
 
@@ -6,6 +6,7 @@ import sys
 import fcntl
 import base64
 import zlib
+import struct
 import subprocess
 
 from enum import Enum
@@ -17,6 +18,7 @@ TEST_TYPES_PRETTY = ['Self tests', 'Shell cmd tests', 'Interactive tests']
 
 KERNEL_DUMP_GCDA_STR = '** GCOV gcda files **'
 KERNEL_DUMP_GCDA_END_STR = '** GCOV gcda files END **'
+GCOV_TAG_FUNCTION = 0x01000000
 
 # Classes
 class Fail(Enum):
@@ -104,13 +106,65 @@ def run_gen_coverage_report_tool(gen_cov_tool):
    return True
 
 
-def write_gcda_file(file, b64data):
+def merge_gcda_data(old, new):
+
+   """
+   Sums the counters of two gcda files of the same object file, in the format
+   written by the kernel (see kernel/gcov.c). The kernel builds use only
+   -fprofile-arcs, so all the counters are arc counters and can be summed.
+   Returns None if the two files don't match.
+   """
+
+   if len(old) != len(new) or len(new) % 4 or old[:12] != new[:12]:
+      return None
+
+   n = len(new) // 4
+   a = list(struct.unpack('<{}I'.format(n), old))
+   b = struct.unpack('<{}I'.format(n), new)
+   i = 3 # skip the header: magic, version, stamp
+
+   while i + 1 < n:
+
+      tag, length = b[i], b[i + 1]
+
+      if a[i] != tag or a[i + 1] != length or i + 2 + length > n:
+         return None
+
+      i += 2
+
+      if tag == GCOV_TAG_FUNCTION:
+
+         if a[i:i + length] != list(b[i:i + length]):
+            return None # different checksums
+
+      else:
+
+         for k in range(i, i + length, 2):
+            val = (a[k] | a[k + 1] << 32) + (b[k] | b[k + 1] << 32)
+            val = min(val, (1 << 64) - 1)
+            a[k], a[k + 1] = val & 0xffffffff, val >> 32
+
+      i += length
+
+   return struct.pack('<{}I'.format(n), *a)
+
+def write_gcda_file(file, b64data, merge = False):
 
    try:
 
       data_compressed = base64.b64decode(b64data)
       data = zlib.decompress(data_compressed)
 
+      if merge and os.path.isfile(file):
+
+         with open(file, 'rb') as fh:
+            merged = merge_gcda_data(fh.read(), data)
+
+         if merged is None:
+            msg_print("WARNING: cannot merge '{}': overwrite it".format(file))
+         else:
+            data = merged
+
       with open(file, 'wb') as fh:
          fh.write(data)
 
@@ -6,6 +6,7 @@
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/cmdline.h>
+#include <tilck/kernel/lock_stats.h>
 #include <tilck/kernel/self_tests.h>
 
 static int no_deadlock_set_elems;
@@ -108,6 +109,11 @@ void debug_check_for_deadlock(void)
    enable_preemption();
 
    if (candidates > 0 && !found_runnable) {
+
+#if LOCK_STATS
+      lock_stats_dump();
+#endif
+
       panic("No runnable task found in no_deadlock_set [%d elems]", candidates);
    }
 }
@@ -174,8 +180,14 @@ void debug_check_for_any_progress(void)
          if (nds_should_skip_progress_check(i, &tid))
             continue;
 
-         if (no_deadlock_set_progress[i] == no_deadlock_set_progress_old[i])
+         if (no_deadlock_set_progress[i] == no_deadlock_set_progress_old[i]) {
+
+#if LOCK_STATS
+            lock_stats_dump();
+#endif
+
             panic("[deadlock?] No progress for tid %d", tid);
+         }
 
          candidates++;
       }
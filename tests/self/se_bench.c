@@ -0,0 +1,310 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/mod_fb.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sort.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/bench.h>
+#include <tilck/kernel/self_tests.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/mods/fb_console.h>
+
+static long bench_cmp_u64(const void *a, const void *b)
+{
+   const u64 x = *(const u64 *)a;
+   const u64 y = *(const u64 *)b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+void
+bench_report(const char *name,
+             u32 iters,
+             u32 ops,
+             const struct bench_result *res)
+{
+   printk(NO_PREFIX "{\"bench\": \"%s\", \"unit\": \"cycles\", "
+          "\"iters\": %u, \"ops\": %u, \"min\": %" PRIu64 ", "
+          "\"median\": %" PRIu64 ", \"avg\": %" PRIu64 ", "
+          "\"max\": %" PRIu64 "}\n",
+          name, iters, ops, res->min, res->median, res->avg, res->max);
+}
+
+int bench_run(const struct bench *b, struct bench_result *res)
+{
+   const u32 ops = b->ops ? b->ops : 1;
+   u64 *samples, start, tot = 0;
+
+   ASSERT(b->iters > 0 && b->iters <= BENCH_MAX_ITERS);
+
+   if (!(samples = kalloc_array_obj(u64, b->iters)))
+      return -ENOMEM;
+
+   for (u32 i = 0; i < b->warmup; i++)
+      b->func(b->arg);
+
+   for (u32 i = 0; i < b->iters; i++) {
+      start = RDTSC();
+      b->func(b->arg);
+      samples[i] = RDTSC() - start;
+   }
+
+   intro_sort_generic(samples, sizeof(u64), b->iters, &bench_cmp_u64);
+
+   for (u32 i = 0; i < b->iters; i++)
+      tot += samples[i];
+
+   *res = (struct bench_result) {
+      .min = samples[0] / ops,
+      .median = samples[b->iters / 2] / ops,
+      .avg = tot / b->iters / ops,
+      .max = samples[b->iters - 1] / ops,
+   };
+
+   kfree_array_obj(samples, u64, b->iters);
+   bench_report(b->name, b->iters, ops, res);
+   return 0;
+}
+
+/* ----------------------- kmalloc size classes ---------------------------- */
+
+#define KMALLOC_BENCH_OPS                     16
+
+static void *kmalloc_bench_ptrs[KMALLOC_BENCH_OPS];
+
+static void kmalloc_bench_func(void *arg)
+{
+   const size_t size = (size_t)arg;
+
+   for (int i = 0; i < KMALLOC_BENCH_OPS; i++) {
+
+      if (!(kmalloc_bench_ptrs[i] = kmalloc(size)))
+         panic("Unable to allocate %zu bytes\n", size);
+   }
+
+   for (int i = 0; i < KMALLOC_BENCH_OPS; i++)
+      kfree2(kmalloc_bench_ptrs[i], size);
+}
+
+static void bench_kmalloc(void)
+{
+   struct bench_result res;
+   char name[32];
+
+   for (size_t s = 16; s <= 64 * KB; s *= 2) {
+
+      if (se_is_stop_requested())
+         break;
+
+      snprintk(name, sizeof(name), "kmalloc_%zu", s);
+
+      struct bench b = {
+         .name = name,
+         .warmup = 16,
+         .iters = 256,
+         .ops = KMALLOC_BENCH_OPS,
+         .func = &kmalloc_bench_func,
+         .arg = (void *)s,
+      };
+
+      if (bench_run(&b, &res))
+         panic("bench_run() failed");
+   }
+}
+
+/* ---------------------------- context switch ----------------------------- */
+
+static volatile bool ctx_switch_bench_stop;
+
+static void ctx_switch_partner(void *unused)
+{
+   while (!ctx_switch_bench_stop)
+      kernel_yield();
+}
+
+static void ctx_switch_bench_func(void *unused)
+{
+   /* Switch to the partner thread and back: two context switches */
+   kernel_yield();
+}
+
+static void bench_ctx_switch(void)
+{
+   struct bench_result res;
+   int tid;
+
+   struct bench b = {
+      .name = "kthread_ctx_switch_roundtrip",
+      .warmup = 64,
+      .iters = 1024,
+      .func = &ctx_switch_bench_func,
+   };
+
+   ctx_switch_bench_stop = false;
+
+   if ((tid = kthread_create(&ctx_switch_partner, 0, NULL)) < 0)
+      panic("Unable to create the partner thread");
+
+   if (bench_run(&b, &res))
+      panic("bench_run() failed");
+
+   ctx_switch_bench_stop = true;
+   kthread_join(tid, true);
+}
+
+/* ---------------------------- path resolution ---------------------------- */
+
+static void path_resolve_bench_func(void *arg)
+{
+   struct vfs_path p;
+
+   if (vfs_resolve(arg, &p, false, true))
+      panic("vfs_resolve(%s) failed", (const char *)arg);
+
+   vfs_fs_shunlock(p.fs);
+   release_obj(p.fs);
+}
+
+static void bench_path_resolve(void)
+{
+   static const char *const paths[] = {
+      "/",
+      "/dev/tty",
+      "/dev/../dev/./tty",
+   };
+
+   static const char *const names[] = {
+      "vfs_resolve_root",
+      "vfs_resolve_2_comps",
+      "vfs_resolve_5_comps",
+   };
+
+   struct bench_result res;
+
+   for (int i = 0; i < ARRAY_SIZE(paths); i++) {
+
+      struct bench b = {
+         .name = names[i],
+         .warmup = 16,
+         .iters = 1024,
+         .func = &path_resolve_bench_func,
+         .arg = (void *)paths[i],
+      };
+
+      if (bench_run(&b, &res))
+         panic("bench_run() failed");
+   }
+}
+
+/* ------------------------------- memcpy ---------------------------------- */
+
+#define MEMCPY_BENCH_BUF_SIZE           (64 * KB)
+
+static char *memcpy_bench_src;
+static char *memcpy_bench_dst;
+
+static void memcpy_bench_plain(void *arg)
+{
+   memcpy(memcpy_bench_dst, memcpy_bench_src, (size_t)arg);
+}
+
+static void memcpy_bench_fast(void *arg)
+{
+   fast_memcpy(memcpy_bench_dst, memcpy_bench_src, (size_t)arg);
+}
+
+static void memcpy_bench_page_plain(void *unused)
+{
+   memcpy32(memcpy_bench_dst, memcpy_bench_src, PAGE_SIZE / 4);
+}
+
+static void memcpy_bench_page_fast(void *unused)
+{
+   fast_copy_page(memcpy_bench_dst, memcpy_bench_src);
+}
+
+static void memcpy_bench_one(const char *name, void (*func)(void *), size_t s)
+{
+   struct bench_result res;
+
+   struct bench b = {
+      .name = name,
+      .warmup = 16,
+      .iters = 256,
+      .func = func,
+      .arg = (void *)s,
+   };
+
+   if (bench_run(&b, &res))
+      panic("bench_run() failed");
+}
+
+/*
+ * Compare the plain memcpy() with fast_memcpy(), the one used by the bulk
+ * data paths (ramfs, pipes), and the COW page copy. The results are cycles
+ * per call: divide the size by them to get the bytes per cycle.
+ */
+static void bench_memcpy(void)
+{
+   char name[32];
+
+   memcpy_bench_src = kmalloc(MEMCPY_BENCH_BUF_SIZE);
+   memcpy_bench_dst = kmalloc(MEMCPY_BENCH_BUF_SIZE);
+
+   if (!memcpy_bench_src || !memcpy_bench_dst)
+      panic("Unable to allocate the memcpy bench buffers");
+
+   memset(memcpy_bench_src, 0xaa, MEMCPY_BENCH_BUF_SIZE);
+
+   for (size_t s = 256; s <= MEMCPY_BENCH_BUF_SIZE; s *= 4) {
+
+      if (se_is_stop_requested())
+         break;
+
+      snprintk(name, sizeof(name), "memcpy_%zu", s);
+      memcpy_bench_one(name, &memcpy_bench_plain, s);
+
+      snprintk(name, sizeof(name), "fast_memcpy_%zu", s);
+      memcpy_bench_one(name, &memcpy_bench_fast, s);
+   }
+
+   if (!se_is_stop_requested()) {
+      memcpy_bench_one("copy_page_memcpy32", &memcpy_bench_page_plain, 0);
+      memcpy_bench_one("fast_copy_page", &memcpy_bench_page_fast, 0);
+   }
+
+   kfree2(memcpy_bench_src, MEMCPY_BENCH_BUF_SIZE);
+   kfree2(memcpy_bench_dst, MEMCPY_BENCH_BUF_SIZE);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void selftest_bench(void)
+{
+   bench_kmalloc();
+
+   if (!se_is_stop_requested())
+      bench_ctx_switch();
+
+   if (!se_is_stop_requested())
+      bench_path_resolve();
+
+   if (!se_is_stop_requested())
+      bench_memcpy();
+
+   if (MOD_fb && use_framebuffer() && !se_is_stop_requested())
+      fb_run_benchmarks();
+
+   if (se_is_stop_requested())
+      se_interrupted_end();
+   else
+      se_regular_end();
+}
+
+REGISTER_SELF_TEST(bench, se_long, &selftest_bench)
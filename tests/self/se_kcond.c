@@ -91,3 +91,68 @@ void selftest_kcond()
 }
 
 REGISTER_SELF_TEST(kcond, se_short, &selftest_kcond)
+
+static int kcond_one_waiting;
+static int kcond_one_woken;
+
+static void kcond_one_waiter(void *arg)
+{
+   kmutex_lock(&cond_mutex);
+   {
+      kcond_one_waiting++;
+
+      if (!kcond_wait(&cond, &cond_mutex, KCOND_WAIT_FOREVER))
+         panic("[kcond_one]: kcond_wait() FAILED\n");
+
+      kcond_one_woken++;
+   }
+   kmutex_unlock(&cond_mutex);
+}
+
+void selftest_kcond_one()
+{
+   int tids[3];
+   kmutex_init(&cond_mutex, 0);
+   kcond_init(&cond);
+   kcond_one_waiting = kcond_one_woken = 0;
+
+   for (int i = 0; i < ARRAY_SIZE(tids); i++) {
+      tids[i] = kthread_create(&kcond_one_waiter, 0, NULL);
+      VERIFY(tids[i] > 0);
+   }
+
+   /* Once we get the mutex with all of them counted, they're all waiting */
+   while (true) {
+
+      bool all_waiting;
+
+      kmutex_lock(&cond_mutex);
+      all_waiting = kcond_one_waiting == ARRAY_SIZE(tids);
+      kmutex_unlock(&cond_mutex);
+
+      if (all_waiting)
+         break;
+
+      kernel_sleep(1);
+   }
+
+   for (int i = 0; i < ARRAY_SIZE(tids); i++) {
+
+      kmutex_lock(&cond_mutex);
+      kcond_signal_one(&cond);
+      kmutex_unlock(&cond_mutex);
+
+      kernel_sleep(TIMER_HZ / 10);
+
+      kmutex_lock(&cond_mutex);
+      printk("[kcond_one]: signal %d, woken: %d\n", i + 1, kcond_one_woken);
+      VERIFY(kcond_one_woken == i + 1);
+      kmutex_unlock(&cond_mutex);
+   }
+
+   kthread_join_all(tids, ARRAY_SIZE(tids), true);
+   kcond_destory(&cond);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(kcond_one, se_short, &selftest_kcond_one)
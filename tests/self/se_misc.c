@@ -8,6 +8,8 @@
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/timer.h>
+#include <tilck/kernel/elf_utils.h>
+#include <tilck/kernel/static_key.h>
 
 void simple_test_kthread(void *arg)
 {
@@ -107,3 +109,117 @@ void selftest_join()
 }
 
 REGISTER_SELF_TEST(join, se_med, &selftest_join)
+
+static int ksyms_check_sym(struct elf_symbol_info *info, void *arg)
+{
+   const ulong va = (ulong)info->vaddr + info->size / 2;
+   const char *name;
+   u32 *checked = arg;
+   u32 size;
+   long off;
+
+   if (!info->size)
+      return 0;
+
+   /* Aliases are fine: just the returned symbol must contain the address */
+   name = find_sym_at_addr(va, &off, &size);
+   VERIFY(name != NULL);
+   VERIFY(off >= 0 && (ulong)off < size);
+   VERIFY(find_sym_at_addr(va, &off, &size) == name);
+   (*checked)++;
+   return 0;
+}
+
+void selftest_ksyms()
+{
+   u32 checked = 0;
+   u64 start, elapsed;
+
+   foreach_symbol(ksyms_check_sym, &checked);
+   printk("[selftest ksyms] checked %u symbols\n", checked);
+
+   start = RDTSC();
+
+   for (u32 i = 0; i < 10000; i++)
+      find_sym_at_addr((ulong)&selftest_ksyms + i % 64, NULL, NULL);
+
+   elapsed = RDTSC() - start;
+   printk("[selftest ksyms] avg lookup cost: %" PRIu64 " cycles\n",
+          elapsed / 10000);
+
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(ksyms, se_short, &selftest_ksyms)
+
+static DEFINE_STATIC_KEY(se_test_key);
+
+static NO_INLINE bool se_test_key_check(void)
+{
+   return static_branch_unlikely(&se_test_key);
+}
+
+void selftest_static_keys()
+{
+   u64 start, elapsed;
+
+   VERIFY(!se_test_key_check());
+
+   static_key_set(&se_test_key, true);
+   VERIFY(static_key_enabled(&se_test_key));
+   VERIFY(se_test_key_check());
+
+   static_key_set(&se_test_key, false);
+   VERIFY(!se_test_key_check());
+
+   start = RDTSC();
+
+   for (u32 i = 0; i < 10000; i++)
+      se_test_key_check();
+
+   elapsed = RDTSC() - start;
+   printk("[selftest static_keys] avg disabled check cost: %" PRIu64
+          " cycles\n", elapsed / 10000);
+
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(static_keys, se_short, &selftest_static_keys)
+
+static volatile bool se_cond_resched_flag;
+
+static void se_cond_resched_thread(void *arg)
+{
+   se_cond_resched_flag = true;
+}
+
+void selftest_cond_resched()
+{
+   u64 start = get_ticks();
+   u32 yields = 0;
+   int tid;
+
+   se_cond_resched_flag = false;
+   disable_preemption();
+
+   if ((tid = kthread_create(se_cond_resched_thread, 0, NULL)) < 0)
+      panic("Unable to create se_cond_resched_thread");
+
+   /*
+    * Busy loop with the preemption disabled: without the preemption point,
+    * the new thread could not run until enable_preemption().
+    */
+   while (!se_cond_resched_flag && get_ticks() - start < 2 * TIMER_HZ) {
+      yields += cond_resched_preempt_disabled();
+      VERIFY(get_preempt_disable_count() == 1);
+   }
+
+   enable_preemption();
+   kthread_join(tid, true);
+
+   printk("[selftest cond_resched] yields: %u\n", yields);
+   VERIFY(se_cond_resched_flag);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(cond_resched, se_short, &selftest_cond_resched)
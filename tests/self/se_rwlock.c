@@ -300,3 +300,54 @@ end:
 }
 
 REGISTER_SELF_TEST(rwlock_wp, se_med, &selftest_rwlock_wp)
+
+#define RWLOCK_PERF_ITERS      100000
+
+/*
+ * Cost of the uncontended lock operations, compared to a kmutex: the shared
+ * ones of a rwlock_wp are expected to be the cheapest, as they don't touch
+ * its inner mutex.
+ */
+void selftest_rwlock_wp_perf()
+{
+   struct kmutex m;
+   u64 start, shared, exclusive, mutex;
+
+   rwlock_wp_init(&test_rwlwp, false);
+   kmutex_init(&m, 0);
+
+   start = RDTSC();
+
+   for (u32 i = 0; i < RWLOCK_PERF_ITERS; i++) {
+      rwlock_wp_shlock(&test_rwlwp);
+      rwlock_wp_shunlock(&test_rwlwp);
+   }
+
+   shared = (RDTSC() - start) / RWLOCK_PERF_ITERS;
+   start = RDTSC();
+
+   for (u32 i = 0; i < RWLOCK_PERF_ITERS; i++) {
+      rwlock_wp_exlock(&test_rwlwp);
+      rwlock_wp_exunlock(&test_rwlwp);
+   }
+
+   exclusive = (RDTSC() - start) / RWLOCK_PERF_ITERS;
+   start = RDTSC();
+
+   for (u32 i = 0; i < RWLOCK_PERF_ITERS; i++) {
+      kmutex_lock(&m);
+      kmutex_unlock(&m);
+   }
+
+   mutex = (RDTSC() - start) / RWLOCK_PERF_ITERS;
+
+   printk("rwlock_wp shlock + shunlock: %" PRIu64 " cycles\n", shared);
+   printk("rwlock_wp exlock + exunlock: %" PRIu64 " cycles\n", exclusive);
+   printk("kmutex lock + unlock:        %" PRIu64 " cycles\n", mutex);
+
+   kmutex_destroy(&m);
+   rwlock_wp_destroy(&test_rwlwp);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(rwlock_wp_perf, se_short, &selftest_rwlock_wp_perf)
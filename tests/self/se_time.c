@@ -181,3 +181,43 @@ void selftest_clock_latency(void)
 }
 
 REGISTER_SELF_TEST(clock_latency, se_long, &selftest_clock_latency)
+
+/*
+ * Sleeps crossing the boundaries of the timing wheel's levels: each one must
+ * never end before its deadline, even when its timer had to be cascaded.
+ */
+static const u32 timer_wheel_sleeps[] = { 1, 2, 63, 64, 65, 127, 200 };
+static u32 timer_wheel_slept[ARRAY_SIZE(timer_wheel_sleeps)];
+
+static void timer_wheel_thread(void *arg)
+{
+   const ulong n = (ulong)arg;
+   const u64 start = get_ticks();
+
+   kernel_sleep(timer_wheel_sleeps[n]);
+   timer_wheel_slept[n] = (u32)(get_ticks() - start);
+}
+
+void selftest_timer_wheel(void)
+{
+   int tids[ARRAY_SIZE(timer_wheel_sleeps)];
+
+   for (int i = 0; i < ARRAY_SIZE(tids); i++) {
+      tids[i] = kthread_create(&timer_wheel_thread, 0, TO_PTR(i));
+      VERIFY(tids[i] > 0);
+   }
+
+   kthread_join_all(tids, ARRAY_SIZE(tids), true);
+
+   for (int i = 0; i < ARRAY_SIZE(tids); i++) {
+
+      printk("sleep(%3u ticks): woken up after %u ticks\n",
+             timer_wheel_sleeps[i], timer_wheel_slept[i]);
+
+      VERIFY(timer_wheel_slept[i] >= timer_wheel_sleeps[i]);
+   }
+
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(timer_wheel, se_short, &selftest_timer_wheel)
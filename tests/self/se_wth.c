@@ -231,3 +231,46 @@ void selftest_wth_perf(void)
 }
 
 REGISTER_SELF_TEST(wth_perf, se_short, &selftest_wth_perf)
+
+static struct wth_delayed_job se_delayed_job;
+static ATOMIC(u32) se_delayed_ticks;
+
+static void test_delayed_func(void *arg)
+{
+   se_delayed_ticks = (u32)get_ticks();
+}
+
+void selftest_wth_delayed(void)
+{
+   const u32 delay = TIMER_HZ / 4;
+   u32 start;
+
+   se_delayed_ticks = 0;
+   wth_delayed_job_init(&se_delayed_job, NULL, &test_delayed_func, NULL);
+
+   /*
+    * A cancelled job must never run. With preemption disabled, the worker
+    * running the fired ktimers cannot run between the two calls.
+    */
+   disable_preemption();
+   {
+      wth_enqueue_delayed(&se_delayed_job, 1);
+      wth_cancel_delayed(&se_delayed_job);
+   }
+   enable_preemption();
+
+   kernel_sleep(delay);
+   VERIFY(se_delayed_ticks == 0);
+
+   start = (u32)get_ticks();
+   wth_enqueue_delayed(&se_delayed_job, delay);
+   kernel_sleep(2 * delay);
+
+   printk("[se_wth] delayed job: armed at %u, run at %u (delay: %u)\n",
+          start, se_delayed_ticks, delay);
+
+   VERIFY(se_delayed_ticks >= start + delay);
+   se_regular_end();
+}
+
+REGISTER_SELF_TEST(wth_delayed, se_short, &selftest_wth_delayed)
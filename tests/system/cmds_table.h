@@ -16,17 +16,31 @@ CMD_ENTRY(fpu_loop,     TT_LONG,  false)
 
 CMD_ENTRY(fork0,        TT_MED,    true)
 CMD_ENTRY(fork1,        TT_SHORT,  true)
+CMD_ENTRY(fork2,        TT_SHORT,  true)
 CMD_ENTRY(sysenter,     TT_SHORT,  true)
 CMD_ENTRY(fork_se,      TT_MED,    true)
 CMD_ENTRY(bad_read,     TT_SHORT,  true)
 CMD_ENTRY(bad_write,    TT_SHORT,  true)
 CMD_ENTRY(fork_perf,    TT_LONG,   true)
 CMD_ENTRY(vfork_perf,   TT_LONG,   true)
+CMD_ENTRY(fork_bench,   TT_LONG,   true)
 CMD_ENTRY(syscall_perf, TT_MED,    true)
+CMD_ENTRY(bench,        TT_LONG,   true)
+CMD_ENTRY(lat_pipe,     TT_MED,    true)
+CMD_ENTRY(lat_futex,    TT_MED,    true)
+CMD_ENTRY(lat_signal,   TT_MED,    true)
+CMD_ENTRY(lat_yield,    TT_MED,    true)
 CMD_ENTRY(fpu,          TT_SHORT,  true)
 CMD_ENTRY(brk,          TT_SHORT,  true)
 CMD_ENTRY(mmap,         TT_MED,    true)
 CMD_ENTRY(mmap2,        TT_SHORT,  true)
+CMD_ENTRY(mmap3,        TT_SHORT,  true)
+CMD_ENTRY(mmap4,        TT_SHORT,  true)
+CMD_ENTRY(mremap1,      TT_SHORT,  true)
+CMD_ENTRY(hugemmap1,    TT_SHORT,  true)
+CMD_ENTRY(rlimit_as,    TT_SHORT,  true)
+CMD_ENTRY(process_vm1,  TT_SHORT,  true)
+CMD_ENTRY(mm_bench,     TT_LONG,   true)
 CMD_ENTRY(kcow,         TT_SHORT,  true)
 CMD_ENTRY(wpid1,        TT_SHORT,  true)
 CMD_ENTRY(wpid2,        TT_SHORT,  true)
@@ -50,6 +64,10 @@ CMD_ENTRY(fs4,          TT_SHORT,  true)
 CMD_ENTRY(fs5,          TT_SHORT,  true)
 CMD_ENTRY(fs6,          TT_SHORT,  true)
 CMD_ENTRY(fs7,          TT_SHORT,  true)
+CMD_ENTRY(fs8,          TT_SHORT,  true)
+CMD_ENTRY(fs9,          TT_SHORT,  true)
+CMD_ENTRY(fs10,         TT_SHORT,  true)
+CMD_ENTRY(iouring1,     TT_SHORT,  true)
 CMD_ENTRY(fs_perf1,     TT_SHORT,  true)
 CMD_ENTRY(fs_perf2,     TT_SHORT,  true)
 CMD_ENTRY(fmmap1,       TT_SHORT,  true)
@@ -59,21 +77,35 @@ CMD_ENTRY(fmmap4,       TT_SHORT,  true)
 CMD_ENTRY(fmmap5,       TT_SHORT,  true)
 CMD_ENTRY(fmmap6,       TT_SHORT,  true)
 CMD_ENTRY(fmmap7,       TT_SHORT,  true)
+CMD_ENTRY(fmmap8,       TT_SHORT,  true)
+CMD_ENTRY(fmmap9,       TT_SHORT,  true)
+CMD_ENTRY(shm1,         TT_SHORT,  true)
 CMD_ENTRY(pipe1,        TT_SHORT,  true)
 CMD_ENTRY(pipe2,        TT_SHORT,  true)
 CMD_ENTRY(pipe3,        TT_SHORT,  true)
 CMD_ENTRY(pipe4,        TT_SHORT,  true)
 CMD_ENTRY(pipe5,        TT_SHORT,  true)
+CMD_ENTRY(pipe6,        TT_SHORT,  true)
+CMD_ENTRY(pipe7,        TT_SHORT,  true)
+CMD_ENTRY(pipe8,        TT_SHORT,  true)
+CMD_ENTRY(pipe9,        TT_SHORT,  true)
 CMD_ENTRY(pollerr,      TT_SHORT,  true)
 CMD_ENTRY(pollhup,      TT_SHORT,  true)
 CMD_ENTRY(poll1,        TT_SHORT,  true)
 CMD_ENTRY(poll2,        TT_SHORT,  true)
 CMD_ENTRY(poll3,        TT_SHORT,  true)
+CMD_ENTRY(epoll1,       TT_SHORT,  true)
+CMD_ENTRY(epoll2,       TT_SHORT,  true)
+CMD_ENTRY(eventfd1,     TT_SHORT,  true)
+CMD_ENTRY(timerfd1,     TT_SHORT,  true)
+CMD_ENTRY(pollpri1,     TT_SHORT,  true)
 CMD_ENTRY(select1,      TT_SHORT,  true)
 CMD_ENTRY(select2,      TT_SHORT,  true)
 CMD_ENTRY(select3,      TT_SHORT,  true)
 CMD_ENTRY(select4,      TT_SHORT,  true)
 CMD_ENTRY(execve0,      TT_SHORT,  true)
+CMD_ENTRY(execve1,      TT_SHORT,  true)
+CMD_ENTRY(spawn0,       TT_SHORT,  true)
 CMD_ENTRY(vfork0,       TT_SHORT,  true)
 CMD_ENTRY(extra,        TT_MED,    true)
 CMD_ENTRY(fatmm1,       TT_SHORT,  true)
@@ -91,6 +123,7 @@ CMD_ENTRY(sig10,        TT_SHORT,  true)
 CMD_ENTRY(sig11,        TT_SHORT,  true)
 CMD_ENTRY(sig12,        TT_SHORT,  true)
 CMD_ENTRY(sig13,        TT_SHORT,  true)
+CMD_ENTRY(sigqueue1,    TT_SHORT,  true)
 CMD_ENTRY(fork_oom,     TT_MED,    true)
 CMD_ENTRY(sigsegv3,     TT_SHORT,  true)
 CMD_ENTRY(sigsegv4,     TT_SHORT,  true)
@@ -98,3 +131,5 @@ CMD_ENTRY(sigsegv5,     TT_SHORT,  true)
 CMD_ENTRY(getuids,      TT_SHORT,  true)
 CMD_ENTRY(getrusage,    TT_SHORT,  true)
 CMD_ENTRY(exit_cb,      TT_SHORT,  true)
+CMD_ENTRY(futex1,       TT_SHORT,  true)
+CMD_ENTRY(vdso1,        TT_SHORT,  true)
@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include "devshell.h"
+#include "test_common.h"
+
+/*
+ * User space micro-benchmarks. Same logic and same output format (one JSON
+ * object per line) as the in-kernel benchmarks: see include/tilck/kernel/
+ * bench.h. In addition, each benchmark might have a setup and a teardown
+ * function, not measured, called around each run, and the results include
+ * the number of operations per second, based on the median.
+ */
+
+static uint64_t bench_samples[BENCH_MAX_ITERS];
+static double cycles_per_us;
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+   return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+/*
+ * Tilck's clocks have the resolution of the system tick: in order to convert
+ * cycles to time units, measure how many cycles elapse in 250 ms, starting
+ * exactly on a clock change, to reduce the error. That's done only once.
+ */
+double get_cycles_per_us(void)
+{
+   struct timespec ts;
+   uint64_t start_ns, now_ns, start_tsc;
+
+   if (cycles_per_us)
+      return cycles_per_us;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   now_ns = start_ns = ts_to_ns(&ts);
+
+   while (now_ns == start_ns) {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      now_ns = ts_to_ns(&ts);
+   }
+
+   start_ns = now_ns;
+   start_tsc = RDTSC();
+
+   while (now_ns - start_ns < 250 * 1000 * 1000) {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      now_ns = ts_to_ns(&ts);
+   }
+
+   cycles_per_us =
+      (double)(RDTSC() - start_tsc) / (double)((now_ns - start_ns) / 1000);
+
+   return cycles_per_us;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+   const uint64_t x = *(const uint64_t *)a;
+   const uint64_t y = *(const uint64_t *)b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void bench_run_single(const struct ubench *b)
+{
+   if (b->setup)
+      b->setup();
+
+   b->func();
+
+   if (b->teardown)
+      b->teardown();
+}
+
+void ubench_run(const struct ubench *b)
+{
+   const int ops = b->ops ? b->ops : 1;
+   const double cpu = get_cycles_per_us();
+   uint64_t start, median, tot = 0;
+
+   DEVSHELL_CMD_ASSERT(b->iters > 0 && b->iters <= BENCH_MAX_ITERS);
+
+   for (int i = 0; i < b->warmup; i++)
+      bench_run_single(b);
+
+   for (int i = 0; i < b->iters; i++) {
+
+      if (b->setup)
+         b->setup();
+
+      start = RDTSC();
+      b->func();
+      bench_samples[i] = RDTSC() - start;
+
+      if (b->teardown)
+         b->teardown();
+   }
+
+   qsort(bench_samples, (size_t)b->iters, sizeof(uint64_t), &bench_cmp_u64);
+
+   for (int i = 0; i < b->iters; i++)
+      tot += bench_samples[i];
+
+   median = bench_samples[b->iters / 2] / ops;
+
+   printf("{\"bench\": \"%s\", \"unit\": \"cycles\", "
+          "\"iters\": %d, \"ops\": %d, \"min\": %" PRIu64 ", "
+          "\"median\": %" PRIu64 ", \"avg\": %" PRIu64 ", "
+          "\"max\": %" PRIu64 ", \"ops_per_sec\": %.0f}\n",
+          b->name, b->iters, ops,
+          bench_samples[0] / ops,
+          median,
+          tot / (uint64_t)b->iters / ops,
+          bench_samples[b->iters - 1] / ops,
+          median ? cpu * 1000000.0 / (double)median : 0.0);
+
+   fflush(stdout);
+}
+
+/* -------------------------- syscall round-trip --------------------------- */
+
+#define SYSCALL_BENCH_OPS                    100
+
+static void syscall_bench_func(void)
+{
+   for (int i = 0; i < SYSCALL_BENCH_OPS; i++)
+      syscall(SYS_getuid);
+}
+
+/* --------------------------- pipe throughput ----------------------------- */
+
+static int bench_pipe[2];
+static char bench_buf[4096];
+
+static void pipe_bench_func(void)
+{
+   int rc;
+
+   rc = write(bench_pipe[1], bench_buf, sizeof(bench_buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(bench_buf));
+
+   rc = read(bench_pipe[0], bench_buf, sizeof(bench_buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(bench_buf));
+}
+
+/* ------------------ context switch (pipe ping-pong) ---------------------- */
+
+static int pingpong_p2c[2];
+static int pingpong_c2p[2];
+
+static void pingpong_child(void)
+{
+   char c;
+
+   while (read(pingpong_p2c[0], &c, 1) == 1) {
+
+      if (write(pingpong_c2p[1], &c, 1) != 1)
+         break;
+   }
+
+   exit(0);
+}
+
+static void pingpong_bench_func(void)
+{
+   char c = 'x';
+   int rc;
+
+   rc = write(pingpong_p2c[1], &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = read(pingpong_c2p[0], &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+}
+
+/* ------------------------- fork, exec and exit --------------------------- */
+
+static void fork_exit_bench_func(void)
+{
+   int wstatus;
+   pid_t pid;
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid)
+      _exit(0);
+
+   DEVSHELL_CMD_ASSERT(waitpid(pid, &wstatus, 0) == pid);
+}
+
+static void fork_exec_exit_bench_func(void)
+{
+   int wstatus;
+   pid_t pid;
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      execl(get_devshell_path(), "devshell", "-c", "bench", "--nop", NULL);
+      _exit(1);
+   }
+
+   DEVSHELL_CMD_ASSERT(waitpid(pid, &wstatus, 0) == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+}
+
+/* ---------------------- blocking poll() on many fds ---------------------- */
+
+#define POLL_BENCH_FDS                        64
+
+static int poll_bench_pipes[POLL_BENCH_FDS][2];
+static int poll_bench_ctl[2];
+static struct pollfd poll_bench_fds[POLL_BENCH_FDS];
+
+/* The child makes the last pipe readable for every byte on the ctl pipe */
+static void poll_bench_child(void)
+{
+   char c;
+
+   while (read(poll_bench_ctl[0], &c, 1) == 1) {
+
+      if (write(poll_bench_pipes[POLL_BENCH_FDS - 1][1], &c, 1) != 1)
+         break;
+   }
+
+   exit(0);
+}
+
+static void poll_bench_func(void)
+{
+   char c = 'x';
+   int rc;
+
+   rc = write(poll_bench_ctl[1], &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = poll(poll_bench_fds, POLL_BENCH_FDS, -1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(poll_bench_fds[POLL_BENCH_FDS - 1].revents & POLLIN);
+
+   rc = read(poll_bench_pipes[POLL_BENCH_FDS - 1][0], &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+}
+
+static void run_poll_bench(void)
+{
+   pid_t pid;
+   int rc, wstatus;
+
+   rc = pipe(poll_bench_ctl);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < POLL_BENCH_FDS; i++) {
+
+      rc = pipe(poll_bench_pipes[i]);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      poll_bench_fds[i] = (struct pollfd) {
+         .fd = poll_bench_pipes[i][0],
+         .events = POLLIN,
+      };
+   }
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      close(poll_bench_ctl[1]);
+      poll_bench_child();
+   }
+
+   close(poll_bench_ctl[0]);
+
+   ubench_run(&(struct ubench) {
+      .name = "poll_64_pipes_wakeup",
+      .warmup = 10,
+      .iters = 1000,
+      .func = &poll_bench_func,
+   });
+
+   close(poll_bench_ctl[1]);   /* The child will get EOF and exit */
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+
+   for (int i = 0; i < POLL_BENCH_FDS; i++) {
+      close(poll_bench_pipes[i][0]);
+      close(poll_bench_pipes[i][1]);
+   }
+}
+
+/* ------------------------------ page faults ------------------------------ */
+
+#define PF_BENCH_PAGES                        64
+
+static char *pf_bench_mem;
+
+static void pf_bench_setup(void)
+{
+   pf_bench_mem = mmap(NULL,
+                       PF_BENCH_PAGES * getpagesize(),
+                       PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE,
+                       -1,
+                       0);
+
+   DEVSHELL_CMD_ASSERT(pf_bench_mem != MAP_FAILED);
+}
+
+static void pf_bench_func(void)
+{
+   const int page_size = getpagesize();
+
+   for (int i = 0; i < PF_BENCH_PAGES; i++)
+      pf_bench_mem[i * page_size] = 1;
+}
+
+static void pf_bench_teardown(void)
+{
+   munmap(pf_bench_mem, PF_BENCH_PAGES * getpagesize());
+}
+
+/* ------------------------------------------------------------------------- */
+
+int cmd_bench(int argc, char **argv)
+{
+   pid_t pingpong_pid;
+   int rc, wstatus;
+
+   if (argc > 0 && !strcmp(argv[0], "--nop"))
+      return 0; /* Used by the fork + exec benchmark */
+
+   ubench_run(&(struct ubench) {
+      .name = "syscall_getuid",
+      .warmup = 10,
+      .iters = 1000,
+      .ops = SYSCALL_BENCH_OPS,
+      .func = &syscall_bench_func,
+   });
+
+   rc = pipe(bench_pipe);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   ubench_run(&(struct ubench) {
+      .name = "pipe_4k_write_read",
+      .warmup = 10,
+      .iters = 1000,
+      .func = &pipe_bench_func,
+   });
+
+   close(bench_pipe[0]);
+   close(bench_pipe[1]);
+
+   rc = pipe(pingpong_p2c);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = pipe(pingpong_c2p);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   pingpong_pid = fork();
+   DEVSHELL_CMD_ASSERT(pingpong_pid >= 0);
+
+   if (!pingpong_pid) {
+      close(pingpong_p2c[1]);
+      close(pingpong_c2p[0]);
+      pingpong_child();
+   }
+
+   close(pingpong_p2c[0]);
+   close(pingpong_c2p[1]);
+
+   ubench_run(&(struct ubench) {
+      .name = "pipe_pingpong_roundtrip",
+      .warmup = 10,
+      .iters = 1000,
+      .func = &pingpong_bench_func,
+   });
+
+   close(pingpong_p2c[1]);   /* The child will get EOF and exit */
+   close(pingpong_c2p[0]);
+
+   rc = waitpid(pingpong_pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pingpong_pid);
+
+   run_poll_bench();
+
+   ubench_run(&(struct ubench) {
+      .name = "fork_exit_wait",
+      .warmup = 5,
+      .iters = 200,
+      .func = &fork_exit_bench_func,
+   });
+
+   ubench_run(&(struct ubench) {
+      .name = "fork_exec_exit_wait",
+      .warmup = 2,
+      .iters = 50,
+      .func = &fork_exec_exit_bench_func,
+   });
+
+   ubench_run(&(struct ubench) {
+      .name = "page_fault_anon",
+      .warmup = 5,
+      .iters = 200,
+      .ops = PF_BENCH_PAGES,
+      .setup = &pf_bench_setup,
+      .func = &pf_bench_func,
+      .teardown = &pf_bench_teardown,
+   });
+
+   return 0;
+}
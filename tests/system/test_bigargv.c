@@ -13,14 +13,25 @@
 #include "sysenter.h"
 #include "test_common.h"
 
-static void do_bigargv_test(size_t len)
+/*
+ * Run devshell with `extra` short arguments followed by a big one of `len`
+ * bytes (counting the final \0).
+ */
+static void do_bigargv_test(size_t len, size_t extra)
 {
    char *big_arg = malloc(len);
-   char *argv[] = { DEVSHELL_PATH, big_arg, NULL };
+   char **argv = calloc(extra + 3, sizeof(char *));
 
    memset(big_arg, 'a', len);
    big_arg[len-1] = 0;
 
+   argv[0] = DEVSHELL_PATH;
+
+   for (size_t i = 0; i < extra; i++)
+      argv[1 + i] = "x";
+
+   argv[1 + extra] = big_arg;
+
    close(0); close(1); close(2);
    execvpe(DEVSHELL_PATH, argv, shell_env);
 
@@ -31,7 +42,7 @@ static void do_bigargv_test(size_t len)
    exit(99); /* unexpected case */
 }
 
-static bool fails_with_e2big(size_t len)
+static bool fails_with_e2big(size_t len, size_t extra)
 {
    int pid;
    int wstatus;
@@ -44,7 +55,7 @@ static bool fails_with_e2big(size_t len)
    }
 
    if (!pid)
-      do_bigargv_test(len);
+      do_bigargv_test(len, extra);
 
    waitpid(pid, &wstatus, 0);
 
@@ -70,7 +81,7 @@ static bool fails_with_e2big(size_t len)
 int cmd_bigargv(int argc, char **argv)
 {
    size_t l = 1024;
-   size_t r = 16 * 4096;
+   size_t r = 2 * USER_ARGS_MAX_PAGES * 4096;
    size_t a0;
    size_t argv_len = 0, env_len = 0;
 
@@ -79,14 +90,17 @@ int cmd_bigargv(int argc, char **argv)
       return 0;
    }
 
-   DEVSHELL_CMD_ASSERT(!fails_with_e2big(l));
-   DEVSHELL_CMD_ASSERT(fails_with_e2big(r));
+   DEVSHELL_CMD_ASSERT(!fails_with_e2big(l, 0));
+   DEVSHELL_CMD_ASSERT(fails_with_e2big(r, 0));
+
+   /* Many arguments: there's no limit on their number, just on their size */
+   DEVSHELL_CMD_ASSERT(!fails_with_e2big(l, 1000));
 
    while (l < r) {
 
       size_t v = (l + r) / 2;
 
-      if (fails_with_e2big(v)) {
+      if (fails_with_e2big(v, 0)) {
          r = v;
       } else {
          l = v + 1;
@@ -95,8 +109,8 @@ int cmd_bigargv(int argc, char **argv)
 
    size_t v = l - 1;
 
-   assert(!fails_with_e2big(v));
-   assert(fails_with_e2big(v + 1));
+   assert(!fails_with_e2big(v, 0));
+   assert(fails_with_e2big(v + 1, 0));
 
    a0 = strlen(DEVSHELL_PATH) + 1;
 
@@ -110,7 +124,7 @@ int cmd_bigargv(int argc, char **argv)
    argv_len += v;                 // max argv[1] length
 
    size_t grand_tot = argv_len + env_len;
-   size_t expected_tot = USER_ARGS_PAGE_COUNT * getpagesize();
+   size_t expected_tot = USER_ARGS_MAX_PAGES * getpagesize();
 
    printf("fix argv[0] length: %zu\n", a0);
    printf("max argv[1] length: %zu\n", v);
@@ -14,3 +14,26 @@ int test_sig(void (*child_func)(void *),
              int ex_sig,
              int ex_code,
              int signal_to_send);
+
+/*
+ * User space micro-benchmarks (see test_bench.c). Each run of `func` is
+ * measured with RDTSC(), while `setup` and `teardown`, if any, are called
+ * around it without being measured. The results are printed as JSON objects,
+ * one per line, in the same format used by the in-kernel benchmarks.
+ */
+
+#define BENCH_MAX_ITERS                    4096
+
+struct ubench {
+
+   const char *name;
+   int warmup;
+   int iters;                       /* must be <= BENCH_MAX_ITERS */
+   int ops;                         /* operations per run, 0 means 1 */
+   void (*setup)(void);
+   void (*func)(void);
+   void (*teardown)(void);
+};
+
+void ubench_run(const struct ubench *b);
+double get_cycles_per_us(void);
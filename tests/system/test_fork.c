@@ -16,6 +16,7 @@
 
 #include "devshell.h"
 #include "sysenter.h"
+#include "test_common.h"
 
 static int sysenter_fork(void)
 {
@@ -192,6 +193,69 @@ int cmd_execve0(int argc, char **argv)
    return 0;
 }
 
+/* Private copies of the writable ELF segments: .data and .bss */
+static int execve1_data = 1234;
+static int execve1_bss[1024];
+
+static bool execve1_check_initial_values(void)
+{
+   if (execve1_data != 1234)
+      return false;
+
+   for (int i = 0; i < 1024; i++)
+      if (execve1_bss[i] != 0)
+         return false;
+
+   return true;
+}
+
+int cmd_execve1(int argc, char **argv)
+{
+   int rc, pid, wstatus;
+   const char *devshell_path = get_devshell_path();
+
+   if (argc >= 1 && !strcmp(argv[0], "--child")) {
+
+      printf("[execve child] check .data and .bss\n");
+
+      if (!execve1_check_initial_values()) {
+         printf("[execve child] data: %d, expected 1234\n", execve1_data);
+         return 1;
+      }
+
+      execve1_data = 42;
+      execve1_bss[1023] = 42;
+      return 0;
+   }
+
+   DEVSHELL_CMD_ASSERT(execve1_check_initial_values());
+
+   /* Dirty our own copies: neither the file nor the children must see it */
+   execve1_data = 5678;
+   execve1_bss[0] = 5678;
+
+   for (int i = 0; i < 2; i++) {
+
+      pid = fork();
+      DEVSHELL_CMD_ASSERT(pid >= 0);
+
+      if (!pid) {
+         execl(devshell_path, "devshell", "-c", "execve1", "--child", NULL);
+         perror("execl");
+         exit(123);
+      }
+
+      rc = waitpid(pid, &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == pid);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+      DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+   }
+
+   DEVSHELL_CMD_ASSERT(execve1_data == 5678);
+   DEVSHELL_CMD_ASSERT(execve1_bss[0] == 5678);
+   return 0;
+}
+
 int cmd_fork1(int argc, char **argv)
 {
    int rc, pid, wstatus;
@@ -244,6 +308,137 @@ int cmd_fork1(int argc, char **argv)
    return 0;
 }
 
+/*
+ * Page tables are shared after fork() and copied only on the first write to
+ * their range: check that writes from the parent, the child and a grandchild
+ * to the same page table (and to pages around it) stay private to each one.
+ */
+static int fork2_child(int *buf, int val, int depth)
+{
+   int pid, wstatus;
+
+   if (buf[0] != 1 || buf[1023] != 2)
+      return 1;
+
+   if (depth > 0) {
+
+      pid = fork();
+
+      if (pid < 0)
+         return 1;
+
+      if (!pid)
+         exit(fork2_child(buf, val + 1, depth - 1));
+
+      /* Write while the grandchild is still sharing the page table with us */
+      buf[0] = val;
+
+      if (waitpid(pid, &wstatus, 0) != pid || WEXITSTATUS(wstatus) != 0)
+         return 1;
+
+   } else {
+
+      buf[0] = val;
+   }
+
+   buf[1023] = val;
+   return buf[0] != val || buf[1023] != val || buf[1024] != 3;
+}
+
+int cmd_fork2(int argc, char **argv)
+{
+   int pid, wstatus;
+   int *buf;
+
+   buf = mmap(NULL,
+              8 * KB,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1,
+              0);
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+
+   buf[0] = 1;
+   buf[1023] = 2;
+   buf[1024] = 3;
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid)
+      exit(fork2_child(buf, 100, 1));
+
+   DEVSHELL_CMD_ASSERT(waitpid(pid, &wstatus, 0) == pid);
+   DEVSHELL_CMD_ASSERT(!WIFSIGNALED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+
+   DEVSHELL_CMD_ASSERT(buf[0] == 1);
+   DEVSHELL_CMD_ASSERT(buf[1023] == 2);
+   DEVSHELL_CMD_ASSERT(buf[1024] == 3);
+
+   /* Now the page table is private again: writing must just work */
+   buf[1024] = 4;
+   DEVSHELL_CMD_ASSERT(buf[1024] == 4);
+
+   DEVSHELL_CMD_ASSERT(munmap(buf, 8 * KB) == 0);
+   return 0;
+}
+
+static int spawn0_child(int argc, char **argv)
+{
+   int fd = atoi(argv[1]);
+   int cloexec_fd = atoi(argv[2]);
+
+   if (fcntl(fd, F_GETFD) < 0)
+      return 1; /* an inherited handle is missing */
+
+   if (fcntl(cloexec_fd, F_GETFD) != -1 || errno != EBADF)
+      return 2; /* an FD_CLOEXEC handle has been inherited */
+
+   return 0;
+}
+
+int cmd_spawn0(int argc, char **argv)
+{
+   int rc, pid, wstatus, fd, cloexec_fd;
+   char fd_str[16], cloexec_fd_str[16];
+   char *child_argv[] = {
+      "devshell", "-c", "spawn0", "--child", fd_str, cloexec_fd_str, NULL
+   };
+
+   if (argc >= 3 && !strcmp(argv[0], "--child"))
+      return spawn0_child(argc, argv);
+
+   fd = open("/", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+
+   cloexec_fd = open("/", O_RDONLY | O_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(cloexec_fd >= 0);
+
+   sprintf(fd_str, "%d", fd);
+   sprintf(cloexec_fd_str, "%d", cloexec_fd);
+
+   printf(STR_PARENT "Spawn a child...\n");
+   pid = tilck_spawn(get_devshell_path(), child_argv, NULL);
+   DEVSHELL_CMD_ASSERT(pid > 0);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   print_waitpid_change(pid, wstatus);
+
+   DEVSHELL_CMD_ASSERT(!WIFSIGNALED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+
+   /* Unlike fork + execve, the errors are returned directly to the parent */
+   rc = tilck_spawn("/nonexistent_file", child_argv, NULL);
+   DEVSHELL_CMD_ASSERT(rc == -ENOENT);
+
+   close(cloexec_fd);
+   close(fd);
+   return 0;
+}
+
 int cmd_vfork0(int argc, char **argv)
 {
    static const char child_hello[] = "Hello from the child!!";
@@ -299,3 +494,83 @@ int cmd_vfork0(int argc, char **argv)
    print_waitpid_change(pid, wstatus);
    return failed;
 }
+
+/*
+ * fork() benchmarks: the cost of fork + exit + wait as a function of the
+ * parent's resident memory, in order to see how it scales with the number
+ * of pages to share (see pdir_clone()), and the rate of vfork + exec + wait.
+ */
+
+static void fork_bench_func(void)
+{
+   int wstatus;
+   pid_t pid;
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid)
+      _exit(0);
+
+   DEVSHELL_CMD_ASSERT(waitpid(pid, &wstatus, 0) == pid);
+}
+
+static void vfork_exec_bench_func(void)
+{
+   int wstatus;
+   pid_t pid;
+
+   pid = vfork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      execl(get_devshell_path(), "devshell", "-c", "bench", "--nop", NULL);
+      _exit(1);
+   }
+
+   DEVSHELL_CMD_ASSERT(waitpid(pid, &wstatus, 0) == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+}
+
+int cmd_fork_bench(int argc, char **argv)
+{
+   static const size_t rss_mb[] = { 0, 1, 4, 16 };
+   char name[32];
+   char *mem;
+
+   for (int i = 0; i < (int)ARRAY_SIZE(rss_mb); i++) {
+
+      const size_t len = rss_mb[i] * MB;
+      mem = NULL;
+
+      if (len) {
+
+         mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+
+         DEVSHELL_CMD_ASSERT(mem != MAP_FAILED);
+         memset(mem, 'x', len);
+      }
+
+      snprintf(name, sizeof(name), "fork_exit_wait_rss_%zuMB", rss_mb[i]);
+
+      ubench_run(&(struct ubench) {
+         .name = name,
+         .warmup = 5,
+         .iters = 100,
+         .func = &fork_bench_func,
+      });
+
+      if (mem)
+         DEVSHELL_CMD_ASSERT(munmap(mem, len) == 0);
+   }
+
+   ubench_run(&(struct ubench) {
+      .name = "vfork_exec_exit_wait",
+      .warmup = 2,
+      .iters = 50,
+      .func = &vfork_exec_bench_func,
+   });
+
+   return 0;
+}
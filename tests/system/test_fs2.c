@@ -15,6 +15,8 @@
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <dirent.h>
+#include <sys/sendfile.h>
+#include <linux/io_uring.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -575,3 +577,566 @@ int cmd_fmmap7(int argc, char **argv)
    unlink(test_file);
    return rc;
 }
+
+/*
+ * Two shared mappings of a file with holes: a block allocated through one of
+ * them (or by write()) must become visible through the other one, which had
+ * the zero page mapped there. Check also msync() and madvise().
+ */
+int cmd_fmmap8(int argc, char **argv)
+{
+   const size_t page_size = (size_t)getpagesize();
+   char *a, *b, *anon;
+   int fd, rc;
+
+   fd = open(test_file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = ftruncate(fd, 3 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   a = mmap(NULL, 3 * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(a != (void *)-1);
+
+   b = mmap(NULL, 3 * page_size, PROT_READ, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(b != (void *)-1);
+
+   /* Both reads map the zero page */
+   DEVSHELL_CMD_ASSERT(a[page_size] == 0);
+   DEVSHELL_CMD_ASSERT(b[page_size] == 0);
+
+   /* Writing through `a` allocates a block: `b` must see it */
+   strcpy(a + page_size, test_str2);
+   DEVSHELL_CMD_ASSERT(!strcmp(b + page_size, test_str2));
+
+   /* The same for a block allocated by write() */
+   DEVSHELL_CMD_ASSERT(b[2 * page_size] == 0);
+   rc = pwrite(fd, test_str, sizeof(test_str), 2 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str));
+   DEVSHELL_CMD_ASSERT(!strcmp(a + 2 * page_size, test_str));
+   DEVSHELL_CMD_ASSERT(!strcmp(b + 2 * page_size, test_str));
+
+   rc = msync(a, 3 * page_size, MS_SYNC);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = msync(a, 3 * page_size, MS_SYNC | MS_ASYNC);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   /* Dropping the pages of a shared mapping does not touch the file */
+   rc = madvise(b, 3 * page_size, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(!strcmp(b + page_size, test_str2));
+
+   rc = madvise(b, 3 * page_size, MADV_WILLNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(!strcmp(b + 2 * page_size, test_str));
+
+   /* Only the private anonymous memory can be lazily freed */
+   rc = madvise(b, 3 * page_size, MADV_FREE);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   munmap(b, 3 * page_size);
+   munmap(a, 3 * page_size);
+
+   rc = msync(a, page_size, MS_ASYNC);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ENOMEM);
+
+   /* Dropping the pages of a private anonymous mapping zeroes them */
+   anon = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   DEVSHELL_CMD_ASSERT(anon != (void *)-1);
+
+   memset(anon, 'x', page_size);
+   rc = madvise(anon, page_size, MADV_DONTNEED);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(anon[0] == 0 && anon[page_size - 1] == 0);
+
+   /*
+    * After MADV_FREE, the page keeps its content until dropped under memory
+    * pressure, when it becomes zero-filled. Writing it cancels the advice.
+    */
+   memset(anon, 'x', page_size);
+   rc = madvise(anon, page_size, MADV_FREE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(anon[1] == 'x' || anon[1] == 0);
+
+   anon[0] = 'y';
+   DEVSHELL_CMD_ASSERT(anon[0] == 'y');
+   DEVSHELL_CMD_ASSERT(anon[1] == 'x' || anon[1] == 0);
+   munmap(anon, page_size);
+
+   close(fd);
+   rc = unlink(test_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/* Private file mappings: the writes never reach the file */
+int cmd_fmmap9(int argc, char **argv)
+{
+   const size_t page_size = (size_t)getpagesize();
+   char *a, *b;
+   char buf[64];
+   int fd, rc;
+
+   fd = open(test_file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = pwrite(fd, test_str, sizeof(test_str), 0);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str));
+
+   rc = pwrite(fd, test_str2, sizeof(test_str2), page_size);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str2));
+
+   a = mmap(NULL, 3 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(a != (void *)-1);
+
+   b = mmap(NULL, 2 * page_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(b != (void *)-1);
+
+   /* The mappings don't depend on the file descriptor */
+   close(fd);
+
+   DEVSHELL_CMD_ASSERT(!strcmp(a, test_str));
+   DEVSHELL_CMD_ASSERT(!strcmp(b + page_size, test_str2));
+   DEVSHELL_CMD_ASSERT(a[2 * page_size] == 0); /* past EOF */
+
+   /* Writing to `a` changes neither `b`, nor the file */
+   strcpy(a, test_str2);
+   DEVSHELL_CMD_ASSERT(!strcmp(a, test_str2));
+   DEVSHELL_CMD_ASSERT(!strcmp(b, test_str));
+
+   fd = open(test_file, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = pread(fd, buf, sizeof(test_str), 0);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, test_str));
+   munmap(b, 2 * page_size);
+
+   /* MAP_FIXED inside the mapping, as the dynamic linkers do */
+   b = mmap(a + page_size, page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, 0);
+   DEVSHELL_CMD_ASSERT(b == a + page_size);
+   DEVSHELL_CMD_ASSERT(!strcmp(b, test_str));
+   DEVSHELL_CMD_ASSERT(!strcmp(a, test_str2));
+
+   b = mmap(a, page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+   DEVSHELL_CMD_ASSERT(b == a);
+   DEVSHELL_CMD_ASSERT(a[0] == 0 && a[page_size - 1] == 0);
+   DEVSHELL_CMD_ASSERT(!strcmp(a + page_size, test_str));
+
+   close(fd);
+   munmap(a, 3 * page_size);
+
+   rc = unlink(test_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/* Share memory between two processes with memfd_create() and shm_open() */
+int cmd_shm1(int argc, char **argv)
+{
+   const size_t page_size = (size_t)getpagesize();
+   const char *names[2] = { NULL, "/shm1_test" };
+   struct stat statbuf;
+   int fd, rc, wstatus;
+   char *vaddr;
+   pid_t child;
+
+   for (int n = 0; n < 2; n++) {
+
+      if (!names[n]) {
+         fd = sys_memfd_create("shm1_test", MFD_CLOEXEC);
+      } else {
+         fd = shm_open(names[n], O_CREAT | O_RDWR | O_EXCL, 0600);
+      }
+
+      DEVSHELL_CMD_ASSERT(fd > 0);
+
+      rc = ftruncate(fd, 2 * page_size);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      rc = fstat(fd, &statbuf);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+      DEVSHELL_CMD_ASSERT(statbuf.st_size == (off_t)(2 * page_size));
+
+      vaddr = mmap(NULL, 2 * page_size,
+                   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+      DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+      close(fd);
+
+      DEVSHELL_CMD_ASSERT((child = fork()) >= 0);
+
+      if (!child) {
+         strcpy(vaddr + page_size, test_str2);
+         exit(0);
+      }
+
+      rc = waitpid(child, &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == child);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && !WEXITSTATUS(wstatus));
+
+      /* The child wrote in the same pages we have mapped */
+      DEVSHELL_CMD_ASSERT(!strcmp(vaddr + page_size, test_str2));
+      munmap(vaddr, 2 * page_size);
+
+      if (names[n]) {
+         rc = shm_unlink(names[n]);
+         DEVSHELL_CMD_ASSERT(rc == 0);
+      }
+   }
+
+   rc = sys_memfd_create("", 0xff00);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+   return 0;
+}
+
+static int
+sys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len)
+{
+   /* Call the syscall directly: splice() requires _GNU_SOURCE */
+   return (int)syscall(SYS_splice, fd_in, off_in, fd_out, off_out, len, 0);
+}
+
+/* sendfile() from a ramfs file to a pipe, then splice() back into a file */
+int cmd_fs8(int argc, char **argv)
+{
+   static const char src_file[] = "/tmp/sf_src";
+   static const char dst_file[] = "/tmp/sf_dst";
+   const size_t page_size = (size_t)getpagesize();
+   const size_t file_size = 2 * page_size + 123;
+   char *buf = malloc(file_size);
+   char *buf2 = malloc(file_size);
+   int pipefd[2];
+   int src, dst, rc;
+   off_t off;
+
+   DEVSHELL_CMD_ASSERT(buf && buf2);
+
+   for (size_t i = 0; i < file_size; i++)
+      buf[i] = (char)('a' + i % 26);
+
+   src = open(src_file, O_CREAT | O_RDWR, 0644);
+   DEVSHELL_CMD_ASSERT(src > 0);
+
+   rc = write(src, buf, file_size);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+
+   dst = open(dst_file, O_CREAT | O_RDWR, 0644);
+   DEVSHELL_CMD_ASSERT(dst > 0);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Move the whole file, one pipe-full at the time */
+   for (off = 0; off < (off_t)file_size; ) {
+
+      const off_t old_off = off;
+      rc = sendfile(pipefd[1], src, &off, file_size);
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      DEVSHELL_CMD_ASSERT(off == old_off + rc);
+
+      rc = sys_splice(pipefd[0], NULL, dst, NULL, (size_t)rc);
+      DEVSHELL_CMD_ASSERT(rc == off - old_off);
+   }
+
+   /* sendfile() with an explicit offset must not move the file position */
+   rc = (int)lseek(src, 0, SEEK_CUR);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+
+   rc = pread(dst, buf2, file_size, 0);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, file_size));
+
+   /* At least one of the two ends of splice() must be a pipe */
+   rc = sys_splice(src, NULL, dst, NULL, 16);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   /* Pipes don't have offsets */
+   off = 0;
+   rc = sys_splice(pipefd[0], &off, dst, NULL, 16);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ESPIPE);
+
+   close(pipefd[0]);
+   close(pipefd[1]);
+   close(dst);
+   close(src);
+   free(buf2);
+   free(buf);
+
+   rc = unlink(dst_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = unlink(src_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/* Large read() and pread() calls, copying directly to the user buffer */
+int cmd_fs9(int argc, char **argv)
+{
+   static const char file[] = "/tmp/big_read";
+   const size_t page_size = (size_t)getpagesize();
+   const size_t file_size = 96 * page_size + 321;
+   char *buf = malloc(file_size);
+   char *buf2 = malloc(file_size);
+   char *bad_buf;
+   int fd, rc;
+
+   DEVSHELL_CMD_ASSERT(buf && buf2);
+
+   for (size_t i = 0; i < file_size; i++)
+      buf[i] = (char)(i * 7 + i / page_size);
+
+   fd = open(file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = write(fd, buf, file_size);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+
+   /* A single read() must return the whole file */
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = read(fd, buf2, file_size + 1000);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, file_size));
+
+   rc = read(fd, buf2, file_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* pread() from an unaligned offset, without moving the file position */
+   memset(buf2, 0, file_size);
+   rc = pread(fd, buf2, file_size, 1000);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size - 1000);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf + 1000, buf2, file_size - 1000));
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == (off_t)file_size);
+
+   /* Invalid user buffer: EFAULT and the file position doesn't move */
+   bad_buf = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   DEVSHELL_CMD_ASSERT(bad_buf != MAP_FAILED);
+   rc = munmap(bad_buf, page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = read(fd, bad_buf, page_size);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EFAULT);
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == 0);
+
+   close(fd);
+   free(buf2);
+   free(buf);
+
+   rc = unlink(file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/* openat() with a directory fd, relative and absolute paths */
+int cmd_fs10(int argc, char **argv)
+{
+   static const char dir[] = "/tmp/openat_dir";
+   char buf[16] = {0};
+   int dfd, fd, fd2, rc;
+
+   rc = mkdir(dir, 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   dfd = open(dir, O_RDONLY | O_DIRECTORY);
+   DEVSHELL_CMD_ASSERT(dfd > 0);
+
+   fd = openat(dfd, "f1", O_CREAT | O_RDWR, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   rc = write(fd, "abc", 3);
+   DEVSHELL_CMD_ASSERT(rc == 3);
+   close(fd);
+
+   /* The file must be there, in the right directory */
+   fd = open("/tmp/openat_dir/f1", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   rc = read(fd, buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 3 && !memcmp(buf, "abc", 3));
+   close(fd);
+
+   /* "." and ".." start from the dir fd too */
+   fd = openat(dfd, ".", O_RDONLY | O_DIRECTORY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   fd2 = openat(fd, "../openat_dir/./f1", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd2 > 0);
+   close(fd2);
+   close(fd);
+
+   /* Absolute paths ignore the dir fd */
+   fd = openat(dfd, "/tmp/openat_dir/f1", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   /* A fd not referring to a directory */
+   rc = openat(fd, "f1", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOTDIR);
+   close(fd);
+
+   rc = openat(dfd, "f2", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = openat(1234, "f1", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   close(dfd);
+
+   rc = unlink("/tmp/openat_dir/f1");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = rmdir(dir);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+#ifndef __NR_io_uring_setup
+   #define __NR_io_uring_setup                   425
+   #define __NR_io_uring_enter                   426
+#endif
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+   return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, int fl)
+{
+   return (int)syscall(__NR_io_uring_enter,
+                       fd, to_submit, min_complete, fl, NULL, 0);
+}
+
+/* Submit a batch of linked write, fsync, read and close ops with io_uring */
+int cmd_iouring1(int argc, char **argv)
+{
+   static const char file[] = "/tmp/iouring_test";
+   static const char msg[] = "hello from io_uring!";
+   struct io_uring_params p = {0};
+   struct io_uring_sqe *sqes, *sqe;
+   struct io_uring_cqe *cqes;
+   unsigned *sq_tail, *sq_array, *cq_head, *cq_tail, head, tail;
+   size_t ring_sz, sqes_sz;
+   char *ring, buf[64] = {0};
+   int ring_fd, fd, rc;
+   int res[6];
+
+   fd = open(file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   ring_fd = sys_io_uring_setup(8, &p);
+   DEVSHELL_CMD_ASSERT(ring_fd > 0);
+   DEVSHELL_CMD_ASSERT(p.sq_entries == 8);
+   DEVSHELL_CMD_ASSERT(p.cq_entries >= 8);
+   DEVSHELL_CMD_ASSERT(p.features & IORING_FEAT_SINGLE_MMAP);
+
+   ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+
+   if (p.cq_off.cqes + p.cq_entries * sizeof(*cqes) > ring_sz)
+      ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(*cqes);
+
+   sqes_sz = p.sq_entries * sizeof(*sqes);
+
+   ring = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE,
+               MAP_SHARED, ring_fd, IORING_OFF_SQ_RING);
+   DEVSHELL_CMD_ASSERT(ring != MAP_FAILED);
+
+   sqes = mmap(NULL, sqes_sz, PROT_READ | PROT_WRITE,
+               MAP_SHARED, ring_fd, IORING_OFF_SQES);
+   DEVSHELL_CMD_ASSERT(sqes != MAP_FAILED);
+
+   sq_tail = (unsigned *)(ring + p.sq_off.tail);
+   sq_array = (unsigned *)(ring + p.sq_off.array);
+   cq_head = (unsigned *)(ring + p.cq_off.head);
+   cq_tail = (unsigned *)(ring + p.cq_off.tail);
+   cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+   memset(sqes, 0, sqes_sz);
+
+   /* write -> fsync -> read, linked in a chain */
+   sqe = &sqes[0];
+   sqe->opcode = IORING_OP_WRITE;
+   sqe->flags = IOSQE_IO_LINK;
+   sqe->fd = fd;
+   sqe->addr = (unsigned long)msg;
+   sqe->len = sizeof(msg);
+   sqe->off = 0;
+
+   sqe = &sqes[1];
+   sqe->opcode = IORING_OP_FSYNC;
+   sqe->flags = IOSQE_IO_LINK;
+   sqe->fd = fd;
+
+   sqe = &sqes[2];
+   sqe->opcode = IORING_OP_READ;
+   sqe->fd = fd;
+   sqe->addr = (unsigned long)buf;
+   sqe->len = sizeof(buf);
+   sqe->off = 0;
+
+   /* A failing op in a chain cancels the rest of it */
+   sqe = &sqes[3];
+   sqe->opcode = IORING_OP_CLOSE;
+   sqe->flags = IOSQE_IO_LINK;
+   sqe->fd = 1234;
+
+   sqe = &sqes[4];
+   sqe->opcode = IORING_OP_NOP;
+
+   /* Not linked: it runs anyway */
+   sqe = &sqes[5];
+   sqe->opcode = IORING_OP_CLOSE;
+   sqe->fd = fd;
+
+   tail = *sq_tail;
+
+   for (unsigned i = 0; i < 6; i++) {
+      sqes[i].user_data = i;
+      sq_array[(tail + i) & (p.sq_entries - 1)] = i;
+   }
+
+   __atomic_store_n(sq_tail, tail + 6, __ATOMIC_RELEASE);
+
+   rc = sys_io_uring_enter(ring_fd, 6, 6, IORING_ENTER_GETEVENTS);
+   DEVSHELL_CMD_ASSERT(rc == 6);
+
+   head = *cq_head;
+   DEVSHELL_CMD_ASSERT(__atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) - head == 6);
+
+   for (unsigned i = 0; i < 6; i++) {
+      struct io_uring_cqe *cqe = &cqes[(head + i) & (p.cq_entries - 1)];
+      DEVSHELL_CMD_ASSERT(cqe->user_data < 6);
+      res[cqe->user_data] = cqe->res;
+   }
+
+   __atomic_store_n(cq_head, head + 6, __ATOMIC_RELEASE);
+
+   DEVSHELL_CMD_ASSERT(res[0] == sizeof(msg));
+   DEVSHELL_CMD_ASSERT(res[1] == 0);
+   DEVSHELL_CMD_ASSERT(res[2] == sizeof(msg));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, msg));
+   DEVSHELL_CMD_ASSERT(res[3] == -EBADF);
+   DEVSHELL_CMD_ASSERT(res[4] == -ECANCELED);
+   DEVSHELL_CMD_ASSERT(res[5] == 0);
+
+   /* The file has been closed by the ring */
+   rc = close(fd);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   /* io_uring_enter() works only on rings */
+   rc = sys_io_uring_enter(0, 1, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EOPNOTSUPP);
+
+   munmap(sqes, sqes_sz);
+   munmap(ring, ring_sz);
+   close(ring_fd);
+
+   rc = unlink(file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
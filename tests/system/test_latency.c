@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include <linux/futex.h> // system header
+
+#include "devshell.h"
+#include "test_common.h"
+
+/*
+ * Latency tests: each one measures, with RDTSC(), many round-trips of a given
+ * IPC mechanism and reports the p50, p99 and max latency in microseconds, as
+ * a JSON object on a single line, like the `bench` command does. The runner
+ * (run_all_tests) can save those results as a baseline and compare later runs
+ * against it: see its --bench-save and --bench-baseline options.
+ */
+
+#define LAT_ITERS                         2000
+
+static uint64_t lat_samples[LAT_ITERS];
+
+static int lat_cmp_u64(const void *a, const void *b)
+{
+   const uint64_t x = *(const uint64_t *)a;
+   const uint64_t y = *(const uint64_t *)b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void lat_report(const char *name, int n)
+{
+   const double cpu = get_cycles_per_us();
+   qsort(lat_samples, (size_t)n, sizeof(uint64_t), &lat_cmp_u64);
+
+   printf("{\"bench\": \"%s\", \"unit\": \"us\", \"iters\": %d, "
+          "\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}\n",
+          name, n,
+          lat_samples[n / 2] / cpu,
+          lat_samples[n * 99 / 100] / cpu,
+          lat_samples[n - 1] / cpu);
+
+   fflush(stdout);
+}
+
+/* Runs `func` LAT_ITERS times (after a short warmup) and reports */
+static void lat_measure(const char *name, void (*func)(void))
+{
+   uint64_t start;
+
+   get_cycles_per_us();    /* Calibrate before measuring */
+
+   for (int i = 0; i < LAT_ITERS / 10; i++)
+      func();
+
+   for (int i = 0; i < LAT_ITERS; i++) {
+      start = RDTSC();
+      func();
+      lat_samples[i] = RDTSC() - start;
+   }
+
+   lat_report(name, LAT_ITERS);
+}
+
+/* ----------------------------- pipe ping-pong ---------------------------- */
+
+static int lat_p2c[2];
+static int lat_c2p[2];
+
+static void lat_pipe_roundtrip(void)
+{
+   char c = 'x';
+   DEVSHELL_CMD_ASSERT(write(lat_p2c[1], &c, 1) == 1);
+   DEVSHELL_CMD_ASSERT(read(lat_c2p[0], &c, 1) == 1);
+}
+
+int cmd_lat_pipe(int argc, char **argv)
+{
+   int rc, wstatus;
+   pid_t pid;
+   char c;
+
+   DEVSHELL_CMD_ASSERT(pipe(lat_p2c) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(lat_c2p) == 0);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+
+      close(lat_p2c[1]);
+      close(lat_c2p[0]);
+
+      while (read(lat_p2c[0], &c, 1) == 1)
+         if (write(lat_c2p[1], &c, 1) != 1)
+            break;
+
+      exit(0);
+   }
+
+   close(lat_p2c[0]);
+   close(lat_c2p[1]);
+
+   lat_measure("lat_pipe_pingpong", &lat_pipe_roundtrip);
+
+   close(lat_p2c[1]);   /* The child gets EOF and exits */
+   close(lat_c2p[0]);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   return 0;
+}
+
+/* --------------------------------- futex --------------------------------- */
+
+/*
+ * Futex ping-pong between two processes, over a word in a memfd mapping:
+ * the parent sets it to 1 and wakes up the child, which sets it back to 0 and
+ * wakes up the parent. The value 2 makes the child exit.
+ */
+static volatile uint32_t *lat_futex_word;
+
+static long lat_futex(int op, uint32_t val)
+{
+   return syscall(SYS_futex, lat_futex_word, op, val, NULL, NULL, 0);
+}
+
+static void lat_futex_roundtrip(void)
+{
+   *lat_futex_word = 1;
+   lat_futex(FUTEX_WAKE, 1);
+
+   while (*lat_futex_word == 1)
+      lat_futex(FUTEX_WAIT, 1);
+}
+
+static void lat_futex_child(void)
+{
+   uint32_t val;
+
+   while ((val = *lat_futex_word) != 2) {
+
+      if (val == 0) {
+         lat_futex(FUTEX_WAIT, 0);
+         continue;
+      }
+
+      *lat_futex_word = 0;
+      lat_futex(FUTEX_WAKE, 1);
+   }
+
+   exit(0);
+}
+
+int cmd_lat_futex(int argc, char **argv)
+{
+   const size_t page_size = (size_t)getpagesize();
+   int fd, rc, wstatus;
+   void *vaddr;
+   pid_t pid;
+
+   fd = sys_memfd_create("lat_futex", MFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(ftruncate(fd, (off_t)page_size) == 0);
+
+   vaddr = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+   close(fd);
+
+   lat_futex_word = vaddr;
+   *lat_futex_word = 0;
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid)
+      lat_futex_child();
+
+   lat_measure("lat_futex_pingpong", &lat_futex_roundtrip);
+
+   *lat_futex_word = 2;
+   lat_futex(FUTEX_WAKE, 1);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   munmap(vaddr, page_size);
+   return 0;
+}
+
+/* ---------------------------- signal round-trip -------------------------- */
+
+static pid_t lat_sig_peer;
+static sigset_t lat_sig_wait_mask;
+
+static void lat_sig_handler(int signum)
+{
+   /* Nothing to do: sigsuspend() returns after the handler */
+}
+
+static void lat_signal_roundtrip(void)
+{
+   DEVSHELL_CMD_ASSERT(kill(lat_sig_peer, SIGUSR1) == 0);
+   sigsuspend(&lat_sig_wait_mask);
+}
+
+int cmd_lat_signal(int argc, char **argv)
+{
+   struct sigaction sa = { .sa_handler = &lat_sig_handler };
+   const pid_t parent = getpid();
+   sigset_t set;
+   int rc, wstatus;
+   pid_t pid;
+
+   /* Block the signals: they must be received only in sigsuspend() */
+   sigemptyset(&set);
+   sigaddset(&set, SIGUSR1);
+   sigaddset(&set, SIGUSR2);
+   DEVSHELL_CMD_ASSERT(sigprocmask(SIG_BLOCK, &set, NULL) == 0);
+
+   DEVSHELL_CMD_ASSERT(sigaction(SIGUSR1, &sa, NULL) == 0);
+   DEVSHELL_CMD_ASSERT(sigaction(SIGUSR2, &sa, NULL) == 0);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+
+      /* The child waits for SIGUSR1 and replies with SIGUSR2 */
+      sigfillset(&lat_sig_wait_mask);
+      sigdelset(&lat_sig_wait_mask, SIGUSR1);
+      sigdelset(&lat_sig_wait_mask, SIGTERM);
+
+      while (true) {
+         sigsuspend(&lat_sig_wait_mask);
+         kill(parent, SIGUSR2);
+      }
+   }
+
+   sigfillset(&lat_sig_wait_mask);
+   sigdelset(&lat_sig_wait_mask, SIGUSR2);
+   lat_sig_peer = pid;
+
+   lat_measure("lat_signal_roundtrip", &lat_signal_roundtrip);
+
+   DEVSHELL_CMD_ASSERT(kill(pid, SIGTERM) == 0);
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+
+   DEVSHELL_CMD_ASSERT(sigprocmask(SIG_UNBLOCK, &set, NULL) == 0);
+   return 0;
+}
+
+/* ------------------------- sched_yield() between N tasks ----------------- */
+
+static void lat_yield(void)
+{
+   sched_yield();
+}
+
+/*
+ * With N tasks spinning on sched_yield(), the latency of each call is the
+ * time it takes to run all the other N-1 tasks once: that's the cost of N
+ * context switches. The number of tasks can be passed as argument.
+ */
+int cmd_lat_yield(int argc, char **argv)
+{
+   const int n = argc > 0 ? atoi(argv[0]) : 4;
+   pid_t pids[16];
+   char name[32];
+   int rc, wstatus;
+
+   DEVSHELL_CMD_ASSERT(n >= 1 && n <= (int)ARRAY_SIZE(pids) + 1);
+
+   for (int i = 0; i < n - 1; i++) {
+
+      pids[i] = fork();
+      DEVSHELL_CMD_ASSERT(pids[i] >= 0);
+
+      if (!pids[i]) {
+         while (true)
+            sched_yield();
+      }
+   }
+
+   snprintf(name, sizeof(name), "lat_sched_yield_%d_tasks", n);
+   lat_measure(name, &lat_yield);
+
+   for (int i = 0; i < n - 1; i++) {
+      DEVSHELL_CMD_ASSERT(kill(pids[i], SIGKILL) == 0);
+      rc = waitpid(pids[i], &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == pids[i]);
+   }
+
+   return 0;
+}
@@ -14,6 +14,9 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/auxv.h>
+
+#include <linux/futex.h> // system header
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -497,3 +500,175 @@ int cmd_getrusage(int argc, char **argv)
    printf("OK\n");
    return 0;
 }
+
+static long futex(u_int32_t *uaddr, int op, u_int32_t val,
+                  const struct timespec *timeout,
+                  u_int32_t *uaddr2, u_int32_t val3)
+{
+   return syscall(SYS_futex, uaddr, op, val, timeout, uaddr2, val3);
+}
+
+/*
+ * Maps again the memfd in the child, at a different vaddr, and waits there on
+ * the first word. Exits with 0 only if the parent really woke us up.
+ */
+static void futex1_child(int fd)
+{
+   struct timespec ts = { .tv_sec = 10, .tv_nsec = 0 };
+   u_int32_t *w;
+   long rc;
+
+   w = mmap(NULL, (size_t)getpagesize(),
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+   if (w == (void *)-1)
+      exit(2);
+
+   rc = futex(&w[0], FUTEX_WAIT, 0, &ts, NULL, 0);
+   exit(rc == 0 ? 0 : 1);
+}
+
+/*
+ * A forked child sleeps on a futex word in a memfd mapping, then the parent
+ * wakes it up: directly with FUTEX_WAKE or, with `requeue`, moving it first
+ * with FUTEX_CMP_REQUEUE on the second word and then waking it up there.
+ */
+static void futex1_shared(bool requeue)
+{
+   const size_t page_size = (size_t)getpagesize();
+   int fd, wstatus, i;
+   u_int32_t *w;
+   pid_t child;
+   long rc = 0;
+
+   fd = sys_memfd_create("futex1", MFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(ftruncate(fd, (off_t)page_size) == 0);
+
+   w = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(w != (void *)-1);
+   w[0] = w[1] = 0;
+
+   DEVSHELL_CMD_ASSERT((child = fork()) >= 0);
+
+   if (!child)
+      futex1_child(fd);
+
+   /* Retry until the child has gone to sleep on the futex */
+   for (i = 0; i < 100 && rc <= 0; i++) {
+
+      if (requeue)
+         rc = futex(&w[0], FUTEX_CMP_REQUEUE, 0, (void *)1, &w[1], 0);
+      else
+         rc = futex(&w[0], FUTEX_WAKE, 1, NULL, NULL, 0);
+
+      if (rc <= 0)
+         usleep(10 * 1000);
+   }
+
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   if (requeue) {
+
+      /* The child now sleeps on the second word only */
+      rc = futex(&w[0], FUTEX_WAKE, 1, NULL, NULL, 0);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      rc = futex(&w[1], FUTEX_WAKE, 1, NULL, NULL, 0);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+   }
+
+   rc = waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == child);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && !WEXITSTATUS(wstatus));
+
+   munmap(w, page_size);
+   close(fd);
+}
+
+int cmd_futex1(int argc, char **argv)
+{
+   struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000 };
+   u_int32_t word = 1234;
+   long rc;
+
+   // A mismatching value must make FUTEX_WAIT fail immediately
+   rc = futex(&word, FUTEX_WAIT, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EAGAIN);
+
+   // The timeout has to make FUTEX_WAIT return with ETIMEDOUT
+   rc = futex(&word, FUTEX_WAIT_PRIVATE, word, &ts, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ETIMEDOUT);
+
+   // Nobody is waiting on the futex
+   rc = futex(&word, FUTEX_WAKE, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   // A zero bitset is invalid
+   rc = futex(&word, FUTEX_WAIT_BITSET, word, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   // Misaligned futex words are invalid
+   rc = futex((void *)((char *)&word + 1), FUTEX_WAKE, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   // FUTEX_CMP_REQUEUE checks the value of the first futex word
+   rc = futex(&word, FUTEX_CMP_REQUEUE, 1, NULL, &word, word + 1);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EAGAIN);
+
+   rc = futex(&word, FUTEX_CMP_REQUEUE, 1, NULL, &word, word);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   futex1_shared(false);
+   futex1_shared(true);
+
+   printf("OK\n");
+   return 0;
+}
+
+static long long tv_to_us(struct timeval *tv)
+{
+   return (long long)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+int cmd_vdso1(int argc, char **argv)
+{
+   struct timeval a, b, prev = {0};
+   struct { long tv_sec; long tv_usec; } raw;
+   struct timespec ts;
+   time_t t;
+   int rc;
+
+   if (!getauxval(AT_SYSINFO_EHDR))
+      printf("[INFO]: No vDSO image, libc will use the syscalls\n");
+
+   for (int i = 0; i < 1000; i++) {
+
+      // Going through the vDSO, if available
+      rc = gettimeofday(&a, NULL);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      // The time must never go backwards
+      DEVSHELL_CMD_ASSERT(tv_to_us(&a) >= tv_to_us(&prev));
+      prev = a;
+
+      // The vDSO must agree with the syscall
+      rc = syscall(SYS_gettimeofday, &raw, NULL);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      b.tv_sec = raw.tv_sec;
+      b.tv_usec = raw.tv_usec;
+      DEVSHELL_CMD_ASSERT(tv_to_us(&b) >= tv_to_us(&a));
+      DEVSHELL_CMD_ASSERT(tv_to_us(&b) - tv_to_us(&a) < 1000000);
+   }
+
+   rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(ts.tv_nsec >= 0 && ts.tv_nsec < 1000000000);
+
+   t = time(NULL);
+   DEVSHELL_CMD_ASSERT(t >= prev.tv_sec && t - prev.tv_sec <= 1);
+
+   printf("OK\n");
+   return 0;
+}
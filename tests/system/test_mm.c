@@ -14,6 +14,8 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -159,6 +161,408 @@ int cmd_mmap2(int argc, char **argv)
    return 0;
 }
 
+#ifndef MREMAP_MAYMOVE
+   #define MREMAP_MAYMOVE     1
+#endif
+
+static void *sys_mremap(void *old, size_t old_len, size_t new_len, int flags)
+{
+   return (void *)syscall(SYS_mremap, old, old_len, new_len, flags);
+}
+
+static bool check_pattern(char *buf, size_t len, char c)
+{
+   for (size_t i = 0; i < len; i++)
+      if (buf[i] != c)
+         return false;
+
+   return true;
+}
+
+int cmd_mremap1(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   char *a, *b, *g;
+
+   a = mmap(NULL, 2 * pg, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(a != MAP_FAILED);
+   memset(a, 'a', 2 * pg);
+
+   /* Grow (in-place, if possible) */
+   b = sys_mremap(a, 2 * pg, 3 * pg, MREMAP_MAYMOVE);
+   DEVSHELL_CMD_ASSERT(b != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, 2 * pg, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(b + 2 * pg, pg, 0));
+   memset(b + 2 * pg, 'b', pg);
+
+   /* Another mapping, likely right after the first one */
+   g = mmap(NULL, pg, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(g != MAP_FAILED);
+
+   /* Grow without moving: it either succeeds in-place, or fails */
+   a = sys_mremap(b, 3 * pg, 64 * pg, 0);
+   DEVSHELL_CMD_ASSERT(a == b || (a == MAP_FAILED && errno == ENOMEM));
+
+   if (a == MAP_FAILED) {
+
+      /* Grow by moving the pages */
+      a = sys_mremap(b, 3 * pg, 64 * pg, MREMAP_MAYMOVE);
+      DEVSHELL_CMD_ASSERT(a != MAP_FAILED);
+      DEVSHELL_CMD_ASSERT(a != b);
+   }
+
+   DEVSHELL_CMD_ASSERT(check_pattern(a, 2 * pg, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(a + 2 * pg, pg, 'b'));
+   DEVSHELL_CMD_ASSERT(check_pattern(a + 3 * pg, 61 * pg, 0));
+   memset(a + 3 * pg, 'c', 61 * pg);
+
+   /* Shrink */
+   b = sys_mremap(a, 64 * pg, pg, 0);
+   DEVSHELL_CMD_ASSERT(b == a);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, pg, 'a'));
+
+   /* Invalid parameters */
+   DEVSHELL_CMD_ASSERT(sys_mremap(b + 1, pg, 2 * pg, 0) == MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(errno == EINVAL);
+   DEVSHELL_CMD_ASSERT(sys_mremap(b, pg, 0, 0) == MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(errno == EINVAL);
+
+   DEVSHELL_CMD_ASSERT(munmap(b, pg) == 0);
+   DEVSHELL_CMD_ASSERT(munmap(g, pg) == 0);
+   return 0;
+}
+
+#ifndef MAP_HUGETLB
+   #define MAP_HUGETLB        0x40000
+#endif
+
+#ifndef MADV_HUGEPAGE
+   #define MADV_HUGEPAGE      14
+#endif
+
+int cmd_hugemmap1(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   const size_t len = 8 * MB;
+   int child, wstatus;
+   char *a, *b;
+
+   a = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(a != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(check_pattern(a, len, 0));
+   memset(a, 'a', len);
+
+   /* Partial unmap in the middle: big pages must be split */
+   DEVSHELL_CMD_ASSERT(munmap(a + 2 * MB, pg) == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(a, 2 * MB, 'a'));
+   DEVSHELL_CMD_ASSERT(check_pattern(a + 2 * MB + pg, len - 2 * MB - pg, 'a'));
+
+   /* Fork: the child's writes must not be visible to the parent (COW) */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+      memset(a + 4 * MB, 'c', 4 * MB);
+      exit(check_pattern(a + 4 * MB, 4 * MB, 'c') ? 0 : 1);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(a + 4 * MB, 4 * MB, 'a'));
+
+   DEVSHELL_CMD_ASSERT(munmap(a, 2 * MB) == 0);
+   DEVSHELL_CMD_ASSERT(munmap(a + 2 * MB + pg, len - 2 * MB - pg) == 0);
+
+   /* madvise(MADV_HUGEPAGE) on a regular mapping must preserve its content */
+   b = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(b != MAP_FAILED);
+   memset(b, 'b', len / 2);
+   DEVSHELL_CMD_ASSERT(madvise(b, len, MADV_HUGEPAGE) == 0);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, len / 2, 'b'));
+   DEVSHELL_CMD_ASSERT(check_pattern(b + len / 2, len / 2, 0));
+   DEVSHELL_CMD_ASSERT(munmap(b, len) == 0);
+   return 0;
+}
+
+static void rlimit_as_child(void)
+{
+   const size_t pg = getpagesize();
+   struct rlimit rl = { .rlim_cur = 0, .rlim_max = RLIM_INFINITY };
+   ulong brk0;
+   void *a;
+
+   brk0 = (ulong)syscall(SYS_brk, 0);
+
+   /* With a zero soft limit, the address space cannot grow at all */
+   DEVSHELL_CMD_ASSERT(setrlimit(RLIMIT_AS, &rl) == 0);
+   DEVSHELL_CMD_ASSERT(getrlimit(RLIMIT_AS, &rl) == 0);
+   DEVSHELL_CMD_ASSERT(rl.rlim_cur == 0 && rl.rlim_max == RLIM_INFINITY);
+
+   a = mmap(NULL, pg, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(a == MAP_FAILED && errno == ENOMEM);
+   DEVSHELL_CMD_ASSERT((ulong)syscall(SYS_brk, brk0 + pg) == brk0);
+
+   /* Without the limit, both must succeed */
+   rl.rlim_cur = RLIM_INFINITY;
+   DEVSHELL_CMD_ASSERT(setrlimit(RLIMIT_AS, &rl) == 0);
+
+   a = mmap(NULL, pg, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(a != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(munmap(a, pg) == 0);
+   DEVSHELL_CMD_ASSERT((ulong)syscall(SYS_brk, brk0 + pg) == brk0 + pg);
+   DEVSHELL_CMD_ASSERT((ulong)syscall(SYS_brk, brk0) == brk0);
+}
+
+/*
+ * RLIMIT_AS: growing the address space beyond the limit must fail with ENOMEM
+ * with mmap() and leave the program break unchanged with brk(). The test runs
+ * in a child process, in order to not limit the devshell itself.
+ */
+int cmd_rlimit_as(int argc, char **argv)
+{
+   int child, wstatus;
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+      rlimit_as_child();
+      exit(0);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   return 0;
+}
+
+static long
+vm_rw(bool write, int pid, struct iovec *l, int lc, struct iovec *r, int rc)
+{
+   const long nr = write ? SYS_process_vm_writev : SYS_process_vm_readv;
+   return syscall(nr, pid, l, (ulong)lc, r, (ulong)rc, 0ul);
+}
+
+/*
+ * process_vm_readv() and process_vm_writev() between a parent and its child,
+ * with iovec elements of different sizes on the two sides.
+ */
+int cmd_process_vm1(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   int child, wstatus, p1[2], p2[2];
+   char *a, *buf, c = 0;
+   struct iovec l[2], r[1];
+
+   a = mmap(NULL, 2 * pg, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+   buf = malloc(2 * pg);
+
+   DEVSHELL_CMD_ASSERT(a != MAP_FAILED && buf != NULL);
+   DEVSHELL_CMD_ASSERT(pipe(p1) == 0 && pipe(p2) == 0);
+   memset(a, 'a', 2 * pg);
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      memset(a, 'c', 2 * pg);       /* Private and writable, now */
+
+      if (write(p1[1], &c, 1) != 1 || read(p2[0], &c, 1) != 1)
+         exit(1);
+
+      exit(check_pattern(a, pg, 'w') && check_pattern(a + pg, pg, 'c') ? 0:1);
+   }
+
+   DEVSHELL_CMD_ASSERT(read(p1[0], &c, 1) == 1);
+
+   l[0] = (struct iovec) { .iov_base = buf, .iov_len = 100 };
+   l[1] = (struct iovec) { .iov_base = buf + 100, .iov_len = 2 * pg - 100 };
+   r[0] = (struct iovec) { .iov_base = a, .iov_len = 2 * pg };
+
+   DEVSHELL_CMD_ASSERT(vm_rw(false, child, l, 2, r, 1) == (long)(2 * pg));
+   DEVSHELL_CMD_ASSERT(check_pattern(buf, 2 * pg, 'c'));
+   DEVSHELL_CMD_ASSERT(check_pattern(a, 2 * pg, 'a'));
+
+   memset(buf, 'w', pg);
+   l[0].iov_len = pg;
+   r[0].iov_len = pg;
+   DEVSHELL_CMD_ASSERT(vm_rw(true, child, l, 1, r, 1) == (long)pg);
+
+   /* Unmapped remote memory, invalid flags and pids */
+   r[0].iov_base = NULL;
+   DEVSHELL_CMD_ASSERT(vm_rw(false, child, l, 1, r, 1) == -1);
+   DEVSHELL_CMD_ASSERT(errno == EFAULT);
+
+   r[0].iov_base = a;
+   DEVSHELL_CMD_ASSERT(syscall(SYS_process_vm_readv, child, l, 1ul,
+                               r, 1ul, 1ul) == -1 && errno == EINVAL);
+
+   DEVSHELL_CMD_ASSERT(write(p2[1], &c, 1) == 1);
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   DEVSHELL_CMD_ASSERT(vm_rw(false, child, l, 1, r, 1) == -1);
+   DEVSHELL_CMD_ASSERT(errno == ESRCH);
+
+   close(p1[0]); close(p1[1]);
+   close(p2[0]); close(p2[1]);
+   free(buf);
+   DEVSHELL_CMD_ASSERT(munmap(a, 2 * pg) == 0);
+   return 0;
+}
+
+/*
+ * Anonymous memory: the first write in a window of pages allocates also the
+ * neighbour pages (fault-around), while MAP_POPULATE allocates all of them
+ * upfront. In both cases, the content must be zero until written.
+ */
+int cmd_mmap3(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   const size_t len = 1 * MB;
+   int child, wstatus;
+   char *a, *b;
+
+   a = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(a != MAP_FAILED);
+
+   /* Write just one byte every 3 pages, then check the others */
+   for (size_t off = 0; off < len; off += 3 * pg)
+      a[off + 1] = 'a';
+
+   for (size_t off = 0; off < len; off += pg) {
+      DEVSHELL_CMD_ASSERT(a[off] == 0);
+      DEVSHELL_CMD_ASSERT(a[off + 1] == ((off / pg) % 3 ? 0 : 'a'));
+   }
+
+   /* The pages allocated by fault-around must be private too */
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+      memset(a, 'c', len);
+      exit(check_pattern(a, len, 'c') ? 0 : 1);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(a[0] == 0 && a[1] == 'a' && a[pg + 1] == 0);
+   DEVSHELL_CMD_ASSERT(munmap(a, len) == 0);
+
+   b = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(b != MAP_FAILED);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, len, 0));
+   memset(b, 'b', len);
+   DEVSHELL_CMD_ASSERT(check_pattern(b, len, 'b'));
+   DEVSHELL_CMD_ASSERT(munmap(b, len) == 0);
+   return 0;
+}
+
+#define MMAP4_COUNT          256
+
+/* Is the page `p` of the mapping `i` still mapped? See cmd_mmap4() */
+static bool mmap4_is_mapped(int i, int p)
+{
+   return !((i % 3 == 0 && p == 1) || (i % 3 == 1 && p == 0));
+}
+
+static bool mmap4_check(char **maps, size_t pg, char c)
+{
+   for (int i = 0; i < MMAP4_COUNT; i++)
+      for (int p = 0; p < 3; p++)
+         if (mmap4_is_mapped(i, p) && maps[i][p * pg] != (char)(c + i + p))
+            return false;
+
+   return true;
+}
+
+/* Many mappings, split by partial munmap() calls, then inherited by fork() */
+int cmd_mmap4(int argc, char **argv)
+{
+   const size_t pg = getpagesize();
+   static char *maps[MMAP4_COUNT];
+   int child, wstatus, rc;
+
+   for (int i = 0; i < MMAP4_COUNT; i++) {
+
+      maps[i] = mmap(NULL, 3 * pg, PROT_READ | PROT_WRITE,
+                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+      DEVSHELL_CMD_ASSERT(maps[i] != MAP_FAILED);
+   }
+
+   /* Touch the pages in a non-sequential order */
+   for (int p = 0; p < 3; p++)
+      for (int i = MMAP4_COUNT - 1; i >= 0; i--)
+         maps[i][p * pg] = (char)('a' + i + p);
+
+   for (int i = 0; i < MMAP4_COUNT; i++) {
+
+      if (i % 3 == 0)
+         rc = munmap(maps[i] + pg, pg);         /* split in two mappings */
+      else if (i % 3 == 1)
+         rc = munmap(maps[i], pg);              /* shrink from the start */
+      else
+         rc = 0;
+
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   DEVSHELL_CMD_ASSERT(mmap4_check(maps, pg, 'a'));
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      /* All the mappings must be found in the child too, for the CoW faults */
+      if (!mmap4_check(maps, pg, 'a'))
+         exit(1);
+
+      for (int i = 0; i < MMAP4_COUNT; i++)
+         for (int p = 0; p < 3; p++)
+            if (mmap4_is_mapped(i, p))
+               maps[i][p * pg] = (char)('A' + i + p);
+
+      exit(mmap4_check(maps, pg, 'A') ? 0 : 2);
+   }
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(mmap4_check(maps, pg, 'a'));
+
+   for (int i = 0; i < MMAP4_COUNT; i++) {
+
+      if (i % 3 == 0) {
+         DEVSHELL_CMD_ASSERT(munmap(maps[i], pg) == 0);
+         DEVSHELL_CMD_ASSERT(munmap(maps[i] + 2 * pg, pg) == 0);
+      } else if (i % 3 == 1) {
+         DEVSHELL_CMD_ASSERT(munmap(maps[i] + pg, 2 * pg) == 0);
+      } else {
+         DEVSHELL_CMD_ASSERT(munmap(maps[i], 3 * pg) == 0);
+      }
+   }
+
+   return 0;
+}
+
 static size_t fork_oom_alloc_size;
 
 static void fork_oom_child(void *buf)
@@ -391,3 +795,114 @@ int cmd_fork_oom(int argc, char **argv)
    free(buf);
    return rc;
 }
+
+/*
+ * Memory management benchmarks: the cost of the first-touch faults on
+ * anonymous memory, with regular and with big pages, and the cost of the
+ * copy-on-write faults after fork(). The results are per page (4 KB).
+ */
+
+#define MM_BENCH_LEN                      (4 * MB)
+
+static char *mm_bench_mem;
+static int mm_bench_pipe[2];
+static pid_t mm_bench_child;
+
+static void mm_bench_map(void)
+{
+   mm_bench_mem = mmap(NULL, MM_BENCH_LEN, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(mm_bench_mem != MAP_FAILED);
+}
+
+static void mm_bench_touch(void)
+{
+   const size_t pg = getpagesize();
+
+   for (size_t off = 0; off < MM_BENCH_LEN; off += pg)
+      mm_bench_mem[off] = 1;
+}
+
+static void mm_bench_unmap(void)
+{
+   DEVSHELL_CMD_ASSERT(munmap(mm_bench_mem, MM_BENCH_LEN) == 0);
+}
+
+/* With MAP_HUGETLB, the work is done by mmap(): measure it as well */
+static void mm_bench_map_huge_and_touch(void)
+{
+   mm_bench_mem = mmap(NULL, MM_BENCH_LEN, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(mm_bench_mem != MAP_FAILED);
+   mm_bench_touch();
+}
+
+/*
+ * Map and populate the memory, then fork a child sharing it and waiting on
+ * a pipe: all the writes in the parent will trigger COW faults.
+ */
+static void mm_bench_cow_setup(void)
+{
+   char c;
+
+   mm_bench_map();
+   mm_bench_touch();
+   DEVSHELL_CMD_ASSERT(pipe(mm_bench_pipe) == 0);
+
+   mm_bench_child = fork();
+   DEVSHELL_CMD_ASSERT(mm_bench_child >= 0);
+
+   if (!mm_bench_child) {
+      close(mm_bench_pipe[1]);
+      exit(read(mm_bench_pipe[0], &c, 1) == 0 ? 0 : 1);
+   }
+
+   close(mm_bench_pipe[0]);
+}
+
+static void mm_bench_cow_teardown(void)
+{
+   int wstatus;
+
+   close(mm_bench_pipe[1]);   /* The child gets EOF and exits */
+   DEVSHELL_CMD_ASSERT(waitpid(mm_bench_child, &wstatus, 0) == mm_bench_child);
+   mm_bench_unmap();
+}
+
+int cmd_mm_bench(int argc, char **argv)
+{
+   const int pages = MM_BENCH_LEN / getpagesize();
+
+   ubench_run(&(struct ubench) {
+      .name = "mm_first_touch_4k",
+      .warmup = 2,
+      .iters = 50,
+      .ops = pages,
+      .setup = &mm_bench_map,
+      .func = &mm_bench_touch,
+      .teardown = &mm_bench_unmap,
+   });
+
+   ubench_run(&(struct ubench) {
+      .name = "mm_first_touch_big_pages",
+      .warmup = 2,
+      .iters = 50,
+      .ops = pages,
+      .func = &mm_bench_map_huge_and_touch,
+      .teardown = &mm_bench_unmap,
+   });
+
+   ubench_run(&(struct ubench) {
+      .name = "mm_cow_fault_after_fork",
+      .warmup = 2,
+      .iters = 50,
+      .ops = pages,
+      .setup = &mm_bench_cow_setup,
+      .func = &mm_bench_touch,
+      .teardown = &mm_bench_cow_teardown,
+   });
+
+   return 0;
+}
@@ -10,6 +10,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include "devshell.h"
 #include "test_common.h"
@@ -388,10 +390,9 @@ pipe_random_test(int readers, int writers)
       return 1;
    }
 
-   if (!getenv("TILCK")) {
-      fcntl(pipefd[0], F_SETPIPE_SZ, 4096);
-      fcntl(pipefd[1], F_SETPIPE_SZ, 4096);
-   }
+   /* Use small pipes, in order to have plenty of blocking reads and writes */
+   fcntl(pipefd[0], F_SETPIPE_SZ, 4096);
+   fcntl(pipefd[1], F_SETPIPE_SZ, 4096);
 
    for (int i = 0; i < writers; i++) {
 
@@ -469,3 +470,290 @@ int cmd_pipe5(int argc, char **argv)
 
    return 0;
 }
+
+/* Resize a pipe with F_SETPIPE_SZ, also while it contains data */
+int cmd_pipe6(int argc, char **argv)
+{
+   const int page_size = getpagesize();
+   const int buf_size = 4 * page_size;
+   char *buf = malloc(buf_size);
+   char *buf2 = malloc(buf_size);
+   int pipefd[2];
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(buf && buf2);
+
+   for (int i = 0; i < buf_size; i++)
+      buf[i] = (char)('a' + i % 26);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fcntl(pipefd[0], F_GETPIPE_SZ);
+   DEVSHELL_CMD_ASSERT(rc >= page_size);
+
+   /* The size is rounded up to at least one page */
+   rc = fcntl(pipefd[1], F_SETPIPE_SZ, 100);
+   DEVSHELL_CMD_ASSERT(rc == page_size);
+
+   rc = write(pipefd[1], buf, buf_size);
+   DEVSHELL_CMD_ASSERT(rc == page_size);
+
+   rc = write(pipefd[1], buf, 1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* Grow the pipe while it's full: the size is rounded to 2^n pages */
+   rc = fcntl(pipefd[1], F_SETPIPE_SZ, 3 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == buf_size);
+
+   rc = write(pipefd[1], buf + page_size, buf_size);
+   DEVSHELL_CMD_ASSERT(rc == 3 * page_size);
+
+   /* The pipe cannot shrink below the data it contains */
+   rc = fcntl(pipefd[1], F_SETPIPE_SZ, page_size);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBUSY);
+
+   rc = read(pipefd[0], buf2, buf_size);
+   DEVSHELL_CMD_ASSERT(rc == buf_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, buf_size));
+
+   /* F_SETPIPE_SZ works only on pipes */
+   rc = fcntl(0, F_GETPIPE_SZ);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   close(pipefd[0]);
+   close(pipefd[1]);
+   free(buf2);
+   free(buf);
+   return 0;
+}
+
+/* Call the syscalls directly: they require _GNU_SOURCE */
+static int sys_tee(int fd_in, int fd_out, size_t len, unsigned flags)
+{
+   return (int)syscall(SYS_tee, fd_in, fd_out, len, flags);
+}
+
+static int sys_vmsplice(int fd, const struct iovec *iov, int cnt, unsigned fl)
+{
+   return (int)syscall(SYS_vmsplice, fd, iov, cnt, fl);
+}
+
+static int sys_pipe_splice(int fd_in, int fd_out, size_t len, unsigned flags)
+{
+   return (int)syscall(SYS_splice, fd_in, NULL, fd_out, NULL, len, flags);
+}
+
+#define TEST_SPLICE_F_NONBLOCK       2
+
+/* vmsplice() into a pipe, tee() it to a second pipe and splice() to a third */
+int cmd_pipe7(int argc, char **argv)
+{
+   static const char msg1[] = "hello, ";
+   static const char msg2[] = "tee world!";
+   const size_t len = sizeof(msg1) - 1 + sizeof(msg2) - 1;
+   struct iovec iov[2];
+   char buf[64], buf2[64];
+   int a[2], b[2], c[2];
+   int rc;
+
+   rc = pipe(a);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = pipe(b);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = pipe(c);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   iov[0] = (struct iovec) { (void *)msg1, sizeof(msg1) - 1 };
+   iov[1] = (struct iovec) { (void *)msg2, sizeof(msg2) - 1 };
+
+   rc = sys_vmsplice(a[1], iov, 2, 0);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   /* tee() duplicates the data, without consuming it */
+   rc = sys_tee(a[0], b[1], len, 0);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   /* splice() between two pipes moves it */
+   rc = sys_pipe_splice(a[0], c[1], len, 0);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   /* Now `a` is empty */
+   rc = sys_tee(a[0], b[1], len, TEST_SPLICE_F_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   rc = read(b[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   /* vmsplice() on the read end reads into the user buffers */
+   iov[0] = (struct iovec) { buf2, 3 };
+   iov[1] = (struct iovec) { buf2 + 3, sizeof(buf2) - 3 };
+   rc = sys_vmsplice(c[0], iov, 2, 0);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, len));
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, msg1, sizeof(msg1) - 1));
+   DEVSHELL_CMD_ASSERT(!memcmp(buf + sizeof(msg1) - 1, msg2, sizeof(msg2) - 1));
+
+   /* tee() works only between two pipes, from a read end to a write end */
+   rc = sys_tee(a[0], 1, len, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = sys_tee(a[1], b[1], len, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   /* No more writers: tee() returns 0 */
+   close(a[1]);
+   rc = sys_tee(a[0], b[1], len, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   close(a[0]);
+   close(b[0]);
+   close(b[1]);
+   close(c[0]);
+   close(c[1]);
+   return 0;
+}
+
+/* writev() and readv() on a pipe, with more segments than the data */
+int cmd_pipe8(int argc, char **argv)
+{
+   static const char msg1[] = "scatter ";
+   static const char msg2[] = "and gather";
+   const size_t len = sizeof(msg1) - 1 + sizeof(msg2) - 1;
+   struct iovec iov[3];
+   char buf[8], buf2[64];
+   int fds[2];
+   int rc;
+
+   rc = pipe(fds);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   iov[0] = (struct iovec) { (void *)msg1, sizeof(msg1) - 1 };
+   iov[1] = (struct iovec) { NULL, 0 };
+   iov[2] = (struct iovec) { (void *)msg2, sizeof(msg2) - 1 };
+
+   rc = writev(fds[1], iov, 3);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+
+   /* Wrong ends of the pipe */
+   rc = writev(fds[0], iov, 3);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   rc = readv(fds[1], iov, 3);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   iov[0] = (struct iovec) { buf, sizeof(buf) };
+   iov[1] = (struct iovec) { buf2, sizeof(buf2) };
+   iov[2] = (struct iovec) { buf2 + 32, 32 };
+
+   rc = readv(fds[0], iov, 3);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, msg1, sizeof(buf)));
+   DEVSHELL_CMD_ASSERT(!memcmp(buf2, msg2, sizeof(msg2) - 1));
+
+   close(fds[0]);
+   close(fds[1]);
+   return 0;
+}
+
+#ifndef O_DIRECT
+   #define O_DIRECT                        040000   /* same on all our archs */
+#endif
+
+static int sys_pipe2(int fds[2], int flags)
+{
+   return (int)syscall(SYS_pipe2, fds, flags);
+}
+
+/* Packet mode: pipe2() with O_DIRECT preserves the boundaries of the writes */
+int cmd_pipe9(int argc, char **argv)
+{
+   static const char *msgs[] = { "ab", "cdef", "g" };
+   char buf[PIPE_BUF + 16], buf2[64];
+   struct iovec iov[2];
+   int fds[2], other[2];
+   int rc;
+
+   rc = sys_pipe2(fds, O_DIRECT);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = fcntl(fds[1], F_SETPIPE_SZ, 64 * 1024);
+   DEVSHELL_CMD_ASSERT(rc >= 64 * 1024);
+
+   for (int i = 0; i < 3; i++) {
+      rc = write(fds[1], msgs[i], strlen(msgs[i]));
+      DEVSHELL_CMD_ASSERT(rc == (int)strlen(msgs[i]));
+   }
+
+   /* One packet per read(), no matter how big the buffer is */
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 2 && !memcmp(buf, "ab", 2));
+
+   /* The rest of a packet not fitting in the buffer is discarded */
+   rc = read(fds[0], buf, 2);
+   DEVSHELL_CMD_ASSERT(rc == 2 && !memcmp(buf, "cd", 2));
+
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 1 && buf[0] == 'g');
+
+   /* Writes bigger than PIPE_BUF are split in multiple packets */
+   memset(buf, 'x', sizeof(buf));
+   rc = write(fds[1], buf, PIPE_BUF + 10);
+   DEVSHELL_CMD_ASSERT(rc == PIPE_BUF + 10);
+
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == PIPE_BUF);
+
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 10);
+
+   /* readv() scatters a single packet */
+   rc = write(fds[1], "scatter", 7);
+   DEVSHELL_CMD_ASSERT(rc == 7);
+
+   iov[0] = (struct iovec) { buf, 4 };
+   iov[1] = (struct iovec) { buf2, sizeof(buf2) };
+   rc = readv(fds[0], iov, 2);
+   DEVSHELL_CMD_ASSERT(rc == 7);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, "scat", 4) && !memcmp(buf2, "ter", 3));
+
+   /* tee() and splice() would lose the packet boundaries */
+   rc = pipe(other);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(fds[1], "p", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = sys_tee(fds[0], other[1], 1, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   /* The mode can be changed only when the pipe is empty */
+   rc = fcntl(fds[1], F_SETFL, O_WRONLY);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBUSY);
+
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = fcntl(fds[1], F_SETFL, O_WRONLY);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Back to the stream mode */
+   rc = write(fds[1], "ab", 2);
+   DEVSHELL_CMD_ASSERT(rc == 2);
+
+   rc = write(fds[1], "c", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = read(fds[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 3 && !memcmp(buf, "abc", 3));
+
+   close(other[0]);
+   close(other[1]);
+   close(fds[0]);
+   close(fds[1]);
+   return 0;
+}
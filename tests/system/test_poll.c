@@ -10,6 +10,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include "devshell.h"
 
@@ -474,3 +477,316 @@ int cmd_pollhup(int argc, char **argv)
 {
    return common_pollerr_pollhup_test(false);
 }
+
+/* Level-triggered and edge-triggered epoll on a pipe, without blocking */
+int cmd_epoll1(int argc, char **argv)
+{
+   struct epoll_event ev, out[4];
+   int pipefd[2];
+   int epfd, rc;
+   char c;
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   epfd = epoll_create1(EPOLL_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(epfd >= 0);
+
+   ev = (struct epoll_event) { .events = EPOLLIN, .data.u64 = 1234 };
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EEXIST);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, epfd, &ev);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   /* Nothing to read yet */
+   rc = epoll_wait(epfd, out, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(pipefd[1], "x", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   /* Level-triggered: we get the event as long as the data is there */
+   for (int i = 0; i < 2; i++) {
+      rc = epoll_wait(epfd, out, 4, 0);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+      DEVSHELL_CMD_ASSERT(out[0].events == EPOLLIN);
+      DEVSHELL_CMD_ASSERT(out[0].data.u64 == 1234);
+   }
+
+   rc = read(pipefd[0], &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = epoll_wait(epfd, out, 4, 50);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Edge-triggered: we get only one event per write */
+   ev.events = EPOLLIN | EPOLLET;
+   rc = epoll_ctl(epfd, EPOLL_CTL_MOD, pipefd[0], &ev);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(pipefd[1], "y", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = epoll_wait(epfd, out, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   rc = epoll_wait(epfd, out, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, pipefd[0], NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, pipefd[0], NULL);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ENOENT);
+
+   close(pipefd[0]);
+   close(pipefd[1]);
+   close(epfd);
+   return 0;
+}
+
+/* Block in epoll_wait() until a child process writes on the pipe */
+int cmd_epoll2(int argc, char **argv)
+{
+   struct epoll_event ev, out[1];
+   int pipefd[2];
+   int epfd, rc, wstatus;
+   pid_t childpid;
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   epfd = epoll_create1(0);
+   DEVSHELL_CMD_ASSERT(epfd >= 0);
+
+   ev = (struct epoll_event) { .events = EPOLLIN, .data.fd = pipefd[0] };
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      usleep(100 * 1000);
+      rc = write(pipefd[1], "x", 1);
+      exit(rc == 1 ? 0 : 1);
+   }
+
+   rc = epoll_wait(epfd, out, 1, -1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(out[0].data.fd == pipefd[0]);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* Closing the fd drops its registration */
+   close(pipefd[0]);
+   rc = epoll_wait(epfd, out, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   close(pipefd[1]);
+   close(epfd);
+   return 0;
+}
+
+int cmd_eventfd1(int argc, char **argv)
+{
+   struct epoll_event ev, out[1];
+   int efd, epfd, rc, wstatus;
+   pid_t childpid;
+   uint64_t val;
+
+   efd = eventfd(3, EFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   /* Normal mode: read() returns the whole counter and resets it */
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val == 3);
+
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* Short buffers and the max value are rejected */
+   rc = read(efd, &val, 4);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   val = UINT64_MAX;
+   rc = write(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+   close(efd);
+
+   /* Semaphore mode: each read() decrements by 1 */
+   efd = eventfd(2, EFD_SEMAPHORE | EFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   for (int i = 0; i < 2; i++) {
+      rc = read(efd, &val, sizeof(val));
+      DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val == 1);
+   }
+
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+   close(efd);
+
+   /* Blocking mode + epoll: wake up from another process */
+   efd = eventfd(0, 0);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   epfd = epoll_create1(0);
+   DEVSHELL_CMD_ASSERT(epfd >= 0);
+
+   ev = (struct epoll_event) { .events = EPOLLIN, .data.fd = efd };
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      usleep(50 * 1000);
+      val = 5;
+      rc = write(efd, &val, sizeof(val));
+      exit(rc == sizeof(val) ? 0 : 1);
+   }
+
+   rc = epoll_wait(epfd, out, 1, -1);
+   DEVSHELL_CMD_ASSERT(rc == 1 && out[0].data.fd == efd);
+
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val == 5);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   close(epfd);
+   close(efd);
+   return 0;
+}
+
+int cmd_timerfd1(int argc, char **argv)
+{
+   struct itimerspec its, old;
+   struct pollfd pfd;
+   int tfd, rc;
+   uint64_t val;
+
+   rc = timerfd_create(CLOCK_BOOTTIME, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(tfd >= 0);
+
+   /* Not armed: nothing to read */
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   rc = timerfd_gettime(tfd, &its);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(!its.it_value.tv_sec && !its.it_value.tv_nsec);
+
+   /* Periodic timer: first expiration after 50 ms, then every 20 ms */
+   its = (struct itimerspec) {
+      .it_value = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000 },
+      .it_interval = { .tv_sec = 0, .tv_nsec = 20 * 1000 * 1000 },
+   };
+
+   rc = timerfd_settime(tfd, 0, &its, NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = timerfd_gettime(tfd, &its);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(its.it_value.tv_sec || its.it_value.tv_nsec);
+   DEVSHELL_CMD_ASSERT(its.it_interval.tv_nsec > 0);
+
+   pfd = (struct pollfd) { .fd = tfd, .events = POLLIN };
+   rc = poll(&pfd, 1, 1000);
+   DEVSHELL_CMD_ASSERT(rc == 1 && (pfd.revents & POLLIN));
+
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val >= 1);
+
+   /* Missed periods are accounted, all at once */
+   usleep(100 * 1000);
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val >= 2);
+
+   /* Disarm the timer and get the old value */
+   its = (struct itimerspec) { 0 };
+   rc = timerfd_settime(tfd, 0, &its, &old);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(old.it_interval.tv_nsec > 0);
+
+   usleep(50 * 1000);
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+   close(tfd);
+
+   /* Blocking read() on an absolute timer, already expired */
+   tfd = timerfd_create(CLOCK_REALTIME, 0);
+   DEVSHELL_CMD_ASSERT(tfd >= 0);
+
+   rc = clock_gettime(CLOCK_REALTIME, &its.it_value);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   its.it_value.tv_sec--;
+   its.it_interval = (struct timespec) { 0 };
+
+   rc = timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(val) && val == 1);
+
+   close(tfd);
+   return 0;
+}
+
+/*
+ * The sysfs files report the changes of their value with POLLPRI | POLLERR,
+ * until they're read again from the beginning (see sysfs_notify()). The
+ * syscall stats notify their readers at most once per second.
+ */
+int cmd_pollpri1(int argc, char **argv)
+{
+   struct pollfd pfd;
+   char buf[256];
+   int fd, rc;
+
+   fd = open("/syst/tracing/syscalls", O_RDONLY);
+
+   if (fd < 0) {
+      printf("[SKIP] because /syst/tracing/syscalls is missing\n");
+      return 0;
+   }
+
+   pfd = (struct pollfd) { .fd = fd, .events = POLLPRI };
+   rc = poll(&pfd, 1, 3000);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(pfd.revents & POLLPRI);
+   DEVSHELL_CMD_ASSERT(!(pfd.revents & POLLIN));   /* not requested */
+
+   /* Re-read the new value: that acknowledges the change */
+   rc = lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = read(fd, buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc > 0);
+
+   /* The next notification cannot come before one second */
+   rc = poll(&pfd, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* POLLIN is always reported: the file can be read at any time */
+   pfd.events = POLLIN;
+   rc = poll(&pfd, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1 && pfd.revents == POLLIN);
+
+   close(fd);
+   return 0;
+}
@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
 
 #include "devshell.h"
 
@@ -1082,6 +1083,61 @@ int cmd_sig13(int argc, char **argv)
    return 0;
 }
 
+/* Test queued RT signals with sigqueue(), sigtimedwait() and signalfd() */
+int cmd_sigqueue1(int argc, char **argv)
+{
+   const int sig = SIGRTMIN + 1;
+   const struct timespec zero_ts = {0};
+   struct signalfd_siginfo ssi[4];
+   sigset_t set, oldset;
+   siginfo_t info;
+   int rc, sfd;
+
+   sigemptyset(&set);
+   sigaddset(&set, sig);
+   rc = sigprocmask(SIG_BLOCK, &set, &oldset);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* RT signals don't coalesce: each one is delivered, in FIFO order */
+   for (int i = 1; i <= 3; i++) {
+      rc = sigqueue(getpid(), sig, (union sigval) { .sival_int = i });
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   for (int i = 1; i <= 3; i++) {
+      rc = sigtimedwait(&set, &info, &zero_ts);
+      DEVSHELL_CMD_ASSERT(rc == sig);
+      DEVSHELL_CMD_ASSERT(info.si_code == SI_QUEUE);
+      DEVSHELL_CMD_ASSERT(info.si_value.sival_int == i);
+   }
+
+   rc = sigtimedwait(&set, &info, &zero_ts);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* signalfd: drain all the queued signals with a single read() */
+   sfd = signalfd(-1, &set, SFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(sfd >= 0);
+
+   for (int i = 10; i < 12; i++) {
+      rc = sigqueue(getpid(), sig, (union sigval) { .sival_int = i });
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   rc = read(sfd, ssi, sizeof(ssi));
+   DEVSHELL_CMD_ASSERT(rc == (int)(2 * sizeof(ssi[0])));
+   DEVSHELL_CMD_ASSERT(ssi[0].ssi_signo == (unsigned)sig);
+   DEVSHELL_CMD_ASSERT(ssi[0].ssi_int == 10);
+   DEVSHELL_CMD_ASSERT(ssi[1].ssi_int == 11);
+
+   rc = read(sfd, ssi, sizeof(ssi));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   close(sfd);
+   rc = sigprocmask(SIG_SETMASK, &oldset, NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
 /* Test that we can handle SIGSEGV, triggered by GPF */
 int cmd_sigsegv4(int argc, char **argv)
 {
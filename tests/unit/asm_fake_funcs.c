@@ -11,3 +11,16 @@ void switch_to_initial_kernel_stack() { NOT_REACHED(); }
 void fault_resumable_call() { NOT_REACHED(); }
 void asm_do_bogomips_loop(void) { NOT_REACHED(); }
 void asm_nop_loop(void) { NOT_REACHED(); }
+void asm_copy_user() { NOT_REACHED(); }
+
+/* Empty exception table */
+const char ex_table[1] = { 0 };
+extern const char ex_table_end[1] __attribute__((alias("ex_table")));
+
+/* Empty static keys table */
+const char static_keys[1] = { 0 };
+extern const char static_keys_end[1] __attribute__((alias("static_keys")));
+
+/* Empty init sections */
+char init_begin[1] = { 0 };
+extern char init_end[1] __attribute__((alias("init_begin")));
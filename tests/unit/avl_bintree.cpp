@@ -321,6 +321,24 @@ static long cmpfun_objval(const void *obj, const void *valptr)
    return s->val - ival;
 }
 
+/* Returns the number of nodes in the subtree, checking the cached sizes */
+static u32 check_sizes(int_struct *obj)
+{
+   if (!obj)
+      return 0;
+
+   u32 size = check_sizes((int_struct *)obj->node.left_obj) +
+              check_sizes((int_struct *)obj->node.right_obj) + 1;
+
+   if (obj->node.size != size) {
+      printf("[ERROR] node %i has size %u, expected: %u\n",
+             obj->val, (u32)obj->node.size, size);
+      NOT_REACHED();
+   }
+
+   return size;
+}
+
 #define MAX_ELEMS (1000*1000)
 
 struct test_data {
@@ -419,6 +437,176 @@ TEST(avl_bintree, first_last_obj)
    ASSERT_TRUE(l == &arr[elems - 1]);
 }
 
+TEST(avl_bintree, find_ge)
+{
+   constexpr const int elems = 32;
+   int_struct arr[elems];
+   int_struct *root = NULL;
+   int_struct *res;
+
+   /* Only even values: 2, 4, ... 64 */
+   for (int i = 0; i < elems; i++)
+      arr[i] = int_struct(2 * (i + 1));
+
+   for (int i = 0; i < elems; i++)
+      bintree_insert(&root, &arr[i], my_cmpfun, int_struct, node);
+
+   for (int v = 0; v <= 2 * elems + 1; v++) {
+
+      res = (int_struct *)
+         bintree_find_ge(root, &v, cmpfun_objval, int_struct, node);
+
+      if (v > 2 * elems) {
+         ASSERT_TRUE(res == NULL);
+         continue;
+      }
+
+      ASSERT_TRUE(res != NULL);
+      ASSERT_EQ(res->val, v <= 2 ? 2 : (v + 1) / 2 * 2);
+   }
+}
+
+TEST(avl_bintree, find_gt)
+{
+   constexpr const int elems = 32;
+   int_struct arr[elems];
+   int_struct *root = NULL;
+   int_struct *res;
+
+   /* Only even values: 2, 4, ... 64 */
+   for (int i = 0; i < elems; i++)
+      arr[i] = int_struct(2 * (i + 1));
+
+   for (int i = 0; i < elems; i++)
+      bintree_insert(&root, &arr[i], my_cmpfun, int_struct, node);
+
+   for (int v = 0; v <= 2 * elems + 1; v++) {
+
+      res = (int_struct *)
+         bintree_find_gt(root, &v, cmpfun_objval, int_struct, node);
+
+      if (v >= 2 * elems) {
+         ASSERT_TRUE(res == NULL);
+         continue;
+      }
+
+      ASSERT_TRUE(res != NULL);
+      ASSERT_EQ(res->val, v / 2 * 2 + 2);
+   }
+}
+
+TEST(avl_bintree, order_statistics)
+{
+   constexpr const int elems = 100;
+   int_struct arr[elems];
+   int_struct *root = NULL;
+   int_struct *res;
+
+   /* Insert 10, 20, ... 1000 in a scrambled order */
+   for (int i = 0; i < elems; i++)
+      arr[i] = int_struct(10 * ((i * 37) % elems + 1));
+
+   for (int i = 0; i < elems; i++)
+      bintree_insert(&root, &arr[i], my_cmpfun, int_struct, node);
+
+   ASSERT_EQ(bintree_get_count(root, int_struct, node), (ulong)elems);
+
+   for (int n = 0; n < elems; n++) {
+      res = (int_struct *)bintree_get_nth_obj(root, n, int_struct, node);
+      ASSERT_TRUE(res != NULL);
+      ASSERT_EQ(res->val, 10 * (n + 1));
+   }
+
+   ASSERT_TRUE(bintree_get_nth_obj(root, elems, int_struct, node) == NULL);
+
+   for (int v = 0; v <= 10 * elems + 10; v += 5) {
+
+      /* The number of values < v */
+      const int expected = CLAMP((v + 9) / 10 - 1, 0, elems);
+      ulong rank = bintree_get_rank(root, &v, cmpfun_objval, int_struct, node);
+      ASSERT_EQ(rank, (ulong)expected);
+   }
+
+   /* Remove the odd positions: the sizes must follow */
+   for (int i = 1; i < elems; i += 2) {
+      int v = 10 * (i + 1);
+      bintree_remove(&root, &v, cmpfun_objval, int_struct, node);
+   }
+
+   ASSERT_EQ(check_sizes(root), (u32)elems / 2);
+
+   for (int n = 0; n < elems / 2; n++) {
+      res = (int_struct *)bintree_get_nth_obj(root, n, int_struct, node);
+      ASSERT_EQ(res->val, 10 * (2 * n + 1));
+   }
+}
+
+TEST(avl_bintree, iter)
+{
+   constexpr const int elems = 64;
+   int_struct arr[elems];
+   int_struct *root = NULL;
+   struct bintree_iter it;
+   int_struct *obj;
+   int expected;
+
+   for (int i = 0; i < elems; i++)
+      arr[i] = int_struct(2 * (elems - i));
+
+   for (int i = 0; i < elems; i++)
+      bintree_insert(&root, &arr[i], my_cmpfun, int_struct, node);
+
+   bintree_iter_start(&it, root, int_struct, node);
+   expected = 2;
+
+   while ((obj = (int_struct *)bintree_iter_next(&it))) {
+      ASSERT_EQ(obj->val, expected);
+      expected += 2;
+   }
+
+   ASSERT_EQ(expected, 2 * elems + 2);
+
+   for (int v = 0; v <= 2 * elems + 1; v++) {
+
+      bintree_iter_start_ge(&it, root, &v, cmpfun_objval, int_struct, node);
+      expected = MAX(2, (v + 1) / 2 * 2);
+
+      while ((obj = (int_struct *)bintree_iter_next(&it))) {
+         ASSERT_EQ(obj->val, expected);
+         expected += 2;
+      }
+
+      ASSERT_EQ(expected, 2 * elems + 2);
+   }
+}
+
+TEST(avl_bintree, cached_first_last)
+{
+   constexpr const int elems = 50;
+   int_struct arr[elems];
+   struct bintree_cached t = {};
+
+   for (int i = 0; i < elems; i++)
+      arr[i] = int_struct((i * 17) % elems);
+
+   for (int i = 0; i < elems; i++) {
+      ASSERT_TRUE(bintree_cached_insert(&t, &arr[i], my_cmpfun,
+                                        int_struct, node));
+      ASSERT_TRUE(t.first == bintree_get_first_obj(t.root, int_struct, node));
+      ASSERT_TRUE(t.last == bintree_get_last_obj(t.root, int_struct, node));
+   }
+
+   for (int i = 0; i < elems; i++) {
+      int v = (i * 7) % elems;
+      ASSERT_TRUE(bintree_cached_remove(&t, &v, cmpfun_objval,
+                                        int_struct, node) != NULL);
+      ASSERT_TRUE(t.first == bintree_get_first_obj(t.root, int_struct, node));
+      ASSERT_TRUE(t.last == bintree_get_last_obj(t.root, int_struct, node));
+   }
+
+   ASSERT_TRUE(t.root == NULL);
+}
+
 static void test_insert_rand_data(int iters, int elems, bool slow_checks)
 {
    random_device rdev;
@@ -457,6 +645,7 @@ static void test_insert_rand_data(int iters, int elems, bool slow_checks)
 
       ASSERT_NO_FATAL_FAILURE({ check_height_vs_elems(root, elems); });
       check_height(root, NULL);
+      ASSERT_EQ(check_sizes(root), (u32)elems);
       in_order_visit(root, data->ordered_nums, elems);
 
       if (!is_sorted(data->ordered_nums, elems)) {
@@ -546,6 +735,7 @@ void remove_rand_data(const int elems, const int iters)
 
          ASSERT_NO_FATAL_FAILURE({ check_height_vs_elems(root, elems); });
          check_height(root, NULL);
+         ASSERT_EQ(check_sizes(root), (u32)new_elems);
          in_order_visit(root, data->ordered_nums, new_elems);
 
          if (!is_sorted(data->ordered_nums, new_elems)) {
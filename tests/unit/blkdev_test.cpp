@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/blkdev.h>
+
+   void blk_init_device(struct blk_device *dev);
+}
+
+using namespace std;
+using namespace testing;
+
+/* Copies of the submitted requests: the originals get freed on completion */
+static vector<struct blk_request> submitted;
+
+static int fake_submit(struct blk_device *dev, struct blk_request *req)
+{
+   submitted.push_back(*req);
+   return 0;
+}
+
+static const struct blk_ops fake_ops = {
+   .submit = fake_submit,
+};
+
+class blkdev_test : public Test {
+
+   void SetUp() override {
+
+      init_kmalloc_for_tests();
+      submitted.clear();
+
+      dev = (struct blk_device) { };
+      dev.name = "fake";
+      dev.sectors = 1024;
+      dev.ops = &fake_ops;
+      blk_init_device(&dev);
+   }
+
+public:
+
+   void submit(struct blk_bio *bio, u64 sector, u32 sectors, bool wr = false) {
+      *bio = (struct blk_bio) { };
+      bio->sector = sector;
+      bio->sectors = sectors;
+      bio->write = wr;
+      bio->buf = buf;
+      blk_submit_bio(&dev, bio);
+   }
+
+   /* Completes the request in flight, like a driver would do */
+   void complete() {
+      blk_end_request(&dev, dev.active, 0);
+   }
+
+   struct blk_device dev;
+   char buf[64 * BLK_SECTOR_SIZE];
+};
+
+TEST_F(blkdev_test, idle_device_dispatches_immediately)
+{
+   struct blk_bio bio;
+
+   submit(&bio, 10, 2);
+   ASSERT_EQ(submitted.size(), 1u);
+   EXPECT_EQ(submitted[0].sector, 10u);
+   EXPECT_EQ(submitted[0].sectors, 2u);
+   EXPECT_FALSE(bio.done);
+
+   complete();
+   EXPECT_TRUE(bio.done);
+   EXPECT_EQ(bio.rc, 0);
+   EXPECT_TRUE(dev.active == NULL);
+}
+
+TEST_F(blkdev_test, plugged_bios_get_merged)
+{
+   struct blk_bio b[4];
+
+   blk_plug(&dev);
+   submit(&b[0], 8, 8);
+   submit(&b[1], 16, 8);          /* back merge */
+   submit(&b[2], 0, 8);           /* front merge */
+   submit(&b[3], 16, 8, true);    /* a write: not mergeable with reads */
+   EXPECT_TRUE(submitted.empty());
+   blk_unplug(&dev);
+
+   ASSERT_EQ(submitted.size(), 1u);
+   EXPECT_EQ(submitted[0].sector, 0u);
+   EXPECT_EQ(submitted[0].sectors, 24u);
+   EXPECT_EQ(submitted[0].bios_count, 3u);
+   EXPECT_EQ(dev.stats.merges, 2u);
+
+   complete();
+
+   for (int i = 0; i < 3; i++)
+      EXPECT_TRUE(b[i].done);
+
+   EXPECT_FALSE(b[3].done);
+   ASSERT_EQ(submitted.size(), 2u);
+   EXPECT_TRUE(submitted[1].write);
+
+   complete();
+   EXPECT_TRUE(b[3].done);
+   EXPECT_EQ(dev.stats.requests, 2u);
+}
+
+TEST_F(blkdev_test, elevator_order)
+{
+   struct blk_bio b[5];
+
+   submit(&b[0], 500, 1);         /* in flight: the head will be at 501 */
+   submit(&b[1], 100, 1);
+   submit(&b[2], 900, 1);
+   submit(&b[3], 600, 1);
+   submit(&b[4], 50, 1);
+
+   while (dev.active)
+      complete();
+
+   ASSERT_EQ(submitted.size(), 5u);
+   EXPECT_EQ(submitted[1].sector, 600u);
+   EXPECT_EQ(submitted[2].sector, 900u);
+   EXPECT_EQ(submitted[3].sector, 50u);   /* wrap around */
+   EXPECT_EQ(submitted[4].sector, 100u);
+}
@@ -193,6 +193,8 @@ static const struct video_interface test_console_vi =
    NULL, /* redraw_static_elements */
    NULL, /* disable_static_elems_refresh */
    NULL, /* enable_static_elems_refresh */
+   NULL, /* begin_batch */
+   NULL, /* flush_batch */
 };
 
 class console_test : public Test {
@@ -271,3 +273,48 @@ TEST_F(console_test, cursor_move)
       +--------------------+
    )");
 }
+
+static string get_screen_row(int row)
+{
+   string s;
+
+   for (int j = 0; j < TEST_TERM_COLS; j++)
+      s += (char)vgaentry_get_char(test_video_framebuffer[row][j]);
+
+   return s;
+}
+
+TEST_F(console_test, scrollback)
+{
+   char buf[64];
+
+   /* Lines 0-3 go in the (compressed) scrollback, the last row is empty */
+   for (int i = 0; i < 8; i++) {
+      sprintf(buf, "line %d: %s\n", i, i % 2 ? "xxxxxxxx" : "abcabc");
+      console_write(buf);
+   }
+
+   t->tintf->scroll_up(t->tstate, 3);
+
+   for (int i = 0; i < TEST_TERM_ROWS; i++) {
+      const int n = i + 1;
+      sprintf(buf, "line %d: %-12s", n, n % 2 ? "xxxxxxxx" : "abcabc");
+      EXPECT_EQ(get_screen_row(i), buf) << "row: " << i;
+   }
+
+   /* Scrolling up beyond the oldest row in the scrollback is not possible */
+   t->tintf->scroll_up(t->tstate, 100);
+   EXPECT_EQ(get_screen_row(0), "line 0: abcabc      ");
+
+   t->tintf->scroll_down(t->tstate, 100);
+   console_test_dump_screen(true);
+   check_screen_vs_expected(R"(
+      +--------------------+
+      |line 4: abcabc      |
+      |line 5: xxxxxxxx    |
+      |line 6: abcabc      |
+      |line 7: xxxxxxxx    |
+      |$                   |
+      +--------------------+
+   )");
+}
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <memory>
 #include <map>
+#include <string>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "kernel_init_funcs.h"
@@ -149,3 +151,76 @@ TEST(fat32, read_whole_file)
    uint32_t actual_file_crc = crc32(0, buf, fsize);
    ASSERT_EQ(fat_crc, actual_file_crc);
 }
+
+struct walk_names_ctx {
+
+   vector<string> names;
+   size_t step;      /* max entries per walk (0 = no limit) */
+   size_t left;
+};
+
+static int
+walk_names_cb(struct fat_hdr *hdr,
+              enum fat_type ft,
+              struct fat_entry *entry,
+              const char *long_name,
+              void *arg)
+{
+   walk_names_ctx *ctx = (walk_names_ctx *)arg;
+   char short_name[16];
+
+   if (ctx->step && !ctx->left)
+      return 1; /* stop: this entry must be visited again by the next walk */
+
+   if (!long_name) {
+      fat_get_short_name(entry, short_name);
+      long_name = short_name;
+   }
+
+   ctx->names.push_back(long_name);
+   ctx->left--;
+   return 0;
+}
+
+TEST(fat32, walk_resume)
+{
+   struct fat_hdr *hdr = (struct fat_hdr *)
+      load_once_file(PROJ_BUILD_DIR "/test_fatpart");
+
+   const enum fat_type ft = fat_get_type(hdr);
+   struct fat_entry *dir = fat_search_entry(hdr, ft, "/testdir", NULL);
+   struct fat_walk_long_name_ctx lname_ctx;
+   struct fat_walk_static_params p;
+   struct fat_walk_pos pos;
+   walk_names_ctx all = {}, steps;
+   u32 clu;
+
+   ASSERT_TRUE(dir != NULL);
+   clu = fat_get_first_cluster(dir);
+
+   p.ctx = &lname_ctx;
+   p.h = hdr;
+   p.ft = ft;
+   p.cb = &walk_names_cb;
+   p.arg = &all;
+
+   fat_walk(&p, clu);
+   ASSERT_GT(all.names.size(), 2u);
+
+   for (size_t step = 1; step <= 3; step++) {
+
+      steps = {};
+      steps.step = step;
+      p.arg = &steps;
+
+      pos = {};
+      pos.cluster = clu;
+
+      while (!pos.eof) {
+         steps.left = step;
+         fat_walk_resume(&p, &pos);
+      }
+
+      ASSERT_EQ(steps.names, all.names);
+   }
+}
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <gtest/gtest.h>
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/errno.h>
+   #include <tilck/kernel/fs/fd_table.h>
+}
+
+using namespace testing;
+
+class fd_table_test : public Test {
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      fd_table_init(&t);
+   }
+
+   void TearDown() override {
+      fd_table_destroy(&t);
+   }
+
+public:
+
+   int open_next(int ge = 0) {
+
+      int fd = fd_table_get_free_fd(&t, ge);
+
+      if (fd >= 0)
+         fd_table_set(&t, fd, &dummy[fd]);
+
+      return fd;
+   }
+
+   struct fd_table t;
+   char dummy[NOFILE_MAX_LIMIT];
+};
+
+TEST_F(fd_table_test, lowest_free_fd)
+{
+   ASSERT_EQ(open_next(), 0);
+   ASSERT_EQ(open_next(), 1);
+   ASSERT_EQ(open_next(), 2);
+
+   fd_table_set(&t, 1, NULL);
+   ASSERT_EQ(fd_table_get(&t, 1), nullptr);
+   ASSERT_EQ(open_next(), 1);
+   ASSERT_EQ(open_next(5), 5);
+   ASSERT_EQ(open_next(), 3);
+   ASSERT_EQ(fd_table_get(&t, 5), &dummy[5]);
+}
+
+TEST_F(fd_table_test, grow_and_iterate)
+{
+   const int n = MAX_HANDLES * 5 + 3;
+   int fd, cnt = 0;
+
+   for (int i = 0; i < n; i++)
+      ASSERT_EQ(open_next(), i);
+
+   ASSERT_GE(t.size, (u32)n);
+   ASSERT_EQ(fd_table_get(&t, n - 1), &dummy[n - 1]);
+   ASSERT_EQ(fd_table_get(&t, (int)t.size), nullptr);
+
+   for (int i = 0; i < n; i += 2)
+      fd_table_set(&t, i, NULL);
+
+   fd_table_for_each(&t, fd) {
+      ASSERT_EQ(fd % 2, 1);
+      ASSERT_EQ(fd_table_get(&t, fd), &dummy[fd]);
+      cnt++;
+   }
+
+   ASSERT_EQ(cnt, n / 2);
+   ASSERT_EQ(open_next(MAX_HANDLES), MAX_HANDLES + (MAX_HANDLES % 2));
+}
+
+TEST_F(fd_table_test, copy)
+{
+   struct fd_table t2;
+   const int n = MAX_HANDLES * 2;
+
+   for (int i = 0; i < n; i++)
+      ASSERT_EQ(open_next(), i);
+
+   ASSERT_EQ(fd_table_copy(&t2, &t), 0);
+   ASSERT_NE(t2.handles, t.handles);
+   fd_table_set(&t, 0, NULL);
+
+   ASSERT_EQ(fd_table_get(&t2, 0), &dummy[0]);
+   ASSERT_EQ(fd_table_get(&t2, n - 1), &dummy[n - 1]);
+   ASSERT_EQ(fd_table_next_open(&t2, n), -1);
+   fd_table_destroy(&t2);
+}
+
+TEST_F(fd_table_test, nofile_limit)
+{
+   t.nofile_cur = MAX_HANDLES + 2;
+
+   for (u32 i = 0; i < t.nofile_cur; i++)
+      ASSERT_EQ(open_next(), (int)i);
+
+   ASSERT_EQ(open_next(), -EMFILE);
+   ASSERT_EQ(fd_table_get_free_fd(&t, (int)t.nofile_cur), -EMFILE);
+
+   fd_table_set(&t, 0, NULL);
+   ASSERT_EQ(open_next(), 0);
+}
@@ -22,10 +22,14 @@ TEST(fork_dup_all_handles, trigger_inside_path)
 {
    vfs_mock mock;
    process pi = {};
+   fd_table fds;
    fs_handle_base handles[3] = {}, dup_handles[2] = {};
-   pi.handles[0] = &handles[0];
-   pi.handles[1] = &handles[1];
-   pi.handles[2] = &handles[2];
+
+   fd_table_init(&fds);
+   pi.fds = &fds;
+
+   for (int i = 0; i < 3; i++)
+      fd_table_set(pi.fds, i, &handles[i]);
 
    EXPECT_CALL(mock, vfs_dup(&handles[0], _))
       .WillOnce(
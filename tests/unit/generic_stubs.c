@@ -29,6 +29,13 @@ void gdt_install() { }
 void idt_install() { }
 void irq_install() { }
 void hw_timer_setup() { }
+void hw_timer_stop_tick() { }
+void hw_timer_restart_tick() { }
+void hw_idle_enter() { }
+bool hw_idle_supported() { return false; }
+bool hw_tsc_is_stable() { return false; }
+u64 hw_tsc_get_hz() { return 0; }
+int hw_clock_wait_edge() { return -1; }
 void irq_install_handler() { }
 void irq_uninstall_handler() { }
 void setup_sysenter_interface() { }
@@ -36,21 +43,31 @@ void switch_to_task() { }
 void pdir_clone() { }
 void pdir_deep_clone() { }
 void pdir_destroy() { }
+void pdir_destroy_preemptible() { }
 void set_curr_pdir() { }
 void arch_specific_new_proc_setup() { NOT_REACHED(); }
 void arch_specific_free_proc() { NOT_REACHED(); }
 void fpu_context_begin() { }
 void fpu_context_end() { }
+void fpu_memset256_sse2() { NOT_REACHED(); }
+void fpu_memset256_avx2() { NOT_REACHED(); }
 void map_zero_pages() { NOT_REACHED(); }
+void pdir_count_user_pages() { NOT_REACHED(); }
+void pdir_count_page_tables() { NOT_REACHED(); }
+void pdir_reclaim_cold_pages() { NOT_REACHED(); }
+void pdir_merge_same_pages() { NOT_REACHED(); }
+size_t pdir_mark_lazyfree_pages() { NOT_REACHED(); return 0; }
+size_t pdir_drop_lazyfree_pages() { NOT_REACHED(); return 0; }
 void dump_var_mtrrs() { }
 void set_page_rw() { }
+void set_pages_rw() { }
+void swap_pages() { NOT_REACHED(); }
 void poweroff() { NOT_REACHED(); }
 int get_irq_num(void *ctx) { return -1; }
 int get_int_num(void *ctx) { return -1; }
-void retain_pageframes_mapped_at() { }
-void release_pageframes_mapped_at() { }
 bool irq_is_masked() { NOT_REACHED(); return false; }
 void dump_stacktrace() { NOT_REACHED(); }
+size_t stackwalk_kernel_stack() { NOT_REACHED(); return 0; }
 bool allocate_fpu_regs() { NOT_REACHED(); return false; }
 void kthread_create_init_regs_arch() { NOT_REACHED(); }
 void kthread_create_setup_initial_stack() { NOT_REACHED(); }
@@ -59,6 +76,16 @@ void *hi_vmem_reserve(size_t size) { return NULL; }
 void hi_vmem_release(void *ptr, size_t size) { }
 void on_first_pdir_update(void) { }
 
+void fast_memcpy(void *dest, const void *src, size_t n)
+{
+   memcpy(dest, src, n);
+}
+
+void fpu_memset256(void *dest, u32 val32, u32 n)
+{
+   memset(dest, (int)val32, n << 5);
+}
+
 void *get_syscall_func_ptr(u32 n) { return NULL; }
 int get_syscall_num(void *func) { return -1; }
 
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include <set>
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/kernel/hashtable.h>
+}
+
+using namespace std;
+
+struct int_obj {
+   int val;
+   struct htable_node node;
+};
+
+static bool int_obj_match(struct htable_node *n, const void *key)
+{
+   return CONTAINER_OF(n, struct int_obj, node)->val == *(const int *)key;
+}
+
+static struct int_obj *find_int(struct htable *ht, int val)
+{
+   return htable_find_obj(ht,
+                          hash_u32((u32)val),
+                          int_obj_match,
+                          &val,
+                          struct int_obj,
+                          node);
+}
+
+static void add_int(struct htable *ht, struct int_obj *o)
+{
+   htable_node_init(&o->node);
+   htable_add(ht, &o->node, hash_u32((u32)o->val));
+}
+
+class htable_test : public ::testing::Test {
+
+protected:
+
+   struct htable ht;
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      htable_init(&ht);
+   }
+
+   void TearDown() override {
+      htable_destroy(&ht);
+   }
+};
+
+TEST_F(htable_test, empty)
+{
+   ASSERT_EQ(htable_get_count(&ht), 0u);
+   ASSERT_TRUE(find_int(&ht, 0) == NULL);
+   ASSERT_TRUE(find_int(&ht, 123) == NULL);
+}
+
+TEST_F(htable_test, add_find_del)
+{
+   const int n = 5000;
+   vector<int_obj> objs(n);
+
+   for (int i = 0; i < n; i++) {
+
+      objs[i].val = i * 7;
+      add_int(&ht, &objs[i]);
+
+      /* Everything inserted so far must be found, during the rehashes too */
+      if (i % 97 == 0) {
+         for (int j = 0; j <= i; j++)
+            ASSERT_EQ(find_int(&ht, j * 7), &objs[j]);
+      }
+   }
+
+   ASSERT_EQ(htable_get_count(&ht), (u32)n);
+   ASSERT_GT(ht.bits, 0u);
+
+   for (int i = 0; i < n; i++) {
+      ASSERT_EQ(find_int(&ht, i * 7), &objs[i]);
+      ASSERT_TRUE(find_int(&ht, i * 7 + 1) == NULL);
+   }
+
+   for (int i = 0; i < n; i += 2) {
+      htable_del(&ht, &objs[i].node);
+      ASSERT_FALSE(htable_node_is_in_table(&objs[i].node));
+   }
+
+   ASSERT_EQ(htable_get_count(&ht), (u32)n / 2);
+
+   for (int i = 0; i < n; i++) {
+      if (i % 2)
+         ASSERT_EQ(find_int(&ht, i * 7), &objs[i]);
+      else
+         ASSERT_TRUE(find_int(&ht, i * 7) == NULL);
+   }
+
+   for (int i = 1; i < n; i += 2)
+      htable_del(&ht, &objs[i].node);
+
+   ASSERT_EQ(htable_get_count(&ht), 0u);
+}
+
+TEST_F(htable_test, rehash_is_incremental)
+{
+   vector<int_obj> objs(256);
+   u32 max_moved = 0;
+
+   for (size_t i = 0; i < objs.size(); i++) {
+
+      const u32 old_bits = ht.bits;
+      const u32 old_pos = ht.old_buckets ? ht.rehash_pos : 0;
+
+      objs[i].val = (int)i;
+      add_int(&ht, &objs[i]);
+
+      if (ht.bits == old_bits && ht.old_buckets)
+         max_moved = max(max_moved, ht.rehash_pos - old_pos);
+   }
+
+   ASSERT_LE(max_moved, (u32)HTABLE_REHASH_STEP);
+
+   for (auto &o : objs)
+      ASSERT_EQ(find_int(&ht, o.val), &o);
+
+   for (auto &o : objs)
+      htable_del(&ht, &o.node);
+}
+
+TEST_F(htable_test, random_ops)
+{
+   const int n = 2000;
+   vector<int_obj> objs(n);
+   vector<bool> in_table(n, false);
+   set<int> vals;
+   mt19937 e(1234);
+
+   while (vals.size() < (size_t)n)
+      vals.insert((int)e());
+
+   int k = 0;
+   for (int v : vals)
+      objs[k++].val = v;
+
+   for (int iter = 0; iter < 50000; iter++) {
+
+      const int i = (int)(e() % n);
+
+      if (in_table[i])
+         htable_del(&ht, &objs[i].node);
+      else
+         add_int(&ht, &objs[i]);
+
+      in_table[i] = !in_table[i];
+      ASSERT_EQ(find_int(&ht, objs[i].val) != NULL, (bool)in_table[i]);
+   }
+
+   u32 count = 0;
+
+   for (int i = 0; i < n; i++) {
+
+      if (in_table[i]) {
+         ASSERT_EQ(find_int(&ht, objs[i].val), &objs[i]);
+         htable_del(&ht, &objs[i].node);
+         count++;
+      }
+   }
+
+   ASSERT_GT(count, 0u);
+   ASSERT_EQ(htable_get_count(&ht), 0u);
+}
+
+TEST(hash_funcs, str)
+{
+   /* Reference values of 32-bit FNV-1a */
+   ASSERT_EQ(hash_str("", 0), 0x811c9dc5u);
+   ASSERT_EQ(hash_str("a", 1), 0xe40c292cu);
+   ASSERT_EQ(hash_str("foobar", 6), 0xbf9cf968u);
+
+   /* The length matters, not the NUL terminator */
+   ASSERT_EQ(hash_str("foobar", 3), hash_str("foo", 3));
+}
+
+TEST(hash_funcs, int_distribution)
+{
+   const u32 bits = 8;
+   const u32 n = 64 * 1024;
+   vector<u32> buckets(1u << bits, 0);
+
+   /* Sequential and strided keys must spread evenly over the low bits */
+   for (u32 stride : { 1u, 16u, 4096u }) {
+
+      fill(buckets.begin(), buckets.end(), 0);
+
+      for (u32 i = 0; i < n; i++)
+         buckets[hash_u32(i * stride) & ((1u << bits) - 1)]++;
+
+      const u32 avg = n >> bits;
+
+      for (u32 c : buckets) {
+         ASSERT_GT(c, avg / 2);
+         ASSERT_LT(c, avg * 2);
+      }
+   }
+
+   ASSERT_NE(hash_u64(1ull << 32), hash_u64(1));
+}
@@ -21,6 +21,7 @@ extern "C" {
    #include <tilck/common/utils.h>
 
    #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/kmalloc_debug.h>
    #include <tilck/kernel/paging.h>
    #include <tilck/kernel/self_tests.h>
 
@@ -28,6 +29,8 @@ extern "C" {
    #include <kernel/kmalloc/kmalloc_block_node.h>  // kmalloc private header
 
    extern struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
+   extern u32 long_lived_heaps_mask;
+   extern ulong kopt_kmalloc_sample;
    void selftest_kmalloc_perf_per_size(int size);
    void kmalloc_dump_heap_stats(void);
    void *node_to_ptr(struct kmalloc_heap *h, int node, size_t size);
@@ -781,6 +784,269 @@ TEST_F(kmalloc_test, multi_step_free)
 }
 
 
+TEST_F(kmalloc_test, alloc_at)
+{
+   void *ptr;
+   size_t s;
+
+   struct kmalloc_heap h;
+   kmalloc_create_heap(&h,
+                       MB,                           /* vaddr */
+                       KMALLOC_MIN_HEAP_SIZE,        /* heap size */
+                       KMALLOC_MIN_HEAP_SIZE / 16,   /* min block size */
+                       KMALLOC_MIN_HEAP_SIZE / 8,    /* alloc block size */
+                       false,                        /* linear mapping */
+                       NULL,                         /* metadata_nodes */
+                       fake_alloc_and_map_func,
+                       fake_free_and_map_func);
+
+   struct block_node *nodes = (struct block_node *)h.metadata_nodes;
+
+   s = 3 * h.min_block_size;
+   ptr = per_heap_kmalloc(&h, &s, KMALLOC_FL_MULTI_STEP | h.min_block_size);
+
+   EXPECT_EQ(s, 3 * h.min_block_size);
+   EXPECT_EQ(ptr, (void *)h.vaddr);
+
+   /* Grow the chunk in-place, crossing the boundary of its rounded-up size */
+   ASSERT_TRUE(per_heap_kmalloc_at(&h,
+                                   (void *)(h.vaddr + 3 * h.min_block_size),
+                                   3 * h.min_block_size,
+                                   0));
+
+   dump_heap_subtree(&h, 0, 5);
+
+   check_metadata(nodes, {
+      "+---------------------------------------------------------------+",
+      "|                              -S-                              |",
+      "+-------------------------------+-------------------------------+",
+      "|              -S-              |              ---              |",
+      "+---------------+---------------+---------------+---------------+",
+      "|      -SF      |      -S-      |      ---      |      ---      |",
+      "+-------+-------+-------+-------+-------+-------+-------+-------+",
+      "|  ASF  |  ASF  |  ASF  |  ---  |  ---  |  ---  |  ---  |  ---  |",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+",
+      "|--F|--F|--F|--F|--F|--F|---|---|---|---|---|---|---|---|---|---|",
+      "+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+"
+   });
+
+   EXPECT_EQ(h.mem_allocated, 6 * h.min_block_size);
+
+   /* Already allocated ranges must be rejected */
+   EXPECT_FALSE(per_heap_kmalloc_at(&h,
+                                    (void *)(h.vaddr + 5 * h.min_block_size),
+                                    2 * h.min_block_size,
+                                    0));
+
+   /* Free the whole chunk at once */
+   s = 6 * h.min_block_size;
+   per_heap_kfree(&h, ptr, &s, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+
+   EXPECT_EQ(h.mem_allocated, 0u);
+   EXPECT_EQ(nodes[0].raw, 0u);
+
+   kmalloc_destroy_heap(&h);
+}
+
+
+static int cache_ctor_calls;
+
+static void cache_test_ctor(void *obj)
+{
+   memset(obj, 0xAB, 48);
+   cache_ctor_calls++;
+}
+
+TEST_F(kmalloc_test, obj_cache)
+{
+   struct kmalloc_cache c;
+   struct debug_kmalloc_cache_info ci;
+   void *objs[3 * KMALLOC_CACHE_MAG_SIZE];
+   void *p;
+
+   /* KMALLOC_CACHE_INIT() is not C++ friendly */
+   memset(&c, 0, sizeof(c));
+   c.name = "test";
+   c.obj_size = 48;
+   c.ctor = &cache_test_ctor;
+
+   cache_ctor_calls = 0;
+
+   for (int i = 0; i < ARRAY_SIZE(objs); i++) {
+      objs[i] = kmalloc_cache_alloc(&c);
+      ASSERT_TRUE(objs[i] != NULL);
+      EXPECT_EQ(((u8 *)objs[i])[47], 0xAB);
+   }
+
+   /* Sizes are rounded up to a power of 2 and objects come from slabs */
+   EXPECT_EQ(c.obj_size, 64u);
+   EXPECT_EQ(cache_ctor_calls, ARRAY_SIZE(objs));
+   EXPECT_EQ(c.hits, 0u);
+
+   for (int i = 0; i < ARRAY_SIZE(objs); i++)
+      kmalloc_cache_free(&c, objs[i]);
+
+   EXPECT_EQ(c.mag_count, (u32)KMALLOC_CACHE_MAG_SIZE);
+   EXPECT_EQ(c.spills, (u32)(ARRAY_SIZE(objs) - KMALLOC_CACHE_MAG_SIZE));
+
+   /* LIFO: we get back the last freed object, without calling the ctor */
+   p = kmalloc_cache_alloc(&c);
+   EXPECT_EQ(p, objs[KMALLOC_CACHE_MAG_SIZE - 1]);
+   EXPECT_EQ(c.hits, 1u);
+   EXPECT_EQ(cache_ctor_calls, ARRAY_SIZE(objs));
+   kmalloc_cache_free(&c, p);
+
+   ASSERT_TRUE(debug_kmalloc_get_cache_info(0, &ci));
+   EXPECT_STREQ(ci.name, "test");
+   EXPECT_EQ(ci.allocs, (u32)ARRAY_SIZE(objs) + 1);
+
+   kmalloc_cache_shrink(&c);
+   EXPECT_EQ(c.mag_count, 0u);
+}
+
+TEST_F(kmalloc_test, obj_pool)
+{
+   struct kmalloc_cache c;
+   void *objs[3 * KMALLOC_CACHE_MAG_SIZE];
+   const u32 n = ARRAY_SIZE(objs);
+
+   memset(&c, 0, sizeof(c));
+   c.name = "test_pool";
+   c.obj_size = 48;
+   c.pool = true;
+   c.prealloc = 4;
+
+   /* The first `prealloc` objects come from the free list */
+   for (u32 i = 0; i < n; i++) {
+      objs[i] = kmalloc_cache_alloc(&c);
+      ASSERT_TRUE(objs[i] != NULL);
+   }
+
+   EXPECT_EQ(c.hits, 4u);
+   EXPECT_EQ(c.free_count, 0u);
+
+   /* Nothing goes back to the heap */
+   for (u32 i = 0; i < n; i++)
+      kmalloc_cache_free(&c, objs[i]);
+
+   EXPECT_EQ(c.mag_count, (u32)KMALLOC_CACHE_MAG_SIZE);
+   EXPECT_EQ(c.free_count, n - KMALLOC_CACHE_MAG_SIZE);
+   EXPECT_EQ(c.spills, 0u);
+
+   for (u32 i = 0; i < n; i++) {
+      objs[i] = kmalloc_cache_alloc(&c);
+      ASSERT_TRUE(objs[i] != NULL);
+   }
+
+   EXPECT_EQ(c.hits, 4u + n);
+
+   for (u32 i = 0; i < n; i++)
+      kmalloc_cache_free(&c, objs[i]);
+
+   kmalloc_cache_shrink(&c);
+   EXPECT_EQ(c.mag_count, 0u);
+   EXPECT_EQ(c.free_count, 0u);
+}
+
+TEST_F(kmalloc_test, obj_cache_destroy)
+{
+   struct kmalloc_cache c1, c2;
+   struct debug_kmalloc_cache_info ci;
+   void *p;
+
+   memset(&c1, 0, sizeof(c1));
+   memset(&c2, 0, sizeof(c2));
+   c1.name = "test1";
+   c1.obj_size = 32;
+   c2.name = "test2";
+   c2.obj_size = 32;
+
+   p = kmalloc_cache_alloc(&c1);
+   ASSERT_TRUE(p != NULL);
+   kmalloc_cache_free(&c1, p);
+
+   p = kmalloc_cache_alloc(&c2);
+   ASSERT_TRUE(p != NULL);
+   kmalloc_cache_free(&c2, p);
+
+   /* The most recently initialized cache comes first */
+   ASSERT_TRUE(debug_kmalloc_get_cache_info(0, &ci));
+   EXPECT_STREQ(ci.name, "test2");
+
+   kmalloc_cache_destroy(&c2);
+   EXPECT_FALSE(c2.initialized);
+   EXPECT_EQ(c2.mag_count, 0u);
+
+   ASSERT_TRUE(debug_kmalloc_get_cache_info(0, &ci));
+   EXPECT_STREQ(ci.name, "test1");
+
+   kmalloc_cache_destroy(&c1);
+   EXPECT_FALSE(c1.initialized);
+
+   if (debug_kmalloc_get_cache_info(0, &ci)) {
+      EXPECT_STRNE(ci.name, "test1");
+   }
+}
+
+static void *shrinker_test_buf;
+
+static size_t shrinker_test_func(struct shrinker *s, size_t bytes)
+{
+   if (!shrinker_test_buf)
+      return 0;
+
+   kfree2(shrinker_test_buf, 4 * KB);
+   shrinker_test_buf = NULL;
+   return 4 * KB;
+}
+
+TEST_F(kmalloc_test, shrinkers)
+{
+   struct kmalloc_cache c;
+   struct shrinker s;
+   void *objs[KMALLOC_CACHE_MAG_SIZE];
+   u32 left;
+
+   memset(&c, 0, sizeof(c));
+   c.name = "test";
+   c.obj_size = 64;
+
+   memset(&s, 0, sizeof(s));
+   s.name = "test";
+   s.shrink = &shrinker_test_func;
+
+   for (int i = 0; i < ARRAY_SIZE(objs); i++) {
+      objs[i] = kmalloc_cache_alloc(&c);
+      ASSERT_TRUE(objs[i] != NULL);
+   }
+
+   for (int i = 0; i < ARRAY_SIZE(objs); i++)
+      kmalloc_cache_free(&c, objs[i]);
+
+   shrinker_test_buf = kmalloc(4 * KB);
+   ASSERT_TRUE(shrinker_test_buf != NULL);
+   register_shrinker(&s);
+
+   /* The built-in shrinker empties the magazines of the caches first */
+   EXPECT_EQ(kmalloc_shrink(128), 128u);
+   EXPECT_EQ(c.mag_count, (u32)KMALLOC_CACHE_MAG_SIZE - 2);
+   EXPECT_EQ(s.calls, 0u);
+
+   left = c.mag_count;
+   EXPECT_EQ(kmalloc_shrink(64 * KB), 64u * left + 4 * KB);
+   EXPECT_EQ(c.mag_count, 0u);
+   EXPECT_EQ(s.calls, 1u);
+   EXPECT_EQ(s.freed, 4 * KB);
+   EXPECT_TRUE(shrinker_test_buf == NULL);
+
+   unregister_shrinker(&s);
+   EXPECT_EQ(kmalloc_shrink(64 * KB), 0u);
+   EXPECT_EQ(s.calls, 1u);
+
+   kmalloc_cache_shrink(&c);
+}
+
+
 TEST_F(kmalloc_test, partial_free)
 {
    void *ptr;
@@ -891,3 +1157,240 @@ TEST_F(kmalloc_test, partial_free)
 
    kmalloc_destroy_heap(&h);
 }
+
+TEST_F(kmalloc_test, max_free)
+{
+   void *p1, *p2;
+   size_t s;
+
+   struct kmalloc_heap h;
+   kmalloc_create_heap(&h,
+                       MB,                           /* vaddr */
+                       KMALLOC_MIN_HEAP_SIZE,        /* heap size */
+                       KMALLOC_MIN_HEAP_SIZE / 16,   /* min block size */
+                       0,    /* alloc block size: 0 because linear_mapping=1 */
+                       true, /* linear mapping */
+                       NULL, NULL, NULL);
+
+   EXPECT_EQ(h.max_free, h.size);
+
+   s = h.size / 2;
+   p1 = per_heap_kmalloc(&h, &s, 0);
+   ASSERT_TRUE(p1 != NULL);
+
+   s = h.size / 2;
+   p2 = per_heap_kmalloc(&h, &s, 0);
+   ASSERT_TRUE(p2 != NULL);
+
+   /* The heap is full: a failed allocation lowers max_free */
+   EXPECT_EQ(h.max_free, h.size);
+   s = h.size / 2;
+   ASSERT_TRUE(per_heap_kmalloc(&h, &s, 0) == NULL);
+   EXPECT_EQ(h.max_free, h.size / 4);
+
+   s = h.min_block_size;
+   ASSERT_TRUE(per_heap_kmalloc(&h, &s, 0) == NULL);
+   EXPECT_EQ(h.max_free, h.min_block_size / 2);
+
+   /* Now the allocations fail without even looking at the metadata */
+   s = h.size / 4;
+   ASSERT_TRUE(per_heap_kmalloc(&h, &s, 0) == NULL);
+   EXPECT_EQ(h.max_free, h.min_block_size / 2);
+
+   /* Each kfree raises it to the size of the biggest block it freed */
+   s = h.size / 2;
+   per_heap_kfree(&h, p1, &s, 0);
+   EXPECT_EQ(h.max_free, h.size / 2);
+
+   s = h.size / 2;
+   per_heap_kfree(&h, p2, &s, 0);
+   EXPECT_EQ(h.max_free, h.size);
+
+   kmalloc_destroy_heap(&h);
+}
+
+TEST_F(kmalloc_test, leak_sampler)
+{
+   struct debug_kmalloc_sample_info si;
+   void *ptrs[4];
+   u32 used, dropped;
+   int found = 0;
+
+   kopt_kmalloc_sample = 2;
+   init_kmalloc_for_tests();
+
+   /*
+    * Blocks bigger than SMALL_HEAP_MAX_ALLOC: creating a small heap would
+    * involve an internal (sampled) allocation, altering the count below.
+    */
+   for (int i = 0; i < 4; i++)
+      ASSERT_TRUE((ptrs[i] = kmalloc(PAGE_SIZE * (i + 1))) != NULL);
+
+   /* Only the 2nd and the 4th allocations have been sampled */
+   debug_kmalloc_get_samples_stats(&used, &dropped);
+   EXPECT_EQ(used, 2u);
+   EXPECT_EQ(dropped, 0u);
+
+   for (int i = 0; debug_kmalloc_get_sample(i, &si); i++) {
+
+      if (!si.ptr)
+         continue;
+
+      if (si.ptr == (ulong)ptrs[1]) {
+         EXPECT_EQ(si.size, 2 * PAGE_SIZE);
+         found++;
+      } else if (si.ptr == (ulong)ptrs[3]) {
+         EXPECT_EQ(si.size, 4 * PAGE_SIZE);
+         found++;
+      }
+
+      EXPECT_NE(si.caller, 0ul);
+   }
+
+   EXPECT_EQ(found, 2);
+
+   for (int i = 0; i < 4; i++)
+      kfree2(ptrs[i], PAGE_SIZE * (i + 1));
+
+   debug_kmalloc_get_samples_stats(&used, &dropped);
+   EXPECT_EQ(used, 0u);
+
+   kopt_kmalloc_sample = 0;
+   init_kmalloc_for_tests();
+   EXPECT_FALSE(debug_kmalloc_get_sample(0, &si));
+}
+
+static bool is_in_long_lived_heap(void *ptr)
+{
+   for (int i = 0; i < KMALLOC_HEAPS_COUNT && heaps[i]; i++) {
+
+      const ulong va = heaps[i]->vaddr;
+
+      if (IN_RANGE((ulong)ptr, va, va + heaps[i]->size))
+         return !!(long_lived_heaps_mask & (1u << i));
+   }
+
+   return false;
+}
+
+/*
+ * A long run of short-lived allocations of random sizes mixed with long-lived
+ * ones: at the end, once the short-lived blocks are freed, the long-lived ones
+ * must not prevent the free memory in the other heaps from coalescing again.
+ */
+TEST_F(kmalloc_test, fragmentation_stress)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   uniform_int_distribution<int> pages_dist(1, 16);
+   uniform_int_distribution<int> op_dist(0, 99);
+   vector<pair<void *, size_t>> short_lived;
+   vector<void *> long_lived;
+   vector<size_t> largest_free_before;
+   size_t ll_budget = 0;
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int i = 0; i < KMALLOC_HEAPS_COUNT && heaps[i]; i++) {
+
+      largest_free_before.push_back(debug_kmalloc_get_heap_largest_free(i));
+
+      if (long_lived_heaps_mask & (1u << i))
+         ll_budget += (heaps[i]->size - heaps[i]->mem_allocated) / 2;
+   }
+
+   /* The biggest heap is never a long-lived one */
+   ASSERT_FALSE(long_lived_heaps_mask & 1u);
+   ASSERT_GT(ll_budget, (size_t)PAGE_SIZE);
+
+   for (int i = 0; i < 20000; i++) {
+
+      const int op = op_dist(e);
+
+      if (op < 5) {
+
+         if ((long_lived.size() + 1) * PAGE_SIZE > ll_budget)
+            continue;
+
+         void *ptr = kmalloc_long_lived(PAGE_SIZE);
+         ASSERT_TRUE(ptr != NULL);
+         ASSERT_TRUE(is_in_long_lived_heap(ptr)) << "i: " << i;
+         long_lived.push_back(ptr);
+
+      } else if (op < 7) {
+
+         if (long_lived.empty())
+            continue;
+
+         const size_t idx = e() % long_lived.size();
+         kfree2(long_lived[idx], PAGE_SIZE);
+         long_lived[idx] = long_lived.back();
+         long_lived.pop_back();
+
+      } else if (op < 55 || short_lived.empty()) {
+
+         const size_t size = (size_t)pages_dist(e) * PAGE_SIZE;
+         void *ptr = kmalloc(size);
+         ASSERT_TRUE(ptr != NULL);
+         ASSERT_FALSE(is_in_long_lived_heap(ptr)) << "i: " << i;
+         short_lived.push_back(make_pair(ptr, size));
+
+      } else {
+
+         const size_t idx = e() % short_lived.size();
+         kfree2(short_lived[idx].first, short_lived[idx].second);
+         short_lived[idx] = short_lived.back();
+         short_lived.pop_back();
+      }
+   }
+
+   for (const auto &p : short_lived)
+      kfree2(p.first, p.second);
+
+   for (int i = 0; i < KMALLOC_HEAPS_COUNT && heaps[i]; i++) {
+
+      if (long_lived_heaps_mask & (1u << i))
+         continue;
+
+      EXPECT_EQ(debug_kmalloc_get_heap_largest_free(i), largest_free_before[i])
+         << "heap: " << i;
+   }
+
+   for (void *ptr : long_lived)
+      kfree2(ptr, PAGE_SIZE);
+}
+
+TEST_F(kmalloc_test, add_heaps)
+{
+   const size_t size = 3 * KMALLOC_MIN_HEAP_SIZE;
+   char *buf = (char *)aligned_alloc(KMALLOC_MAX_ALIGN, size);
+   const ulong va = (ulong)buf;
+   const size_t free_before = kmalloc_get_max_tot_heap_free();
+   vector<struct kmalloc_heap *> added;
+   size_t s = 4 * KB;
+   void *ptr;
+
+   kmalloc_add_heaps(va, va + size);
+
+   for (int i = 0; i < KMALLOC_HEAPS_COUNT && heaps[i]; i++) {
+      if (IN_RANGE(heaps[i]->vaddr, va, va + size))
+         added.push_back(heaps[i]);
+   }
+
+   /* The range is split in a 128 KB heap followed by a 64 KB one */
+   ASSERT_EQ(added.size(), 2u);
+   EXPECT_EQ(added[0]->vaddr, va);
+   EXPECT_EQ(added[0]->size, 2 * KMALLOC_MIN_HEAP_SIZE);
+   EXPECT_EQ(added[1]->vaddr, va + 2 * KMALLOC_MIN_HEAP_SIZE);
+   EXPECT_EQ(added[1]->size, KMALLOC_MIN_HEAP_SIZE);
+   EXPECT_GT(kmalloc_get_max_tot_heap_free(), free_before);
+
+   ptr = per_heap_kmalloc(added[1], &s, 0);
+   ASSERT_TRUE(ptr != NULL);
+   EXPECT_TRUE(IN_RANGE((ulong)ptr, va + 2 * KMALLOC_MIN_HEAP_SIZE, va + size));
+   per_heap_kfree(added[1], ptr, &s, 0);
+
+   /* Reset kmalloc before freeing the buffer, as its heaps point to it */
+   init_kmalloc_for_tests();
+   free(buf);
+}
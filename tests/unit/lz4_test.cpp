@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <string>
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/common/lz4.h>
+}
+
+using namespace std;
+
+static int decompress(const string &src, char *dst, u32 dst_len)
+{
+   return lz4_decompress_block(src.data(), (u32)src.size(), dst, dst_len);
+}
+
+TEST(lz4, literals_only)
+{
+   char buf[64];
+   const string src("\x50" "hello", 6);
+
+   ASSERT_EQ(decompress(src, buf, sizeof(buf)), 5);
+   EXPECT_EQ(string(buf, 5), "hello");
+}
+
+TEST(lz4, long_literals)
+{
+   char buf[64];
+   const string lit(20, 'z');
+   const string src = string("\xf0\x05", 2) + lit;
+
+   ASSERT_EQ(decompress(src, buf, sizeof(buf)), 20);
+   EXPECT_EQ(string(buf, 20), lit);
+}
+
+TEST(lz4, overlapping_match)
+{
+   char buf[64];
+
+   /* "abc", then a match of 9 bytes at offset 3, then the literal "x" */
+   const string src("\x35" "abc" "\x03\x00" "\x10" "x", 8);
+
+   ASSERT_EQ(decompress(src, buf, sizeof(buf)), 13);
+   EXPECT_EQ(string(buf, 13), "abcabcabcabcx");
+}
+
+TEST(lz4, long_match)
+{
+   char buf[512];
+
+   /* "a", then a match of 15 + 4 + 255 + 10 = 284 bytes at offset 1 */
+   const string src("\x1f" "a" "\x01\x00" "\xff\x0a" "\x10" "b", 8);
+
+   ASSERT_EQ(decompress(src, buf, sizeof(buf)), 286);
+   EXPECT_EQ(string(buf, 285), string(285, 'a'));
+   EXPECT_EQ(buf[285], 'b');
+}
+
+TEST(lz4, malformed_blocks)
+{
+   char buf[16];
+
+   /* Offset 0 */
+   EXPECT_EQ(decompress(string("\x14" "a" "\x00\x00", 4), buf, 16), -1);
+
+   /* Offset before the beginning of the output */
+   EXPECT_EQ(decompress(string("\x14" "a" "\x02\x00", 4), buf, 16), -1);
+
+   /* Truncated literals */
+   EXPECT_EQ(decompress(string("\x50" "ab", 3), buf, 16), -1);
+
+   /* Output buffer too small */
+   EXPECT_EQ(decompress(string("\x50" "hello", 6), buf, 4), -1);
+
+   /* The match does not fit in the output buffer */
+   EXPECT_EQ(decompress(string("\x1f" "a" "\x01\x00" "\x10", 5), buf, 16), -1);
+}
+
+static void check_round_trip(const string &data, u32 cap)
+{
+   static u32 hash_table[1 << 10];
+   string block(cap, '\0');
+   string out(data.size(), '\0');
+   u32 len;
+
+   len = lz4_compress_block(data.data(), (u32)data.size(),
+                            &block[0], cap, hash_table, 10);
+
+   ASSERT_GT(len, 0u);
+   ASSERT_LT(len, cap);
+
+   ASSERT_EQ(lz4_decompress_block(block.data(), len, &out[0], data.size()),
+             (int)data.size());
+
+   EXPECT_EQ(out, data);
+}
+
+TEST(lz4, compress_round_trip)
+{
+   string text, mixed;
+
+   for (int i = 0; i < 200; i++)
+      text += "The quick brown fox jumps over the lazy dog " + to_string(i);
+
+   for (int i = 0; i < 4096; i++)
+      mixed += (char)((i % 7 == 0) ? i * 31 : i / 64);
+
+   check_round_trip(string(4096, '\0'), 4096);
+   check_round_trip(text, (u32)text.size());
+   check_round_trip(mixed, 4096);
+
+   /* Very short inputs: all literals */
+   check_round_trip(string(13, 'a'), 64);
+}
+
+TEST(lz4, compress_incompressible)
+{
+   static u32 hash_table[1 << 10];
+   char block[4096];
+   string data;
+   u32 seed = 12345;
+
+   for (int i = 0; i < 4096; i++) {
+      seed = seed * 1103515245 + 12345;
+      data += (char)(seed >> 16);
+   }
+
+   /* Random data does not fit in 3/4 of its size */
+   EXPECT_EQ(lz4_compress_block(data.data(), 4096, block, 3072,
+                                hash_table, 10), 0u);
+}
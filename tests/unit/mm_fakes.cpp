@@ -52,8 +52,30 @@ void initialize_test_kernel_heap()
    };
 }
 
+/*
+ * The object caches are static structs bound to the heaps: they must forget
+ * all their objects (and slabs) when the heaps get re-initialized.
+ */
+static void reset_kmalloc_caches()
+{
+   struct kmalloc_cache *c, *next;
+
+   for (c = caches_list; c; c = next) {
+      next = c->next;
+      c->next = NULL;
+      c->initialized = false;
+      c->mag_count = 0;
+      c->free_list = NULL;
+      c->free_count = 0;
+      c->allocs = c->hits = c->frees = c->spills = 0;
+   }
+
+   caches_list = NULL;
+}
+
 void init_kmalloc_for_tests()
 {
+   reset_kmalloc_caches();
    bzero(&kmalloc_initialized, sizeof(kmalloc_initialized));
    bzero((void *)&first_heap_struct, sizeof(first_heap_struct));
    bzero(&heaps, sizeof(heaps));
@@ -135,11 +157,28 @@ bool is_mapped(pdir_t *, void *vaddrp)
    return mappings.find(vaddr) != mappings.end();
 }
 
+bool is_rw_mapped(pdir_t *pdir, void *vaddrp)
+{
+   /* The fake mappings don't track permissions: everything is writable */
+   return is_mapped(pdir, vaddrp);
+}
+
 ulong get_mapping(pdir_t *, void *vaddrp)
 {
    return mappings[(ulong)vaddrp];
 }
 
+int get_mapping2(pdir_t *, void *vaddrp, ulong *pa_ref)
+{
+   auto it = mappings.find((ulong)vaddrp);
+
+   if (it == mappings.end())
+      return -EFAULT;
+
+   *pa_ref = it->second;
+   return 0;
+}
+
 int virtual_read(pdir_t *pdir, void *extern_va, void *dest, size_t len)
 {
    memcpy(dest, extern_va, len);
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+extern "C" {
+   #include <tilck/kernel/mpmc_ringbuf.h>
+}
+
+class mpmc_ringbuf_test : public Test {
+
+protected:
+
+   struct mpmc_ringbuf rb;
+   vector<u8> buf;
+
+   void init(u32 max_elems, u32 e_size) {
+      buf.resize(mpmc_ringbuf_buf_size(max_elems, e_size));
+      mpmc_ringbuf_init(&rb, max_elems, e_size, buf.data());
+   }
+
+   void TearDown() override {
+      mpmc_ringbuf_destroy(&rb);
+   }
+};
+
+TEST_F(mpmc_ringbuf_test, basic)
+{
+   int values[] = {1, 2, 3, 4, 5};
+   bool was_empty;
+   int val;
+
+   init(4, sizeof(int));
+   ASSERT_TRUE(mpmc_ringbuf_is_empty(&rb));
+
+   for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(mpmc_ringbuf_write_elem(&rb, &values[i], &was_empty));
+      ASSERT_EQ(was_empty, i == 0);
+   }
+
+   ASSERT_FALSE(mpmc_ringbuf_write_elem(&rb, &values[4], &was_empty));
+   ASSERT_FALSE(was_empty);
+   ASSERT_TRUE(mpmc_ringbuf_is_full(&rb));
+   ASSERT_EQ(mpmc_ringbuf_get_elems(&rb), 4u);
+
+   for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(mpmc_ringbuf_read_elem(&rb, &val));
+      ASSERT_EQ(val, values[i]);
+   }
+
+   ASSERT_FALSE(mpmc_ringbuf_read_elem(&rb, &val));
+   ASSERT_TRUE(mpmc_ringbuf_is_empty(&rb));
+}
+
+TEST_F(mpmc_ringbuf_test, rotation)
+{
+   int next_write = 0, next_read = 0, val;
+
+   init(4, sizeof(int));
+
+   for (int iter = 0; iter < 100; iter++) {
+
+      /* Write 3 and read 2 elements, until the ring is full */
+      for (int i = 0; i < 3; i++) {
+
+         if (mpmc_ringbuf_is_full(&rb)) {
+            ASSERT_FALSE(mpmc_ringbuf_write_elem(&rb, &next_write, NULL));
+            break;
+         }
+
+         ASSERT_TRUE(mpmc_ringbuf_write_elem(&rb, &next_write, NULL));
+         next_write++;
+      }
+
+      for (int i = 0; i < 2; i++) {
+         ASSERT_TRUE(mpmc_ringbuf_read_elem(&rb, &val));
+         ASSERT_EQ(val, next_read++);
+      }
+   }
+
+   while (mpmc_ringbuf_read_elem(&rb, &val))
+      ASSERT_EQ(val, next_read++);
+
+   ASSERT_EQ(next_read, next_write);
+}
+
+TEST_F(mpmc_ringbuf_test, batch)
+{
+   u8 in[] = "abcdefghij";
+   u8 out[16] = {0};
+   bool was_empty;
+
+   init(8, 1);
+
+   ASSERT_EQ(mpmc_ringbuf_write_elems(&rb, in, 5, &was_empty), 5u);
+   ASSERT_TRUE(was_empty);
+
+   /* Only 3 free slots left */
+   ASSERT_EQ(mpmc_ringbuf_write_elems(&rb, in + 5, 5, &was_empty), 3u);
+   ASSERT_FALSE(was_empty);
+   ASSERT_EQ(mpmc_ringbuf_write_elems(&rb, in, 1, &was_empty), 0u);
+
+   ASSERT_EQ(mpmc_ringbuf_read_elems(&rb, out, 6), 6u);
+   ASSERT_EQ(memcmp(out, "abcdef", 6), 0);
+
+   /* Wrap around the end of the buffer */
+   ASSERT_EQ(mpmc_ringbuf_write_elems(&rb, (u8 *)"XYZW", 4, NULL), 4u);
+   ASSERT_EQ(mpmc_ringbuf_read_elems(&rb, out, 16), 6u);
+   ASSERT_EQ(memcmp(out, "ghXYZW", 6), 0);
+   ASSERT_EQ(mpmc_ringbuf_read_elems(&rb, out, 16), 0u);
+}
+
+TEST_F(mpmc_ringbuf_test, resize)
+{
+   vector<u8> new_buf(mpmc_ringbuf_buf_size(16, sizeof(int)));
+   void *old_buf;
+   int val;
+
+   init(4, sizeof(int));
+
+   /* Make the pending elements wrap around */
+   for (int i = 0; i < 3; i++)
+      ASSERT_TRUE(mpmc_ringbuf_write_elem(&rb, &i, NULL));
+
+   for (int i = 0; i < 3; i++)
+      ASSERT_TRUE(mpmc_ringbuf_read_elem(&rb, &val));
+
+   for (int i = 0; i < 4; i++)
+      ASSERT_TRUE(mpmc_ringbuf_write_elem(&rb, &i, NULL));
+
+   old_buf = mpmc_ringbuf_resize(&rb, 16, new_buf.data());
+   ASSERT_EQ(old_buf, (void *)buf.data());
+   ASSERT_EQ(mpmc_ringbuf_get_elems(&rb), 4u);
+
+   for (int i = 4; i < 16; i++)
+      ASSERT_TRUE(mpmc_ringbuf_write_elem(&rb, &i, NULL));
+
+   ASSERT_FALSE(mpmc_ringbuf_write_elem(&rb, &val, NULL));
+
+   for (int i = 0; i < 16; i++) {
+      ASSERT_TRUE(mpmc_ringbuf_read_elem(&rb, &val));
+      ASSERT_EQ(val, i);
+   }
+
+   ASSERT_TRUE(mpmc_ringbuf_is_empty(&rb));
+}
+
+TEST_F(mpmc_ringbuf_test, concurrent)
+{
+   const int producers = 4, consumers = 4;
+   const u32 per_producer = 50000;
+   vector<thread> threads;
+   vector<u32> seen(producers * per_producer);
+   atomic<u32> consumed(0);
+   atomic<u64> sum(0);
+
+   init(64, sizeof(u32));
+
+   for (int p = 0; p < producers; p++) {
+
+      threads.emplace_back([this, p, per_producer] {
+
+         u32 batch[4], n, written;
+
+         for (u32 i = 0; i < per_producer; i += written) {
+
+            n = min(per_producer - i, 4u);
+
+            for (u32 j = 0; j < n; j++)
+               batch[j] = p * per_producer + i + j;
+
+            if (!(written = mpmc_ringbuf_write_elems(&rb, batch, n, NULL)))
+               this_thread::yield();
+         }
+      });
+   }
+
+   for (int c = 0; c < consumers; c++) {
+
+      threads.emplace_back([&, this] {
+
+         u32 batch[3], n;
+
+         while (consumed.load() < producers * per_producer) {
+
+            if (!(n = mpmc_ringbuf_read_elems(&rb, batch, 3)))
+               this_thread::yield();
+
+            for (u32 j = 0; j < n; j++) {
+               seen[batch[j]]++;
+               sum += batch[j];
+            }
+
+            consumed += n;
+         }
+      });
+   }
+
+   for (auto &t : threads)
+      t.join();
+
+   const u64 total = producers * per_producer;
+   ASSERT_EQ(sum.load(), total * (total - 1) / 2);
+
+   for (u32 i = 0; i < total; i++)
+      ASSERT_EQ(seen[i], 1u) << "value: " << i;
+
+   ASSERT_TRUE(mpmc_ringbuf_is_empty(&rb));
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <gtest/gtest.h>
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/common/string_util.h>
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/fs/pagecache.h>
+}
+
+using namespace testing;
+
+static int fills_count;
+
+static int test_fill_page(struct page_cache *pc, ulong index, char *buf)
+{
+   fills_count++;
+   memset(buf, (int)(index & 0xff), PAGE_SIZE);
+   return 0;
+}
+
+class pagecache_test : public Test {
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      fills_count = 0;
+      pc_init(&pc, &test_fill_page, 100 * PAGE_SIZE + 10);
+      ra = (struct pc_readahead) { };
+   }
+
+   void TearDown() override {
+      pc_destroy(&pc);
+   }
+
+public:
+   struct page_cache pc;
+   struct pc_readahead ra;
+};
+
+TEST_F(pagecache_test, read)
+{
+   char buf[64];
+   offt pos = 3 * PAGE_SIZE - 32;
+
+   EXPECT_EQ(pc_read(&pc, NULL, buf, sizeof(buf), &pos), 64);
+   EXPECT_EQ(pos, (offt)(3 * PAGE_SIZE + 32));
+   EXPECT_EQ(buf[0], 2);
+   EXPECT_EQ(buf[63], 3);
+   EXPECT_EQ(pc.nr_pages, 2u);
+
+   /* Cached: no more fills */
+   pos = 3 * PAGE_SIZE - 32;
+   EXPECT_EQ(pc_read(&pc, NULL, buf, sizeof(buf), &pos), 64);
+   EXPECT_EQ(fills_count, 2);
+
+   /* Short read at EOF */
+   pos = 100 * PAGE_SIZE;
+   EXPECT_EQ(pc_read(&pc, NULL, buf, sizeof(buf), &pos), 10);
+   EXPECT_EQ(pc_read(&pc, NULL, buf, sizeof(buf), &pos), 0);
+}
+
+TEST_F(pagecache_test, sequential_readahead_grows)
+{
+   pc_update_readahead(&pc, &ra, 0);
+   EXPECT_EQ(ra.win, (u32)PC_RA_MIN_PAGES);
+   EXPECT_EQ(pc.nr_pages, (size_t)PC_RA_MIN_PAGES);
+
+   for (ulong i = 1; i < 60; i++)
+      pc_update_readahead(&pc, &ra, i);
+
+   EXPECT_EQ(ra.win, (u32)PC_RA_MAX_PAGES);
+
+   /* Everything up to the end of the last window has been read ahead */
+   EXPECT_GE(ra.end, 60u);
+   EXPECT_EQ(pc.nr_pages, MIN((size_t)ra.end, (size_t)101) - 1);
+}
+
+TEST_F(pagecache_test, random_access_resets_window)
+{
+   for (ulong i = 0; i < 10; i++)
+      pc_update_readahead(&pc, &ra, i);
+
+   EXPECT_GT(ra.win, (u32)PC_RA_MIN_PAGES);
+
+   const size_t cached = pc.nr_pages;
+   pc_update_readahead(&pc, &ra, 70);
+
+   EXPECT_EQ(ra.win, 0u);
+   EXPECT_EQ(pc.nr_pages, cached);
+
+   /* A new stream is detected starting from there */
+   pc_update_readahead(&pc, &ra, 71);
+   EXPECT_EQ(ra.win, (u32)PC_RA_MIN_PAGES);
+   EXPECT_EQ(pc.nr_pages, cached + PC_RA_MIN_PAGES);
+}
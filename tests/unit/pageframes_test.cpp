@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <gtest/gtest.h>
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/common/basic_defs.h>
+   #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/system_mmap.h>
+   #include <tilck/kernel/pageframes.h>
+   #include <tilck/kernel/test/mem_regions.h>
+}
+
+using namespace testing;
+
+class pageframes_test : public Test {
+
+   void SetUp() override {
+
+      init_kmalloc_for_tests();
+
+      saved_count = mem_regions_count;
+      memcpy(saved, mem_regions, sizeof(saved));
+
+      mem_regions_count = 3;
+
+      mem_regions[0] = (struct mem_region) {
+         .addr = 0,
+         .len = 1 * MB,
+         .type = MULTIBOOT_MEMORY_AVAILABLE,
+         .extra = MEM_REG_EXTRA_LOWMEM,
+      };
+
+      mem_regions[1] = (struct mem_region) {
+         .addr = 1 * MB,
+         .len = 15 * MB,
+         .type = MULTIBOOT_MEMORY_AVAILABLE,
+         .extra = 0,
+      };
+
+      mem_regions[2] = (struct mem_region) {
+         .addr = 16 * MB + 4 * KB,
+         .len = 1 * MB,
+         .type = MULTIBOOT_MEMORY_RESERVED,
+         .extra = 0,
+      };
+
+      init_pageframes(0, 32 * MB);
+   }
+
+   void TearDown() override {
+
+      kfree_array_obj(pageframes, struct pageframe, pageframes_count);
+      pageframes = NULL;
+      pageframes_count = 0;
+
+      mem_regions_count = saved_count;
+      memcpy(mem_regions, saved, sizeof(saved));
+   }
+
+   int saved_count;
+   struct mem_region saved[3];
+};
+
+TEST_F(pageframes_test, types_from_system_mmap)
+{
+   struct pageframe_stats s;
+   get_pageframe_stats(&s);
+
+   const size_t pages_per_mb = MB / PAGE_SIZE;
+
+   EXPECT_EQ(s.total, 32 * pages_per_mb);
+   EXPECT_EQ(s.by_type[PF_TYPE_KERNEL], 1 * pages_per_mb);
+   EXPECT_EQ(s.by_type[PF_TYPE_OTHER], 15 * pages_per_mb);
+
+   /* Everything not covered by the mmap is reserved too */
+   EXPECT_EQ(s.by_type[PF_TYPE_RESERVED], 16 * pages_per_mb);
+   EXPECT_EQ(s.mapped, 0u);
+}
+
+TEST_F(pageframes_test, refcount_and_mapcount)
+{
+   struct pageframe_stats s;
+   const ulong pa = 2 * MB;
+   struct pageframe *pf = pf_get(pa);
+
+   ASSERT_TRUE(pf != NULL);
+   EXPECT_TRUE(pf_get(32 * MB) == NULL);
+   EXPECT_EQ(pf_ref_count_inc(32 * MB), 0u);
+
+   /* An owner (e.g. ramfs) retains the page, then 2 processes map it */
+   pf_retain(pa, PF_TYPE_FILE);
+   EXPECT_EQ(pf_ref_count_inc(pa), 2u);
+   EXPECT_EQ(pf_ref_count_inc(pa), 3u);
+   EXPECT_EQ(pf->mapcount, 2u);
+   EXPECT_EQ(pf->type, PF_TYPE_FILE);
+
+   get_pageframe_stats(&s);
+   EXPECT_EQ(s.by_type[PF_TYPE_FILE], 1u);
+   EXPECT_EQ(s.mapped, 1u);
+   EXPECT_EQ(s.shared, 1u);
+   EXPECT_EQ(s.saved, 1u);
+   EXPECT_EQ(s.anon, 0u);
+
+   /* The owner goes away: the page stays mapped, as a private one */
+   pf_release(pa);
+   EXPECT_EQ(pf_ref_count_get(pa), 2u);
+   EXPECT_EQ(pf->type, PF_TYPE_OTHER);
+
+   get_pageframe_stats(&s);
+   EXPECT_EQ(s.anon, 1u);
+
+   EXPECT_EQ(pf_ref_count_dec(pa), 1u);
+   EXPECT_EQ(pf_ref_count_dec(pa), 0u);
+   EXPECT_EQ(pf->mapcount, 0u);
+}
+
+TEST_F(pageframes_test, lazyfree_type_dropped_on_last_unmap)
+{
+   const ulong pa = 3 * MB;
+   struct pageframe *pf = pf_get(pa);
+
+   ASSERT_TRUE(pf != NULL);
+
+   /* An anonymous page, shared after fork(), then MADV_FREE-ed */
+   EXPECT_EQ(pf_ref_count_inc(pa), 1u);
+   EXPECT_EQ(pf_ref_count_inc(pa), 2u);
+   pf->type = PF_TYPE_LAZYFREE;
+
+   EXPECT_EQ(pf_ref_count_dec(pa), 1u);
+   EXPECT_EQ(pf->type, PF_TYPE_LAZYFREE);
+
+   /* Once freed, the frame must not be considered lazily freed anymore */
+   EXPECT_EQ(pf_ref_count_dec(pa), 0u);
+   EXPECT_EQ(pf->type, PF_TYPE_OTHER);
+   EXPECT_STREQ(pf_type_str(PF_TYPE_LAZYFREE), "lazyfree");
+}
@@ -4,6 +4,7 @@
 #include <random>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -11,6 +12,15 @@ using namespace testing;
 
 extern "C" {
    #include <tilck/kernel/sort.h>
+
+#if defined(__i386__) || defined(__x86_64)
+   #include <tilck/common/arch/generic_x86/x86_utils.h>
+#elif defined(__riscv)
+   #include <tilck/common/arch/riscv/riscv_utils.h>
+#else
+   /* TODO: actually implement an equivalent of RDTSC for AARCH64 */
+   static inline ulong RDTSC(void) { return 0; }
+#endif
 }
 
 static long less_than_cmp_int(const void *a, const void *b)
@@ -99,6 +109,214 @@ TEST(insertion_sort_generic, random)
    ASSERT_TRUE(my_is_sorted((ulong *)&vec[0], vec.size(), less_than_cmp_int));
 }
 
+static ulong long_key(const void *a)
+{
+   /* Flip the sign bit, in order to order negative numbers first */
+   return (ulong)*(const long *)a ^ ((ulong)1 << (8 * sizeof(long) - 1));
+}
+
+struct sort_test_elem {
+   u32 key;
+   u32 seq;       /* original position, to check the stability */
+   u64 payload;
+};
+
+static long sort_test_elem_cmp(const void *a, const void *b)
+{
+   const struct sort_test_elem *x = (const struct sort_test_elem *)a;
+   const struct sort_test_elem *y = (const struct sort_test_elem *)b;
+   return (long)x->key - (long)y->key;
+}
+
+static ulong sort_test_elem_key(const void *a)
+{
+   return ((const struct sort_test_elem *)a)->key;
+}
+
+static void
+check_intro_sort_ptr(vector<long> vec)
+{
+   vector<long> expected = vec;
+   sort(expected.begin(), expected.end());
+
+   intro_sort_ptr(vec.data(), (u32)vec.size(), less_than_cmp_int);
+   ASSERT_EQ(vec, expected);
+}
+
+TEST(intro_sort_ptr, basic_test)
+{
+   check_intro_sort_ptr({ });
+   check_intro_sort_ptr({ 1 });
+   check_intro_sort_ptr({ 2, 1 });
+   check_intro_sort_ptr({ 3, 4, 1, 0, -3, 10, 2 });
+}
+
+TEST(intro_sort_ptr, patterns)
+{
+   const u32 n = 5000;
+   vector<long> vec(n);
+
+   for (u32 i = 0; i < n; i++)
+      vec[i] = i;
+
+   check_intro_sort_ptr(vec);        /* already sorted */
+
+   reverse(vec.begin(), vec.end());
+   check_intro_sort_ptr(vec);        /* reverse sorted */
+
+   for (u32 i = 0; i < n; i++)
+      vec[i] = i % 3;
+
+   check_intro_sort_ptr(vec);        /* many duplicates */
+
+   for (u32 i = 0; i < n; i++)
+      vec[i] = (i & 1) ? (long)i : (long)(n - i);
+
+   check_intro_sort_ptr(vec);        /* organ pipe-like */
+}
+
+TEST(intro_sort_ptr, random)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   lognormal_distribution<> dist(5.0, 3);
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   vector<long> vec;
+
+   for (u32 elems = 1; elems <= 100000; elems *= 7) {
+      random_fill_vec(e, dist, vec, elems);
+      check_intro_sort_ptr(vec);
+   }
+}
+
+TEST(intro_sort_generic, random)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   uniform_int_distribution<u32> dist(0, 1000);
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   vector<sort_test_elem> vec(20000);
+
+   for (u32 i = 0; i < vec.size(); i++)
+      vec[i] = { dist(e), i, (u64)i * 3 };
+
+   intro_sort_generic(vec.data(), sizeof(vec[0]),
+                      (u32)vec.size(), sort_test_elem_cmp);
+
+   for (u32 i = 1; i < vec.size(); i++)
+      ASSERT_LE(vec[i - 1].key, vec[i].key);
+
+   for (const auto &el : vec)
+      ASSERT_EQ(el.payload, (u64)el.seq * 3);
+}
+
+TEST(radix_sort_ptr, random)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   lognormal_distribution<> dist(5.0, 3);
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   vector<long> vec, tmp, expected;
+
+   for (u32 elems = 1; elems <= 100000; elems *= 7) {
+
+      random_fill_vec(e, dist, vec, elems);
+
+      for (u32 i = 0; i < elems; i += 3)
+         vec[i] = -vec[i];
+
+      expected = vec;
+      tmp.resize(elems);
+      sort(expected.begin(), expected.end());
+
+      radix_sort_ptr(vec.data(), tmp.data(), elems, long_key);
+      ASSERT_EQ(vec, expected);
+   }
+}
+
+TEST(radix_sort_generic, stable)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   uniform_int_distribution<u32> dist(0, 70000);
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   vector<sort_test_elem> vec(20000), tmp(20000);
+
+   for (u32 i = 0; i < vec.size(); i++)
+      vec[i] = { dist(e), i, (u64)i * 3 };
+
+   radix_sort_generic(vec.data(), tmp.data(), sizeof(vec[0]),
+                      (u32)vec.size(), sort_test_elem_key);
+
+   for (u32 i = 1; i < vec.size(); i++) {
+
+      ASSERT_LE(vec[i - 1].key, vec[i].key);
+
+      if (vec[i - 1].key == vec[i].key) {
+         ASSERT_LT(vec[i - 1].seq, vec[i].seq);
+      }
+   }
+}
+
+static void
+bench_sort_func(const char *name,
+                const vector<long> &input,
+                function<void(vector<long> &)> func)
+{
+   const int iters = 10;
+   vector<long> vec;
+   u64 start, tot = 0;
+
+   for (int i = 0; i < iters; i++) {
+      vec = input;
+      start = RDTSC();
+      func(vec);
+      tot += RDTSC() - start;
+   }
+
+   printf("[ INFO     ] %-16s %6u elems: %10lu cycles\n",
+          name, (u32)input.size(), (unsigned long)(tot / iters));
+}
+
+TEST(sort, DISABLED_benchmark)
+{
+   default_random_engine e(1234);
+   lognormal_distribution<> dist(5.0, 3);
+   vector<long> input, tmp;
+
+   for (u32 elems = 1000; elems <= 64000; elems *= 4) {
+
+      random_fill_vec(e, dist, input, elems);
+      tmp.resize(elems);
+
+      if (elems <= 16000) {
+         bench_sort_func("insertion_sort", input, [](vector<long> &v) {
+            insertion_sort_ptr(v.data(), (u32)v.size(), less_than_cmp_int);
+         });
+      }
+
+      bench_sort_func("intro_sort", input, [](vector<long> &v) {
+         intro_sort_ptr(v.data(), (u32)v.size(), less_than_cmp_int);
+      });
+
+      bench_sort_func("radix_sort", input, [&tmp](vector<long> &v) {
+         radix_sort_ptr(v.data(), tmp.data(), (u32)v.size(), long_key);
+      });
+
+      bench_sort_func("std::sort", input, [](vector<long> &v) {
+         sort(v.begin(), v.end());
+      });
+   }
+}
+
 bool array_reverse_ptr_check(const vector<ulong> &vec)
 {
    vector<ulong> copy = vec;
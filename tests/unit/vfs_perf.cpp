@@ -2,6 +2,19 @@
 
 #include "vfs_test.h"
 
+extern "C" {
+   #include <tilck/kernel/kmalloc.h>
+
+#if defined(__i386__) || defined(__x86_64)
+   #include <tilck/common/arch/generic_x86/x86_utils.h>
+#elif defined(__riscv)
+   #include <tilck/common/arch/riscv/riscv_utils.h>
+#else
+   /* TODO: actually implement an equivalent of RDTSC for AARCH64 */
+   static inline ulong RDTSC(void) { return 0; }
+#endif
+}
+
 using namespace std;
 
 class ramfs_perf : public vfs_test_base {
@@ -45,3 +58,70 @@ TEST_F(ramfs_perf, creat)
    for (int i = 0; i < 100; i++)
       create_test_file(i);
 }
+
+/*
+ * Bursts of handles bigger than the magazine of the handle cache, in order to
+ * exercise the pool's free list as well.
+ */
+#define PERF_BURST          (4 * KMALLOC_CACHE_MAG_SIZE)
+#define PERF_ITERS                                  1000
+
+TEST_F(ramfs_perf, open_close)
+{
+   fs_handle h[PERF_BURST];
+   u64 start, tot = 0;
+   int rc;
+
+   create_test_file(0);
+
+   for (int iter = 0; iter < PERF_ITERS; iter++) {
+
+      start = RDTSC();
+
+      for (int i = 0; i < PERF_BURST; i++) {
+         rc = vfs_open("/test_0", &h[i], O_RDONLY, 0);
+         ASSERT_EQ(rc, 0);
+      }
+
+      for (int i = 0; i < PERF_BURST; i++)
+         vfs_close(h[i]);
+
+      tot += RDTSC() - start;
+   }
+
+   printf("[ INFO     ] Avg. cycles per open + close: %lu\n",
+          (unsigned long)(tot / (PERF_ITERS * PERF_BURST)));
+}
+
+TEST_F(ramfs_perf, handle_pool_vs_kmalloc)
+{
+   void *h[PERF_BURST];
+   u64 start, tot_pool = 0, tot_kmalloc = 0;
+
+   for (int iter = 0; iter < PERF_ITERS; iter++) {
+
+      start = RDTSC();
+
+      for (int i = 0; i < PERF_BURST; i++)
+         ASSERT_TRUE((h[i] = vfs_alloc_handle_raw()) != NULL);
+
+      for (int i = 0; i < PERF_BURST; i++)
+         vfs_free_handle(h[i]);
+
+      tot_pool += RDTSC() - start;
+      start = RDTSC();
+
+      for (int i = 0; i < PERF_BURST; i++)
+         ASSERT_TRUE((h[i] = kmalloc(MAX_FS_HANDLE_SIZE)) != NULL);
+
+      for (int i = 0; i < PERF_BURST; i++)
+         kfree2(h[i], MAX_FS_HANDLE_SIZE);
+
+      tot_kmalloc += RDTSC() - start;
+   }
+
+   printf("[ INFO     ] Avg. cycles per alloc + free (pool):    %lu\n",
+          (unsigned long)(tot_pool / (PERF_ITERS * PERF_BURST)));
+   printf("[ INFO     ] Avg. cycles per alloc + free (kmalloc): %lu\n",
+          (unsigned long)(tot_kmalloc / (PERF_ITERS * PERF_BURST)));
+}
@@ -149,6 +149,10 @@ protected:
       release_obj(&fs2);
       release_obj(&fs3);
 
+      fs1.hosted_mps = 0;
+      fs2.mp = nullptr;
+      fs3.mp = nullptr;
+
       reset_all_fs_refcounts();
       test_fs_clear_mps();
       vfs_test_base::TearDown();
@@ -553,6 +557,29 @@ TEST_F(vfs_resolve_multi_fs, dot_dot)
    ASSERT_NO_FATAL_FAILURE({ check_all_fs_refcounts(); });
 }
 
+TEST_F(vfs_resolve_multi_fs, mp_lookup)
+{
+   struct mnt_fs *target;
+
+   ASSERT_EQ(fs1.hosted_mps, 2u);
+   ASSERT_EQ(fs2.hosted_mps, 0u);
+   ASSERT_TRUE(fs1.mp == nullptr);
+   ASSERT_TRUE(fs2.mp != nullptr);
+   ASSERT_TRUE(fs3.mp != nullptr);
+
+   target = mp_get_retained_at(&fs1, path(root1, {"dev"}));
+   ASSERT_TRUE(target == &fs3);
+   release_obj(target);
+
+   target = mp_get_retained_at(&fs1, path(root1, {"a", "b", "c2"}));
+   ASSERT_TRUE(target == &fs2);
+   release_obj(target);
+
+   ASSERT_TRUE(mp_get_retained_at(&fs1, path(root1, {"a", "b"})) == nullptr);
+   ASSERT_TRUE(mp_get_retained_at(&fs2, root2) == nullptr);
+   ASSERT_NO_FATAL_FAILURE({ check_all_fs_refcounts(); });
+}
+
 TEST_F(vfs_resolve_multi_fs, rel_paths)
 {
    int rc;
@@ -3,12 +3,17 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <linux/falloc.h>
 
 #include <iostream>
 #include <random>
 
 #include "vfs_test.h"
 
+extern "C" {
+   #include "kernel/fs/ramfs/ramfs_int.h"
+}
+
 using namespace std;
 using namespace testing;
 
@@ -166,24 +171,152 @@ TEST_F(vfs_fat32, fseek)
    close(fd);
 }
 
-TEST_F(vfs_fat32, pread_not_supported)
+TEST_F(vfs_fat32, pread)
 {
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
    const char *fatpart_file_path = "/bigfile";
+   const char *real_file_path = PROJ_BUILD_DIR "/test_sysroot/bigfile";
+   char buf_tilck[300];
+   char buf_linux[300];
    fs_handle h = NULL;
-   char buf[32];
    int rc;
 
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   int fd = open(real_file_path, O_RDONLY);
+   ASSERT_GE(fd, 0);
+
+   const off_t file_size = lseek(fd, 0, SEEK_END);
+   uniform_int_distribution<off_t> dist(0, file_size + 100);
+
    rc = vfs_open(fatpart_file_path, &h, 0, O_RDONLY);
    ASSERT_TRUE(rc == 0);
    ASSERT_TRUE(h != NULL);
 
-   rc = vfs_pread(h, buf, sizeof(buf), 0 /* offset */);
-   EXPECT_EQ(rc, -EPERM);
+   /* Move the file position somewhere: pread() must not change it */
+   ASSERT_EQ(vfs_seek(h, 123, SEEK_SET), 123);
+
+   for (int i = 0; i < 5000; i++) {
+
+      const off_t off = dist(engine);
+
+      memset(buf_linux, 0, sizeof(buf_linux));
+      memset(buf_tilck, 0, sizeof(buf_tilck));
+
+      ssize_t linux_read = pread(fd, buf_linux, sizeof(buf_linux), off);
+      ssize_t tilck_read = vfs_pread(h, buf_tilck, sizeof(buf_tilck), off);
+
+      ASSERT_EQ(tilck_read, linux_read) << "Offset: " << off;
+      ASSERT_EQ(memcmp(buf_tilck, buf_linux, sizeof(buf_linux)), 0)
+         << "Offset: " << off;
+   }
+
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_CUR), 123);
+
+   /* Regular reads continue from the file position */
+   ASSERT_EQ(vfs_read(h, buf_tilck, sizeof(buf_tilck)),
+             pread(fd, buf_linux, sizeof(buf_linux), 123));
+   ASSERT_EQ(memcmp(buf_tilck, buf_linux, sizeof(buf_linux)), 0);
+
+   vfs_close(h);
+   close(fd);
+}
+
+class vfs_fat32_rw : public vfs_test_base {
+
+protected:
+
+   struct mnt_fs *fat_fs;
+   vector<char> img;
+
+   void SetUp() override {
+
+      size_t fatpart_size;
+      vfs_test_base::SetUp();
+
+      const char *buf = load_once_file(TEST_FATPART_FILE, &fatpart_size);
+
+      /* A writable copy, with some free space at the end */
+      img.assign(buf, buf + fatpart_size);
+      img.resize(fatpart_size + 256 * KB);
+
+      fat_fs = fat_mount_ramdisk(img.data(), img.size(), VFS_FS_RW);
+      ASSERT_TRUE(fat_fs != NULL);
+
+      mp_init(fat_fs);
+   }
+
+   void TearDown() override {
+
+      fat_umount_ramdisk(fat_fs);
+      vfs_test_base::TearDown();
+   }
+};
+
+TEST_F(vfs_fat32_rw, create_write_unlink)
+{
+   const char *path = "/testdir/A_new_file.txt";
+   struct k_stat64 st;
+   vector<char> data(10000), buf(20000);
+   fs_handle h = NULL;
+
+   for (size_t i = 0; i < data.size(); i++)
+      data[i] = (char)('a' + i % 26);
+
+   ASSERT_EQ(vfs_open(path, &h, O_CREAT | O_EXCL | O_WRONLY, 0644), 0);
+   ASSERT_EQ(vfs_write(h, data.data(), 4000), 4000);
+   ASSERT_EQ(vfs_write(h, data.data() + 4000, 6000), 6000);
+   vfs_close(h);
+
+   ASSERT_EQ(vfs_stat64(path, &st, true), 0);
+   ASSERT_EQ(st.st_size, 10000);
+
+   ASSERT_EQ(vfs_open(path, &h, O_RDONLY, 0), 0);
+   ASSERT_EQ(vfs_read(h, buf.data(), buf.size()), 10000);
+   ASSERT_EQ(memcmp(buf.data(), data.data(), data.size()), 0);
+
+   /* The open files cannot be unlinked on FAT */
+   ASSERT_EQ(vfs_unlink(path), -EBUSY);
+   vfs_close(h);
+
+   ASSERT_EQ(vfs_unlink(path), 0);
+   ASSERT_EQ(vfs_open(path, &h, O_RDONLY, 0), -ENOENT);
+
+   /* The slots of the unlinked entry are reused */
+   ASSERT_EQ(vfs_open(path, &h, O_CREAT | O_EXCL | O_WRONLY, 0644), 0);
+   vfs_close(h);
+   ASSERT_EQ(vfs_stat64(path, &st, true), 0);
+   ASSERT_EQ(st.st_size, 0);
+}
+
+TEST_F(vfs_fat32_rw, truncate_and_sync)
+{
+   struct fat_hdr *hdr = (struct fat_hdr *)img.data();
+   const size_t bps = hdr->BPB_BytsPerSec;
+   const size_t fat_size = fat_get_FATSz(hdr) * bps;
+   const char *fat0 = img.data() + hdr->BPB_RsvdSecCnt * bps;
+   char buf[5000];
+   fs_handle h = NULL;
+
+   ASSERT_EQ(vfs_open("/bigfile", &h, O_RDWR, 0), 0);
+   ASSERT_EQ(vfs_ftruncate(h, 100), 0);
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_END), 100);
 
-   rc = vfs_pread(h, buf, sizeof(buf), 10 /* offset */);
-   EXPECT_EQ(rc, -EPERM);
+   /* Growing the file again: the new bytes must read as zeros */
+   ASSERT_EQ(vfs_ftruncate(h, sizeof(buf)), 0);
+   ASSERT_EQ(vfs_pread(h, buf, sizeof(buf), 0), (ssize_t)sizeof(buf));
+
+   for (size_t i = 100; i < sizeof(buf); i++)
+      ASSERT_EQ(buf[i], 0) << "Offset: " << i;
 
    vfs_close(h);
+   fat_flush((struct fat_fs_device_data *)fat_fs->device_data);
+
+   /* After a flush, all the FATs are the same */
+   for (u32 n = 1; n < hdr->BPB_NumFATs; n++)
+      ASSERT_EQ(memcmp(fat0, fat0 + n * fat_size, fat_size), 0);
 }
 
 class vfs_ramfs : public vfs_test_base {
@@ -242,6 +375,404 @@ TEST_F(vfs_ramfs, create_and_unlink_file)
    ASSERT_EQ(rc, -ENOENT);
 }
 
+TEST_F(vfs_ramfs, dcache)
+{
+   struct vfs_dcache_stats s0, s1;
+   struct k_stat64 st;
+   fs_handle h;
+   int rc;
+
+   ASSERT_EQ(vfs_mkdir("/a", 0755), 0);
+   ASSERT_EQ(vfs_mkdir("/a/b", 0755), 0);
+   ASSERT_EQ(vfs_open("/a/b/f", &h, O_CREAT | O_RDWR, 0644), 0);
+   vfs_close(h);
+
+   /* The first resolve fills the cache, the next ones must hit it */
+   ASSERT_EQ(vfs_stat64("/a/b/f", &st, true), 0);
+   s0 = vfs_dcache_stats;
+   ASSERT_EQ(vfs_stat64("/a/b/f", &st, true), 0);
+   s1 = vfs_dcache_stats;
+   EXPECT_EQ(s1.misses, s0.misses);
+   EXPECT_EQ(s1.hits, s0.hits + 3);
+
+   /* Unlink must invalidate the positive entry */
+   ASSERT_EQ(vfs_unlink("/a/b/f"), 0);
+   rc = vfs_stat64("/a/b/f", &st, true);
+   EXPECT_EQ(rc, -ENOENT);
+
+   /* Now, we must get a negative hit */
+   s0 = vfs_dcache_stats;
+   rc = vfs_stat64("/a/b/f", &st, true);
+   EXPECT_EQ(rc, -ENOENT);
+   s1 = vfs_dcache_stats;
+   EXPECT_EQ(s1.neg_hits, s0.neg_hits + 1);
+
+   /* Creating the file again must invalidate the negative entry */
+   ASSERT_EQ(vfs_open("/a/b/f", &h, O_CREAT | O_RDWR, 0644), 0);
+   vfs_close(h);
+   ASSERT_EQ(vfs_stat64("/a/b/f", &st, true), 0);
+
+   /* Same thing for directories */
+   ASSERT_EQ(vfs_unlink("/a/b/f"), 0);
+   ASSERT_EQ(vfs_rmdir("/a/b"), 0);
+   EXPECT_EQ(vfs_stat64("/a/b", &st, true), -ENOENT);
+   EXPECT_EQ(vfs_stat64("/a/b/f", &st, true), -ENOENT);
+   ASSERT_EQ(vfs_mkdir("/a/b", 0755), 0);
+   EXPECT_EQ(vfs_stat64("/a/b", &st, true), 0);
+   EXPECT_EQ(vfs_stat64("/a/b/f", &st, true), -ENOENT);
+
+   ASSERT_EQ(vfs_rmdir("/a/b"), 0);
+   ASSERT_EQ(vfs_rmdir("/a"), 0);
+}
+
+TEST_F(vfs_ramfs, create_with_dir_locks)
+{
+   struct k_stat64 st;
+   fs_handle h;
+
+   ASSERT_TRUE(mnt_fs->fsops->dir_exlock != NULL);
+   ASSERT_EQ(vfs_mkdir("/d", 0755), 0);
+
+   /* The entry exists now: the re-check under the dir lock must see that */
+   ASSERT_EQ(vfs_open("/d/f", &h, O_CREAT | O_EXCL | O_RDWR, 0644), 0);
+   vfs_close(h);
+   EXPECT_EQ(vfs_open("/d/f", &h, O_CREAT | O_EXCL | O_RDWR, 0644), -EEXIST);
+   EXPECT_EQ(vfs_mkdir("/d", 0755), -EEXIST);
+
+   /* The root dir has no entry: that goes through the exclusive fs-lock */
+   ASSERT_EQ(vfs_open("/", &h, O_CREAT | O_RDONLY, 0), 0);
+   vfs_close(h);
+
+   ASSERT_EQ(vfs_symlink("/d/f", "/d/l"), 0);
+   ASSERT_EQ(vfs_stat64("/d/l", &st, true), 0);
+   EXPECT_EQ(st.st_mode & S_IFMT, (mode_t)S_IFREG);
+
+   /* The dir lock must have been released: unlink requires the fs exlock */
+   ASSERT_EQ(vfs_unlink("/d/l"), 0);
+   ASSERT_EQ(vfs_unlink("/d/f"), 0);
+   ASSERT_EQ(vfs_rmdir("/d"), 0);
+}
+
+TEST_F(vfs_ramfs, hashed_dir)
+{
+   const int n = 8 * RAMFS_DIR_HASH_MIN_ENTRIES;
+   struct ramfs_inode *idir;
+   struct k_stat64 st;
+   char path[64];
+   fs_handle h, dh;
+
+   ASSERT_EQ(vfs_mkdir("/d", 0755), 0);
+   ASSERT_EQ(vfs_open("/d", &dh, O_RDONLY, 0), 0);
+   idir = ((struct ramfs_handle *)dh)->inode;
+   EXPECT_EQ(idir->entries_buckets, nullptr);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "/d/file_%d", i);
+      ASSERT_EQ(vfs_open(path, &h, O_CREAT | O_RDWR, 0644), 0);
+      vfs_close(h);
+   }
+
+   /* The directory switched to the hashed mode and grew its table */
+   ASSERT_NE(idir->entries_buckets, nullptr);
+   EXPECT_GT(idir->buckets_count, (u32)RAMFS_DIR_HASH_MIN_BUCKETS);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "/d/file_%d", i);
+      ASSERT_EQ(vfs_stat64(path, &st, true), 0);
+   }
+
+   EXPECT_EQ(vfs_stat64("/d/file_", &st, true), -ENOENT);
+   EXPECT_EQ(vfs_stat64("/d/file_00", &st, true), -ENOENT);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "/d/file_%d", i);
+      ASSERT_EQ(vfs_unlink(path), 0);
+   }
+
+   /* Back to the single tree */
+   EXPECT_EQ(idir->entries_buckets, nullptr);
+   EXPECT_EQ(idir->num_entries, 2);
+   EXPECT_EQ(vfs_stat64("/d/.", &st, true), 0);
+   vfs_close(dh);
+   ASSERT_EQ(vfs_rmdir("/d"), 0);
+}
+
+TEST_F(vfs_ramfs, entry_sizes)
+{
+   /* Names fitting in each one of the entry size classes, plus a too long one */
+   const size_t lens[] = { 1, 40, 100, RAMFS_ENTRY_MAX_LEN - 1 };
+   struct k_stat64 st;
+   char path[RAMFS_ENTRY_MAX_LEN + 8];
+   fs_handle h;
+
+   for (size_t len : lens) {
+
+      path[0] = '/';
+      memset(path + 1, 'a' + (char)(len % 26), len);
+      path[len + 1] = 0;
+
+      ASSERT_EQ(vfs_open(path, &h, O_CREAT | O_RDWR, 0644), 0);
+      vfs_close(h);
+      ASSERT_EQ(vfs_stat64(path, &st, true), 0);
+   }
+
+   for (size_t len : lens) {
+
+      path[0] = '/';
+      memset(path + 1, 'a' + (char)(len % 26), len);
+      path[len + 1] = 0;
+      ASSERT_EQ(vfs_unlink(path), 0);
+   }
+
+   memset(path + 1, 'z', RAMFS_ENTRY_MAX_LEN);
+   path[RAMFS_ENTRY_MAX_LEN + 1] = 0;
+   EXPECT_EQ(vfs_open(path, &h, O_CREAT | O_RDWR, 0644), -ENAMETOOLONG);
+}
+
+TEST_F(vfs_ramfs, extents)
+{
+   const size_t file_size = 200 * KB;
+   const size_t chunk = 1000;
+   vector<char> data(file_size), buf(file_size);
+   struct k_stat64 st;
+   fs_handle h;
+
+   for (size_t i = 0; i < file_size; i++)
+      data[i] = (char)(i % 251 + 1);
+
+   ASSERT_EQ(vfs_open("/f", &h, O_CREAT | O_RDWR, 0644), 0);
+
+   /* Grow the file sequentially, in small chunks */
+   for (size_t off = 0; off < file_size; off += chunk) {
+      const size_t n = MIN(chunk, file_size - off);
+      ASSERT_EQ(vfs_write(h, &data[off], n), (ssize_t)n);
+   }
+
+   /* Big extents can only over-allocate, up to a single extent */
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_GE((size_t)st.st_blocks * 512, file_size);
+   EXPECT_LE((size_t)st.st_blocks * 512,
+             file_size + RAMFS_MAX_EXTENT_PAGES * PAGE_SIZE);
+
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], file_size), 0);
+
+   /* Truncate in the middle of an extent, then extend the file again */
+   ASSERT_EQ(vfs_ftruncate(h, 10000), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ((size_t)st.st_blocks * 512, 3 * PAGE_SIZE);
+   ASSERT_EQ(vfs_ftruncate(h, 20000), 0);
+
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), 20000);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], 10000), 0);
+
+   for (size_t i = 10000; i < 20000; i++)
+      ASSERT_EQ(buf[i], 0) << "Offset: " << i;
+
+   /* Fill a hole, between two blocks */
+   ASSERT_EQ(vfs_pwrite(h, &data[0], chunk, 60000), (ssize_t)chunk);
+   ASSERT_EQ(vfs_pwrite(h, &data[0], 30000, 15000), 30000);
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), 61000);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], 10000), 0);
+   ASSERT_EQ(memcmp(&buf[15000], &data[0], 30000), 0);
+   ASSERT_EQ(memcmp(&buf[60000], &data[0], chunk), 0);
+
+   for (size_t i = 45000; i < 60000; i++)
+      ASSERT_EQ(buf[i], 0) << "Offset: " << i;
+
+   vfs_close(h);
+   ASSERT_EQ(vfs_unlink("/f"), 0);
+}
+
+TEST_F(vfs_ramfs, fallocate)
+{
+   const size_t file_size = 200 * KB;
+   const int punch = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+   vector<char> data(file_size), buf(file_size);
+   struct k_stat64 st;
+   size_t used;
+   fs_handle h;
+
+   for (size_t i = 0; i < file_size; i++)
+      data[i] = (char)(i % 251 + 1);
+
+   ASSERT_EQ(vfs_open("/f", &h, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_write(h, &data[0], file_size), (ssize_t)file_size);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   used = (size_t)st.st_blocks * 512;
+
+   EXPECT_EQ(vfs_fallocate(h, FALLOC_FL_PUNCH_HOLE, 0, 1), -EOPNOTSUPP);
+   EXPECT_EQ(vfs_fallocate(h, FALLOC_FL_ZERO_RANGE, 0, 1), -EOPNOTSUPP);
+   EXPECT_EQ(vfs_fallocate(h, 0, -1, 1), -EINVAL);
+   EXPECT_EQ(vfs_fallocate(h, 0, 0, 0), -EINVAL);
+
+   /* Punch a hole in the middle of the first extent: pages [2, 13) */
+   ASSERT_EQ(vfs_fallocate(h, punch, 5000, 50000), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ((size_t)st.st_size, file_size);
+   EXPECT_EQ((size_t)st.st_blocks * 512, used - 11 * PAGE_SIZE);
+   used = (size_t)st.st_blocks * 512;
+
+   /* Punch a hole across three extents: pages [15, 34) */
+   ASSERT_EQ(vfs_fallocate(h, punch, 60000, 80000), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ((size_t)st.st_blocks * 512, used - 19 * PAGE_SIZE);
+   used = (size_t)st.st_blocks * 512;
+
+   /* Punch a hole inside a single page: nothing gets freed */
+   ASSERT_EQ(vfs_fallocate(h, punch, 150000, 10), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ((size_t)st.st_blocks * 512, used);
+
+   memset(&data[5000], 0, 50000);
+   memset(&data[60000], 0, 80000);
+   memset(&data[150000], 0, 10);
+
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], file_size), 0);
+
+   /* Fill the holes again */
+   for (size_t i = 0; i < file_size; i++)
+      data[i] = (char)(i % 251 + 1);
+
+   ASSERT_EQ(vfs_pwrite(h, &data[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], file_size), 0);
+
+   vfs_close(h);
+   ASSERT_EQ(vfs_unlink("/f"), 0);
+
+   /* Preallocation, extending the file */
+   ASSERT_EQ(vfs_open("/g", &h, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_fallocate(h, 0, 0, 40000), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ(st.st_size, 40000);
+   EXPECT_EQ((size_t)st.st_blocks * 512, 10 * PAGE_SIZE);
+
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), 40000);
+
+   for (size_t i = 0; i < 40000; i++)
+      ASSERT_EQ(buf[i], 0) << "Offset: " << i;
+
+   /* Preallocation past EOF, keeping the size */
+   ASSERT_EQ(vfs_fallocate(h, FALLOC_FL_KEEP_SIZE, 40000, 40000), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ(st.st_size, 40000);
+   EXPECT_EQ((size_t)st.st_blocks * 512, 20 * PAGE_SIZE);
+
+   /* Writing in the preallocated range doesn't allocate anything */
+   ASSERT_EQ(vfs_pwrite(h, &data[0], 80000, 0), 80000);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   EXPECT_EQ(st.st_size, 80000);
+   EXPECT_EQ((size_t)st.st_blocks * 512, 20 * PAGE_SIZE);
+
+   ASSERT_EQ(vfs_pread(h, &buf[0], file_size, 0), 80000);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], 80000), 0);
+
+   vfs_close(h);
+   ASSERT_EQ(vfs_unlink("/g"), 0);
+}
+
+static struct ramfs_block *ramfs_first_block(fs_handle h)
+{
+   struct ramfs_inode *i = ((struct ramfs_handle *)h)->inode;
+   return (struct ramfs_block *)
+      bintree_get_first_obj(i->blocks_tree_root, struct ramfs_block, node);
+}
+
+TEST_F(vfs_ramfs, copy_file_range)
+{
+   const size_t file_size = 200 * KB;
+   vector<char> data(file_size), buf(file_size), tmp(100);
+   fs_handle a, b, c, d;
+   struct k_stat64 st;
+   offt in, out;
+
+   for (size_t i = 0; i < file_size; i++)
+      data[i] = (char)(i % 251 + 1);
+
+   for (size_t i = 0; i < tmp.size(); i++)
+      tmp[i] = 'x';
+
+   ASSERT_EQ(vfs_open("/a", &a, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_open("/b", &b, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_open("/c", &c, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_open("/d", &d, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_write(a, &data[0], file_size), (ssize_t)file_size);
+
+   in = out = 0;
+   EXPECT_EQ(vfs_copy_file_range(a, &in, a, &out, 10), -EINVAL);
+
+   /* Copy the whole file: all of its blocks get shared */
+   ASSERT_EQ(vfs_copy_file_range(b, &in, a, &out, 10), 0);
+   ASSERT_EQ(vfs_copy_file_range(a, &in, b, &out, file_size),
+             (ssize_t)file_size);
+   EXPECT_EQ(in, (offt)file_size);
+   EXPECT_EQ(out, (offt)file_size);
+
+   ASSERT_EQ(vfs_fstat64(b, &st), 0);
+   EXPECT_EQ((size_t)st.st_size, file_size);
+   EXPECT_EQ((size_t)st.st_blocks * 512, file_size);
+
+   ASSERT_TRUE(ramfs_first_block(b)->sh != NULL);
+   EXPECT_EQ(ramfs_first_block(b)->sh, ramfs_first_block(a)->sh);
+   EXPECT_EQ(ramfs_first_block(b)->vaddr, ramfs_first_block(a)->vaddr);
+
+   ASSERT_EQ(vfs_pread(b, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], file_size), 0);
+
+   /* Writing to any of the two files unshares the block written */
+   ASSERT_EQ(vfs_pwrite(b, &tmp[0], tmp.size(), 5000), (ssize_t)tmp.size());
+   EXPECT_TRUE(ramfs_first_block(b)->sh == NULL);
+   EXPECT_NE(ramfs_first_block(b)->vaddr, ramfs_first_block(a)->vaddr);
+
+   ASSERT_EQ(vfs_pwrite(a, &tmp[0], tmp.size(), 100000), (ssize_t)tmp.size());
+
+   ASSERT_EQ(vfs_pread(b, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], 5000), 0);
+   ASSERT_EQ(memcmp(&buf[5000], &tmp[0], tmp.size()), 0);
+   ASSERT_EQ(memcmp(&buf[5100], &data[5100], file_size - 5100), 0);
+
+   memcpy(&data[100000], &tmp[0], tmp.size());
+   ASSERT_EQ(vfs_pread(a, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[0], &data[0], file_size), 0);
+
+   /* Same offset in the page: the head is copied, the rest gets shared */
+   in = 1000;
+   out = 5096;
+   ASSERT_EQ(vfs_copy_file_range(a, &in, c, &out, 100000), 100000);
+   ASSERT_EQ(vfs_pread(c, &buf[0], file_size, 0), 105096);
+   ASSERT_EQ(memcmp(&buf[5096], &data[1000], 100000), 0);
+
+   for (size_t i = 0; i < 5096; i++)
+      ASSERT_EQ(buf[i], 0) << "Offset: " << i;
+
+   /* Different offsets in the page: everything is copied */
+   in = 1;
+   out = 0;
+   ASSERT_EQ(vfs_copy_file_range(a, &in, d, &out, 50000), 50000);
+   ASSERT_EQ(vfs_pread(d, &buf[0], file_size, 0), 50000);
+   ASSERT_EQ(memcmp(&buf[0], &data[1], 50000), 0);
+
+   /* The copies survive the source */
+   ASSERT_EQ(vfs_ftruncate(a, 0), 0);
+   vfs_close(a);
+   ASSERT_EQ(vfs_unlink("/a"), 0);
+
+   ASSERT_EQ(vfs_pread(c, &buf[0], file_size, 0), 105096);
+   ASSERT_EQ(memcmp(&buf[5096], &data[1000], 100000), 0);
+
+   ASSERT_EQ(vfs_pread(b, &buf[0], file_size, 0), (ssize_t)file_size);
+   ASSERT_EQ(memcmp(&buf[5100], &data[5100], 100000 - 5100), 0);
+
+   vfs_close(b);
+   vfs_close(c);
+   vfs_close(d);
+   ASSERT_EQ(vfs_unlink("/b"), 0);
+   ASSERT_EQ(vfs_unlink("/c"), 0);
+   ASSERT_EQ(vfs_unlink("/d"), 0);
+}
+
 void vfs_ramfs::test_pread_pwrite_seek(bool fseek)
 {
    const off_t data_size = 2 * MB;
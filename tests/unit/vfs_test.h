@@ -23,13 +23,17 @@ class vfs_test_base : public ::testing::Test {
 
 protected:
 
+   /* Used by the VFS functions bouncing data, like vfs_splice() */
+   char io_copybuf[IO_COPYBUF_SIZE];
+
    void SetUp() override {
 
       init_kmalloc_for_tests();
+      get_curr_task()->io_copybuf = io_copybuf;
    }
 
    void TearDown() override {
 
-      /* do nothing, for the moment */
+      get_curr_task()->io_copybuf = NULL;
    }
 };
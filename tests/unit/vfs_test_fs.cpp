@@ -157,6 +157,8 @@ extern const struct fs_ops static_fsops_testfs = {
    .fs_exunlock          = vfs_test_fs_exunlock,
    .fs_shlock            = vfs_test_fs_shlock,
    .fs_shunlock          = vfs_test_fs_shunlock,
+   .dir_exlock           = nullptr,
+   .dir_exunlock         = nullptr,
    .exlock_noblk         = nullptr,
    .exunlock             = nullptr,
 };
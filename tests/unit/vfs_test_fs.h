@@ -58,6 +58,8 @@ inline struct mnt_fs create_test_fs(const char *name, tfs_entry *root)
       .flags            = 0,
       .device_data      = root,
       .fsops            = &static_fsops_testfs,
+      .hosted_mps       = 0,
+      .mp               = nullptr,
    };
 
    return fs;
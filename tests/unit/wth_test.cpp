@@ -34,8 +34,8 @@ static void destroy_last_worker_thread(void)
    const u32 queue_size = t->rb.max_elems;
    assert(t != NULL);
 
-   safe_ringbuf_destory(&t->rb);
-   kfree_array_obj(t->jobs, struct wjob, queue_size);
+   mpmc_ringbuf_destroy(&t->rb);
+   kfree2(t->rb_buf, mpmc_ringbuf_buf_size(queue_size, sizeof(struct wjob)));
    kfree_obj(t, struct worker_thread);
    bzero((void *)t, sizeof(*t));
    worker_threads[wth] = NULL;
@@ -49,7 +49,8 @@ class worker_thread_test : public Test {
    }
 
    void TearDown() override {
-      destroy_last_worker_thread();
+      while (worker_threads_cnt > 0)
+         destroy_last_worker_thread();
    }
 };
 
@@ -193,3 +194,52 @@ TEST_F(worker_thread_test, chaos)
       }
    }
 }
+
+static vector<ulong> executed_jobs;
+
+static void record_job_func(void *arg)
+{
+   executed_jobs.push_back((ulong)arg);
+}
+
+TEST_F(worker_thread_test, grow_queue)
+{
+   struct worker_thread *wth = wth_find_worker(WTH_PRIO_HIGHEST);
+   const u32 max_jobs = wth_get_queue_size(wth);
+   ulong next_val = 0;
+   bool res;
+
+   executed_jobs.clear();
+
+   /* Move the read position, so that the pending jobs wrap around */
+   for (u32 i = 0; i < max_jobs / 2; i++) {
+      ASSERT_TRUE(wth_enqueue_on(wth, &record_job_func, TO_PTR(next_val++)));
+      ASSERT_NO_FATAL_FAILURE({ res = wth_process_single_job(wth); });
+      ASSERT_TRUE(res);
+   }
+
+   for (u32 i = 0; i < max_jobs; i++)
+      ASSERT_TRUE(wth_enqueue_on(wth, &record_job_func, TO_PTR(next_val++)));
+
+   ASSERT_FALSE(wth_enqueue_on(wth, &record_job_func, TO_PTR(next_val)));
+   ASSERT_TRUE(wth_grow_queue(wth));
+   ASSERT_EQ(wth_get_queue_size(wth), 2 * max_jobs);
+
+   for (u32 i = 0; i < max_jobs; i++)
+      ASSERT_TRUE(wth_enqueue_on(wth, &record_job_func, TO_PTR(next_val++)));
+
+   ASSERT_FALSE(wth_enqueue_on(wth, &record_job_func, TO_PTR(next_val)));
+
+   do {
+      ASSERT_NO_FATAL_FAILURE({ res = wth_process_single_job(wth); });
+   } while (res);
+
+   ASSERT_EQ(executed_jobs.size(), next_val);
+
+   for (ulong i = 0; i < next_val; i++)
+      ASSERT_EQ(executed_jobs[i], i);
+
+   EXPECT_EQ(wth_get_stats(wth)->grows, 1u);
+   EXPECT_EQ(wth_get_stats(wth)->dropped, 2u);
+   EXPECT_EQ(wth_get_stats(wth)->max_depth, 2 * max_jobs);
+}
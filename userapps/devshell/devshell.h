@@ -101,6 +101,16 @@ getdents64(unsigned fd, struct linux_dirent64 *dirp, unsigned count)
    return sysenter_call3(SYS_getdents64, fd, dirp, count);
 }
 
+#ifndef MFD_CLOEXEC
+   #define MFD_CLOEXEC                           0x0001U
+#endif
+
+static inline int sys_memfd_create(const char *name, unsigned flags)
+{
+   /* Call the syscall directly: memfd_create() requires _GNU_SOURCE */
+   return (int)syscall(SYS_memfd_create, name, flags);
+}
+
 static inline int tilck_get_num_gcov_files(void)
 {
    return sysenter_call1(TILCK_CMD_SYSCALL,
@@ -139,3 +149,9 @@ tilck_set_sched_alive_thread_enabled(bool enabled)
                          TILCK_CMD_SET_SAT_ENABLED,
                          enabled);
 }
+
+static inline int
+tilck_spawn(const char *path, char *const *argv, char *const *env)
+{
+   return sysenter_call4(TILCK_CMD_SYSCALL, TILCK_CMD_SPAWN, path, argv, env);
+}
@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -34,6 +35,33 @@ static int reboot_cmd;
 
 static int fork_and_run_shell_on_tty(int tty);
 
+/* -- services -- */
+
+#define MAX_SERVICES                   32
+#define MAX_SERVICE_DEPS                8
+#define MAX_SERVICE_ARGS               16
+
+enum svc_state {
+   SVC_WAITING,            /* waiting for its dependencies */
+   SVC_RUNNING,
+   SVC_DONE,
+   SVC_FAILED,             /* failed or skipped because of a failed dep */
+};
+
+struct service {
+
+   const char *name;
+   bool daemon;            /* daemon: the deps on it are met once started */
+   enum svc_state state;
+   pid_t pid;
+   int ndeps;
+   int deps[MAX_SERVICE_DEPS];            /* indexes in services[] */
+   char *argv[MAX_SERVICE_ARGS];
+};
+
+static struct service services[MAX_SERVICES];
+static int services_count;
+
 /* -- command line options -- */
 
 static bool opt_quiet;
@@ -213,6 +241,230 @@ static void run_start_script(void)
    }
 }
 
+static unsigned long get_monotonic_ms(void)
+{
+   struct timespec ts;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+      return 0;
+
+   return (unsigned long)ts.tv_sec * 1000 + (unsigned long)ts.tv_nsec / 1000000;
+}
+
+static int find_service(const char *name)
+{
+   for (int i = 0; i < services_count; i++) {
+
+      if (!strcmp(services[i].name, name))
+         return i;
+   }
+
+   return -1;
+}
+
+/*
+ * Parses a line of INIT_SERVICES_FILE, in the format:
+ *
+ *    <name> <once|daemon> <dep1,dep2,...|-> <program> [args...]
+ *
+ * A dependency must be declared before the service using it: that makes the
+ * dependency graph acyclic by construction.
+ */
+static void parse_service_line(char *line, int line_num)
+{
+   struct service *s = &services[services_count];
+   char *name, *type, *deps, *dep, *arg;
+   int nargs = 0;
+
+   name = strtok(line, " \t\n");
+
+   if (!name || *name == '#')
+      return; /* empty line or comment */
+
+   type = strtok(NULL, " \t\n");
+   deps = strtok(NULL, " \t\n");
+
+   while (nargs < MAX_SERVICE_ARGS - 1 && (arg = strtok(NULL, " \t\n")))
+      s->argv[nargs++] = strdup(arg);
+
+   if (!nargs || (strcmp(type, "once") && strcmp(type, "daemon"))) {
+      printf("[init] %s:%d: invalid service line\n",
+             INIT_SERVICES_FILE, line_num);
+      goto err;
+   }
+
+   if (services_count == MAX_SERVICES) {
+      printf("[init] Too many services, ignoring '%s'\n", name);
+      goto err;
+   }
+
+   if (find_service(name) >= 0) {
+      printf("[init] Duplicate service '%s'\n", name);
+      goto err;
+   }
+
+   if (strcmp(deps, "-")) {
+      for (dep = strtok(deps, ","); dep; dep = strtok(NULL, ",")) {
+
+         const int idx = find_service(dep);
+
+         if (idx < 0 || s->ndeps == MAX_SERVICE_DEPS) {
+            printf("[init] Service '%s': invalid dependency '%s'\n",
+                   name, dep);
+            goto err;
+         }
+
+         s->deps[s->ndeps++] = idx;
+      }
+   }
+
+   s->name = strdup(name);
+   s->daemon = !strcmp(type, "daemon");
+   s->state = SVC_WAITING;
+   services_count++;
+   return;
+
+err:
+   for (int i = 0; i < nargs; i++)
+      free(s->argv[i]);
+
+   memset(s, 0, sizeof(*s));
+}
+
+static void read_services_file(void)
+{
+   char line[256];
+   int line_num = 0;
+   FILE *fh = fopen(INIT_SERVICES_FILE, "r");
+
+   if (!fh)
+      return; /* No services file: that's fine */
+
+   while (fgets(line, sizeof(line), fh))
+      parse_service_line(line, ++line_num);
+
+   fclose(fh);
+}
+
+/* Returns 1 if the deps of `s` are met, 0 if not yet, -1 if they never will */
+static int service_deps_met(struct service *s)
+{
+   int ret = 1;
+
+   for (int i = 0; i < s->ndeps; i++) {
+
+      struct service *d = &services[s->deps[i]];
+
+      if (d->state == SVC_FAILED)
+         return -1;
+
+      if (d->state == SVC_WAITING || (d->state == SVC_RUNNING && !d->daemon))
+         ret = 0;
+   }
+
+   return ret;
+}
+
+static void start_service(struct service *s)
+{
+   /*
+    * Use vfork(): init is blocked only for the time of the execve() and its
+    * address space (with all the services) doesn't get copied. The child
+    * cannot do anything else than calling execve() or _exit(): the signal
+    * handlers are reset to the default by execve() itself.
+    */
+   pid_t pid = vfork();
+
+   if (pid < 0) {
+      printf("[init] vfork() failed: %s\n", strerror(errno));
+      s->state = SVC_FAILED;
+      return;
+   }
+
+   if (!pid) {
+      execve(s->argv[0], s->argv, NULL);
+      _exit(127);
+   }
+
+   s->pid = pid;
+   s->state = SVC_RUNNING;
+   printf("[init] [%8lu ms] service %s: started, pid %d\n",
+          get_monotonic_ms(), s->name, pid);
+}
+
+/*
+ * Starts all the services whose deps are met. Starting a daemon might make
+ * other services ready and failing one might make others fail: iterate until
+ * nothing changes.
+ */
+static void start_ready_services(void)
+{
+   bool changed;
+
+   if (in_shutdown)
+      return;
+
+   do {
+
+      changed = false;
+
+      for (int i = 0; i < services_count; i++) {
+
+         struct service *s = &services[i];
+         int met;
+
+         if (s->state != SVC_WAITING)
+            continue;
+
+         if (!(met = service_deps_met(s)))
+            continue;
+
+         if (met < 0) {
+            printf("[init] service %s: skipped, a dependency failed\n",
+                   s->name);
+            s->state = SVC_FAILED;
+         } else {
+            start_service(s);
+         }
+
+         changed = true;
+      }
+
+   } while (changed);
+}
+
+static bool handle_service_exit(pid_t pid, int wstatus)
+{
+   struct service *s = NULL;
+
+   for (int i = 0; i < services_count; i++) {
+      if (services[i].state == SVC_RUNNING && services[i].pid == pid) {
+         s = &services[i];
+         break;
+      }
+   }
+
+   if (!s)
+      return false;
+
+   if (WIFSIGNALED(wstatus)) {
+      printf("[init] [%8lu ms] service %s: killed by signal %d\n",
+             get_monotonic_ms(), s->name, WTERMSIG(wstatus));
+   } else {
+      printf("[init] [%8lu ms] service %s: exited with status %d\n",
+             get_monotonic_ms(), s->name, WEXITSTATUS(wstatus));
+   }
+
+   /* A daemon's dependents are already running: don't make them fail */
+   if (!s->daemon && (WIFSIGNALED(wstatus) || WEXITSTATUS(wstatus)))
+      s->state = SVC_FAILED;
+   else
+      s->state = SVC_DONE;
+
+   start_ready_services();
+   return true;
+}
+
 static void do_initial_setup(void)
 {
    if (!getenv("TILCK")) {
@@ -301,6 +553,8 @@ static void show_help_and_exit(void)
    printf("    init -h/--help      Show this help and exit\n");
    printf("    init -q             Quiet: don't report exit of orphan tasks\n");
    printf("    init -ns            Don't run the script: %s\n", START_SCRIPT);
+   printf("                        nor the services in: %s\n",
+          INIT_SERVICES_FILE);
    printf("    init -nr            Don't respawn shells\n");
    printf("    init -- <cmdline>   "
           "Run the specified cmdline instead of the default one.\n");
@@ -399,7 +653,7 @@ static void wait_for_children(int timeout_ms)
 
       if (shell_tty > 0)
          report_shell_exit(pid, shell_tty, wstatus);
-      else
+      else if (!handle_service_exit(pid, wstatus))
          report_process_exit(pid, wstatus);
    }
 }
@@ -558,8 +812,9 @@ int main(int argc, char **argv, char **env)
 
    if (!opt_nostart) {
       run_start_script();
+      read_services_file();
    } else {
-      printf("[init] Skipping the start script\n");
+      printf("[init] Skipping the start script and the services\n");
    }
 
    if (stat(shell_args[0], &statbuf) < 0) {
@@ -588,6 +843,13 @@ int main(int argc, char **argv, char **env)
       }
    }
 
+   /*
+    * Start the services after the shells, in order to not delay the first
+    * prompt: the ones with no pending deps start now, the others later from
+    * wait_for_children(), as soon as their deps are met.
+    */
+   start_ready_services();
+
    wait_for_children(0);
 
    if (opt_do_exit) {
@@ -23,13 +23,15 @@ static bool opt_file_passed;
 static u8 opt_test_short;
 static u8 opt_test_bits = 8;
 static u8 opt_test_channels = 1;
+static u8 opt_period_kb;
 
 static void
 show_help(void)
 {
    printf("syntax:\n");
-   printf("    play [-d device] --test [-b 8|16] [-ch 1|2] [-s]\n");
-   printf("    play [-d device] <WAVE FILE>\n");
+   printf("    play [-d device] [-p period_kb] --test "
+          "[-b 8|16] [-ch 1|2] [-s]\n");
+   printf("    play [-d device] [-p period_kb] <WAVE FILE>\n");
 }
 
 static void
@@ -54,6 +56,14 @@ parse_args(int argc, char **argv)
          argc--; argv++;
          strncpy(opt_device, argv[0], sizeof(opt_device)-1);
 
+      } else if (!strcmp(arg, "-p")) {
+
+         if (argc < 2)
+            show_help_and_exit();
+
+         argc--; argv++;
+         opt_period_kb = (u8)atoi(argv[0]);
+
       } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
 
          show_help_and_exit();
@@ -242,6 +252,7 @@ test_sound(int devfd)
       .bits = opt_test_bits,
       .channels = opt_test_channels,
       .sign = 1,
+      .period_kb = opt_period_kb,
    };
 
    tot_sz = gen_test_sound(
@@ -280,6 +291,8 @@ test_sound(int devfd)
    return 0;
 }
 
+#define WAV_CHUNK_SIZE      (64 * KB)
+
 #define CHUNK_ID_RIFF       0x52494646
 #define FORMAT_WAV          0x57415645
 #define SUBCHUNK1_ID_FMT    0x666d7420
@@ -393,7 +406,7 @@ play_wav_file(int devfd)
    printf("%u bits/sample, %u channels at %u Hz\n",
           hdr.BitsPerSample, hdr.NumChannels, hdr.SampleRate);
 
-   buf = malloc(32 * KB);
+   buf = malloc(WAV_CHUNK_SIZE);
 
    if (!buf) {
       printf("Out of memory\n");
@@ -406,6 +419,7 @@ play_wav_file(int devfd)
       .bits = hdr.BitsPerSample,
       .channels = hdr.NumChannels,
       .sign = 1,
+      .period_kb = opt_period_kb,
    };
 
    rc = ioctl(devfd, TILCK_IOCTL_SOUND_SETUP, &params);
@@ -430,8 +444,8 @@ play_wav_file(int devfd)
          last_sec = sec;
       }
 
-      /* Read 32 KB */
-      while ((rc = read(fd, buf + data_read, 32 * KB - data_read)) > 0) {
+      /* Several periods per write(): the driver queues all of them */
+      while ((rc = read(fd, buf + data_read, WAV_CHUNK_SIZE - data_read)) > 0) {
          data_read += rc;
       }
 
@@ -454,7 +468,7 @@ play_wav_file(int devfd)
 
       tot_read += data_read;
 
-   } while (data_read == 32 * KB);
+   } while (data_read == WAV_CHUNK_SIZE);
 
    printf("\n");
    rc = 0;
@@ -514,6 +528,7 @@ int main(int argc, char **argv)
 {
    int rc, cmd_rc, devfd;
    struct tilck_sound_card_info nfo;
+   struct tilck_sound_stats stats;
 
    parse_args(argc-1, argv+1);
 
@@ -559,6 +574,12 @@ int main(int argc, char **argv)
       return 1;
    }
 
+   if (ioctl(devfd, TILCK_IOCTL_SOUND_GET_STATS, &stats) == 0) {
+      printf("Periods: %u x %u bytes, max queued: %u, underruns: %u\n",
+             stats.periods, stats.period_size,
+             stats.high_water, stats.underruns);
+   }
+
    rc = ioctl(devfd, TILCK_IOCTL_SOUND_RELEASE, NULL);
 
    if (rc < 0) {
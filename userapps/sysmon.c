@@ -0,0 +1,605 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * sysmon: a low-overhead system monitor, reading Tilck's /syst files.
+ *
+ * All the files are opened once: every refresh re-reads each of them with
+ * pread() at offset 0 (see tilck_sysfs.h), with no open/close per sample.
+ * The numeric counters come from the binary .snapshot files, while the
+ * per-task, per-IRQ and per-syscall tables are parsed from text. The screen
+ * is rendered incrementally: only the lines that changed since the previous
+ * frame are re-drawn, all in a single write(). In log mode (-l) instead, a
+ * single compact line is printed per sample: good for the serial console.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <tilck/common/basic_defs.h> /* for MIN(), MAX() and ARRAY_SIZE() */
+#include <tilck/common/tilck_sysfs.h>
+
+#define SYST                  "/syst"
+#define TEXT_BUF_SZ           (64 * 1024)
+#define MAX_TASKS             256
+#define MAX_IRQS              256
+#define MAX_SYSCALLS          512
+#define MAX_NAME              24
+#define MAX_LINES             48
+#define LINE_SZ               128
+#define TOP_IRQS              6
+#define TOP_SYSCALLS          8
+
+/* The numeric properties, in the order they appear in /syst/mm and /cpu */
+enum { MM_HEAPS_KB, MM_USED_KB, MM_LOW_MEM, MM_VALUES };
+enum { CPU_CTX_SWITCHES, CPU_RQ_LEN, CPU_VALUES };
+
+struct task_sample {
+
+   int tid;
+   int pid;
+   char state;
+   uint64_t user_us;
+   uint64_t sys_us;
+   char name[MAX_NAME];
+};
+
+struct named_counter {
+
+   char name[MAX_NAME];
+   uint64_t count;
+};
+
+struct sample {
+
+   uint64_t time_us;
+   uint64_t mm[MM_VALUES];
+   uint64_t cpu[CPU_VALUES];
+
+   struct task_sample tasks[MAX_TASKS];
+   int tasks_count;
+
+   struct named_counter irqs[MAX_IRQS];
+   int irqs_count;
+
+   struct named_counter syscalls[MAX_SYSCALLS];
+   int syscalls_count;
+};
+
+struct rate {
+
+   const char *name;
+   uint64_t delta;
+};
+
+struct task_rate {
+
+   int idx;                      /* in sample.tasks */
+   uint64_t delta_us;
+};
+
+static struct sample samples[2];
+static char text_buf[TEXT_BUF_SZ];
+static int rss_kb_by_pid[MAX_TASKS];
+
+static char screen[2][MAX_LINES][LINE_SZ];
+static int screen_lines[2];
+static char out_buf[MAX_LINES * (LINE_SZ + 16) + 64];
+
+static int fd_mm_snap = -1, fd_cpu_snap = -1;
+static int fd_tasks = -1, fd_procs = -1, fd_irqs = -1, fd_syscalls = -1;
+
+static uint64_t get_time_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* Reads the whole file with pread(), starting from offset 0 */
+static int read_text(int fd)
+{
+   int rc, tot = 0;
+
+   if (fd < 0)
+      return -1;
+
+   while (tot < TEXT_BUF_SZ - 1) {
+
+      rc = pread(fd, text_buf + tot, TEXT_BUF_SZ - 1 - tot, tot);
+
+      if (rc <= 0)
+         break;
+
+      tot += rc;
+   }
+
+   text_buf[tot] = 0;
+   return tot;
+}
+
+static void read_snapshot(int fd, uint64_t *values, int count)
+{
+   char buf[sizeof(struct tilck_sysfs_snap) + 16 * sizeof(uint64_t)];
+   struct tilck_sysfs_snap *s = (void *)buf;
+   int rc;
+
+   if (fd < 0)
+      return;
+
+   rc = pread(fd, buf, sizeof(buf), 0);
+
+   if (rc < (int)sizeof(*s) || s->magic != TILCK_SYSFS_SNAPSHOT_MAGIC)
+      return;
+
+   memcpy(values, s->values, MIN((int)s->count, count) * sizeof(uint64_t));
+}
+
+static void read_tasks(struct sample *s)
+{
+   struct task_sample *t;
+   char *line, *saveptr = NULL;
+   int n;
+
+   s->tasks_count = 0;
+
+   if (read_text(fd_tasks) <= 0)
+      return;
+
+   line = strtok_r(text_buf, "\n", &saveptr);
+
+   for (; line; line = strtok_r(NULL, "\n", &saveptr)) {
+
+      if (s->tasks_count == MAX_TASKS)
+         break;
+
+      t = &s->tasks[s->tasks_count];
+      t->name[0] = 0;
+
+      if (sscanf(line, "%d %d %c %" SCNu64 " %" SCNu64 " %n",
+                 &t->tid, &t->pid, &t->state,
+                 &t->user_us, &t->sys_us, &n) < 5)
+      {
+         continue;
+      }
+
+      snprintf(t->name, sizeof(t->name), "%s", line + n);
+      s->tasks_count++;
+   }
+}
+
+static void read_rss(void)
+{
+   char *line, *saveptr = NULL;
+   unsigned long vsz_kb, rss_kb;
+   int pid;
+
+   memset(rss_kb_by_pid, 0, sizeof(rss_kb_by_pid));
+
+   if (read_text(fd_procs) <= 0)
+      return;
+
+   line = strtok_r(text_buf, "\n", &saveptr);
+
+   for (; line; line = strtok_r(NULL, "\n", &saveptr)) {
+
+      if (sscanf(line, "%d %lu %lu", &pid, &vsz_kb, &rss_kb) != 3)
+         continue;
+
+      if (pid >= 0 && pid < MAX_TASKS)
+         rss_kb_by_pid[pid] = (int)rss_kb;
+   }
+}
+
+/*
+ * Both the IRQ and the syscall tables begin with a name (or number) followed
+ * by the counter we're interested in.
+ */
+static int
+read_counters(int fd, struct named_counter *arr, int max)
+{
+   char *line, *saveptr = NULL;
+   struct named_counter *c;
+   int n = 0;
+
+   if (read_text(fd) <= 0)
+      return 0;
+
+   line = strtok_r(text_buf, "\n", &saveptr);
+
+   for (; line && n < max; line = strtok_r(NULL, "\n", &saveptr)) {
+
+      c = &arr[n];
+
+      if (sscanf(line, "%23s %" SCNu64, c->name, &c->count) == 2)
+         n++;
+   }
+
+   return n;
+}
+
+static void take_sample(struct sample *s)
+{
+   s->time_us = get_time_us();
+   read_snapshot(fd_mm_snap, s->mm, MM_VALUES);
+   read_snapshot(fd_cpu_snap, s->cpu, CPU_VALUES);
+   read_tasks(s);
+   s->irqs_count = read_counters(fd_irqs, s->irqs, MAX_IRQS);
+   s->syscalls_count = read_counters(fd_syscalls, s->syscalls, MAX_SYSCALLS);
+}
+
+static struct task_sample *
+find_task(struct sample *s, int tid)
+{
+   for (int i = 0; i < s->tasks_count; i++)
+      if (s->tasks[i].tid == tid)
+         return &s->tasks[i];
+
+   return NULL;
+}
+
+static uint64_t
+find_counter(struct named_counter *arr, int n, const char *name)
+{
+   for (int i = 0; i < n; i++)
+      if (!strcmp(arr[i].name, name))
+         return arr[i].count;
+
+   return 0;
+}
+
+static uint64_t
+task_delta_us(struct sample *prev, struct task_sample *t)
+{
+   struct task_sample *p = find_task(prev, t->tid);
+   uint64_t now = t->user_us + t->sys_us;
+   uint64_t before = p ? p->user_us + p->sys_us : 0;
+
+   return now >= before ? now - before : 0;
+}
+
+static int cmp_rate_desc(const void *a, const void *b)
+{
+   const struct rate *ra = a, *rb = b;
+   return ra->delta < rb->delta ? 1 : (ra->delta > rb->delta ? -1 : 0);
+}
+
+/* Fills `rates` with the counters sorted by their increment, returns count */
+static int
+get_rates(struct named_counter *prev, int prev_n,
+          struct named_counter *curr, int curr_n,
+          struct rate *rates)
+{
+   uint64_t before;
+   int n = 0;
+
+   for (int i = 0; i < curr_n; i++) {
+
+      before = find_counter(prev, prev_n, curr[i].name);
+
+      if (curr[i].count > before)
+         rates[n++] = (struct rate) { curr[i].name, curr[i].count - before };
+   }
+
+   qsort(rates, n, sizeof(rates[0]), &cmp_rate_desc);
+   return n;
+}
+
+static inline uint64_t
+per_sec(uint64_t delta, uint64_t elapsed_us)
+{
+   return elapsed_us ? delta * 1000000 / elapsed_us : 0;
+}
+
+/* Tenths of percent of the elapsed time */
+static inline unsigned
+permille(uint64_t delta_us, uint64_t elapsed_us)
+{
+   return elapsed_us ? (unsigned)(delta_us * 1000 / elapsed_us) : 0;
+}
+
+static uint64_t
+get_busy_us(struct sample *prev, struct sample *curr, int *top_idx)
+{
+   uint64_t d, busy = 0, top = 0;
+
+   *top_idx = -1;
+
+   for (int i = 0; i < curr->tasks_count; i++) {
+
+      struct task_sample *t = &curr->tasks[i];
+
+      if (!strcmp(t->name, "idle"))
+         continue;
+
+      d = task_delta_us(prev, t);
+      busy += d;
+
+      if (d > top) {
+         top = d;
+         *top_idx = i;
+      }
+   }
+
+   return busy;
+}
+
+static uint64_t sum_rates(struct rate *rates, int n)
+{
+   uint64_t tot = 0;
+
+   for (int i = 0; i < n; i++)
+      tot += rates[i].delta;
+
+   return tot;
+}
+
+static struct rate irq_rates[MAX_IRQS];
+static struct rate sys_rates[MAX_SYSCALLS];
+
+static void
+log_sample(struct sample *prev, struct sample *curr)
+{
+   const uint64_t el = curr->time_us - prev->time_us;
+   int top, n_irqs, n_sys;
+   uint64_t busy;
+
+   busy = get_busy_us(prev, curr, &top);
+
+   n_irqs = get_rates(prev->irqs, prev->irqs_count,
+                      curr->irqs, curr->irqs_count, irq_rates);
+
+   n_sys = get_rates(prev->syscalls, prev->syscalls_count,
+                     curr->syscalls, curr->syscalls_count, sys_rates);
+
+   printf("t=%" PRIu64 " cpu=%u.%u%% cs/s=%" PRIu64 " rq=%" PRIu64
+          " kmalloc=%" PRIu64 "/%" PRIu64 "K lowmem=%" PRIu64
+          " irq/s=%" PRIu64 " sys/s=%" PRIu64 " top=%s:%u.%u%%\n",
+          curr->time_us / 1000000,
+          permille(busy, el) / 10, permille(busy, el) % 10,
+          per_sec(curr->cpu[CPU_CTX_SWITCHES] - prev->cpu[CPU_CTX_SWITCHES],
+                  el),
+          curr->cpu[CPU_RQ_LEN],
+          curr->mm[MM_USED_KB],
+          curr->mm[MM_HEAPS_KB],
+          curr->mm[MM_LOW_MEM],
+          per_sec(sum_rates(irq_rates, n_irqs), el),
+          per_sec(sum_rates(sys_rates, n_sys), el),
+          top >= 0 ? curr->tasks[top].name : "-",
+          top >= 0 ? permille(task_delta_us(prev, &curr->tasks[top]), el) / 10
+                   : 0,
+          top >= 0 ? permille(task_delta_us(prev, &curr->tasks[top]), el) % 10
+                   : 0);
+
+   fflush(stdout);
+}
+
+/* ---------------------------- Screen mode ---------------------------- */
+
+static char (*lines)[LINE_SZ];
+static int lines_count;
+
+static void add_line(const char *fmt, ...)
+{
+   va_list args;
+
+   if (lines_count >= MAX_LINES)
+      return;
+
+   va_start(args, fmt);
+   vsnprintf(lines[lines_count++], LINE_SZ, fmt, args);
+   va_end(args);
+}
+
+static int cmp_task_rate_desc(const void *a, const void *b)
+{
+   const struct task_rate *ta = a, *tb = b;
+
+   if (ta->delta_us != tb->delta_us)
+      return ta->delta_us < tb->delta_us ? 1 : -1;
+
+   return ta->idx - tb->idx;     /* keep the kernel's order for the ties */
+}
+
+static void
+render_sample(struct sample *prev, struct sample *curr, int max_tasks)
+{
+   static struct task_rate task_rates[MAX_TASKS];
+   const uint64_t el = curr->time_us - prev->time_us;
+   unsigned busy_pm;
+   int top, n_irqs, n_sys, n;
+
+   busy_pm = permille(get_busy_us(prev, curr, &top), el);
+
+   add_line("sysmon - cpu %u.%u%%  ctx sw/s %" PRIu64 "  runqueue %" PRIu64,
+            busy_pm / 10, busy_pm % 10,
+            per_sec(curr->cpu[CPU_CTX_SWITCHES] - prev->cpu[CPU_CTX_SWITCHES],
+                    el),
+            curr->cpu[CPU_RQ_LEN]);
+
+   add_line("kmalloc: %" PRIu64 " KB used of %" PRIu64 " KB, "
+            "low memory events: %" PRIu64,
+            curr->mm[MM_USED_KB],
+            curr->mm[MM_HEAPS_KB],
+            curr->mm[MM_LOW_MEM]);
+
+   add_line("");
+   add_line("%-5s %-5s %s %6s %8s %10s  %s",
+            "TID", "PID", "S", "CPU%", "RSS_KB", "TIME_MS", "NAME");
+
+   /* Sort the tasks by CPU usage */
+   for (int i = 0; i < curr->tasks_count; i++) {
+      task_rates[i] = (struct task_rate) {
+         .idx = i,
+         .delta_us = task_delta_us(prev, &curr->tasks[i]),
+      };
+   }
+
+   n = curr->tasks_count;
+   qsort(task_rates, n, sizeof(task_rates[0]), &cmp_task_rate_desc);
+
+   for (int i = 0; i < MIN(n, max_tasks); i++) {
+
+      struct task_sample *t = &curr->tasks[task_rates[i].idx];
+      unsigned pm = permille(task_rates[i].delta_us, el);
+      int rss = t->pid < MAX_TASKS && t->tid == t->pid
+         ? rss_kb_by_pid[t->pid]
+         : 0;
+
+      add_line("%-5d %-5d %c %4u.%u %8d %10" PRIu64 "  %s",
+               t->tid, t->pid, t->state, pm / 10, pm % 10, rss,
+               (t->user_us + t->sys_us) / 1000, t->name);
+   }
+
+   n_irqs = get_rates(prev->irqs, prev->irqs_count,
+                      curr->irqs, curr->irqs_count, irq_rates);
+
+   add_line("");
+   add_line("IRQs/s: %" PRIu64, per_sec(sum_rates(irq_rates, n_irqs), el));
+
+   for (int i = 0; i < MIN(n_irqs, TOP_IRQS); i++)
+      add_line("   irq %-4s %10" PRIu64,
+               irq_rates[i].name, per_sec(irq_rates[i].delta, el));
+
+   if (fd_syscalls < 0)
+      return;
+
+   n_sys = get_rates(prev->syscalls, prev->syscalls_count,
+                     curr->syscalls, curr->syscalls_count, sys_rates);
+
+   add_line("");
+   add_line("Syscalls/s: %" PRIu64, per_sec(sum_rates(sys_rates, n_sys), el));
+
+   for (int i = 0; i < MIN(n_sys, TOP_SYSCALLS); i++)
+      add_line("   %-20s %10" PRIu64,
+               sys_rates[i].name, per_sec(sys_rates[i].delta, el));
+}
+
+/*
+ * Emits only the lines different from the previous frame, moving the cursor
+ * there and clearing the rest of the line, then clears the lines left over
+ * from a longer previous frame. Everything goes out with a single write().
+ */
+static void flush_frame(int frame, bool first)
+{
+   char (*old)[LINE_SZ] = screen[!frame];
+   const int old_count = screen_lines[!frame];
+   char *p = out_buf;
+   char *end = out_buf + sizeof(out_buf);
+
+   if (first)
+      p += snprintf(p, end - p, "\033[2J");
+
+   for (int i = 0; i < lines_count && p < end; i++) {
+
+      if (!first && i < old_count && !strcmp(old[i], lines[i]))
+         continue;
+
+      p += snprintf(p, end - p, "\033[%d;1H%s\033[K", i + 1, lines[i]);
+   }
+
+   if (lines_count < old_count && p < end)
+      p += snprintf(p, end - p, "\033[%d;1H\033[J", lines_count + 1);
+
+   if (p < end)
+      p += snprintf(p, end - p, "\033[%d;1H", lines_count + 1);
+
+   write(1, out_buf, MIN(p, end) - out_buf);
+   screen_lines[frame] = lines_count;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void open_files(void)
+{
+   fd_mm_snap = open(SYST "/mm/" TILCK_SYSFS_SNAPSHOT_NAME, O_RDONLY);
+   fd_cpu_snap = open(SYST "/cpu/" TILCK_SYSFS_SNAPSHOT_NAME, O_RDONLY);
+   fd_tasks = open(SYST "/cpu/tasks", O_RDONLY);
+   fd_procs = open(SYST "/mm/processes", O_RDONLY);
+   fd_irqs = open(SYST "/cpu/irqs", O_RDONLY);
+
+   /* Available only when the tracing module is compiled-in */
+   fd_syscalls = open(SYST "/tracing/syscalls", O_RDONLY);
+}
+
+static void show_help(const char *argv0)
+{
+   fprintf(stderr,
+           "Usage: %s [-l] [-d <ms>] [-n <count>] [-t <tasks>]\n\n"
+           "    -l          log mode: one compact line per sample\n"
+           "    -d <ms>     interval between samples (default: 1000)\n"
+           "    -n <count>  exit after <count> samples\n"
+           "    -t <tasks>  max number of tasks shown (default: 20)\n",
+           argv0);
+}
+
+int main(int argc, char **argv)
+{
+   int delay_ms = 1000, count = -1, max_tasks = 20;
+   bool log_mode = false;
+   int opt, cur = 0;
+
+   while ((opt = getopt(argc, argv, "ld:n:t:h")) != -1) {
+
+      switch (opt) {
+
+         case 'l':
+            log_mode = true;
+            break;
+
+         case 'd':
+            delay_ms = MAX(atoi(optarg), 10);
+            break;
+
+         case 'n':
+            count = atoi(optarg);
+            break;
+
+         case 't':
+            max_tasks = MAX(atoi(optarg), 0);
+            break;
+
+         default:
+            show_help(argv[0]);
+            return 1;
+      }
+   }
+
+   open_files();
+
+   if (fd_tasks < 0 && fd_mm_snap < 0) {
+      fprintf(stderr, "ERROR: %s not available\n", SYST);
+      return 1;
+   }
+
+   take_sample(&samples[cur]);
+
+   for (int i = 0; count < 0 || i < count; i++) {
+
+      usleep(delay_ms * 1000);
+
+      cur = !cur;
+      take_sample(&samples[cur]);
+
+      if (log_mode) {
+         log_sample(&samples[!cur], &samples[cur]);
+         continue;
+      }
+
+      read_rss();
+
+      lines = screen[i % 2];
+      lines_count = 0;
+      render_sample(&samples[!cur], &samples[cur], max_tasks);
+      flush_frame(i % 2, i == 0);
+   }
+
+   return 0;
+}